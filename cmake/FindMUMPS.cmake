@@ -40,6 +40,10 @@ LIST(APPEND REQUIRED_REAL_LIBRARIES "MUMPSD_SEQ_LIBRARY")
 FIND_LIBRARY(MUMPSZ_SEQ_LIBRARY zmumps_seq  ${MUMPS_LIB_SEARCH_PATH})
 LIST(APPEND REQUIRED_CPLX_LIBRARIES "MUMPSZ_SEQ_LIBRARY")
 
+# The single precision versions (mixed precision solving) are optional.
+FIND_LIBRARY(MUMPSS_SEQ_LIBRARY smumps_seq  ${MUMPS_LIB_SEARCH_PATH})
+FIND_LIBRARY(MUMPSC_SEQ_LIBRARY cmumps_seq  ${MUMPS_LIB_SEARCH_PATH})
+
 LIST(APPEND REQUIRED_REAL_LIBRARIES "MUMPS_MPISEQ_LIBRARY")
 LIST(APPEND REQUIRED_CPLX_LIBRARIES "MUMPS_MPISEQ_LIBRARY")  
 
@@ -63,5 +67,14 @@ FIND_PACKAGE_HANDLE_STANDARD_ARGS(  MUMPS
     LIST(APPEND MUMPS_CPLX_LIBRARIES ${${_LIB}})
   ENDFOREACH(_LIB ${REQUIRED_CPLX_LIBRARIES})
 
+# The mixed precision is compiled only if both single precision versions have been found.
+IF(MUMPSS_SEQ_LIBRARY AND MUMPSC_SEQ_LIBRARY)
+  SET(HAVE_MUMPS_SINGLE YES)
+  LIST(APPEND MUMPS_REAL_LIBRARIES ${MUMPSS_SEQ_LIBRARY})
+  LIST(APPEND MUMPS_CPLX_LIBRARIES ${MUMPSC_SEQ_LIBRARY})
+ELSE(MUMPSS_SEQ_LIBRARY AND MUMPSC_SEQ_LIBRARY)
+  MESSAGE(STATUS "MUMPS: smumps_seq / cmumps_seq not found, the mixed precision falls back to double precision.")
+ENDIF(MUMPSS_SEQ_LIBRARY AND MUMPSC_SEQ_LIBRARY)
+
 # Finally, set MUMPS_INCLUDE_DIR to point to the MUMPS include directory.
 SET(MUMPS_INCLUDE_DIR ${MUMPS_INCLUDE_DIR} ${MUMPS_INCLUDE_PATH})
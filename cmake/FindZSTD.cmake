@@ -0,0 +1,28 @@
+#
+# ZSTD
+#
+# Looks for the zstd compression library.
+#
+
+SET(ZSTD_INCLUDE_SEARCH_PATH
+	${ZSTD_ROOT}/include
+	/usr/include
+	/usr/local/include/
+)
+
+SET(ZSTD_LIB_SEARCH_PATH
+	${ZSTD_ROOT}/lib
+	/usr/lib64
+	/usr/lib
+	/usr/local/lib/
+)
+
+FIND_PATH(ZSTD_INCLUDE_DIR zstd.h ${ZSTD_INCLUDE_SEARCH_PATH})
+FIND_LIBRARY(ZSTD_LIBRARY zstd ${ZSTD_LIB_SEARCH_PATH})
+
+IF(ZSTD_INCLUDE_DIR AND ZSTD_LIBRARY)
+	SET(ZSTD_FOUND TRUE)
+ENDIF(ZSTD_INCLUDE_DIR AND ZSTD_LIBRARY)
+
+INCLUDE(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(ZSTD DEFAULT_MSG ZSTD_LIBRARY ZSTD_INCLUDE_DIR)
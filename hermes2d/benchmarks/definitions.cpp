@@ -0,0 +1,310 @@
+#include "definitions.h"
+#include <cstdio>
+#include <cstdlib>
+
+static void print_usage(const char* program)
+{
+  std::cout << "Usage: " << program << " [options]" << std::endl
+    << "  --benchmark NAME      poisson, adapt or all (default all)" << std::endl
+    << "  --refinements N       uniform refinements of the L-shaped mesh (default 4)" << std::endl
+    << "  --order P             polynomial order of the space (default 2)" << std::endl
+    << "  --threads T           assembly and algebra threads (default as in Api2D)" << std::endl
+    << "  --solver NAME         umfpack, superlu, mumps, petsc, amesos, aztecoo or native (default umfpack)" << std::endl
+    << "  --adapt-steps K       steps of the adaptivity benchmark (default 3)" << std::endl
+    << "  --repetitions R       runs of every benchmark (default 1)" << std::endl
+    << "  --format FORMAT       csv or json (default csv)" << std::endl
+    << "  --output FILE         the report file (default the standard output)" << std::endl;
+}
+
+static bool get_solver_type(const std::string& name, MatrixSolverType& type)
+{
+  const char* names[] = { "umfpack", "petsc", "mumps", "superlu", "amesos", "aztecoo", "native" };
+  const MatrixSolverType types[] = { SOLVER_UMFPACK, SOLVER_PETSC, SOLVER_MUMPS, SOLVER_SUPERLU, SOLVER_AMESOS, SOLVER_AZTECOO, SOLVER_NATIVE_ITERATIVE };
+  for (unsigned int i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    if(name == names[i])
+    {
+      type = types[i];
+      return true;
+    }
+  return false;
+}
+
+BenchmarkParameters::BenchmarkParameters() : benchmark("all"), refinements(4), order(2),
+  threads(Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)), solver("umfpack"), adapt_steps(3),
+  repetitions(1), format("csv")
+{
+}
+
+bool BenchmarkParameters::parse(int argc, char* argv[])
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string option = argv[i];
+    if(option == "--help" || i + 1 == argc)
+    {
+      print_usage(argv[0]);
+      return false;
+    }
+    std::string value = argv[++i];
+    if(option == "--benchmark")
+      this->benchmark = value;
+    else if(option == "--refinements")
+      this->refinements = atoi(value.c_str());
+    else if(option == "--order")
+      this->order = atoi(value.c_str());
+    else if(option == "--threads")
+      this->threads = atoi(value.c_str());
+    else if(option == "--solver")
+      this->solver = value;
+    else if(option == "--adapt-steps")
+      this->adapt_steps = atoi(value.c_str());
+    else if(option == "--repetitions")
+      this->repetitions = atoi(value.c_str());
+    else if(option == "--format")
+      this->format = value;
+    else if(option == "--output")
+      this->output = value;
+    else
+    {
+      print_usage(argv[0]);
+      return false;
+    }
+  }
+
+  MatrixSolverType solver_type;
+  if(this->benchmark != "all" && this->benchmark != "poisson" && this->benchmark != "adapt")
+    std::cout << "Unknown benchmark " << this->benchmark << "." << std::endl;
+  else if(!get_solver_type(this->solver, solver_type))
+    std::cout << "Unknown solver " << this->solver << "." << std::endl;
+  else if(this->format != "csv" && this->format != "json")
+    std::cout << "Unknown format " << this->format << "." << std::endl;
+  else if(this->refinements < 0 || this->order < 1 || this->threads < 1 || this->adapt_steps < 1 || this->repetitions < 1)
+    std::cout << "The numbers have to be positive (the refinements non-negative)." << std::endl;
+  else
+    return true;
+
+  print_usage(argv[0]);
+  return false;
+}
+
+bool BenchmarkParameters::apply() const
+{
+  MatrixSolverType solver_type;
+  if(!get_solver_type(this->solver, solver_type))
+    return false;
+  HermesCommonApi.set_integral_param_value(Hermes::matrixSolverType, solver_type);
+  HermesCommonApi.set_integral_param_value(Hermes::numThreadsAlgebra, this->threads);
+  Hermes2DApi.set_integral_param_value(Hermes::Hermes2D::numThreads, this->threads);
+  return true;
+}
+
+BenchmarkReport::BenchmarkReport(const BenchmarkParameters& parameters) : parameters(parameters)
+{
+}
+
+void BenchmarkReport::add(const std::string& benchmark, int repetition, int step, int ndof, const std::string& phase, double seconds)
+{
+  Record record;
+  record.benchmark = benchmark;
+  record.repetition = repetition;
+  record.step = step;
+  record.ndof = ndof;
+  record.phase = phase;
+  record.seconds = seconds;
+  this->records.push_back(record);
+}
+
+void BenchmarkReport::write(std::ostream& out) const
+{
+  const BenchmarkParameters& p = this->parameters;
+  char seconds[32];
+  if(p.format == "csv")
+    out << "benchmark,refinements,order,threads,solver,repetition,step,ndof,phase,seconds" << std::endl;
+  else
+    out << "[" << std::endl;
+
+  for (unsigned int i = 0; i < this->records.size(); i++)
+  {
+    const Record& r = this->records[i];
+    sprintf(seconds, "%.6f", r.seconds);
+    if(p.format == "csv")
+      out << r.benchmark << "," << p.refinements << "," << p.order << "," << p.threads << "," << p.solver << ","
+      << r.repetition << "," << r.step << "," << r.ndof << "," << r.phase << "," << seconds << std::endl;
+    else
+      out << "  {\"benchmark\": \"" << r.benchmark << "\", \"refinements\": " << p.refinements << ", \"order\": " << p.order
+      << ", \"threads\": " << p.threads << ", \"solver\": \"" << p.solver << "\", \"repetition\": " << r.repetition
+      << ", \"step\": " << r.step << ", \"ndof\": " << r.ndof << ", \"phase\": \"" << r.phase << "\", \"seconds\": " << seconds
+      << (i + 1 < this->records.size() ? "}," : "}") << std::endl;
+  }
+
+  if(p.format == "json")
+    out << "]" << std::endl;
+}
+
+void create_lshape_mesh(Mesh* mesh)
+{
+  double2 vertices[8] = { { -1.0, -1.0 }, { 0.0, -1.0 }, { 1.0, -1.0 }, { -1.0, 0.0 }, { 0.0, 0.0 }, { 1.0, 0.0 }, { -1.0, 1.0 }, { 0.0, 1.0 } };
+  int4 quads[3] = { { 0, 1, 4, 3 }, { 1, 2, 5, 4 }, { 3, 4, 7, 6 } };
+  std::string quad_markers[3] = { "Domain", "Domain", "Domain" };
+  int2 boundary[8] = { { 0, 1 }, { 1, 2 }, { 2, 5 }, { 5, 4 }, { 4, 7 }, { 7, 6 }, { 6, 3 }, { 3, 0 } };
+  std::string boundary_markers[8] = { "Boundary", "Boundary", "Boundary", "Boundary", "Boundary", "Boundary", "Boundary", "Boundary" };
+  mesh->create(8, vertices, 0, NULL, NULL, 3, quads, quad_markers, 8, boundary, boundary_markers);
+}
+
+/// Assembles and solves the Poisson problem on the space, the times go to the report.
+/// The library forms are in the residual form, so the solution is the negative solution of the assembled system.
+static void assemble_and_solve(WeakForm<double>* wf, Space<double>* space, Solution<double>* sln, const std::string& benchmark,
+  int repetition, int step, BenchmarkReport& report, bool reassemble)
+{
+  int ndof = space->get_num_dofs();
+  Hermes::Mixins::TimeMeasurable timer;
+
+  DiscreteProblem<double> dp(wf, space);
+  SparseMatrix<double>* matrix = Hermes::Algebra::create_matrix<double>();
+  Vector<double>* rhs = Hermes::Algebra::create_vector<double>();
+
+  timer.tick();
+  dp.assemble(matrix, rhs);
+  timer.tick();
+  report.add(benchmark, repetition, step, ndof, "assembly", timer.last());
+
+  if(reassemble)
+  {
+    // The sparse structure is kept, only the values are assembled again.
+    timer.tick();
+    dp.assemble(matrix, rhs);
+    timer.tick();
+    report.add(benchmark, repetition, step, ndof, "reassembly", timer.last());
+  }
+
+  Hermes::Solvers::LinearMatrixSolver<double>* solver = Hermes::Solvers::create_linear_solver<double>(matrix, rhs);
+  timer.tick();
+  solver->solve();
+  timer.tick();
+  report.add(benchmark, repetition, step, ndof, "solve", timer.last());
+
+  std::vector<double> coeffs(ndof);
+  for (int i = 0; i < ndof; i++)
+    coeffs[i] = -solver->get_sln_vector()[i];
+  Solution<double>::vector_to_solution(ndof > 0 ? &coeffs[0] : NULL, space, sln);
+
+  delete solver;
+  delete matrix;
+  delete rhs;
+}
+
+void run_poisson_benchmark(const BenchmarkParameters& parameters, int repetition, BenchmarkReport& report)
+{
+  Hermes::Mixins::TimeMeasurable timer;
+
+  Mesh mesh;
+  create_lshape_mesh(&mesh);
+  timer.tick();
+  for (int i = 0; i < parameters.refinements; i++)
+    mesh.refine_all_elements();
+  timer.tick();
+  report.add("poisson", repetition, 0, 0, "mesh", timer.last());
+
+  DefaultEssentialBCConst<double> bc_essential("Boundary", 0.0);
+  EssentialBCs<double> bcs(&bc_essential);
+  timer.tick();
+  H1Space<double> space(&mesh, &bcs, parameters.order);
+  timer.tick();
+  int ndof = space.get_num_dofs();
+  report.add("poisson", repetition, 0, ndof, "space", timer.last());
+
+  // The first call traverses the mesh, the second one replays the recorded states.
+  TraversePlan plan;
+  int num_states;
+  Hermes::vector<const Mesh*> meshes;
+  meshes.push_back(&mesh);
+  timer.tick();
+  plan.get_states(meshes, num_states);
+  timer.tick();
+  report.add("poisson", repetition, 0, ndof, "traversal", timer.last());
+  timer.tick();
+  plan.get_states(meshes, num_states);
+  timer.tick();
+  report.add("poisson", repetition, 0, ndof, "traversal_replay", timer.last());
+
+  WeakFormsH1::DefaultWeakFormPoisson<double> wf(HERMES_ANY, new Hermes1DFunction<double>(1.0), new Hermes2DFunction<double>(-1.0));
+  Solution<double> sln;
+  assemble_and_solve(&wf, &space, &sln, "poisson", repetition, 0, report, true);
+
+  const char* bin_filename = "benchmark_solution.h2db";
+  const char* vtk_filename = "benchmark_solution.vtk";
+  timer.tick();
+  sln.save_bin(bin_filename);
+  timer.tick();
+  report.add("poisson", repetition, 0, ndof, "save_bin", timer.last());
+
+  Solution<double> loaded;
+  timer.tick();
+  loaded.load_bin(bin_filename, &space);
+  timer.tick();
+  report.add("poisson", repetition, 0, ndof, "load_bin", timer.last());
+
+  Views::Linearizer lin;
+  timer.tick();
+  lin.save_solution_vtk(&sln, vtk_filename, "u", false);
+  timer.tick();
+  report.add("poisson", repetition, 0, ndof, "save_vtk", timer.last());
+
+  remove(bin_filename);
+  remove(vtk_filename);
+}
+
+void run_adapt_benchmark(const BenchmarkParameters& parameters, int repetition, BenchmarkReport& report)
+{
+  Hermes::Mixins::TimeMeasurable timer;
+
+  Mesh mesh;
+  create_lshape_mesh(&mesh);
+  for (int i = 0; i < parameters.refinements; i++)
+    mesh.refine_all_elements();
+
+  DefaultEssentialBCConst<double> bc_essential("Boundary", 0.0);
+  EssentialBCs<double> bcs(&bc_essential);
+  H1Space<double> space(&mesh, &bcs, parameters.order);
+  WeakFormsH1::DefaultWeakFormPoisson<double> wf(HERMES_ANY, new Hermes1DFunction<double>(1.0), new Hermes2DFunction<double>(-1.0));
+  RefinementSelectors::H1ProjBasedSelector<double> selector(RefinementSelectors::H2D_HP_ANISO, 1.0, H2DRS_DEFAULT_ORDER);
+  Solution<double> sln;
+
+  for (int step = 0; step < parameters.adapt_steps; step++)
+  {
+    timer.tick();
+    Mesh::ReferenceMeshCreator ref_mesh_creator(&mesh);
+    Mesh* ref_mesh = ref_mesh_creator.create_ref_mesh();
+    Space<double>::ReferenceSpaceCreator ref_space_creator(&space, ref_mesh);
+    Space<double>* ref_space = ref_space_creator.create_ref_space();
+    timer.tick();
+    int ndof_ref = ref_space->get_num_dofs();
+    report.add("adapt", repetition, step, ndof_ref, "reference_space", timer.last());
+
+    Solution<double>* ref_sln = new Solution<double>;
+    assemble_and_solve(&wf, ref_space, ref_sln, "adapt", repetition, step, report, false);
+
+    timer.tick();
+    OGProjection<double> ogProjection;
+    ogProjection.project_global(&space, ref_sln, &sln);
+    timer.tick();
+    report.add("adapt", repetition, step, ndof_ref, "projection", timer.last());
+
+    Adapt<double> adaptivity(&space);
+    timer.tick();
+    adaptivity.calc_err_est(&sln, ref_sln);
+    timer.tick();
+    report.add("adapt", repetition, step, ndof_ref, "error_estimate", timer.last());
+
+    timer.tick();
+    bool done = adaptivity.adapt(&selector, 0.3, 0, -1);
+    timer.tick();
+    report.add("adapt", repetition, step, ndof_ref, "adapt", timer.last());
+
+    delete ref_sln;
+    delete ref_space;
+    delete ref_mesh;
+    if(done)
+      break;
+  }
+}
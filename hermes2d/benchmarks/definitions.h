@@ -0,0 +1,62 @@
+#include "hermes2d.h"
+
+using namespace Hermes;
+using namespace Hermes::Hermes2D;
+
+/// Settings of one run of the benchmarks, given on the command line.
+struct BenchmarkParameters
+{
+  BenchmarkParameters();
+
+  /// Parses the command line, returns false (after printing the usage) on an error or --help.
+  bool parse(int argc, char* argv[]);
+
+  /// Sets the number of threads and the matrix solver to the APIs, returns false if the solver is unknown.
+  bool apply() const;
+
+  std::string benchmark;
+  int refinements;
+  int order;
+  int threads;
+  std::string solver;
+  int adapt_steps;
+  int repetitions;
+  std::string format;
+  std::string output;
+};
+
+/// The measured times, written as CSV (one line per measurement) or as a JSON array.
+class BenchmarkReport
+{
+public:
+  BenchmarkReport(const BenchmarkParameters& parameters);
+
+  void add(const std::string& benchmark, int repetition, int step, int ndof, const std::string& phase, double seconds);
+
+  void write(std::ostream& out) const;
+
+protected:
+  struct Record
+  {
+    std::string benchmark;
+    int repetition;
+    int step;
+    int ndof;
+    std::string phase;
+    double seconds;
+  };
+
+  const BenchmarkParameters& parameters;
+  std::vector<Record> records;
+};
+
+/// The L-shaped domain (-1, 1)^2 \ (0, 1)^2 of three quadrilaterals, the boundary marked "Boundary".
+void create_lshape_mesh(Mesh* mesh);
+
+/// Poisson problem as in test_examples/01-poisson on the uniformly refined mesh: mesh refinement, space setup,
+/// traversal, assembly (first and repeated), solve and the output of the solution (binary and VTK).
+void run_poisson_benchmark(const BenchmarkParameters& parameters, int repetition, BenchmarkReport& report);
+
+/// The hp-adaptivity loop as in test_examples/04-complex-adapt for the Poisson problem: per step the reference space,
+/// assembly, solve, projection, error estimate and adaptation.
+void run_adapt_benchmark(const BenchmarkParameters& parameters, int repetition, BenchmarkReport& report);
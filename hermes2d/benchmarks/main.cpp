@@ -0,0 +1,56 @@
+#include "definitions.h"
+#include <fstream>
+
+// Benchmarks of the assembly, traversal, solve, adaptivity and I/O, made of the test examples
+// 01-poisson and 04-complex-adapt with the sizes and the settings given on the command line.
+// The times are written in a machine-readable form (CSV or JSON), one record per measured phase,
+// so that the reports of two versions of Hermes can be compared to catch performance regressions.
+//
+// Example:
+//   benchmarks --benchmark all --refinements 5 --order 3 --threads 4 --solver umfpack --format json --output report.json
+//
+// The CSV columns (the JSON keys) are:
+//   benchmark, refinements, order, threads, solver - the settings,
+//   repetition, step - the run of the benchmark and the adaptivity step (0 for the poisson benchmark),
+//   ndof - the number of DOFs of the (reference) space,
+//   phase - mesh, space, traversal, traversal_replay, assembly, reassembly, solve, save_bin, load_bin, save_vtk for the poisson benchmark,
+//           reference_space, assembly, solve, projection, error_estimate, adapt for the adapt benchmark,
+//   seconds - the wall time of the phase.
+
+int main(int argc, char* argv[])
+{
+  BenchmarkParameters parameters;
+  if(!parameters.parse(argc, argv) || !parameters.apply())
+    return -1;
+
+  BenchmarkReport report(parameters);
+  try
+  {
+    for (int repetition = 0; repetition < parameters.repetitions; repetition++)
+    {
+      if(parameters.benchmark == "all" || parameters.benchmark == "poisson")
+        run_poisson_benchmark(parameters, repetition, report);
+      if(parameters.benchmark == "all" || parameters.benchmark == "adapt")
+        run_adapt_benchmark(parameters, repetition, report);
+    }
+  }
+  catch(Hermes::Exceptions::Exception& e)
+  {
+    e.print_msg();
+    return -1;
+  }
+  catch(std::exception& e)
+  {
+    std::cout << e.what() << std::endl;
+    return -1;
+  }
+
+  if(parameters.output.empty())
+    report.write(std::cout);
+  else
+  {
+    std::ofstream out(parameters.output.c_str());
+    report.write(out);
+  }
+  return 0;
+}
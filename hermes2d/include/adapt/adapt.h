@@ -27,6 +27,7 @@
 #include "../refinement_selectors/selector.h"
 #include "exceptions.h"
 #include "../global.h"
+#include "../mixins2d.h"
 
 namespace Hermes
 {
@@ -54,7 +55,7 @@ namespace Hermes
     *  and it acts as a container for the calculated errors.
     */
     template<typename Scalar>
-    class HERMES_API Adapt : public Hermes::Mixins::TimeMeasurable, public Hermes::Mixins::Loggable
+    class HERMES_API Adapt : public Hermes::Mixins::TimeMeasurable, public Hermes::Mixins::Loggable, public Hermes::Hermes2D::Mixins::Parallel
     {
     public:
       /// Constructor. Suitable for problems where various solution components belong to different spaces (L2, H1, Hcurl,
@@ -151,6 +152,19 @@ namespace Hermes
         Hermes::vector<double>* component_errors = NULL, bool solutions_for_adapt = true,
         unsigned int error_flags = HERMES_TOTAL_ERROR_REL | HERMES_ELEMENT_ERROR_REL);
 
+      /// Sets whether the projections of this class are local (LocalProjection, element by element) instead of
+      /// global (OGProjection, a global mass-matrix system). Used by calc_err_exact() and project_reference_solutions().
+      /// Default false.
+      void set_local_projection(bool local_projection);
+
+      /// Projects the reference solutions onto the (coarse) spaces, which gives the coarse solutions for calc_err_est().
+      /** \param[in] rslns The reference solutions.
+      *  \param[out] slns The coarse solutions. */
+      void project_reference_solutions(Hermes::vector<Solution<Scalar>*> rslns, Hermes::vector<Solution<Scalar>*> slns);
+
+      /// Type-safe version of project_reference_solutions() for one solution.
+      void project_reference_solutions(Solution<Scalar>* rsln, Solution<Scalar>* sln);
+
       /// Refines elements based on results from calc_err_est().
       /**
       *  \param[in] refinement_selectors Vector of selectors.
@@ -193,7 +207,7 @@ namespace Hermes
 
       /// Returns regular queue of elements
       /** \return A regular queue. */
-      const Hermes::vector<ElementReference>& get_regular_queue() const;
+      const Hermes::vector<ElementReference>& get_regular_queue();
 
       /// Apply a single refinement.
       /** \param[in] A refinement to apply. */
@@ -209,6 +223,7 @@ namespace Hermes
 
       std::queue<ElementReference> priority_queue; ///< A queue of priority elements. Elements in this queue are processed before the elements in the Adapt::regular_queue.
       Hermes::vector<ElementReference> regular_queue; ///< A queue of elements which should be processes. The queue had to be filled by the method fill_regular_queue().
+      int regular_queue_sorted; ///< A number of leading elements of Adapt::regular_queue that are sorted. Negative if the whole queue is in its final order.
       std::vector<ElementToRefine> last_refinements; ///< A vector of refinements generated during the last finished execution of the method adapt().
 
       /// Fixes refinements of a mesh which is shared among multiple components of a multimesh.
@@ -233,6 +248,12 @@ namespace Hermes
       bool have_errors;                     ///< True if errors of elements were calculated.
       bool have_coarse_solutions;           ///< True if the coarse solutions were set.
       bool have_reference_solutions;        ///< True if the reference solutions were set.
+      bool local_projection;                ///< True if LocalProjection is used instead of OGProjection, see set_local_projection().
+
+      /// Projects source onto space by LocalProjection or OGProjection, see set_local_projection().
+      void project(const Space<Scalar>* space, Solution<Scalar>* source, Solution<Scalar>* target);
+
+      TraversePlan traverse_plan;           ///< Recorded traversal of the coarse and reference meshes, reused while these do not change.
 
       double* errors[H2D_MAX_COMPONENTS];   ///< Errors of elements. Meaning of the error depeds on flags used when the
       ///< method calc_errors_internal() was calls. Initialized in the method calc_errors_internal().
@@ -286,14 +307,33 @@ namespace Hermes
       virtual double eval_error_norm(MatrixFormVolError* form,
         MeshFunction<Scalar>*rsln1, MeshFunction<Scalar>*rsln2);
 
+      /// Evaluates all the error forms and the norm forms on the current (union) element in one pass.
+      /** The same as eval_error() and eval_error_norm() for all the pairs of components with an error form,
+      *  but the geometry and the values of the solutions of each component are calculated only once per integration order.
+      *  \param[in] fns The (coarse) solutions of the components followed by the reference solutions.
+      *  \param[in, out] element_errors The squares of the errors are added here, per component.
+      *  \param[in, out] element_norms The squares of the norms are added here, per component. */
+      virtual void eval_errors(MeshFunction<Scalar>** fns, double* element_errors, double* element_norms);
+
+      /// The integration order of the form on the current element of the reference solutions.
+      int calc_error_order(MatrixFormVolError* form, MeshFunction<Scalar>*rsln1, MeshFunction<Scalar>*rsln2);
+
       /// Builds an ordered queue of elements that are be examined.
-      /** The method fills Adapt::standard_queue by elements sorted accordin to their error descending.
+      /** The method fills Adapt::standard_queue by elements which are sorted according to their error descending
+      *  lazily through sort_regular_queue().
       *  The method assumes that Adapt::errors_squared contains valid values.
       *  If a special order of elements is requested, this method has to be overridden.
       *  /param[in] meshes An array of pointers to meshes of a (coarse) solution. An index into the array is an index of a component.
       *  /param[in] meshes An array of pointers to meshes of a reference solution. An index into the array is an index of a component. */
       virtual void fill_regular_queue(const Mesh** meshes);
 
+      /// Makes sure the first \a count elements of Adapt::regular_queue are the elements with the largest errors, sorted.
+      /** The default fill_regular_queue() does not sort, since adapt() usually processes just a small part of the queue.
+      *  The queue is sorted in growing chunks as far as it is walked. If fill_regular_queue() is overridden (and does not
+      *  call this implementation), its order is kept.
+      *  \param[in] count A number of elements that will be accessed. */
+      void sort_regular_queue(int count);
+
     private:
       /// A functor that compares elements accoring to their error. Used by std::sort().
       class CompareElements
@@ -127,12 +127,16 @@ namespace Hermes
       ///
       /// Functions used for evaluating the actual error estimator forms for an active element or edge segment.
       ///
+      /// The solutions \a slns are those of the calling thread (see calc_err_internal()).
       double eval_volumetric_estimator(typename KellyTypeAdapt::ErrorEstimatorForm* err_est_form,
+                                       Solution<Scalar>** slns,
                                        RefMap* rm);
       double eval_boundary_estimator(typename KellyTypeAdapt::ErrorEstimatorForm* err_est_form,
+                                     Solution<Scalar>** slns,
                                      RefMap* rm,
                                      SurfPos* surf_pos);
       double eval_interface_estimator(typename KellyTypeAdapt::ErrorEstimatorForm* err_est_form,
+                                      Solution<Scalar>** slns,
                                       RefMap *rm,
                                       SurfPos* surf_pos,
                                       LightArray<NeighborSearch<Scalar>*>& neighbor_searches,
@@ -166,9 +170,19 @@ namespace Hermes
 
       /// Specifies whether the interface error estimator will be evaluated from each side of each interface
       /// (when <c>ignore_visited_segments == false</c> ), or only once for each interface
-      /// (<c>ignore_visited_segments == true</c>).
+      /// (<c>ignore_visited_segments == true</c>). In the latter case, a segment is evaluated from the side
+      /// of the element with the lower id, so that the result does not depend on the order of processing.
       bool ignore_visited_segments;
 
+      /// An interface error estimate attributed to the element on the other side of a segment.
+      /// Collected per traversal state and added to the element errors after the (parallel) evaluation.
+      struct NeighborError
+      {
+        int component;
+        int id;
+        double error;
+      };
+
       /// Calculates error estimates for each solution component, the total error estimate, and possibly also
       /// their normalizations. If called with a pair of solutions, the version from Adapt is used (this is e.g.
       /// done when comparing approximate solution to the exact one - in this case, we do not want to compute
@@ -287,6 +301,13 @@ namespace Hermes
       ///
       bool adapt(double thr, int strat = 0, int regularize = -1, double to_be_processed = 0.0);
 
+      /// Refines the elements selected according to the errors calculated by \code calc_err_est \endcode
+      /// by the given selectors, which get the coarse solutions in place of the reference ones.
+      /// With \code RefinementSelectors::SmoothnessSelector \endcode, this is hp-adaptivity without reference solutions.
+      ///
+      bool adapt(Hermes::vector<RefinementSelectors::Selector<Scalar>*> refinement_selectors, double thr, int strat = 0,
+                 int regularize = -1, double to_be_processed = 0.0);
+
       void disable_aposteriori_interface_scaling() { use_aposteriori_interface_scaling = false; }
 
       void set_volumetric_scaling_const(double C) { volumetric_scaling_const = C; }
@@ -0,0 +1,95 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_AFFINE_DECOMPOSITION_H
+#define __H2D_AFFINE_DECOMPOSITION_H
+
+#include "global.h"
+#ifdef WITH_UMFPACK
+#include "solvers/umfpack_solver.h"
+#include "discrete_problem.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// @ingroup inner
+    /// \brief Affine parameter decomposition of a parametric problem, for many solves with different parameters.
+    /// \details The forms of the weak formulation declare their terms (Form::set_affine_term()) of
+    /// A(mu) = A_c + sum_q theta_q(mu) A_q, f(mu) = f_c + sum_q theta_q(mu) f_q,
+    /// the forms of the constant term A_c, f_c have the default H2D_AFFINE_CONSTANT_TERM.
+    /// assemble() assembles every term once (one traversal per term) on the common sparsity pattern of the problem,
+    /// combine() then builds the system of a parameter as a linear combination of the stored values, without any traversal.
+    /// With DiscreteProblemLinear, f_q contains the Dirichlet lift of A_q, so that it is scaled by theta_q too.
+    /// The values of the forms must not depend on the parameters (nor on the solution, the terms are assembled with zero u_ext).
+    /// Typical usage:
+    /// DiscreteProblemLinear<double> dp(&wf, &space);
+    /// AffineDecomposition<double> decomposition(&dp);
+    /// decomposition.assemble();
+    /// for(...) { decomposition.combine(theta, &matrix, &rhs); solver.solve(); }
+    template<typename Scalar>
+    class HERMES_API AffineDecomposition : public Hermes::Mixins::Loggable
+    {
+    public:
+      AffineDecomposition(DiscreteProblem<Scalar>* dp);
+      ~AffineDecomposition();
+
+      /// Assembles the terms, if the spaces or the weak formulation changed since the last call.
+      void assemble();
+
+      /// The number of the parametric terms (without the constant one), WeakForm::get_num_affine_terms().
+      int get_num_terms() const;
+
+      /// matrix = A_c + sum_q theta[q] A_q, rhs = f_c + sum_q theta[q] f_q.
+      /// \param[in] theta get_num_terms() coefficients.
+      /// \param[out] matrix Gets (shares) the pattern of the decomposition if it does not have it (the pattern is kept by the following calls).
+      /// \param[out] rhs Optional.
+      void combine(const Hermes::vector<Scalar>& theta, CSCMatrix<Scalar>* matrix, Vector<Scalar>* rhs = NULL) const;
+
+      /// The stored values of the term q (H2D_AFFINE_CONSTANT_TERM for the constant one) on the pattern get_Ap(), get_Ai(),
+      /// the basis of the reduced operators.
+      const Scalar* get_matrix_values(int q) const;
+      const Scalar* get_rhs_values(int q) const;
+      const int* get_Ap() const;
+      const int* get_Ai() const;
+      unsigned int get_size() const;
+      unsigned int get_nnz() const;
+
+    protected:
+      void free();
+
+      /// The decomposition was assembled for the current spaces and weak formulation.
+      bool is_up_to_date() const;
+
+      DiscreteProblem<Scalar>* dp;
+      int num_terms;
+      unsigned int size;
+      unsigned int nnz;
+      int* Ap;
+      int* Ai;
+      /// The pattern of the terms (Ap, Ai), shared by the matrices of combine().
+      SparsityPattern* pattern;
+      /// The values of the terms, [0] the constant one, [q + 1] the term q.
+      Scalar** matrix_values;
+      Scalar** rhs_values;
+
+      /// What the terms were assembled for.
+      std::vector<int> space_seqs;
+      const WeakForm<Scalar>* wf;
+    };
+  }
+}
+#endif
+#endif
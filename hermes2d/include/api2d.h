@@ -39,7 +39,25 @@ namespace Hermes
     {
       numThreads,
 			xmlSchemasDirPath,
-			precalculatedFormsDirPath
+			precalculatedFormsDirPath,
+      /// Memory budget (in MB) of the assembling cache of one DiscreteProblem, 0 means unlimited.
+      cacheMemoryBudget,
+      /// If nonzero, meshes are reordered by Mesh::reorder_hilbert() after a reference mesh is created
+      /// by Mesh::ReferenceMeshCreator and after each adaptivity step. Default 0.
+      meshReordering,
+      /// The number of elements (per quadrature) for which each Solution keeps its precalculated
+      /// values, see Solution::set_element_cache_size(). Default H2D_SOLUTION_ELEMENT_CACHE_SIZE.
+      solutionElementCacheSize,
+      /// Counting of the use of the caches by CacheStatistics, 0 off (default), 1 on, 2 on and reset at the beginning
+      /// of each DiscreteProblem::assemble().
+      cacheStatistics,
+      /// A file with the triangle quadrature rules replacing the built-in ones of the orders above 10,
+      /// see Quad2DStd::load_triangle_rules(). Setting it loads the rules into g_quad_2d_std, the empty string (default)
+      /// restores the built-in rules.
+      triangleQuadratureRules,
+      /// If nonzero, the projection matrices of CurvMap and Space are cached in the directory precalculatedFormsDirPath,
+      /// see PrecalculatedTables. Default 0.
+      precalculatedTablesCache
     };
 
     /// API Class containing settings for the whole Hermes2D.
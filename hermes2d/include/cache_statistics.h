@@ -0,0 +1,114 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_CACHE_STATISTICS_H
+#define __H2D_CACHE_STATISTICS_H
+
+#include "global.h"
+#include <iostream>
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// Maximum number of the threads CacheStatistics keeps separate counters of, the others are not counted.
+    #define H2D_CACHE_STATISTICS_MAX_THREADS 256
+
+    /// The caches CacheStatistics counts the use of.
+    enum CacheType
+    {
+      /// The assembling cache of DiscreteProblem, one lookup per assembled state.
+      H2D_CACHE_ASSEMBLY = 0,
+      /// The tables of the values of the shape functions of PrecalcShapeset (including the shared reference tables),
+      /// one lookup per PrecalcShapeset::set_quad_order().
+      H2D_CACHE_PRECALC = 1,
+      /// The element cache of Solution, one lookup per Solution::set_active_element().
+      H2D_CACHE_SOLUTION = 2,
+      /// The per sub-element nodes of RefMap (one lookup per RefMap::set_active_element() / RefMap::force_transform())
+      /// and their tables (jacobian, inverse reference map, ... one lookup per get_*() of a non-constant RefMap).
+      H2D_CACHE_REFMAP = 3,
+      H2D_NUM_CACHES = 4
+    };
+
+    /// The counters of one cache.
+    struct HERMES_API CacheCounters
+    {
+      CacheCounters();
+      unsigned long lookups;
+      unsigned long hits;
+      unsigned long misses;
+      /// The number of the calculated and stored records.
+      unsigned long inserts;
+      /// The memory held by the cache (of all the instances), in bytes.
+      long long bytes;
+    };
+
+    /// \brief Counters of the lookups, hits, misses and inserts and of the memory held by the caches of the assembling.
+    /// \details The counting is switched on by Hermes2DApi.set_integral_param_value(Hermes::Hermes2D::cacheStatistics, value),
+    /// value 1 counts from then on (until reset()), value 2 resets the counters at the beginning of each DiscreteProblem::assemble(),
+    /// so that they describe the last assembling only. A switched-off lookup costs one test.
+    /// The bytes are counted always (the allocations are expensive anyway), so that they are right even if the counting
+    /// is switched on later, and reset() does not zero them.
+    /// Every thread writes its own counters (also the threads of the OpenMP teams running concurrently), they are summed by get().
+    /// Typical usage:
+    /// Hermes2DApi.set_integral_param_value(Hermes::Hermes2D::cacheStatistics, 2);
+    /// dp.assemble(matrix, rhs);
+    /// CacheStatistics::report();
+    /// double precalc_hit_rate = CacheStatistics::get(H2D_CACHE_PRECALC).hits / (double)CacheStatistics::get(H2D_CACHE_PRECALC).lookups;
+    class HERMES_API CacheStatistics
+    {
+    public:
+      static inline bool is_enabled() { return enabled; }
+
+      /// Called by Api2D::set_integral_param_value() for Hermes::Hermes2D::cacheStatistics.
+      static void set_mode(int mode);
+
+      /// The counters of the cache summed over the threads.
+      static CacheCounters get(CacheType cache);
+
+      /// Zeroes the lookups, hits, misses and inserts of all caches.
+      /// Must not be called while other threads are counting.
+      static void reset();
+
+      /// Called at the beginning of DiscreteProblem::assemble(), resets the counters if the mode is 2.
+      static void begin_assembly();
+
+      static const char* get_name(CacheType cache);
+
+      /// Writes the counters and the hit rate of all caches.
+      static void report(std::ostream& out = std::cout);
+
+      /// Counts one lookup (if enabled).
+      static inline void lookup(CacheType cache, bool hit)
+      {
+        if(enabled)
+          count_lookup(cache, hit);
+      }
+
+      /// Counts one insert of a record of the given size.
+      static void insert(CacheType cache, long long bytes);
+
+      /// Changes the memory held by the cache, negative for the released records.
+      static void add_bytes(CacheType cache, long long bytes);
+
+    private:
+      static void count_lookup(CacheType cache, bool hit);
+
+      static bool enabled;
+      static bool reset_per_assembly;
+    };
+  }
+}
+#endif
@@ -23,6 +23,7 @@
 #include "config.h"
 #include "compat.h"
 #include "function/solution.h"
+#include <queue>
 
 namespace Hermes
 {
@@ -75,6 +76,30 @@ namespace Hermes
       };
 
       CalculationContinuity(IdentificationMethod identification_method);
+      ~CalculationContinuity();
+
+      /// Enables / disables asynchronous checkpointing.
+      /// In the asynchronous mode, add_record() only takes a snapshot of the meshes, spaces and solutions
+      /// and returns, the files are written on a background thread. Meshes and solutions are written in
+      /// the binary formats (MeshReaderH2DBinary, Solution::save_bin()), which the load methods recognize.
+      /// A record is listed in the index file only once all its files have been written.
+      /// \param[in] max_in_flight The maximum number of snapshots that are kept in memory, add_record()
+      /// blocks until a snapshot is written if there are this many of them.
+      void set_async_checkpointing(bool enabled, int max_in_flight = 2);
+
+      /// Enables / disables delta checkpointing.
+      /// In the delta mode, a mesh sharing the base mesh with the one of the previous record is stored as
+      /// the refinements following the common part of their refinement histories, and a space of the same
+      /// type is stored as the element data that differ, both referring to the files of the previous record.
+      /// Solutions are stored in full. The load methods replay the chains transparently. Meshes are always
+      /// written in the binary format (MeshReaderH2DBinary) in this mode.
+      /// \param[in] max_chain_length After this many deltas in a row, a full record is stored again, which
+      /// bounds the length of the chains replayed on loading.
+      void set_delta_checkpointing(bool enabled, int max_chain_length = 10);
+
+      /// Blocks until all the asynchronous checkpoints have been written.
+      /// Throws the first failure that occurred on the background thread, if any.
+      void wait_for_checkpoints();
 
       /// One record of the calculation. Stores every information to resume a calculation from this one point.
       class HERMES_API Record
@@ -151,6 +176,11 @@ namespace Hermes
         /// Internals. Used for identifying.
         double time;
         unsigned int number;
+
+        /// Returns the name of a file of this record.
+        std::string get_file_name(const std::string& prefix, unsigned int i, bool binary = false) const;
+
+        friend class CalculationContinuity<Scalar>;
       };
 
       /// Add a record.
@@ -186,6 +216,75 @@ namespace Hermes
       static void set_error_file_name(std::string error_file_nameToSet);
 
     private:
+      /// A snapshot of the state passed to add_record(), written by the checkpoint thread.
+      class CheckpointJob
+      {
+      public:
+        CheckpointJob(Record* record, std::string index_file_name, std::string index_line);
+        ~CheckpointJob();
+
+        /// Writes the snapshot and appends the record to the index file.
+        void write();
+
+        Record* record;
+        std::string index_file_name;
+        std::string index_line;
+
+        Hermes::vector<Mesh*> meshes;
+        Hermes::vector<SpaceType> space_types;
+        Hermes::vector<typename Space<Scalar>::ElementDataSnapshot> spaces;
+        Hermes::vector<Solution<Scalar>*> solutions;
+      };
+
+      /// Saves everything into the record, either directly or through the checkpoint thread, and appends
+      /// the record to the index file.
+      void store_record(Record* record, const char* index_file_name, std::string index_line, Hermes::vector<Mesh*> meshes, Hermes::vector<Space<Scalar>*> spaces, Hermes::vector<Solution<Scalar>*> slns, double time_step, double time_step_n_minus_one, double error);
+
+      /// The checkpoint thread.
+      static void* checkpoint_thread_func(void* data);
+
+      /// The last stored file of a mesh / space (of one index in the vectors passed to add_record())
+      /// and what is needed to store the next one as a delta to it.
+      struct MeshDeltaState
+      {
+        MeshDeltaState() : base_key(0), chain_length(0) {};
+        std::string file_name;
+        unsigned int base_key;
+        Hermes::vector<std::pair<unsigned int, int> > refinements;
+        int chain_length;
+      };
+      struct SpaceDeltaState
+      {
+        SpaceDeltaState() : type(HERMES_INVALID_SPACE), chain_length(0) {};
+        std::string file_name;
+        SpaceType type;
+        typename Space<Scalar>::ElementDataSnapshot element_data;
+        int chain_length;
+      };
+
+      /// Stores the i-th mesh / space of the record as a delta if possible, returns whether it did.
+      /// Updates the state in any case, the caller stores the full file if no delta was stored.
+      bool store_mesh_delta(Record* record, unsigned int i, Mesh* mesh);
+      bool store_space_delta(Record* record, unsigned int i, Space<Scalar>* space);
+
+      /// Delta checkpointing.
+      bool delta_checkpointing;
+      int max_delta_chain_length;
+      Hermes::vector<MeshDeltaState> mesh_delta_states;
+      Hermes::vector<SpaceDeltaState> space_delta_states;
+
+      /// Asynchronous checkpointing.
+      bool async_checkpointing;
+      int max_checkpoints_in_flight;
+      /// Snapshots waiting to be written; the front one is being written.
+      std::queue<CheckpointJob*> checkpoint_queue;
+      std::string checkpoint_failure;
+      bool checkpoint_thread_running;
+      bool checkpoint_thread_exit;
+      pthread_t checkpoint_thread;
+      pthread_mutex_t checkpoint_mutex;
+      pthread_cond_t checkpoint_cond;
+
       /// Names for the file stored.
       static std::string mesh_file_name;
       static std::string space_file_name;
@@ -0,0 +1,54 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_COST_MODEL_H
+#define __H2D_COST_MODEL_H
+
+#include "global.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// @ingroup inner
+    /// \brief Estimated costs of the work on the elements of hp meshes and their partition among the threads.
+    /// \details The work on an element of the order p grows with the number of its shape functions (~p^2) and
+    /// the number of the quadrature points (~p^2), so the elements of a typical hp mesh differ in the cost by orders
+    /// of magnitude. The threads get contiguous ranges of the work items (which keeps the neighboring elements
+    /// on one thread) of about the same estimated cost, see partition().
+    class HERMES_API CostModel
+    {
+    public:
+      /// The number of the shape functions of a (scalar) element of the order (encoded by H2D_MAKE_QUAD_ORDER for quads).
+      static int get_num_shapes(int order, ElementMode2D mode);
+
+      /// The number of the quadrature points integrating the products of the shape functions of the order exactly.
+      static int get_num_points(int order, ElementMode2D mode);
+
+      /// The cost of the integration of the forms on one element: the quadrature points times the pairs (matrix forms)
+      /// and the shape functions (vector forms) of the element, larger for the curved elements (their reference
+      /// mapping is evaluated in each point and the quadrature order is increased).
+      static double get_element_cost(int num_shapes, int order, ElementMode2D mode, bool curved, int num_matrix_forms, int num_vector_forms);
+
+      /// Splits the items first, ..., end - 1 of the costs into num_parts contiguous parts of about the same total cost,
+      /// the part k is bounds[k], ..., bounds[k + 1] - 1 (bounds[0] = first, bounds[num_parts] = end).
+      static void partition(const double* costs, int first, int end, int num_parts, int* bounds);
+
+      /// The ratio of the longest and the mean time of the threads (1 for a perfect balance).
+      static double get_imbalance(const std::vector<double>& times);
+    };
+  }
+}
+#endif
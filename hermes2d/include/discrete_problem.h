@@ -26,6 +26,7 @@
 #include "refinement_selectors/selector.h"
 #include "exceptions.h"
 #include "mixins2d.h"
+#include "reference_integrals.h"
 
 namespace Hermes
 {
@@ -59,8 +60,23 @@ namespace Hermes
     ///
     /// This class does assembling into external matrix / vector structures.
     ///
+    /// \brief Memory used by a DiscreteProblem, in bytes, see DiscreteProblem::get_memory_usage().
+    struct HERMES_API DiscreteProblemMemoryUsage
+    {
+      std::size_t cache;                ///< The assembling cache, see DiscreteProblem::get_cache_memory_size().
+      std::size_t sparse_structure;     ///< The sparse structure of the matrix.
+      std::size_t scatter_map;          ///< The positions of the local matrices in the matrix.
+      std::size_t batched_assembly;     ///< The shape tables, the reference integrals and the groups of the batched assembly.
+      std::size_t dg_cache;             ///< The neighbor data of the DG assembling (without the NeighborSearches).
+      std::size_t static_condensation;  ///< The condensed elements and the per-thread local systems.
+      std::size_t per_thread;           ///< The per-thread shapesets, reference maps and u_ext (kept between the assemblings), assembly buffers and arenas.
+      std::size_t auxiliary;            ///< The element partition and the form order cache.
+
+      std::size_t get_total() const;
+    };
+
     template<typename Scalar>
-    class HERMES_API DiscreteProblem : public DiscreteProblemInterface<Scalar>, public Hermes::Mixins::TimeMeasurable, public Hermes::Hermes2D::Mixins::SettableSpaces<Scalar>, public Hermes::Hermes2D::Mixins::StateQueryable
+    class HERMES_API DiscreteProblem : public DiscreteProblemInterface<Scalar>, public Hermes::Mixins::TimeMeasurable, public Hermes::Hermes2D::Mixins::SettableSpaces<Scalar>, public Hermes::Hermes2D::Mixins::StateQueryable, public Hermes::Hermes2D::Mixins::MemoryAccounted, public Hermes::Hermes2D::Mixins::Parallel
     {
     public:
       /// Constructor for multiple components / equations.
@@ -89,6 +105,108 @@ namespace Hermes
       /// If the cache should not be used for any reason.
       inline void set_do_not_use_cache() { this->do_not_use_cache = true; }
 
+      /// Buffered assembly: each thread stores the assembled values in its own buffer,
+      /// the buffers are merged into the matrix / vector after all elements are processed.
+      /// This avoids concurrent access to the matrix / vector entries and the result
+      /// does not depend on the scheduling of the threads.
+      inline void set_buffered_assembly(bool to_set = true) { this->buffered_assembly = to_set; }
+
+      /// Colored assembly: the elements are split into colors (Space::get_element_coloring()) so that
+      /// no two elements of the same color share a DOF, and the colors are assembled one after another.
+      /// Threads assembling the same color never add to the same matrix / vector entry.
+      /// Used only for problems with one space and no DG forms, ignored otherwise.
+      inline void set_colored_assembly(bool to_set = true) { this->colored_assembly = to_set; }
+
+      /// Marker-grouped assembly: the elements (of each color with the colored assembly) are assembled grouped by
+      /// their element marker, so that the consecutive elements of a thread activate the same forms with the same
+      /// external functions and quadrature orders (better branch prediction and instruction cache locality
+      /// with many material regions). The order within a group is the order of the traversal.
+      inline void set_marker_grouped_assembly(bool to_set = true) { this->marker_grouped_assembly = to_set; }
+
+      /// Cost-balanced assembly: instead of handing the work items out one by one, each thread gets one contiguous
+      /// range of the work items (of each phase) of about the same estimated cost (see CostModel: the shape functions
+      /// of the spaces, the quadrature points, curved elements and the forms active on the element), so that
+      /// the neighboring elements are assembled by one thread. Default: false.
+      inline void set_cost_balanced_assembly(bool to_set = true) { this->cost_balanced_assembly = to_set; }
+
+      /// The times of the threads spent assembling the work items in the last assemble(), to see the imbalance
+      /// (CostModel::get_imbalance()).
+      const std::vector<double>& get_thread_assembly_times() const { return this->thread_assembly_times; }
+
+      /// The sparsity pattern of the matrices of this problem (NULL before the first assembling of a matrix,
+      /// or for DG problems), shared by all of them (see SparseMatrix::alloc_with_pattern()).
+      SparsityPattern* get_sparsity_pattern() const { return this->sparse_pattern; }
+
+      /// Uses the pattern (e.g. of another problem on the same spaces with the same blocks of the matrix) for
+      /// the matrices of this problem instead of calculating it, so that they share it. The caller guarantees
+      /// the pattern contains the structure of the problem, only its size and symmetric storage are checked
+      /// (otherwise the pattern is calculated as usual). Has no effect on DG problems.
+      void set_sparsity_pattern(SparsityPattern* pattern);
+
+      /// Pipelined symbolic factorization: once the sparse structure of the matrix exists, one thread runs the symbolic
+      /// analysis of its pattern (LinearMatrixSolver::analyze_structure()) while the others start assembling the values,
+      /// the factorization in the solve then only does the numeric phase. The solver has to solve the matrix assembled
+      /// by this problem, NULL (the default) switches this off.
+      inline void set_structure_analysis(LinearMatrixSolver<Scalar>* solver) { this->structure_analysis_solver = solver; }
+
+      /// Batched assembly of the volumetric matrix forms with constant coefficients (MatrixFormVol::get_constant_coefficients(),
+      /// e.g. DefaultMatrixFormVol, DefaultMatrixFormDiffusion, DefaultJacobianDiffusion and DefaultJacobianAdvection) on affine elements (straight triangles
+      /// and parallelograms, not subdivided in the traversal). The shape functions are tabulated at the quadrature points of the
+      /// reference element once, the local matrices of all the elements with the same form, mode, order and assembly list lengths
+      /// are calculated in one pass over flat arrays of the element Jacobians and scattered into the matrix afterwards.
+      /// Ignored with the buffered assembly and the static condensation.
+      inline void set_batched_assembly(bool to_set = true) { this->batched_assembly = to_set; }
+
+      /// With the batched assembly, the local matrices of the elements whose shape functions are all standard (not constrained)
+      /// are combined from the integrals over the reference element (ReferenceIntegrals) scaled by the constant reference map,
+      /// with no quadrature at all. The tables are read from (or written to) the directory precalculatedFormsDirPath of Api2D.
+      /// Implies set_batched_assembly().
+      void set_reference_integrals(bool to_set = true);
+
+      /// The per-thread clones of the weak form are kept from one assembling to the next one instead of being made in each.
+      /// Only for the assemblings between which neither the weak form, nor its forms, nor its external functions change
+      /// (e.g. the iterations of the Newton's method), set_weak_formulation(), set_time() and set_time_step() make the clones again.
+      /// The other per-thread structures (the shapesets, the reference maps, the u_ext solutions, the assembly lists) are kept always.
+      void set_persistent_weakform_clones(bool to_set = true);
+
+      /// The integration order of each element (and of its edges) is lowered by reduction, to at least 1, with respect to
+      /// the order calculated from the forms. The global integration order of the weak form is not lowered.
+      /// Meant for an inexact but cheaper assembling of a matrix, typically the one a preconditioner is built from
+      /// (NewtonSolver::set_precond_quadrature_order_reduction()). Ignored with the batched assembly.
+      void set_quadrature_order_reduction(int reduction);
+
+      /// Distributed assembly: only the states whose element of the first space (with an element in the state) lies
+      /// in the part part of Mesh::partition_elements(num_parts) are assembled. The matrix and the vector then hold
+      /// just the contributions of this part, the parts of all the processes have to be summed by the solver
+      /// (MumpsSolver::set_distributed()). The meshes and the spaces (and so the DOF numbering) are the same in all the processes.
+      void set_partition(int part, int num_parts);
+#ifdef WITH_MPI
+      /// set_partition() with the rank and the size of MPI_COMM_WORLD.
+      void set_mpi_partition();
+#endif
+
+      /// Static condensation: the bubble DOFs (Space::assign_bubble_dofs()) are eliminated element by element
+      /// by the Schur complement of the local matrix, the assembled matrix and vector contain only the vertex
+      /// and edge DOFs (numbered by get_condensed_dof_index()). The bubble DOFs of the solution of the condensed
+      /// system are recovered by expand_condensed_solution().
+      /// Requires the spaces on the same mesh (no sub-elements in the traversal), no DG forms.
+      void set_static_condensation(bool to_set = true);
+      inline bool get_static_condensation() const { return this->static_condensation; }
+
+      /// Assemble only the forms of the affine term q (Form::set_affine_term()), e.g. H2D_AFFINE_CONSTANT_TERM,
+      /// H2D_ALL_AFFINE_TERMS (default) for all the forms. The sparsity pattern does not depend on it.
+      void set_affine_term(int q);
+      inline int get_affine_term() const { return this->current_affine_term; }
+
+      /// Number of DOFs of the condensed system (get_num_dofs() without the static condensation).
+      int get_num_condensed_dofs() const;
+
+      /// Index in the condensed system of the DOF dof, -1 for the bubble DOFs.
+      int get_condensed_dof_index(int dof) const;
+
+      /// Full coefficient vector (get_num_dofs() long) from the solution of the last assembled condensed system.
+      void expand_condensed_solution(const Scalar* condensed_solution, Scalar* solution) const;
+
       /// Get the weak forms.
       const WeakForm<Scalar>* get_weak_formulation() const;
 
@@ -110,6 +228,29 @@ namespace Hermes
 
       void delete_cache();
 
+      /// Returns the (approximate) memory used by the assembling cache, in bytes.
+      std::size_t get_cache_memory_size() const;
+
+      /// Returns the memory used by the instance, split by the data structures.
+      DiscreteProblemMemoryUsage get_memory_usage() const;
+      virtual std::size_t get_total_memory_usage() const;
+
+      /// Cache statistics, counted since the creation or the last reset_cache_statistics().
+      /// A hit is a state assembled from the cached data, a miss a state for which the data had to be calculated,
+      /// an eviction is an element whose cached data were deleted because of the memory budget (Hermes2DApiParam::cacheMemoryBudget).
+      inline unsigned long get_cache_hits() const { return this->cache_hits; }
+      inline unsigned long get_cache_misses() const { return this->cache_misses; }
+      inline unsigned long get_cache_evictions() const { return this->cache_evictions; }
+      double get_cache_hit_rate() const;
+      void reset_cache_statistics();
+
+      /// Statistics of the per-thread arenas holding the temporaries of one assembled state, counted since the creation.
+      /// Allocations are the temporaries taken from the arenas, block allocations the heap allocations made by the arenas,
+      /// the peak size is the largest memory (in bytes) one thread needed for a single state.
+      inline unsigned long get_arena_allocations() const { return this->arena_allocations; }
+      inline unsigned long get_arena_block_allocations() const { return this->arena_block_allocations; }
+      inline size_t get_arena_peak_size() const { return this->arena_peak_size; }
+
       /// Assembling.
       /// General assembling procedure for nonlinear problems. coeff_vec is the
       /// previous Newton vector. If force_diagonal_block == true, then (zero) matrix
@@ -127,6 +268,14 @@ namespace Hermes
       void assemble(Scalar* coeff_vec, Vector<Scalar>* rhs = NULL,
         bool force_diagonal_blocks = false, Table* block_weights = NULL);
 
+      /// Assembles only the residual vector, e.g. for the damping of the Newton's method.
+      /// The matrix forms are neither evaluated nor taken into account by the integration order
+      /// (the same holds for the other methods without the matrix).
+      void assemble_residual(Scalar* coeff_vec, Vector<Scalar>* rhs);
+
+      /// result = J(coeff_vec) direction, by MatrixFreeJacobian (the assembling cache is used, no matrix is created).
+      virtual bool assemble_jacobian_vector_product(Scalar* coeff_vec, Scalar* direction, Scalar* result);
+
       /// Light version passing NULL for the coefficient vector. External solutions
       /// are initialized with zeros.
       virtual void assemble(SparseMatrix<Scalar>* mat, Vector<Scalar>* rhs = NULL, bool force_diagonal_blocks = false,
@@ -138,23 +287,96 @@ namespace Hermes
       void assemble(Vector<Scalar>* rhs = NULL, bool force_diagonal_blocks = false,
         Table* block_weights = NULL);
 
+      /// Ensemble assembling of many instances of the problem differing only in their coefficients and right-hand sides:
+      /// the weak forms wfs[k] have the structure of the weak form of this problem (the same forms, blocks, areas and external
+      /// functions on the same meshes), the system of the instance k is assembled into mats[k] and rhss[k].
+      /// The meshes are traversed once, the shape functions, the reference maps and the geometry of each element are
+      /// calculated once (for the integration orders of the weak form of this problem) and the forms of all the instances
+      /// are evaluated on them one after another. All the matrices get the sparsity pattern of mats[0] (the matrices have to be
+      /// of the same type), the scatter positions of the entries are shared too.
+      /// External solutions are initialized with zeros (the light assemble()). The buffered and the batched assembly are not
+      /// used for the ensemble, the static condensation, DG forms and Runge-Kutta are not supported.
+      /// \param[in] mats wfs.size() matrices, or empty for the right-hand sides only.
+      /// \param[in] rhss wfs.size() vectors, or empty for the matrices only.
+      void assemble_ensemble(const Hermes::vector<WeakForm<Scalar>*>& wfs, const Hermes::vector<SparseMatrix<Scalar>*>& mats,
+        const Hermes::vector<Vector<Scalar>*>& rhss);
+
       /// \ingroup Helper methods inside {calc_order_*, assemble_*}
       /// Init geometry, jacobian * weights, return the number of integration points.
       static int init_geometry_points(RefMap* reference_mapping, int order, Geom<double>*& geometry, double*& jacobian_x_weights);
       static int init_surface_geometry_points(RefMap* reference_mapping, int& order, Traverse::State* current_state, Geom<double>*& geometry, double*& jacobian_x_weights);
 
     protected:
-      void init_assembling(Scalar* coeff_vec, PrecalcShapeset*** pss , PrecalcShapeset*** spss, RefMap*** refmaps, Solution<Scalar>*** u_ext, AsmList<Scalar>*** als, WeakForm<Scalar>** weakforms);
+      /// Sets up the per-thread structures (thread_pss, ...), those of the previous assembling are reused
+      /// if the number of threads and the shapesets and the meshes of the spaces are the same.
+      void init_assembling(Scalar* coeff_vec);
 
-      void deinit_assembling(PrecalcShapeset*** pss , PrecalcShapeset*** spss, RefMap*** refmaps, Solution<Scalar>*** u_ext, AsmList<Scalar>*** als, WeakForm<Scalar>** weakforms);
+      void deinit_assembling();
+
+      void free_thread_structures();
+      void free_thread_weakforms();
 
       /// The form will be assembled.
+      /// \param[in] form_i The position of the form in its list of the weak form (mfvol, mfsurf, vfvol, vfsurf).
       bool form_to_be_assembled(MatrixForm<Scalar>* form, Traverse::State* current_state);
-      bool form_to_be_assembled(MatrixFormVol<Scalar>* form, Traverse::State* current_state);
-      bool form_to_be_assembled(MatrixFormSurf<Scalar>* form, Traverse::State* current_state);
+      bool form_to_be_assembled(MatrixFormVol<Scalar>* form, int form_i, Traverse::State* current_state);
+      bool form_to_be_assembled(MatrixFormSurf<Scalar>* form, int form_i, Traverse::State* current_state);
       bool form_to_be_assembled(VectorForm<Scalar>* form, Traverse::State* current_state);
-      bool form_to_be_assembled(VectorFormVol<Scalar>* form, Traverse::State* current_state);
-      bool form_to_be_assembled(VectorFormSurf<Scalar>* form, Traverse::State* current_state);
+      bool form_to_be_assembled(VectorFormVol<Scalar>* form, int form_i, Traverse::State* current_state);
+      bool form_to_be_assembled(VectorFormSurf<Scalar>* form, int form_i, Traverse::State* current_state);
+
+      /// Activation of the forms of one kind on the internal markers (the element markers for the volumetric forms,
+      /// the boundary markers for the surface ones).
+      class FormMarkerTable
+      {
+      public:
+        FormMarkerTable();
+
+        /// \param[in] form_markers The internal markers of the areas of each form (valid on the meshes of all its spaces).
+        /// \param[in] any_marker The form has the area HERMES_ANY.
+        void init(const std::vector<std::vector<int> >& form_markers, const std::vector<bool>& any_marker);
+
+        inline bool is_active(int form_i, int marker) const
+        {
+          if(marker < 0 || marker >= num_markers)
+            return any_marker[form_i] != 0;
+          return active[form_i * num_markers + marker] != 0;
+        }
+
+      private:
+        /// active[form_i * num_markers + marker].
+        std::vector<unsigned char> active;
+        std::vector<unsigned char> any_marker;
+        int num_markers;
+      };
+
+      /// Translates the areas of the forms to the internal markers, called once per assembling by init_assembling(),
+      /// so that form_to_be_assembled() tests a byte instead of looking the areas up by their names.
+      /// Sets space_element_markers as well.
+      void init_form_marker_tables();
+
+      /// For each space the sorted internal element markers where any of its forms is assembled, empty if a form of the space
+      /// is assembled everywhere, on the boundary or on the inner edges. For the traversals that may skip the elements
+      /// of the components with no forms there (Traverse::get_states()).
+      Hermes::vector<std::vector<int> > space_element_markers;
+
+      /// Sets the demands below from Form::set_demand() of the forms, called once per assembling by init_assembling()
+      /// after init_form_marker_tables(). Frees the cache records of the spaces the demand of which changed.
+      void init_fn_demands();
+
+      /// For each space the union of the demands (FuncDemand) of its forms on the test and the basis functions,
+      /// what calculate_cache_records() precalculates.
+      std::vector<unsigned int> space_fn_demand;
+      /// The demands space_fn_demand the cache records were calculated for.
+      std::vector<unsigned int> cache_fn_demand;
+      /// The unions of the demands of all the forms on u_ext and on the external functions of the WeakForm.
+      unsigned int u_ext_fn_demand;
+      unsigned int ext_fn_demand;
+
+      FormMarkerTable mfvol_markers;
+      FormMarkerTable mfsurf_markers;
+      FormMarkerTable vfvol_markers;
+      FormMarkerTable vfsurf_markers;
 
       // Return scaling coefficient.
       double block_scaling_coeff(MatrixForm<Scalar>* form) const;
@@ -170,6 +392,19 @@ namespace Hermes
       void create_sparse_structure();
       void create_sparse_structure(SparseMatrix<Scalar>* mat, Vector<Scalar>* rhs = NULL);
 
+      /// Identification of what the sparse structure depends on: the seq numbers, the numbers and the offsets
+      /// of DOFs of the spaces, the seq numbers of their meshes, the blocks of the matrix and whether the matrix
+      /// stores only its upper triangle.
+      void get_sparse_structure_key(bool** blocks, std::vector<int>& key) const;
+
+      /// Calculates the sparse structure (without the DG terms) from the assembly lists of the traversal states, in parallel:
+      /// the numbers of nonzeros of all columns are counted first, then the columns are filled.
+      /// For matrices with SparseMatrix::is_symmetric_storage() only the upper triangle is created, the caller
+      /// guarantees the weak formulation is symmetric, the lower triangle is not checked.
+      void calculate_sparse_structure(bool** blocks);
+
+      void free_sparse_structure();
+
       /// Set the special handling of external functions of Runge-Kutta methods, including information how many spaces were there in the original problem.
       inline void set_RK(int original_spaces_count) { this->RungeKutta = true; RK_original_spaces_count = original_spaces_count; }
 
@@ -188,6 +423,186 @@ namespace Hermes
       /// Adjusts order to refmaps.
       void adjust_order_to_refmaps(Form<Scalar> *form, int& order, Hermes::Ord* o, RefMap** current_refmaps);
 
+      /// Adds a local matrix to current_mat, or to the assembly buffer of the calling thread.
+      /// The local matrices of the volumetric forms go through the scatter map if the matrix supports it.
+      void add_to_matrix(unsigned int m, unsigned int n, Scalar** local_matrix, int* rows, int* cols);
+
+      /// The scatter map: for every state and every pair of spaces the positions (SparseMatrix::get_position())
+      /// of the entries of the local matrix of the element assembly lists in current_mat. It is built during the
+      /// first assembling and then used while the matrix, its structure and the traversal stay the same, so that
+      /// the reassembling (e.g. in Newton's iterations) adds the values without searching for the entries.
+      void init_scatter_map(int num_states);
+      void free_scatter_map();
+      /// Sets the state being assembled by the calling thread (-1 for none).
+      void set_scatter_map_state(int state_i);
+      /// The positions of the local matrix, NULL if the local matrix is not one of the element assembly lists of the state.
+      int* get_scatter_positions(unsigned int m, unsigned int n, int* rows, int* cols);
+
+      /// Adds a value to current_rhs, or to the assembly buffer of the calling thread.
+      void add_to_rhs(int idx, Scalar value);
+
+      /// Distributed assembly, see set_partition().
+      int partition_part;
+      int partition_num_parts;
+      /// The parts of the elements of the meshes of the spaces and the seq numbers of the meshes they were calculated for.
+      std::vector<int*> element_parts;
+      std::vector<unsigned> element_parts_seq;
+
+      /// The states of the traversal belonging to the part (all of them for one part).
+      /// @return A new array (to be deleted by the caller) if the states were filtered, states otherwise.
+      Traverse::State** get_partition_states(Traverse::State** states, int num_states, int& num_partition_states);
+      void free_element_parts();
+
+      /// Batched assembly, see set_batched_assembly().
+      /// Values, x- and y-derivatives (np each) of the shape functions of one shapeset at the points of one quadrature rule
+      /// on the reference element, one column per shape function index.
+      class BatchShapeTable
+      {
+      public:
+        int np;
+        std::map<int, int> columns;
+        std::vector<double> values;
+        /// Column of the shape function index, tabulated on the first request.
+        int get_column(Shapeset* shapeset, int index, ElementMode2D mode, int order);
+      };
+
+      /// One volumetric matrix form on the elements sharing the shape tables and the assembly list lengths.
+      class BatchGroup
+      {
+      public:
+        int form_i;
+        ElementMode2D mode;
+        int order;
+        BatchShapeTable* table_i;
+        BatchShapeTable* table_j;
+        /// If not NULL, the local matrices are combined from these and the columns are the positions in them.
+        const ReferenceIntegrals* integrals;
+        int cnt_i;
+        int cnt_j;
+        /// Per element: the state, the columns in the tables (or integrals), the DOFs and the coefficients of the assembly lists,
+        /// the Jacobian and the inverse reference map (5 entries).
+        std::vector<int> states;
+        std::vector<int> columns_i;
+        std::vector<int> columns_j;
+        std::vector<int> dofs_i;
+        std::vector<int> dofs_j;
+        std::vector<Scalar> coefs_i;
+        std::vector<Scalar> coefs_j;
+        std::vector<double> geometry;
+      };
+
+      /// Groups the (state, form) pairs that can be batched, the groups are reused while the traversal and the spaces stay the same.
+      void init_batched_assembly(Traverse::State** states, int num_states);
+      void free_batched_assembly();
+
+      /// Sets the state being assembled by the calling thread.
+      void set_batched_state(int state_i);
+
+      /// The volumetric matrix form mfvol_i of the state of the calling thread is assembled in the batches.
+      bool is_form_batched(int mfvol_i) const;
+
+      /// Calculates the local matrices of the groups and adds them to current_mat.
+      void assemble_batched();
+
+      bool batched_assembly;
+      /// See set_quadrature_order_reduction().
+      int quadrature_order_reduction;
+      /// Keyed by the shapeset id, the mode and the quadrature order.
+      std::map<std::vector<int>, BatchShapeTable*> batch_tables;
+      /// See set_reference_integrals().
+      bool use_reference_integrals;
+      /// Keyed by the shapeset ids, the mode and the orders.
+      std::map<std::vector<int>, ReferenceIntegrals*> reference_integrals;
+      std::vector<BatchGroup*> batch_groups;
+      /// batched_forms[state_i * wf->mfvol.size() + mfvol_i].
+      std::vector<char> batched_forms;
+      std::vector<int> batched_thread_states;
+      /// What the groups were made for.
+      std::vector<int> batch_groups_key;
+
+      /// Static condensation.
+      /// The data of one element needed for the rhs-only assembling and the recovery of the bubble DOFs.
+      class CondensedElement
+      {
+      public:
+        CondensedElement(int num_interface, int num_bubble);
+        ~CondensedElement();
+        int num_interface;
+        int num_bubble;
+        /// DOFs (in the full numbering).
+        int* interface_dofs;
+        int* bubble_dofs;
+        /// LU factorization of A_bb (row-wise), with the row pivots.
+        Scalar* lu;
+        int* pivots;
+        /// A_bb^{-1} A_bi (num_bubble x num_interface), A_ib (num_interface x num_bubble), A_bb^{-1} f_b.
+        Scalar* X;
+        Scalar* A_ib;
+        Scalar* y;
+        void lu_solve(Scalar* b) const;
+      };
+
+      /// The local system of the element the calling thread assembles.
+      class CondensationBuffer
+      {
+      public:
+        CondensationBuffer(int ndof);
+        ~CondensationBuffer();
+        /// Index of the DOF in dofs, -1 if the DOF is not in the element.
+        int* local_index;
+        std::vector<int> dofs;
+        std::vector<Scalar> A;
+        std::vector<Scalar> f;
+        bool active;
+      };
+
+      /// Numbers the condensed DOFs, allocates the buffers and the element records.
+      void init_static_condensation();
+      void free_static_condensation();
+
+      /// Collects the DOFs of the element, the contributions then go to the buffer of the thread.
+      void begin_condensation(AsmList<Scalar>** current_als, Traverse::State* current_state);
+      /// Eliminates the bubble DOFs from the local system and adds the Schur complement to current_mat / current_rhs.
+      void end_condensation(Traverse::State* current_state);
+
+      /// Maps the sparse structure of the full system to the condensed DOFs.
+      void condense_sparse_structure();
+
+      bool static_condensation;
+      /// For each DOF its index in the condensed system, -1 for the bubble DOFs.
+      int* condensed_dof_index;
+      int condensed_ndof;
+      /// Indexed by the element id.
+      CondensedElement** condensed_elements;
+      int condensed_elements_size;
+      CondensationBuffer** condensation_buffers;
+      int condensation_buffers_size;
+
+      /// Sets the index of the state being assembled by the calling thread to its assembly buffers.
+      void set_assembly_buffers_state(int state_i);
+
+      /// Merges the assembly buffers into current_mat / current_rhs.
+      void merge_assembly_buffers();
+
+      /// Splits the states into work items and the work items into phases.
+      /// A work item is a range of states assembled by one thread, the phases are assembled one after another.
+      /// The work item item_i contains the states item_first_states[item_i], ..., item_end_states[item_i] - 1,
+      /// the phase phase_i contains the work items phase_first_items[phase_i], ..., phase_first_items[phase_i + 1] - 1.
+      void init_assembly_schedule(Traverse::State** states, int num_states, int*& item_first_states, int*& item_end_states, int*& phase_first_items, int& num_phases);
+
+      /// Reorders the work items of each phase of the schedule by the element marker of their first state (stable counting sort).
+      void group_assembly_schedule_by_marker(Traverse::State** states, int* item_first_states, int* item_end_states, int* phase_first_items, int num_phases);
+
+      /// The ranges of the work items of the threads for the cost-balanced assembly: the thread thread_i assembles
+      /// in the phase phase_i the work items bounds[phase_i * (num_threads + 1) + thread_i], ..., bounds[phase_i * (num_threads + 1) + thread_i + 1] - 1.
+      int* init_balanced_assembly_bounds(Traverse::State** states, int* item_first_states, int* item_end_states, int* phase_first_items, int num_phases, int num_threads);
+
+      /// The estimated cost of the assembling of the state, see CostModel.
+      double get_state_cost(Traverse::State* state) const;
+
+      /// Assembles the states first_state, ..., end_state - 1 (one work item) on the calling thread.
+      void assemble_work_item(Traverse::State** states, int first_state, int end_state, Transformable** current_fns);
+
       /// Matrix volumetric forms - calculate the integration order.
       int calc_order_matrix_form(MatrixForm<Scalar>* mfv, RefMap** current_refmaps, Solution<Scalar>** current_u_ext, Traverse::State* current_state);
 
@@ -209,6 +624,23 @@ namespace Hermes
       /// Cleans up after init_ext_orders.
       void deinit_ext_orders(Form<Scalar> *form, Func<Hermes::Ord>** oi, Func<Hermes::Ord>** oext);
 
+      /// Key of the form order cache, unused values are zero.
+      struct FormOrderKey
+      {
+        static const int max_length = 32;
+        int values[max_length];
+        bool operator<(const FormOrderKey& other) const { return memcmp(values, other.values, sizeof(values)) < 0; }
+      };
+
+      /// \ingroup Helper methods inside {calc_order_*, assemble_*}
+      /// Fills the key of the order cache: the position of the form, the shape function orders
+      /// (max_order_j is -1 for vector forms) and the orders init_ext_orders gives to the external functions.
+      /// @return false if the key does not fit in FormOrderKey, the order is not cached then.
+      bool calc_order_key(Form<Scalar> *form, int max_order_i, int max_order_j, Solution<Scalar>** current_u_ext, Traverse::State* current_state, FormOrderKey& key);
+
+      /// The order cache of the calling thread, NULL outside of the assembling.
+      std::map<FormOrderKey, int>* get_form_order_cache();
+
       /// Init function. Common code for the constructors.
       void init();
 
@@ -243,10 +675,38 @@ namespace Hermes
       /// Internal.
       bool is_linear;
 
+      /// The right-hand side is assembled without the matrix, but with the contributions of the Dirichlet basis functions
+      /// by the matrix forms (DiscreteProblemLinear::assemble() with no matrix), see assemble_matrix_forms().
+      bool dirichlet_lift_only;
+
+      /// The matrix forms are evaluated: for the matrix, or for the Dirichlet lift only.
+      bool assemble_matrix_forms() const { return this->current_mat != NULL || this->dirichlet_lift_only; }
+
       /// Matrix structure can be reused.
       /// If other conditions apply.
       bool have_matrix;
 
+      /// The structure of the matrix (CSC) calculated by calculate_sparse_structure(), reused by new matrices while
+      /// get_sparse_structure_key() stays the same.
+      int* sparse_structure_col_start;
+      int* sparse_structure_rows;
+      std::vector<int> sparse_structure_key;
+      /// The calculated structure as the pattern the matrices share, it owns the arrays above.
+      SparsityPattern* sparse_pattern;
+
+      /// See init_scatter_map(), scatter_map[(state_i * neq + i) * neq + j] for the spaces i (rows), j (columns).
+      int** scatter_map;
+      int scatter_map_num_states;
+      int scatter_map_size;
+      /// The memory of the position arrays of scatter_map.
+      std::size_t scatter_map_bytes;
+      /// What the scatter map was built for.
+      SparseMatrix<Scalar>* scatter_map_matrix;
+      unsigned long scatter_map_num_traversals;
+      /// The state and the (volumetric) assembly lists of each thread, set while the volumetric matrix forms are assembled.
+      std::vector<int> scatter_map_thread_states;
+      std::vector<AsmList<Scalar>**> scatter_map_thread_als;
+
       /// There is a matrix form set on DG_INNER_EDGE area or not.
       bool DG_matrix_forms_present;
 
@@ -265,15 +725,43 @@ namespace Hermes
       bool current_force_diagonal_blocks;
       Table* current_block_weights;
 
+      /// See set_affine_term().
+      int current_affine_term;
+
       /// Caching.
+      /// Identification of the cached data of an element that does not depend on the element id:
+      /// the vertex coordinates, the polynomial order and the shapeset.
+      /// When new spaces are set (after adaptivity), the ids of unchanged elements may differ,
+      /// the cached data are then found using this key.
+      class CacheElementKey
+      {
+      public:
+        CacheElementKey();
+        /// Curved elements get an invalid key (nvert == 0), their geometry is not determined by the vertices.
+        CacheElementKey(Element* e, int order, int shapeset_id);
+        bool operator<(const CacheElementKey& other) const;
+        int nvert;
+        double coordinates[2 * H2D_MAX_NUMBER_VERTICES];
+        int order;
+        int shapeset_id;
+      };
+
       class CacheRecordPerElement
       {
       public:
+        CacheRecordPerElement();
         void clear();
         int* asmlistIdx;
         int asmlistCnt;
+        /// The last assembling the record was used in (for the LRU eviction).
+        unsigned int last_used;
+        CacheElementKey element_key;
       };
 
+      /// Moves the cached data of elements that did not change to the (possibly new) ids of the elements
+      /// in the space space_i (using CacheElementKey), deletes the rest.
+      void reuse_cache_records(unsigned int space_i);
+
       class CacheRecordPerSubIdx
       {
       public:
@@ -292,16 +780,268 @@ namespace Hermes
         int* n_quadrature_pointsSurface;
         int* orderSurface;
         int* asmlistSurfaceCnt;
+        /// Memory used by the record, in bytes.
+        std::size_t get_memory_size() const;
+      };
+
+      /// Open-addressing (linear probing) hash table of the records of one element, keyed by sub_idx.
+      /// Lookups (get()) need no locking, insertions have to be serialized
+      /// (they are done in the critical section cache_records_sub_idx_map).
+      /// When the table grows, the old slot arrays are kept until clear(), so that
+      /// concurrent lookups never access deallocated memory.
+      class SubIdxCacheTable
+      {
+      public:
+        SubIdxCacheTable();
+        ~SubIdxCacheTable();
+
+        /// Returns the record for sub_idx, NULL if there is none.
+        CacheRecordPerSubIdx* get(uint64_t sub_idx) const;
+
+        /// Inserts (or replaces) the record for sub_idx.
+        void insert(uint64_t sub_idx, CacheRecordPerSubIdx* record);
+
+        /// Deletes all records and the slot arrays.
+        void clear();
+
+        /// Memory used by the table and its records, in bytes.
+        std::size_t get_memory_size() const;
+
+      private:
+        class SlotArray
+        {
+        public:
+          SlotArray(int capacity, SlotArray* previous);
+          ~SlotArray();
+          int capacity;
+          uint64_t* keys;
+          CacheRecordPerSubIdx** records;
+          /// Slot array this one replaced.
+          SlotArray* previous;
+        };
+
+        static int hash(uint64_t sub_idx, int capacity);
+
+        SlotArray* volatile slots;
+        int count;
       };
 
-      std::map<uint64_t, CacheRecordPerSubIdx*>*** cache_records_sub_idx;
+      SubIdxCacheTable*** cache_records_sub_idx;
       CacheRecordPerElement*** cache_records_element;
       bool** cache_element_stored;
+      /// Guards the creation of the records of cache_records_sub_idx and the marking of cache_element_stored.
+      omp_lock_t cache_lock;
       int cache_size;
       bool do_not_use_cache;
 
+      /// Cache statistics.
+      unsigned long cache_hits;
+      unsigned long cache_misses;
+      unsigned long cache_evictions;
+      /// The memory of the cache accounted to CacheStatistics so far.
+      std::size_t cache_statistics_bytes;
+
+      /// Number of the current assembling, for the LRU eviction.
+      unsigned int cache_assembling_stamp;
+
+      /// Evicts the least recently used cached elements until the cache fits in the memory budget.
+      void enforce_cache_memory_budget();
+
+      /// Frees all the cache records of the space.
+      void free_cache_records(unsigned int space_i);
+
+      /// Caches of the form orders (Ord evaluated by the forms) for the keys of calc_order_key, indexed [thread],
+      /// so that no lock is needed. The increase due to the reference map is not cached, it is added to the cached order,
+      /// so that one entry serves both straight and curved elements.
+      /// Cleared by set_weak_formulation, and when the number of forms of the weak formulation changes.
+      std::vector<std::map<FormOrderKey, int> > form_order_caches;
+      unsigned int form_order_cache_forms;
+
+      /// Buffered assembly.
+      class AssemblyBuffer
+      {
+      public:
+        AssemblyBuffer();
+        ~AssemblyBuffer();
+
+        /// One buffered value.
+        /// The index of the state and the running number of the value within the state
+        /// determine the order of summation of values with the same position.
+        class Entry
+        {
+        public:
+          int row;
+          int col;
+          int state;
+          int seq;
+          Scalar value;
+          inline bool operator<(const Entry& other) const
+          {
+            if(col != other.col)
+              return col < other.col;
+            if(row != other.row)
+              return row < other.row;
+            if(state != other.state)
+              return state < other.state;
+            return seq < other.seq;
+          }
+        };
+
+        void add(int row, int col, Scalar value);
+        void set_state(int state);
+
+        Entry* entries;
+        int count;
+        int size;
+        int current_state;
+        int current_seq;
+      };
+
+      bool buffered_assembly;
+      /// Per-thread buffers for the matrix and the right-hand side.
+      AssemblyBuffer** mat_buffers;
+      AssemblyBuffer** rhs_buffers;
+
+      /// Colored assembly.
+      bool colored_assembly;
+
+      /// Marker-grouped assembly.
+      bool marker_grouped_assembly;
+
+      /// Cost-balanced assembly and the times of the threads.
+      bool cost_balanced_assembly;
+      std::vector<double> thread_assembly_times;
+
+      /// See set_structure_analysis().
+      LinearMatrixSolver<Scalar>* structure_analysis_solver;
+
+      /// Per-thread bump allocator for the temporaries of one state (local matrices, pointer arrays).
+      /// All the memory is given back at once by reset() before the next state is assembled.
+      class AssemblyArena
+      {
+      public:
+        AssemblyArena();
+        ~AssemblyArena();
+
+        /// Returns memory aligned to a cache line, valid until the next reset().
+        void* allocate(size_t size);
+
+        template<typename T>
+        T* allocate_array(int count) { return (T*)this->allocate(count * sizeof(T)); }
+
+        /// Zeroed m x n matrix with the layout of new_matrix().
+        Scalar** allocate_matrix(unsigned int m, unsigned int n);
+
+        /// Releases all the allocations. Blocks are merged into one so that the next state fits into it.
+        void reset();
+
+        unsigned long allocations;
+        unsigned long block_allocations;
+        size_t peak_size;
+
+      private:
+        class Block
+        {
+        public:
+          char* raw;
+          char* data;
+          size_t size;
+          size_t used;
+          Block* next;
+        };
+
+        Block* add_block(size_t size);
+
+        Block* blocks;
+        size_t in_use;
+      };
+
+      AssemblyArena** arenas;
+
+      /// The value of an ext function of the forms (Form::ext) on the current element (edge) of a thread.
+      struct FormExtFn
+      {
+        MeshFunction<Scalar>* fn;
+        int order;
+        Func<Scalar>* value;
+      };
+
+      /// Indexed [thread], see get_form_ext_fn().
+      std::vector<FormExtFn>* form_ext_fns;
+
+      /// The value of the ext function fn of a form at the quadrature order on the current element (edge) of the calling thread.
+      /// Evaluated by the first form using the function, shared read-only by the others (the weak form clones
+      /// share the functions the forms share), until free_form_ext_fns() once the element (edge) is assembled.
+      Func<Scalar>* get_form_ext_fn(MeshFunction<Scalar>* fn, int order);
+
+      /// Frees the values of get_form_ext_fn() of the calling thread.
+      void free_form_ext_fns();
+
+      /// Per-thread structures of the assembling, indexed [thread][equation], kept between the assemblings.
+      PrecalcShapeset*** thread_pss;
+      PrecalcShapeset*** thread_spss;
+      RefMap*** thread_refmaps;
+      /// NULL for the linear problems.
+      Solution<Scalar>*** thread_u_ext;
+      AsmList<Scalar>*** thread_als;
+      /// Indexed [thread], NULL if not made yet.
+      WeakForm<Scalar>** thread_weakforms;
+      /// What the per-thread structures were made for.
+      int thread_structures_num_threads;
+      std::vector<Shapeset*> thread_structures_shapesets;
+      std::vector<const Mesh*> thread_structures_meshes;
+      /// thread_u_ext are ZeroSolutions (assembling with no coefficient vector).
+      bool thread_u_ext_zero;
+      /// See set_persistent_weakform_clones().
+      bool persistent_weakform_clones;
+
+      /// Ensemble assembling (assemble_ensemble()), the number of the instances, 0 outside of it.
+      int ensemble_size;
+      /// The clones of the weak forms of the instances, indexed [thread][instance].
+      WeakForm<Scalar>*** ensemble_thread_weakforms;
+      /// Empty outside of the ensemble assembling (and if the instances have no matrices / vectors).
+      std::vector<SparseMatrix<Scalar>*> ensemble_mats;
+      std::vector<Vector<Scalar>*> ensemble_rhss;
+      /// The instance each thread assembles at the moment, indexed [thread].
+      std::vector<int> ensemble_thread_instances;
+
+      /// Checks that the weak form has the structure of the weak form of this problem (see assemble_ensemble()).
+      void check_ensemble_weakform(const WeakForm<Scalar>* instance_wf) const;
+
+      /// The matrices and the vectors of the instances other than the first one get the structure of the first one.
+      void init_ensemble_systems();
+
+      /// Ends the ensemble assembling, deletes the clones of the weak forms of the instances.
+      void free_ensemble();
+
+      /// Switches the calling thread to the instance, sets the state to the external functions of its weak form.
+      /// \return The clone of the weak form of the instance of the calling thread.
+      WeakForm<Scalar>* set_ensemble_instance(Traverse::State* current_state, int instance_i);
+
+      /// The matrix / the vector the calling thread assembles to, current_mat / current_rhs outside of the ensemble assembling.
+      inline SparseMatrix<Scalar>* get_target_matrix() const
+      {
+        return !this->ensemble_mats.empty() ? this->ensemble_mats[this->ensemble_thread_instances[omp_get_thread_num()]] : this->current_mat;
+      }
+      inline Vector<Scalar>* get_target_rhs() const
+      {
+        return !this->ensemble_rhss.empty() ? this->ensemble_rhss[this->ensemble_thread_instances[omp_get_thread_num()]] : this->current_rhs;
+      }
+
+      /// Recorded traversal of the meshes, replayed in the assemblings until the meshes change.
+      TraversePlan traverse_plan;
+
+      /// The arena of the calling thread.
+      AssemblyArena* current_arena() const;
+
+      /// Arena statistics accumulated over the finished assemblings.
+      unsigned long arena_allocations;
+      unsigned long arena_block_allocations;
+      size_t arena_peak_size;
+
       /// Exception caught in a parallel region.
       Hermes::Exceptions::Exception* caughtException;
+      omp_lock_t caught_exception_lock;
     
       
       ///* DG *///
@@ -315,7 +1055,43 @@ namespace Hermes
         PrecalcShapeset** current_pss, PrecalcShapeset** current_spss, RefMap** current_refmaps, AsmList<Scalar>** current_als,
         Traverse::State* current_state, Hermes::vector<MatrixFormDG<Scalar>*> current_mfDG, Hermes::vector<VectorFormDG<Scalar>*> current_vfDG, Transformable** fn,
         std::map<unsigned int, PrecalcShapeset *> npss, std::map<unsigned int, PrecalcShapeset *> nspss, std::map<unsigned int, RefMap *> nrefmap,
-        LightArray<NeighborSearch<Scalar>*>& neighbor_searches, unsigned int min_dg_mesh_seq, WeakForm<Scalar>* current_wf);
+        LightArray<NeighborSearch<Scalar>*>& neighbor_searches, AsmList<Scalar>** neighbor_als, unsigned int min_dg_mesh_seq, WeakForm<Scalar>* current_wf);
+
+      /// The neighbor data of the edges of one state: the NeighborSearches with the transformations of the central and the neighbor
+      /// elements (updated according to the multimesh tree), the neighbor edges with their orientation, the segments assembled
+      /// by the neighbor states and the assembly lists of the neighbor elements. See init_DG_cache().
+      struct DGStateCache
+      {
+        DGStateCache(int nvert, unsigned int num_spaces);
+        ~DGStateCache();
+
+        int nvert;
+        unsigned int num_spaces;
+        /// The edge is not an inner one on any mesh / it is an intra-element edge on all the DG meshes.
+        bool skip_edge[H2D_MAX_NUMBER_VERTICES];
+        LightArray<NeighborSearch<Scalar>*>* neighbor_searches[H2D_MAX_NUMBER_VERTICES];
+        unsigned int num_neighbors[H2D_MAX_NUMBER_VERTICES];
+        bool* processed[H2D_MAX_NUMBER_VERTICES];
+        /// neighbor_als[isurf][neighbor_i * num_spaces + space_i], NULL until the segment is assembled for the first time.
+        AsmList<Scalar>** neighbor_als[H2D_MAX_NUMBER_VERTICES];
+      };
+
+      /// The DG neighbor data is calculated during the first assembling and then kept for every state while the traversal
+      /// and the spaces stay the same, so that the reassembling (e.g. in Newton's iterations) does not search for the neighbors,
+      /// build the multimesh trees and calculate the assembly lists of the neighbor elements again.
+      void init_DG_cache(int num_states);
+      void free_DG_cache();
+      /// Sets the state being assembled by the calling thread (-1 for none).
+      void set_DG_cache_state(int state_i);
+      /// Calculates the neighbor data of all the edges of the state.
+      DGStateCache* build_DG_state_cache(Traverse::State* current_state, unsigned int min_dg_mesh_seq);
+
+      /// See init_DG_cache(), indexed by the states of the partition.
+      std::vector<DGStateCache*> DG_cache;
+      /// What the cache was built for.
+      std::vector<int> DG_cache_key;
+      /// The state of each thread.
+      std::vector<int> DG_cache_thread_states;
 
       /// Assemble DG matrix forms.
       void assemble_DG_matrix_forms(PrecalcShapeset** current_pss, PrecalcShapeset** current_spss, RefMap** current_refmaps, AsmList<Scalar>** current_als,
@@ -350,6 +1126,11 @@ namespace Hermes
       /// Initialize neighbors.
       bool init_neighbors(LightArray<NeighborSearch<Scalar>*>& neighbor_searches, Traverse::State* current_state, unsigned int min_dg_mesh_seq);
 
+      /// Decides which of the two states adjacent to the inner edge segment neighbor_i assembles its DG matrix forms:
+      /// the one with the lexicographically smaller ids of its elements (in the order of the meshes), so that every
+      /// segment is assembled exactly once, independently of the order (and the threads) the states are assembled in.
+      bool DG_segment_owned(LightArray<NeighborSearch<Scalar>*>& neighbor_searches, unsigned int neighbor_i) const;
+
       /// Initialize the tree for traversing multimesh neighbors.
       void build_multimesh_tree(NeighborNode* root, LightArray<NeighborSearch<Scalar>*>& neighbor_searches);
 
@@ -379,6 +1160,7 @@ namespace Hermes
 
       template<typename T> friend class KellyTypeAdapt;
       template<typename T> friend class LinearSolver;
+      template<typename T> friend class AffineDecomposition;
       template<typename T> friend class NewtonSolver;
       template<typename T> friend class PicardSolver;
       template<typename T> friend class RungeKutta;
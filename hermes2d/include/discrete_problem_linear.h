@@ -45,6 +45,8 @@ namespace Hermes
 
       /// Assembling.
       /// Light version, linear problems.
+      /// Without the matrix (mat NULL), the right-hand side still contains the Dirichlet lift of the matrix forms,
+      /// so that it is the same as the one assembled with the matrix (e.g. a new right-hand side for a kept matrix).
       virtual void assemble(SparseMatrix<Scalar>* mat, Vector<Scalar>* rhs = NULL, bool force_diagonal_blocks = false,
         Table* block_weights = NULL);
 
@@ -54,6 +56,11 @@ namespace Hermes
       virtual void assemble_matrix_form(MatrixForm<Scalar>* form, int order, Func<double>** base_fns, Func<double>** test_fns, Func<Scalar>** ext, Func<Scalar>** u_ext,
       AsmList<Scalar>* current_als_i, AsmList<Scalar>* current_als_j, Traverse::State* current_state, int n_quadrature_points, Geom<double>* geometry, double* jacobian_x_weights);
 
+      /// The right-hand side without the matrix (dirichlet_lift_only): only the contributions of the Dirichlet basis functions
+      /// of the form, -a(u_D, v), the same as assemble_matrix_form() adds to the right-hand side.
+      void assemble_dirichlet_lift(MatrixForm<Scalar>* form, Func<double>** base_fns, Func<double>** test_fns, Func<Scalar>** ext, Func<Scalar>** u_ext,
+        AsmList<Scalar>* current_als_i, AsmList<Scalar>* current_als_j, int n_quadrature_points, Geom<double>* geometry, double* jacobian_x_weights);
+
       template<typename T> friend class KellyTypeAdapt;
       template<typename T> friend class NewtonSolver;
       template<typename T> friend class PicardSolver;
@@ -0,0 +1,135 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_FLUX_CORRECTED_TRANSPORT_H
+#define __H2D_FLUX_CORRECTED_TRANSPORT_H
+
+#include "global.h"
+#ifdef WITH_UMFPACK
+#include "solvers/umfpack_solver.h"
+#include "space/space.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// @ingroup inner
+    /// \brief Time stepper of the algebraic flux-corrected transport (FCT) for du/dt = K u, theta-scheme in time.
+    /// \details The operators are built once by init() on the CSC pattern of the assembled matrices:
+    /// the lumped mass matrix M_L, the artificial diffusion D (d_ij = max(0, -k_ij, -k_ji)) making K + D a low order
+    /// operator, and the matrices of the three systems, factorized by their first solve.
+    /// One step() then consists of
+    /// 1. the explicit low order predictor  M_L / tau u_L = (M_L / tau + (1 - theta)(K + D)) u_n,
+    /// 2. the high order (Galerkin) solution (M_C / tau - theta K) u_H = (M_C / tau + (1 - theta) K) u_n,
+    /// 3. the antidiffusive fluxes f_ij = (m_ij / tau + theta d_ij)(u_H,i - u_H,j) - (m_ij / tau - (1 - theta) d_ij)(u_n,i - u_n,j),
+    ///    prelimited and limited by the Zalesak limiter with the bounds from u_L,
+    /// 4. the corrected solution (M_L / tau - theta (K + D)) u_new = (M_L / tau + (1 - theta)(K + D)) u_n + sum_j alpha_ij f_ij,
+    /// with no matrix copies, the matrix-vector products and the limiter run in parallel (Hermes2DApi numThreads),
+    /// node by node so that no thread writes the data of another.
+    /// Only the pairs of the limited DOFs (all by default, typically the vertex DOFs of the linear elements,
+    /// see find_linear_dofs()) are lumped, stabilized and limited, the others are kept as assembled.
+    /// The matrices have to be assembled on the same space (the same, symmetric, pattern), M_C symmetric.
+    /// Typical usage:
+    /// dp_mass.assemble(mass_matrix); dp_convection.assemble(convection_matrix);
+    /// FluxCorrectedTransport fct(0.5);
+    /// fct.init(mass_matrix, convection_matrix, time_step);
+    /// for(...) fct.step(coeff_vec, coeff_vec);
+    class HERMES_API FluxCorrectedTransport
+    {
+    public:
+      /// \param[in] theta 0 explicit, 0.5 Crank-Nicolson, 1 implicit.
+      FluxCorrectedTransport(double theta = 0.5);
+      ~FluxCorrectedTransport();
+
+      /// Builds the operators.
+      /// \param[in] mass_matrix The consistent mass matrix M_C (not divided by the time step).
+      /// \param[in] convection_matrix The matrix K of du/dt = K u.
+      /// \param[in] limited_dofs NULL for all DOFs.
+      /// The matrices are not kept, init() has to be called again after they (or the time step) change.
+      void init(CSCMatrix<double>* mass_matrix, CSCMatrix<double>* convection_matrix, double time_step, const bool* limited_dofs = NULL);
+
+      /// One time step, u_new may be u_n.
+      /// \param[in] unlimited_dofs The DOFs the fluxes of which are not limited (smooth regions), NULL for none.
+      void step(double* u_n, double* u_new, const bool* unlimited_dofs = NULL);
+
+      /// The low order predictor, the high order solution and the limited fluxes of the last step().
+      double* get_low_order_solution() const;
+      double* get_high_order_solution() const;
+      double* get_limited_flux() const;
+
+      /// The vertex DOFs of the elements of order 1 that have no neighbor of a higher order and no constrained vertex,
+      /// the DOFs for which the lumping and the limiting are consistent.
+      /// \param[out] result Array of get_num_dofs() of the space.
+      static void find_linear_dofs(const Space<double>* space, bool* result);
+
+    protected:
+      void free();
+
+      /// y = A x for the values Ax on the pattern, row by row (the pattern is symmetric).
+      void multiply(double* Ax, double* x, double* y) const;
+
+      /// Solves the system of the solver with the right hand side b into x.
+      void solve(LinearMatrixSolver<double>* solver, UMFPackVector<double>* rhs, bool& factorized, double* b, double* x);
+
+      double theta;
+      double time_step;
+      int size;
+      int nnz;
+      int* Ap;
+      int* Ai;
+      /// The pattern of the matrices (Ap, Ai), the one of the mass matrix if it has got one, shared by the system matrices.
+      SparsityPattern* pattern;
+      /// The index of the entry (j, i) for the entry (i, j), of the diagonal entry of each column.
+      int* transposed;
+      int* diagonal;
+      bool* limited;
+
+      /// The values on the pattern: consistent and lumped mass, K + D, artificial diffusion.
+      double* mass;
+      double* lumped_mass;
+      double* low_order_operator;
+      double* diffusion;
+      /// M_L / tau + (1 - theta)(K + D), M_C / tau + (1 - theta) K.
+      double* low_order_rhs;
+      double* high_order_rhs;
+      /// M_L is diagonal (all the pairs lumped), the predictor is then a division.
+      bool lumped_diagonal;
+
+      UMFPackMatrix<double>* low_order_matrix;
+      UMFPackMatrix<double>* high_order_matrix;
+      UMFPackMatrix<double>* lumped_matrix;
+      UMFPackVector<double>* low_order_vector;
+      UMFPackVector<double>* high_order_vector;
+      UMFPackVector<double>* lumped_vector;
+      UMFPackLinearMatrixSolver<double>* low_order_solver;
+      UMFPackLinearMatrixSolver<double>* high_order_solver;
+      UMFPackLinearMatrixSolver<double>* lumped_solver;
+      bool low_order_factorized, high_order_factorized, lumped_factorized;
+
+      double* u_L;
+      double* u_H;
+      double* flux;
+      double* b;
+      double* P_plus;
+      double* P_minus;
+      double* Q_plus;
+      double* Q_minus;
+      double* R_plus;
+      double* R_minus;
+    };
+  }
+}
+#endif
+#endif
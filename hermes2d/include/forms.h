@@ -36,6 +36,24 @@ namespace Hermes
 
     template<typename Scalar> class OGProjection;
 
+    /// The quantities of the functions a form uses (Form::set_demand()), the assembling precalculates and transforms
+    /// only the union of those demanded by the forms of the element.
+    enum FuncDemand
+    {
+      H2D_DEMAND_VAL = 1,       ///< val (val0, val1 of the vector valued functions).
+      H2D_DEMAND_GRAD = 2,      ///< dx, dy.
+      H2D_DEMAND_LAPLACE = 4,   ///< laplace (dx, dy are then calculated too).
+      H2D_DEMAND_CURL = 8,      ///< curl.
+      H2D_DEMAND_DIV = 16,      ///< div.
+      /// What was always calculated (the laplace with H2D_USE_SECOND_DERIVATIVES defined).
+#ifdef H2D_USE_SECOND_DERIVATIVES
+      H2D_DEMAND_DEFAULT = H2D_DEMAND_VAL | H2D_DEMAND_GRAD | H2D_DEMAND_LAPLACE | H2D_DEMAND_CURL | H2D_DEMAND_DIV,
+#else
+      H2D_DEMAND_DEFAULT = H2D_DEMAND_VAL | H2D_DEMAND_GRAD | H2D_DEMAND_CURL | H2D_DEMAND_DIV,
+#endif
+      H2D_DEMAND_ALL = H2D_DEMAND_VAL | H2D_DEMAND_GRAD | H2D_DEMAND_LAPLACE | H2D_DEMAND_CURL | H2D_DEMAND_DIV
+    };
+
     /// Calculated function values (from the class Function) on an element for assembling.
     /// @ingroup inner
     template<typename T>
@@ -49,7 +67,7 @@ namespace Hermes
 
       T *val;            ///< Function values. If T == Hermes::Ord and orders vary with direction, this returns max(h_order, v_order).
       T *dx, *dy;        ///< First-order partial derivatives.
-      T *laplace;        ///< Sum of second-order partial derivatives. Enabled by defining H2D_USE_SECOND_DERIVATIVES in h2d_common.h.
+      T *laplace;        ///< Sum of second-order partial derivatives, NULL unless H2D_DEMAND_LAPLACE is demanded.
       T *val0, *val1;    ///< Components of a vector field.
       T *dx0, *dx1;      ///< Components of the gradient of a vector field.
       T *dy0, *dy1;      ///< Components of the gradient of a vector field.
@@ -74,10 +92,33 @@ namespace Hermes
 
       int get_num_gip() const;
 
+      /// The real and the imaginary parts of the complex values attribute (one of val, dx, dy, laplace, val0, ..., div
+      /// of this instance) in separate contiguous arrays, the split storage, so that the kernels over the integration
+      /// points run on double arrays, vectorized as in the real problems (see int_fn_products()).
+      /// An attribute is converted at its first call and kept until the values change by add() or subtract().
+      /// Only for T = std::complex<double>, throws otherwise.
+      void get_split(const T* attribute, const double*& re, const double*& im);
+
     protected:
       const int num_gip; ///< Number of integration points used by this intance.
       const int nc;      ///< Number of components. Currently accepted values are 1 (H1, L2 space) and 2 (Hcurl, Hdiv space).
 
+      /// Allocates all the given value arrays as one contiguous block, each array starting on a cache line boundary.
+      /** \param[in] arrays Addresses of the members (val, dx, ...) to be allocated.
+      *  \param[in] count Number of the arrays. */
+      void allocate_storage(T** arrays[], int count);
+
+      /// Allocates the arrays of the (FuncDemand) demand by allocate_storage(), the others stay NULL.
+      void allocate_storage(unsigned int demand);
+
+      /// Contiguous block of all value arrays, NULL if the arrays were allocated one by one.
+      void* storage;
+
+      /// The split storage (see get_split()), two arrays for each attribute, NULL until the first get_split().
+      double* split_storage;
+      /// Bit i set if the attribute i (in the order of get_split()) is converted.
+      unsigned int split_done;
+
       /// Calculate this -= func for each function expations and each integration point.
       /** \param[in] func A function which is subtracted from *this. A number of integratioN points and a number of component has to match. */
       void subtract(T* attribute, T* other_attribute);
@@ -87,9 +128,11 @@ namespace Hermes
       void add(Func<T>* func);
 
       friend Func<Hermes::Ord>* init_fn_ord(const int order);
-      friend Func<double>* init_fn(PrecalcShapeset *fu, RefMap *rm, const int order);
-      template<typename Scalar> friend Func<Scalar>* init_fn(MeshFunction<Scalar>*fu, const int order);
-      template<typename Scalar> friend Func<Scalar>* init_fn(Solution<Scalar>*fu, const int order);
+      friend Func<Hermes::Ord>* get_fn_ord(const int order);
+      friend Func<double>* init_fn(PrecalcShapeset *fu, RefMap *rm, const int order, unsigned int demand);
+      friend void init_fns(PrecalcShapeset *fu, RefMap *rm, const int order, const int* shape_indices, int count, Func<double>** result, unsigned int demand);
+      template<typename Scalar> friend Func<Scalar>* init_fn(MeshFunction<Scalar>*fu, const int order, unsigned int demand);
+      template<typename Scalar> friend Func<Scalar>* init_fn(Solution<Scalar>*fu, const int order, unsigned int demand);
 
       template<typename Scalar> friend class DiscontinuousFunc;
       template<typename Scalar> friend class Adapt;
@@ -201,6 +244,12 @@ namespace Hermes
       ///< otherwise 1 (each edge has a unique global normal).
       ///< Only for edge.
 
+      /// Allocates all the given coordinate arrays as one contiguous block, each array starting on a cache line boundary.
+      void allocate_storage(T** arrays[], int count, int np);
+
+      /// Contiguous block of all coordinate arrays, NULL if the arrays were allocated one by one.
+      void* storage;
+
       friend Geom<Hermes::Ord>* init_geom_ord();
       friend Geom<double>* init_geom_vol(RefMap *rm, const int order);
       friend Geom<double>* init_geom_surf(RefMap *rm, int isurf, int marker, const int order, double3*& tan);
@@ -255,14 +304,35 @@ namespace Hermes
 
     /// Init the function for calculation the integration order.
     HERMES_API Func<Hermes::Ord>* init_fn_ord(const int order);
+    /// The function for calculation the integration order shared by all the callers, pre-built for the orders
+    /// up to H2D_FN_ORD_TABLE_SIZE - 1 (the higher orders get the highest one, above any quadrature anyway).
+    /// Read-only, not to be freed. The order calculation of DiscreteProblem uses it instead of init_fn_ord().
+    HERMES_API Func<Hermes::Ord>* get_fn_ord(const int order);
     /// Init the shape function for the evaluation of the volumetric/surface integral (transformation of values).
-    HERMES_API Func<double>* init_fn(PrecalcShapeset *fu, RefMap *rm, const int order);
+    /// \param[in] demand FuncDemand flags, only the demanded arrays are precalculated and allocated (the others are NULL).
+    HERMES_API Func<double>* init_fn(PrecalcShapeset *fu, RefMap *rm, const int order, unsigned int demand = H2D_DEMAND_DEFAULT);
+    /// The same for the shapes shape_indices[0..count-1] of the active element of fu, into result[0..count-1].
+    /// On the affine Hcurl and Hdiv elements the (covariant / contravariant) Piola map is then applied
+    /// to the reference values of all the shapes at once, as one 2x2 matrix.
+    HERMES_API void init_fns(PrecalcShapeset *fu, RefMap *rm, const int order, const int* shape_indices, int count, Func<double>** result, unsigned int demand = H2D_DEMAND_DEFAULT);
     /// Init the mesh-function for the evaluation of the volumetric/surface integral.
+    /// \param[in] demand As in init_fn(PrecalcShapeset*), H2D_DEMAND_DEFAULT without it.
+    template<typename Scalar>
+    HERMES_API Func<Scalar>* init_fn(MeshFunction<Scalar>*fu, const int order, unsigned int demand);
     template<typename Scalar>
     HERMES_API Func<Scalar>* init_fn(MeshFunction<Scalar>*fu, const int order);
     /// Init the solution for the evaluation of the volumetric/surface integral.
+    /// \param[in] demand As in init_fn(PrecalcShapeset*), H2D_DEMAND_DEFAULT without it.
+    template<typename Scalar>
+    HERMES_API Func<Scalar>* init_fn(Solution<Scalar>*fu, const int order, unsigned int demand);
     template<typename Scalar>
     HERMES_API Func<Scalar>* init_fn(Solution<Scalar>*fu, const int order);
+
+    /// sum_i wt[i] * (u1[i] * v1[i] + u2[i] * v2[i]) over the n integration points, u1 and u2 attributes of fn (e.g. its dx, dy)
+    /// and v1, v2 real (e.g. of a test function), u2 and v2 may be NULL. Complex functions are integrated on their split storage
+    /// (Func::get_split()) as four real sums over contiguous double arrays, instead of the interleaved std::complex arithmetic.
+    template<typename Scalar>
+    HERMES_API Scalar int_fn_products(int n, const double* wt, Func<Scalar>* fn, const Scalar* u1, const double* v1, const Scalar* u2 = NULL, const double* v2 = NULL);
   }
 }
 #endif
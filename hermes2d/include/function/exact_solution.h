@@ -71,6 +71,12 @@ namespace Hermes
         return value (x, y);
       };
 
+      /// Function returning the values and derivatives in n points at once, used when the
+      /// function is precalculated on an element (integration, projection, error calculation).
+      /// The default calls exact_function() point by point; override it if the function can be
+      /// evaluated in a vectorized way.
+      virtual void exact_function_batch(int n, const double* x, const double* y, Scalar* val, Scalar* dx, Scalar* dy) const;
+
       /// Function returning the integration order that
       /// should be used when integrating the function.
       virtual Hermes::Ord ord(Hermes::Ord x, Hermes::Ord y) const = 0;
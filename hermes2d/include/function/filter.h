@@ -30,6 +30,10 @@ namespace Hermes
     /// The output of Filter is an arbitrary combination of up to three input functions,
     /// which usually are Solutions to PDEs, but can also be other Filters.
     ///
+    /// A Filter keeps per-element state and must not be shared between threads. All library
+    /// filters implement clone(), which clones the inputs as well (cloned Solutions share
+    /// their coefficient arrays), so each thread can cheaply get its own instance.
+    ///
     /// (This class cannot be instantiated.)
     ///
     template<typename Scalar>
@@ -331,6 +335,100 @@ namespace Hermes
       virtual void filter_fn(int n, Hermes::vector<double*> values, double* result);
     };
 
+    /// @ingroup meshFunctions
+    /// CompositeFilter evaluates a whole expression over its inputs in one pass over the
+    /// integration points, so that chains such as MagFilter(DiffFilter(...)) do not need
+    /// a Filter (and its precalculated tables) per operation. The expression is built from
+    /// the handles returned by input() and constant(), e.g. for the magnitude of the
+    /// difference of two vector fields given by their components:
+    ///
+    ///   CompositeFilter<double> f(Hermes::vector<MeshFunction<double>*>(u1, u2, v1, v2));
+    ///   f.set_expression(sqrt(sqr(f.input(0) - f.input(2)) + sqr(f.input(1) - f.input(3))));
+    ///
+    /// The expression is a DAG: a handle used several times is evaluated once per point.
+    /// As in SimpleFilter, 'items' may select derivatives of the inputs (e.g. H2D_FN_DX_0),
+    /// but the result itself has values only.
+    template<typename Scalar>
+    class HERMES_API CompositeFilter : public SimpleFilter<Scalar>
+    {
+    public:
+      CompositeFilter(Hermes::vector<MeshFunction<Scalar>*> solutions, Hermes::vector<int> items = *(new Hermes::vector<int>));
+      virtual MeshFunction<Scalar>* clone() const;
+      virtual ~CompositeFilter();
+
+      /// Handle of a node of the expression.
+      class HERMES_API Expr
+      {
+      public:
+        Expr operator-() const { return apply(Neg); }
+        friend Expr operator+(const Expr& a, const Expr& b) { return a.apply(Add, b); }
+        friend Expr operator-(const Expr& a, const Expr& b) { return a.apply(Sub, b); }
+        friend Expr operator*(const Expr& a, const Expr& b) { return a.apply(Mul, b); }
+        friend Expr operator/(const Expr& a, const Expr& b) { return a.apply(Div, b); }
+        friend Expr operator+(const Expr& a, Scalar b) { return a + a.filter->constant(b); }
+        friend Expr operator-(const Expr& a, Scalar b) { return a - a.filter->constant(b); }
+        friend Expr operator*(const Expr& a, Scalar b) { return a * a.filter->constant(b); }
+        friend Expr operator/(const Expr& a, Scalar b) { return a / a.filter->constant(b); }
+        friend Expr operator+(Scalar a, const Expr& b) { return b.filter->constant(a) + b; }
+        friend Expr operator-(Scalar a, const Expr& b) { return b.filter->constant(a) - b; }
+        friend Expr operator*(Scalar a, const Expr& b) { return b.filter->constant(a) * b; }
+        friend Expr operator/(Scalar a, const Expr& b) { return b.filter->constant(a) / b; }
+        friend Expr sqr(const Expr& a) { return a.apply(Sqr); }
+        friend Expr sqrt(const Expr& a) { return a.apply(Sqrt); }
+        /// The absolute value (the modulus for complex numbers).
+        friend Expr abs(const Expr& a) { return a.apply(Abs); }
+
+      protected:
+        enum OperationType
+        {
+          Input,
+          Constant,
+          Add,
+          Sub,
+          Mul,
+          Div,
+          Neg,
+          Sqr,
+          Sqrt,
+          Abs
+        };
+
+        Expr(CompositeFilter* filter, int index) : filter(filter), index(index) {}
+        Expr apply(OperationType type) const { return filter->add_operation(type, index); }
+        Expr apply(OperationType type, const Expr& b) const { return filter->add_operation(type, index, b.index); }
+
+        CompositeFilter* filter;
+        int index;
+        friend class CompositeFilter;
+      };
+
+      /// The values of the i-th input function (the item selected for it).
+      Expr input(int i);
+
+      Expr constant(Scalar value);
+
+      /// Sets the expression the filter evaluates. Must be called before the filter is used.
+      void set_expression(const Expr& expression);
+
+    protected:
+      /// One node of the expression; the operands always precede the node in 'operations'.
+      struct Operation
+      {
+        typename Expr::OperationType type;
+        int a, b;
+        Scalar value;
+      };
+
+      Expr add_operation(typename Expr::OperationType type, int a, int b = -1);
+
+      Hermes::vector<Operation> operations;
+
+      /// Index of the node whose value is the result, -1 if not set.
+      int output;
+
+      virtual void filter_fn(int n, Hermes::vector<Scalar*> values, Scalar* result);
+    };
+
     /// @ingroup meshFunctions
     /// Removes the imaginary part from a function.
     class HERMES_API RealFilter : public ComplexFilter
@@ -379,10 +477,12 @@ namespace Hermes
     {
     public:
       AngleFilter(Hermes::vector<MeshFunction<std::complex<double> >*> solutions, Hermes::vector<int> items = *(new Hermes::vector<int>));
+      virtual MeshFunction<std::complex<double> >* clone() const;
       virtual ~AngleFilter();
 
     protected:
-      virtual void filter_fn(int n, Hermes::vector<std::complex<double>*> values, double* result);
+      /// The angle is stored in the real part of the result.
+      virtual void filter_fn(int n, Hermes::vector<std::complex<double>*> values, std::complex<double>* result);
     };
 
     /// @ingroup meshFunctions
@@ -155,7 +155,7 @@ namespace Hermes
       /// \param mask[in] A combination of one or more of the constants H2D_FN_VAL, H2D_FN_DX, H2D_FN_DY,
       ///   H2D_FN_DXX, H2D_FN_DYY, H2D_FN_DXY specifying the values which should be precalculated. The default is
       ///   H2D_FN_VAL | H2D_FN_DX | H2D_FN_DY. You can also use H2D_FN_ALL to precalculate everything.
-      void set_quad_order(unsigned int order, int mask = H2D_FN_DEFAULT);
+      virtual void set_quad_order(unsigned int order, int mask = H2D_FN_DEFAULT);
 
       Scalar* get_values(int a, int b);
 
@@ -209,9 +209,6 @@ namespace Hermes
       /// Current Node.
       Node* cur_node;
 
-      /// Nodes for the overflow sub-element transformation.
-      LightArray<Node*>* overflow_nodes;
-
       /// With changed sub-element mapping, there comes the need for a change of the current
       /// Node table nodes.
       void update_nodes_ptr();
@@ -229,8 +226,6 @@ namespace Hermes
 
       Node* new_node(int mask, int num_points); ///< allocates a new Node structure
 
-      virtual void  handle_overflow_idx() = 0;
-
       void replace_cur_node(Node* node);
 
       static void check_params(int component, Node* cur_node, int num_components);
@@ -262,8 +257,8 @@ namespace Hermes
       friend class VonMisesFilter;
       friend HERMES_API Geom<double>* init_geom_vol(RefMap *rm, const int order);
       friend HERMES_API Geom<double>* init_geom_surf(RefMap *rm, SurfPos* surf_pos, const int order);
-      friend HERMES_API Func<double>* init_fn(PrecalcShapeset *fu, RefMap *rm, const int order);
-      template<typename T> friend HERMES_API Func<T>* init_fn(MeshFunction<T>*fu, const int order);
+      friend HERMES_API Func<double>* init_fn(PrecalcShapeset *fu, RefMap *rm, const int order, unsigned int demand);
+      template<typename T> friend HERMES_API Func<T>* init_fn(MeshFunction<T>*fu, const int order, unsigned int demand);
     };
   }
 }
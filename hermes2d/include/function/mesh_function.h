@@ -62,6 +62,17 @@ namespace Hermes
       /// Return the value at the coordinates x,y.
       virtual Func<Scalar>* get_pt_value(double x, double y, Element* e = NULL) = 0;
 
+      /// Return the values at the coordinates x[i], y[i], i < n, in values[i] (NULL for points outside of the mesh).
+      /// The points are located in the order of the cells of Mesh::get_element_grid(), trying the element
+      /// of the previous point first.
+      void get_pt_values(const double* x, const double* y, int n, Func<Scalar>** values);
+
+      /// Evaluate the component 'component' at the coordinates x[i], y[i], i < n, into the caller-provided
+      /// arrays val, dx, dy (any of them may be NULL). Points outside of the mesh get zeros.
+      /// Returns the number of the points inside of the mesh.
+      /// This generic version goes through get_pt_value(), Solution evaluates without allocations per point.
+      virtual int get_pt_values(const double* x, const double* y, int n, Scalar* val, Scalar* dx, Scalar* dy, int component = 0);
+
       /// Cloning function - for parallel OpenMP blocks.
       /// Designed to return an identical clone of this instance.
       virtual MeshFunction<Scalar>* clone() const
@@ -96,11 +107,6 @@ namespace Hermes
       /// Internal.
       virtual void set_active_element(Element* e);
 
-      /// Virtual function handling overflows. Has to be virtual, because
-      /// the necessary iterators in the templated class do not work with GCC.
-      /// Internal.
-      virtual void handle_overflow_idx();
-
       /// See Transformable::push_transform.
       /// Internal.
       virtual void push_transform(int son);
@@ -117,6 +123,10 @@ namespace Hermes
       virtual int get_edge_fn_order(int edge);
 
     protected:
+      /// Finds the elements containing the points x[i], y[i] (NULL outside of the mesh) and the reference
+      /// coordinates xi1[i], xi2[i] in them. point_order lists the point indices grouped by the elements.
+      void locate_points(const double* x, const double* y, int n, Element** elements, double* xi1, double* xi2, int* point_order);
+
       ElementMode2D mode;
       const Mesh* mesh;
       RefMap* refmap;
@@ -134,7 +144,7 @@ namespace Hermes
       template<typename T> friend class Func;
       template<typename T> friend class Geom;
 
-      template<typename T> friend HERMES_API Func<T>* init_fn(MeshFunction<T>*fu, const int order);
+      template<typename T> friend HERMES_API Func<T>* init_fn(MeshFunction<T>*fu, const int order, unsigned int demand);
 
       template<typename T> friend class DiscontinuousFunc;
       template<typename T> friend class DiscreteProblem;
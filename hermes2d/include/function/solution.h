@@ -72,8 +72,18 @@ namespace Hermes
     /// The number of monomials is (p + 1)^2 for quads and (p + 1)*(p + 2)/2 for triangles, where
     /// 'p' is the polynomial degree.
     ///
+    /// \brief Memory used by a solution, in bytes, see Solution::get_memory_usage().
+    struct HERMES_API SolutionMemoryUsage
+    {
+      std::size_t coefficients;   ///< The monomial coefficients and the element tables, the share of this instance if they are shared by copies.
+      std::size_t tables;         ///< The element cache of the precalculated values.
+      std::size_t auxiliary;      ///< The buffer of the derivatives.
+
+      std::size_t get_total() const;
+    };
+
     template<typename Scalar>
-    class HERMES_API Solution : public MeshFunction<Scalar>, public Hermes2D::Mixins::XMLParsing
+    class HERMES_API Solution : public MeshFunction<Scalar>, public Hermes2D::Mixins::XMLParsing, public Hermes2D::Mixins::MemoryAccounted
     {
     public:
       Solution();
@@ -88,8 +98,31 @@ namespace Hermes
       void assign(Solution* sln);
       inline Solution& operator = (Solution& sln) { assign(&sln); return *this; }
 
+      /// Copies the solution. The coefficient arrays are shared with 'sln' (copy-on-write),
+      /// so copying is O(1) until one of the instances is modified.
       virtual void copy(const Solution<Scalar>* sln);
 
+      /// Copies the solution as copy() does, the copy is defined on mesh, which has to be a copy of the mesh of sln
+      /// (see Mesh::copy()), so that the copy stays valid when the original mesh changes.
+      void copy(const Solution<Scalar>* sln, const Mesh* mesh);
+
+      /// Sets the number of elements (per quadrature) for which the precalculated values are kept.
+      /// Raise it if the same elements are revisited often, e.g. when the solution is an external
+      /// function in several traversals, or in DG assembling with neighbors. The cache belongs to
+      /// this instance; assembling works on per-thread clones, each of which has its own cache.
+      /// The default is taken from Api2D::solutionElementCacheSize.
+      void set_element_cache_size(int size);
+      int get_element_cache_size() const;
+
+      /// Statistics of the element cache, counted in set_active_element() since the last reset.
+      unsigned long get_element_cache_hits() const;
+      unsigned long get_element_cache_misses() const;
+      void reset_element_cache_statistics();
+
+      /// Returns the memory used by the solution, split by the data structures.
+      SolutionMemoryUsage get_memory_usage() const;
+      virtual std::size_t get_total_memory_usage() const;
+
       /// Sets solution equal to Dirichlet lift only, solution vector = 0.
       void set_dirichlet_lift(const Space<Scalar>* space, PrecalcShapeset* pss = NULL);
 
@@ -101,6 +134,20 @@ namespace Hermes
       /// restores the solution in the memory.
       void load(const char* filename, Space<Scalar>* space);
 
+      /// Saves the solution to a binary file. The monomial coefficients, element orders and element
+      /// coefficient indices are written as raw blocks, which makes this format much faster and smaller
+      /// than the XML one of save() for large solutions. The files are not portable between platforms
+      /// of different byte order.
+      /// \param[in] compress If true, the blocks are compressed (requires WITH_ZSTD, ignored otherwise).
+      void save_bin(const char* filename, bool compress = false) const;
+
+      /// Loads the solution from a file previously created by Solution::save_bin(). The file is mapped
+      /// into memory, compressed files are decompressed block by block.
+      void load_bin(const char* filename, Space<Scalar>* space);
+
+      /// Version of the format written by save_bin(), files of other versions are rejected by load_bin().
+      static const int H2D_BINARY_SOLUTION_VERSION = 1;
+
       /// Returns solution value or derivatives at element e, in its reference domain point (xi1, xi2).
       /// 'item' controls the returned value: 0 = value, 1 = dx, 2 = dy, 3 = dxx, 4 = dyy, 5 = dxy.
       /// NOTE: This function should be used for postprocessing only, it is not effective
@@ -127,6 +174,11 @@ namespace Hermes
       /// slow. Prefer Solution::get_ref_value if possible.
       virtual Func<Scalar>* get_pt_value(double x, double y, Element* e = NULL);
 
+      /// See MeshFunction::get_pt_values(). Scalar solutions are evaluated element by element
+      /// straight from the monomial coefficients, without allocations per point.
+      virtual int get_pt_values(const double* x, const double* y, int n, Scalar* val, Scalar* dx, Scalar* dy, int component = 0);
+      using MeshFunction<Scalar>::get_pt_values;
+
       /// Multiplies the function represented by this class by the given coefficient.
       void multiply(Scalar coef);
 
@@ -135,6 +187,9 @@ namespace Hermes
 
       inline SpaceType get_space_type() const { return space_type; };
 
+      /// The polynomial order of the element with the id, the solution has to be of the type HERMES_SLN.
+      inline int get_elem_order(int id) const { return elem_orders[id]; };
+
       /// Passes solution components calculated from solution vector as Solutions.
       static void vector_to_solutions(const Scalar* solution_vector, Hermes::vector<const Space<Scalar> *> spaces,
           Hermes::vector<Solution<Scalar>*> solutions,
@@ -204,23 +259,31 @@ namespace Hermes
 
       bool transform;
 
-      /// Precalculated tables for last four used elements.
+      /// Precalculated tables for the last element_cache_size used elements, per quadrature.
       /// There is a 2-layer structure of the precalculated tables.
       /// The first (the lowest) one is the layer where mapping of integral orders to
       /// Function::Node takes place. See function.h for details.
       /// The second one is the layer with mapping of sub-element transformation to
       /// a table from the lowest layer.
       /// The highest layer (in contrast to the PrecalcShapeset class) is represented
-      /// here only by this array.
-      std::map<uint64_t, LightArray<struct Function<Scalar>::Node*>*>* tables[H2D_MAX_QUADRATURES][H2D_SOLUTION_ELEMENT_CACHE_SIZE];
+      /// here only by this array of element_cache_size slots (allocated on first use).
+      std::map<uint64_t, LightArray<struct Function<Scalar>::Node*>*>** tables[H2D_MAX_QUADRATURES];
+
+      /// The elements the slots of 'tables' belong to.
+      Element** elems[H2D_MAX_QUADRATURES];
+      /// The slot of the current element and the slot to be replaced next (per quadrature).
+      int cur_elem, oldest[H2D_MAX_QUADRATURES];
 
-      Element* elems[H2D_MAX_QUADRATURES][H2D_SOLUTION_ELEMENT_CACHE_SIZE];
-      int cur_elem, oldest[H2D_SOLUTION_ELEMENT_CACHE_SIZE];
+      int element_cache_size;
+      unsigned long element_cache_hits, element_cache_misses;
 
       Scalar* mono_coeffs;  ///< monomial coefficient array
       int* elem_coeffs[H2D_MAX_SOLUTION_COMPONENTS];  ///< array of pointers into mono_coeffs
       /// Stored element orders in the mathematical sense. The polynomial degree of the highest basis function + increments due to the element shape, etc.  .
       int* elem_orders;
+      /// Number of Solutions sharing mono_coeffs, elem_coeffs and elem_orders (see copy()),
+      /// NULL while this instance is the only owner of the arrays.
+      mutable int* coeffs_refs;
       int num_coeffs, num_elems;
       int num_dofs;
 
@@ -236,6 +299,32 @@ namespace Hermes
 
       void init_dxdy_buffer();
 
+      /// Releases mono_coeffs, elem_coeffs and elem_orders; they are deleted only if no copy shares them.
+      void free_coeffs();
+
+      /// Gives this instance its own copy of the coefficient arrays if they are shared; called before modifying them.
+      void detach_coeffs();
+
+      /// The header of the binary solution file, followed by the blocks of mono_coeffs, elem_orders and
+      /// elem_coeffs (all components one after another), each of which starts at a multiple of 8 bytes.
+      /// The block sizes are the stored (possibly compressed) sizes in bytes.
+      struct BinaryHeader
+      {
+        char magic[8];
+        int byte_order;
+        int version;
+        int scalar_size;
+        int space_type;
+        int num_components;
+        int num_elems;
+        int num_coeffs;
+        int compression;
+        uint64_t block_sizes[3];
+      };
+
+      /// Creates the solution from the (mapped) contents of a binary file.
+      void load_bin_data(const char* data, size_t size);
+
       void free_tables();
 
       Element* e_last; ///< last visited element when getting solution values at specific points
@@ -251,7 +340,7 @@ namespace Hermes
       template<typename T> friend class DiscreteProblem;
       template<typename T> friend class DiscreteProblemLinear;
       template<typename T> friend class NeighborSearch;
-      template<typename T> friend HERMES_API Func<T>* init_fn(Solution<T>*fu, const int order);
+      template<typename T> friend HERMES_API Func<T>* init_fn(Solution<T>*fu, const int order, unsigned int demand);
       template<typename T> friend class RefinementSelectors::ProjBasedSelector;
       template<typename T> friend class RefinementSelectors::H1ProjBasedSelector;
       template<typename T> friend class RefinementSelectors::L2ProjBasedSelector;
@@ -67,6 +67,21 @@ namespace Hermes
       /// \param son[in] Son element number in the range[0-3] for triangles and[0-7] for quads.
       virtual void push_transform(int son);
 
+      /// The sub-element transformation index of the son of the sub-element sub_idx.
+      /// The indices of the paths of the first levels are the paths themselves, (sub_idx << 3) + son + 1 up to H2D_MAX_IDX,
+      /// the deeper paths are numbered as they appear (H2D_DEEP_IDX_FLAG | number, shared by all the instances and threads),
+      /// so that every path up to H2D_MAX_TRN_LEVEL levels has its unique index and the caches keyed by it stay valid.
+      static uint64_t get_son_idx(uint64_t sub_idx, int son);
+
+      /// The index of the parent sub-element of sub_idx (> 0).
+      static uint64_t get_parent_idx(uint64_t sub_idx);
+
+      /// The son of the last transformation of sub_idx (> 0).
+      static int get_last_son(uint64_t sub_idx);
+
+      /// The maximum number of the transformations (the depth of the sub-element).
+      static const unsigned int H2D_MAX_TRN_LEVEL = 48;
+
     protected:
 
       Transformable();
@@ -96,7 +111,6 @@ namespace Hermes
 
       static void push_transforms(std::set<Transformable *>& transformables, int son);
       static void pop_transforms(std::set<Transformable *>& transformables);
-      static const unsigned int H2D_MAX_TRN_LEVEL = 15;
 
       /// The active element.
       Element* element;
@@ -106,12 +120,13 @@ namespace Hermes
       /// Sub-element transformation index.
       uint64_t sub_idx;
 
-      /// The largest sub_idx for top <= 10.
-      /// FIXME: Why it is only 0x4000?
-      static const uint64_t H2D_MAX_IDX = (1ULL << 3 * H2D_MAX_TRN_LEVEL) - 1;
+      /// The largest index that is the path itself (45 bits, 15 levels), see get_son_idx().
+      static const uint64_t H2D_MAX_IDX = (1ULL << 45) - 1;
+      /// The flag of the numbered indices of the deeper paths.
+      static const uint64_t H2D_DEEP_IDX_FLAG = 1ULL << 63;
 
       /// Transformation matrix stack.
-      Trf stack[21];
+      Trf stack[H2D_MAX_TRN_LEVEL + 1];
       /// Stack top.
       unsigned int top;
 
@@ -33,7 +33,7 @@
 
 /// Internal.
 #define H2D_NUM_MODES 2 ///< A number of modes, see enum ElementMode2D.
-#define H2D_SOLUTION_ELEMENT_CACHE_SIZE 2 ///< A maximum number of vertices of an element.
+#define H2D_SOLUTION_ELEMENT_CACHE_SIZE 4 ///< The default number of elements a Solution keeps precalculated values for (see Api2D::solutionElementCacheSize).
 #define H2D_MAX_NODE_ID 10000000
 #define H2D_MAX_SOLUTION_COMPONENTS 2
 
@@ -66,12 +66,20 @@
     /// An index of identity transformation.
     static const int H2D_TRF_IDENTITY = H2D_TRF_QUAD_NUM;
 
+#define H2D_MIN_SORTED_QUEUE_CHUNK 64 ///< A minimum number of elements of the adaptivity queue that are sorted at once. \internal
+
+#define H2D_OGPROJECTION_CACHE_SIZE 8 ///< A maximum number of projection matrices kept by OGProjection. \internal
+
 #define H2DRS_ASSUMED_MAX_CANDS 512 ///< An estimated maximum number of candidates. Used for purpose of reserving space. \internal \ingroup g_selectors
 
 //TODO: find out why 20 used used, should'n be there 2*(H2DRS_MAX_ORDER+1)
 #define H2DRS_INTR_GIP_ORDER 20 ///< An integration order used to integrate while evaluating a candidate. \internal \ingroup g_selectors
 #define H2DRS_MAX_ORDER_INC 1 ///< Maximum increase of an order in candidates. \ingroup g_selectors
 
+#define H2DRS_DEFAULT_PRUNING_TOLERANCE 0.5 ///< A default fraction of the smallest error found below which candidates of a higher number of DOFs are not expected to get when pruning candidates. \ingroup g_selectors
+
+#define H2DRS_MAX_REF_EXPANSIONS 3 ///< A maximum number of function expansions (f, df/dx, ...) of a reference solution a projection based selector uses. \internal \ingroup g_selectors
+
 #define H2DRS_SCORE_DIFF_ZERO 1E-13 ///< A threshold of difference between scores. Anything below this values is considered zero. \internal \ingroup g_selectors
 
 #define H2DRS_ORDER_ANY -1 ///< Any order. Used as a wildcard to indicate that a given order can by any valid order. \internal \ingroup g_selectors
@@ -145,6 +153,15 @@ namespace Hermes
       static double norm_fn_hdiv(MeshFunction<Scalar>* sln, RefMap* ru);
 
       static double get_l2_norm(Vector<Scalar>* vec);
+
+    protected:
+      /// Sums the element contributions of the norm (sln2 == NULL) or of the error over the (union) mesh.
+      /// The elements are processed in parallel by per-thread clones of the functions; the sum is
+      /// compensated and independent of the number of threads.
+      static double calc_element_sum(MeshFunction<Scalar>* sln1, MeshFunction<Scalar>* sln2, int norm_type);
+
+      /// The contribution of the current element, see calc_element_sum().
+      static double calc_element_contribution(MeshFunction<Scalar>* sln1, MeshFunction<Scalar>* sln2, int norm_type);
     };
 
     /// Projection norms.
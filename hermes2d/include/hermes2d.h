@@ -36,6 +36,7 @@
 #include "mesh/mesh_reader.h"
 #include "mesh/mesh_reader_h2d.h"
 #include "mesh/mesh_reader_h2d_xml.h"
+#include "mesh/mesh_reader_h2d_binary.h"
 #include "mesh/mesh_reader_h1d_xml.h"
 #include "mesh/mesh_reader_exodusii.h"
 
@@ -58,6 +59,15 @@
 #include "weakform/weakform.h"
 #include "discrete_problem.h"
 #include "discrete_problem_linear.h"
+#include "matrix_free_jacobian.h"
+#include "p_multigrid_precond.h"
+#include "l2_mass_inverse.h"
+#include "flux_corrected_transport.h"
+#include "affine_decomposition.h"
+#include "reference_integrals.h"
+#include "precalculated_tables.h"
+#include "cost_model.h"
+#include "cache_statistics.h"
 #include "forms.h"
 
 #include "integrals/h1.h"
@@ -80,6 +90,8 @@
 #include "views/stream_view.h"
 #include "views/vector_base_view.h"
 #include "views/vector_view.h"
+#include "views/linearizer_batch.h"
+#include "views/hdf5_writer.h"
 
 #include "mesh/refinement_type.h"
 #include "mesh/element_to_refine.h"
@@ -90,6 +102,7 @@
 #include "refinement_selectors/l2_proj_based_selector.h"
 #include "refinement_selectors/h1_proj_based_selector.h"
 #include "refinement_selectors/hcurl_proj_based_selector.h"
+#include "refinement_selectors/smoothness_selector.h"
 
 #include "adapt/adapt.h"
 #include "adapt/kelly_type_adapt.h"
@@ -0,0 +1,101 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_L2_MASS_INVERSE_H
+#define __H2D_L2_MASS_INVERSE_H
+
+#include "global.h"
+#include "space/space.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// @ingroup inner
+    /// \brief Inverse of the mass matrix (the L2 product of the basis functions) of L2 spaces, without any global assembling.
+    /// \details The basis functions of L2Space do not overlap the elements, so the mass matrix is block diagonal by the elements
+    /// and its inverse consists of the inverses of the element blocks. On an element with a constant jacobian (a triangle or
+    /// a parallelogram), the block is the block of the reference element times the jacobian, so the inverse of the reference
+    /// block is calculated once for every shapeset, element mode and order and only scaled. The blocks of the other elements
+    /// are integrated with their reference maps and inverted. With L2ShapesetLegendre on quadrilaterals, the blocks are diagonal
+    /// and apply() only scales the coefficients.
+    /// The blocks are calculated in compute() again only if the spaces changed.
+    /// Typical usage, an explicit step M k = f of a DG problem:
+    /// Hermes::Hermes2D::L2MassInverse<double> mass_inverse(&space);
+    /// mass_inverse.compute();
+    /// mass_inverse.apply(f, k);
+    template<typename Scalar>
+    class HERMES_API L2MassInverse
+    {
+    public:
+      L2MassInverse(Hermes::vector<const Space<Scalar>*> spaces);
+      L2MassInverse(const Space<Scalar>* space);
+      ~L2MassInverse();
+
+      /// Calculates the inverses of the element blocks, if the spaces changed since the last call.
+      void compute();
+
+      /// out = M^{-1} in, the vectors are numbered as the DOFs of the spaces and may be the same.
+      void apply(const Scalar* in, Scalar* out) const;
+
+      /// All the blocks are diagonal.
+      bool is_diagonal() const;
+
+      /// Number of the element blocks.
+      int get_num_blocks() const;
+
+    protected:
+      /// The inverse of the block of one element is scale * inverse, with the inverse possibly shared by the elements
+      /// with the same reference block.
+      struct Block
+      {
+        unsigned int cnt;
+        int* dofs;
+        double scale;
+        double** inverse;
+        bool diagonal;
+        bool owns_inverse;
+      };
+
+      /// Inverse of the reference block (the mass matrix of the shape functions of the element on the reference element).
+      struct ReferenceInverse
+      {
+        double** inverse;
+        bool diagonal;
+      };
+
+      void free();
+
+      /// Integrates the block of the shape functions idx on the element e with the jacobian jac (NULL on the reference element)
+      /// using the quadrature order order.
+      static double** calculate_block(PrecalcShapeset* pss, Element* e, int* idx, unsigned int cnt, int order, double* jac);
+
+      /// Inverts the block (overwritten by its LU decomposition), returns whether the inverse is diagonal.
+      static bool invert_block(double** block, unsigned int cnt, double** inverse);
+
+      /// The order of the quadrature integrating the products of the shape functions of the element exactly.
+      int get_quadrature_order(const Space<Scalar>* space, Element* e, bool const_jacobian) const;
+
+      Hermes::vector<const Space<Scalar>*> spaces;
+      /// The seqs of the spaces the blocks were calculated for.
+      Hermes::vector<int> seqs;
+
+      Hermes::vector<Block> blocks;
+      /// Reference inverses by the space, the element mode and the shape function indices.
+      std::map<std::vector<int>, ReferenceInverse> reference_inverses;
+    };
+  }
+}
+#endif
@@ -100,12 +100,49 @@ namespace Hermes
 
       /// Get the Residual.
       Vector<Scalar>* get_residual();
+
+      /// Assemble the system with the bubble DOFs condensed (see DiscreteProblem::set_static_condensation()),
+      /// get_sln_vector() still returns all the DOFs, get_jacobian() and get_residual() the condensed system.
+      void set_static_condensation(bool to_set = true);
+
+      /// The matrix forms do not depend on the time (nor on the solution), e.g. the heat equation with constant coefficients.
+      /// The matrix and its factorization are then kept from the first solve(), the following ones (after set_time())
+      /// assemble and solve only the right-hand side. They are rebuilt after the time step, the spaces (their seq)
+      /// or the weak formulation change. Not used with the static condensation (its right-hand side needs the matrix).
+      void set_time_independent_jacobian(bool onOff = true);
+
+      /// The number of solve() calls that reused the matrix (see set_time_independent_jacobian()).
+      unsigned int get_num_saved_assemblies() const;
+
+      /// The matrix solver analyzes the pattern of the matrix while its values are being assembled
+      /// (see DiscreteProblem::set_structure_analysis()), the factorization then does only the numeric phase.
+      /// Supported by UMFPACK and (centralized) MUMPS, the other solvers ignore it. Not used with the static condensation.
+      void set_pipelined_analysis(bool to_set = true);
+
+      /// Solves an ensemble of the instances of the problem differing only in their coefficients and right-hand sides,
+      /// the weak forms wfs[k] have the structure of the weak form of the problem (see DiscreteProblem::assemble_ensemble()).
+      /// The systems of all the instances are assembled in one traversal (on the same sparsity pattern) and solved one after another.
+      /// The matrices, the vectors and the matrix solvers of the instances are kept for the next call with the same number of them.
+      void solve_ensemble(const Hermes::vector<WeakForm<Scalar>*>& wfs);
+
+      /// The solution vector of the instance instance_i of the last solve_ensemble().
+      Scalar* get_ensemble_sln_vector(int instance_i);
     protected:
+      /// The kept matrix is still valid for the current spaces, time step and weak formulation.
+      bool jacobian_reusable();
+
+      /// Records what the matrix was assembled for.
+      void store_jacobian_key();
+
       DiscreteProblemLinear<Scalar>* dp; ///< FE problem being solved.
 
       /// The solution vector.
       Scalar* sln_vector;
 
+      /// The solution vector with the bubble DOFs recovered, if the static condensation is used.
+      Scalar* expanded_sln_vector;
+      int expanded_sln_vector_size;
+
       /// Jacobian.
       SparseMatrix<Scalar>* jacobian;
 
@@ -117,6 +154,25 @@ namespace Hermes
       
       /// This instance owns its DP.
       const bool own_dp;
+
+      /// See set_time_independent_jacobian().
+      bool time_independent_jacobian;
+      /// The matrix is valid for the key below.
+      bool jacobian_valid;
+      std::vector<int> jacobian_space_seqs;
+      double jacobian_time_step;
+      const WeakForm<Scalar>* jacobian_wf;
+      int jacobian_ndof;
+      unsigned int num_saved_assemblies;
+
+      /// See set_pipelined_analysis().
+      bool pipelined_analysis;
+
+      /// The systems of the instances of solve_ensemble().
+      Hermes::vector<SparseMatrix<Scalar>*> ensemble_jacobians;
+      Hermes::vector<Vector<Scalar>*> ensemble_residuals;
+      Hermes::vector<LinearMatrixSolver<Scalar>*> ensemble_matrix_solvers;
+      void free_ensemble();
     };
   }
 }
@@ -0,0 +1,80 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_MATRIX_FREE_JACOBIAN_H
+#define __H2D_MATRIX_FREE_JACOBIAN_H
+
+#include "discrete_problem.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// @ingroup inner
+    /// \brief The Jacobian (the matrix) of a DiscreteProblem at a given coefficient vector, which is never stored.
+    /// \details multiply_with_vector(x, y) runs the assembling of the matrix forms with this object in place of the
+    /// matrix, every contribution J[m][n] of an element is immediately turned into y[m] += J[m][n] * x[n]. The weak
+    /// forms, the traversal, the threads and the cache of the shape functions and the geometry of DiscreteProblem
+    /// are used as they are, no sparse structure is created. Suitable for iterative (Krylov) methods and explicit
+    /// methods that only need the products with the matrix.
+    /// Typical usage:
+    /// Hermes::Hermes2D::MatrixFreeJacobian<double> jacobian(&dp, coeff_vec);
+    /// jacobian.multiply_with_vector(x, y);
+    template<typename Scalar>
+    class HERMES_API MatrixFreeJacobian : public SparseMatrix<Scalar>
+    {
+    public:
+      /// @param[in] coeff_vec The coefficient vector at which the Jacobian is evaluated (copied), NULL for linear problems.
+      MatrixFreeJacobian(DiscreteProblem<Scalar>* dp, Scalar* coeff_vec = NULL, bool force_diagonal_blocks = false, Table* block_weights = NULL);
+      virtual ~MatrixFreeJacobian();
+
+      /// Changes the coefficient vector at which the Jacobian is evaluated (copied).
+      void set_coeff_vector(Scalar* coeff_vec);
+
+      /// y = J x, by assembling the matrix forms.
+      virtual void multiply_with_vector(Scalar* vector_in, Scalar* vector_out);
+
+      /// The structure is not created at all.
+      virtual void prealloc(unsigned int n);
+      virtual void pre_add_ij(unsigned int row, unsigned int col);
+      virtual void alloc_with_structure(unsigned int n, const int* col_start, const int* rows);
+      virtual void alloc();
+      virtual void free();
+      virtual void zero();
+
+      /// The contributions of the assembling, added to the product.
+      virtual void add(unsigned int m, unsigned int n, Scalar v);
+      virtual void add(unsigned int m, unsigned int n, Scalar **mat, int *rows, int *cols);
+      virtual void add_to_diagonal(Scalar v);
+
+      /// The entries are not available.
+      virtual Scalar get(unsigned int m, unsigned int n);
+      virtual bool dump(FILE *file, const char *var_name, EMatrixDumpFormat fmt = DF_MATLAB_SPARSE, char* number_format = "%lf");
+      virtual unsigned int get_matrix_size() const;
+      virtual double get_fill_in() const;
+
+    protected:
+      DiscreteProblem<Scalar>* dp;
+      Scalar* coeff_vec;
+      bool force_diagonal_blocks;
+      Table* block_weights;
+
+      /// The vectors of the product being calculated.
+      Scalar* vector_in;
+      Scalar* vector_out;
+    };
+  }
+}
+#endif
@@ -70,6 +70,9 @@ namespace Hermes
         coeffs = NULL;};
         CurvMap(CurvMap* cm);
         ~CurvMap();
+
+        /// Releases the cached coefficients of refined curved elements, see precalculate_refmap_coeffs().
+        static void clear_coeffs_cache();
     private:
       /// this structure defines a curved mapping of an element; it has two
       /// modes, depending on the value of 'toplevel'
@@ -101,8 +104,34 @@ namespace Hermes
       /// order: 'e' is a pointer to the element to which this CurvMap
       /// belongs to. First, old "coeffs" are removed if they are not NULL,
       /// then new coefficients are projected.
+      /// The coefficients of refined elements are cached by the geometry of their base mesh element and
+      /// the transformation path, so that the same sons in (copies of) meshes are only projected once.
       void update_refmap_coeffs(Element* e);
 
+      /// Calls update_refmap_coeffs() for all the (curved) elements, by num_threads threads.
+      static void precalculate_refmap_coeffs(const std::vector<Element*>& elements, int num_threads);
+
+      /// Key of the cache of the coefficients: the vertices, the base mesh element's vertices and curves,
+      /// the transformation path and the order. Zeroed before filled in, compared bytewise.
+      struct CoeffsCacheKey
+      {
+        CoeffsCacheKey(Element* e, Element* parent, uint64_t part, int order);
+        bool operator<(const CoeffsCacheKey& other) const;
+
+        int nvert;
+        int order;
+        uint64_t part;
+        double vertices[2 * H2D_MAX_NUMBER_VERTICES];
+        double parent_vertices[2 * H2D_MAX_NUMBER_VERTICES];
+        Nurbs* nurbs[H2D_MAX_NUMBER_EDGES];
+      };
+
+      /// The cached coefficients (their count and the array), the keys hold a reference to the curves.
+      static std::map<CoeffsCacheKey, std::pair<int, double2*> > coeffs_cache;
+
+      /// Maximum number of the cached coefficient arrays, the cache is cleared once it is reached.
+      static const int H2D_MAX_CACHED_COEFFS = 16384;
+
       void get_mid_edge_points(Element* e, double2* pt, int n);
 
       static double** edge_proj_matrix;  ///< projection matrix for each edge is the same
@@ -116,10 +145,21 @@ namespace Hermes
       static Quad1DStd quad1d;
       static Quad2DStd quad2d; ///<  fixme: g_quad_2d_std
 
-      static Trf ctm;
+      /// The knot span of the parameter t of the curve (from 0 to 1): kv[span] <= t < kv[span + 1],
+      /// the last non-empty span for the end of the curve.
+      /// \param[in] guess The span to start the search from (that of the previous point of a batch), -1 for none.
+      static int nurbs_find_span(const Nurbs* nurbs, double t, int guess = -1);
+
+      /// The degree + 1 basis functions N_{span - degree}, ..., N_{span} of the curve non-zero in the knot span,
+      /// calculated iteratively (de Boor) by O(degree^2) operations.
+      static void nurbs_basis_fns(const Nurbs* nurbs, int span, double t, double* N);
 
-      /// Recursive calculation of the basis function N_i,k(int i, int k, double t, double* knot).
-      static double nurbs_basis_fn(int i, int k, double t, double* knot);
+      /// The point of the curve at the parameter t (from 0 to 1).
+      /// \param[in, out] span The knot span of the previous point (-1 for none), the one of t on return.
+      static void nurbs_point(const Nurbs* nurbs, double t, int& span, double& x, double& y);
+
+      /// The points (only) of nurbs_edge() at the parameters t[0], ..., t[n - 1], each knot span search starts at the previous one.
+      static void nurbs_edge_points(Element* e, Nurbs* nurbs, int edge, int n, const double* t, double2* pts);
 
       // Nurbs curve: t goes from -1 to 1, function returns x, y coordinates in plane
       // as well as the unit normal and unit tangential vectors. This is done using
@@ -137,17 +177,23 @@ namespace Hermes
 
       static void calc_ref_map(Element* e, Nurbs** nurbs, double xi_1, double xi_2, double2& f);
 
+      /// calc_ref_map() in the n points (xi_1[i], xi_2[i]), each curve is evaluated in all the points at once.
+      static void calc_ref_map(Element* e, Nurbs** nurbs, int n, const double* xi_1, const double* xi_2, double2* f);
+
       static void precalculate_cholesky_projection_matrix_edge(H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss);
       static double** calculate_bubble_projection_matrix(int nb, int* indices, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss, ElementMode2D mode);
       static void precalculate_cholesky_projection_matrices_bubble(H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss);
+      /// The projection matrices needed for the element, calculated once, thread-safe.
+      static void precalculate_projection_matrices(Element* e, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss);
 
-      static void edge_coord(Element* e, int edge, double t, double2& x, double2& v);
-      static void calc_edge_projection(Element* e, int edge, Nurbs** nurbs, int order, double2* proj, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss);
+      /// The transformation ctm maps the reference element to the part of the (base mesh) element e.
+      static void edge_coord(Element* e, const Trf& ctm, int edge, double t, double2& x, double2& v);
+      static void calc_edge_projection(Element* e, const Trf& ctm, int edge, Nurbs** nurbs, int order, double2* proj, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss);
 
       static void old_projection(Element* e, int order, double2* proj, double* old[2], H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss);
-      static void calc_bubble_projection(Element* e, Nurbs** nurbs, int order, double2* proj, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss);
+      static void calc_bubble_projection(Element* e, const Trf& ctm, Nurbs** nurbs, int order, double2* proj, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss);
 
-      static void ref_map_projection(Element* e, Nurbs** nurbs, int order, double2* proj, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss);
+      static void ref_map_projection(Element* e, const Trf& ctm, Nurbs** nurbs, int order, double2* proj, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss);
 
       static bool warning_issued;
       template<typename T> friend class Space;
@@ -164,6 +210,7 @@ namespace Hermes
       friend class MeshReader;
       friend class MeshReaderH2D;
       friend class MeshReaderH2DXML;
+      friend class MeshReaderH2DBinary;
       friend CurvMap* create_son_curv_map(Element* e, int son);
     };
   }
@@ -26,6 +26,7 @@ namespace Hermes
       template<typename Scalar> class HOnlySelector;
       template<typename Scalar> class POnlySelector;
       template<typename Scalar> class OptimumSelector;
+      template<typename Scalar> class SmoothnessSelector;
     };
 
     /// A refinement record. \ingroup g_adapt
@@ -67,6 +68,7 @@ namespace Hermes
       template<typename T> friend class RefinementSelectors::HOnlySelector;
       template<typename T> friend class RefinementSelectors::POnlySelector;
       template<typename T> friend class RefinementSelectors::OptimumSelector;
+      template<typename T> friend class RefinementSelectors::SmoothnessSelector;
     };
   }
 }
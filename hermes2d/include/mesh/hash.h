@@ -49,6 +49,12 @@ namespace Hermes
 
       static const int H2D_DEFAULT_HASH_SIZE = 0x8000; // 32K entries
 
+      /// Statistics of the synonym lists: the mean and the maximum number of nodes
+      /// visited when searching for a stored node, and the current number of buckets.
+      void get_hash_statistics(double& mean_probe_length, int& max_probe_length, int& num_buckets) const;
+
+      /// Memory used by the node array and the hash tables, in bytes.
+      std::size_t get_memory_size() const;
 
     protected:
       HashTable();
@@ -85,6 +91,11 @@ namespace Hermes
       /// Reconstructs the hashtable, after, e.g., the nodes have been loaded from a file.
       void rebuild();
 
+      /// Grows the tables (keeping the size a power of two) so that they have at least as many buckets
+      /// as the given number of nodes. Called automatically when a node is created and the number
+      /// of nodes exceeds the number of buckets, except during concurrent access.
+      void rehash(int num_nodes);
+
       /// Frees all memory used by the instance.
       void free();
 
@@ -94,6 +105,18 @@ namespace Hermes
       /// Removes an edge node with parent id's p1 and p2.
       void remove_edge_node(int id);
 
+      /// Enables concurrent access to the tables (used by Mesh::refine_all_elements()).
+      /// The buckets are then guarded by striped locks and the node array by the critical section
+      /// hash_table_nodes, the node array must have its pages reserved and be append-only.
+      /// Every node with id >= first_stamped_node obtained by get_vertex_node() or get_edge_node()
+      /// gets node_stamps[id - first_stamped_node] lowered to the current stamp of the calling thread,
+      /// thread_stamps[omp_get_thread_num()], which is then incremented.
+      void begin_concurrent_access(int first_stamped_node, uint64_t* node_stamps, uint64_t* thread_stamps);
+      /// Disables concurrent access.
+      void end_concurrent_access();
+      /// True between begin_concurrent_access() and end_concurrent_access().
+      inline bool is_concurrent() const { return locks != NULL; }
+
       // Internal members
     private:
 
@@ -108,8 +131,17 @@ namespace Hermes
       /// Returns the node matching the parent ids p1 and p2.
       Node* search_list(Node* node, int p1, int p2) const;
 
-      /// Creates a copy of a hash synonym list.
-      void copy_list(Node** ptr, Node* node);
+      /// Concurrent access, see begin_concurrent_access().
+      static const int H2D_HASH_LOCKS = 256;
+      omp_lock_t* locks;
+      int first_stamped_node;
+      uint64_t* node_stamps;
+      uint64_t* thread_stamps;
+      inline void lock_bucket(int i) { if(locks != NULL) omp_set_lock(locks + (i & (H2D_HASH_LOCKS - 1))); }
+      inline void unlock_bucket(int i) { if(locks != NULL) omp_unset_lock(locks + (i & (H2D_HASH_LOCKS - 1))); }
+      void stamp(Node* node);
+      Node* add_node();
+      void remove_node(int id);
 
       friend struct Node;
       friend class MeshReaderH2D;
@@ -33,12 +33,15 @@ namespace Hermes
 
     class Element;
     class HashTable;
+    class Mesh;
 
     template<typename Scalar> class Space;
     template<typename Scalar> class KellyTypeAdapt;
     struct MItem;
     struct Rect;
     extern unsigned g_mesh_seq;
+    /// Returns g_mesh_seq and increments it, safe for meshes created concurrently.
+    HERMES_API unsigned next_mesh_seq();
 
     namespace RefinementSelectors
     {
@@ -122,10 +125,10 @@ namespace Hermes
     public:
       Element();
       int id;              ///< element id number
-      bool active;   ///< 0 = active, no sons; 1 = inactive (refined), has sons
-      bool used;     ///< array item usage flag
+      unsigned active:1;   ///< 1 = active, no sons; 0 = inactive (refined), has sons
+      unsigned used:1;     ///< array item usage flag
+      unsigned visited:1;  ///< true if the element has been visited during assembling
       Element* parent;     ///< pointer to the parent element for the current son
-      bool visited;        ///< true if the element has been visited during assembling
       
       /// Calculates the area of the element. For curved elements, this is only
       /// an approximation: the curvature is not accounted for.
@@ -161,22 +164,27 @@ namespace Hermes
       bool bsplit() const;
 
     protected:
+      // The members are ordered so that there is no padding between them on 64-bit platforms.
+
+      /// Increase in integration order, see RefMap::calc_inv_ref_order()
+      int iro_cache;
+
       CurvMap* cm; ///< curved mapping, NULL if not curvilinear
       /// Serves for saving the once calculated area of this element.
-      bool areaCalculated;
-      /// Serves for saving the once calculated area of this element.
       double area;
 
-      bool center_set;
       double x_center, y_center;
 
-      /// Serves for saving the once calculated diameter of this element.
-      bool diameterCalculated;
       /// Serves for saving the once calculated diameter of this element.
       double diameter;
 
-      /// Increase in integration order, see RefMap::calc_inv_ref_order()
-      int iro_cache;
+      /// Serves for saving the once calculated area of this element.
+      /// The flags of the values calculated on demand are not packed with the other ones,
+      /// they may be set by several threads at once.
+      bool areaCalculated;
+      bool center_set;
+      /// Serves for saving the once calculated diameter of this element.
+      bool diameterCalculated;
 
       /// Helper functions to obtain the index of the next or previous vertex/edge
       int next_vert(int i) const;
@@ -198,6 +206,7 @@ namespace Hermes
       friend class MeshReaderH2D;
       friend class MeshReaderH1DXML;
       friend class MeshReaderH2DXML;
+      friend class MeshReaderH2DBinary;
       friend class PrecalcShapeset;
       template<typename Scalar> friend class Space;
       template<typename Scalar> friend class Adapt;
@@ -233,6 +242,131 @@ namespace Hermes
       friend CurvMap* create_son_curv_map(Element* e, int son);
     };
 
+    /// \brief Immutable flat view of the active elements of a mesh, for read-only passes.
+    /// \details The active elements are numbered 0, ..., get_num_elements() - 1 in the order
+    /// of their ids, their data are stored in plain arrays (vertices by four, triangles have -1 as the
+    /// fourth one). Vertices are numbered 0, ..., get_num_vertices() - 1 in the order of their node ids.
+    /// The neighbor across an edge is the active element sharing the edge node,
+    /// -1 on the boundary and on hanging edges.
+    /// Obtained by Mesh::get_snapshot(), which rebuilds it when get_seq() of the mesh changes.
+    class HERMES_API MeshSnapshot
+    {
+    public:
+      MeshSnapshot(const Mesh* mesh);
+      ~MeshSnapshot();
+
+      /// Returns true if the snapshot was built for the current state of the mesh.
+      bool is_valid(const Mesh* mesh) const;
+
+      inline int get_num_elements() const { return num_elements; }
+      inline int get_num_vertices() const { return num_vertices; }
+
+      /// Per element.
+      inline Element* get_element(int i) const { return elements[i]; }
+      inline int get_element_id(int i) const { return element_ids[i]; }
+      inline int get_nvert(int i) const { return vertices[4 * i + 3] < 0 ? 3 : 4; }
+      inline const int* get_vertices(int i) const { return vertices + 4 * i; }
+      inline const int* get_neighbors(int i) const { return neighbors + 4 * i; }
+      inline int get_marker(int i) const { return markers[i]; }
+      inline bool is_curved(int i) const { return curved[i]; }
+
+      /// Per vertex.
+      inline double get_x(int v) const { return x[v]; }
+      inline double get_y(int v) const { return y[v]; }
+      inline int get_vertex_node_id(int v) const { return vertex_node_ids[v]; }
+
+      /// Index of the active element with the given id, -1 if it is not active.
+      inline int get_index(int element_id) const { return element_id < max_element_id ? indices[element_id] : -1; }
+
+      /// Memory used by the snapshot, in bytes.
+      std::size_t get_memory_size() const;
+
+    private:
+      unsigned seq;
+      int num_elements, num_vertices, max_element_id;
+
+      Element** elements;
+      int* element_ids;
+      int* vertices;
+      int* neighbors;
+      int* markers;
+      bool* curved;
+
+      double* x;
+      double* y;
+      int* vertex_node_ids;
+
+      int* indices;
+    };
+
+    /// \brief Memory used by a mesh, in bytes, see Mesh::get_memory_usage().
+    struct HERMES_API MeshMemoryUsage
+    {
+      std::size_t elements;     ///< The element array, including the unused items.
+      std::size_t nodes;        ///< The node array, including the unused items.
+      std::size_t hash_tables;  ///< The vertex and edge node hash tables.
+      std::size_t curved_maps;  ///< The curved maps and their coefficients.
+      std::size_t auxiliary;    ///< The snapshot, the element grid, the neighbor table and the refinement history.
+
+      std::size_t get_total() const;
+    };
+
+    /// \brief Cached result of the search for the neighbors across an edge of an active element.
+    /// \details See NeighborSearch::set_active_edge() and Mesh::set_neighbor_table(). The elements are stored
+    /// by ids together with their creation stamps, so that an entry is recognized as stale once any of these
+    /// elements has been refined or removed.
+    struct HERMES_API NeighborTableEntry
+    {
+      int neighborhood_type;
+
+      /// The central element first, then the neighbors.
+      std::vector<int> element_ids;
+      std::vector<unsigned int> element_stamps;
+
+      /// Per neighbor: the local number of the edge on the neighbor and its orientation.
+      std::vector<int> local_edges;
+      std::vector<bool> orientations;
+
+      /// Per neighbor: the transformations of the central element (neighbor), empty if there are none.
+      std::vector<std::vector<unsigned int> > central_transformations;
+      std::vector<std::vector<unsigned int> > neighbor_transformations;
+    };
+
+    /// \brief Uniform grid over the bounding boxes of the active elements of a mesh.
+    /// \details Used to locate the element containing a physical point
+    /// (RefMap::element_on_physical_coordinates()) without walking the whole mesh.
+    /// The grid has roughly as many cells as there are active elements, the boxes
+    /// of curved elements are enlarged by half of their diameter.
+    class HERMES_API ElementGrid
+    {
+    public:
+      ElementGrid(const Mesh* mesh);
+      ~ElementGrid();
+
+      /// Returns true if the grid was built for the current state of the mesh.
+      bool is_valid(const Mesh* mesh) const;
+
+      /// Returns the elements whose boxes may contain the point, the number of them in 'count'.
+      Element** get_candidates(double x, double y, int& count) const;
+
+      /// Returns the index of the cell containing the point, -1 if outside of the grid.
+      int get_cell(double x, double y) const;
+
+      /// Memory used by the grid, in bytes.
+      std::size_t get_memory_size() const;
+
+    private:
+      unsigned seq;
+      int num_active_elements;
+
+      double x_min, y_min, cell_width, cell_height;
+      int nx, ny;
+
+      /// Elements of the cell i are cell_elements[cell_start[i]], ..., cell_elements[cell_start[i + 1] - 1].
+      int* cell_start;
+      Element** cell_elements;
+    };
+
     /// \brief Represents a finite element mesh.
     /// Typical usage:
     /// Hermes::Hermes2D::Mesh mesh;
@@ -246,7 +380,7 @@ namespace Hermes
     ///&nbsp;e.print_msg();
     ///&nbsp;return -1;
     /// }
-    class HERMES_API Mesh : public HashTable, public Hermes::Hermes2D::Mixins::StateQueryable
+    class HERMES_API Mesh : public HashTable, public Hermes::Hermes2D::Mixins::StateQueryable, public Hermes::Hermes2D::Mixins::MemoryAccounted
     {
     public:
       Mesh();
@@ -303,6 +437,9 @@ namespace Hermes
       /// Returns the number of edge nodes.
       int get_num_edge_nodes() const;
 
+      /// Returns the history of the refinements of the base mesh, see refinements.
+      const Hermes::vector<std::pair<unsigned int, int> >& get_refinements() const;
+
       /// Refines an element.
       /// \param id[in] Element id number.
       /// \param refinement[in] Ignored for triangles. If the element
@@ -315,6 +452,12 @@ namespace Hermes
       /// \param refinement[in] Same meaning as in refine_element_id().
       void refine_all_elements(int refinement = 0, bool mark_as_initial = false);
 
+      /// Refines the elements ids[i] by refinement_types[i] (same meaning as in refine_element_id(), -1 skips the element),
+      /// with the same result as refine_element_id() called in this order, except that the new elements may get other ids
+      /// (they are appended, the ids of the removed elements are not reused).
+      /// Large sets of elements are refined by several threads (Hermes2DApi numThreads), see refine_elements_parallel().
+      void refine_elements(const std::vector<int>& ids, const std::vector<int>& refinement_types);
+
       /// Selects elements to refine according to a given criterion and
       /// performs 'depth' levels of refinements. The criterion function
       /// receives a pointer to an element to be considered.
@@ -361,6 +504,26 @@ namespace Hermes
       /// refine_all_elements().
       void unrefine_all_elements(bool keep_initial_refinements = true);
 
+      /// Renumbers the elements and the nodes along the Hilbert curve through their centers,
+      /// so that the elements neighboring in the mesh are mostly neighbors also in the memory
+      /// and in the traversal order. The base elements, the initial refinements and the rest
+      /// of the elements are renumbered separately, as are the top-level vertices and the
+      /// other nodes, so that the unused ids and the meaning of the counts stay intact.
+      /// Spaces on this mesh hold per-element data and have to be created after this call,
+      /// or reordered by Space::reorder_element_data(). Adapt reorders only the meshes that
+      /// have no spaces besides those being adapted.
+      /// \param[out] new_element_ids If not NULL, filled with the new ids indexed by the old ones,
+      /// it has to have (at least) get_max_element_id() items.
+      /// \param[in] first_element_id Elements with lower ids keep their ids.
+      void reorder_hilbert(int* new_element_ids = NULL, int first_element_id = 0);
+
+      /// Splits the active elements into num_parts parts of (almost) the same number of elements,
+      /// contiguous along the Hilbert curve through the element centers. The result depends only
+      /// on the mesh, so that all the processes of a distributed computation get the same partition.
+      /// \param[out] parts Filled with the part of every active element (-1 for the other ids),
+      /// it has to have (at least) get_max_element_id() items.
+      void partition_elements(int num_parts, int* parts) const;
+
       /// For internal use.
       Element* get_element_fast(int id) const;
 
@@ -370,6 +533,39 @@ namespace Hermes
       /// For internal use.
       void set_seq(unsigned seq);
 
+      /// For internal use.
+      /// Returns the point location grid of the active elements, (re)built on demand.
+      /// The returned grid stays allocated until the grid is rebuilt twice (i.e. until the second change of the mesh).
+      const ElementGrid* get_element_grid() const;
+
+      /// For internal use.
+      /// Returns the flat view of the active elements, (re)built on demand.
+      /// The returned snapshot stays allocated until the snapshot is rebuilt twice.
+      const MeshSnapshot* get_snapshot() const;
+
+      /// Returns the memory used by the mesh, split by the data structures.
+      MeshMemoryUsage get_memory_usage() const;
+      virtual std::size_t get_total_memory_usage() const;
+
+      /// Turns on (off) the table of neighbors across the edges of active elements, filled by NeighborSearch
+      /// (default: off). An entry stays in use until one of the elements it refers to is refined or removed,
+      /// so refining (unrefining) a part of the mesh only causes the searches around that part to be repeated.
+      void set_neighbor_table(bool enabled);
+
+      /// For internal use.
+      bool is_neighbor_table_enabled() const;
+
+      /// For internal use.
+      /// Looks up the entry for the edge of the active element, returns false if there is no valid one.
+      bool get_neighbor_table_entry(int element_id, int edge, NeighborTableEntry& entry) const;
+
+      /// For internal use.
+      void set_neighbor_table_entry(int element_id, int edge, const NeighborTableEntry& entry) const;
+
+      /// For internal use.
+      /// Creation stamp of the element, see NeighborTableEntry.
+      unsigned int get_element_stamp(int id) const;
+
       /// Class for creating reference mesh.
       class HERMES_API ReferenceMeshCreator
       {
@@ -430,6 +626,36 @@ namespace Hermes
       int nactive;
       unsigned seq;
 
+      /// See get_element_grid().
+      mutable ElementGrid* element_grid;
+
+      /// The grid replaced by the last rebuild, see get_element_grid().
+      mutable ElementGrid* retired_element_grid;
+
+      /// See get_snapshot().
+      mutable MeshSnapshot* snapshot;
+
+      /// The snapshot replaced by the last rebuild, see get_snapshot().
+      mutable MeshSnapshot* retired_snapshot;
+
+      /// The number of the spaces on this mesh (maintained by Space), Adapt reorders the mesh only
+      /// if it knows all of them.
+      mutable int space_count;
+
+      /// See set_neighbor_table(), the entries are indexed by 4 * element id + edge.
+      bool neighbor_table_enabled;
+      mutable std::map<int, NeighborTableEntry> neighbor_table;
+
+      /// Creation stamps of the elements by ids, assigned while the neighbor table is enabled.
+      std::vector<unsigned int> element_stamps;
+      unsigned int element_stamp_counter;
+
+      /// Stamps a (re)created element.
+      void stamp_element(int id);
+
+      /// Clears the neighbor table and the element stamps.
+      void clear_neighbor_table();
+
       int nbase, ntopvert;
       int ninitial;
 
@@ -510,6 +736,7 @@ namespace Hermes
         friend class Space<double>;
         friend class Space<std::complex<double> >;
         friend class Mesh;
+        friend class MeshReaderH2DBinary;
       };
 
       /// \brief Curved element exception.
@@ -546,6 +773,7 @@ namespace Hermes
 
       friend class MeshReaderH2D;
       friend class MeshReaderH2DXML;
+      friend class MeshReaderH2DBinary;
       friend class MeshReaderH1DXML;
       friend class MeshReaderExodusII;
       friend class DiscreteProblem<double>;
@@ -681,8 +909,33 @@ namespace Hermes
       Element* create_triangle(int marker, Node* v0, Node* v1, Node* v2, CurvMap* cm, int id = -1);
       void refine_element(Element* e, int refinement);
 
+      /// Adds an element to the array, under a lock during the concurrent refinement.
+      Element* add_element();
+
+      /// Refines the active elements parents[i] by refinement_types[i] by several threads, used by refine_all_elements()
+      /// and refine_elements(). Elements sharing no vertex (nor an existing mid-edge vertex) are refined concurrently,
+      /// the curved ones by the calling thread. Afterwards, the new elements and nodes are renumbered,
+      /// so that the ids do not depend on the timing of the threads: the sons in the order of their
+      /// parents, the nodes in the order of the first refinement using them.
+      void refine_elements_parallel(const std::vector<Element*>& parents, const std::vector<int>& refinement_types, int num_threads);
+
+      /// While set (by refine_all_elements()), the coefficients of the curved sons are not calculated
+      /// by the refinement, but by precalculate_refmap_coeffs() afterwards.
+      bool refmap_coeffs_deferred;
+
+      /// Calculates the coefficients of the curved reference mapping of a new son, unless deferred.
+      void update_refmap_coeffs(Element* e);
+
+      /// Calculates the coefficients of the curved reference mappings of the elements with the given
+      /// or higher ids by several threads, used after loading and refining all elements.
+      void precalculate_refmap_coeffs(int first_element_id = 0);
+
+      /// Moves the nodes and the elements to the new ids (indexed by the old ones, unused ids map
+      /// to themselves) and updates all pointers and the hash table.
+      void apply_renumbering(const int* new_node_ids, const int* new_element_ids);
+
       /// Vector for storing refinements in order to be able to save/load meshes with identical element IDs.
-      /// Refinement "-1" stands for unrefinement.
+      /// Refinement "-1" stands for unrefinement, "-2" for reorder_hilbert() (with the first_element_id as the id).
       Hermes::vector<std::pair<unsigned int, int> > refinements;
 
       /// Refines a quad element into four quads, or two quads (horizontally or
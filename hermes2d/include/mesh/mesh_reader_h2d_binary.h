@@ -0,0 +1,212 @@
+// This file is part of Hermes2D
+//
+// Hermes2D is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D; if not, see <http://www.gnu.prg/licenses/>.
+
+#ifndef _MESH_READER_H2D_BINARY_H_
+#define _MESH_READER_H2D_BINARY_H_
+
+#include "mesh_reader.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// Mesh reader from the Hermes2D binary format
+    ///
+    /// @ingroup mesh_readers
+    /// The file stores the vertices, elements, boundary markers, curves and the refinement history
+    /// of the mesh in contiguous blocks. The file is mapped into memory and the blocks are used
+    /// directly, no parsing takes place. The files are not portable between platforms of different
+    /// byte order.
+    /// Typical usage:
+    /// Hermes::Hermes2D::Mesh mesh;
+    /// Hermes::Hermes2D::MeshReaderH2DBinary mloader;
+    /// try
+    /// {
+    ///&nbsp;mloader.load("mesh.h2db", &mesh);
+    /// }
+    /// catch(Exceptions::MeshLoadFailureException& e)
+    /// {
+    ///&nbsp;e.print_msg();
+    ///&nbsp;return -1;
+    /// }
+    class HERMES_API MeshReaderH2DBinary : public MeshReader
+    {
+    public:
+      MeshReaderH2DBinary();
+      virtual ~MeshReaderH2DBinary();
+
+      /// This method loads a single mesh from a file.
+      /// The file may also be a delta file written by save_delta(), in which case the chain of parent files
+      /// is loaded and the refinements are replayed, or a tree file written by save_tree(), in which case the refined mesh
+      /// is restored without replaying anything.
+      virtual bool load(const char *filename, Mesh *mesh);
+
+      /// Loads a mesh from a file, performing only the first refinement_count refinements of its history
+      /// (all of them if refinement_count is negative). Always the complete mesh for a tree file.
+      bool load(const char *filename, Mesh *mesh, int refinement_count);
+
+      /// This method saves a single mesh to a file.
+      bool save(const char *filename, Mesh *mesh);
+
+      /// Saves a mesh as a delta to a mesh previously saved to parent_filename (by save() or save_delta()).
+      /// Only the refinements following the common part of the refinement histories are stored, so the two
+      /// meshes have to share the base mesh, which is not checked.
+      /// \param[in] parent_refinements The refinement history (Mesh::get_refinements()) of the parent mesh.
+      bool save_delta(const char *filename, Mesh *mesh, const char* parent_filename, const Hermes::vector<std::pair<unsigned int, int> >& parent_refinements);
+
+      /// Saves the mesh with its complete element tree (all the nodes and elements, active or not, with their ids,
+      /// and the curved maps), load() then restores the refined mesh directly instead of replaying the refinements.
+      /// The refinement history is stored as well, so that the loaded mesh can be saved by save() again.
+      /// Intended for repeated runs starting from the same refined mesh, the files are larger than those of save().
+      bool save_tree(const char *filename, Mesh *mesh);
+
+      /// Performs the refinements of a refinement history, stored as (element id, refinement type) pairs.
+      static void apply_refinements(Mesh *mesh, const int* refinements, int count);
+
+      /// Version of the format written by save(), files of other versions are rejected by load().
+      static const int H2D_BINARY_MESH_VERSION = 1;
+
+    protected:
+      /// The file header, followed by the data blocks, each of which starts at a multiple of 8 bytes:
+      /// - vertices: 2 doubles (x, y) per vertex,
+      /// - elements: 5 ints (4 vertex indices, the last one -1 for triangles, internal marker) per element,
+      /// - boundary edges: 3 ints (2 vertex indices, internal marker) per edge,
+      /// - curves: 6 ints (2 vertex indices, arc flag, degree, number of control points, number of knots) per curve,
+      /// - curve data: per curve the arc angle, the control points (3 doubles each) and the knot vector,
+      /// - refinements: 2 ints (element id, refinement type) per refinement,
+      /// - markers: 2 ints (internal marker, length of the user marker) per element and boundary marker,
+      /// - marker characters: the user markers, concatenated.
+      struct Header
+      {
+        char magic[8];
+        int byte_order;
+        int version;
+        int vertex_count;
+        int element_count;
+        int boundary_edge_count;
+        int curve_count;
+        int curve_data_count;
+        int refinement_count;
+        int element_marker_count;
+        int boundary_marker_count;
+        int marker_chars_count;
+        int reserved[3];
+      };
+
+      /// Byte offsets of the data blocks, computed from the header.
+      struct Layout
+      {
+        Layout(const Header& header);
+        size_t vertices;
+        size_t elements;
+        size_t boundary_edges;
+        size_t curves;
+        size_t curve_data;
+        size_t refinements;
+        size_t markers;
+        size_t marker_chars;
+        size_t total;
+      };
+
+      /// The header of a delta file, followed by the name of the parent file and the refinements
+      /// (2 ints each) following the first prefix_count refinements of the parent, each block
+      /// starting at a multiple of 8 bytes.
+      struct DeltaHeader
+      {
+        char magic[8];
+        int byte_order;
+        int version;
+        int parent_name_length;
+        int prefix_count;
+        int refinement_count;
+        int reserved[3];
+      };
+
+      /// The header of a tree file (save_tree()), followed by the blocks, each of which starts at a multiple of 8 bytes:
+      /// - nodes: TreeNode per node id,
+      /// - elements: TreeElement per element id,
+      /// - curved maps: TreeCurvMap per element with a curved map,
+      /// - curves: 7 ints (element id, edge, arc flag, twin flag, degree, number of control points, number of knots) per curved
+      ///   edge of a top level curved map,
+      /// - curve data, refinements, markers and marker characters as in the file of save().
+      struct TreeHeader
+      {
+        char magic[8];
+        int byte_order;
+        int version;
+        int node_count;
+        int element_count;
+        int nbase;
+        int nactive;
+        int ntopvert;
+        int ninitial;
+        int curv_map_count;
+        int curve_count;
+        int curve_data_count;
+        int refinement_count;
+        int element_marker_count;
+        int boundary_marker_count;
+        int marker_chars_count;
+        int reserved[3];
+      };
+
+      struct TreeNode
+      {
+        /// Bits: used, type, bnd, then ref shifted by 3.
+        int flags;
+        int p1, p2;
+        /// Edge nodes: the marker and the ids of the elements sharing the edge (-1 for none).
+        int marker;
+        int elem[2];
+        /// Vertex nodes: the coordinates.
+        double x, y;
+      };
+
+      struct TreeElement
+      {
+        /// Bits: used, active, then the number of vertices shifted by 2.
+        int flags;
+        int marker;
+        int parent;
+        int vn[H2D_MAX_NUMBER_VERTICES];
+        /// The edge nodes of an active element, the sons (-1 for none) of an inactive one.
+        int en_or_sons[H2D_MAX_ELEMENT_SONS];
+      };
+
+      struct TreeCurvMap
+      {
+        int element;
+        int toplevel;
+        int order;
+        /// The base element of a map of a refined element.
+        int parent;
+        uint64_t part;
+      };
+
+      /// Creates the mesh from the (mapped) contents of a file.
+      void load(const char* data, size_t size, Mesh *mesh, int refinement_count);
+
+      /// Creates the mesh from the (mapped) contents of a tree file.
+      void load_tree(const char* data, size_t size, Mesh *mesh);
+
+      /// Inserts the markers stored in the marker blocks into the conversion tables of the mesh.
+      static void load_markers(const int* markers, const char* marker_chars, int element_marker_count, int boundary_marker_count, int marker_chars_count, Mesh *mesh);
+
+      /// Collects the markers of the conversion tables of the mesh.
+      static void save_markers(Mesh *mesh, std::vector<int>& markers, std::string& marker_chars, int& element_marker_count, int& boundary_marker_count);
+    };
+  }
+}
+#endif
@@ -72,7 +72,21 @@ namespace Hermes
       /// This method saves multiple meshes according to subdomains in the vector meshes.
       bool save(const char *filename, Hermes::vector<Mesh *> meshes);
 
+      /// Set to use / not to use the streaming parsing (default: not to).
+      /// In the streaming parsing, the file is read by a SAX parser and the mesh is created while
+      /// reading, without building the document tree first. The file is not validated in this mode.
+      void set_streaming(bool to_set);
+
     protected:
+      /// Internal.
+      bool streaming;
+
+      /// SAX handler creating the mesh (meshes) in the streaming parsing.
+      class StreamingHandler;
+
+      /// Internal method running the SAX parser with the handler on the file.
+      void load_streaming(const char *filename, StreamingHandler& handler);
+
       /// Internal method loading contents of parsed_xml_mesh into mesh.
       bool load(std::auto_ptr<XMLMesh::mesh> & parsed_xml_mesh, Mesh *mesh, std::map<unsigned int, unsigned int>& vertex_is);
 
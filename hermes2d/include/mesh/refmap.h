@@ -20,6 +20,8 @@
 #include "../shapeset/precalc.h"
 #include "../quadrature/quad_all.h"
 #include "shapeset/shapeset_h1_all.h"
+#include "../cache_statistics.h"
+#include "../mixins2d.h"
 
 namespace Hermes
 {
@@ -42,13 +44,17 @@ namespace Hermes
     /// the calculation of integration points positions in the physical domain and
     /// the calculation of edge tangents in 1D integration points.
     ///
-    class HERMES_API RefMap : public Transformable
+    class HERMES_API RefMap : public Transformable, public Hermes::Hermes2D::Mixins::MemoryAccounted
     {
     public:
       RefMap();
 
       ~RefMap();
 
+      /// Returns the memory of the precalculated tables of the sub-element mappings (except for the tangents) in bytes.
+      std::size_t get_memory_usage() const;
+      virtual std::size_t get_total_memory_usage() const;
+
       /// Sets the quadrature points in which the reference map will be evaluated.
       /// \param quad_2d[in] The quadrature points.
       void set_quad_2d(Quad2D* quad_2d);
@@ -63,6 +69,10 @@ namespace Hermes
       /// Must be called prior to using all other functions in the class.
       virtual void set_active_element(Element* e);
 
+      /// Frees the tables and forgets the active element, the next set_active_element() sets the reference map up
+      /// even for the same element (whose vertices may have moved, or which may be another one at the same address).
+      void reset();
+
       /// Returns the triples[x, y, norm] of the tangent to the specified (possibly
       /// curved) edge at the 1D integration points along the edge. The maximum
       /// 1D quadrature rule is used by default, but the user may specify his own
@@ -75,6 +85,7 @@ namespace Hermes
       static void untransform(Element* e, double x, double y, double& xi1, double& xi2);
 
       /// Returns the element pointer located at physical coordinates x, y.
+      /// Only the elements listed for the point by Mesh::get_element_grid() are tested.
       /// \param[in] x Physical x-coordinate.
       /// \param[in] y Physical y-coordinate.
       /// \param[in] x_reference Optional parameter, in which the x-coordinate of x in the reference domain will be returned.
@@ -173,6 +184,8 @@ namespace Hermes
         double* phys_x[H2D_MAX_TABLES];
         double* phys_y[H2D_MAX_TABLES];
         double3* tan[H2D_MAX_NUMBER_EDGES];
+        /// The memory of the node and its tables (except for the tangents), for CacheStatistics.
+        long long bytes;
       };
 
       /// Table of RefMap::Nodes, indexed by a sub-element mapping.
@@ -180,25 +193,19 @@ namespace Hermes
 
       Node* cur_node;
 
-      Node* overflow;
-
       void update_cur_node()
       {
         Node* updated_node = new Node;
 
-        if(sub_idx > H2D_MAX_IDX) {
+        bool inserted = nodes.insert(std::make_pair(sub_idx, updated_node)).second;
+        if(inserted == false)
+          /// The value had already existed.
           delete updated_node;
-          cur_node = handle_overflow();
-        }
-        else {
-          if(nodes.insert(std::make_pair(sub_idx, updated_node)).second == false)
-            /// The value had already existed.
-            delete updated_node;
-          else
-            /// The value had not existed.
-            init_node(updated_node);
-          cur_node = nodes[sub_idx];
-        }
+        else
+          /// The value had not existed.
+          init_node(updated_node);
+        CacheStatistics::lookup(H2D_CACHE_REFMAP, !inserted);
+        cur_node = nodes[sub_idx];
       }
 
       void calc_inv_ref_map(int order);
@@ -211,6 +218,10 @@ namespace Hermes
 
       static bool is_parallelogram(Element* e);
 
+      /// Calculates the physical coordinates of the integration points of an element with
+      /// a constant jacobian directly from its affine map. Either of x, y may be NULL.
+      void calc_const_phys_coords(int order, double* x, double* y);
+
       void calc_phys_x(int order);
 
       void calc_phys_y(int order);
@@ -225,7 +236,8 @@ namespace Hermes
 
       void free_node(Node* node);
 
-      Node* handle_overflow();
+      /// Accounts a new table of cur_node of the given size to CacheStatistics.
+      void insert_table(long long bytes);
 
       Quad1DStd quad_1d;
 
@@ -254,7 +266,7 @@ namespace Hermes
       template<typename T> friend class Geom;
       friend Geom<double>* init_geom_vol(RefMap *rm, const int order);
       friend Geom<double>* init_geom_surf(RefMap *rm, SurfPos* surf_pos, const int order);
-      friend Func<double>* init_fn(PrecalcShapeset *fu, RefMap *rm, const int order);
+      friend Func<double>* init_fn(PrecalcShapeset *fu, RefMap *rm, const int order, unsigned int demand);
       template<typename T> friend T int_g_h(Function<T>* fg, Function<T>* fh, RefMap* rg, RefMap* rh);
 	};
   }
@@ -104,6 +104,7 @@ namespace Hermes
       friend class Views::Vectorizer;
       template<typename Scalar> friend class DiscreteProblem;
       template<typename Scalar> friend class DiscreteProblemLinear;
+      template<typename Scalar> friend class KellyTypeAdapt;
       };
 
       void begin(int n, const Mesh** meshes, Transformable** fn = NULL);
@@ -111,16 +112,60 @@ namespace Hermes
 
       State* get_next_state(int* top_by_ref = NULL, int* id_by_ref = NULL);
       int get_num_states(Hermes::vector<const Mesh*> meshes);
+
+      /// Performs the whole traversal at once and returns copies of all (leaf) states.
+      /// The states can then be processed in parallel without any locking of the traversal,
+      /// threads only have to set the states to their functions (set_state_to_fns()).
+      /// Has to be called on a master Traverse instance.
+      /// \param[out] states_count Number of the returned states.
+      /// \param[in] element_markers Optional, for each mesh the sorted internal element markers of the base elements
+      /// the mesh is traversed on (empty for all of them). On the other base elements the element of the mesh is NULL
+      /// in all the states and its refinements are not descended, the base elements with no mesh left are skipped.
+      /// If all the meshes are the same one (or its copies with the same seq and refinements), the states are simply
+      /// the active elements of the mesh (with the identity sub-element transformations), without the multi-mesh logic.
+      /// \return The array of states, to be deallocated by free_states().
+      State** get_states(Hermes::vector<const Mesh*> meshes, int& states_count, const Hermes::vector<std::vector<int> >* element_markers = NULL);
+
+      /// Deallocation of the array returned by get_states().
+      static void free_states(State** states, int states_count);
+
+      /// Sets the active elements and sub-element transformations of the state to the functions.
+      /// This is what get_next_state() does with the functions passed to begin().
+      static void set_state_to_fns(State* state, Transformable** fn);
       inline Element*  get_base() const { return base; }
 
       void init_transforms(State* s, int i);
 
       UniData** construct_union_mesh(Mesh* unimesh);
 
+      /// Returns the union mesh of the meshes together with its UniData tables.
+      /// The union mesh is shared by all the callers with the same meshes (addresses and seq numbers) and kept
+      /// for repeated use, so it is only constructed once for e.g. repeated Filters on a coarse and a reference mesh.
+      /// Every call has to be paired with release_union_mesh(), the returned data must not be deallocated by the caller.
+      static Mesh* get_union_mesh(int n, const Mesh** meshes, UniData**& unidata);
+
+      /// Releases the union mesh obtained by get_union_mesh().
+      static void release_union_mesh(Mesh* unimesh);
+
+      /// Deletes all the cached union meshes that are not in use.
+      static void clear_union_mesh_cache();
+
       int num;
       const Mesh** meshes;
       Transformable** fn;
 
+      /// The restriction of the meshes to element markers of get_states(), NULL for none.
+      const Hermes::vector<std::vector<int> >* element_markers;
+
+      /// Is the i-th mesh traversed on the base element?
+      bool is_traversed(int i, Element* base_element) const;
+
+      /// All the meshes are the first one or its copies with the same refinements, see get_states().
+      static bool is_single_mesh(Hermes::vector<const Mesh*>& meshes);
+
+      /// get_states() of a single mesh, the states of its active elements (base element by base element, as the general traversal).
+      State** get_states_single_mesh(Hermes::vector<const Mesh*>& meshes, int& states_count);
+
       State* stack;
       int top, size;
 
@@ -153,6 +198,48 @@ namespace Hermes
       friend class Views::Orderizer;
       friend class Views::Vectorizer;
       friend class Views::Linearizer;
+      friend class TraversePlan;
+    };
+
+    /// @ingroup inner
+    /// Recorded multi-mesh traversal, i.e. the states returned by Traverse::get_states(), together with the identification
+    /// of the meshes it was made for (their addresses, seq numbers and element storage).
+    /// As long as the meshes do not change (Newton iterations, time steps on a fixed mesh), the states are replayed
+    /// and no traversal is done at all. Any refinement / unrefinement of a mesh changes its seq number and invalidates the plan.
+    class HERMES_API TraversePlan
+    {
+    public:
+      TraversePlan();
+      ~TraversePlan();
+
+      /// Returns the states of the union of the meshes, the traversal is only done if the meshes differ from those of the last call.
+      /// The states belong to the plan and are valid until the next call or clear().
+      /// \param[out] states_count Number of the returned states.
+      /// \param[in] element_markers See Traverse::get_states(), a change of them invalidates the plan as well.
+      Traverse::State** get_states(Hermes::vector<const Mesh*> meshes, int& states_count, const Hermes::vector<std::vector<int> >* element_markers = NULL);
+
+      /// Deletes the recorded states.
+      void clear();
+
+      /// Statistics - how many times the states were traversed / replayed.
+      inline unsigned long get_num_traversals() const { return this->num_traversals; }
+      inline unsigned long get_num_replays() const { return this->num_replays; }
+
+    private:
+      /// Does the plan correspond to the meshes?
+      bool is_valid_for(Hermes::vector<const Mesh*>& meshes, const Hermes::vector<std::vector<int> >* element_markers) const;
+
+      Traverse::State** states;
+      int num_states;
+
+      /// Identification of the meshes.
+      Hermes::vector<const Mesh*> meshes;
+      Hermes::vector<unsigned> seqs;
+      Hermes::vector<Element*> first_elements;
+      Hermes::vector<std::vector<int> > element_markers;
+
+      unsigned long num_traversals;
+      unsigned long num_replays;
     };
   }
 }
@@ -68,6 +68,85 @@ namespace Hermes
         bool validate;
       };
 
+      /// The kinds of the objects the memory of which is aggregated by MemoryAccounted.
+      enum MemoryUsageKind
+      {
+        H2D_MEMORY_MESH = 0,
+        H2D_MEMORY_SPACE = 1,
+        H2D_MEMORY_SOLUTION = 2,
+        H2D_MEMORY_PRECALC_SHAPESET = 3,
+        H2D_MEMORY_REFMAP = 4,
+        H2D_MEMORY_DISCRETE_PROBLEM = 5,
+        H2D_NUM_MEMORY_USAGE_KINDS = 6
+      };
+
+      /// \ingroup g_mixins2d
+      /// Mixin of the classes reporting their memory usage (get_memory_usage()), it keeps the register of the living
+      /// instances of each kind, so that the memory can be aggregated over all of them, e.g.:
+      /// Hermes::Hermes2D::Mixins::MemoryAccounted::report_global_memory_usage();
+      /// The global functions must not be called while other threads create or destroy the instances.
+      class HERMES_API MemoryAccounted
+      {
+      public:
+        /// The memory used by the instance, in bytes (the total of get_memory_usage() of the class).
+        virtual std::size_t get_total_memory_usage() const = 0;
+
+        /// The sum of get_total_memory_usage() over all the living instances of the kind.
+        static std::size_t get_global_memory_usage(MemoryUsageKind kind);
+
+        /// The number of the living instances of the kind.
+        static unsigned int get_global_instance_count(MemoryUsageKind kind);
+
+        /// Writes the number of the instances and the memory of each kind.
+        static void report_global_memory_usage(std::ostream& out = std::cout);
+
+        static const char* get_kind_name(MemoryUsageKind kind);
+
+      protected:
+        MemoryAccounted(MemoryUsageKind kind);
+        MemoryAccounted(const MemoryAccounted& other);
+        MemoryAccounted& operator=(const MemoryAccounted& other);
+        virtual ~MemoryAccounted();
+
+      private:
+        MemoryUsageKind memory_usage_kind;
+      };
+
+      /// \ingroup g_mixins2d
+      /// Mixin of the classes running parallel (OpenMP) loops, it lets an instance use its own number of threads
+      /// instead of Hermes2DApi numThreads, so that independent problems solved concurrently in one process
+      /// can partition the cores among themselves, e.g.:
+      /// dp_1.set_num_threads(4); dp_1.set_thread_affinity(cores_0_to_3);
+      /// dp_2.set_num_threads(4); dp_2.set_thread_affinity(cores_4_to_7);
+      class HERMES_API Parallel
+      {
+      public:
+        /// Sets the number of threads of this instance.
+        /// \param[in] num_threads Positive, or 0 (default) for Hermes2DApi numThreads.
+        /// Must not be called during a computation of the instance.
+        void set_num_threads(int num_threads);
+
+        /// The number of threads this instance uses.
+        int get_num_threads() const;
+
+        /// Pins the i-th thread of the parallel loops of this instance to the core cores[i % cores.size()]
+        /// (the pinning stays after the loop, the OpenMP runtime reuses its threads, thread 0 is the calling thread).
+        /// An empty vector (default) leaves the threads unpinned, the pinning is ignored on the platforms without the support of it.
+        void set_thread_affinity(const std::vector<int>& cores);
+
+        const std::vector<int>& get_thread_affinity() const;
+
+      protected:
+        Parallel();
+
+        /// Called by each thread at the beginning of the parallel loops, pins the thread if set_thread_affinity() was used.
+        void apply_thread_affinity() const;
+
+      private:
+        int num_threads;
+        std::vector<int> affinity_cores;
+      };
+
       /// \ingroup g_mixins2d
       /// Mixin that interfaces linear algebra structures output.
       template<typename Scalar>
@@ -112,8 +191,15 @@ namespace Hermes
         /// Sets number format for the vector output.
         /// Default: "%lf".
         void set_rhs_number_format(char* number_format);
-        
+
       protected:
+        /// Writes the matrix of the iteration if the output of it is on (output_matrix()), to the file
+        /// matrixFilename + iteration (+ ".m" for DF_MATLAB_SPARSE). DF_HERMES_BIN is the fastest format for large matrices,
+        /// Matrix::load() reads it back.
+        void process_matrix_output(SparseMatrix<Scalar>* matrix, int iteration);
+        /// The same for the rhs (output_rhs()).
+        void process_vector_output(Vector<Scalar>* rhs, int iteration);
+
         bool print_matrix_zero_values;
         bool output_matrixOn;
         int output_matrixIterations;
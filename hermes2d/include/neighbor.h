@@ -153,6 +153,8 @@ namespace Hermes
       /// \return     Number of shape functions in the extended shapeset (sum of central and neighbor elems' local counts).
       ///
       ExtendedShapeset* create_extended_asmlist(const Space<Scalar>* space, AsmList<Scalar>* al);
+      /// The same with an already calculated assembly list of the neighbor element on the active segment (which is copied).
+      ExtendedShapeset* create_extended_asmlist(const Space<Scalar>* space, AsmList<Scalar>* al, const AsmList<Scalar>* neighbor_al);
       ExtendedShapeset* create_extended_asmlist_multicomponent(const Space<Scalar>* space, AsmList<Scalar>* al);
 
       /*** Methods for working with quadrature on the active edge. ***/
@@ -203,6 +205,9 @@ namespace Hermes
         ///
         ExtendedShapeset(NeighborSearch<Scalar>* neighborhood, AsmList<Scalar>* central_al, const Space<Scalar>*space);
 
+        /// Constructor with the neighbor's assembly list already obtained (it is copied).
+        ExtendedShapeset(AsmList<Scalar>* central_al, const AsmList<Scalar>* neighbor_al);
+
         ExtendedShapeset(const ExtendedShapeset & other);
 
         /// Destructor.
@@ -408,6 +413,12 @@ namespace Hermes
       /// Cleaning of internal structures before a new edge is set as active.
       void reset_neighb_info();
 
+      /// Restores the state after the search for neighbors across the active edge from the mesh neighbor table.
+      void load_neighbor_table_entry(const NeighborTableEntry& entry);
+
+      /// Stores the state after the search for neighbors across the active edge in the mesh neighbor table.
+      void store_neighbor_table_entry() const;
+
       /*** Quadrature on the active edge. ***/
       Quad2D* quad;
 
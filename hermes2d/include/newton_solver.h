@@ -68,7 +68,7 @@ namespace Hermes
     ///&nbsp;return -1;<br>
     /// }<br>
     template<typename Scalar>
-    class HERMES_API NewtonSolver : public NonlinearSolver<Scalar>, public Hermes::Hermes2D::Mixins::SettableSpaces<Scalar>, public Hermes::Mixins::OutputAttachable, public Hermes::Hermes2D::Mixins::MatrixRhsOutput<Scalar>, public Hermes::Hermes2D::Mixins::StateQueryable
+    class HERMES_API NewtonSolver : public NonlinearSolver<Scalar>, public Hermes::Hermes2D::Mixins::SettableSpaces<Scalar>, public Hermes::Mixins::OutputAttachable, public Hermes::Hermes2D::Mixins::MatrixRhsOutput<Scalar>, public Hermes::Hermes2D::Mixins::StateQueryable, public Hermes::Mixins::IterationRecordable
     {
     public:
       NewtonSolver();
@@ -185,6 +185,61 @@ namespace Hermes
       /// Set the weak forms.
       void set_weak_formulation(const WeakForm<Scalar>* wf);
 
+      /// Turn on or off the adaptive reuse of the jacobian (and its LU factorization in the case of a direct solver).
+      /// The previous jacobian is kept as long as the residual norm contracts (the ratio of the current
+      /// and the previous residual norm) at least by max_contraction_rate, otherwise it is assembled and factorized again.
+      /// The first iteration of solve() tries the jacobian from the previous call (e.g. the previous time step).
+      /// Default: off.
+      /// \param[in] onOff on(true)-adaptive reuse, off(false)-the jacobian is assembled in every iteration.
+      /// \param[in] max_contraction_rate The contraction rate needed to reuse the jacobian, must be > 0 and <= 1.0.
+      void set_jacobian_reuse(bool onOff, double max_contraction_rate = 0.5);
+
+      /// Number of the jacobian assemblies and factorizations saved by set_jacobian_reuse() since the creation of the solver.
+      unsigned int get_num_saved_factorizations() const;
+
+      /// Turn on or off the jacobian lagging: the jacobian (and its factorization) is kept for at most max_lag
+      /// following iterations, also over the calls of solve(), and refreshed sooner if the iterations stagnate, i.e. the
+      /// residual norm does not decrease at least by stagnation_ratio. Can be combined with set_broyden_updates().
+      /// Default: off (max_lag = 0).
+      /// \param[in] max_lag The number of iterations with the same jacobian, 0 turns the lagging off.
+      /// \param[in] stagnation_ratio The ratio of the current and the previous residual norm, must be > 0 and <= 1.0.
+      void set_jacobian_lagging(unsigned int max_lag, double stagnation_ratio = 0.9);
+
+      /// Turn on or off the Broyden's (rank-one) updates of the lagged jacobian (see set_jacobian_lagging(), which has
+      /// to be on): the quasi-Newton's method. The updates are applied by the Sherman-Morrison formula on top of the
+      /// factorization of the last assembled jacobian, so neither the assembling nor the factorization is repeated.
+      /// The updates are discarded whenever the jacobian is refreshed.
+      /// Default: off.
+      void set_broyden_updates(bool onOff = true);
+
+      /// Turn on or off the pipelined symbolic factorization: the matrix solver analyzes the pattern of the jacobian
+      /// while its values are being assembled (see DiscreteProblem::set_structure_analysis()), the factorization
+      /// then does only the numeric phase. Supported by UMFPACK and (centralized) MUMPS, the other solvers ignore it.
+      /// Default: off.
+      void set_pipelined_analysis(bool onOff = true);
+
+      /// Turn on or off the inexact Newton's method (only with an iterative linear solver).
+      /// The (relative) tolerance of the linear solver is set in every iteration to the forcing term eta_k
+      /// of Eisenstat and Walker, computed from the history of the residual norms:
+      /// choice 1: eta_k = | ||F_k|| - ||F_{k-1} + J_{k-1} s_{k-1}|| | / ||F_{k-1}||,
+      /// choice 2: eta_k = 0.9 (||F_k|| / ||F_{k-1}||)^2,
+      /// with their safeguards and max_forcing_term as the upper bound (and the value for the first iteration).
+      /// Default: off.
+      /// \param[in] onOff on(true)-inexact Newton's method, off(false)-the linear solver tolerance is not changed.
+      /// \param[in] choice 1 or 2, see above.
+      /// \param[in] max_forcing_term The upper bound of the forcing terms, must be > 0 and < 1.0.
+      void set_inexact_newton(bool onOff, int choice = 2, double max_forcing_term = 0.9);
+
+      /// The preconditioner of the iterative linear solver is built from a cheaper matrix than the jacobian: the jacobian
+      /// assembled with the integration orders lowered by reduction (DiscreteProblem::set_quadrature_order_reduction()),
+      /// by a second DiscreteProblem of the same weak form and spaces, with its own cache. For high-order spaces, where
+      /// the quadrature dominates the assembling, the preconditioning matrix is much cheaper, while the Krylov method
+      /// still solves the system with the exact jacobian.
+      /// Only with the linear solvers supporting LinearMatrixSolver::set_precond_matrix() (the built-in iterative solver,
+      /// AztecOO with a Precond object, PETSc).
+      /// Default: 0, the preconditioner is built from the jacobian.
+      void set_precond_quadrature_order_reduction(int reduction);
+
     protected:
       /// This instance owns its DP.
       const bool own_dp;
@@ -195,6 +250,17 @@ namespace Hermes
       /// Internal setting of default values (see individual set methods).
       void init_attributes();
 
+      /// Multiplies vec (of the length ndof) by the inverse of the Broyden's updates, i.e. B_k^{-1} = (I + u_{k-1} s_{k-1}^T)...(I + u_0 s_0^T) B_0^{-1}.
+      void apply_broyden_updates(Scalar* vec, int ndof);
+
+      /// Adds the update by the last step broyden_step and the difference of the residuals y (the right hand side of the linear solver is overwritten).
+      void add_broyden_update(Scalar* y, int ndof);
+
+      void free_broyden_updates();
+
+      /// Assembles the preconditioning matrix (if set_precond_quadrature_order_reduction() is on) and passes it to the linear solver.
+      void assemble_precond_matrix(Scalar* coeff_vec);
+
       /// Jacobian.
       SparseMatrix<Scalar>* jacobian;
 
@@ -226,6 +292,45 @@ namespace Hermes
       double sufficient_improvement_factor;
       /// necessary number of steps to increase back the damping coeff.
       unsigned int necessary_successful_steps_to_increase;
+
+      /// Adaptive jacobian reuse (see set_jacobian_reuse()).
+      bool jacobian_reuse;
+      /// The contraction rate of the residual norm needed to reuse the jacobian.
+      double max_jacobian_reuse_contraction_rate;
+      /// The jacobian has been assembled and factorized and it can be reused.
+      bool jacobian_factorized;
+      /// Statistics.
+      unsigned int num_saved_factorizations;
+
+      /// Jacobian lagging (see set_jacobian_lagging()).
+      unsigned int max_jacobian_lag;
+      double jacobian_stagnation_ratio;
+      /// The number of iterations since the last assembling of the jacobian.
+      unsigned int lagged_iterations;
+
+      /// Broyden's updates (see set_broyden_updates()).
+      bool broyden_updates;
+
+      /// See set_pipelined_analysis().
+      bool pipelined_analysis;
+      /// The steps s_j and the vectors u_j = (s_j - B_j^{-1} y_j) / (s_j^T B_j^{-1} y_j) of the updates.
+      Hermes::vector<Scalar*> broyden_steps;
+      Hermes::vector<Scalar*> broyden_directions;
+      /// The last residual, the last step and a work vector, all of the length broyden_ndof.
+      Scalar* broyden_residual;
+      Scalar* broyden_step;
+      Scalar* broyden_vec;
+      int broyden_ndof;
+
+      /// Inexact Newton's method (see set_inexact_newton()).
+      bool inexact_newton;
+      int forcing_term_choice;
+      double max_forcing_term;
+
+      /// Preconditioning matrix of lower integration orders (see set_precond_quadrature_order_reduction()).
+      int precond_order_reduction;
+      DiscreteProblem<Scalar>* precond_dp;
+      SparseMatrix<Scalar>* precond_matrix;
     };
   }
 }
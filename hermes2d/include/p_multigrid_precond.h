@@ -0,0 +1,130 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_P_MULTIGRID_PRECOND_H
+#define __H2D_P_MULTIGRID_PRECOND_H
+
+#include "global.h"
+#ifdef WITH_UMFPACK
+#include "solvers/native_iter_solver.h"
+#include "solvers/precond_amg.h"
+#include "space/space.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// @ingroup inner
+    /// \brief p-multigrid preconditioner of the systems assembled on spaces with a hierarchical shapeset
+    /// (H1ShapesetJacobi, H1ShapesetOrtho, the Legendre shapesets).
+    /// \details Every DOF gets the polynomial degree of its shape function. The level of the degree p consists of the DOFs
+    /// of the degree <= p, so that, with the hierarchical shapeset, the spaces of the levels are nested and the transfer
+    /// between the levels is the selection of the DOFs: the restriction takes the residual at the coarse DOFs, the coarse
+    /// matrix is the submatrix of these DOFs (= the Galerkin product) and the prolongation adds the correction at them.
+    /// One application is a V-cycle from the highest degree down to p = 1 (with the step set_order_step()), each level
+    /// with p > 1 is smoothed by the Chebyshev polynomial scaled by the diagonal, the p = 1 problem is solved by UMFPACK
+    /// or by a V-cycle of AMGPrecond, see set_coarse_solver().
+    /// The degrees are taken from the spaces in every compute(), the spaces have to be the ones the matrix is assembled on.
+    /// Typical usage, with the built-in iterative solver:
+    /// Hermes::Hermes2D::PMultigridPrecond<double> pmg(spaces);
+    /// native_iter_solver->set_precond(&pmg);
+    template<typename Scalar>
+    class HERMES_API PMultigridPrecond : public Hermes::Preconditioners::CSCPrecond<Scalar>
+    {
+    public:
+      PMultigridPrecond(Hermes::vector<const Space<Scalar>*> spaces);
+      PMultigridPrecond(const Space<Scalar>* space);
+      virtual ~PMultigridPrecond();
+
+      virtual void destroy();
+      virtual void compute();
+      virtual void apply(Scalar* r, Scalar* z);
+
+      enum CoarseSolverType
+      {
+        PMG_COARSE_UMFPACK,
+        PMG_COARSE_AMG
+      };
+
+      /// Solver of the p = 1 level.
+      /// Default: PMG_COARSE_UMFPACK
+      void set_coarse_solver(CoarseSolverType coarse_solver_type);
+
+      /// The degree of the level below p is p - order_step (at least 1).
+      /// Default: 1
+      void set_order_step(int order_step);
+
+      /// Degree of the Chebyshev smoother.
+      /// Default: 3
+      void set_smoother_sweeps(int sweeps);
+
+      /// Number of the levels (including p = 1) of the last compute().
+      int get_num_levels() const;
+
+    protected:
+      struct Level
+      {
+        Level();
+        ~Level();
+        /// The maximum degree of the DOFs of the level.
+        int order;
+        int size;
+        /// The matrix of the level, row-wise (CSR) with the sorted columns.
+        int* Ap;
+        int* Aj;
+        Scalar* Ax;
+        /// The positions of the DOFs of the level in the next finer level (NULL on the finest level).
+        int* fine_index;
+        /// Inverse of the diagonal, the Gershgorin bound of the spectrum of D^{-1} A.
+        Scalar* inv_diag;
+        double lambda_max;
+        /// Right hand side, solution and the work vectors of the cycle.
+        Scalar *b, *x, *r, *d, *t;
+      };
+
+      /// The polynomial degree of every DOF.
+      void calculate_dof_orders(int ndof);
+
+      /// The level of the DOFs of the degree <= order of the level finer.
+      Level* create_coarser_level(Level* finer, int order);
+
+      void setup_smoother(Level* level);
+      void smooth(Level* level);
+      void cycle(unsigned int level_i);
+
+      void setup_coarse_solver(Level* level);
+      void solve_coarse(Level* level);
+
+      Hermes::vector<const Space<Scalar>*> spaces;
+      Hermes::vector<Level*> levels;
+      int* dof_orders;
+
+      CoarseSolverType coarse_solver_type;
+      int order_step;
+      int sweeps;
+
+      /// The matrix of the p = 1 level for the coarse solver (in the full storage, as UMFPACK needs).
+      UMFPackMatrix<Scalar>* coarse_matrix;
+      UMFPackVector<Scalar>* coarse_rhs;
+      Hermes::Solvers::UMFPackLinearMatrixSolver<Scalar>* coarse_umfpack;
+      /// The coarse matrix got new values, the next coarse solve factorizes it.
+      bool coarse_factorization_needed;
+      /// Kept over compute(), so that its hierarchy is reused while the pattern of the p = 1 matrix does not change.
+      Hermes::Preconditioners::AMGPrecond<Scalar>* coarse_amg;
+    };
+  }
+}
+#endif
+#endif
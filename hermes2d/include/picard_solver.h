@@ -71,7 +71,7 @@ namespace Hermes
     ///&nbsp;return -1;<br>
     /// }<br>
     template<typename Scalar>
-    class HERMES_API PicardSolver : public Solvers::NonlinearSolver<Scalar>, public Hermes::Hermes2D::Mixins::SettableSpaces<Scalar>, public Hermes::Mixins::OutputAttachable, public Hermes::Hermes2D::Mixins::MatrixRhsOutput<Scalar>, public Hermes::Hermes2D::Mixins::StateQueryable
+    class HERMES_API PicardSolver : public Solvers::NonlinearSolver<Scalar>, public Hermes::Hermes2D::Mixins::SettableSpaces<Scalar>, public Hermes::Mixins::OutputAttachable, public Hermes::Hermes2D::Mixins::MatrixRhsOutput<Scalar>, public Hermes::Hermes2D::Mixins::StateQueryable, public Hermes::Mixins::IterationRecordable
     {
     public:
       PicardSolver();
@@ -126,9 +126,25 @@ namespace Hermes
       void set_weak_formulation(const WeakForm<Scalar>* wf);
     protected:
       void init();
-      
-      static void calculate_anderson_coeffs(Scalar** previous_vectors, Scalar* anderson_coeffs, int num_last_vectors_used, int ndof);
-      
+
+      /// Anderson acceleration.
+      /// The history of the last num_last_vectors_used coefficient vectors x_0, ..., x_{m-1} is kept in a ring buffer,
+      /// together with a QR factorization of the differences of consecutive residuals
+      /// dr_k = r_{k+1} - r_k, r_k = x_{k+1} - x_k. The factorization is updated (a column appended by Gram-Schmidt,
+      /// the oldest one removed by Givens rotations) instead of being recomputed, so that one accelerated step
+      /// costs O(num_last_vectors_used * ndof).
+      /// (Re)allocates the workspace if ndof or num_last_vectors_used changed, and resets the history.
+      void init_anderson(int ndof);
+      /// Stores this->sln_vector in the history and, if the history is full, replaces it with the accelerated vector.
+      void anderson_step(int ndof);
+      /// Appends the column anderson_work to the QR factorization.
+      /// Returns false if the column is (numerically) linearly dependent on the previous ones.
+      bool anderson_append_column(int ndof);
+      /// Removes the oldest column from the QR factorization.
+      void anderson_delete_first_column(int ndof);
+      /// Releases the workspace.
+      void free_anderson();
+
       bool verbose_output_linear_solver;
 
       /// Matrix.
@@ -148,6 +164,23 @@ namespace Hermes
       int num_last_vectors_used;
       bool anderson_is_on;
       double anderson_beta;
+
+      /// Anderson acceleration workspace, kept over the calls of solve().
+      /// Dimensions it has been allocated for.
+      int anderson_ndof, anderson_size;
+      /// Ring buffer of the last coefficient vectors, oldest first.
+      Scalar** anderson_vectors;
+      int anderson_num_vectors;
+      /// Orthonormal columns (num_last_vectors_used - 2 of them at most) and the upper triangular factor
+      /// of the QR factorization of the residual differences.
+      Scalar** anderson_Q;
+      Scalar** anderson_R;
+      int anderson_num_columns;
+      /// Auxiliary vector of the length ndof.
+      Scalar* anderson_work;
+      /// Least-squares coefficients and the resulting Anderson (mixing) coefficients.
+      Scalar* anderson_gamma;
+      Scalar* anderson_coeffs;
     };
   }
 }
@@ -0,0 +1,51 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_PRECALCULATED_TABLES_H
+#define __H2D_PRECALCULATED_TABLES_H
+
+#include "global.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// @ingroup inner
+    /// \brief The on-disk cache of the Cholesky-factorized projection matrices calculated at the first use.
+    /// \details The edge and bubble projection matrices of CurvMap and the edge projection matrix of Space
+    /// (with the diagonals of their Cholesky factors) do not depend on anything but the shapeset and the order,
+    /// so with the Api2D parameter precalculatedTablesCache set, they are read from the directory precalculatedFormsDirPath
+    /// instead of being calculated, and written there when they are not found (if the directory is writable).
+    /// Each file starts with a magic string with the version of the format and the size of the table,
+    /// a file of another version or size is ignored (and overwritten).
+    class HERMES_API PrecalculatedTables
+    {
+    public:
+      /// The cache is switched on by the Api2D parameter precalculatedTablesCache.
+      static bool is_enabled();
+
+      /// The file of the table name of the order in the directory precalculatedFormsDirPath.
+      static std::string get_filename(const std::string& name, int order);
+
+      /// Reads the n x n matrix (allocated by new_matrix) and the diagonal p of its Cholesky factorization.
+      /// \return false (and mat, p untouched) if the file is not there or does not describe the table of the size n.
+      static bool load(const std::string& name, int order, int n, double**& mat, double*& p);
+
+      /// Writes the matrix and the diagonal, see load(). A partially written file is removed.
+      static bool save(const std::string& name, int order, int n, double** mat, const double* p);
+    };
+  }
+}
+#endif
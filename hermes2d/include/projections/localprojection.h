@@ -26,6 +26,13 @@ namespace Hermes
   namespace Hermes2D
   {
     /// @ingroup projections
+    /// \brief Class for local (element by element) projecting, an alternative to OGProjection without a global system.
+    /// The coefficients are obtained by the projection-based interpolation: the values in the vertices (H1 spaces),
+    /// then the projection of the rest onto the functions of each edge (of the trace for H1, of the tangential component
+    /// for Hcurl and of the normal component for Hdiv), and finally the projection of the rest onto the bubble functions
+    /// of each element. Each of these is a small dense problem, the edges (by the levels of their elements) and the
+    /// elements are processed in parallel. For L2 spaces, the result is the same as the one of the global projection.
+    /// The source function is evaluated by MeshFunction::get_pt_values() in the quadrature points of the target elements.
     template<typename Scalar>
     class HERMES_API LocalProjection
     {
@@ -55,6 +62,28 @@ namespace Hermes
 
     protected:
       static int ndof;
+
+      /// Sets the coefficients of the unconstrained vertex functions of an H1 space to the values in the vertices.
+      static void project_vertices(const Space<Scalar>* space, MeshFunction<Scalar>* meshfn, Scalar* target_vec);
+
+      /// Projects meshfn minus the already projected part onto the functions of one edge of an element, or onto
+      /// its bubble functions (edge == -1). The functions not belonging to the edge (or the bubble) have to be projected already.
+      static void project_entity(const Space<Scalar>* space, MeshFunction<Scalar>* meshfn, ProjNormType proj_norm,
+          Element* e, int edge, RefMap* refmap, PrecalcShapeset* pss, AsmList<Scalar>* al, Scalar* target_vec);
+
+      /// Runs project_entity() for the pairs (elements[i], edges[i]) in parallel.
+      static void project_entities(const Space<Scalar>* space, MeshFunction<Scalar>* meshfn, ProjNormType proj_norm,
+          const Hermes::vector<Element*>& elements, const Hermes::vector<int>& edges, Scalar* target_vec);
+
+      /// The number of quantities (values, derivatives, ...) in the inner product of the projection, see get_features().
+      static int get_num_features(SpaceType space_type, ProjNormType proj_norm, bool edge);
+
+      /// Fills features[i * num_features + f] with the quantities of the inner product of the projection in the points.
+      /// \param[in] v0, v1 The values (v1 only for vector-valued spaces).
+      /// \param[in] d0, d1 The derivatives dx, dy (H1, L2 spaces), or the curl (Hcurl) or the divergence (Hdiv) in d0.
+      template<typename T>
+      static void get_features(SpaceType space_type, ProjNormType proj_norm, bool edge, Geom<double>* geometry, int np,
+          T* v0, T* v1, T* d0, T* d1, T* features);
     };
   }
 }
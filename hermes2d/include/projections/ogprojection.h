@@ -80,6 +80,10 @@ namespace Hermes
        \param proj_norm               (optional) the project normalise.
        \param newton_tol              (optional) the newton tolerance.
        \param newton_max_iter         (optional) the newton maximum iterator.
+
+       The projection matrix, its factorization and the Dirichlet lift are kept for the space and the norm,
+       so that repeated projections onto an unchanged space only assemble the right hand side and back-substitute.
+       The space is unchanged while neither its get_seq() nor its DOFs and Dirichlet values change, see free_cache().
        */
       void project_global(const Space<Scalar>* space, MeshFunction<Scalar>* source_meshfn,
           Scalar* target_vec, ProjNormType proj_norm = HERMES_UNSET_NORM);
@@ -101,6 +105,9 @@ namespace Hermes
           Hermes::vector<Solution<Scalar>*> source_slns, Hermes::vector<Solution<Scalar>*> target_slns,
           Hermes::vector<ProjNormType> proj_norms = Hermes::vector<ProjNormType>(), bool delete_old_mesh = false);
 
+      /// Frees the projection matrices kept by project_global() (at most H2D_OGPROJECTION_CACHE_SIZE of them).
+      static void free_cache();
+
     protected:
       /// Underlying function for global orthogonal projection.
       /// Not intended for the user. NOTE: the weak form here must be
@@ -109,6 +116,32 @@ namespace Hermes
       /// PDE, the PDE will just be solved.
       void project_internal(const Space<Scalar>* space, WeakForm<Scalar>* proj_wf, Scalar* target_vec);
 
+      /// A projection matrix with its solver and the right hand side contribution of the Dirichlet lift.
+      struct CachedProjection
+      {
+        const Space<Scalar>* space;
+        int space_seq, first_dof, ndof;
+        unsigned int bc_values_seq;
+        ProjNormType norm;
+        SparseMatrix<Scalar>* matrix;
+        Vector<Scalar>* lift;
+        Vector<Scalar>* rhs;
+        LinearMatrixSolver<Scalar>* matrix_solver;
+        /// The matrix has been factorized by the solver.
+        bool factorized;
+      };
+
+      /// Finds the projection matrix of the space in the norm, assembles it if it is not cached.
+      CachedProjection* get_cached_projection(const Space<Scalar>* space, ProjNormType norm);
+
+      /// Projects using the cached matrix, only the right hand side is assembled.
+      void project_cached(const Space<Scalar>* space, MeshFunction<Scalar>* source_meshfn, Scalar* target_vec, ProjNormType norm);
+
+      static void free_cached_projection(CachedProjection* cached);
+
+      /// The cached projections, the most recently used last.
+      static Hermes::vector<CachedProjection*> cache;
+
       /// Jacobian matrix (same as stiffness matrix since projections are linear).
       class ProjectionMatrixFormVol : public MatrixFormVol<Scalar>
       {
@@ -33,6 +33,8 @@ namespace Hermes
 
     const int g_max_quad = 24;
     const int g_max_tri = 20;
+    /// The number of the points of the highest order rule of g_quad_2d_std (13 x 13 points of the quads of the order g_max_quad).
+    const int H2D_MAX_INTEGRATION_POINTS_COUNT = 169;
 
     /// Quad1D is a base class for all 1D quadrature points.
     ///
@@ -38,6 +38,20 @@ namespace Hermes
     public:  Quad2DStd();
              ~Quad2DStd();
 
+             /// Replaces the triangle rules of the orders min_order..g_max_tri with the rules in the file, e.g. the symmetric
+             /// rules with fewer points and all points inside (Xiao-Gimbutas, Witherden-Vincent) for the high orders of hp-adaptivity.
+             /// The file holds for each rule a line "order number_of_points" followed by the lines "x y weight" of the points
+             /// on the reference triangle (-1,-1), (1,-1), (-1,1) (the weights sum to 2). The rules of the orders below
+             /// min_order and those not in the file are kept. Each rule is checked to integrate the polynomials of its order
+             /// exactly and to have its points inside the triangle, an exception is thrown otherwise.
+             /// The rules are shared by all the instances, they must be loaded before any computation
+             /// (the precalculated shape function values are cached by the order).
+             /// Hermes2DApi.set_text_param_value(triangleQuadratureRules, filename) calls this for g_quad_2d_std.
+             void load_triangle_rules(const char* filename, int min_order = 11);
+
+             /// Restores the built-in triangle rules.
+             void reset_triangle_rules();
+
              virtual void dummy_fn() {}
     };
 
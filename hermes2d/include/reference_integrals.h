@@ -0,0 +1,96 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_REFERENCE_INTEGRALS_H
+#define __H2D_REFERENCE_INTEGRALS_H
+
+#include "global.h"
+#include "shapeset/shapeset.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// The integrals over the reference element stored by ReferenceIntegrals, u the basis function, v the test function.
+    enum ReferenceIntegral
+    {
+      H2D_RI_MASS = 0,  ///< \int u v
+      H2D_RI_DX_DX = 1, ///< \int u_x v_x
+      H2D_RI_DY_DY = 2, ///< \int u_y v_y
+      H2D_RI_DX_DY = 3, ///< \int u_x v_y + u_y v_x
+      H2D_RI_DX_V = 4,  ///< \int u_x v
+      H2D_RI_DY_V = 5,  ///< \int u_y v
+      H2D_RI_NUM = 6
+    };
+
+    /// @ingroup inner
+    /// \brief The integrals of the products of the shape functions (and their derivatives) over the reference element.
+    /// \details One object holds the tables of all the pairs of the shape functions of the test shapeset up to the order
+    /// order_i and of the basis shapeset up to the order order_j on the element mode. On an affine element (a straight
+    /// triangle or a parallelogram), the integrals of the constant-coefficient forms (mass, stiffness, convection) are
+    /// combinations of these with the coefficients given by the (constant) reference map, so no quadrature is needed,
+    /// see DiscreteProblem::set_reference_integrals().
+    /// The tables are read from the directory given by the Api2D parameter precalculatedFormsDirPath. If they are not
+    /// there, they are calculated and written there for the next runs (if the directory is writable).
+    class HERMES_API ReferenceIntegrals : public Hermes::Mixins::Loggable
+    {
+    public:
+      ReferenceIntegrals(Shapeset* shapeset_i, Shapeset* shapeset_j, ElementMode2D mode, int order_i, int order_j);
+
+      /// Row (test function) of the shape function index in the tables, -1 if not there (e.g. a constrained function).
+      int get_position_i(int index) const;
+      /// Column (basis function) of the shape function index in the tables, -1 if not there.
+      int get_position_j(int index) const;
+
+      int get_num_i() const;
+      int get_num_j() const;
+
+      /// The table of the integral, the entry of the test function at the row i and the basis function
+      /// at the column j is table[i * get_num_j() + j].
+      const double* get_table(ReferenceIntegral integral) const;
+
+      /// The tables were read from the disk.
+      bool is_loaded() const;
+
+      /// The memory of the tables, in bytes.
+      std::size_t get_memory_size() const;
+
+      /// The name of the file with the tables in the directory precalculatedFormsDirPath.
+      static std::string get_filename(int id_i, int id_j, ElementMode2D mode, int order_i, int order_j);
+
+    protected:
+      /// The indices of the shape functions of the shapeset up to the order.
+      static void get_indices(Shapeset* shapeset, ElementMode2D mode, int order, std::vector<int>& indices);
+
+      void calculate(Shapeset* shapeset_i, Shapeset* shapeset_j);
+      bool load(const std::string& filename);
+      bool save(const std::string& filename) const;
+
+      int id_i, id_j;
+      ElementMode2D mode;
+      int order_i, order_j;
+      bool loaded;
+
+      std::vector<int> indices_i;
+      std::vector<int> indices_j;
+      /// Positions of the indices, -1 for the missing ones.
+      std::vector<int> positions_i;
+      std::vector<int> positions_j;
+      /// H2D_RI_NUM tables one after another.
+      std::vector<double> tables;
+    };
+  }
+}
+#endif
@@ -67,6 +67,10 @@ namespace Hermes
         /**  Overriden function. For details, see ProjBasedSelector::precalc_ref_solution(). */
         virtual Scalar** precalc_ref_solution(int inx_son, Solution<Scalar>* rsln, Element* element, int intr_gip_order);
 
+        /// Returns a number of function expansions returned by precalc_ref_solution().
+        /**  Overriden function. For details, see ProjBasedSelector::get_num_ref_expansions(). */
+        virtual int get_num_ref_expansions() const { return H2D_HCFE_NUM; };
+
         /// Calculates values of shape function at GIP for all transformations.
         /**  Overriden function. For details, see ProjBasedSelector::precalc_shapes(). */
         virtual void precalc_shapes(const double3* gip_points, const int num_gip_points, const Trf* trfs, const int num_noni_trfs, const Hermes::vector<typename OptimumSelector<Scalar>::ShapeInx>& shapes, const int max_shape_inx, typename ProjBasedSelector<Scalar>::TrfShape& svals, ElementMode2D mode);
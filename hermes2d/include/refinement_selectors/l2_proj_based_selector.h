@@ -63,6 +63,10 @@ namespace Hermes
         /**  Overriden function. For details, see ProjBasedSelector::precalc_ref_solution(). */
         virtual Scalar** precalc_ref_solution(int inx_son, Solution<Scalar>* rsln, Element* element, int intr_gip_order);
 
+        /// Returns a number of function expansions returned by precalc_ref_solution().
+        /**  Overriden function. For details, see ProjBasedSelector::get_num_ref_expansions(). */
+        virtual int get_num_ref_expansions() const { return H2D_L2FE_NUM; };
+
         /**  Overriden function. For details, see OptimumSelector::create_candidates(). */
         void create_candidates(Element* e, int quad_order, int max_ha_quad_order, int max_p_quad_order);
 
@@ -69,6 +69,11 @@ namespace Hermes
       protected: //options
         bool opt_symmetric_mesh; ///< True if ::H2D_PREFER_SYMMETRIC_MESH is set. True by default.
         bool opt_apply_exp_dof; ///< True if ::H2D_APPLY_CONV_EXP_DOF is set. False by default.
+        bool opt_prune_candidates; ///< True if candidates are pruned, see set_candidate_pruning(). False by default.
+        double pruning_tolerance; ///< A tolerance of pruning of candidates, see set_candidate_pruning().
+
+        /// Copies options of another selector. Used when cloning.
+        void copy_options(const OptimumSelector<Scalar>* source);
       public:
         /// Enables or disables an option.
         /** If overridden, the implementation has to call a parent implementation.
@@ -76,6 +81,17 @@ namespace Hermes
         *  \param[in] enable True to enable, false to disable. */
         virtual void set_option(const SelOption option, bool enable);
 
+        /// Enables or disables pruning of candidates.
+        /** If enabled, candidates are evaluated in stages of an increasing number of DOFs
+        *  (candidates closer to the current orders of the element go first among equal DOFs)
+        *  and the evaluation stops as soon as no candidate with more DOFs can get a better score,
+        *  assuming that such a candidate does not decrease the error below \a tolerance times the smallest error found so far.
+        *  Candidates of higher orders are then never projected, which is where most of the time is spent.
+        *  Disabled by default, i.e. all candidates are evaluated.
+        *  \param[in] enable True to enable, false to disable.
+        *  \param[in] tolerance A number from (0, 1]. The lower, the more candidates are evaluated and the closer the selection is to the one without pruning. */
+        void set_candidate_pruning(bool enable, double tolerance = H2DRS_DEFAULT_PRUNING_TOLERANCE);
+
         /// A candidate.
         struct Cand {
           double error; ///< An error of this candidate.
@@ -188,6 +204,15 @@ namespace Hermes
         *  \param[out] dev_error A deviation of \f$\log_{10} e\f$ where \f$e\f$ is an error of a candidate. It cannot be NULL. */
         void evaluate_candidates(Element* e, Solution<Scalar>* rsln, double* avg_error, double* dev_error);
 
+        /// Calculates error, dofs, and score of candidates in stages of an increasing number of DOFs. Used if pruning of candidates is enabled.
+        /** Candidates which were not evaluated are removed from the list of candidates.
+        *  \param[in] e An element that is being refined.
+        *  \param[in] quad_order An encoded order of the element. Candidates closer to it are evaluated first among candidates with the same number of DOFs.
+        *  \param[in] rsln A reference solution which is used to calculate the error.
+        *  \param[out] avg_error An average of \f$\log_{10} e\f$ where \f$e\f$ is an error of an evaluated candidate. It cannot be NULL.
+        *  \param[out] dev_error A deviation of \f$\log_{10} e\f$ where \f$e\f$ is an error of an evaluated candidate. It cannot be NULL. */
+        void evaluate_candidates_pruned(Element* e, int quad_order, Solution<Scalar>* rsln, double* avg_error, double* dev_error);
+
         /// Sorts and selects the best candidate and the best H-candidate according to the score.
         /** Any two candidates with the same score are skipped since it is not possible to decide between them.
         *  The method assumes that the candidate at the index 0 is the original element therefore
@@ -237,6 +262,17 @@ namespace Hermes
         *  \return True if score of \a a is greater than the score of \a b. */
         static bool compare_cand_score(const Cand& a, const Cand& b);
 
+        /// Orders candidates by an increasing number of DOFs. Among candidates with the same number of DOFs, a candidate closer to a given order goes first.
+        class CompareCandDofs
+        {
+        public:
+          CompareCandDofs(int quad_order);
+          bool operator()(const Cand& a, const Cand& b) const;
+        private:
+          int distance(const Cand& cand) const;
+          int order_h, order_v;
+        };
+
       protected: //orders and their range
         int current_max_order; ///< Current maximum order.
         int current_min_order; ///< Current minimum order.
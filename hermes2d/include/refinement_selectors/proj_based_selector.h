@@ -74,6 +74,31 @@ namespace Hermes
         TrfShape* cached_shape_ortho_vals; ///< Precalculated valus of orthogonalized shape functions.
         TrfShape* cached_shape_vals; ///< Precalculate values of shape functions.
 
+        /// Evaluates shape functions and orthonormal shape functions of both element modes at the integration points.
+        /** The values are shared by all clones of this selector and never change once evaluated,
+        *  therefore the clones may read them concurrently without any locking.
+        *  Has to be called serially, before the clones are used in parallel (Adapt::adapt() does so).
+        *  Calling it more than once has no effect. */
+        void precalculate_shape_values();
+
+        /// Allocates one contiguous buffer for samples of the reference solution on the sons of all given elements.
+        /** Together with store_ref_solution_samples() this lets Adapt::adapt() evaluate the reference solution
+        *  for all elements to be refined in one pass, before the selection. The selection then only reads the samples
+        *  and does not touch the state of the reference solution.
+        *  Does nothing if the selector does not support samples (see get_num_ref_expansions()).
+        *  \param[in] elements Elements of the coarse mesh that will be processed by select_refinement(). */
+        void init_ref_solution_samples(const Hermes::vector<Element*>& elements);
+
+        /// Makes a clone of this selector read the samples of the reference solution of another selector.
+        void share_ref_solution_samples(ProjBasedSelector<Scalar>* source);
+
+        /// Evaluates the reference solution on sons of an element into the buffer allocated by init_ref_solution_samples().
+        /** Distinct elements may be processed in parallel, each thread with its own clone of the selector and of \a rsln. */
+        void store_ref_solution_samples(Element* e, Solution<Scalar>* rsln);
+
+        /// Frees the samples of the reference solution. The selector evaluates the reference solution element by element again.
+        void free_ref_solution_samples();
+
       protected: //evaluated shape basis
         /// A transform shaped function expansions.
         /** The contents of the class can be accessed through an array index operator.
@@ -220,14 +245,24 @@ namespace Hermes
         /** Defines a cache of projection matrices for all possible permutations of orders. */
         typedef double** ProjMatrixCache[H2DRS_MAX_ORDER + 2][H2DRS_MAX_ORDER + 2];
 
-        /// An array of projection matrices.
+        /// A cache of diagonals of Cholesky factors.
+        /** Defines a cache of diagonals of factored projection matrices for all possible permutations of orders. */
+        typedef double* ProjMatrixDiagCache[H2DRS_MAX_ORDER + 2][H2DRS_MAX_ORDER + 2];
+
+        /// An array of factored projection matrices.
         /** The first index is the mode (see the enum ElementMode2D). The second and the third index
         *  is the horizontal and the vertical order respectively.
         *
+        *  The projection matrix does not depend on the element, it is factored by choldc() once
+        *  and every candidate then only needs a back-substitution (cholsl()).
+        *  The lower triangle holds the Cholesky factor, its diagonal is in proj_matrix_diag_cache.
         *  All matrices are square dense matrices and they have to be created through the function new_matrix().
         *  If record is NULL, the corresponding matrix has to be calculated. */
         ProjMatrixCache proj_matrix_cache[H2D_NUM_MODES];
 
+        /// Diagonals of the Cholesky factors in proj_matrix_cache, indexed the same way.
+        ProjMatrixDiagCache proj_matrix_diag_cache[H2D_NUM_MODES];
+
         /// An array of cached right-hand side values.
         /** The first index is an index of the shape function.
         *
@@ -324,6 +359,25 @@ namespace Hermes
         *  \return A pointer to 2D array. The first index is an index of the function expansion (f, df/dx, ...), the second index is an index of the integration point. */
         virtual Scalar** precalc_ref_solution(int inx_son, Solution<Scalar>* rsln, Element* element, int intr_gip_order) = 0;
 
+        /// Returns a number of function expansions (f, df/dx, ...) returned by precalc_ref_solution().
+        /** Override to allow samples of the reference solution (see init_ref_solution_samples()).
+        *  The number cannot exceed ::H2DRS_MAX_REF_EXPANSIONS. The default implementation returns zero, i.e. no samples are used. */
+        virtual int get_num_ref_expansions() const { return 0; };
+
+        /// Obtains values of the reference solution on all sons of an element through precalc_ref_solution().
+        /** \param[in] e An element of the coarse mesh.
+        *  \param[in] rsln A reference solution.
+        *  \param[out] rval Values for every son, see precalc_ref_solution(). */
+        void precalc_ref_solution_sons(Element* e, Solution<Scalar>* rsln, Scalar** rval[H2D_MAX_ELEMENT_SONS]);
+
+        /// Sets up pointers to the samples of the reference solution on sons of an element.
+        /** \return False if there are no samples of the element. */
+        bool get_ref_solution_samples(Element* e, Scalar** rval[H2D_MAX_ELEMENT_SONS]);
+
+        Scalar* ref_samples; ///< Samples of the reference solution. NULL if not used. Owned by the selector which is not a clone.
+        std::map<int, size_t>* ref_sample_offsets; ///< Offsets of the samples of an element (key: element ID) in ProjBasedSelector::ref_samples.
+        Scalar* ref_sample_rvals[H2D_MAX_ELEMENT_SONS][H2DRS_MAX_REF_EXPANSIONS]; ///< Pointers to the samples of the current element. The first index is an index of a son, the second index is an index of a function expansion.
+
         /// Builds projection matrix using a given set of shapes.
         /** Override to calculate a projection matrix.
         *  \param[in] gip_points Integration points. The first index is an index of an integration point, the second index is defined through the enum GIP2DIndices.
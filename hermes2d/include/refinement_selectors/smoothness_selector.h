@@ -0,0 +1,71 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_REFINEMENT_SELECTORS_SMOOTHNESS_SELECTOR_H
+#define __H2D_REFINEMENT_SELECTORS_SMOOTHNESS_SELECTOR_H
+
+#include "selector.h"
+#include "shapeset/shapeset_h1_all.h"
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    namespace RefinementSelectors {
+      /// A selector that chooses between H- and P-refinement by the smoothness of the coarse solution. \ingroup g_selectors
+      /** The solution on the element is expanded in the hierarchic shape functions of H1Shapeset (the local L2 projection
+      *  on the reference element, exact, since the solution is a polynomial of the order of the element there).
+      *  The L2 norms a_k of the parts of the expansion of the degrees k = 1, ..., p are fitted by C exp(-sigma k),
+      *  a decay rate sigma above the threshold marks the solution as smooth (analytic) and the element is P-refined,
+      *  otherwise it is H-refined. Elements of order 1 (nothing to fit) are P-refined, elements of the maximum order H-refined.
+      *  No reference solution is needed: the selector gets the coarse solution (use KellyTypeAdapt::adapt() with selectors),
+      *  so that together with the Kelly-type error estimate each step of hp-adaptivity needs only the coarse solve.
+      *  For scalar H1 solutions. */
+      template<typename Scalar>
+      class HERMES_API SmoothnessSelector : public Selector<Scalar> {
+      public:
+        /// Constructor.
+        /** \param[in] max_order A maximum order used by this selector. If it is ::H2DRS_DEFAULT_ORDER, a maximum supported order is used.
+        *  \param[in] decay_threshold The decay rate sigma above which the element is P-refined. */
+        SmoothnessSelector(int max_order = H2DRS_DEFAULT_ORDER, double decay_threshold = 1.0);
+
+        /// Cloning for paralelism.
+        virtual Selector<Scalar>* clone();
+
+        /// The decay rate sigma of the hierarchic coefficients of the solution on the (active) element, see the class description.
+        /// Infinity if the expansion has no higher degrees than 1, or vanishes.
+        double get_decay_rate(Element* element, int quad_order, Solution<Scalar>* sln);
+
+      protected:
+        /// Selects a refinement.
+        /** P-refinement by one order in both directions for smooth solutions, H-refinement otherwise.
+        *  For details, see Selector::select_refinement. */
+        virtual bool select_refinement(Element* element, int quad_order, Solution<Scalar>* rsln, ElementToRefine& refinement);
+
+        /// Generates orders of elements which will be created due to a proposed refinement in another component that shares the same a mesh.
+        /** If a parameter suggested_quad_orders is NULL, the method uses an encoded order in orig_quad_order.
+        *  For details, see Selector::generate_shared_mesh_orders. */
+        virtual void generate_shared_mesh_orders(const Element* element, const int orig_quad_order, const int refinement, int tgt_quad_orders[H2D_MAX_ELEMENT_SONS], const int* suggested_quad_orders);
+
+        double decay_threshold;
+
+        H1Shapeset shapeset;
+
+        template<typename T> friend class Adapt;
+        template<typename T> friend class KellyTypeAdapt;
+      };
+    }
+  }
+}
+#endif
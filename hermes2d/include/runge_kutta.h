@@ -21,6 +21,7 @@
 #include "function/filter.h"
 #include "exceptions.h"
 #include "mixins2d.h"
+#include "l2_mass_inverse.h"
 namespace Hermes
 {
   namespace Hermes2D
@@ -34,6 +35,8 @@ namespace Hermes
     //     under it, then solve for block at position 22, eliminate all blocks
     //     under it, etc. Currently this is not done and everything is left to
     //     the matrix solver.
+    //     Done for explicit methods: their stages are computed without the Newton's
+    //     method, see set_lumped_mass().
     //
     // (2) In example 03-timedep-adapt-space-and-time with implicit Euler
     //     method, Newton's method takes much longer than in 01-timedep-adapt-space-only
@@ -68,10 +71,12 @@ namespace Hermes
     //     Jordan canonical form (I think) for better performance. This
     //     can be found, I think, in newer Butcher's papers or presentation
     //     (he has them online), and possibly in his book.
+    //     Partially done: see set_decoupled_stages(), which uses the real
+    //     Schur form instead, as it exists for every table.
     /// @ingroup userSolvingAPI
     /// Runge-Kutta methods implementation for time-dependent problems.
     template<typename Scalar>
-    class HERMES_API RungeKutta : public Hermes::Mixins::Loggable, public Hermes::Mixins::TimeMeasurable, public Hermes::Mixins::IntegrableWithGlobalOrder, public Hermes::Mixins::SettableComputationTime, public Hermes::Hermes2D::Mixins::SettableSpaces<Scalar>, public Hermes::Hermes2D::Mixins::MatrixRhsOutput<Scalar>
+    class HERMES_API RungeKutta : public Hermes::Mixins::Loggable, public Hermes::Mixins::TimeMeasurable, public Hermes::Mixins::IntegrableWithGlobalOrder, public Hermes::Mixins::SettableComputationTime, public Hermes::Hermes2D::Mixins::SettableSpaces<Scalar>, public Hermes::Hermes2D::Mixins::MatrixRhsOutput<Scalar>, public Hermes::Mixins::IterationRecordable
     {
     public:
       /// Constructor.
@@ -111,7 +116,56 @@ namespace Hermes
       void rk_time_step_newton(Hermes::vector<Solution<Scalar>*> slns_time_prev, Hermes::vector<Solution<Scalar>*> slns_time_new);
       void rk_time_step_newton(Solution<Scalar>* sln_time_prev, Solution<Scalar>* sln_time_new);
 
+      /// Performs one time step with the adaptive choice of its size (see set_adaptive_time_stepping()), starting
+      /// with the current time step. The step is repeated with a smaller time step while the error estimate of the
+      /// embedded Butcher's table exceeds the tolerance, or while the Newton's method fails. The stage vectors of
+      /// a rejected step are the initial guess of the repeated one, and the mass matrix is not assembled again.
+      /// The time is then advanced by the accepted time step, which is returned, and the time step is set to the one
+      /// proposed by the controller for the next step.
+      double rk_time_step_adaptive(Hermes::vector<Solution<Scalar>*> slns_time_prev, Hermes::vector<Solution<Scalar>*> slns_time_new);
+      double rk_time_step_adaptive(Solution<Scalar>* sln_time_prev, Solution<Scalar>* sln_time_new);
+
+      /// Tolerances of rk_time_step_adaptive(). The error estimate e = h \sum_j (b_j - b2_j) K_j is accepted if
+      /// rms(e) <= abs_tol + rel_tol * max(rms(Y_n), rms(Y_{n+1})), rms being the root mean square of the coefficients.
+      void set_adaptive_time_stepping(double rel_tol, double abs_tol = 0.0);
+      /// The bounds of the time step of rk_time_step_adaptive(), zero max_time_step for no upper bound.
+      /// Falling below min_time_step throws an exception.
+      void set_time_step_bounds(double min_time_step, double max_time_step = 0.0);
+      /// The PID controller of rk_time_step_adaptive(): with the (relative) errors err_n of the accepted steps,
+      /// h_{n+1} = h_n * safety * err_n^{-k_I} * (err_{n-1} / err_n)^{k_P} * (err_{n-1}^2 / (err_n err_{n-2}))^{k_D},
+      /// the change limited to [min_factor, max_factor]. For an embedded error of the order q, k_I = 0.3 / (q + 1),
+      /// k_P = 0.4 / (q + 1) is the PI controller of Gustafsson, k_P = k_D = 0 the elementary one with k_I = 1 / (q + 1).
+      /// The default is the PI controller for q = 1. A rejected step is repeated with safety * err^{-(k_I + k_P)} times the step.
+      void set_time_step_controller(double k_integral, double k_proportional = 0.0, double k_derivative = 0.0,
+        double safety = 0.9, double min_factor = 0.2, double max_factor = 5.0);
+      /// The time step is not increased by rk_time_step_adaptive() unless by at least the factor ratio (1.0 by default). A kept time step
+      /// keeps the stage matrix and its factorization (see set_time_independent_jacobian()), a slightly larger one is not worth their rebuild.
+      void set_max_time_step_ratio_without_rebuild(double ratio);
+
       void set_freeze_jacobian();
+      /// Turn on or off the adaptive reuse of the Jacobian and its factorization (see NewtonSolver::set_jacobian_reuse()).
+      /// The previous Jacobian is kept, also over the time steps, as long as the Newton's residual norm
+      /// contracts at least by max_contraction_rate, otherwise it is assembled and factorized again.
+      void set_jacobian_reuse(bool onOff, double max_contraction_rate = 0.5);
+      /// Number of the Jacobian assemblies and factorizations saved by set_jacobian_reuse().
+      unsigned int get_num_saved_factorizations() const;
+      /// Turn on or off the decoupling of the stages. The Newton's matrix I x M - h A x J of all the stages is replaced
+      /// by the one with the Jacobian J of the stationary residual at the previous time level (the simplified Newton's method),
+      /// which the real Schur form A = Q R Q^T of the Butcher's matrix turns block upper triangular. The stages are then solved
+      /// one after another, by systems of the size ndof (or 2 ndof for a pair of complex eigenvalues of A) instead of one system
+      /// of the size num_stages * ndof. Equal diagonal blocks of R (e.g. of SDIRK tables) share the matrix and its factorization.
+      void set_decoupled_stages(bool onOff = true);
+      /// Turn on or off the assembly of the stage Jacobian by scaling, for autonomous problems: all its blocks are then the
+      /// Jacobian J of the stationary residual times -h a_ij. J is assembled once per time step at the previous time level
+      /// (the simplified Newton's method), or only once if linear is true; then the stage matrix with its factorization is
+      /// also kept while the time step does not change. Needs a matrix with supports_sparse_to_blocks() (UMFPACK).
+      void set_time_independent_jacobian(bool onOff = true, bool linear = false);
+      /// With an explicit Butcher's table, the stages are computed one after another without the Newton's method:
+      /// only the stationary residual is assembled per stage and the mass matrix M is inverted. M is assembled and
+      /// factorized only when the spaces change; for L2 spaces it is not assembled at all, its diagonal blocks of the elements
+      /// are integrated and inverted by L2MassInverse.
+      /// If onOff is true, the lumped (row sum) mass matrix is used instead, e.g. for flux corrected transport.
+      void set_lumped_mass(bool onOff = true);
       void set_newton_tol(double newton_tol);
       void set_newton_max_iter(int newton_max_iter);
       void set_newton_damping_coeff(double newton_damping_coeff);
@@ -160,6 +214,56 @@ namespace Hermes
       // Prepare u_ext_vec.
       void prepare_u_ext_vec();
 
+      /// Calculates the real Schur form of the Butcher's matrix and its diagonal blocks, see set_decoupled_stages().
+      void init_schur_form();
+
+      /// Assembles the Jacobian of the stationary residual at the previous time level, multiplied block-wise
+      /// by block_table, for block_size stages (matrix forms only).
+      /// The matrix shares the pattern if given (see DiscreteProblem::set_sparsity_pattern()).
+      void assemble_stage_block(double** block_table, unsigned int block_size, SparseMatrix<Scalar>* matrix,
+        Hermes::vector<Solution<Scalar>*> slns_time_prev, SparsityPattern* pattern = NULL);
+
+      /// Assembles the matrices of the diagonal blocks of the decoupled stage system (and the Jacobian for their coupling).
+      void assemble_decoupled_stage_matrices(Hermes::vector<Solution<Scalar>*> slns_time_prev);
+
+      /// Solves the decoupled stage system with the right hand side vector_right, the increment of K_vector goes to increment.
+      void solve_decoupled_stages(Scalar* increment);
+
+      void free_decoupled_stage_matrices();
+
+      /// The stage matrix can be built from the stationary Jacobian, see set_time_independent_jacobian().
+      bool can_scale_stationary_jacobian();
+
+      /// Builds matrix_right (without the mass matrix) from the stationary Jacobian.
+      void scale_stationary_jacobian(Hermes::vector<Solution<Scalar>*> slns_time_prev);
+
+      /// Computes the stages of an explicit Butcher's table into K_vector, see set_lumped_mass().
+      void rk_explicit_stages(Hermes::vector<Solution<Scalar>*> slns_time_prev, Hermes::vector<Solution<Scalar>*> slns_time_new);
+
+      /// Assembles (if the spaces changed) and prepares the inversion of the mass matrix for rk_explicit_stages().
+      void init_explicit_mass();
+
+      /// Solves M k = explicit_rhs with the (lumped) mass matrix M prepared by init_explicit_mass().
+      void solve_explicit_stage(Scalar* k);
+
+      void free_explicit_mass();
+
+      /// Calculates the new time level solution (and the error estimate) from K_vector.
+      void finish_time_step(Hermes::vector<Solution<Scalar>*> slns_time_prev, Hermes::vector<Solution<Scalar>*> slns_time_new,
+        Hermes::vector<Solution<Scalar>*> error_fns);
+
+      /// Makes the work vectors large enough for ndof unknowns (per stage). They only grow.
+      void ensure_workspace(unsigned int ndof);
+
+      /// Updates the copies of the spaces for the stages, they are only recreated when the spaces change.
+      void update_stage_spaces();
+
+      /// Assembles the mass matrix matrix_left, if the spaces changed since it was assembled last.
+      void assemble_mass_matrix();
+
+      /// The relative error (see set_adaptive_time_stepping()) of the last time step.
+      double embedded_error_norm();
+
       /// Matrix for the time derivative part of the equation (left-hand side).
       SparseMatrix<Scalar>* matrix_left;
 
@@ -207,7 +311,83 @@ namespace Hermes
       int newton_max_iter;
       double newton_damping_coeff;
       double newton_max_allowed_residual_norm;
-      
+
+      /// Adaptive Jacobian reuse (see set_jacobian_reuse()).
+      bool jacobian_reuse;
+      double max_jacobian_reuse_contraction_rate;
+      /// matrix_right has been assembled and factorized and it can be reused.
+      bool jacobian_factorized;
+      unsigned int num_saved_factorizations;
+
+      /// Decoupling of the stages (see set_decoupled_stages()).
+      bool decoupled_stages;
+      /// The real Schur form A = schur_Q * schur_R * schur_Q^T of the Butcher's matrix.
+      double** schur_Q;
+      double** schur_R;
+      /// The first stages of the diagonal blocks of schur_R (of the size 1 or 2), the last entry is num_stages.
+      Hermes::vector<unsigned int> schur_block_starts;
+      /// The index of the block whose matrix and solver the block uses (the block itself or a previous equal one).
+      Hermes::vector<unsigned int> schur_block_owners;
+      /// The matrices, right hand sides and solvers of the diagonal blocks, NULL for the blocks that are not owners.
+      Hermes::vector<SparseMatrix<Scalar>*> schur_block_matrices;
+      Hermes::vector<Vector<Scalar>*> schur_block_rhs;
+      Hermes::vector<LinearMatrixSolver<Scalar>*> schur_block_solvers;
+      Hermes::vector<bool> schur_block_factorized;
+      /// The Jacobian of the stationary residual, NULL if schur_R is block diagonal.
+      SparseMatrix<Scalar>* stage_jacobian;
+
+      /// Stage Jacobian by scaling (see set_time_independent_jacobian()).
+      bool time_independent_jacobian;
+      bool time_independent_jacobian_linear;
+      /// The Jacobian of the stationary residual and the time it was assembled at.
+      SparseMatrix<Scalar>* stationary_jacobian;
+      double stationary_jacobian_time;
+      /// matrix_right has the structure of the current spaces.
+      bool stage_matrix_structure_valid;
+      /// The time step of the last matrix_right, -1 if it cannot be reused.
+      double stage_matrix_time_step;
+
+      /// The explicit path (see set_lumped_mass()).
+      bool lumped_mass;
+      /// The weak formulation of one stage residual (vector forms only) and its discrete problem.
+      WeakForm<Scalar>* explicit_wf;
+      DiscreteProblem<Scalar>* explicit_dp;
+      Vector<Scalar>* explicit_rhs;
+      /// The solver of the mass matrix (matrix_left), used if neither lumped nor all spaces are L2.
+      LinearMatrixSolver<Scalar>* mass_solver;
+      /// The seqs of the spaces the mass matrix was prepared for, empty if it has to be prepared again.
+      Hermes::vector<int> explicit_mass_seqs;
+      /// The inverse of the lumped mass matrix.
+      Scalar* lumped_mass_inverse;
+      /// The inverse of the mass matrix of L2 spaces, calculated element by element without assembling matrix_left.
+      L2MassInverse<Scalar>* l2_mass_inverse;
+
+      /// The seqs of the spaces matrix_left was assembled for.
+      Hermes::vector<int> mass_matrix_seqs;
+
+      /// Adaptive time stepping (see set_adaptive_time_stepping()).
+      double adaptive_rel_tol;
+      double adaptive_abs_tol;
+      double min_time_step;
+      double max_time_step;
+      double controller_k_integral;
+      double controller_k_proportional;
+      double controller_k_derivative;
+      double controller_safety;
+      double controller_min_factor;
+      double controller_max_factor;
+      double time_step_keep_ratio;
+      /// The errors of the last two accepted time steps, 0.0 if there are none.
+      double last_step_error;
+      double second_last_step_error;
+
+      /// The number of unknowns (per stage) the work vectors below are allocated for.
+      unsigned int workspace_ndof;
+
+      /// Copies of the spaces for all the stages (num_stages * spaces.size()), and the seqs of the spaces they were copied from.
+      Hermes::vector<Space<Scalar>*> stage_spaces;
+      Hermes::vector<int> stage_spaces_seqs;
+
       Hermes::vector<Solution<Scalar>*> residuals_vector;
 
       /// Vector K_vector of length num_stages * ndof. will represent
@@ -219,6 +399,12 @@ namespace Hermes
 
       /// Vector for the left part of the residual.
       Scalar* vector_left;
+
+      /// The coefficients of the new time level solution (of length ndof).
+      Scalar* sln_coeff_vec;
+
+      /// The Newton's increment of the decoupled stage system (of length num_stages * ndof).
+      Scalar* decoupled_increment;
       
       ///< The filters to reinitialize in every Newton's loop
       Hermes::vector<Filter<Scalar>*> filters_to_reinit;
@@ -18,6 +18,7 @@
 
 #include "../function/function.h"
 #include "../shapeset/shapeset.h"
+#include "../mixins2d.h"
 
 namespace Hermes
 {
@@ -30,7 +31,7 @@ namespace Hermes
     /// PrecalcShapeset is a cache of precalculated shape function values.
     ///
     ///
-    class HERMES_API PrecalcShapeset : public Function<double>
+    class HERMES_API PrecalcShapeset : public Function<double>, public Hermes::Hermes2D::Mixins::MemoryAccounted
     {
     public:
       /// Returns type of space
@@ -52,6 +53,11 @@ namespace Hermes
       /// Destructor.
       virtual ~PrecalcShapeset();
 
+      /// Returns the memory of the tables of the instance in bytes, 0 for a slave instance. The shared reference tables
+      /// are not included (they are counted by CacheStatistics).
+      std::size_t get_memory_usage() const;
+      virtual std::size_t get_total_memory_usage() const;
+
       /// Ensures subsequent calls to get_active_element() will be returning 'e'.
       /// Switches the class to the appropriate mode (triangle, quad).
       virtual void set_active_element(Element* e);
@@ -62,15 +68,83 @@ namespace Hermes
       /// \param index[in] Shape index.
       void set_active_shape(int index);
 
+      /// See Function::set_quad_order.
+      /// Values of standard shape functions on the standard quadrature are taken from
+      /// the cache shared by all instances over the same shapeset type.
+      virtual void set_quad_order(unsigned int order, int mask = H2D_FN_DEFAULT);
+
     private:
+      /// \brief Process-wide cache of the shape function values of one shapeset type.
+      /// \details Nodes are keyed by (mode, shape index, sub_idx, quad order, mask level),
+      /// level 0 holding H2D_FN_DEFAULT and level 1 H2D_FN_ALL. The untransformed shapes
+      /// (sub_idx == 0) live in a dense table indexed by [mode][shape index][quad order],
+      /// the transformed ones in an insert-only hash table of rows over the quad orders.
+      /// Lookups do not lock: a slot is published once, after its contents are written,
+      /// and never changes afterwards. Only the calculation of a missing node is serialized.
+      class ReferenceTable
+      {
+      public:
+        ReferenceTable(int max_index_tri, int max_index_quad);
+        ~ReferenceTable();
+
+        /// Returns the slot of the given node, NULL if out of range or if the table is full.
+        Node** get_entry(ElementMode2D mode, int index, uint64_t sub_idx, unsigned int order, int level);
+
+      private:
+        /// Capacity of sub_rows, a power of two.
+        static const int H2D_NUM_SUB_ROWS = 1 << 14;
+
+        /// Row of the transformed shape in sub_rows.
+        struct SubRow
+        {
+          /// (sub_idx, index, mode), zero for an empty row.
+          uint64_t key;
+          Node** nodes;
+        };
+
+        /// Returns the row of nodes over (quad order, level) of the key, inserts it if missing.
+        Node** get_sub_row(uint64_t key, int row_size);
+
+        /// Dense rows of the untransformed shapes, the quad ones start at offset[HERMES_MODE_QUAD].
+        Node** nodes;
+        int size;
+        int offset[H2D_NUM_MODES];
+        int num_indices[H2D_NUM_MODES];
+        int num_orders[H2D_NUM_MODES];
+
+        SubRow* sub_rows;
+        int num_sub_rows;
+      };
+
+      /// Returns the table shared by all instances over the shapeset type, creates it if needed.
+      static ReferenceTable* get_reference_table(Shapeset* shapeset);
+
+      /// Shared tables by Shapeset::get_id(), freed at exit.
+      struct ReferenceTables
+      {
+        ~ReferenceTables();
+        ReferenceTable* tables[H2D_NUM_SHAPESET_IDS];
+      };
+      static ReferenceTables reference_tables;
+
+      /// Table of this->shapeset, NULL if the shapeset type has none.
+      ReferenceTable* reference_table;
+
+      /// True iff the active shape values can be taken from reference_table.
+      bool use_reference_table() const;
+
+      /// Calculates the values of the active shape on the active sub-element for reference_table.
+      Node* precalculate_reference(int order, int level);
+
+      /// Calculates the expansion k of the active shape at the (transformed) points x, y of the rule,
+      /// sum-factorized on tensor product rules of tensor product shapesets.
+      void calculate_values(Quad2D* quad, int order, int k, int component, const double* x, const double* y, double* result);
+
       virtual void set_quad_2d(Quad2D* quad_2d);
 
       /// \brief Frees all precalculated tables.
       virtual void free();
 
-      /// Virtual function handling overflows. Has to be virtual, because
-      /// the necessary iterators in the templated class do not work with GCC.
-      virtual void handle_overflow_idx();
 
 
       /// Returns the index of the active shape (can be negative if the shape is constrained).
@@ -128,6 +202,7 @@ namespace Hermes
       template<typename T> friend class DiscontinuousFunc;
       template<typename T> friend class DiscreteProblem;
       template<typename T> friend class NeighborSearch;
+      template<typename T> friend class L2MassInverse;
       friend class CurvMap;
     };
   }
@@ -41,6 +41,7 @@ namespace Hermes
       template<typename Scalar> class H1ProjBasedSelector;
       template<typename Scalar> class L2ProjBasedSelector;
       template<typename Scalar> class HcurlProjBasedSelector;
+      template<typename Scalar> class SmoothnessSelector;
     };
 
     enum SpaceType {
@@ -51,6 +52,13 @@ namespace Hermes
       HERMES_INVALID_SPACE = -9999
     };
 
+    /// Upper bound (exclusive) of the values returned by Shapeset::get_id().
+    const int H2D_NUM_SHAPESET_IDS = 32;
+
+    /// Shape functions up to this order are evaluated from their monomial coefficients
+    /// by Shapeset::get_values().
+    const int H2D_BATCH_MAX_ORDER = 4;
+
     /// @ingroup spaces
     /// \brief Defines a set of shape functions.
     ///
@@ -118,6 +126,10 @@ namespace Hermes
       /// Returns space type.
       virtual SpaceType get_space_type() const = 0;
 
+      /// Returns true if all shape functions on elements of the mode (and all their expansions)
+      /// are products f(x) g(y), which allows get_values_tensor().
+      virtual bool is_tensor_product(ElementMode2D mode) const;
+
     protected:
       /// Returns a complete set of indices of bubble functions for an element of the given order.
       int* get_bubble_indices(int order, ElementMode2D mode) const;
@@ -133,6 +145,20 @@ namespace Hermes
       /// domain, component is 0 for Scalar shapesets and 0 or 1 for vector shapesets.
       double get_value(int n, int index, double x, double y, int component, ElementMode2D mode);
 
+      /// Obtains the values of the given shape function at the points (x[i], y[i]), i < np.
+      /// Functions of order up to H2D_BATCH_MAX_ORDER are evaluated from their coefficients
+      /// in the monomials x^a y^b in one loop over the points, the others by get_value().
+      void get_values(int n, int index, int np, const double* x, const double* y, int component, ElementMode2D mode, double* result);
+
+      /// Obtains the values of the given shape function at the tensor product points (x[a], y[b]),
+      /// stored to result[a * ny + b]. Requires is_tensor_product(mode): the function is evaluated
+      /// along one line in each direction only, the rest are products of the two.
+      void get_values_tensor(int n, int index, int nx, const double* x, int ny, const double* y, int component, ElementMode2D mode, double* result);
+
+      /// Returns the monomial coefficients used by get_values(), NULL if the function is not
+      /// of low order or not a polynomial with the given monomials.
+      const double* get_coefficients(int n, int index, int component, ElementMode2D mode);
+
       double get_fn_value (int index, double x, double y, int component, ElementMode2D mode);
       double get_dx_value (int index, double x, double y, int component, ElementMode2D mode);
       double get_dy_value (int index, double x, double y, int component, ElementMode2D mode);
@@ -209,7 +235,9 @@ namespace Hermes
       template<typename Scalar> friend class RefinementSelectors::L2ProjBasedSelector;
       template<typename Scalar> friend class RefinementSelectors::HcurlProjBasedSelector;
       template<typename Scalar> friend class RefinementSelectors::OptimumSelector;
+      template<typename Scalar> friend class RefinementSelectors::SmoothnessSelector;
       friend class PrecalcShapeset;
+      friend class ReferenceIntegrals;
       friend void check_leg_tri(Shapeset* shapeset);
       friend void check_gradleg_tri(Shapeset* shapeset);
       template<typename Scalar> friend class Form;
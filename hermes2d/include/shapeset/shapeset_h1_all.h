@@ -47,6 +47,7 @@ namespace Hermes
     public:
       H1ShapesetJacobi();
       virtual Shapeset* clone() { return new H1ShapesetJacobi(*this); };
+      virtual bool is_tensor_product(ElementMode2D mode) const { return mode == HERMES_MODE_QUAD; }
       virtual int get_max_index(ElementMode2D mode);
     private:
       virtual int get_id() const { return 1; }
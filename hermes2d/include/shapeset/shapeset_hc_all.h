@@ -39,6 +39,8 @@ namespace Hermes
       static const int max_index[H2D_NUM_MODES];
     };
 
+    // The experimental eigen shapesets below are disabled, their sources (shapeset_hc_eigen2.cpp,
+    // shapeset_hc_gradeigen.cpp) are not compiled into the library.
     /*
     // Experimental.
     /// @ingroup spaces
@@ -31,6 +31,7 @@ namespace Hermes
     public:
       L2ShapesetLegendre();
       virtual Shapeset* clone() { return new L2ShapesetLegendre(*this); };
+      virtual bool is_tensor_product(ElementMode2D mode) const { return mode == HERMES_MODE_QUAD; }
       virtual SpaceType get_space_type() const { return HERMES_L2_SPACE; }
       virtual int get_max_index(ElementMode2D mode);
     protected:
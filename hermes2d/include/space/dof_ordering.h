@@ -0,0 +1,106 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_DOF_ORDERING_H
+#define __H2D_DOF_ORDERING_H
+
+#include "../global.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// Strategies of numbering the basis functions of a Space, see Space::set_dof_ordering().
+    enum DofOrderingType
+    {
+      HERMES_DOF_ORDERING_NATURAL = 0,           ///< The vertex, edge and bubble functions in turn (default).
+      HERMES_DOF_ORDERING_RCM = 1,               ///< Reverse Cuthill-McKee, reduces the bandwidth of the matrix.
+      HERMES_DOF_ORDERING_NESTED_DISSECTION = 2, ///< Nested dissection, reduces the fill-in of direct solvers.
+      HERMES_DOF_ORDERING_ELEMENT_BLOCKS = 3     ///< The functions of each element together, in the order of the elements.
+    };
+
+    /// Granularity of the common numbering of several spaces, see Space::assign_dofs_interleaved().
+    enum DofInterleavingType
+    {
+      HERMES_DOF_INTERLEAVING_NODES = 0,   ///< The functions of all spaces at a vertex, an edge or an element interior together.
+      HERMES_DOF_INTERLEAVING_ELEMENTS = 1 ///< The functions of all spaces first appearing in an element together.
+    };
+
+    /// @ingroup spaces
+    /// \brief Orderings of the vertices of a graph, used to number the basis functions.
+    /// \details The graph is given in the compressed format: the neighbors of the vertex i are
+    /// adjacency[adjacency_start[i]], ..., adjacency[adjacency_start[i + 1] - 1]. The orderings
+    /// fill the array order with the vertices in their new order (order[new position] = vertex).
+    class HERMES_API DofOrdering
+    {
+    public:
+      /// Reverse Cuthill-McKee ordering of each connected component, started from a pseudo-peripheral vertex.
+      static void reverse_cuthill_mckee(int num_vertices, const int* adjacency_start, const int* adjacency, int* order);
+
+      /// Nested dissection: the graph is split by a level of its level structure into two parts,
+      /// which are ordered (recursively) first, followed by the separating level.
+      static void nested_dissection(int num_vertices, const int* adjacency_start, const int* adjacency, int* order);
+
+      /// Parts with at most this number of vertices are not dissected further, but ordered by reverse Cuthill-McKee.
+      static const int H2D_DISSECTION_LEAF_SIZE = 64;
+
+    protected:
+      /// The graph being ordered, its vertices labeled by the parts they belong to (-1 once ordered).
+      class Graph
+      {
+      public:
+        Graph(int num_vertices, const int* adjacency_start, const int* adjacency);
+        ~Graph();
+
+        /// Breadth-first search from root through the vertices labeled by label. The vertices are stored
+        /// by the levels, the level l starts at level_start[l]. Neighbors of each vertex are visited in
+        /// the order of increasing degree if sort_by_degree is set. Returns the number of levels.
+        int get_level_structure(int root, int label, std::vector<int>& vertices, std::vector<int>& level_start, bool sort_by_degree);
+
+        /// Returns a vertex of (nearly) the maximum eccentricity in the part of start.
+        int get_pseudo_peripheral_vertex(int start, int label);
+
+        /// Appends the reverse Cuthill-McKee ordering of the part of root to order.
+        void append_reverse_cuthill_mckee(int root, int label, std::vector<int>& order);
+
+        /// Appends the nested dissection ordering of the part of the given vertices to order.
+        void dissect(int label, const std::vector<int>& vertices, std::vector<int>& order);
+
+        inline int get_degree(int v) const { return adjacency_start[v + 1] - adjacency_start[v]; }
+
+        int num_vertices;
+        const int* adjacency_start;
+        const int* adjacency;
+
+        int* labels;
+        int next_label;
+
+        /// Vertices visited in the current search are marked by visit_stamp.
+        int* visited;
+        int visit_stamp;
+
+        /// Comparison of vertices by their degrees.
+        class DegreeLess
+        {
+        public:
+          DegreeLess(const Graph* graph) : graph(graph) {};
+          bool operator()(int a, int b) const;
+          const Graph* graph;
+        };
+      };
+    };
+  }
+}
+#endif
@@ -19,6 +19,7 @@
 #include "../mesh/mesh.h"
 #include "../shapeset/shapeset.h"
 #include "asmlist.h"
+#include "dof_ordering.h"
 #include "../mesh/traverse.h"
 #include "../quadrature/quad_all.h"
 #include "../boundary_conditions/essential_boundary_conditions.h"
@@ -101,8 +102,20 @@ namespace Hermes
     /// <br>
     /// The handling of irregular meshes is desribed in H1Space and HcurlSpace.<br>
     ///
+    /// \brief Memory used by a space, in bytes, see Space::get_memory_usage().
+    struct HERMES_API SpaceMemoryUsage
+    {
+      std::size_t node_data;        ///< The node data table (ndata), including the unused items, and the boundary projections.
+      std::size_t element_data;     ///< The element data table (edata), including the unused items.
+      std::size_t projection;       ///< The edge projection matrix (proj_mat) and its Cholesky factor.
+      std::size_t assembly_lists;   ///< The cached assembly lists.
+      std::size_t auxiliary;        ///< The element coloring and the tracking of the DOF numbering.
+
+      std::size_t get_total() const;
+    };
+
     template<typename Scalar>
-    class HERMES_API Space : public Hermes::Mixins::Loggable, public Hermes::Hermes2D::Mixins::StateQueryable, public Hermes::Hermes2D::Mixins::XMLParsing
+    class HERMES_API Space : public Hermes::Mixins::Loggable, public Hermes::Hermes2D::Mixins::StateQueryable, public Hermes::Hermes2D::Mixins::XMLParsing, public Hermes::Hermes2D::Mixins::MemoryAccounted
     {
     public:
       Space();
@@ -183,12 +196,28 @@ namespace Hermes
       /// Saves this space into a file.
       bool save(const char *filename) const;
 
+      /// Saves this space into a binary file. The element data are written as raw arrays, no XML is built nor parsed
+      /// on loading, which makes restarts of large calculations much faster. The files are not portable between platforms
+      /// of different byte order.
+      /// \param[in] compress If true, the arrays are compressed (requires WITH_ZSTD, ignored otherwise).
+      bool save_bin(const char *filename, bool compress = false) const;
+
       /// Loads a space from a file.
+      /// The file may be written by save(), save_bin() (recognized by its header), or it may be a delta file
+      /// written by save_delta(), the chain of its parent files is then read.
       static Space<Scalar>* load(const char *filename, Mesh* mesh, bool validate, EssentialBCs<Scalar>* essential_bcs = NULL, Shapeset* shapeset = NULL);
 
       /// Obtains an assembly list for the given element.
+      /// The lists of all active elements are calculated on the first call and reused until the DOFs are assigned
+      /// (or the essential boundary condition values updated) again.
       virtual void get_element_assembly_list(Element* e, AsmList<Scalar>* al, unsigned int first_dof = 0) const;
 
+      /// Obtains a coloring of active elements such that no two elements of the same color share a DOF.
+      /// The coloring is calculated on the first call and reused until get_seq() changes.
+      /// \param[out] num_colors The number of colors.
+      /// \return Colors indexed by element id, -1 for elements that are not active.
+      const int* get_element_coloring(int& num_colors) const;
+
       /// Copy from Space instance 'space'
       virtual void copy(const Space<Scalar>* space, Mesh* new_mesh);
 
@@ -225,6 +254,48 @@ namespace Hermes
         unsigned int order_increase;
       };
 
+      /// Class for creating reference spaces repeatedly during adaptivity, reusing the previous one where possible.
+      /// The reference mesh and space are owned by this object, they are valid until the next call to update_ref_space()
+      /// that has to create them anew, or until this object is destroyed.
+      /// The reference mesh is only reused while the coarse mesh does not change, since the ids of the coarse elements
+      /// are the ids of their copies in the reference mesh (see ReferenceSpaceCreator::handle_orders()).
+      class HERMES_API IncrementalReferenceSpaceCreator
+      {
+      public:
+        /// Constructor.
+        /// \param[in] coarse_space The coarse (original) space, adapted between calls of update_ref_space().
+        /// \param[in] refinement See Mesh::ReferenceMeshCreator.
+        /// \param[in] order_increase Increase of the polynomial order.
+        IncrementalReferenceSpaceCreator(const Space<Scalar>* coarse_space, int refinement = 0, unsigned int order_increase = 1);
+
+        /// Destructor, deletes the reference space and mesh.
+        ~IncrementalReferenceSpaceCreator();
+
+        /// Returns the reference space for the current state of the coarse space.
+        /// If the coarse mesh did not change since the last call, the previous reference mesh and space are kept
+        /// and the orders are updated only on the coarse elements that have changed_in_last_adaptation set or whose order differs.
+        /// Otherwise the reference mesh and space are created anew by Mesh::ReferenceMeshCreator and ReferenceSpaceCreator.
+        Space<Scalar>* update_ref_space(bool assign_dofs = true);
+
+        /// Returns true if the last call of update_ref_space() reused the previous reference mesh and space.
+        bool was_reused() const;
+
+      private:
+        /// The order of the reference space on the coarse element e.
+        int get_ref_order(Element* e) const;
+
+        /// Storage.
+        const Space<Scalar>* coarse_space;
+        int refinement;
+        unsigned int order_increase;
+        Mesh* ref_mesh;
+        Space<Scalar>* ref_space;
+        unsigned int coarse_mesh_seq;
+        /// The coarse orders the reference space is made of, indexed by the coarse element ids.
+        std::vector<int> coarse_orders;
+        bool reused;
+      };
+
       /// Sets element polynomial order. This version does not call assign_dofs() and is
       /// intended primarily for internal use.
       virtual void set_element_order_internal(int id, int order);
@@ -238,10 +309,71 @@ namespace Hermes
       virtual int assign_dofs(int first_dof = 0, int stride = 1);
 
       /// \brief Assings the degrees of freedom to all Spaces in the Hermes::vector.
+      /// \details Each space numbers its basis functions according to its own set_dof_ordering().
       static int assign_dofs(Hermes::vector<Space<Scalar>*> spaces);
 
+      /// \brief Assigns the degrees of freedom of all Spaces in a common, interleaved numbering.
+      /// \details The functions of all spaces belonging to a node (or to an element) are numbered
+      /// together, so that the matrix of a coupled system consists of small dense blocks. The nodes
+      /// and elements are visited in the order of the active elements, the orderings of the individual
+      /// spaces are not used. All spaces have to be defined on the same mesh. The DOF numbers of the
+      /// spaces are global, has_interleaved_dofs() then tells DiscreteProblem and Solution not to
+      /// offset them by the numbers of DOFs of the preceding spaces.
+      /// \return The total number of basis functions.
+      static int assign_dofs_interleaved(Hermes::vector<Space<Scalar>*> spaces, DofInterleavingType interleaving = HERMES_DOF_INTERLEAVING_NODES);
+
+      /// True if the DOFs were assigned by assign_dofs_interleaved().
+      bool has_interleaved_dofs() const;
+
+      /// \brief Keeps the numbering of the previous assign_dofs() to relate it to the current one (default: off).
+      /// \details With the tracking on, assign_dofs() (with the natural ordering) keeps the nodes and elements
+      /// that did not change since the previous assignment in their previous order, only the functions of the
+      /// changed patch are numbered anew (next to their unchanged neighbors). The mapping of the previous
+      /// DOFs to the current ones is available by get_dof_mapping().
+      void set_dof_tracking(bool enabled);
+
+      /// The previous DOFs mapped to the current ones by assign_dofs() with the tracking on, see set_dof_tracking().
+      /// The array is indexed by (previous DOF - previous first DOF) / previous stride, it contains the current DOF
+      /// numbers, or -1 for the functions which are not in the space anymore. NULL if there was no previous assignment.
+      const int* get_dof_mapping() const;
+
+      /// The length of the array returned by get_dof_mapping().
+      int get_dof_mapping_size() const;
+
+      /// Returns the memory used by the space, split by the data structures.
+      SpaceMemoryUsage get_memory_usage() const;
+      virtual std::size_t get_total_memory_usage() const;
+
+      /// Transfers the coefficients of the previous numbering (get_dof_mapping_size() of them) to the current one,
+      /// the coefficients of the new functions are set to zero.
+      void transfer_coeff_vector(const Scalar* previous_coeff_vec, Scalar* coeff_vec) const;
+
+      /// Sets the strategy of numbering the basis functions by assign_dofs() (default: HERMES_DOF_ORDERING_NATURAL).
+      /// The functions of a node (or of the interior of an element) are always numbered consecutively,
+      /// the strategies order these blocks, blocks sharing an element being neighbors in the graph ordered.
+      void set_dof_ordering(DofOrderingType dof_ordering);
+
+      DofOrderingType get_dof_ordering() const;
+
       virtual Scalar* get_bc_projection(SurfPos* surf_pos, int order, EssentialBoundaryCondition<Scalar> *bc) = 0;
 
+      /// The geometry of a point of a boundary edge at which the essential conditions are evaluated.
+      struct EdgeBCPoint
+      {
+        double x, y, n_x, n_y, t_x, t_y;
+      };
+
+      /// The same projection with the geometry of the edge calculated beforehand by calc_edge_bc_points(), NULL for
+      /// constant conditions. Called in parallel by update_essential_bc_values(), i.e. it (and the conditions) has to be thread-safe.
+      /// The default ignores the points and calls get_bc_projection().
+      virtual Scalar* get_bc_projection(SurfPos* surf_pos, int order, EssentialBoundaryCondition<Scalar> *bc, const EdgeBCPoint* points);
+
+      /// The number of the points of an edge: the two endpoints, then the points of the 1D quadrature of the maximum order.
+      static int get_edge_bc_points_count();
+
+      /// Evaluates the geometry at the points of the edge (surf_pos->lo, surf_pos->hi of the base element edge).
+      static void calc_edge_bc_points(SurfPos* surf_pos, EdgeBCPoint* points);
+
       static void update_essential_bc_values(Hermes::vector<Space<Scalar>*> spaces, double time);
 
       static void update_essential_bc_values(Space<Scalar>*s, double time);
@@ -255,6 +387,10 @@ namespace Hermes
       /// Sets polynomial orders to elements created by Mesh::regularize() using "parents".
       void distribute_orders(Mesh* mesh, int* parents);
 
+      /// Moves the per-element data after Mesh::reorder_hilbert() renumbered the elements of the mesh.
+      /// \param[in] new_element_ids The new ids indexed by the old ones, as returned by Mesh::reorder_hilbert().
+      void reorder_element_data(const int* new_element_ids);
+
       /// Internal. Obtains the order of an edge, according to the minimum rule.
       virtual int get_edge_order(Element* e, int edge) const;
 
@@ -274,7 +410,7 @@ namespace Hermes
       void free();
 
       /// Returns the total (global) number of vertex functions.
-      /// The DOF ordering starts with vertex functions, so it it necessary to know how many of them there are.
+      /// The natural DOF ordering starts with vertex functions, so it it necessary to know how many of them there are.
       int get_vertex_functions_count();
       /// Returns the total (global) number of edge functions.
       int get_edge_functions_count();
@@ -305,6 +441,35 @@ namespace Hermes
       int seq, mesh_seq;
       int was_assigned;
 
+      /// Incremented by every update_essential_bc_values(), i.e. also by every assignment of DOFs.
+      /// Unlike seq it tells whether the Dirichlet lift may have changed.
+      unsigned int bc_values_seq;
+
+      /// See set_dof_ordering().
+      DofOrderingType dof_ordering;
+
+      /// See has_interleaved_dofs().
+      bool interleaved_dofs;
+
+      /// A node (or an element interior) and its DOFs in the previous numbering, see set_dof_tracking().
+      struct DofBlockRecord
+      {
+        int dof, n;
+        /// Vertex nodes: the parents and the coordinates, edge nodes: the vertices, elements: the vertices and the order.
+        int key[4];
+        double x, y;
+      };
+
+      /// See set_dof_tracking().
+      bool dof_tracking;
+
+      /// The previous numbering, indexed by the node and element ids.
+      std::vector<DofBlockRecord> previous_node_blocks, previous_element_blocks;
+      int previous_first_dof, previous_stride, previous_size;
+
+      /// See get_dof_mapping().
+      std::vector<int> dof_mapping;
+
       struct BaseComponent
       {
         int dof;
@@ -345,6 +510,62 @@ namespace Hermes
         bool changed_in_last_adaptation;
       };
 
+      /// Cached element coloring (see get_element_coloring()) and the seq it was calculated for.
+      mutable int* element_colors;
+      mutable int element_colors_count;
+      mutable int element_colors_seq;
+
+      /// Copies of the element data written by save(), paired with the element ids.
+      typedef Hermes::vector<std::pair<int, ElementData> > ElementDataSnapshot;
+
+      /// Writes a space file from a snapshot of the element data, see save().
+      static bool save(const char *filename, SpaceType type, const ElementDataSnapshot& element_data);
+
+      /// Writes a binary space file from a snapshot of the element data, see save_bin().
+      static bool save_bin(const char *filename, SpaceType type, const ElementDataSnapshot& element_data, bool compress);
+
+      /// Writes a delta file storing only the element data that differ from those of a space previously
+      /// saved to parent_filename (by save() or save_delta()).
+      /// \param[in] parent_element_data The snapshot the parent file was written from.
+      static bool save_delta(const char *filename, SpaceType type, const ElementDataSnapshot& element_data, const char* parent_filename, const ElementDataSnapshot& parent_element_data);
+
+      /// Reads the snapshot of the element data from a file written by save(), save_bin() or save_delta().
+      static void load_element_data(const char *filename, bool validate, SpaceType& type, ElementDataSnapshot& element_data);
+
+      /// Creates a space from a snapshot of the element data, see load().
+      static Space<Scalar>* load(SpaceType type, const ElementDataSnapshot& element_data, Mesh* mesh, EssentialBCs<Scalar>* essential_bcs, Shapeset* shapeset);
+
+      /// The header of a delta file, followed by the name of the parent file, the changed element data
+      /// (5 ints each: id, order, bdof, n, changed_in_last_adaptation) and the ids of the removed elements,
+      /// each block starting at a multiple of 8 bytes.
+      struct DeltaHeader
+      {
+        char magic[8];
+        int byte_order;
+        int version;
+        int space_type;
+        int parent_name_length;
+        int changed_count;
+        int removed_count;
+      };
+
+      /// The header of a binary space file, followed by one block of the element data as five arrays of count ints
+      /// (ids, orders, bdofs, ns, changed_in_last_adaptation), compressed to block_size bytes if compression is nonzero.
+      struct BinaryHeader
+      {
+        char magic[8];
+        int byte_order;
+        int version;
+        int space_type;
+        int count;
+        int compression;
+        int padding;
+        uint64_t block_size;
+      };
+
+      /// Takes the snapshot of the element data written by save().
+      void get_element_data_snapshot(ElementDataSnapshot& element_data) const;
+
       NodeData* ndata;    ///< node data table
       ElementData* edata; ///< element data table
       int nsize, ndata_allocated; ///< number of items in ndata, allocated space
@@ -361,6 +582,9 @@ namespace Hermes
       /// enough to contain all node and element id's, and to reallocate them if not.
       virtual void resize_tables();
 
+      /// Unregisters the space from its mesh (see Mesh::space_count) and sets the mesh to NULL.
+      void release_mesh();
+
       void update_orders_recurrent(Element* e, int order);
 
       virtual void reset_dof_assignment(); ///< Resets assignment of DOF to an unassigned state.
@@ -368,18 +592,86 @@ namespace Hermes
       virtual void assign_edge_dofs() = 0;
       virtual void assign_bubble_dofs() = 0;
 
+      /// Renumbers the assigned DOFs according to dof_ordering, before the constraints are calculated.
+      void reorder_dofs();
+
+      /// The first part of assign_dofs(): numbers the vertex, edge and bubble functions.
+      /// Returns false if the space is not ready to be assigned.
+      bool number_dofs(int first_dof, int stride);
+
+      /// The second part of assign_dofs(): the boundary conditions and the constraints of the numbered functions.
+      void finish_dofs_assignment();
+
+      /// Gives the functions of the node the DOF numbers starting at dof (if they were not renumbered yet), see assign_dofs_interleaved().
+      void interleave_node_dofs(Node* node, bool* renumbered, int& dof);
+
+      /// The record of the node (the element interior) in the previous numbering, NULL if it was not numbered or it changed since.
+      const DofBlockRecord* get_previous_block(Node* node) const;
+      const DofBlockRecord* get_previous_block(Element* e) const;
+
+      /// Renumbers the DOFs so that the unchanged nodes and elements keep their previous order, see set_dof_tracking().
+      void renumber_dofs_stably();
+
+      /// Adds a block of renumber_dofs_stably(), the changed blocks (record == NULL) are placed after the
+      /// unchanged block anchor.
+      void add_stable_block(const DofBlockRecord* record, int* dof, int n, int& anchor, std::vector<std::pair<std::pair<int, int>, int> >& keys,
+        std::vector<int*>& block_dofs, std::vector<int>& block_lengths);
+
+      /// Calculates dof_mapping and records the current numbering as the previous one.
+      void update_dof_tracking();
+
       virtual void get_vertex_assembly_list(Element* e, int iv, AsmList<Scalar>* al) const = 0;
       virtual void get_boundary_assembly_list_internal(Element* e, int surf_num, AsmList<Scalar>* al) const = 0;
       virtual void get_bubble_assembly_list(Element* e, AsmList<Scalar>* al) const;
 
+      /// Calculates the assembly list of the element (without the cache), the vertex, edge and bubble functions in turn.
+      virtual void calculate_element_assembly_list(Element* e, AsmList<Scalar>* al) const;
+
+      /// The cached assembly lists of the active elements in the CSR format: those of the element id are
+      /// al_cache_idx[al_cache_start[id]], ..., al_cache_idx[al_cache_start[id + 1] - 1] (and the same
+      /// in al_cache_dof, al_cache_coef). al_cache_start is NULL if the cache is not calculated.
+      mutable int* al_cache_start;
+      mutable int* al_cache_idx;
+      mutable int* al_cache_dof;
+      mutable Scalar* al_cache_coef;
+      mutable int al_cache_size;  ///< The maximum element id, al_cache_start has al_cache_size + 1 items.
+
+      /// Calculates the assembly list cache.
+      void build_assembly_list_cache() const;
+      void free_assembly_list_cache();
+
       double** proj_mat;
       double*  chol_p;
+      /// The size of proj_mat (and chol_p).
+      int proj_mat_size;
 
       /// Used for bc projection.
       Hermes::vector<void*> bc_data;
 
       void precalculate_projection_matrix(int nv, double**& mat, double*& p);
-      void update_edge_bc(Element* e, SurfPos* surf_pos);
+
+      /// A boundary edge of an active element with an essential condition.
+      struct EdgeBC
+      {
+        Element* e;
+        SurfPos surf_pos;
+        EssentialBoundaryCondition<Scalar>* bc;
+        int order;
+      };
+
+      /// Collects the boundary edges with a condition of the element (its active descendants), into edge_bcs.
+      void collect_edge_bc(Element* e, SurfPos* surf_pos);
+
+      /// The edges of the last update_essential_bc_values().
+      Hermes::vector<EdgeBC> edge_bcs;
+
+      /// The geometry of the edges of the last update_essential_bc_values() (the conditions that are not constant),
+      /// the next one (the time-dependent conditions, a new assignment of the DOFs on the same mesh) reuses it for the edges
+      /// in the same position. Dropped when the mesh changes.
+      Hermes::vector<EdgeBCPoint*> edge_bc_points;
+      Hermes::vector<SurfPos> edge_bc_points_positions;
+      int edge_bc_points_mesh_seq;
+      void free_edge_bc_points();
 
       /// Called by Space to update constraining relationships between shape functions due
       /// to hanging nodes in the mesh. As this is space-specific, this function is reimplemented
@@ -413,6 +705,8 @@ namespace Hermes
       friend class Adapt<Scalar>;
       friend class DiscreteProblem<Scalar>;
       template<typename T> friend class CalculationContinuity;
+      template<typename T> friend class L2MassInverse;
+      template<typename T> friend class AffineDecomposition;
     };
   }
 }
@@ -56,6 +56,7 @@ namespace Hermes
 			void fix_vertex(int id, Scalar value = 0.0);
 
 			virtual Scalar* get_bc_projection(SurfPos* surf_pos, int order, EssentialBoundaryCondition<Scalar> *bc);
+			virtual Scalar* get_bc_projection(SurfPos* surf_pos, int order, EssentialBoundaryCondition<Scalar> *bc, const typename Space<Scalar>::EdgeBCPoint* points);
 
 			/// Copy from Space instance 'space'
 			virtual void copy(const Space<Scalar>* space, Mesh* new_mesh);
@@ -82,16 +83,49 @@ namespace Hermes
 				double lo, hi;
 			};
 
-			inline void output_component(typename Space<Scalar>::BaseComponent*& current, typename Space<Scalar>::BaseComponent*& last, typename Space<Scalar>::BaseComponent* min,
-				Node*& edge, typename Space<Scalar>::BaseComponent*& edge_dofs);
+			/// A component of the constraint of a hanging vertex node, independent of the numbering of the DOFs:
+			/// the (unconstrained) vertex node if k == -1, the k-th function of the edge node otherwise.
+			struct ConstraintComponent
+			{
+				int node;
+				int k;
+				double coef;
+			};
 
-			typename Space<Scalar>::BaseComponent* merge_baselists(typename Space<Scalar>::BaseComponent* l1, int n1, typename Space<Scalar>::BaseComponent* l2, int n2,
-				Node* edge, typename Space<Scalar>::BaseComponent*& edge_dofs, int& ncomponents);
+			/// A constrained edge node, base and part as in NodeData.
+			struct ConstrainedEdge
+			{
+				int node;
+				Node* base;
+				int part;
+			};
+
+			/// Adds the constraint of the mid-edge vertex node mid_vn: the average of the constraints of the endpoints,
+			/// the functions of the constraining edge node en taken at the position mid instead.
+			void add_vertex_constraint(Node* mid_vn, Node* vn0, Node* vn1, Node* en, double mid, int ori, ElementMode2D mode);
 
+			/// Collects the constraints of the element (recursively its sons), called by update_constraints() when the cache is not valid.
 			void update_constrained_nodes(Element* e, EdgeInfo* ei0, EdgeInfo* ei1, EdgeInfo* ei2, EdgeInfo* ei3);
 
+			/// Sets the constraints of the cache to the node data: the baselists in terms of the current DOFs and Dirichlet values.
 			virtual void update_constraints();
 
+			/// The cache of the constraints in the CSR format, kept as long as the mesh, the orders and the shapeset are the same:
+			/// the constraint of the vertex node id is constraint_components[constraint_start[id]], ...,
+			/// constraint_components[constraint_start[id] + constraint_count[id] - 1], constraint_start[id] is -1 for the other nodes.
+			std::vector<ConstraintComponent> constraint_components;
+			std::vector<int> constraint_start;
+			std::vector<int> constraint_count;
+			/// The constrained vertex nodes in the order of their constraints.
+			std::vector<int> constrained_vertices;
+			std::vector<ConstrainedEdge> constrained_edges;
+			int constraint_mesh_seq;
+			int constraint_space_seq;
+			Shapeset* constraint_shapeset;
+
+			/// The baselists of the constrained vertex nodes, NodeData::baselist points here.
+			std::vector<typename Space<Scalar>::BaseComponent> constraint_baselists;
+
 			struct FixedVertex
 			{
 				int id;
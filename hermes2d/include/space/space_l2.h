@@ -42,8 +42,6 @@ namespace Hermes
 
 			virtual Scalar* get_bc_projection(SurfPos* surf_pos, int order, EssentialBoundaryCondition<Scalar> *bc);
 
-			virtual void get_element_assembly_list(Element* e, AsmList<Scalar>* al, unsigned int first_dof = 0) const;
-
 			/// Copy from Space instance 'space'
 			virtual void copy(const Space<Scalar>* space, Mesh* new_mesh);
 		protected:
@@ -76,6 +74,7 @@ namespace Hermes
 			virtual void get_vertex_assembly_list(Element* e, int iv, AsmList<Scalar>* al) const;
 			virtual void get_boundary_assembly_list_internal(Element* e, int surf_num, AsmList<Scalar>* al) const;
 			virtual void get_bubble_assembly_list(Element* e, AsmList<Scalar>* al) const;
+			virtual void calculate_element_assembly_list(Element* e, AsmList<Scalar>* al) const;
 			template<typename T> friend class Space<T>::ReferenceSpaceCreator;
 			friend class Space<Scalar>;
 		};
@@ -51,6 +51,12 @@ namespace Hermes
       /// One-dimensional function derivative integration order.
       Hermes::Ord derivative(Hermes::Ord x) const {return Hermes::Ord(2);};
 
+      /// Values at n points, the intervals are found through the bucket table (see find_interval()).
+      virtual void value_batch(int n, const double* x, double* out) const;
+
+      /// Derivatives at n points.
+      virtual void derivative_batch(int n, const double* x, double* out) const;
+
       /// Plots the spline in format for Pylab (just pairs
       /// x-coordinate and value per line). The interval of definition
       /// of the spline will be extended by "extension" both to the left
@@ -60,10 +66,14 @@ namespace Hermes
       void plot(const char* filename, double extension, bool plot_derivative = false, int subdiv = 50) const;
 
     protected:
-      /// Uses a bisection method to locale interval where a given point lies.
+      /// Locates the interval where a given point lies, through the bucket table if calculate_coeffs() built it
+      /// (constant time for uniformly spaced points), by bisection otherwise.
       /// Returns false if point lies outside.
       bool find_interval(double x_in, int& m) const;
 
+      /// Builds the bucket table, called by calculate_coeffs().
+      void init_buckets();
+
       /// Extrapolate the value of the spline outside of its interval of definition.
       double extrapolate_value(double point_end, double value_end, double derivative_end, double x_in) const;
       /// Grid points, ordered.
@@ -94,6 +104,12 @@ namespace Hermes
       /// A set of four coefficients a, b, c, d for an elementary cubic spline.
       Hermes::vector<SplineCoeff> coeffs;
 
+      /// The interval of definition is split into buckets of equal width (twice as many as the intervals),
+      /// bucket_intervals[b] is the interval of the left end of the bucket b, the interval of a point in the bucket
+      /// is found by a short linear search from there.
+      Hermes::vector<int> bucket_intervals;
+      double bucket_inv_width;
+
       /// Gets derivative at a point that lies in interval 'm'.
       double get_derivative_from_interval(double x_in, int m) const;
 
@@ -0,0 +1,126 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_HDF5_WRITER_H
+#define __H2D_HDF5_WRITER_H
+
+#include "global.h"
+#ifdef WITH_HDF5
+#include "linearizer.h"
+#include <hdf5.h>
+#include <queue>
+#include <pthread.h>
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    namespace Views
+    {
+      /// Writes a time series of linearized functions (see Linearizer) into one HDF5 file with an XDMF descriptor,
+      /// instead of one VTK file per time step.
+      /// Each triangulation is written once, as the group /mesh_<m> with the datasets points (x, y) and triangles,
+      /// the values of the steps on it are appended as the rows of the chunked dataset /mesh_<m>/values
+      /// (and their times to /mesh_<m>/times). A new triangulation (e.g. after adaptivity) starts a new group.
+      /// With Linearizer::set_topology_reuse() the triangulation stays the same for all the steps on the same mesh.
+      /// The XDMF descriptor (a temporal collection of the steps, the file name with the extension .xmf) is rewritten
+      /// by flush() and the destructor, ParaView and VisIt read it directly.
+      /// Typical usage:
+      /// HDF5TimeSeriesWriter writer("heat.h5", "T");
+      /// for(...) { ...; lin.process_solution(&sln); writer.add_step(&lin, time); }
+      class HERMES_API HDF5TimeSeriesWriter : public Hermes::Mixins::Loggable
+      {
+      public:
+        /// \param[in] filename The HDF5 file, created (truncated).
+        /// \param[in] quantity_name The name of the values in the XDMF descriptor.
+        /// \param[in] compression_level 0 - none, 1 - 9 the deflate level of the chunks of the values.
+        HDF5TimeSeriesWriter(const char* filename, const char* quantity_name, int compression_level = 0);
+        /// Writes the remaining steps, the descriptor and closes the file.
+        ~HDF5TimeSeriesWriter();
+
+        /// Enables / disables the asynchronous writing.
+        /// In the asynchronous mode, add_step() copies the data of the step and returns, the file is written
+        /// on a background thread (the only one calling HDF5 then).
+        /// \param[in] max_in_flight The maximum number of the copied steps kept in memory, add_step() blocks until
+        /// a step is written if there are this many of them.
+        void set_async(bool enabled, int max_in_flight = 4);
+
+        /// Appends the current linearization of lin (after Linearizer::process_solution()) as the step at the time.
+        void add_step(Linearizer* lin, double time);
+
+        /// Blocks until all the steps are written, flushes the file and rewrites the descriptor.
+        /// Throws the first failure of the background thread, if any.
+        void flush();
+
+      protected:
+        /// One step to be written; points and triangles are there only if the step starts a new triangulation.
+        struct StepJob
+        {
+          int mesh_index;
+          int step_index;
+          double time;
+          std::vector<double> points;
+          std::vector<int> triangles;
+          std::vector<double> values;
+        };
+
+        /// A triangulation written to the file and the number of the steps on it.
+        struct MeshRecord
+        {
+          int num_vertices;
+          int num_triangles;
+          int num_steps;
+        };
+
+        void write(StepJob* job);
+        void write_mesh(StepJob* job);
+        void write_xdmf() const;
+        /// Blocks until the queue is empty, returns (and clears) the failure of the background thread.
+        std::string wait_for_steps();
+
+        static void* writer_thread_func(void* data);
+
+        std::string filename;
+        std::string quantity_name;
+        int compression_level;
+        hid_t file;
+
+        /// The last triangulation, to recognize the steps on it.
+        std::vector<double> last_points;
+        std::vector<int> last_triangles;
+
+        std::vector<MeshRecord> meshes;
+        std::vector<std::pair<int, double> > steps;
+
+        /// The open datasets of the last triangulation, used by the writing thread only.
+        hid_t values_dataset, times_dataset;
+
+        /// Asynchronous writing.
+        bool async;
+        int max_in_flight;
+        /// Steps waiting to be written; the front one is being written.
+        std::queue<StepJob*> queue;
+        std::string failure;
+        bool thread_running;
+        bool thread_exit;
+        pthread_t thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+      };
+    }
+  }
+}
+#endif
+#endif
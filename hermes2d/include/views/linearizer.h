@@ -19,6 +19,7 @@
 #include "../global.h"
 #include "../function/solution.h"
 #include "linearizer_base.h"
+#include "vtk_writer.h"
 
 namespace Hermes
 {
@@ -47,10 +48,33 @@ namespace Hermes
         /// \param[in] eps - tolerance parameter controlling how fine the resulting linearized approximation of the solution is.
         void process_solution(MeshFunction<double>* sln, int item = H2D_FN_VAL_0, double eps = HERMES_EPS_NORMAL);
 
+        /// Recomputes only the vertex values of the last process_solution() for another function on the same meshes
+        /// (e.g. the next time step), with the item of the last process_solution(). The refinement of the elements,
+        /// the vertex coordinates and the triangles are kept.
+        /// \return false (nothing is changed) if the meshes are not the ones of the last process_solution() or they changed,
+        /// process_solution() has to be called then.
+        bool update_values(MeshFunction<double>* sln);
+
+        /// Sets whether process_solution() reuses the topology (the refinement, the vertex coordinates and the triangles)
+        /// of the last linearization and only updates the values by update_values(), as long as the meshes,
+        /// the element orders (of a Solution), the item, eps, the displacement and the curvature epsilon are the same.
+        /// The refinement is then the one adapted to the first function, e.g. the first time step of an animation
+        /// in ScalarView (see ScalarView::get_linearizer()) or of a VTK time series.
+        /// Default: false.
+        void set_topology_reuse(bool reuse = true);
+
+        /// Sets the level of detail produced besides the triangles: the triangulation of the elements refined at most
+        /// level times (see LinearizerBase::get_lod_triangles()), for a fast rendering of large linearizations.
+        /// Default: -1 (none).
+        void set_lod_level(int level);
+
         /// Save a MeshFunction (Solution, Filter) in VTK format.
+        /// \param[in] format Legacy VTK (ASCII or binary) or VTU (raw or compressed).
+        /// \param[in] num_parts If greater than one, the triangles are split into num_parts .vtu files written in parallel
+        /// and filename is the .pvtu file referencing them (VTU formats only).
         void save_solution_vtk(MeshFunction<double>* sln, const char* filename, const char* quantity_name,
           bool mode_3D = true, int item = H2D_FN_VAL_0,
-          double eps = HERMES_EPS_NORMAL);
+          double eps = HERMES_EPS_NORMAL, VTKFormat format = HERMES_VTK_ASCII, int num_parts = 1);
 
         /// Set the displacement, i.e. set two functions that will deform the domain for visualization, in the x-direction, and the y-direction.
         void set_displacement(MeshFunction<double>* xdisp, MeshFunction<double>* ydisp, double dmult = 1.0);
@@ -100,7 +124,56 @@ namespace Hermes
         /// What kind of information do we want to get out of the solution.
         int item, component, value_type;
 
-        int add_vertex();
+        /// Recorded traversal of the meshes, replayed as long as the meshes do not change.
+        TraversePlan traverse_plan;
+
+        /// The refinement of one traversal state recorded by process_solution() and replayed by update_values():
+        /// the split decisions in the order of the process_triangle() / process_quad() calls and the (merged) vertices
+        /// in the order of the get_vertex() calls. A vertex is updated only by the first state using it, the other
+        /// states have it stored as -1 - index.
+        struct StateRecord
+        {
+          std::vector<char> splits;
+          std::vector<int> vertices;
+          int thread;
+        };
+
+        /// The record of the state processed by a thread and the positions in it.
+        struct RecordCursor
+        {
+          StateRecord* record;
+          unsigned int split_i, vertex_i;
+        };
+
+        std::vector<StateRecord> state_records;
+        std::vector<RecordCursor> record_cursors;
+        /// The meshes and their seqs the records belong to.
+        Hermes::vector<const Mesh*> record_meshes;
+        Hermes::vector<unsigned> record_mesh_seqs;
+        /// update_values() is running: the splits and the vertices are taken from the records.
+        bool replaying;
+
+        /// See set_topology_reuse().
+        bool topology_reuse;
+        /// See set_lod_level().
+        int lod_level;
+        /// The parameters of the last process_solution() that linearized the function, for set_topology_reuse().
+        int record_item;
+        double record_eps, record_dmult, record_curvature_epsilon;
+        MeshFunction<double> *record_xdisp, *record_ydisp;
+        /// The orders of the active elements, empty if the function is not a Solution.
+        std::vector<int> record_orders;
+
+        /// The orders of the active elements of sln, if it is a Solution of the type HERMES_SLN.
+        void get_element_orders(MeshFunction<double>* sln, std::vector<int>& orders) const;
+
+        /// The meshes of sln and the displacement functions.
+        Hermes::vector<const Mesh*> get_meshes(MeshFunction<double>* sln) const;
+
+        /// Traverses the elements of sln, either refining them (and recording the refinement) or replaying the records.
+        void linearize(MeshFunction<double>* sln, bool replay);
+
+        /// Vertex of the calling thread (see LinearizerBase::ThreadBuffer), when replaying the recorded vertex with its value updated.
         int get_vertex(int p1, int p2, double x, double y, double value);
 
         void process_triangle(MeshFunction<double>** fns, int iv0, int iv1, int iv2, int level,
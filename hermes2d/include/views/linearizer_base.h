@@ -23,6 +23,7 @@
 
 #include "global.h"
 #include "../quadrature/quad_all.h"
+#include "../mixins2d.h"
 
 namespace Hermes
 {
@@ -72,7 +73,7 @@ namespace Hermes
 
       /// Base class for Linearizer, Orderizer, Vectorizer.
 
-      class HERMES_API LinearizerBase : public Hermes::Mixins::TimeMeasurable, public Hermes::Mixins::Loggable
+      class HERMES_API LinearizerBase : public Hermes::Mixins::TimeMeasurable, public Hermes::Mixins::Loggable, public Hermes::Hermes2D::Mixins::Parallel
       {
       public:
         void set_max_absolute_value(double max_abs);
@@ -86,6 +87,9 @@ namespace Hermes
         int3* get_triangles();
         int* get_triangle_markers();
         int get_num_triangles();
+        /// The coarse triangulation for the level of detail (see Linearizer::set_lod_level()), on the same vertices.
+        int3* get_lod_triangles();
+        int get_num_lod_triangles();
         int2* get_edges();
         int* get_edge_markers();
         int get_num_edges();
@@ -113,6 +117,8 @@ namespace Hermes
 
         int3* tris;      ///< triangles: vertex index triplets
         int* tri_markers;///< triangle_markers: triangle markers, ordering equal to tris
+        int3* lod_tris;  ///< triangles of the elements refined to a limited level only, not regularized
+        int lod_triangle_count;
         int2* edges;     ///< edges: pairs of vertex indices
         int* edge_markers;     ///< edge_markers: edge markers, ordering equal to edges
         int* hash_table; ///< hash table
@@ -134,6 +140,60 @@ namespace Hermes
 
         int hash(int p1, int p2);
 
+        /// Vertices, triangles and element edges produced by one thread in process_solution(), with its own vertex hash.
+        /// The threads do not share anything while refining the elements, the buffers are merged into the arrays of
+        /// the instance by merge_thread_buffers() afterwards.
+        struct ThreadBuffer
+        {
+          ThreadBuffer(int vertex_dim, int vertex_size, int triangle_size, int edges_size);
+          ~ThreadBuffer();
+
+          /// Index of a new vertex, the vertex arrays are enlarged if needed (moving verts).
+          int add_vertex();
+          void add_triangle(int iv0, int iv1, int iv2, int marker);
+          void add_lod_triangle(int iv0, int iv1, int iv2);
+          /// Edge of an element, split at the mid-edge vertices only after the merge.
+          void add_edge(int iv1, int iv2, int marker);
+          int hash(int p1, int p2) const;
+
+          int vertex_dim;  ///< number of doubles per vertex: coordinates and values
+          double* verts;
+          int4* info;      ///< as LinearizerBase::info, the parents are the indices in this buffer or minus mesh vertex ids
+          int* hash_table;
+          int hash_size;   ///< power of two, independent of vertex_size
+          int vertex_count, vertex_size;
+
+          int3* tris;
+          int* tri_markers;
+          int triangle_count, triangle_size;
+
+          int3* lod_tris;
+          int lod_triangle_count, lod_triangle_size;
+
+          int3* edges;     ///< (iv1, iv2, marker)
+          int edges_count, edges_size;
+
+          /// Maximum absolute value seen by the thread.
+          double max;
+        };
+
+        /// Allocates a buffer for each of num_threads threads, the initial sizes are split among the threads.
+        void init_thread_buffers(int num_threads, int vertex_dim, int vertex_size, int triangle_size, int edges_size);
+        void free_thread_buffers();
+        /// The buffer of the calling thread.
+        ThreadBuffer* get_thread_buffer() const;
+        /// With auto_max, raises max to the maxima of the threads.
+        void reduce_thread_max();
+
+        /// Merges the thread buffers into info, hash_table, tris, tri_markers, lod_tris and edges of the instance and returns
+        /// the merged vertices (vertex_size * vertex_dim doubles, malloc-ed).
+        /// Vertices with the same parents are identified, if match_values, only if also their coordinates and values agree
+        /// (discontinuities). The element edges are split at the mid-edge vertices of the merged vertices.
+        /// \param[out] vertex_maps If not NULL, filled with the merged index of every vertex of every buffer.
+        double* merge_thread_buffers(int vertex_dim, bool match_values, std::vector<std::vector<int> >* vertex_maps = NULL);
+
+        Hermes::vector<ThreadBuffer*> thread_buffers;
+
         mutable pthread_mutex_t data_mutex;
 
         Hermes::Exceptions::Exception* caughtException;
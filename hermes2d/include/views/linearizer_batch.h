@@ -0,0 +1,78 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_LINEARIZER_BATCH_H
+#define __H2D_LINEARIZER_BATCH_H
+
+#include "linearizer.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    namespace Views
+    {
+      /// \brief Headless output of many functions (solutions, filters, time steps) to VTK files.
+      /// \details Needs neither a window nor the view thread. The functions queued by add() are written by run():
+      /// the functions on the same meshes (e.g. the time steps on a steady mesh) share one linearization, the first one
+      /// is linearized by Linearizer::process_solution(), for the others only the vertex values are updated by
+      /// Linearizer::update_values(). The groups of functions on different meshes are processed concurrently.
+      /// Typical usage:
+      /// Hermes::Hermes2D::Views::LinearizerBatch batch("u", Hermes::Hermes2D::Views::HERMES_VTU_COMPRESSED);
+      /// for(int step = 0; step < num_steps; step++)
+      ///   batch.add(solutions[step], filenames[step]);
+      /// batch.run();
+      class HERMES_API LinearizerBatch : public Hermes::Mixins::Loggable
+      {
+      public:
+        /// The parameters are the ones of Linearizer::save_solution_vtk().
+        LinearizerBatch(const char* quantity_name, VTKFormat format = HERMES_VTU_COMPRESSED, int item = H2D_FN_VAL_0,
+          double eps = HERMES_EPS_NORMAL, bool mode_3D = true);
+
+        /// Queues the function to be written to filename, the function has to live until run().
+        void add(MeshFunction<double>* sln, const char* filename);
+
+        /// Writes all the queued functions and empties the queue.
+        void run();
+
+        /// Number of the queued functions.
+        int get_num_jobs() const;
+
+        /// Number of the linearizations done by the last run(), the other functions only updated the values.
+        int get_num_linearizations() const;
+
+      protected:
+        struct Job
+        {
+          MeshFunction<double>* sln;
+          std::string filename;
+        };
+
+        /// Writes the jobs (on the same meshes) with one Linearizer.
+        void run_group(const std::vector<int>& group);
+
+        std::string quantity_name;
+        VTKFormat format;
+        int item;
+        double eps;
+        bool mode_3D;
+
+        std::vector<Job> jobs;
+        int num_linearizations;
+      };
+    }
+  }
+}
+#endif
@@ -37,12 +37,14 @@ namespace Hermes
         template<typename Scalar>
         void process_space(const Space<Scalar>* space);
 
-        /// Saves a MeshFunction (Solution, Filter) in VTK format.
+        /// Saves the polynomial orders of a space in VTK format.
+        /// The format and num_parts as in Linearizer::save_solution_vtk().
         template<typename Scalar>
-        void save_orders_vtk(const Space<Scalar>* space, const char* file_name);
+        void save_orders_vtk(const Space<Scalar>* space, const char* file_name, VTKFormat format = HERMES_VTK_ASCII, int num_parts = 1);
 
+        /// Saves the edges of the mesh of a space in VTK format.
         template<typename Scalar>
-        void save_mesh_vtk(const Space<Scalar>* space, const char* file_name);
+        void save_mesh_vtk(const Space<Scalar>* space, const char* file_name, VTKFormat format = HERMES_VTK_ASCII, int num_parts = 1);
 
         int get_labels(int*& lvert, char**& ltext, double2*& lbox) const;
 
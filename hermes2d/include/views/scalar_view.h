@@ -54,6 +54,16 @@ namespace Hermes
         void show(MeshFunction<double>* sln, double eps = HERMES_EPS_NORMAL, int item = H2D_FN_VAL_0,
           MeshFunction<double>* xdisp = NULL, MeshFunction<double>* ydisp = NULL, double dmult = 1.0);
 
+        /// Sets the asynchronous mode: show() of a Solution (without displacement) only hands a snapshot of it to a worker
+        /// thread of the view, which linearizes and draws it, and returns at once. The snapshot shares the coefficients
+        /// (see Solution::copy()) and is defined on a copy of the mesh, so the solver may go on changing both.
+        /// If show() is called faster than the snapshots are drawn, the intermediate ones are dropped.
+        /// Other functions are shown synchronously. Default: false.
+        void set_asynchronous(bool asynchronous = true);
+
+        /// Waits until the worker of the asynchronous mode has drawn the last snapshot.
+        void wait_for_asynchronous_updates();
+
         void show_linearizer_data(double eps = HERMES_EPS_NORMAL, int item = H2D_FN_VAL_0);
 
         inline void show_mesh(bool show = true) { show_edges = show; refresh(); }
@@ -73,6 +83,34 @@ namespace Hermes
         /// Linearizer class responsible for obtaining linearized data.
         Linearizer* lin;
 
+        /// The linearization and drawing done by show(), in the calling thread.
+        void process_and_draw(MeshFunction<double>* sln, double eps, int item,
+          MeshFunction<double>* xdisp, MeshFunction<double>* ydisp, double dmult);
+
+        /// A snapshot handed to the worker of the asynchronous mode.
+        struct AsyncJob
+        {
+          Solution<double>* sln;
+          Mesh* mesh;
+          double eps;
+          int item;
+        };
+
+        bool asynchronous;
+        /// The snapshot to be drawn next, NULL if none, a newer one replaces it.
+        AsyncJob* async_pending;
+        /// The worker is drawing a snapshot.
+        bool async_busy;
+        bool async_stop, async_thread_running;
+        pthread_t async_thread;
+        /// Protects the members above, async_cond signals a new snapshot, the stop and the end of drawing.
+        pthread_mutex_t async_mutex;
+        pthread_cond_t async_cond;
+
+        static void* async_worker(void* view);
+        static void delete_async_job(AsyncJob* job);
+        void stop_async_worker();
+
         /// Information about a vertex node.
         struct VertexNodeInfo
         {
@@ -119,7 +157,8 @@ namespace Hermes
         void draw_element_infos_2d(); ///< Draws elements infos in 2D mode.
 
       protected: //values
-#define H2DV_GL_MAX_EDGE_BUFFER 128 ///< A maximum number of pairs per a buffer.
+#define H2DV_LOD_LEVEL 1 ///< The level of detail produced by the linearizer, see Linearizer::set_lod_level().
+#define H2DV_LOD_MIN_TRIANGLES 200000 ///< The minimum number of triangles for which the level of detail is drawn while the view is moved.
 #pragma pack(push)
 #pragma pack(1)
         struct GLVertex2 ///< OpenGL vertex. Used to cache vertices prior rendering
@@ -130,21 +169,40 @@ namespace Hermes
           GLVertex2(float x, float y, float coord) : x(x), y(y), coord(coord) {};
           static const size_t H2D_OFFSETOF_COORD = 2*sizeof(float); ///< Offset of coordinate
         };
+        struct GLVertex3 ///< OpenGL vertex of the 3D mode, in the coordinates of the linearizer (x, y, value), transformed by the modelview matrix.
+        {
+          float x, y, value;
+          float nx, ny, nz;
+          GLVertex3() {};
+          GLVertex3(float x, float y, float value, float nx, float ny, float nz) : x(x), y(y), value(value), nx(nx), ny(ny), nz(nz) {};
+          static const size_t H2D_OFFSETOF_VALUE = 2*sizeof(float); ///< Offset of the value
+          static const size_t H2D_OFFSETOF_NORMAL = 3*sizeof(float); ///< Offset of the normal
+        };
 #pragma pack(pop)
 
         bool lin_updated; ///< true, if lin now contains new values
 
+        /// The buffers are filled once after lin is updated and kept by the GL for all the redraws.
         unsigned int gl_coord_buffer; ///< Vertex coordinate buffer. (x, y, t)
+        unsigned int gl_coord_buffer_3d; ///< Vertex buffer of the 3D mode, filled if the normals are calculated.
         unsigned int gl_index_buffer; ///< Index data buffer.
-        unsigned int gl_edge_inx_buffer; ///< A buffer for edge indices. The side of the buffer is H2DV_GL_MAX_EDGE_BUFFER pairs of indids.
+        unsigned int gl_lod_index_buffer; ///< Index data buffer of the level of detail (Linearizer::get_lod_triangles()).
+        unsigned int gl_edge_inx_buffer; ///< A buffer for edge indices, the boundary edges first.
         int max_gl_verts; ///< A maximum allocated number of vertices
+        int max_gl_verts_3d; ///< A maximum allocated number of vertices of the 3D mode
         int max_gl_tris; ///< A maximum allocated number of triangles
+        int max_gl_lod_tris; ///< A maximum allocated number of triangles of the level of detail
         int gl_tri_cnt; ///< A number of OpenGL triangles
+        int gl_lod_tri_cnt; ///< A number of OpenGL triangles of the level of detail
+        int gl_edge_cnt, gl_boundary_edge_cnt; ///< Numbers of all the edges and of the boundary edges in gl_edge_inx_buffer
 
         bool show_values; ///< true to show values
 
         void prepare_gl_geometry(); ///< prepares geometry in a form compatible with GL arrays; Data are updated if lin is updated. In a case of a failure (out of memory), gl_verts is NULL and an old OpenGL rendering method has to be used.
+        void fill_gl_triangles(unsigned int& gl_buffer, int& max_gl_cnt, int& gl_cnt, const int3* tris, int tri_cnt, const double3* verts); ///< Fills an index buffer by the triangles with finite values.
+        bool use_lod() const; ///< true, if the level of detail is to be drawn instead of all the triangles (a large linearization is being moved).
         void draw_values_2d(); ///< draws values
+        void draw_values_3d(); ///< draws the surface of the 3D mode and the edges on it
         void draw_edges_2d(); ///< draws edges
 
         void draw_normals_3d(); ////< Draws normals of the 3d mesh. Used for debugging purposses only.
@@ -209,6 +267,8 @@ namespace Hermes
         virtual void on_right_mouse_down(int x, int y); ///< Handles selecting/deselecting of nodes.
         virtual void on_middle_mouse_down(int x, int y);
         virtual void on_middle_mouse_up(int x, int y);
+        virtual void on_left_mouse_up(int x, int y); ///< Redraws all the triangles after the view was moved.
+        virtual void on_right_mouse_up(int x, int y);
         virtual const char* get_help_text() const;
         virtual void on_close();
       };
@@ -223,6 +283,9 @@ class HERMES_API ScalarView : public View
         void show(MeshFunction<double>* sln, double eps = HERMES_EPS_NORMAL, int item = H2D_FN_VAL_0,
           MeshFunction<double>* xdisp = NULL, MeshFunction<double>* ydisp = NULL, double dmult = 1.0) { throw Hermes::Exceptions::Exception("GLUT disabled."); }
 
+        void set_asynchronous(bool asynchronous = true) { throw Hermes::Exceptions::Exception("GLUT disabled."); }
+        void wait_for_asynchronous_updates() { throw Hermes::Exceptions::Exception("GLUT disabled."); }
+
         void show_linearizer_data(double eps = HERMES_EPS_NORMAL, int item = H2D_FN_VAL_0) { throw Hermes::Exceptions::Exception("GLUT disabled."); }
 
         inline void show_mesh(bool show = true) { throw Hermes::Exceptions::Exception("GLUT disabled."); }
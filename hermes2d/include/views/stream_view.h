@@ -55,13 +55,22 @@ namespace Hermes
 
       protected:
 
-        struct Node
+        /// Triangle of the Vectorizer output, stored in the order of the leaves of the BVH.
+        struct BVHTriangle
         {
-          bool leaf;
-          int level;
-          Node* sons[2];
-          int elements[100];
-          int num_elem;
+          double x1, y1, x2, y2, x3, y3;
+          int index;
+        };
+
+        /// Node of the bounding volume hierarchy of the triangles, the nodes are stored in one array in the depth-first
+        /// order, so the first son of a node is the next node.
+        struct BVHNode
+        {
+          double x_min, x_max, y_min, y_max;
+          /// Leaf: the triangles first, ..., first + count - 1 of bvh_triangles, inner node: count = 0.
+          int first, count;
+          /// Inner node: the index of the second son.
+          int second;
         };
 
         Vectorizer* vec;
@@ -74,34 +83,34 @@ namespace Hermes
         int num_stream;
         double2** streamlines;
         int* streamlength;
-        Node* root;
+        std::vector<BVHNode> bvh_nodes;
+        std::vector<BVHTriangle> bvh_triangles;
         double root_x_min;
         double root_x_max;
         double root_y_min;
         double root_y_max;
 
-        /// Recurent function that finds linearized triangle which contain point (x, y).
+        /// Finds the linearized triangle which contains the point (x, y), -1 if none.
         /// As side effect it returns bacycentric coordinates of point (x, y) in that triangle.
-        int find_triangle_in_tree(double x, double y, Node* father, double x_min, double x_max, double y_min, double y_max, double3& bar);
+        int find_triangle(double x, double y, double3& bar) const;
 
-        /// Adds triangle to the kD-tree.
-        /// If father Node has more than 100 elements
-        /// it splits computation domain into 2 parts (vertically or horizontally).
-        void add_element_to_tree(Node* father, int e_idx, double x_min, double x_max, double y_min, double y_max);
-
-        /// Builds kD-tree.
+        /// Builds the BVH of the triangles.
         void build_tree();
-        void delete_tree(Node* father);
+
+        /// Builds the node of the triangles first, ..., first + count - 1 of indices (reordered by the median splits),
+        /// returns its index.
+        int build_tree_node(std::vector<int>& indices, int first, int count, const double* boxes, const double* centroids);
 
         /// Tests whether given point (x, y) lies in given triangle
         /// using barycentric coordinates (returned as side efect).
-        bool is_in_triangle(int idx, double x, double y, double3& bar);
+        static bool is_in_triangle(const BVHTriangle& tri, double x, double y, double3& bar);
 
-        /// Gets values of velocities at given point using built kD-tree.
-        bool get_solution_values(double x, double y, double& xval, double& yval);
+        /// Gets values of velocities at given point using the BVH.
+        bool get_solution_values(double x, double y, double& xval, double& yval) const;
 
         /// Starts from initial point (x_start, y_start)
         /// and using adaptive RK method finds streamline with "idx".
+        /// Called concurrently for different streamlines.
         int create_streamline(double x_start, double y_start, int idx);
 
         /// Finds initial points for all steamlines along boundary with given marker
@@ -112,6 +121,9 @@ namespace Hermes
         /// (one whose first vertex is not second vertex for any other edge).
         int find_initial_edge(int num_edges, int3* edges);
 
+        /// Deletes the streamlines.
+        void free_streamlines();
+
         virtual void on_display();
         virtual void on_mouse_move(int x, int y);
         virtual void on_key_down(unsigned char key, int x, int y);
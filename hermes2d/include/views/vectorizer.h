@@ -87,17 +87,19 @@ namespace Hermes
         int xitem, component_x, value_type_x;
         int yitem, component_y, value_type_y;
 
+        /// Recorded traversal of the meshes, replayed as long as the meshes do not change.
+        TraversePlan traverse_plan;
+
         double4* verts;  ///< vertices: (x, y, xvalue, yvalue) quadruples
         int2* dashes;
 
         int dashes_count; ///< Real numbers of vertices, triangles and edges, dashes
         int dashes_size; ///< Size of arrays of vertices, triangles and edges, dashes
 
+        /// Vertex of the calling thread (see LinearizerBase::ThreadBuffer).
         int get_vertex(int p1, int p2, double x, double y, double xvalue, double yvalue);
         void process_dash(int iv1, int iv2);
 
-        int add_vertex();
-
         void add_dash(int iv1, int iv2);
 
         void process_triangle(MeshFunction<double>** fns, int iv0, int iv1, int iv2, int level,
@@ -0,0 +1,104 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef __H2D_VTK_WRITER_H
+#define __H2D_VTK_WRITER_H
+
+#include "global.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    namespace Views
+    {
+      /// Formats of the VTK output of Linearizer and Orderizer.
+      enum VTKFormat
+      {
+        HERMES_VTK_ASCII,      ///< Legacy VTK, text.
+        HERMES_VTK_BINARY,     ///< Legacy VTK, big-endian binary.
+        HERMES_VTU_RAW,        ///< XML unstructured grid (.vtu), the arrays appended in binary.
+        HERMES_VTU_COMPRESSED  ///< As HERMES_VTU_RAW, the arrays compressed by zlib (requires WITH_ZLIB, written raw otherwise).
+      };
+
+      /// Writes an unstructured grid of lines or triangles with scalar point and cell data to VTK files.
+      /// The data are not copied, they have to live until the output is written.
+      /// All the values are written as 32-bit floats, as in the legacy ASCII output.
+      class HERMES_API VTKWriter : public Hermes::Mixins::Loggable
+      {
+      public:
+        /// \param[in] points The coordinates of the i-th point are points[i * point_stride], points[i * point_stride + 1]
+        /// and, if use_z, points[i * point_stride + 2].
+        /// \param[in] cells cell_size (2 - lines, 3 - triangles) point indices per cell.
+        VTKWriter(int num_points, const double* points, int point_stride, bool use_z, int num_cells, const int* cells, int cell_size);
+
+        /// Scalar point data, values[i * stride] belongs to the i-th point.
+        void add_point_data(const char* name, const double* values, int stride);
+
+        /// Scalar cell data, zeros if values is NULL.
+        void add_cell_data(const char* name, const int* values);
+
+        /// Writes one file in the format.
+        void save(const char* filename, VTKFormat format);
+
+        /// Splits the cells into num_parts pieces written by the threads as filename_<part>.vtu and writes the .pvtu file
+        /// filename referencing them. The format has to be one of the VTU formats.
+        void save_parallel(const char* filename, int num_parts, VTKFormat format);
+
+      protected:
+        struct DataArray
+        {
+          std::string name;
+          const double* values;
+          int stride;
+          const int* int_values;
+        };
+
+        /// The arrays of a .vtu file, the points renumbered to the ones used by the cells of the piece.
+        struct Piece
+        {
+          std::vector<float> points;
+          std::vector<int> connectivity;
+          std::vector<int> offsets;
+          std::vector<unsigned char> types;
+          std::vector<std::vector<float> > point_data;
+          std::vector<std::vector<float> > cell_data;
+        };
+
+        void build_piece(int first_cell, int last_cell, Piece& piece) const;
+        void save_legacy(const char* filename, bool binary) const;
+        void save_vtu(const char* filename, const Piece& piece, bool compress) const;
+
+        /// The VTK cell type of the cells.
+        unsigned char get_cell_type() const;
+
+        /// Appends the binary block of an array (its size header and the possibly compressed data) to out.
+        static void encode_array(const void* data, size_t bytes, bool compress, std::vector<char>& out);
+
+        int num_points;
+        const double* points;
+        int point_stride;
+        bool use_z;
+        int num_cells;
+        const int* cells;
+        int cell_size;
+
+        std::vector<DataArray> point_data;
+        std::vector<DataArray> cell_data;
+      };
+    }
+  }
+}
+#endif
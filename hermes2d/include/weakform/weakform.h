@@ -17,6 +17,7 @@
 #define __H2D_WEAKFORM_H
 
 #include "../function/solution.h"
+#include "../forms.h"
 #include <string>
 
 namespace Hermes
@@ -31,6 +32,11 @@ namespace Hermes
       HERMES_AXISYM_Y = 2        // Axisymmetric problem where y-axis is the axis of symmetry.
     };
 
+    /// The affine term of the forms not multiplied by any parameter coefficient (see Form::set_affine_term()).
+    static const int H2D_AFFINE_CONSTANT_TERM = -1;
+    /// DiscreteProblem::set_affine_term() value assembling the forms of all the terms (default).
+    static const int H2D_ALL_AFFINE_TERMS = -2;
+
     class RefMap;
     template<typename Scalar> class DiscreteProblem;
     template<typename Scalar> class DiscreteProblemLinear;
@@ -159,6 +165,9 @@ namespace Hermes
       /// Cloning.
       virtual WeakForm* clone() const;
 
+      /// The number of the parametric affine terms (the largest Form::set_affine_term() + 1), 0 if the form is not parametric.
+      int get_num_affine_terms() const;
+
       /// Internal.
       Hermes::vector<Form<Scalar> *> get_forms() const;
       Hermes::vector<MatrixFormVol<Scalar> *> get_mfvol() const;
@@ -249,6 +258,22 @@ namespace Hermes
       /// scaling factor
       void setScalingFactor(double scalingFactor);
 
+      /// The quantities (FuncDemand flags) the value() and ord() of the form read, the assembling precalculates
+      /// only their union over the forms, the other arrays of the Funcs are NULL.
+      /// Default: H2D_DEMAND_DEFAULT for all, e.g. a mass matrix form calls set_demand(H2D_DEMAND_VAL, H2D_DEMAND_VAL).
+      /// The assembling uses the clones of the forms, so this belongs to the constructor of the form (called by its clone()).
+      /// \param[in] u_demand The basis functions (u of the matrix forms).
+      /// \param[in] v_demand The test functions.
+      /// \param[in] u_ext_demand The previous iterations (u_ext).
+      /// \param[in] ext_demand The external functions (ext).
+      void set_demand(unsigned int u_demand, unsigned int v_demand, unsigned int u_ext_demand = H2D_DEMAND_DEFAULT, unsigned int ext_demand = H2D_DEMAND_DEFAULT);
+
+      /// The form belongs to the term q of the affine parameter decomposition A(mu) = A_c + sum_q theta_q(mu) A_q
+      /// (and f(mu) = f_c + sum_q theta_q(mu) f_q for the vector forms), see AffineDecomposition.
+      /// Default: H2D_AFFINE_CONSTANT_TERM (A_c, f_c). The value of the form must not depend on the parameters.
+      void set_affine_term(int q);
+      int get_affine_term() const;
+
     protected:
       /// Set pointer to a WeakForm.
       inline void set_weakform(WeakForm<Scalar>* wf) { this->wf = wf; }
@@ -276,6 +301,20 @@ namespace Hermes
 
       WeakForm<Scalar>* wf;
       double stage_time;
+
+      /// See set_demand().
+      unsigned int u_demand;
+      unsigned int v_demand;
+      unsigned int u_ext_demand;
+      unsigned int ext_demand;
+
+      /// See set_affine_term().
+      int affine_term;
+
+      /// Index of the form in WeakForm::forms, set when the form is added or cloned. The clones of the per-thread
+      /// weak formulations have the same positions, the form order cache of DiscreteProblem identifies the forms by them.
+      int position;
+
       void set_uExtOffset(int u_ext_offset);
       friend class WeakForm<Scalar>;
       friend class RungeKutta<Scalar>;
@@ -307,6 +346,13 @@ namespace Hermes
       virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *u, Func<Hermes::Ord> *v,
         Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
 
+      /// Evaluates the form for all pairs of basis and test functions of the current element (or edge) at once.
+      /// result[i][j] receives the value for the test function v[i] and the basis function u[j].
+      /// Returns false if the form does not provide the block evaluation for the current data,
+      /// the assembling then falls back to calling value() for each pair.
+      virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar **result) const;
+
     protected:
       friend class DiscreteProblem<Scalar>;
     };
@@ -325,6 +371,12 @@ namespace Hermes
       virtual ~MatrixFormVol();
 
       virtual MatrixFormVol* clone() const;
+
+      /// If the form is \int mass * u * v + diffusion * \nabla u \cdot \nabla v + (convection_x * u_x + convection_y * u_y) * v
+      /// with constant coefficients (planar, independent of u_ext and ext), fills them in and returns true.
+      /// Such forms are assembled in batches on affine elements, see DiscreteProblem::set_batched_assembly()
+      /// and DiscreteProblem::set_reference_integrals().
+      virtual bool get_constant_coefficients(Scalar& mass, Scalar& diffusion, Scalar& convection_x, Scalar& convection_y) const;
     };
 
     /// \brief Abstract, base class for matrix Surface form - i.e. MatrixForm, where the integration is with respect to 1D-Lebesgue measure (element domain-boundary edges).
@@ -380,6 +432,14 @@ namespace Hermes
 
       virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *v, Geom<Hermes::Ord> *e,
         Func<Ord> **ext) const;
+
+      /// Evaluates the form for all test functions of the current element (or edge) at once.
+      /// result[i] receives the value for the test function v[i].
+      /// Returns false if the form does not provide the block evaluation for the current data,
+      /// the assembling then falls back to calling value() for each test function.
+      virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar *result) const;
+
       unsigned int i;
 
     protected:
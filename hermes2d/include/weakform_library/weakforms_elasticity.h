@@ -25,6 +25,13 @@ with Dirichlet and/or zero Neumann BC
 
 Nonzero Neumann and Newton boundary conditions can be enabled
 by creating a descendant and adding surface forms to it.
+
+The forms evaluate their blocks at once (value_block()): the weighted
+derivatives of each test function are combined with the Lame parameters
+once and reused for all basis functions, the diagonal blocks (HERMES_SYM)
+compute the upper triangle only. The displacement components are best
+numbered by Space<Scalar>::assign_dofs_interleaved(), so that the four
+blocks of a node pair are close in the matrix.
 */
 namespace Hermes
 {
@@ -46,6 +53,9 @@ namespace Hermes
         virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *u, Func<Hermes::Ord> *v,
           Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
 
+        virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+          Geom<double> *e, Func<Scalar> **ext, Scalar **result) const;
+
         virtual MatrixFormVol<Scalar>* clone() const;
       private:
         double lambda, mu;
@@ -64,6 +74,9 @@ namespace Hermes
         virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *u,
           Func<Hermes::Ord> *v, Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
 
+        virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+          Geom<double> *e, Func<Scalar> **ext, Scalar **result) const;
+
         virtual MatrixFormVol<Scalar>* clone() const;
       private:
         double lambda, mu;
@@ -82,6 +95,9 @@ namespace Hermes
         virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *v,
           Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
 
+        virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+          Geom<double> *e, Func<Scalar> **ext, Scalar *result) const;
+
         virtual VectorFormVol<Scalar>* clone() const;
       private:
         double lambda, mu;
@@ -100,6 +116,9 @@ namespace Hermes
         virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *v,
           Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
 
+        virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+          Geom<double> *e, Func<Scalar> **ext, Scalar *result) const;
+
         virtual VectorFormVol<Scalar>* clone() const;
       private:
         double lambda, mu;
@@ -118,6 +137,9 @@ namespace Hermes
         virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *v,
           Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
 
+        virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+          Geom<double> *e, Func<Scalar> **ext, Scalar *result) const;
+
         virtual VectorFormVol<Scalar>* clone() const;
       private:
         double lambda, mu;
@@ -136,6 +158,9 @@ namespace Hermes
         virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *v,
           Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
 
+        virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+          Geom<double> *e, Func<Scalar> **ext, Scalar *result) const;
+
         virtual VectorFormVol<Scalar>* clone() const;
       private:
         double lambda, mu;
@@ -154,6 +179,9 @@ namespace Hermes
         virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *u, Func<Hermes::Ord> *v,
           Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
 
+        virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+          Geom<double> *e, Func<Scalar> **ext, Scalar **result) const;
+
         virtual MatrixFormVol<Scalar>* clone() const;
       private:
         double lambda, mu;
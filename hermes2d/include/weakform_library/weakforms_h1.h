@@ -51,8 +51,13 @@ namespace Hermes
         virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *u,
           Func<Hermes::Ord> *v, Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
 
+        virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+          Geom<double> *e, Func<Scalar> **ext, Scalar **result) const;
+
         virtual MatrixFormVol<Scalar>* clone() const;
 
+        virtual bool get_constant_coefficients(Scalar& mass, Scalar& diffusion, Scalar& convection_x, Scalar& convection_y) const;
+
       private:
 
         Hermes2DFunction<Scalar>* coeff;
@@ -83,8 +88,13 @@ namespace Hermes
         virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *u, Func<Hermes::Ord> *v,
           Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
 
+        virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+          Geom<double> *e, Func<Scalar> **ext, Scalar **result) const;
+
         virtual MatrixFormVol<Scalar>* clone() const;
 
+        virtual bool get_constant_coefficients(Scalar& mass, Scalar& diffusion, Scalar& convection_x, Scalar& convection_y) const;
+
       private:
         int idx_j;
 
@@ -110,8 +120,13 @@ namespace Hermes
         virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *u, Func<Hermes::Ord> *v,
           Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
 
+        virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+          Geom<double> *e, Func<Scalar> **ext, Scalar **result) const;
+
         virtual MatrixFormVol<Scalar>* clone() const;
 
+        virtual bool get_constant_coefficients(Scalar& mass, Scalar& diffusion, Scalar& convection_x, Scalar& convection_y) const;
+
       private:
         int idx_j;
 
@@ -148,6 +163,8 @@ namespace Hermes
 
         virtual MatrixFormVol<Scalar>* clone() const;
 
+        virtual bool get_constant_coefficients(Scalar& mass, Scalar& diffusion, Scalar& convection_x, Scalar& convection_y) const;
+
       private:
         int idx_j;
         Hermes1DFunction<Scalar>* coeff1, *coeff2;
@@ -177,6 +194,9 @@ namespace Hermes
         virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *v,
           Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
 
+        virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+          Geom<double> *e, Func<Scalar> **ext, Scalar *result) const;
+
         virtual VectorFormVol<Scalar>* clone() const;
 
       private:
@@ -240,6 +260,9 @@ namespace Hermes
         virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *v,
           Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
 
+        virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+          Geom<double> *e, Func<Scalar> **ext, Scalar *result) const;
+
         virtual VectorFormVol<Scalar>* clone() const;
 
       private:
@@ -4,6 +4,7 @@
 #include "weakforms_h1.h"
 #include "../forms.h"
 #include "../function/filter.h"
+#include "../discrete_problem.h"
 
 namespace Hermes
 {
@@ -1163,6 +1164,105 @@ namespace Hermes
                 unsigned int g;
               };
             };
+
+            /// The material data of all the groups in contiguous arrays indexed by the internal element marker of the mesh,
+            /// built once from MaterialPropertyMaps, so that MultigroupDiffusion does not look the materials up by their names
+            /// (and copy their vectors) for every form and element.
+            class HERMES_API MultigroupMaterialData
+            {
+            public:
+              MultigroupMaterialData(const MaterialPropertyMaps& matprop, Mesh *mesh);
+
+              unsigned int get_G() const { return G; }
+
+              /// The element marker has a material.
+              inline bool has_marker(int marker) const { return marker >= 0 && marker < num_markers && defined[marker]; }
+
+              inline double get_D(int marker, unsigned int g) const { return D[marker * G + g]; }
+
+              inline double get_src(int marker, unsigned int g) const { return src[marker * G + g]; }
+
+              /// The coefficient of the u v term of the block (gto, gfrom): the removal cross-section on the diagonal
+              /// minus the scattering and the fission yield from gfrom to gto.
+              inline double get_reaction(int marker, unsigned int gto, unsigned int gfrom) const { return reaction[(marker * G + gto) * G + gfrom]; }
+
+              /// The block (gto, gfrom) is nonzero in some material.
+              bool is_block_nonzero(unsigned int gto, unsigned int gfrom) const;
+
+            protected:
+              unsigned int G;
+              int num_markers;
+              std::vector<bool> defined;
+              std::vector<double> D;
+              std::vector<double> src;
+              std::vector<double> reaction;
+            };
+
+            /// Diffusion, removal, scattering and fission of the multigroup diffusion fused into one form per block
+            /// (Jacobian) and one form per group (Residual, all the couplings of the group in one pass over the points),
+            /// with the material data from MultigroupMaterialData. It replaces DiffusionReaction, Scattering, FissionYield
+            /// and ExternalSources, see CompleteWeakForms::Diffusion::FusedWeakFormFixedSource.
+            struct HERMES_API MultigroupDiffusion
+            {
+              template<typename Scalar>
+              class HERMES_API Jacobian : public MatrixFormVol<Scalar>
+              {
+              public:
+                Jacobian(unsigned int gto, unsigned int gfrom, const MultigroupMaterialData* data, GeomType geom_type = HERMES_PLANAR)
+                  : MatrixFormVol<Scalar>(gto, gfrom), gto(gto), gfrom(gfrom), data(data), geom_type(geom_type)
+                {};
+
+                virtual Scalar value(int n, double *wt, Func<Scalar> *u_ext[], Func<double> *u,
+                  Func<double> *v, Geom<double> *e, Func<Scalar> **ext) const;
+
+                virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *u,
+                  Func<Hermes::Ord> *v, Geom<Hermes::Ord> *e, Func<Hermes::Ord> **ext) const;
+
+                /// The u v and the gradient integrals of all the pairs of the element with the weights formed once.
+                virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+                  Geom<double> *e, Func<Scalar> **ext, Scalar **result) const;
+
+                virtual MatrixFormVol<Scalar>* clone() const {
+                  return new Jacobian(*this);
+                }
+
+              private:
+                unsigned int gto, gfrom;
+                const MultigroupMaterialData* data;
+                GeomType geom_type;
+              };
+
+              template<typename Scalar>
+              class HERMES_API Residual : public VectorFormVol<Scalar>
+              {
+              public:
+                Residual(unsigned int g, const MultigroupMaterialData* data, GeomType geom_type = HERMES_PLANAR)
+                  : VectorFormVol<Scalar>(g), g(g), data(data), geom_type(geom_type)
+                {};
+
+                virtual Scalar value(int n, double *wt, Func<Scalar> *u_ext[], Func<double> *v,
+                  Geom<double> *e, Func<Scalar> **ext) const;
+
+                virtual Hermes::Ord ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *v,
+                  Geom<Hermes::Ord> *e, Func<Ord> **ext) const;
+
+                virtual bool value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+                  Geom<double> *e, Func<Scalar> **ext, Scalar *result) const;
+
+                virtual VectorFormVol<Scalar>* clone() const {
+                  return new Residual(*this);
+                }
+
+              private:
+                /// The weights of the point i: wt_u_v[i] of v (the reaction of all the groups and the source),
+                /// wt_dx[i], wt_dy[i] of the derivatives of v (the diffusion).
+                void weights(int n, double *wt, Func<Scalar> *u_ext[], Geom<double> *e, Scalar* wt_v, Scalar* wt_dx, Scalar* wt_dy) const;
+
+                unsigned int g;
+                const MultigroupMaterialData* data;
+                GeomType geom_type;
+              };
+            };
           }
         }
 
@@ -1221,6 +1321,21 @@ namespace Hermes
               /// get over it.
               double get_keff() { return 0.0; };
             };
+
+            /// The same problem as DefaultWeakFormFixedSource with the sources of matprop, assembled by the fused
+            /// MultigroupDiffusion forms: one matrix form per nonzero block instead of up to three, one vector form per group
+            /// instead of up to 2 G + 2, with the material data read from contiguous per-marker arrays.
+            /// The mesh must not get new element markers while the weak form is used.
+            template<typename Scalar>
+            class HERMES_API FusedWeakFormFixedSource : public WeakForm<Scalar>
+            {
+            public:
+              FusedWeakFormFixedSource(const MaterialPropertyMaps& matprop, Mesh *mesh, GeomType geom_type = HERMES_PLANAR);
+              virtual ~FusedWeakFormFixedSource();
+
+            protected:
+              MultigroupMaterialData* data;
+            };
           }
         }
 
@@ -1253,6 +1368,76 @@ namespace Hermes
 
             void filter_fn(int n, Hermes::vector<double*> values, double* result);
           };
+
+          /// \brief Power (source) iteration for the effective multiplication factor of the multigroup diffusion, L phi = 1 / keff F phi.
+          /// \details The loss operator L (diffusion, removal and scattering) and the fission operator F are assembled once as matrices.
+          /// The operator of the iteration is factorized by the first solve only, each iteration is then one solve with the factors
+          /// and one product with F, instead of the assembling of DefaultWeakFormSourceIteration (the fission source integrated
+          /// from the previous iterates) and a linear solve from scratch.
+          /// With the Wielandt shift keff_s (set_wielandt_shift()), the iteration solves (L - F / keff_s) phi_new = (1 / keff - 1 / keff_s) F phi,
+          /// so that the error is reduced by (1 / keff_s - 1 / keff_0) / (1 / keff_s - 1 / keff_1) per iteration instead of keff_1 / keff_0
+          /// (keff_0 the fundamental, keff_1 the next eigenvalue). The shift has to stay above keff_0 and the closer it is,
+          /// the fewer iterations are needed.
+          /// keff is updated by the ratio of the fission productions (the sums of the entries of F phi).
+          /// Homogeneous essential conditions only (the essential dofs are not in the system).
+          /// Typical usage:
+          /// PowerIteration power(matprop, spaces);
+          /// power.set_wielandt_shift(1.1);
+          /// double keff = power.solve(1.0);
+          /// Solution<double>::vector_to_solutions(power.get_sln_vector(), spaces, solutions);
+          class HERMES_API PowerIteration : public Hermes::Mixins::Loggable
+          {
+          public:
+            PowerIteration(const MaterialProperties::Diffusion::MaterialPropertyMaps& matprop, Hermes::vector<const Space<double>*> spaces, GeomType geom_type = HERMES_PLANAR);
+            virtual ~PowerIteration();
+
+            /// Sets the Wielandt shift, 0.0 (default) for the plain power iteration.
+            /// The operator of the iteration is assembled and factorized again by the next solve().
+            void set_wielandt_shift(double keff_shift);
+
+            /// Relative tolerance of keff and of the fission source (default 1e-8), maximum number of iterations (default 1000).
+            void set_tolerance(double tol);
+            void set_max_iterations(int max_iterations);
+
+            /// Iterates from the initial guess until the tolerance is reached, a warning is issued if the maximum number of
+            /// iterations is exceeded.
+            /// \param[in] initial_keff_guess The initial keff.
+            /// \param[in] coeff_vec The initial flux (the coefficients of the spaces), NULL for a constant one.
+            /// \return keff.
+            double solve(double initial_keff_guess = 1.0, double* coeff_vec = NULL);
+
+            /// The flux of the last solve(), normalized to the unit fission production.
+            double* get_sln_vector() const;
+
+            double get_keff() const;
+            int get_num_iterations() const;
+
+          protected:
+            /// Assembles F (once) and L - F / keff_s with its solver.
+            void init_operators();
+
+            /// fission = F phi, returns the sum of the entries.
+            double fission_production(double* phi, double* fission);
+
+            const MaterialProperties::Diffusion::MaterialPropertyMaps& matprop;
+            Hermes::vector<const Space<double>*> spaces;
+            GeomType geom_type;
+
+            double keff_shift;
+            double tol;
+            int max_iterations;
+
+            int ndof;
+            SparseMatrix<double>* iteration_matrix;
+            SparseMatrix<double>* fission_matrix;
+            Vector<double>* rhs;
+            LinearMatrixSolver<double>* solver;
+            bool factorized;
+
+            double* sln_vector;
+            double keff;
+            int num_iterations;
+          };
         }
       }
     }
@@ -25,6 +25,7 @@
 #include "traverse.h"
 #include "refinement_selectors/optimum_selector.h"
 #include "matrix.h"
+#include <algorithm>
 
 namespace Hermes
 {
@@ -33,11 +34,13 @@ namespace Hermes
     template<typename Scalar>
     Adapt<Scalar>::Adapt(Hermes::vector<Space<Scalar>*> spaces,
       Hermes::vector<ProjNormType> proj_norms) :
-    spaces(spaces),
+    regular_queue_sorted(-1),
+      spaces(spaces),
       num_act_elems(-1),
       have_errors(false),
       have_coarse_solutions(false),
-      have_reference_solutions(false)
+      have_reference_solutions(false),
+      local_projection(false)
     {
       // sanity check
       if(proj_norms.size() > 0 && spaces.size() != proj_norms.size())
@@ -94,11 +97,13 @@ namespace Hermes
 
     template<typename Scalar>
     Adapt<Scalar>::Adapt(Space<Scalar>* space, ProjNormType proj_norm) :
-    spaces(Hermes::vector<Space<Scalar>*>()),
+    regular_queue_sorted(-1),
+      spaces(Hermes::vector<Space<Scalar>*>()),
       num_act_elems(-1),
       have_errors(false),
       have_coarse_solutions(false),
-      have_reference_solutions(false)
+      have_reference_solutions(false),
+      local_projection(false)
     {
       if(space == NULL) throw Exceptions::NullException(1);
       spaces.push_back(space);
@@ -158,6 +163,7 @@ namespace Hermes
     bool Adapt<Scalar>::adapt(Hermes::vector<RefinementSelectors::Selector<Scalar> *> refinement_selectors, double thr, int strat,
       int regularize, double to_be_processed)
     {
+      Hermes::ProfilerRegion profiler_region("Adapt::adapt");
       this->tick();
       // Important, sets the current caughtException to NULL.
       this->caughtException = NULL;
@@ -221,6 +227,7 @@ namespace Hermes
         // Process the queuse(s) to see what elements to really refine.
         if(priority_queue.empty())
         {
+          sort_regular_queue(inx_regular_element + 1);
           id = regular_queue[inx_regular_element].id;
           comp = regular_queue[inx_regular_element].comp;
           inx_regular_element++;
@@ -287,10 +294,15 @@ namespace Hermes
         return true;
       }
 
+      // Shape values of projection based selectors are shared by all clones, evaluate them now while still serial.
+      for (unsigned int j = 0; j < refinement_selectors.size(); j++)
+        if(dynamic_cast<RefinementSelectors::ProjBasedSelector<Scalar>*>(refinement_selectors[j]) != NULL)
+          dynamic_cast<RefinementSelectors::ProjBasedSelector<Scalar>*>(refinement_selectors[j])->precalculate_shape_values();
+
       // RefinementSelectors cloning.
-      RefinementSelectors::Selector<Scalar>*** global_refinement_selectors = new RefinementSelectors::Selector<Scalar>**[Hermes::Hermes2D::Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
+      RefinementSelectors::Selector<Scalar>*** global_refinement_selectors = new RefinementSelectors::Selector<Scalar>**[this->get_num_threads()];
 
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      for(unsigned int i = 0; i < this->get_num_threads(); i++)
       {
         global_refinement_selectors[i] = new RefinementSelectors::Selector<Scalar>*[refinement_selectors.size()];
         for (unsigned int j = 0; j < refinement_selectors.size(); j++)
@@ -313,9 +325,9 @@ namespace Hermes
       }
 
       // Solution cloning.
-      Solution<Scalar>*** rslns = new Solution<Scalar>**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
+      Solution<Scalar>*** rslns = new Solution<Scalar>**[this->get_num_threads()];
 
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      for(unsigned int i = 0; i < this->get_num_threads(); i++)
       {
         rslns[i] = new Solution<Scalar>*[this->num];
         for (int j = 0; j < this->num; j++)
@@ -325,6 +337,58 @@ namespace Hermes
         }
       }
 
+      // Sample reference solutions on all elements to be refined in one parallel pass, the selectors then only read the samples.
+      for (unsigned int j = 0; j < refinement_selectors.size(); j++)
+      {
+        RefinementSelectors::ProjBasedSelector<Scalar>* selector = dynamic_cast<RefinementSelectors::ProjBasedSelector<Scalar>*>(refinement_selectors[j]);
+        if(selector == NULL || rsln[j] == NULL)
+          continue;
+        Hermes::vector<Element*> elements_to_sample;
+        for(unsigned int i = 0; i < ids.size(); i++)
+          if(components[i] == j)
+            elements_to_sample.push_back(meshes[j]->get_element(ids[i]));
+        selector->init_ref_solution_samples(elements_to_sample);
+        for(unsigned int i = 1; i < this->get_num_threads(); i++)
+          dynamic_cast<RefinementSelectors::ProjBasedSelector<Scalar>*>(global_refinement_selectors[i][j])->share_ref_solution_samples(selector);
+      }
+
+      int id_to_sample;
+#pragma omp parallel shared(ids, components, meshes) private(id_to_sample) num_threads(this->get_num_threads())
+      {
+        this->apply_thread_affinity();
+#pragma omp for schedule(dynamic, 16)
+        for(id_to_sample = 0; id_to_sample < ids.size(); id_to_sample++)
+        {
+          try
+          {
+            RefinementSelectors::ProjBasedSelector<Scalar>* selector = dynamic_cast<RefinementSelectors::ProjBasedSelector<Scalar>*>(global_refinement_selectors[omp_get_thread_num()][components[id_to_sample]]);
+            if(selector != NULL && rsln[components[id_to_sample]] != NULL)
+              selector->store_ref_solution_samples(meshes[components[id_to_sample]]->get_element(ids[id_to_sample]), rslns[omp_get_thread_num()][components[id_to_sample]]);
+          }
+          catch(Hermes::Exceptions::Exception& exception)
+          {
+#pragma omp critical (caughtException)
+            if(this->caughtException == NULL)
+              this->caughtException = exception.clone();
+          }
+          catch(std::exception& exception)
+          {
+#pragma omp critical (caughtException)
+            if(this->caughtException == NULL)
+              this->caughtException = new Hermes::Exceptions::Exception(exception.what());
+          }
+        }
+      }
+
+      // Incomplete samples are not used, the selectors evaluate the reference solutions themselves.
+      if(this->caughtException != NULL)
+      {
+        for(unsigned int i = 0; i < this->get_num_threads(); i++)
+          for (unsigned int j = 0; j < refinement_selectors.size(); j++)
+            if(dynamic_cast<RefinementSelectors::ProjBasedSelector<Scalar>*>(global_refinement_selectors[i][j]) != NULL)
+              dynamic_cast<RefinementSelectors::ProjBasedSelector<Scalar>*>(global_refinement_selectors[i][j])->free_ref_solution_samples();
+      }
+
       this->tick();
       this->info("Adaptivity: data preparation duration: %f s.", this->last());
 
@@ -336,12 +400,32 @@ namespace Hermes
       RefinementSelectors::Selector<Scalar>** current_refinement_selectors;
       Solution<Scalar>** current_rslns;
       int id_to_refine;
-#define CHUNKSIZE 1
-      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
-#pragma omp parallel shared(ids, components, elem_inx_to_proc, meshes, current_orders) private(current_refinement_selectors, current_rslns, id_to_refine) num_threads(num_threads_used)
+      int num_threads_used = this->get_num_threads();
+
+      // The selection on an element of the order p costs about (the shape functions) * (the quadrature points) ~ p^4,
+      // the threads get contiguous ranges of the elements of about the same estimated cost.
+      int num_elements_to_refine = ids.size();
+      double* element_costs = new double[std::max(num_elements_to_refine, 1)];
+      for(int i = 0; i < num_elements_to_refine; i++)
       {
-#pragma omp for schedule(static, CHUNKSIZE)
-        for(id_to_refine = 0; id_to_refine < ids.size(); id_to_refine++)
+        ElementMode2D mode = meshes[components[i]]->get_element(ids[i])->get_mode();
+        element_costs[i] = CostModel::get_element_cost(CostModel::get_num_shapes(current_orders[i], mode), current_orders[i], mode, false, 1, 0);
+      }
+      int* thread_bounds = NULL;
+      std::vector<double> thread_times;
+
+#pragma omp parallel shared(ids, components, elem_inx_to_proc, meshes, current_orders, thread_bounds, thread_times) private(current_refinement_selectors, current_rslns, id_to_refine) num_threads(num_threads_used)
+      {
+        this->apply_thread_affinity();
+#pragma omp single
+        {
+          // The team may be smaller than requested.
+          thread_bounds = new int[omp_get_num_threads() + 1];
+          CostModel::partition(element_costs, 0, num_elements_to_refine, omp_get_num_threads(), thread_bounds);
+          thread_times.assign(omp_get_num_threads(), 0.0);
+        }
+        double thread_start_time = omp_get_wtime();
+        for(id_to_refine = thread_bounds[omp_get_thread_num()]; id_to_refine < thread_bounds[omp_get_thread_num() + 1]; id_to_refine++)
         {
           try
           {
@@ -378,7 +462,12 @@ namespace Hermes
               this->caughtException = new Hermes::Exceptions::Exception(exception.what());
           }
         }
+        thread_times[omp_get_thread_num()] = omp_get_wtime() - thread_start_time;
       }
+      delete [] thread_bounds;
+      delete [] element_costs;
+      if(thread_times.size() > 1)
+        this->info("Adaptivity: refinement selection imbalance of the threads (the longest / the mean time): %f.", CostModel::get_imbalance(thread_times));
 
       if(this->caughtException == NULL)
       {
@@ -394,10 +483,14 @@ namespace Hermes
       this->tick();
       this->info("Adaptivity: refinement selection duration: %f s.", this->last());
 
+      for (unsigned int j = 0; j < refinement_selectors.size(); j++)
+        if(dynamic_cast<RefinementSelectors::ProjBasedSelector<Scalar>*>(refinement_selectors[j]) != NULL)
+          dynamic_cast<RefinementSelectors::ProjBasedSelector<Scalar>*>(refinement_selectors[j])->free_ref_solution_samples();
+
       if(this->caughtException == NULL)
         fix_shared_mesh_refinements(meshes, elem_inx_to_proc, idx, global_refinement_selectors);
 
-      for(unsigned int i = 0; i < Hermes::Hermes2D::Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      for(unsigned int i = 0; i < this->get_num_threads(); i++)
       {
         if(i > 0)
           for (unsigned int j = 0; j < refinement_selectors.size(); j++)
@@ -406,7 +499,7 @@ namespace Hermes
       }
       delete [] global_refinement_selectors;
 
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      for(unsigned int i = 0; i < this->get_num_threads(); i++)
       {
         if(rslns[i] != NULL)
         {
@@ -452,6 +545,54 @@ namespace Hermes
         if(rsln[j] != NULL)
           rsln[j]->enable_transform(true);
 
+      // renumber the elements of the refined meshes along the Hilbert curve
+      // (only if all the spaces on the meshes are the adapted ones, other spaces would keep the data of the old ids)
+      bool reordered = Hermes2DApi.get_integral_param_value(meshReordering) != 0;
+      for (int i = 0; i < this->num && reordered; i++)
+      {
+        int adapted_spaces = 0;
+        for (int j = 0; j < this->num; j++)
+          if(meshes[j] == meshes[i])
+            adapted_spaces++;
+        if(meshes[i]->space_count > adapted_spaces)
+        {
+          this->warn("Adaptivity: the mesh of the component %d is used by other spaces too, the meshes are not reordered.", i);
+          reordered = false;
+        }
+      }
+      if(reordered)
+      {
+        int* new_element_ids[H2D_MAX_COMPONENTS];
+        for (int i = 0; i < this->num; i++)
+        {
+          new_element_ids[i] = NULL;
+          for (int j = 0; j < i; j++)
+            if(meshes[j] == meshes[i])
+              new_element_ids[i] = new_element_ids[j];
+          if(new_element_ids[i] == NULL)
+          {
+            new_element_ids[i] = new int[meshes[i]->get_max_element_id()];
+            meshes[i]->reorder_hilbert(new_element_ids[i]);
+          }
+          this->spaces[i]->reorder_element_data(new_element_ids[i]);
+        }
+
+        for (unsigned int i = 0; i < elem_inx_to_proc.size(); i++)
+          elem_inx_to_proc[i].id = new_element_ids[elem_inx_to_proc[i].comp][elem_inx_to_proc[i].id];
+        for (unsigned int i = 0; i < ids.size(); i++)
+          ids[i] = new_element_ids[components[i]][ids[i]];
+
+        for (int i = 0; i < this->num; i++)
+        {
+          bool shared = false;
+          for (int j = i + 1; j < this->num; j++)
+            if(new_element_ids[j] == new_element_ids[i])
+              shared = true;
+          if(!shared)
+            delete [] new_element_ids[i];
+        }
+      }
+
       //store for the user to retrieve
       last_refinements.swap(elem_inx_to_proc);
 
@@ -463,6 +604,8 @@ namespace Hermes
       for(unsigned int i = 0; i < this->spaces.size(); i++)
         this->spaces[i]->assign_dofs();
 
+      // ids are in the new numbering if the meshes were reordered, the cached element data are matched
+      // by the geometry (not by the ids), so no flags have to be set because of the renumbering
       for (int i = 0; i < this->num; i++)
       {
         for_all_active_elements(e, this->spaces[i]->get_mesh())
@@ -633,13 +776,12 @@ namespace Hermes
       this->tick();
       if(num != 1)
         throw Exceptions::LengthException(1, 1, num);
-      OGProjection<Scalar> ogProjection;
       typename Mesh::ReferenceMeshCreator ref_mesh_creator(this->spaces[0]->get_mesh());
       Mesh* ref_mesh = ref_mesh_creator.create_ref_mesh();
       typename Space<Scalar>::ReferenceSpaceCreator ref_space_creator(this->spaces[0], ref_mesh, 0);
       Space<Scalar>* ref_space = ref_space_creator.create_ref_space();
       Solution<Scalar> ref_sln_local;
-      ogProjection.project_global(ref_space, rsln, &ref_sln_local);
+      this->project(ref_space, rsln, &ref_sln_local);
       double result = calc_err_internal(sln, &ref_sln_local, NULL, solutions_for_adapt, error_flags);
       delete ref_space;
       delete ref_mesh;
@@ -663,17 +805,17 @@ namespace Hermes
       Hermes::vector<Solution<Scalar>*> ref_slns_local;
       for(unsigned int i = 0; i < num; i++)
       {
-        OGProjection<Scalar> ogProjection;
         typename Mesh::ReferenceMeshCreator ref_mesh_creator(this->spaces[i]->get_mesh());
         ref_meshes[i] = ref_mesh_creator.create_ref_mesh();
-        typename Space<Scalar>::ReferenceSpaceCreator ref_space_creator(this->spaces[i], ref_mesh_creator.create_ref_mesh(), 0);
+        typename Space<Scalar>::ReferenceSpaceCreator ref_space_creator(this->spaces[i], ref_meshes[i], 0);
         ref_spaces[i] = ref_space_creator.create_ref_space();
         ref_slns_local.push_back(new Solution<Scalar>);
-        ogProjection.project_global(ref_space_creator.create_ref_space(), rslns[i], ref_slns_local.back());
+        this->project(ref_spaces[i], rslns[i], ref_slns_local.back());
       }
       double result = calc_err_internal(slns, ref_slns_local, component_errors, solutions_for_adapt, error_flags);
       for(unsigned int i = 0; i < num; i++)
       {
+        delete ref_slns_local[i];
         delete ref_spaces[i];
         delete ref_meshes[i];
       }
@@ -684,10 +826,53 @@ namespace Hermes
       return result;
     }
 
+    template<typename Scalar>
+    void Adapt<Scalar>::set_local_projection(bool local_projection)
+    {
+      this->local_projection = local_projection;
+    }
+
+    template<typename Scalar>
+    void Adapt<Scalar>::project(const Space<Scalar>* space, Solution<Scalar>* source, Solution<Scalar>* target)
+    {
+      if(this->local_projection)
+        LocalProjection<Scalar>::project_local(space, source, target, HERMES_UNSET_NORM);
+      else
+      {
+        OGProjection<Scalar> ogProjection;
+        ogProjection.project_global(space, source, target);
+      }
+    }
+
+    template<typename Scalar>
+    void Adapt<Scalar>::project_reference_solutions(Hermes::vector<Solution<Scalar>*> rslns, Hermes::vector<Solution<Scalar>*> slns)
+    {
+      if(rslns.size() != num)
+        throw Exceptions::LengthException(1, rslns.size(), num);
+      if(slns.size() != num)
+        throw Exceptions::LengthException(2, slns.size(), num);
+      this->tick();
+      for(int i = 0; i < this->num; i++)
+        this->project(this->spaces[i], rslns[i], slns[i]);
+      this->tick();
+      this->info("Adaptivity: projection of the reference solutions duration: %f s.", this->last());
+    }
+
+    template<typename Scalar>
+    void Adapt<Scalar>::project_reference_solutions(Solution<Scalar>* rsln, Solution<Scalar>* sln)
+    {
+      Hermes::vector<Solution<Scalar>*> rslns;
+      rslns.push_back(rsln);
+      Hermes::vector<Solution<Scalar>*> slns;
+      slns.push_back(sln);
+      project_reference_solutions(rslns, slns);
+    }
+
     template<typename Scalar>
     bool Adapt<Scalar>::adapt(RefinementSelectors::Selector<Scalar>* refinement_selector, double thr, int strat,
       int regularize, double to_be_processed)
     {
+      Hermes::ProfilerRegion profiler_region("Adapt::adapt");
       if(refinement_selector==NULL)
         throw Exceptions::NullException(1);
       Hermes::vector<RefinementSelectors::Selector<Scalar> *> refinement_selectors;
@@ -781,8 +966,9 @@ namespace Hermes
     };
 
     template<typename Scalar>
-    const Hermes::vector<typename Adapt<Scalar>::ElementReference>& Adapt<Scalar>::get_regular_queue() const
+    const Hermes::vector<typename Adapt<Scalar>::ElementReference>& Adapt<Scalar>::get_regular_queue()
     {
+      sort_regular_queue(regular_queue.size());
       return regular_queue;
     };
 
@@ -819,6 +1005,36 @@ namespace Hermes
     template<typename Scalar>
     void Adapt<Scalar>::apply_refinements(std::vector<ElementToRefine>& elems_to_refine)
     {
+      // The meshes are refined first, each at once (by several threads for large counts, Mesh::refine_elements()),
+      // an element of a mesh shared by several components only once. The orders are set afterwards.
+      std::vector<Mesh*> refined_meshes;
+      for (std::vector<ElementToRefine>::const_iterator elem_ref = elems_to_refine.begin();
+        elem_ref != elems_to_refine.end(); elem_ref++)
+      {
+        Mesh* mesh = this->spaces[elem_ref->comp]->get_mesh();
+        if(elem_ref->split != H2D_REFINEMENT_P && std::find(refined_meshes.begin(), refined_meshes.end(), mesh) == refined_meshes.end())
+          refined_meshes.push_back(mesh);
+      }
+
+      for (unsigned int mesh_i = 0; mesh_i < refined_meshes.size(); mesh_i++)
+      {
+        Mesh* mesh = refined_meshes[mesh_i];
+        std::vector<int> ids, splits;
+        std::vector<bool> listed(mesh->get_max_element_id(), false);
+        for (std::vector<ElementToRefine>::const_iterator elem_ref = elems_to_refine.begin();
+          elem_ref != elems_to_refine.end(); elem_ref++)
+        {
+          if(elem_ref->split == H2D_REFINEMENT_P || this->spaces[elem_ref->comp]->get_mesh() != mesh || listed[elem_ref->id])
+            continue;
+          if(!mesh->get_element(elem_ref->id)->active)
+            continue;
+          listed[elem_ref->id] = true;
+          ids.push_back(elem_ref->id);
+          splits.push_back(elem_ref->split);
+        }
+        mesh->refine_elements(ids, splits);
+      }
+
       for (std::vector<ElementToRefine>::const_iterator elem_ref = elems_to_refine.begin();
         elem_ref != elems_to_refine.end(); elem_ref++)
         apply_refinement(*elem_ref);
@@ -901,14 +1117,9 @@ namespace Hermes
     }
 
     template<typename Scalar>
-    double Adapt<Scalar>::eval_error(typename Adapt<Scalar>::MatrixFormVolError* form,
-      MeshFunction<Scalar>*sln1, MeshFunction<Scalar>*sln2, MeshFunction<Scalar>*rsln1,
-      MeshFunction<Scalar>*rsln2)
+    int Adapt<Scalar>::calc_error_order(typename Adapt<Scalar>::MatrixFormVolError* form, MeshFunction<Scalar>*rsln1, MeshFunction<Scalar>*rsln2)
     {
-      RefMap *rv1 = sln1->get_refmap();
-      RefMap *rv2 = sln2->get_refmap();
       RefMap *rrv1 = rsln1->get_refmap();
-      RefMap *rrv2 = rsln2->get_refmap();
 
       // determine the integration order
       int inc = (rsln1->get_num_components() == 2) ? 1 : 0;
@@ -920,20 +1131,103 @@ namespace Hermes
       Hermes::Ord o = form->ord(1, &fake_wt, NULL, ou, ov, fake_e, NULL);
       int order = rrv1->get_inv_ref_order();
       order += o.get_order();
-      if(static_cast<Solution<Scalar>*>(rsln1) || static_cast<Solution<Scalar>*>(rsln2))
-      {
-        if(static_cast<Solution<Scalar>*>(rsln1)->get_type() == HERMES_EXACT)
-        { limit_order_nowarn(order, rv1->get_active_element()->get_mode()); }
-        else
-          limit_order(order, rv1->get_active_element()->get_mode());
-      }
+      if(static_cast<Solution<Scalar>*>(rsln1)->get_type() == HERMES_EXACT)
+        limit_order_nowarn(order, rrv1->get_active_element()->get_mode());
       else
-        limit_order(order, rv1->get_active_element()->get_mode());
+        limit_order(order, rrv1->get_active_element()->get_mode());
 
       ou->free_ord(); delete ou;
       ov->free_ord(); delete ov;
       delete fake_e;
 
+      return order;
+    }
+
+    template<typename Scalar>
+    void Adapt<Scalar>::eval_errors(MeshFunction<Scalar>** fns, double* element_errors, double* element_norms)
+    {
+      // The integration orders of the forms, usually all the same.
+      int error_orders[H2D_MAX_COMPONENTS][H2D_MAX_COMPONENTS];
+      int norm_orders[H2D_MAX_COMPONENTS][H2D_MAX_COMPONENTS];
+      Hermes::vector<int> orders;
+      for (int i = 0; i < num; i++)
+        for (int j = 0; j < num; j++)
+        {
+          if(error_form[i][j] == NULL)
+            continue;
+          error_orders[i][j] = calc_error_order(error_form[i][j], fns[num + i], fns[num + j]);
+          norm_orders[i][j] = calc_error_order(norm_form[i][j], fns[num + i], fns[num + j]);
+          if(std::find(orders.begin(), orders.end(), error_orders[i][j]) == orders.end())
+            orders.push_back(error_orders[i][j]);
+          if(std::find(orders.begin(), orders.end(), norm_orders[i][j]) == orders.end())
+            orders.push_back(norm_orders[i][j]);
+        }
+
+      // One pass per order: the geometry and the values of the solutions of each component are
+      // calculated once and shared by all the forms of the order.
+      ElementMode2D mode = fns[num]->get_active_element()->get_mode();
+      Quad2D* quad = fns[0]->get_quad_2d();
+      for (unsigned int order_i = 0; order_i < orders.size(); order_i++)
+      {
+        int order = orders[order_i];
+        double3* pt = quad->get_points(order, mode);
+        int np = quad->get_num_points(order, mode);
+
+        // All the functions are on the same (union) element, its geometry is the one of the first reference solution.
+        RefMap* rrv = fns[num]->get_refmap();
+        Geom<double>* e = init_geom_vol(rrv, order);
+        double* jac = rrv->get_jacobian(order);
+        double* jwt = new double[np];
+        for(int i = 0; i < np; i++)
+          jwt[i] = pt[i][2] * jac[i];
+
+        Func<Scalar>* err[H2D_MAX_COMPONENTS];
+        Func<Scalar>* v[H2D_MAX_COMPONENTS];
+        memset(err, 0, sizeof(err));
+        memset(v, 0, sizeof(v));
+
+        for (int i = 0; i < num; i++)
+          for (int j = 0; j < num; j++)
+          {
+            if(error_form[i][j] == NULL)
+              continue;
+            if(error_orders[i][j] != order && norm_orders[i][j] != order)
+              continue;
+            int comps[2] = { i, j };
+            for (int k = 0; k < 2; k++)
+            {
+              int c = comps[k];
+              if(v[c] != NULL)
+                continue;
+              v[c] = init_fn(fns[num + c], order);
+              err[c] = init_fn(fns[c], order);
+              err[c]->subtract(v[c]);
+            }
+            if(error_orders[i][j] == order)
+              element_errors[i] += std::abs(error_form[i][j]->value(np, jwt, NULL, err[i], err[j], e, NULL));
+            if(norm_orders[i][j] == order)
+              element_norms[i] += std::abs(norm_form[i][j]->value(np, jwt, NULL, v[i], v[j], e, NULL));
+          }
+
+        for (int i = 0; i < num; i++)
+          if(v[i] != NULL)
+          {
+            err[i]->free_fn(); delete err[i];
+            v[i]->free_fn(); delete v[i];
+          }
+        e->free(); delete e;
+        delete [] jwt;
+      }
+    }
+
+    template<typename Scalar>
+    double Adapt<Scalar>::eval_error(typename Adapt<Scalar>::MatrixFormVolError* form,
+      MeshFunction<Scalar>*sln1, MeshFunction<Scalar>*sln2, MeshFunction<Scalar>*rsln1,
+      MeshFunction<Scalar>*rsln2)
+    {
+      RefMap *rrv1 = rsln1->get_refmap();
+      int order = calc_error_order(form, rsln1, rsln2);
+
       // eval the form
       Quad2D* quad = sln1->get_quad_2d();
       double3* pt = quad->get_points(order, sln1->get_active_element()->get_mode());
@@ -972,31 +1266,7 @@ namespace Hermes
       MeshFunction<Scalar>*rsln1, MeshFunction<Scalar>*rsln2)
     {
       RefMap *rrv1 = rsln1->get_refmap();
-      RefMap *rrv2 = rsln2->get_refmap();
-
-      // determine the integration order
-      int inc = (rsln1->get_num_components() == 2) ? 1 : 0;
-      Func<Hermes::Ord>* ou = init_fn_ord(rsln1->get_fn_order() + inc);
-      Func<Hermes::Ord>* ov = init_fn_ord(rsln2->get_fn_order() + inc);
-
-      double fake_wt = 1.0;
-      Geom<Hermes::Ord>* fake_e = init_geom_ord();
-      Hermes::Ord o = form->ord(1, &fake_wt, NULL, ou, ov, fake_e, NULL);
-      int order = rrv1->get_inv_ref_order();
-      order += o.get_order();
-      if(static_cast<Solution<Scalar>*>(rsln1) || static_cast<Solution<Scalar>*>(rsln2))
-      {
-        if(static_cast<Solution<Scalar>*>(rsln1)->get_type() == HERMES_EXACT)
-        { limit_order_nowarn(order, rrv1->get_active_element()->get_mode());  }
-        else
-          limit_order(order, rrv1->get_active_element()->get_mode());
-      }
-      else
-        limit_order(order, rrv1->get_active_element()->get_mode());
-
-      ou->free_ord(); delete ou;
-      ov->free_ord(); delete ov;
-      delete fake_e;
+      int order = calc_error_order(form, rsln1, rsln2);
 
       // eval the form
       Quad2D* quad = rsln1->get_quad_2d();
@@ -1028,7 +1298,8 @@ namespace Hermes
     double Adapt<Scalar>::calc_err_internal(Hermes::vector<Solution<Scalar>*> slns, Hermes::vector<Solution<Scalar>*> rslns,
       Hermes::vector<double>* component_errors, bool solutions_for_adapt, unsigned int error_flags)
     {
-      int i, j;
+      Hermes::ProfilerRegion profiler_region("Adapt::calc_err_internal");
+      int i;
       
       bool compatible_meshes = true;
       for (int space_i = 0; space_i < this->num; space_i++)
@@ -1085,15 +1356,11 @@ namespace Hermes
 
       // Prepare multi-mesh traversal and error arrays.
       const Mesh **meshes = new const Mesh *[2 * num];
-      Transformable **tr = new Transformable *[2 * num];
-      Traverse trav(true);
       num_act_elems = 0;
       for (i = 0; i < num; i++)
       {
         meshes[i] = sln[i]->get_mesh();
         meshes[i + num] = rsln[i]->get_mesh();
-        tr[i] = sln[i];
-        tr[i + num] = rsln[i];
 
         num_act_elems += sln[i]->get_mesh()->get_num_active_elements();
 
@@ -1115,31 +1382,126 @@ namespace Hermes
       double total_error = 0.0;
 
       // Calculate error.
-      Traverse::State * ee;
-      trav.begin(2 * num, meshes, tr);
-      while ((ee = trav.get_next_state()) != NULL)
+      // Repeated error calculations on the same meshes replay the recorded traversal.
+      Hermes::vector<const Mesh*> meshes_vector;
+      for (i = 0; i < 2 * num; i++)
+        meshes_vector.push_back(meshes[i]);
+      int num_states;
+      Traverse::State** states = this->traverse_plan.get_states(meshes_vector, num_states);
+
+      // Per-thread instances of the solutions, the first thread uses the originals.
+      // If the solutions cannot be cloned (exact solutions without clone()), one thread does all the work.
+      int num_threads_used = this->get_num_threads();
+      MeshFunction<Scalar>*** fns = new MeshFunction<Scalar>**[num_threads_used];
+      Transformable*** trfs = new Transformable**[num_threads_used];
+      int num_clones = 0;
+      try
       {
-        for (i = 0; i < num; i++)
+        for (int thread_i = 0; thread_i < num_threads_used; thread_i++, num_clones++)
         {
-          for (j = 0; j < num; j++)
+          fns[thread_i] = new MeshFunction<Scalar>*[2 * num];
+          memset(fns[thread_i], 0, sizeof(MeshFunction<Scalar>*) * 2 * num);
+          for (i = 0; i < num; i++)
           {
-            if(error_form[i][j] != NULL)
-            {
-              double err, nrm;
-              err = eval_error(error_form[i][j], sln[i], sln[j], rsln[i], rsln[j]);
-              nrm = eval_error_norm(norm_form[i][j], rsln[i], rsln[j]);
-
-              norms[i] += nrm;
-              total_norm  += nrm;
-              total_error += err;
-              errors_components[i] += err;
-              if(solutions_for_adapt)
-                this->errors[i][ee->e[i]->id] += err;
-            }
+            fns[thread_i][i] = (thread_i == 0) ? sln[i] : sln[i]->clone();
+            fns[thread_i][i + num] = (thread_i == 0) ? rsln[i] : rsln[i]->clone();
+          }
+        }
+      }
+      catch(Hermes::Exceptions::Exception&)
+      {
+        for (i = 0; i < 2 * num; i++)
+          delete fns[num_clones][i];
+        delete [] fns[num_clones];
+        num_threads_used = num_clones;
+      }
+      for (int thread_i = 0; thread_i < num_threads_used; thread_i++)
+      {
+        trfs[thread_i] = new Transformable*[2 * num];
+        for (i = 0; i < 2 * num; i++)
+        {
+          fns[thread_i][i]->set_quad_2d(&g_quad_2d_std);
+          trfs[thread_i][i] = fns[thread_i][i];
+        }
+      }
+
+      // The contributions of the states are stored and summed in the order of the states afterwards,
+      // so that the element errors do not depend on the number of threads.
+      double* state_errors = new double[num_states * num];
+      double* state_norms = new double[num_states * num];
+      memset(state_errors, 0, sizeof(double) * num_states * num);
+      memset(state_norms, 0, sizeof(double) * num_states * num);
+      Hermes::Exceptions::Exception* caughtException = NULL;
+
+      int state_i;
+#pragma omp parallel shared(states) private(state_i) num_threads(num_threads_used)
+      {
+        this->apply_thread_affinity();
+#pragma omp for schedule(dynamic, 16)
+        for(state_i = 0; state_i < num_states; state_i++)
+        {
+          if(caughtException != NULL)
+            continue;
+
+          try
+          {
+            Traverse::set_state_to_fns(states[state_i], trfs[omp_get_thread_num()]);
+            eval_errors(fns[omp_get_thread_num()], state_errors + state_i * num, state_norms + state_i * num);
+          }
+          catch(Hermes::Exceptions::Exception& e)
+          {
+#pragma omp critical (caughtException)
+            if(caughtException == NULL)
+              caughtException = e.clone();
+          }
+          catch(std::exception& e)
+          {
+#pragma omp critical (caughtException)
+            if(caughtException == NULL)
+              caughtException = new Hermes::Exceptions::Exception(e.what());
           }
         }
       }
-      trav.finish();
+
+      for (int thread_i = 0; thread_i < num_threads_used; thread_i++)
+      {
+        if(thread_i > 0)
+          for (i = 0; i < 2 * num; i++)
+            delete fns[thread_i][i];
+        delete [] fns[thread_i];
+        delete [] trfs[thread_i];
+      }
+      delete [] fns;
+      delete [] trfs;
+
+      if(caughtException != NULL)
+      {
+        delete [] state_errors;
+        delete [] state_norms;
+        delete [] meshes;
+        delete [] norms;
+        delete [] errors_components;
+        Hermes::Exceptions::Exception exception(*caughtException);
+        delete caughtException;
+        throw exception;
+      }
+
+      for(state_i = 0; state_i < num_states; state_i++)
+      {
+        for (i = 0; i < num; i++)
+        {
+          double err = state_errors[state_i * num + i];
+          double nrm = state_norms[state_i * num + i];
+          norms[i] += nrm;
+          total_norm  += nrm;
+          total_error += err;
+          errors_components[i] += err;
+          if(solutions_for_adapt && states[state_i]->e[i] != NULL)
+            this->errors[i][states[state_i]->e[i]->id] += err;
+        }
+      }
+      delete [] state_errors;
+      delete [] state_norms;
 
       // Store the calculation for each solution component separately.
       if(component_errors != NULL)
@@ -1186,6 +1548,7 @@ namespace Hermes
       // Prepare an ordered list of elements according to an error.
       if(solutions_for_adapt)
       {
+        regular_queue_sorted = -1;
         fill_regular_queue(meshes);
         have_errors = true;
       }
@@ -1199,7 +1562,6 @@ namespace Hermes
       }
 
       delete [] meshes;
-      delete [] tr;
       delete [] norms;
       delete [] errors_components;
 
@@ -1220,6 +1582,7 @@ namespace Hermes
       Hermes::vector<double>* component_errors, bool solutions_for_adapt,
       unsigned int error_flags)
     {
+      Hermes::ProfilerRegion profiler_region("Adapt::calc_err_internal");
       Hermes::vector<Solution<Scalar>*> slns;
       slns.push_back(sln);
       Hermes::vector<Solution<Scalar>*> rslns;
@@ -1260,8 +1623,29 @@ namespace Hermes
           regular_queue.push_back(ElementReference(e->id, i));
         }
       }
-      //sort
-      std::sort(regular_queue.begin(), regular_queue.end(), CompareElements(errors));
+      //nothing is sorted yet, adapt() sorts only as far as it gets, see sort_regular_queue()
+      regular_queue_sorted = 0;
+    }
+
+    template<typename Scalar>
+    void Adapt<Scalar>::sort_regular_queue(int count)
+    {
+      //the queue was ordered by an overridden fill_regular_queue() or is already sorted far enough
+      if(regular_queue_sorted < 0 || count <= regular_queue_sorted)
+        return;
+
+      //sort in growing chunks: select the chunk with the largest errors from the rest, then sort just the chunk
+      const int size = (int)regular_queue.size();
+      int new_sorted = std::max(count, std::max(2 * regular_queue_sorted, std::max(H2D_MIN_SORTED_QUEUE_CHUNK, size / 64)));
+      if(new_sorted > size)
+        new_sorted = size;
+
+      typename Hermes::vector<ElementReference>::iterator first = regular_queue.begin() + regular_queue_sorted;
+      typename Hermes::vector<ElementReference>::iterator last = regular_queue.begin() + new_sorted;
+      if(new_sorted < size)
+        std::nth_element(first, last, regular_queue.end(), CompareElements(errors));
+      std::sort(first, last, CompareElements(errors));
+      regular_queue_sorted = new_sorted;
     }
 
     template HERMES_API class Adapt<double>;
@@ -0,0 +1,247 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "affine_decomposition.h"
+#ifdef WITH_UMFPACK
+#include "api2d.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// Below this number of the entries, the combination runs sequentially.
+    static const int AFFINE_PARALLEL_MIN_NNZ = 100000;
+
+    template<typename Scalar>
+    AffineDecomposition<Scalar>::AffineDecomposition(DiscreteProblem<Scalar>* dp) : dp(dp), num_terms(0), size(0), nnz(0),
+      Ap(NULL), Ai(NULL), pattern(NULL), matrix_values(NULL), rhs_values(NULL), wf(NULL)
+    {
+      if(dp == NULL)
+        throw Exceptions::NullException(1);
+    }
+
+    template<typename Scalar>
+    AffineDecomposition<Scalar>::~AffineDecomposition()
+    {
+      free();
+    }
+
+    template<typename Scalar>
+    void AffineDecomposition<Scalar>::free()
+    {
+      if(matrix_values != NULL)
+      {
+        for(int q = 0; q <= num_terms; q++)
+        {
+          delete [] matrix_values[q];
+          delete [] rhs_values[q];
+        }
+        delete [] matrix_values;
+        delete [] rhs_values;
+        matrix_values = rhs_values = NULL;
+      }
+      if(pattern != NULL)
+        pattern->release();
+      pattern = NULL;
+      Ap = Ai = NULL;
+      size = nnz = 0;
+      num_terms = 0;
+      space_seqs.clear();
+      wf = NULL;
+    }
+
+    template<typename Scalar>
+    bool AffineDecomposition<Scalar>::is_up_to_date() const
+    {
+      if(matrix_values == NULL || dp->get_weak_formulation() != this->wf)
+        return false;
+      Hermes::vector<const Space<Scalar>*> spaces = dp->get_spaces();
+      if(spaces.size() != space_seqs.size())
+        return false;
+      for(unsigned int i = 0; i < spaces.size(); i++)
+        if(spaces[i]->get_seq() != space_seqs[i])
+          return false;
+      return true;
+    }
+
+    template<typename Scalar>
+    void AffineDecomposition<Scalar>::assemble()
+    {
+      if(is_up_to_date())
+        return;
+      free();
+
+      const WeakForm<Scalar>* current_wf = dp->get_weak_formulation();
+      if(current_wf == NULL)
+        throw Exceptions::NullException(0);
+      int current_num_terms = current_wf->get_num_affine_terms();
+
+      CSCMatrix<Scalar> matrix;
+      UMFPackVector<Scalar> rhs;
+      int previous_term = dp->get_affine_term();
+      try
+      {
+        // The matrix is new for the problem, its structure has to be created.
+        dp->have_matrix = false;
+        for(int q = H2D_AFFINE_CONSTANT_TERM; q < current_num_terms; q++)
+        {
+          dp->set_affine_term(q);
+          dp->assemble(&matrix, &rhs);
+
+          // All the terms are assembled on the pattern of the problem, it does not depend on the term.
+          if(q == H2D_AFFINE_CONSTANT_TERM)
+          {
+            size = matrix.get_matrix_size();
+            nnz = matrix.get_nnz();
+            pattern = matrix.get_sparsity_pattern();
+            if(pattern != NULL)
+              pattern->add_reference();
+            else
+            {
+              // DG problems, the matrix has got its own structure.
+              int* col_start = new int[size + 1];
+              memcpy(col_start, matrix.get_Ap(), (size + 1) * sizeof(int));
+              int* rows = new int[std::max((int)nnz, 1)];
+              memcpy(rows, matrix.get_Ai(), nnz * sizeof(int));
+              pattern = new SparsityPattern(size, col_start, rows, matrix.is_symmetric_storage());
+            }
+            Ap = const_cast<int*>(pattern->get_col_start());
+            Ai = const_cast<int*>(pattern->get_rows());
+            num_terms = current_num_terms;
+            matrix_values = new Scalar*[num_terms + 1];
+            rhs_values = new Scalar*[num_terms + 1];
+            memset(matrix_values, 0, (num_terms + 1) * sizeof(Scalar*));
+            memset(rhs_values, 0, (num_terms + 1) * sizeof(Scalar*));
+          }
+          matrix_values[q + 1] = new Scalar[nnz];
+          memcpy(matrix_values[q + 1], matrix.get_Ax(), nnz * sizeof(Scalar));
+          rhs_values[q + 1] = new Scalar[size];
+          rhs.extract(rhs_values[q + 1]);
+        }
+      }
+      catch(...)
+      {
+        dp->set_affine_term(previous_term);
+        dp->have_matrix = false;
+        free();
+        throw;
+      }
+      dp->set_affine_term(previous_term);
+      // The matrix is local, the next assembling of the problem creates the structure of its own matrix.
+      dp->have_matrix = false;
+
+      Hermes::vector<const Space<Scalar>*> spaces = dp->get_spaces();
+      for(unsigned int i = 0; i < spaces.size(); i++)
+        space_seqs.push_back(spaces[i]->get_seq());
+      this->wf = current_wf;
+
+      this->info("AffineDecomposition: %d parametric terms assembled, %u DOFs, %u nonzeros.", num_terms, size, nnz);
+    }
+
+    template<typename Scalar>
+    int AffineDecomposition<Scalar>::get_num_terms() const
+    {
+      return num_terms;
+    }
+
+    template<typename Scalar>
+    void AffineDecomposition<Scalar>::combine(const Hermes::vector<Scalar>& theta, CSCMatrix<Scalar>* matrix, Vector<Scalar>* rhs) const
+    {
+      if(matrix_values == NULL)
+        throw Exceptions::Exception("AffineDecomposition::combine(): assemble() has to be called first.");
+      if(theta.size() != (unsigned int)num_terms)
+        throw Exceptions::LengthException(1, theta.size(), num_terms);
+      if(matrix == NULL)
+        throw Exceptions::NullException(2);
+
+      if(matrix->get_sparsity_pattern() != pattern)
+        matrix->alloc_with_pattern(pattern);
+
+      Scalar* Ax = matrix->get_Ax();
+      Scalar** values = matrix_values;
+      int num_terms_used = num_terms;
+      int nnz_used = nnz;
+      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(nnz_used > AFFINE_PARALLEL_MIN_NNZ)
+      for(int k = 0; k < nnz_used; k++)
+      {
+        Scalar value = values[0][k];
+        for(int q = 0; q < num_terms_used; q++)
+          value += theta[q] * values[q + 1][k];
+        Ax[k] = value;
+      }
+
+      if(rhs != NULL)
+      {
+        if(rhs->length() != size)
+          rhs->alloc(size);
+        Scalar* b = new Scalar[size];
+        for(unsigned int i = 0; i < size; i++)
+        {
+          b[i] = rhs_values[0][i];
+          for(int q = 0; q < num_terms; q++)
+            b[i] += theta[q] * rhs_values[q + 1][i];
+        }
+        rhs->zero();
+        rhs->add_vector(b);
+        delete [] b;
+      }
+    }
+
+    template<typename Scalar>
+    const Scalar* AffineDecomposition<Scalar>::get_matrix_values(int q) const
+    {
+      if(q < H2D_AFFINE_CONSTANT_TERM || q >= num_terms || matrix_values == NULL)
+        throw Exceptions::ValueException("q", q, H2D_AFFINE_CONSTANT_TERM, num_terms - 1);
+      return matrix_values[q + 1];
+    }
+
+    template<typename Scalar>
+    const Scalar* AffineDecomposition<Scalar>::get_rhs_values(int q) const
+    {
+      if(q < H2D_AFFINE_CONSTANT_TERM || q >= num_terms || rhs_values == NULL)
+        throw Exceptions::ValueException("q", q, H2D_AFFINE_CONSTANT_TERM, num_terms - 1);
+      return rhs_values[q + 1];
+    }
+
+    template<typename Scalar>
+    const int* AffineDecomposition<Scalar>::get_Ap() const
+    {
+      return Ap;
+    }
+
+    template<typename Scalar>
+    const int* AffineDecomposition<Scalar>::get_Ai() const
+    {
+      return Ai;
+    }
+
+    template<typename Scalar>
+    unsigned int AffineDecomposition<Scalar>::get_size() const
+    {
+      return size;
+    }
+
+    template<typename Scalar>
+    unsigned int AffineDecomposition<Scalar>::get_nnz() const
+    {
+      return nnz;
+    }
+
+    template class HERMES_API AffineDecomposition<double>;
+    template class HERMES_API AffineDecomposition<std::complex<double> >;
+  }
+}
+#endif
@@ -22,6 +22,8 @@
 #include "common.h"
 #include "exceptions.h"
 #include "api2d.h"
+#include "cache_statistics.h"
+#include "quadrature/quad_all.h"
 #include <xercesc/util/PlatformUtils.hpp>
 
 using namespace xercesc;
@@ -49,8 +51,14 @@ namespace Hermes
       XMLPlatformUtils::Initialize();   
 
       this->integral_parameters.insert(std::pair<Hermes2DApiParam, Parameter<int>*> (Hermes::Hermes2D::numThreads,new Parameter<int>(NUM_THREADS)));
+      this->integral_parameters.insert(std::pair<Hermes2DApiParam, Parameter<int>*> (Hermes::Hermes2D::cacheMemoryBudget,new Parameter<int>(0)));
+      this->integral_parameters.insert(std::pair<Hermes2DApiParam, Parameter<int>*> (Hermes::Hermes2D::meshReordering,new Parameter<int>(0)));
+      this->integral_parameters.insert(std::pair<Hermes2DApiParam, Parameter<int>*> (Hermes::Hermes2D::solutionElementCacheSize,new Parameter<int>(H2D_SOLUTION_ELEMENT_CACHE_SIZE)));
+      this->integral_parameters.insert(std::pair<Hermes2DApiParam, Parameter<int>*> (Hermes::Hermes2D::cacheStatistics,new Parameter<int>(0)));
+      this->integral_parameters.insert(std::pair<Hermes2DApiParam, Parameter<int>*> (Hermes::Hermes2D::precalculatedTablesCache,new Parameter<int>(0)));
       this->text_parameters.insert(std::pair<Hermes2DApiParam, Parameter<std::string>*> (Hermes::Hermes2D::xmlSchemasDirPath,new Parameter<std::string>(*(new std::string(H2D_XML_SCHEMAS_DIRECTORY)))));
       std::stringstream ss;
+      this->text_parameters.insert(std::pair<Hermes2DApiParam, Parameter<std::string>*> (Hermes::Hermes2D::triangleQuadratureRules,new Parameter<std::string>(std::string())));
       ss << H2D_PRECALCULATED_FORMS_DIRECTORY;
       if(ss.str().at(ss.str().length() - 1) == '\\' || ss.str().at(ss.str().length() - 1) == '/')
         this->text_parameters.insert(std::pair<Hermes2DApiParam, Parameter<std::string>*> (Hermes::Hermes2D::precalculatedFormsDirPath,new Parameter<std::string>(*(new std::string(H2D_PRECALCULATED_FORMS_DIRECTORY)))));
@@ -88,6 +96,8 @@ namespace Hermes
         throw Hermes::Exceptions::Exception("Wrong Hermes::Api parameter name:%i", param);
       this->integral_parameters.find(param)->second->user_set = true;
       this->integral_parameters.find(param)->second->user_val = value;
+      if(param == Hermes::Hermes2D::cacheStatistics)
+        CacheStatistics::set_mode(value);
     }
 
     std::string Api2D::get_text_param_value(Hermes2DApiParam param)
@@ -106,6 +116,12 @@ namespace Hermes
         throw Hermes::Exceptions::Exception("Wrong Hermes::Api parameter name:%i", param);
       this->text_parameters.find(param)->second->user_set = true;
       this->text_parameters.find(param)->second->user_val = value;
+      if(param == Hermes::Hermes2D::triangleQuadratureRules)
+      {
+        g_quad_2d_std.reset_triangle_rules();
+        if(!value.empty())
+          g_quad_2d_std.load_triangle_rules(value.c_str());
+      }
     }
 
     Hermes::Hermes2D::Api2D HERMES_API Hermes2DApi;
@@ -0,0 +1,165 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "cache_statistics.h"
+#include <cstdio>
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    bool CacheStatistics::enabled = false;
+    bool CacheStatistics::reset_per_assembly = false;
+
+    CacheCounters::CacheCounters() : lookups(0), hits(0), misses(0), inserts(0), bytes(0)
+    {
+    }
+
+    /// The counters of one thread, padded so that the threads do not share cache lines.
+    struct CacheStatisticsThreadData
+    {
+      CacheCounters counters[H2D_NUM_CACHES];
+      char padding[64];
+    };
+
+    static CacheStatisticsThreadData cache_statistics_threads[H2D_CACHE_STATISTICS_MAX_THREADS];
+
+    /// The slots are given to the threads in the order of their first count. The threads are told apart by a thread-specific key,
+    /// omp_get_thread_num() is the same for the threads of the teams running concurrently (several DiscreteProblems assembled
+    /// in the threads of one process).
+    static int cache_statistics_num_threads = 0;
+    static pthread_mutex_t cache_statistics_threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+    static pthread_key_t cache_statistics_thread_key;
+    static pthread_once_t cache_statistics_thread_key_once = PTHREAD_ONCE_INIT;
+
+    static void create_cache_statistics_thread_key()
+    {
+      pthread_key_create(&cache_statistics_thread_key, NULL);
+    }
+
+    static CacheCounters* get_cache_counters(CacheType cache)
+    {
+      pthread_once(&cache_statistics_thread_key_once, create_cache_statistics_thread_key);
+      CacheStatisticsThreadData* data = (CacheStatisticsThreadData*)pthread_getspecific(cache_statistics_thread_key);
+      if(data == NULL)
+      {
+        pthread_mutex_lock(&cache_statistics_threads_mutex);
+        if(cache_statistics_num_threads < H2D_CACHE_STATISTICS_MAX_THREADS)
+          data = &cache_statistics_threads[cache_statistics_num_threads++];
+        pthread_mutex_unlock(&cache_statistics_threads_mutex);
+        if(data == NULL)
+          return NULL;
+        pthread_setspecific(cache_statistics_thread_key, data);
+      }
+      return &data->counters[cache];
+    }
+
+    void CacheStatistics::set_mode(int mode)
+    {
+      enabled = (mode != 0);
+      reset_per_assembly = (mode == 2);
+    }
+
+    void CacheStatistics::count_lookup(CacheType cache, bool hit)
+    {
+      CacheCounters* counters = get_cache_counters(cache);
+      if(counters == NULL)
+        return;
+      counters->lookups++;
+      if(hit)
+        counters->hits++;
+      else
+        counters->misses++;
+    }
+
+    void CacheStatistics::insert(CacheType cache, long long bytes)
+    {
+      CacheCounters* counters = get_cache_counters(cache);
+      if(counters == NULL)
+        return;
+      counters->inserts++;
+      counters->bytes += bytes;
+    }
+
+    void CacheStatistics::add_bytes(CacheType cache, long long bytes)
+    {
+      CacheCounters* counters = get_cache_counters(cache);
+      if(counters != NULL)
+        counters->bytes += bytes;
+    }
+
+    CacheCounters CacheStatistics::get(CacheType cache)
+    {
+      CacheCounters sum;
+      for(int i = 0; i < H2D_CACHE_STATISTICS_MAX_THREADS; i++)
+      {
+        const CacheCounters& counters = cache_statistics_threads[i].counters[cache];
+        sum.lookups += counters.lookups;
+        sum.hits += counters.hits;
+        sum.misses += counters.misses;
+        sum.inserts += counters.inserts;
+        sum.bytes += counters.bytes;
+      }
+      return sum;
+    }
+
+    void CacheStatistics::reset()
+    {
+      for(int i = 0; i < H2D_CACHE_STATISTICS_MAX_THREADS; i++)
+        for(int cache = 0; cache < H2D_NUM_CACHES; cache++)
+        {
+          CacheCounters& counters = cache_statistics_threads[i].counters[cache];
+          counters.lookups = counters.hits = counters.misses = counters.inserts = 0;
+        }
+    }
+
+    void CacheStatistics::begin_assembly()
+    {
+      if(reset_per_assembly)
+        reset();
+    }
+
+    const char* CacheStatistics::get_name(CacheType cache)
+    {
+      switch(cache)
+      {
+      case H2D_CACHE_ASSEMBLY:
+        return "DiscreteProblem";
+      case H2D_CACHE_PRECALC:
+        return "PrecalcShapeset";
+      case H2D_CACHE_SOLUTION:
+        return "Solution";
+      case H2D_CACHE_REFMAP:
+        return "RefMap";
+      default:
+        return "";
+      }
+    }
+
+    void CacheStatistics::report(std::ostream& out)
+    {
+      char line[256];
+      sprintf(line, "%-20s %12s %12s %12s %8s %12s %14s", "Cache", "Lookups", "Hits", "Misses", "Hit rate", "Inserts", "Bytes");
+      out << line << std::endl;
+      for(int cache = 0; cache < H2D_NUM_CACHES; cache++)
+      {
+        CacheCounters counters = get((CacheType)cache);
+        sprintf(line, "%-20s %12lu %12lu %12lu %7.2f%% %12lu %14lld", get_name((CacheType)cache), counters.lookups, counters.hits, counters.misses,
+          counters.lookups > 0 ? 100.0 * counters.hits / counters.lookups : 0.0, counters.inserts, counters.bytes);
+        out << line << std::endl;
+      }
+    }
+  }
+}
@@ -15,6 +15,7 @@
 
 #include "calculation_continuity.h"
 #include "mesh_reader_h2d_xml.h"
+#include "mesh_reader_h2d_binary.h"
 #include "space_h1.h"
 #include "space_hdiv.h"
 #include "space_hcurl.h"
@@ -25,6 +26,12 @@ namespace Hermes
 {
   namespace Hermes2D
   {
+    static bool file_exists(const std::string& filename)
+    {
+      std::ifstream file(filename.c_str());
+      return file.good();
+    }
+
     CalculationContinuityException::CalculationContinuityException() : Exception()
     {
     }
@@ -100,8 +107,11 @@ namespace Hermes
     }
 
     template<typename Scalar>
-    CalculationContinuity<Scalar>::CalculationContinuity(IdentificationMethod identification_method) : last_record(NULL), record_available(false), identification_method(identification_method), num(0)
+    CalculationContinuity<Scalar>::CalculationContinuity(IdentificationMethod identification_method) : delta_checkpointing(false), max_delta_chain_length(10), async_checkpointing(false), max_checkpoints_in_flight(2), checkpoint_thread_running(false), checkpoint_thread_exit(false), last_record(NULL), record_available(false), identification_method(identification_method), num(0)
     {
+      pthread_mutex_init(&checkpoint_mutex, NULL);
+      pthread_cond_init(&checkpoint_cond, NULL);
+
       double last_time;
       unsigned int last_number;
       std::stringstream ss;
@@ -166,56 +176,26 @@ namespace Hermes
     template<typename Scalar>
     void CalculationContinuity<Scalar>::add_record(double time, unsigned int number, Mesh* mesh, Space<Scalar>* space, Solution<Scalar>* sln, double time_step, double time_step_n_minus_one, double error)
     {
-      std::ofstream ofile("timeAndNumber.h2d", std::ios_base::app);
-      if(ofile)
-      {
-        ofile << ++this->num << ' ' << time << ' ' << number << std::endl;
-        ofile.close();
-      }
-      else
-        throw IOCalculationContinuityException(CalculationContinuityException::general, IOCalculationContinuityException::output, "timeAndNumber.h2d");
-
-      CalculationContinuity<Scalar>::Record* record = new CalculationContinuity<Scalar>::Record(time, number);
-      record->save_mesh(mesh);
+      Hermes::vector<Mesh*> meshes;
+      meshes.push_back(mesh);
+      Hermes::vector<Space<Scalar>*> spaces;
       if(space != NULL)
-        record->save_space(space);
+        spaces.push_back(space);
+      Hermes::vector<Solution<Scalar>*> slns;
       if(sln != NULL)
-        record->save_solution(sln);
-      if(time_step > 0.0)
-        record->save_time_step_length(time_step);
-      if(time_step_n_minus_one > 0.0)
-        record->save_time_step_length_n_minus_one(time_step_n_minus_one);
-      if(error > 0.0)
-        record->save_error(error);
+        slns.push_back(sln);
 
-      this->records.insert(std::pair<std::pair<double, unsigned int>, CalculationContinuity<Scalar>::Record*>(std::pair<double, unsigned int>(time, number), record));
-      this->last_record = record;
+      this->add_record(time, number, meshes, spaces, slns, time_step, time_step_n_minus_one, error);
     }
 
     template<typename Scalar>
     void CalculationContinuity<Scalar>::add_record(double time, unsigned int number, Hermes::vector<Mesh*> meshes, Hermes::vector<Space<Scalar>*> spaces, Hermes::vector<Solution<Scalar>*> slns, double time_step, double time_step_n_minus_one, double error)
     {
-      std::ofstream ofile("timeAndNumber.h2d", std::ios_base::app);
-      if(ofile)
-      {
-        ofile << ++this->num << ' ' << time << ' ' << number << std::endl;
-        ofile.close();
-      }
-      else
-        throw IOCalculationContinuityException(CalculationContinuityException::general, IOCalculationContinuityException::output, "timeAndNumber.h2d");
+      std::stringstream index_line;
+      index_line << ++this->num << ' ' << time << ' ' << number;
 
       CalculationContinuity<Scalar>::Record* record = new CalculationContinuity<Scalar>::Record(time, number);
-      record->save_meshes(meshes);
-      if(spaces != Hermes::vector<Space<Scalar>*>())
-        record->save_spaces(spaces);
-      if(slns != Hermes::vector<Solution<Scalar>*>())
-        record->save_solutions(slns);
-      if(time_step > 0.0)
-        record->save_time_step_length(time_step);
-      if(time_step_n_minus_one > 0.0)
-        record->save_time_step_length_n_minus_one(time_step_n_minus_one);
-      if(error > 0.0)
-        record->save_error(error);
+      this->store_record(record, "timeAndNumber.h2d", index_line.str(), meshes, spaces, slns, time_step, time_step_n_minus_one, error);
 
       this->records.insert(std::pair<std::pair<double, unsigned int>, CalculationContinuity<Scalar>::Record*>(std::pair<double, unsigned int>(time, number), record));
       this->last_record = record;
@@ -224,114 +204,474 @@ namespace Hermes
     template<typename Scalar>
     void CalculationContinuity<Scalar>::add_record(double time, Mesh* mesh, Space<Scalar>* space, Solution<Scalar>* sln, double time_step, double time_step_n_minus_one, double error)
     {
-      std::ofstream ofile("onlyTime.h2d", std::ios_base::app);
-      if(ofile)
-      {
-        ofile << ++this->num << ' ' << time << std::endl;
-        ofile.close();
-      }
-      else
-        throw IOCalculationContinuityException(CalculationContinuityException::general, IOCalculationContinuityException::output, "onlyTime.h2d");
+      Hermes::vector<Mesh*> meshes;
+      meshes.push_back(mesh);
+      Hermes::vector<Space<Scalar>*> spaces;
+      if(space != NULL)
+        spaces.push_back(space);
+      Hermes::vector<Solution<Scalar>*> slns;
+      if(sln != NULL)
+        slns.push_back(sln);
+
+      this->add_record(time, meshes, spaces, slns, time_step, time_step_n_minus_one, error);
+    }
+
+    template<typename Scalar>
+    void CalculationContinuity<Scalar>::add_record(double time, Hermes::vector<Mesh*> meshes, Hermes::vector<Space<Scalar>*> spaces, Hermes::vector<Solution<Scalar>*> slns, double time_step, double time_step_n_minus_one, double error)
+    {
+      std::stringstream index_line;
+      index_line << ++this->num << ' ' << time;
 
       CalculationContinuity<Scalar>::Record* record = new CalculationContinuity<Scalar>::Record(time);
-      record->save_mesh(mesh);
+      this->store_record(record, "onlyTime.h2d", index_line.str(), meshes, spaces, slns, time_step, time_step_n_minus_one, error);
+
+      this->time_records.insert(std::pair<double, CalculationContinuity<Scalar>::Record*>(time, record));
+      this->last_record = record;
+    }
+
+    template<typename Scalar>
+    void CalculationContinuity<Scalar>::add_record(unsigned int number, Mesh* mesh, Space<Scalar>* space, Solution<Scalar>* sln, double time_step, double time_step_n_minus_one, double error)
+    {
+      Hermes::vector<Mesh*> meshes;
+      meshes.push_back(mesh);
+      Hermes::vector<Space<Scalar>*> spaces;
       if(space != NULL)
-        record->save_space(space);
+        spaces.push_back(space);
+      Hermes::vector<Solution<Scalar>*> slns;
       if(sln != NULL)
-        record->save_solution(sln);
-      if(time_step > 0.0)
-        record->save_time_step_length(time_step);
-      if(time_step_n_minus_one > 0.0)
-        record->save_time_step_length_n_minus_one(time_step_n_minus_one);
-      if(error > 0.0)
-        record->save_error(error);
+        slns.push_back(sln);
 
-      this->time_records.insert(std::pair<double, CalculationContinuity<Scalar>::Record*>(time, record));
+      this->add_record(number, meshes, spaces, slns, time_step, time_step_n_minus_one, error);
+    }
+
+    template<typename Scalar>
+    void CalculationContinuity<Scalar>::add_record(unsigned int number, Hermes::vector<Mesh*> meshes, Hermes::vector<Space<Scalar>*> spaces, Hermes::vector<Solution<Scalar>*> slns, double time_step, double time_step_n_minus_one, double error)
+    {
+      std::stringstream index_line;
+      index_line << ++this->num << ' ' << number;
+
+      CalculationContinuity<Scalar>::Record* record = new CalculationContinuity<Scalar>::Record(number);
+      this->store_record(record, "onlyNumber.h2d", index_line.str(), meshes, spaces, slns, time_step, time_step_n_minus_one, error);
+
+      this->numbered_records.insert(std::pair<unsigned int, CalculationContinuity<Scalar>::Record*>(number, record));
       this->last_record = record;
     }
 
     template<typename Scalar>
-    void CalculationContinuity<Scalar>::add_record(double time, Hermes::vector<Mesh*> meshes, Hermes::vector<Space<Scalar>*> spaces, Hermes::vector<Solution<Scalar>*> slns, double time_step, double time_step_n_minus_one, double error)
+    CalculationContinuity<Scalar>::~CalculationContinuity()
     {
-      std::ofstream ofile("onlyTime.h2d", std::ios_base::app);
-      if(ofile)
+      if(this->checkpoint_thread_running)
       {
-        ofile << ++this->num << ' ' << time << std::endl;
-        ofile.close();
+        // The thread writes all the remaining snapshots before exiting.
+        pthread_mutex_lock(&this->checkpoint_mutex);
+        this->checkpoint_thread_exit = true;
+        pthread_cond_broadcast(&this->checkpoint_cond);
+        pthread_mutex_unlock(&this->checkpoint_mutex);
+        pthread_join(this->checkpoint_thread, NULL);
       }
-      else
-        throw IOCalculationContinuityException(CalculationContinuityException::general, IOCalculationContinuityException::output, "onlyTime.h2d");
-      CalculationContinuity<Scalar>::Record* record = new CalculationContinuity<Scalar>::Record(time);
-      record->save_meshes(meshes);
-      if(spaces != Hermes::vector<Space<Scalar>*>())
-        record->save_spaces(spaces);
-      if(slns != Hermes::vector<Solution<Scalar>*>())
-        record->save_solutions(slns);
+      pthread_mutex_destroy(&this->checkpoint_mutex);
+      pthread_cond_destroy(&this->checkpoint_cond);
+    }
+
+    template<typename Scalar>
+    void CalculationContinuity<Scalar>::set_async_checkpointing(bool enabled, int max_in_flight)
+    {
+      if(max_in_flight < 1)
+        throw Exceptions::ValueException("max_in_flight", max_in_flight, 1);
+      if(!enabled)
+        this->wait_for_checkpoints();
+
+      pthread_mutex_lock(&this->checkpoint_mutex);
+      this->async_checkpointing = enabled;
+      this->max_checkpoints_in_flight = max_in_flight;
+      pthread_mutex_unlock(&this->checkpoint_mutex);
+    }
+
+    template<typename Scalar>
+    void CalculationContinuity<Scalar>::wait_for_checkpoints()
+    {
+      pthread_mutex_lock(&this->checkpoint_mutex);
+      while(!this->checkpoint_queue.empty())
+        pthread_cond_wait(&this->checkpoint_cond, &this->checkpoint_mutex);
+      std::string failure = this->checkpoint_failure;
+      this->checkpoint_failure.clear();
+      pthread_mutex_unlock(&this->checkpoint_mutex);
+
+      if(!failure.empty())
+        throw CalculationContinuityException(CalculationContinuityException::general, failure.c_str());
+    }
+
+    template<typename Scalar>
+    void CalculationContinuity<Scalar>::store_record(Record* record, const char* index_file_name, std::string index_line, Hermes::vector<Mesh*> meshes, Hermes::vector<Space<Scalar>*> spaces, Hermes::vector<Solution<Scalar>*> slns, double time_step, double time_step_n_minus_one, double error)
+    {
+      if(!this->async_checkpointing)
+      {
+        std::ofstream ofile(index_file_name, std::ios_base::app);
+        if(ofile)
+        {
+          ofile << index_line << std::endl;
+          ofile.close();
+        }
+        else
+          throw IOCalculationContinuityException(CalculationContinuityException::general, IOCalculationContinuityException::output, index_file_name);
+
+      }
+
+      // With delta checkpointing, the meshes and spaces that can be stored as deltas to the previous
+      // record are written right away (the files are small), the rest is written in full below.
+      std::vector<bool> mesh_deltas(meshes.size(), false);
+      std::vector<bool> space_deltas(spaces.size(), false);
+      if(this->delta_checkpointing)
+      {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+          mesh_deltas[i] = this->store_mesh_delta(record, i, meshes[i]);
+        for(unsigned int i = 0; i < spaces.size(); i++)
+          space_deltas[i] = this->store_space_delta(record, i, spaces[i]);
+      }
+
+      if(!this->async_checkpointing)
+      {
+        if(!this->delta_checkpointing)
+        {
+          record->save_meshes(meshes);
+          if(spaces != Hermes::vector<Space<Scalar>*>())
+            record->save_spaces(spaces);
+        }
+        else
+        {
+          // Meshes are written in the binary format, so that they can be parents of delta files.
+          MeshReaderH2DBinary reader;
+          for(unsigned int i = 0; i < meshes.size(); i++)
+          {
+            if(mesh_deltas[i])
+              continue;
+            std::string filename = record->get_file_name(CalculationContinuity<Scalar>::mesh_file_name, i, true);
+            try
+            {
+              reader.save(filename.c_str(), meshes[i]);
+            }
+            catch(std::exception& e)
+            {
+              throw IOCalculationContinuityException(CalculationContinuityException::meshes, IOCalculationContinuityException::output, filename.c_str(), e.what());
+            }
+          }
+          for(unsigned int i = 0; i < spaces.size(); i++)
+          {
+            if(space_deltas[i])
+              continue;
+            std::string filename = record->get_file_name(CalculationContinuity<Scalar>::space_file_name, i);
+            if(!Space<Scalar>::save_bin(filename.c_str(), this->space_delta_states[i].type, this->space_delta_states[i].element_data, false))
+              throw IOCalculationContinuityException(CalculationContinuityException::spaces, IOCalculationContinuityException::output, filename.c_str());
+          }
+        }
+        if(slns != Hermes::vector<Solution<Scalar>*>())
+          record->save_solutions(slns);
+      }
+
+      // These are tiny, no need for snapshots.
       if(time_step > 0.0)
         record->save_time_step_length(time_step);
       if(time_step_n_minus_one > 0.0)
         record->save_time_step_length_n_minus_one(time_step_n_minus_one);
       if(error > 0.0)
         record->save_error(error);
-      this->time_records.insert(std::pair<double, CalculationContinuity<Scalar>::Record*>(time, record));
-      this->last_record = record;
+
+      if(!this->async_checkpointing)
+        return;
+
+      CheckpointJob* job = new CheckpointJob(record, index_file_name, index_line);
+      for(unsigned int i = 0; i < meshes.size(); i++)
+      {
+        if(mesh_deltas[i])
+        {
+          job->meshes.push_back(NULL);
+          continue;
+        }
+        job->meshes.push_back(new Mesh);
+        job->meshes.back()->copy(meshes[i]);
+      }
+      for(unsigned int i = 0; i < spaces.size(); i++)
+      {
+        job->spaces.push_back(typename Space<Scalar>::ElementDataSnapshot());
+        if(space_deltas[i])
+          job->space_types.push_back(HERMES_INVALID_SPACE);
+        else if(this->delta_checkpointing)
+        {
+          job->space_types.push_back(this->space_delta_states[i].type);
+          job->spaces.back() = this->space_delta_states[i].element_data;
+        }
+        else
+        {
+          job->space_types.push_back(spaces[i]->get_type());
+          spaces[i]->get_element_data_snapshot(job->spaces.back());
+        }
+      }
+      for(unsigned int i = 0; i < slns.size(); i++)
+      {
+        // Exact solutions have no coefficients to copy, they are saved right away.
+        if(slns[i]->get_type() != HERMES_SLN)
+        {
+          try
+          {
+            slns[i]->save(record->get_file_name(CalculationContinuity<Scalar>::solution_file_name, i).c_str());
+          }
+          catch(Hermes::Exceptions::SolutionSaveFailureException& e)
+          {
+            delete job;
+            throw IOCalculationContinuityException(CalculationContinuityException::solutions, IOCalculationContinuityException::output, record->get_file_name(CalculationContinuity<Scalar>::solution_file_name, i).c_str(), e.what());
+          }
+          job->solutions.push_back(NULL);
+        }
+        else
+        {
+          job->solutions.push_back(new Solution<Scalar>);
+          job->solutions.back()->copy(slns[i]);
+        }
+      }
+
+      if(!this->checkpoint_thread_running)
+      {
+        this->checkpoint_thread_exit = false;
+        if(pthread_create(&this->checkpoint_thread, NULL, checkpoint_thread_func, this) != 0)
+        {
+          delete job;
+          throw CalculationContinuityException(CalculationContinuityException::general, "Could not start the checkpoint thread.");
+        }
+        this->checkpoint_thread_running = true;
+      }
+
+      pthread_mutex_lock(&this->checkpoint_mutex);
+      while((int)this->checkpoint_queue.size() >= this->max_checkpoints_in_flight)
+        pthread_cond_wait(&this->checkpoint_cond, &this->checkpoint_mutex);
+      this->checkpoint_queue.push(job);
+      pthread_cond_broadcast(&this->checkpoint_cond);
+      std::string failure = this->checkpoint_failure;
+      this->checkpoint_failure.clear();
+      pthread_mutex_unlock(&this->checkpoint_mutex);
+
+      if(!failure.empty())
+        throw CalculationContinuityException(CalculationContinuityException::general, failure.c_str());
     }
 
     template<typename Scalar>
-    void CalculationContinuity<Scalar>::add_record(unsigned int number, Mesh* mesh, Space<Scalar>* space, Solution<Scalar>* sln, double time_step, double time_step_n_minus_one, double error)
+    void CalculationContinuity<Scalar>::set_delta_checkpointing(bool enabled, int max_chain_length)
     {
-      std::ofstream ofile("onlyNumber.h2d", std::ios_base::app);
-      if(ofile)
+      if(max_chain_length < 1)
+        throw Exceptions::ValueException("max_chain_length", max_chain_length, 1);
+      this->delta_checkpointing = enabled;
+      this->max_delta_chain_length = max_chain_length;
+
+      // The next record starts new chains.
+      this->mesh_delta_states.clear();
+      this->space_delta_states.clear();
+    }
+
+    /// Identifies the base mesh (the geometry the refinements of Mesh::get_refinements() start from).
+    static unsigned int mesh_base_key(Mesh* mesh)
+    {
+      // FNV-1a.
+      unsigned int key = 2166136261u;
+      Element* e;
+      for_all_base_elements(e, mesh)
       {
-        ofile << ++this->num << ' ' << number << std::endl;
-        ofile.close();
+        int data[2] = { e->id, e->marker };
+        const unsigned char* bytes = (const unsigned char*)data;
+        for(unsigned int byte_i = 0; byte_i < sizeof(data); byte_i++)
+          key = (key ^ bytes[byte_i]) * 16777619u;
+        for(unsigned int i = 0; i < e->get_nvert(); i++)
+        {
+          double vertex[2] = { e->vn[i]->x, e->vn[i]->y };
+          bytes = (const unsigned char*)vertex;
+          for(unsigned int byte_i = 0; byte_i < sizeof(vertex); byte_i++)
+            key = (key ^ bytes[byte_i]) * 16777619u;
+        }
+      }
+      return key;
+    }
+
+    template<typename Scalar>
+    bool CalculationContinuity<Scalar>::store_mesh_delta(Record* record, unsigned int i, Mesh* mesh)
+    {
+      if(this->mesh_delta_states.size() <= i)
+        this->mesh_delta_states.resize(i + 1);
+      MeshDeltaState& state = this->mesh_delta_states[i];
+
+      std::string filename = record->get_file_name(CalculationContinuity<Scalar>::mesh_file_name, i, true);
+      unsigned int base_key = mesh_base_key(mesh);
+
+      bool delta = !state.file_name.empty() && state.base_key == base_key && state.chain_length < this->max_delta_chain_length;
+      if(delta)
+      {
+        try
+        {
+          MeshReaderH2DBinary reader;
+          reader.save_delta(filename.c_str(), mesh, state.file_name.c_str(), state.refinements);
+        }
+        catch(std::exception& e)
+        {
+          throw IOCalculationContinuityException(CalculationContinuityException::meshes, IOCalculationContinuityException::output, filename.c_str(), e.what());
+        }
+        state.chain_length++;
       }
       else
-        throw IOCalculationContinuityException(CalculationContinuityException::general, IOCalculationContinuityException::output, "onlyNumber.h2d");
+        state.chain_length = 0;
 
-      CalculationContinuity<Scalar>::Record* record = new CalculationContinuity<Scalar>::Record(number);
-      record->save_mesh(mesh);
-      if(space != NULL)
-        record->save_space(space);
-      if(sln != NULL)
-        record->save_solution(sln);
-      if(time_step > 0.0)
-        record->save_time_step_length(time_step);
-      if(time_step_n_minus_one > 0.0)
-        record->save_time_step_length_n_minus_one(time_step_n_minus_one);
-      if(error > 0.0)
-        record->save_error(error);
+      state.file_name = filename;
+      state.base_key = base_key;
+      state.refinements = mesh->get_refinements();
+      return delta;
+    }
 
-      this->numbered_records.insert(std::pair<unsigned int, CalculationContinuity<Scalar>::Record*>(number, record));
-      this->last_record = record;
+    template<typename Scalar>
+    bool CalculationContinuity<Scalar>::store_space_delta(Record* record, unsigned int i, Space<Scalar>* space)
+    {
+      if(this->space_delta_states.size() <= i)
+        this->space_delta_states.resize(i + 1);
+      SpaceDeltaState& state = this->space_delta_states[i];
+
+      std::string filename = record->get_file_name(CalculationContinuity<Scalar>::space_file_name, i);
+      typename Space<Scalar>::ElementDataSnapshot element_data;
+      space->get_element_data_snapshot(element_data);
+
+      bool delta = !state.file_name.empty() && state.type == space->get_type() && state.chain_length < this->max_delta_chain_length;
+      if(delta)
+      {
+        if(!Space<Scalar>::save_delta(filename.c_str(), space->get_type(), element_data, state.file_name.c_str(), state.element_data))
+          throw IOCalculationContinuityException(CalculationContinuityException::spaces, IOCalculationContinuityException::output, filename.c_str());
+        state.chain_length++;
+      }
+      else
+        state.chain_length = 0;
+
+      state.file_name = filename;
+      state.type = space->get_type();
+      state.element_data.swap(element_data);
+      return delta;
     }
 
     template<typename Scalar>
-    void CalculationContinuity<Scalar>::add_record(unsigned int number, Hermes::vector<Mesh*> meshes, Hermes::vector<Space<Scalar>*> spaces, Hermes::vector<Solution<Scalar>*> slns, double time_step, double time_step_n_minus_one, double error)
+    void* CalculationContinuity<Scalar>::checkpoint_thread_func(void* data)
     {
-      std::ofstream ofile("onlyNumber.h2d", std::ios_base::app);
+      CalculationContinuity<Scalar>* continuity = (CalculationContinuity<Scalar>*)data;
+
+      pthread_mutex_lock(&continuity->checkpoint_mutex);
+      while(true)
+      {
+        while(continuity->checkpoint_queue.empty() && !continuity->checkpoint_thread_exit)
+          pthread_cond_wait(&continuity->checkpoint_cond, &continuity->checkpoint_mutex);
+        if(continuity->checkpoint_queue.empty())
+          break;
+
+        // The job stays in the queue while it is written, so that it counts as in flight.
+        CheckpointJob* job = continuity->checkpoint_queue.front();
+        pthread_mutex_unlock(&continuity->checkpoint_mutex);
+
+        std::string failure;
+        try
+        {
+          job->write();
+        }
+        catch(std::exception& e)
+        {
+          failure = e.what();
+        }
+        delete job;
+
+        pthread_mutex_lock(&continuity->checkpoint_mutex);
+        continuity->checkpoint_queue.pop();
+        if(!failure.empty() && continuity->checkpoint_failure.empty())
+          continuity->checkpoint_failure = failure;
+        pthread_cond_broadcast(&continuity->checkpoint_cond);
+      }
+      pthread_mutex_unlock(&continuity->checkpoint_mutex);
+
+      return NULL;
+    }
+
+    template<typename Scalar>
+    CalculationContinuity<Scalar>::CheckpointJob::CheckpointJob(Record* record, std::string index_file_name, std::string index_line) : record(record), index_file_name(index_file_name), index_line(index_line)
+    {
+    }
+
+    template<typename Scalar>
+    CalculationContinuity<Scalar>::CheckpointJob::~CheckpointJob()
+    {
+      for(unsigned int i = 0; i < this->meshes.size(); i++)
+        if(this->meshes[i] != NULL)
+          delete this->meshes[i];
+      for(unsigned int i = 0; i < this->solutions.size(); i++)
+        if(this->solutions[i] != NULL)
+          delete this->solutions[i];
+    }
+
+    template<typename Scalar>
+    void CalculationContinuity<Scalar>::CheckpointJob::write()
+    {
+      MeshReaderH2DBinary reader;
+      for(unsigned int i = 0; i < this->meshes.size(); i++)
+      {
+        if(this->meshes[i] == NULL)
+          continue;
+        std::string filename = this->record->get_file_name(CalculationContinuity<Scalar>::mesh_file_name, i, true);
+        try
+        {
+          reader.save(filename.c_str(), this->meshes[i]);
+        }
+        catch(std::exception& e)
+        {
+          throw IOCalculationContinuityException(CalculationContinuityException::meshes, IOCalculationContinuityException::output, filename.c_str(), e.what());
+        }
+      }
+
+      for(unsigned int i = 0; i < this->spaces.size(); i++)
+      {
+        if(this->space_types[i] == HERMES_INVALID_SPACE)
+          continue;
+        std::string filename = this->record->get_file_name(CalculationContinuity<Scalar>::space_file_name, i);
+        try
+        {
+          if(!Space<Scalar>::save_bin(filename.c_str(), this->space_types[i], this->spaces[i], false))
+            throw IOCalculationContinuityException(CalculationContinuityException::spaces, IOCalculationContinuityException::output, filename.c_str());
+        }
+        catch(std::exception& e)
+        {
+          throw IOCalculationContinuityException(CalculationContinuityException::spaces, IOCalculationContinuityException::output, filename.c_str(), e.what());
+        }
+      }
+
+      for(unsigned int i = 0; i < this->solutions.size(); i++)
+      {
+        if(this->solutions[i] == NULL)
+          continue;
+        std::string filename = this->record->get_file_name(CalculationContinuity<Scalar>::solution_file_name, i, true);
+        try
+        {
+          this->solutions[i]->save_bin(filename.c_str());
+        }
+        catch(std::exception& e)
+        {
+          throw IOCalculationContinuityException(CalculationContinuityException::solutions, IOCalculationContinuityException::output, filename.c_str(), e.what());
+        }
+      }
+
+      std::ofstream ofile(this->index_file_name.c_str(), std::ios_base::app);
       if(ofile)
       {
-        ofile << ++this->num << ' ' << number << std::endl;
+        ofile << this->index_line << std::endl;
         ofile.close();
       }
       else
-        throw IOCalculationContinuityException(CalculationContinuityException::general, IOCalculationContinuityException::output, "onlyNumber.h2d");
+        throw IOCalculationContinuityException(CalculationContinuityException::general, IOCalculationContinuityException::output, this->index_file_name.c_str());
+    }
 
-      CalculationContinuity<Scalar>::Record* record = new CalculationContinuity<Scalar>::Record(number);
-      record->save_meshes(meshes);
-      if(spaces != Hermes::vector<Space<Scalar>*>())
-        record->save_spaces(spaces);
-      if(slns != Hermes::vector<Solution<Scalar>*>())
-        record->save_solutions(slns);
-      if(time_step > 0.0)
-        record->save_time_step_length(time_step);
-      if(time_step_n_minus_one > 0.0)
-        record->save_time_step_length_n_minus_one(time_step_n_minus_one);
-      if(error > 0.0)
-        record->save_error(error);
-      this->numbered_records.insert(std::pair<unsigned int, CalculationContinuity<Scalar>::Record*>(number, record));
-      this->last_record = record;
+    template<typename Scalar>
+    std::string CalculationContinuity<Scalar>::Record::get_file_name(const std::string& prefix, unsigned int i, bool binary) const
+    {
+      std::stringstream filename;
+      filename << prefix << i << '_' << (std::string)"t = " << this->time << (std::string)"n = " << this->number << (std::string)".h2d";
+      if(binary)
+        filename << 'b';
+      return filename.str();
     }
 
     template<typename Scalar>
@@ -531,7 +871,15 @@ namespace Hermes
         filename << CalculationContinuity<Scalar>::mesh_file_name << i << '_' << (std::string)"t = " << this->time << (std::string)"n = " << this->number << (std::string)".h2d";
         try
         {
-          reader.load(filename.str().c_str(), meshes[i]);
+          // Asynchronous checkpoints are written in the binary format.
+          std::string binary_filename = this->get_file_name(CalculationContinuity<Scalar>::mesh_file_name, i, true);
+          if(file_exists(binary_filename))
+          {
+            MeshReaderH2DBinary binary_reader;
+            binary_reader.load(binary_filename.c_str(), meshes[i]);
+          }
+          else
+            reader.load(filename.str().c_str(), meshes[i]);
         }
         catch(Hermes::Exceptions::MeshLoadFailureException& e)
         {
@@ -548,7 +896,14 @@ namespace Hermes
 
       try
       {
-        reader.load(filename.str().c_str(), mesh);
+        std::string binary_filename = this->get_file_name(CalculationContinuity<Scalar>::mesh_file_name, 0, true);
+        if(file_exists(binary_filename))
+        {
+          MeshReaderH2DBinary binary_reader;
+          binary_reader.load(binary_filename.c_str(), mesh);
+        }
+        else
+          reader.load(filename.str().c_str(), mesh);
       }
       catch(Hermes::Exceptions::MeshLoadFailureException& e)
       {
@@ -649,7 +1004,11 @@ namespace Hermes
         filename << CalculationContinuity<Scalar>::solution_file_name << i << '_' << (std::string)"t = " << this->time << (std::string)"n = " << this->number << (std::string)".h2d";
         try
         {
-          solutions[i]->load(filename.str().c_str(), spaces[i]);
+          std::string binary_filename = this->get_file_name(CalculationContinuity<Scalar>::solution_file_name, i, true);
+          if(file_exists(binary_filename))
+            solutions[i]->load_bin(binary_filename.c_str(), spaces[i]);
+          else
+            solutions[i]->load(filename.str().c_str(), spaces[i]);
           solutions[i]->space_type = spaces[i]->get_type();
         }
         catch(Hermes::Exceptions::SolutionLoadFailureException& e)
@@ -669,7 +1028,11 @@ namespace Hermes
       filename << CalculationContinuity<Scalar>::solution_file_name << 0 << '_' << (std::string)"t = " << this->time << (std::string)"n = " << this->number << (std::string)".h2d";
       try
       {
-        solution->load(filename.str().c_str(), space);
+        std::string binary_filename = this->get_file_name(CalculationContinuity<Scalar>::solution_file_name, 0, true);
+        if(file_exists(binary_filename))
+          solution->load_bin(binary_filename.c_str(), space);
+        else
+          solution->load(filename.str().c_str(), space);
         solution->space_type = space->get_type();
       }
       catch(Hermes::Exceptions::SolutionLoadFailureException& e)
@@ -0,0 +1,86 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "cost_model.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// The reference mapping of a curved element, evaluated in each point, about doubles the work.
+    static const double H2D_CURVED_ELEMENT_COST_FACTOR = 2.0;
+    /// The work on an element independent of the forms (the transformations, the assembly lists).
+    static const double H2D_ELEMENT_BASE_COST = 10.0;
+
+    int CostModel::get_num_shapes(int order, ElementMode2D mode)
+    {
+      if(mode == HERMES_MODE_TRIANGLE)
+      {
+        int p = H2D_GET_H_ORDER(order);
+        return (p + 1) * (p + 2) / 2;
+      }
+      return (H2D_GET_H_ORDER(order) + 1) * (H2D_GET_V_ORDER(order) + 1);
+    }
+
+    int CostModel::get_num_points(int order, ElementMode2D mode)
+    {
+      // Gauss rules integrating the products (of the order 2p) exactly.
+      if(mode == HERMES_MODE_TRIANGLE)
+      {
+        int p = 2 * H2D_GET_H_ORDER(order);
+        return std::max((p + 1) * (p + 2) / 6, 1);
+      }
+      return (H2D_GET_H_ORDER(order) + 1) * (H2D_GET_V_ORDER(order) + 1);
+    }
+
+    double CostModel::get_element_cost(int num_shapes, int order, ElementMode2D mode, bool curved, int num_matrix_forms, int num_vector_forms)
+    {
+      double np = get_num_points(order, mode);
+      double cost = H2D_ELEMENT_BASE_COST + np * ((double)num_matrix_forms * num_shapes * num_shapes + (double)num_vector_forms * num_shapes);
+      return curved ? H2D_CURVED_ELEMENT_COST_FACTOR * cost : cost;
+    }
+
+    void CostModel::partition(const double* costs, int first, int end, int num_parts, int* bounds)
+    {
+      double total = 0.0;
+      for(int i = first; i < end; i++)
+        total += costs[i];
+
+      // The part k ends where the prefix sum of the costs reaches (k + 1) / num_parts of the total.
+      bounds[0] = first;
+      int item_i = first;
+      double sum = 0.0;
+      for(int part_i = 0; part_i < num_parts - 1; part_i++)
+      {
+        double target = total * (part_i + 1) / num_parts;
+        while(item_i < end && sum + 0.5 * costs[item_i] < target)
+          sum += costs[item_i++];
+        bounds[part_i + 1] = item_i;
+      }
+      bounds[num_parts] = end;
+    }
+
+    double CostModel::get_imbalance(const std::vector<double>& times)
+    {
+      double max_time = 0.0, sum = 0.0;
+      for(unsigned int i = 0; i < times.size(); i++)
+      {
+        max_time = std::max(max_time, times[i]);
+        sum += times[i];
+      }
+      return sum > 0.0 ? max_time * times.size() / sum : 1.0;
+    }
+  }
+}
@@ -17,14 +17,19 @@
 // along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "discrete_problem.h"
+#include "matrix_free_jacobian.h"
 #include "function/exact_solution.h"
 #include <algorithm>
 #include <map>
 #include <string>
+#include <typeinfo>
 #include <utility>
 #include <vector>
 #include "global.h"
 #include "integrals/h1.h"
+#ifdef WITH_MPI
+#include <mpi.h>
+#endif
 #include "quadrature/limit_order.h"
 #include "mesh/traverse.h"
 #include "space/space.h"
@@ -33,6 +38,8 @@
 #include "function/solution.h"
 #include "neighbor.h"
 #include "api2d.h"
+#include "cache_statistics.h"
+#include "cost_model.h"
 
 using namespace Hermes::Algebra::DenseMatrixOperations;
 
@@ -46,7 +53,8 @@ namespace Hermes
     double DiscreteProblem<Scalar>::fake_wt = 1.0;
 
     template<typename Scalar>
-    DiscreteProblem<Scalar>::DiscreteProblem(const WeakForm<Scalar>* wf, Hermes::vector<const Space<Scalar> *> spaces) : Hermes::Solvers::DiscreteProblemInterface<Scalar>(), wf(wf)
+    DiscreteProblem<Scalar>::DiscreteProblem(const WeakForm<Scalar>* wf, Hermes::vector<const Space<Scalar> *> spaces) : Hermes::Solvers::DiscreteProblemInterface<Scalar>(),
+      Mixins::MemoryAccounted(Mixins::H2D_MEMORY_DISCRETE_PROBLEM), wf(wf)
     {
       if(spaces.empty())
         throw Exceptions::NullException(2);
@@ -54,7 +62,8 @@ namespace Hermes
       for(unsigned int i = 0; i < spaces.size(); i++)
       {
         this->spaces.push_back(spaces.at(i));
-        this->spaces_first_dofs.push_back(first_dof_running);
+        // Interleaved DOFs are numbered in the whole system already.
+        this->spaces_first_dofs.push_back(spaces.at(i)->has_interleaved_dofs() ? 0 : first_dof_running);
         first_dof_running += spaces.at(i)->get_num_dofs();
       }
       init();
@@ -62,7 +71,7 @@ namespace Hermes
 
     template<typename Scalar>
     DiscreteProblem<Scalar>::DiscreteProblem(const WeakForm<Scalar>* wf, const Space<Scalar>* space)
-      : Hermes::Solvers::DiscreteProblemInterface<Scalar>(), wf(wf)
+      : Hermes::Solvers::DiscreteProblemInterface<Scalar>(), Mixins::MemoryAccounted(Mixins::H2D_MEMORY_DISCRETE_PROBLEM), wf(wf)
     {
       spaces.push_back(space);
       this->spaces_first_dofs.push_back(0);
@@ -71,7 +80,7 @@ namespace Hermes
     }
 
     template<typename Scalar>
-    DiscreteProblem<Scalar>::DiscreteProblem() : Hermes::Solvers::DiscreteProblemInterface<Scalar>(), wf(NULL)
+    DiscreteProblem<Scalar>::DiscreteProblem() : Hermes::Solvers::DiscreteProblemInterface<Scalar>(), Mixins::MemoryAccounted(Mixins::H2D_MEMORY_DISCRETE_PROBLEM), wf(NULL)
     {
       // Set all attributes for which we don't need to acces wf or spaces.
       // This is important for the destructor to properly detect what needs to be deallocated.
@@ -86,6 +95,15 @@ namespace Hermes
 
       // Matrix<Scalar> related settings.
       have_matrix = false;
+      this->sparse_structure_col_start = NULL;
+      this->sparse_structure_rows = NULL;
+      this->sparse_pattern = NULL;
+      this->scatter_map = NULL;
+      this->scatter_map_num_states = 0;
+      this->scatter_map_size = 0;
+      this->scatter_map_bytes = 0;
+      this->scatter_map_matrix = NULL;
+      this->scatter_map_num_traversals = 0;
 
       // There is a special function that sets a DiscreteProblem to be FVM.
       // Purpose is that this constructor looks cleaner and is simpler.
@@ -101,12 +119,64 @@ namespace Hermes
       current_mat = NULL;
       current_rhs = NULL;
       current_block_weights = NULL;
+      current_affine_term = H2D_ALL_AFFINE_TERMS;
 
 
       cache_element_stored = NULL;
 
       this->do_not_use_cache = false;
 
+      this->buffered_assembly = false;
+      this->mat_buffers = NULL;
+      this->rhs_buffers = NULL;
+
+      this->colored_assembly = false;
+      this->marker_grouped_assembly = false;
+      this->cost_balanced_assembly = false;
+      this->structure_analysis_solver = NULL;
+
+      this->batched_assembly = false;
+      this->use_reference_integrals = false;
+      this->quadrature_order_reduction = 0;
+
+      this->partition_part = 0;
+      this->partition_num_parts = 1;
+
+      this->static_condensation = false;
+      this->condensed_dof_index = NULL;
+      this->condensed_ndof = 0;
+      this->condensed_elements = NULL;
+      this->condensed_elements_size = 0;
+      this->condensation_buffers = NULL;
+      this->condensation_buffers_size = 0;
+
+      // Locks of the instance, the instances assembled concurrently do not wait for each other.
+      omp_init_lock(&this->cache_lock);
+      omp_init_lock(&this->caught_exception_lock);
+
+      this->arenas = NULL;
+      this->form_ext_fns = NULL;
+      this->dirichlet_lift_only = false;
+      this->arena_allocations = this->arena_block_allocations = 0;
+
+      this->thread_pss = this->thread_spss = NULL;
+      this->thread_refmaps = NULL;
+      this->thread_u_ext = NULL;
+      this->thread_als = NULL;
+      this->thread_weakforms = NULL;
+      this->thread_structures_num_threads = 0;
+      this->thread_u_ext_zero = false;
+      this->persistent_weakform_clones = false;
+      this->ensemble_size = 0;
+      this->ensemble_thread_weakforms = NULL;
+      this->arena_peak_size = 0;
+
+      this->cache_hits = this->cache_misses = this->cache_evictions = 0;
+      this->cache_statistics_bytes = 0;
+      this->cache_assembling_stamp = 0;
+
+      this->form_order_cache_forms = 0;
+
       this->spaces_size = 0;
 
       this->is_linear = false;
@@ -158,6 +228,15 @@ namespace Hermes
 
       // Matrix<Scalar> related settings.
       have_matrix = false;
+      this->sparse_structure_col_start = NULL;
+      this->sparse_structure_rows = NULL;
+      this->sparse_pattern = NULL;
+      this->scatter_map = NULL;
+      this->scatter_map_num_states = 0;
+      this->scatter_map_size = 0;
+      this->scatter_map_bytes = 0;
+      this->scatter_map_matrix = NULL;
+      this->scatter_map_num_traversals = 0;
 
       // There is a special function that sets a DiscreteProblem to be FVM.
       // Purpose is that this constructor looks cleaner and is simpler.
@@ -181,8 +260,9 @@ namespace Hermes
       current_mat = NULL;
       current_rhs = NULL;
       current_block_weights = NULL;
+      current_affine_term = H2D_ALL_AFFINE_TERMS;
 
-      cache_records_sub_idx = new std::map<uint64_t, CacheRecordPerSubIdx*>**[spaces.size()];
+      cache_records_sub_idx = new SubIdxCacheTable**[spaces.size()];
       cache_records_element = new CacheRecordPerElement**[spaces.size()];
 
       this->cache_size = spaces[0]->get_mesh()->get_max_element_id() + 1;
@@ -195,8 +275,8 @@ namespace Hermes
 
       for(unsigned int i = 0; i < spaces.size(); i++)
       {
-        cache_records_sub_idx[i] = (std::map<uint64_t, CacheRecordPerSubIdx*>**)malloc(this->cache_size * sizeof(std::map<uint64_t, CacheRecordPerSubIdx*>*));
-        memset(cache_records_sub_idx[i], NULL, this->cache_size * sizeof(std::map<uint64_t, CacheRecordPerSubIdx*>*));
+        cache_records_sub_idx[i] = (SubIdxCacheTable**)malloc(this->cache_size * sizeof(SubIdxCacheTable*));
+        memset(cache_records_sub_idx[i], NULL, this->cache_size * sizeof(SubIdxCacheTable*));
 
         cache_records_element[i] = (CacheRecordPerElement**)malloc(this->cache_size * sizeof(CacheRecordPerElement*));
         memset(cache_records_element[i], NULL, this->cache_size * sizeof(CacheRecordPerElement*));
@@ -204,6 +284,57 @@ namespace Hermes
       cache_element_stored = NULL;
 
       this->do_not_use_cache = false;
+
+      this->buffered_assembly = false;
+      this->mat_buffers = NULL;
+      this->rhs_buffers = NULL;
+
+      this->colored_assembly = false;
+      this->marker_grouped_assembly = false;
+      this->cost_balanced_assembly = false;
+      this->structure_analysis_solver = NULL;
+
+      this->batched_assembly = false;
+      this->use_reference_integrals = false;
+      this->quadrature_order_reduction = 0;
+
+      this->partition_part = 0;
+      this->partition_num_parts = 1;
+
+      this->static_condensation = false;
+      this->condensed_dof_index = NULL;
+      this->condensed_ndof = 0;
+      this->condensed_elements = NULL;
+      this->condensed_elements_size = 0;
+      this->condensation_buffers = NULL;
+      this->condensation_buffers_size = 0;
+
+      // Locks of the instance, the instances assembled concurrently do not wait for each other.
+      omp_init_lock(&this->cache_lock);
+      omp_init_lock(&this->caught_exception_lock);
+
+      this->arenas = NULL;
+      this->form_ext_fns = NULL;
+      this->dirichlet_lift_only = false;
+      this->arena_allocations = this->arena_block_allocations = 0;
+
+      this->thread_pss = this->thread_spss = NULL;
+      this->thread_refmaps = NULL;
+      this->thread_u_ext = NULL;
+      this->thread_als = NULL;
+      this->thread_weakforms = NULL;
+      this->thread_structures_num_threads = 0;
+      this->thread_u_ext_zero = false;
+      this->persistent_weakform_clones = false;
+      this->ensemble_size = 0;
+      this->ensemble_thread_weakforms = NULL;
+      this->arena_peak_size = 0;
+
+      this->cache_hits = this->cache_misses = this->cache_evictions = 0;
+      this->cache_statistics_bytes = 0;
+      this->cache_assembling_stamp = 0;
+
+      this->form_order_cache_forms = 0;
     }
 
     template<typename Scalar>
@@ -215,12 +346,14 @@ namespace Hermes
 
       Space<Scalar>::update_essential_bc_values(spaces, time);
       const_cast<WeakForm<Scalar>*>(this->wf)->set_current_time(time);
+      this->free_thread_weakforms();
     }
 
     template<typename Scalar>
     void DiscreteProblem<Scalar>::set_time_step(double time_step)
     {
       const_cast<WeakForm<Scalar>*>(this->wf)->set_current_time_step(time_step);
+      this->free_thread_weakforms();
     }
 
     template<typename Scalar>
@@ -232,1069 +365,3798 @@ namespace Hermes
       if(sp_seq != NULL) delete [] sp_seq;
 
       this->delete_cache();
+      CacheStatistics::add_bytes(H2D_CACHE_ASSEMBLY, -(long long)this->cache_statistics_bytes);
+      this->free_sparse_structure();
+      this->free_scatter_map();
+      this->free_DG_cache();
+      this->free_static_condensation();
+      this->free_element_parts();
+      this->free_batched_assembly();
+      this->free_thread_structures();
+      for (typename std::map<std::vector<int>, BatchShapeTable*>::iterator it = this->batch_tables.begin(); it != this->batch_tables.end(); it++)
+        delete it->second;
+      for (std::map<std::vector<int>, ReferenceIntegrals*>::iterator it = this->reference_integrals.begin(); it != this->reference_integrals.end(); it++)
+        delete it->second;
+
+      omp_destroy_lock(&this->cache_lock);
+      omp_destroy_lock(&this->caught_exception_lock);
     }
 
     template<typename Scalar>
-    int DiscreteProblem<Scalar>::get_num_dofs() const
+    void DiscreteProblem<Scalar>::set_reference_integrals(bool to_set)
     {
-      return this->ndof;
+      this->use_reference_integrals = to_set;
+      if(to_set)
+        this->batched_assembly = true;
+      // The groups are made again.
+      this->free_batched_assembly();
     }
 
     template<typename Scalar>
-    Hermes::vector<const Space<Scalar>*> DiscreteProblem<Scalar>::get_spaces() const
+    int DiscreteProblem<Scalar>::get_num_dofs() const
     {
-      return this->spaces;
+      return this->ndof;
     }
 
     template<typename Scalar>
-    const WeakForm<Scalar>* DiscreteProblem<Scalar>::get_weak_formulation() const
+    void DiscreteProblem<Scalar>::set_partition(int part, int num_parts)
     {
-      return this->wf;
+      if(num_parts < 1)
+        throw Exceptions::ValueException("num_parts", num_parts, 1);
+      if(part < 0 || part >= num_parts)
+        throw Exceptions::ValueException("part", part, 0, num_parts - 1);
+      if(this->partition_part == part && this->partition_num_parts == num_parts)
+        return;
+      this->partition_part = part;
+      this->partition_num_parts = num_parts;
+      this->free_element_parts();
+      // Other states, other structure.
+      this->have_matrix = false;
+      this->free_scatter_map();
+      this->free_DG_cache();
     }
 
+#ifdef WITH_MPI
     template<typename Scalar>
-    void DiscreteProblem<Scalar>::set_weak_formulation(const WeakForm<Scalar>* wf)
+    void DiscreteProblem<Scalar>::set_mpi_partition()
     {
-      if(wf == NULL)
-        throw Hermes::Exceptions::NullException(0);
-
-      this->wf = wf;
-      this->have_matrix = false;
-
-      if(!this->wf->mfDG.empty())
-        this->DG_matrix_forms_present = true;
-
-      if(!this->wf->vfDG.empty())
-        this->DG_vector_forms_present = true;
+      int rank, size;
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+      MPI_Comm_size(MPI_COMM_WORLD, &size);
+      this->set_partition(rank, size);
     }
+#endif
 
     template<typename Scalar>
-    bool DiscreteProblem<Scalar>::is_matrix_free() const
+    void DiscreteProblem<Scalar>::free_element_parts()
     {
-      return wf->is_matrix_free();
+      for (unsigned int i = 0; i < this->element_parts.size(); i++)
+        if(this->element_parts[i] != NULL)
+          delete [] this->element_parts[i];
+      this->element_parts.clear();
+      this->element_parts_seq.clear();
     }
 
     template<typename Scalar>
-    bool DiscreteProblem<Scalar>::is_up_to_date() const
+    Traverse::State** DiscreteProblem<Scalar>::get_partition_states(Traverse::State** states, int num_states, int& num_partition_states)
     {
-      // check if we can reuse the matrix structure
-      bool up_to_date = true;
-      if(!have_matrix)
-        up_to_date = false;
+      if(this->partition_num_parts == 1)
+      {
+        num_partition_states = num_states;
+        return states;
+      }
 
-      for (unsigned int i = 0; i < wf->get_neq(); i++)
+      if(this->element_parts.size() != this->spaces_size)
       {
-        if(spaces[i]->get_seq() != sp_seq[i])
+        this->free_element_parts();
+        this->element_parts.resize(this->spaces_size, (int*)NULL);
+        this->element_parts_seq.resize(this->spaces_size, 0);
+      }
+      for (unsigned int space_i = 0; space_i < this->spaces_size; space_i++)
+      {
+        const Mesh* mesh = this->spaces[space_i]->get_mesh();
+        if(this->element_parts[space_i] == NULL || this->element_parts_seq[space_i] != mesh->get_seq())
         {
-          up_to_date = false;
-          break;
+          if(this->element_parts[space_i] != NULL)
+            delete [] this->element_parts[space_i];
+          this->element_parts[space_i] = new int[std::max(mesh->get_max_element_id(), 1)];
+          mesh->partition_elements(this->partition_num_parts, this->element_parts[space_i]);
+          this->element_parts_seq[space_i] = mesh->get_seq();
         }
       }
 
-      return up_to_date;
+      Traverse::State** partition_states = new Traverse::State*[std::max(num_states, 1)];
+      num_partition_states = 0;
+      for (int state_i = 0; state_i < num_states; state_i++)
+        for (unsigned int space_i = 0; space_i < this->spaces_size; space_i++)
+          if(states[state_i]->e[space_i] != NULL)
+          {
+            if(this->element_parts[space_i][states[state_i]->e[space_i]->id] == this->partition_part)
+              partition_states[num_partition_states++] = states[state_i];
+            break;
+          }
+      return partition_states;
     }
 
     template<typename Scalar>
-    void DiscreteProblem<Scalar>::set_fvm()
+    int DiscreteProblem<Scalar>::BatchShapeTable::get_column(Shapeset* shapeset, int index, ElementMode2D mode, int order)
     {
-      this->is_fvm = true;
+      std::map<int, int>::const_iterator it = this->columns.find(index);
+      if(it != this->columns.end())
+        return it->second;
+
+      int column = this->columns.size();
+      double3* pt = g_quad_2d_std.get_points(order, mode);
+      this->values.resize((column + 1) * 3 * this->np);
+      double* val = &this->values[column * 3 * this->np];
+      for (int i = 0; i < this->np; i++)
+      {
+        val[i] = shapeset->get_fn_value(index, pt[i][0], pt[i][1], 0, mode);
+        val[this->np + i] = shapeset->get_dx_value(index, pt[i][0], pt[i][1], 0, mode);
+        val[2 * this->np + i] = shapeset->get_dy_value(index, pt[i][0], pt[i][1], 0, mode);
+      }
+      this->columns.insert(std::pair<int, int>(index, column));
+      return column;
     }
 
     template<typename Scalar>
-    void DiscreteProblem<Scalar>::delete_cache()
+    void DiscreteProblem<Scalar>::free_batched_assembly()
     {
-      for(unsigned int i = 0; i < spaces.size(); i++)
+      for (unsigned int i = 0; i < this->batch_groups.size(); i++)
+        delete this->batch_groups[i];
+      this->batch_groups.clear();
+      this->batched_forms.clear();
+      this->batch_groups_key.clear();
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::init_batched_assembly(Traverse::State** states, int num_states)
+    {
+      int num_forms = this->wf->mfvol.size();
+      if(!this->batched_assembly || this->current_mat == NULL || this->buffered_assembly || this->static_condensation || num_forms == 0)
       {
-        for(unsigned int j = 0; j < cache_size; j++)
+        this->free_batched_assembly();
+        return;
+      }
+
+      std::vector<int> key;
+      key.push_back(num_states);
+      key.push_back(this->traverse_plan.get_num_traversals());
+      key.push_back(this->partition_part);
+      key.push_back(this->partition_num_parts);
+      for (unsigned int space_i = 0; space_i < this->spaces_size; space_i++)
+      {
+        key.push_back(this->spaces[space_i]->get_seq());
+        key.push_back(this->spaces_first_dofs[space_i]);
+      }
+      std::vector<bool> form_eligible(num_forms, false);
+      for (int form_i = 0; form_i < num_forms; form_i++)
+      {
+        MatrixFormVol<Scalar>* mfv = this->wf->mfvol[form_i];
+        Scalar mass, diffusion, convection_x, convection_y;
+        form_eligible[form_i] = mfv->get_constant_coefficients(mass, diffusion, convection_x, convection_y)
+          && this->spaces[mfv->i]->get_shapeset()->get_num_components() == 1 && this->spaces[mfv->j]->get_shapeset()->get_num_components() == 1;
+        key.push_back(form_eligible[form_i] ? 1 : 0);
+      }
+      if(!this->batched_forms.empty() && key == this->batch_groups_key)
+        return;
+
+      this->free_batched_assembly();
+      this->batch_groups_key = key;
+      this->batched_forms.assign(num_states * num_forms, 0);
+
+      std::map<std::vector<int>, BatchGroup*> groups;
+      AsmList<Scalar> al_i, al_j;
+      for (int state_i = 0; state_i < num_states; state_i++)
+      {
+        Traverse::State* current_state = states[state_i];
+        for (int form_i = 0; form_i < num_forms; form_i++)
         {
-          if(this->cache_records_sub_idx[i][j] != NULL)
+          if(!form_eligible[form_i])
+            continue;
+          MatrixFormVol<Scalar>* mfv = this->wf->mfvol[form_i];
+          Element* e_i = current_state->e[mfv->i];
+          Element* e_j = current_state->e[mfv->j];
+          if(e_i == NULL || e_j == NULL || current_state->sub_idx[mfv->i] != 0 || current_state->sub_idx[mfv->j] != 0)
+            continue;
+          if(e_i->is_curved() || (e_i->is_quad() && !RefMap::is_parallelogram(e_i)))
+            continue;
+          if(!form_to_be_assembled(mfv, form_i, current_state))
+            continue;
+
+          this->spaces[mfv->i]->get_element_assembly_list(e_i, &al_i, this->spaces_first_dofs[mfv->i]);
+          this->spaces[mfv->j]->get_element_assembly_list(e_j, &al_j, this->spaces_first_dofs[mfv->j]);
+
+          // The product of two polynomials on an affine element, the same order for both kinds of terms.
+          int max_order_i = this->spaces[mfv->i]->get_element_order(e_i->id);
+          int max_order_j = this->spaces[mfv->j]->get_element_order(e_j->id);
+          max_order_i = std::max(H2D_GET_H_ORDER(max_order_i), H2D_GET_V_ORDER(max_order_i));
+          max_order_j = std::max(H2D_GET_H_ORDER(max_order_j), H2D_GET_V_ORDER(max_order_j));
+          for (unsigned int k = 0; k < e_i->get_nvert(); k++)
+          {
+            max_order_i = std::max(max_order_i, this->spaces[mfv->i]->get_edge_order(e_i, k));
+            max_order_j = std::max(max_order_j, this->spaces[mfv->j]->get_edge_order(e_j, k));
+          }
+          ElementMode2D mode = e_i->get_mode();
+          int order = max_order_i + max_order_j;
+          limit_order_nowarn(order, mode);
+
+          // The reference integrals, if all the shape functions are in them.
+          ReferenceIntegrals* integrals = NULL;
+          if(this->use_reference_integrals)
+          {
+            std::vector<int> integrals_key;
+            integrals_key.push_back(this->spaces[mfv->i]->get_shapeset()->get_id());
+            integrals_key.push_back(this->spaces[mfv->j]->get_shapeset()->get_id());
+            integrals_key.push_back(mode);
+            integrals_key.push_back(max_order_i);
+            integrals_key.push_back(max_order_j);
+            ReferenceIntegrals*& found = this->reference_integrals[integrals_key];
+            if(found == NULL)
+              found = new ReferenceIntegrals(this->spaces[mfv->i]->get_shapeset(), this->spaces[mfv->j]->get_shapeset(), mode, max_order_i, max_order_j);
+            integrals = found;
+            for (unsigned int k = 0; k < al_i.cnt && integrals != NULL; k++)
+              if(integrals->get_position_i(al_i.idx[k]) < 0)
+                integrals = NULL;
+            for (unsigned int k = 0; k < al_j.cnt && integrals != NULL; k++)
+              if(integrals->get_position_j(al_j.idx[k]) < 0)
+                integrals = NULL;
+          }
+
+          BatchShapeTable* tables[2];
+          for (int table_i = 0; table_i < 2; table_i++)
           {
-            for(typename std::map<uint64_t, CacheRecordPerSubIdx*>::iterator it = this->cache_records_sub_idx[i][j]->begin(); it != this->cache_records_sub_idx[i][j]->end(); it++)
+            std::vector<int> table_key;
+            table_key.push_back(this->spaces[table_i == 0 ? mfv->i : mfv->j]->get_shapeset()->get_id());
+            table_key.push_back(mode);
+            table_key.push_back(order);
+            typename std::map<std::vector<int>, BatchShapeTable*>::iterator it = this->batch_tables.find(table_key);
+            if(it == this->batch_tables.end())
             {
-              it->second->clear();
-              delete it->second;
+              BatchShapeTable* table = new BatchShapeTable;
+              table->np = g_quad_2d_std.get_num_points(order, mode);
+              it = this->batch_tables.insert(std::pair<std::vector<int>, BatchShapeTable*>(table_key, table)).first;
             }
+            tables[table_i] = it->second;
+          }
 
-            this->cache_records_sub_idx[i][j]->clear();
-            delete this->cache_records_sub_idx[i][j];
-            this->cache_records_sub_idx[i][j] = NULL;
+          std::vector<int> group_key;
+          group_key.push_back(form_i);
+          group_key.push_back(mode);
+          group_key.push_back(order);
+          group_key.push_back(al_i.cnt);
+          group_key.push_back(al_j.cnt);
+          group_key.push_back(integrals == NULL ? -1 : max_order_i);
+          group_key.push_back(integrals == NULL ? -1 : max_order_j);
+          BatchGroup*& group = groups[group_key];
+          if(group == NULL)
+          {
+            group = new BatchGroup;
+            group->form_i = form_i;
+            group->mode = mode;
+            group->order = order;
+            group->table_i = tables[0];
+            group->table_j = tables[1];
+            group->integrals = integrals;
+            group->cnt_i = al_i.cnt;
+            group->cnt_j = al_j.cnt;
+            this->batch_groups.push_back(group);
           }
-          if(this->cache_records_element[i][j] != NULL)
+
+          group->states.push_back(state_i);
+          for (unsigned int k = 0; k < al_i.cnt; k++)
           {
-            this->cache_records_element[i][j]->clear();
-            delete this->cache_records_element[i][j];
-            this->cache_records_element[i][j] = NULL;
+            if(integrals != NULL)
+              group->columns_i.push_back(integrals->get_position_i(al_i.idx[k]));
+            else
+              group->columns_i.push_back(tables[0]->get_column(this->spaces[mfv->i]->get_shapeset(), al_i.idx[k], mode, order));
+            group->dofs_i.push_back(al_i.dof[k]);
+            group->coefs_i.push_back(al_i.coef[k]);
+          }
+          for (unsigned int k = 0; k < al_j.cnt; k++)
+          {
+            if(integrals != NULL)
+              group->columns_j.push_back(integrals->get_position_j(al_j.idx[k]));
+            else
+              group->columns_j.push_back(tables[1]->get_column(this->spaces[mfv->j]->get_shapeset(), al_j.idx[k], mode, order));
+            group->dofs_j.push_back(al_j.dof[k]);
+            group->coefs_j.push_back(al_j.coef[k]);
           }
+
+          // The same affine map as RefMap::calc_const_inv_ref_map().
+          int k = e_i->is_triangle() ? 2 : 3;
+          double m[2][2] = { { e_i->vn[1]->x - e_i->vn[0]->x, e_i->vn[k]->x - e_i->vn[0]->x },
+          { e_i->vn[1]->y - e_i->vn[0]->y, e_i->vn[k]->y - e_i->vn[0]->y } };
+          double jacobian = 0.25 * (m[0][0] * m[1][1] - m[0][1] * m[1][0]);
+          double ij = 0.5 / jacobian;
+          group->geometry.push_back(jacobian);
+          group->geometry.push_back(m[1][1] * ij);
+          group->geometry.push_back(-m[1][0] * ij);
+          group->geometry.push_back(-m[0][1] * ij);
+          group->geometry.push_back(m[0][0] * ij);
+
+          this->batched_forms[state_i * num_forms + form_i] = 1;
         }
-        free(cache_records_sub_idx[i]);
-        free(cache_records_element[i]);
       }
-      delete [] this->cache_records_sub_idx;
-      delete [] this->cache_records_element;
+
+      int num_threads_used = this->get_num_threads();
+      this->batched_thread_states.assign(num_threads_used, -1);
     }
 
     template<typename Scalar>
-    void DiscreteProblem<Scalar>::set_spaces(Hermes::vector<const Space<Scalar>*> spacesToSet)
+    void DiscreteProblem<Scalar>::set_batched_state(int state_i)
     {
-      for(unsigned int i = 0; i < spacesToSet.size(); i++)
-        spacesToSet[i]->check();
-
-      if(this->spaces_size != spacesToSet.size() && this->spaces_size > 0)
-        throw Hermes::Exceptions::LengthException(0, spacesToSet.size(), this->spaces_size);
-
-      int originalSize = this->spaces.size();
+      if(!this->batched_forms.empty())
+        this->batched_thread_states[omp_get_thread_num()] = state_i;
+    }
 
-      this->spaces = spacesToSet;
+    template<typename Scalar>
+    bool DiscreteProblem<Scalar>::is_form_batched(int mfvol_i) const
+    {
+      if(this->batched_forms.empty())
+        return false;
+      int state_i = this->batched_thread_states[omp_get_thread_num()];
+      return state_i >= 0 && this->batched_forms[state_i * this->wf->mfvol.size() + mfvol_i] != 0;
+    }
 
-      this->ndof = Space<Scalar>::get_num_dofs(spaces);
+    /// The largest number of quadrature points the batched kernels are instantiated for
+    /// (covers the triangle and the quadrilateral rules of the orders up to 12).
+    #define H2D_BATCH_FIXED_NP_MAX 64
 
-      /// \todo TEMPORARY There is something wrong with caching vector shapesets.
-      for(unsigned int i = 0; i < spacesToSet.size(); i++)
-        if(spacesToSet[i]->get_shapeset()->get_num_components() > 1)
-          this->do_not_use_cache = true;
+    /// The quadrature sums of one pair of a test and a basis function of the batched assembly:
+    /// sums[0] mass, sums[1] diffusion, sums[2] / sums[3] the x- / y-convection.
+    /// NP is the number of the quadrature points known at compile time (the loop is unrolled and vectorized), 0 for the runtime np.
+    template<int NP>
+    static void batched_pair_sums(int np, const double3* pt, const double* val_i, const double* gx_i, const double* gy_i,
+      const double* val_j, const double* gx_j, const double* gy_j, double* sums)
+    {
+      const int n = (NP > 0 ? NP : np);
+      double mass_sum = 0.0, diffusion_sum = 0.0, convection_x_sum = 0.0, convection_y_sum = 0.0;
+      for (int q = 0; q < n; q++)
+      {
+        mass_sum += pt[q][2] * val_i[q] * val_j[q];
+        diffusion_sum += pt[q][2] * (gx_i[q] * gx_j[q] + gy_i[q] * gy_j[q]);
+        convection_x_sum += pt[q][2] * gx_j[q] * val_i[q];
+        convection_y_sum += pt[q][2] * gy_j[q] * val_i[q];
+      }
+      sums[0] = mass_sum;
+      sums[1] = diffusion_sum;
+      sums[2] = convection_x_sum;
+      sums[3] = convection_y_sum;
+    }
 
-      have_matrix = false;
+    typedef void (*BatchedPairSumsFn)(int np, const double3* pt, const double* val_i, const double* gx_i, const double* gy_i,
+      const double* val_j, const double* gx_j, const double* gy_j, double* sums);
 
-      unsigned int first_dof_running = 0;
-      this->spaces_first_dofs.clear();
-      for(unsigned int i = 0; i < spaces.size(); i++)
+    /// Fills the dispatch table with the instantiations of batched_pair_sums() for NP = 1, ..., N.
+    template<int N>
+    struct BatchedPairSumsTable
+    {
+      static void fill(BatchedPairSumsFn* table)
       {
-        this->spaces_first_dofs.push_back(first_dof_running);
-        first_dof_running += spaces.at(i)->get_num_dofs();
+        table[N] = &batched_pair_sums<N>;
+        BatchedPairSumsTable<N - 1>::fill(table);
       }
+    };
 
-      if(originalSize == 0)
+    template<>
+    struct BatchedPairSumsTable<0>
+    {
+      static void fill(BatchedPairSumsFn* table)
       {
-        // Internal variables settings.
-        sp_seq = new int[spaces.size()];
-        memset(sp_seq, -1, sizeof(int) * spaces.size());
+        table[0] = &batched_pair_sums<0>;
+      }
+    };
 
-        // Matrix<Scalar> related settings.
-        have_matrix = false;
+    /// The dispatch table, filled at the static initialization.
+    static BatchedPairSumsFn batched_pair_sums_table[H2D_BATCH_FIXED_NP_MAX + 1];
+    static struct BatchedPairSumsTableInitializer
+    {
+      BatchedPairSumsTableInitializer()
+      {
+        BatchedPairSumsTable<H2D_BATCH_FIXED_NP_MAX>::fill(batched_pair_sums_table);
+      }
+    } batched_pair_sums_table_initializer;
 
-        cache_records_sub_idx = new std::map<uint64_t, CacheRecordPerSubIdx*>**[spaces.size()];
-        cache_records_element = new CacheRecordPerElement**[spaces.size()];
+    /// The kernel for np quadrature points, the generic one above H2D_BATCH_FIXED_NP_MAX.
+    static BatchedPairSumsFn get_batched_pair_sums(int np)
+    {
+      return (np > 0 && np <= H2D_BATCH_FIXED_NP_MAX) ? batched_pair_sums_table[np] : batched_pair_sums_table[0];
+    }
 
-        this->cache_size = spaces[0]->get_mesh()->get_max_element_id() + 1;
-        for(unsigned int i = 1; i < spaces.size(); i++)
-        {
-          int cache_size_i = spaces[i]->get_mesh()->get_max_element_id() + 1;
-          if(cache_size_i > cache_size)
-            this->cache_size = cache_size_i;
-        }
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::assemble_batched()
+    {
+      Hermes::ProfilerRegion profiler_region("DiscreteProblem::assemble_batched");
+      if(this->batched_forms.empty())
+        return;
+      // The forms of the states are not batched outside of assemble().
+      this->batched_thread_states.assign(this->batched_thread_states.size(), -1);
+      if(this->caughtException != NULL)
+        return;
 
-        for(unsigned int i = 0; i < spaces.size(); i++)
-        {
-          cache_records_sub_idx[i] = (std::map<uint64_t, CacheRecordPerSubIdx*>**)malloc(this->cache_size * sizeof(std::map<uint64_t, CacheRecordPerSubIdx*>*));
-          memset(cache_records_sub_idx[i], NULL, this->cache_size * sizeof(std::map<uint64_t, CacheRecordPerSubIdx*>*));
+      // Elements of one group calculated at once.
+      const int batch_size = 64;
 
-          cache_records_element[i] = (CacheRecordPerElement**)malloc(this->cache_size * sizeof(CacheRecordPerElement*));
-          memset(cache_records_element[i], NULL, this->cache_size * sizeof(CacheRecordPerElement*));
-        }
-        cache_element_stored = NULL;
-      }
-      else
-      {
-        int max_size = spacesToSet[0]->get_mesh()->get_max_element_id();
-        for(unsigned int i = 1; i < spacesToSet.size(); i++)
+      int num_batches = 0;
+      std::vector<int> batch_groups_index, batch_first_elements;
+      for (unsigned int group_i = 0; group_i < this->batch_groups.size(); group_i++)
+        for (unsigned int first = 0; first < this->batch_groups[group_i]->states.size(); first += batch_size)
         {
-          int max_size_i = spacesToSet[i]->get_mesh()->get_max_element_id();
-          if(max_size_i > max_size)
-            max_size = max_size_i;
-          sp_seq[i] = spacesToSet[i]->get_seq();
+          batch_groups_index.push_back(group_i);
+          batch_first_elements.push_back(first);
+          num_batches++;
         }
 
-        if(max_size > this->cache_size + 1)
+      int num_threads_used = this->get_num_threads();
+#pragma omp parallel num_threads(num_threads_used)
+      {
+        this->apply_thread_affinity();
+        // No state is set, add_to_matrix() does not use the scatter map.
+        this->set_scatter_map_state(-1);
+        std::vector<double> gradients;
+        std::vector<Scalar> local_matrices;
+        std::vector<Scalar*> rows;
+#pragma omp for schedule(dynamic, 1)
+        for (int batch_i = 0; batch_i < num_batches; batch_i++)
         {
-          for(unsigned int i = 0; i < this->spaces_size; i++)
+          if(this->caughtException != NULL)
+            continue;
+          try
           {
-            this->cache_records_sub_idx[i] = (std::map<uint64_t, CacheRecordPerSubIdx*>**)realloc(this->cache_records_sub_idx[i], max_size * sizeof(std::map<uint64_t, CacheRecordPerSubIdx*>*));
-            memset(this->cache_records_sub_idx[i] + this->cache_size, NULL, (max_size - this->cache_size) * sizeof(std::map<uint64_t, CacheRecordPerSubIdx*>*));
+            BatchGroup* group = this->batch_groups[batch_groups_index[batch_i]];
+            MatrixFormVol<Scalar>* form = this->wf->mfvol[group->form_i];
+            if(fabs(form->scaling_factor) < 1e-12 || fabs(this->block_scaling_coeff(form)) < 1e-12)
+              continue;
+            // The groups are kept over the assemblies of the different affine terms.
+            if(this->current_affine_term != H2D_ALL_AFFINE_TERMS && form->affine_term != this->current_affine_term)
+              continue;
+            Scalar mass, diffusion, convection_x, convection_y;
+            form->get_constant_coefficients(mass, diffusion, convection_x, convection_y);
 
-            this->cache_records_element[i] = (CacheRecordPerElement**)realloc(this->cache_records_element[i], max_size * sizeof(CacheRecordPerElement*));
-            memset(this->cache_records_element[i] + this->cache_size, NULL, (max_size - this->cache_size) * sizeof(CacheRecordPerElement*));
-          }
+            int first = batch_first_elements[batch_i];
+            int count = std::min((int)group->states.size() - first, batch_size);
+            int np = group->table_i->np;
+            int cnt_i = group->cnt_i, cnt_j = group->cnt_j;
+            double3* pt = g_quad_2d_std.get_points(group->order, group->mode);
+            BatchedPairSumsFn pair_sums = get_batched_pair_sums(np);
 
-          this->cache_size = max_size;
-        }
+            // Physical x- and y-derivatives of the test functions and the basis functions of one element.
+            gradients.resize(2 * (cnt_i + cnt_j) * np);
+            local_matrices.assign(count * cnt_i * cnt_j, Scalar(0));
 
-        for(unsigned int i = 0; i < spaces.size(); i++)
-        {
-          for(unsigned int j = 0; j < cache_size; j++)
-          {
-            if(j < spaces[i]->get_mesh()->get_max_element_id())
+            for (int e = 0; e < count && group->integrals != NULL; e++)
             {
-              if(spaces[i]->get_mesh()->get_element(j) == NULL || !spaces[i]->get_mesh()->get_element(j)->active || spaces[i]->get_element_order(spaces[i]->get_mesh()->get_element(j)->id) < 0)
-              {
-                if(this->cache_records_sub_idx[i][j] != NULL)
+              // With u_x = g1 r_x + g2 r_y, u_y = g3 r_x + g4 r_y (r the reference derivatives), the products of the physical
+              // derivatives are combinations of the reference integrals with constant coefficients.
+              const double* geometry = &group->geometry[(first + e) * 5];
+              const int* positions_i = &group->columns_i[(first + e) * cnt_i];
+              const int* positions_j = &group->columns_j[(first + e) * cnt_j];
+              const ReferenceIntegrals* integrals = group->integrals;
+              int n_j = integrals->get_num_j();
+              Scalar c_mass = geometry[0] * mass;
+              Scalar c_dx_dx = geometry[0] * diffusion * (geometry[1] * geometry[1] + geometry[3] * geometry[3]);
+              Scalar c_dy_dy = geometry[0] * diffusion * (geometry[2] * geometry[2] + geometry[4] * geometry[4]);
+              Scalar c_dx_dy = geometry[0] * diffusion * (geometry[1] * geometry[2] + geometry[3] * geometry[4]);
+              Scalar c_dx_v = geometry[0] * (convection_x * geometry[1] + convection_y * geometry[3]);
+              Scalar c_dy_v = geometry[0] * (convection_x * geometry[2] + convection_y * geometry[4]);
+              const double* tables[H2D_RI_NUM];
+              for (int integral = 0; integral < H2D_RI_NUM; integral++)
+                tables[integral] = integrals->get_table((ReferenceIntegral)integral);
+
+              Scalar* local = &local_matrices[e * cnt_i * cnt_j];
+              for (int i = 0; i < cnt_i; i++)
+                for (int j = 0; j < cnt_j; j++)
                 {
-                  for(typename std::map<uint64_t, CacheRecordPerSubIdx*>::iterator it = this->cache_records_sub_idx[i][j]->begin(); it != this->cache_records_sub_idx[i][j]->end(); it++)
-                    it->second->clear();
+                  int position = positions_i[i] * n_j + positions_j[j];
+                  local[i * cnt_j + j] = c_mass * tables[H2D_RI_MASS][position] + c_dx_dx * tables[H2D_RI_DX_DX][position]
+                    + c_dy_dy * tables[H2D_RI_DY_DY][position] + c_dx_dy * tables[H2D_RI_DX_DY][position]
+                    + c_dx_v * tables[H2D_RI_DX_V][position] + c_dy_v * tables[H2D_RI_DY_V][position];
+                }
+            }
 
-                  this->cache_records_sub_idx[i][j]->clear();
-                  delete this->cache_records_sub_idx[i][j];
-                  this->cache_records_sub_idx[i][j] = NULL;
+            for (int e = 0; e < count && group->integrals == NULL; e++)
+            {
+              const double* geometry = &group->geometry[(first + e) * 5];
+              const int* columns[2] = { &group->columns_i[(first + e) * cnt_i], &group->columns_j[(first + e) * cnt_j] };
+              BatchShapeTable* tables[2] = { group->table_i, group->table_j };
+              int cnts[2] = { cnt_i, cnt_j };
+              double* grads[2] = { &gradients[0], &gradients[2 * cnt_i * np] };
+              for (int side = 0; side < 2; side++)
+                for (int k = 0; k < cnts[side]; k++)
+                {
+                  const double* dx = &tables[side]->values[(columns[side][k] * 3 + 1) * np];
+                  const double* dy = dx + np;
+                  double* gx = grads[side] + 2 * k * np;
+                  double* gy = gx + np;
+                  for (int q = 0; q < np; q++)
+                  {
+                    gx[q] = dx[q] * geometry[1] + dy[q] * geometry[2];
+                    gy[q] = dx[q] * geometry[3] + dy[q] * geometry[4];
+                  }
                 }
-                if(this->cache_records_element[i][j] != NULL)
+
+              Scalar* local = &local_matrices[e * cnt_i * cnt_j];
+              for (int i = 0; i < cnt_i; i++)
+              {
+                const double* val_i = &group->table_i->values[columns[0][i] * 3 * np];
+                const double* gx_i = grads[0] + 2 * i * np;
+                const double* gy_i = gx_i + np;
+                for (int j = 0; j < cnt_j; j++)
                 {
-                  this->cache_records_element[i][j]->clear();
-                  delete this->cache_records_element[i][j];
-                  this->cache_records_element[i][j] = NULL;
+                  const double* val_j = &group->table_j->values[columns[1][j] * 3 * np];
+                  const double* gx_j = grads[1] + 2 * j * np;
+                  const double* gy_j = gx_j + np;
+                  double sums[4];
+                  pair_sums(np, pt, val_i, gx_i, gy_i, val_j, gx_j, gy_j, sums);
+                  local[i * cnt_j + j] = geometry[0] * (mass * sums[0] + diffusion * sums[1]
+                    + convection_x * sums[2] + convection_y * sums[3]);
                 }
               }
             }
-            else
+
+            // Scatter.
+            double coefficient = this->block_scaling_coeff(form) * form->scaling_factor;
+            bool tra = (form->i != form->j) && (form->sym != 0);
+            rows.resize(std::max(cnt_i, cnt_j));
+            std::vector<Scalar> transposed(tra ? cnt_i * cnt_j : 0);
+            for (int e = 0; e < count; e++)
             {
-              if(this->cache_records_sub_idx[i][j] != NULL)
-              {
-                for(typename std::map<uint64_t, CacheRecordPerSubIdx*>::iterator it = this->cache_records_sub_idx[i][j]->begin(); it != this->cache_records_sub_idx[i][j]->end(); it++)
-                  it->second->clear();
+              Scalar* local = &local_matrices[e * cnt_i * cnt_j];
+              int* dofs_i = &group->dofs_i[(first + e) * cnt_i];
+              int* dofs_j = &group->dofs_j[(first + e) * cnt_j];
+              const Scalar* coefs_i = &group->coefs_i[(first + e) * cnt_i];
+              const Scalar* coefs_j = &group->coefs_j[(first + e) * cnt_j];
+              for (int i = 0; i < cnt_i; i++)
+                for (int j = 0; j < cnt_j; j++)
+                {
+                  if(dofs_i[i] < 0 || dofs_j[j] < 0 || std::abs(coefs_i[i]) < 1e-12 || std::abs(coefs_j[j]) < 1e-12)
+                    local[i * cnt_j + j] = 0;
+                  else
+                    local[i * cnt_j + j] *= coefficient * coefs_i[i] * coefs_j[j];
+                }
 
-                this->cache_records_sub_idx[i][j]->clear();
-                delete this->cache_records_sub_idx[i][j];
-                this->cache_records_sub_idx[i][j] = NULL;
-              }
-              if(this->cache_records_element[i][j] != NULL)
+              for (int i = 0; i < cnt_i; i++)
+                rows[i] = local + i * cnt_j;
+              this->add_to_matrix(cnt_i, cnt_j, &rows[0], dofs_i, dofs_j);
+
+              if(tra)
               {
-                this->cache_records_element[i][j]->clear();
-                delete this->cache_records_element[i][j];
-                this->cache_records_element[i][j] = NULL;
+                for (int i = 0; i < cnt_i; i++)
+                  for (int j = 0; j < cnt_j; j++)
+                    transposed[j * cnt_i + i] = (form->sym < 0) ? -local[i * cnt_j + j] : local[i * cnt_j + j];
+                for (int j = 0; j < cnt_j; j++)
+                  rows[j] = &transposed[j * cnt_i];
+                this->add_to_matrix(cnt_j, cnt_i, &rows[0], dofs_j, dofs_i);
               }
             }
           }
+          catch(Hermes::Exceptions::Exception& e)
+          {
+            omp_set_lock(&this->caught_exception_lock);
+            if(this->caughtException == NULL)
+              this->caughtException = e.clone();
+            omp_unset_lock(&this->caught_exception_lock);
+          }
+          catch(std::exception& e)
+          {
+            omp_set_lock(&this->caught_exception_lock);
+            if(this->caughtException == NULL)
+              this->caughtException = new Hermes::Exceptions::Exception(e.what());
+            omp_unset_lock(&this->caught_exception_lock);
+          }
         }
       }
-
-      this->ndof = Space<Scalar>::get_num_dofs(this->spaces);
-      this->spaces_size = this->spaces.size();
     }
 
     template<typename Scalar>
-    void DiscreteProblem<Scalar>::set_space(const Space<Scalar>* space)
+    void DiscreteProblem<Scalar>::set_static_condensation(bool to_set)
     {
-      Hermes::vector<const Space<Scalar>*> spaces;
-      spaces.push_back(space);
-      this->set_spaces(spaces);
+      if(this->static_condensation == to_set)
+        return;
+      this->static_condensation = to_set;
+      // The matrix has a different size now.
+      this->have_matrix = false;
+      if(!to_set)
+        this->free_static_condensation();
     }
 
     template<typename Scalar>
-    double DiscreteProblem<Scalar>::block_scaling_coeff(MatrixForm<Scalar>* form) const
+    int DiscreteProblem<Scalar>::get_num_condensed_dofs() const
     {
-      if(current_block_weights != NULL)
-        return current_block_weights->get_A(form->i, form->j);
-      return 1.0;
+      if(!this->static_condensation || this->condensed_dof_index == NULL)
+        return this->ndof;
+      return this->condensed_ndof;
     }
 
     template<typename Scalar>
-    double DiscreteProblem<Scalar>::block_scaling_coeff(MatrixFormDG<Scalar>* form) const
+    int DiscreteProblem<Scalar>::get_condensed_dof_index(int dof) const
     {
-      if(current_block_weights != NULL)
-        return current_block_weights->get_A(form->i, form->j);
-      return 1.0;
+      if(!this->static_condensation || this->condensed_dof_index == NULL)
+        return dof;
+      if(dof < 0 || dof >= this->ndof)
+        throw Exceptions::ValueException("dof", dof, 0, this->ndof);
+      return this->condensed_dof_index[dof];
     }
 
     template<typename Scalar>
-    bool DiscreteProblem<Scalar>::form_to_be_assembled(MatrixForm<Scalar>* form, Traverse::State* current_state)
+    void DiscreteProblem<Scalar>::expand_condensed_solution(const Scalar* condensed_solution, Scalar* solution) const
     {
-      if(current_state->e[form->i] == NULL || current_state->e[form->j] == NULL)
-        return false;
-      if(fabs(form->scaling_factor) < 1e-12)
-        return false;
+      if(!this->static_condensation || this->condensed_dof_index == NULL)
+      {
+        memcpy(solution, condensed_solution, this->ndof * sizeof(Scalar));
+        return;
+      }
 
-      // If a block scaling table is provided, and if the scaling coefficient
-      // A_mn for this block is zero, then the form does not need to be assembled.
-      if(current_block_weights != NULL)
-        if(fabs(current_block_weights->get_A(form->i, form->j)) < 1e-12)
-          return false;
-      return true;
+      for (int dof = 0; dof < this->ndof; dof++)
+        if(this->condensed_dof_index[dof] >= 0)
+          solution[dof] = condensed_solution[this->condensed_dof_index[dof]];
+
+      // u_b = A_bb^{-1} (f_b - A_bi u_i), the bubble DOFs of the elements are disjoint.
+      int num_threads_used = this->get_num_threads();
+#pragma omp parallel for num_threads(num_threads_used) schedule(dynamic, 64)
+      for (int id = 0; id < this->condensed_elements_size; id++)
+      {
+        CondensedElement* record = this->condensed_elements[id];
+        if(record == NULL)
+          continue;
+        for (int b = 0; b < record->num_bubble; b++)
+        {
+          Scalar value = record->y[b];
+          for (int i = 0; i < record->num_interface; i++)
+            value -= record->X[b * record->num_interface + i] * solution[record->interface_dofs[i]];
+          solution[record->bubble_dofs[b]] = value;
+        }
+      }
     }
 
     template<typename Scalar>
-    bool DiscreteProblem<Scalar>::form_to_be_assembled(MatrixFormVol<Scalar>* form, Traverse::State* current_state)
+    Hermes::vector<const Space<Scalar>*> DiscreteProblem<Scalar>::get_spaces() const
     {
-      if(!form_to_be_assembled((MatrixForm<Scalar>*)form, current_state))
-        return false;
+      return this->spaces;
+    }
 
-      // Assemble this form only if one of its areas is HERMES_ANY
-      // of if the element marker coincides with one of the form's areas.
-      bool assemble_this_form = false;
-      for (unsigned int ss = 0; ss < form->areas.size(); ss++)
+    template<typename Scalar>
+    const WeakForm<Scalar>* DiscreteProblem<Scalar>::get_weak_formulation() const
+    {
+      return this->wf;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::set_weak_formulation(const WeakForm<Scalar>* wf)
+    {
+      if(wf == NULL)
+        throw Hermes::Exceptions::NullException(0);
+
+      this->wf = wf;
+      this->have_matrix = false;
+      this->form_order_caches.clear();
+      this->free_thread_weakforms();
+
+      if(!this->wf->mfDG.empty())
+        this->DG_matrix_forms_present = true;
+
+      if(!this->wf->vfDG.empty())
+        this->DG_vector_forms_present = true;
+    }
+
+    template<typename Scalar>
+    bool DiscreteProblem<Scalar>::is_matrix_free() const
+    {
+      return wf->is_matrix_free();
+    }
+
+    template<typename Scalar>
+    bool DiscreteProblem<Scalar>::assemble_jacobian_vector_product(Scalar* coeff_vec, Scalar* direction, Scalar* result)
+    {
+      MatrixFreeJacobian<Scalar> jacobian(this, coeff_vec);
+      jacobian.multiply_with_vector(direction, result);
+      return true;
+    }
+
+    template<typename Scalar>
+    bool DiscreteProblem<Scalar>::is_up_to_date() const
+    {
+      // check if we can reuse the matrix structure
+      bool up_to_date = true;
+      if(!have_matrix)
+        up_to_date = false;
+
+      for (unsigned int i = 0; i < wf->get_neq(); i++)
+      {
+        if(spaces[i]->get_seq() != sp_seq[i])
+        {
+          up_to_date = false;
+          break;
+        }
+      }
+
+      return up_to_date;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::set_fvm()
+    {
+      this->is_fvm = true;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::delete_cache()
+    {
+      for(unsigned int i = 0; i < spaces.size(); i++)
+      {
+        for(unsigned int j = 0; j < cache_size; j++)
+        {
+          if(this->cache_records_sub_idx[i][j] != NULL)
+          {
+            this->cache_records_sub_idx[i][j]->clear();
+            delete this->cache_records_sub_idx[i][j];
+            this->cache_records_sub_idx[i][j] = NULL;
+          }
+          if(this->cache_records_element[i][j] != NULL)
+          {
+            this->cache_records_element[i][j]->clear();
+            delete this->cache_records_element[i][j];
+            this->cache_records_element[i][j] = NULL;
+          }
+        }
+        free(cache_records_sub_idx[i]);
+        free(cache_records_element[i]);
+      }
+      delete [] this->cache_records_sub_idx;
+      delete [] this->cache_records_element;
+    }
+
+    template<typename Scalar>
+    double DiscreteProblem<Scalar>::get_cache_hit_rate() const
+    {
+      if(this->cache_hits + this->cache_misses == 0)
+        return 0.0;
+      return this->cache_hits / (double)(this->cache_hits + this->cache_misses);
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::reset_cache_statistics()
+    {
+      this->cache_hits = this->cache_misses = this->cache_evictions = 0;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::free_cache_records(unsigned int space_i)
+    {
+      for(unsigned int j = 0; j < this->cache_size; j++)
+      {
+        if(this->cache_records_sub_idx[space_i][j] != NULL)
+        {
+          this->cache_records_sub_idx[space_i][j]->clear();
+          delete this->cache_records_sub_idx[space_i][j];
+          this->cache_records_sub_idx[space_i][j] = NULL;
+        }
+        if(this->cache_records_element[space_i][j] != NULL)
+        {
+          this->cache_records_element[space_i][j]->clear();
+          delete this->cache_records_element[space_i][j];
+          this->cache_records_element[space_i][j] = NULL;
+        }
+      }
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::enforce_cache_memory_budget()
+    {
+      int budget_mb = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::cacheMemoryBudget);
+      if(budget_mb <= 0)
+        return;
+      std::size_t budget = (std::size_t)budget_mb * 1024 * 1024;
+
+      // Cached elements: (last use, (space, element id)), and their memory.
+      std::vector<std::pair<unsigned int, std::pair<int, int> > > cached_elements;
+      std::size_t total_size = 0;
+      for(unsigned int i = 0; i < this->spaces_size; i++)
+        for(unsigned int j = 0; j < this->cache_size; j++)
+        {
+          if(this->cache_records_sub_idx[i][j] == NULL && this->cache_records_element[i][j] == NULL)
+            continue;
+          std::size_t size = 0;
+          if(this->cache_records_sub_idx[i][j] != NULL)
+            size += this->cache_records_sub_idx[i][j]->get_memory_size();
+          unsigned int last_used = 0;
+          if(this->cache_records_element[i][j] != NULL)
+          {
+            size += sizeof(CacheRecordPerElement) + this->cache_records_element[i][j]->asmlistCnt * sizeof(int);
+            last_used = this->cache_records_element[i][j]->last_used;
+          }
+          total_size += size;
+          cached_elements.push_back(std::pair<unsigned int, std::pair<int, int> >(last_used, std::pair<int, int>(i, j)));
+        }
+
+      if(total_size <= budget)
+        return;
+
+      // Oldest first, the sizes are recalculated in this order rather than sorted along.
+      std::sort(cached_elements.begin(), cached_elements.end());
+      for(unsigned int k = 0; k < cached_elements.size() && total_size > budget; k++)
+      {
+        int i = cached_elements[k].second.first;
+        int j = cached_elements[k].second.second;
+        if(this->cache_records_sub_idx[i][j] != NULL)
+        {
+          total_size -= this->cache_records_sub_idx[i][j]->get_memory_size();
+          this->cache_records_sub_idx[i][j]->clear();
+          delete this->cache_records_sub_idx[i][j];
+          this->cache_records_sub_idx[i][j] = NULL;
+        }
+        if(this->cache_records_element[i][j] != NULL)
+        {
+          total_size -= sizeof(CacheRecordPerElement) + this->cache_records_element[i][j]->asmlistCnt * sizeof(int);
+          this->cache_records_element[i][j]->clear();
+          delete this->cache_records_element[i][j];
+          this->cache_records_element[i][j] = NULL;
+        }
+        this->cache_evictions++;
+      }
+    }
+
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::CacheElementKey::CacheElementKey() : nvert(0), order(-1), shapeset_id(-1)
+    {
+    }
+
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::CacheElementKey::CacheElementKey(Element* e, int order, int shapeset_id) : nvert(0), order(order), shapeset_id(shapeset_id)
+    {
+      if(e->is_curved())
+        return;
+      this->nvert = e->get_nvert();
+      for(int i = 0; i < this->nvert; i++)
+      {
+        this->coordinates[2 * i] = e->vn[i]->x;
+        this->coordinates[2 * i + 1] = e->vn[i]->y;
+      }
+    }
+
+    template<typename Scalar>
+    bool DiscreteProblem<Scalar>::CacheElementKey::operator<(const CacheElementKey& other) const
+    {
+      if(this->nvert != other.nvert)
+        return this->nvert < other.nvert;
+      if(this->order != other.order)
+        return this->order < other.order;
+      if(this->shapeset_id != other.shapeset_id)
+        return this->shapeset_id < other.shapeset_id;
+      for(int i = 0; i < 2 * this->nvert; i++)
+        if(this->coordinates[i] != other.coordinates[i])
+          return this->coordinates[i] < other.coordinates[i];
+      return false;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::reuse_cache_records(unsigned int space_i)
+    {
+      // Cached elements by their keys.
+      std::map<CacheElementKey, int> cached_elements;
+      for(unsigned int j = 0; j < this->cache_size; j++)
+        if(this->cache_records_element[space_i][j] != NULL && this->cache_records_element[space_i][j]->element_key.nvert > 0)
+          cached_elements.insert(std::pair<CacheElementKey, int>(this->cache_records_element[space_i][j]->element_key, j));
+
+      SubIdxCacheTable** new_cache_records_sub_idx = (SubIdxCacheTable**)malloc(this->cache_size * sizeof(SubIdxCacheTable*));
+      memset(new_cache_records_sub_idx, NULL, this->cache_size * sizeof(SubIdxCacheTable*));
+      CacheRecordPerElement** new_cache_records_element = (CacheRecordPerElement**)malloc(this->cache_size * sizeof(CacheRecordPerElement*));
+      memset(new_cache_records_element, NULL, this->cache_size * sizeof(CacheRecordPerElement*));
+
+      // Elements changed in the last adaptation are recalculated anyway, all others keep their data.
+      Element* e;
+      for_all_active_elements(e, this->spaces[space_i]->get_mesh())
+      {
+        if(e->id >= this->cache_size)
+          continue;
+        int order = this->spaces[space_i]->get_element_order(e->id);
+        if(order < 0 || this->spaces[space_i]->edata[e->id].changed_in_last_adaptation)
+          continue;
+
+        CacheElementKey key(e, order, this->spaces[space_i]->get_shapeset()->get_id());
+        if(key.nvert == 0)
+          continue;
+        typename std::map<CacheElementKey, int>::iterator it = cached_elements.find(key);
+        if(it == cached_elements.end())
+          continue;
+
+        new_cache_records_sub_idx[e->id] = this->cache_records_sub_idx[space_i][it->second];
+        new_cache_records_element[e->id] = this->cache_records_element[space_i][it->second];
+        this->cache_records_sub_idx[space_i][it->second] = NULL;
+        this->cache_records_element[space_i][it->second] = NULL;
+        cached_elements.erase(it);
+      }
+
+      // Delete the data of elements that were not found.
+      for(unsigned int j = 0; j < this->cache_size; j++)
+      {
+        if(this->cache_records_sub_idx[space_i][j] != NULL)
+        {
+          this->cache_records_sub_idx[space_i][j]->clear();
+          delete this->cache_records_sub_idx[space_i][j];
+        }
+        if(this->cache_records_element[space_i][j] != NULL)
+        {
+          this->cache_records_element[space_i][j]->clear();
+          delete this->cache_records_element[space_i][j];
+        }
+      }
+      free(this->cache_records_sub_idx[space_i]);
+      free(this->cache_records_element[space_i]);
+
+      this->cache_records_sub_idx[space_i] = new_cache_records_sub_idx;
+      this->cache_records_element[space_i] = new_cache_records_element;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::set_spaces(Hermes::vector<const Space<Scalar>*> spacesToSet)
+    {
+      for(unsigned int i = 0; i < spacesToSet.size(); i++)
+        spacesToSet[i]->check();
+
+      if(this->spaces_size != spacesToSet.size() && this->spaces_size > 0)
+        throw Hermes::Exceptions::LengthException(0, spacesToSet.size(), this->spaces_size);
+
+      int originalSize = this->spaces.size();
+
+      this->spaces = spacesToSet;
+
+      this->ndof = Space<Scalar>::get_num_dofs(spaces);
+
+      /// \todo TEMPORARY There is something wrong with caching vector shapesets.
+      for(unsigned int i = 0; i < spacesToSet.size(); i++)
+        if(spacesToSet[i]->get_shapeset()->get_num_components() > 1)
+          this->do_not_use_cache = true;
+
+      have_matrix = false;
+
+      unsigned int first_dof_running = 0;
+      this->spaces_first_dofs.clear();
+      for(unsigned int i = 0; i < spaces.size(); i++)
+      {
+        // Interleaved DOFs are numbered in the whole system already.
+        this->spaces_first_dofs.push_back(spaces.at(i)->has_interleaved_dofs() ? 0 : first_dof_running);
+        first_dof_running += spaces.at(i)->get_num_dofs();
+      }
+
+      if(originalSize == 0)
+      {
+        // Internal variables settings.
+        sp_seq = new int[spaces.size()];
+        memset(sp_seq, -1, sizeof(int) * spaces.size());
+
+        // Matrix<Scalar> related settings.
+        have_matrix = false;
+
+        cache_records_sub_idx = new SubIdxCacheTable**[spaces.size()];
+        cache_records_element = new CacheRecordPerElement**[spaces.size()];
+
+        this->cache_size = spaces[0]->get_mesh()->get_max_element_id() + 1;
+        for(unsigned int i = 1; i < spaces.size(); i++)
+        {
+          int cache_size_i = spaces[i]->get_mesh()->get_max_element_id() + 1;
+          if(cache_size_i > cache_size)
+            this->cache_size = cache_size_i;
+        }
+
+        for(unsigned int i = 0; i < spaces.size(); i++)
+        {
+          cache_records_sub_idx[i] = (SubIdxCacheTable**)malloc(this->cache_size * sizeof(SubIdxCacheTable*));
+          memset(cache_records_sub_idx[i], NULL, this->cache_size * sizeof(SubIdxCacheTable*));
+
+          cache_records_element[i] = (CacheRecordPerElement**)malloc(this->cache_size * sizeof(CacheRecordPerElement*));
+          memset(cache_records_element[i], NULL, this->cache_size * sizeof(CacheRecordPerElement*));
+        }
+        cache_element_stored = NULL;
+      }
+      else
+      {
+        int max_size = spacesToSet[0]->get_mesh()->get_max_element_id();
+        for(unsigned int i = 1; i < spacesToSet.size(); i++)
+        {
+          int max_size_i = spacesToSet[i]->get_mesh()->get_max_element_id();
+          if(max_size_i > max_size)
+            max_size = max_size_i;
+          sp_seq[i] = spacesToSet[i]->get_seq();
+        }
+
+        if(max_size > this->cache_size + 1)
+        {
+          for(unsigned int i = 0; i < this->spaces_size; i++)
+          {
+            this->cache_records_sub_idx[i] = (SubIdxCacheTable**)realloc(this->cache_records_sub_idx[i], max_size * sizeof(SubIdxCacheTable*));
+            memset(this->cache_records_sub_idx[i] + this->cache_size, NULL, (max_size - this->cache_size) * sizeof(SubIdxCacheTable*));
+
+            this->cache_records_element[i] = (CacheRecordPerElement**)realloc(this->cache_records_element[i], max_size * sizeof(CacheRecordPerElement*));
+            memset(this->cache_records_element[i] + this->cache_size, NULL, (max_size - this->cache_size) * sizeof(CacheRecordPerElement*));
+          }
+
+          this->cache_size = max_size;
+        }
+
+        for(unsigned int i = 0; i < spaces.size(); i++)
+          this->reuse_cache_records(i);
+      }
+
+      this->ndof = Space<Scalar>::get_num_dofs(this->spaces);
+      this->spaces_size = this->spaces.size();
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::set_space(const Space<Scalar>* space)
+    {
+      Hermes::vector<const Space<Scalar>*> spaces;
+      spaces.push_back(space);
+      this->set_spaces(spaces);
+    }
+
+    template<typename Scalar>
+    double DiscreteProblem<Scalar>::block_scaling_coeff(MatrixForm<Scalar>* form) const
+    {
+      if(current_block_weights != NULL)
+        return current_block_weights->get_A(form->i, form->j);
+      return 1.0;
+    }
+
+    template<typename Scalar>
+    double DiscreteProblem<Scalar>::block_scaling_coeff(MatrixFormDG<Scalar>* form) const
+    {
+      if(current_block_weights != NULL)
+        return current_block_weights->get_A(form->i, form->j);
+      return 1.0;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::set_affine_term(int q)
+    {
+      if(q < H2D_ALL_AFFINE_TERMS)
+        throw Exceptions::ValueException("q", q, H2D_ALL_AFFINE_TERMS);
+      this->current_affine_term = q;
+    }
+
+    template<typename Scalar>
+    bool DiscreteProblem<Scalar>::form_to_be_assembled(MatrixForm<Scalar>* form, Traverse::State* current_state)
+    {
+      if(current_state->e[form->i] == NULL || current_state->e[form->j] == NULL)
+        return false;
+      if(fabs(form->scaling_factor) < 1e-12)
+        return false;
+      if(this->current_affine_term != H2D_ALL_AFFINE_TERMS && form->affine_term != this->current_affine_term)
+        return false;
+
+      // If a block scaling table is provided, and if the scaling coefficient
+      // A_mn for this block is zero, then the form does not need to be assembled.
+      if(current_block_weights != NULL)
+        if(fabs(current_block_weights->get_A(form->i, form->j)) < 1e-12)
+          return false;
+      return true;
+    }
+
+    template<typename Scalar>
+    bool DiscreteProblem<Scalar>::form_to_be_assembled(MatrixFormVol<Scalar>* form, int form_i, Traverse::State* current_state)
+    {
+      if(!form_to_be_assembled((MatrixForm<Scalar>*)form, current_state))
+        return false;
+
+      // Assemble this form only if one of its areas is HERMES_ANY
+      // of if the element marker coincides with one of the form's areas.
+      return this->mfvol_markers.is_active(form_i, current_state->rep->marker);
+    }
+
+    template<typename Scalar>
+    bool DiscreteProblem<Scalar>::form_to_be_assembled(MatrixFormSurf<Scalar>* form, int form_i, Traverse::State* current_state)
+    {
+      if(current_state->rep->en[current_state->isurf]->marker == 0)
+        return false;
+
+      if(form->areas[0] == H2D_DG_INNER_EDGE)
+        return false;
+      if(!form_to_be_assembled((MatrixForm<Scalar>*)form, current_state))
+        return false;
+
+      return this->mfsurf_markers.is_active(form_i, current_state->rep->en[current_state->isurf]->marker);
+    }
+
+    template<typename Scalar>
+    bool DiscreteProblem<Scalar>::form_to_be_assembled(VectorForm<Scalar>* form, Traverse::State* current_state)
+    {
+      if(current_state->e[form->i] == NULL)
+        return false;
+      if(fabs(form->scaling_factor) < 1e-12)
+        return false;
+      if(this->current_affine_term != H2D_ALL_AFFINE_TERMS && form->affine_term != this->current_affine_term)
+        return false;
+
+      return true;
+    }
+
+    template<typename Scalar>
+    bool DiscreteProblem<Scalar>::form_to_be_assembled(VectorFormVol<Scalar>* form, int form_i, Traverse::State* current_state)
+    {
+      if(!form_to_be_assembled((VectorForm<Scalar>*)form, current_state))
+        return false;
+
+      // Assemble this form only if one of its areas is HERMES_ANY
+      // of if the element marker coincides with one of the form's areas.
+      return this->vfvol_markers.is_active(form_i, current_state->rep->marker);
+    }
+
+    template<typename Scalar>
+    bool DiscreteProblem<Scalar>::form_to_be_assembled(VectorFormSurf<Scalar>* form, int form_i, Traverse::State* current_state)
+    {
+      if(current_state->rep->en[current_state->isurf]->marker == 0)
+        return false;
+
+      if(form->areas[0] == H2D_DG_INNER_EDGE)
+        return false;
+
+      if(!form_to_be_assembled((VectorForm<Scalar>*)form, current_state))
+        return false;
+
+      return this->vfsurf_markers.is_active(form_i, current_state->rep->en[current_state->isurf]->marker);
+    }
+
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::FormMarkerTable::FormMarkerTable() : num_markers(0)
+    {
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::FormMarkerTable::init(const std::vector<std::vector<int> >& form_markers, const std::vector<bool>& any_marker)
+    {
+      this->num_markers = 0;
+      for(unsigned int form_i = 0; form_i < form_markers.size(); form_i++)
+        for(unsigned int i = 0; i < form_markers[form_i].size(); i++)
+          this->num_markers = std::max(this->num_markers, form_markers[form_i][i] + 1);
+
+      this->active.assign(form_markers.size() * this->num_markers, 0);
+      this->any_marker.assign(form_markers.size(), 0);
+      for(unsigned int form_i = 0; form_i < form_markers.size(); form_i++)
+      {
+        if(any_marker[form_i])
+        {
+          this->any_marker[form_i] = 1;
+          std::fill(this->active.begin() + form_i * this->num_markers, this->active.begin() + (form_i + 1) * this->num_markers, 1);
+        }
+        for(unsigned int i = 0; i < form_markers[form_i].size(); i++)
+          this->active[form_i * this->num_markers + form_markers[form_i][i]] = 1;
+      }
+    }
+
+    /// The internal markers of the areas of a form, an area counts if it has the same internal marker
+    /// on the meshes of both spaces of the form.
+    static void get_form_internal_markers(const Hermes::vector<std::string>& areas, const Mesh* mesh_i, const Mesh* mesh_j, bool boundary,
+      std::vector<int>& markers, bool& any_marker)
+    {
+      any_marker = false;
+      for (unsigned int ss = 0; ss < areas.size(); ss++)
+      {
+        if(areas[ss] == HERMES_ANY)
+        {
+          any_marker = true;
+          continue;
+        }
+        int marker_i, marker_j;
+        bool valid_i, valid_j;
+        if(boundary)
+        {
+          valid_i = mesh_i->get_boundary_markers_conversion().get_internal_marker(areas[ss]).valid;
+          marker_i = mesh_i->get_boundary_markers_conversion().get_internal_marker(areas[ss]).marker;
+          valid_j = mesh_j->get_boundary_markers_conversion().get_internal_marker(areas[ss]).valid;
+          marker_j = mesh_j->get_boundary_markers_conversion().get_internal_marker(areas[ss]).marker;
+        }
+        else
+        {
+          valid_i = mesh_i->get_element_markers_conversion().get_internal_marker(areas[ss]).valid;
+          marker_i = mesh_i->get_element_markers_conversion().get_internal_marker(areas[ss]).marker;
+          valid_j = mesh_j->get_element_markers_conversion().get_internal_marker(areas[ss]).valid;
+          marker_j = mesh_j->get_element_markers_conversion().get_internal_marker(areas[ss]).marker;
+        }
+        if(valid_i && valid_j && marker_i == marker_j && marker_i >= 0)
+          markers.push_back(marker_i);
+      }
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::init_form_marker_tables()
+    {
+      std::vector<std::vector<int> > markers;
+      std::vector<bool> any_marker;
+      bool any;
+
+      markers.assign(this->wf->mfvol.size(), std::vector<int>());
+      any_marker.assign(this->wf->mfvol.size(), false);
+      for(unsigned int form_i = 0; form_i < this->wf->mfvol.size(); form_i++)
+      {
+        MatrixFormVol<Scalar>* form = this->wf->mfvol[form_i];
+        get_form_internal_markers(form->areas, this->spaces[form->i]->get_mesh(), this->spaces[form->j]->get_mesh(), false, markers[form_i], any);
+        any_marker[form_i] = any;
+      }
+      this->mfvol_markers.init(markers, any_marker);
+
+      markers.assign(this->wf->mfsurf.size(), std::vector<int>());
+      any_marker.assign(this->wf->mfsurf.size(), false);
+      for(unsigned int form_i = 0; form_i < this->wf->mfsurf.size(); form_i++)
+      {
+        MatrixFormSurf<Scalar>* form = this->wf->mfsurf[form_i];
+        get_form_internal_markers(form->areas, this->spaces[form->i]->get_mesh(), this->spaces[form->j]->get_mesh(), true, markers[form_i], any);
+        any_marker[form_i] = any;
+      }
+      this->mfsurf_markers.init(markers, any_marker);
+
+      markers.assign(this->wf->vfvol.size(), std::vector<int>());
+      any_marker.assign(this->wf->vfvol.size(), false);
+      for(unsigned int form_i = 0; form_i < this->wf->vfvol.size(); form_i++)
+      {
+        VectorFormVol<Scalar>* form = this->wf->vfvol[form_i];
+        get_form_internal_markers(form->areas, this->spaces[form->i]->get_mesh(), this->spaces[form->i]->get_mesh(), false, markers[form_i], any);
+        any_marker[form_i] = any;
+      }
+      this->vfvol_markers.init(markers, any_marker);
+
+      markers.assign(this->wf->vfsurf.size(), std::vector<int>());
+      any_marker.assign(this->wf->vfsurf.size(), false);
+      for(unsigned int form_i = 0; form_i < this->wf->vfsurf.size(); form_i++)
+      {
+        VectorFormSurf<Scalar>* form = this->wf->vfsurf[form_i];
+        get_form_internal_markers(form->areas, this->spaces[form->i]->get_mesh(), this->spaces[form->i]->get_mesh(), true, markers[form_i], any);
+        any_marker[form_i] = any;
+      }
+      this->vfsurf_markers.init(markers, any_marker);
+
+      // The volumetric forms restricted to some element markers restrict their spaces, any other form leaves its spaces unrestricted.
+      std::vector<bool> unrestricted(this->spaces.size(), !this->wf->mfDG.empty() || !this->wf->vfDG.empty());
+      for(unsigned int form_i = 0; form_i < this->wf->mfsurf.size(); form_i++)
+        unrestricted[this->wf->mfsurf[form_i]->i] = unrestricted[this->wf->mfsurf[form_i]->j] = true;
+      for(unsigned int form_i = 0; form_i < this->wf->vfsurf.size(); form_i++)
+        unrestricted[this->wf->vfsurf[form_i]->i] = true;
+
+      this->space_element_markers.assign(this->spaces.size(), std::vector<int>());
+      for(unsigned int form_i = 0; form_i < this->wf->mfvol.size(); form_i++)
+      {
+        MatrixFormVol<Scalar>* form = this->wf->mfvol[form_i];
+        std::vector<int> form_markers;
+        get_form_internal_markers(form->areas, this->spaces[form->i]->get_mesh(), this->spaces[form->j]->get_mesh(), false, form_markers, any);
+        if(any)
+          unrestricted[form->i] = unrestricted[form->j] = true;
+        this->space_element_markers[form->i].insert(this->space_element_markers[form->i].end(), form_markers.begin(), form_markers.end());
+        this->space_element_markers[form->j].insert(this->space_element_markers[form->j].end(), form_markers.begin(), form_markers.end());
+      }
+      for(unsigned int form_i = 0; form_i < this->wf->vfvol.size(); form_i++)
+      {
+        VectorFormVol<Scalar>* form = this->wf->vfvol[form_i];
+        std::vector<int> form_markers;
+        get_form_internal_markers(form->areas, this->spaces[form->i]->get_mesh(), this->spaces[form->i]->get_mesh(), false, form_markers, any);
+        if(any)
+          unrestricted[form->i] = true;
+        this->space_element_markers[form->i].insert(this->space_element_markers[form->i].end(), form_markers.begin(), form_markers.end());
+      }
+
+      for(unsigned int space_i = 0; space_i < this->spaces.size(); space_i++)
+      {
+        std::vector<int>& space_markers = this->space_element_markers[space_i];
+        if(unrestricted[space_i])
+          space_markers.clear();
+        std::sort(space_markers.begin(), space_markers.end());
+        space_markers.erase(std::unique(space_markers.begin(), space_markers.end()), space_markers.end());
+      }
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::init_fn_demands()
+    {
+      this->space_fn_demand.assign(this->spaces_size, 0);
+      this->u_ext_fn_demand = 0;
+      this->ext_fn_demand = 0;
+
+      for(unsigned int form_i = 0; form_i < this->wf->mfvol.size(); form_i++)
+      {
+        MatrixFormVol<Scalar>* form = this->wf->mfvol[form_i];
+        this->space_fn_demand[form->i] |= form->v_demand;
+        this->space_fn_demand[form->j] |= form->u_demand;
+      }
+      for(unsigned int form_i = 0; form_i < this->wf->mfsurf.size(); form_i++)
+      {
+        MatrixFormSurf<Scalar>* form = this->wf->mfsurf[form_i];
+        this->space_fn_demand[form->i] |= form->v_demand;
+        this->space_fn_demand[form->j] |= form->u_demand;
+      }
+      for(unsigned int form_i = 0; form_i < this->wf->vfvol.size(); form_i++)
+        this->space_fn_demand[this->wf->vfvol[form_i]->i] |= this->wf->vfvol[form_i]->v_demand;
+      for(unsigned int form_i = 0; form_i < this->wf->vfsurf.size(); form_i++)
+        this->space_fn_demand[this->wf->vfsurf[form_i]->i] |= this->wf->vfsurf[form_i]->v_demand;
+
+      for(unsigned int form_i = 0; form_i < this->wf->forms.size(); form_i++)
+      {
+        this->u_ext_fn_demand |= this->wf->forms[form_i]->u_ext_demand;
+        this->ext_fn_demand |= this->wf->forms[form_i]->ext_demand;
+      }
+
+      // The spaces with no forms keep the default.
+      for(unsigned int space_i = 0; space_i < this->spaces_size; space_i++)
+        if(this->space_fn_demand[space_i] == 0)
+          this->space_fn_demand[space_i] = H2D_DEMAND_DEFAULT;
+
+      if((int)this->cache_fn_demand.size() != this->spaces_size)
+        this->cache_fn_demand.assign(this->spaces_size, H2D_DEMAND_DEFAULT);
+      for(unsigned int space_i = 0; space_i < this->spaces_size; space_i++)
+      {
+        if(this->cache_fn_demand[space_i] != this->space_fn_demand[space_i])
+        {
+          this->free_cache_records(space_i);
+          this->cache_fn_demand[space_i] = this->space_fn_demand[space_i];
+        }
+      }
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::create_sparse_structure(SparseMatrix<Scalar>* mat, Vector<Scalar>* rhs)
+    {
+      this->current_mat = mat;
+      if(rhs != NULL)
+        this->current_rhs = rhs;
+      this->create_sparse_structure();
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::create_sparse_structure()
+    {
+      Hermes::ProfilerRegion profiler_region("DiscreteProblem::create_sparse_structure");
+      if(this->static_condensation)
+        this->init_static_condensation();
+      // The size of the assembled system.
+      int system_ndof = this->static_condensation ? this->condensed_ndof : this->ndof;
+
+      // The products with the Jacobian need no structure.
+      if(dynamic_cast<MatrixFreeJacobian<Scalar>*>(current_mat) != NULL)
+      {
+        if(current_rhs != NULL)
+        {
+          if(current_rhs->length() == 0)
+            current_rhs->alloc(system_ndof);
+          else
+            current_rhs->zero();
+        }
+        return;
+      }
+
+      if(is_up_to_date())
+      {
+        if(current_mat != NULL)
+          current_mat->zero();
+        if(current_rhs != NULL)
+        {
+          // If we use e.g. a new NewtonSolver (providing a new Vector) for this instance of DiscreteProblem that already assembled a system,
+          // we end up with everything up_to_date, but unallocated Vector.
+          if(current_rhs->length() == 0)
+            current_rhs->alloc(system_ndof);
+          else
+            current_rhs->zero();
+        }
+        return;
+      }
+
+      // For DG, the sparse structure is different as we have to
+      // account for over-edge calculations.
+      bool is_DG = false;
+      for(unsigned int i = 0; i < this->wf->mfsurf.size(); i++)
+      {
+        if(!this->wf->mfDG.empty())
+        {
+          is_DG = true;
+          break;
+        }
+      }
+      for(unsigned int i = 0; i < this->wf->vfsurf.size() && is_DG == false; i++)
+      {
+        if(!this->wf->vfDG.empty())
+        {
+          is_DG = true;
+          break;
+        }
+      }
+
+      if(current_mat != NULL)
+      {
+        // Spaces have changed: create the matrix from scratch.
+        have_matrix = true;
+        current_mat->free();
+        free_scatter_map();
+
+        if(!is_DG)
+        {
+          // The structure is calculated only if it changed, e.g. a new matrix of the same problem reuses it.
+          bool **blocks = wf->get_blocks(current_force_diagonal_blocks);
+          // The Schur complement couples all the interface DOFs of an element.
+          if(this->static_condensation)
+            for (unsigned int i = 0; i < wf->get_neq(); i++)
+              for (unsigned int j = 0; j < wf->get_neq(); j++)
+                blocks[i][j] = true;
+          std::vector<int> key;
+          get_sparse_structure_key(blocks, key);
+          // A pattern given by set_sparsity_pattern() has got no key yet.
+          if(this->sparse_pattern != NULL && this->sparse_structure_key.empty()
+            && this->sparse_pattern->get_size() == (unsigned int)system_ndof && this->sparse_pattern->is_symmetric() == current_mat->is_symmetric_storage())
+            this->sparse_structure_key = key;
+          if(this->sparse_pattern == NULL || key != this->sparse_structure_key)
+          {
+            free_sparse_structure();
+            calculate_sparse_structure(blocks);
+            if(this->static_condensation)
+              condense_sparse_structure();
+            this->sparse_pattern = new SparsityPattern(system_ndof, this->sparse_structure_col_start, this->sparse_structure_rows, current_mat->is_symmetric_storage());
+            this->sparse_structure_key = key;
+          }
+          delete [] blocks;
+
+          current_mat->alloc_with_pattern(this->sparse_pattern);
+        }
+        else
+        {
+          current_mat->prealloc(this->ndof);
+
+          AsmList<Scalar>* al = new AsmList<Scalar>[wf->get_neq()];
+          const Mesh** meshes = new const Mesh*[wf->get_neq()];
+          bool **blocks = wf->get_blocks(current_force_diagonal_blocks);
+
+          // Init multi-mesh traversal.
+          for (unsigned int i = 0; i < wf->get_neq(); i++)
+            meshes[i] = spaces[i]->get_mesh();
+
+          Traverse trav(true);
+          trav.begin(wf->get_neq(), meshes);
+
+          if(is_DG)
+          {
+            Hermes::vector<Space<Scalar>*> mutable_spaces;
+            for(unsigned int i = 0; i < this->spaces_size; i++)
+            {
+              mutable_spaces.push_back(const_cast<Space<Scalar>*>(spaces.at(i)));
+              spaces_first_dofs[i] = 0;
+            }
+            Space<Scalar>::assign_dofs(mutable_spaces);
+          }
+
+          Traverse::State* current_state;
+          // Loop through all elements.
+          while ((current_state = trav.get_next_state()) != NULL)
+          {
+            // Obtain assembly lists for the element at all spaces.
+            /// \todo do not get the assembly list again if the element was not changed.
+            for (unsigned int i = 0; i < wf->get_neq(); i++)
+              if(current_state->e[i] != NULL)
+                if(is_DG)
+                  spaces[i]->get_element_assembly_list(current_state->e[i], &(al[i]));
+                else
+                  spaces[i]->get_element_assembly_list(current_state->e[i], &(al[i]), spaces_first_dofs[i]);
+
+            if(is_DG)
+            {
+              // Number of edges ( =  number of vertices).
+              int num_edges = current_state->e[0]->nvert;
+
+              // Allocation an array of arrays of neighboring elements for every mesh x edge.
+              Element **** neighbor_elems_arrays = new Element ***[wf->get_neq()];
+              for(unsigned int i = 0; i < wf->get_neq(); i++)
+                neighbor_elems_arrays[i] = new Element **[num_edges];
+
+              // The same, only for number of elements
+              int ** neighbor_elems_counts = new int *[wf->get_neq()];
+              for(unsigned int i = 0; i < wf->get_neq(); i++)
+                neighbor_elems_counts[i] = new int[num_edges];
+
+              // Get the neighbors.
+              for(unsigned int el = 0; el < wf->get_neq(); el++)
+              {
+                NeighborSearch<Scalar> ns(current_state->e[el], meshes[el]);
+
+                // Ignoring errors (and doing nothing) in case the edge is a boundary one.
+                ns.set_ignore_errors(true);
+
+                for(int ed = 0; ed < num_edges; ed++)
+                {
+                  ns.set_active_edge(ed);
+                  const Hermes::vector<Element *> *neighbors = ns.get_neighbors();
+
+                  neighbor_elems_counts[el][ed] = ns.get_num_neighbors();
+                  neighbor_elems_arrays[el][ed] = new Element *[neighbor_elems_counts[el][ed]];
+                  for(int neigh = 0; neigh < neighbor_elems_counts[el][ed]; neigh++)
+                    neighbor_elems_arrays[el][ed][neigh] = (*neighbors)[neigh];
+                }
+              }
+
+              // Pre-add into the stiffness matrix.
+              for (unsigned int m = 0; m < wf->get_neq(); m++)
+                for(unsigned int el = 0; el < wf->get_neq(); el++)
+                  for(int ed = 0; ed < num_edges; ed++)
+                    for(int neigh = 0; neigh < neighbor_elems_counts[el][ed]; neigh++)
+                      if((blocks[m][el] || blocks[el][m]) && current_state->e[m] != NULL)
+                      {
+                        AsmList<Scalar>*am = &(al[m]);
+                        AsmList<Scalar>*an = new AsmList<Scalar>;
+                        spaces[el]->get_element_assembly_list(neighbor_elems_arrays[el][ed][neigh], an);
+
+                        // pretend assembling of the element stiffness matrix
+                        // register nonzero elements
+                        for (unsigned int i = 0; i < am->cnt; i++)
+                          if(am->dof[i] >= 0)
+                            for (unsigned int j = 0; j < an->cnt; j++)
+                              if(an->dof[j] >= 0)
+                              {
+                                if(blocks[m][el]) current_mat->pre_add_ij(am->dof[i], an->dof[j]);
+                                if(blocks[el][m]) current_mat->pre_add_ij(an->dof[j], am->dof[i]);
+                              }
+                              delete an;
+                      }
+
+                      // Deallocation an array of arrays of neighboring elements
+                      // for every mesh x edge.
+                      for(unsigned int el = 0; el < wf->get_neq(); el++)
+                      {
+                        for(int ed = 0; ed < num_edges; ed++)
+                          delete [] neighbor_elems_arrays[el][ed];
+                        delete [] neighbor_elems_arrays[el];
+                      }
+                      delete [] neighbor_elems_arrays;
+
+                      // The same, only for number of elements.
+                      for(unsigned int el = 0; el < wf->get_neq(); el++)
+                        delete [] neighbor_elems_counts[el];
+                      delete [] neighbor_elems_counts;
+            }
+
+            // Go through all equation-blocks of the local stiffness matrix.
+            for (unsigned int m = 0; m < wf->get_neq(); m++)
+            {
+              for (unsigned int n = 0; n < wf->get_neq(); n++)
+              {
+                if(blocks[m][n] && current_state->e[m] != NULL && current_state->e[n] != NULL)
+                {
+                  AsmList<Scalar>*am = &(al[m]);
+                  AsmList<Scalar>*an = &(al[n]);
+
+                  // Pretend assembling of the element stiffness matrix.
+                  for (unsigned int i = 0; i < am->cnt; i++)
+                    if(am->dof[i] >= 0)
+                      for (unsigned int j = 0; j < an->cnt; j++)
+                        if(an->dof[j] >= 0)
+                          current_mat->pre_add_ij(am->dof[i], an->dof[j]);
+                }
+              }
+            }
+          }
+
+          trav.finish();
+          delete [] al;
+          delete [] meshes;
+          delete [] blocks;
+
+          current_mat->alloc();
+        }
+      }
+
+      // WARNING: unlike Matrix<Scalar>::alloc(), Vector<Scalar>::alloc(ndof) frees the memory occupied
+      // by previous vector before allocating
+      if(current_rhs != NULL)
+        current_rhs->alloc(system_ndof);
+
+      // save space seq numbers and weakform seq number, so we can detect their changes
+      for (unsigned int i = 0; i < wf->get_neq(); i++)
+        sp_seq[i] = spaces[i]->get_seq();
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::get_sparse_structure_key(bool** blocks, std::vector<int>& key) const
+    {
+      key.clear();
+      key.push_back(this->ndof);
+      key.push_back(this->current_mat->is_symmetric_storage() ? 1 : 0);
+      key.push_back(this->static_condensation ? 1 : 0);
+      key.push_back(this->partition_part);
+      key.push_back(this->partition_num_parts);
+      for (unsigned int i = 0; i < wf->get_neq(); i++)
+      {
+        key.push_back(spaces[i]->get_seq());
+        key.push_back(spaces[i]->get_num_dofs());
+        key.push_back(spaces_first_dofs[i]);
+        key.push_back(spaces[i]->get_mesh()->get_seq());
+        for (unsigned int j = 0; j < wf->get_neq(); j++)
+          key.push_back(blocks[i][j] ? 1 : 0);
+      }
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::calculate_sparse_structure(bool** blocks)
+    {
+      int neq = wf->get_neq();
+      for (int i = 0; i < neq; i++)
+        if(!spaces[i]->is_up_to_date())
+          throw Exceptions::Exception("Space is out of date, if you manually refine it, you have to call assign_dofs().");
+
+      Hermes::vector<const Mesh*> meshes;
+      for (int i = 0; i < neq; i++)
+        meshes.push_back(spaces[i]->get_mesh());
+      int num_all_states;
+      Traverse trav(true);
+      Traverse::State** all_states = trav.get_states(meshes, num_all_states);
+      // Only the part assembled by this instance, see set_partition().
+      int num_states;
+      Traverse::State** states = get_partition_states(all_states, num_all_states, num_states);
+      int num_threads_used = this->get_num_threads();
+      bool symmetric = this->current_mat->is_symmetric_storage();
+
+      // The DOFs of the states (in all spaces), state_dof_start[state_i * neq + space_i] is the first one of the space.
+      int* state_dof_start = new int[num_states * neq + 1];
+      state_dof_start[0] = 0;
+      int* state_dofs = NULL;
+      for (int pass = 0; pass < 2; pass++)
+      {
+        if(pass == 1)
+          state_dofs = new int[std::max(state_dof_start[num_states * neq], 1)];
+#pragma omp parallel num_threads(num_threads_used)
+        {
+          this->apply_thread_affinity();
+          AsmList<Scalar> al;
+#pragma omp for schedule(dynamic, 64)
+          for (int state_i = 0; state_i < num_states; state_i++)
+            for (int space_i = 0; space_i < neq; space_i++)
+            {
+              int count = 0;
+              if(states[state_i]->e[space_i] != NULL)
+              {
+                spaces[space_i]->get_element_assembly_list(states[state_i]->e[space_i], &al, spaces_first_dofs[space_i]);
+                for (unsigned int i = 0; i < al.cnt; i++)
+                  if(al.dof[i] >= 0)
+                  {
+                    if(pass == 1)
+                      state_dofs[state_dof_start[state_i * neq + space_i] + count] = al.dof[i];
+                    count++;
+                  }
+              }
+              if(pass == 0)
+                state_dof_start[state_i * neq + space_i + 1] = count;
+            }
+        }
+        if(pass == 0)
+          for (int i = 0; i < num_states * neq; i++)
+            state_dof_start[i + 1] += state_dof_start[i];
+      }
+      if(states != all_states)
+        delete [] states;
+      Traverse::free_states(all_states, num_all_states);
+
+      // The (state, space) pairs of every DOF.
+      int* dof_pair_start = new int[this->ndof + 1];
+      memset(dof_pair_start, 0, (this->ndof + 1) * sizeof(int));
+      for (int i = 0; i < state_dof_start[num_states * neq]; i++)
+        dof_pair_start[state_dofs[i] + 1]++;
+      for (int i = 0; i < this->ndof; i++)
+        dof_pair_start[i + 1] += dof_pair_start[i];
+      int* dof_pairs = new int[std::max(dof_pair_start[this->ndof], 1)];
+      int* position = new int[std::max(this->ndof, 1)];
+      memcpy(position, dof_pair_start, this->ndof * sizeof(int));
+      for (int pair = 0; pair < num_states * neq; pair++)
+        for (int i = state_dof_start[pair]; i < state_dof_start[pair + 1]; i++)
+          dof_pairs[position[state_dofs[i]]++] = pair;
+      delete [] position;
+
+      // The rows of every column: the DOFs of the spaces coupled to the column space in the states of the column
+      // (only those up to the column if just the upper triangle is stored).
+      this->sparse_structure_col_start = new int[this->ndof + 1];
+      this->sparse_structure_col_start[0] = 0;
+      int* rows = NULL;
+      for (int pass = 0; pass < 2; pass++)
+      {
+        if(pass == 1)
+          rows = new int[std::max(this->sparse_structure_col_start[this->ndof], 1)];
+#pragma omp parallel num_threads(num_threads_used)
+        {
+          this->apply_thread_affinity();
+          // marks[row] == col if the row is already in the column col.
+          std::vector<int> marks(this->ndof, -1);
+#pragma omp for schedule(dynamic, 256)
+          for (int col = 0; col < this->ndof; col++)
+          {
+            int count = 0;
+            for (int i = dof_pair_start[col]; i < dof_pair_start[col + 1]; i++)
+            {
+              int state_i = dof_pairs[i] / neq;
+              int space_n = dof_pairs[i] % neq;
+              for (int space_m = 0; space_m < neq; space_m++)
+                if(blocks[space_m][space_n])
+                  for (int j = state_dof_start[state_i * neq + space_m]; j < state_dof_start[state_i * neq + space_m + 1]; j++)
+                    if(marks[state_dofs[j]] != col && (!symmetric || state_dofs[j] <= col))
+                    {
+                      marks[state_dofs[j]] = col;
+                      if(pass == 1)
+                        rows[this->sparse_structure_col_start[col] + count] = state_dofs[j];
+                      count++;
+                    }
+            }
+            if(pass == 0)
+              this->sparse_structure_col_start[col + 1] = count;
+            else
+              std::sort(rows + this->sparse_structure_col_start[col], rows + this->sparse_structure_col_start[col + 1]);
+          }
+        }
+        if(pass == 0)
+          for (int col = 0; col < this->ndof; col++)
+            this->sparse_structure_col_start[col + 1] += this->sparse_structure_col_start[col];
+      }
+
+      delete [] state_dofs;
+      delete [] state_dof_start;
+      delete [] dof_pair_start;
+      delete [] dof_pairs;
+      this->sparse_structure_rows = rows;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::free_sparse_structure()
+    {
+      // The matrices of the pattern keep it.
+      if(this->sparse_pattern != NULL)
+      {
+        this->sparse_pattern->release();
+        this->sparse_pattern = NULL;
+      }
+      else if(this->sparse_structure_col_start != NULL)
+      {
+        delete [] this->sparse_structure_col_start;
+        delete [] this->sparse_structure_rows;
+      }
+      this->sparse_structure_col_start = NULL;
+      this->sparse_structure_rows = NULL;
+      this->sparse_structure_key.clear();
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::set_sparsity_pattern(SparsityPattern* pattern)
+    {
+      free_sparse_structure();
+      if(pattern != NULL)
+      {
+        pattern->add_reference();
+        this->sparse_pattern = pattern;
+        this->sparse_structure_col_start = const_cast<int*>(pattern->get_col_start());
+        this->sparse_structure_rows = const_cast<int*>(pattern->get_rows());
+      }
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::assemble(SparseMatrix<Scalar>* mat, Vector<Scalar>* rhs,
+      bool force_diagonal_blocks, Table* block_weights)
+    {
+      Scalar* coeff_vec = NULL;
+      assemble(coeff_vec, mat, rhs, force_diagonal_blocks, block_weights);
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::assemble(Vector<Scalar>* rhs,
+      bool force_diagonal_blocks, Table* block_weights)
+    {
+      assemble(NULL, NULL, rhs, force_diagonal_blocks, block_weights);
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::init_assembling(Scalar* coeff_vec)
+    {
+      int num_threads_used = this->get_num_threads();
+      bool reuse = (this->thread_pss != NULL && this->thread_structures_num_threads == num_threads_used
+        && this->thread_structures_shapesets.size() == (unsigned int)wf->get_neq());
+      for (unsigned int j = 0; reuse && j < this->thread_structures_shapesets.size(); j++)
+        reuse = (this->thread_structures_shapesets[j] == spaces[j]->shapeset && this->thread_structures_meshes[j] == spaces[j]->get_mesh());
+
+      if(reuse)
+      {
+        // The elements may have changed since the last assembling.
+        for(int i = 0; i < num_threads_used; i++)
+          for (unsigned int j = 0; j < wf->get_neq(); j++)
+            this->thread_refmaps[i][j]->reset();
+      }
+      else
+      {
+        this->free_thread_structures();
+
+        this->thread_pss = new PrecalcShapeset**[num_threads_used];
+        this->thread_spss = new PrecalcShapeset**[num_threads_used];
+        this->thread_refmaps = new RefMap**[num_threads_used];
+        this->thread_als = new AsmList<Scalar>**[num_threads_used];
+        for(int i = 0; i < num_threads_used; i++)
+        {
+          this->thread_pss[i] = new PrecalcShapeset*[wf->get_neq()];
+          this->thread_spss[i] = new PrecalcShapeset*[wf->get_neq()];
+          this->thread_refmaps[i] = new RefMap*[wf->get_neq()];
+          this->thread_als[i] = new AsmList<Scalar>*[wf->get_neq()];
+          for (unsigned int j = 0; j < wf->get_neq(); j++)
+          {
+            this->thread_pss[i][j] = new PrecalcShapeset(spaces[j]->shapeset);
+            this->thread_spss[i][j] = new PrecalcShapeset(this->thread_pss[i][j]);
+            this->thread_refmaps[i][j] = new RefMap();
+            this->thread_refmaps[i][j]->set_quad_2d(&g_quad_2d_std);
+            this->thread_als[i][j] = new AsmList<Scalar>();
+          }
+        }
+
+        this->thread_structures_num_threads = num_threads_used;
+        for (unsigned int j = 0; j < wf->get_neq(); j++)
+        {
+          this->thread_structures_shapesets.push_back(spaces[j]->shapeset);
+          this->thread_structures_meshes.push_back(spaces[j]->get_mesh());
+        }
+      }
+
+      // U_ext functions, the objects are kept, the values are set again.
+      if(!is_linear)
+      {
+        if(this->thread_u_ext != NULL && this->thread_u_ext_zero != (coeff_vec == NULL))
+        {
+          for(int i = 0; i < num_threads_used; i++)
+          {
+            for (unsigned int j = 0; j < wf->get_neq(); j++)
+              delete this->thread_u_ext[i][j];
+            delete [] this->thread_u_ext[i];
+          }
+          delete [] this->thread_u_ext;
+          this->thread_u_ext = NULL;
+        }
+
+        if(this->thread_u_ext == NULL)
+        {
+          this->thread_u_ext_zero = (coeff_vec == NULL);
+          this->thread_u_ext = new Solution<Scalar>**[num_threads_used];
+          for(int i = 0; i < num_threads_used; i++)
+          {
+            this->thread_u_ext[i] = new Solution<Scalar>*[wf->get_neq()];
+            for (int j = 0; j < wf->get_neq(); j++)
+            {
+              if(coeff_vec != NULL)
+                this->thread_u_ext[i][j] = new Solution<Scalar>(spaces[j]->get_mesh());
+              else if(spaces[j]->get_shapeset()->get_num_components() == 1)
+                this->thread_u_ext[i][j] = new ZeroSolution<Scalar>(spaces[j]->get_mesh());
+              else
+                this->thread_u_ext[i][j] = new ZeroSolutionVector<Scalar>(spaces[j]->get_mesh());
+            }
+          }
+        }
+
+        if(coeff_vec != NULL)
+        {
+          int first_dof = 0;
+          for (int j = 0; j < wf->get_neq(); j++)
+          {
+            Solution<Scalar>::vector_to_solution(coeff_vec, spaces[j], this->thread_u_ext[0][j], !RungeKutta, first_dof);
+            first_dof += spaces[j]->get_num_dofs();
+          }
+          for(int i = 1; i < num_threads_used; i++)
+            for (int j = 0; j < wf->get_neq(); j++)
+              this->thread_u_ext[i][j]->copy(this->thread_u_ext[0][j]);
+        }
+      }
+
+        // Weakforms.
+        if(this->thread_weakforms == NULL)
+        {
+          this->thread_weakforms = new WeakForm<Scalar>*[num_threads_used];
+          for(int i = 0; i < num_threads_used; i++)
+          {
+            this->thread_weakforms[i] = this->wf->clone();
+            this->thread_weakforms[i]->cloneMembers(this->wf);
+          }
+        }
+
+        // The order cache identifies the forms by their positions.
+        if(this->form_order_cache_forms != this->wf->forms.size())
+        {
+          this->form_order_caches.clear();
+          this->form_order_cache_forms = this->wf->forms.size();
+        }
+        if(this->form_order_caches.size() < (unsigned int)num_threads_used)
+          this->form_order_caches.resize(num_threads_used);
+
+        this->init_form_marker_tables();
+        this->init_fn_demands();
+
+        assert(cache_element_stored == NULL);
+        cache_element_stored = new bool*[this->spaces_size];
+        for(unsigned int i = 0; i < this->spaces_size; i++)
+        {
+          cache_element_stored[i] = new bool[this->spaces[i]->get_mesh()->get_max_element_id()];
+          memset(cache_element_stored[i], 0, sizeof(bool) * this->spaces[i]->get_mesh()->get_max_element_id());
+        }
+
+        this->cache_assembling_stamp++;
+
+        // Assembly buffers.
+        if(this->buffered_assembly)
+        {
+          mat_buffers = new AssemblyBuffer*[this->get_num_threads()];
+          rhs_buffers = new AssemblyBuffer*[this->get_num_threads()];
+          for(unsigned int i = 0; i < this->get_num_threads(); i++)
+          {
+            mat_buffers[i] = new AssemblyBuffer();
+            rhs_buffers[i] = new AssemblyBuffer();
+          }
+        }
+
+        // Arenas for the temporaries.
+        arenas = new AssemblyArena*[this->get_num_threads()];
+        for(unsigned int i = 0; i < this->get_num_threads(); i++)
+          arenas[i] = new AssemblyArena();
+
+        form_ext_fns = new std::vector<FormExtFn>[this->get_num_threads()];
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::deinit_assembling()
+    {
+      if(!this->persistent_weakform_clones)
+        this->free_thread_weakforms();
+
+      for(unsigned int i = 0; i < this->spaces_size; i++)
+        delete [] cache_element_stored[i];
+      delete [] cache_element_stored;
+      cache_element_stored = NULL;
+
+      if(mat_buffers != NULL)
+      {
+        for(unsigned int i = 0; i < this->get_num_threads(); i++)
+        {
+          delete mat_buffers[i];
+          delete rhs_buffers[i];
+        }
+        delete [] mat_buffers;
+        delete [] rhs_buffers;
+        mat_buffers = NULL;
+        rhs_buffers = NULL;
+      }
+
+      for(unsigned int i = 0; i < this->get_num_threads(); i++)
+      {
+        this->arena_allocations += arenas[i]->allocations;
+        this->arena_block_allocations += arenas[i]->block_allocations;
+        this->arena_peak_size = std::max(this->arena_peak_size, arenas[i]->peak_size);
+        delete arenas[i];
+      }
+      delete [] arenas;
+      arenas = NULL;
+
+      // Left only by an exception in the assembling.
+      for(unsigned int i = 0; i < this->get_num_threads(); i++)
+        for(unsigned int j = 0; j < form_ext_fns[i].size(); j++)
+        {
+          form_ext_fns[i][j].value->free_fn();
+          delete form_ext_fns[i][j].value;
+        }
+      delete [] form_ext_fns;
+      form_ext_fns = NULL;
+
+      this->enforce_cache_memory_budget();
+
+      std::size_t cache_memory_size = this->get_cache_memory_size();
+      CacheStatistics::add_bytes(H2D_CACHE_ASSEMBLY, (long long)cache_memory_size - (long long)this->cache_statistics_bytes);
+      this->cache_statistics_bytes = cache_memory_size;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::free_thread_structures()
+    {
+      this->free_thread_weakforms();
+      if(this->thread_pss == NULL)
+        return;
+
+      int neq = this->thread_structures_shapesets.size();
+      for(int i = 0; i < this->thread_structures_num_threads; i++)
+      {
+        for (int j = 0; j < neq; j++)
+        {
+          delete this->thread_spss[i][j];
+          delete this->thread_pss[i][j];
+          delete this->thread_refmaps[i][j];
+          delete this->thread_als[i][j];
+          if(this->thread_u_ext != NULL)
+            delete this->thread_u_ext[i][j];
+        }
+        delete [] this->thread_spss[i];
+        delete [] this->thread_pss[i];
+        delete [] this->thread_refmaps[i];
+        delete [] this->thread_als[i];
+        if(this->thread_u_ext != NULL)
+          delete [] this->thread_u_ext[i];
+      }
+      delete [] this->thread_spss;
+      delete [] this->thread_pss;
+      delete [] this->thread_refmaps;
+      delete [] this->thread_als;
+      delete [] this->thread_u_ext;
+      this->thread_pss = this->thread_spss = NULL;
+      this->thread_refmaps = NULL;
+      this->thread_als = NULL;
+      this->thread_u_ext = NULL;
+      this->thread_structures_num_threads = 0;
+      this->thread_structures_shapesets.clear();
+      this->thread_structures_meshes.clear();
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::free_thread_weakforms()
+    {
+      if(this->thread_weakforms == NULL)
+        return;
+      for(int i = 0; i < this->thread_structures_num_threads; i++)
+      {
+        this->thread_weakforms[i]->free_ext();
+        delete this->thread_weakforms[i];
+      }
+      delete [] this->thread_weakforms;
+      this->thread_weakforms = NULL;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::set_persistent_weakform_clones(bool to_set)
+    {
+      this->persistent_weakform_clones = to_set;
+      if(!to_set)
+        this->free_thread_weakforms();
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::set_quadrature_order_reduction(int reduction)
+    {
+      if(reduction < 0)
+        throw Exceptions::ValueException("reduction", reduction, 0);
+      if(reduction == this->quadrature_order_reduction)
+        return;
+      this->quadrature_order_reduction = reduction;
+
+      // The orders are stored in the cache records, they are calculated again.
+      for(unsigned int i = 0; i < this->spaces.size(); i++)
+        this->free_cache_records(i);
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::assemble(Scalar* coeff_vec, SparseMatrix<Scalar>* mat, Vector<Scalar>* rhs, bool force_diagonal_blocks, Table* block_weights)
+    {
+      Hermes::ProfilerRegion profiler_region("DiscreteProblem::assemble");
+      CacheStatistics::begin_assembly();
+      // Check.
+      this->check();
+      if(this->ndof == 0)
+        throw Exceptions::Exception("Zero DOFs detected in DiscreteProblem::assemble().");
+
+      // Important, sets the current caughtException to NULL.
+      this->caughtException = NULL;
+
+      current_mat = mat;
+      current_rhs = rhs;
+      current_force_diagonal_blocks = force_diagonal_blocks;
+      current_block_weights = block_weights;
+
+      // Check that the block scaling table have proper dimension.
+      if(block_weights != NULL)
+        if(block_weights->get_size() != wf->get_neq())
+          throw Exceptions::LengthException(6, block_weights->get_size(), wf->get_neq());
+
+      // Creating matrix sparse structure.
+      create_sparse_structure();
+      init_ensemble_systems();
+
+      // Initial check of meshes and spaces.
+      for(unsigned int ext_i = 0; ext_i < this->wf->ext.size(); ext_i++)
+      {
+        if(!this->wf->ext[ext_i]->isOkay())
+          throw Hermes::Exceptions::Exception("Ext function %d is not okay in assemble().", ext_i);
+      }
+
+      // The per-thread structures.
+      init_assembling(coeff_vec);
+      PrecalcShapeset*** pss = this->thread_pss;
+      Solution<Scalar>*** u_ext = this->thread_u_ext;
+      WeakForm<Scalar>** weakforms = this->thread_weakforms;
+
+      // Vector of meshes.
+      Hermes::vector<const Mesh*> meshes;
+      for(unsigned int space_i = 0; space_i < spaces.size(); space_i++)
+        meshes.push_back(spaces[space_i]->get_mesh());
+      for(unsigned int ext_i = 0; ext_i < this->wf->ext.size(); ext_i++)
+        meshes.push_back(this->wf->ext[ext_i]->get_mesh());
+      for(unsigned int form_i = 0; form_i < this->wf->get_forms().size(); form_i++)
+        for(unsigned int ext_i = 0; ext_i < this->wf->get_forms()[form_i]->ext.size(); ext_i++)
+          if(this->wf->get_forms()[form_i]->ext[ext_i] != NULL)
+            meshes.push_back(this->wf->get_forms()[form_i]->ext[ext_i]->get_mesh());
+      for(unsigned int space_i = 0; space_i < spaces.size(); space_i++)
+        meshes.push_back(spaces[space_i]->get_mesh());
+
+      // All states of the traversal are precalculated, so that the threads do not need
+      // to wait for each other. The plan only traverses the meshes again if they changed since the last assembling.
+      int num_all_states;
+      Traverse::State** all_states = this->traverse_plan.get_states(meshes, num_all_states);
+      int num_states;
+      Traverse::State** states = get_partition_states(all_states, num_all_states, num_states);
+      init_scatter_map(num_states);
+      init_batched_assembly(states, num_states);
+      init_DG_cache(num_states);
+
+      Hermes::vector<Transformable *>* fns = new Hermes::vector<Transformable *>[this->get_num_threads()];
+      for(unsigned int i = 0; i < this->get_num_threads(); i++)
+      {
+        for (unsigned j = 0; j < spaces.size(); j++)
+          fns[i].push_back(pss[i][j]);
+        for (unsigned j = 0; j < this->wf->ext.size(); j++)
+        {
+          fns[i].push_back(weakforms[i]->ext[j]);
+          weakforms[i]->ext[j]->set_quad_2d(&g_quad_2d_std);
+        }
+        for(unsigned int form_i = 0; form_i < this->wf->get_forms().size(); form_i++)
+        {
+          for(unsigned int ext_i = 0; ext_i < this->wf->get_forms()[form_i]->ext.size(); ext_i++)
+            if(this->wf->get_forms()[form_i]->ext[ext_i] != NULL)
+            {
+              fns[i].push_back(weakforms[i]->get_forms()[form_i]->ext[ext_i]);
+              weakforms[i]->get_forms()[form_i]->ext[ext_i]->set_quad_2d(&g_quad_2d_std);
+            }
+        }
+        for (unsigned j = 0; j < wf->get_neq(); j++)
+        {
+          fns[i].push_back(u_ext[i][j]);
+          u_ext[i][j]->set_quad_2d(&g_quad_2d_std);
+        }
+      }
+
+      // Work items and phases of the assembly.
+      int* item_first_states;
+      int* item_end_states;
+      int* phase_first_items;
+      int num_phases;
+      init_assembly_schedule(states, num_states, item_first_states, item_end_states, phase_first_items, num_phases);
+      if(this->marker_grouped_assembly)
+        group_assembly_schedule_by_marker(states, item_first_states, item_end_states, phase_first_items, num_phases);
+
+      int item_i;
+
+#define CHUNKSIZE 1
+      int num_threads_used = this->get_num_threads();
+      bool analyze_structure = (mat != NULL && this->structure_analysis_solver != NULL);
+      int* balanced_bounds = NULL;
+#pragma omp parallel shared(states, mat, rhs, balanced_bounds) private(item_i) num_threads(num_threads_used)
+      {
+        this->apply_thread_affinity();
+
+#pragma omp single
+        {
+          // The team may be smaller than requested.
+          this->thread_assembly_times.assign(omp_get_num_threads(), 0.0);
+          if(this->cost_balanced_assembly)
+            balanced_bounds = init_balanced_assembly_bounds(states, item_first_states, item_end_states, phase_first_items, num_phases, omp_get_num_threads());
+        }
+
+        // The symbolic analysis of the (final) pattern by the last thread, it joins the assembly afterwards
+        // and gets the items the others have not taken yet.
+        if(analyze_structure && omp_get_thread_num() == omp_get_num_threads() - 1)
+        {
+          try
+          {
+            this->structure_analysis_solver->analyze_structure();
+          }
+          catch(Hermes::Exceptions::Exception& e)
+          {
+            omp_set_lock(&this->caught_exception_lock);
+            if(this->caughtException == NULL)
+              this->caughtException = e.clone();
+            omp_unset_lock(&this->caught_exception_lock);
+          }
+          catch(std::exception& e)
+          {
+            omp_set_lock(&this->caught_exception_lock);
+            if(this->caughtException == NULL)
+              this->caughtException = new Hermes::Exceptions::Exception(e.what());
+            omp_unset_lock(&this->caught_exception_lock);
+          }
+        }
+
+        double thread_start_time = omp_get_wtime();
+        Transformable** current_fns = &(fns[omp_get_thread_num()].front());
+        for(int phase_i = 0; phase_i < num_phases; phase_i++)
+        {
+          if(balanced_bounds != NULL)
+          {
+            // The contiguous range of the work items of this thread, of about the same estimated cost as the others.
+            int* bounds = &balanced_bounds[phase_i * (omp_get_num_threads() + 1)];
+            for(item_i = bounds[omp_get_thread_num()]; item_i < bounds[omp_get_thread_num() + 1]; item_i++)
+              assemble_work_item(states, item_first_states[item_i], item_end_states[item_i], current_fns);
+            // The next phase (color) may share the DOFs with this one.
+#pragma omp barrier
+          }
+          else
+          {
+#pragma omp for schedule(dynamic, CHUNKSIZE)
+            for(item_i = phase_first_items[phase_i]; item_i < phase_first_items[phase_i + 1]; item_i++)
+              assemble_work_item(states, item_first_states[item_i], item_end_states[item_i], current_fns);
+          }
+        }
+        this->thread_assembly_times[omp_get_thread_num()] = omp_get_wtime() - thread_start_time;
+      }
+      delete [] balanced_bounds;
+
+      assemble_batched();
+
+      if(this->buffered_assembly && this->caughtException == NULL)
+        merge_assembly_buffers();
+
+      deinit_assembling();
+
+      delete [] item_first_states;
+      delete [] item_end_states;
+      delete [] phase_first_items;
+      if(states != all_states)
+        delete [] states;
+
+      for(unsigned int i = 0; i < this->get_num_threads(); i++)
+      {
+        fns[i].clear();
+      }
+      delete [] fns;
+
+      /// \todo Should this be really here? Or in assemble()?
+      if(current_mat != NULL)
+        current_mat->finish();
+      if(current_rhs != NULL)
+        current_rhs->finish();
+
+      if(this->caughtException != NULL)
+        throw *(this->caughtException);
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::assemble(Scalar* coeff_vec, Vector<Scalar>* rhs,
+      bool force_diagonal_blocks, Table* block_weights)
+    {
+      assemble(coeff_vec, NULL, rhs, force_diagonal_blocks, block_weights);
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::assemble_residual(Scalar* coeff_vec, Vector<Scalar>* rhs)
+    {
+      assemble(coeff_vec, NULL, rhs);
+    }
+
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::CacheRecordPerSubIdx::CacheRecordPerSubIdx() : asmlistCnt(0), fns(NULL), fnsSurface(NULL), geometry(NULL), jacobian_x_weights(NULL), n_quadrature_points(0)
+    {
+    }
+
+    /// Memory used by the value arrays of a Func, in bytes.
+    template<typename T>
+    static std::size_t func_memory_size(Func<T>* fn)
+    {
+      std::size_t size = sizeof(Func<T>);
+      T* arrays[11] = { fn->val, fn->dx, fn->dy, fn->laplace, fn->val0, fn->val1, fn->dx0, fn->dx1, fn->dy0, fn->dy1, fn->curl };
+      for(int i = 0; i < 11; i++)
+        if(arrays[i] != NULL)
+          size += fn->get_num_gip() * sizeof(T);
+      if(fn->div != NULL)
+        size += fn->get_num_gip() * sizeof(T);
+      return size;
+    }
+
+    /// Memory used by the arrays of a Geom, in bytes.
+    template<typename T>
+    static std::size_t geom_memory_size(Geom<T>* geom, int np)
+    {
+      std::size_t size = sizeof(Geom<T>);
+      T* arrays[6] = { geom->x, geom->y, geom->nx, geom->ny, geom->tx, geom->ty };
+      for(int i = 0; i < 6; i++)
+        if(arrays[i] != NULL)
+          size += np * sizeof(T);
+      return size;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::check_ensemble_weakform(const WeakForm<Scalar>* instance_wf) const
+    {
+      if(instance_wf == NULL)
+        throw Exceptions::NullException(1);
+      if(instance_wf->get_neq() != this->wf->get_neq() || instance_wf->mfvol.size() != this->wf->mfvol.size() || instance_wf->mfsurf.size() != this->wf->mfsurf.size()
+        || instance_wf->vfvol.size() != this->wf->vfvol.size() || instance_wf->vfsurf.size() != this->wf->vfsurf.size() || instance_wf->ext.size() != this->wf->ext.size())
+        throw Exceptions::Exception("DiscreteProblem::assemble_ensemble(): the weak form of an instance does not have the forms of the weak form of the problem.");
+
+      for(unsigned int i = 0; i < this->wf->mfvol.size(); i++)
+        if(instance_wf->mfvol[i]->i != this->wf->mfvol[i]->i || instance_wf->mfvol[i]->j != this->wf->mfvol[i]->j)
+          throw Exceptions::Exception("DiscreteProblem::assemble_ensemble(): the volumetric matrix form %d of an instance has a different block.", i);
+      for(unsigned int i = 0; i < this->wf->mfsurf.size(); i++)
+        if(instance_wf->mfsurf[i]->i != this->wf->mfsurf[i]->i || instance_wf->mfsurf[i]->j != this->wf->mfsurf[i]->j)
+          throw Exceptions::Exception("DiscreteProblem::assemble_ensemble(): the surface matrix form %d of an instance has a different block.", i);
+      for(unsigned int i = 0; i < this->wf->vfvol.size(); i++)
+        if(instance_wf->vfvol[i]->i != this->wf->vfvol[i]->i)
+          throw Exceptions::Exception("DiscreteProblem::assemble_ensemble(): the volumetric vector form %d of an instance has a different block.", i);
+      for(unsigned int i = 0; i < this->wf->vfsurf.size(); i++)
+        if(instance_wf->vfsurf[i]->i != this->wf->vfsurf[i]->i)
+          throw Exceptions::Exception("DiscreteProblem::assemble_ensemble(): the surface vector form %d of an instance has a different block.", i);
+
+      // The external functions get the elements of the traversal of the meshes of the problem.
+      for(unsigned int i = 0; i < this->wf->ext.size(); i++)
+        if(instance_wf->ext[i]->get_mesh()->get_seq() != this->wf->ext[i]->get_mesh()->get_seq())
+          throw Exceptions::Exception("DiscreteProblem::assemble_ensemble(): the external function %d of an instance is not on the mesh of the problem.", i);
+      Hermes::vector<Form<Scalar>*> forms = this->wf->get_forms();
+      Hermes::vector<Form<Scalar>*> instance_forms = instance_wf->get_forms();
+      for(unsigned int form_i = 0; form_i < forms.size(); form_i++)
+      {
+        if(instance_forms[form_i]->ext.size() != forms[form_i]->ext.size())
+          throw Exceptions::Exception("DiscreteProblem::assemble_ensemble(): a form of an instance has different external functions.");
+        for(unsigned int ext_i = 0; ext_i < forms[form_i]->ext.size(); ext_i++)
+          if((instance_forms[form_i]->ext[ext_i] == NULL) != (forms[form_i]->ext[ext_i] == NULL) || (forms[form_i]->ext[ext_i] != NULL
+            && instance_forms[form_i]->ext[ext_i]->get_mesh()->get_seq() != forms[form_i]->ext[ext_i]->get_mesh()->get_seq()))
+            throw Exceptions::Exception("DiscreteProblem::assemble_ensemble(): a form of an instance has different external functions.");
+      }
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::assemble_ensemble(const Hermes::vector<WeakForm<Scalar>*>& wfs, const Hermes::vector<SparseMatrix<Scalar>*>& mats,
+      const Hermes::vector<Vector<Scalar>*>& rhss)
+    {
+      Hermes::ProfilerRegion profiler_region("DiscreteProblem::assemble_ensemble");
+      this->check();
+      if(wfs.empty() || (mats.empty() && rhss.empty()))
+        throw Exceptions::Exception("DiscreteProblem::assemble_ensemble(): nothing to assemble.");
+      if(!mats.empty() && mats.size() != wfs.size())
+        throw Exceptions::LengthException(2, mats.size(), wfs.size());
+      if(!rhss.empty() && rhss.size() != wfs.size())
+        throw Exceptions::LengthException(3, rhss.size(), wfs.size());
+      if(this->static_condensation || RungeKutta || !this->wf->mfDG.empty() || !this->wf->vfDG.empty())
+        throw Exceptions::Exception("DiscreteProblem::assemble_ensemble(): the static condensation, Runge-Kutta and DG forms are not supported.");
+      for(unsigned int instance_i = 0; instance_i < wfs.size(); instance_i++)
       {
-        if(form->areas[ss] == HERMES_ANY)
+        this->check_ensemble_weakform(wfs[instance_i]);
+        if(!mats.empty())
         {
-          assemble_this_form = true;
-          break;
+          if(mats[instance_i] == NULL)
+            throw Exceptions::NullException(2, instance_i);
+          // The scatter positions of the first matrix are used for all of them.
+          if(typeid(*mats[instance_i]) != typeid(*mats[0]) || mats[instance_i]->is_symmetric_storage() != mats[0]->is_symmetric_storage())
+            throw Exceptions::Exception("DiscreteProblem::assemble_ensemble(): the matrices are not of the same type.");
+        }
+        if(!rhss.empty() && rhss[instance_i] == NULL)
+          throw Exceptions::NullException(3, instance_i);
+      }
+
+      int num_threads_used = this->get_num_threads();
+      this->ensemble_thread_weakforms = new WeakForm<Scalar>**[num_threads_used];
+      for(int i = 0; i < num_threads_used; i++)
+      {
+        this->ensemble_thread_weakforms[i] = new WeakForm<Scalar>*[wfs.size()];
+        for(unsigned int instance_i = 0; instance_i < wfs.size(); instance_i++)
+        {
+          WeakForm<Scalar>* clone = wfs[instance_i]->clone();
+          clone->cloneMembers(wfs[instance_i]);
+          for(unsigned int ext_i = 0; ext_i < clone->ext.size(); ext_i++)
+            clone->ext[ext_i]->set_quad_2d(&g_quad_2d_std);
+          Hermes::vector<Form<Scalar>*> forms = clone->get_forms();
+          for(unsigned int form_i = 0; form_i < forms.size(); form_i++)
+            for(unsigned int ext_i = 0; ext_i < forms[form_i]->ext.size(); ext_i++)
+              if(forms[form_i]->ext[ext_i] != NULL)
+                forms[form_i]->ext[ext_i]->set_quad_2d(&g_quad_2d_std);
+          this->ensemble_thread_weakforms[i][instance_i] = clone;
         }
+      }
+      this->ensemble_size = wfs.size();
+      this->ensemble_mats = mats;
+      this->ensemble_rhss = rhss;
+      this->ensemble_thread_instances.assign(num_threads_used, 0);
+
+      // The instances scatter straight into their own systems.
+      bool buffered_assembly_used = this->buffered_assembly;
+      bool batched_assembly_used = this->batched_assembly;
+      this->buffered_assembly = this->batched_assembly = false;
+
+      SparseMatrix<Scalar>* first_mat = mats.empty() ? NULL : mats[0];
+      Vector<Scalar>* first_rhs = rhss.empty() ? NULL : rhss[0];
+      try
+      {
+        this->assemble(first_mat, first_rhs);
+      }
+      catch(...)
+      {
+        this->buffered_assembly = buffered_assembly_used;
+        this->batched_assembly = batched_assembly_used;
+        this->free_ensemble();
+        throw;
+      }
+      this->buffered_assembly = buffered_assembly_used;
+      this->batched_assembly = batched_assembly_used;
+
+      // The first ones are finished by assemble().
+      for(unsigned int instance_i = 1; instance_i < mats.size(); instance_i++)
+        mats[instance_i]->finish();
+      for(unsigned int instance_i = 1; instance_i < rhss.size(); instance_i++)
+        rhss[instance_i]->finish();
+      this->free_ensemble();
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::free_ensemble()
+    {
+      if(this->ensemble_thread_weakforms != NULL)
+      {
+        for(unsigned int i = 0; i < this->ensemble_thread_instances.size(); i++)
+        {
+          for(int instance_i = 0; instance_i < this->ensemble_size; instance_i++)
+          {
+            this->ensemble_thread_weakforms[i][instance_i]->free_ext();
+            delete this->ensemble_thread_weakforms[i][instance_i];
+          }
+          delete [] this->ensemble_thread_weakforms[i];
+        }
+        delete [] this->ensemble_thread_weakforms;
+        this->ensemble_thread_weakforms = NULL;
+      }
+      this->ensemble_size = 0;
+      this->ensemble_mats.clear();
+      this->ensemble_rhss.clear();
+      this->ensemble_thread_instances.clear();
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::init_ensemble_systems()
+    {
+      if(this->ensemble_size == 0)
+        return;
+
+      for(unsigned int instance_i = 0; instance_i < this->ensemble_mats.size(); instance_i++)
+      {
+        // The first matrix has got the structure in create_sparse_structure(), unless it is a new one of an up-to-date problem.
+        if(instance_i == 0 && this->ensemble_mats[0]->get_matrix_size() == (unsigned int)this->ndof)
+          continue;
+        if(this->sparse_pattern == NULL)
+          throw Exceptions::Exception("DiscreteProblem::assemble_ensemble(): the sparsity pattern of the problem is not available.");
+        this->ensemble_mats[instance_i]->alloc_with_pattern(this->sparse_pattern);
+      }
+      for(unsigned int instance_i = 1; instance_i < this->ensemble_rhss.size(); instance_i++)
+      {
+        if(this->ensemble_rhss[instance_i]->length() != (unsigned int)this->ndof)
+          this->ensemble_rhss[instance_i]->alloc(this->ndof);
         else
+          this->ensemble_rhss[instance_i]->zero();
+      }
+    }
+
+    template<typename Scalar>
+    WeakForm<Scalar>* DiscreteProblem<Scalar>::set_ensemble_instance(Traverse::State* current_state, int instance_i)
+    {
+      int thread_i = omp_get_thread_num();
+      this->ensemble_thread_instances[thread_i] = instance_i;
+      WeakForm<Scalar>* instance_wf = this->ensemble_thread_weakforms[thread_i][instance_i];
+
+      // The external functions follow the spaces in the traversal of assemble(), their meshes are those of the problem.
+      int state_fn_i = this->spaces_size;
+      for(unsigned int ext_i = 0; ext_i < instance_wf->ext.size(); ext_i++, state_fn_i++)
+        if(current_state->e[state_fn_i] != NULL)
+        {
+          instance_wf->ext[ext_i]->set_active_element(current_state->e[state_fn_i]);
+          instance_wf->ext[ext_i]->set_transform(current_state->sub_idx[state_fn_i]);
+        }
+      for(unsigned int form_i = 0; form_i < instance_wf->forms.size(); form_i++)
+        for(unsigned int ext_i = 0; ext_i < instance_wf->forms[form_i]->ext.size(); ext_i++)
+        {
+          MeshFunction<Scalar>* fn = instance_wf->forms[form_i]->ext[ext_i];
+          if(fn == NULL)
+            continue;
+          if(current_state->e[state_fn_i] != NULL)
+          {
+            fn->set_active_element(current_state->e[state_fn_i]);
+            fn->set_transform(current_state->sub_idx[state_fn_i]);
+          }
+          state_fn_i++;
+        }
+
+      instance_wf->set_active_state(current_state->e);
+      return instance_wf;
+    }
+
+    template<typename Scalar>
+    std::size_t DiscreteProblem<Scalar>::CacheRecordPerSubIdx::get_memory_size() const
+    {
+      std::size_t size = sizeof(CacheRecordPerSubIdx);
+      if(this->fns == NULL)
+        return size;
+
+      size += this->asmlistCnt * sizeof(Func<double>*);
+      for(unsigned int i = 0; i < this->asmlistCnt; i++)
+        size += func_memory_size(this->fns[i]);
+      size += geom_memory_size(this->geometry, this->n_quadrature_points);
+      size += this->n_quadrature_points * sizeof(double);
+
+      if(this->fnsSurface != NULL)
+      {
+        size += nvert * (sizeof(Func<double>**) + sizeof(Geom<double>*) + sizeof(double*) + 3 * sizeof(int));
+        for(unsigned int edge_i = 0; edge_i < nvert; edge_i++)
+        {
+          if(this->fnsSurface[edge_i] == NULL)
+            continue;
+          size += this->asmlistSurfaceCnt[edge_i] * sizeof(Func<double>*);
+          for(unsigned int i = 0; i < this->asmlistSurfaceCnt[edge_i]; i++)
+            size += func_memory_size(this->fnsSurface[edge_i][i]);
+          size += geom_memory_size(this->geometrySurface[edge_i], this->n_quadrature_pointsSurface[edge_i]);
+          size += this->n_quadrature_pointsSurface[edge_i] * sizeof(double);
+        }
+      }
+      return size;
+    }
+
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::SubIdxCacheTable::SlotArray::SlotArray(int capacity, SlotArray* previous) : capacity(capacity), previous(previous)
+    {
+      this->keys = new uint64_t[capacity];
+      this->records = new CacheRecordPerSubIdx*[capacity];
+      memset(this->records, 0, capacity * sizeof(CacheRecordPerSubIdx*));
+    }
+
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::SubIdxCacheTable::SlotArray::~SlotArray()
+    {
+      delete [] this->keys;
+      delete [] this->records;
+    }
+
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::SubIdxCacheTable::SubIdxCacheTable() : slots(NULL), count(0)
+    {
+    }
+
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::SubIdxCacheTable::~SubIdxCacheTable()
+    {
+      this->clear();
+    }
+
+    template<typename Scalar>
+    int DiscreteProblem<Scalar>::SubIdxCacheTable::hash(uint64_t sub_idx, int capacity)
+    {
+      // The capacity is a power of two, mix the bits so that the low ones depend on all of them.
+      sub_idx ^= sub_idx >> 33;
+      sub_idx *= 0xff51afd7ed558ccdULL;
+      sub_idx ^= sub_idx >> 33;
+      return (int)(sub_idx & (uint64_t)(capacity - 1));
+    }
+
+    template<typename Scalar>
+    typename DiscreteProblem<Scalar>::CacheRecordPerSubIdx* DiscreteProblem<Scalar>::SubIdxCacheTable::get(uint64_t sub_idx) const
+    {
+#pragma omp flush
+      SlotArray* current_slots = this->slots;
+      if(current_slots == NULL)
+        return NULL;
+
+      int position = hash(sub_idx, current_slots->capacity);
+      while(true)
+      {
+        CacheRecordPerSubIdx* record = current_slots->records[position];
+        if(record == NULL)
+          return NULL;
+        if(current_slots->keys[position] == sub_idx)
+          return record;
+        position = (position + 1) & (current_slots->capacity - 1);
+      }
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::SubIdxCacheTable::insert(uint64_t sub_idx, CacheRecordPerSubIdx* record)
+    {
+      // Keep the load factor at most 1/2.
+      if(this->slots == NULL || 2 * (this->count + 1) > this->slots->capacity)
+      {
+        SlotArray* new_slots = new SlotArray(this->slots == NULL ? 8 : 2 * this->slots->capacity, this->slots);
+        if(this->slots != NULL)
+        {
+          for(int i = 0; i < this->slots->capacity; i++)
+          {
+            if(this->slots->records[i] == NULL)
+              continue;
+            int position = hash(this->slots->keys[i], new_slots->capacity);
+            while(new_slots->records[position] != NULL)
+              position = (position + 1) & (new_slots->capacity - 1);
+            new_slots->keys[position] = this->slots->keys[i];
+            new_slots->records[position] = this->slots->records[i];
+          }
+        }
+        // The new array has to be complete before it is visible to lookups.
+#pragma omp flush
+        this->slots = new_slots;
+      }
+
+      int position = hash(sub_idx, this->slots->capacity);
+      while(this->slots->records[position] != NULL)
+      {
+        if(this->slots->keys[position] == sub_idx)
         {
-          bool marker_on_space_m = this->spaces[form->i]->get_mesh()->get_element_markers_conversion().get_internal_marker(form->areas[ss]).valid;
-          if(marker_on_space_m)
-            marker_on_space_m = (this->spaces[form->i]->get_mesh()->get_element_markers_conversion().get_internal_marker(form->areas[ss]).marker == current_state->rep->marker);
+          this->slots->records[position] = record;
+          return;
+        }
+        position = (position + 1) & (this->slots->capacity - 1);
+      }
 
-          bool marker_on_space_n = this->spaces[form->j]->get_mesh()->get_element_markers_conversion().get_internal_marker(form->areas[ss]).valid;
-          if(marker_on_space_n)
-            marker_on_space_n = (this->spaces[form->j]->get_mesh()->get_element_markers_conversion().get_internal_marker(form->areas[ss]).marker == current_state->rep->marker);
+      // The key has to be visible before the record, a lookup finding the record reads the key.
+      this->slots->keys[position] = sub_idx;
+#pragma omp flush
+      this->slots->records[position] = record;
+#pragma omp flush
+      this->count++;
+    }
 
-          if(marker_on_space_m && marker_on_space_n)
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::SubIdxCacheTable::clear()
+    {
+      if(this->slots != NULL)
+      {
+        for(int i = 0; i < this->slots->capacity; i++)
+          if(this->slots->records[i] != NULL)
           {
-            assemble_this_form = true;
-            break;
+            this->slots->records[i]->clear();
+            delete this->slots->records[i];
           }
+      }
+
+      while(this->slots != NULL)
+      {
+        SlotArray* previous = this->slots->previous;
+        delete this->slots;
+        this->slots = previous;
+      }
+      this->count = 0;
+    }
+
+    template<typename Scalar>
+    std::size_t DiscreteProblem<Scalar>::SubIdxCacheTable::get_memory_size() const
+    {
+      std::size_t size = sizeof(SubIdxCacheTable);
+      for(SlotArray* slot_array = this->slots; slot_array != NULL; slot_array = slot_array->previous)
+        size += sizeof(SlotArray) + slot_array->capacity * (sizeof(uint64_t) + sizeof(CacheRecordPerSubIdx*));
+
+      if(this->slots != NULL)
+        for(int i = 0; i < this->slots->capacity; i++)
+          if(this->slots->records[i] != NULL)
+            size += this->slots->records[i]->get_memory_size();
+      return size;
+    }
+
+    template<typename Scalar>
+    std::size_t DiscreteProblem<Scalar>::get_cache_memory_size() const
+    {
+      std::size_t size = 0;
+      for(unsigned int i = 0; i < this->spaces_size; i++)
+      {
+        size += this->cache_size * (sizeof(SubIdxCacheTable*) + sizeof(CacheRecordPerElement*));
+        for(unsigned int j = 0; j < this->cache_size; j++)
+        {
+          if(this->cache_records_sub_idx[i][j] != NULL)
+            size += this->cache_records_sub_idx[i][j]->get_memory_size();
+          if(this->cache_records_element[i][j] != NULL)
+            size += sizeof(CacheRecordPerElement) + this->cache_records_element[i][j]->asmlistCnt * sizeof(int);
         }
       }
-      if(!assemble_this_form)
-        return false;
-      return true;
+      return size;
+    }
+
+    std::size_t DiscreteProblemMemoryUsage::get_total() const
+    {
+      return cache + sparse_structure + scatter_map + batched_assembly + dg_cache + static_condensation + per_thread + auxiliary;
     }
 
     template<typename Scalar>
-    bool DiscreteProblem<Scalar>::form_to_be_assembled(MatrixFormSurf<Scalar>* form, Traverse::State* current_state)
+    DiscreteProblemMemoryUsage DiscreteProblem<Scalar>::get_memory_usage() const
     {
-      if(current_state->rep->en[current_state->isurf]->marker == 0)
-        return false;
+      DiscreteProblemMemoryUsage usage;
+      usage.cache = this->get_cache_memory_size();
+
+      usage.sparse_structure = this->sparse_structure_key.capacity() * sizeof(int);
+      if(this->sparse_structure_col_start != NULL)
+        usage.sparse_structure += (this->ndof + 1 + std::max(this->sparse_structure_col_start[this->ndof], 1)) * sizeof(int);
+
+      usage.scatter_map = (this->scatter_map != NULL) ? this->scatter_map_size * sizeof(int*) + this->scatter_map_bytes : 0;
+
+      usage.batched_assembly = this->batched_forms.capacity() + this->batched_thread_states.capacity() * sizeof(int);
+      for (typename std::map<std::vector<int>, BatchShapeTable*>::const_iterator it = this->batch_tables.begin(); it != this->batch_tables.end(); it++)
+        usage.batched_assembly += sizeof(BatchShapeTable) + it->second->values.capacity() * sizeof(double)
+          + it->second->columns.size() * (sizeof(std::pair<int, int>) + 3 * sizeof(void*));
+      for (std::map<std::vector<int>, ReferenceIntegrals*>::const_iterator it = this->reference_integrals.begin(); it != this->reference_integrals.end(); it++)
+        usage.batched_assembly += sizeof(ReferenceIntegrals) + it->second->get_memory_size();
+      for (unsigned int i = 0; i < this->batch_groups.size(); i++)
+      {
+        const BatchGroup* group = this->batch_groups[i];
+        usage.batched_assembly += sizeof(BatchGroup) + (group->states.capacity() + group->columns_i.capacity() + group->columns_j.capacity()
+          + group->dofs_i.capacity() + group->dofs_j.capacity()) * sizeof(int) + (group->coefs_i.capacity() + group->coefs_j.capacity()) * sizeof(Scalar)
+          + group->geometry.capacity() * sizeof(double);
+      }
 
-      if(form->areas[0] == H2D_DG_INNER_EDGE)
-        return false;
-      if(!form_to_be_assembled((MatrixForm<Scalar>*)form, current_state))
-        return false;
+      usage.dg_cache = this->DG_cache.capacity() * sizeof(DGStateCache*);
+      for (unsigned int i = 0; i < this->DG_cache.size(); i++)
+        if(this->DG_cache[i] != NULL)
+        {
+          usage.dg_cache += sizeof(DGStateCache);
+          for (int isurf = 0; isurf < this->DG_cache[i]->nvert; isurf++)
+            usage.dg_cache += this->DG_cache[i]->num_neighbors[isurf] * (sizeof(bool) + this->DG_cache[i]->num_spaces * sizeof(AsmList<Scalar>*));
+        }
 
-      bool assemble_this_form = false;
-      for (unsigned int ss = 0; ss < form->areas.size(); ss++)
+      usage.static_condensation = 0;
+      if(this->condensed_dof_index != NULL)
+        usage.static_condensation += this->ndof * sizeof(int);
+      if(this->condensed_elements != NULL)
+      {
+        usage.static_condensation += this->condensed_elements_size * sizeof(CondensedElement*);
+        for (int i = 0; i < this->condensed_elements_size; i++)
+          if(this->condensed_elements[i] != NULL)
+          {
+            int ni = this->condensed_elements[i]->num_interface;
+            int nb = this->condensed_elements[i]->num_bubble;
+            usage.static_condensation += sizeof(CondensedElement) + (ni + 2 * nb) * sizeof(int) + (nb * nb + 2 * nb * ni + nb) * sizeof(Scalar);
+          }
+      }
+      if(this->condensation_buffers != NULL)
+        for (int i = 0; i < this->condensation_buffers_size; i++)
+          usage.static_condensation += sizeof(CondensationBuffer) + this->ndof * sizeof(int) + this->condensation_buffers[i]->dofs.capacity() * sizeof(int)
+            + (this->condensation_buffers[i]->A.capacity() + this->condensation_buffers[i]->f.capacity()) * sizeof(Scalar);
+
+      usage.per_thread = 0;
+      int num_threads_used = this->get_num_threads();
+      for (int i = 0; i < num_threads_used; i++)
       {
-        if(form->areas[ss] == HERMES_ANY)
+        if(this->mat_buffers != NULL)
+          usage.per_thread += (this->mat_buffers[i]->size + this->rhs_buffers[i]->size) * sizeof(typename AssemblyBuffer::Entry);
+        if(this->arenas != NULL)
+          usage.per_thread += this->arenas[i]->peak_size;
+      }
+      for (int i = 0; this->thread_pss != NULL && i < this->thread_structures_num_threads; i++)
+        for (unsigned int j = 0; j < this->thread_structures_shapesets.size(); j++)
         {
-          assemble_this_form = true;
-          break;
+          usage.per_thread += this->thread_pss[i][j]->get_memory_usage() + this->thread_spss[i][j]->get_memory_usage() + this->thread_refmaps[i][j]->get_memory_usage();
+          if(this->thread_u_ext != NULL)
+            usage.per_thread += this->thread_u_ext[i][j]->get_total_memory_usage();
         }
-        else
+
+      usage.auxiliary = 0;
+      for (unsigned int i = 0; i < this->form_order_caches.size(); i++)
+        usage.auxiliary += this->form_order_caches[i].size() * (sizeof(std::pair<FormOrderKey, int>) + 3 * sizeof(void*));
+      for (unsigned int i = 0; i < this->element_parts.size(); i++)
+        if(this->element_parts[i] != NULL)
+          usage.auxiliary += std::max(this->spaces[i]->get_mesh()->get_max_element_id(), 1) * sizeof(int);
+
+      return usage;
+    }
+
+    template<typename Scalar>
+    std::size_t DiscreteProblem<Scalar>::get_total_memory_usage() const
+    {
+      return this->get_memory_usage().get_total();
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::CacheRecordPerSubIdx::clear()
+    {
+      for(unsigned int i = 0; i < this->asmlistCnt; i++)
+      {
+        this->fns[i]->free_fn();
+        delete this->fns[i];
+      }
+      delete [] this->fns;
+
+      delete [] this->jacobian_x_weights;
+      this->geometry->free();
+      delete this->geometry;
+
+      if(this->fnsSurface != NULL)
+      {
+        for(unsigned int edge_i = 0; edge_i < nvert; edge_i++)
         {
-          bool marker_on_space_m = this->spaces[form->i]->get_mesh()->get_boundary_markers_conversion().get_internal_marker(form->areas[ss]).valid;
-          if(marker_on_space_m)
-            marker_on_space_m = (this->spaces[form->i]->get_mesh()->get_boundary_markers_conversion().get_internal_marker(form->areas[ss]).marker == current_state->rep->en[current_state->isurf]->marker);
+          if(this->fnsSurface[edge_i] == NULL)
+            continue;
+          delete [] this->jacobian_x_weightsSurface[edge_i];
+          this->geometrySurface[edge_i]->free();
+          delete this->geometrySurface[edge_i];
+
+          for(unsigned int i = 0; i < this->asmlistSurfaceCnt[edge_i]; i++)
+          {
+            this->fnsSurface[edge_i][i]->free_fn();
+            delete this->fnsSurface[edge_i][i];
+          }
+          delete [] this->fnsSurface[edge_i];
+        }
+
+        delete [] this->fnsSurface;
+        delete [] this->geometrySurface;
+        delete [] this->jacobian_x_weightsSurface;
+
+        delete [] this->n_quadrature_pointsSurface;
+        delete [] this->orderSurface;
+        delete [] this->asmlistSurfaceCnt;
+
+        this->fnsSurface = NULL;
+      }
+    }
+
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::CacheRecordPerElement::CacheRecordPerElement() : asmlistIdx(NULL), asmlistCnt(0), last_used(0)
+    {
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::CacheRecordPerElement::clear()
+    {
+      delete [] this->asmlistIdx;
+    }
+
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::AssemblyBuffer::AssemblyBuffer() : entries(NULL), count(0), size(0), current_state(0), current_seq(0)
+    {
+    }
 
-          bool marker_on_space_n = this->spaces[form->j]->get_mesh()->get_boundary_markers_conversion().get_internal_marker(form->areas[ss]).valid;
-          if(marker_on_space_n)
-            marker_on_space_n = (this->spaces[form->j]->get_mesh()->get_boundary_markers_conversion().get_internal_marker(form->areas[ss]).marker == current_state->rep->en[current_state->isurf]->marker);
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::AssemblyBuffer::~AssemblyBuffer()
+    {
+      if(this->entries != NULL)
+        free(this->entries);
+    }
 
-          if(marker_on_space_m && marker_on_space_n)
-          {
-            assemble_this_form = true;
-            break;
-          }
-        }
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::AssemblyBuffer::add(int row, int col, Scalar value)
+    {
+      if(this->count == this->size)
+      {
+        this->size = (this->size == 0 ? 1024 : 2 * this->size);
+        this->entries = (Entry*)realloc(this->entries, this->size * sizeof(Entry));
       }
-      if(assemble_this_form == false)
-        return false;
-      return true;
+      Entry& entry = this->entries[this->count++];
+      entry.row = row;
+      entry.col = col;
+      entry.state = this->current_state;
+      entry.seq = this->current_seq++;
+      entry.value = value;
     }
 
     template<typename Scalar>
-    bool DiscreteProblem<Scalar>::form_to_be_assembled(VectorForm<Scalar>* form, Traverse::State* current_state)
+    void DiscreteProblem<Scalar>::AssemblyBuffer::set_state(int state)
     {
-      if(current_state->e[form->i] == NULL)
-        return false;
-      if(fabs(form->scaling_factor) < 1e-12)
-        return false;
-
-      return true;
+      this->current_state = state;
+      this->current_seq = 0;
     }
 
+    /// Alignment of the arena allocations (cache line size).
+    static const size_t H2D_ARENA_ALIGNMENT = 64;
+    /// Size of the first arena block, enough for the temporaries of a usual state.
+    static const size_t H2D_ARENA_BLOCK_SIZE = 64 * 1024;
+
     template<typename Scalar>
-    bool DiscreteProblem<Scalar>::form_to_be_assembled(VectorFormVol<Scalar>* form, Traverse::State* current_state)
+    DiscreteProblem<Scalar>::AssemblyArena::AssemblyArena() : allocations(0), block_allocations(0), peak_size(0), blocks(NULL), in_use(0)
     {
-      if(!form_to_be_assembled((VectorForm<Scalar>*)form, current_state))
-        return false;
+    }
 
-      // Assemble this form only if one of its areas is HERMES_ANY
-      // of if the element marker coincides with one of the form's areas.
-      bool assemble_this_form = false;
-      for (unsigned int ss = 0; ss < form->areas.size(); ss++)
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::AssemblyArena::~AssemblyArena()
+    {
+      while(this->blocks != NULL)
       {
-        if(form->areas[ss] == HERMES_ANY)
-        {
-          assemble_this_form = true;
-          break;
-        }
-        else
-        {
-          bool marker_on_space_m = this->spaces[form->i]->get_mesh()->get_element_markers_conversion().get_internal_marker(form->areas[ss]).valid;
-          if(marker_on_space_m)
-            marker_on_space_m = (this->spaces[form->i]->get_mesh()->get_element_markers_conversion().get_internal_marker(form->areas[ss]).marker == current_state->rep->marker);
-
-          if(marker_on_space_m)
-          {
-            assemble_this_form = true;
-            break;
-          }
-        }
+        Block* next = this->blocks->next;
+        free(this->blocks->raw);
+        delete this->blocks;
+        this->blocks = next;
       }
-      if(!assemble_this_form)
-        return false;
-      return true;
     }
 
     template<typename Scalar>
-    bool DiscreteProblem<Scalar>::form_to_be_assembled(VectorFormSurf<Scalar>* form, Traverse::State* current_state)
+    typename DiscreteProblem<Scalar>::AssemblyArena::Block* DiscreteProblem<Scalar>::AssemblyArena::add_block(size_t size)
     {
-      if(current_state->rep->en[current_state->isurf]->marker == 0)
-        return false;
+      Block* block = new Block;
+      block->raw = (char*)malloc(size + H2D_ARENA_ALIGNMENT);
+      if(block->raw == NULL)
+      {
+        delete block;
+        throw Hermes::Exceptions::Exception("Unable to allocate an assembly arena block of %d bytes.", (int)size);
+      }
+      block->data = (char*)(((size_t)block->raw + H2D_ARENA_ALIGNMENT - 1) & ~(H2D_ARENA_ALIGNMENT - 1));
+      block->size = size;
+      block->used = 0;
+      block->next = this->blocks;
+      this->blocks = block;
+      this->block_allocations++;
+      return block;
+    }
 
-      if(form->areas[0] == H2D_DG_INNER_EDGE)
-        return false;
+    template<typename Scalar>
+    void* DiscreteProblem<Scalar>::AssemblyArena::allocate(size_t size)
+    {
+      size = (size + H2D_ARENA_ALIGNMENT - 1) & ~(H2D_ARENA_ALIGNMENT - 1);
+      if(this->blocks == NULL || this->blocks->used + size > this->blocks->size)
+        this->add_block(std::max(size, H2D_ARENA_BLOCK_SIZE));
+
+      void* result = this->blocks->data + this->blocks->used;
+      this->blocks->used += size;
+      this->in_use += size;
+      if(this->in_use > this->peak_size)
+        this->peak_size = this->in_use;
+      this->allocations++;
+      return result;
+    }
 
-      if(!form_to_be_assembled((VectorForm<Scalar>*)form, current_state))
-        return false;
+    template<typename Scalar>
+    Scalar** DiscreteProblem<Scalar>::AssemblyArena::allocate_matrix(unsigned int m, unsigned int n)
+    {
+      size_t size = sizeof(Scalar*) * m + sizeof(Scalar) * m * n;
+      Scalar** vec = (Scalar**)this->allocate(size);
+      memset(vec, 0, size);
+      Scalar* row = (Scalar*)(vec + m);
+      for (unsigned int i = 0; i < m; i++, row += n)
+        vec[i] = row;
+      return vec;
+    }
 
-      bool assemble_this_form = false;
-      for (unsigned int ss = 0; ss < form->areas.size(); ss++)
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::AssemblyArena::reset()
+    {
+      if(this->blocks != NULL && this->blocks->next != NULL)
       {
-        if(form->areas[ss] == HERMES_ANY)
-        {
-          assemble_this_form = true;
-          break;
-        }
-        else
+        size_t total_size = 0;
+        while(this->blocks != NULL)
         {
-          bool marker_on_space_m = this->spaces[form->i]->get_mesh()->get_boundary_markers_conversion().get_internal_marker(form->areas[ss]).valid;
-          if(marker_on_space_m)
-            marker_on_space_m = (this->spaces[form->i]->get_mesh()->get_boundary_markers_conversion().get_internal_marker(form->areas[ss]).marker == current_state->rep->en[current_state->isurf]->marker);
-
-          if(marker_on_space_m)
-          {
-            assemble_this_form = true;
-            break;
-          }
+          Block* next = this->blocks->next;
+          total_size += this->blocks->size;
+          free(this->blocks->raw);
+          delete this->blocks;
+          this->blocks = next;
         }
+        this->add_block(total_size);
       }
-      if(assemble_this_form == false)
-        return false;
-      return true;
+      if(this->blocks != NULL)
+        this->blocks->used = 0;
+      this->in_use = 0;
     }
 
     template<typename Scalar>
-    void DiscreteProblem<Scalar>::create_sparse_structure(SparseMatrix<Scalar>* mat, Vector<Scalar>* rhs)
+    typename DiscreteProblem<Scalar>::AssemblyArena* DiscreteProblem<Scalar>::current_arena() const
     {
-      this->current_mat = mat;
-      if(rhs != NULL)
-        this->current_rhs = rhs;
-      this->create_sparse_structure();
+      return this->arenas[omp_get_thread_num()];
     }
 
     template<typename Scalar>
-    void DiscreteProblem<Scalar>::create_sparse_structure()
+    Func<Scalar>* DiscreteProblem<Scalar>::get_form_ext_fn(MeshFunction<Scalar>* fn, int order)
     {
-      if(is_up_to_date())
+      std::vector<FormExtFn>& values = this->form_ext_fns[omp_get_thread_num()];
+      for(unsigned int i = 0; i < values.size(); i++)
+        if(values[i].fn == fn && values[i].order == order)
+          return values[i].value;
+
+      // The union of the demands of the forms, any of them may share the value.
+      FormExtFn value;
+      value.fn = fn;
+      value.order = order;
+      value.value = init_fn(fn, order, this->ext_fn_demand);
+      values.push_back(value);
+      return value.value;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::free_form_ext_fns()
+    {
+      std::vector<FormExtFn>& values = this->form_ext_fns[omp_get_thread_num()];
+      for(unsigned int i = 0; i < values.size(); i++)
       {
-        if(current_mat != NULL)
-          current_mat->zero();
-        if(current_rhs != NULL)
-        {
-          // If we use e.g. a new NewtonSolver (providing a new Vector) for this instance of DiscreteProblem that already assembled a system,
-          // we end up with everything up_to_date, but unallocated Vector.
-          if(current_rhs->length() == 0)
-            current_rhs->alloc(this->ndof);
-          else
-            current_rhs->zero();
-        }
-        return;
+        values[i].value->free_fn();
+        delete values[i].value;
       }
+      values.clear();
+    }
 
-      // For DG, the sparse structure is different as we have to
-      // account for over-edge calculations.
-      bool is_DG = false;
-      for(unsigned int i = 0; i < this->wf->mfsurf.size(); i++)
+    /// The most runs of contiguous DOFs of the local matrices added as dense blocks: an element of a discontinuous space
+    /// has one, the extended assembly list of a DG edge two (the central and the neighbor element).
+    static const int H2D_MAX_DENSE_BLOCK_RUNS = 2;
+
+    /// Splits the DOFs into the runs of consecutive ones, run_starts[k] is the position of the first DOF of the run k,
+    /// run_starts[num_runs] == count. False if there are more than H2D_MAX_DENSE_BLOCK_RUNS runs or a DOF is not assigned.
+    static bool get_contiguous_runs(unsigned int count, const int* dofs, unsigned int run_starts[H2D_MAX_DENSE_BLOCK_RUNS + 1], int& num_runs)
+    {
+      num_runs = 0;
+      for (unsigned int i = 0; i < count; i++)
       {
-        if(!this->wf->mfDG.empty())
+        if(dofs[i] < 0)
+          return false;
+        if(i == 0 || dofs[i] != dofs[i - 1] + 1)
         {
-          is_DG = true;
-          break;
+          if(num_runs == H2D_MAX_DENSE_BLOCK_RUNS)
+            return false;
+          run_starts[num_runs++] = i;
         }
       }
-      for(unsigned int i = 0; i < this->wf->vfsurf.size() && is_DG == false; i++)
+      run_starts[num_runs] = count;
+      return true;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::add_to_matrix(unsigned int m, unsigned int n, Scalar** local_matrix, int* rows, int* cols)
+    {
+      Hermes::ProfilerRegion profiler_region("DiscreteProblem::add_to_matrix");
+      if(this->static_condensation)
       {
-        if(!this->wf->vfDG.empty())
+        CondensationBuffer* buffer = this->condensation_buffers[omp_get_thread_num()];
+        if(buffer->active)
         {
-          is_DG = true;
-          break;
+          int size = buffer->dofs.size();
+          for (unsigned int i = 0; i < m; i++)
+            if(rows[i] >= 0)
+              for (unsigned int j = 0; j < n; j++)
+                if(cols[j] >= 0)
+                  buffer->A[buffer->local_index[rows[i]] * size + buffer->local_index[cols[j]]] += local_matrix[i][j];
+          return;
         }
       }
 
-      if(current_mat != NULL)
+      if(this->buffered_assembly)
       {
-        // Spaces have changed: create the matrix from scratch.
-        have_matrix = true;
-        current_mat->free();
-        current_mat->prealloc(this->ndof);
-
-        AsmList<Scalar>* al = new AsmList<Scalar>[wf->get_neq()];
-        const Mesh** meshes = new const Mesh*[wf->get_neq()];
-        bool **blocks = wf->get_blocks(current_force_diagonal_blocks);
-
-        // Init multi-mesh traversal.
-        for (unsigned int i = 0; i < wf->get_neq(); i++)
-          meshes[i] = spaces[i]->get_mesh();
-
-        Traverse trav(true);
-        trav.begin(wf->get_neq(), meshes);
+        AssemblyBuffer* buffer = this->mat_buffers[omp_get_thread_num()];
+        // The lower triangle is not buffered at all if the matrix stores only the upper one.
+        bool symmetric = this->current_mat->is_symmetric_storage();
+        for (unsigned int i = 0; i < m; i++)
+          for (unsigned int j = 0; j < n; j++)
+            if(rows[i] >= 0 && cols[j] >= 0 && (!symmetric || rows[i] <= cols[j]))
+              buffer->add(rows[i], cols[j], local_matrix[i][j]);
+      }
+      else
+      {
+        SparseMatrix<Scalar>* target_mat = this->get_target_matrix();
 
-        if(is_DG)
+        // The elements of discontinuous (L2) spaces and their DG neighbors have contiguous DOFs, their local matrices
+        // are added as dense blocks, without the scatter map and without the search for each entry.
+        unsigned int row_runs[H2D_MAX_DENSE_BLOCK_RUNS + 1], col_runs[H2D_MAX_DENSE_BLOCK_RUNS + 1];
+        int num_row_runs, num_col_runs;
+        if(m > 1 && n > 1 && get_contiguous_runs(m, rows, row_runs, num_row_runs) && get_contiguous_runs(n, cols, col_runs, num_col_runs))
         {
-          Hermes::vector<Space<Scalar>*> mutable_spaces;
-          for(unsigned int i = 0; i < this->spaces_size; i++)
-          {
-            mutable_spaces.push_back(const_cast<Space<Scalar>*>(spaces.at(i)));
-            spaces_first_dofs[i] = 0;
-          }
-          Space<Scalar>::assign_dofs(mutable_spaces);
+          for (int row_run = 0; row_run < num_row_runs; row_run++)
+            for (int col_run = 0; col_run < num_col_runs; col_run++)
+              target_mat->add_dense_block(rows[row_runs[row_run]], cols[col_runs[col_run]], row_runs[row_run + 1] - row_runs[row_run],
+                col_runs[col_run + 1] - col_runs[col_run], local_matrix + row_runs[row_run], col_runs[col_run]);
+          return;
         }
 
-        Traverse::State* current_state;
-        // Loop through all elements.
-        while ((current_state = trav.get_next_state()) != NULL)
+        int* positions = (this->scatter_map != NULL) ? get_scatter_positions(m, n, rows, cols) : NULL;
+        if(positions != NULL)
         {
-          // Obtain assembly lists for the element at all spaces.
-          /// \todo do not get the assembly list again if the element was not changed.
-          for (unsigned int i = 0; i < wf->get_neq(); i++)
-            if(current_state->e[i] != NULL)
-              if(is_DG)
-                spaces[i]->get_element_assembly_list(current_state->e[i], &(al[i]));
-              else
-                spaces[i]->get_element_assembly_list(current_state->e[i], &(al[i]), spaces_first_dofs[i]);
-
-          if(is_DG)
-          {
-            // Number of edges ( =  number of vertices).
-            int num_edges = current_state->e[0]->nvert;
-
-            // Allocation an array of arrays of neighboring elements for every mesh x edge.
-            Element **** neighbor_elems_arrays = new Element ***[wf->get_neq()];
-            for(unsigned int i = 0; i < wf->get_neq(); i++)
-              neighbor_elems_arrays[i] = new Element **[num_edges];
+          for (unsigned int i = 0; i < m; i++)
+            for (unsigned int j = 0; j < n; j++)
+              if(positions[i * n + j] >= 0)
+                target_mat->add_to_position(positions[i * n + j], local_matrix[i][j]);
+        }
+        else
+          target_mat->add(m, n, local_matrix, rows, cols);
+      }
+    }
 
-            // The same, only for number of elements
-            int ** neighbor_elems_counts = new int *[wf->get_neq()];
-            for(unsigned int i = 0; i < wf->get_neq(); i++)
-              neighbor_elems_counts[i] = new int[num_edges];
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::init_scatter_map(int num_states)
+    {
+      if(this->current_mat == NULL || !this->current_mat->supports_positions() || this->buffered_assembly || this->static_condensation)
+      {
+        free_scatter_map();
+        return;
+      }
 
-            // Get the neighbors.
-            for(unsigned int el = 0; el < wf->get_neq(); el++)
-            {
-              NeighborSearch<Scalar> ns(current_state->e[el], meshes[el]);
+      // The positions stay valid for the same matrix (with the same structure) and the same states.
+      if(this->scatter_map != NULL && (this->scatter_map_matrix != this->current_mat || this->scatter_map_size != num_states * (int)(wf->get_neq() * wf->get_neq())
+        || this->scatter_map_num_traversals != this->traverse_plan.get_num_traversals()))
+        free_scatter_map();
 
-              // Ignoring errors (and doing nothing) in case the edge is a boundary one.
-              ns.set_ignore_errors(true);
+      if(this->scatter_map == NULL)
+      {
+        int neq = wf->get_neq();
+        this->scatter_map = new int*[num_states * neq * neq];
+        memset(this->scatter_map, 0, num_states * neq * neq * sizeof(int*));
+        this->scatter_map_num_states = num_states;
+        this->scatter_map_size = num_states * neq * neq;
+        this->scatter_map_matrix = this->current_mat;
+        this->scatter_map_num_traversals = this->traverse_plan.get_num_traversals();
+      }
 
-              for(int ed = 0; ed < num_edges; ed++)
-              {
-                ns.set_active_edge(ed);
-                const Hermes::vector<Element *> *neighbors = ns.get_neighbors();
+      int num_threads_used = this->get_num_threads();
+      this->scatter_map_thread_states.assign(num_threads_used, -1);
+      this->scatter_map_thread_als.assign(num_threads_used, (AsmList<Scalar>**)NULL);
+    }
 
-                neighbor_elems_counts[el][ed] = ns.get_num_neighbors();
-                neighbor_elems_arrays[el][ed] = new Element *[neighbor_elems_counts[el][ed]];
-                for(int neigh = 0; neigh < neighbor_elems_counts[el][ed]; neigh++)
-                  neighbor_elems_arrays[el][ed][neigh] = (*neighbors)[neigh];
-              }
-            }
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::free_scatter_map()
+    {
+      if(this->scatter_map != NULL)
+      {
+        for (int i = 0; i < this->scatter_map_size; i++)
+          if(this->scatter_map[i] != NULL)
+            delete [] this->scatter_map[i];
+        delete [] this->scatter_map;
+        this->scatter_map = NULL;
+      }
+      this->scatter_map_num_states = 0;
+      this->scatter_map_size = 0;
+      this->scatter_map_bytes = 0;
+      this->scatter_map_matrix = NULL;
+    }
 
-            // Pre-add into the stiffness matrix.
-            for (unsigned int m = 0; m < wf->get_neq(); m++)
-              for(unsigned int el = 0; el < wf->get_neq(); el++)
-                for(int ed = 0; ed < num_edges; ed++)
-                  for(int neigh = 0; neigh < neighbor_elems_counts[el][ed]; neigh++)
-                    if((blocks[m][el] || blocks[el][m]) && current_state->e[m] != NULL)
-                    {
-                      AsmList<Scalar>*am = &(al[m]);
-                      AsmList<Scalar>*an = new AsmList<Scalar>;
-                      spaces[el]->get_element_assembly_list(neighbor_elems_arrays[el][ed][neigh], an);
-
-                      // pretend assembling of the element stiffness matrix
-                      // register nonzero elements
-                      for (unsigned int i = 0; i < am->cnt; i++)
-                        if(am->dof[i] >= 0)
-                          for (unsigned int j = 0; j < an->cnt; j++)
-                            if(an->dof[j] >= 0)
-                            {
-                              if(blocks[m][el]) current_mat->pre_add_ij(am->dof[i], an->dof[j]);
-                              if(blocks[el][m]) current_mat->pre_add_ij(an->dof[j], am->dof[i]);
-                            }
-                            delete an;
-                    }
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::set_scatter_map_state(int state_i)
+    {
+      if(this->scatter_map != NULL)
+        this->scatter_map_thread_states[omp_get_thread_num()] = state_i;
+    }
 
-                    // Deallocation an array of arrays of neighboring elements
-                    // for every mesh x edge.
-                    for(unsigned int el = 0; el < wf->get_neq(); el++)
-                    {
-                      for(int ed = 0; ed < num_edges; ed++)
-                        delete [] neighbor_elems_arrays[el][ed];
-                      delete [] neighbor_elems_arrays[el];
-                    }
-                    delete [] neighbor_elems_arrays;
+    template<typename Scalar>
+    int* DiscreteProblem<Scalar>::get_scatter_positions(unsigned int m, unsigned int n, int* rows, int* cols)
+    {
+      int thread_i = omp_get_thread_num();
+      int state_i = this->scatter_map_thread_states[thread_i];
+      AsmList<Scalar>** als = this->scatter_map_thread_als[thread_i];
+      if(state_i < 0 || als == NULL)
+        return NULL;
+
+      // The spaces of the assembly lists.
+      int neq = wf->get_neq();
+      int space_m = -1, space_n = -1;
+      for (int i = 0; i < neq; i++)
+      {
+        if(als[i]->dof == rows && als[i]->cnt == m)
+          space_m = i;
+        if(als[i]->dof == cols && als[i]->cnt == n)
+          space_n = i;
+      }
+      if(space_m < 0 || space_n < 0)
+        return NULL;
 
-                    // The same, only for number of elements.
-                    for(unsigned int el = 0; el < wf->get_neq(); el++)
-                      delete [] neighbor_elems_counts[el];
-                    delete [] neighbor_elems_counts;
-          }
+      // Only the thread assembling the state ever accesses its part of the map.
+      int*& positions = this->scatter_map[(state_i * neq + space_m) * neq + space_n];
+      if(positions == NULL)
+      {
+        positions = new int[std::max(m * n, 1u)];
+#pragma omp atomic
+        this->scatter_map_bytes += std::max(m * n, 1u) * sizeof(int);
+        for (unsigned int i = 0; i < m; i++)
+          for (unsigned int j = 0; j < n; j++)
+            positions[i * n + j] = (rows[i] >= 0 && cols[j] >= 0) ? this->current_mat->get_position(rows[i], cols[j]) : -1;
+      }
+      return positions;
+    }
 
-          // Go through all equation-blocks of the local stiffness matrix.
-          for (unsigned int m = 0; m < wf->get_neq(); m++)
-          {
-            for (unsigned int n = 0; n < wf->get_neq(); n++)
-            {
-              if(blocks[m][n] && current_state->e[m] != NULL && current_state->e[n] != NULL)
-              {
-                AsmList<Scalar>*am = &(al[m]);
-                AsmList<Scalar>*an = &(al[n]);
-
-                // Pretend assembling of the element stiffness matrix.
-                for (unsigned int i = 0; i < am->cnt; i++)
-                  if(am->dof[i] >= 0)
-                    for (unsigned int j = 0; j < an->cnt; j++)
-                      if(an->dof[j] >= 0)
-                        current_mat->pre_add_ij(am->dof[i], an->dof[j]);
-              }
-            }
-          }
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::add_to_rhs(int idx, Scalar value)
+    {
+      if(this->static_condensation)
+      {
+        CondensationBuffer* buffer = this->condensation_buffers[omp_get_thread_num()];
+        if(buffer->active)
+        {
+          if(idx >= 0)
+            buffer->f[buffer->local_index[idx]] += value;
+          return;
         }
-
-        trav.finish();
-        delete [] al;
-        delete [] meshes;
-        delete [] blocks;
-
-        current_mat->alloc();
       }
 
-      // WARNING: unlike Matrix<Scalar>::alloc(), Vector<Scalar>::alloc(ndof) frees the memory occupied
-      // by previous vector before allocating
-      if(current_rhs != NULL)
-        current_rhs->alloc(this->ndof);
-
-      // save space seq numbers and weakform seq number, so we can detect their changes
-      for (unsigned int i = 0; i < wf->get_neq(); i++)
-        sp_seq[i] = spaces[i]->get_seq();
+      if(this->buffered_assembly)
+        this->rhs_buffers[omp_get_thread_num()]->add(idx, 0, value);
+      else
+        this->get_target_rhs()->add(idx, value);
     }
 
     template<typename Scalar>
-    void DiscreteProblem<Scalar>::assemble(SparseMatrix<Scalar>* mat, Vector<Scalar>* rhs,
-      bool force_diagonal_blocks, Table* block_weights)
+    DiscreteProblem<Scalar>::CondensedElement::CondensedElement(int num_interface, int num_bubble) : num_interface(num_interface), num_bubble(num_bubble)
     {
-      Scalar* coeff_vec = NULL;
-      assemble(coeff_vec, mat, rhs, force_diagonal_blocks, block_weights);
+      this->interface_dofs = new int[std::max(num_interface, 1)];
+      this->bubble_dofs = new int[num_bubble];
+      this->lu = new Scalar[num_bubble * num_bubble];
+      this->pivots = new int[num_bubble];
+      this->X = new Scalar[std::max(num_bubble * num_interface, 1)];
+      this->A_ib = new Scalar[std::max(num_bubble * num_interface, 1)];
+      this->y = new Scalar[num_bubble];
+      std::fill(this->y, this->y + num_bubble, Scalar(0));
     }
 
     template<typename Scalar>
-    void DiscreteProblem<Scalar>::assemble(Vector<Scalar>* rhs,
-      bool force_diagonal_blocks, Table* block_weights)
+    DiscreteProblem<Scalar>::CondensedElement::~CondensedElement()
     {
-      assemble(NULL, NULL, rhs, force_diagonal_blocks, block_weights);
+      delete [] this->interface_dofs;
+      delete [] this->bubble_dofs;
+      delete [] this->lu;
+      delete [] this->pivots;
+      delete [] this->X;
+      delete [] this->A_ib;
+      delete [] this->y;
     }
 
     template<typename Scalar>
-    void DiscreteProblem<Scalar>::init_assembling(Scalar* coeff_vec, PrecalcShapeset*** pss , PrecalcShapeset*** spss, RefMap*** refmaps, Solution<Scalar>*** u_ext, AsmList<Scalar>*** als, WeakForm<Scalar>** weakforms)
+    void DiscreteProblem<Scalar>::CondensedElement::lu_solve(Scalar* b) const
     {
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      int n = this->num_bubble;
+      for (int k = 0; k < n; k++)
       {
-        pss[i] = new PrecalcShapeset*[wf->get_neq()];
-        for (unsigned int j = 0; j < wf->get_neq(); j++)
-          pss[i][j] = new PrecalcShapeset(spaces[j]->shapeset);
+        if(this->pivots[k] != k)
+          std::swap(b[k], b[this->pivots[k]]);
+        for (int i = k + 1; i < n; i++)
+          b[i] -= this->lu[i * n + k] * b[k];
       }
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      for (int k = n - 1; k >= 0; k--)
       {
-        spss[i] = new PrecalcShapeset*[wf->get_neq()];
-        for (unsigned int j = 0; j < wf->get_neq(); j++)
-          spss[i][j] = new PrecalcShapeset(pss[i][j]);
+        for (int j = k + 1; j < n; j++)
+          b[k] -= this->lu[k * n + j] * b[j];
+        b[k] /= this->lu[k * n + k];
       }
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+    }
+
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::CondensationBuffer::CondensationBuffer(int ndof) : active(false)
+    {
+      this->local_index = new int[std::max(ndof, 1)];
+      memset(this->local_index, -1, ndof * sizeof(int));
+    }
+
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::CondensationBuffer::~CondensationBuffer()
+    {
+      delete [] this->local_index;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::init_static_condensation()
+    {
+      if(this->DG_matrix_forms_present || this->DG_vector_forms_present)
+        throw Exceptions::Exception("The static condensation is not available for problems with DG forms.");
+      if(dynamic_cast<MatrixFreeJacobian<Scalar>*>(this->current_mat) != NULL)
+        throw Exceptions::Exception("The static condensation needs an assembled matrix.");
+
+      int num_threads_used = this->get_num_threads();
+      if(this->condensed_dof_index == NULL || !this->is_up_to_date())
       {
-        refmaps[i] = new RefMap*[wf->get_neq()];
-        for (unsigned int j = 0; j < wf->get_neq(); j++)
-        {
-          refmaps[i][j] = new RefMap();
-          refmaps[i][j]->set_quad_2d(&g_quad_2d_std);
-        }
-      }
+        this->free_static_condensation();
 
-      // U_ext functions
-      if(!is_linear)
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+        // The bubble DOFs of all the spaces, the rest is numbered in the original order.
+        this->condensed_dof_index = new int[std::max(this->ndof, 1)];
+        memset(this->condensed_dof_index, 0, this->ndof * sizeof(int));
+        AsmList<Scalar> al;
+        for (unsigned int space_i = 0; space_i < this->spaces_size; space_i++)
         {
-          if(coeff_vec != NULL)
-          {
-            u_ext[i] = new Solution<Scalar>*[wf->get_neq()];
-            if(i == 0)
-            {
-              int first_dof = 0;
-              for (int j = 0; j < wf->get_neq(); j++)
-              {
-                u_ext[i][j] = new Solution<Scalar>(spaces[j]->get_mesh());
-                Solution<Scalar>::vector_to_solution(coeff_vec, spaces[j], u_ext[i][j], !RungeKutta, first_dof);
-                first_dof += spaces[j]->get_num_dofs();
-              }
-            }
-            else
-            {
-              for (int j = 0; j < wf->get_neq(); j++)
-              {
-                u_ext[i][j] = new Solution<Scalar>(spaces[j]->get_mesh());
-                u_ext[i][j]->copy(u_ext[0][j]);
-              }
-            }
-          }
-          else
+          Element* e;
+          for_all_active_elements(e, this->spaces[space_i]->get_mesh())
           {
-            u_ext[i] = new Solution<Scalar>*[wf->get_neq()];
-            for (int j = 0; j < wf->get_neq(); j++)
-            {
-              if(spaces[j]->get_shapeset()->get_num_components() == 1)
-                u_ext[i][j] = new ZeroSolution<Scalar>(spaces[j]->get_mesh());
-              else
-                u_ext[i][j] = new ZeroSolutionVector<Scalar>(spaces[j]->get_mesh());
-            }
+            al.cnt = 0;
+            this->spaces[space_i]->get_bubble_assembly_list(e, &al);
+            for (unsigned int i = 0; i < al.cnt; i++)
+              if(al.dof[i] >= 0)
+                this->condensed_dof_index[al.dof[i] + this->spaces_first_dofs[space_i]] = -1;
           }
         }
-
-        // Assembly lists
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+        this->condensed_ndof = 0;
+        for (int dof = 0; dof < this->ndof; dof++)
+          if(this->condensed_dof_index[dof] == 0)
+            this->condensed_dof_index[dof] = this->condensed_ndof++;
+        if(this->condensed_ndof == 0)
         {
-          als[i] = new AsmList<Scalar>*[wf->get_neq()];
-          for (unsigned int j = 0; j < wf->get_neq(); j++)
-            als[i][j] = new AsmList<Scalar>();
+          this->free_static_condensation();
+          throw Exceptions::Exception("The static condensation would eliminate all the DOFs.");
         }
 
-        // Weakforms.
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
-        {
-          weakforms[i] = this->wf->clone();
-          weakforms[i]->cloneMembers(this->wf);
-        }
+        this->condensed_elements_size = this->spaces[0]->get_mesh()->get_max_element_id();
+        this->condensed_elements = new CondensedElement*[std::max(this->condensed_elements_size, 1)];
+        memset(this->condensed_elements, 0, this->condensed_elements_size * sizeof(CondensedElement*));
+      }
 
-        assert(cache_element_stored == NULL);
-        cache_element_stored = new bool*[this->spaces_size];
-        for(unsigned int i = 0; i < this->spaces_size; i++)
-        {
-          cache_element_stored[i] = new bool[this->spaces[i]->get_mesh()->get_max_element_id()];
-          memset(cache_element_stored[i], 0, sizeof(bool) * this->spaces[i]->get_mesh()->get_max_element_id());
-        }
+      if(this->condensation_buffers_size != num_threads_used)
+      {
+        for (int i = 0; i < this->condensation_buffers_size; i++)
+          delete this->condensation_buffers[i];
+        delete [] this->condensation_buffers;
+        this->condensation_buffers = new CondensationBuffer*[num_threads_used];
+        for (int i = 0; i < num_threads_used; i++)
+          this->condensation_buffers[i] = new CondensationBuffer(this->ndof);
+        this->condensation_buffers_size = num_threads_used;
+      }
     }
 
     template<typename Scalar>
-    void DiscreteProblem<Scalar>::deinit_assembling(PrecalcShapeset*** pss , PrecalcShapeset*** spss, RefMap*** refmaps, Solution<Scalar>*** u_ext, AsmList<Scalar>*** als, WeakForm<Scalar>** weakforms)
+    void DiscreteProblem<Scalar>::free_static_condensation()
     {
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      if(this->condensed_dof_index != NULL)
       {
-        for (unsigned int j = 0; j < wf->get_neq(); j++)
-          delete pss[i][j];
-        delete [] pss[i];
+        delete [] this->condensed_dof_index;
+        this->condensed_dof_index = NULL;
+      }
+      this->condensed_ndof = 0;
+      if(this->condensed_elements != NULL)
+      {
+        for (int i = 0; i < this->condensed_elements_size; i++)
+          if(this->condensed_elements[i] != NULL)
+            delete this->condensed_elements[i];
+        delete [] this->condensed_elements;
+        this->condensed_elements = NULL;
       }
-      delete [] pss;
+      this->condensed_elements_size = 0;
+      // The buffers are sized by the number of DOFs.
+      for (int i = 0; i < this->condensation_buffers_size; i++)
+        delete this->condensation_buffers[i];
+      if(this->condensation_buffers != NULL)
+        delete [] this->condensation_buffers;
+      this->condensation_buffers = NULL;
+      this->condensation_buffers_size = 0;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::begin_condensation(AsmList<Scalar>** current_als, Traverse::State* current_state)
+    {
+      CondensationBuffer* buffer = this->condensation_buffers[omp_get_thread_num()];
+      // A state left after an exception.
+      for (unsigned int i = 0; i < buffer->dofs.size(); i++)
+        buffer->local_index[buffer->dofs[i]] = -1;
+      buffer->dofs.clear();
 
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      for (unsigned int space_i = 0; space_i < this->spaces_size; space_i++)
       {
-        for (unsigned int j = 0; j < wf->get_neq(); j++)
-          delete spss[i][j];
-        delete [] spss[i];
+        if(current_state->e[space_i] == NULL || current_state->sub_idx[space_i] != 0)
+          throw Exceptions::Exception("The static condensation needs the spaces (and the external functions) on the same mesh.");
+        AsmList<Scalar>* al = current_als[space_i];
+        for (unsigned int i = 0; i < al->cnt; i++)
+          if(al->dof[i] >= 0 && buffer->local_index[al->dof[i]] < 0)
+          {
+            buffer->local_index[al->dof[i]] = buffer->dofs.size();
+            buffer->dofs.push_back(al->dof[i]);
+          }
       }
-      delete [] spss;
 
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      int size = buffer->dofs.size();
+      buffer->A.assign(size * size, Scalar(0));
+      buffer->f.assign(size, Scalar(0));
+      buffer->active = true;
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::end_condensation(Traverse::State* current_state)
+    {
+      CondensationBuffer* buffer = this->condensation_buffers[omp_get_thread_num()];
+      buffer->active = false;
+
+      int size = buffer->dofs.size();
+      int* interface_local = this->current_arena()->template allocate_array<int>(std::max(size, 1));
+      int* bubble_local = this->current_arena()->template allocate_array<int>(std::max(size, 1));
+      int ni = 0, nb = 0;
+      for (int i = 0; i < size; i++)
+        if(this->condensed_dof_index[buffer->dofs[i]] >= 0)
+          interface_local[ni++] = i;
+        else
+          bubble_local[nb++] = i;
+      int* rows = this->current_arena()->template allocate_array<int>(std::max(ni, 1));
+      for (int i = 0; i < ni; i++)
+        rows[i] = this->condensed_dof_index[buffer->dofs[interface_local[i]]];
+
+      CondensedElement*& record = this->condensed_elements[current_state->e[0]->id];
+      if(nb == 0)
       {
-        for (unsigned int j = 0; j < wf->get_neq(); j++)
-          delete refmaps[i][j];
-        delete [] refmaps[i];
+        // Nothing to eliminate.
+        if(record != NULL)
+        {
+          delete record;
+          record = NULL;
+        }
       }
-      delete [] refmaps;
-
-      if(u_ext != NULL)
+      else if(this->current_mat != NULL)
       {
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+        if(record == NULL || record->num_interface != ni || record->num_bubble != nb)
+        {
+          if(record != NULL)
+            delete record;
+          record = new CondensedElement(ni, nb);
+        }
+        for (int i = 0; i < ni; i++)
+          record->interface_dofs[i] = buffer->dofs[interface_local[i]];
+        for (int b = 0; b < nb; b++)
+          record->bubble_dofs[b] = buffer->dofs[bubble_local[b]];
+
+        // LU factorization of A_bb with partial pivoting by rows.
+        for (int a = 0; a < nb; a++)
+          for (int b = 0; b < nb; b++)
+            record->lu[a * nb + b] = buffer->A[bubble_local[a] * size + bubble_local[b]];
+        for (int k = 0; k < nb; k++)
         {
-          if(u_ext[i] != NULL)
+          int pivot = k;
+          for (int i = k + 1; i < nb; i++)
+            if(std::abs(record->lu[i * nb + k]) > std::abs(record->lu[pivot * nb + k]))
+              pivot = i;
+          record->pivots[k] = pivot;
+          if(pivot != k)
+            for (int j = 0; j < nb; j++)
+              std::swap(record->lu[k * nb + j], record->lu[pivot * nb + j]);
+          if(record->lu[k * nb + k] == Scalar(0))
+            throw Exceptions::Exception("The local matrix of the bubble DOFs of the element %d is singular, it can not be condensed.", current_state->e[0]->id);
+          for (int i = k + 1; i < nb; i++)
           {
-            for (unsigned int j = 0; j < wf->get_neq(); j++)
-              delete u_ext[i][j];
-            delete [] u_ext[i];
+            Scalar multiplier = record->lu[i * nb + k] / record->lu[k * nb + k];
+            record->lu[i * nb + k] = multiplier;
+            if(multiplier != Scalar(0))
+              for (int j = k + 1; j < nb; j++)
+                record->lu[i * nb + j] -= multiplier * record->lu[k * nb + j];
           }
         }
-        delete [] u_ext;
+
+        // X = A_bb^{-1} A_bi, one column after another.
+        Scalar* column = this->current_arena()->template allocate_array<Scalar>(nb);
+        for (int i = 0; i < ni; i++)
+        {
+          for (int b = 0; b < nb; b++)
+            column[b] = buffer->A[bubble_local[b] * size + interface_local[i]];
+          record->lu_solve(column);
+          for (int b = 0; b < nb; b++)
+            record->X[b * ni + i] = column[b];
+        }
+        for (int i = 0; i < ni; i++)
+          for (int b = 0; b < nb; b++)
+            record->A_ib[i * nb + b] = buffer->A[interface_local[i] * size + bubble_local[b]];
+
+        // S = A_ii - A_ib A_bb^{-1} A_bi.
+        Scalar** schur = this->current_arena()->allocate_matrix(ni, ni);
+        for (int i = 0; i < ni; i++)
+          for (int j = 0; j < ni; j++)
+          {
+            Scalar value = buffer->A[interface_local[i] * size + interface_local[j]];
+            for (int b = 0; b < nb; b++)
+              value -= record->A_ib[i * nb + b] * record->X[b * ni + j];
+            schur[i][j] = value;
+          }
+        this->add_to_matrix(ni, ni, schur, rows, rows);
       }
+      else if(record == NULL || record->num_interface != ni || record->num_bubble != nb)
+        throw Exceptions::Exception("The right-hand side of a statically condensed system has to be assembled together with or after its matrix.");
 
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      if(nb == 0)
       {
-        for (unsigned int j = 0; j < wf->get_neq(); j++)
-          delete als[i][j];
-        delete [] als[i];
+        if(this->current_mat != NULL)
+        {
+          Scalar** local = this->current_arena()->allocate_matrix(ni, ni);
+          for (int i = 0; i < ni; i++)
+            for (int j = 0; j < ni; j++)
+              local[i][j] = buffer->A[interface_local[i] * size + interface_local[j]];
+          this->add_to_matrix(ni, ni, local, rows, rows);
+        }
+        if(this->current_rhs != NULL)
+          for (int i = 0; i < ni; i++)
+            this->add_to_rhs(rows[i], buffer->f[interface_local[i]]);
       }
-      delete [] als;
-
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      else if(this->current_rhs != NULL)
       {
-        weakforms[i]->free_ext();
-        delete weakforms[i];
+        // g = f_i - A_ib A_bb^{-1} f_b, A_bb^{-1} f_b is kept for the recovery.
+        for (int b = 0; b < nb; b++)
+          record->y[b] = buffer->f[bubble_local[b]];
+        record->lu_solve(record->y);
+        for (int i = 0; i < ni; i++)
+        {
+          Scalar value = buffer->f[interface_local[i]];
+          for (int b = 0; b < nb; b++)
+            value -= record->A_ib[i * nb + b] * record->y[b];
+          this->add_to_rhs(rows[i], value);
+        }
       }
-      delete [] weakforms;
 
-      for(unsigned int i = 0; i < this->spaces_size; i++)
-        delete [] cache_element_stored[i];
-      delete [] cache_element_stored;
-      cache_element_stored = NULL;
+      for (int i = 0; i < size; i++)
+        buffer->local_index[buffer->dofs[i]] = -1;
+      buffer->dofs.clear();
     }
 
     template<typename Scalar>
-    void DiscreteProblem<Scalar>::assemble(Scalar* coeff_vec, SparseMatrix<Scalar>* mat, Vector<Scalar>* rhs, bool force_diagonal_blocks, Table* block_weights)
+    void DiscreteProblem<Scalar>::condense_sparse_structure()
     {
-      // Check.
-      this->check();
-      if(this->ndof == 0)
-        throw Exceptions::Exception("Zero DOFs detected in DiscreteProblem::assemble().");
-
-      // Important, sets the current caughtException to NULL.
-      this->caughtException = NULL;
-
-      current_mat = mat;
-      current_rhs = rhs;
-      current_force_diagonal_blocks = force_diagonal_blocks;
-      current_block_weights = block_weights;
-
-      // Check that the block scaling table have proper dimension.
-      if(block_weights != NULL)
-        if(block_weights->get_size() != wf->get_neq())
-          throw Exceptions::LengthException(6, block_weights->get_size(), wf->get_neq());
-
-      // Creating matrix sparse structure.
-      create_sparse_structure();
-
-      // Initial check of meshes and spaces.
-      for(unsigned int ext_i = 0; ext_i < this->wf->ext.size(); ext_i++)
+      int* col_start = new int[this->condensed_ndof + 1];
+      col_start[0] = 0;
+      int col = 0;
+      int count = 0;
+      for (int dof = 0; dof < this->ndof; dof++)
       {
-        if(!this->wf->ext[ext_i]->isOkay())
-          throw Hermes::Exceptions::Exception("Ext function %d is not okay in assemble().", ext_i);
+        if(this->condensed_dof_index[dof] < 0)
+          continue;
+        // The map is increasing, the rows stay sorted and in the upper triangle.
+        for (int i = this->sparse_structure_col_start[dof]; i < this->sparse_structure_col_start[dof + 1]; i++)
+          if(this->condensed_dof_index[this->sparse_structure_rows[i]] >= 0)
+            this->sparse_structure_rows[count++] = this->condensed_dof_index[this->sparse_structure_rows[i]];
+        col_start[++col] = count;
       }
+      delete [] this->sparse_structure_col_start;
+      this->sparse_structure_col_start = col_start;
+    }
 
-      // Structures that cloning will be done into.
-      PrecalcShapeset*** pss = new PrecalcShapeset**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-      PrecalcShapeset*** spss = new PrecalcShapeset**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-      RefMap*** refmaps = new RefMap**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-      Solution<Scalar>*** u_ext = new Solution<Scalar>**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-      AsmList<Scalar>*** als = new AsmList<Scalar>**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-      WeakForm<Scalar>** weakforms = new WeakForm<Scalar>*[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-
-      // Fill these structures.
-      init_assembling(coeff_vec, pss, spss, refmaps, u_ext, als, weakforms);
-
-      // Vector of meshes.
-      Hermes::vector<const Mesh*> meshes;
-      for(unsigned int space_i = 0; space_i < spaces.size(); space_i++)
-        meshes.push_back(spaces[space_i]->get_mesh());
-      for(unsigned int ext_i = 0; ext_i < this->wf->ext.size(); ext_i++)
-        meshes.push_back(this->wf->ext[ext_i]->get_mesh());
-      for(unsigned int form_i = 0; form_i < this->wf->get_forms().size(); form_i++)
-        for(unsigned int ext_i = 0; ext_i < this->wf->get_forms()[form_i]->ext.size(); ext_i++)
-          if(this->wf->get_forms()[form_i]->ext[ext_i] != NULL)
-            meshes.push_back(this->wf->get_forms()[form_i]->ext[ext_i]->get_mesh());
-      for(unsigned int space_i = 0; space_i < spaces.size(); space_i++)
-        meshes.push_back(spaces[space_i]->get_mesh());
-
-      Traverse trav_master(true);
-      unsigned int num_states = trav_master.get_num_states(meshes);
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::set_assembly_buffers_state(int state_i)
+    {
+      this->mat_buffers[omp_get_thread_num()]->set_state(state_i);
+      this->rhs_buffers[omp_get_thread_num()]->set_state(state_i);
+    }
 
-      trav_master.begin(meshes.size(), &(meshes.front()));
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::merge_assembly_buffers()
+    {
+      int num_threads_used = this->get_num_threads();
 
-      Traverse* trav = new Traverse[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-      Hermes::vector<Transformable *>* fns = new Hermes::vector<Transformable *>[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      // Every thread merges the values from all buffers belonging to its own range of columns (of the matrix)
+      // or rows (of the vector), so that no two threads ever add to the same entry.
+#pragma omp parallel num_threads(num_threads_used)
       {
-        for (unsigned j = 0; j < spaces.size(); j++)
-          fns[i].push_back(pss[i][j]);
-        for (unsigned j = 0; j < this->wf->ext.size(); j++)
-        {
-          fns[i].push_back(weakforms[i]->ext[j]);
-          weakforms[i]->ext[j]->set_quad_2d(&g_quad_2d_std);
-        }
-        for(unsigned int form_i = 0; form_i < this->wf->get_forms().size(); form_i++)
+        this->apply_thread_affinity();
+        int range_start = (int)(((long long)this->ndof * omp_get_thread_num()) / num_threads_used);
+        int range_end = (int)(((long long)this->ndof * (omp_get_thread_num() + 1)) / num_threads_used);
+
+        for(int buffer_type = 0; buffer_type < 2; buffer_type++)
         {
-          for(unsigned int ext_i = 0; ext_i < this->wf->get_forms()[form_i]->ext.size(); ext_i++)
-            if(this->wf->get_forms()[form_i]->ext[ext_i] != NULL)
+          AssemblyBuffer** buffers = (buffer_type == 0 ? this->mat_buffers : this->rhs_buffers);
+          if((buffer_type == 0 && this->current_mat == NULL) || (buffer_type == 1 && this->current_rhs == NULL))
+            continue;
+
+          int count = 0;
+          for(int thread_i = 0; thread_i < num_threads_used; thread_i++)
+            for(int entry_i = 0; entry_i < buffers[thread_i]->count; entry_i++)
             {
-              fns[i].push_back(weakforms[i]->get_forms()[form_i]->ext[ext_i]);
-              weakforms[i]->get_forms()[form_i]->ext[ext_i]->set_quad_2d(&g_quad_2d_std);
+              int key = (buffer_type == 0 ? buffers[thread_i]->entries[entry_i].col : buffers[thread_i]->entries[entry_i].row);
+              if(key >= range_start && key < range_end)
+                count++;
             }
-        }
-        for (unsigned j = 0; j < wf->get_neq(); j++)
-        {
-          fns[i].push_back(u_ext[i][j]);
-          u_ext[i][j]->set_quad_2d(&g_quad_2d_std);
-        }
-        trav[i].begin(meshes.size(), &(meshes.front()), &(fns[i].front()));
-        trav[i].stack = trav_master.stack;
-      }
 
-      int state_i;
+          typename AssemblyBuffer::Entry* entries = new typename AssemblyBuffer::Entry[count];
+          count = 0;
+          for(int thread_i = 0; thread_i < num_threads_used; thread_i++)
+            for(int entry_i = 0; entry_i < buffers[thread_i]->count; entry_i++)
+            {
+              int key = (buffer_type == 0 ? buffers[thread_i]->entries[entry_i].col : buffers[thread_i]->entries[entry_i].row);
+              if(key >= range_start && key < range_end)
+                entries[count++] = buffers[thread_i]->entries[entry_i];
+            }
 
-      PrecalcShapeset** current_pss;
-      PrecalcShapeset** current_spss;
-      RefMap** current_refmaps;
-      Solution<Scalar>** current_u_ext;
-      AsmList<Scalar>** current_als;
-      WeakForm<Scalar>* current_weakform;
+          // Sorting makes the order of summation independent of the thread that assembled the values.
+          std::sort(entries, entries + count);
 
-#define CHUNKSIZE 1
-      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
-#pragma omp parallel shared(trav_master, mat, rhs ) private(state_i, current_pss, current_spss, current_refmaps, current_u_ext, current_als, current_weakform) num_threads(num_threads_used)
-      {
-#pragma omp for schedule(static, CHUNKSIZE)
-        for(state_i = 0; state_i < num_states; state_i++)
-        {
-          if(this->caughtException != NULL)
-            continue;
           try
           {
-            Traverse::State current_state;
-#pragma omp critical (get_next_state)
+            int entry_i = 0;
+            while(entry_i < count)
             {
-              try
-              {
-                current_state = trav[omp_get_thread_num()].get_next_state(&trav_master.top, &trav_master.id);
-              }
-              catch(Hermes::Exceptions::Exception& e)
-              {
-                if(this->caughtException == NULL)
-                  this->caughtException = e.clone();
-              }
-              catch(std::exception& e)
-              {
-                if(this->caughtException == NULL)
-                  this->caughtException = new Hermes::Exceptions::Exception(e.what());
-              }
-            }
-
-            current_pss = pss[omp_get_thread_num()];
-            current_spss = spss[omp_get_thread_num()];
-            current_refmaps = refmaps[omp_get_thread_num()];
-            current_u_ext = u_ext[omp_get_thread_num()];
-            current_als = als[omp_get_thread_num()];
-            current_weakform = weakforms[omp_get_thread_num()];
+              Scalar sum = entries[entry_i].value;
+              int next_i = entry_i + 1;
+              while(next_i < count && entries[next_i].row == entries[entry_i].row && entries[next_i].col == entries[entry_i].col)
+                sum += entries[next_i++].value;
 
-            // One state is a collection of (virtual) elements sharing
-            // the same physical location on (possibly) different meshes.
-            // This is then the same element of the virtual union mesh.
-            // The proper sub-element mappings to all the functions of
-            // this stage is supplied by the function Traverse::get_next_state()
-            // called in the while loop.
-            assemble_one_state(current_pss, current_spss, current_refmaps, current_u_ext, current_als, &current_state, current_weakform);
+              if(buffer_type == 0)
+                this->current_mat->add(entries[entry_i].row, entries[entry_i].col, sum);
+              else
+                this->current_rhs->add(entries[entry_i].row, sum);
 
-            if(DG_matrix_forms_present || DG_vector_forms_present)
-              assemble_one_DG_state(current_pss, current_spss, current_refmaps, current_als, &current_state, current_weakform->mfDG, current_weakform->vfDG, trav[omp_get_thread_num()].fn, current_weakform);
+              entry_i = next_i;
+            }
           }
           catch(Hermes::Exceptions::Exception& e)
           {
+            omp_set_lock(&this->caught_exception_lock);
             if(this->caughtException == NULL)
               this->caughtException = e.clone();
+            omp_unset_lock(&this->caught_exception_lock);
           }
           catch(std::exception& e)
           {
+            omp_set_lock(&this->caught_exception_lock);
             if(this->caughtException == NULL)
               this->caughtException = new Hermes::Exceptions::Exception(e.what());
+            omp_unset_lock(&this->caught_exception_lock);
           }
+
+          delete [] entries;
         }
       }
 
-      deinit_assembling(pss, spss, refmaps, u_ext, als, weakforms);
+      for(int thread_i = 0; thread_i < num_threads_used; thread_i++)
+      {
+        this->mat_buffers[thread_i]->count = 0;
+        this->rhs_buffers[thread_i]->count = 0;
+      }
+    }
 
-      trav_master.finish();
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
-        trav[i].finish();
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::init_assembly_schedule(Traverse::State** states, int num_states, int*& item_first_states, int*& item_end_states, int*& phase_first_items, int& num_phases)
+    {
+      item_first_states = new int[num_states];
+      item_end_states = new int[num_states];
 
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      if(!this->colored_assembly || this->spaces_size != 1 || this->DG_matrix_forms_present || this->DG_vector_forms_present)
       {
-        fns[i].clear();
+        // Every state is a work item, all in one phase.
+        for(int state_i = 0; state_i < num_states; state_i++)
+        {
+          item_first_states[state_i] = state_i;
+          item_end_states[state_i] = state_i + 1;
+        }
+        num_phases = 1;
+        phase_first_items = new int[2];
+        phase_first_items[0] = 0;
+        phase_first_items[1] = num_states;
+        return;
       }
-      delete [] fns;
-      delete [] trav;
 
-      /// \todo Should this be really here? Or in assemble()?
-      if(current_mat != NULL)
-        current_mat->finish();
-      if(current_rhs != NULL)
-        current_rhs->finish();
+      int num_colors;
+      const int* colors = this->spaces[0]->get_element_coloring(num_colors);
 
-      if(DG_matrix_forms_present || DG_vector_forms_present)
+      // The states of one element (its sub-elements in the union mesh) come one after another
+      // in the traversal and share all DOFs, so these form one work item.
+      int* run_first_states = new int[num_states];
+      int* run_colors = new int[num_states];
+      int num_runs = 0;
+      for(int state_i = 0; state_i < num_states; state_i++)
       {
-        Element* element_to_set_nonvisited;
-        for(unsigned int mesh_i = 0; mesh_i < meshes.size(); mesh_i++)
-          for_all_elements(element_to_set_nonvisited, meshes[mesh_i])
-          element_to_set_nonvisited->visited = false;
+        if(state_i > 0 && states[state_i]->e[0] == states[state_i - 1]->e[0])
+          continue;
+        run_first_states[num_runs] = state_i;
+        run_colors[num_runs] = (states[state_i]->e[0] == NULL ? 0 : colors[states[state_i]->e[0]->id]);
+        num_runs++;
       }
 
-      if(this->caughtException != NULL)
-        throw *(this->caughtException);
-    }
+      // Sort the work items by color, one color is one phase.
+      num_phases = std::max(num_colors, 1);
+      phase_first_items = new int[num_phases + 1];
+      memset(phase_first_items, 0, (num_phases + 1) * sizeof(int));
+      for(int run_i = 0; run_i < num_runs; run_i++)
+        phase_first_items[run_colors[run_i] + 1]++;
+      for(int phase_i = 0; phase_i < num_phases; phase_i++)
+        phase_first_items[phase_i + 1] += phase_first_items[phase_i];
+
+      int* phase_positions = new int[num_phases];
+      memcpy(phase_positions, phase_first_items, num_phases * sizeof(int));
+      for(int run_i = 0; run_i < num_runs; run_i++)
+      {
+        int item_i = phase_positions[run_colors[run_i]]++;
+        item_first_states[item_i] = run_first_states[run_i];
+        item_end_states[item_i] = (run_i == num_runs - 1 ? num_states : run_first_states[run_i + 1]);
+      }
 
-    template<typename Scalar>
-    void DiscreteProblem<Scalar>::assemble(Scalar* coeff_vec, Vector<Scalar>* rhs,
-      bool force_diagonal_blocks, Table* block_weights)
-    {
-      assemble(coeff_vec, NULL, rhs, force_diagonal_blocks, block_weights);
+      delete [] phase_positions;
+      delete [] run_first_states;
+      delete [] run_colors;
     }
 
     template<typename Scalar>
-    DiscreteProblem<Scalar>::CacheRecordPerSubIdx::CacheRecordPerSubIdx() : fnsSurface(NULL)
+    void DiscreteProblem<Scalar>::group_assembly_schedule_by_marker(Traverse::State** states, int* item_first_states, int* item_end_states, int* phase_first_items, int num_phases)
     {
-    }
+      int num_items = phase_first_items[num_phases];
+      if(num_items == 0)
+        return;
 
-    template<typename Scalar>
-    void DiscreteProblem<Scalar>::CacheRecordPerSubIdx::clear()
-    {
-      for(unsigned int i = 0; i < this->asmlistCnt; i++)
+      int num_markers = 1;
+      for(int item_i = 0; item_i < num_items; item_i++)
+        num_markers = std::max(num_markers, states[item_first_states[item_i]]->rep->marker + 1);
+
+      int* marker_positions = new int[num_markers + 1];
+      int* sorted_first_states = new int[num_items];
+      int* sorted_end_states = new int[num_items];
+      for(int phase_i = 0; phase_i < num_phases; phase_i++)
       {
-        this->fns[i]->free_fn();
-        delete this->fns[i];
+        memset(marker_positions, 0, (num_markers + 1) * sizeof(int));
+        for(int item_i = phase_first_items[phase_i]; item_i < phase_first_items[phase_i + 1]; item_i++)
+          marker_positions[std::max(states[item_first_states[item_i]]->rep->marker, 0) + 1]++;
+        marker_positions[0] = phase_first_items[phase_i];
+        for(int marker = 0; marker < num_markers; marker++)
+          marker_positions[marker + 1] += marker_positions[marker];
+
+        for(int item_i = phase_first_items[phase_i]; item_i < phase_first_items[phase_i + 1]; item_i++)
+        {
+          int sorted_item_i = marker_positions[std::max(states[item_first_states[item_i]]->rep->marker, 0)]++;
+          sorted_first_states[sorted_item_i] = item_first_states[item_i];
+          sorted_end_states[sorted_item_i] = item_end_states[item_i];
+        }
       }
-      delete [] this->fns;
+      memcpy(item_first_states, sorted_first_states, num_items * sizeof(int));
+      memcpy(item_end_states, sorted_end_states, num_items * sizeof(int));
 
-      delete [] this->jacobian_x_weights;
-      this->geometry->free();
-      delete this->geometry;
+      delete [] marker_positions;
+      delete [] sorted_first_states;
+      delete [] sorted_end_states;
+    }
 
-      if(this->fnsSurface != NULL)
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::assemble_work_item(Traverse::State** states, int first_state, int end_state, Transformable** current_fns)
+    {
+      int thread_i = omp_get_thread_num();
+      PrecalcShapeset** current_pss = this->thread_pss[thread_i];
+      PrecalcShapeset** current_spss = this->thread_spss[thread_i];
+      RefMap** current_refmaps = this->thread_refmaps[thread_i];
+      Solution<Scalar>** current_u_ext = this->thread_u_ext[thread_i];
+      AsmList<Scalar>** current_als = this->thread_als[thread_i];
+      WeakForm<Scalar>* current_weakform = this->thread_weakforms[thread_i];
+
+      for(int state_i = first_state; state_i < end_state; state_i++)
       {
-        for(unsigned int edge_i = 0; edge_i < nvert; edge_i++)
+        if(this->caughtException != NULL)
+          continue;
+        try
         {
-          if(this->fnsSurface[edge_i] == NULL)
-            continue;
-          delete [] this->jacobian_x_weightsSurface[edge_i];
-          this->geometrySurface[edge_i]->free();
-          delete this->geometrySurface[edge_i];
+          Traverse::State* current_state = states[state_i];
 
-          for(unsigned int i = 0; i < this->asmlistSurfaceCnt[edge_i]; i++)
-          {
-            this->fnsSurface[edge_i][i]->free_fn();
-            delete this->fnsSurface[edge_i][i];
-          }
-          delete [] this->fnsSurface[edge_i];
-        }
+          // Temporaries of the previous state are not needed any more.
+          this->current_arena()->reset();
 
-        delete [] this->fnsSurface;
-        delete [] this->geometrySurface;
-        delete [] this->jacobian_x_weightsSurface;
+          // One state is a collection of (virtual) elements sharing
+          // the same physical location on (possibly) different meshes.
+          // This is then the same element of the virtual union mesh.
+          // The proper sub-element mappings to all the functions of
+          // this stage are set here from the precalculated state.
+          Traverse::set_state_to_fns(current_state, current_fns);
 
-        delete [] this->n_quadrature_pointsSurface;
-        delete [] this->orderSurface;
-        delete [] this->asmlistSurfaceCnt;
+          if(this->buffered_assembly)
+            set_assembly_buffers_state(state_i);
+          set_scatter_map_state(state_i);
+          set_batched_state(state_i);
+          set_DG_cache_state(state_i);
 
-        this->fnsSurface = NULL;
+          assemble_one_state(current_pss, current_spss, current_refmaps, current_u_ext, current_als, current_state, current_weakform);
+
+          if(DG_matrix_forms_present || DG_vector_forms_present)
+            assemble_one_DG_state(current_pss, current_spss, current_refmaps, current_als, current_state, current_weakform->mfDG, current_weakform->vfDG, current_fns, current_weakform);
+        }
+        catch(Hermes::Exceptions::Exception& e)
+        {
+          omp_set_lock(&this->caught_exception_lock);
+          if(this->caughtException == NULL)
+            this->caughtException = e.clone();
+          omp_unset_lock(&this->caught_exception_lock);
+        }
+        catch(std::exception& e)
+        {
+          omp_set_lock(&this->caught_exception_lock);
+          if(this->caughtException == NULL)
+            this->caughtException = new Hermes::Exceptions::Exception(e.what());
+          omp_unset_lock(&this->caught_exception_lock);
+        }
       }
     }
 
     template<typename Scalar>
-    void DiscreteProblem<Scalar>::CacheRecordPerElement::clear()
+    double DiscreteProblem<Scalar>::get_state_cost(Traverse::State* state) const
     {
-      delete [] this->asmlistIdx;
+      int num_shapes = 0, max_order = 0;
+      bool curved = false;
+      ElementMode2D mode = HERMES_MODE_TRIANGLE;
+      for(unsigned int space_i = 0; space_i < this->spaces_size; space_i++)
+      {
+        Element* e = state->e[space_i];
+        if(e == NULL)
+          continue;
+        int order = this->spaces[space_i]->edata[e->id].order;
+        mode = e->get_mode();
+        num_shapes += CostModel::get_num_shapes(order, mode);
+        max_order = std::max(max_order, e->is_triangle() ? H2D_GET_H_ORDER(order) : order);
+        curved = curved || e->is_curved();
+      }
+      if(num_shapes == 0)
+        return 0.0;
+
+      int num_matrix_forms = this->wf->mfvol.size(), num_vector_forms = this->wf->vfvol.size();
+      if(state->isBnd)
+      {
+        num_matrix_forms += this->wf->mfsurf.size() + this->wf->mfDG.size();
+        num_vector_forms += this->wf->vfsurf.size() + this->wf->vfDG.size();
+      }
+      return CostModel::get_element_cost(num_shapes, max_order, mode, curved, num_matrix_forms, num_vector_forms);
+    }
+
+    template<typename Scalar>
+    int* DiscreteProblem<Scalar>::init_balanced_assembly_bounds(Traverse::State** states, int* item_first_states, int* item_end_states, int* phase_first_items, int num_phases, int num_threads)
+    {
+      int num_items = phase_first_items[num_phases];
+      double* costs = new double[std::max(num_items, 1)];
+      for(int item_i = 0; item_i < num_items; item_i++)
+      {
+        costs[item_i] = 0.0;
+        for(int state_i = item_first_states[item_i]; state_i < item_end_states[item_i]; state_i++)
+          costs[item_i] += get_state_cost(states[state_i]);
+      }
+
+      int* bounds = new int[num_phases * (num_threads + 1)];
+      for(int phase_i = 0; phase_i < num_phases; phase_i++)
+        CostModel::partition(costs, phase_first_items[phase_i], phase_first_items[phase_i + 1], num_threads, &bounds[phase_i * (num_threads + 1)]);
+      delete [] costs;
+      return bounds;
     }
 
     template<typename Scalar>
     bool DiscreteProblem<Scalar>::state_needs_recalculation(AsmList<Scalar>** current_als, Traverse::State* current_state)
     {
+      Hermes::ProfilerRegion profiler_region("DiscreteProblem::state_needs_recalculation");
       for(unsigned int i = 0; i < this->spaces_size; i++)
       {
         if(current_state->e[i] == NULL)
@@ -1327,6 +4189,7 @@ namespace Hermes
     void DiscreteProblem<Scalar>::calculate_cache_records(PrecalcShapeset** current_pss, PrecalcShapeset** current_spss, RefMap** current_refmaps, Solution<Scalar>** current_u_ext, AsmList<Scalar>** current_als, Traverse::State* current_state,
       AsmList<Scalar>** current_alsSurface, WeakForm<Scalar>* current_wf)
     {
+      Hermes::ProfilerRegion profiler_region("DiscreteProblem::calculate_cache_records");
       for(unsigned int space_i = 0; space_i < this->spaces_size; space_i++)
       {
         bool new_cache = false;
@@ -1334,39 +4197,44 @@ namespace Hermes
           continue;
 
         // No sub_idx map for this element.
-#pragma omp critical (cache_records_sub_idx_map)
+        omp_set_lock(&this->cache_lock);
         {
           try
           {
             if(this->cache_records_sub_idx[space_i][current_state->e[space_i]->id] == NULL)
             {
-              this->cache_records_sub_idx[space_i][current_state->e[space_i]->id] = new std::map<uint64_t, CacheRecordPerSubIdx*>;
+              this->cache_records_sub_idx[space_i][current_state->e[space_i]->id] = new SubIdxCacheTable;
               new_cache = true;
             }
             else
             {
-              // If the sub_idx map exists AND contains a record for this sub_idx, we need to delete the record.
-              typename std::map<uint64_t, CacheRecordPerSubIdx*>::iterator it = this->cache_records_sub_idx[space_i][current_state->e[space_i]->id]->find(current_state->sub_idx[space_i]);
-              if(it != this->cache_records_sub_idx[space_i][current_state->e[space_i]->id]->end())
-                (*it).second->clear();
+              // If the sub_idx table exists AND contains a record for this sub_idx, we need to delete the record.
+              CacheRecordPerSubIdx* record = this->cache_records_sub_idx[space_i][current_state->e[space_i]->id]->get(current_state->sub_idx[space_i]);
+              if(record != NULL)
+                record->clear();
               else new_cache = true;
             }
 
             // Insert the new record.
             if(new_cache)
-              this->cache_records_sub_idx[space_i][current_state->e[space_i]->id]->insert(std::pair<uint64_t, CacheRecordPerSubIdx*>(current_state->sub_idx[space_i], new CacheRecordPerSubIdx));
+              this->cache_records_sub_idx[space_i][current_state->e[space_i]->id]->insert(current_state->sub_idx[space_i], new CacheRecordPerSubIdx);
           }
           catch(Hermes::Exceptions::Exception& e)
           {
+            omp_set_lock(&this->caught_exception_lock);
             if(this->caughtException == NULL)
               this->caughtException = e.clone();
+            omp_unset_lock(&this->caught_exception_lock);
           }
           catch(std::exception& e)
           {
+            omp_set_lock(&this->caught_exception_lock);
             if(this->caughtException == NULL)
               this->caughtException = new Hermes::Exceptions::Exception(e.what());
+            omp_unset_lock(&this->caught_exception_lock);
           }
         }
+        omp_unset_lock(&this->cache_lock);
         if(this->caughtException != NULL)
           return;
       }
@@ -1378,9 +4246,10 @@ namespace Hermes
         Hermes::vector<MatrixFormVol<Scalar>*> current_mfvol = current_wf->mfvol;
         Hermes::vector<VectorFormVol<Scalar>*> current_vfvol = current_wf->vfvol;
 
-        for(int current_mfvol_i = 0; current_mfvol_i < current_mfvol.size(); current_mfvol_i++)
+        // Without the matrix (the residual only), the matrix forms do not determine the order.
+        for(int current_mfvol_i = 0; this->assemble_matrix_forms() && current_mfvol_i < current_mfvol.size(); current_mfvol_i++)
         {
-          if(!form_to_be_assembled(current_mfvol[current_mfvol_i], current_state))
+          if(!form_to_be_assembled(current_mfvol[current_mfvol_i], current_mfvol_i, current_state))
             continue;
           current_mfvol[current_mfvol_i]->wf = current_wf;
           int orderTemp = calc_order_matrix_form(current_mfvol[current_mfvol_i], current_refmaps, current_u_ext, current_state);
@@ -1390,7 +4259,7 @@ namespace Hermes
 
         for(int current_vfvol_i = 0; current_vfvol_i < current_vfvol.size(); current_vfvol_i++)
         {
-          if(!form_to_be_assembled(current_vfvol[current_vfvol_i], current_state))
+          if(!form_to_be_assembled(current_vfvol[current_vfvol_i], current_vfvol_i, current_state))
             continue;
           current_vfvol[current_vfvol_i]->wf = current_wf;
           int orderTemp = calc_order_vector_form(current_vfvol[current_vfvol_i], current_refmaps, current_u_ext, current_state);
@@ -1400,9 +4269,9 @@ namespace Hermes
 
         if(current_state->isBnd)
         {
-          for(int current_mfvol_i = 0; current_mfvol_i < current_mfvol.size(); current_mfvol_i++)
+          for(int current_mfvol_i = 0; this->assemble_matrix_forms() && current_mfvol_i < current_mfvol.size(); current_mfvol_i++)
           {
-            if(!form_to_be_assembled(current_mfvol[current_mfvol_i], current_state))
+            if(!form_to_be_assembled(current_mfvol[current_mfvol_i], current_mfvol_i, current_state))
               continue;
             current_mfvol[current_mfvol_i]->wf = current_wf;
             int orderTemp = calc_order_matrix_form(current_mfvol[current_mfvol_i], current_refmaps, current_u_ext, current_state);
@@ -1411,7 +4280,7 @@ namespace Hermes
           }
           for(int current_vfvol_i = 0; current_vfvol_i < current_vfvol.size(); current_vfvol_i++)
           {
-            if(!form_to_be_assembled(current_vfvol[current_vfvol_i], current_state))
+            if(!form_to_be_assembled(current_vfvol[current_vfvol_i], current_vfvol_i, current_state))
               continue;
             current_vfvol[current_vfvol_i]->wf = current_wf;
             int orderTemp = calc_order_vector_form(current_vfvol[current_vfvol_i], current_refmaps, current_u_ext, current_state);
@@ -1430,9 +4299,9 @@ namespace Hermes
           {
             if(!current_state->bnd[current_state->isurf])
               continue;
-            for(int current_mfsurf_i = 0; current_mfsurf_i < current_mfsurf.size(); current_mfsurf_i++)
+            for(int current_mfsurf_i = 0; this->assemble_matrix_forms() && current_mfsurf_i < current_mfsurf.size(); current_mfsurf_i++)
             {
-              if(!form_to_be_assembled(current_mfsurf[current_mfsurf_i], current_state))
+              if(!form_to_be_assembled(current_mfsurf[current_mfsurf_i], current_mfsurf_i, current_state))
                 continue;
               current_mfsurf[current_mfsurf_i]->wf = current_wf;
               int orderTemp = calc_order_matrix_form(current_mfsurf[current_mfsurf_i], current_refmaps, current_u_ext, current_state);
@@ -1442,7 +4311,7 @@ namespace Hermes
 
             for(int current_vfsurf_i = 0; current_vfsurf_i < current_vfsurf.size(); current_vfsurf_i++)
             {
-              if(!form_to_be_assembled(current_vfsurf[current_vfsurf_i], current_state))
+              if(!form_to_be_assembled(current_vfsurf[current_vfsurf_i], current_vfsurf_i, current_state))
                 continue;
               current_vfsurf[current_vfsurf_i]->wf = current_wf;
               int orderTemp = calc_order_vector_form(current_vfsurf[current_vfsurf_i], current_refmaps, current_u_ext, current_state);
@@ -1451,6 +4320,9 @@ namespace Hermes
             }
           }
         }
+
+        if(this->quadrature_order_reduction > 0)
+          order = std::max(order - this->quadrature_order_reduction, 1);
       }
 
       // Order is known, we know how many integration points we need and we can proceed.
@@ -1463,12 +4335,13 @@ namespace Hermes
         bool computingThread = false;
         if(!this->cache_element_stored[i][current_state->e[i]->id])
         {
-#pragma omp critical (cache_for_element_preparation)
+          omp_set_lock(&this->cache_lock);
           if(!this->cache_element_stored[i][current_state->e[i]->id])
           {
             computingThread = true;
             this->cache_element_stored[i][current_state->e[i]->id] = true;
           }
+          omp_unset_lock(&this->cache_lock);
         }
 
         if(computingThread)
@@ -1482,13 +4355,11 @@ namespace Hermes
           this->cache_records_element[i][current_state->e[i]->id]->asmlistIdx = new int[current_als[i]->cnt];
           for(unsigned int asmlist_i = 0; asmlist_i < current_als[i]->cnt; asmlist_i++)
             this->cache_records_element[i][current_state->e[i]->id]->asmlistIdx[asmlist_i] = current_als[i]->idx[asmlist_i];
+          this->cache_records_element[i][current_state->e[i]->id]->element_key = CacheElementKey(current_state->e[i], this->spaces[i]->get_element_order(current_state->e[i]->id), this->spaces[i]->get_shapeset()->get_id());
           this->cache_element_stored[i][current_state->e[i]->id] = true;
         }
 
-        CacheRecordPerSubIdx* newRecord;
-
-#pragma omp critical (cache_records_sub_idx_map)
-        newRecord = (*this->cache_records_sub_idx[i][current_state->e[i]->id]->find(current_state->sub_idx[i])).second;
+        CacheRecordPerSubIdx* newRecord = this->cache_records_sub_idx[i][current_state->e[i]->id]->get(current_state->sub_idx[i]);
 
         newRecord->nvert = current_state->rep->nvert;
         newRecord->order = order;
@@ -1501,11 +4372,7 @@ namespace Hermes
         current_refmaps[i]->force_transform(current_pss[i]->get_transform(), current_pss[i]->get_ctm());
         newRecord->fns = new Func<double>*[current_als[i]->cnt];
         newRecord->asmlistCnt = current_als[i]->cnt;
-        for (unsigned int j = 0; j < current_als[i]->cnt; j++)
-        {
-          current_spss[i]->set_active_shape(current_als[i]->idx[j]);
-          newRecord->fns[j] = init_fn(current_spss[i], current_refmaps[i], newRecord->order);
-        }
+        init_fns(current_spss[i], current_refmaps[i], newRecord->order, current_als[i]->idx, current_als[i]->cnt, newRecord->fns, this->space_fn_demand[i]);
 
         newRecord->n_quadrature_points = init_geometry_points(current_refmaps[i], newRecord->order, newRecord->geometry, newRecord->jacobian_x_weights);
 
@@ -1538,11 +4405,8 @@ namespace Hermes
             newRecord->asmlistSurfaceCnt[current_state->isurf] = current_alsSurface[i][current_state->isurf].cnt;
 
             newRecord->fnsSurface[current_state->isurf] = new Func<double>*[current_alsSurface[i][current_state->isurf].cnt];
-            for (unsigned int j = 0; j < current_alsSurface[i][current_state->isurf].cnt; j++)
-            {
-              current_spss[i]->set_active_shape(current_alsSurface[i][current_state->isurf].idx[j]);
-              newRecord->fnsSurface[current_state->isurf][j] = init_fn(current_spss[i], current_refmaps[i], newRecord->orderSurface[current_state->isurf]);
-            }
+            init_fns(current_spss[i], current_refmaps[i], newRecord->orderSurface[current_state->isurf], current_alsSurface[i][current_state->isurf].idx,
+              current_alsSurface[i][current_state->isurf].cnt, newRecord->fnsSurface[current_state->isurf], this->space_fn_demand[i]);
           }
         }
       }
@@ -1552,6 +4416,7 @@ namespace Hermes
     void DiscreteProblem<Scalar>::assemble_one_state(PrecalcShapeset** current_pss, PrecalcShapeset** current_spss, RefMap** current_refmaps, Solution<Scalar>** current_u_ext, AsmList<Scalar>** current_als, 
       Traverse::State* current_state, WeakForm<Scalar>* current_wf)
     {
+      Hermes::ProfilerRegion profiler_region("DiscreteProblem::assemble_one_state");
       // Representing space.
       int rep_space_i = -1;
 
@@ -1569,17 +4434,37 @@ namespace Hermes
         if(rep_space_i == -1)
           return;
 
+        if(this->static_condensation)
+          this->begin_condensation(current_als, current_state);
+
         // Element-wise parameters for WeakForm.
         (const_cast<WeakForm<Scalar>*>(current_wf))->set_active_state(current_state->e);
 
         // Do we have to recalculate the data for this state even if the cache contains the data?
         bool changedInLastAdaptation = this->do_not_use_cache ? true : this->state_needs_recalculation(current_als, current_state);
+        if(changedInLastAdaptation)
+        {
+#pragma omp atomic
+          this->cache_misses++;
+        }
+        else
+        {
+#pragma omp atomic
+          this->cache_hits++;
+        }
+        // The records are recalculated in place, their memory is accounted for at the end of the assembling.
+        if(!this->do_not_use_cache)
+        {
+          CacheStatistics::lookup(H2D_CACHE_ASSEMBLY, !changedInLastAdaptation);
+          if(changedInLastAdaptation)
+            CacheStatistics::insert(H2D_CACHE_ASSEMBLY, 0);
+        }
 
         // Assembly lists for surface forms.
         AsmList<Scalar>** current_alsSurface = NULL;
         if(current_state->isBnd && (current_wf->mfsurf.size() > 0 || current_wf->vfsurf.size() > 0 || current_wf->mfDG.size() > 0 || current_wf->vfDG.size() > 0))
         {
-          current_alsSurface = new AsmList<Scalar>*[this->spaces_size];
+          current_alsSurface = this->current_arena()->template allocate_array<AsmList<Scalar>*>(this->spaces_size);
           for(unsigned int space_i = 0; space_i < this->spaces_size; space_i++)
           {
             if(current_state->e[space_i] == NULL)
@@ -1592,7 +4477,7 @@ namespace Hermes
         }
 
         // Calculate the cache entries.
-        CacheRecordPerSubIdx** cacheRecordPerSubIdx = new CacheRecordPerSubIdx*[this->spaces_size];
+        CacheRecordPerSubIdx** cacheRecordPerSubIdx = this->current_arena()->template allocate_array<CacheRecordPerSubIdx*>(this->spaces_size);
 
         if(changedInLastAdaptation)
           this->calculate_cache_records(current_pss, current_spss, current_refmaps, current_u_ext, current_als, current_state, current_alsSurface, current_wf);
@@ -1601,15 +4486,17 @@ namespace Hermes
           return;
 
         // Store the cache entries.
-        for(int temp_i = 0; temp_i < this->spaces_size; temp_i++)
         {
-          if(current_state->e[temp_i] == NULL)
-            continue;
-#pragma omp critical (cache_records_sub_idx_map)
+          Hermes::ProfilerRegion profiler_region("DiscreteProblem cache lookup");
+          for(int temp_i = 0; temp_i < this->spaces_size; temp_i++)
           {
-            typename std::map<uint64_t, CacheRecordPerSubIdx*>::iterator it = this->cache_records_sub_idx[temp_i][current_state->e[temp_i]->id]->find(current_state->sub_idx[temp_i]);
-            if(it != this->cache_records_sub_idx[temp_i][current_state->e[temp_i]->id]->end())
-              cacheRecordPerSubIdx[temp_i] = it->second;
+            if(current_state->e[temp_i] == NULL)
+              continue;
+            CacheRecordPerSubIdx* record = this->cache_records_sub_idx[temp_i][current_state->e[temp_i]->id]->get(current_state->sub_idx[temp_i]);
+            if(record != NULL)
+              cacheRecordPerSubIdx[temp_i] = record;
+            if(this->cache_records_element[temp_i][current_state->e[temp_i]->id] != NULL)
+              this->cache_records_element[temp_i][current_state->e[temp_i]->id]->last_used = this->cache_assembling_stamp;
           }
         }
 
@@ -1623,11 +4510,11 @@ namespace Hermes
 
         if(!this->is_linear)
         {
-          u_ext = new Func<Scalar>*[prevNewtonSize];
+          u_ext = this->current_arena()->template allocate_array<Func<Scalar>*>(prevNewtonSize);
           if(current_u_ext != NULL)
             for(int u_ext_i = 0; u_ext_i < prevNewtonSize; u_ext_i++)
               if(current_u_ext[u_ext_i] != NULL)
-                u_ext[u_ext_i] = init_fn(current_u_ext[u_ext_i], order);
+                u_ext[u_ext_i] = init_fn(current_u_ext[u_ext_i], order, this->u_ext_fn_demand);
               else
                 u_ext[u_ext_i] = NULL;
           else
@@ -1635,74 +4522,99 @@ namespace Hermes
               u_ext[u_ext_i] = NULL;
         }
 
-        // - ext
-        int current_extCount = this->wf->ext.size();
-        Func<Scalar>** ext = NULL;
-        if(current_extCount > 0)
+        // The forms of the weak form of this thread, or of each instance of the ensemble (assemble_ensemble())
+        // on the shape functions and the geometry calculated above.
+        int num_instances = this->ensemble_size > 0 ? this->ensemble_size : 1;
+        for(int instance_i = 0; instance_i < num_instances; instance_i++)
         {
-          ext = new Func<Scalar>*[current_extCount];
-          for(int ext_i = 0; ext_i < current_extCount; ext_i++)
-            if(current_wf->ext[ext_i] != NULL)
-              ext[ext_i] = init_fn(current_wf->ext[ext_i], order);
-            else
-              ext[ext_i] = NULL;
-        }
+          WeakForm<Scalar>* instance_wf = current_wf;
+          if(this->ensemble_size > 0)
+            instance_wf = this->set_ensemble_instance(current_state, instance_i);
+
+          // - ext
+          int current_extCount = this->wf->ext.size();
+          Func<Scalar>** ext = NULL;
+          if(current_extCount > 0)
+          {
+            ext = this->current_arena()->template allocate_array<Func<Scalar>*>(current_extCount);
+            for(int ext_i = 0; ext_i < current_extCount; ext_i++)
+              if(instance_wf->ext[ext_i] != NULL)
+                ext[ext_i] = init_fn(instance_wf->ext[ext_i], order, this->ext_fn_demand);
+              else
+                ext[ext_i] = NULL;
+          }
 
-        if(RungeKutta)
-          for(int ext_i = 0; ext_i < this->RK_original_spaces_count; ext_i++)
-            u_ext[ext_i]->add(ext[current_extCount - this->RK_original_spaces_count + ext_i]);
+          if(RungeKutta)
+            for(int ext_i = 0; ext_i < this->RK_original_spaces_count; ext_i++)
+              u_ext[ext_i]->add(ext[current_extCount - this->RK_original_spaces_count + ext_i]);
 
-        if(current_mat != NULL)
-        {
-          for(int current_mfvol_i = 0; current_mfvol_i < wf->mfvol.size(); current_mfvol_i++)
+          if(this->assemble_matrix_forms())
           {
-            MatrixFormVol<Scalar>* mfv = current_wf->mfvol[current_mfvol_i];
+            if(this->scatter_map != NULL)
+              this->scatter_map_thread_als[omp_get_thread_num()] = current_als;
+            for(int current_mfvol_i = 0; current_mfvol_i < wf->mfvol.size(); current_mfvol_i++)
+            {
+              MatrixFormVol<Scalar>* mfv = instance_wf->mfvol[current_mfvol_i];
 
-            if(!form_to_be_assembled(mfv, current_state))
-              continue;
+              if(!form_to_be_assembled(mfv, current_mfvol_i, current_state) || this->is_form_batched(current_mfvol_i))
+                continue;
 
-            int form_i = mfv->i;
-            int form_j = mfv->j;
-            CacheRecordPerSubIdx* CacheRecordPerSubIdxI = cacheRecordPerSubIdx[form_i];
-            CacheRecordPerSubIdx* CacheRecordPerSubIdxJ = cacheRecordPerSubIdx[form_j];
-
-            assemble_matrix_form(mfv, 
-              CacheRecordPerSubIdxI->order, 
-              CacheRecordPerSubIdxJ->fns, 
-              CacheRecordPerSubIdxI->fns, 
-              ext,
-              u_ext,
-              current_als[form_i], 
-              current_als[form_j], 
-              current_state, 
-              CacheRecordPerSubIdxI->n_quadrature_points, 
-              CacheRecordPerSubIdxI->geometry, 
-              CacheRecordPerSubIdxI->jacobian_x_weights);
+              int form_i = mfv->i;
+              int form_j = mfv->j;
+              CacheRecordPerSubIdx* CacheRecordPerSubIdxI = cacheRecordPerSubIdx[form_i];
+              CacheRecordPerSubIdx* CacheRecordPerSubIdxJ = cacheRecordPerSubIdx[form_j];
+
+              assemble_matrix_form(mfv, 
+                CacheRecordPerSubIdxI->order, 
+                CacheRecordPerSubIdxJ->fns, 
+                CacheRecordPerSubIdxI->fns, 
+                ext,
+                u_ext,
+                current_als[form_i], 
+                current_als[form_j], 
+                current_state, 
+                CacheRecordPerSubIdxI->n_quadrature_points, 
+                CacheRecordPerSubIdxI->geometry, 
+                CacheRecordPerSubIdxI->jacobian_x_weights);
+            }
+            if(this->scatter_map != NULL)
+              this->scatter_map_thread_als[omp_get_thread_num()] = NULL;
           }
-        }
-        if(current_rhs != NULL)
-        {
-          for(int current_vfvol_i = 0; current_vfvol_i < wf->vfvol.size(); current_vfvol_i++)
+          if(current_rhs != NULL)
           {
-            VectorFormVol<Scalar>* vfv = current_wf->vfvol[current_vfvol_i];
+            for(int current_vfvol_i = 0; current_vfvol_i < wf->vfvol.size(); current_vfvol_i++)
+            {
+              VectorFormVol<Scalar>* vfv = instance_wf->vfvol[current_vfvol_i];
 
-            if(!form_to_be_assembled(vfv, current_state))
-              continue;
+              if(!form_to_be_assembled(vfv, current_vfvol_i, current_state))
+                continue;
 
-            int form_i = vfv->i;
-            CacheRecordPerSubIdx* CacheRecordPerSubIdxI = cacheRecordPerSubIdx[form_i];
+              int form_i = vfv->i;
+              CacheRecordPerSubIdx* CacheRecordPerSubIdxI = cacheRecordPerSubIdx[form_i];
+
+              assemble_vector_form(vfv, 
+                CacheRecordPerSubIdxI->order, 
+                CacheRecordPerSubIdxI->fns, 
+                ext,
+                u_ext, 
+                current_als[form_i], 
+                current_state, 
+                CacheRecordPerSubIdxI->n_quadrature_points,
+                CacheRecordPerSubIdxI->geometry, 
+                CacheRecordPerSubIdxI->jacobian_x_weights);
+            }
+          }
 
-            assemble_vector_form(vfv, 
-              CacheRecordPerSubIdxI->order, 
-              CacheRecordPerSubIdxI->fns, 
-              ext,
-              u_ext, 
-              current_als[form_i], 
-              current_state, 
-              CacheRecordPerSubIdxI->n_quadrature_points,
-              CacheRecordPerSubIdxI->geometry, 
-              CacheRecordPerSubIdxI->jacobian_x_weights);
+          // Cleanup - ext
+          for(int ext_i = 0; ext_i < current_extCount; ext_i++)
+          {
+            if(instance_wf->ext[ext_i] != NULL)
+            {
+              ext[ext_i]->free_fn();
+              delete ext[ext_i];
+            }
           }
+          this->free_form_ext_fns();
         }
 
         // Cleanup - u_ext
@@ -1714,19 +4626,7 @@ namespace Hermes
               u_ext[u_ext_i]->free_fn();
               delete u_ext[u_ext_i];
             }
-            delete [] u_ext;
-        }
-
-        // Cleanup - ext
-        for(int ext_i = 0; ext_i < current_extCount; ext_i++)
-        {
-          if(current_wf->ext[ext_i] != NULL)
-          {
-            ext[ext_i]->free_fn();
-            delete ext[ext_i];
-          }
         }
-          delete [] ext;
 
           // Assemble surface integrals now: loop through surfaces of the element.
           if(current_state->isBnd && (current_wf->mfsurf.size() > 0 || current_wf->vfsurf.size() > 0))
@@ -1736,9 +4636,6 @@ namespace Hermes
               if(!current_state->bnd[current_state->isurf])
                 continue;
 
-              // Edge-wise parameters for WeakForm.
-              (const_cast<WeakForm<Scalar>*>(current_wf))->set_active_edge_state(current_state->e, current_state->isurf);
-
               // Ext functions.
               // - order
               int orderSurf = cacheRecordPerSubIdx[rep_space_i]->orderSurface[current_state->isurf];
@@ -1747,78 +4644,97 @@ namespace Hermes
               Func<Scalar>** u_extSurf = NULL;
               if(!this->is_linear)
               {
-                u_extSurf = new Func<Scalar>*[prevNewtonSize];
+                u_extSurf = this->current_arena()->template allocate_array<Func<Scalar>*>(prevNewtonSize);
                 if(current_u_ext != NULL)
                   for(int u_ext_surf_i = 0; u_ext_surf_i < prevNewtonSize; u_ext_surf_i++)
                     if(current_u_ext[u_ext_surf_i] != NULL)
-                      u_extSurf[u_ext_surf_i] = current_state->e[u_ext_surf_i] == NULL ? NULL : init_fn(current_u_ext[u_ext_surf_i], orderSurf);
+                      u_extSurf[u_ext_surf_i] = current_state->e[u_ext_surf_i] == NULL ? NULL : init_fn(current_u_ext[u_ext_surf_i], orderSurf, this->u_ext_fn_demand);
                     else
                       u_extSurf[u_ext_surf_i] = NULL;
                 else
                   for(int u_ext_surf_i = 0; u_ext_surf_i < prevNewtonSize; u_ext_surf_i++)
                     u_extSurf[u_ext_surf_i] = NULL;
               }
-              // - ext
-              int current_extCount = this->wf->ext.size();
-              Func<Scalar>** extSurf = new Func<Scalar>*[current_extCount];
-              for(int ext_surf_i = 0; ext_surf_i < current_extCount; ext_surf_i++)
-                if(current_wf->ext[ext_surf_i] != NULL)
-                  extSurf[ext_surf_i] = current_state->e[ext_surf_i] == NULL ? NULL : init_fn(current_wf->ext[ext_surf_i], orderSurf);
-                else
-                  extSurf[ext_surf_i] = NULL;
-
-              if(RungeKutta)
-                for(int ext_surf_i = 0; ext_surf_i < this->RK_original_spaces_count; ext_surf_i++)
-                  u_extSurf[ext_surf_i]->add(extSurf[current_extCount - this->RK_original_spaces_count + ext_surf_i]);
 
-              if(current_mat != NULL)
+              for(int instance_i = 0; instance_i < num_instances; instance_i++)
               {
-                for(int current_mfsurf_i = 0; current_mfsurf_i < wf->mfsurf.size(); current_mfsurf_i++)
+                WeakForm<Scalar>* instance_wf = current_wf;
+                if(this->ensemble_size > 0)
+                  instance_wf = this->set_ensemble_instance(current_state, instance_i);
+
+                // Edge-wise parameters for WeakForm.
+                instance_wf->set_active_edge_state(current_state->e, current_state->isurf);
+
+                // - ext
+                int current_extCount = this->wf->ext.size();
+                Func<Scalar>** extSurf = this->current_arena()->template allocate_array<Func<Scalar>*>(current_extCount);
+                for(int ext_surf_i = 0; ext_surf_i < current_extCount; ext_surf_i++)
+                  if(instance_wf->ext[ext_surf_i] != NULL)
+                    extSurf[ext_surf_i] = current_state->e[ext_surf_i] == NULL ? NULL : init_fn(instance_wf->ext[ext_surf_i], orderSurf, this->ext_fn_demand);
+                  else
+                    extSurf[ext_surf_i] = NULL;
+
+                if(RungeKutta)
+                  for(int ext_surf_i = 0; ext_surf_i < this->RK_original_spaces_count; ext_surf_i++)
+                    u_extSurf[ext_surf_i]->add(extSurf[current_extCount - this->RK_original_spaces_count + ext_surf_i]);
+
+                if(this->assemble_matrix_forms())
                 {
-                  if(!form_to_be_assembled(current_wf->mfsurf[current_mfsurf_i], current_state))
-                    continue;
-
-                  int form_i = current_wf->mfsurf[current_mfsurf_i]->i;
-                  int form_j = current_wf->mfsurf[current_mfsurf_i]->j;
-                  CacheRecordPerSubIdx* CacheRecordPerSubIdxI = cacheRecordPerSubIdx[form_i];
-                  CacheRecordPerSubIdx* CacheRecordPerSubIdxJ = cacheRecordPerSubIdx[form_j];
-
-                  assemble_matrix_form(current_wf->mfsurf[current_mfsurf_i], 
-                    CacheRecordPerSubIdxI->orderSurface[current_state->isurf], 
-                    CacheRecordPerSubIdxJ->fnsSurface[current_state->isurf], 
-                    CacheRecordPerSubIdxI->fnsSurface[current_state->isurf], 
-                    extSurf, 
-                    u_extSurf,
-                    &current_alsSurface[form_i][current_state->isurf], 
-                    &current_alsSurface[form_j][current_state->isurf], 
-                    current_state, 
-                    CacheRecordPerSubIdxI->n_quadrature_pointsSurface[current_state->isurf], 
-                    CacheRecordPerSubIdxI->geometrySurface[current_state->isurf], 
-                    CacheRecordPerSubIdxI->jacobian_x_weightsSurface[current_state->isurf]);
+                  for(int current_mfsurf_i = 0; current_mfsurf_i < wf->mfsurf.size(); current_mfsurf_i++)
+                  {
+                    if(!form_to_be_assembled(instance_wf->mfsurf[current_mfsurf_i], current_mfsurf_i, current_state))
+                      continue;
+
+                    int form_i = instance_wf->mfsurf[current_mfsurf_i]->i;
+                    int form_j = instance_wf->mfsurf[current_mfsurf_i]->j;
+                    CacheRecordPerSubIdx* CacheRecordPerSubIdxI = cacheRecordPerSubIdx[form_i];
+                    CacheRecordPerSubIdx* CacheRecordPerSubIdxJ = cacheRecordPerSubIdx[form_j];
+
+                    assemble_matrix_form(instance_wf->mfsurf[current_mfsurf_i], 
+                      CacheRecordPerSubIdxI->orderSurface[current_state->isurf], 
+                      CacheRecordPerSubIdxJ->fnsSurface[current_state->isurf], 
+                      CacheRecordPerSubIdxI->fnsSurface[current_state->isurf], 
+                      extSurf, 
+                      u_extSurf,
+                      &current_alsSurface[form_i][current_state->isurf], 
+                      &current_alsSurface[form_j][current_state->isurf], 
+                      current_state, 
+                      CacheRecordPerSubIdxI->n_quadrature_pointsSurface[current_state->isurf], 
+                      CacheRecordPerSubIdxI->geometrySurface[current_state->isurf], 
+                      CacheRecordPerSubIdxI->jacobian_x_weightsSurface[current_state->isurf]);
+                  }
                 }
-              }
 
-              if(current_rhs != NULL)
-              {
-                for(int current_vfsurf_i = 0; current_vfsurf_i < wf->vfsurf.size(); current_vfsurf_i++)
+                if(current_rhs != NULL)
                 {
-                  if(!form_to_be_assembled(current_wf->vfsurf[current_vfsurf_i], current_state))
-                    continue;
-
-                  int form_i = current_wf->vfsurf[current_vfsurf_i]->i;
-                  CacheRecordPerSubIdx* CacheRecordPerSubIdxI = cacheRecordPerSubIdx[form_i];
-
-                  assemble_vector_form(current_wf->vfsurf[current_vfsurf_i], 
-                    CacheRecordPerSubIdxI->orderSurface[current_state->isurf], 
-                    CacheRecordPerSubIdxI->fnsSurface[current_state->isurf], 
-                    extSurf, 
-                    u_extSurf, 
-                    &current_alsSurface[form_i][current_state->isurf], 
-                    current_state, 
-                    CacheRecordPerSubIdxI->n_quadrature_pointsSurface[current_state->isurf], 
-                    CacheRecordPerSubIdxI->geometrySurface[current_state->isurf], 
-                    CacheRecordPerSubIdxI->jacobian_x_weightsSurface[current_state->isurf]);
+                  for(int current_vfsurf_i = 0; current_vfsurf_i < wf->vfsurf.size(); current_vfsurf_i++)
+                  {
+                    if(!form_to_be_assembled(instance_wf->vfsurf[current_vfsurf_i], current_vfsurf_i, current_state))
+                      continue;
+
+                    int form_i = instance_wf->vfsurf[current_vfsurf_i]->i;
+                    CacheRecordPerSubIdx* CacheRecordPerSubIdxI = cacheRecordPerSubIdx[form_i];
+
+                    assemble_vector_form(instance_wf->vfsurf[current_vfsurf_i], 
+                      CacheRecordPerSubIdxI->orderSurface[current_state->isurf], 
+                      CacheRecordPerSubIdxI->fnsSurface[current_state->isurf], 
+                      extSurf, 
+                      u_extSurf, 
+                      &current_alsSurface[form_i][current_state->isurf], 
+                      current_state, 
+                      CacheRecordPerSubIdxI->n_quadrature_pointsSurface[current_state->isurf], 
+                      CacheRecordPerSubIdxI->geometrySurface[current_state->isurf], 
+                      CacheRecordPerSubIdxI->jacobian_x_weightsSurface[current_state->isurf]);
+                  }
                 }
+
+                for(int ext_surf_i = 0; ext_surf_i < current_extCount; ext_surf_i++)
+                  if(instance_wf->ext[ext_surf_i] != NULL)
+                  {
+                    extSurf[ext_surf_i]->free_fn();
+                    delete extSurf[ext_surf_i];
+                  }
+                this->free_form_ext_fns();
               }
 
               if(current_u_ext != NULL)
@@ -1829,16 +4745,7 @@ namespace Hermes
                     u_extSurf[u_ext_surf_i]->free_fn();
                     delete u_extSurf[u_ext_surf_i];
                   }
-                  delete [] u_extSurf;
               }
-
-              for(int ext_surf_i = 0; ext_surf_i < current_extCount; ext_surf_i++)
-                if(current_wf->ext[ext_surf_i] != NULL)
-                {
-                  extSurf[ext_surf_i]->free_fn();
-                  delete extSurf[ext_surf_i];
-                }
-                delete [] extSurf;
             }
 
             for(unsigned int i = 0; i < this->spaces_size; i++)
@@ -1846,10 +4753,8 @@ namespace Hermes
                 delete [] current_alsSurface[i];
           }
 
-          if(cacheRecordPerSubIdx != NULL)
-            delete [] cacheRecordPerSubIdx;
-          if(current_alsSurface != NULL)
-            delete [] current_alsSurface;
+        if(this->static_condensation)
+          this->end_condensation(current_state);
     }
 
     template<typename Scalar>
@@ -1857,14 +4762,6 @@ namespace Hermes
     {
       int order;
 
-      // order of solutions from the previous Newton iteration etc..
-      Func<Hermes::Ord>** u_ext_ord = new Func<Hermes::Ord>*[RungeKutta ? RK_original_spaces_count : this->wf->get_neq() - form->u_ext_offset];
-      Func<Hermes::Ord>** ext_ord = NULL;
-      int ext_size = std::max(form->ext.size(), form->wf->ext.size());
-      if(ext_size > 0)
-        ext_ord = new Func<Hermes::Ord>*[ext_size];
-      init_ext_orders(form, u_ext_ord, ext_ord, current_u_ext, current_state);
-
       // Order of shape functions.
       int max_order_j = this->spaces[form->j]->get_element_order(current_state->e[form->j]->id);
       int max_order_i = this->spaces[form->i]->get_element_order(current_state->e[form->i]->id);
@@ -1887,21 +4784,44 @@ namespace Hermes
           max_order_j = eo;
       }
 
-      Func<Hermes::Ord>* ou = init_fn_ord(max_order_j + (spaces[form->j]->get_shapeset()->get_num_components() > 1 ? 1 : 0));
-      Func<Hermes::Ord>* ov = init_fn_ord(max_order_i + (spaces[form->i]->get_shapeset()->get_num_components() > 1 ? 1 : 0));
+      // The Ord evaluation depends only on the orders, look it up first.
+      FormOrderKey key;
+      std::map<FormOrderKey, int>* form_order_cache = this->get_form_order_cache();
+      if(form_order_cache != NULL && !calc_order_key(form, max_order_i, max_order_j, current_u_ext, current_state, key))
+        form_order_cache = NULL;
+      if(form_order_cache != NULL)
+      {
+        typename std::map<FormOrderKey, int>::const_iterator it = form_order_cache->find(key);
+        if(it != form_order_cache->end())
+        {
+          Hermes::Ord o(it->second);
+          adjust_order_to_refmaps(form, order, &o, current_refmaps);
+          return order;
+        }
+      }
+
+      // order of solutions from the previous Newton iteration etc..
+      Func<Hermes::Ord>** u_ext_ord = new Func<Hermes::Ord>*[RungeKutta ? RK_original_spaces_count : this->wf->get_neq() - form->u_ext_offset];
+      Func<Hermes::Ord>** ext_ord = NULL;
+      int ext_size = std::max(form->ext.size(), form->wf->ext.size());
+      if(ext_size > 0)
+        ext_ord = new Func<Hermes::Ord>*[ext_size];
+      init_ext_orders(form, u_ext_ord, ext_ord, current_u_ext, current_state);
+
+      Func<Hermes::Ord>* ou = get_fn_ord(max_order_j + (spaces[form->j]->get_shapeset()->get_num_components() > 1 ? 1 : 0));
+      Func<Hermes::Ord>* ov = get_fn_ord(max_order_i + (spaces[form->i]->get_shapeset()->get_num_components() > 1 ? 1 : 0));
 
       // Total order of the vector form.
       Hermes::Ord o = form->ord(1, &fake_wt, u_ext_ord, ou, ov, &geom_ord, ext_ord);
 
+      if(form_order_cache != NULL)
+        (*form_order_cache)[key] = o.get_order();
+
       adjust_order_to_refmaps(form, order, &o, current_refmaps);
 
       // Cleanup.
       deinit_ext_orders(form, u_ext_ord, ext_ord);
       delete [] u_ext_ord;
-      ou->free_ord();
-      delete ou;
-      ov->free_ord();
-      delete ov;
 
       return order;
     }
@@ -1910,6 +4830,7 @@ namespace Hermes
     void DiscreteProblem<Scalar>::assemble_matrix_form(MatrixForm<Scalar>* form, int order, Func<double>** base_fns, Func<double>** test_fns, Func<Scalar>** ext, Func<Scalar>** u_ext,
       AsmList<Scalar>* current_als_i, AsmList<Scalar>* current_als_j, Traverse::State* current_state, int n_quadrature_points, Geom<double>* geometry, double* jacobian_x_weights)
     {
+      Hermes::ProfilerRegion profiler_region("DiscreteProblem::assemble_matrix_form");
       bool surface_form = (dynamic_cast<MatrixFormVol<Scalar>*>(form) == NULL);
 
       double block_scaling_coefficient = this->block_scaling_coeff(form);
@@ -1918,17 +4839,17 @@ namespace Hermes
       bool sym = (form->i == form->j) && (form->sym == 1);
 
       // Assemble the local stiffness matrix for the form form.
-      Scalar **local_stiffness_matrix = new_matrix<Scalar>(std::max(current_als_i->cnt, current_als_j->cnt));
+      Scalar **local_stiffness_matrix = this->current_arena()->allocate_matrix(std::max(current_als_i->cnt, current_als_j->cnt), std::max(current_als_i->cnt, current_als_j->cnt));
 
       Func<Scalar>** local_ext = ext;
       // If the user supplied custom ext functions for this form.
       if(form->ext.size() > 0)
       {
         int local_ext_count = form->ext.size();
-        local_ext = new Func<Scalar>*[local_ext_count];
+        local_ext = this->current_arena()->template allocate_array<Func<Scalar>*>(local_ext_count);
         for(int ext_i = 0; ext_i < local_ext_count; ext_i++)
           if(form->ext[ext_i] != NULL)
-            local_ext[ext_i] = current_state->e[ext_i] == NULL ? NULL : init_fn(form->ext[ext_i], order);
+            local_ext[ext_i] = current_state->e[ext_i] == NULL ? NULL : this->get_form_ext_fn(form->ext[ext_i], order);
           else
             local_ext[ext_i] = NULL;
       }
@@ -1937,8 +4858,28 @@ namespace Hermes
       if(RungeKutta)
         u_ext += form->u_ext_offset;
 
+      // Forms may evaluate the whole block at once, only the coefficients are then applied here.
+      bool block_evaluated = form->value_block(n_quadrature_points, jacobian_x_weights, u_ext,
+        base_fns, current_als_j->cnt, test_fns, current_als_i->cnt, geometry, local_ext, local_stiffness_matrix);
+
+      if(block_evaluated)
+      {
+        if(surface_form)
+          block_scaling_coefficient *= 0.5;
+        for (unsigned int i = 0; i < current_als_i->cnt; i++)
+        {
+          for (unsigned int j = 0; j < current_als_j->cnt; j++)
+          {
+            if(current_als_i->dof[i] < 0 || current_als_j->dof[j] < 0 || std::abs(current_als_i->coef[i]) < 1e-12 || std::abs(current_als_j->coef[j]) < 1e-12)
+              local_stiffness_matrix[i][j] = 0;
+            else
+              local_stiffness_matrix[i][j] *= block_scaling_coefficient * form->scaling_factor * current_als_j->coef[j] * current_als_i->coef[i];
+          }
+        }
+      }
+
       // Actual form-specific calculation.
-      for (unsigned int i = 0; i < current_als_i->cnt; i++)
+      for (unsigned int i = 0; i < current_als_i->cnt && !block_evaluated; i++)
       {
         if(current_als_i->dof[i] < 0)
           continue;
@@ -1993,7 +4934,7 @@ namespace Hermes
 
       // Insert the local stiffness matrix into the global one.
 
-      current_mat->add(current_als_i->cnt, current_als_j->cnt, local_stiffness_matrix, current_als_i->dof, current_als_j->dof);
+      add_to_matrix(current_als_i->cnt, current_als_j->cnt, local_stiffness_matrix, current_als_i->dof, current_als_j->dof);
 
       // Insert also the off-diagonal (anti-)symmetric block, if required.
       if(tra)
@@ -2002,25 +4943,11 @@ namespace Hermes
           chsgn(local_stiffness_matrix, current_als_i->cnt, current_als_j->cnt);
         transpose(local_stiffness_matrix, current_als_i->cnt, current_als_j->cnt);
 
-        current_mat->add(current_als_j->cnt, current_als_i->cnt, local_stiffness_matrix, current_als_j->dof, current_als_i->dof);
-      }
-
-      if(form->ext.size() > 0)
-      {
-        for(int ext_i = 0; ext_i < form->ext.size(); ext_i++)
-          if(form->ext[ext_i] != NULL)
-          {
-            local_ext[ext_i]->free_fn();
-            delete local_ext[ext_i];
-          }
-          delete [] local_ext;
+        add_to_matrix(current_als_j->cnt, current_als_i->cnt, local_stiffness_matrix, current_als_j->dof, current_als_i->dof);
       }
 
       if(RungeKutta)
         u_ext -= form->u_ext_offset;
-
-      // Cleanup.
-      delete [] local_stiffness_matrix;
     }
 
     template<typename Scalar>
@@ -2028,14 +4955,6 @@ namespace Hermes
     {
       int order;
 
-      // order of solutions from the previous Newton iteration etc..
-      Func<Hermes::Ord>** u_ext_ord = new Func<Hermes::Ord>*[RungeKutta ? RK_original_spaces_count : this->wf->get_neq() - form->u_ext_offset];
-      Func<Hermes::Ord>** ext_ord = NULL;
-      int ext_size = std::max(form->ext.size(), form->wf->ext.size());
-      if(ext_size > 0)
-        ext_ord = new Func<Hermes::Ord>*[ext_size];
-      init_ext_orders(form, u_ext_ord, ext_ord, current_u_ext, current_state);
-
       // Order of shape functions.
       int max_order_i = this->spaces[form->i]->get_element_order(current_state->e[form->i]->id);
       if(H2D_GET_V_ORDER(max_order_i) > H2D_GET_H_ORDER(max_order_i))
@@ -2049,18 +4968,44 @@ namespace Hermes
         if(eo > max_order_i)
           max_order_i = eo;
       }
-      Func<Hermes::Ord>* ov = init_fn_ord(max_order_i + (spaces[form->i]->get_shapeset()->get_num_components() > 1 ? 1 : 0));
+
+      // The Ord evaluation depends only on the orders, look it up first.
+      FormOrderKey key;
+      std::map<FormOrderKey, int>* form_order_cache = this->get_form_order_cache();
+      if(form_order_cache != NULL && !calc_order_key(form, max_order_i, -1, current_u_ext, current_state, key))
+        form_order_cache = NULL;
+      if(form_order_cache != NULL)
+      {
+        typename std::map<FormOrderKey, int>::const_iterator it = form_order_cache->find(key);
+        if(it != form_order_cache->end())
+        {
+          Hermes::Ord o(it->second);
+          adjust_order_to_refmaps(form, order, &o, current_refmaps);
+          return order;
+        }
+      }
+
+      // order of solutions from the previous Newton iteration etc..
+      Func<Hermes::Ord>** u_ext_ord = new Func<Hermes::Ord>*[RungeKutta ? RK_original_spaces_count : this->wf->get_neq() - form->u_ext_offset];
+      Func<Hermes::Ord>** ext_ord = NULL;
+      int ext_size = std::max(form->ext.size(), form->wf->ext.size());
+      if(ext_size > 0)
+        ext_ord = new Func<Hermes::Ord>*[ext_size];
+      init_ext_orders(form, u_ext_ord, ext_ord, current_u_ext, current_state);
+
+      Func<Hermes::Ord>* ov = get_fn_ord(max_order_i + (spaces[form->i]->get_shapeset()->get_num_components() > 1 ? 1 : 0));
 
       // Total order of the vector form.
       Hermes::Ord o = form->ord(1, &fake_wt, u_ext_ord, ov, &geom_ord, ext_ord);
 
+      if(form_order_cache != NULL)
+        (*form_order_cache)[key] = o.get_order();
+
       adjust_order_to_refmaps(form, order, &o, current_refmaps);
 
       // Cleanup.
       deinit_ext_orders(form, u_ext_ord, ext_ord);
       delete [] u_ext_ord;
-      ov->free_ord();
-      delete ov;
 
       return order;
     }
@@ -2069,6 +5014,7 @@ namespace Hermes
     void DiscreteProblem<Scalar>::assemble_vector_form(VectorForm<Scalar>* form, int order, Func<double>** test_fns, Func<Scalar>** ext, Func<Scalar>** u_ext, 
       AsmList<Scalar>* current_als_i, Traverse::State* current_state, int n_quadrature_points, Geom<double>* geometry, double* jacobian_x_weights)
     {
+      Hermes::ProfilerRegion profiler_region("DiscreteProblem::assemble_vector_form");
       bool surface_form = (dynamic_cast<VectorFormVol<Scalar>*>(form) == NULL);
 
       Func<Scalar>** local_ext = ext;
@@ -2077,10 +5023,10 @@ namespace Hermes
       if(form->ext.size() > 0)
       {
         int local_ext_count = form->ext.size();
-        local_ext = new Func<Scalar>*[local_ext_count];
+        local_ext = this->current_arena()->template allocate_array<Func<Scalar>*>(local_ext_count);
         for(int ext_i = 0; ext_i < local_ext_count; ext_i++)
           if(form->ext[ext_i] != NULL)
-            local_ext[ext_i] = init_fn(form->ext[ext_i], order);
+            local_ext[ext_i] = this->get_form_ext_fn(form->ext[ext_i], order);
           else
             local_ext[ext_i] = NULL;
       }
@@ -2089,8 +5035,25 @@ namespace Hermes
       if(RungeKutta)
         u_ext += form->u_ext_offset;
 
+      // Forms may evaluate all test functions at once.
+      Scalar* local_rhs = this->current_arena()->template allocate_array<Scalar>(current_als_i->cnt);
+      bool block_evaluated = form->value_block(n_quadrature_points, jacobian_x_weights, u_ext, test_fns, current_als_i->cnt, geometry, local_ext, local_rhs);
+
+      if(block_evaluated)
+      {
+        double scaling_coefficient = (surface_form ? 0.5 : 1.0) * form->scaling_factor;
+        for (unsigned int i = 0; i < current_als_i->cnt; i++)
+        {
+          if(current_als_i->dof[i] < 0)
+            continue;
+          if(std::abs(current_als_i->coef[i]) < 1e-12)
+            continue;
+          add_to_rhs(current_als_i->dof[i], local_rhs[i] * scaling_coefficient * current_als_i->coef[i]);
+        }
+      }
+
       // Actual form-specific calculation.
-      for (unsigned int i = 0; i < current_als_i->cnt; i++)
+      for (unsigned int i = 0; i < current_als_i->cnt && !block_evaluated; i++)
       {
         if(current_als_i->dof[i] < 0)
           continue;
@@ -2107,18 +5070,7 @@ namespace Hermes
         else
           val = form->value(n_quadrature_points, jacobian_x_weights, u_ext, v, geometry, local_ext) * form->scaling_factor * current_als_i->coef[i];
 
-        current_rhs->add(current_als_i->dof[i], val);
-      }
-
-      if(form->ext.size() > 0)
-      {
-        for(int ext_i = 0; ext_i < form->ext.size(); ext_i++)
-          if(form->ext[ext_i] != NULL)
-          {
-            local_ext[ext_i]->free_fn();
-            delete local_ext[ext_i];
-          }
-          delete [] local_ext;
+        add_to_rhs(current_als_i->dof[i], val);
       }
 
       if(RungeKutta)
@@ -2174,61 +5126,79 @@ namespace Hermes
         for(int i = 0; i < prev_size; i++)
           if(current_u_ext[i + form->u_ext_offset] != NULL)
             if(surface_form)
-              oi[i] = init_fn_ord(current_u_ext[i + form->u_ext_offset]->get_edge_fn_order(current_state->isurf) + (current_u_ext[i + form->u_ext_offset]->get_num_components() > 1 ? 1 : 0));
+              oi[i] = get_fn_ord(current_u_ext[i + form->u_ext_offset]->get_edge_fn_order(current_state->isurf) + (current_u_ext[i + form->u_ext_offset]->get_num_components() > 1 ? 1 : 0));
             else
-              oi[i] = init_fn_ord(current_u_ext[i + form->u_ext_offset]->get_fn_order() + (current_u_ext[i + form->u_ext_offset]->get_num_components() > 1 ? 1 : 0));
+              oi[i] = get_fn_ord(current_u_ext[i + form->u_ext_offset]->get_fn_order() + (current_u_ext[i + form->u_ext_offset]->get_num_components() > 1 ? 1 : 0));
           else
-            oi[i] = init_fn_ord(0);
+            oi[i] = get_fn_ord(0);
       else
         for(int i = 0; i < prev_size; i++)
-          oi[i] = init_fn_ord(0);
+          oi[i] = get_fn_ord(0);
 
       if(form->ext.size() > 0)
       {
         for (int i = 0; i < form->ext.size(); i++)
           if(surface_form)
-            oext[i] = init_fn_ord(form->ext[i]->get_edge_fn_order(current_state->isurf) + (form->ext[i]->get_num_components() > 1 ? 1 : 0));
+            oext[i] = get_fn_ord(form->ext[i]->get_edge_fn_order(current_state->isurf) + (form->ext[i]->get_num_components() > 1 ? 1 : 0));
           else
-            oext[i] = init_fn_ord(form->ext[i]->get_fn_order() + (form->ext[i]->get_num_components() > 1 ? 1 : 0));
+            oext[i] = get_fn_ord(form->ext[i]->get_fn_order() + (form->ext[i]->get_num_components() > 1 ? 1 : 0));
       }
 
       else
       {
         for (int i = 0; i < form->wf->ext.size(); i++)
           if(surface_form)
-            oext[i] = init_fn_ord(form->wf->ext[i]->get_edge_fn_order(current_state->isurf) + (form->wf->ext[i]->get_num_components() > 1 ? 1 : 0));
+            oext[i] = get_fn_ord(form->wf->ext[i]->get_edge_fn_order(current_state->isurf) + (form->wf->ext[i]->get_num_components() > 1 ? 1 : 0));
           else
-            oext[i] = init_fn_ord(form->wf->ext[i]->get_fn_order() + (form->wf->ext[i]->get_num_components() > 1 ? 1 : 0));
+            oext[i] = get_fn_ord(form->wf->ext[i]->get_fn_order() + (form->wf->ext[i]->get_num_components() > 1 ? 1 : 0));
       }
     }
 
     template<typename Scalar>
     void DiscreteProblem<Scalar>::deinit_ext_orders(Form<Scalar> *form, Func<Hermes::Ord>** oi, Func<Hermes::Ord>** oext)
+    {
+      // The functions are the shared ones of get_fn_ord().
+      if(oext != NULL)
+        delete [] oext;
+    }
+
+    template<typename Scalar>
+    std::map<typename DiscreteProblem<Scalar>::FormOrderKey, int>* DiscreteProblem<Scalar>::get_form_order_cache()
+    {
+      unsigned int thread = omp_get_thread_num();
+      return (thread < this->form_order_caches.size()) ? &this->form_order_caches[thread] : NULL;
+    }
+
+    template<typename Scalar>
+    bool DiscreteProblem<Scalar>::calc_order_key(Form<Scalar> *form, int max_order_i, int max_order_j, Solution<Scalar>** current_u_ext, Traverse::State* current_state, FormOrderKey& key)
     {
       unsigned int prev_size = RungeKutta ? RK_original_spaces_count : this->wf->get_neq() - form->u_ext_offset;
-      for(int i = 0; i < prev_size; i++)
+      bool surface_form = (current_state->isurf > -1);
+      const Hermes::vector<MeshFunction<Scalar>*>& ext = form->ext.size() > 0 ? form->ext : form->wf->ext;
+      if(form->position < 0 || 4 + prev_size + ext.size() > FormOrderKey::max_length)
+        return false;
+
+      memset(key.values, 0, sizeof(key.values));
+      int length = 0;
+      // The forms of the per-thread weak formulations are clones, their positions are common.
+      key.values[length++] = form->position;
+      key.values[length++] = RungeKutta ? 1 : 0;
+      key.values[length++] = max_order_i;
+      key.values[length++] = max_order_j;
+
+      // The same orders init_ext_orders uses.
+      for(unsigned int i = 0; i < prev_size; i++)
       {
-        oi[i]->free_ord();
-        delete oi[i];
+        Solution<Scalar>* u = (current_u_ext == NULL) ? NULL : current_u_ext[i + form->u_ext_offset];
+        if(u != NULL)
+          key.values[length] = (surface_form ? u->get_edge_fn_order(current_state->isurf) : u->get_fn_order()) + (u->get_num_components() > 1 ? 1 : 0);
+        length++;
       }
 
-      if(oext != NULL)
-      {
-        if(form->ext.size() > 0)
-          for (int i = 0; i < form->ext.size(); i++)
-          {
-            oext[i]->free_ord();
-            delete oext[i];
-          }
-        else
-          for (int i = 0; i < form->wf->ext.size(); i++)
-          {
-            oext[i]->free_ord();
-            delete oext[i];
-          }
+      for (unsigned int i = 0; i < ext.size(); i++)
+        key.values[length++] = (surface_form ? ext[i]->get_edge_fn_order(current_state->isurf) : ext[i]->get_fn_order()) + (ext[i]->get_num_components() > 1 ? 1 : 0);
 
-          delete [] oext;
-      }
+      return true;
     }
 
     template<typename Scalar>
@@ -2272,182 +5242,254 @@ namespace Hermes
         }
       }
 
-      bool** processed = new bool*[current_state->rep->nvert];
-      LightArray<NeighborSearch<Scalar>*>** neighbor_searches = new LightArray<NeighborSearch<Scalar>*>*[current_state->rep->nvert];
-      (5);
-      unsigned int* num_neighbors = new unsigned int[current_state->rep->nvert];
-
-      bool intra_edge_passed_DG[H2D_MAX_NUMBER_VERTICES];
-      for(int a = 0; a < H2D_MAX_NUMBER_VERTICES; a++)
-        intra_edge_passed_DG[a] = false;
+      // The neighbor data of the state, calculated in the first assembling.
+      DGStateCache* cache = NULL;
+      int cache_state_i = this->DG_cache_thread_states.empty() ? -1 : this->DG_cache_thread_states[omp_get_thread_num()];
+      if(cache_state_i >= 0)
+      {
+        if(this->DG_cache[cache_state_i] == NULL)
+          this->DG_cache[cache_state_i] = build_DG_state_cache(current_state, min_dg_mesh_seq);
+        cache = this->DG_cache[cache_state_i];
+      }
+      else
+        cache = build_DG_state_cache(current_state, min_dg_mesh_seq);
 
-#pragma omp critical (DG)
+      for(current_state->isurf = 0; current_state->isurf < current_state->rep->nvert; current_state->isurf++)
       {
-        for(unsigned int i = 0; i < current_state->num; i++)
-          current_state->e[i]->visited = true;
+        if(cache->skip_edge[current_state->isurf])
+          continue;
 
-        for(current_state->isurf = 0; current_state->isurf < current_state->rep->nvert; current_state->isurf++)
+        for(unsigned int neighbor_i = 0; neighbor_i < cache->num_neighbors[current_state->isurf]; neighbor_i++)
         {
-          bool inner_edge_for_dg = false;
-          for(int i = 0; i < this->spaces_size; i++)
-            if(current_state->e[i]->en[current_state->isurf]->marker == 0)
-              inner_edge_for_dg = true;
-          if(inner_edge_for_dg)
-          {
-            neighbor_searches[current_state->isurf] = new LightArray<NeighborSearch<Scalar>*>(5);
+          if(!DG_vector_forms_present && cache->processed[current_state->isurf][neighbor_i])
+            continue;
 
-            if(!init_neighbors((*neighbor_searches[current_state->isurf]), current_state, min_dg_mesh_seq))
-            {
-              intra_edge_passed_DG[current_state->isurf] = true;
-              continue;
-            }
-            // Create a multimesh tree;
-            NeighborNode* root = new NeighborNode(NULL, 0);
-            build_multimesh_tree(root, (*neighbor_searches[current_state->isurf]));
+          // DG-inner-edge-wise parameters for WeakForm.
+          (const_cast<WeakForm<Scalar>*>(current_wf))->set_active_DG_state(current_state->e, current_state->isurf);
+
+          assemble_DG_one_neighbor(cache->processed[current_state->isurf][neighbor_i], neighbor_i, current_pss, current_spss, current_refmaps, current_als,
+            current_state, current_mfDG, current_vfDG, fn,
+            npss, nspss, nrefmap, (*cache->neighbor_searches[current_state->isurf]), cache->neighbor_als[current_state->isurf] + neighbor_i * cache->num_spaces,
+            min_dg_mesh_seq, current_wf);
+        }
+      }
+
+      if(cache_state_i < 0)
+        delete cache;
+
+      // Deinitialize neighbor pss's, refmaps.
+      if(DG_matrix_forms_present)
+      {
+        for(std::map<unsigned int, PrecalcShapeset *>::iterator it = nspss.begin(); it != nspss.end(); it++)
+          delete it->second;
+        for(std::map<unsigned int, PrecalcShapeset *>::iterator it = npss.begin(); it != npss.end(); it++)
+          delete it->second;
+        for(std::map<unsigned int, RefMap *>::iterator it = nrefmap.begin(); it != nrefmap.end(); it++)
+          delete it->second;
+      }
+    }
+
+    template<typename Scalar>
+    typename DiscreteProblem<Scalar>::DGStateCache* DiscreteProblem<Scalar>::build_DG_state_cache(Traverse::State* current_state, unsigned int min_dg_mesh_seq)
+    {
+      DGStateCache* cache = new DGStateCache(current_state->rep->nvert, this->spaces_size);
+
+      for(current_state->isurf = 0; current_state->isurf < current_state->rep->nvert; current_state->isurf++)
+      {
+        bool inner_edge_for_dg = false;
+        for(int i = 0; i < this->spaces_size; i++)
+          if(current_state->e[i]->en[current_state->isurf]->marker == 0)
+            inner_edge_for_dg = true;
+        if(!inner_edge_for_dg)
+          continue;
+
+        LightArray<NeighborSearch<Scalar>*>* neighbor_searches = new LightArray<NeighborSearch<Scalar>*>(5);
+        cache->neighbor_searches[current_state->isurf] = neighbor_searches;
+
+        if(!init_neighbors((*neighbor_searches), current_state, min_dg_mesh_seq))
+          continue;
+
+        // Create a multimesh tree;
+        NeighborNode* root = new NeighborNode(NULL, 0);
+        build_multimesh_tree(root, (*neighbor_searches));
 
 #ifdef DEBUG_DG_ASSEMBLING
 #pragma omp critical (debug_DG)
-            {
-              int id = 0;
-              bool pass = true;
-              if(DEBUG_DG_ASSEMBLING_ELEMENT != -1)
-              {
-                for(unsigned int i = 0; i < (*neighbor_searches[current_state->isurf]).get_size(); i++)
-                  if((*neighbor_searches[current_state->isurf]).present(i))
-                    if((*neighbor_searches[current_state->isurf]).get(i)->central_el->id == DEBUG_DG_ASSEMBLING_ELEMENT)
-                      pass = false;
-              }
-              else
-                pass = false;
+        {
+          int id = 0;
+          bool pass = true;
+          if(DEBUG_DG_ASSEMBLING_ELEMENT != -1)
+          {
+            for(unsigned int i = 0; i < (*neighbor_searches).get_size(); i++)
+              if((*neighbor_searches).present(i))
+                if((*neighbor_searches).get(i)->central_el->id == DEBUG_DG_ASSEMBLING_ELEMENT)
+                  pass = false;
+          }
+          else
+            pass = false;
 
-              if(!pass)
-                if(DEBUG_DG_ASSEMBLING_ISURF != -1)
-                  if(current_state->isurf != DEBUG_DG_ASSEMBLING_ISURF)
-                    pass = true;
+          if(!pass)
+            if(DEBUG_DG_ASSEMBLING_ISURF != -1)
+              if(current_state->isurf != DEBUG_DG_ASSEMBLING_ISURF)
+                pass = true;
 
-              if(!pass)
+          if(!pass)
+          {
+            for(unsigned int i = 0; i < (*neighbor_searches).get_size(); i++)
+            {
+              if((*neighbor_searches).present(i))
               {
-                for(unsigned int i = 0; i < (*neighbor_searches[current_state->isurf]).get_size(); i++)
+                NeighborSearch<Scalar>* ns = (*neighbor_searches).get(i);
+                std::cout << (std::string)"The " << ++id << (std::string)"-th Neighbor search:: " << (std::string)"Central element: " << ns->central_el->id << (std::string)", Isurf: " << current_state->isurf << (std::string)", Original sub_idx: " << ns->original_central_el_transform << std::endl;
+                for(int j = 0; j < ns->n_neighbors; j++)
                 {
-                  if((*neighbor_searches[current_state->isurf]).present(i))
+                  std::cout << '\t' << (std::string)"The " << j << (std::string)"-th neighbor element: " << ns->neighbors[j]->id << std::endl;
+                  if(ns->central_transformations.present(j))
                   {
-                    NeighborSearch<Scalar>* ns = (*neighbor_searches[current_state->isurf]).get(i);
-                    std::cout << (std::string)"The " << ++id << (std::string)"-th Neighbor search:: " << (std::string)"Central element: " << ns->central_el->id << (std::string)", Isurf: " << current_state->isurf << (std::string)", Original sub_idx: " << ns->original_central_el_transform << std::endl;
-                    for(int j = 0; j < ns->n_neighbors; j++)
-                    {
-                      std::cout << '\t' << (std::string)"The " << j << (std::string)"-th neighbor element: " << ns->neighbors[j]->id << std::endl;
-                      if(ns->central_transformations.present(j))
-                      {
-                        std::cout << '\t' << (std::string)"Central transformations: " << std::endl;
-                        for(int k = 0; k < ns->central_transformations.get(j)->num_levels; k++)
-                          std::cout << '\t' << '\t' << ns->central_transformations.get(j)->transf[k] << std::endl;
-                      }
-                      if(ns->neighbor_transformations.present(j))
-                      {
-                        std::cout << '\t' << (std::string)"Neighbor transformations: " << std::endl;
-                        for(int k = 0; k < ns->neighbor_transformations.get(j)->num_levels; k++)
-                          std::cout << '\t' << '\t' << ns->neighbor_transformations.get(j)->transf[k] << std::endl;
-                      }
-                    }
+                    std::cout << '\t' << (std::string)"Central transformations: " << std::endl;
+                    for(int k = 0; k < ns->central_transformations.get(j)->num_levels; k++)
+                      std::cout << '\t' << '\t' << ns->central_transformations.get(j)->transf[k] << std::endl;
+                  }
+                  if(ns->neighbor_transformations.present(j))
+                  {
+                    std::cout << '\t' << (std::string)"Neighbor transformations: " << std::endl;
+                    for(int k = 0; k < ns->neighbor_transformations.get(j)->num_levels; k++)
+                      std::cout << '\t' << '\t' << ns->neighbor_transformations.get(j)->transf[k] << std::endl;
                   }
                 }
               }
             }
+          }
+        }
 #endif
 
-            // Update all NeighborSearches according to the multimesh tree.
-            // After this, all NeighborSearches in neighbor_searches should have the same count
-            // of neighbors and proper set of transformations
-            // for the central and the neighbor element(s) alike.
-            // Also check that every NeighborSearch has the same number of neighbor elements.
-            num_neighbors[current_state->isurf] = 0;
-            for(unsigned int i = 0; i < (*neighbor_searches[current_state->isurf]).get_size(); i++)
+        // Update all NeighborSearches according to the multimesh tree.
+        // After this, all NeighborSearches in neighbor_searches should have the same count
+        // of neighbors and proper set of transformations
+        // for the central and the neighbor element(s) alike.
+        // Also check that every NeighborSearch has the same number of neighbor elements.
+        unsigned int num_neighbors = 0;
+        for(unsigned int i = 0; i < (*neighbor_searches).get_size(); i++)
+        {
+          if((*neighbor_searches).present(i))
+          {
+            NeighborSearch<Scalar>* ns = (*neighbor_searches).get(i);
+            update_neighbor_search(ns, root);
+            if(num_neighbors == 0)
+              num_neighbors = ns->n_neighbors;
+            if(ns->n_neighbors != num_neighbors)
             {
-              if((*neighbor_searches[current_state->isurf]).present(i))
-              {
-                NeighborSearch<Scalar>* ns = (*neighbor_searches[current_state->isurf]).get(i);
-                update_neighbor_search(ns, root);
-                if(num_neighbors[current_state->isurf] == 0)
-                  num_neighbors[current_state->isurf] = ns->n_neighbors;
-                if(ns->n_neighbors != num_neighbors[current_state->isurf])
-                  throw Hermes::Exceptions::Exception("Num_neighbors of different NeighborSearches not matching in DiscreteProblem<Scalar>::assemble_surface_integrals().");
-              }
+              delete root;
+              delete cache;
+              throw Hermes::Exceptions::Exception("Num_neighbors of different NeighborSearches not matching in DiscreteProblem<Scalar>::assemble_surface_integrals().");
             }
+          }
+        }
 
-            // Delete the multimesh tree;
-            delete root;
+        // Delete the multimesh tree;
+        delete root;
 
-            processed[current_state->isurf] = new bool[num_neighbors[current_state->isurf]];
+        cache->num_neighbors[current_state->isurf] = num_neighbors;
+        cache->processed[current_state->isurf] = new bool[num_neighbors];
 
-            for(unsigned int neighbor_i = 0; neighbor_i < num_neighbors[current_state->isurf]; neighbor_i++)
-            {
-              // If the active segment has already been processed (when the neighbor element was assembled), it is skipped.
-              // We test all neighbor searches, because in the case of intra-element edge, the neighboring (the same as central) element
-              // will be marked as visited, even though the edge was not calculated.
-              processed[current_state->isurf][neighbor_i] = true;
-              for(unsigned int i = 0; i < (*neighbor_searches[current_state->isurf]).get_size(); i++)
-              {
-                if((*neighbor_searches[current_state->isurf]).present(i))
-                {
-                  if(!(*neighbor_searches[current_state->isurf]).get(i)->neighbors.at(neighbor_i)->visited)
-                  {
-                    processed[current_state->isurf][neighbor_i] = false;
-                    break;
-                  }
-                }
-              }
-            }
-          }
-        }
+        // The segments the neighbor states assemble are marked as processed.
+        for(unsigned int neighbor_i = 0; neighbor_i < num_neighbors; neighbor_i++)
+          cache->processed[current_state->isurf][neighbor_i] = !DG_segment_owned((*neighbor_searches), neighbor_i);
+
+        cache->neighbor_als[current_state->isurf] = new AsmList<Scalar>*[num_neighbors * this->spaces_size];
+        memset(cache->neighbor_als[current_state->isurf], 0, num_neighbors * this->spaces_size * sizeof(AsmList<Scalar>*));
+
+        cache->skip_edge[current_state->isurf] = false;
       }
 
-      for(current_state->isurf = 0; current_state->isurf < current_state->rep->nvert; current_state->isurf++)
+      return cache;
+    }
+
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::DGStateCache::DGStateCache(int nvert, unsigned int num_spaces) : nvert(nvert), num_spaces(num_spaces)
+    {
+      for(int isurf = 0; isurf < H2D_MAX_NUMBER_VERTICES; isurf++)
       {
-        if(intra_edge_passed_DG[current_state->isurf])
-          continue;
-        
-        bool inner_edge_for_dg = false;
-          for(int i = 0; i < this->spaces_size; i++)
-            if(current_state->e[i]->en[current_state->isurf]->marker == 0)
-              inner_edge_for_dg = true;
-        if(!inner_edge_for_dg)
-          continue;
+        this->skip_edge[isurf] = true;
+        this->neighbor_searches[isurf] = NULL;
+        this->num_neighbors[isurf] = 0;
+        this->processed[isurf] = NULL;
+        this->neighbor_als[isurf] = NULL;
+      }
+    }
 
-        for(unsigned int neighbor_i = 0; neighbor_i < num_neighbors[current_state->isurf]; neighbor_i++)
+    template<typename Scalar>
+    DiscreteProblem<Scalar>::DGStateCache::~DGStateCache()
+    {
+      for(int isurf = 0; isurf < this->nvert; isurf++)
+      {
+        if(this->neighbor_searches[isurf] != NULL)
         {
-          if(!DG_vector_forms_present && processed[current_state->isurf][neighbor_i])
-            continue;
-
-          // DG-inner-edge-wise parameters for WeakForm.
-          (const_cast<WeakForm<Scalar>*>(current_wf))->set_active_DG_state(current_state->e, current_state->isurf);
-
-          assemble_DG_one_neighbor(processed[current_state->isurf][neighbor_i], neighbor_i, current_pss, current_spss, current_refmaps, current_als,
-            current_state, current_mfDG, current_vfDG, fn,
-            npss, nspss, nrefmap, (*neighbor_searches[current_state->isurf]), min_dg_mesh_seq, current_wf);
+          for(unsigned int i = 0; i < this->neighbor_searches[isurf]->get_size(); i++)
+            if(this->neighbor_searches[isurf]->present(i))
+              delete this->neighbor_searches[isurf]->get(i);
+          delete this->neighbor_searches[isurf];
         }
-
-        // Delete the neighbor_searches array.
-        for(unsigned int i = 0; i < (*neighbor_searches[current_state->isurf]).get_size(); i++)
-          if((*neighbor_searches[current_state->isurf]).present(i))
-            delete (*neighbor_searches[current_state->isurf]).get(i);
-        delete neighbor_searches[current_state->isurf];
-        delete [] processed[current_state->isurf];
+        if(this->neighbor_als[isurf] != NULL)
+        {
+          for(unsigned int i = 0; i < this->num_neighbors[isurf] * this->num_spaces; i++)
+            if(this->neighbor_als[isurf][i] != NULL)
+              delete this->neighbor_als[isurf][i];
+          delete [] this->neighbor_als[isurf];
+        }
+        if(this->processed[isurf] != NULL)
+          delete [] this->processed[isurf];
       }
+    }
 
-      delete [] processed;
-      delete [] neighbor_searches;
-      delete [] num_neighbors;
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::init_DG_cache(int num_states)
+    {
+      if(!DG_matrix_forms_present && !DG_vector_forms_present)
+      {
+        free_DG_cache();
+        return;
+      }
 
-      // Deinitialize neighbor pss's, refmaps.
-      if(DG_matrix_forms_present)
+      // The states (and so the elements and their neighbors) are those of the same traversal,
+      // the assembly lists stay the same for the same spaces.
+      std::vector<int> key;
+      key.push_back(num_states);
+      key.push_back(this->traverse_plan.get_num_traversals());
+      key.push_back(this->partition_part);
+      key.push_back(this->partition_num_parts);
+      for (unsigned int space_i = 0; space_i < this->spaces_size; space_i++)
       {
-        for(std::map<unsigned int, PrecalcShapeset *>::iterator it = nspss.begin(); it != nspss.end(); it++)
-          delete it->second;
-        for(std::map<unsigned int, PrecalcShapeset *>::iterator it = npss.begin(); it != npss.end(); it++)
-          delete it->second;
-        for(std::map<unsigned int, RefMap *>::iterator it = nrefmap.begin(); it != nrefmap.end(); it++)
-          delete it->second;
+        key.push_back(this->spaces[space_i]->get_seq());
+        key.push_back(this->spaces_first_dofs[space_i]);
+      }
+      if(key != this->DG_cache_key)
+      {
+        free_DG_cache();
+        this->DG_cache_key = key;
+        this->DG_cache.assign(num_states, (DGStateCache*)NULL);
       }
+
+      int num_threads_used = this->get_num_threads();
+      this->DG_cache_thread_states.assign(num_threads_used, -1);
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::free_DG_cache()
+    {
+      for(unsigned int i = 0; i < this->DG_cache.size(); i++)
+        if(this->DG_cache[i] != NULL)
+          delete this->DG_cache[i];
+      this->DG_cache.clear();
+      this->DG_cache_key.clear();
+      this->DG_cache_thread_states.clear();
+    }
+
+    template<typename Scalar>
+    void DiscreteProblem<Scalar>::set_DG_cache_state(int state_i)
+    {
+      if(!this->DG_cache.empty())
+        this->DG_cache_thread_states[omp_get_thread_num()] = state_i;
     }
 
     template<typename Scalar>
@@ -2455,7 +5497,7 @@ namespace Hermes
       PrecalcShapeset** current_pss, PrecalcShapeset** current_spss, RefMap** current_refmaps, AsmList<Scalar>** current_als,
       Traverse::State* current_state, Hermes::vector<MatrixFormDG<Scalar>*> current_mfDG, Hermes::vector<VectorFormDG<Scalar>*> current_vfDG, Transformable** fn,
       std::map<unsigned int, PrecalcShapeset *> npss, std::map<unsigned int, PrecalcShapeset *> nspss, std::map<unsigned int, RefMap *> nrefmap,
-      LightArray<NeighborSearch<Scalar>*>& neighbor_searches, unsigned int min_dg_mesh_seq, WeakForm<Scalar>* current_wf)
+      LightArray<NeighborSearch<Scalar>*>& neighbor_searches, AsmList<Scalar>** neighbor_als, unsigned int min_dg_mesh_seq, WeakForm<Scalar>* current_wf)
     {
       // Set the active segment in all NeighborSearches
       for(unsigned int i = 0; i < neighbor_searches.get_size(); i++)
@@ -2530,7 +5572,12 @@ namespace Hermes
           continue;
 
         nbs[i] = neighbor_searches.get(spaces[i]->get_mesh()->get_seq() - min_dg_mesh_seq);
-        ext_asmlist[i] = nbs[i]->create_extended_asmlist(spaces[i], current_als[i]);
+        if(neighbor_als[i] == NULL)
+        {
+          neighbor_als[i] = new AsmList<Scalar>();
+          spaces[i]->get_boundary_assembly_list(nbs[i]->neighb_el, nbs[i]->neighbor_edge.local_num_of_edge, neighbor_als[i]);
+        }
+        ext_asmlist[i] = nbs[i]->create_extended_asmlist(spaces[i], current_als[i], neighbor_als[i]);
         nbs[i]->set_quad_order(order);
         order_base = order;
         n_quadrature_points = init_surface_geometry_points(current_refmaps[i], order_base, current_state, geometry[i], jacobian_x_weights[i]);
@@ -2581,7 +5628,7 @@ namespace Hermes
           typename NeighborSearch<Scalar>::ExtendedShapeset* ext_asmlist_u = ext_asmlist[n];
           typename NeighborSearch<Scalar>::ExtendedShapeset* ext_asmlist_v = ext_asmlist[m];
 
-          Scalar **local_stiffness_matrix = new_matrix<Scalar>(std::max(ext_asmlist_u->cnt, ext_asmlist_v->cnt));
+          Scalar **local_stiffness_matrix = this->current_arena()->allocate_matrix(std::max(ext_asmlist_u->cnt, ext_asmlist_v->cnt), std::max(ext_asmlist_u->cnt, ext_asmlist_v->cnt));
           for (int i = 0; i < ext_asmlist_v->cnt; i++)
           {
             if(ext_asmlist_v->dof[i] < 0)
@@ -2609,9 +5656,7 @@ namespace Hermes
             }
           }
 
-          current_mat->add(ext_asmlist_v->cnt, ext_asmlist_u->cnt, local_stiffness_matrix, ext_asmlist_v->dof, ext_asmlist_u->dof);
-
-          delete [] local_stiffness_matrix;
+          add_to_matrix(ext_asmlist_v->cnt, ext_asmlist_u->cnt, local_stiffness_matrix, ext_asmlist_v->dof, ext_asmlist_u->dof);
         }
       }
 
@@ -2656,7 +5701,7 @@ namespace Hermes
 
             Func<double>* v = init_fn(current_spss[n], current_refmaps[n], nbs_v->get_quad_eo());
 
-            current_rhs->add(current_als[n]->dof[dof_i], 0.5 * vfs->value(n_quadrature_points, jacobian_x_weights[n], v, e[n], ext) * vfs->scaling_factor * current_als[n]->coef[dof_i]);
+            add_to_rhs(current_als[n]->dof[dof_i], 0.5 * vfs->value(n_quadrature_points, jacobian_x_weights[n], v, e[n], ext) * vfs->scaling_factor * current_als[n]->coef[dof_i]);
 
             v->free_fn();
             delete v;
@@ -2758,6 +5803,24 @@ namespace Hermes
       return DG_intra;
     }
 
+    template<typename Scalar>
+    bool DiscreteProblem<Scalar>::DG_segment_owned(LightArray<NeighborSearch<Scalar>*>& neighbor_searches, unsigned int neighbor_i) const
+    {
+      // The neighbor state sees the same pairs of elements swapped. On the meshes where the segment is an intra-element one,
+      // the elements are the same and the next mesh decides; the segment is not assembled if it is intra-element on all of them.
+      for(unsigned int i = 0; i < neighbor_searches.get_size(); i++)
+      {
+        if(neighbor_searches.present(i))
+        {
+          NeighborSearch<Scalar>* ns = neighbor_searches.get(i);
+          int neighbor_id = ns->neighbors.at(neighbor_i)->id;
+          if(ns->central_el->id != neighbor_id)
+            return ns->central_el->id < neighbor_id;
+        }
+      }
+      return false;
+    }
+
     template<typename Scalar>
     void DiscreteProblem<Scalar>::build_multimesh_tree(NeighborNode* root,
       LightArray<NeighborSearch<Scalar>*>& neighbor_searches)
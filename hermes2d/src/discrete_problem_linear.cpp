@@ -26,6 +26,7 @@
 #include "function/solution.h"
 #include "neighbor.h"
 #include "api2d.h"
+#include "cache_statistics.h"
 
 using namespace Hermes::Algebra::DenseMatrixOperations;
 
@@ -62,6 +63,8 @@ namespace Hermes
       bool force_diagonal_blocks,
       Table* block_weights)
     {
+      Hermes::ProfilerRegion profiler_region("DiscreteProblem::assemble");
+      CacheStatistics::begin_assembly();
       // Check.
       this->check();
       if(this->ndof == 0)
@@ -72,6 +75,8 @@ namespace Hermes
 
       this->current_mat = mat;
       this->current_rhs = rhs;
+      // The right-hand side alone still gets the Dirichlet lift, it is the same as the one assembled with the matrix.
+      this->dirichlet_lift_only = (mat == NULL && rhs != NULL);
       this->current_force_diagonal_blocks = force_diagonal_blocks;
       this->current_block_weights = block_weights;
 
@@ -82,6 +87,7 @@ namespace Hermes
 
       // Creating matrix sparse structure.
       this->create_sparse_structure();
+      this->init_ensemble_systems();
 
       // Initial check of meshes and spaces.
       for(unsigned int ext_i = 0; ext_i < this->wf->get_ext().size(); ext_i++)
@@ -90,15 +96,13 @@ namespace Hermes
           throw Hermes::Exceptions::Exception("Ext function %d is not okay in assemble().", ext_i);
       }
 
-      // Structures that cloning will be done into.
-      PrecalcShapeset*** pss = new PrecalcShapeset**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-      PrecalcShapeset*** spss = new PrecalcShapeset**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-      RefMap*** refmaps = new RefMap**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-      AsmList<Scalar>*** als = new AsmList<Scalar>**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-      WeakForm<Scalar>** weakforms = new WeakForm<Scalar>*[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-
-      // Fill these structures.
-      this->init_assembling(NULL, pss, spss, refmaps, NULL, als, weakforms);
+      // The per-thread structures.
+      this->init_assembling(NULL);
+      PrecalcShapeset*** pss = this->thread_pss;
+      PrecalcShapeset*** spss = this->thread_spss;
+      RefMap*** refmaps = this->thread_refmaps;
+      AsmList<Scalar>*** als = this->thread_als;
+      WeakForm<Scalar>** weakforms = this->thread_weakforms;
 
       // Vector of meshes.
       Hermes::vector<const Mesh*> meshes;
@@ -111,14 +115,23 @@ namespace Hermes
           if(this->wf->get_forms()[form_i]->ext[ext_i] != NULL)
             meshes.push_back(this->wf->get_forms()[form_i]->ext[ext_i]->get_mesh());
 
-      Traverse trav_master(true);
-      unsigned int num_states = trav_master.get_num_states(meshes);
-
-      trav_master.begin(meshes.size(), &(meshes.front()));
-
-      Traverse* trav = new Traverse[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-      Hermes::vector<Transformable *>* fns = new Hermes::vector<Transformable *>[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      // The spaces whose forms are all restricted to some element markers are only traversed on those,
+      // the refinements of their meshes elsewhere do not split the states of the other spaces (no u_ext is evaluated here).
+      Hermes::vector<std::vector<int> > element_markers(this->space_element_markers);
+      element_markers.resize(meshes.size());
+
+      // All states of the traversal are precalculated, so that the threads do not need
+      // to wait for each other. The plan only traverses the meshes again if they changed since the last assembling.
+      int num_all_states;
+      Traverse::State** all_states = this->traverse_plan.get_states(meshes, num_all_states, &element_markers);
+      int num_states;
+      Traverse::State** states = this->get_partition_states(all_states, num_all_states, num_states);
+      this->init_scatter_map(num_states);
+      this->init_batched_assembly(states, num_states);
+      this->init_DG_cache(num_states);
+
+      Hermes::vector<Transformable *>* fns = new Hermes::vector<Transformable *>[this->get_num_threads()];
+      for(unsigned int i = 0; i < this->get_num_threads(); i++)
       {
         for (unsigned j = 0; j < this->spaces.size(); j++)
           fns[i].push_back(pss[i][j]);
@@ -136,37 +149,70 @@ namespace Hermes
               weakforms[i]->get_forms()[form_i]->ext[ext_i]->set_quad_2d(&g_quad_2d_std);
             }
         }
-        trav[i].begin(meshes.size(), &(meshes.front()), &(fns[i].front()));
-        trav[i].stack = trav_master.stack;
       }
 
-      int state_i;
+      // Work items and phases of the assembly.
+      int* item_first_states;
+      int* item_end_states;
+      int* phase_first_items;
+      int num_phases;
+      this->init_assembly_schedule(states, num_states, item_first_states, item_end_states, phase_first_items, num_phases);
+
+      int state_i, item_i;
 
       PrecalcShapeset** current_pss;
       PrecalcShapeset** current_spss;
       RefMap** current_refmaps;
       AsmList<Scalar>** current_als;
       WeakForm<Scalar>* current_weakform;
+      Transformable** current_fns;
 
 #define CHUNKSIZE 1
-      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
-#pragma omp parallel shared(trav_master, mat, rhs ) private(state_i, current_pss, current_spss, current_refmaps, current_als, current_weakform) num_threads(num_threads_used)
+      int num_threads_used = this->get_num_threads();
+#pragma omp parallel shared(states, mat, rhs ) private(state_i, item_i, current_pss, current_spss, current_refmaps, current_als, current_weakform, current_fns) num_threads(num_threads_used)
       {
-#pragma omp for schedule(static, CHUNKSIZE)
-        for(state_i = 0; state_i < num_states; state_i++)
+        this->apply_thread_affinity();
+        for(int phase_i = 0; phase_i < num_phases; phase_i++)
         {
-          if(this->caughtException != NULL)
-            continue;
-
-          try
+#pragma omp for schedule(dynamic, CHUNKSIZE)
+          for(item_i = phase_first_items[phase_i]; item_i < phase_first_items[phase_i + 1]; item_i++)
           {
-            Traverse::State current_state;
-
-#pragma omp critical (get_next_state)
+            for(state_i = item_first_states[item_i]; state_i < item_end_states[item_i]; state_i++)
             {
+              if(this->caughtException != NULL)
+                continue;
+
               try
               {
-                current_state = trav[omp_get_thread_num()].get_next_state(&trav_master.top, &trav_master.id);
+                Traverse::State* current_state = states[state_i];
+
+                current_pss = pss[omp_get_thread_num()];
+                current_spss = spss[omp_get_thread_num()];
+                current_refmaps = refmaps[omp_get_thread_num()];
+                current_als = als[omp_get_thread_num()];
+                current_weakform = weakforms[omp_get_thread_num()];
+                current_fns = &(fns[omp_get_thread_num()].front());
+
+                // Temporaries of the previous state are not needed any more.
+                this->current_arena()->reset();
+
+                // One state is a collection of (virtual) elements sharing
+                // the same physical location on (possibly) different meshes.
+                // This is then the same element of the virtual union mesh.
+                // The proper sub-element mappings to all the functions of
+                // this stage are set here from the precalculated state.
+                Traverse::set_state_to_fns(current_state, current_fns);
+
+                if(this->buffered_assembly)
+                  this->set_assembly_buffers_state(state_i);
+                this->set_scatter_map_state(state_i);
+                this->set_batched_state(state_i);
+                this->set_DG_cache_state(state_i);
+
+                this->assemble_one_state(current_pss, current_spss, current_refmaps, NULL, current_als, current_state, current_weakform);
+
+                if(this->DG_matrix_forms_present || this->DG_vector_forms_present)
+                  this->assemble_one_DG_state(current_pss, current_spss, current_refmaps, current_als, current_state, current_weakform->mfDG, current_weakform->vfDG, current_fns, current_weakform);
               }
               catch(Hermes::Exceptions::Exception& e)
               {
@@ -179,49 +225,29 @@ namespace Hermes
                   this->caughtException = new Hermes::Exceptions::Exception(e.what());
               }
             }
-
-            current_pss = pss[omp_get_thread_num()];
-            current_spss = spss[omp_get_thread_num()];
-            current_refmaps = refmaps[omp_get_thread_num()];
-            current_als = als[omp_get_thread_num()];
-            current_weakform = weakforms[omp_get_thread_num()];
-
-            // One state is a collection of (virtual) elements sharing
-            // the same physical location on (possibly) different meshes.
-            // This is then the same element of the virtual union mesh.
-            // The proper sub-element mappings to all the functions of
-            // this stage is supplied by the function Traverse::get_next_state()
-            // called in the while loop. 
-            this->assemble_one_state(current_pss, current_spss, current_refmaps, NULL, current_als, &current_state, current_weakform);
-
-            if(this->DG_matrix_forms_present || this->DG_vector_forms_present)
-              this->assemble_one_DG_state(current_pss, current_spss, current_refmaps, current_als, &current_state, current_weakform->mfDG, current_weakform->vfDG, trav[omp_get_thread_num()].fn, current_weakform);
-          }
-          catch(Hermes::Exceptions::Exception& e)
-          {
-            if(this->caughtException == NULL)
-              this->caughtException = e.clone();
-          }
-          catch(std::exception& e)
-          {
-            if(this->caughtException == NULL)
-              this->caughtException = new Hermes::Exceptions::Exception(e.what());
           }
         }
       }
 
-      this->deinit_assembling(pss, spss, refmaps, NULL, als, weakforms);
+      this->assemble_batched();
+
+      if(this->buffered_assembly && this->caughtException == NULL)
+        this->merge_assembly_buffers();
 
-      trav_master.finish();
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
-        trav[i].finish();
+      this->deinit_assembling();
+      this->dirichlet_lift_only = false;
 
-      for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+      delete [] item_first_states;
+      delete [] item_end_states;
+      delete [] phase_first_items;
+      if(states != all_states)
+        delete [] states;
+
+      for(unsigned int i = 0; i < this->get_num_threads(); i++)
       {
         fns[i].clear();
       }
       delete [] fns;
-      delete [] trav;
 
       /// \todo Should this be really here? Or in assemble()?
       if(this->current_mat != NULL)
@@ -229,14 +255,6 @@ namespace Hermes
       if(this->current_rhs != NULL)
         this->current_rhs->finish();
 
-      if(this->DG_matrix_forms_present || this->DG_vector_forms_present)
-      {
-        Element* element_to_set_nonvisited;
-        for(unsigned int mesh_i = 0; mesh_i < meshes.size(); mesh_i++)
-          for_all_elements(element_to_set_nonvisited, meshes[mesh_i])
-          element_to_set_nonvisited->visited = false;
-      }
-
       if(this->caughtException != NULL)
         throw *(this->caughtException);
     }
@@ -245,6 +263,7 @@ namespace Hermes
     void DiscreteProblemLinear<Scalar>::assemble_matrix_form(MatrixForm<Scalar>* form, int order, Func<double>** base_fns, Func<double>** test_fns, Func<Scalar>** ext, Func<Scalar>** u_ext,
       AsmList<Scalar>* current_als_i, AsmList<Scalar>* current_als_j, Traverse::State* current_state, int n_quadrature_points, Geom<double>* geometry, double* jacobian_x_weights)
     {
+      Hermes::ProfilerRegion profiler_region("DiscreteProblem::assemble_matrix_form");
       bool surface_form = (dynamic_cast<MatrixFormVol<Scalar>*>(form) == NULL);
 
       double block_scaling_coefficient = this->block_scaling_coeff(form);
@@ -253,23 +272,61 @@ namespace Hermes
       bool sym = (form->i == form->j) && (form->sym == 1);
 
       // Assemble the local stiffness matrix for the form form.
-      Scalar **local_stiffness_matrix = new_matrix<Scalar>(std::max(current_als_i->cnt, current_als_j->cnt));
+      Scalar **local_stiffness_matrix = this->current_arena()->allocate_matrix(std::max(current_als_i->cnt, current_als_j->cnt), std::max(current_als_i->cnt, current_als_j->cnt));
 
       Func<Scalar>** local_ext = ext;
       // If the user supplied custom ext functions for this form.
       if(form->ext.size() > 0)
       {
         int local_ext_count = form->ext.size();
-        local_ext = new Func<Scalar>*[local_ext_count];
+        local_ext = this->current_arena()->template allocate_array<Func<Scalar>*>(local_ext_count);
         for(int ext_i = 0; ext_i < local_ext_count; ext_i++)
           if(form->ext[ext_i] != NULL)
-            local_ext[ext_i] = current_state->e[ext_i] == NULL ? NULL : init_fn(form->ext[ext_i], order);
+            local_ext[ext_i] = current_state->e[ext_i] == NULL ? NULL : this->get_form_ext_fn(form->ext[ext_i], order);
           else
             local_ext[ext_i] = NULL;
       }
 
+      if(this->current_mat == NULL)
+      {
+        this->assemble_dirichlet_lift(form, base_fns, test_fns, local_ext, u_ext, current_als_i, current_als_j, n_quadrature_points, geometry, jacobian_x_weights);
+        return;
+      }
+
+      // Forms may evaluate the whole block at once, only the coefficients are then applied here.
+      // Contributions of the Dirichlet basis functions go to the right-hand side.
+      bool block_evaluated = form->value_block(n_quadrature_points, jacobian_x_weights, u_ext,
+        base_fns, current_als_j->cnt, test_fns, current_als_i->cnt, geometry, local_ext, local_stiffness_matrix);
+
+      if(block_evaluated)
+      {
+        if(surface_form)
+          block_scaling_coefficient *= 0.5;
+        for (unsigned int i = 0; i < current_als_i->cnt; i++)
+        {
+          for (unsigned int j = 0; j < current_als_j->cnt; j++)
+          {
+            if(current_als_i->dof[i] < 0)
+            {
+              local_stiffness_matrix[i][j] = 0;
+              continue;
+            }
+            if(std::abs(current_als_i->coef[i]) < 1e-12 || std::abs(current_als_j->coef[j]) < 1e-12)
+            {
+              local_stiffness_matrix[i][j] = 0;
+              continue;
+            }
+            Scalar val = local_stiffness_matrix[i][j] * block_scaling_coefficient * form->scaling_factor * current_als_j->coef[j] * current_als_i->coef[i];
+            if(current_als_j->dof[j] >= 0)
+              local_stiffness_matrix[i][j] = val;
+            else
+              this->add_to_rhs(current_als_i->dof[i], -val);
+          }
+        }
+      }
+
       // Actual form-specific calculation.
-      for (unsigned int i = 0; i < current_als_i->cnt; i++)
+      for (unsigned int i = 0; i < current_als_i->cnt && !block_evaluated; i++)
       {
         if(current_als_i->dof[i] < 0)
           continue;
@@ -300,9 +357,9 @@ namespace Hermes
             {
               {
                 if(surface_form)
-                  this->current_rhs->add(current_als_i->dof[i], -0.5 * block_scaling_coefficient * form->value(n_quadrature_points, jacobian_x_weights, u_ext, u, v, geometry, local_ext) * form->scaling_factor * current_als_j->coef[j] * current_als_i->coef[i]);
+                  this->add_to_rhs(current_als_i->dof[i], -0.5 * block_scaling_coefficient * form->value(n_quadrature_points, jacobian_x_weights, u_ext, u, v, geometry, local_ext) * form->scaling_factor * current_als_j->coef[j] * current_als_i->coef[i]);
                 else
-                  this->current_rhs->add(current_als_i->dof[i], -block_scaling_coefficient * form->value(n_quadrature_points, jacobian_x_weights, u_ext, u, v, geometry, local_ext) * form->scaling_factor * current_als_j->coef[j] * current_als_i->coef[i]);
+                  this->add_to_rhs(current_als_i->dof[i], -block_scaling_coefficient * form->value(n_quadrature_points, jacobian_x_weights, u_ext, u, v, geometry, local_ext) * form->scaling_factor * current_als_j->coef[j] * current_als_i->coef[i]);
               }
             }
           }
@@ -327,14 +384,14 @@ namespace Hermes
               local_stiffness_matrix[i][j] = local_stiffness_matrix[j][i] = val;
             else
             {
-              this->current_rhs->add(current_als_i->dof[i], -val);
+              this->add_to_rhs(current_als_i->dof[i], -val);
             }
           }
         }
       }
 
       // Insert the local stiffness matrix into the global one.
-      this->current_mat->add(current_als_i->cnt, current_als_j->cnt, local_stiffness_matrix, current_als_i->dof, current_als_j->dof);
+      this->add_to_matrix(current_als_i->cnt, current_als_j->cnt, local_stiffness_matrix, current_als_i->dof, current_als_j->dof);
 
       // Insert also the off-diagonal (anti-)symmetric block, if required.
       if(tra)
@@ -343,29 +400,46 @@ namespace Hermes
           chsgn(local_stiffness_matrix, current_als_i->cnt, current_als_j->cnt);
         transpose(local_stiffness_matrix, current_als_i->cnt, current_als_j->cnt);
 
-        this->current_mat->add(current_als_j->cnt, current_als_i->cnt, local_stiffness_matrix, current_als_j->dof, current_als_i->dof);
+        this->add_to_matrix(current_als_j->cnt, current_als_i->cnt, local_stiffness_matrix, current_als_j->dof, current_als_i->dof);
 
         // Linear problems only: Subtracting Dirichlet lift contribution from the RHS:
         for (unsigned int j = 0; j < current_als_i->cnt; j++)
           if(current_als_i->dof[j] < 0)
             for (unsigned int i = 0; i < current_als_j->cnt; i++)
               if(current_als_j->dof[i] >= 0)
-                this->current_rhs->add(current_als_j->dof[i], -local_stiffness_matrix[i][j]);
+                this->add_to_rhs(current_als_j->dof[i], -local_stiffness_matrix[i][j]);
       }
+    }
 
-      if(form->ext.size() > 0)
+    template<typename Scalar>
+    void DiscreteProblemLinear<Scalar>::assemble_dirichlet_lift(MatrixForm<Scalar>* form, Func<double>** base_fns, Func<double>** test_fns, Func<Scalar>** ext, Func<Scalar>** u_ext,
+      AsmList<Scalar>* current_als_i, AsmList<Scalar>* current_als_j, int n_quadrature_points, Geom<double>* geometry, double* jacobian_x_weights)
+    {
+      // Most elements have no Dirichlet basis function.
+      bool any_dirichlet = false;
+      for (unsigned int j = 0; j < current_als_j->cnt && !any_dirichlet; j++)
+        if(current_als_j->dof[j] < 0 && std::abs(current_als_j->coef[j]) >= 1e-12)
+          any_dirichlet = true;
+      if(!any_dirichlet)
+        return;
+
+      bool surface_form = (dynamic_cast<MatrixFormVol<Scalar>*>(form) == NULL);
+      bool sym = (form->i == form->j) && (form->sym == 1);
+      // The same scaling as the entries of assemble_matrix_form().
+      double coefficient = this->block_scaling_coeff(form) * ((surface_form && !sym) ? 0.5 : 1.0);
+
+      for (unsigned int i = 0; i < current_als_i->cnt; i++)
       {
-        for(int ext_i = 0; ext_i < form->ext.size(); ext_i++)
-          if(form->ext[ext_i] != NULL)
-          {
-            local_ext[ext_i]->free_fn();
-            delete local_ext[ext_i];
-          }
-          delete [] local_ext;
+        if(current_als_i->dof[i] < 0 || std::abs(current_als_i->coef[i]) < 1e-12)
+          continue;
+        for (unsigned int j = 0; j < current_als_j->cnt; j++)
+        {
+          if(current_als_j->dof[j] >= 0 || std::abs(current_als_j->coef[j]) < 1e-12)
+            continue;
+          Scalar val = coefficient * form->value(n_quadrature_points, jacobian_x_weights, u_ext, base_fns[j], test_fns[i], geometry, ext) * form->scaling_factor * current_als_j->coef[j] * current_als_i->coef[i];
+          this->add_to_rhs(current_als_i->dof[i], -val);
+        }
       }
-
-      // Cleanup.
-      delete [] local_stiffness_matrix;
     }
 
     template class HERMES_API DiscreteProblemLinear<double>;
@@ -0,0 +1,410 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "flux_corrected_transport.h"
+#ifdef WITH_UMFPACK
+#include "api2d.h"
+#include "neighbor.h"
+#include <algorithm>
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// Below this number of the rows, the node loops run sequentially.
+    static const int FCT_PARALLEL_MIN_SIZE = 10000;
+
+    FluxCorrectedTransport::FluxCorrectedTransport(double theta) : theta(theta), time_step(0.0), size(0), nnz(0),
+      Ap(NULL), Ai(NULL), pattern(NULL), transposed(NULL), diagonal(NULL), limited(NULL),
+      mass(NULL), lumped_mass(NULL), low_order_operator(NULL), diffusion(NULL), low_order_rhs(NULL), high_order_rhs(NULL), lumped_diagonal(true),
+      low_order_matrix(NULL), high_order_matrix(NULL), lumped_matrix(NULL), low_order_vector(NULL), high_order_vector(NULL), lumped_vector(NULL),
+      low_order_solver(NULL), high_order_solver(NULL), lumped_solver(NULL),
+      low_order_factorized(false), high_order_factorized(false), lumped_factorized(false),
+      u_L(NULL), u_H(NULL), flux(NULL), b(NULL), P_plus(NULL), P_minus(NULL), Q_plus(NULL), Q_minus(NULL), R_plus(NULL), R_minus(NULL)
+    {
+      if(theta < 0.0 || theta > 1.0)
+        throw Exceptions::ValueException("theta", theta, 0.0, 1.0);
+    }
+
+    FluxCorrectedTransport::~FluxCorrectedTransport()
+    {
+      free();
+    }
+
+    void FluxCorrectedTransport::free()
+    {
+      delete low_order_solver;
+      delete high_order_solver;
+      delete lumped_solver;
+      delete low_order_matrix;
+      delete high_order_matrix;
+      delete lumped_matrix;
+      delete low_order_vector;
+      delete high_order_vector;
+      delete lumped_vector;
+      low_order_solver = high_order_solver = lumped_solver = NULL;
+      low_order_matrix = high_order_matrix = lumped_matrix = NULL;
+      low_order_vector = high_order_vector = lumped_vector = NULL;
+
+      if(pattern != NULL)
+        pattern->release();
+      pattern = NULL;
+      delete [] transposed;
+      delete [] diagonal;
+      delete [] limited;
+      delete [] mass;
+      delete [] lumped_mass;
+      delete [] low_order_operator;
+      delete [] diffusion;
+      delete [] low_order_rhs;
+      delete [] high_order_rhs;
+      delete [] u_L;
+      delete [] u_H;
+      delete [] flux;
+      delete [] b;
+      delete [] P_plus;
+      delete [] P_minus;
+      delete [] Q_plus;
+      delete [] Q_minus;
+      delete [] R_plus;
+      delete [] R_minus;
+      Ap = Ai = transposed = diagonal = NULL;
+      limited = NULL;
+      mass = lumped_mass = low_order_operator = diffusion = low_order_rhs = high_order_rhs = NULL;
+      u_L = u_H = flux = b = P_plus = P_minus = Q_plus = Q_minus = R_plus = R_minus = NULL;
+      size = nnz = 0;
+    }
+
+    void FluxCorrectedTransport::init(CSCMatrix<double>* mass_matrix, CSCMatrix<double>* convection_matrix, double time_step, const bool* limited_dofs)
+    {
+      if(time_step <= 0.0)
+        throw Exceptions::ValueException("time_step", time_step, 0.0);
+      int n = mass_matrix->get_size();
+      int n_nz = mass_matrix->get_nnz();
+      bool shared_pattern = mass_matrix->get_sparsity_pattern() != NULL && mass_matrix->get_sparsity_pattern() == convection_matrix->get_sparsity_pattern();
+      if(!shared_pattern && (convection_matrix->get_size() != n || convection_matrix->get_nnz() != n_nz
+        || !std::equal(mass_matrix->get_Ap(), mass_matrix->get_Ap() + n + 1, convection_matrix->get_Ap())
+        || !std::equal(mass_matrix->get_Ai(), mass_matrix->get_Ai() + n_nz, convection_matrix->get_Ai())))
+        throw Exceptions::Exception("FluxCorrectedTransport: the mass and the convection matrix have to have the same pattern.");
+
+      free();
+      this->time_step = time_step;
+      size = n;
+      nnz = n_nz;
+      pattern = mass_matrix->get_sparsity_pattern();
+      if(pattern != NULL && !pattern->is_symmetric())
+        pattern->add_reference();
+      else
+      {
+        int* col_start = new int[size + 1];
+        int* rows = new int[std::max(nnz, 1)];
+        memcpy(col_start, mass_matrix->get_Ap(), (size + 1) * sizeof(int));
+        memcpy(rows, mass_matrix->get_Ai(), nnz * sizeof(int));
+        pattern = new SparsityPattern(size, col_start, rows);
+      }
+      Ap = const_cast<int*>(pattern->get_col_start());
+      Ai = const_cast<int*>(pattern->get_rows());
+
+      limited = new bool[size];
+      for(int i = 0; i < size; i++)
+        limited[i] = (limited_dofs == NULL) ? true : limited_dofs[i];
+
+      // The position of the transposed entries, the rows of each column are sorted.
+      transposed = new int[nnz];
+      diagonal = new int[size];
+      for(int col = 0; col < size; col++)
+      {
+        diagonal[col] = -1;
+        for(int idx = Ap[col]; idx < Ap[col + 1]; idx++)
+        {
+          int row = Ai[idx];
+          int* position = std::lower_bound(Ai + Ap[row], Ai + Ap[row + 1], col);
+          if(position == Ai + Ap[row + 1] || *position != col)
+            throw Exceptions::Exception("FluxCorrectedTransport: the pattern of the matrices has to be symmetric.");
+          transposed[idx] = position - Ai;
+          if(row == col)
+            diagonal[col] = idx;
+        }
+        if(diagonal[col] == -1)
+          throw Exceptions::Exception("FluxCorrectedTransport: the pattern of the matrices has to contain the diagonal.");
+      }
+
+      double* K = convection_matrix->get_Ax();
+      mass = new double[nnz];
+      memcpy(mass, mass_matrix->get_Ax(), nnz * sizeof(double));
+      lumped_mass = new double[nnz];
+      diffusion = new double[nnz];
+      low_order_operator = new double[nnz];
+      low_order_rhs = new double[nnz];
+      high_order_rhs = new double[nnz];
+      double* low_order_values = new double[nnz];
+      double* high_order_values = new double[nnz];
+      lumped_diagonal = true;
+
+      // Each column (node) is written by one thread only, the pattern and the matrices being symmetric.
+      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(size > FCT_PARALLEL_MIN_SIZE) reduction(&&:lumped_diagonal)
+      for(int i = 0; i < size; i++)
+      {
+        double lumped_diagonal_value = 0.0, diffusion_diagonal_value = 0.0;
+        for(int idx = Ap[i]; idx < Ap[i + 1]; idx++)
+        {
+          int j = Ai[idx];
+          lumped_mass[idx] = mass[idx];
+          diffusion[idx] = 0.0;
+          if(j == i)
+            continue;
+          if(limited[i] && limited[j])
+          {
+            lumped_diagonal_value += mass[idx];
+            lumped_mass[idx] = 0.0;
+            double d = std::max(0.0, std::max(-K[idx], -K[transposed[idx]]));
+            diffusion[idx] = d;
+            diffusion_diagonal_value -= d;
+          }
+          else if(mass[idx] != 0.0)
+            lumped_diagonal = false;
+        }
+        lumped_mass[diagonal[i]] += lumped_diagonal_value;
+        diffusion[diagonal[i]] = diffusion_diagonal_value;
+
+        for(int idx = Ap[i]; idx < Ap[i + 1]; idx++)
+        {
+          low_order_operator[idx] = K[idx] + diffusion[idx];
+          low_order_values[idx] = lumped_mass[idx] / time_step - theta * low_order_operator[idx];
+          low_order_rhs[idx] = lumped_mass[idx] / time_step + (1.0 - theta) * low_order_operator[idx];
+          high_order_values[idx] = mass[idx] / time_step - theta * K[idx];
+          high_order_rhs[idx] = mass[idx] / time_step + (1.0 - theta) * K[idx];
+        }
+      }
+
+      // The system matrices only hold their values.
+      low_order_matrix = new UMFPackMatrix<double>;
+      low_order_matrix->alloc_with_pattern(pattern);
+      memcpy(low_order_matrix->get_Ax(), low_order_values, nnz * sizeof(double));
+      high_order_matrix = new UMFPackMatrix<double>;
+      high_order_matrix->alloc_with_pattern(pattern);
+      memcpy(high_order_matrix->get_Ax(), high_order_values, nnz * sizeof(double));
+      low_order_vector = new UMFPackVector<double>(size);
+      high_order_vector = new UMFPackVector<double>(size);
+      low_order_solver = new UMFPackLinearMatrixSolver<double>(low_order_matrix, low_order_vector);
+      high_order_solver = new UMFPackLinearMatrixSolver<double>(high_order_matrix, high_order_vector);
+      if(!lumped_diagonal)
+      {
+        lumped_matrix = new UMFPackMatrix<double>;
+        lumped_matrix->alloc_with_pattern(pattern);
+        memcpy(lumped_matrix->get_Ax(), lumped_mass, nnz * sizeof(double));
+        lumped_vector = new UMFPackVector<double>(size);
+        lumped_solver = new UMFPackLinearMatrixSolver<double>(lumped_matrix, lumped_vector);
+      }
+      low_order_factorized = high_order_factorized = lumped_factorized = false;
+      delete [] low_order_values;
+      delete [] high_order_values;
+
+      u_L = new double[size];
+      u_H = new double[size];
+      flux = new double[size];
+      b = new double[size];
+      P_plus = new double[size];
+      P_minus = new double[size];
+      Q_plus = new double[size];
+      Q_minus = new double[size];
+      R_plus = new double[size];
+      R_minus = new double[size];
+    }
+
+    void FluxCorrectedTransport::multiply(double* Ax, double* x, double* y) const
+    {
+      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(size > FCT_PARALLEL_MIN_SIZE)
+      for(int i = 0; i < size; i++)
+      {
+        // The row i is the column i of the transposed entries.
+        double sum = 0.0;
+        for(int idx = Ap[i]; idx < Ap[i + 1]; idx++)
+          sum += Ax[transposed[idx]] * x[Ai[idx]];
+        y[i] = sum;
+      }
+    }
+
+    void FluxCorrectedTransport::solve(LinearMatrixSolver<double>* solver, UMFPackVector<double>* rhs, bool& factorized, double* b, double* x)
+    {
+      rhs->zero();
+      rhs->add_vector(b);
+      if(!solver->solve())
+        throw Exceptions::LinearMatrixSolverException("FluxCorrectedTransport: the system could not be solved.");
+      if(!factorized)
+      {
+        solver->set_factorization_scheme(HERMES_REUSE_FACTORIZATION_COMPLETELY);
+        factorized = true;
+      }
+      memcpy(x, solver->get_sln_vector(), size * sizeof(double));
+    }
+
+    void FluxCorrectedTransport::step(double* u_n, double* u_new, const bool* unlimited_dofs)
+    {
+      if(low_order_solver == NULL)
+        throw Exceptions::Exception("FluxCorrectedTransport: init() has to be called first.");
+
+      // 1. The low order predictor.
+      multiply(low_order_rhs, u_n, b);
+      if(lumped_diagonal)
+      {
+        for(int i = 0; i < size; i++)
+          u_L[i] = b[i] * time_step / lumped_mass[diagonal[i]];
+      }
+      else
+      {
+        for(int i = 0; i < size; i++)
+          flux[i] = b[i] * time_step;
+        solve(lumped_solver, lumped_vector, lumped_factorized, flux, u_L);
+      }
+
+      // 2. The high order solution.
+      multiply(high_order_rhs, u_n, flux);
+      solve(high_order_solver, high_order_vector, high_order_factorized, flux, u_H);
+
+      // 3. The sums of the positive and negative fluxes and the bounds.
+      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(size > FCT_PARALLEL_MIN_SIZE)
+      for(int i = 0; i < size; i++)
+      {
+        P_plus[i] = P_minus[i] = Q_plus[i] = Q_minus[i] = 0.0;
+        if(!limited[i])
+          continue;
+        double m_i = lumped_mass[diagonal[i]];
+        for(int idx = Ap[i]; idx < Ap[i + 1]; idx++)
+        {
+          int j = Ai[idx];
+          if(j == i || !limited[j] || mass[idx] == 0.0)
+            continue;
+          double f = (mass[idx] / time_step + theta * diffusion[idx]) * (u_H[i] - u_H[j])
+            - (mass[idx] / time_step - (1.0 - theta) * diffusion[idx]) * (u_n[i] - u_n[j]);
+          // Prelimiting, the fluxes down the gradient of the predictor are dropped.
+          if(f * (u_L[j] - u_L[i]) > 0.0)
+            f = 0.0;
+          if(f > 0.0)
+            P_plus[i] += f;
+          else
+            P_minus[i] += f;
+          double q = m_i * (u_L[j] - u_L[i]) / time_step;
+          Q_plus[i] = std::max(Q_plus[i], q);
+          Q_minus[i] = std::min(Q_minus[i], q);
+        }
+        R_plus[i] = (P_plus[i] == 0.0) ? 1.0 : std::min(1.0, Q_plus[i] / P_plus[i]);
+        R_minus[i] = (P_minus[i] == 0.0) ? 1.0 : std::min(1.0, Q_minus[i] / P_minus[i]);
+        if(unlimited_dofs != NULL && unlimited_dofs[i])
+          R_plus[i] = R_minus[i] = 1.0;
+      }
+
+      // The limited fluxes, f_ji = -f_ij and alpha_ji = alpha_ij, so that every node sums its own.
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(size > FCT_PARALLEL_MIN_SIZE)
+      for(int i = 0; i < size; i++)
+      {
+        double sum = 0.0;
+        if(limited[i])
+        {
+          for(int idx = Ap[i]; idx < Ap[i + 1]; idx++)
+          {
+            int j = Ai[idx];
+            if(j == i || !limited[j] || mass[idx] == 0.0)
+              continue;
+            double f = (mass[idx] / time_step + theta * diffusion[idx]) * (u_H[i] - u_H[j])
+              - (mass[idx] / time_step - (1.0 - theta) * diffusion[idx]) * (u_n[i] - u_n[j]);
+            if(f * (u_L[j] - u_L[i]) > 0.0)
+              f = 0.0;
+            if(f > 0.0)
+              sum += std::min(R_plus[i], R_minus[j]) * f;
+            else if(f < 0.0)
+              sum += std::min(R_minus[i], R_plus[j]) * f;
+          }
+        }
+        flux[i] = sum;
+      }
+
+      // 4. The corrected solution.
+      multiply(low_order_rhs, u_n, b);
+      for(int i = 0; i < size; i++)
+        b[i] += flux[i];
+      solve(low_order_solver, low_order_vector, low_order_factorized, b, u_new);
+    }
+
+    double* FluxCorrectedTransport::get_low_order_solution() const
+    {
+      return u_L;
+    }
+
+    double* FluxCorrectedTransport::get_high_order_solution() const
+    {
+      return u_H;
+    }
+
+    double* FluxCorrectedTransport::get_limited_flux() const
+    {
+      return flux;
+    }
+
+    void FluxCorrectedTransport::find_linear_dofs(const Space<double>* space, bool* result)
+    {
+      int ndof = space->get_num_dofs();
+      for(int i = 0; i < ndof; i++)
+        result[i] = false;
+
+      AsmList<double> al;
+      Element* e;
+      for_all_active_elements(e, space->get_mesh())
+      {
+        int order = space->get_element_order(e->id);
+        if(order != 1 && order != H2D_MAKE_QUAD_ORDER(1, 1))
+          continue;
+
+        // A neighbor of a higher order or a constrained vertex excludes the element.
+        bool excluded = false;
+        for(unsigned int iv = 0; iv < e->get_nvert() && !excluded; iv++)
+        {
+          if(e->vn[iv]->is_constrained_vertex())
+          {
+            excluded = true;
+            break;
+          }
+          NeighborSearch<double> ns(e, space->get_mesh());
+          ns.set_ignore_errors(true);
+          ns.set_active_edge(iv);
+          for(unsigned int i = 0; i < ns.get_neighbors()->size(); i++)
+          {
+            int neighbor_order = space->get_element_order(ns.get_neighbors()->at(i)->id);
+            if(neighbor_order != 1 && neighbor_order != H2D_MAKE_QUAD_ORDER(1, 1))
+            {
+              excluded = true;
+              break;
+            }
+          }
+        }
+        if(excluded)
+          continue;
+
+        space->get_element_assembly_list(e, &al);
+        for(unsigned int iv = 0; iv < e->get_nvert(); iv++)
+        {
+          int index = space->get_shapeset()->get_vertex_index(iv, e->get_mode());
+          for(unsigned int j = 0; j < al.get_cnt(); j++)
+            if(al.get_idx()[j] == index && al.get_dof()[j] >= 0)
+              result[al.get_dof()[j]] = true;
+        }
+      }
+    }
+  }
+}
+#endif
@@ -23,8 +23,26 @@ namespace Hermes
 {
   namespace Hermes2D
   {
+    /// Alignment (cache line size) of the arrays in the pooled storage of Func and Geom.
+    static const size_t H2D_FORMS_STORAGE_ALIGNMENT = 64;
+
+    /// Allocates count arrays of length values in one block and sets *arrays[i] to the i-th array.
+    /// Returns the pointer to be passed to ::free().
+    template<typename T>
+    static void* allocate_aligned_arrays(T** arrays[], int count, int length)
+    {
+      size_t stride = ((length * sizeof(T) + H2D_FORMS_STORAGE_ALIGNMENT - 1) / H2D_FORMS_STORAGE_ALIGNMENT) * H2D_FORMS_STORAGE_ALIGNMENT;
+      void* storage = malloc(stride * count + H2D_FORMS_STORAGE_ALIGNMENT);
+      if(storage == NULL)
+        throw Hermes::Exceptions::Exception("Unable to allocate the storage for %d arrays of %d values.", count, length);
+      char* base = (char*)(((size_t)storage + H2D_FORMS_STORAGE_ALIGNMENT - 1) & ~(H2D_FORMS_STORAGE_ALIGNMENT - 1));
+      for(int i = 0; i < count; i++)
+        *arrays[i] = (T*)(base + i * stride);
+      return storage;
+    }
+
     template<typename T>
-    Func<T>::Func(int num_gip, int num_comps) : num_gip(num_gip), nc(num_comps)
+    Func<T>::Func(int num_gip, int num_comps) : num_gip(num_gip), nc(num_comps), storage(NULL), split_storage(NULL), split_done(0)
     {
       val = NULL;
       dx = NULL;
@@ -49,13 +67,12 @@ namespace Hermes
       if(nc != func->nc)
         throw Hermes::Exceptions::Exception("Unable to subtract a function due to a different number of components (this: %d, other: %d)", nc, func->nc);
 
+      this->split_done = 0;
       subtract(this->val, func->val);
       subtract(this->dx, func->dx);
       subtract(this->dy, func->dy);
 
-#ifdef H2D_USE_SECOND_DERIVATIVES
-        subtract(this->laplace, func->laplace);
-#endif
+      subtract(this->laplace, func->laplace);
 
       if(nc > 1)
       {
@@ -76,6 +93,46 @@ namespace Hermes
       return num_gip;
     }
 
+    template<typename T>
+    void Func<T>::allocate_storage(T** arrays[], int count)
+    {
+      if(storage != NULL)
+        throw Hermes::Exceptions::Exception("Func::allocate_storage() called twice on the same instance.");
+      storage = allocate_aligned_arrays(arrays, count, num_gip);
+    }
+
+    template<typename T>
+    void Func<T>::allocate_storage(unsigned int demand)
+    {
+      T** arrays[4];
+      int count = 0;
+      if(nc == 1)
+      {
+        if(demand & H2D_DEMAND_VAL)
+          arrays[count++] = &val;
+        if(demand & H2D_DEMAND_GRAD)
+        {
+          arrays[count++] = &dx;
+          arrays[count++] = &dy;
+        }
+        if(demand & H2D_DEMAND_LAPLACE)
+          arrays[count++] = &laplace;
+      }
+      else
+      {
+        if(demand & H2D_DEMAND_VAL)
+        {
+          arrays[count++] = &val0;
+          arrays[count++] = &val1;
+        }
+        if(demand & H2D_DEMAND_CURL)
+          arrays[count++] = &curl;
+        if(demand & H2D_DEMAND_DIV)
+          arrays[count++] = &div;
+      }
+      allocate_storage(arrays, count);
+    }
+
     template<typename T>
     void Func<T>::subtract(T* attribute, T* other_attribute)
     {
@@ -94,13 +151,12 @@ namespace Hermes
       if(nc != func->nc)
         throw Hermes::Exceptions::Exception("Unable to add a function due to a different number of components (this: %d, other: %d)", nc, func->nc);
 
+      this->split_done = 0;
       add(this->val, func->val);
       add(this->dx, func->dx);
       add(this->dy, func->dy);
 
-#ifdef H2D_USE_SECOND_DERIVATIVES
       add(this->laplace, func->laplace);
-#endif
 
       if(nc > 1)
       {
@@ -148,17 +204,90 @@ namespace Hermes
       laplace = NULL;
     }
 
+    template<typename T>
+    void Func<T>::get_split(const T* attribute, const double*& re, const double*& im)
+    {
+      throw Hermes::Exceptions::Exception("Func::get_split() is only available for complex functions.");
+    }
+
+    /// The number of the attributes in the split storage.
+    static const int H2D_NUM_SPLIT_ATTRIBUTES = 12;
+
+    template<>
+    void Func<std::complex<double> >::get_split(const std::complex<double>* attribute, const double*& re, const double*& im)
+    {
+      std::complex<double>* attributes[H2D_NUM_SPLIT_ATTRIBUTES] = { val, dx, dy, laplace, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
+      if(this->nc > 1)
+      {
+        attributes[4] = val0; attributes[5] = val1;
+        attributes[6] = dx0; attributes[7] = dx1;
+        attributes[8] = dy0; attributes[9] = dy1;
+        attributes[10] = curl; attributes[11] = div;
+      }
+      int index = 0;
+      while(index < H2D_NUM_SPLIT_ATTRIBUTES && (attributes[index] != attribute || attribute == NULL))
+        index++;
+      if(index == H2D_NUM_SPLIT_ATTRIBUTES)
+        throw Hermes::Exceptions::Exception("Func::get_split(): the array is not an attribute of this function.");
+
+      if(split_storage == NULL)
+      {
+        double** arrays[2 * H2D_NUM_SPLIT_ATTRIBUTES];
+        double* split_arrays[2 * H2D_NUM_SPLIT_ATTRIBUTES];
+        for(int i = 0; i < 2 * H2D_NUM_SPLIT_ATTRIBUTES; i++)
+          arrays[i] = &split_arrays[i];
+        split_storage = (double*)allocate_aligned_arrays(arrays, 2 * H2D_NUM_SPLIT_ATTRIBUTES, num_gip);
+      }
+      // The arrays are found again from the block (its alignment as in allocate_aligned_arrays()).
+      size_t stride = ((num_gip * sizeof(double) + H2D_FORMS_STORAGE_ALIGNMENT - 1) / H2D_FORMS_STORAGE_ALIGNMENT) * H2D_FORMS_STORAGE_ALIGNMENT;
+      char* base = (char*)(((size_t)split_storage + H2D_FORMS_STORAGE_ALIGNMENT - 1) & ~(H2D_FORMS_STORAGE_ALIGNMENT - 1));
+      double* split_re = (double*)(base + 2 * index * stride);
+      double* split_im = (double*)(base + (2 * index + 1) * stride);
+
+      if(!(split_done & (1u << index)))
+      {
+        for(int i = 0; i < num_gip; i++)
+        {
+          split_re[i] = attribute[i].real();
+          split_im[i] = attribute[i].imag();
+        }
+        split_done |= 1u << index;
+      }
+      re = split_re;
+      im = split_im;
+    }
+
     template<typename T>
     void Func<T>::free_fn()
     {
+      if(split_storage != NULL)
+      {
+        ::free(split_storage);
+        split_storage = NULL;
+      }
+      split_done = 0;
+
+      if(storage != NULL)
+      {
+        ::free(storage);
+        storage = NULL;
+        val = dx = dy = laplace = NULL;
+        if(this->nc > 1)
+        {
+          val0 = val1 = NULL;
+          dx0 = dx1 = NULL;
+          dy0 = dy1 = NULL;
+          curl = NULL;
+          div = NULL;
+        }
+        return;
+      }
+
       delete [] val; val = NULL;
       delete [] dx; dx = NULL;
       delete [] dy; dy = NULL;
 
-#ifdef H2D_USE_SECOND_DERIVATIVES
-      delete [] laplace; 
-      laplace = NULL;
-#endif
+      delete [] laplace; laplace = NULL;
 
       if(this->nc > 1)
       {
@@ -295,6 +424,7 @@ namespace Hermes
     template<typename T>
     Geom<T>::Geom()
     {
+      storage = NULL;
       elem_marker = -1;
       edge_marker = -1;
       id = 0;
@@ -307,11 +437,28 @@ namespace Hermes
     template<typename T>
     void Geom<T>::free()
     {
+      if(storage != NULL)
+      {
+        ::free(storage);
+        storage = NULL;
+        x = y = NULL;
+        tx = ty = NULL;
+        nx = ny = NULL;
+        return;
+      }
       delete [] x;    delete [] y;
       delete [] tx;    delete [] ty;
       delete [] nx;    delete [] ny;
     }
 
+    template<typename T>
+    void Geom<T>::allocate_storage(T** arrays[], int count, int np)
+    {
+      if(storage != NULL)
+        throw Hermes::Exceptions::Exception("Geom::allocate_storage() called twice on the same instance.");
+      storage = allocate_aligned_arrays(arrays, count, np);
+    }
+
     template<typename T>
     InterfaceGeom<T>::InterfaceGeom(Geom<T>* geom, int n_marker, int n_id, T n_diam) :
     Geom<T>(), neighb_marker(n_marker), neighb_id(n_id), neighb_diam(n_diam)
@@ -395,8 +542,14 @@ namespace Hermes
       e->elem_marker = rm->get_active_element()->marker;
       Quad2D* quad = rm->get_quad_2d();
       int np = quad->get_num_points(order, rm->get_active_element()->get_mode());
-      e->x = new double[np];
-      e->y = new double[np];
+      double** arrays[] = { &e->x, &e->y };
+      e->allocate_storage(arrays, 2, np);
+      // Affine elements: straight from the map, without the per-order tables of the RefMap.
+      if(rm->is_jacobian_const())
+      {
+        rm->calc_const_phys_coords(order, e->x, e->y);
+        return e;
+      }
       double* x = rm->get_phys_x(order);
       double* y = rm->get_phys_y(order);
       for (int i = 0; i < np; i++)
@@ -423,12 +576,8 @@ namespace Hermes
       
       Quad2D* quad = rm->get_quad_2d();
       int np = quad->get_num_points(order, rm->get_active_element()->get_mode());
-      e->x = new double[np];
-      e->y = new double[np];
-      e->tx = new double[np];
-      e->ty = new double[np];
-      e->nx = new double[np];
-      e->ny = new double[np];
+      double** arrays[] = { &e->x, &e->y, &e->tx, &e->ty, &e->nx, &e->ny };
+      e->allocate_storage(arrays, 6, np);
       for (int i = 0; i < np; i++)
       {
         e->x[i] = x[i];
@@ -449,9 +598,7 @@ namespace Hermes
       f->val = d;
       f->dx = d1;
       f->dy = d1;
-#ifdef H2D_USE_SECOND_DERIVATIVES
       f->laplace = d;
-#endif
       f->val0 = f->val1 = d;
       f->dx0 = f->dx1 = d1;
       f->dy0 = f->dy1 = d1;
@@ -460,184 +607,202 @@ namespace Hermes
       return f;
     }
 
-    Func<double>* init_fn(PrecalcShapeset *fu, RefMap *rm, const int order)
+    /// The number of the pre-built functions of get_fn_ord().
+    #define H2D_FN_ORD_TABLE_SIZE 64
+
+    static Func<Hermes::Ord>* fn_ord_table[H2D_FN_ORD_TABLE_SIZE];
+    static struct FnOrdTableInitializer
     {
+      FnOrdTableInitializer()
+      {
+        for (int order = 0; order < H2D_FN_ORD_TABLE_SIZE; order++)
+          fn_ord_table[order] = init_fn_ord(order);
+      }
+      ~FnOrdTableInitializer()
+      {
+        for (int order = 0; order < H2D_FN_ORD_TABLE_SIZE; order++)
+        {
+          fn_ord_table[order]->free_ord();
+          delete fn_ord_table[order];
+        }
+      }
+    } fn_ord_table_initializer;
+
+    Func<Hermes::Ord>* get_fn_ord(const int order)
+    {
+      return fn_ord_table[std::max(0, std::min(order, H2D_FN_ORD_TABLE_SIZE - 1))];
+    }
+
+    /// The FuncDemand flags init_fn() really calculates for a function of num_components components:
+    /// the laplace implies the gradient, the flags of the other kind of functions are dropped
+    /// and nothing demanded means the values.
+    static unsigned int effective_demand(int num_components, unsigned int demand, bool laplace_available)
+    {
+      if(num_components == 1)
+      {
+        if(!laplace_available && (demand & H2D_DEMAND_LAPLACE))
+          demand = (demand & ~H2D_DEMAND_LAPLACE) | H2D_DEMAND_GRAD;
+        if(demand & H2D_DEMAND_LAPLACE)
+          demand |= H2D_DEMAND_GRAD;
+        demand &= H2D_DEMAND_VAL | H2D_DEMAND_GRAD | H2D_DEMAND_LAPLACE;
+      }
+      else
+        demand &= H2D_DEMAND_VAL | H2D_DEMAND_CURL | H2D_DEMAND_DIV;
+      return demand == 0 ? (unsigned int)H2D_DEMAND_VAL : demand;
+    }
+
+    /// The precalculation mask (H2D_FN_*) of the (effective) FuncDemand flags.
+    static int get_demand_mask(int num_components, unsigned int demand)
+    {
+      int mask = 0;
+      if(num_components == 1)
+      {
+        if(demand & H2D_DEMAND_VAL)
+          mask |= H2D_FN_VAL_0;
+        if(demand & H2D_DEMAND_GRAD)
+          mask |= H2D_FN_DX_0 | H2D_FN_DY_0;
+        if(demand & H2D_DEMAND_LAPLACE)
+          mask |= H2D_FN_DXX_0 | H2D_FN_DYY_0 | H2D_FN_DXY_0;
+      }
+      else
+      {
+        if(demand & H2D_DEMAND_VAL)
+          mask |= H2D_FN_VAL;
+        if(demand & H2D_DEMAND_CURL)
+          mask |= H2D_FN_DX_1 | H2D_FN_DY_0;
+        if(demand & H2D_DEMAND_DIV)
+          mask |= H2D_FN_DX_0 | H2D_FN_DY_1;
+      }
+      return mask;
+    }
+
+    Func<double>* init_fn(PrecalcShapeset *fu, RefMap *rm, const int order, unsigned int demand)
+    {
+      Hermes::ProfilerRegion profiler_region("init_fn");
       int nc = fu->get_num_components();
       SpaceType space_type = fu->get_space_type();
       Quad2D* quad = fu->get_quad_2d();
 
-#ifdef H2D_USE_SECOND_DERIVATIVES
-      if(space_type == HERMES_H1_SPACE || space_type == HERMES_L2_SPACE)
-          fu->set_quad_order(order, H2D_FN_ALL);
-      else
-        fu->set_quad_order(order);
-#else
-        fu->set_quad_order(order);
-#endif
+      if(space_type == HERMES_HCURL_SPACE)
+        demand &= ~H2D_DEMAND_DIV;
+      else if(space_type == HERMES_HDIV_SPACE)
+        demand &= ~H2D_DEMAND_CURL;
+      demand = effective_demand(nc, demand, true);
+      fu->set_quad_order(order, get_demand_mask(nc, demand));
 
-      double3* pt = quad->get_points(order, rm->get_active_element()->get_mode());
       int np = quad->get_num_points(order, rm->get_active_element()->get_mode());
       Func<double>* u = new Func<double>(np, nc);
+      u->allocate_storage(demand);
 
       // H1 & L2 space.
       if(space_type == HERMES_H1_SPACE || space_type == HERMES_L2_SPACE)
       {
-        u->val = new double[np];
-        u->dx  = new double[np];
-        u->dy  = new double[np];
+        if(demand & H2D_DEMAND_VAL)
+          memcpy(u->val, fu->get_fn_values(), np * sizeof(double));
+        if(!(demand & H2D_DEMAND_GRAD))
+          return u;
 
-#ifdef H2D_USE_SECOND_DERIVATIVES
-        u->laplace = new double[np];
-#endif
-
-        double *fn = fu->get_fn_values();
         double *dx = fu->get_dx_values();
         double *dy = fu->get_dy_values();
 
-        double *dxx;
-        double *dxy;
-        double *dyy;
-
-#ifdef H2D_USE_SECOND_DERIVATIVES
-        dxx = fu->get_dxx_values();
-        dxy = fu->get_dxy_values();
-        dyy = fu->get_dyy_values();
-#endif
-
-        double2x2 *m;
+        // Affine elements: one inverse matrix and no second reference map.
         if(rm->is_jacobian_const())
         {
-          m = new double2x2[np];
-          double2x2 const_inv_ref_map;
-
-          const_inv_ref_map[0][0] = rm->get_const_inv_ref_map()[0][0][0];
-          const_inv_ref_map[0][1] = rm->get_const_inv_ref_map()[0][0][1];
-          const_inv_ref_map[1][0] = rm->get_const_inv_ref_map()[0][1][0];
-          const_inv_ref_map[1][1] = rm->get_const_inv_ref_map()[0][1][1];
-
-          for(int i = 0; i < np; i++)
+          double2x2& cm = *rm->get_const_inv_ref_map();
+          for (int i = 0; i < np; i++)
+          {
+            u->dx[i] = (dx[i] * cm[0][0] + dy[i] * cm[0][1]);
+            u->dy[i] = (dx[i] * cm[1][0] + dy[i] * cm[1][1]);
+          }
+          if(demand & H2D_DEMAND_LAPLACE)
           {
-            m[i][0][0] = const_inv_ref_map[0][0];
-            m[i][0][1] = const_inv_ref_map[0][1];
-            m[i][1][0] = const_inv_ref_map[1][0];
-            m[i][1][1] = const_inv_ref_map[1][1];
+            double *dxx = fu->get_dxx_values();
+            double *dxy = fu->get_dxy_values();
+            double *dyy = fu->get_dyy_values();
+            double axx = (Hermes::sqr(cm[0][0]) + Hermes::sqr(cm[1][0]));
+            double ayy = (Hermes::sqr(cm[0][1]) + Hermes::sqr(cm[1][1]));
+            double axy = 2.0 * (cm[0][0]*cm[0][1] + cm[1][0]*cm[1][1]);
+            for (int i = 0; i < np; i++)
+              u->laplace[i] = ( dxx[i] * axx + dxy[i] * axy + dyy[i] * ayy );
           }
+          return u;
         }
-        else
-          m = rm->get_inv_ref_map(order);
 
-#ifdef H2D_USE_SECOND_DERIVATIVES
-        double3x2 *mm;
-        mm = rm->get_second_ref_map(order);
-        for (int i = 0; i < np; i++, m++, mm++)
+        double2x2 *m = rm->get_inv_ref_map(order);
+        for (int i = 0; i < np; i++, m++)
         {
-          u->val[i] = fn[i];
           u->dx[i] = (dx[i] * (*m)[0][0] + dy[i] * (*m)[0][1]);
           u->dy[i] = (dx[i] * (*m)[1][0] + dy[i] * (*m)[1][1]);
-      
-          double axx = (Hermes::sqr((*m)[0][0]) + Hermes::sqr((*m)[1][0]));
-          double ayy = (Hermes::sqr((*m)[0][1]) + Hermes::sqr((*m)[1][1]));
-          double axy = 2.0 * ((*m)[0][0]*(*m)[0][1] + (*m)[1][0]*(*m)[1][1]);
-          double ax = (*mm)[0][0] + (*mm)[2][0];
-          double ay = (*mm)[0][1] + (*mm)[2][1];
-          u->laplace[i] = ( dx[i] * ax + dy[i] * ay + dxx[i] * axx + dxy[i] * axy + dyy[i] * ayy );
         }
-#else
-        for (int i = 0; i < np; i++, m++)
+        if(demand & H2D_DEMAND_LAPLACE)
         {
-          u->val[i] = fn[i];
-          u->dx[i] = (dx[i] * (*m)[0][0] + dy[i] * (*m)[0][1]);
-          u->dy[i] = (dx[i] * (*m)[1][0] + dy[i] * (*m)[1][1]);
+          double *dxx = fu->get_dxx_values();
+          double *dxy = fu->get_dxy_values();
+          double *dyy = fu->get_dyy_values();
+          double3x2 *mm = rm->get_second_ref_map(order);
+          m = rm->get_inv_ref_map(order);
+          for (int i = 0; i < np; i++, m++, mm++)
+          {
+            double axx = (Hermes::sqr((*m)[0][0]) + Hermes::sqr((*m)[1][0]));
+            double ayy = (Hermes::sqr((*m)[0][1]) + Hermes::sqr((*m)[1][1]));
+            double axy = 2.0 * ((*m)[0][0]*(*m)[0][1] + (*m)[1][0]*(*m)[1][1]);
+            double ax = (*mm)[0][0] + (*mm)[2][0];
+            double ay = (*mm)[0][1] + (*mm)[2][1];
+            u->laplace[i] = ( dx[i] * ax + dy[i] * ay + dxx[i] * axx + dxy[i] * axy + dyy[i] * ayy );
+          }
         }
-#endif
-        
-        m -= np;
-        if(rm->is_jacobian_const())
-          delete [] m;
       }
       // Hcurl space.
       else if(space_type == HERMES_HCURL_SPACE)
       {
-        u->val0 = new double[np];
-        u->val1 = new double[np];
-        u->curl = new double[np];
-
-        double *fn0 = fu->get_fn_values(0);
-        double *fn1 = fu->get_fn_values(1);
-        double *dx1 = fu->get_dx_values(1);
-        double *dy0 = fu->get_dy_values(0);
-        double2x2 *m;
-        if(rm->is_jacobian_const())
+        // Affine elements: one inverse matrix for all points.
+        double2x2 *mat = rm->is_jacobian_const() ? rm->get_const_inv_ref_map() : rm->get_inv_ref_map(order);
+        int mstep = rm->is_jacobian_const() ? 0 : 1;
+        double2x2 *m = mat;
+        if(demand & H2D_DEMAND_VAL)
         {
-          m = new double2x2[np];
-          double2x2 const_inv_ref_map;
-
-          const_inv_ref_map[0][0] = rm->get_const_inv_ref_map()[0][0][0];
-          const_inv_ref_map[0][1] = rm->get_const_inv_ref_map()[0][0][1];
-          const_inv_ref_map[1][0] = rm->get_const_inv_ref_map()[0][1][0];
-          const_inv_ref_map[1][1] = rm->get_const_inv_ref_map()[0][1][1];
-
-          for(int i = 0; i < np; i++)
+          double *fn0 = fu->get_fn_values(0);
+          double *fn1 = fu->get_fn_values(1);
+          for (int i = 0; i < np; i++, m += mstep)
           {
-            m[i][0][0] = const_inv_ref_map[0][0];
-            m[i][0][1] = const_inv_ref_map[0][1];
-            m[i][1][0] = const_inv_ref_map[1][0];
-            m[i][1][1] = const_inv_ref_map[1][1];
+            u->val0[i] = (fn0[i] * (*m)[0][0] + fn1[i] * (*m)[0][1]);
+            u->val1[i] = (fn0[i] * (*m)[1][0] + fn1[i] * (*m)[1][1]);
           }
         }
-        else
-          m = rm->get_inv_ref_map(order);
-        for (int i = 0; i < np; i++, m++)
+        if(demand & H2D_DEMAND_CURL)
         {
-          u->val0[i] = (fn0[i] * (*m)[0][0] + fn1[i] * (*m)[0][1]);
-          u->val1[i] = (fn0[i] * (*m)[1][0] + fn1[i] * (*m)[1][1]);
-          u->curl[i] = ((*m)[0][0] * (*m)[1][1] - (*m)[1][0] * (*m)[0][1]) * (dx1[i] - dy0[i]);
+          double *dx1 = fu->get_dx_values(1);
+          double *dy0 = fu->get_dy_values(0);
+          m = mat;
+          for (int i = 0; i < np; i++, m += mstep)
+            u->curl[i] = ((*m)[0][0] * (*m)[1][1] - (*m)[1][0] * (*m)[0][1]) * (dx1[i] - dy0[i]);
         }
-
-        m -= np;
-        if(rm->is_jacobian_const())
-          delete [] m;
       }
       // Hdiv space.
       else if(space_type == HERMES_HDIV_SPACE)
       {
-        u->val0 = new double[np];
-        u->val1 = new double[np];
-
-        double *fn0 = fu->get_fn_values(0);
-        double *fn1 = fu->get_fn_values(1);
-        double *dx0 = fu->get_dx_values(0);
-        double *dy1 = fu->get_dy_values(1);
-        double2x2 *m;
-        if(rm->is_jacobian_const())
+        // Affine elements: one inverse matrix for all points.
+        double2x2 *mat = rm->is_jacobian_const() ? rm->get_const_inv_ref_map() : rm->get_inv_ref_map(order);
+        int mstep = rm->is_jacobian_const() ? 0 : 1;
+        double2x2 *m = mat;
+        if(demand & H2D_DEMAND_VAL)
         {
-          m = new double2x2[np];
-          double2x2 const_inv_ref_map;
-
-          const_inv_ref_map[0][0] = rm->get_const_inv_ref_map()[0][0][0];
-          const_inv_ref_map[0][1] = rm->get_const_inv_ref_map()[0][0][1];
-          const_inv_ref_map[1][0] = rm->get_const_inv_ref_map()[0][1][0];
-          const_inv_ref_map[1][1] = rm->get_const_inv_ref_map()[0][1][1];
-
-          for(int i = 0; i < np; i++)
+          double *fn0 = fu->get_fn_values(0);
+          double *fn1 = fu->get_fn_values(1);
+          for (int i = 0; i < np; i++, m += mstep)
           {
-            m[i][0][0] = const_inv_ref_map[0][0];
-            m[i][0][1] = const_inv_ref_map[0][1];
-            m[i][1][0] = const_inv_ref_map[1][0];
-            m[i][1][1] = const_inv_ref_map[1][1];
+            u->val0[i] = (  fn0[i] * (*m)[1][1] - fn1[i] * (*m)[1][0]);
+            u->val1[i] = (- fn0[i] * (*m)[0][1] + fn1[i] * (*m)[0][0]);
           }
         }
-        else
-          m = rm->get_inv_ref_map(order);
-        for (int i = 0; i < np; i++, m++)
+        if(demand & H2D_DEMAND_DIV)
         {
-          u->val0[i] = (  fn0[i] * (*m)[1][1] - fn1[i] * (*m)[1][0]);
-          u->val1[i] = (- fn0[i] * (*m)[0][1] + fn1[i] * (*m)[0][0]);
-          u->div[i] = ((*m)[0][0] * (*m)[1][1] - (*m)[1][0] * (*m)[0][1]) * (dx0[i] + dy1[i]);
+          double *dx0 = fu->get_dx_values(0);
+          double *dy1 = fu->get_dy_values(1);
+          m = mat;
+          for (int i = 0; i < np; i++, m += mstep)
+            u->div[i] = ((*m)[0][0] * (*m)[1][1] - (*m)[1][0] * (*m)[0][1]) * (dx0[i] + dy1[i]);
         }
-        m -= np;
-        if(rm->is_jacobian_const())
-          delete [] m;
       }
       else
         throw Hermes::Exceptions::Exception("Wrong space type - space has to be either H1, Hcurl, Hdiv or L2");
@@ -645,128 +810,235 @@ namespace Hermes
       return u;
     }
 
-    template<typename Scalar>
-    Func<Scalar>* init_fn(MeshFunction<Scalar>*fu, const int order)
+    void init_fns(PrecalcShapeset *fu, RefMap *rm, const int order, const int* shape_indices, int count, Func<double>** result, unsigned int demand)
     {
-      // Sanity checks.
-      if(fu == NULL) throw Hermes::Exceptions::Exception("NULL MeshFunction in Func<Scalar>*::init_fn().");
-      if(fu->get_mesh() == NULL) throw Hermes::Exceptions::Exception("Uninitialized MeshFunction used.");
+      SpaceType space_type = fu->get_space_type();
+      if((space_type != HERMES_HCURL_SPACE && space_type != HERMES_HDIV_SPACE) || !rm->is_jacobian_const())
+      {
+        for (int j = 0; j < count; j++)
+        {
+          fu->set_active_shape(shape_indices[j]);
+          result[j] = init_fn(fu, rm, order, demand);
+        }
+        return;
+      }
 
-      int nc = fu->get_num_components();
+      Hermes::ProfilerRegion profiler_region("init_fns");
+      bool hcurl = (space_type == HERMES_HCURL_SPACE);
       Quad2D* quad = fu->get_quad_2d();
-      fu->set_quad_order(order);
-      double3* pt = quad->get_points(order, fu->get_active_element()->get_mode());
-      int np = quad->get_num_points(order, fu->get_active_element()->get_mode());
-      Func<Scalar>* u = new Func<Scalar>(np, nc);
+      int np = quad->get_num_points(order, rm->get_active_element()->get_mode());
 
-      if(u->nc == 1)
+      demand = effective_demand(2, demand & ~(hcurl ? H2D_DEMAND_DIV : H2D_DEMAND_CURL), true);
+      int mask = get_demand_mask(2, demand);
+      bool values = (demand & H2D_DEMAND_VAL) != 0;
+      bool derivative = (demand & (H2D_DEMAND_CURL | H2D_DEMAND_DIV)) != 0;
+
+      // The Piola map: [val0; val1] = P [fn0; fn1], the curl (div) is scaled by the determinant of the inverse map.
+      double2x2& m = *rm->get_const_inv_ref_map();
+      double p00, p01, p10, p11;
+      if(hcurl)
       {
-        u->val = new Scalar[np];
-        u->dx  = new Scalar[np];
-        u->dy  = new Scalar[np];
-        memcpy(u->val, fu->get_fn_values(), np * sizeof(Scalar));
-        memcpy(u->dx, fu->get_dx_values(), np * sizeof(Scalar));
-        memcpy(u->dy, fu->get_dy_values(), np * sizeof(Scalar));
+        p00 = m[0][0]; p01 = m[0][1];
+        p10 = m[1][0]; p11 = m[1][1];
       }
-      else if(u->nc == 2)
+      else
       {
-        u->val0 = new Scalar[np];
-        u->val1 = new Scalar[np];
-        u->curl = new Scalar[np];
-        u->div = new Scalar[np];
+        p00 = m[1][1]; p01 = -m[1][0];
+        p10 = -m[0][1]; p11 = m[0][0];
+      }
+      double det = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+      // curl = dx1 - dy0, div = dx0 + dy1.
+      double sign = hcurl ? -1.0 : 1.0;
 
+      for (int j = 0; j < count; j++)
+      {
+        fu->set_active_shape(shape_indices[j]);
+        fu->set_quad_order(order, mask);
+
+        Func<double>* u = new Func<double>(np, 2);
+        u->allocate_storage(demand);
+
+        if(values)
+        {
+          double *fn0 = fu->get_fn_values(0);
+          double *fn1 = fu->get_fn_values(1);
+          for (int i = 0; i < np; i++)
+          {
+            u->val0[i] = fn0[i] * p00 + fn1[i] * p01;
+            u->val1[i] = fn0[i] * p10 + fn1[i] * p11;
+          }
+        }
+        if(derivative)
+        {
+          double* d = hcurl ? u->curl : u->div;
+          double *d0 = hcurl ? fu->get_dy_values(0) : fu->get_dx_values(0);
+          double *d1 = hcurl ? fu->get_dx_values(1) : fu->get_dy_values(1);
+          for (int i = 0; i < np; i++)
+            d[i] = det * (d1[i] + sign * d0[i]);
+        }
+        result[j] = u;
+      }
+    }
+
+    /// The values, the curl and the div of a vector valued mesh function from the precalculated tables.
+    template<typename Scalar>
+    static void copy_vector_values(MeshFunction<Scalar>* fu, Func<Scalar>* u, unsigned int demand)
+    {
+      int np = u->get_num_gip();
+      if(demand & H2D_DEMAND_VAL)
+      {
         memcpy(u->val0, fu->get_fn_values(0), np * sizeof(Scalar));
         memcpy(u->val1, fu->get_fn_values(1), np * sizeof(Scalar));
-
+      }
+      if(demand & H2D_DEMAND_CURL)
+      {
         Scalar *dx1 = fu->get_dx_values(1);
         Scalar *dy0 = fu->get_dy_values(0);
-        for (int i = 0; i < np; i++) u->curl[i] = dx1[i] - dy0[i];
-
+        for (int i = 0; i < np; i++)
+          u->curl[i] = dx1[i] - dy0[i];
+      }
+      if(demand & H2D_DEMAND_DIV)
+      {
         Scalar *dx0 = fu->get_dx_values(0);
         Scalar *dy1 = fu->get_dy_values(1);
-        for (int i = 0; i < np; i++) u->div[i] = dx0[i] + dy1[i];
+        for (int i = 0; i < np; i++)
+          u->div[i] = dx0[i] + dy1[i];
       }
-      return u;
     }
 
     template<typename Scalar>
-    Func<Scalar>* init_fn(Solution<Scalar>*fu, const int order)
+    Func<Scalar>* init_fn(MeshFunction<Scalar>*fu, const int order, unsigned int demand)
     {
+      Hermes::ProfilerRegion profiler_region("init_fn");
       // Sanity checks.
       if(fu == NULL) throw Hermes::Exceptions::Exception("NULL MeshFunction in Func<Scalar>*::init_fn().");
       if(fu->get_mesh() == NULL) throw Hermes::Exceptions::Exception("Uninitialized MeshFunction used.");
 
-      SpaceType space_type = fu->get_space_type();
-      SolutionType sln_type = fu->get_type();
+      int nc = fu->get_num_components();
+      Quad2D* quad = fu->get_quad_2d();
+      // The laplace is calculated only for the Solutions (init_fn(Solution*)).
+      demand = effective_demand(nc, demand, false);
+      fu->set_quad_order(order, get_demand_mask(nc, demand));
+      int np = quad->get_num_points(order, fu->get_active_element()->get_mode());
+      Func<Scalar>* u = new Func<Scalar>(np, nc);
+      u->allocate_storage(demand);
+
+      if(u->nc == 1)
+      {
+        if(demand & H2D_DEMAND_VAL)
+          memcpy(u->val, fu->get_fn_values(), np * sizeof(Scalar));
+        if(demand & H2D_DEMAND_GRAD)
+        {
+          memcpy(u->dx, fu->get_dx_values(), np * sizeof(Scalar));
+          memcpy(u->dy, fu->get_dy_values(), np * sizeof(Scalar));
+        }
+      }
+      else if(u->nc == 2)
+        copy_vector_values(fu, u, demand);
+      return u;
+    }
+
+    template<typename Scalar>
+    Func<Scalar>* init_fn(MeshFunction<Scalar>*fu, const int order)
+    {
+      return init_fn(fu, order, H2D_DEMAND_DEFAULT);
+    }
+
+    template<typename Scalar>
+    Func<Scalar>* init_fn(Solution<Scalar>*fu, const int order, unsigned int demand)
+    {
+      // Sanity checks.
+      if(fu == NULL) throw Hermes::Exceptions::Exception("NULL MeshFunction in Func<Scalar>*::init_fn().");
+      if(fu->get_mesh() == NULL) throw Hermes::Exceptions::Exception("Uninitialized MeshFunction used.");
 
       int nc = fu->get_num_components();
       Quad2D* quad = fu->get_quad_2d();
-#ifdef H2D_USE_SECOND_DERIVATIVES
-      if(space_type == HERMES_H1_SPACE && sln_type != HERMES_EXACT)
-        fu->set_quad_order(order, H2D_FN_ALL);
-      else
-        fu->set_quad_order(order);
-#else
-        fu->set_quad_order(order);
-#endif
-      double3* pt = quad->get_points(order, fu->get_active_element()->get_mode());
+      // The second derivatives are transformed only for the H1 solutions (not the exact ones).
+      demand = effective_demand(nc, demand, fu->get_space_type() == HERMES_H1_SPACE && fu->get_type() != HERMES_EXACT);
+      fu->set_quad_order(order, get_demand_mask(nc, demand));
       int np = quad->get_num_points(order, fu->get_active_element()->get_mode());
       Func<Scalar>* u = new Func<Scalar>(np, nc);
+      u->allocate_storage(demand);
 
       if(u->nc == 1)
       {
-        u->val = new Scalar[np];
-        u->dx  = new Scalar[np];
-        u->dy  = new Scalar[np];
-        
-#ifdef H2D_USE_SECOND_DERIVATIVES
-        if(space_type == HERMES_H1_SPACE && sln_type != HERMES_EXACT)
-          u->laplace = new Scalar[np];
-#endif
-
-        memcpy(u->val, fu->get_fn_values(), np * sizeof(Scalar));
-        memcpy(u->dx, fu->get_dx_values(), np * sizeof(Scalar));
-        memcpy(u->dy, fu->get_dy_values(), np * sizeof(Scalar));
-
-#ifdef H2D_USE_SECOND_DERIVATIVES
-        if(space_type == HERMES_H1_SPACE && sln_type != HERMES_EXACT)
+        if(demand & H2D_DEMAND_VAL)
+          memcpy(u->val, fu->get_fn_values(), np * sizeof(Scalar));
+        if(demand & H2D_DEMAND_GRAD)
+        {
+          memcpy(u->dx, fu->get_dx_values(), np * sizeof(Scalar));
+          memcpy(u->dy, fu->get_dy_values(), np * sizeof(Scalar));
+        }
+        if(demand & H2D_DEMAND_LAPLACE)
         {
           Scalar *dxx = fu->get_dxx_values();
           Scalar *dyy = fu->get_dyy_values();
           for (int i = 0; i < np; i++)
             u->laplace[i] = dxx[i] + dyy[i];
         }
-#endif
       }
       else if(u->nc == 2)
-      {
-        u->val0 = new Scalar[np];
-        u->val1 = new Scalar[np];
-        u->curl = new Scalar[np];
-        u->div = new Scalar[np];
-
-        memcpy(u->val0, fu->get_fn_values(0), np * sizeof(Scalar));
-        memcpy(u->val1, fu->get_fn_values(1), np * sizeof(Scalar));
-
-        Scalar *dx1 = fu->get_dx_values(1);
-        Scalar *dy0 = fu->get_dy_values(0);
-        for (int i = 0; i < np; i++) 
-          u->curl[i] = dx1[i] - dy0[i];
-
-        Scalar *dx0 = fu->get_dx_values(0);
-        Scalar *dy1 = fu->get_dy_values(1);
-        for (int i = 0; i < np; i++) 
-          u->div[i] = dx0[i] + dy1[i];
-      }
+        copy_vector_values(fu, u, demand);
       return u;
     }
 
+    template<typename Scalar>
+    Func<Scalar>* init_fn(Solution<Scalar>*fu, const int order)
+    {
+      return init_fn(fu, order, H2D_DEMAND_DEFAULT);
+    }
+
+    template Func<double>* init_fn(MeshFunction<double>*fu, const int order, unsigned int demand);
+    template Func<std::complex<double> >* init_fn(MeshFunction<std::complex<double> >*fu, const int order, unsigned int demand);
+
+    template HERMES_API Func<double>* init_fn(Solution<double>*fu, const int order, unsigned int demand);
+    template HERMES_API Func<std::complex<double> >* init_fn(Solution<std::complex<double> >*fu, const int order, unsigned int demand);
     template Func<double>* init_fn(MeshFunction<double>*fu, const int order);
     template Func<std::complex<double> >* init_fn(MeshFunction<std::complex<double> >*fu, const int order);
-
     template HERMES_API Func<double>* init_fn(Solution<double>*fu, const int order);
     template HERMES_API Func<std::complex<double> >* init_fn(Solution<std::complex<double> >*fu, const int order);
 
+    template<typename Scalar>
+    Scalar int_fn_products(int n, const double* wt, Func<Scalar>* fn, const Scalar* u1, const double* v1, const Scalar* u2, const double* v2)
+    {
+      Scalar result = 0.0;
+      if(u2 == NULL || v2 == NULL)
+        for(int i = 0; i < n; i++)
+          result += wt[i] * u1[i] * v1[i];
+      else
+        for(int i = 0; i < n; i++)
+          result += wt[i] * (u1[i] * v1[i] + u2[i] * v2[i]);
+      return result;
+    }
+
+    template<>
+    std::complex<double> int_fn_products(int n, const double* wt, Func<std::complex<double> >* fn, const std::complex<double>* u1, const double* v1, const std::complex<double>* u2, const double* v2)
+    {
+      const double* re1, *im1;
+      fn->get_split(u1, re1, im1);
+      double result_re = 0.0, result_im = 0.0;
+      if(u2 == NULL || v2 == NULL)
+        for(int i = 0; i < n; i++)
+        {
+          double w = wt[i] * v1[i];
+          result_re += w * re1[i];
+          result_im += w * im1[i];
+        }
+      else
+      {
+        const double* re2, *im2;
+        fn->get_split(u2, re2, im2);
+        for(int i = 0; i < n; i++)
+        {
+          result_re += wt[i] * (re1[i] * v1[i] + re2[i] * v2[i]);
+          result_im += wt[i] * (im1[i] * v1[i] + im2[i] * v2[i]);
+        }
+      }
+      return std::complex<double>(result_re, result_im);
+    }
+
+    template HERMES_API double int_fn_products(int n, const double* wt, Func<double>* fn, const double* u1, const double* v1, const double* u2, const double* v2);
+
     template class HERMES_API Func<Hermes::Ord>;
     template class HERMES_API Func<double>;
     template class HERMES_API Func<std::complex<double> >;
@@ -47,6 +47,16 @@ namespace Hermes
       return 1;
     }
 
+    template<typename Scalar>
+    void ExactSolutionScalar<Scalar>::exact_function_batch(int n, const double* x, const double* y, Scalar* val, Scalar* dx, Scalar* dy) const
+    {
+      for (int i = 0; i < n; i++)
+      {
+        dx[i] = dy[i] = 0.0;
+        val[i] = exact_function(x[i], y[i], dx[i], dy[i]);
+      }
+    }
+
     template<typename Scalar>
     ExactSolutionVector<Scalar>::ExactSolutionVector(const Mesh* mesh) : ExactSolution<Scalar>(mesh)
     {
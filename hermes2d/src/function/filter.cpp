@@ -104,13 +104,7 @@ namespace Hermes
       }
 
       if(unimesh)
-      {
-        Traverse trav;
-        trav.begin(num, meshes);
-        this->mesh = new Mesh;
-        unidata = trav.construct_union_mesh(const_cast<Hermes2D::Mesh*>(this->mesh));
-        trav.finish();
-      }
+        this->mesh = Traverse::get_union_mesh(num, meshes, unidata);
 
       // misc init
       this->num_components = 1;
@@ -193,10 +187,8 @@ namespace Hermes
 
       if(unimesh)
       {
-        delete this->mesh;
-        for (int i = 0; i < num; i++)
-          ::free(unidata[i]);
-        delete [] unidata;
+        Traverse::release_union_mesh(const_cast<Mesh*>(this->mesh));
+        unimesh = false;
       }
     }
 
@@ -886,6 +878,110 @@ namespace Hermes
       return filter;
     }
 
+    template<typename Scalar>
+    CompositeFilter<Scalar>::CompositeFilter(Hermes::vector<MeshFunction<Scalar>*> solutions, Hermes::vector<int> items)
+      : SimpleFilter<Scalar>(solutions, items), output(-1)
+    {
+    }
+
+    template<typename Scalar>
+    CompositeFilter<Scalar>::~CompositeFilter()
+    {
+    }
+
+    template<typename Scalar>
+    MeshFunction<Scalar>* CompositeFilter<Scalar>::clone() const
+    {
+      Hermes::vector<MeshFunction<Scalar>*> slns;
+      Hermes::vector<int> items;
+      for(int i = 0; i < this->num; i++)
+      {
+        slns.push_back(this->sln[i]->clone());
+        items.push_back(this->item[i]);
+      }
+      CompositeFilter<Scalar>* filter = new CompositeFilter<Scalar>(slns, items);
+      filter->operations = this->operations;
+      filter->output = this->output;
+      filter->setDeleteSolutions();
+      return filter;
+    }
+
+    template<typename Scalar>
+    typename CompositeFilter<Scalar>::Expr CompositeFilter<Scalar>::input(int i)
+    {
+      if(i < 0 || i >= this->num)
+        throw Hermes::Exceptions::ValueException("i", i, 0, this->num - 1);
+      return add_operation(Expr::Input, i);
+    }
+
+    template<typename Scalar>
+    typename CompositeFilter<Scalar>::Expr CompositeFilter<Scalar>::constant(Scalar value)
+    {
+      Expr expr = add_operation(Expr::Constant, -1);
+      this->operations.back().value = value;
+      return expr;
+    }
+
+    template<typename Scalar>
+    typename CompositeFilter<Scalar>::Expr CompositeFilter<Scalar>::add_operation(typename Expr::OperationType type, int a, int b)
+    {
+      Operation operation;
+      operation.type = type;
+      operation.a = a;
+      operation.b = b;
+      operation.value = 0.0;
+      this->operations.push_back(operation);
+      return Expr(this, this->operations.size() - 1);
+    }
+
+    template<typename Scalar>
+    void CompositeFilter<Scalar>::set_expression(const Expr& expression)
+    {
+      if(expression.filter != this)
+        throw Hermes::Exceptions::Exception("CompositeFilter: the expression was built on a different filter.");
+      this->output = expression.index;
+    }
+
+    template<typename Scalar>
+    void CompositeFilter<Scalar>::filter_fn(int n, Hermes::vector<Scalar*> values, Scalar* result)
+    {
+      if(this->output < 0)
+        throw Hermes::Exceptions::Exception("CompositeFilter: no expression set, call set_expression() first.");
+
+      // Only the nodes up to the output one can contribute to it.
+      int num_operations = this->output + 1;
+      const Operation* ops = &this->operations.front();
+      Scalar* regs = new Scalar[num_operations];
+      Scalar** inputs = new Scalar*[this->num];
+      for (int j = 0; j < this->num; j++)
+        inputs[j] = values.at(j);
+
+      for (int i = 0; i < n; i++)
+      {
+        for (int k = 0; k < num_operations; k++)
+        {
+          const Operation& op = ops[k];
+          switch(op.type)
+          {
+          case Expr::Input: regs[k] = inputs[op.a][i]; break;
+          case Expr::Constant: regs[k] = op.value; break;
+          case Expr::Add: regs[k] = regs[op.a] + regs[op.b]; break;
+          case Expr::Sub: regs[k] = regs[op.a] - regs[op.b]; break;
+          case Expr::Mul: regs[k] = regs[op.a] * regs[op.b]; break;
+          case Expr::Div: regs[k] = regs[op.a] / regs[op.b]; break;
+          case Expr::Neg: regs[k] = -regs[op.a]; break;
+          case Expr::Sqr: regs[k] = regs[op.a] * regs[op.a]; break;
+          case Expr::Sqrt: regs[k] = std::sqrt(regs[op.a]); break;
+          case Expr::Abs: regs[k] = std::abs(regs[op.a]); break;
+          }
+        }
+        result[i] = regs[this->output];
+      }
+
+      delete [] inputs;
+      delete [] regs;
+    }
+
     template<>
     void SquareFilter<double>::filter_fn(int n, Hermes::vector<double *> v1, double* result)
     {
@@ -1037,7 +1133,7 @@ namespace Hermes
     {
     }
 
-    void AngleFilter::filter_fn(int n, Hermes::vector<std::complex<double>*> v1, double* result)
+    void AngleFilter::filter_fn(int n, Hermes::vector<std::complex<double>*> v1, std::complex<double>* result)
     {
       for (int i = 0; i < n; i++)
         result[i] = atan2( v1.at(0)[i].imag(), v1.at(0)[i].real() );
@@ -1047,13 +1143,24 @@ namespace Hermes
       : SimpleFilter<std::complex<double> >(solutions, items)
     {
       if(solutions.size() > 1)
-        throw Hermes::Exceptions::Exception("RealFilter only supports one MeshFunction.");
+        throw Hermes::Exceptions::Exception("AngleFilter only supports one MeshFunction.");
     };
 
     AngleFilter::~AngleFilter()
     {
     }
 
+    MeshFunction<std::complex<double> >* AngleFilter::clone() const
+    {
+      Hermes::vector<MeshFunction<std::complex<double> >*> slns;
+      Hermes::vector<int> items;
+      slns.push_back(this->sln[0]->clone());
+      items.push_back(this->item[0]);
+      AngleFilter* filter = new AngleFilter(slns, items);
+      filter->setDeleteSolutions();
+      return filter;
+    }
+
     void VonMisesFilter::precalculate(int order, int mask)
     {
       if(mask & (H2D_FN_DX | H2D_FN_DY | H2D_FN_DXX | H2D_FN_DYY | H2D_FN_DXY))
@@ -1132,6 +1239,7 @@ namespace Hermes
       for(int i = 0; i < num; i++)
         slns[i] = sln[i]->clone();
       VonMisesFilter* filter = new VonMisesFilter(slns, num, lambda, mu, cyl, item1, item2);
+      delete [] slns;
       filter->setDeleteSolutions();
       return filter;
     }
@@ -1190,8 +1298,9 @@ namespace Hermes
     }
 
     template<typename Scalar>
-    LinearFilter<Scalar>::LinearFilter(MeshFunction<Scalar>* old) // : Filter(old)
+    LinearFilter<Scalar>::LinearFilter(MeshFunction<Scalar>* old) : Filter<Scalar>(&old, 1)
     {
+      this->tau_frac = 1;
       init_components();
     }
 
@@ -1217,6 +1326,18 @@ namespace Hermes
           throw Hermes::Exceptions::Exception("Filter: Solutions do not have the same number of components!");
     }
 
+    template<typename Scalar>
+    MeshFunction<Scalar>* LinearFilter<Scalar>::clone() const
+    {
+      LinearFilter<Scalar>* filter;
+      if(this->num == 2)
+        filter = new LinearFilter<Scalar>(this->sln[0]->clone(), this->sln[1]->clone(), this->tau_frac);
+      else
+        filter = new LinearFilter<Scalar>(this->sln[0]->clone());
+      filter->setDeleteSolutions();
+      return filter;
+    }
+
     template<typename Scalar>
     void LinearFilter<Scalar>::set_active_element(Element* e)
     {
@@ -1246,5 +1367,9 @@ namespace Hermes
     template class HERMES_API SumFilter<std::complex<double> >;
     template class HERMES_API SquareFilter<double>;
     template class HERMES_API SquareFilter<std::complex<double> >;
+    template class HERMES_API CompositeFilter<double>;
+    template class HERMES_API CompositeFilter<std::complex<double> >;
+    template class HERMES_API LinearFilter<double>;
+    template class HERMES_API LinearFilter<std::complex<double> >;
   }
 }
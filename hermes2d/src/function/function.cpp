@@ -45,7 +45,6 @@ namespace Hermes
       cur_node = NULL;
       sub_tables = NULL;
       nodes = NULL;
-      overflow_nodes = NULL;
       memset(quads, 0, sizeof(quads));
     }
 
@@ -216,13 +215,10 @@ namespace Hermes
     template<typename Scalar>
     void Function<Scalar>::update_nodes_ptr()
     {
-      if(sub_idx > H2D_MAX_IDX)
-        handle_overflow_idx();
-      else {
-        if(sub_tables->find(sub_idx) == sub_tables->end())
-          sub_tables->insert(std::pair<uint64_t, LightArray<Node*>*>(sub_idx, new LightArray<Node*>));
-        nodes = sub_tables->find(sub_idx)->second;
-      }
+      // Every sub-element has its own index (Transformable::get_son_idx()), the tables of all of them are kept.
+      if(sub_tables->find(sub_idx) == sub_tables->end())
+        sub_tables->insert(std::pair<uint64_t, LightArray<Node*>*>(sub_idx, new LightArray<Node*>));
+      nodes = sub_tables->find(sub_idx)->second;
     }
 
     template<typename Scalar>
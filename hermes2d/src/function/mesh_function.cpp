@@ -14,8 +14,10 @@
 // along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "mesh_function.h"
+#include "forms.h"
 #include "../views/linearizer_base.h"
 #include <limits>
+#include <algorithm>
 
 namespace Hermes
 {
@@ -42,13 +44,6 @@ namespace Hermes
     MeshFunction<Scalar>::~MeshFunction()
     {
       delete refmap;
-      if(this->overflow_nodes != NULL)
-      {
-        for(unsigned int i = 0; i < this->overflow_nodes->get_size(); i++)
-          if(this->overflow_nodes->present(i))
-            ::free(this->overflow_nodes->get(i));
-        delete this->overflow_nodes;
-      }
     }
     
     template<typename Scalar>
@@ -188,6 +183,98 @@ namespace Hermes
       this->warn("Asked for a min value of a complex function.");
     }
 
+    template<typename Scalar>
+    void MeshFunction<Scalar>::locate_points(const double* x, const double* y, int n, Element** elements, double* xi1, double* xi2, int* point_order)
+    {
+      const ElementGrid* grid = this->mesh->get_element_grid();
+
+      // Go through the points by the grid cells, trying the element of the previous point first.
+      std::pair<int, int>* sorted = new std::pair<int, int>[n];
+      for (int i = 0; i < n; i++)
+        sorted[i] = std::make_pair(grid->get_cell(x[i], y[i]), i);
+      std::sort(sorted, sorted + n);
+
+      Element* e = NULL;
+      for (int k = 0; k < n; k++)
+      {
+        int i = sorted[k].second;
+        if(e == NULL || !RefMap::is_element_on_physical_coordinates(e, x[i], y[i], xi1 + i, xi2 + i))
+          e = RefMap::element_on_physical_coordinates(this->mesh, x[i], y[i], xi1 + i, xi2 + i);
+        elements[i] = e;
+      }
+
+      // Group the points by the elements.
+      for (int i = 0; i < n; i++)
+        sorted[i] = std::make_pair(elements[i] == NULL ? -1 : elements[i]->id, i);
+      std::sort(sorted, sorted + n);
+      for (int k = 0; k < n; k++)
+        point_order[k] = sorted[k].second;
+
+      delete [] sorted;
+    }
+
+    template<typename Scalar>
+    void MeshFunction<Scalar>::get_pt_values(const double* x, const double* y, int n, Func<Scalar>** values)
+    {
+      Element** elements = new Element*[n];
+      double* xi = new double[2 * n];
+      int* point_order = new int[n];
+      locate_points(x, y, n, elements, xi, xi + n, point_order);
+
+      for (int k = 0; k < n; k++)
+      {
+        int i = point_order[k];
+        values[i] = (elements[i] == NULL) ? NULL : this->get_pt_value(x[i], y[i], elements[i]);
+      }
+
+      delete [] elements;
+      delete [] xi;
+      delete [] point_order;
+    }
+
+    template<typename Scalar>
+    int MeshFunction<Scalar>::get_pt_values(const double* x, const double* y, int n, Scalar* val, Scalar* dx, Scalar* dy, int component)
+    {
+      Element** elements = new Element*[n];
+      double* xi = new double[2 * n];
+      int* point_order = new int[n];
+      locate_points(x, y, n, elements, xi, xi + n, point_order);
+
+      int found = 0;
+      for (int k = 0; k < n; k++)
+      {
+        int i = point_order[k];
+        Scalar v = 0.0, vx = 0.0, vy = 0.0;
+        if(elements[i] != NULL)
+        {
+          Func<Scalar>* f = this->get_pt_value(x[i], y[i], elements[i]);
+          found++;
+          if(this->num_components == 1)
+          {
+            if(f->val != NULL) v = f->val[0];
+            if(f->dx != NULL) vx = f->dx[0];
+            if(f->dy != NULL) vy = f->dy[0];
+          }
+          else
+          {
+            if((component ? f->val1 : f->val0) != NULL) v = (component ? f->val1 : f->val0)[0];
+            if((component ? f->dx1 : f->dx0) != NULL) vx = (component ? f->dx1 : f->dx0)[0];
+            if((component ? f->dy1 : f->dy0) != NULL) vy = (component ? f->dy1 : f->dy0)[0];
+          }
+          f->free_fn();
+          delete f;
+        }
+        if(val != NULL) val[i] = v;
+        if(dx != NULL) dx[i] = vx;
+        if(dy != NULL) dy[i] = vy;
+      }
+
+      delete [] elements;
+      delete [] xi;
+      delete [] point_order;
+      return found;
+    }
+
     template<typename Scalar>
     int MeshFunction<Scalar>::get_edge_fn_order(int edge)
     {
@@ -233,19 +320,6 @@ namespace Hermes
       Function<Scalar>::reset_transform();
     }
 
-    template<typename Scalar>
-    void MeshFunction<Scalar>::handle_overflow_idx()
-    {
-      if(this->overflow_nodes != NULL) {
-        for(unsigned int i = 0; i < this->overflow_nodes->get_size(); i++)
-          if(this->overflow_nodes->present(i))
-            ::free(this->overflow_nodes->get(i));
-        delete this->overflow_nodes;
-      }
-      this->nodes = new LightArray<typename Function<Scalar>::Node *>;
-      this->overflow_nodes = this->nodes;
-    }
-
     template<typename Scalar>
     void MeshFunction<Scalar>::push_transform(int son)
     {
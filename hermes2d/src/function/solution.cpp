@@ -19,10 +19,23 @@
 #include "solution_h2d_xml.h"
 #include "ogprojection.h"
 #include "api2d.h"
+#include "cache_statistics.h"
 
 #include <iostream>
+#include <fstream>
 #include <algorithm>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+
 namespace Hermes
 {
   namespace Hermes2D
@@ -98,13 +111,13 @@ namespace Hermes
       this->num_components = 0;
       e_last = NULL;
 
-      for(int i = 0; i < 4; i++)
-        for(int j = 0; j < 4; j++)
-          tables[i][j] = new std::map<uint64_t, LightArray<struct Function<double>::Node*>*>;
+      element_cache_size = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::solutionElementCacheSize);
+      element_cache_hits = element_cache_misses = 0;
 
       mono_coeffs = NULL;
       elem_coeffs[0] = elem_coeffs[1] = NULL;
       elem_orders = NULL;
+      coeffs_refs = NULL;
       dxdy_buffer = NULL;
       num_coeffs = num_elems = 0;
       num_dofs = -1;
@@ -123,13 +136,13 @@ namespace Hermes
 			this->num_components = 0;
 			e_last = NULL;
 
-			for(int i = 0; i < 4; i++)
-				for(int j = 0; j < 4; j++)
-					tables[i][j] = new std::map<uint64_t, LightArray<struct Function<std::complex<double> >::Node*>*>;
+			element_cache_size = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::solutionElementCacheSize);
+			element_cache_hits = element_cache_misses = 0;
 
 			mono_coeffs = NULL;
 			elem_coeffs[0] = elem_coeffs[1] = NULL;
 			elem_orders = NULL;
+			coeffs_refs = NULL;
 			dxdy_buffer = NULL;
 			num_coeffs = num_elems = 0;
 			num_dofs = -1;
@@ -139,7 +152,7 @@ namespace Hermes
 
     template<>
     Solution<double>::Solution()
-        : MeshFunction<double>()
+        : MeshFunction<double>(), Mixins::MemoryAccounted(Mixins::H2D_MEMORY_SOLUTION)
     {
       space_type = HERMES_INVALID_SPACE;
       this->init();
@@ -147,14 +160,14 @@ namespace Hermes
 
     template<>
     Solution<std::complex<double> >::Solution()
-        : MeshFunction<std::complex<double> >()
+        : MeshFunction<std::complex<double> >(), Mixins::MemoryAccounted(Mixins::H2D_MEMORY_SOLUTION)
     {
       space_type = HERMES_INVALID_SPACE;
       this->init();
     }
 
     template<>
-    Solution<double>::Solution(const Mesh *mesh) : MeshFunction<double>(mesh)
+    Solution<double>::Solution(const Mesh *mesh) : MeshFunction<double>(mesh), Mixins::MemoryAccounted(Mixins::H2D_MEMORY_SOLUTION)
     {
       space_type = HERMES_INVALID_SPACE;
       this->init();
@@ -162,7 +175,7 @@ namespace Hermes
     }
 
     template<>
-    Solution<std::complex<double> >::Solution(const Mesh *mesh) : MeshFunction<std::complex<double> >(mesh)
+    Solution<std::complex<double> >::Solution(const Mesh *mesh) : MeshFunction<std::complex<double> >(mesh), Mixins::MemoryAccounted(Mixins::H2D_MEMORY_SOLUTION)
     {
       space_type = HERMES_INVALID_SPACE;
       this->init();
@@ -170,7 +183,7 @@ namespace Hermes
     }
 
     template<>
-    Solution<double>::Solution(Space<double>* s, Vector<double>* coeff_vec) : MeshFunction<double>(s->get_mesh())
+    Solution<double>::Solution(Space<double>* s, Vector<double>* coeff_vec) : MeshFunction<double>(s->get_mesh()), Mixins::MemoryAccounted(Mixins::H2D_MEMORY_SOLUTION)
     {
       space_type = s->get_type();
       this->init();
@@ -179,7 +192,7 @@ namespace Hermes
     }
 
     template<>
-    Solution<std::complex<double> >::Solution(Space<std::complex<double> >* s, Vector<std::complex<double> >* coeff_vec) : MeshFunction<std::complex<double> >(s->get_mesh())
+    Solution<std::complex<double> >::Solution(Space<std::complex<double> >* s, Vector<std::complex<double> >* coeff_vec) : MeshFunction<std::complex<double> >(s->get_mesh()), Mixins::MemoryAccounted(Mixins::H2D_MEMORY_SOLUTION)
     {
       space_type = s->get_type();
       this->init();
@@ -188,7 +201,7 @@ namespace Hermes
     }
 
     template<>
-    Solution<double>::Solution(Space<double>* s, double* coeff_vec) : MeshFunction<double>(s->get_mesh())
+    Solution<double>::Solution(Space<double>* s, double* coeff_vec) : MeshFunction<double>(s->get_mesh()), Mixins::MemoryAccounted(Mixins::H2D_MEMORY_SOLUTION)
     {
       space_type = s->get_type();
       this->init();
@@ -197,7 +210,7 @@ namespace Hermes
     }
 
     template<>
-    Solution<std::complex<double> >::Solution(Space<std::complex<double> >* s, std::complex<double> * coeff_vec) : MeshFunction<std::complex<double> >(s->get_mesh())
+    Solution<std::complex<double> >::Solution(Space<std::complex<double> >* s, std::complex<double> * coeff_vec) : MeshFunction<std::complex<double> >(s->get_mesh()), Mixins::MemoryAccounted(Mixins::H2D_MEMORY_SOLUTION)
     {
       space_type = s->get_type();
       this->init();
@@ -221,6 +234,7 @@ namespace Hermes
       elem_coeffs[0] = sln->elem_coeffs[0];  sln->elem_coeffs[0] = NULL;
       elem_coeffs[1] = sln->elem_coeffs[1];  sln->elem_coeffs[1] = NULL;
       elem_orders = sln->elem_orders;      sln->elem_orders = NULL;
+      coeffs_refs = sln->coeffs_refs;      sln->coeffs_refs = NULL;
       dxdy_buffer = sln->dxdy_buffer;      sln->dxdy_buffer = NULL;
       num_coeffs = sln->num_coeffs;          sln->num_coeffs = 0;
       num_elems = sln->num_elems;          sln->num_elems = 0;
@@ -228,7 +242,7 @@ namespace Hermes
       sln_type = sln->sln_type;
       this->num_components = sln->num_components;
 
-      memset(sln->tables, 0, sizeof(sln->tables));
+      sln->free_tables();
     }
 
     template<typename Scalar>
@@ -238,28 +252,31 @@ namespace Hermes
       free();
 
       this->mesh = sln->mesh;
+      // The per-thread clones used in assembling keep the cache size of the original.
+      element_cache_size = sln->element_cache_size;
 
       sln_type = sln->sln_type;
       space_type = sln->get_space_type();
       this->num_components = sln->num_components;
       num_dofs = sln->num_dofs;
 
-      if(sln->sln_type == HERMES_SLN) // standard solution: copy coefficient arrays
+      if(sln->sln_type == HERMES_SLN) // standard solution: share coefficient arrays
       {
         num_coeffs = sln->num_coeffs;
         num_elems = sln->num_elems;
 
-        mono_coeffs = new Scalar[num_coeffs];
-        memcpy(mono_coeffs, sln->mono_coeffs, sizeof(Scalar) * num_coeffs);
-
-        for (int l = 0; l < this->num_components; l++)
+#pragma omp critical (solution_coeffs_refs)
         {
-          elem_coeffs[l] = new int[num_elems];
-          memcpy(elem_coeffs[l], sln->elem_coeffs[l], sizeof(int) * num_elems);
+          if(sln->coeffs_refs == NULL)
+            sln->coeffs_refs = new int(1);
+          (*sln->coeffs_refs)++;
         }
+        coeffs_refs = sln->coeffs_refs;
 
-        elem_orders = new int[num_elems];
-        memcpy(elem_orders, sln->elem_orders, sizeof(int) * num_elems);
+        mono_coeffs = sln->mono_coeffs;
+        for (int l = 0; l < this->num_components; l++)
+          elem_coeffs[l] = sln->elem_coeffs[l];
+        elem_orders = sln->elem_orders;
 
         init_dxdy_buffer();
       }
@@ -269,6 +286,13 @@ namespace Hermes
       this->element = NULL;
     }
 
+    template<typename Scalar>
+    void Solution<Scalar>::copy(const Solution<Scalar>* sln, const Mesh* mesh)
+    {
+      copy(sln);
+      this->mesh = mesh;
+    }
+
     template<typename Scalar>
     MeshFunction<Scalar>* Solution<Scalar>::clone() const
     {
@@ -280,35 +304,183 @@ namespace Hermes
     template<typename Scalar>
     void Solution<Scalar>::free_tables()
     {
-      for (int i = 0; i < 4; i++)
-        for (int j = 0; j < 4; j++)
-          if(tables[i][j] != NULL)
-          {
-            for(typename std::map<uint64_t, LightArray<struct Function<Scalar>::Node*>*>::iterator it = tables[i][j]->begin(); it != tables[i][j]->end(); it++)
+      for (int i = 0; i < H2D_MAX_QUADRATURES; i++)
+      {
+        if(tables[i] != NULL)
+        {
+          for (int j = 0; j < element_cache_size; j++)
+            if(tables[i][j] != NULL)
             {
-              for(unsigned int l = 0; l < it->second->get_size(); l++)
-                if(it->second->present(l))
-                  ::free(it->second->get(l));
-              delete it->second;
+              for(typename std::map<uint64_t, LightArray<struct Function<Scalar>::Node*>*>::iterator it = tables[i][j]->begin(); it != tables[i][j]->end(); it++)
+              {
+                for(unsigned int l = 0; l < it->second->get_size(); l++)
+                  if(it->second->present(l))
+                  {
+                    CacheStatistics::add_bytes(H2D_CACHE_SOLUTION, -it->second->get(l)->size);
+                    ::free(it->second->get(l));
+                  }
+                delete it->second;
+              }
+              tables[i][j]->clear();
+              delete tables[i][j];
             }
-            tables[i][j]->clear();
-            delete tables[i][j];
-            tables[i][j] = NULL;
-            elems[i][j] = NULL;
-          }
+          delete [] tables[i];
+          tables[i] = NULL;
+        }
+        if(elems[i] != NULL)
+        {
+          delete [] elems[i];
+          elems[i] = NULL;
+        }
+        oldest[i] = 0;
+      }
+    }
+
+    template<typename Scalar>
+    void Solution<Scalar>::set_element_cache_size(int size)
+    {
+      if(size < 1)
+        throw Hermes::Exceptions::ValueException("size", size, 1);
+      if(size == element_cache_size)
+        return;
+      free_tables();
+      element_cache_size = size;
+      this->element = NULL;
+    }
+
+    template<typename Scalar>
+    int Solution<Scalar>::get_element_cache_size() const
+    {
+      return element_cache_size;
+    }
+
+    template<typename Scalar>
+    unsigned long Solution<Scalar>::get_element_cache_hits() const
+    {
+      return element_cache_hits;
+    }
+
+    template<typename Scalar>
+    unsigned long Solution<Scalar>::get_element_cache_misses() const
+    {
+      return element_cache_misses;
+    }
+
+    std::size_t SolutionMemoryUsage::get_total() const
+    {
+      return coefficients + tables + auxiliary;
+    }
+
+    template<typename Scalar>
+    SolutionMemoryUsage Solution<Scalar>::get_memory_usage() const
+    {
+      SolutionMemoryUsage usage;
+      usage.coefficients = 0;
+      if(mono_coeffs != NULL)
+        usage.coefficients += num_coeffs * sizeof(Scalar);
+      if(elem_orders != NULL)
+        usage.coefficients += num_elems * sizeof(int);
+      for(int l = 0; l < H2D_MAX_SOLUTION_COMPONENTS; l++)
+        if(elem_coeffs[l] != NULL)
+          usage.coefficients += num_elems * sizeof(int);
+      if(coeffs_refs != NULL && *coeffs_refs > 1)
+        usage.coefficients /= *coeffs_refs;
+
+      usage.tables = 0;
+      for (int i = 0; i < H2D_MAX_QUADRATURES; i++)
+        if(tables[i] != NULL)
+        {
+          usage.tables += element_cache_size * (sizeof(void*) + sizeof(Element*));
+          for (int j = 0; j < element_cache_size; j++)
+            if(tables[i][j] != NULL)
+              for(typename std::map<uint64_t, LightArray<struct Function<Scalar>::Node*>*>::const_iterator it = tables[i][j]->begin(); it != tables[i][j]->end(); it++)
+                for(unsigned int l = 0; l < it->second->get_size(); l++)
+                  if(it->second->present(l))
+                    usage.tables += it->second->get(l)->size;
+        }
+
+      usage.auxiliary = (dxdy_buffer != NULL) ? this->num_components * 5 * 121 * sizeof(Scalar) : 0;
+      return usage;
+    }
+
+    template<typename Scalar>
+    std::size_t Solution<Scalar>::get_total_memory_usage() const
+    {
+      return this->get_memory_usage().get_total();
+    }
+
+    template<typename Scalar>
+    void Solution<Scalar>::reset_element_cache_statistics()
+    {
+      element_cache_hits = element_cache_misses = 0;
+    }
+
+    template<typename Scalar>
+    void Solution<Scalar>::free_coeffs()
+    {
+      bool last_owner = true;
+      if(coeffs_refs != NULL)
+      {
+#pragma omp critical (solution_coeffs_refs)
+        last_owner = (--(*coeffs_refs) == 0);
+        if(last_owner)
+          delete coeffs_refs;
+        coeffs_refs = NULL;
+      }
+
+      if(last_owner)
+      {
+        if(mono_coeffs != NULL)
+          delete [] mono_coeffs;
+        if(elem_orders != NULL)
+          delete [] elem_orders;
+        for (int i = 0; i < H2D_MAX_SOLUTION_COMPONENTS; i++)
+          if(elem_coeffs[i] != NULL)
+            delete [] elem_coeffs[i];
+      }
+
+      mono_coeffs = NULL;
+      elem_orders = NULL;
+      for (int i = 0; i < H2D_MAX_SOLUTION_COMPONENTS; i++)
+        elem_coeffs[i] = NULL;
+    }
+
+    template<typename Scalar>
+    void Solution<Scalar>::detach_coeffs()
+    {
+      if(coeffs_refs == NULL)
+        return;
+
+      Scalar* own_mono_coeffs = new Scalar[num_coeffs];
+      memcpy(own_mono_coeffs, mono_coeffs, sizeof(Scalar) * num_coeffs);
+      int* own_elem_orders = new int[num_elems];
+      memcpy(own_elem_orders, elem_orders, sizeof(int) * num_elems);
+      int* own_elem_coeffs[H2D_MAX_SOLUTION_COMPONENTS];
+      for (int l = 0; l < H2D_MAX_SOLUTION_COMPONENTS; l++)
+      {
+        own_elem_coeffs[l] = NULL;
+        if(l < this->num_components && elem_coeffs[l] != NULL)
+        {
+          own_elem_coeffs[l] = new int[num_elems];
+          memcpy(own_elem_coeffs[l], elem_coeffs[l], sizeof(int) * num_elems);
+        }
+      }
+
+      // Drops this instance's reference (deleting the old arrays if the other copies are gone meanwhile).
+      free_coeffs();
+
+      mono_coeffs = own_mono_coeffs;
+      elem_orders = own_elem_orders;
+      for (int l = 0; l < H2D_MAX_SOLUTION_COMPONENTS; l++)
+        elem_coeffs[l] = own_elem_coeffs[l];
     }
 
     template<>
     void Solution<double>::free()
     {
-      if(mono_coeffs  != NULL) { delete [] mono_coeffs;   mono_coeffs = NULL;  }
-      if(elem_orders != NULL) { delete [] elem_orders;  elem_orders = NULL; }
+      free_coeffs();
       if(dxdy_buffer != NULL) { delete [] dxdy_buffer;  dxdy_buffer = NULL; }
 
-      for (int i = 0; i < this->num_components; i++)
-        if(elem_coeffs[i] != NULL)
-        { delete [] elem_coeffs[i];  elem_coeffs[i] = NULL; }
-
         e_last = NULL;
 
         free_tables();
@@ -317,14 +489,9 @@ namespace Hermes
 		template<>
 		void Solution<std::complex<double> >::free()
 		{
-			if(mono_coeffs  != NULL) { delete [] mono_coeffs;   mono_coeffs = NULL;  }
-			if(elem_orders != NULL) { delete [] elem_orders;  elem_orders = NULL; }
+			free_coeffs();
 			if(dxdy_buffer != NULL) { delete [] dxdy_buffer;  dxdy_buffer = NULL; }
 
-			for (int i = 0; i < this->num_components; i++)
-				if(elem_coeffs[i] != NULL)
-				{ delete [] elem_coeffs[i];  elem_coeffs[i] = NULL; }
-
 				e_last = NULL;
 
 				free_tables();
@@ -351,20 +518,27 @@ namespace Hermes
       // this is a set of LU-decomposed matrices shared by all Solutions
       double** mat[2][11];
       int* perm[2][11];
+      // their inverses, i.e. the matrices converting values in Chebyshev points to monomial coefficients
+      double** inv[2][11];
 
       mono_lu_init()
       {
         memset(mat, 0, sizeof(mat));
+        memset(inv, 0, sizeof(inv));
       }
 
       ~mono_lu_init()
       {
         for (int m = 0; m <= 1; m++)
           for (int i = 0; i <= 10; i++)
+          {
             if(mat[m][i] != NULL) {
               delete [] mat[m][i];
               delete [] perm[m][i];
             }
+            if(inv[m][i] != NULL)
+              delete [] inv[m][i];
+          }
       }
     }
     mono_lu;
@@ -499,49 +673,109 @@ namespace Hermes
         delete [] mono_coeffs;
       mono_coeffs = new Scalar[num_coeffs];
 
-      // Express the solution on elements as a linear combination of monomials.
+      // Lay out mono_coeffs and prepare the conversion matrices of all (mode, order) pairs present,
+      // so that the elements can be processed independently of each other.
       Quad2D* quad = &g_quad_2d_cheb;
-      pss->set_quad_2d(quad);
-      Scalar* mono = mono_coeffs;
+      Hermes::vector<Element*> active_elements;
+      int offset = 0;
       for_all_active_elements(e, this->mesh)
       {
-        this->mode = e->get_mode();
+        active_elements.push_back(e);
+        ElementMode2D mode = e->get_mode();
         o = elem_orders[e->id];
-        int np = quad->get_num_points(o, e->get_mode());
+        int np = quad->get_num_points(o, mode);
+        for (int l = 0; l < this->num_components; l++)
+        {
+          elem_coeffs[l][e->id] = offset;
+          offset += np;
+        }
 
+#pragma omp critical (mono_lu)
+        if(mono_lu.inv[mode][o] == NULL)
+        {
+          this->mode = mode;
+          if(mono_lu.mat[mode][o] == NULL)
+            mono_lu.mat[mode][o] = calc_mono_matrix(o, mono_lu.perm[mode][o]);
+          double** inv = new_matrix<double>(np, np);
+          double* column = new double[np];
+          for (int j = 0; j < np; j++)
+          {
+            memset(column, 0, sizeof(double) * np);
+            column[j] = 1.0;
+            lubksb(mono_lu.mat[mode][o], np, mono_lu.perm[mode][o], column);
+            for (int i = 0; i < np; i++)
+              inv[i][j] = column[i];
+          }
+          delete [] column;
+          mono_lu.inv[mode][o] = inv;
+        }
+      }
+
+      // Express the solution on elements as a linear combination of monomials.
+      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+      PrecalcShapeset** thread_pss = new PrecalcShapeset*[num_threads_used];
+      for (int i = 0; i < num_threads_used; i++)
+      {
+        thread_pss[i] = new PrecalcShapeset(pss);
+        thread_pss[i]->set_quad_2d(quad);
+      }
+      int num_active_elements = (int)active_elements.size();
+      double dir_lift_coeff = add_dir_lift ? 1.0 : 0.0;
+
+#pragma omp parallel num_threads(num_threads_used)
+      {
+        PrecalcShapeset* current_pss = thread_pss[omp_get_thread_num()];
         AsmList<Scalar> al;
-        space->get_element_assembly_list(e, &al);
-        pss->set_active_element(e);
+        Scalar val[121];
 
-        for (int l = 0; l < this->num_components; l++)
+#pragma omp for schedule(dynamic, 256)
+        for (int element_i = 0; element_i < num_active_elements; element_i++)
         {
-          // Obtain solution values for the current element.
-          Scalar* val = mono;
-          elem_coeffs[l][e->id] = (int) (mono - mono_coeffs);
-          memset(val, 0, sizeof(Scalar)*np);
-          for (unsigned int k = 0; k < al.cnt; k++)
+          Element* current_e = active_elements[element_i];
+          ElementMode2D mode = current_e->get_mode();
+          int current_o = elem_orders[current_e->id];
+          int np = quad->get_num_points(current_o, mode);
+          double** inv = mono_lu.inv[mode][current_o];
+
+          space->get_element_assembly_list(current_e, &al);
+          current_pss->set_active_element(current_e);
+
+          for (int l = 0; l < this->num_components; l++)
           {
-            pss->set_active_shape(al.idx[k]);
-            pss->set_quad_order(o, H2D_FN_VAL);
-            int dof = al.dof[k];
-            double dir_lift_coeff = add_dir_lift ? 1.0 : 0.0;
-            // By subtracting space->first_dof we make sure that it does not matter where the
-            // enumeration of dofs in the space starts. This ca be either zero or there can be some
-            // offset. By adding start_index we move to the desired section of coeff_vec.
-            Scalar coef = al.coef[k] * (dof >= 0 ? coeff_vec[dof  - space->first_dof + start_index] : dir_lift_coeff);
-            double* shape = pss->get_fn_values(l);
+            // Obtain solution values for the current element.
+            memset(val, 0, sizeof(Scalar)*np);
+            for (unsigned int k = 0; k < al.cnt; k++)
+            {
+              current_pss->set_active_shape(al.idx[k]);
+              current_pss->set_quad_order(current_o, H2D_FN_VAL);
+              int dof = al.dof[k];
+              // By subtracting space->first_dof we make sure that it does not matter where the
+              // enumeration of dofs in the space starts. This ca be either zero or there can be some
+              // offset. By adding start_index we move to the desired section of coeff_vec.
+              // Interleaved dofs are numbered in the whole coeff_vec already.
+              Scalar coef = al.coef[k] * (dof >= 0 ? coeff_vec[space->has_interleaved_dofs() ? dof : dof  - space->first_dof + start_index] : dir_lift_coeff);
+              double* shape = current_pss->get_fn_values(l);
+              for (int i = 0; i < np; i++)
+                val[i] += shape[i] * coef;
+            }
+
+            // The monomial coefficients.
+            Scalar* mono = mono_coeffs + elem_coeffs[l][current_e->id];
             for (int i = 0; i < np; i++)
-              val[i] += shape[i] * coef;
+            {
+              Scalar sum = 0.0;
+              for (int j = 0; j < np; j++)
+                sum += inv[i][j] * val[j];
+              mono[i] = sum;
+            }
           }
-          mono += np;
-
-          // solve for the monomial coefficients
-          if(mono_lu.mat[this->mode][o] == NULL)
-            mono_lu.mat[this->mode][o] = calc_mono_matrix(o, mono_lu.perm[this->mode][o]);
-          lubksb(mono_lu.mat[this->mode][o], np, mono_lu.perm[this->mode][o], val);
         }
       }
 
+      for (int i = 0; i < num_threads_used; i++)
+        delete thread_pss[i];
+      delete [] thread_pss;
+
       if(this->mesh == NULL) throw Hermes::Exceptions::Exception("mesh == NULL.\n");
       init_dxdy_buffer();
       this->element = NULL;
@@ -809,6 +1043,7 @@ namespace Hermes
     {
       if(sln_type == HERMES_SLN)
       {
+        detach_coeffs();
         for (int i = 0; i < num_coeffs; i++)
           mono_coeffs[i] *= coef;
       }
@@ -873,21 +1108,35 @@ namespace Hermes
       
       MeshFunction<Scalar>::set_active_element(e);
 
+      if(tables[this->cur_quad] == NULL)
+      {
+        tables[this->cur_quad] = new std::map<uint64_t, LightArray<struct Function<Scalar>::Node*>*>*[element_cache_size];
+        memset(tables[this->cur_quad], 0, sizeof(std::map<uint64_t, LightArray<struct Function<Scalar>::Node*>*>*) * element_cache_size);
+        elems[this->cur_quad] = new Element*[element_cache_size];
+        memset(elems[this->cur_quad], 0, sizeof(Element*) * element_cache_size);
+        oldest[this->cur_quad] = 0;
+      }
+
       // try finding an existing table for e
-      for (cur_elem = 0; cur_elem < 4; cur_elem++)
+      for (cur_elem = 0; cur_elem < element_cache_size; cur_elem++)
         if(elems[this->cur_quad][cur_elem] == e)
           break;
 
       // if not found, free the oldest one and use its slot
-      if(cur_elem >= 4)
+      CacheStatistics::lookup(H2D_CACHE_SOLUTION, cur_elem < element_cache_size);
+      if(cur_elem >= element_cache_size)
       {
+        element_cache_misses++;
         if(tables[this->cur_quad][oldest[this->cur_quad]] != NULL)
         {
           for(typename std::map<uint64_t, LightArray<struct Function<Scalar>::Node*>*>::iterator it = tables[this->cur_quad][oldest[this->cur_quad]]->begin(); it != tables[this->cur_quad][oldest[this->cur_quad]]->end(); it++)
           {
             for(unsigned int l = 0; l < it->second->get_size(); l++)
               if(it->second->present(l))
+              {
+                CacheStatistics::add_bytes(H2D_CACHE_SOLUTION, -it->second->get(l)->size);
                 ::free(it->second->get(l));
+              }
             delete it->second;
           }
           delete tables[this->cur_quad][oldest[this->cur_quad]];
@@ -898,11 +1147,13 @@ namespace Hermes
         tables[this->cur_quad][oldest[this->cur_quad]] = new std::map<uint64_t, LightArray<struct Function<Scalar>::Node*>*>;
 
         cur_elem = oldest[this->cur_quad];
-        if(++oldest[this->cur_quad] >= 4)
+        if(++oldest[this->cur_quad] >= element_cache_size)
           oldest[this->cur_quad] = 0;
 
         elems[this->cur_quad][cur_elem] = e;
       }
+      else
+        element_cache_hits++;
 
       if(sln_type == HERMES_SLN)
       {
@@ -954,6 +1205,58 @@ namespace Hermes
         y[i] = y[i]*x[i] + z[i];
     }
 
+    /// The number of the points evaluated at once by eval_mono().
+    static const int H2D_MONO_BLOCK = 8;
+
+    /// Horner's scheme of the monomial coefficients mono (a row of the powers of x for each power of y, o + 1 coefficients
+    /// in the rows of quads, i + 1 in the i-th row of triangles) in np points. The points are processed in blocks
+    /// of H2D_MONO_BLOCK: the partial sums of a block stay in registers over all the coefficients (the fixed-length inner
+    /// loops are vectorized by the compiler), instead of one pass over all the points for each coefficient.
+    template<typename Scalar, typename Coord>
+    static void eval_mono(int np, int o, bool quad, const Scalar* mono, const Coord* x, const Coord* y, Scalar* result)
+    {
+      int p = 0;
+      for (; p + H2D_MONO_BLOCK <= np; p += H2D_MONO_BLOCK)
+      {
+        const Coord* xb = x + p;
+        const Coord* yb = y + p;
+        Scalar sum[H2D_MONO_BLOCK], row[H2D_MONO_BLOCK];
+        const Scalar* m = mono;
+        for (int i = 0; i <= o; i++)
+        {
+          for (int q = 0; q < H2D_MONO_BLOCK; q++)
+            row[q] = m[0];
+          m++;
+          for (int j = 0; j < (quad ? o : i); j++, m++)
+            for (int q = 0; q < H2D_MONO_BLOCK; q++)
+              row[q] = row[q] * xb[q] + *m;
+          if(i == 0)
+            for (int q = 0; q < H2D_MONO_BLOCK; q++)
+              sum[q] = row[q];
+          else
+            for (int q = 0; q < H2D_MONO_BLOCK; q++)
+              sum[q] = sum[q] * yb[q] + row[q];
+        }
+        for (int q = 0; q < H2D_MONO_BLOCK; q++)
+          result[p + q] = sum[q];
+      }
+
+      // The rest of the points.
+      for (; p < np; p++)
+      {
+        const Scalar* m = mono;
+        Scalar sum = 0.0;
+        for (int i = 0; i <= o; i++)
+        {
+          Scalar row = *m++;
+          for (int j = 0; j < (quad ? o : i); j++)
+            row = row * x[p] + *m++;
+          sum = sum * y[p] + row;
+        }
+        result[p] = sum;
+      }
+    }
+
     static const int H2D_GRAD = H2D_FN_DX_0 | H2D_FN_DY_0;
     static const int H2D_SECOND = H2D_FN_DXX_0 | H2D_FN_DXY_0 | H2D_FN_DYY_0;
     static const int H2D_CURL = H2D_FN_DX | H2D_FN_DY;
@@ -968,7 +1271,6 @@ namespace Hermes
       // H1 space
       if(space_type == HERMES_H1_SPACE)
       {
-#ifdef H2D_USE_SECOND_DERIVATIVES
         if(((newmask & H2D_SECOND) == H2D_SECOND && (oldmask & H2D_SECOND) != H2D_SECOND))
         {
           this->update_refmap();
@@ -987,7 +1289,6 @@ namespace Hermes
             node->values[0][5][i] = (*m)[0][0]*(*m)[1][0]*vxx + ((*m)[0][0]*(*m)[1][1] + (*m)[1][0]*(*m)[0][1])*vxy + (*m)[0][1]*(*m)[1][1]*vyy + (*mm)[1][0]*vx + (*mm)[1][1]*vy;   //dxy
           }
         }
-#endif
         if((newmask & H2D_GRAD) == H2D_GRAD && (oldmask & H2D_GRAD) != H2D_GRAD)
         {
           this->update_refmap();
@@ -1092,7 +1393,6 @@ namespace Hermes
         // transform integration points by the current matrix
         Scalar* x = new Scalar[np];
         Scalar* y = new Scalar[np];
-        Scalar* tx = new Scalar[np];
         double3* pt = quad->get_points(order, this->element->get_mode());
         for (i = 0; i < np; i++)
         {
@@ -1102,6 +1402,28 @@ namespace Hermes
 
         // obtain the solution values, this is the core of the whole module
         int o = elem_orders[this->element->id];
+
+        // Volume rules of quads in g_quad_2d_std are tensor products (the point a * n + b is made of
+        // the a-th x and b-th y 1D point), the Horner's scheme is then sum-factorized into
+        // O(o^2 n + o n^2) operations instead of O(o^2 n^2).
+        int n = 0;
+        Scalar* rows = NULL;
+        Scalar* x_1d = NULL;
+        if(this->mode == HERMES_MODE_QUAD && quad == &g_quad_2d_std && order <= quad->get_max_order(HERMES_MODE_QUAD))
+        {
+          n = (int) (sqrt((double) np) + 0.5);
+          if(n * n == np)
+          {
+            rows = new Scalar[(o + 1) * n];
+            // The 1D points in x, contiguous, the 1D points in y are y[0], ..., y[n - 1].
+            x_1d = new Scalar[n];
+            for (int a = 0; a < n; a++)
+              x_1d[a] = x[a * n];
+          }
+          else
+            n = 0;
+        }
+
         for (l = 0; l < this->num_components; l++)
         {
           for (k = 0; k < 6; k++)
@@ -1114,29 +1436,39 @@ namespace Hermes
                 // copy the old table if we have it already
                 memcpy(result, this->cur_node->values[l][k], np * sizeof(Scalar));
               }
-              else
+              else if(rows != NULL)
               {
-                // calculate the solution values using Horner's scheme
+                // Horner's scheme in x along the 1D points for each power of y, then in y,
+                // both with the points in the innermost (contiguous, vectorized) loops.
                 Scalar* mono = dxdy_coeffs[l][k];
-                for (i = 0; i <= o; i++)
+                for (i = 0; i <= o; i++, mono += o + 1)
                 {
-                  set_vec_num(np, tx, *mono++);
-                  for (j = 1; j <= (this->mode ? o : i); j++)
-                    vec_x_vec_p_num(np, tx, x, *mono++);
-
-                  if(!i)
-                    memcpy(result, tx, sizeof(Scalar)*np);
-                  else
-                    vec_x_vec_p_vec(np, result, y, tx);
+                  Scalar* row = rows + i * n;
+                  set_vec_num(n, row, mono[0]);
+                  for (j = 1; j <= o; j++)
+                    vec_x_vec_p_num(n, row, x_1d, mono[j]);
+                }
+                for (int a = 0; a < n; a++)
+                {
+                  Scalar* result_a = result + a * n;
+                  set_vec_num(n, result_a, rows[a]);
+                  for (i = 1; i <= o; i++)
+                    vec_x_vec_p_num(n, result_a, y, rows[i * n + a]);
                 }
               }
+              else
+                eval_mono(np, o, this->mode == HERMES_MODE_QUAD, dxdy_coeffs[l][k], x, y, result);
             }
           }
         }
 
         delete [] x;
         delete [] y;
-        delete [] tx;
+        if(rows != NULL)
+        {
+          delete [] rows;
+          delete [] x_1d;
+        }
 
         // transform gradient or vector solution, if required
         if(transform)
@@ -1155,6 +1487,12 @@ namespace Hermes
         // evaluate the exact solution
         if(this->num_components == 1)
         {
+          Scalar* val = node->values[0][0];
+          Scalar* dx = node->values[0][1];
+          Scalar* dy = node->values[0][2];
+          (static_cast<ExactSolutionScalar<Scalar>*>(this))->exact_function_batch(np, x, y, val, dx, dy);
+          Scalar multiplicator = (static_cast<ExactSolutionScalar<Scalar>*>(this))->exact_multiplicator;
+
           // untransform values
           if(!transform)
           {
@@ -1166,22 +1504,19 @@ namespace Hermes
             for (i = 0, m = mat; i < np; i++, m += mstep)
             {
               double jac = (*m)[0][0] *  (*m)[1][1] - (*m)[1][0] *  (*m)[0][1];
-              Scalar val, dx = 0.0, dy = 0.0;
-              val = (static_cast<ExactSolutionScalar<Scalar>*>(this))->exact_function(x[i], y[i], dx, dy);
-              node->values[0][0][i] = val * (static_cast<ExactSolutionVector<Scalar>*>(this))->exact_multiplicator;
-              node->values[0][1][i] = (  (*m)[1][1]*dx - (*m)[0][1]*dy) / jac * (static_cast<ExactSolutionVector<Scalar>*>(this))->exact_multiplicator;
-              node->values[0][2][i] = (- (*m)[1][0]*dx + (*m)[0][0]*dy) / jac * (static_cast<ExactSolutionVector<Scalar>*>(this))->exact_multiplicator;
+              Scalar dx_i = dx[i], dy_i = dy[i];
+              val[i] *= multiplicator;
+              dx[i] = (  (*m)[1][1]*dx_i - (*m)[0][1]*dy_i) / jac * multiplicator;
+              dy[i] = (- (*m)[1][0]*dx_i + (*m)[0][0]*dy_i) / jac * multiplicator;
             }
           }
-          else
+          else if(multiplicator != 1.0)
           {
             for (i = 0; i < np; i++)
             {
-              Scalar val, dx = 0.0, dy = 0.0;
-              val = (static_cast<ExactSolutionScalar<Scalar>*>(this))->exact_function(x[i], y[i], dx, dy);
-              node->values[0][0][i] = val * (static_cast<ExactSolutionVector<Scalar>*>(this))->exact_multiplicator;
-              node->values[0][1][i] = dx * (static_cast<ExactSolutionVector<Scalar>*>(this))->exact_multiplicator;
-              node->values[0][2][i] = dy * (static_cast<ExactSolutionVector<Scalar>*>(this))->exact_multiplicator;
+              val[i] *= multiplicator;
+              dx[i] *= multiplicator;
+              dy[i] *= multiplicator;
             }
           }
         }
@@ -1210,9 +1545,11 @@ namespace Hermes
       if(this->nodes->present(order))
       {
         assert(this->nodes->get(order) == this->cur_node);
+        CacheStatistics::add_bytes(H2D_CACHE_SOLUTION, -this->nodes->get(order)->size);
         ::free(this->nodes->get(order));
       }
       this->nodes->add(node, order);
+      CacheStatistics::insert(H2D_CACHE_SOLUTION, node->size);
       this->cur_node = node;
     }
 
@@ -1543,6 +1880,241 @@ namespace Hermes
       return;
     }
 
+    static const char H2D_BINARY_SOLUTION_MAGIC[8] = { 'H', '2', 'D', 'S', 'L', 'N', 'B', 'I' };
+    static const int H2D_BINARY_SOLUTION_BYTE_ORDER = 0x01020304;
+
+    static size_t sln_aligned_size(size_t bytes)
+    {
+      return (bytes + 7) & ~(size_t)7;
+    }
+
+    /// Writes one block of the binary solution file, compressed if requested, and returns the stored size.
+    static uint64_t sln_write_block(std::ofstream& out, const void* data, size_t bytes, bool compress)
+    {
+      static const char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+      size_t stored = bytes;
+#ifdef WITH_ZSTD
+      if(compress && bytes > 0)
+      {
+        size_t bound = ZSTD_compressBound(bytes);
+        char* buffer = new char[bound];
+        stored = ZSTD_compress(buffer, bound, data, bytes, 3);
+        if(ZSTD_isError(stored))
+        {
+          delete [] buffer;
+          throw Hermes::Exceptions::SolutionSaveFailureException("Compression of the binary solution failed: %s.", ZSTD_getErrorName(stored));
+        }
+        out.write(buffer, stored);
+        delete [] buffer;
+      }
+      else
+#endif
+      if(bytes > 0)
+        out.write((const char*)data, bytes);
+      out.write(padding, sln_aligned_size(stored) - stored);
+      return stored;
+    }
+
+    /// Reads one block of the binary solution file into a buffer of 'bytes' bytes.
+    static void sln_read_block(const char* data, uint64_t stored, void* target, size_t bytes, bool compressed)
+    {
+      if(compressed)
+      {
+#ifdef WITH_ZSTD
+        size_t result = ZSTD_decompress(target, bytes, data, (size_t)stored);
+        if(ZSTD_isError(result) || result != bytes)
+          throw Hermes::Exceptions::SolutionLoadFailureException("Decompression of the binary solution failed.");
+#else
+        throw Hermes::Exceptions::SolutionLoadFailureException("The binary solution file is compressed, Hermes has to be built with WITH_ZSTD to read it.");
+#endif
+      }
+      else
+      {
+        if(stored != bytes)
+          throw Hermes::Exceptions::SolutionLoadFailureException("Corrupt block in the binary solution file.");
+        memcpy(target, data, bytes);
+      }
+    }
+
+    template<typename Scalar>
+    void Solution<Scalar>::save_bin(const char* filename, bool compress) const
+    {
+      if(sln_type == HERMES_UNDEF)
+        throw Exceptions::Exception("Cannot save -- uninitialized solution.");
+      if(sln_type != HERMES_SLN)
+        throw Hermes::Exceptions::SolutionSaveFailureException("Only solutions given by coefficients can be saved in the binary format.");
+
+      BinaryHeader header;
+      memset(&header, 0, sizeof(BinaryHeader));
+      memcpy(header.magic, H2D_BINARY_SOLUTION_MAGIC, sizeof(H2D_BINARY_SOLUTION_MAGIC));
+      header.byte_order = H2D_BINARY_SOLUTION_BYTE_ORDER;
+      header.version = H2D_BINARY_SOLUTION_VERSION;
+      header.scalar_size = sizeof(Scalar);
+      header.space_type = this->space_type;
+      header.num_components = this->num_components;
+      header.num_elems = this->num_elems;
+      header.num_coeffs = this->num_coeffs;
+#ifdef WITH_ZSTD
+      header.compression = compress ? 1 : 0;
+#else
+      if(compress)
+        this->warn("Solution::save_bin(): Hermes was built without WITH_ZSTD, the file will not be compressed.");
+#endif
+
+      std::ofstream out(filename, std::ios::out | std::ios::binary);
+      if(!out.is_open())
+        throw Hermes::Exceptions::SolutionSaveFailureException("Could not open the file %s for writing.", filename);
+
+      // The header is rewritten with the stored block sizes at the end.
+      out.write((const char*)&header, sln_aligned_size(sizeof(BinaryHeader)));
+      header.block_sizes[0] = sln_write_block(out, mono_coeffs, (size_t)num_coeffs * sizeof(Scalar), header.compression != 0);
+      header.block_sizes[1] = sln_write_block(out, elem_orders, (size_t)num_elems * sizeof(int), header.compression != 0);
+
+      int* all_elem_coeffs = new int[(size_t)this->num_components * num_elems];
+      for (int component_i = 0; component_i < this->num_components; component_i++)
+        memcpy(all_elem_coeffs + (size_t)component_i * num_elems, elem_coeffs[component_i], num_elems * sizeof(int));
+      header.block_sizes[2] = sln_write_block(out, all_elem_coeffs, (size_t)this->num_components * num_elems * sizeof(int), header.compression != 0);
+      delete [] all_elem_coeffs;
+
+      out.seekp(0, std::ios::beg);
+      out.write((const char*)&header, sizeof(BinaryHeader));
+      out.close();
+      if(out.fail())
+        throw Hermes::Exceptions::SolutionSaveFailureException("Writing of the binary solution file %s failed.", filename);
+    }
+
+    template<typename Scalar>
+    void Solution<Scalar>::load_bin(const char* filename, Space<Scalar>* space)
+    {
+      free();
+      this->mesh = space->get_mesh();
+      this->space_type = space->get_type();
+
+#ifndef WIN32
+      int fd = open(filename, O_RDONLY);
+      if(fd < 0)
+        throw Hermes::Exceptions::SolutionLoadFailureException("Could not open the binary solution file %s.", filename);
+
+      struct stat file_stat;
+      if(fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(BinaryHeader))
+      {
+        close(fd);
+        throw Hermes::Exceptions::SolutionLoadFailureException("The file %s is not a binary solution file.", filename);
+      }
+      size_t size = (size_t)file_stat.st_size;
+
+      void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if(data == MAP_FAILED)
+        throw Hermes::Exceptions::SolutionLoadFailureException("Could not map the binary solution file %s into memory.", filename);
+
+      try
+      {
+        load_bin_data((const char*)data, size);
+      }
+      catch(...)
+      {
+        munmap(data, size);
+        throw;
+      }
+      munmap(data, size);
+#else
+      std::ifstream in(filename, std::ios::in | std::ios::binary);
+      if(!in.is_open())
+        throw Hermes::Exceptions::SolutionLoadFailureException("Could not open the binary solution file %s.", filename);
+      in.seekg(0, std::ios::end);
+      size_t size = (size_t)in.tellg();
+      in.seekg(0, std::ios::beg);
+
+      // double storage keeps the blocks aligned.
+      double* data = new double[size / sizeof(double) + 1];
+      in.read((char*)data, size);
+      in.close();
+
+      try
+      {
+        load_bin_data((const char*)data, size);
+      }
+      catch(...)
+      {
+        delete [] data;
+        throw;
+      }
+      delete [] data;
+#endif
+    }
+
+    template<typename Scalar>
+    void Solution<Scalar>::load_bin_data(const char* data, size_t size)
+    {
+      if(size < sizeof(BinaryHeader) || memcmp(data, H2D_BINARY_SOLUTION_MAGIC, sizeof(H2D_BINARY_SOLUTION_MAGIC)) != 0)
+        throw Hermes::Exceptions::SolutionLoadFailureException("The file is not a binary solution file.");
+
+      const BinaryHeader* header = (const BinaryHeader*)data;
+      if(header->byte_order != H2D_BINARY_SOLUTION_BYTE_ORDER)
+        throw Hermes::Exceptions::SolutionLoadFailureException("The binary solution file was written on a platform with a different byte order.");
+      if(header->version != H2D_BINARY_SOLUTION_VERSION)
+        throw Hermes::Exceptions::SolutionLoadFailureException("Unsupported binary solution file version %i (expected %i).", header->version, H2D_BINARY_SOLUTION_VERSION);
+      if(header->scalar_size != sizeof(Scalar))
+        throw Hermes::Exceptions::SolutionLoadFailureException("Mismatched real - complex solutions.");
+      if(header->space_type != this->space_type)
+        throw Exceptions::Exception("Space types not compliant in Solution::load_bin().");
+      if(header->num_components < 1 || header->num_components > H2D_MAX_SOLUTION_COMPONENTS || header->num_elems < 0 || header->num_coeffs < 0)
+        throw Hermes::Exceptions::SolutionLoadFailureException("Corrupt header of the binary solution file.");
+
+      size_t offsets[4];
+      offsets[0] = sln_aligned_size(sizeof(BinaryHeader));
+      for (int block_i = 0; block_i < 3; block_i++)
+        offsets[block_i + 1] = offsets[block_i] + sln_aligned_size((size_t)header->block_sizes[block_i]);
+      if(size < offsets[3])
+        throw Hermes::Exceptions::SolutionLoadFailureException("The binary solution file is truncated.");
+
+      this->num_coeffs = header->num_coeffs;
+      this->num_elems = header->num_elems;
+      this->num_components = header->num_components;
+
+      this->mono_coeffs = new Scalar[num_coeffs];
+      this->elem_orders = new int[num_elems];
+      for (int component_i = 0; component_i < this->num_components; component_i++)
+        elem_coeffs[component_i] = new int[num_elems];
+
+      bool compressed = header->compression != 0;
+      sln_read_block(data + offsets[0], header->block_sizes[0], mono_coeffs, (size_t)num_coeffs * sizeof(Scalar), compressed);
+      sln_read_block(data + offsets[1], header->block_sizes[1], elem_orders, (size_t)num_elems * sizeof(int), compressed);
+
+      if(compressed)
+      {
+        int* all_elem_coeffs = new int[(size_t)this->num_components * num_elems];
+        try
+        {
+          sln_read_block(data + offsets[2], header->block_sizes[2], all_elem_coeffs, (size_t)this->num_components * num_elems * sizeof(int), true);
+        }
+        catch(...)
+        {
+          delete [] all_elem_coeffs;
+          throw;
+        }
+        for (int component_i = 0; component_i < this->num_components; component_i++)
+          memcpy(elem_coeffs[component_i], all_elem_coeffs + (size_t)component_i * num_elems, num_elems * sizeof(int));
+        delete [] all_elem_coeffs;
+      }
+      else
+      {
+        if(header->block_sizes[2] != (uint64_t)this->num_components * num_elems * sizeof(int))
+          throw Hermes::Exceptions::SolutionLoadFailureException("Corrupt block in the binary solution file.");
+        for (int component_i = 0; component_i < this->num_components; component_i++)
+          memcpy(elem_coeffs[component_i], data + offsets[2] + (size_t)component_i * num_elems * sizeof(int), num_elems * sizeof(int));
+      }
+
+      for (int component_i = 0; component_i < this->num_components; component_i++)
+        for (int elems_i = 0; elems_i < num_elems; elems_i++)
+          if(elem_coeffs[component_i][elems_i] < 0 || elem_coeffs[component_i][elems_i] > num_coeffs)
+            throw Hermes::Exceptions::SolutionLoadFailureException("Corrupt element coefficients in the binary solution file.");
+
+      sln_type = HERMES_SLN;
+      init_dxdy_buffer();
+    }
+
     template<typename Scalar>
     Scalar Solution<Scalar>::get_ref_value(Element* e, double xi1, double xi2, int component, int item)
     {
@@ -1565,6 +2137,89 @@ namespace Hermes
       return result;
     }
 
+    template<typename Scalar>
+    int Solution<Scalar>::get_pt_values(const double* x, const double* y, int n, Scalar* val, Scalar* dx, Scalar* dy, int component)
+    {
+      if(sln_type != HERMES_SLN || this->num_components != 1)
+        return MeshFunction<Scalar>::get_pt_values(x, y, n, val, dx, dy, component);
+
+      Element** elements = new Element*[n];
+      double* xi = new double[2 * n];
+      int* point_order = new int[n];
+      this->locate_points(x, y, n, elements, xi, xi + n, point_order);
+
+      // The reference coordinates and the values (value, dx, dy on the reference element) of the points of one element.
+      double* run_xi1 = new double[n];
+      double* run_xi2 = new double[n];
+      Scalar* v = new Scalar[3 * n];
+
+      int found = 0;
+      int k = 0;
+      while (k < n)
+      {
+        // The points are grouped by the elements, all the points of the element are evaluated at once.
+        Element* e = elements[point_order[k]];
+        int run_end = k + 1;
+        while (run_end < n && elements[point_order[run_end]] == e)
+          run_end++;
+        int count = run_end - k;
+
+        if(e == NULL)
+        {
+          for (int r = k; r < run_end; r++)
+          {
+            int i = point_order[r];
+            if(val != NULL) val[i] = 0.0;
+            if(dx != NULL) dx[i] = 0.0;
+            if(dy != NULL) dy[i] = 0.0;
+          }
+          k = run_end;
+          continue;
+        }
+        found += count;
+
+        set_active_element(e);
+        int o = elem_orders[e->id];
+        for (int r = 0; r < count; r++)
+        {
+          run_xi1[r] = xi[point_order[k + r]];
+          run_xi2[r] = xi[n + point_order[k + r]];
+        }
+        int num_items = (dx != NULL || dy != NULL) ? 3 : 1;
+        for (int item = 0; item < num_items; item++)
+          eval_mono(count, o, this->mode == HERMES_MODE_QUAD, dxdy_coeffs[0][item], run_xi1, run_xi2, v + item * n);
+
+        for (int r = 0; r < count; r++)
+        {
+          int i = point_order[k + r];
+          if(val != NULL)
+            val[i] = v[r];
+          if(dx != NULL || dy != NULL)
+          {
+            double2x2 m;
+            if(this->refmap->is_jacobian_const())
+              memcpy(m, this->refmap->get_const_inv_ref_map(), sizeof(double2x2));
+            else
+            {
+              double xx, yy;
+              this->refmap->inv_ref_map_at_point(run_xi1[r], run_xi2[r], xx, yy, m);
+            }
+            if(dx != NULL) dx[i] = m[0][0] * v[n + r] + m[0][1] * v[2 * n + r];
+            if(dy != NULL) dy[i] = m[1][0] * v[n + r] + m[1][1] * v[2 * n + r];
+          }
+        }
+        k = run_end;
+      }
+
+      delete [] run_xi1;
+      delete [] run_xi2;
+      delete [] v;
+      delete [] elements;
+      delete [] xi;
+      delete [] point_order;
+      return found;
+    }
+
     template<typename Scalar>
     Scalar Solution<Scalar>::get_ref_value_transformed(Element* e, double xi1, double xi2, int a, int b)
     {
@@ -1587,7 +2242,6 @@ namespace Hermes
         }
         else
         {
-#ifdef H2D_USE_SECOND_DERIVATIVES
           double2x2 mat;
           double3x2 mat2;
           double xx, yy;
@@ -1606,7 +2260,6 @@ namespace Hermes
             return sqr(mat[1][0])*vxx + 2*mat[1][1]*mat[1][0]*vxy + sqr(mat[1][1])*vyy + mat2[2][0]*vx + mat2[2][1]*vy;   // dyy
           if(b == 5)
             return mat[0][0]*mat[1][0]*vxx + (mat[0][0]*mat[1][1] + mat[1][0]*mat[0][1])*vxy + mat[0][1]*mat[1][1]*vyy + mat2[1][0]*vx + mat2[1][1]*vy;   //dxy
-#endif
         }
       }
       else // vector solution
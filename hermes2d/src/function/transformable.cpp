@@ -15,6 +15,8 @@
 
 #include "transformable.h"
 #include "mesh.h"
+#include <map>
+#include <vector>
 namespace Hermes
 {
   namespace Hermes2D
@@ -62,7 +64,7 @@ namespace Hermes
     {
       assert(top > 0);
       ctm = stack + (--top);
-      sub_idx = (sub_idx - 1) >> 3;
+      sub_idx = get_parent_idx(sub_idx);
     }
 
     uint64_t Transformable::get_transform() const { return sub_idx; }
@@ -84,12 +86,14 @@ namespace Hermes
 
     void Transformable::set_transform(uint64_t idx)
     {
-      int son[25];
+      int son[H2D_MAX_TRN_LEVEL + 1];
       int i = 0;
       while (idx > 0)
       {
-        son[i++] = (idx - 1) & 7;
-        idx = (idx - 1) >> 3;
+        if(i > (int)H2D_MAX_TRN_LEVEL)
+          throw Hermes::Exceptions::Exception("Too deep transform.");
+        son[i++] = get_last_son(idx);
+        idx = get_parent_idx(idx);
       }
       reset_transform();
       for (int k = i-1; k >= 0; k--)
@@ -111,7 +115,53 @@ namespace Hermes
       mat->t[1] = ctm->m[1] * tr->t[1] + ctm->t[1];
 
       ctm = mat;
-      sub_idx = (sub_idx << 3) + son + 1; // see traverse.cpp if this changes
+      sub_idx = get_son_idx(sub_idx, son);
+    }
+
+    /// The paths of the numbered indices (get_son_idx()), the index is H2D_DEEP_IDX_FLAG | the position.
+    static std::vector<std::pair<uint64_t, int> > deep_idx_paths;
+    static std::map<std::pair<uint64_t, int>, uint64_t> deep_idx_numbers;
+
+    uint64_t Transformable::get_son_idx(uint64_t sub_idx, int son)
+    {
+      if(sub_idx <= (H2D_MAX_IDX - 8) >> 3)
+        return (sub_idx << 3) + son + 1;
+
+      uint64_t son_idx;
+#pragma omp critical (transformable_deep_idx)
+      {
+        std::pair<uint64_t, int> path(sub_idx, son);
+        std::map<std::pair<uint64_t, int>, uint64_t>::iterator it = deep_idx_numbers.find(path);
+        if(it != deep_idx_numbers.end())
+          son_idx = it->second;
+        else
+        {
+          son_idx = H2D_DEEP_IDX_FLAG | deep_idx_paths.size();
+          deep_idx_paths.push_back(path);
+          deep_idx_numbers.insert(std::make_pair(path, son_idx));
+        }
+      }
+      return son_idx;
+    }
+
+    uint64_t Transformable::get_parent_idx(uint64_t sub_idx)
+    {
+      if(!(sub_idx & H2D_DEEP_IDX_FLAG))
+        return (sub_idx - 1) >> 3;
+      uint64_t parent_idx;
+#pragma omp critical (transformable_deep_idx)
+      parent_idx = deep_idx_paths[sub_idx & ~H2D_DEEP_IDX_FLAG].first;
+      return parent_idx;
+    }
+
+    int Transformable::get_last_son(uint64_t sub_idx)
+    {
+      if(!(sub_idx & H2D_DEEP_IDX_FLAG))
+        return (int)((sub_idx - 1) & 7);
+      int son;
+#pragma omp critical (transformable_deep_idx)
+      son = deep_idx_paths[sub_idx & ~H2D_DEEP_IDX_FLAG].second;
+      return son;
     }
 
     void Transformable::push_transforms(std::set<Transformable *>& transformables, int son)
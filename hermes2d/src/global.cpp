@@ -23,6 +23,7 @@
 #include "quadrature/limit_order.h"
 #include "integrals/h1.h"
 #include "discrete_problem.h"
+#include "api2d.h"
 
 namespace Hermes
 {
@@ -48,43 +49,10 @@ namespace Hermes
       // sanity checks
       if(sln1 == NULL) throw Hermes::Exceptions::Exception("sln1 is NULL in calc_abs_error().");
       if(sln2 == NULL) throw Hermes::Exceptions::Exception("sln2 is NULL in calc_abs_error().");
+      if(norm_type != HERMES_L2_NORM && norm_type != HERMES_H1_NORM && norm_type != HERMES_HCURL_NORM && norm_type != HERMES_HDIV_NORM)
+        throw Hermes::Exceptions::Exception("Unknown norm in calc_error().");
 
-      Quad2D* quad = &g_quad_2d_std;
-      sln1->set_quad_2d(quad);
-      sln2->set_quad_2d(quad);
-
-      const Mesh* meshes[2] = { sln1->get_mesh(), sln2->get_mesh() };
-      Transformable* tr[2] = { sln1, sln2 };
-      Traverse trav(true);
-      trav.begin(2, meshes, tr);
-
-      double error = 0.0;
-      Traverse::State* ee;
-      while ((ee = trav.get_next_state()) != NULL)
-      {
-        update_limit_table(ee->e[0]->get_mode());
-
-        RefMap* ru = sln1->get_refmap();
-        RefMap* rv = sln2->get_refmap();
-        switch (norm_type)
-        {
-        case HERMES_L2_NORM:
-          error += error_fn_l2(sln1, sln2, ru, rv);
-          break;
-        case HERMES_H1_NORM:
-          error += error_fn_h1(sln1, sln2, ru, rv);
-          break;
-        case HERMES_HCURL_NORM:
-          error += error_fn_hc(sln1, sln2, ru, rv);
-          break;
-        case HERMES_HDIV_NORM:
-          error += error_fn_hdiv(sln1, sln2, ru, rv);
-          break;
-        default: throw Hermes::Exceptions::Exception("Unknown norm in calc_error().");
-        }
-      }
-      trav.finish();
-      return sqrt(error);
+      return sqrt(calc_element_sum(sln1, sln2, norm_type));
     }
 
     template<typename Scalar>
@@ -99,39 +67,155 @@ namespace Hermes
     template<typename Scalar>
     double Global<Scalar>::calc_norm(MeshFunction<Scalar>* sln, int norm_type)
     {
-      Quad2D* quad = &g_quad_2d_std;
-      sln->set_quad_2d(quad);
+      if(norm_type != HERMES_L2_NORM && norm_type != HERMES_H1_NORM && norm_type != HERMES_HCURL_NORM && norm_type != HERMES_HDIV_NORM)
+        throw Hermes::Exceptions::Exception("Unknown norm in calc_norm().");
 
-      double norm = 0.0;
-      Element* e;
-      const Mesh* mesh = sln->get_mesh();
+      return sqrt(calc_element_sum(sln, NULL, norm_type));
+    }
 
-      for_all_active_elements(e, mesh)
+    template<typename Scalar>
+    double Global<Scalar>::calc_element_contribution(MeshFunction<Scalar>* sln1, MeshFunction<Scalar>* sln2, int norm_type)
+    {
+      RefMap* ru = sln1->get_refmap();
+      if(sln2 == NULL)
       {
-        // set maximum integration order for use in integrals, see limit_order()
-        update_limit_table(e->get_mode());
-
-        sln->set_active_element(e);
-        RefMap* ru = sln->get_refmap();
-
         switch (norm_type)
         {
         case HERMES_L2_NORM:
-          norm += norm_fn_l2(sln, ru);
-          break;
+          return norm_fn_l2(sln1, ru);
         case HERMES_H1_NORM:
-          norm += norm_fn_h1(sln, ru);
-          break;
+          return norm_fn_h1(sln1, ru);
         case HERMES_HCURL_NORM:
-          norm += norm_fn_hc(sln, ru);
-          break;
-        case HERMES_HDIV_NORM:
-          norm += norm_fn_hdiv(sln, ru);
-          break;
-        default: throw Hermes::Exceptions::Exception("Unknown norm in calc_norm().");
+          return norm_fn_hc(sln1, ru);
+        default:
+          return norm_fn_hdiv(sln1, ru);
+        }
+      }
+
+      RefMap* rv = sln2->get_refmap();
+      switch (norm_type)
+      {
+      case HERMES_L2_NORM:
+        return error_fn_l2(sln1, sln2, ru, rv);
+      case HERMES_H1_NORM:
+        return error_fn_h1(sln1, sln2, ru, rv);
+      case HERMES_HCURL_NORM:
+        return error_fn_hc(sln1, sln2, ru, rv);
+      default:
+        return error_fn_hdiv(sln1, sln2, ru, rv);
+      }
+    }
+
+    template<typename Scalar>
+    double Global<Scalar>::calc_element_sum(MeshFunction<Scalar>* sln1, MeshFunction<Scalar>* sln2, int norm_type)
+    {
+      int num_fns = (sln2 == NULL) ? 1 : 2;
+      MeshFunction<Scalar>* slns[2] = { sln1, sln2 };
+
+      Hermes::vector<const Mesh*> meshes;
+      for (int j = 0; j < num_fns; j++)
+        meshes.push_back(slns[j]->get_mesh());
+
+      // Per-thread instances of the functions, the first thread uses the originals.
+      // If the functions cannot be cloned, the computation is done by one thread.
+      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+      MeshFunction<Scalar>*** fns = new MeshFunction<Scalar>**[num_threads_used];
+      Transformable*** trfs = new Transformable**[num_threads_used];
+      int num_clones = 0;
+      try
+      {
+        for (int i = 0; i < num_threads_used; i++, num_clones++)
+        {
+          fns[i] = new MeshFunction<Scalar>*[2];
+          fns[i][0] = fns[i][1] = NULL;
+          for (int j = 0; j < num_fns; j++)
+            fns[i][j] = (i == 0) ? slns[j] : slns[j]->clone();
+          trfs[i] = new Transformable*[2];
         }
       }
-      return sqrt(norm);
+      catch(Hermes::Exceptions::Exception&)
+      {
+        delete fns[num_clones][0];
+        delete [] fns[num_clones];
+        num_threads_used = num_clones;
+      }
+      for (int i = 0; i < num_threads_used; i++)
+        for (int j = 0; j < num_fns; j++)
+        {
+          fns[i][j]->set_quad_2d(&g_quad_2d_std);
+          trfs[i][j] = fns[i][j];
+        }
+
+      int num_states;
+      Traverse trav(true);
+      Traverse::State** states = trav.get_states(meshes, num_states);
+
+      // The contributions are stored per state and summed in the order of the states afterwards,
+      // so that the result does not depend on the number of threads or the scheduling.
+      double* contributions = new double[num_states];
+      Hermes::Exceptions::Exception* caughtException = NULL;
+
+      int state_i;
+#pragma omp parallel shared(states) private(state_i) num_threads(num_threads_used)
+      {
+#pragma omp for schedule(dynamic, 16)
+        for(state_i = 0; state_i < num_states; state_i++)
+        {
+          if(caughtException != NULL)
+            continue;
+
+          try
+          {
+            MeshFunction<Scalar>** current_fns = fns[omp_get_thread_num()];
+            Traverse::set_state_to_fns(states[state_i], trfs[omp_get_thread_num()]);
+            contributions[state_i] = calc_element_contribution(current_fns[0], num_fns == 2 ? current_fns[1] : NULL, norm_type);
+          }
+          catch(Hermes::Exceptions::Exception& e)
+          {
+#pragma omp critical (caughtException)
+            if(caughtException == NULL)
+              caughtException = e.clone();
+          }
+          catch(std::exception& e)
+          {
+#pragma omp critical (caughtException)
+            if(caughtException == NULL)
+              caughtException = new Hermes::Exceptions::Exception(e.what());
+          }
+        }
+      }
+
+      // Kahan summation.
+      double sum = 0.0, compensation = 0.0;
+      for (state_i = 0; state_i < num_states; state_i++)
+      {
+        double y = contributions[state_i] - compensation;
+        double t = sum + y;
+        compensation = (t - sum) - y;
+        sum = t;
+      }
+
+      delete [] contributions;
+      Traverse::free_states(states, num_states);
+      for (int i = 0; i < num_threads_used; i++)
+      {
+        if(i > 0)
+          for (int j = 0; j < num_fns; j++)
+            delete fns[i][j];
+        delete [] fns[i];
+        delete [] trfs[i];
+      }
+      delete [] fns;
+      delete [] trfs;
+
+      if(caughtException != NULL)
+      {
+        Hermes::Exceptions::Exception exception(*caughtException);
+        delete caughtException;
+        throw exception;
+      }
+
+      return sum;
     }
 
     template<typename Scalar>
@@ -0,0 +1,293 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "l2_mass_inverse.h"
+#include "shapeset/precalc.h"
+#include "mesh/refmap.h"
+#include "quadrature/limit_order.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// Relative size of the off-diagonal entries of a reference inverse considered zero.
+    static const double L2_MASS_INVERSE_DIAGONAL_TOLERANCE = 1e-12;
+
+    template<typename Scalar>
+    L2MassInverse<Scalar>::L2MassInverse(Hermes::vector<const Space<Scalar>*> spaces) : spaces(spaces)
+    {
+    }
+
+    template<typename Scalar>
+    L2MassInverse<Scalar>::L2MassInverse(const Space<Scalar>* space)
+    {
+      this->spaces.push_back(space);
+    }
+
+    template<typename Scalar>
+    L2MassInverse<Scalar>::~L2MassInverse()
+    {
+      this->free();
+    }
+
+    template<typename Scalar>
+    void L2MassInverse<Scalar>::free()
+    {
+      for (unsigned int block_i = 0; block_i < this->blocks.size(); block_i++)
+      {
+        delete [] this->blocks[block_i].dofs;
+        if(this->blocks[block_i].owns_inverse)
+          delete [] this->blocks[block_i].inverse;
+      }
+      this->blocks.clear();
+      for (typename std::map<std::vector<int>, ReferenceInverse>::iterator it = this->reference_inverses.begin(); it != this->reference_inverses.end(); it++)
+        delete [] it->second.inverse;
+      this->reference_inverses.clear();
+      this->seqs.clear();
+    }
+
+    template<typename Scalar>
+    void L2MassInverse<Scalar>::compute()
+    {
+      bool spaces_changed = (this->seqs.size() != this->spaces.size());
+      for (unsigned int space_i = 0; !spaces_changed && space_i < this->spaces.size(); space_i++)
+        if(this->seqs[space_i] != this->spaces[space_i]->get_seq())
+          spaces_changed = true;
+      if(!spaces_changed)
+        return;
+
+      this->free();
+
+      for (unsigned int space_i = 0; space_i < this->spaces.size(); space_i++)
+        if(this->spaces[space_i]->get_type() != HERMES_L2_SPACE)
+          throw Exceptions::Exception("L2MassInverse: the space %d is not an L2Space.", space_i);
+
+      RefMap refmap;
+      refmap.set_quad_2d(&g_quad_2d_std);
+      AsmList<Scalar> al;
+      unsigned int first_dof = 0;
+      for (unsigned int space_i = 0; space_i < this->spaces.size(); space_i++)
+      {
+        const Space<Scalar>* space = this->spaces[space_i];
+        PrecalcShapeset pss(space->get_shapeset());
+        pss.set_quad_2d(&g_quad_2d_std);
+
+        Element* e;
+        for_all_active_elements(e, space->get_mesh())
+        {
+          space->get_element_assembly_list(e, &al, first_dof);
+          unsigned int cnt = al.get_cnt();
+          if(cnt == 0)
+            continue;
+          // The coefficients of the basis functions of L2Space are ones.
+          int* idx = al.get_idx();
+
+          Block block;
+          block.cnt = cnt;
+          block.dofs = new int[cnt];
+          memcpy(block.dofs, al.get_dof(), cnt * sizeof(int));
+
+          refmap.set_active_element(e);
+          if(refmap.is_jacobian_const())
+          {
+            std::vector<int> key;
+            key.push_back(space_i);
+            key.push_back(e->get_mode());
+            key.insert(key.end(), idx, idx + cnt);
+
+            typename std::map<std::vector<int>, ReferenceInverse>::iterator it = this->reference_inverses.find(key);
+            if(it == this->reference_inverses.end())
+            {
+              ReferenceInverse reference_inverse;
+              double** reference_block = calculate_block(&pss, e, idx, cnt, get_quadrature_order(space, e, true), NULL);
+              reference_inverse.inverse = new_matrix<double>(cnt, cnt);
+              reference_inverse.diagonal = invert_block(reference_block, cnt, reference_inverse.inverse);
+              delete [] reference_block;
+              it = this->reference_inverses.insert(std::pair<std::vector<int>, ReferenceInverse>(key, reference_inverse)).first;
+            }
+
+            block.scale = 1.0 / refmap.get_const_jacobian();
+            block.inverse = it->second.inverse;
+            block.diagonal = it->second.diagonal;
+            block.owns_inverse = false;
+          }
+          else
+          {
+            int order = get_quadrature_order(space, e, false);
+            double** element_block = calculate_block(&pss, e, idx, cnt, order, refmap.get_jacobian(order));
+
+            block.scale = 1.0;
+            block.inverse = new_matrix<double>(cnt, cnt);
+            block.diagonal = invert_block(element_block, cnt, block.inverse);
+            block.owns_inverse = true;
+            delete [] element_block;
+          }
+
+          this->blocks.push_back(block);
+        }
+        first_dof += space->get_num_dofs();
+      }
+
+      for (unsigned int space_i = 0; space_i < this->spaces.size(); space_i++)
+        this->seqs.push_back(this->spaces[space_i]->get_seq());
+    }
+
+    template<typename Scalar>
+    int L2MassInverse<Scalar>::get_quadrature_order(const Space<Scalar>* space, Element* e, bool const_jacobian) const
+    {
+      int order = space->get_element_order(e->id);
+      int order_h = 2 * H2D_GET_H_ORDER(order);
+      int order_v = 2 * H2D_GET_V_ORDER(order);
+
+      // The jacobian of a straight quadrilateral is bilinear, curved elements are integrated by the highest order.
+      if(e->is_curved())
+        return g_quad_2d_std.get_max_order(e->get_mode());
+      if(!const_jacobian)
+      {
+        order_h++;
+        order_v++;
+      }
+
+      if(e->is_triangle())
+        order = order_h;
+      else
+        order = H2D_MAKE_QUAD_ORDER(order_h, order_v);
+      limit_order_nowarn(order, e->get_mode());
+      return order;
+    }
+
+    template<typename Scalar>
+    double** L2MassInverse<Scalar>::calculate_block(PrecalcShapeset* pss, Element* e, int* idx, unsigned int cnt, int order, double* jac)
+    {
+      double3* pt = g_quad_2d_std.get_points(order, e->get_mode());
+      int np = g_quad_2d_std.get_num_points(order, e->get_mode());
+
+      // The values of the shape functions in the quadrature points.
+      double** values = new_matrix<double>(cnt, np);
+      pss->set_active_element(e);
+      pss->set_master_transform();
+      for (unsigned int i = 0; i < cnt; i++)
+      {
+        pss->set_active_shape(idx[i]);
+        pss->set_quad_order(order, H2D_FN_VAL);
+        memcpy(values[i], pss->get_fn_values(), np * sizeof(double));
+      }
+
+      double** block = new_matrix<double>(cnt, cnt);
+      for (unsigned int i = 0; i < cnt; i++)
+        for (unsigned int j = 0; j <= i; j++)
+        {
+          double sum = 0.0;
+          for (int k = 0; k < np; k++)
+            sum += pt[k][2] * (jac == NULL ? 1.0 : jac[k]) * values[i][k] * values[j][k];
+          block[i][j] = block[j][i] = sum;
+        }
+
+      delete [] values;
+      return block;
+    }
+
+    template<typename Scalar>
+    bool L2MassInverse<Scalar>::invert_block(double** block, unsigned int cnt, double** inverse)
+    {
+      int* indx = new int[cnt];
+      double d;
+      DenseMatrixOperations::ludcmp(block, cnt, indx, &d);
+
+      // The columns of the inverse.
+      double* column = new double[cnt];
+      for (unsigned int j = 0; j < cnt; j++)
+      {
+        memset(column, 0, cnt * sizeof(double));
+        column[j] = 1.0;
+        DenseMatrixOperations::lubksb<double>(block, cnt, indx, column);
+        for (unsigned int i = 0; i < cnt; i++)
+          inverse[i][j] = column[i];
+      }
+      delete [] column;
+      delete [] indx;
+
+      bool diagonal = true;
+      for (unsigned int i = 0; i < cnt && diagonal; i++)
+        for (unsigned int j = 0; j < cnt; j++)
+          if(i != j && std::abs(inverse[i][j]) > L2_MASS_INVERSE_DIAGONAL_TOLERANCE * std::sqrt(std::abs(inverse[i][i] * inverse[j][j])))
+          {
+            diagonal = false;
+            break;
+          }
+      return diagonal;
+    }
+
+    template<typename Scalar>
+    void L2MassInverse<Scalar>::apply(const Scalar* in, Scalar* out) const
+    {
+      if(this->seqs.empty() && !this->spaces.empty())
+        throw Exceptions::Exception("L2MassInverse: compute() has to be called before apply().");
+
+      int num_blocks = this->blocks.size();
+#pragma omp parallel
+      {
+        unsigned int max_cnt = 0;
+        for (int block_i = 0; block_i < num_blocks; block_i++)
+          max_cnt = std::max(max_cnt, this->blocks[block_i].cnt);
+        Scalar* block_in = new Scalar[max_cnt > 0 ? max_cnt : 1];
+
+#pragma omp for schedule(static)
+        for (int block_i = 0; block_i < num_blocks; block_i++)
+        {
+          const Block& block = this->blocks[block_i];
+          // The input is copied first, so that in and out can be the same.
+          for (unsigned int i = 0; i < block.cnt; i++)
+            block_in[i] = in[block.dofs[i]];
+          if(block.diagonal)
+          {
+            for (unsigned int i = 0; i < block.cnt; i++)
+              out[block.dofs[i]] = block.scale * block.inverse[i][i] * block_in[i];
+          }
+          else
+          {
+            for (unsigned int i = 0; i < block.cnt; i++)
+            {
+              Scalar sum = 0.0;
+              for (unsigned int j = 0; j < block.cnt; j++)
+                sum += block.inverse[i][j] * block_in[j];
+              out[block.dofs[i]] = block.scale * sum;
+            }
+          }
+        }
+
+        delete [] block_in;
+      }
+    }
+
+    template<typename Scalar>
+    bool L2MassInverse<Scalar>::is_diagonal() const
+    {
+      for (unsigned int block_i = 0; block_i < this->blocks.size(); block_i++)
+        if(!this->blocks[block_i].diagonal)
+          return false;
+      return true;
+    }
+
+    template<typename Scalar>
+    int L2MassInverse<Scalar>::get_num_blocks() const
+    {
+      return this->blocks.size();
+    }
+
+    template class HERMES_API L2MassInverse<double>;
+    template class HERMES_API L2MassInverse<std::complex<double> >;
+  }
+}
@@ -28,25 +28,25 @@ namespace Hermes
   namespace Hermes2D
   {
     template<typename Scalar>
-    LinearSolver<Scalar>::LinearSolver() : dp(new DiscreteProblemLinear<Scalar>()), sln_vector(NULL), own_dp(true)
+    LinearSolver<Scalar>::LinearSolver() : dp(new DiscreteProblemLinear<Scalar>()), sln_vector(NULL), expanded_sln_vector(NULL), expanded_sln_vector_size(0), own_dp(true)
     {
       this->init();
     }
 
     template<typename Scalar>
-    LinearSolver<Scalar>::LinearSolver(DiscreteProblemLinear<Scalar>* dp) : dp(dp), sln_vector(NULL), own_dp(false)
+    LinearSolver<Scalar>::LinearSolver(DiscreteProblemLinear<Scalar>* dp) : dp(dp), sln_vector(NULL), expanded_sln_vector(NULL), expanded_sln_vector_size(0), own_dp(false)
     {
       this->init();
     }
 
     template<typename Scalar>
-    LinearSolver<Scalar>::LinearSolver(const WeakForm<Scalar>* wf, const Space<Scalar>* space) : dp(new DiscreteProblemLinear<Scalar>(wf, space)), sln_vector(NULL), own_dp(true)
+    LinearSolver<Scalar>::LinearSolver(const WeakForm<Scalar>* wf, const Space<Scalar>* space) : dp(new DiscreteProblemLinear<Scalar>(wf, space)), sln_vector(NULL), expanded_sln_vector(NULL), expanded_sln_vector_size(0), own_dp(true)
     {
       this->init();
     }
 
     template<typename Scalar>
-    LinearSolver<Scalar>::LinearSolver(const WeakForm<Scalar>* wf, Hermes::vector<const Space<Scalar>*> spaces) : dp(new DiscreteProblemLinear<Scalar>(wf, spaces)), sln_vector(NULL), own_dp(true)
+    LinearSolver<Scalar>::LinearSolver(const WeakForm<Scalar>* wf, Hermes::vector<const Space<Scalar>*> spaces) : dp(new DiscreteProblemLinear<Scalar>(wf, spaces)), sln_vector(NULL), expanded_sln_vector(NULL), expanded_sln_vector_size(0), own_dp(true)
     {
       this->init();
     }
@@ -58,6 +58,13 @@ namespace Hermes
       this->residual = create_vector<Scalar>();
       this->matrix_solver = create_linear_solver<Scalar>(this->jacobian, this->residual);
       this->set_verbose_output(true);
+      this->time_independent_jacobian = false;
+      this->jacobian_valid = false;
+      this->jacobian_time_step = 0.0;
+      this->jacobian_wf = NULL;
+      this->jacobian_ndof = -1;
+      this->num_saved_assemblies = 0;
+      this->pipelined_analysis = false;
     }
 
     template<typename Scalar>
@@ -85,12 +92,14 @@ namespace Hermes
     void LinearSolver<Scalar>::set_weak_formulation(const WeakForm<Scalar>* wf)
     {
       (static_cast<DiscreteProblem<Scalar>*>(this->dp))->set_weak_formulation(wf);
+      this->jacobian_valid = false;
     }
 
     template<typename Scalar>
     void LinearSolver<Scalar>::set_time_step(double time_step)
     {
       const_cast<WeakForm<Scalar>*>(this->dp->wf)->set_current_time_step(time_step);
+      this->jacobian_valid = false;
     }
 
     template<typename Scalar>
@@ -105,16 +114,77 @@ namespace Hermes
       return this->residual;
     }
 
+    template<typename Scalar>
+    void LinearSolver<Scalar>::set_static_condensation(bool to_set)
+    {
+      static_cast<DiscreteProblem<Scalar>*>(this->dp)->set_static_condensation(to_set);
+      this->jacobian_valid = false;
+    }
+
+    template<typename Scalar>
+    void LinearSolver<Scalar>::set_time_independent_jacobian(bool onOff)
+    {
+      this->time_independent_jacobian = onOff;
+      this->jacobian_valid = false;
+    }
+
+    template<typename Scalar>
+    unsigned int LinearSolver<Scalar>::get_num_saved_assemblies() const
+    {
+      return this->num_saved_assemblies;
+    }
+
+    template<typename Scalar>
+    void LinearSolver<Scalar>::set_pipelined_analysis(bool to_set)
+    {
+      this->pipelined_analysis = to_set;
+    }
+
+    template<typename Scalar>
+    bool LinearSolver<Scalar>::jacobian_reusable()
+    {
+      if(!this->time_independent_jacobian || !this->jacobian_valid)
+        return false;
+      DiscreteProblem<Scalar>* dp_full = static_cast<DiscreteProblem<Scalar>*>(this->dp);
+      if(dp_full->get_static_condensation())
+        return false;
+      if(dp_full->get_weak_formulation() != this->jacobian_wf || dp_full->get_weak_formulation()->get_current_time_step() != this->jacobian_time_step)
+        return false;
+      Hermes::vector<const Space<Scalar>*> spaces = dp_full->get_spaces();
+      if(spaces.size() != this->jacobian_space_seqs.size() || Space<Scalar>::get_num_dofs(spaces) != this->jacobian_ndof)
+        return false;
+      for(unsigned int i = 0; i < spaces.size(); i++)
+        if(spaces[i]->get_seq() != this->jacobian_space_seqs[i])
+          return false;
+      return true;
+    }
+
+    template<typename Scalar>
+    void LinearSolver<Scalar>::store_jacobian_key()
+    {
+      DiscreteProblem<Scalar>* dp_full = static_cast<DiscreteProblem<Scalar>*>(this->dp);
+      Hermes::vector<const Space<Scalar>*> spaces = dp_full->get_spaces();
+      this->jacobian_space_seqs.clear();
+      for(unsigned int i = 0; i < spaces.size(); i++)
+        this->jacobian_space_seqs.push_back(spaces[i]->get_seq());
+      this->jacobian_ndof = Space<Scalar>::get_num_dofs(spaces);
+      this->jacobian_wf = dp_full->get_weak_formulation();
+      this->jacobian_time_step = this->jacobian_wf->get_current_time_step();
+      this->jacobian_valid = !dp_full->get_static_condensation();
+    }
+
     template<typename Scalar>
     void LinearSolver<Scalar>::set_spaces(Hermes::vector<const Space<Scalar>*> spaces)
     {
       static_cast<DiscreteProblem<Scalar>*>(this->dp)->set_spaces(spaces);
+      this->jacobian_valid = false;
     }
 
     template<typename Scalar>
     void LinearSolver<Scalar>::set_space(const Space<Scalar>* space)
     {
       static_cast<DiscreteProblem<Scalar>*>(this->dp)->set_space(space);
+      this->jacobian_valid = false;
     }
     
     template<typename Scalar>
@@ -129,6 +199,9 @@ namespace Hermes
       delete jacobian;
       delete residual;
       delete matrix_solver;
+      this->free_ensemble();
+      if(expanded_sln_vector != NULL)
+        delete [] expanded_sln_vector;
       if(own_dp)
         delete this->dp;
       else
@@ -138,47 +211,113 @@ namespace Hermes
     template<typename Scalar>
     void LinearSolver<Scalar>::solve()
     {
+      Hermes::ProfilerRegion profiler_region("LinearSolver::solve");
       this->check();
 
       this->tick();
 
       this->on_initialization();
 
-      dp->assemble(this->jacobian, this->residual);
-      if(this->output_rhsOn && (this->output_rhsIterations == -1 || this->output_rhsIterations >= 1))
+      if(this->jacobian_reusable())
       {
-        char* fileName = new char[this->RhsFilename.length() + 5];
-        if(this->RhsFormat == Hermes::Algebra::DF_MATLAB_SPARSE)
-          sprintf(fileName, "%s%i.m", this->RhsFilename.c_str(), 1);
-        else
-          sprintf(fileName, "%s%i", this->RhsFilename.c_str(), 1);
-        FILE* rhs_file = fopen(fileName, "w+");
-        residual->dump(rhs_file, this->RhsVarname.c_str(), this->RhsFormat, this->rhs_number_format);
-        fclose(rhs_file);
+        // Only the right-hand side, the matrix and its factorization are kept.
+        dp->assemble(NULL, this->residual);
+        this->process_vector_output(residual, 1);
+        this->matrix_solver->set_factorization_scheme(HERMES_REUSE_FACTORIZATION_COMPLETELY);
+        this->num_saved_assemblies++;
       }
-      if(this->output_matrixOn && (this->output_matrixIterations == -1 || this->output_matrixIterations >= 1))
+      else
+      {
+        DiscreteProblem<Scalar>* dp_analyzed = static_cast<DiscreteProblem<Scalar>*>(this->dp);
+        bool analyze = this->pipelined_analysis && !dp_analyzed->get_static_condensation();
+        dp_analyzed->set_structure_analysis(analyze ? this->matrix_solver : NULL);
+        dp->assemble(this->jacobian, this->residual);
+        dp_analyzed->set_structure_analysis(NULL);
+        this->process_vector_output(residual, 1);
+        this->process_matrix_output(jacobian, 1);
+        if(this->time_independent_jacobian)
         {
-          char* fileName = new char[this->matrixFilename.length() + 5];
-          if(this->matrixFormat == Hermes::Algebra::DF_MATLAB_SPARSE)
-            sprintf(fileName, "%s%i.m", this->matrixFilename.c_str(), 1);
-          else
-            sprintf(fileName, "%s%i", this->matrixFilename.c_str(), 1);
-          FILE* matrix_file = fopen(fileName, "w+");
-
-          jacobian->dump(matrix_file, this->matrixVarname.c_str(), this->matrixFormat, this->matrix_number_format);
-          fclose(matrix_file);
+          this->matrix_solver->set_factorization_scheme(HERMES_FACTORIZE_FROM_SCRATCH);
+          this->store_jacobian_key();
         }
+      }
 
       this->matrix_solver->solve();
 
       this->sln_vector = matrix_solver->get_sln_vector();
 
+      // The bubble DOFs.
+      DiscreteProblem<Scalar>* dp_full = static_cast<DiscreteProblem<Scalar>*>(this->dp);
+      if(dp_full->get_static_condensation())
+      {
+        int ndof = dp_full->get_num_dofs();
+        if(this->expanded_sln_vector_size != ndof)
+        {
+          if(this->expanded_sln_vector != NULL)
+            delete [] this->expanded_sln_vector;
+          this->expanded_sln_vector = new Scalar[ndof];
+          this->expanded_sln_vector_size = ndof;
+        }
+        dp_full->expand_condensed_solution(this->sln_vector, this->expanded_sln_vector);
+        this->sln_vector = this->expanded_sln_vector;
+      }
+
       this->on_finish();
       
       this->tick();
       this->info("\tLinear solver solution duration: %f s.\n", this->last());
     }
 
+    template<typename Scalar>
+    void LinearSolver<Scalar>::solve_ensemble(const Hermes::vector<WeakForm<Scalar>*>& wfs)
+    {
+      Hermes::ProfilerRegion profiler_region("LinearSolver::solve_ensemble");
+      this->check();
+
+      this->tick();
+
+      if(this->ensemble_matrix_solvers.size() != wfs.size())
+      {
+        this->free_ensemble();
+        for(unsigned int instance_i = 0; instance_i < wfs.size(); instance_i++)
+        {
+          this->ensemble_jacobians.push_back(create_matrix<Scalar>());
+          this->ensemble_residuals.push_back(create_vector<Scalar>());
+          this->ensemble_matrix_solvers.push_back(create_linear_solver<Scalar>(this->ensemble_jacobians.back(), this->ensemble_residuals.back()));
+        }
+      }
+
+      static_cast<DiscreteProblem<Scalar>*>(this->dp)->assemble_ensemble(wfs, this->ensemble_jacobians, this->ensemble_residuals);
+
+      for(unsigned int instance_i = 0; instance_i < wfs.size(); instance_i++)
+        this->ensemble_matrix_solvers[instance_i]->solve();
+
+      this->tick();
+      this->info("\tLinear solver ensemble of %d instances solution duration: %f s.\n", (int)wfs.size(), this->last());
+    }
+
+    template<typename Scalar>
+    Scalar* LinearSolver<Scalar>::get_ensemble_sln_vector(int instance_i)
+    {
+      if(instance_i < 0 || instance_i >= (int)this->ensemble_matrix_solvers.size())
+        throw Exceptions::ValueException("instance_i", instance_i, 0, (int)this->ensemble_matrix_solvers.size() - 1);
+      return this->ensemble_matrix_solvers[instance_i]->get_sln_vector();
+    }
+
+    template<typename Scalar>
+    void LinearSolver<Scalar>::free_ensemble()
+    {
+      for(unsigned int instance_i = 0; instance_i < this->ensemble_matrix_solvers.size(); instance_i++)
+      {
+        delete this->ensemble_matrix_solvers[instance_i];
+        delete this->ensemble_jacobians[instance_i];
+        delete this->ensemble_residuals[instance_i];
+      }
+      this->ensemble_matrix_solvers.clear();
+      this->ensemble_jacobians.clear();
+      this->ensemble_residuals.clear();
+    }
+
     template<typename Scalar>
     Scalar *LinearSolver<Scalar>::get_sln_vector()
     {
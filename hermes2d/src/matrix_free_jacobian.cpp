@@ -0,0 +1,169 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "matrix_free_jacobian.h"
+#include <algorithm>
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    static inline void add_to_product(double& target, double v)
+    {
+#pragma omp atomic
+      target += v;
+    }
+
+    static inline void add_to_product(std::complex<double>& target, std::complex<double> v)
+    {
+#pragma omp critical (MatrixFreeJacobian_add)
+      target += v;
+    }
+
+    template<typename Scalar>
+    MatrixFreeJacobian<Scalar>::MatrixFreeJacobian(DiscreteProblem<Scalar>* dp, Scalar* coeff_vec, bool force_diagonal_blocks, Table* block_weights)
+      : SparseMatrix<Scalar>(dp->get_num_dofs()), dp(dp), coeff_vec(NULL), force_diagonal_blocks(force_diagonal_blocks), block_weights(block_weights),
+      vector_in(NULL), vector_out(NULL)
+    {
+      set_coeff_vector(coeff_vec);
+    }
+
+    template<typename Scalar>
+    MatrixFreeJacobian<Scalar>::~MatrixFreeJacobian()
+    {
+      if(this->coeff_vec != NULL)
+        delete [] this->coeff_vec;
+    }
+
+    template<typename Scalar>
+    void MatrixFreeJacobian<Scalar>::set_coeff_vector(Scalar* coeff_vec)
+    {
+      if(this->coeff_vec != NULL)
+      {
+        delete [] this->coeff_vec;
+        this->coeff_vec = NULL;
+      }
+      this->size = dp->get_num_dofs();
+      if(coeff_vec != NULL)
+      {
+        this->coeff_vec = new Scalar[this->size];
+        memcpy(this->coeff_vec, coeff_vec, this->size * sizeof(Scalar));
+      }
+    }
+
+    template<typename Scalar>
+    void MatrixFreeJacobian<Scalar>::multiply_with_vector(Scalar* vector_in, Scalar* vector_out)
+    {
+      if(this->size != (unsigned int)dp->get_num_dofs())
+        throw Hermes::Exceptions::Exception("The number of DOFs changed since the MatrixFreeJacobian was created, call set_coeff_vector().");
+
+      this->vector_in = vector_in;
+      this->vector_out = vector_out;
+      std::fill(vector_out, vector_out + this->size, Scalar(0));
+
+      dp->assemble(this->coeff_vec, this, NULL, this->force_diagonal_blocks, this->block_weights);
+
+      this->vector_in = NULL;
+      this->vector_out = NULL;
+    }
+
+    template<typename Scalar>
+    void MatrixFreeJacobian<Scalar>::prealloc(unsigned int n)
+    {
+    }
+
+    template<typename Scalar>
+    void MatrixFreeJacobian<Scalar>::pre_add_ij(unsigned int row, unsigned int col)
+    {
+    }
+
+    template<typename Scalar>
+    void MatrixFreeJacobian<Scalar>::alloc_with_structure(unsigned int n, const int* col_start, const int* rows)
+    {
+    }
+
+    template<typename Scalar>
+    void MatrixFreeJacobian<Scalar>::alloc()
+    {
+    }
+
+    template<typename Scalar>
+    void MatrixFreeJacobian<Scalar>::free()
+    {
+    }
+
+    template<typename Scalar>
+    void MatrixFreeJacobian<Scalar>::zero()
+    {
+    }
+
+    template<typename Scalar>
+    void MatrixFreeJacobian<Scalar>::add(unsigned int m, unsigned int n, Scalar v)
+    {
+      if(v != 0.0)
+        add_to_product(this->vector_out[m], v * this->vector_in[n]);
+    }
+
+    template<typename Scalar>
+    void MatrixFreeJacobian<Scalar>::add(unsigned int m, unsigned int n, Scalar **mat, int *rows, int *cols)
+    {
+      for (unsigned int i = 0; i < m; i++)       // rows
+      {
+        if(rows[i] < 0)
+          continue;
+        Scalar result = 0.0;
+        for (unsigned int j = 0; j < n; j++)     // cols
+          if(cols[j] >= 0) // not Dir. dofs.
+            result += mat[i][j] * this->vector_in[cols[j]];
+        add_to_product(this->vector_out[rows[i]], result);
+      }
+    }
+
+    template<typename Scalar>
+    void MatrixFreeJacobian<Scalar>::add_to_diagonal(Scalar v)
+    {
+      for (unsigned int i = 0; i < this->size; i++)
+        add(i, i, v);
+    }
+
+    template<typename Scalar>
+    Scalar MatrixFreeJacobian<Scalar>::get(unsigned int m, unsigned int n)
+    {
+      throw Hermes::Exceptions::Exception("The entries of MatrixFreeJacobian are not stored.");
+      return 0.0;
+    }
+
+    template<typename Scalar>
+    bool MatrixFreeJacobian<Scalar>::dump(FILE *file, const char *var_name, EMatrixDumpFormat fmt, char* number_format)
+    {
+      return false;
+    }
+
+    template<typename Scalar>
+    unsigned int MatrixFreeJacobian<Scalar>::get_matrix_size() const
+    {
+      return this->size;
+    }
+
+    template<typename Scalar>
+    double MatrixFreeJacobian<Scalar>::get_fill_in() const
+    {
+      return 0.0;
+    }
+
+    template class HERMES_API MatrixFreeJacobian<double>;
+    template class HERMES_API MatrixFreeJacobian<std::complex<double> >;
+  }
+}
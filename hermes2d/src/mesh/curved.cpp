@@ -22,6 +22,7 @@
 #include "mesh.h"
 #include "quad_all.h"
 #include "matrix.h"
+#include "precalculated_tables.h"
 
 using namespace Hermes::Algebra::DenseMatrixOperations;
 namespace Hermes
@@ -39,7 +40,8 @@ namespace Hermes
     Quad1DStd CurvMap::quad1d;
     Quad2DStd CurvMap::quad2d;
 
-    Trf CurvMap::ctm;
+    std::map<CurvMap::CoeffsCacheKey, std::pair<int, double2*> > CurvMap::coeffs_cache;
+
 
     static double lambda_0(double x, double y)
     {
@@ -56,27 +58,132 @@ namespace Hermes
 
     bool CurvMap::warning_issued = false;
 
-    double CurvMap::nurbs_basis_fn(int i, int k, double t, double* knot)
+    /// Degrees of the curves whose basis functions are calculated in the arrays on the stack.
+    static const int H2D_NURBS_STACK_DEGREE = 15;
+
+    int CurvMap::nurbs_find_span(const Nurbs* nurbs, double t, int guess)
     {
-      if(k == 0)
+      int p = nurbs->degree;
+      int last = nurbs->np - 1;
+      const double* kv = nurbs->kv;
+
+      // The ends of the curve, the empty spans of the repeated knots are skipped.
+      if(t >= kv[last + 1])
       {
-        return (t >= knot[i] && t <= knot[i + 1] && knot[i] < knot[i + 1]) ? 1.0 : 0.0;
+        int span = last;
+        while(span > p && kv[span] >= kv[span + 1])
+          span--;
+        return span;
       }
-      else
+      if(t <= kv[p])
       {
-        double N1 = nurbs_basis_fn(i, k-1, t, knot);
-        double N2 = nurbs_basis_fn(i + 1, k-1, t, knot);
+        int span = p;
+        while(span < last && kv[span] >= kv[span + 1])
+          span++;
+        return span;
+      }
+
+      // The points of a batch mostly lie in the span of the previous one, or in one of the next ones.
+      if(guess >= p && guess <= last && kv[guess] <= t)
+      {
+        while(kv[guess + 1] <= t)
+          guess++;
+        return guess;
+      }
+
+      // kv[low] <= t < kv[high].
+      int low = p, high = last + 1;
+      while(high - low > 1)
+      {
+        int mid = (low + high) / 2;
+        if(t < kv[mid])
+          high = mid;
+        else
+          low = mid;
+      }
+      return low;
+    }
+
+    void CurvMap::nurbs_basis_fns(const Nurbs* nurbs, int span, double t, double* N)
+    {
+      int p = nurbs->degree;
+      const double* kv = nurbs->kv;
+
+      double left_stack[H2D_NURBS_STACK_DEGREE + 1], right_stack[H2D_NURBS_STACK_DEGREE + 1];
+      std::vector<double> left_heap, right_heap;
+      double* left = left_stack;
+      double* right = right_stack;
+      if(p > H2D_NURBS_STACK_DEGREE)
+      {
+        left_heap.resize(p + 1);
+        right_heap.resize(p + 1);
+        left = &left_heap[0];
+        right = &right_heap[0];
+      }
 
-        double result = 0.0;
-        if(knot[i + k] != knot[i])
+      // N_{span - j}, ..., N_{span} of the degree j from those of the degree j - 1.
+      N[0] = 1.0;
+      for (int j = 1; j <= p; j++)
+      {
+        left[j] = t - kv[span + 1 - j];
+        right[j] = kv[span + j] - t;
+        double saved = 0.0;
+        for (int r = 0; r < j; r++)
         {
-          result += ((t - knot[i]) / (knot[i + k] - knot[i])) * N1;
+          double temp = N[r] / (right[r + 1] + left[j - r]);
+          N[r] = saved + right[r + 1] * temp;
+          saved = left[j - r] * temp;
         }
-        if(knot[i + k+1] != knot[i + 1])
+        N[j] = saved;
+      }
+    }
+
+    void CurvMap::nurbs_point(const Nurbs* nurbs, double t, int& span, double& x, double& y)
+    {
+      int p = nurbs->degree;
+      double N_stack[H2D_NURBS_STACK_DEGREE + 1];
+      std::vector<double> N_heap;
+      double* N = N_stack;
+      if(p > H2D_NURBS_STACK_DEGREE)
+      {
+        N_heap.resize(p + 1);
+        N = &N_heap[0];
+      }
+
+      span = nurbs_find_span(nurbs, t, span);
+      nurbs_basis_fns(nurbs, span, t, N);
+
+      double3* cp = nurbs->pt;
+      x = y = 0.0;
+      double sum = 0.0;  // sum of basis fns and weights
+      for (int r = 0; r <= p; r++)
+      {
+        int i = span - p + r;
+        double w_basis = cp[i][2] * N[r];
+        sum += w_basis;
+        x += w_basis * cp[i][0];
+        y += w_basis * cp[i][1];
+      }
+      x /= sum;
+      y /= sum;
+    }
+
+    void CurvMap::nurbs_edge_points(Element* e, Nurbs* nurbs, int edge, int n, const double* t, double2* pts)
+    {
+      Node* A = e->vn[edge];
+      Node* B = e->vn[e->next_vert(edge)];
+      int span = -1;
+      for (int i = 0; i < n; i++)
+      {
+        // Nurbs curves are parametrized from 0 to 1.
+        double s = (t[i] + 1.0) / 2.0;
+        if(nurbs == NULL)
         {
-          result += ((knot[i + k+1] - t) / (knot[i + k+1] - knot[i + 1])) * N2;
+          pts[i][0] = A->x + s * (B->x - A->x);
+          pts[i][1] = A->y + s * (B->y - A->y);
         }
-        return result;
+        else
+          nurbs_point(nurbs, s, span, pts[i][0], pts[i][1]);
       }
     }
 
@@ -114,23 +221,8 @@ namespace Hermes
         // Circular arc.
         if(nurbs->arc)
         {
-          double3* cp = nurbs->pt;
-          x = y = 0.0;
-          double sum = 0.0;  // sum of basis fns and weights
-
-          for (int i = 0; i < nurbs->np; i++)
-          {
-            double basis = nurbs_basis_fn(i, nurbs->degree, t, nurbs->kv);
-            sum += cp[i][2] * basis;
-            double x_i = cp[i][0];
-            double y_i = cp[i][1];
-            double w_i = cp[i][2];
-            x   += w_i * basis * x_i;
-            y   += w_i * basis * y_i;
-          }
-
-          x /= sum;
-          y /= sum;
+          int span = -1;
+          nurbs_point(nurbs, t, span, x, y);
 
           // Normal and tangential vectors.
           // FIXME; This calculation is artificial and it assumes that
@@ -246,24 +338,10 @@ namespace Hermes
         // FIXME - calculation of normal and tangential vectors needs to be added.
         else
         {
-          double3* cp = nurbs->pt;
-          x = y = 0.0;
-          double sum = 0.0;  // sum of basis fns and weights
-
-          for (int i = 0; i < nurbs->np; i++)
-          {
-            double basis = nurbs_basis_fn(i, nurbs->degree, t, nurbs->kv);
-            sum += cp[i][2] * basis;
-            double x_i = cp[i][0];
-            double y_i = cp[i][1];
-            double w_i = cp[i][2];
-            x   += w_i * basis * x_i;
-            y   += w_i * basis * y_i;
-          }
-
-          x /= sum;
-          y /= sum;
+          int span = -1;
+          nurbs_point(nurbs, t, span, x, y);
 
+#pragma omp critical (curv_map_warning)
           if(!warning_issued)
           {
             printf("FIXME: IMPLEMENT CALCULATION OF n_x, n_y, t_x, t_y in nurbs_edge() !!!\n");
@@ -384,6 +462,101 @@ namespace Hermes
         calc_ref_map_tri(e, nurbs, xi_1, xi_2, f[0], f[1]);
     }
 
+    static double lambda(int vertex, double x, double y)
+    {
+      switch(vertex)
+      {
+      case 0:
+        return lambda_0(x, y);
+      case 1:
+        return lambda_1(x, y);
+      default:
+        return lambda_2(x, y);
+      }
+    }
+
+    void CurvMap::calc_ref_map(Element* e, Nurbs** nurbs, int n, const double* xi_1, const double* xi_2, double2* f)
+    {
+      double* t = new double[n];
+
+      if(e->get_mode() == HERMES_MODE_QUAD)
+      {
+        // The same as calc_ref_map_quad(), the edges in all the points first.
+        double2* ex = new double2[H2D_MAX_NUMBER_EDGES * n];
+        for (int edge = 0; edge < H2D_MAX_NUMBER_EDGES; edge++)
+        {
+          const double* xi = (edge % 2 == 0) ? xi_1 : xi_2;
+          double sign = (edge < 2) ? 1.0 : -1.0;
+          for (int i = 0; i < n; i++)
+            t[i] = sign * xi[i];
+          nurbs_edge_points(e, nurbs[edge], edge, n, t, ex + edge * n);
+        }
+
+        for (int i = 0; i < n; i++)
+        {
+          double x1 = xi_1[i], x2 = xi_2[i];
+          for (int k = 0; k < 2; k++)
+          {
+            double v0 = k == 0 ? e->vn[0]->x : e->vn[0]->y, v1 = k == 0 ? e->vn[1]->x : e->vn[1]->y;
+            double v2 = k == 0 ? e->vn[2]->x : e->vn[2]->y, v3 = k == 0 ? e->vn[3]->x : e->vn[3]->y;
+            f[i][k] = (1-x2)/2.0 * ex[i][k] + (1 + x1)/2.0 * ex[n + i][k] +
+              (1 + x2)/2.0 * ex[2 * n + i][k] + (1-x1)/2.0 * ex[3 * n + i][k] -
+              (1-x1)*(1-x2)/4.0 * v0 - (1 + x1)*(1-x2)/4.0 * v1 -
+              (1 + x1)*(1 + x2)/4.0 * v2 - (1-x1)*(1 + x2)/4.0 * v3;
+          }
+        }
+        delete [] ex;
+      }
+      else
+      {
+        // The same as calc_ref_map_tri(), each edge in all the points (but its end points) at once.
+        double2* ep = new double2[n];
+        int* edge_points = new int[n];
+        for (int i = 0; i < n; i++)
+          f[i][0] = f[i][1] = 0.0;
+
+        for (unsigned int j = 0; j < e->get_nvert(); j++)
+        {
+          int va = j;
+          int vb = e->next_vert(j);
+          int num_edge_points = 0;
+          for (int i = 0; i < n; i++)
+          {
+            // vertex part
+            double l_a = lambda(va, xi_1[i], xi_2[i]);
+            f[i][0] += e->vn[j]->x * l_a;
+            f[i][1] += e->vn[j]->y * l_a;
+
+            if(!(((ref_vert[0][va][0] == xi_1[i]) && (ref_vert[0][va][1] == xi_2[i])) ||
+              ((ref_vert[0][vb][0] == xi_1[i]) && (ref_vert[0][vb][1] == xi_2[i]))))
+            {
+              t[num_edge_points] = lambda(vb, xi_1[i], xi_2[i]) - l_a;
+              edge_points[num_edge_points++] = i;
+            }
+          }
+
+          // edge part, see nurbs_edge_0()
+          nurbs_edge_points(e, nurbs[j], j, num_edge_points, t, ep);
+          for (int m = 0; m < num_edge_points; m++)
+          {
+            int i = edge_points[m];
+            double l_a = lambda(va, xi_1[i], xi_2[i]);
+            double l_b = lambda(vb, xi_1[i], xi_2[i]);
+            double tm = t[m];
+            double k = 4.0 / ((1-tm) * (1 + tm));
+            double fx = (ep[m][0] - 0.5 * ((1-tm) * (e->vn[va]->x) + (1 + tm) * (e->vn[vb]->x))) * k;
+            double fy = (ep[m][1] - 0.5 * ((1-tm) * (e->vn[va]->y) + (1 + tm) * (e->vn[vb]->y))) * k;
+            f[i][0] += fx * l_a  * l_b;
+            f[i][1] += fy * l_a  * l_b;
+          }
+        }
+        delete [] ep;
+        delete [] edge_points;
+      }
+
+      delete [] t;
+    }
+
     //// projection based interpolation ////////////////////////////////////////////////////////////////
 
     // preparation of projection matrices, Cholesky factorization
@@ -392,6 +565,10 @@ namespace Hermes
       int order = ref_map_shapeset->get_max_order();
       int n = order - 1; // number of edge basis functions
 
+      bool cached = PrecalculatedTables::is_enabled();
+      if(cached && !edge_proj_matrix && PrecalculatedTables::load("curved_edge", order, n, edge_proj_matrix, edge_p))
+        return;
+
       if(!edge_proj_matrix)
         edge_proj_matrix = new_matrix<double>(n, n);
 
@@ -496,6 +673,9 @@ namespace Hermes
       if(!edge_p)
         edge_p = new double[n];
       choldc(edge_proj_matrix, n, edge_p);
+
+      if(cached)
+        PrecalculatedTables::save("curved_edge", order, n, edge_proj_matrix, edge_p);
     }
 
     // calculate the H1 seminorm products (\phi_i, \phi_j) for all 0 <= i, j < n, n is the number of bubble functions
@@ -535,17 +715,24 @@ namespace Hermes
     {
       // *** triangles ***
       int order = ref_map_shapeset->get_max_order();
+      bool cached = PrecalculatedTables::is_enabled();
 
       // calculate projection matrix of maximum order
       if(ref_map_pss->get_active_element()->get_mode() == HERMES_MODE_TRIANGLE)
       {
         int nb = ref_map_shapeset->get_num_bubbles(order, HERMES_MODE_TRIANGLE);
-        int* indices = ref_map_shapeset->get_bubble_indices(order, HERMES_MODE_TRIANGLE);
-        bubble_proj_matrix_tri = calculate_bubble_projection_matrix(nb, indices, ref_map_shapeset, ref_map_pss, HERMES_MODE_TRIANGLE);
+        if(!cached || !PrecalculatedTables::load("curved_bubble_tri", order, nb, bubble_proj_matrix_tri, bubble_tri_p))
+        {
+          int* indices = ref_map_shapeset->get_bubble_indices(order, HERMES_MODE_TRIANGLE);
+          bubble_proj_matrix_tri = calculate_bubble_projection_matrix(nb, indices, ref_map_shapeset, ref_map_pss, HERMES_MODE_TRIANGLE);
+
+          // cholesky factorization of the matrix
+          bubble_tri_p = new double[nb];
+          choldc(bubble_proj_matrix_tri, nb, bubble_tri_p);
 
-        // cholesky factorization of the matrix
-        bubble_tri_p = new double[nb];
-        choldc(bubble_proj_matrix_tri, nb, bubble_tri_p);
+          if(cached)
+            PrecalculatedTables::save("curved_bubble_tri", order, nb, bubble_proj_matrix_tri, bubble_tri_p);
+        }
       }
 
       // *** quads ***
@@ -555,20 +742,26 @@ namespace Hermes
       {
         order = H2D_MAKE_QUAD_ORDER(order, order);
         int nb = ref_map_shapeset->get_num_bubbles(order, HERMES_MODE_QUAD);
-        int *indices = ref_map_shapeset->get_bubble_indices(order, HERMES_MODE_QUAD);
+        if(!cached || !PrecalculatedTables::load("curved_bubble_quad", H2D_GET_H_ORDER(order), nb, bubble_proj_matrix_quad, bubble_quad_p))
+        {
+          int *indices = ref_map_shapeset->get_bubble_indices(order, HERMES_MODE_QUAD);
 
-        bubble_proj_matrix_quad = calculate_bubble_projection_matrix(nb, indices, ref_map_shapeset, ref_map_pss, HERMES_MODE_QUAD);
+          bubble_proj_matrix_quad = calculate_bubble_projection_matrix(nb, indices, ref_map_shapeset, ref_map_pss, HERMES_MODE_QUAD);
 
-        // cholesky factorization of the matrix
-        bubble_quad_p = new double[nb];
-        choldc(bubble_proj_matrix_quad, nb, bubble_quad_p);
+          // cholesky factorization of the matrix
+          bubble_quad_p = new double[nb];
+          choldc(bubble_proj_matrix_quad, nb, bubble_quad_p);
+
+          if(cached)
+            PrecalculatedTables::save("curved_bubble_quad", H2D_GET_H_ORDER(order), nb, bubble_proj_matrix_quad, bubble_quad_p);
+        }
       }
     }
 
     //// edge part of projection based interpolation ///////////////////////////////////////////////////
 
     // compute point (x, y) in reference element, edge vector (v1, v2)
-    void CurvMap::edge_coord(Element* e, int edge, double t, double2& x, double2& v)
+    void CurvMap::edge_coord(Element* e, const Trf& ctm, int edge, double t, double2& x, double2& v)
     {
       int mode = e->get_mode();
       double2 a, b;
@@ -586,7 +779,7 @@ namespace Hermes
       v[0] /= lenght; v[1] /= lenght;
     }
 
-    void CurvMap::calc_edge_projection(Element* e, int edge, Nurbs** nurbs, int order, double2* proj, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss)
+    void CurvMap::calc_edge_projection(Element* e, const Trf& ctm, int edge, Nurbs** nurbs, int order, double2* proj, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss)
     {
       ref_map_pss->set_active_element(e);
 
@@ -615,13 +808,18 @@ namespace Hermes
       calc_ref_map(e, nurbs, b_1, b_2, fb);
 
       double2* pt = quad1d.get_points(mo1);
+      double xi_1[15], xi_2[15];
       for (j = 0; j < np; j++) // over all integration points
       {
         double2 x, v;
+        edge_coord(e, ctm, edge, pt[j][0], x, v);
+        xi_1[j] = x[0];
+        xi_2[j] = x[1];
+      }
+      calc_ref_map(e, nurbs, np, xi_1, xi_2, fn);
+      for (j = 0; j < np; j++)
+      {
         double t = pt[j][0];
-        edge_coord(e, edge, t, x, v);
-        calc_ref_map(e, nurbs, x[0], x[1], fn[j]);
-
         for (k = 0; k < 2; k++)
           fn[j][k] = fn[j][k] - (fa[k] + (t + 1)/2.0 * (fb[k] - fa[k]));
       }
@@ -720,7 +918,7 @@ namespace Hermes
       }
     }
 
-    void CurvMap::calc_bubble_projection(Element* e, Nurbs** nurbs, int order, double2* proj, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss)
+    void CurvMap::calc_bubble_projection(Element* e, const Trf& ctm, Nurbs** nurbs, int order, double2* proj, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss)
     {
       ref_map_pss->set_active_element(e);
 
@@ -748,13 +946,16 @@ namespace Hermes
 
       // fn values of both components of nonpolynomial function
       double3* pt = quad2d.get_points(mo2, e->get_mode());
+      double* xi_1 = new double[np];
+      double* xi_2 = new double[np];
       for (j = 0; j < np; j++)  // over all integration points
       {
-        double2 a;
-        a[0] = ctm.m[0] * pt[j][0] + ctm.t[0];
-        a[1] = ctm.m[1] * pt[j][1] + ctm.t[1];
-        calc_ref_map(e, nurbs, a[0], a[1], fn[j]);
+        xi_1[j] = ctm.m[0] * pt[j][0] + ctm.t[0];
+        xi_2[j] = ctm.m[1] * pt[j][1] + ctm.t[1];
       }
+      calc_ref_map(e, nurbs, np, xi_1, xi_2, fn);
+      delete [] xi_1;
+      delete [] xi_2;
 
       double2* result = proj + e->get_nvert() + e->get_nvert() * (order - 1);
       for (k = 0; k < 2; k++)
@@ -792,7 +993,7 @@ namespace Hermes
 
     ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    void CurvMap::ref_map_projection(Element* e, Nurbs** nurbs, int order, double2* proj, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss)
+    void CurvMap::ref_map_projection(Element* e, const Trf& ctm, Nurbs** nurbs, int order, double2* proj, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss)
     {
       // vertex part
       for (unsigned int i = 0; i < e->get_nvert(); i++)
@@ -806,10 +1007,24 @@ namespace Hermes
 
       // edge part
       for (int edge = 0; edge < (int)e->get_nvert(); edge++)
-        calc_edge_projection(e, edge, nurbs, order, proj, ref_map_shapeset, ref_map_pss);
+        calc_edge_projection(e, ctm, edge, nurbs, order, proj, ref_map_shapeset, ref_map_pss);
 
       //bubble part
-      calc_bubble_projection(e, nurbs, order, proj, ref_map_shapeset, ref_map_pss);
+      calc_bubble_projection(e, ctm, nurbs, order, proj, ref_map_shapeset, ref_map_pss);
+    }
+
+    void CurvMap::precalculate_projection_matrices(Element* e, H1ShapesetJacobi* ref_map_shapeset, PrecalcShapeset* ref_map_pss)
+    {
+      // The meshes are read (and refined) in parallel, the first elements of all the threads come here at once.
+#pragma omp critical (curv_map_projection_matrices)
+      {
+        if(edge_proj_matrix == NULL)
+          precalculate_cholesky_projection_matrix_edge(ref_map_shapeset, ref_map_pss);
+        if(bubble_proj_matrix_tri == NULL && e->get_mode() == HERMES_MODE_TRIANGLE)
+          precalculate_cholesky_projection_matrices_bubble(ref_map_shapeset, ref_map_pss);
+        if(bubble_proj_matrix_quad == NULL && e->get_mode() == HERMES_MODE_QUAD)
+          precalculate_cholesky_projection_matrices_bubble(ref_map_shapeset, ref_map_pss);
+      }
     }
 
     void CurvMap::update_refmap_coeffs(Element* e)
@@ -821,12 +1036,7 @@ namespace Hermes
       ref_map_pss.set_active_element(e);
 
       // calculation of projection matrices
-      if(edge_proj_matrix == NULL)
-        precalculate_cholesky_projection_matrix_edge(&ref_map_shapeset, &ref_map_pss);
-      if(bubble_proj_matrix_tri == NULL && e->get_mode() == HERMES_MODE_TRIANGLE)
-        precalculate_cholesky_projection_matrices_bubble(&ref_map_shapeset, &ref_map_pss);
-      if(bubble_proj_matrix_quad == NULL && e->get_mode() == HERMES_MODE_QUAD)
-        precalculate_cholesky_projection_matrices_bubble(&ref_map_shapeset, &ref_map_pss);
+      precalculate_projection_matrices(e, &ref_map_shapeset, &ref_map_pss);
 
       // allocate projection coefficients
       int nv = e->get_nvert();
@@ -844,6 +1054,24 @@ namespace Hermes
       // WARNING: do not change the format of the array 'coeffs'. If it changes,
       // RefMap::set_active_element() has to be changed too.
 
+      // refined elements: the same part of the same base mesh element may have been projected already
+      if(toplevel == false)
+      {
+        CoeffsCacheKey key(e, parent, part, order);
+        bool found = false;
+#pragma omp critical (curv_map_coeffs_cache)
+        {
+          std::map<CoeffsCacheKey, std::pair<int, double2*> >::const_iterator it = coeffs_cache.find(key);
+          if(it != coeffs_cache.end() && it->second.first == nc)
+          {
+            memcpy(coeffs, it->second.second, sizeof(double2) * nc);
+            found = true;
+          }
+        }
+        if(found)
+          return;
+      }
+
       Nurbs** nurbs;
       if(toplevel == false)
       {
@@ -856,11 +1084,83 @@ namespace Hermes
         ref_map_pss.reset_transform();
         nurbs = e->cm->nurbs;
       }
-      ctm = *(ref_map_pss.get_ctm());
+      Trf ctm = *(ref_map_pss.get_ctm());
       ref_map_pss.reset_transform(); // fixme - do we need this?
 
       // calculation of new projection coefficients
-      ref_map_projection(e, nurbs, order, coeffs, &ref_map_shapeset, &ref_map_pss);
+      ref_map_projection(e, ctm, nurbs, order, coeffs, &ref_map_shapeset, &ref_map_pss);
+
+      if(toplevel == false)
+      {
+#pragma omp critical (curv_map_coeffs_cache)
+        {
+          if(coeffs_cache.size() >= (size_t)H2D_MAX_CACHED_COEFFS)
+            clear_coeffs_cache();
+          CoeffsCacheKey key(e, parent, part, order);
+          if(coeffs_cache.find(key) == coeffs_cache.end())
+          {
+            double2* cached = new double2[nc];
+            memcpy(cached, coeffs, sizeof(double2) * nc);
+            coeffs_cache.insert(std::pair<CoeffsCacheKey, std::pair<int, double2*> >(key, std::pair<int, double2*>(nc, cached)));
+            for (int i = 0; i < H2D_MAX_NUMBER_EDGES; i++)
+              if(key.nurbs[i] != NULL)
+              {
+#pragma omp atomic
+                key.nurbs[i]->ref++;
+              }
+          }
+        }
+      }
+    }
+
+    void CurvMap::precalculate_refmap_coeffs(const std::vector<Element*>& elements, int num_threads)
+    {
+      if(elements.empty())
+        return;
+
+      // The projection matrices first, so that the threads do not wait for each other on them.
+      elements[0]->cm->update_refmap_coeffs(elements[0]);
+
+#pragma omp parallel for schedule(dynamic, 8) num_threads(num_threads)
+      for (int i = 1; i < (int)elements.size(); i++)
+        elements[i]->cm->update_refmap_coeffs(elements[i]);
+    }
+
+    void CurvMap::clear_coeffs_cache()
+    {
+      for (std::map<CoeffsCacheKey, std::pair<int, double2*> >::iterator it = coeffs_cache.begin(); it != coeffs_cache.end(); it++)
+      {
+        delete [] it->second.second;
+        for (int i = 0; i < H2D_MAX_NUMBER_EDGES; i++)
+          if(it->first.nurbs[i] != NULL)
+            it->first.nurbs[i]->unref();
+      }
+      coeffs_cache.clear();
+    }
+
+    CurvMap::CoeffsCacheKey::CoeffsCacheKey(Element* e, Element* parent, uint64_t part, int order)
+    {
+      memset(this, 0, sizeof(CoeffsCacheKey));
+      this->nvert = e->get_nvert();
+      this->order = order;
+      this->part = part;
+      for (unsigned int i = 0; i < e->get_nvert(); i++)
+      {
+        this->vertices[2 * i] = e->vn[i]->x;
+        this->vertices[2 * i + 1] = e->vn[i]->y;
+      }
+      // A triangle may have been refined to quads.
+      for (unsigned int i = 0; i < parent->get_nvert(); i++)
+      {
+        this->parent_vertices[2 * i] = parent->vn[i]->x;
+        this->parent_vertices[2 * i + 1] = parent->vn[i]->y;
+        this->nurbs[i] = parent->cm->nurbs[i];
+      }
+    }
+
+    bool CurvMap::CoeffsCacheKey::operator<(const CoeffsCacheKey& other) const
+    {
+      return memcmp(this, &other, sizeof(CoeffsCacheKey)) < 0;
     }
 
     void CurvMap::get_mid_edge_points(Element* e, double2* pt, int n)
@@ -876,14 +1176,17 @@ namespace Hermes
         nurbs = e->cm->nurbs;
       }
 
-      ctm = *(tran.get_ctm());
-      double xi_1, xi_2;
+      Trf ctm = *(tran.get_ctm());
+      double* xi_1 = new double[n];
+      double* xi_2 = new double[n];
       for (int i = 0; i < n; i++)
       {
-        xi_1 = ctm.m[0] * pt[i][0] + ctm.t[0];
-        xi_2 = ctm.m[1] * pt[i][1] + ctm.t[1];
-        calc_ref_map(e, nurbs, xi_1, xi_2, pt[i]);
+        xi_1[i] = ctm.m[0] * pt[i][0] + ctm.t[0];
+        xi_2[i] = ctm.m[1] * pt[i][1] + ctm.t[1];
       }
+      calc_ref_map(e, nurbs, n, xi_1, xi_2, pt);
+      delete [] xi_1;
+      delete [] xi_2;
     }
 
     void Nurbs::unref()
@@ -905,7 +1208,11 @@ namespace Hermes
       if(toplevel)
         for (int i = 0; i < 4; i++)
           if(nurbs[i] != NULL)
+          {
+            // The curves are shared with the copied map, whose mesh may be copied by several threads at once.
+#pragma omp atomic
             nurbs[i]->ref++;
+          }
     }
 
     CurvMap::~CurvMap()
@@ -24,6 +24,9 @@ namespace Hermes
     HashTable::HashTable()
     {
       v_table = NULL; e_table = NULL;
+      locks = NULL;
+      node_stamps = thread_stamps = NULL;
+      first_stamped_node = 0;
     }
 
     HashTable::~HashTable()
@@ -46,17 +49,6 @@ namespace Hermes
       memset(e_table, 0, size * sizeof(Node*));
     }
 
-    void HashTable::copy_list(Node** ptr, Node* node)
-    {
-      while (node != NULL)
-      {
-        *ptr = &nodes[node->id];
-        ptr = &((*ptr)->next_hash);
-        node = node->next_hash;
-      }
-      *ptr = NULL;
-    }
-
     Node* HashTable::get_node(int id) const
     {
       return &(nodes[id]);
@@ -80,13 +72,20 @@ namespace Hermes
       nodes.copy(ht->nodes);
       mask = ht->mask;
 
+      // The hash chains are the same, only their pointers are translated to the copy.
+      std::vector<std::pair<Node*, Node*> > node_pages;
+      nodes.get_page_map(ht->nodes, node_pages);
+
       v_table = new Node*[mask + 1];
       e_table = new Node*[mask + 1];
       for (int i = 0; i <= mask; i++)
       {
-        copy_list(v_table + i, ht->v_table[i]);
-        copy_list(e_table + i, ht->e_table[i]);
+        v_table[i] = Array<Node>::translate(node_pages, ht->v_table[i]);
+        e_table[i] = Array<Node>::translate(node_pages, ht->e_table[i]);
       }
+      for (int id = 0; id < nodes.get_size(); id++)
+        if(nodes[id].used)
+          nodes[id].next_hash = Array<Node>::translate(node_pages, nodes[id].next_hash);
     }
 
     void HashTable::rebuild()
@@ -114,6 +113,51 @@ namespace Hermes
       }
     }
 
+    void HashTable::rehash(int num_nodes)
+    {
+      int size = mask + 1;
+      if(size >= num_nodes)
+        return;
+      while (size < num_nodes)
+        size *= 2;
+
+      delete [] v_table;
+      delete [] e_table;
+      mask = size - 1;
+      v_table = new Node*[size];
+      e_table = new Node*[size];
+      rebuild();
+    }
+
+    void HashTable::get_hash_statistics(double& mean_probe_length, int& max_probe_length, int& num_buckets) const
+    {
+      long long total = 0;
+      int count = 0;
+      max_probe_length = 0;
+      num_buckets = mask + 1;
+      for (int i = 0; i <= mask; i++)
+      {
+        for (int table = 0; table < 2; table++)
+        {
+          int length = 0;
+          for (Node* node = (table == 0 ? v_table[i] : e_table[i]); node != NULL; node = node->next_hash)
+          {
+            length++;
+            total += length;
+            count++;
+          }
+          if(length > max_probe_length)
+            max_probe_length = length;
+        }
+      }
+      mean_probe_length = count > 0 ? (double) total / count : 0.0;
+    }
+
+    std::size_t HashTable::get_memory_size() const
+    {
+      return nodes.get_memory_size() + 2 * (mask + 1) * sizeof(Node*);
+    }
+
     void HashTable::free()
     {
       nodes.free();
@@ -142,15 +186,23 @@ namespace Hermes
 
     Node* HashTable::get_vertex_node(int p1, int p2)
     {
+      if(locks == NULL && nodes.get_num_items() >= mask + 1)
+        rehash(nodes.get_num_items() + 1);
+
       // search for the node in the vertex hashtable
       if(p1 > p2) std::swap(p1, p2);
       int i = hash(p1, p2);
+      lock_bucket(i);
       Node* node = search_list(v_table[i], p1, p2);
-      if(node != NULL) 
+      if(node != NULL)
+      {
+        stamp(node);
+        unlock_bucket(i);
         return node;
+      }
 
       // not found - create a new one
-      Node* newnode = nodes.add();
+      Node* newnode = add_node();
 
       // initialize the new Node
       newnode->type = HERMES_TYPE_VERTEX;
@@ -165,20 +217,31 @@ namespace Hermes
       // insert into hashtable
       newnode->next_hash = v_table[i];
       v_table[i] = newnode;
+      stamp(newnode);
+      unlock_bucket(i);
 
       return newnode;
     }
 
     Node* HashTable::get_edge_node(int p1, int p2)
     {
+      if(locks == NULL && nodes.get_num_items() >= mask + 1)
+        rehash(nodes.get_num_items() + 1);
+
       // search for the node in the edge hashtable
       if(p1 > p2) std::swap(p1, p2);
       int i = hash(p1, p2);
+      lock_bucket(i);
       Node* node = search_list(e_table[i], p1, p2);
-      if(node != NULL) return node;
+      if(node != NULL)
+      {
+        stamp(node);
+        unlock_bucket(i);
+        return node;
+      }
 
       // not found - create a new one
-      Node* newnode = nodes.add();
+      Node* newnode = add_node();
 
       // initialize the new node
       newnode->type = HERMES_TYPE_EDGE;
@@ -192,6 +255,8 @@ namespace Hermes
       // insert into hashtable
       newnode->next_hash = e_table[i];
       e_table[i] = newnode;
+      stamp(newnode);
+      unlock_bucket(i);
 
       return newnode;
     }
@@ -199,19 +264,28 @@ namespace Hermes
     Node* HashTable::peek_vertex_node(int p1, int p2) const
     {
       if(p1 > p2) std::swap(p1, p2);
-      return search_list(v_table[hash(p1, p2)], p1, p2);
+      int i = hash(p1, p2);
+      const_cast<HashTable*>(this)->lock_bucket(i);
+      Node* node = search_list(v_table[i], p1, p2);
+      const_cast<HashTable*>(this)->unlock_bucket(i);
+      return node;
     }
 
     Node* HashTable::peek_edge_node(int p1, int p2) const
     {
       if(p1 > p2) std::swap(p1, p2);
-      return search_list(e_table[hash(p1, p2)], p1, p2);
+      int i = hash(p1, p2);
+      const_cast<HashTable*>(this)->lock_bucket(i);
+      Node* node = search_list(e_table[i], p1, p2);
+      const_cast<HashTable*>(this)->unlock_bucket(i);
+      return node;
     }
 
     void HashTable::remove_vertex_node(int id)
     {
       // remove the node from the hash table
       int i = hash(nodes[id].p1, nodes[id].p2);
+      lock_bucket(i);
       Node** ptr = v_table + i;
       Node* node = *ptr;
       while (node != NULL)
@@ -224,15 +298,17 @@ namespace Hermes
         ptr = &node->next_hash;
         node = *ptr;
       }
+      unlock_bucket(i);
 
       // remove node from the array
-      nodes.remove(id);
+      remove_node(id);
     }
 
     void HashTable::remove_edge_node(int id)
     {
       // remove the node from the hash table
       int i = hash(nodes[id].p1, nodes[id].p2);
+      lock_bucket(i);
       Node** ptr = e_table + i;
       Node* node = *ptr;
       while (node != NULL)
@@ -245,9 +321,59 @@ namespace Hermes
         ptr = &node->next_hash;
         node = *ptr;
       }
+      unlock_bucket(i);
 
       // remove node from the array
-      nodes.remove(id);
+      remove_node(id);
+    }
+
+    void HashTable::begin_concurrent_access(int first_stamped_node, uint64_t* node_stamps, uint64_t* thread_stamps)
+    {
+      this->first_stamped_node = first_stamped_node;
+      this->node_stamps = node_stamps;
+      this->thread_stamps = thread_stamps;
+      locks = new omp_lock_t[H2D_HASH_LOCKS];
+      for (int i = 0; i < H2D_HASH_LOCKS; i++)
+        omp_init_lock(locks + i);
+    }
+
+    void HashTable::end_concurrent_access()
+    {
+      for (int i = 0; i < H2D_HASH_LOCKS; i++)
+        omp_destroy_lock(locks + i);
+      delete [] locks;
+      locks = NULL;
+      node_stamps = thread_stamps = NULL;
+    }
+
+    void HashTable::stamp(Node* node)
+    {
+      if(node_stamps == NULL || node->id < first_stamped_node)
+        return;
+      uint64_t current = thread_stamps[omp_get_thread_num()]++;
+      if(current < node_stamps[node->id - first_stamped_node])
+        node_stamps[node->id - first_stamped_node] = current;
+    }
+
+    Node* HashTable::add_node()
+    {
+      if(locks == NULL)
+        return nodes.add();
+      Node* node;
+#pragma omp critical (hash_table_nodes)
+      node = nodes.add();
+      return node;
+    }
+
+    void HashTable::remove_node(int id)
+    {
+      if(locks == NULL)
+        nodes.remove(id);
+      else
+      {
+#pragma omp critical (hash_table_nodes)
+        nodes.remove(id);
+      }
     }
   }
-}
\ No newline at end of file
+}
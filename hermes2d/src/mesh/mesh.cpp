@@ -26,6 +26,14 @@ namespace Hermes
   {
 
     static const int H2D_DG_INNER_EDGE_INT = -1234567;
+
+    /// Minimum number of elements to refine for the parallel refine_all_elements() and refine_elements().
+    static const int H2D_PARALLEL_REFINEMENT_MIN_ELEMENTS = 4096;
+
+    /// Minimum number of elements for the parallel translation of the pointers in copy().
+    static const int H2D_PARALLEL_COPY_MIN_ELEMENTS = 65536;
+
+    static void renumber_group(std::vector<std::pair<uint64_t, int> >& group, int* new_ids);
     static const std::string H2D_DG_INNER_EDGE = "-1234567";
 
     bool Node::is_constrained_vertex() const
@@ -248,10 +256,26 @@ namespace Hermes
 
     unsigned g_mesh_seq = 0;
 
-    Mesh::Mesh() : HashTable()
+    unsigned next_mesh_seq()
     {
-      nbase = nactive = ntopvert = ninitial = 0;
+      unsigned seq;
+#pragma omp critical (mesh_seq)
       seq = g_mesh_seq++;
+      return seq;
+    }
+
+    Mesh::Mesh() : HashTable(), Mixins::MemoryAccounted(Mixins::H2D_MEMORY_MESH)
+    {
+      nbase = nactive = ntopvert = ninitial = 0;
+      seq = next_mesh_seq();
+      element_grid = NULL;
+      retired_element_grid = NULL;
+      snapshot = NULL;
+      retired_snapshot = NULL;
+      space_count = 0;
+      neighbor_table_enabled = false;
+      refmap_coeffs_deferred = false;
+      element_stamp_counter = 0;
     }
 
     Mesh::~Mesh() 
@@ -281,6 +305,9 @@ namespace Hermes
       Mesh* ref_mesh = new Mesh;
       ref_mesh->copy(this->coarse_mesh);
       ref_mesh->refine_all_elements(refinement, false);
+      // Only the new elements are renumbered, the coarse ones keep their ids for the reference space.
+      if(Hermes2DApi.get_integral_param_value(meshReordering))
+        ref_mesh->reorder_hilbert(NULL, this->coarse_mesh->get_max_element_id());
       return ref_mesh;
     }
 
@@ -346,35 +373,55 @@ namespace Hermes
       }
       ntopvert = nv;
 
+      // The consecutive elements (edges) mostly share the marker (e.g. the element blocks of a file),
+      // the conversion of a marker is looked up only when it differs from the previous one.
+      const std::string* last_marker = NULL;
+      int marker = -1;
+
       // create triangles
       Element* e;
       for (int i = 0; i < nt; i++)
       {
-        this->element_markers_conversion.insert_marker(this->element_markers_conversion.min_marker_unused, tri_markers[i]);
+        if(last_marker == NULL || tri_markers[i] != *last_marker)
+        {
+          this->element_markers_conversion.insert_marker(this->element_markers_conversion.min_marker_unused, tri_markers[i]);
+          marker = this->element_markers_conversion.get_internal_marker(tri_markers[i]).marker;
+          last_marker = &tri_markers[i];
+        }
 
-        e = create_triangle(this->element_markers_conversion.get_internal_marker(tri_markers[i]).marker, &nodes[tris[i][0]], &nodes[tris[i][1]],
-          &nodes[tris[i][2]], NULL);
+        e = create_triangle(marker, &nodes[tris[i][0]], &nodes[tris[i][1]], &nodes[tris[i][2]], NULL);
       }
 
       // create quads
+      last_marker = NULL;
       for (int i = 0; i < nq; i++)
       {
-        this->element_markers_conversion.insert_marker(this->element_markers_conversion.min_marker_unused, quad_markers[i]);
+        if(last_marker == NULL || quad_markers[i] != *last_marker)
+        {
+          this->element_markers_conversion.insert_marker(this->element_markers_conversion.min_marker_unused, quad_markers[i]);
+          marker = this->element_markers_conversion.get_internal_marker(quad_markers[i]).marker;
+          last_marker = &quad_markers[i];
+        }
 
-        e = create_quad(this->element_markers_conversion.get_internal_marker(quad_markers[i]).marker, &nodes[quads[i][0]], &nodes[quads[i][1]],
-          &nodes[quads[i][2]], &nodes[quads[i][3]], NULL);
+        e = create_quad(marker, &nodes[quads[i][0]], &nodes[quads[i][1]], &nodes[quads[i][2]], &nodes[quads[i][3]], NULL);
       }
 
       // set boundary markers
+      last_marker = NULL;
       for (int i = 0; i < nm; i++)
       {
         Node* en = peek_edge_node(mark[i][0], mark[i][1]);
         if(en == NULL)
           throw Hermes::Exceptions::Exception("Boundary data error (edge does not exist)");
 
-        this->boundary_markers_conversion.insert_marker(this->boundary_markers_conversion.min_marker_unused, boundary_markers[i]);
+        if(last_marker == NULL || boundary_markers[i] != *last_marker)
+        {
+          this->boundary_markers_conversion.insert_marker(this->boundary_markers_conversion.min_marker_unused, boundary_markers[i]);
+          marker = this->boundary_markers_conversion.get_internal_marker(boundary_markers[i]).marker;
+          last_marker = &boundary_markers[i];
+        }
 
-        en->marker = this->boundary_markers_conversion.get_internal_marker(boundary_markers[i]).marker;
+        en->marker = marker;
 
         nodes[mark[i][0]].bnd = 1;
         nodes[mark[i][1]].bnd = 1;
@@ -382,7 +429,7 @@ namespace Hermes
       }
 
       nbase = nactive = ninitial = nt + nq;
-      seq = g_mesh_seq++;
+      seq = next_mesh_seq();
     }
 
     int Mesh::get_num_elements() const
@@ -481,6 +528,11 @@ namespace Hermes
       }
     }
 
+    const Hermes::vector<std::pair<unsigned int, int> >& Mesh::get_refinements() const
+    {
+      return this->refinements;
+    }
+
     Element* Mesh::get_element(int id) const
     {
       if(id < 0 || id >= elements.get_size())
@@ -493,6 +545,316 @@ namespace Hermes
       return seq;
     }
 
+    const ElementGrid* Mesh::get_element_grid() const
+    {
+      const ElementGrid* grid;
+#pragma omp critical (element_grid)
+      {
+        if(element_grid == NULL || !element_grid->is_valid(this))
+        {
+          // Another thread may still hold the outdated grid, it is freed on the next rebuild.
+          if(retired_element_grid != NULL)
+            delete retired_element_grid;
+          retired_element_grid = element_grid;
+          element_grid = new ElementGrid(this);
+        }
+        grid = element_grid;
+      }
+      return grid;
+    }
+
+    const MeshSnapshot* Mesh::get_snapshot() const
+    {
+      const MeshSnapshot* result;
+#pragma omp critical (mesh_snapshot)
+      {
+        if(snapshot == NULL || !snapshot->is_valid(this))
+        {
+          // Another thread may still hold the outdated snapshot, it is freed on the next rebuild.
+          if(retired_snapshot != NULL)
+            delete retired_snapshot;
+          retired_snapshot = snapshot;
+          snapshot = new MeshSnapshot(this);
+        }
+        result = snapshot;
+      }
+      return result;
+    }
+
+    std::size_t MeshMemoryUsage::get_total() const
+    {
+      return elements + nodes + hash_tables + curved_maps + auxiliary;
+    }
+
+    MeshMemoryUsage Mesh::get_memory_usage() const
+    {
+      MeshMemoryUsage usage;
+      usage.elements = elements.get_memory_size();
+      usage.nodes = nodes.get_memory_size();
+      usage.hash_tables = HashTable::get_memory_size() - usage.nodes;
+
+      usage.curved_maps = 0;
+      Element* e;
+      for_all_elements(e, this)
+        if(e->cm != NULL)
+          usage.curved_maps += sizeof(CurvMap) + (e->cm->coeffs != NULL ? e->cm->nc * sizeof(double2) : 0);
+
+      usage.auxiliary = refinements.capacity() * sizeof(std::pair<unsigned int, int>) + element_stamps.capacity() * sizeof(unsigned int);
+      if(snapshot != NULL)
+        usage.auxiliary += snapshot->get_memory_size();
+      if(retired_snapshot != NULL)
+        usage.auxiliary += retired_snapshot->get_memory_size();
+      if(element_grid != NULL)
+        usage.auxiliary += element_grid->get_memory_size();
+      if(retired_element_grid != NULL)
+        usage.auxiliary += retired_element_grid->get_memory_size();
+      for (std::map<int, NeighborTableEntry>::const_iterator it = neighbor_table.begin(); it != neighbor_table.end(); it++)
+      {
+        const NeighborTableEntry& entry = it->second;
+        usage.auxiliary += sizeof(std::pair<int, NeighborTableEntry>) + entry.element_ids.capacity() * sizeof(int)
+          + entry.element_stamps.capacity() * sizeof(unsigned int) + entry.local_edges.capacity() * sizeof(int) + entry.orientations.capacity() / 8;
+        for (unsigned int i = 0; i < entry.central_transformations.size(); i++)
+          usage.auxiliary += sizeof(std::vector<unsigned int>) + entry.central_transformations[i].capacity() * sizeof(unsigned int);
+        for (unsigned int i = 0; i < entry.neighbor_transformations.size(); i++)
+          usage.auxiliary += sizeof(std::vector<unsigned int>) + entry.neighbor_transformations[i].capacity() * sizeof(unsigned int);
+      }
+
+      return usage;
+    }
+
+    std::size_t Mesh::get_total_memory_usage() const
+    {
+      return this->get_memory_usage().get_total();
+    }
+
+    MeshSnapshot::MeshSnapshot(const Mesh* mesh)
+    {
+      seq = mesh->get_seq();
+      num_elements = mesh->get_num_active_elements();
+      max_element_id = mesh->get_max_element_id();
+
+      int size = std::max(num_elements, 1);
+      elements = new Element*[size];
+      element_ids = new int[size];
+      vertices = new int[4 * size];
+      neighbors = new int[4 * size];
+      markers = new int[size];
+      curved = new bool[size];
+      indices = new int[std::max(max_element_id, 1)];
+      for (int i = 0; i < max_element_id; i++)
+        indices[i] = -1;
+
+      // Elements, vertices referenced by them.
+      int max_node_id = mesh->get_max_node_id();
+      int* vertex_indices = new int[std::max(max_node_id, 1)];
+      for (int i = 0; i < max_node_id; i++)
+        vertex_indices[i] = -1;
+
+      int n = 0;
+      Element* e;
+      for_all_active_elements(e, mesh)
+      {
+        elements[n] = e;
+        element_ids[n] = e->id;
+        markers[n] = e->marker;
+        curved[n] = e->is_curved();
+        indices[e->id] = n;
+        for (unsigned int i = 0; i < e->get_nvert(); i++)
+          vertex_indices[e->vn[i]->id] = 0;
+        n++;
+      }
+      num_elements = n;
+
+      num_vertices = 0;
+      for (int i = 0; i < max_node_id; i++)
+        if(vertex_indices[i] == 0)
+          vertex_indices[i] = num_vertices++;
+      x = new double[std::max(num_vertices, 1)];
+      y = new double[std::max(num_vertices, 1)];
+      vertex_node_ids = new int[std::max(num_vertices, 1)];
+      for (int i = 0; i < max_node_id; i++)
+        if(vertex_indices[i] >= 0)
+        {
+          Node* node = mesh->get_node(i);
+          x[vertex_indices[i]] = node->x;
+          y[vertex_indices[i]] = node->y;
+          vertex_node_ids[vertex_indices[i]] = i;
+        }
+
+      // Vertex and neighbor tables.
+      for (int i = 0; i < num_elements; i++)
+      {
+        e = elements[i];
+        for (unsigned int j = 0; j < 4; j++)
+        {
+          if(j >= e->get_nvert())
+          {
+            vertices[4 * i + j] = neighbors[4 * i + j] = -1;
+            continue;
+          }
+          vertices[4 * i + j] = vertex_indices[e->vn[j]->id];
+          Element* neighbor = e->en[j]->elem[0] == e ? e->en[j]->elem[1] : e->en[j]->elem[0];
+          neighbors[4 * i + j] = (neighbor != NULL && neighbor->used && neighbor->active) ? indices[neighbor->id] : -1;
+        }
+      }
+
+      delete [] vertex_indices;
+    }
+
+    MeshSnapshot::~MeshSnapshot()
+    {
+      delete [] elements;
+      delete [] element_ids;
+      delete [] vertices;
+      delete [] neighbors;
+      delete [] markers;
+      delete [] curved;
+      delete [] x;
+      delete [] y;
+      delete [] vertex_node_ids;
+      delete [] indices;
+    }
+
+    std::size_t MeshSnapshot::get_memory_size() const
+    {
+      std::size_t size = std::max(num_elements, 1);
+      std::size_t vertex_size = std::max(num_vertices, 1);
+      return sizeof(MeshSnapshot) + size * (sizeof(Element*) + 10 * sizeof(int) + sizeof(bool))
+        + vertex_size * (2 * sizeof(double) + sizeof(int)) + std::max(max_element_id, 1) * sizeof(int);
+    }
+
+    bool MeshSnapshot::is_valid(const Mesh* mesh) const
+    {
+      return seq == mesh->get_seq() && num_elements == mesh->get_num_active_elements();
+    }
+
+    ElementGrid::ElementGrid(const Mesh* mesh)
+    {
+      seq = mesh->get_seq();
+      num_active_elements = mesh->get_num_active_elements();
+
+      // Bounding boxes of the active elements.
+      const MeshSnapshot* snapshot = mesh->get_snapshot();
+      int n = snapshot->get_num_elements();
+      double4* boxes = new double4[std::max(n, 1)];
+      for (int i = 0; i < n; i++)
+      {
+        double* box = boxes[i];
+        const int* vertices = snapshot->get_vertices(i);
+        box[0] = box[2] = snapshot->get_x(vertices[0]);
+        box[1] = box[3] = snapshot->get_y(vertices[0]);
+        for (int j = 1; j < snapshot->get_nvert(i); j++)
+        {
+          box[0] = std::min(box[0], snapshot->get_x(vertices[j]));
+          box[1] = std::min(box[1], snapshot->get_y(vertices[j]));
+          box[2] = std::max(box[2], snapshot->get_x(vertices[j]));
+          box[3] = std::max(box[3], snapshot->get_y(vertices[j]));
+        }
+        if(snapshot->is_curved(i))
+        {
+          double margin = 0.5 * snapshot->get_element(i)->get_diameter();
+          box[0] -= margin;
+          box[1] -= margin;
+          box[2] += margin;
+          box[3] += margin;
+        }
+      }
+
+      double x_max, y_max;
+      x_min = y_min = x_max = y_max = 0.0;
+      for (int i = 0; i < n; i++)
+      {
+        if(i == 0 || boxes[i][0] < x_min) x_min = boxes[i][0];
+        if(i == 0 || boxes[i][1] < y_min) y_min = boxes[i][1];
+        if(i == 0 || boxes[i][2] > x_max) x_max = boxes[i][2];
+        if(i == 0 || boxes[i][3] > y_max) y_max = boxes[i][3];
+      }
+
+      // Square cells, about one per element.
+      double width = std::max(x_max - x_min, 1e-12), height = std::max(y_max - y_min, 1e-12);
+      double cell_size = sqrt(width * height / std::max(n, 1));
+      nx = std::max(1, std::min(2048, (int) ceil(width / cell_size)));
+      ny = std::max(1, std::min(2048, (int) ceil(height / cell_size)));
+      cell_width = width / nx;
+      cell_height = height / ny;
+
+      // Two passes: the counts per cell, then the elements.
+      cell_start = new int[nx * ny + 1];
+      memset(cell_start, 0, (nx * ny + 1) * sizeof(int));
+      for (int pass = 0; pass < 2; pass++)
+      {
+        for (int i = 0; i < n; i++)
+        {
+          int i0 = std::max(0, std::min(nx - 1, (int) ((boxes[i][0] - x_min) / cell_width)));
+          int i1 = std::max(0, std::min(nx - 1, (int) ((boxes[i][2] - x_min) / cell_width)));
+          int j0 = std::max(0, std::min(ny - 1, (int) ((boxes[i][1] - y_min) / cell_height)));
+          int j1 = std::max(0, std::min(ny - 1, (int) ((boxes[i][3] - y_min) / cell_height)));
+          for (int j = j0; j <= j1; j++)
+            for (int k = i0; k <= i1; k++)
+            {
+              if(pass == 0)
+                cell_start[j * nx + k + 1]++;
+              else
+                cell_elements[cell_start[j * nx + k]++] = snapshot->get_element(i);
+            }
+        }
+        if(pass == 0)
+        {
+          for (int i = 0; i < nx * ny; i++)
+            cell_start[i + 1] += cell_start[i];
+          cell_elements = new Element*[std::max(cell_start[nx * ny], 1)];
+        }
+        else
+        {
+          // cell_start[i] now points to the end of the cell i.
+          for (int i = nx * ny; i > 0; i--)
+            cell_start[i] = cell_start[i - 1];
+          cell_start[0] = 0;
+        }
+      }
+
+      delete [] boxes;
+    }
+
+    ElementGrid::~ElementGrid()
+    {
+      delete [] cell_start;
+      delete [] cell_elements;
+    }
+
+    std::size_t ElementGrid::get_memory_size() const
+    {
+      return sizeof(ElementGrid) + (nx * ny + 1) * sizeof(int) + std::max(cell_start[nx * ny], 1) * sizeof(Element*);
+    }
+
+    bool ElementGrid::is_valid(const Mesh* mesh) const
+    {
+      return seq == mesh->get_seq() && num_active_elements == mesh->get_num_active_elements();
+    }
+
+    int ElementGrid::get_cell(double x, double y) const
+    {
+      // Allow for rounding on the boundary of the grid.
+      double tol_x = 1e-10 * cell_width * nx, tol_y = 1e-10 * cell_height * ny;
+      if(x < x_min - tol_x || y < y_min - tol_y || x > x_min + cell_width * nx + tol_x || y > y_min + cell_height * ny + tol_y)
+        return -1;
+      int i = std::max(0, std::min(nx - 1, (int) ((x - x_min) / cell_width)));
+      int j = std::max(0, std::min(ny - 1, (int) ((y - y_min) / cell_height)));
+      return j * nx + i;
+    }
+
+    Element** ElementGrid::get_candidates(double x, double y, int& count) const
+    {
+      int cell = get_cell(x, y);
+      if(cell < 0)
+      {
+        count = 0;
+        return NULL;
+      }
+      count = cell_start[cell + 1] - cell_start[cell];
+      return cell_elements + cell_start[cell];
+    }
+
     void Mesh::set_seq(unsigned seq)
     {
       this->seq = seq;
@@ -529,10 +891,93 @@ namespace Hermes
       return 2;
     }
 
+    Element* Mesh::add_element()
+    {
+      Element* e;
+      if(!this->is_concurrent())
+      {
+        e = elements.add();
+        stamp_element(e->id);
+        return e;
+      }
+#pragma omp critical (mesh_elements)
+      {
+        e = elements.add();
+        stamp_element(e->id);
+      }
+      return e;
+    }
+
+    void Mesh::stamp_element(int id)
+    {
+      if(!this->neighbor_table_enabled)
+        return;
+      if(id >= (int)element_stamps.size())
+        element_stamps.resize(id + 1, 0);
+      element_stamps[id] = ++element_stamp_counter;
+    }
+
+    unsigned int Mesh::get_element_stamp(int id) const
+    {
+      return id < (int)element_stamps.size() ? element_stamps[id] : 0;
+    }
+
+    void Mesh::set_neighbor_table(bool enabled)
+    {
+      clear_neighbor_table();
+      this->neighbor_table_enabled = enabled;
+    }
+
+    bool Mesh::is_neighbor_table_enabled() const
+    {
+      return this->neighbor_table_enabled;
+    }
+
+    void Mesh::clear_neighbor_table()
+    {
+      neighbor_table.clear();
+      element_stamps.clear();
+    }
+
+    bool Mesh::get_neighbor_table_entry(int element_id, int edge, NeighborTableEntry& entry) const
+    {
+      if(!this->neighbor_table_enabled)
+        return false;
+
+      bool found = false;
+#pragma omp critical (neighbor_table)
+      {
+        std::map<int, NeighborTableEntry>::const_iterator it = neighbor_table.find(4 * element_id + edge);
+        if(it != neighbor_table.end())
+        {
+          // Valid as long as all the elements are the same active ones.
+          found = true;
+          for (unsigned int i = 0; i < it->second.element_ids.size() && found; i++)
+          {
+            int id = it->second.element_ids[i];
+            Element* e = get_element_fast(id);
+            if(!e->used || !e->active || get_element_stamp(id) != it->second.element_stamps[i])
+              found = false;
+          }
+          if(found)
+            entry = it->second;
+        }
+      }
+      return found;
+    }
+
+    void Mesh::set_neighbor_table_entry(int element_id, int edge, const NeighborTableEntry& entry) const
+    {
+      if(!this->neighbor_table_enabled)
+        return;
+#pragma omp critical (neighbor_table)
+      neighbor_table[4 * element_id + edge] = entry;
+    }
+
     Element* Mesh::create_triangle(int marker, Node* v0, Node* v1, Node* v2, CurvMap* cm, int id)
     {
       // create a new element
-      Element* e = elements.add();
+      Element* e = add_element();
 
       if(id != -1)
         e->id = id;
@@ -567,7 +1012,7 @@ namespace Hermes
       CurvMap* cm, int id)
     {
       // create a new element
-      Element* e = elements.add();
+      Element* e = add_element();
 
       if(id != -1)
         e->id = id;
@@ -668,10 +1113,11 @@ namespace Hermes
       // update coefficients of curved reference mapping
       for (int i = 0; i < 4; i++)
         if(sons[i]->is_curved())
-          sons[i]->cm->update_refmap_coeffs(sons[i]);
+          this->update_refmap_coeffs(sons[i]);
 
       // deactivate this element and unregister from its nodes
       e->active = 0;
+#pragma omp atomic
       this->nactive += 3;
       e->unref_all_nodes(this);
 
@@ -744,6 +1190,7 @@ namespace Hermes
 
       // deactivate this element and unregister from its nodes
       e->active = false;
+#pragma omp atomic
       nactive--;
       e->unref_all_nodes(this);
 
@@ -785,6 +1232,7 @@ namespace Hermes
         sons[3] = create_quad(e->marker, x3, mid, x2, e->vn[3], cm[3]);
 
         // Increase the number of active elements by 4.
+#pragma omp atomic
         this->nactive += H2D_MAX_ELEMENT_SONS;
 
         // set correct boundary markers for the new edge nodes
@@ -821,6 +1269,7 @@ namespace Hermes
         sons[1] = create_quad(e->marker, x3, x1, e->vn[2], e->vn[3], cm[1]);
         sons[2] = sons[3] = NULL;
 
+#pragma omp atomic
         this->nactive += 2;
 
         sons[0]->en[0]->bnd = bnd[0];  sons[0]->en[0]->marker = mrk[0];
@@ -857,6 +1306,7 @@ namespace Hermes
         sons[2] = create_quad(e->marker, e->vn[0], x0, x2, e->vn[3], cm[0]);
         sons[3] = create_quad(e->marker, x0, e->vn[1], e->vn[2], x2, cm[1]);
 
+#pragma omp atomic
         this->nactive += 2;
 
         sons[2]->en[0]->bnd = bnd[0];  sons[2]->en[0]->marker = mrk[0];
@@ -873,7 +1323,7 @@ namespace Hermes
       // update coefficients of curved reference mapping
       for (i = 0; i < 4; i++)
         if(sons[i] != NULL && sons[i]->cm != NULL)
-          sons[i]->cm->update_refmap_coeffs(sons[i]);
+          this->update_refmap_coeffs(sons[i]);
 
       // optimization: iro never gets worse
       if(e->iro_cache == 0)
@@ -958,7 +1408,7 @@ namespace Hermes
       }
       else refine_quad(e, refinement);
 
-      this->seq = g_mesh_seq++;
+      this->seq = next_mesh_seq();
     }
 
     void Mesh::refine_element_id(int id, int refinement)
@@ -981,16 +1431,225 @@ namespace Hermes
         return;
 
       elements.set_append_only(true);
+      this->refmap_coeffs_deferred = true;
 
-      for_all_active_elements(e, this)
-        refine_element_id(e->id, refinement);
+      int num_threads = Hermes2DApi.get_integral_param_value(numThreads);
+      if(num_threads > 1 && refinement != 3 && nactive >= H2D_PARALLEL_REFINEMENT_MIN_ELEMENTS)
+      {
+        std::vector<Element*> parents;
+        for_all_active_elements(e, this)
+          parents.push_back(e);
+        refine_elements_parallel(parents, std::vector<int>(parents.size(), refinement), num_threads);
+      }
+      else
+        for_all_active_elements(e, this)
+          refine_element_id(e->id, refinement);
 
+      this->refmap_coeffs_deferred = false;
       elements.set_append_only(false);
 
+      // The sons, all in the new ids.
+      this->precalculate_refmap_coeffs(ninitial);
+
       if(mark_as_initial)
         ninitial = this->get_max_element_id();
     }
 
+    void Mesh::refine_elements(const std::vector<int>& ids, const std::vector<int>& refinement_types)
+    {
+      if(ids.size() != refinement_types.size())
+        throw Hermes::Exceptions::LengthException(1, 2, ids.size(), refinement_types.size());
+
+      std::vector<Element*> parents;
+      std::vector<int> parent_refinements;
+      std::vector<bool> listed(this->get_max_element_id(), false);
+      for (unsigned int i = 0; i < ids.size(); i++)
+      {
+        if(refinement_types[i] == -1)
+          continue;
+        Element* e = this->get_element(ids[i]);
+        if(!e->used) throw Hermes::Exceptions::Exception("Invalid element id number.");
+        if(!e->active || listed[e->id]) throw Hermes::Exceptions::Exception("Attempt to refine element #%d which has been refined already.", e->id);
+        listed[e->id] = true;
+        parents.push_back(e);
+        parent_refinements.push_back(refinement_types[i]);
+      }
+
+      int num_threads = Hermes2DApi.get_integral_param_value(numThreads);
+      if(num_threads <= 1 || (int)parents.size() < H2D_PARALLEL_REFINEMENT_MIN_ELEMENTS)
+      {
+        for (unsigned int i = 0; i < parents.size(); i++)
+          this->refine_element(parents[i], parent_refinements[i]);
+        return;
+      }
+
+      int first_new_element = this->get_max_element_id();
+      elements.set_append_only(true);
+      this->refmap_coeffs_deferred = true;
+      refine_elements_parallel(parents, parent_refinements, num_threads);
+      this->refmap_coeffs_deferred = false;
+      elements.set_append_only(false);
+      this->precalculate_refmap_coeffs(first_new_element);
+    }
+
+    void Mesh::update_refmap_coeffs(Element* e)
+    {
+      if(!this->refmap_coeffs_deferred)
+        e->cm->update_refmap_coeffs(e);
+    }
+
+    void Mesh::precalculate_refmap_coeffs(int first_element_id)
+    {
+      std::vector<Element*> curved_elements;
+      for (int id = first_element_id; id < this->get_max_element_id(); id++)
+      {
+        Element* e = this->get_element_fast(id);
+        if(e->used && e->cm != NULL)
+          curved_elements.push_back(e);
+      }
+      CurvMap::precalculate_refmap_coeffs(curved_elements, Hermes2DApi.get_integral_param_value(numThreads));
+    }
+
+    /// Number of colors (elements refined together) of refine_elements_parallel(), the last one is serial.
+    static const int H2D_REFINEMENT_COLORS = 64;
+
+    void Mesh::refine_elements_parallel(const std::vector<Element*>& parents, const std::vector<int>& refinement_types, int num_threads)
+    {
+      Element* e;
+
+      // Colors: elements of one color share no vertex node and no existing mid-edge vertex node,
+      // so they touch disjoint nodes when refined. Curved elements (the curved maps are not thread-safe),
+      // triangles split to quads and the elements no color was left for are refined serially.
+      // The colors hold the positions of the elements in parents.
+      std::vector<std::vector<int> > colors(H2D_REFINEMENT_COLORS);
+      int max_node_id = this->get_max_node_id();
+      uint64_t* masks = new uint64_t[max_node_id];
+      memset(masks, 0, max_node_id * sizeof(uint64_t));
+      for (unsigned int parent_i = 0; parent_i < parents.size(); parent_i++)
+      {
+        e = parents[parent_i];
+        Node* touched[2 * H2D_MAX_NUMBER_VERTICES];
+        int num_touched = 0;
+        for (unsigned int i = 0; i < e->get_nvert(); i++)
+        {
+          touched[num_touched++] = e->vn[i];
+          Node* mid = peek_vertex_node(e->vn[i]->id, e->vn[e->next_vert(i)]->id);
+          if(mid != NULL)
+            touched[num_touched++] = mid;
+        }
+
+        int color = H2D_REFINEMENT_COLORS - 1;
+        if(!e->is_curved() && !(e->is_triangle() && refinement_types[parent_i] == 3))
+        {
+          uint64_t used = 0;
+          for (int i = 0; i < num_touched; i++)
+            used |= masks[touched[i]->id];
+          for (int i = 0; i < H2D_REFINEMENT_COLORS - 1; i++)
+            if(!(used & ((uint64_t)1 << i)))
+            {
+              color = i;
+              break;
+            }
+        }
+        if(color < H2D_REFINEMENT_COLORS - 1)
+          for (int i = 0; i < num_touched; i++)
+            masks[touched[i]->id] |= (uint64_t)1 << color;
+        colors[color].push_back(parent_i);
+      }
+      delete [] masks;
+
+      // The arrays must not grow their page tables while being read: a quad creates at most
+      // five vertex and twelve edge nodes, the new items are appended.
+      int first_new_element = this->get_max_element_id();
+      int first_new_node = max_node_id;
+      int max_new_nodes = 17 * (int)parents.size();
+      elements.reserve(first_new_element + 4 * (int)parents.size());
+      nodes.reserve(first_new_node + max_new_nodes);
+      // No rehashing during the concurrent access, the tables are grown for the usual count
+      // (about three new nodes per element) in advance.
+      this->rehash(this->get_num_nodes() + 3 * (int)parents.size());
+      nodes.set_append_only(true);
+
+      // Stamps of the new nodes: (position of the refined element in parents, number of the request within it).
+      uint64_t* node_stamps = new uint64_t[max_new_nodes];
+      for (int i = 0; i < max_new_nodes; i++)
+        node_stamps[i] = ~(uint64_t)0;
+      uint64_t* thread_stamps = new uint64_t[num_threads];
+      this->begin_concurrent_access(first_new_node, node_stamps, thread_stamps);
+
+      for (unsigned int i = 0; i < colors[H2D_REFINEMENT_COLORS - 1].size(); i++)
+      {
+        int parent_i = colors[H2D_REFINEMENT_COLORS - 1][i];
+        e = parents[parent_i];
+        thread_stamps[0] = (uint64_t)parent_i << 6;
+        if(e->is_triangle())
+        {
+          if(refinement_types[parent_i] == 3)
+            refine_triangle_to_quads(this, e);
+          else
+            refine_triangle_to_triangles(e);
+        }
+        else
+          refine_quad(e, refinement_types[parent_i]);
+      }
+
+      for (int color = 0; color < H2D_REFINEMENT_COLORS - 1; color++)
+      {
+        std::vector<int>& color_elements = colors[color];
+        int num_color_elements = color_elements.size();
+        if(num_color_elements == 0)
+          continue;
+#pragma omp parallel for schedule(dynamic, 64) num_threads(num_threads)
+        for (int i = 0; i < num_color_elements; i++)
+        {
+          int parent_i = color_elements[i];
+          Element* parent = parents[parent_i];
+          thread_stamps[omp_get_thread_num()] = (uint64_t)parent_i << 6;
+          if(parent->is_triangle())
+            refine_triangle_to_triangles(parent);
+          else
+            refine_quad(parent, refinement_types[parent_i]);
+        }
+      }
+
+      this->end_concurrent_access();
+      nodes.set_append_only(false);
+
+      // Ids independent of the timing: sons in the order of parents (as the serial refinement numbers them),
+      // new nodes in the order of their stamps.
+      int max_element_id = this->get_max_element_id();
+      int* new_element_ids = new int[max_element_id];
+      for (int i = 0; i < max_element_id; i++)
+        new_element_ids[i] = i;
+      int next_id = first_new_element;
+      for (unsigned int i = 0; i < parents.size(); i++)
+        for (int j = 0; j < H2D_MAX_ELEMENT_SONS; j++)
+          if(parents[i]->sons[j] != NULL)
+            new_element_ids[parents[i]->sons[j]->id] = next_id++;
+
+      max_node_id = this->get_max_node_id();
+      int* new_node_ids = new int[max_node_id];
+      for (int i = 0; i < max_node_id; i++)
+        new_node_ids[i] = i;
+      std::vector<std::pair<uint64_t, int> > new_nodes;
+      for (int i = first_new_node; i < max_node_id; i++)
+        if(nodes[i].used)
+          new_nodes.push_back(std::pair<uint64_t, int>(node_stamps[i - first_new_node], i));
+      renumber_group(new_nodes, new_node_ids);
+
+      this->apply_renumbering(new_node_ids, new_element_ids);
+      nodes.sort_unused();
+
+      delete [] new_element_ids;
+      delete [] new_node_ids;
+      delete [] node_stamps;
+      delete [] thread_stamps;
+
+      for (unsigned int i = 0; i < parents.size(); i++)
+        this->refinements.push_back(std::pair<unsigned int, int>(parents[i]->id, refinement_types[i]));
+      this->seq = next_mesh_seq();
+    }
+
     static int rtb_marker;
     static bool rtb_aniso;
     static char* rtb_vert;
@@ -1186,7 +1845,7 @@ namespace Hermes
           unrefine_element_id(e->sons[i]->id);
 
       unrefine_element_internal(e);
-      seq = g_mesh_seq++;
+      seq = next_mesh_seq();
     }
 
     void Mesh::unrefine_all_elements(bool keep_initial_refinements)
@@ -1211,6 +1870,226 @@ namespace Hermes
         unrefine_element_id(list[i]);
     }
 
+    /// Number of bits per coordinate of the Hilbert curve in Mesh::reorder_hilbert().
+    static const int H2D_HILBERT_BITS = 16;
+
+    /// Position of the point (x, y) of the [0, 2^H2D_HILBERT_BITS)^2 grid along the Hilbert curve.
+    static uint64_t hilbert_index(unsigned int x, unsigned int y)
+    {
+      const unsigned int n = 1u << H2D_HILBERT_BITS;
+      uint64_t d = 0;
+      for (unsigned int s = n >> 1; s > 0; s >>= 1)
+      {
+        unsigned int rx = (x & s) ? 1 : 0;
+        unsigned int ry = (y & s) ? 1 : 0;
+        d += (uint64_t)s * s * ((3 * rx) ^ ry);
+        // Rotate the quadrant.
+        if(ry == 0)
+        {
+          if(rx == 1)
+          {
+            x = n - 1 - x;
+            y = n - 1 - y;
+          }
+          std::swap(x, y);
+        }
+      }
+      return d;
+    }
+
+    /// Assigns the used ids of one group to its items sorted by the keys.
+    static void renumber_group(std::vector<std::pair<uint64_t, int> >& group, int* new_ids)
+    {
+      std::vector<int> ids(group.size());
+      for (unsigned int i = 0; i < group.size(); i++)
+        ids[i] = group[i].second;
+      std::sort(ids.begin(), ids.end());
+      std::sort(group.begin(), group.end());
+      for (unsigned int i = 0; i < group.size(); i++)
+        new_ids[group[i].second] = ids[i];
+    }
+
+    void Mesh::apply_renumbering(const int* new_node_ids, const int* new_element_ids)
+    {
+      Node* node;
+      Element* e;
+
+      // Redirect the pointers while the items are still in their old places.
+      for_all_edge_nodes(node, this)
+        for (unsigned int i = 0; i < 2; i++)
+          if(node->elem[i] != NULL)
+            node->elem[i] = &elements[new_element_ids[node->elem[i]->id]];
+
+      for_all_elements(e, this)
+      {
+        for (unsigned int i = 0; i < e->get_nvert(); i++)
+          e->vn[i] = &nodes[new_node_ids[e->vn[i]->id]];
+
+        if(e->active)
+        {
+          for (unsigned int i = 0; i < e->get_nvert(); i++)
+            e->en[i] = &nodes[new_node_ids[e->en[i]->id]];
+        }
+        else
+        {
+          for (unsigned int i = 0; i < 4; i++)
+            if(e->sons[i] != NULL)
+              e->sons[i] = &elements[new_element_ids[e->sons[i]->id]];
+        }
+
+        if(e->cm != NULL && !e->cm->toplevel)
+          e->cm->parent = &elements[new_element_ids[e->cm->parent->id]];
+
+        if(e->parent != NULL)
+          e->parent = &elements[new_element_ids[e->parent->id]];
+      }
+
+      // Move the nodes, the parent ids refer to vertices.
+      std::vector<Node> node_copies;
+      node_copies.reserve(this->get_num_nodes());
+      for_all_nodes(node, this)
+        node_copies.push_back(*node);
+      for (unsigned int i = 0; i < node_copies.size(); i++)
+      {
+        Node& copy = node_copies[i];
+        copy.id = new_node_ids[copy.id];
+        if(copy.p1 >= 0)
+        {
+          copy.p1 = new_node_ids[copy.p1];
+          copy.p2 = new_node_ids[copy.p2];
+          if(copy.p1 > copy.p2)
+            std::swap(copy.p1, copy.p2);
+        }
+        nodes[copy.id] = copy;
+      }
+      this->rebuild();
+
+      // Move the elements.
+      std::vector<Element> element_copies;
+      element_copies.reserve(this->get_num_elements());
+      for_all_elements(e, this)
+        element_copies.push_back(*e);
+      for (unsigned int i = 0; i < element_copies.size(); i++)
+      {
+        element_copies[i].id = new_element_ids[element_copies[i].id];
+        elements[element_copies[i].id] = element_copies[i];
+      }
+      clear_neighbor_table();
+    }
+
+    void Mesh::partition_elements(int num_parts, int* parts) const
+    {
+      if(num_parts < 1)
+        throw Hermes::Exceptions::ValueException("num_parts", num_parts, 1);
+
+      Node* node;
+      Element* e;
+
+      double x_min = 0.0, x_max = 0.0, y_min = 0.0, y_max = 0.0;
+      bool first = true;
+      for_all_vertex_nodes(node, this)
+      {
+        if(first || node->x < x_min) x_min = node->x;
+        if(first || node->x > x_max) x_max = node->x;
+        if(first || node->y < y_min) y_min = node->y;
+        if(first || node->y > y_max) y_max = node->y;
+        first = false;
+      }
+      double scale = (double)((1u << H2D_HILBERT_BITS) - 1) / std::max(std::max(x_max - x_min, y_max - y_min), 1e-300);
+
+      int max_element_id = this->get_max_element_id();
+      for (int i = 0; i < max_element_id; i++)
+        parts[i] = -1;
+
+      // The ids break the ties, the order is the same in every process.
+      std::vector<std::pair<uint64_t, int> > order;
+      for_all_active_elements(e, this)
+      {
+        double x, y;
+        e->get_center(x, y);
+        order.push_back(std::pair<uint64_t, int>(hilbert_index((unsigned int)((x - x_min) * scale), (unsigned int)((y - y_min) * scale)), e->id));
+      }
+      std::sort(order.begin(), order.end());
+
+      int count = order.size();
+      for (int i = 0; i < count; i++)
+        parts[order[i].second] = (int)(((int64_t)i * num_parts) / count);
+    }
+
+    void Mesh::reorder_hilbert(int* new_element_ids, int first_element_id)
+    {
+      Node* node;
+      Element* e;
+
+      // Bounding box of the vertices.
+      double x_min = 0.0, x_max = 0.0, y_min = 0.0, y_max = 0.0;
+      bool first = true;
+      for_all_vertex_nodes(node, this)
+      {
+        if(first || node->x < x_min) x_min = node->x;
+        if(first || node->x > x_max) x_max = node->x;
+        if(first || node->y < y_min) y_min = node->y;
+        if(first || node->y > y_max) y_max = node->y;
+        first = false;
+      }
+      double scale = (double)((1u << H2D_HILBERT_BITS) - 1) / std::max(std::max(x_max - x_min, y_max - y_min), 1e-300);
+
+      // Node groups: top-level vertices, other nodes; the positions of edge nodes are the edge midpoints.
+      int max_node_id = this->get_max_node_id();
+      int* new_node_ids = new int[max_node_id];
+      for (int i = 0; i < max_node_id; i++)
+        new_node_ids[i] = i;
+      std::vector<std::pair<uint64_t, int> > node_groups[2];
+      for_all_nodes(node, this)
+      {
+        double x, y;
+        if(node->type == HERMES_TYPE_VERTEX)
+        {
+          x = node->x;
+          y = node->y;
+        }
+        else
+        {
+          x = (nodes[node->p1].x + nodes[node->p2].x) * 0.5;
+          y = (nodes[node->p1].y + nodes[node->p2].y) * 0.5;
+        }
+        uint64_t key = hilbert_index((unsigned int)((x - x_min) * scale), (unsigned int)((y - y_min) * scale));
+        node_groups[node->id < ntopvert ? 0 : 1].push_back(std::pair<uint64_t, int>(key, node->id));
+      }
+      for (int i = 0; i < 2; i++)
+        renumber_group(node_groups[i], new_node_ids);
+
+      // Element groups: base elements, initial refinements, others.
+      int max_element_id = this->get_max_element_id();
+      int* new_ids = new int[max_element_id];
+      for (int i = 0; i < max_element_id; i++)
+        new_ids[i] = i;
+      std::vector<std::pair<uint64_t, int> > element_groups[3];
+      for_all_elements(e, this)
+      {
+        if(e->id < first_element_id)
+          continue;
+        double x, y;
+        e->get_center(x, y);
+        uint64_t key = hilbert_index((unsigned int)((x - x_min) * scale), (unsigned int)((y - y_min) * scale));
+        element_groups[e->id < nbase ? 0 : (e->id < ninitial ? 1 : 2)].push_back(std::pair<uint64_t, int>(key, e->id));
+      }
+      for (int i = 0; i < 3; i++)
+        renumber_group(element_groups[i], new_ids);
+
+      this->apply_renumbering(new_node_ids, new_ids);
+
+      // Recorded so that a saved mesh is reconstructed with the same ids.
+      this->refinements.push_back(std::pair<unsigned int, int>(first_element_id, -2));
+
+      if(new_element_ids != NULL)
+        memcpy(new_element_ids, new_ids, sizeof(int) * max_element_id);
+      delete [] new_ids;
+      delete [] new_node_ids;
+
+      this->seq = next_mesh_seq();
+    }
+
     Nurbs* Mesh::reverse_nurbs(Nurbs* nurbs)
     {
       Nurbs* rev = new Nurbs;
@@ -1345,36 +2224,45 @@ namespace Hermes
 
     void Mesh::copy(const Mesh* mesh)
     {
-      unsigned int i;
-
       free();
       // Serves as a Mesh::init() for purposes of pointer calculation.
 
-      // copy nodes and elements
+      // copy nodes and elements, page by page
       HashTable::copy(mesh);
       elements.copy(mesh->elements);
 
       this->refinements = mesh->refinements;
 
-      Element* e;
-      for_all_elements(e, this)
+      // The pointers are translated by the page addresses, the original mesh is not read.
+      std::vector<std::pair<Node*, Node*> > node_pages;
+      nodes.get_page_map(mesh->nodes, node_pages);
+      std::vector<std::pair<Element*, Element*> > element_pages;
+      elements.get_page_map(mesh->elements, element_pages);
+
+      int max_element_id = elements.get_size();
+      int num_threads = Hermes2DApi.get_integral_param_value(numThreads);
+#pragma omp parallel for schedule(static) num_threads(num_threads) if(max_element_id >= H2D_PARALLEL_COPY_MIN_ELEMENTS)
+      for (int id = 0; id < max_element_id; id++)
       {
+        Element* e = &elements[id];
+        if(!e->used)
+          continue;
+
         // update vertex node pointers
-        for (i = 0; i < e->get_nvert(); i++)
-          e->vn[i] = &nodes[e->vn[i]->id];
+        for (unsigned int j = 0; j < e->get_nvert(); j++)
+          e->vn[j] = Array<Node>::translate(node_pages, e->vn[j]);
 
         if(e->active)
         {
           // update edge node pointers
-          for (i = 0; i < e->get_nvert(); i++)
-            e->en[i] = &nodes[e->en[i]->id];
+          for (unsigned int j = 0; j < e->get_nvert(); j++)
+            e->en[j] = Array<Node>::translate(node_pages, e->en[j]);
         }
         else
         {
           // update son pointers
-          for (i = 0; i < 4; i++)
-            if(e->sons[i] != NULL)
-              e->sons[i] = &elements[e->sons[i]->id];
+          for (unsigned int j = 0; j < 4; j++)
+            e->sons[j] = Array<Element>::translate(element_pages, e->sons[j]);
         }
 
         // copy CurvMap, update its parent
@@ -1382,20 +2270,23 @@ namespace Hermes
         {
           e->cm = new CurvMap(e->cm);
           if(!e->cm->toplevel)
-            e->cm->parent = &elements[e->cm->parent->id];
+            e->cm->parent = Array<Element>::translate(element_pages, e->cm->parent);
         }
 
         //update parent pointer
-        if(e->parent != NULL)
-          e->parent = &elements[e->parent->id];
+        e->parent = Array<Element>::translate(element_pages, e->parent);
       }
 
       // update element pointers in edge nodes
-      Node* node;
-      for_all_edge_nodes(node, this)
-        for (i = 0; i < 2; i++)
-          if(node->elem[i] != NULL)
-            node->elem[i] = &elements[node->elem[i]->id];
+      int max_node_id = nodes.get_size();
+#pragma omp parallel for schedule(static) num_threads(num_threads) if(max_node_id >= H2D_PARALLEL_COPY_MIN_ELEMENTS)
+      for (int id = 0; id < max_node_id; id++)
+      {
+        Node* node = &nodes[id];
+        if(node->used && node->type)
+          for (unsigned int j = 0; j < 2; j++)
+            node->elem[j] = Array<Element>::translate(element_pages, node->elem[j]);
+      }
 
       nbase = mesh->nbase;
       nactive = mesh->nactive;
@@ -1467,7 +2358,7 @@ namespace Hermes
 
       nbase = nactive = ninitial = mesh->nbase;
       ntopvert = mesh->ntopvert;
-      seq = g_mesh_seq++;
+      seq = next_mesh_seq();
     }
 
     void Mesh::free()
@@ -1489,6 +2380,27 @@ namespace Hermes
       this->element_markers_conversion.conversion_table_inverse.clear();
       this->refinements.clear();
       this->seq = -1;
+      clear_neighbor_table();
+      if(this->element_grid != NULL)
+      {
+        delete this->element_grid;
+        this->element_grid = NULL;
+      }
+      if(this->retired_element_grid != NULL)
+      {
+        delete this->retired_element_grid;
+        this->retired_element_grid = NULL;
+      }
+      if(this->snapshot != NULL)
+      {
+        delete this->snapshot;
+        this->snapshot = NULL;
+      }
+      if(this->retired_snapshot != NULL)
+      {
+        delete this->retired_snapshot;
+        this->retired_snapshot = NULL;
+      }
     }
 
     void Mesh::copy_converted(Mesh* mesh)
@@ -1573,7 +2485,7 @@ namespace Hermes
 
       nbase = nactive = ninitial = mesh->nactive;
       ntopvert = mesh->ntopvert = get_num_nodes();
-      seq = g_mesh_seq++;
+      seq = next_mesh_seq();
     }
 
     void Mesh::convert_quads_to_triangles()
@@ -1918,7 +2830,7 @@ namespace Hermes
       // update coefficients of curved reference mapping
       for (int i = 0; i < 3; i++)
         if(sons[i]->is_curved())
-          sons[i]->cm->update_refmap_coeffs(sons[i]);
+          mesh->update_refmap_coeffs(sons[i]);
 
       // deactivate this element and unregister from its nodes
       e->active = 0;
@@ -1964,7 +2876,7 @@ namespace Hermes
       else
         refine_quad_to_quads(e);
 
-      seq = g_mesh_seq++;
+      seq = next_mesh_seq();
     }
 
     void Mesh::refine_quad_to_triangles(Element* e)
@@ -2162,7 +3074,7 @@ namespace Hermes
       else
         refine_quad_to_triangles(e);
 
-      seq = g_mesh_seq++;
+      seq = next_mesh_seq();
     }
 
     void Mesh::convert_element_to_base_id(int id)
@@ -2176,7 +3088,7 @@ namespace Hermes
       else
         convert_quads_to_base(e);// FIXME:
 
-      seq = g_mesh_seq++;
+      seq = next_mesh_seq();
     }
 
     Mesh::MarkersConversion::MarkersConversion() : min_marker_unused(1)
@@ -2946,7 +3858,7 @@ namespace Hermes
       // update coefficients of curved reference mapping
       for (i = 0; i < 4; i++)
         if(sons[i] != NULL && sons[i]->cm != NULL)
-          sons[i]->cm->update_refmap_coeffs(sons[i]);
+          this->update_refmap_coeffs(sons[i]);
 
       //set pointers to parent element for sons
       for(int i = 0; i < 4; i++)
@@ -3210,7 +4122,8 @@ namespace Hermes
       {
         if(e->sons[i]->id >= parents_size)
         {
-          parents_size = 2 * parents_size;
+          while(e->sons[i]->id >= parents_size)
+            parents_size = 2 * parents_size;
           parents = (int*) realloc(parents, sizeof(int) * parents_size);
         }
 
@@ -3236,9 +4149,14 @@ namespace Hermes
       for_all_active_elements(e, this)
         parents[e->id] = e->id;
 
+      // Each pass collects the elements with too many hanging nodes first and refines them at once (refine_elements()),
+      // the refinements of a pass only add hanging nodes, so the elements found are refined by the element by element pass as well.
+      std::vector<int> ids, isos;
       do
       {
         ok = true;
+        ids.clear();
+        isos.clear();
         for_all_active_elements(e, this)
         {
           int iso = -1;
@@ -3272,11 +4190,15 @@ namespace Hermes
 
           if(iso >= 0)
           {
-            refine_element_id(e->id, iso);
-            for (int i = 0; i < 4; i++)
-              assign_parent(e, i);
+            ids.push_back(e->id);
+            isos.push_back(iso);
           }
         }
+
+        refine_elements(ids, isos);
+        for (unsigned int id_i = 0; id_i < ids.size(); id_i++)
+          for (int i = 0; i < 4; i++)
+            assign_parent(this->get_element_fast(ids[id_i]), i);
       }
       while (!ok);
 
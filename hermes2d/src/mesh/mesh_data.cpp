@@ -82,9 +82,62 @@ namespace Hermes
       return *this;
     }
 
+    // The whitespace separated words of a line, as reading them from a std::istringstream.
+    class LineTokenizer
+    {
+    public:
+      LineTokenizer(const std::string& line) : line(line), pos(0) {}
+
+      /// The next word, false (and the word unchanged) at the end of the line.
+      bool next(std::string& word)
+      {
+        while (pos < line.size() && isspace((unsigned char)line[pos]))
+          pos++;
+        if(pos == line.size())
+          return false;
+        size_t start = pos;
+        while (pos < line.size() && !isspace((unsigned char)line[pos]))
+          pos++;
+        word.assign(line, start, pos - start);
+        return true;
+      }
+
+    private:
+      const std::string& line;
+      size_t pos;
+    };
+
+    // Whether the word starts with a number (as reading an int / a double from it by a stream succeeds).
+    static bool starts_with_number(const std::string& word)
+    {
+      if(word.empty())
+        return false;
+      char c = word[0];
+      return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.';
+    }
+
+    static bool is_int(const std::string& word)
+    {
+      if(!starts_with_number(word))
+        return false;
+      char* end;
+      strtol(word.c_str(), &end, 10);
+      return end != word.c_str();
+    }
+
+    static bool is_double(const std::string& word)
+    {
+      if(!starts_with_number(word))
+        return false;
+      char* end;
+      strtod(word.c_str(), &end);
+      return end != word.c_str();
+    }
+
     void MeshData::strip(std::string& str)
     {
       std::string temp;
+      temp.reserve(str.length() + 16);
 
       // Remove comments
       if(str.find('#') != str.npos)
@@ -153,24 +206,38 @@ namespace Hermes
     {
       std::vector<std::string> varlist;
 
-      int dummy_int;
-      double dummy_dbl;
-
-      std::ifstream inFile(mesh_file_.c_str());
+      // The whole file at once, split into the lines in place.
+      std::ifstream inFile(mesh_file_.c_str(), std::ios::in | std::ios::binary);
+      std::string buffer;
+      if(inFile)
+      {
+        inFile.seekg(0, std::ios::end);
+        buffer.resize((size_t)inFile.tellg());
+        inFile.seekg(0, std::ios::beg);
+        if(!buffer.empty())
+          inFile.read(&buffer[0], buffer.size());
+      }
       std::string line, word, temp_word, next_word;
 
       int counter(0);
       bool isVert(false), isElt(false), isBdy(false), isCurv(false), isRef(false), isVar(false);
 
-      while (std::getline(inFile,line))
+      size_t line_start = 0;
+      while (line_start < buffer.size())
       {
+        size_t line_end = buffer.find('\n', line_start);
+        if(line_end == buffer.npos)
+          line_end = buffer.size();
+        line.assign(buffer, line_start, line_end - line_start);
+        line_start = line_end + 1;
+
         // Remove all comments, unnecessary blank spaces, commas and paranthesis
         strip(line);
 
         if(line.find_first_not_of("\t ") != line.npos)
         {
-          std::istringstream stream(line);
-          stream >> word;
+          LineTokenizer stream(line);
+          stream.next(word);
 
           if(*word.rbegin() == '=')
           {
@@ -222,9 +289,7 @@ namespace Hermes
           {
             if(isVert)
             {
-              std::istringstream istr(word);
-
-              if(!(istr >> dummy_dbl))
+              if(!is_double(word))
                 x_vertex.push_back(atof(vars_[restore(word)][0].c_str()));
               else
                 x_vertex.push_back(atof(word.c_str()));
@@ -233,9 +298,7 @@ namespace Hermes
             }
             if(isElt)
             {
-              std::istringstream istr(word);
-
-              if(!(istr >> dummy_int))
+              if(!is_int(word))
                 en1.push_back(atoi(vars_[restore(word)][0].c_str()));
               else
                 en1.push_back(atoi(word.c_str()));
@@ -244,9 +307,7 @@ namespace Hermes
             }
             else if(isBdy)
             {
-              std::istringstream istr(word);
-
-              if(!(istr >> dummy_dbl))
+              if(!is_double(word))
                 bdy_first.push_back(atof(vars_[restore(word)][0].c_str()));
               else
                 bdy_first.push_back(atof(word.c_str()));
@@ -255,9 +316,7 @@ namespace Hermes
             }
             else if(isCurv)
             {
-              std::istringstream istr(word);
-
-              if(!(istr >> dummy_int))
+              if(!is_int(word))
                 curv_first.push_back(atoi(vars_[restore(word)][0].c_str()));
               else
                 curv_first.push_back(atoi(word.c_str()));
@@ -266,9 +325,7 @@ namespace Hermes
             }
             else if(isRef)
             {
-              std::istringstream istr(word);
-
-              if(!(istr >> dummy_int))
+              if(!is_int(word))
                 ref_elt.push_back(atoi(vars_[restore(word)][0].c_str()));
               else
                 ref_elt.push_back(atoi(word.c_str()));
@@ -284,20 +341,18 @@ namespace Hermes
 
           if(isVert)
           {
-            while (stream >> word)
+            while (stream.next(word))
             {
-              std::istringstream istr(word);
-
               if(counter%2 == 0)
               {
-                if(!(istr >> dummy_dbl))
+                if(!is_double(word))
                   x_vertex.push_back(atof(vars_[restore(word)][0].c_str()));
                 else
                   x_vertex.push_back(atof(word.c_str()));
               }
               else
               {
-                if(!(istr >> dummy_dbl))
+                if(!is_double(word))
                   y_vertex.push_back(atof(vars_[restore(word)][0].c_str()));
                 else
                   y_vertex.push_back(atof(word.c_str()));
@@ -308,34 +363,32 @@ namespace Hermes
           }
           else if(isElt)
           {
-            while (stream >> word)
+            while (stream.next(word))
             {
-              std::istringstream istr(word);
-
               if(counter%5 == 0)
               {
-                if(!(istr >> dummy_int))
+                if(!is_int(word))
                   en1.push_back(atoi(vars_[restore(word)][0].c_str()));
                 else
                   en1.push_back(atoi(word.c_str()));
               }
               else if(counter%5 == 1)
               {
-                if(!(istr >> dummy_int))
+                if(!is_int(word))
                   en2.push_back(atoi(vars_[restore(word)][0].c_str()));
                 else
                   en2.push_back(atoi(word.c_str()));
               }
               else if(counter%5 == 2)
               {
-                if(!(istr >> dummy_int))
+                if(!is_int(word))
                   en3.push_back(atoi(vars_[restore(word)][0].c_str()));
                 else
                   en3.push_back(atoi(word.c_str()));
               }
               else if(counter%5 == 3)
               {
-                if(!(istr >> dummy_int))
+                if(!is_int(word))
                 {
                   en4.push_back(-1);
                   e_mtl.push_back(restore(word));
@@ -353,20 +406,18 @@ namespace Hermes
           }
           else if(isBdy)
           {
-            while (stream >> word)
+            while (stream.next(word))
             {
-              std::istringstream istr(word);
-
               if(counter%3 == 0)
               {
-                if(!(istr >> dummy_int))
+                if(!is_int(word))
                   bdy_first.push_back(atoi(vars_[restore(word)][0].c_str()));
                 else
                   bdy_first.push_back(atoi(word.c_str()));
               }
               else if(counter%3 == 1)
               {
-                if(!(istr >> dummy_int))
+                if(!is_int(word))
                   bdy_second.push_back(atoi(vars_[restore(word)][0].c_str()));
                 else
                   bdy_second.push_back(atoi(word.c_str()));
@@ -379,27 +430,25 @@ namespace Hermes
           }
           else if(isCurv)
           {
-            while (stream >> word)
+            while (stream.next(word))
             {
-              std::istringstream istr(word);
-
               if(counter%5 == 0)
               {
-                if(!(istr >> dummy_int))
+                if(!is_int(word))
                   curv_first.push_back(atoi(vars_[restore(word)][0].c_str()));
                 else
                   curv_first.push_back(atoi(word.c_str()));
               }
               else if(counter%5 == 1)
               {
-                if(!(istr >> dummy_int))
+                if(!is_int(word))
                   curv_second.push_back(atoi(vars_[restore(word)][0].c_str()));
                 else
                   curv_second.push_back(atoi(word.c_str()));
               }
               else if(counter%5 == 2)
               {
-                if(istr >> dummy_dbl)
+                if(is_double(word))
                 {
                   curv_third.push_back(atof(word.c_str()));
                 }
@@ -408,7 +457,8 @@ namespace Hermes
                   curv_third.push_back(atof(vars_[restore(word)][0].c_str()));
                 }
 
-                stream >> next_word;
+                next_word.clear();
+                stream.next(next_word);
 
                 if(next_word == "")
                 {
@@ -436,20 +486,18 @@ namespace Hermes
           }
           else if(isRef)
           {
-            while (stream >> word)
+            while (stream.next(word))
             {
-              std::istringstream istr(word);
-
               if(counter%2 == 0)
               {
-                if(!(istr >> dummy_int))
+                if(!is_int(word))
                   ref_elt.push_back(atoi(vars_[restore(word)][0].c_str()));
                 else
                   ref_elt.push_back(atoi(word.c_str()));
               }
               else
               {
-                if(!(istr >> dummy_int))
+                if(!is_int(word))
                   ref_type.push_back(atoi(vars_[restore(word)][0].c_str()));
                 else
                   ref_type.push_back(atoi(word.c_str()));
@@ -460,7 +508,7 @@ namespace Hermes
           }
           else if(isVar)
           {
-            while (stream >> word)
+            while (stream.next(word))
             {
               vars_[temp_word].push_back(restore(word));
               ++counter;
@@ -18,7 +18,8 @@
 #include <string.h>
 #include "mesh_reader_exodusii.h"
 #include "mesh.h"
-#include <map>
+#include <vector>
+#include <algorithm>
 
 #ifdef WITH_EXODUSII
 #include <exodusII.h>
@@ -39,24 +40,18 @@ namespace Hermes
     {
     }
 
-    struct Vertex
+    // Orders the nodes by their coordinates, the nodes with the same coordinates by their index.
+    struct NodeCompare
     {
-      double x, y;
-    };
-
-    // needed for comparison of vertices inside std::map
-    struct VCompare
-    {
-      bool operator()(Vertex a, Vertex b) const
+      NodeCompare(const double* x, const double* y) : x(x), y(y) {}
+      bool operator()(int a, int b) const
       {
-        if(a.x < b.x) return true;
-        else if(a.x > b.x) return false;
-        else
-        {
-          if(a.y < b.y) return true;
-          return false;
-        }
+        if(x[a] != x[b]) return x[a] < x[b];
+        if(y[a] != y[b]) return y[a] < y[b];
+        return a < b;
       }
+      const double* x;
+      const double* y;
     };
 
     bool MeshReaderExodusII::load(const char *file_name, Mesh *mesh)
@@ -83,37 +78,43 @@ namespace Hermes
       double *y = new double[n_nodes];
       err = ex_get_coord(exoid, x, y, NULL);
 
-      // remove duplicate vertices and build renumbering map
-      std::map<Vertex, int, VCompare> vtx_list;        // map for eliminating duplicities
-      std::map<int, int> vmap;                // reindexing map
-      Hermes::vector<Vertex> vtx_arr;              // vertex array
+      // remove duplicate vertices and build renumbering map: after sorting the nodes by their coordinates
+      // the duplicates are neighbors, the vertices are numbered in the order of the first occurrence
+      std::vector<int> order(n_nodes);
+      for (int i = 0; i < n_nodes; i++)
+        order[i] = i;
+      std::sort(order.begin(), order.end(), NodeCompare(x, y));
+      std::vector<int> first(n_nodes);    // the first node with the same coordinates
+      for (int k = 0; k < n_nodes; k++)
+      {
+        int i = order[k];
+        if(k > 0 && x[i] == x[order[k - 1]] && y[i] == y[order[k - 1]])
+          first[i] = first[order[k - 1]];
+        else
+          first[i] = i;
+      }
+
+      std::vector<int> vmap(n_nodes + 1);    // reindexing map (the file numbers the nodes from 1)
+      int n_vtx = 0;
+      for (int i = 0; i < n_nodes; i++)
+        if(first[i] == i)
+          n_vtx++;
+      double2 *vtx = new double2[n_vtx];
       int vid = 0;
       for (int i = 0; i < n_nodes; i++)
       {
-        int k;
-        Vertex v = { x[i], y[i] };
-        if(vtx_list.count(v) == 0)
+        if(first[i] == i)
         {
-          vtx_arr.push_back(v);
-          k = vid++;
-          vtx_list[v] = k;
+          vtx[vid][0] = x[i];
+          vtx[vid][1] = y[i];
+          vmap[i + 1] = vid++;
         }
         else
-          k = vtx_list[v];
-
-        vmap[i + 1] = k;
+          vmap[i + 1] = vmap[first[i] + 1];
       }
       delete [] x;
       delete [] y;
 
-      int n_vtx = vtx_arr.size();
-      double2 *vtx = new double2[n_vtx];
-      for (int i = 0; i < n_vtx; i++)
-      {
-        vtx[i][0] = vtx_arr[i].x;
-        vtx[i][1] = vtx_arr[i].y;
-      }
-
       int n_tri = 0;    // number of triangles
       int n_quad = 0;    // number of quads
 
@@ -245,7 +246,7 @@ namespace Hermes
 
         for (int j = 0; j < num_elem_in_set; j++)
         {
-          int nv = el_nv[side_list[j] - 1];      // # of vertices of the element
+          int nv = el_nv[elem_list[j] - 1];      // # of vertices of the element
           int vt = side_list[j] - 1;
           marks[im][0] = els[elem_list[j] - 1][vt];
           marks[im][1] = els[elem_list[j] - 1][(vt + 1) % nv];
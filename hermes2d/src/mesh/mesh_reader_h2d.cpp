@@ -360,10 +360,7 @@ namespace Hermes
       }
 
       // update refmap coeffs of curvilinear elements
-      Element* e;
-      for_all_elements(e, mesh)
-        if(e->cm != NULL)
-          e->cm->update_refmap_coeffs(e);
+      mesh->precalculate_refmap_coeffs();
 
       //// refinements /////////////////////////////////////////////////////////////
       if(m.n_ref > 0)
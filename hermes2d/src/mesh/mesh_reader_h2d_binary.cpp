@@ -0,0 +1,845 @@
+// This file is part of Hermes2D
+//
+// Hermes2D is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D; if not, see <http://www.gnu.prg/licenses/>.
+
+#include <string.h>
+#include <fstream>
+#include <algorithm>
+#include "mesh.h"
+#include "mesh_reader_h2d_binary.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    static const char H2D_BINARY_MESH_MAGIC[8] = { 'H', '2', 'D', 'M', 'E', 'S', 'H', 'B' };
+    static const char H2D_BINARY_MESH_DELTA_MAGIC[8] = { 'H', '2', 'D', 'M', 'E', 'S', 'H', 'D' };
+    static const char H2D_BINARY_MESH_TREE_MAGIC[8] = { 'H', '2', 'D', 'M', 'E', 'S', 'H', 'T' };
+    static const int H2D_BINARY_MESH_BYTE_ORDER = 0x01020304;
+
+    static size_t aligned_size(size_t bytes)
+    {
+      return (bytes + 7) & ~(size_t)7;
+    }
+
+    static void write_block(std::ofstream& out, const void* data, size_t bytes)
+    {
+      static const char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+      if(bytes > 0)
+        out.write((const char*)data, bytes);
+      out.write(padding, aligned_size(bytes) - bytes);
+    }
+
+    MeshReaderH2DBinary::Layout::Layout(const Header& header)
+    {
+      vertices = aligned_size(sizeof(Header));
+      elements = vertices + aligned_size(2 * (size_t)header.vertex_count * sizeof(double));
+      boundary_edges = elements + aligned_size(5 * (size_t)header.element_count * sizeof(int));
+      curves = boundary_edges + aligned_size(3 * (size_t)header.boundary_edge_count * sizeof(int));
+      curve_data = curves + aligned_size(6 * (size_t)header.curve_count * sizeof(int));
+      refinements = curve_data + aligned_size((size_t)header.curve_data_count * sizeof(double));
+      markers = refinements + aligned_size(2 * (size_t)header.refinement_count * sizeof(int));
+      marker_chars = markers + aligned_size(2 * (size_t)(header.element_marker_count + header.boundary_marker_count) * sizeof(int));
+      total = marker_chars + aligned_size((size_t)header.marker_chars_count);
+    }
+
+    MeshReaderH2DBinary::MeshReaderH2DBinary()
+    {
+    }
+
+    MeshReaderH2DBinary::~MeshReaderH2DBinary()
+    {
+    }
+
+    bool MeshReaderH2DBinary::load(const char *filename, Mesh *mesh)
+    {
+      return load(filename, mesh, -1);
+    }
+
+    bool MeshReaderH2DBinary::load(const char *filename, Mesh *mesh, int refinement_count)
+    {
+#ifndef WIN32
+      int fd = open(filename, O_RDONLY);
+      if(fd < 0)
+        throw Hermes::Exceptions::MeshLoadFailureException("Could not open the binary mesh file %s.", filename);
+
+      struct stat file_stat;
+      if(fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(Header))
+      {
+        close(fd);
+        throw Hermes::Exceptions::MeshLoadFailureException("The file %s is not a binary mesh file.", filename);
+      }
+      size_t size = (size_t)file_stat.st_size;
+
+      void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if(data == MAP_FAILED)
+        throw Hermes::Exceptions::MeshLoadFailureException("Could not map the binary mesh file %s into memory.", filename);
+
+      try
+      {
+        load((const char*)data, size, mesh, refinement_count);
+      }
+      catch(...)
+      {
+        munmap(data, size);
+        throw;
+      }
+      munmap(data, size);
+#else
+      std::ifstream in(filename, std::ios::in | std::ios::binary);
+      if(!in.is_open())
+        throw Hermes::Exceptions::MeshLoadFailureException("Could not open the binary mesh file %s.", filename);
+      in.seekg(0, std::ios::end);
+      size_t size = (size_t)in.tellg();
+      in.seekg(0, std::ios::beg);
+
+      // double storage keeps the blocks aligned.
+      double* data = new double[size / sizeof(double) + 1];
+      in.read((char*)data, size);
+      in.close();
+
+      try
+      {
+        load((const char*)data, size, mesh, refinement_count);
+      }
+      catch(...)
+      {
+        delete [] data;
+        throw;
+      }
+      delete [] data;
+#endif
+      return true;
+    }
+
+    void MeshReaderH2DBinary::load(const char* data, size_t size, Mesh *mesh, int refinement_count)
+    {
+      if(size >= sizeof(DeltaHeader) && memcmp(data, H2D_BINARY_MESH_DELTA_MAGIC, sizeof(H2D_BINARY_MESH_DELTA_MAGIC)) == 0)
+      {
+        const DeltaHeader* header = (const DeltaHeader*)data;
+        if(header->byte_order != H2D_BINARY_MESH_BYTE_ORDER)
+          throw Hermes::Exceptions::MeshLoadFailureException("The binary mesh file was written on a platform with a different byte order.");
+        if(header->version != H2D_BINARY_MESH_VERSION)
+          throw Hermes::Exceptions::MeshLoadFailureException("Unsupported binary mesh file version %i (expected %i).", header->version, H2D_BINARY_MESH_VERSION);
+
+        size_t parent_name_offset = aligned_size(sizeof(DeltaHeader));
+        size_t refinements_offset = parent_name_offset + aligned_size((size_t)header->parent_name_length);
+        if(header->parent_name_length <= 0 || header->prefix_count < 0 || header->refinement_count < 0 || size < refinements_offset + 2 * (size_t)header->refinement_count * sizeof(int))
+          throw Hermes::Exceptions::MeshLoadFailureException("Corrupt binary mesh delta file.");
+
+        // The parent file, with its own part of the refinements, then the rest.
+        int total_count = header->prefix_count + header->refinement_count;
+        if(refinement_count < 0 || refinement_count > total_count)
+          refinement_count = total_count;
+        std::string parent_filename(data + parent_name_offset, header->parent_name_length);
+        load(parent_filename.c_str(), mesh, std::min(refinement_count, (int)header->prefix_count));
+        if(refinement_count > header->prefix_count)
+        {
+          apply_refinements(mesh, (const int*)(data + refinements_offset), refinement_count - header->prefix_count);
+          mesh->initial_single_check();
+        }
+        return;
+      }
+
+      if(size >= sizeof(TreeHeader) && memcmp(data, H2D_BINARY_MESH_TREE_MAGIC, sizeof(H2D_BINARY_MESH_TREE_MAGIC)) == 0)
+      {
+        load_tree(data, size, mesh);
+        return;
+      }
+
+      if(size < sizeof(Header) || memcmp(data, H2D_BINARY_MESH_MAGIC, sizeof(H2D_BINARY_MESH_MAGIC)) != 0)
+        throw Hermes::Exceptions::MeshLoadFailureException("The file is not a binary mesh file.");
+
+      const Header* header = (const Header*)data;
+      if(header->byte_order != H2D_BINARY_MESH_BYTE_ORDER)
+        throw Hermes::Exceptions::MeshLoadFailureException("The binary mesh file was written on a platform with a different byte order.");
+      if(header->version != H2D_BINARY_MESH_VERSION)
+        throw Hermes::Exceptions::MeshLoadFailureException("Unsupported binary mesh file version %i (expected %i).", header->version, H2D_BINARY_MESH_VERSION);
+
+      Layout layout(*header);
+      if(size < layout.total)
+        throw Hermes::Exceptions::MeshLoadFailureException("The binary mesh file is truncated.");
+
+      mesh->free();
+
+      // Initialize mesh.
+      int hash_size = HashTable::H2D_DEFAULT_HASH_SIZE;
+      while (hash_size < 8 * header->vertex_count)
+        hash_size *= 2;
+      mesh->init(hash_size);
+
+      // Markers //
+      load_markers((const int*)(data + layout.markers), data + layout.marker_chars, header->element_marker_count, header->boundary_marker_count, header->marker_chars_count, mesh);
+
+      // Vertices //
+      const double* vertices = (const double*)(data + layout.vertices);
+      for (int vertex_i = 0; vertex_i < header->vertex_count; vertex_i++)
+      {
+        Node* node = mesh->nodes.add();
+        assert(node->id == vertex_i);
+        node->ref = TOP_LEVEL_REF;
+        node->type = HERMES_TYPE_VERTEX;
+        node->bnd = 0;
+        node->p1 = node->p2 = -1;
+        node->next_hash = NULL;
+        node->x = vertices[2 * vertex_i];
+        node->y = vertices[2 * vertex_i + 1];
+      }
+      mesh->ntopvert = header->vertex_count;
+
+      // Elements //
+      mesh->nbase = mesh->nactive = mesh->ninitial = header->element_count;
+      const int* elements = (const int*)(data + layout.elements);
+      for (int element_i = 0; element_i < header->element_count; element_i++)
+      {
+        const int* element = elements + 5 * element_i;
+        int nvert = element[3] < 0 ? 3 : 4;
+        for (int i = 0; i < nvert; i++)
+          if(element[i] < 0 || element[i] >= header->vertex_count)
+            throw Hermes::Exceptions::MeshLoadFailureException("Element #%i: vertex #%i does not exist.", element_i, element[i]);
+
+        if(nvert == 3)
+          mesh->create_triangle(element[4], &mesh->nodes[element[0]], &mesh->nodes[element[1]], &mesh->nodes[element[2]], NULL);
+        else
+          mesh->create_quad(element[4], &mesh->nodes[element[0]], &mesh->nodes[element[1]], &mesh->nodes[element[2]], &mesh->nodes[element[3]], NULL);
+      }
+
+      // Boundaries //
+      const int* boundary_edges = (const int*)(data + layout.boundary_edges);
+      for (int edge_i = 0; edge_i < header->boundary_edge_count; edge_i++)
+      {
+        int v1 = boundary_edges[3 * edge_i];
+        int v2 = boundary_edges[3 * edge_i + 1];
+        int marker = boundary_edges[3 * edge_i + 2];
+
+        Node* en = mesh->peek_edge_node(v1, v2);
+        if(en == NULL)
+          throw Hermes::Exceptions::MeshLoadFailureException("Boundary data #%d: edge %d-%d does not exist.", edge_i, v1, v2);
+
+        en->marker = marker;
+
+        // This is extremely important, as in DG, it is assumed that negative boundary markers are reserved
+        // for the inner edges.
+        if(marker > 0)
+        {
+          mesh->nodes[v1].bnd = 1;
+          mesh->nodes[v2].bnd = 1;
+          en->bnd = 1;
+        }
+      }
+
+      // Curves //
+      const int* curves = (const int*)(data + layout.curves);
+      const double* curve_data = (const double*)(data + layout.curve_data);
+      int curve_data_position = 0;
+      for (int curve_i = 0; curve_i < header->curve_count; curve_i++)
+      {
+        const int* curve = curves + 6 * curve_i;
+        int p1 = curve[0], p2 = curve[1];
+
+        Node* en = mesh->peek_edge_node(p1, p2);
+        if(en == NULL)
+          throw Hermes::Exceptions::MeshLoadFailureException("Curve #%d: edge %d-%d does not exist.", curve_i, p1, p2);
+        if(curve[4] < 2 || curve[5] < 0 || curve_data_position + 1 + 3 * curve[4] + curve[5] > header->curve_data_count)
+          throw Hermes::Exceptions::MeshLoadFailureException("Curve #%d: corrupt curve data.", curve_i);
+
+        Nurbs* nurbs = new Nurbs;
+        nurbs->arc = (curve[2] != 0);
+        nurbs->degree = curve[3];
+        nurbs->np = curve[4];
+        nurbs->nk = curve[5];
+        nurbs->angle = curve_data[curve_data_position++];
+        nurbs->pt = new double3[nurbs->np];
+        memcpy(nurbs->pt, curve_data + curve_data_position, 3 * nurbs->np * sizeof(double));
+        curve_data_position += 3 * nurbs->np;
+        nurbs->kv = new double[nurbs->nk];
+        memcpy(nurbs->kv, curve_data + curve_data_position, nurbs->nk * sizeof(double));
+        curve_data_position += nurbs->nk;
+        nurbs->ref = 0;
+
+        // assign the curve to the elements sharing the edge node
+        for (unsigned int node_i = 0; node_i < 2; node_i++)
+        {
+          Element* e = en->elem[node_i];
+          if(e == NULL) continue;
+
+          if(e->cm == NULL)
+          {
+            e->cm = new CurvMap;
+            memset(e->cm, 0, sizeof(CurvMap));
+            e->cm->toplevel = 1;
+            e->cm->order = 4;
+          }
+
+          int idx = -1;
+          for (unsigned j = 0; j < e->get_nvert(); j++)
+            if(e->en[j] == en) { idx = j; break; }
+          assert(idx >= 0);
+
+          if(e->vn[idx]->id == p1)
+          {
+            e->cm->nurbs[idx] = nurbs;
+            nurbs->ref++;
+          }
+          else
+          {
+            Nurbs* nurbs_rev = mesh->reverse_nurbs(nurbs);
+            e->cm->nurbs[idx] = nurbs_rev;
+            nurbs_rev->ref++;
+          }
+        }
+        if(!nurbs->ref) delete nurbs;
+      }
+
+      // update refmap coeffs of curvilinear elements
+      mesh->precalculate_refmap_coeffs();
+
+      // refinements.
+      if(refinement_count < 0 || refinement_count > header->refinement_count)
+        refinement_count = header->refinement_count;
+      apply_refinements(mesh, (const int*)(data + layout.refinements), refinement_count);
+
+      mesh->initial_single_check();
+    }
+
+    void MeshReaderH2DBinary::load_markers(const int* markers, const char* marker_chars, int element_marker_count, int boundary_marker_count, int marker_chars_count, Mesh *mesh)
+    {
+      int marker_chars_position = 0;
+      for (int marker_i = 0; marker_i < element_marker_count + boundary_marker_count; marker_i++)
+      {
+        int internal_marker = markers[2 * marker_i];
+        int length = markers[2 * marker_i + 1];
+        if(length < 0 || marker_chars_position + length > marker_chars_count)
+          throw Hermes::Exceptions::MeshLoadFailureException("Corrupt marker #%i in the binary mesh file.", marker_i);
+
+        Mesh::MarkersConversion& conversion = (marker_i < element_marker_count) ? (Mesh::MarkersConversion&)mesh->element_markers_conversion : (Mesh::MarkersConversion&)mesh->boundary_markers_conversion;
+        conversion.insert_marker(internal_marker, std::string(marker_chars + marker_chars_position, length));
+        if(internal_marker >= conversion.min_marker_unused)
+          conversion.min_marker_unused = internal_marker + 1;
+        marker_chars_position += length;
+      }
+    }
+
+    void MeshReaderH2DBinary::save_markers(Mesh *mesh, std::vector<int>& markers, std::string& marker_chars, int& element_marker_count, int& boundary_marker_count)
+    {
+      for (int conversion_i = 0; conversion_i < 2; conversion_i++)
+      {
+        Mesh::MarkersConversion& conversion = (conversion_i == 0) ? (Mesh::MarkersConversion&)mesh->element_markers_conversion : (Mesh::MarkersConversion&)mesh->boundary_markers_conversion;
+        for(std::map<int, std::string>::const_iterator it = conversion.conversion_table.begin(); it != conversion.conversion_table.end(); ++it)
+        {
+          markers.push_back(it->first);
+          markers.push_back(it->second.length());
+          marker_chars.append(it->second);
+        }
+        if(conversion_i == 0)
+          element_marker_count = markers.size() / 2;
+        else
+          boundary_marker_count = markers.size() / 2 - element_marker_count;
+      }
+    }
+
+    void MeshReaderH2DBinary::load_tree(const char* data, size_t size, Mesh *mesh)
+    {
+      const TreeHeader* header = (const TreeHeader*)data;
+      if(header->byte_order != H2D_BINARY_MESH_BYTE_ORDER)
+        throw Hermes::Exceptions::MeshLoadFailureException("The binary mesh file was written on a platform with a different byte order.");
+      if(header->version != H2D_BINARY_MESH_VERSION)
+        throw Hermes::Exceptions::MeshLoadFailureException("Unsupported binary mesh file version %i (expected %i).", header->version, H2D_BINARY_MESH_VERSION);
+      if(header->node_count < 0 || header->element_count < 0 || header->curv_map_count < 0 || header->curve_count < 0 || header->curve_data_count < 0
+        || header->refinement_count < 0 || header->element_marker_count < 0 || header->boundary_marker_count < 0 || header->marker_chars_count < 0)
+        throw Hermes::Exceptions::MeshLoadFailureException("Corrupt binary mesh tree file.");
+
+      size_t nodes_offset = aligned_size(sizeof(TreeHeader));
+      size_t elements_offset = nodes_offset + aligned_size((size_t)header->node_count * sizeof(TreeNode));
+      size_t curv_maps_offset = elements_offset + aligned_size((size_t)header->element_count * sizeof(TreeElement));
+      size_t curves_offset = curv_maps_offset + aligned_size((size_t)header->curv_map_count * sizeof(TreeCurvMap));
+      size_t curve_data_offset = curves_offset + aligned_size(7 * (size_t)header->curve_count * sizeof(int));
+      size_t refinements_offset = curve_data_offset + aligned_size((size_t)header->curve_data_count * sizeof(double));
+      size_t markers_offset = refinements_offset + aligned_size(2 * (size_t)header->refinement_count * sizeof(int));
+      size_t marker_chars_offset = markers_offset + aligned_size(2 * (size_t)(header->element_marker_count + header->boundary_marker_count) * sizeof(int));
+      if(size < marker_chars_offset + aligned_size((size_t)header->marker_chars_count))
+        throw Hermes::Exceptions::MeshLoadFailureException("The binary mesh file is truncated.");
+
+      mesh->free();
+
+      int hash_size = HashTable::H2D_DEFAULT_HASH_SIZE;
+      while (hash_size < header->node_count)
+        hash_size *= 2;
+      mesh->init(hash_size);
+
+      load_markers((const int*)(data + markers_offset), data + marker_chars_offset, header->element_marker_count, header->boundary_marker_count, header->marker_chars_count, mesh);
+
+      // The items with their ids first, the pointers can then be set directly.
+      const TreeNode* tree_nodes = (const TreeNode*)(data + nodes_offset);
+      const TreeElement* tree_elements = (const TreeElement*)(data + elements_offset);
+      for (int node_i = 0; node_i < header->node_count; node_i++)
+        mesh->nodes.add();
+      for (int element_i = 0; element_i < header->element_count; element_i++)
+        mesh->elements.add();
+
+      for (int node_i = 0; node_i < header->node_count; node_i++)
+      {
+        const TreeNode& tree_node = tree_nodes[node_i];
+        if(!(tree_node.flags & 1))
+          continue;
+        Node* node = &mesh->nodes[node_i];
+        node->type = (tree_node.flags >> 1) & 1;
+        node->bnd = (tree_node.flags >> 2) & 1;
+        node->ref = tree_node.flags >> 3;
+        node->p1 = tree_node.p1;
+        node->p2 = tree_node.p2;
+        node->next_hash = NULL;
+        if(node->type == HERMES_TYPE_VERTEX)
+        {
+          node->x = tree_node.x;
+          node->y = tree_node.y;
+        }
+        else
+        {
+          node->marker = tree_node.marker;
+          for (int i = 0; i < 2; i++)
+          {
+            if(tree_node.elem[i] >= header->element_count)
+              throw Hermes::Exceptions::MeshLoadFailureException("Node #%i: element #%i does not exist.", node_i, tree_node.elem[i]);
+            node->elem[i] = tree_node.elem[i] < 0 ? NULL : &mesh->elements[tree_node.elem[i]];
+          }
+        }
+      }
+
+      for (int element_i = 0; element_i < header->element_count; element_i++)
+      {
+        const TreeElement& tree_element = tree_elements[element_i];
+        if(!(tree_element.flags & 1))
+          continue;
+        Element* e = &mesh->elements[element_i];
+        e->active = (tree_element.flags >> 1) & 1;
+        e->nvert = tree_element.flags >> 2;
+        e->marker = tree_element.marker;
+        e->iro_cache = -1;
+        e->cm = NULL;
+        e->visited = false;
+        e->areaCalculated = e->center_set = e->diameterCalculated = false;
+        if(e->nvert != 3 && e->nvert != 4)
+          throw Hermes::Exceptions::MeshLoadFailureException("Element #%i: wrong number of vertices.", element_i);
+        if(tree_element.parent >= header->element_count)
+          throw Hermes::Exceptions::MeshLoadFailureException("Element #%i: parent #%i does not exist.", element_i, tree_element.parent);
+        e->parent = tree_element.parent < 0 ? NULL : &mesh->elements[tree_element.parent];
+
+        for (int i = 0; i < H2D_MAX_NUMBER_VERTICES; i++)
+        {
+          int id = tree_element.vn[i];
+          if(i < (int)e->nvert && (id < 0 || id >= header->node_count))
+            throw Hermes::Exceptions::MeshLoadFailureException("Element #%i: vertex #%i does not exist.", element_i, id);
+          e->vn[i] = i < (int)e->nvert ? &mesh->nodes[id] : NULL;
+        }
+        for (int i = 0; i < H2D_MAX_ELEMENT_SONS; i++)
+        {
+          int id = tree_element.en_or_sons[i];
+          if(id >= (e->active ? header->node_count : header->element_count))
+            throw Hermes::Exceptions::MeshLoadFailureException("Element #%i: node or son #%i does not exist.", element_i, id);
+          if(e->active)
+            e->en[i] = (id < 0) ? NULL : &mesh->nodes[id];
+          else
+            e->sons[i] = (id < 0) ? NULL : &mesh->elements[id];
+        }
+      }
+
+      // The unused ids, reused in the same order as after sort_unused().
+      for (int node_i = 0; node_i < header->node_count; node_i++)
+        if(!(tree_nodes[node_i].flags & 1))
+          mesh->nodes.remove(node_i);
+      for (int element_i = 0; element_i < header->element_count; element_i++)
+        if(!(tree_elements[element_i].flags & 1))
+          mesh->elements.remove(element_i);
+      mesh->nodes.sort_unused();
+      mesh->elements.sort_unused();
+      mesh->rebuild();
+
+      mesh->nbase = header->nbase;
+      mesh->nactive = header->nactive;
+      mesh->ntopvert = header->ntopvert;
+      mesh->ninitial = header->ninitial;
+
+      // Curved maps //
+      const TreeCurvMap* curv_maps = (const TreeCurvMap*)(data + curv_maps_offset);
+      for (int curv_map_i = 0; curv_map_i < header->curv_map_count; curv_map_i++)
+      {
+        const TreeCurvMap& tree_curv_map = curv_maps[curv_map_i];
+        if(tree_curv_map.element < 0 || tree_curv_map.element >= header->element_count || !mesh->elements[tree_curv_map.element].used
+          || (!tree_curv_map.toplevel && (tree_curv_map.parent < 0 || tree_curv_map.parent >= header->element_count)))
+          throw Hermes::Exceptions::MeshLoadFailureException("Curved map #%i: corrupt data.", curv_map_i);
+
+        CurvMap* cm = new CurvMap;
+        memset(cm, 0, sizeof(CurvMap));
+        cm->toplevel = (tree_curv_map.toplevel != 0);
+        cm->order = tree_curv_map.order;
+        if(!cm->toplevel)
+        {
+          cm->parent = &mesh->elements[tree_curv_map.parent];
+          cm->part = tree_curv_map.part;
+        }
+        mesh->elements[tree_curv_map.element].cm = cm;
+      }
+
+      // Curves //
+      const int* curves = (const int*)(data + curves_offset);
+      const double* curve_data = (const double*)(data + curve_data_offset);
+      int curve_data_position = 0;
+      for (int curve_i = 0; curve_i < header->curve_count; curve_i++)
+      {
+        const int* curve = curves + 7 * curve_i;
+        int element_id = curve[0], edge = curve[1];
+        if(element_id < 0 || element_id >= header->element_count || edge < 0 || edge >= H2D_MAX_NUMBER_EDGES
+          || mesh->elements[element_id].cm == NULL || !mesh->elements[element_id].cm->toplevel)
+          throw Hermes::Exceptions::MeshLoadFailureException("Curve #%d: the element has no top level curved map.", curve_i);
+        if(curve[5] < 2 || curve[6] < 0 || curve_data_position + 1 + 3 * curve[5] + curve[6] > header->curve_data_count)
+          throw Hermes::Exceptions::MeshLoadFailureException("Curve #%d: corrupt curve data.", curve_i);
+
+        Nurbs* nurbs = new Nurbs;
+        nurbs->arc = (curve[2] != 0);
+        nurbs->twin = (curve[3] != 0);
+        nurbs->degree = curve[4];
+        nurbs->np = curve[5];
+        nurbs->nk = curve[6];
+        nurbs->angle = curve_data[curve_data_position++];
+        nurbs->pt = new double3[nurbs->np];
+        memcpy(nurbs->pt, curve_data + curve_data_position, 3 * nurbs->np * sizeof(double));
+        curve_data_position += 3 * nurbs->np;
+        nurbs->kv = new double[nurbs->nk];
+        memcpy(nurbs->kv, curve_data + curve_data_position, nurbs->nk * sizeof(double));
+        curve_data_position += nurbs->nk;
+        nurbs->ref = 1;
+        mesh->elements[element_id].cm->nurbs[edge] = nurbs;
+      }
+
+      mesh->precalculate_refmap_coeffs();
+
+      mesh->refinements.clear();
+      const int* refinements = (const int*)(data + refinements_offset);
+      for (int refinement_i = 0; refinement_i < header->refinement_count; refinement_i++)
+        mesh->refinements.push_back(std::pair<unsigned int, int>(refinements[2 * refinement_i], refinements[2 * refinement_i + 1]));
+
+      mesh->seq = next_mesh_seq();
+      mesh->initial_single_check();
+    }
+
+    bool MeshReaderH2DBinary::save_tree(const char *filename, Mesh *mesh)
+    {
+      if(mesh->seq < 0)
+        throw Hermes::Exceptions::Exception("The mesh to save has not been initialized.");
+
+      TreeHeader header;
+      memset(&header, 0, sizeof(TreeHeader));
+      memcpy(header.magic, H2D_BINARY_MESH_TREE_MAGIC, sizeof(H2D_BINARY_MESH_TREE_MAGIC));
+      header.byte_order = H2D_BINARY_MESH_BYTE_ORDER;
+      header.version = H2D_BINARY_MESH_VERSION;
+      header.node_count = mesh->get_max_node_id();
+      header.element_count = mesh->get_max_element_id();
+      header.nbase = mesh->nbase;
+      header.nactive = mesh->nactive;
+      header.ntopvert = mesh->ntopvert;
+      header.ninitial = mesh->ninitial;
+
+      // nodes
+      std::vector<TreeNode> tree_nodes(header.node_count);
+      if(header.node_count > 0)
+        memset(&tree_nodes[0], 0, header.node_count * sizeof(TreeNode));
+      for (int node_i = 0; node_i < header.node_count; node_i++)
+      {
+        Node* node = &mesh->nodes[node_i];
+        TreeNode& tree_node = tree_nodes[node_i];
+        if(!node->used)
+          continue;
+        tree_node.flags = 1 | (node->type << 1) | (node->bnd << 2) | (node->ref << 3);
+        tree_node.p1 = node->p1;
+        tree_node.p2 = node->p2;
+        if(node->type == HERMES_TYPE_VERTEX)
+        {
+          tree_node.x = node->x;
+          tree_node.y = node->y;
+        }
+        else
+        {
+          tree_node.marker = node->marker;
+          for (int i = 0; i < 2; i++)
+            tree_node.elem[i] = node->elem[i] == NULL ? -1 : node->elem[i]->id;
+        }
+      }
+
+      // elements, curved maps and the curves of the top level ones
+      std::vector<TreeElement> tree_elements(header.element_count);
+      if(header.element_count > 0)
+        memset(&tree_elements[0], 0, header.element_count * sizeof(TreeElement));
+      std::vector<TreeCurvMap> curv_maps;
+      std::vector<int> curves;
+      std::vector<double> curve_data;
+      for (int element_i = 0; element_i < header.element_count; element_i++)
+      {
+        Element* e = mesh->get_element_fast(element_i);
+        TreeElement& tree_element = tree_elements[element_i];
+        if(!e->used)
+          continue;
+        tree_element.flags = 1 | (e->active << 1) | (e->get_nvert() << 2);
+        tree_element.marker = e->marker;
+        tree_element.parent = e->parent == NULL ? -1 : e->parent->id;
+        for (int i = 0; i < H2D_MAX_NUMBER_VERTICES; i++)
+          tree_element.vn[i] = i < e->get_nvert() ? e->vn[i]->id : -1;
+        for (int i = 0; i < H2D_MAX_ELEMENT_SONS; i++)
+        {
+          if(e->active)
+            tree_element.en_or_sons[i] = (i < e->get_nvert() && e->en[i] != NULL) ? e->en[i]->id : -1;
+          else
+            tree_element.en_or_sons[i] = e->sons[i] == NULL ? -1 : e->sons[i]->id;
+        }
+
+        if(e->cm == NULL)
+          continue;
+        TreeCurvMap tree_curv_map;
+        memset(&tree_curv_map, 0, sizeof(TreeCurvMap));
+        tree_curv_map.element = e->id;
+        tree_curv_map.toplevel = e->cm->toplevel ? 1 : 0;
+        tree_curv_map.order = e->cm->order;
+        tree_curv_map.parent = e->cm->toplevel ? -1 : e->cm->parent->id;
+        tree_curv_map.part = e->cm->toplevel ? 0 : e->cm->part;
+        curv_maps.push_back(tree_curv_map);
+
+        if(e->cm->toplevel)
+          for (int i = 0; i < e->get_nvert(); i++)
+            if(e->cm->nurbs[i] != NULL)
+            {
+              Nurbs* nurbs = e->cm->nurbs[i];
+              curves.push_back(e->id);
+              curves.push_back(i);
+              curves.push_back(nurbs->arc ? 1 : 0);
+              curves.push_back(nurbs->twin ? 1 : 0);
+              curves.push_back(nurbs->degree);
+              curves.push_back(nurbs->np);
+              curves.push_back(nurbs->nk);
+              curve_data.push_back(nurbs->angle);
+              for (int j = 0; j < nurbs->np; j++)
+                for (int k = 0; k < 3; k++)
+                  curve_data.push_back(nurbs->pt[j][k]);
+              for (int j = 0; j < nurbs->nk; j++)
+                curve_data.push_back(nurbs->kv[j]);
+            }
+      }
+      header.curv_map_count = curv_maps.size();
+      header.curve_count = curves.size() / 7;
+      header.curve_data_count = curve_data.size();
+
+      // refinements
+      std::vector<int> refinements;
+      for(unsigned int refinement_i = 0; refinement_i < mesh->refinements.size(); refinement_i++)
+      {
+        refinements.push_back(mesh->refinements[refinement_i].first);
+        refinements.push_back(mesh->refinements[refinement_i].second);
+      }
+      header.refinement_count = mesh->refinements.size();
+
+      // markers
+      std::vector<int> markers;
+      std::string marker_chars;
+      save_markers(mesh, markers, marker_chars, header.element_marker_count, header.boundary_marker_count);
+      header.marker_chars_count = marker_chars.length();
+
+      std::ofstream out(filename, std::ios::out | std::ios::binary);
+      if(!out.is_open())
+        throw Hermes::Exceptions::Exception("Could not open the file %s for writing.", filename);
+
+      write_block(out, &header, sizeof(TreeHeader));
+      write_block(out, tree_nodes.empty() ? NULL : &tree_nodes[0], tree_nodes.size() * sizeof(TreeNode));
+      write_block(out, tree_elements.empty() ? NULL : &tree_elements[0], tree_elements.size() * sizeof(TreeElement));
+      write_block(out, curv_maps.empty() ? NULL : &curv_maps[0], curv_maps.size() * sizeof(TreeCurvMap));
+      write_block(out, curves.empty() ? NULL : &curves[0], curves.size() * sizeof(int));
+      write_block(out, curve_data.empty() ? NULL : &curve_data[0], curve_data.size() * sizeof(double));
+      write_block(out, refinements.empty() ? NULL : &refinements[0], refinements.size() * sizeof(int));
+      write_block(out, markers.empty() ? NULL : &markers[0], markers.size() * sizeof(int));
+      write_block(out, marker_chars.data(), marker_chars.length());
+
+      if(out.fail())
+        throw Hermes::Exceptions::Exception("Could not write the binary mesh file %s.", filename);
+      out.close();
+
+      return true;
+    }
+
+    void MeshReaderH2DBinary::apply_refinements(Mesh *mesh, const int* refinements, int count)
+    {
+      for (int refinement_i = 0; refinement_i < count; refinement_i++)
+      {
+        int element_id = refinements[2 * refinement_i];
+        int refinement_type = refinements[2 * refinement_i + 1];
+        if(refinement_type == -1)
+          mesh->unrefine_element_id(element_id);
+        else if(refinement_type == -2)
+          mesh->reorder_hilbert(NULL, element_id);
+        else
+          mesh->refine_element_id(element_id, refinement_type);
+      }
+    }
+
+    bool MeshReaderH2DBinary::save(const char *filename, Mesh *mesh)
+    {
+      Header header;
+      memset(&header, 0, sizeof(Header));
+      memcpy(header.magic, H2D_BINARY_MESH_MAGIC, sizeof(H2D_BINARY_MESH_MAGIC));
+      header.byte_order = H2D_BINARY_MESH_BYTE_ORDER;
+      header.version = H2D_BINARY_MESH_VERSION;
+
+      // Utility pointer.
+      Element* e;
+
+      // vertices
+      std::vector<double> vertices(2 * mesh->ntopvert);
+      for (int i = 0; i < mesh->ntopvert; i++)
+      {
+        vertices[2 * i] = mesh->nodes[i].x;
+        vertices[2 * i + 1] = mesh->nodes[i].y;
+      }
+      header.vertex_count = mesh->ntopvert;
+
+      // elements
+      std::vector<int> elements;
+      elements.reserve(5 * mesh->get_num_base_elements());
+      for (int i = 0; i < mesh->get_num_base_elements(); i++)
+      {
+        e = mesh->get_element_fast(i);
+        if(!e->used)
+          continue;
+        for (int j = 0; j < 4; j++)
+          elements.push_back(j < (int)e->get_nvert() ? e->vn[j]->id : -1);
+        elements.push_back(e->marker);
+      }
+      header.element_count = elements.size() / 5;
+
+      // boundary markers
+      std::vector<int> boundary_edges;
+      for_all_base_elements(e, mesh)
+        for (unsigned i = 0; i < e->get_nvert(); i++)
+          if(mesh->get_base_edge_node(e, i)->marker)
+          {
+            boundary_edges.push_back(e->vn[i]->id);
+            boundary_edges.push_back(e->vn[e->next_vert(i)]->id);
+            boundary_edges.push_back(mesh->get_base_edge_node(e, i)->marker);
+          }
+      header.boundary_edge_count = boundary_edges.size() / 3;
+
+      // curved edges
+      std::vector<int> curves;
+      std::vector<double> curve_data;
+      for_all_base_elements(e, mesh)
+        if(e->is_curved())
+          for (unsigned i = 0; i < e->get_nvert(); i++)
+            if(e->cm->nurbs[i] != NULL && !is_twin_nurbs(e, i))
+            {
+              Nurbs* nurbs = e->cm->nurbs[i];
+              curves.push_back(e->vn[i]->id);
+              curves.push_back(e->vn[e->next_vert(i)]->id);
+              curves.push_back(nurbs->arc ? 1 : 0);
+              curves.push_back(nurbs->degree);
+              curves.push_back(nurbs->np);
+              curves.push_back(nurbs->nk);
+              curve_data.push_back(nurbs->arc ? nurbs->angle : 0.0);
+              for (int j = 0; j < nurbs->np; j++)
+                for (int k = 0; k < 3; k++)
+                  curve_data.push_back(nurbs->pt[j][k]);
+              for (int j = 0; j < nurbs->nk; j++)
+                curve_data.push_back(nurbs->kv[j]);
+            }
+      header.curve_count = curves.size() / 6;
+      header.curve_data_count = curve_data.size();
+
+      // refinements
+      std::vector<int> refinements;
+      for(unsigned int refinement_i = 0; refinement_i < mesh->refinements.size(); refinement_i++)
+      {
+        refinements.push_back(mesh->refinements[refinement_i].first);
+        refinements.push_back(mesh->refinements[refinement_i].second);
+      }
+      header.refinement_count = mesh->refinements.size();
+
+      // markers
+      std::vector<int> markers;
+      std::string marker_chars;
+      save_markers(mesh, markers, marker_chars, header.element_marker_count, header.boundary_marker_count);
+      header.marker_chars_count = marker_chars.length();
+
+      std::ofstream out(filename, std::ios::out | std::ios::binary);
+      if(!out.is_open())
+        throw Hermes::Exceptions::Exception("Could not open the file %s for writing.", filename);
+
+      write_block(out, &header, sizeof(Header));
+      write_block(out, vertices.empty() ? NULL : &vertices[0], vertices.size() * sizeof(double));
+      write_block(out, elements.empty() ? NULL : &elements[0], elements.size() * sizeof(int));
+      write_block(out, boundary_edges.empty() ? NULL : &boundary_edges[0], boundary_edges.size() * sizeof(int));
+      write_block(out, curves.empty() ? NULL : &curves[0], curves.size() * sizeof(int));
+      write_block(out, curve_data.empty() ? NULL : &curve_data[0], curve_data.size() * sizeof(double));
+      write_block(out, refinements.empty() ? NULL : &refinements[0], refinements.size() * sizeof(int));
+      write_block(out, markers.empty() ? NULL : &markers[0], markers.size() * sizeof(int));
+      write_block(out, marker_chars.data(), marker_chars.length());
+
+      if(out.fail())
+        throw Hermes::Exceptions::Exception("Could not write the binary mesh file %s.", filename);
+      out.close();
+
+      return true;
+    }
+
+    bool MeshReaderH2DBinary::save_delta(const char *filename, Mesh *mesh, const char* parent_filename, const Hermes::vector<std::pair<unsigned int, int> >& parent_refinements)
+    {
+      unsigned int prefix_count = 0;
+      while(prefix_count < parent_refinements.size() && prefix_count < mesh->refinements.size() && parent_refinements[prefix_count] == mesh->refinements[prefix_count])
+        prefix_count++;
+
+      DeltaHeader header;
+      memset(&header, 0, sizeof(DeltaHeader));
+      memcpy(header.magic, H2D_BINARY_MESH_DELTA_MAGIC, sizeof(H2D_BINARY_MESH_DELTA_MAGIC));
+      header.byte_order = H2D_BINARY_MESH_BYTE_ORDER;
+      header.version = H2D_BINARY_MESH_VERSION;
+      header.parent_name_length = strlen(parent_filename);
+      header.prefix_count = prefix_count;
+      header.refinement_count = mesh->refinements.size() - prefix_count;
+
+      std::vector<int> refinements;
+      refinements.reserve(2 * header.refinement_count);
+      for(unsigned int refinement_i = prefix_count; refinement_i < mesh->refinements.size(); refinement_i++)
+      {
+        refinements.push_back(mesh->refinements[refinement_i].first);
+        refinements.push_back(mesh->refinements[refinement_i].second);
+      }
+
+      std::ofstream out(filename, std::ios::out | std::ios::binary);
+      if(!out.is_open())
+        throw Hermes::Exceptions::Exception("Could not open the file %s for writing.", filename);
+
+      write_block(out, &header, sizeof(DeltaHeader));
+      write_block(out, parent_filename, header.parent_name_length);
+      write_block(out, refinements.empty() ? NULL : &refinements[0], refinements.size() * sizeof(int));
+
+      if(out.fail())
+        throw Hermes::Exceptions::Exception("Could not write the binary mesh file %s.", filename);
+      out.close();
+
+      return true;
+    }
+  }
+}
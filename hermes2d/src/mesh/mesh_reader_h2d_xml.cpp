@@ -17,6 +17,14 @@
 #include "api2d.h"
 #include "mesh_reader_h2d_xml.h"
 #include <iostream>
+#include <xercesc/sax2/SAX2XMLReader.hpp>
+#include <xercesc/sax2/XMLReaderFactory.hpp>
+#include <xercesc/sax2/DefaultHandler.hpp>
+#include <xercesc/sax2/Attributes.hpp>
+#include <xercesc/sax/SAXParseException.hpp>
+#include <xercesc/util/PlatformUtils.hpp>
+#include <xercesc/util/XMLString.hpp>
+#include <xercesc/util/XMLUni.hpp>
 
 using namespace std;
 
@@ -24,7 +32,98 @@ namespace Hermes
 {
   namespace Hermes2D
   {
-    MeshReaderH2DXML::MeshReaderH2DXML()
+    class MeshReaderH2DXML::StreamingHandler : public xercesc::DefaultHandler
+    {
+    public:
+      /// \param[in] domain True for subdomain files, whose domain is created in the mesh and also stored
+      /// for creating the subdomain meshes afterwards.
+      StreamingHandler(MeshReaderH2DXML* reader, Mesh* mesh, bool domain);
+
+      virtual void startElement(const XMLCh* const uri, const XMLCh* const localname, const XMLCh* const qname, const xercesc::Attributes& attrs);
+      virtual void endElement(const XMLCh* const uri, const XMLCh* const localname, const XMLCh* const qname);
+      virtual void characters(const XMLCh* const chars, const XMLSize_t length);
+
+      /// Creates the meshes of the subdomains from the stored domain.
+      void create_subdomains(Hermes::vector<Mesh *> meshes);
+
+    protected:
+      /// Arc or NURBS as read from the file.
+      struct Curve
+      {
+        int v1, v2;
+        bool arc;
+        double angle;
+        int degree;
+        /// Triples (x, y, weight).
+        std::vector<double> inner_points;
+        std::vector<double> knots;
+      };
+
+      /// Subdomain as read from the file, the lists are empty if not present.
+      struct Subdomain
+      {
+        std::vector<int> vertices;
+        std::vector<int> elements;
+        std::vector<int> boundary_edges;
+        std::vector<int> inner_edges;
+        std::vector<std::pair<int, int> > refinements;
+      };
+
+      /// Attributes of the current XML element.
+      void read_attributes(const xercesc::Attributes& attrs);
+      const std::string& attribute(const char* name) const;
+      int int_attribute(const char* name) const;
+      double double_attribute(const char* name) const;
+      /// The attribute 'm' without leading and trailing whitespaces.
+      std::string marker_attribute() const;
+
+      /// Position (node id) of a vertex referenced in the file.
+      int vertex_position(int v) const;
+
+      void add_vertex();
+      void add_element(bool quad);
+      void add_edge();
+      /// Creates the curve on the edge p1-p2 and assigns it to the elements sharing the edge.
+      void add_curve(Mesh* mesh, const Curve& curve, int p1, int p2, bool skip_missing);
+      /// Finishes the elements once all curves are known.
+      void finish_base_mesh();
+      static void refine(Mesh* mesh, int element_id, int refinement_type);
+
+      MeshReaderH2DXML* reader;
+      Mesh* mesh;
+      bool domain;
+
+      std::vector<std::pair<std::string, std::string> > attributes;
+      std::map<std::string, double> variables;
+      /// Position of the vertex (element) with the index 'i' from the file, -1 if there is none.
+      std::vector<int> vertex_is;
+      std::vector<int> element_is;
+      int edges_read;
+      int curves_read;
+      bool base_mesh_finished;
+      bool in_subdomains;
+      /// The NURBS being read.
+      Curve curve;
+      /// The subdomain list being read, and the text of its current item.
+      std::vector<int>* list;
+      std::string text;
+
+      /// Domain files only: the domain stored for creating the subdomain meshes.
+      /// Per vertex x, y.
+      std::vector<double> vertex_coordinates;
+      /// Per element 4 vertex positions (the last one -1 for triangles) and the index of the marker.
+      std::vector<int> elements;
+      /// Per edge 2 vertex positions, the index of the marker and the index 'i' from the file.
+      std::vector<int> edges;
+      std::vector<std::string> element_markers;
+      std::vector<std::string> boundary_markers;
+      std::map<std::string, int> element_marker_indices;
+      std::map<std::string, int> boundary_marker_indices;
+      std::vector<Curve> curves;
+      std::vector<Subdomain> subdomains;
+    };
+
+    MeshReaderH2DXML::MeshReaderH2DXML() : streaming(false)
     {
     }
 
@@ -32,10 +131,23 @@ namespace Hermes
     {
     }
 
+    void MeshReaderH2DXML::set_streaming(bool to_set)
+    {
+      this->streaming = to_set;
+    }
+
     bool MeshReaderH2DXML::load(const char *filename, Mesh *mesh)
     {
       mesh->free();
 
+      if(this->streaming)
+      {
+        StreamingHandler handler(this, mesh, false);
+        load_streaming(filename, handler);
+        mesh->initial_single_check();
+        return true;
+      }
+
       std::map<unsigned int, unsigned int> vertex_is;
 
       try
@@ -59,6 +171,8 @@ namespace Hermes
             int refinement_type = parsed_xml_mesh->refinements()->ref().at(i).refinement_type();
             if(refinement_type == -1)
               mesh->unrefine_element_id(element_id);
+            else if(refinement_type == -2)
+              mesh->reorder_hilbert(NULL, element_id);
             else
               mesh->refine_element_id(element_id, refinement_type);
           }
@@ -152,6 +266,14 @@ namespace Hermes
 
       Mesh global_mesh;
 
+      if(this->streaming)
+      {
+        StreamingHandler handler(this, &global_mesh, true);
+        load_streaming(filename, handler);
+        handler.create_subdomains(meshes);
+        return true;
+      }
+
       try
       {
         ::xml_schema::flags parsing_flags = 0;
@@ -221,367 +343,391 @@ namespace Hermes
           }
         }
 
-        for(unsigned int subdomains_i = 0; subdomains_i < subdomains_count; subdomains_i++)
+        int num_threads = Hermes2DApi.get_integral_param_value(numThreads);
+        Hermes::Exceptions::Exception* caught_exception = NULL;
+
+        // The meshes of the subdomains are created in parallel, the parsed domain is only read.
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+        for(int subdomains_i = 0; subdomains_i < (int)subdomains_count; subdomains_i++)
         {
-          unsigned int vertex_number_count = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).vertices().present() ? parsed_xml_domain->subdomains().subdomain().at(subdomains_i).vertices()->i().size() : 0;
-          unsigned int element_number_count = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).elements().present() ? parsed_xml_domain->subdomains().subdomain().at(subdomains_i).elements()->i().size() : 0;
-          unsigned int boundary_edge_number_count = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).boundary_edges().present() ? parsed_xml_domain->subdomains().subdomain().at(subdomains_i).boundary_edges()->i().size() : 0;
-          unsigned int inner_edge_number_count = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).inner_edges().present() ? parsed_xml_domain->subdomains().subdomain().at(subdomains_i).inner_edges()->i().size() : 0;
+          if(caught_exception != NULL)
+            continue;
 
-          // copy the whole mesh if the subdomain is the whole mesh.
-          if(element_number_count == 0 || element_number_count == parsed_xml_domain->elements().el().size())
+          try
           {
-            meshes[subdomains_i]->copy(&global_mesh);
-            // refinements.
-            if(parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements().present() && parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().size() > 0)
+            unsigned int vertex_number_count = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).vertices().present() ? parsed_xml_domain->subdomains().subdomain().at(subdomains_i).vertices()->i().size() : 0;
+            unsigned int element_number_count = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).elements().present() ? parsed_xml_domain->subdomains().subdomain().at(subdomains_i).elements()->i().size() : 0;
+            unsigned int boundary_edge_number_count = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).boundary_edges().present() ? parsed_xml_domain->subdomains().subdomain().at(subdomains_i).boundary_edges()->i().size() : 0;
+            unsigned int inner_edge_number_count = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).inner_edges().present() ? parsed_xml_domain->subdomains().subdomain().at(subdomains_i).inner_edges()->i().size() : 0;
+
+            // copy the whole mesh if the subdomain is the whole mesh.
+            if(element_number_count == 0 || element_number_count == parsed_xml_domain->elements().el().size())
             {
-              // perform initial refinements
-              for (unsigned int i = 0; i < parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().size(); i++)
+              meshes[subdomains_i]->copy(&global_mesh);
+              // refinements.
+              if(parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements().present() && parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().size() > 0)
               {
-                int element_id = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().at(i).element_id();
-                int refinement_type = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().at(i).refinement_type();
-                if(refinement_type == -1)
-                  meshes[subdomains_i]->unrefine_element_id(element_id);
-                else
-                  meshes[subdomains_i]->refine_element_id(element_id, refinement_type);
+                // perform initial refinements
+                for (unsigned int i = 0; i < parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().size(); i++)
+                {
+                  int element_id = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().at(i).element_id();
+                  int refinement_type = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().at(i).refinement_type();
+                  if(refinement_type == -1)
+                    meshes[subdomains_i]->unrefine_element_id(element_id);
+                  else if(refinement_type == -2)
+                    meshes[subdomains_i]->reorder_hilbert(NULL, element_id);
+                  else
+                    meshes[subdomains_i]->refine_element_id(element_id, refinement_type);
+                }
               }
             }
-          }
-          else
-          {
-            // Variables //
-            unsigned int variables_count = parsed_xml_domain->variables().present() ? parsed_xml_domain->variables()->var().size() : 0;
-
-            std::map<std::string, double> variables;
-            for (unsigned int variables_i = 0; variables_i < variables_count; variables_i++)
-#ifdef _MSC_VER
-              variables.insert(std::make_pair<std::string, double>((std::string)parsed_xml_domain->variables()->var().at(variables_i).name(), (double&&)parsed_xml_domain->variables()->var().at(variables_i).value()));
-#else
-              variables.insert(std::make_pair<std::string, double>((std::string)parsed_xml_domain->variables()->var().at(variables_i).name(), parsed_xml_domain->variables()->var().at(variables_i).value()));
-#endif
-            // Vertex numbers //
-            // create a mapping order-in-the-whole-domain <-> order-in-this-subdomain.
-            std::map<unsigned int, unsigned int> vertex_vertex_numbers;
-
-            // Initialize mesh.
-            int size = HashTable::H2D_DEFAULT_HASH_SIZE;
-            while (size < 8 * vertex_number_count)
-              size *= 2;
-            meshes[subdomains_i]->init(size);
-
-            // Create top-level vertex nodes.
-            if(vertex_number_count == 0)
-              vertex_number_count = parsed_xml_domain->vertices().v().size();
-            for (unsigned int vertex_numbers_i = 0; vertex_numbers_i < vertex_number_count; vertex_numbers_i++)
+            else
             {
-              unsigned int vertex_number;
-              if(vertex_number_count == parsed_xml_domain->vertices().v().size())
-                vertex_number = vertex_is[vertex_numbers_i];
-              else
+              // Variables //
+              unsigned int variables_count = parsed_xml_domain->variables().present() ? parsed_xml_domain->variables()->var().size() : 0;
+
+              std::map<std::string, double> variables;
+              for (unsigned int variables_i = 0; variables_i < variables_count; variables_i++)
+  #ifdef _MSC_VER
+                variables.insert(std::make_pair<std::string, double>((std::string)parsed_xml_domain->variables()->var().at(variables_i).name(), (double&&)parsed_xml_domain->variables()->var().at(variables_i).value()));
+  #else
+                variables.insert(std::make_pair<std::string, double>((std::string)parsed_xml_domain->variables()->var().at(variables_i).name(), parsed_xml_domain->variables()->var().at(variables_i).value()));
+  #endif
+              // Vertex numbers //
+              // create a mapping order-in-the-whole-domain <-> order-in-this-subdomain.
+              std::map<unsigned int, unsigned int> vertex_vertex_numbers;
+
+              // Initialize mesh.
+              int size = HashTable::H2D_DEFAULT_HASH_SIZE;
+              while (size < 8 * vertex_number_count)
+                size *= 2;
+              meshes[subdomains_i]->init(size);
+
+              // Create top-level vertex nodes.
+              if(vertex_number_count == 0)
+                vertex_number_count = parsed_xml_domain->vertices().v().size();
+              for (unsigned int vertex_numbers_i = 0; vertex_numbers_i < vertex_number_count; vertex_numbers_i++)
               {
-                vertex_number =  parsed_xml_domain->subdomains().subdomain().at(subdomains_i).vertices()->i().at(vertex_numbers_i);
-                if(vertex_number > max_vertex_i)
-                  throw Exceptions::MeshLoadFailureException("Wrong vertex number:%u in subdomain %u.", vertex_number, subdomains_i);
-              }
-
-              vertex_vertex_numbers.insert(std::pair<unsigned int, unsigned int>(vertex_number, vertex_numbers_i));
-              Node* node = meshes[subdomains_i]->nodes.add();
-              assert(node->id == vertex_numbers_i);
-              node->ref = TOP_LEVEL_REF;
-              node->type = HERMES_TYPE_VERTEX;
-              node->bnd = 0;
-              node->p1 = node->p2 = -1;
-              node->next_hash = NULL;
-
-              // variables matching.
-              std::string x = parsed_xml_domain->vertices().v().at(vertex_number).x();
-              std::string y = parsed_xml_domain->vertices().v().at(vertex_number).y();
-              double x_value;
-              double y_value;
-
-              // variables lookup.
-              bool x_found = false;
-              bool y_found = false;
-              if(variables.find(x) != variables.end())
-              {
-                x_value = variables.find(x)->second;
-                x_found = true;
-              }
-              if(variables.find(y) != variables.end())
-              {
-                y_value = variables.find(y)->second;
-                y_found = true;
-              }
-
-              // test of value if no variable found.
-              if(!x_found)
-                if(std::strtod(x.c_str(), NULL) != 0.0)
-                  x_value = std::strtod(x.c_str(), NULL);
+                unsigned int vertex_number;
+                if(vertex_number_count == parsed_xml_domain->vertices().v().size())
+                  vertex_number = vertex_is[vertex_numbers_i];
                 else
                 {
-                  // This is a hard part, to find out if it is really zero.
-                  int dot_position = strchr(x.c_str(), '.') == NULL ? -1 : strchr(x.c_str(), '.') - x.c_str();
-                  for(int i = 0; i < dot_position; i++)
-                    if(strncmp(x.c_str() + i, "0", 1) != 0)
-                      throw Hermes::Exceptions::MeshLoadFailureException("Wrong syntax in the x coordinate of vertex no. %i.", vertex_number + 1);
-                  for(int i = dot_position + 1; i < x.length(); i++)
-                    if(strncmp(x.c_str() + i, "0", 1) != 0)
-                      throw Hermes::Exceptions::MeshLoadFailureException("Wrong syntax in the x coordinate of vertex no. %i.", vertex_number + 1);
-                  x_value = std::strtod(x.c_str(), NULL);
+                  vertex_number =  parsed_xml_domain->subdomains().subdomain().at(subdomains_i).vertices()->i().at(vertex_numbers_i);
+                  if(vertex_number > max_vertex_i)
+                    throw Exceptions::MeshLoadFailureException("Wrong vertex number:%u in subdomain %u.", vertex_number, subdomains_i);
                 }
 
-                if(!y_found)
-                  if(std::strtod(y.c_str(), NULL) != 0.0)
-                    y_value = std::strtod(y.c_str(), NULL);
+                vertex_vertex_numbers.insert(std::pair<unsigned int, unsigned int>(vertex_number, vertex_numbers_i));
+                Node* node = meshes[subdomains_i]->nodes.add();
+                assert(node->id == vertex_numbers_i);
+                node->ref = TOP_LEVEL_REF;
+                node->type = HERMES_TYPE_VERTEX;
+                node->bnd = 0;
+                node->p1 = node->p2 = -1;
+                node->next_hash = NULL;
+
+                // variables matching.
+                std::string x = parsed_xml_domain->vertices().v().at(vertex_number).x();
+                std::string y = parsed_xml_domain->vertices().v().at(vertex_number).y();
+                double x_value;
+                double y_value;
+
+                // variables lookup.
+                bool x_found = false;
+                bool y_found = false;
+                if(variables.find(x) != variables.end())
+                {
+                  x_value = variables.find(x)->second;
+                  x_found = true;
+                }
+                if(variables.find(y) != variables.end())
+                {
+                  y_value = variables.find(y)->second;
+                  y_found = true;
+                }
+
+                // test of value if no variable found.
+                if(!x_found)
+                  if(std::strtod(x.c_str(), NULL) != 0.0)
+                    x_value = std::strtod(x.c_str(), NULL);
                   else
                   {
                     // This is a hard part, to find out if it is really zero.
-                    int dot_position = strchr(y.c_str(), '.') == NULL ? -1 : strchr(y.c_str(), '.') - y.c_str();
+                    int dot_position = strchr(x.c_str(), '.') == NULL ? -1 : strchr(x.c_str(), '.') - x.c_str();
                     for(int i = 0; i < dot_position; i++)
-                      if(strncmp(y.c_str() + i, "0", 1) != 0)
-                        throw Hermes::Exceptions::MeshLoadFailureException("Wrong syntax in the y coordinate of vertex no. %i.", vertex_number + 1);
-                    for(int i = dot_position + 1; i < y.length(); i++)
-                      if(strncmp(y.c_str() + i, "0", 1) != 0)
-                        throw Hermes::Exceptions::MeshLoadFailureException("Wrong syntax in the y coordinate of vertex no. %i.", vertex_number + 1);
-                    y_value = std::strtod(y.c_str(), NULL);
+                      if(strncmp(x.c_str() + i, "0", 1) != 0)
+                        throw Hermes::Exceptions::MeshLoadFailureException("Wrong syntax in the x coordinate of vertex no. %i.", vertex_number + 1);
+                    for(int i = dot_position + 1; i < x.length(); i++)
+                      if(strncmp(x.c_str() + i, "0", 1) != 0)
+                        throw Hermes::Exceptions::MeshLoadFailureException("Wrong syntax in the x coordinate of vertex no. %i.", vertex_number + 1);
+                    x_value = std::strtod(x.c_str(), NULL);
                   }
 
-                  // assignment.
-                  node->x = x_value;
-                  node->y = y_value;
-            }
-            meshes[subdomains_i]->ntopvert = vertex_number_count;
-
-            // Element numbers //
-            unsigned int element_count = parsed_xml_domain->elements().el().size();
-            meshes[subdomains_i]->nbase = element_count;
-            meshes[subdomains_i]->nactive = meshes[subdomains_i]->ninitial = element_number_count;
-
-            Element* e;
-            int* elements_existing = new int[element_count];
-            for(int i = 0; i < element_count; i++)
-              elements_existing[i] = -1;
-            for (int element_number_i = 0; element_number_i < element_number_count; element_number_i++)
-            {
-              int elementI = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).elements()->i().at(element_number_i);
-              if(elementI > max_element_i)
-                  throw Exceptions::MeshLoadFailureException("Wrong element number:%i in subdomain %u.", elementI, subdomains_i);
-
-              elements_existing[element_is[parsed_xml_domain->subdomains().subdomain().at(subdomains_i).elements()->i().at(element_number_i)]] = elementI;
-            }
-            for (int element_i = 0; element_i < element_count; element_i++)
-            {
-              bool found = false;
-              if(element_number_count == 0)
-                found = true;
-              else
-                found = elements_existing[element_i] != -1;
-
-              if(!found)
-              {
-                meshes[subdomains_i]->elements.skip_slot();
-                continue;
+                  if(!y_found)
+                    if(std::strtod(y.c_str(), NULL) != 0.0)
+                      y_value = std::strtod(y.c_str(), NULL);
+                    else
+                    {
+                      // This is a hard part, to find out if it is really zero.
+                      int dot_position = strchr(y.c_str(), '.') == NULL ? -1 : strchr(y.c_str(), '.') - y.c_str();
+                      for(int i = 0; i < dot_position; i++)
+                        if(strncmp(y.c_str() + i, "0", 1) != 0)
+                          throw Hermes::Exceptions::MeshLoadFailureException("Wrong syntax in the y coordinate of vertex no. %i.", vertex_number + 1);
+                      for(int i = dot_position + 1; i < y.length(); i++)
+                        if(strncmp(y.c_str() + i, "0", 1) != 0)
+                          throw Hermes::Exceptions::MeshLoadFailureException("Wrong syntax in the y coordinate of vertex no. %i.", vertex_number + 1);
+                      y_value = std::strtod(y.c_str(), NULL);
+                    }
+
+                    // assignment.
+                    node->x = x_value;
+                    node->y = y_value;
               }
+              meshes[subdomains_i]->ntopvert = vertex_number_count;
+
+              // Element numbers //
+              unsigned int element_count = parsed_xml_domain->elements().el().size();
+              meshes[subdomains_i]->nbase = element_count;
+              meshes[subdomains_i]->nactive = meshes[subdomains_i]->ninitial = element_number_count;
+
+              Element* e;
+              int* elements_existing = new int[element_count];
+              for(int i = 0; i < element_count; i++)
+                elements_existing[i] = -1;
+              for (int element_number_i = 0; element_number_i < element_number_count; element_number_i++)
+              {
+                int elementI = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).elements()->i().at(element_number_i);
+                if(elementI > max_element_i)
+                    throw Exceptions::MeshLoadFailureException("Wrong element number:%i in subdomain %u.", elementI, subdomains_i);
 
-              XMLSubdomains::domain::elements_type::el_type* element = NULL;
-              for(int searched_element_i = 0; searched_element_i < element_count; searched_element_i++)
+                elements_existing[element_is[parsed_xml_domain->subdomains().subdomain().at(subdomains_i).elements()->i().at(element_number_i)]] = elementI;
+              }
+              for (int element_i = 0; element_i < element_count; element_i++)
               {
-                element = &parsed_xml_domain->elements().el().at(searched_element_i);
-                if(element->i() == elements_existing[element_i])
-                  break;
+                bool found = false;
+                if(element_number_count == 0)
+                  found = true;
                 else
-                  element = NULL;
+                  found = elements_existing[element_i] != -1;
+
+                if(!found)
+                {
+                  meshes[subdomains_i]->elements.skip_slot();
+                  continue;
+                }
+
+                XMLSubdomains::domain::elements_type::el_type* element = NULL;
+                for(int searched_element_i = 0; searched_element_i < element_count; searched_element_i++)
+                {
+                  element = &parsed_xml_domain->elements().el().at(searched_element_i);
+                  if(element->i() == elements_existing[element_i])
+                    break;
+                  else
+                    element = NULL;
+                }
+                if(element == NULL)
+                  throw Exceptions::MeshLoadFailureException("Element number wrong in the mesh file.");
+
+                XMLSubdomains::q_t* el_q = dynamic_cast<XMLSubdomains::q_t*>(element);
+                XMLSubdomains::t_t* el_t = dynamic_cast<XMLSubdomains::t_t*>(element);
+                if(el_q != NULL)
+                  e = meshes[subdomains_i]->create_quad(meshes[subdomains_i]->element_markers_conversion.get_internal_marker(element->m()).marker,
+                  &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_q->v1())->second],
+                  &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_q->v2())->second],
+                  &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_q->v3())->second],
+                  &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_q->v4())->second],
+                  NULL, element_i);
+                if(el_t != NULL)
+                  e = meshes[subdomains_i]->create_triangle(meshes[subdomains_i]->element_markers_conversion.get_internal_marker(element->m()).marker,
+                  &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_t->v1())->second],
+                  &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_t->v2())->second],
+                  &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_t->v3())->second],
+                  NULL, element_i);
               }
-              if(element == NULL)
-                throw Exceptions::MeshLoadFailureException("Element number wrong in the mesh file.");
-
-              XMLSubdomains::q_t* el_q = dynamic_cast<XMLSubdomains::q_t*>(element);
-              XMLSubdomains::t_t* el_t = dynamic_cast<XMLSubdomains::t_t*>(element);
-              if(el_q != NULL)
-                e = meshes[subdomains_i]->create_quad(meshes[subdomains_i]->element_markers_conversion.get_internal_marker(element->m()).marker,
-                &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_q->v1())->second],
-                &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_q->v2())->second],
-                &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_q->v3())->second],
-                &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_q->v4())->second],
-                NULL, element_i);
-              if(el_t != NULL)
-                e = meshes[subdomains_i]->create_triangle(meshes[subdomains_i]->element_markers_conversion.get_internal_marker(element->m()).marker,
-                &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_t->v1())->second],
-                &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_t->v2())->second],
-                &meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(el_t->v3())->second],
-                NULL, element_i);
-            }
 
-            // Boundary Edge numbers //
-            if(boundary_edge_number_count == 0)
-              boundary_edge_number_count = parsed_xml_domain->edges().ed().size();
+              // Boundary Edge numbers //
+              if(boundary_edge_number_count == 0)
+                boundary_edge_number_count = parsed_xml_domain->edges().ed().size();
 
-            for (int boundary_edge_number_i = 0; boundary_edge_number_i < boundary_edge_number_count; boundary_edge_number_i++)
-            {
-              XMLSubdomains::domain::edges_type::ed_type* edge = NULL;
-              for(unsigned int to_find_i = 0; to_find_i < parsed_xml_domain->edges().ed().size(); to_find_i++)
+              for (int boundary_edge_number_i = 0; boundary_edge_number_i < boundary_edge_number_count; boundary_edge_number_i++)
               {
-                if(boundary_edge_number_count != parsed_xml_domain->edges().ed().size())
+                XMLSubdomains::domain::edges_type::ed_type* edge = NULL;
+                for(unsigned int to_find_i = 0; to_find_i < parsed_xml_domain->edges().ed().size(); to_find_i++)
                 {
-                  if(parsed_xml_domain->edges().ed().at(to_find_i).i() == parsed_xml_domain->subdomains().subdomain().at(subdomains_i).boundary_edges()->i().at(boundary_edge_number_i))
+                  if(boundary_edge_number_count != parsed_xml_domain->edges().ed().size())
                   {
-                    edge = &parsed_xml_domain->edges().ed().at(to_find_i);
-                    break;
+                    if(parsed_xml_domain->edges().ed().at(to_find_i).i() == parsed_xml_domain->subdomains().subdomain().at(subdomains_i).boundary_edges()->i().at(boundary_edge_number_i))
+                    {
+                      edge = &parsed_xml_domain->edges().ed().at(to_find_i);
+                      break;
+                    }
                   }
-                }
-                else
-                {
-                  if(parsed_xml_domain->edges().ed().at(to_find_i).i() == edge_is[boundary_edge_number_i])
+                  else
                   {
-                    edge = &parsed_xml_domain->edges().ed().at(to_find_i);
-                    break;
+                    if(parsed_xml_domain->edges().ed().at(to_find_i).i() == edge_is[boundary_edge_number_i])
+                    {
+                      edge = &parsed_xml_domain->edges().ed().at(to_find_i);
+                      break;
+                    }
                   }
                 }
-              }
 
-              if(edge == NULL)
-                  throw Exceptions::MeshLoadFailureException("Wrong boundary-edge number:%i in subdomain %u.", parsed_xml_domain->subdomains().subdomain().at(subdomains_i).boundary_edges()->i().at(boundary_edge_number_i), subdomains_i);
+                if(edge == NULL)
+                    throw Exceptions::MeshLoadFailureException("Wrong boundary-edge number:%i in subdomain %u.", parsed_xml_domain->subdomains().subdomain().at(subdomains_i).boundary_edges()->i().at(boundary_edge_number_i), subdomains_i);
 
-              Node* en = meshes[subdomains_i]->peek_edge_node(vertex_vertex_numbers.find(edge->v1())->second, vertex_vertex_numbers.find(edge->v2())->second);
-              if(en == NULL)
-                throw Hermes::Exceptions::MeshLoadFailureException("Boundary data error (edge %i does not exist).", boundary_edge_number_i);
+                Node* en = meshes[subdomains_i]->peek_edge_node(vertex_vertex_numbers.find(edge->v1())->second, vertex_vertex_numbers.find(edge->v2())->second);
+                if(en == NULL)
+                  throw Hermes::Exceptions::MeshLoadFailureException("Boundary data error (edge %i does not exist).", boundary_edge_number_i);
 
-              en->marker = meshes[subdomains_i]->boundary_markers_conversion.get_internal_marker(edge->m()).marker;
+                en->marker = meshes[subdomains_i]->boundary_markers_conversion.get_internal_marker(edge->m()).marker;
 
-              meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(edge->v1())->second].bnd = 1;
-              meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(edge->v2())->second].bnd = 1;
-              en->bnd = 1;
-            }
-
-            // Inner Edge numbers //
-            for (int inner_edge_number_i = 0; inner_edge_number_i < inner_edge_number_count; inner_edge_number_i++)
-            {
-              XMLSubdomains::domain::edges_type::ed_type* edge = NULL;
+                meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(edge->v1())->second].bnd = 1;
+                meshes[subdomains_i]->nodes[vertex_vertex_numbers.find(edge->v2())->second].bnd = 1;
+                en->bnd = 1;
+              }
 
-              for(unsigned int to_find_i = 0; to_find_i < parsed_xml_domain->edges().ed().size(); to_find_i++)
+              // Inner Edge numbers //
+              for (int inner_edge_number_i = 0; inner_edge_number_i < inner_edge_number_count; inner_edge_number_i++)
               {
-                if(parsed_xml_domain->edges().ed().at(to_find_i).i() == parsed_xml_domain->subdomains().subdomain().at(subdomains_i).inner_edges()->i().at(inner_edge_number_i))
+                XMLSubdomains::domain::edges_type::ed_type* edge = NULL;
+
+                for(unsigned int to_find_i = 0; to_find_i < parsed_xml_domain->edges().ed().size(); to_find_i++)
                 {
-                  edge = &parsed_xml_domain->edges().ed().at(to_find_i);
-                  break;
+                  if(parsed_xml_domain->edges().ed().at(to_find_i).i() == parsed_xml_domain->subdomains().subdomain().at(subdomains_i).inner_edges()->i().at(inner_edge_number_i))
+                  {
+                    edge = &parsed_xml_domain->edges().ed().at(to_find_i);
+                    break;
+                  }
                 }
-              }
 
-              if(edge == NULL)
-                  throw Exceptions::MeshLoadFailureException("Wrong inner-edge number:%i in subdomain %u.", parsed_xml_domain->subdomains().subdomain().at(subdomains_i).boundary_edges()->i().at(inner_edge_number_i), subdomains_i);
+                if(edge == NULL)
+                    throw Exceptions::MeshLoadFailureException("Wrong inner-edge number:%i in subdomain %u.", parsed_xml_domain->subdomains().subdomain().at(subdomains_i).boundary_edges()->i().at(inner_edge_number_i), subdomains_i);
 
-              Node* en = meshes[subdomains_i]->peek_edge_node(vertex_vertex_numbers.find(edge->v1())->second, vertex_vertex_numbers.find(edge->v2())->second);
-              if(en == NULL)
-                throw Hermes::Exceptions::MeshLoadFailureException("Inner data error (edge %i does not exist).", inner_edge_number_i);
+                Node* en = meshes[subdomains_i]->peek_edge_node(vertex_vertex_numbers.find(edge->v1())->second, vertex_vertex_numbers.find(edge->v2())->second);
+                if(en == NULL)
+                  throw Hermes::Exceptions::MeshLoadFailureException("Inner data error (edge %i does not exist).", inner_edge_number_i);
 
-              en->marker = meshes[subdomains_i]->boundary_markers_conversion.get_internal_marker(edge->m()).marker;
-              en->bnd = 0;
-            }
-
-            // Curves //
-            // Arcs & NURBSs //
-            unsigned int arc_count = parsed_xml_domain->curves().present() ? parsed_xml_domain->curves()->arc().size() : 0;
-            unsigned int nurbs_count = parsed_xml_domain->curves().present() ? parsed_xml_domain->curves()->NURBS().size() : 0;
+                en->marker = meshes[subdomains_i]->boundary_markers_conversion.get_internal_marker(edge->m()).marker;
+                en->bnd = 0;
+              }
 
-            for (unsigned int curves_i = 0; curves_i < arc_count + nurbs_count; curves_i++)
-            {
-              // load the control points, knot vector, etc.
-              Node* en;
-              int p1, p2;
+              // Curves //
+              // Arcs & NURBSs //
+              unsigned int arc_count = parsed_xml_domain->curves().present() ? parsed_xml_domain->curves()->arc().size() : 0;
+              unsigned int nurbs_count = parsed_xml_domain->curves().present() ? parsed_xml_domain->curves()->NURBS().size() : 0;
 
-              // first do arcs, then NURBSs.
-              Nurbs* nurbs;
-              if(curves_i < arc_count)
+              for (unsigned int curves_i = 0; curves_i < arc_count + nurbs_count; curves_i++)
               {
-                if(vertex_vertex_numbers.find(parsed_xml_domain->curves()->arc().at(curves_i).v1()) == vertex_vertex_numbers.end() ||
-                  vertex_vertex_numbers.find(parsed_xml_domain->curves()->arc().at(curves_i).v2()) == vertex_vertex_numbers.end())
-                  continue;
-                else
-                {
-                  // read the end point indices
-                  p1 = vertex_vertex_numbers.find(parsed_xml_domain->curves()->arc().at(curves_i).v1())->second;
-                  p2 = vertex_vertex_numbers.find(parsed_xml_domain->curves()->arc().at(curves_i).v2())->second;
+                // load the control points, knot vector, etc.
+                Node* en;
+                int p1, p2;
 
-                  nurbs = load_arc(meshes[subdomains_i], parsed_xml_domain, curves_i, &en, p1, p2, true);
-                  if(nurbs == NULL)
+                // first do arcs, then NURBSs.
+                Nurbs* nurbs;
+                if(curves_i < arc_count)
+                {
+                  if(vertex_vertex_numbers.find(parsed_xml_domain->curves()->arc().at(curves_i).v1()) == vertex_vertex_numbers.end() ||
+                    vertex_vertex_numbers.find(parsed_xml_domain->curves()->arc().at(curves_i).v2()) == vertex_vertex_numbers.end())
                     continue;
+                  else
+                  {
+                    // read the end point indices
+                    p1 = vertex_vertex_numbers.find(parsed_xml_domain->curves()->arc().at(curves_i).v1())->second;
+                    p2 = vertex_vertex_numbers.find(parsed_xml_domain->curves()->arc().at(curves_i).v2())->second;
+
+                    nurbs = load_arc(meshes[subdomains_i], parsed_xml_domain, curves_i, &en, p1, p2, true);
+                    if(nurbs == NULL)
+                      continue;
+                  }
                 }
-              }
-              else
-              {
-                if(vertex_vertex_numbers.find(parsed_xml_domain->curves()->NURBS().at(curves_i - arc_count).v1()) == vertex_vertex_numbers.end() ||
-                  vertex_vertex_numbers.find(parsed_xml_domain->curves()->NURBS().at(curves_i - arc_count).v2()) == vertex_vertex_numbers.end())
-                  continue;
                 else
                 {
-                  // read the end point indices
-                  p1 = vertex_vertex_numbers.find(parsed_xml_domain->curves()->NURBS().at(curves_i - arc_count).v1())->second;
-                  p2 = vertex_vertex_numbers.find(parsed_xml_domain->curves()->NURBS().at(curves_i - arc_count).v2())->second;
-
-                  nurbs = load_nurbs(meshes[subdomains_i], parsed_xml_domain, curves_i - arc_count, &en, p1, p2, true);
-                  if(nurbs == NULL)
+                  if(vertex_vertex_numbers.find(parsed_xml_domain->curves()->NURBS().at(curves_i - arc_count).v1()) == vertex_vertex_numbers.end() ||
+                    vertex_vertex_numbers.find(parsed_xml_domain->curves()->NURBS().at(curves_i - arc_count).v2()) == vertex_vertex_numbers.end())
                     continue;
-                }
-              }
-
-              // assign the arc to the elements sharing the edge node
-              for (unsigned int node_i = 0; node_i < 2; node_i++)
-              {
-                Element* e = en->elem[node_i];
-                if(e == NULL) continue;
+                  else
+                  {
+                    // read the end point indices
+                    p1 = vertex_vertex_numbers.find(parsed_xml_domain->curves()->NURBS().at(curves_i - arc_count).v1())->second;
+                    p2 = vertex_vertex_numbers.find(parsed_xml_domain->curves()->NURBS().at(curves_i - arc_count).v2())->second;
 
-                if(e->cm == NULL)
-                {
-                  e->cm = new CurvMap;
-                  memset(e->cm, 0, sizeof(CurvMap));
-                  e->cm->toplevel = 1;
-                  e->cm->order = 4;
+                    nurbs = load_nurbs(meshes[subdomains_i], parsed_xml_domain, curves_i - arc_count, &en, p1, p2, true);
+                    if(nurbs == NULL)
+                      continue;
+                  }
                 }
 
-                int idx = -1;
-                for (unsigned j = 0; j < e->get_nvert(); j++)
-                  if(e->en[j] == en) { idx = j; break; }
-                  assert(idx >= 0);
+                // assign the arc to the elements sharing the edge node
+                for (unsigned int node_i = 0; node_i < 2; node_i++)
+                {
+                  Element* e = en->elem[node_i];
+                  if(e == NULL) continue;
 
-                  if(e->vn[idx]->id == p1)
-                  {
-                    e->cm->nurbs[idx] = nurbs;
-                    nurbs->ref++;
-                  }
-                  else
+                  if(e->cm == NULL)
                   {
-                    Nurbs* nurbs_rev = meshes[subdomains_i]->reverse_nurbs(nurbs);
-                    e->cm->nurbs[idx] = nurbs_rev;
-                    nurbs_rev->ref++;
+                    e->cm = new CurvMap;
+                    memset(e->cm, 0, sizeof(CurvMap));
+                    e->cm->toplevel = 1;
+                    e->cm->order = 4;
                   }
+
+                  int idx = -1;
+                  for (unsigned j = 0; j < e->get_nvert(); j++)
+                    if(e->en[j] == en) { idx = j; break; }
+                    assert(idx >= 0);
+
+                    if(e->vn[idx]->id == p1)
+                    {
+                      e->cm->nurbs[idx] = nurbs;
+                      nurbs->ref++;
+                    }
+                    else
+                    {
+                      Nurbs* nurbs_rev = meshes[subdomains_i]->reverse_nurbs(nurbs);
+                      e->cm->nurbs[idx] = nurbs_rev;
+                      nurbs_rev->ref++;
+                    }
+                }
+                if(!nurbs->ref) delete nurbs;
               }
-              if(!nurbs->ref) delete nurbs;
-            }
 
-            // update refmap coeffs of curvilinear elements
-            for_all_elements(e, meshes[subdomains_i])
-              if(e->cm != NULL)
-                e->cm->update_refmap_coeffs(e);
+              // update refmap coeffs of curvilinear elements
+              meshes[subdomains_i]->precalculate_refmap_coeffs();
 
-            // refinements.
-            if(parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements().present() && parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().size() > 0)
-            {
-              // perform initial refinements
-              for (unsigned int i = 0; i < parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().size(); i++)
+              // refinements.
+              if(parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements().present() && parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().size() > 0)
               {
-                int element_id = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().at(i).element_id();
-                int refinement_type = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().at(i).refinement_type();
-                if(refinement_type == -1)
-                  meshes[subdomains_i]->unrefine_element_id(element_id);
-                else
-                  meshes[subdomains_i]->refine_element_id(element_id, refinement_type);
+                // perform initial refinements
+                for (unsigned int i = 0; i < parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().size(); i++)
+                {
+                  int element_id = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().at(i).element_id();
+                  int refinement_type = parsed_xml_domain->subdomains().subdomain().at(subdomains_i).refinements()->ref().at(i).refinement_type();
+                  if(refinement_type == -1)
+                    meshes[subdomains_i]->unrefine_element_id(element_id);
+                  else if(refinement_type == -2)
+                    meshes[subdomains_i]->reorder_hilbert(NULL, element_id);
+                  else
+                    meshes[subdomains_i]->refine_element_id(element_id, refinement_type);
+                }
               }
-            }
 
-            delete [] elements_existing;
+              delete [] elements_existing;
+            }
+            meshes[subdomains_i]->initial_single_check();
+          }
+          catch(Hermes::Exceptions::Exception& e)
+          {
+#pragma omp critical (caught_exception)
+            if(caught_exception == NULL)
+              caught_exception = e.clone();
+          }
+          catch(std::exception& e)
+          {
+#pragma omp critical (caught_exception)
+            if(caught_exception == NULL)
+              caught_exception = new Hermes::Exceptions::Exception(e.what());
           }
-          meshes[subdomains_i]->seq = g_mesh_seq++;
-          meshes[subdomains_i]->initial_single_check();
         }
 
         delete [] vertex_is;
@@ -590,6 +736,17 @@ namespace Hermes
 
         delete [] edge_is;
 
+        if(caught_exception != NULL)
+        {
+          std::string message(caught_exception->what());
+          delete caught_exception;
+          throw Hermes::Exceptions::MeshLoadFailureException("%s", message.c_str());
+        }
+
+        // The sequence numbers follow the order of the subdomains.
+        for(unsigned int subdomains_i = 0; subdomains_i < subdomains_count; subdomains_i++)
+          meshes[subdomains_i]->seq = next_mesh_seq();
+
         return true;
       }
       catch (const xml_schema::exception& e)
@@ -1025,9 +1182,7 @@ namespace Hermes
         }
 
         // update refmap coeffs of curvilinear elements
-        for_all_elements(e, mesh)
-          if(e->cm != NULL)
-            e->cm->update_refmap_coeffs(e);
+        mesh->precalculate_refmap_coeffs();
       }
       catch (const xml_schema::exception& e)
       {
@@ -1291,9 +1446,7 @@ namespace Hermes
         }
 
         // update refmap coeffs of curvilinear elements
-        for_all_elements(e, mesh)
-          if(e->cm != NULL)
-            e->cm->update_refmap_coeffs(e);
+        mesh->precalculate_refmap_coeffs();
       }
       catch (const xml_schema::exception& e)
       {
@@ -1444,5 +1597,700 @@ namespace Hermes
       for (int i = nurbs->degree + 1; i < max; i++)
         nurbs_xml.knot().push_back(XMLMesh::knot(nurbs->kv[i]));
     }
+
+    static std::string transcode(const XMLCh* const value)
+    {
+      char* transcoded = xercesc::XMLString::transcode(value);
+      std::string result(transcoded);
+      xercesc::XMLString::release(&transcoded);
+      return result;
+    }
+
+    static double parse_coordinate(const std::string& value, const std::map<std::string, double>& variables, const char* axis, int vertex_i)
+    {
+      // variables lookup.
+      std::map<std::string, double>::const_iterator variable = variables.find(value);
+      if(variable != variables.end())
+        return variable->second;
+
+      double result = std::strtod(value.c_str(), NULL);
+      if(result != 0.0)
+        return result;
+
+      // This is a hard part, to find out if it is really zero.
+      int dot_position = strchr(value.c_str(), '.') == NULL ? -1 : strchr(value.c_str(), '.') - value.c_str();
+      for(int i = 0; i < dot_position; i++)
+        if(value[i] != '0')
+          throw Hermes::Exceptions::MeshLoadFailureException("Wrong syntax in the %s coordinate of vertex no. %i.", axis, vertex_i + 1);
+      for(int i = dot_position + 1; i < (int)value.length(); i++)
+        if(value[i] != '0')
+          throw Hermes::Exceptions::MeshLoadFailureException("Wrong syntax in the %s coordinate of vertex no. %i.", axis, vertex_i + 1);
+      return result;
+    }
+
+    void MeshReaderH2DXML::load_streaming(const char *filename, StreamingHandler& handler)
+    {
+      xercesc::XMLPlatformUtils::Initialize();
+      xercesc::SAX2XMLReader* parser = xercesc::XMLReaderFactory::createXMLReader();
+      parser->setFeature(xercesc::XMLUni::fgSAX2CoreNameSpaces, true);
+      parser->setFeature(xercesc::XMLUni::fgSAX2CoreValidation, false);
+      parser->setContentHandler(&handler);
+      parser->setErrorHandler(&handler);
+
+      std::string error;
+      try
+      {
+        parser->parse(filename);
+      }
+      catch (const xercesc::SAXParseException& e)
+      {
+        std::ostringstream message;
+        message << transcode(e.getMessage()) << " (line " << e.getLineNumber() << ")";
+        error = message.str();
+      }
+      catch (const xercesc::XMLException& e)
+      {
+        error = transcode(e.getMessage());
+      }
+      catch (...)
+      {
+        delete parser;
+        xercesc::XMLPlatformUtils::Terminate();
+        throw;
+      }
+
+      delete parser;
+      xercesc::XMLPlatformUtils::Terminate();
+
+      if(!error.empty())
+        throw Hermes::Exceptions::MeshLoadFailureException("%s", error.c_str());
+    }
+
+    MeshReaderH2DXML::StreamingHandler::StreamingHandler(MeshReaderH2DXML* reader, Mesh* mesh, bool domain) : reader(reader), mesh(mesh), domain(domain),
+      edges_read(0), curves_read(0), base_mesh_finished(false), in_subdomains(false), list(NULL)
+    {
+      // The number of vertices is not known in advance, the hash table grows as needed.
+      mesh->init();
+      mesh->ntopvert = 0;
+      mesh->nbase = mesh->nactive = mesh->ninitial = 0;
+    }
+
+    void MeshReaderH2DXML::StreamingHandler::read_attributes(const xercesc::Attributes& attrs)
+    {
+      attributes.resize(attrs.getLength());
+      for (unsigned int i = 0; i < attributes.size(); i++)
+      {
+        attributes[i].first = transcode(attrs.getLocalName(i));
+        attributes[i].second = transcode(attrs.getValue(i));
+      }
+    }
+
+    const std::string& MeshReaderH2DXML::StreamingHandler::attribute(const char* name) const
+    {
+      for (unsigned int i = 0; i < attributes.size(); i++)
+        if(attributes[i].first == name)
+          return attributes[i].second;
+      throw Hermes::Exceptions::MeshLoadFailureException("Missing attribute '%s' in the mesh file.", name);
+    }
+
+    int MeshReaderH2DXML::StreamingHandler::int_attribute(const char* name) const
+    {
+      return std::atoi(attribute(name).c_str());
+    }
+
+    double MeshReaderH2DXML::StreamingHandler::double_attribute(const char* name) const
+    {
+      return std::strtod(attribute(name).c_str(), NULL);
+    }
+
+    std::string MeshReaderH2DXML::StreamingHandler::marker_attribute() const
+    {
+      std::string marker = attribute("m");
+
+      // Trim whitespaces.
+      unsigned int begin = marker.find_first_not_of(" \t\n");
+      unsigned int end = marker.find_last_not_of(" \t\n");
+      marker.erase(end + 1, marker.length());
+      marker.erase(0, begin);
+      return marker;
+    }
+
+    int MeshReaderH2DXML::StreamingHandler::vertex_position(int v) const
+    {
+      // Subdomain files reference the vertices by their positions, mesh files by their indices 'i'.
+      int position = -1;
+      if(domain)
+        position = (v >= 0 && v < mesh->ntopvert) ? v : -1;
+      else
+        position = (v >= 0 && v < (int)vertex_is.size()) ? vertex_is[v] : -1;
+      if(position == -1)
+        throw Hermes::Exceptions::MeshLoadFailureException("Vertex %i referenced in the mesh file does not exist.", v);
+      return position;
+    }
+
+    void MeshReaderH2DXML::StreamingHandler::startElement(const XMLCh* const uri, const XMLCh* const localname, const XMLCh* const qname, const xercesc::Attributes& attrs)
+    {
+      std::string name = transcode(localname);
+      read_attributes(attrs);
+
+      if(name == "var")
+        variables[attribute("name")] = double_attribute("value");
+      else if(name == "v")
+        add_vertex();
+      else if(name == "q" || name == "t")
+        add_element(name == "q");
+      else if(name == "el")
+        add_element(attribute("type").find("q_t") != std::string::npos);
+      else if(name == "ed")
+        add_edge();
+      else if(name == "arc")
+      {
+        curve.arc = true;
+        curve.v1 = int_attribute("v1");
+        curve.v2 = int_attribute("v2");
+        curve.angle = double_attribute("angle");
+        add_curve(mesh, curve, vertex_position(curve.v1), vertex_position(curve.v2), false);
+        if(domain)
+          curves.push_back(curve);
+        curves_read++;
+      }
+      else if(name == "NURBS")
+      {
+        curve.arc = false;
+        curve.v1 = int_attribute("v1");
+        curve.v2 = int_attribute("v2");
+        curve.degree = int_attribute("deg");
+        curve.inner_points.clear();
+        curve.knots.clear();
+      }
+      else if(name == "inner_point")
+      {
+        curve.inner_points.push_back(double_attribute("x"));
+        curve.inner_points.push_back(double_attribute("y"));
+        curve.inner_points.push_back(double_attribute("weight"));
+      }
+      else if(name == "knot")
+        curve.knots.push_back(double_attribute("value"));
+      else if(name == "ref")
+      {
+        if(in_subdomains)
+          subdomains.back().refinements.push_back(std::pair<int, int>(int_attribute("element_id"), int_attribute("refinement_type")));
+        else
+        {
+          finish_base_mesh();
+          refine(mesh, int_attribute("element_id"), int_attribute("refinement_type"));
+        }
+      }
+      else if(name == "subdomains")
+      {
+        finish_base_mesh();
+        in_subdomains = true;
+      }
+      else if(in_subdomains)
+      {
+        if(name == "subdomain")
+          subdomains.push_back(Subdomain());
+        else if(name == "vertices")
+          list = &subdomains.back().vertices;
+        else if(name == "elements")
+          list = &subdomains.back().elements;
+        else if(name == "boundary_edges")
+          list = &subdomains.back().boundary_edges;
+        else if(name == "inner_edges")
+          list = &subdomains.back().inner_edges;
+        else if(name == "i")
+          text.clear();
+      }
+    }
+
+    void MeshReaderH2DXML::StreamingHandler::endElement(const XMLCh* const uri, const XMLCh* const localname, const XMLCh* const qname)
+    {
+      std::string name = transcode(localname);
+
+      if(name == "NURBS")
+      {
+        add_curve(mesh, curve, vertex_position(curve.v1), vertex_position(curve.v2), false);
+        if(domain)
+          curves.push_back(curve);
+        curves_read++;
+      }
+      else if(name == "edges" && !in_subdomains)
+      {
+        // check that all boundary edges have a marker assigned
+        Node* en;
+        for_all_edge_nodes(en, mesh)
+          if(en->ref < 2 && en->marker == 0)
+            reader->warn("Boundary edge node does not have a boundary marker.");
+      }
+      else if(name == "i" && list != NULL)
+        list->push_back(std::atoi(text.c_str()));
+      else if(name == "vertices" || name == "elements" || name == "boundary_edges" || name == "inner_edges")
+        list = NULL;
+      else if(name == "mesh" || name == "domain")
+        finish_base_mesh();
+    }
+
+    void MeshReaderH2DXML::StreamingHandler::characters(const XMLCh* const chars, const XMLSize_t length)
+    {
+      // Only the items of subdomain lists have text content.
+      if(list != NULL)
+        for (XMLSize_t i = 0; i < length; i++)
+          text.push_back((char)chars[i]);
+    }
+
+    void MeshReaderH2DXML::StreamingHandler::add_vertex()
+    {
+      Node* node = mesh->nodes.add();
+      int vertex_i = node->id;
+      assert(vertex_i == mesh->ntopvert);
+      node->ref = TOP_LEVEL_REF;
+      node->type = HERMES_TYPE_VERTEX;
+      node->bnd = 0;
+      node->p1 = node->p2 = -1;
+      node->next_hash = NULL;
+      node->x = parse_coordinate(attribute("x"), variables, "x", vertex_i);
+      node->y = parse_coordinate(attribute("y"), variables, "y", vertex_i);
+      mesh->ntopvert = vertex_i + 1;
+
+      int i = int_attribute("i");
+      if(i < 0 || i > H2D_MAX_NODE_ID - 1)
+        throw Exceptions::MeshLoadFailureException("The index 'i' of vertex in the mesh file must be lower than %i.", H2D_MAX_NODE_ID);
+      if(i >= (int)vertex_is.size())
+        vertex_is.resize(i + 1, -1);
+      vertex_is[i] = vertex_i;
+
+      if(domain)
+      {
+        vertex_coordinates.push_back(node->x);
+        vertex_coordinates.push_back(node->y);
+      }
+    }
+
+    void MeshReaderH2DXML::StreamingHandler::add_element(bool quad)
+    {
+      std::string marker = marker_attribute();
+      mesh->element_markers_conversion.insert_marker(mesh->element_markers_conversion.min_marker_unused, marker);
+
+      static const char* vertex_names[4] = { "v1", "v2", "v3", "v4" };
+      int v[4] = { -1, -1, -1, -1 };
+      for (int i = 0; i < (quad ? 4 : 3); i++)
+        v[i] = vertex_position(int_attribute(vertex_names[i]));
+
+      mesh->nbase++;
+      mesh->nactive++;
+      mesh->ninitial++;
+
+      Element* e;
+      int internal_marker = mesh->element_markers_conversion.get_internal_marker(marker).marker;
+      if(quad)
+        e = mesh->create_quad(internal_marker, &mesh->nodes[v[0]], &mesh->nodes[v[1]], &mesh->nodes[v[2]], &mesh->nodes[v[3]], NULL);
+      else
+        e = mesh->create_triangle(internal_marker, &mesh->nodes[v[0]], &mesh->nodes[v[1]], &mesh->nodes[v[2]], NULL);
+
+      if(domain)
+      {
+        int i = int_attribute("i");
+        if(i < 0 || i > H2D_MAX_NODE_ID - 1)
+          throw Exceptions::MeshLoadFailureException("The index 'i' of element in the mesh file must be lower than %i.", H2D_MAX_NODE_ID);
+        if(i >= (int)element_is.size())
+          element_is.resize(i + 1, -1);
+        element_is[i] = e->id;
+
+        if(element_marker_indices.find(marker) == element_marker_indices.end())
+        {
+          element_marker_indices.insert(std::pair<std::string, int>(marker, element_markers.size()));
+          element_markers.push_back(marker);
+        }
+        for (int i = 0; i < 4; i++)
+          elements.push_back(v[i]);
+        elements.push_back(element_marker_indices.find(marker)->second);
+      }
+    }
+
+    void MeshReaderH2DXML::StreamingHandler::add_edge()
+    {
+      int v1 = vertex_position(int_attribute("v1"));
+      int v2 = vertex_position(int_attribute("v2"));
+
+      Node* en = mesh->peek_edge_node(v1, v2);
+      if(en == NULL)
+        throw Hermes::Exceptions::MeshLoadFailureException("Boundary data #%d: edge %d-%d does not exist.", edges_read, v1, v2);
+
+      // This functions check if the user-supplied marker on this element has been
+      // already used, and if not, inserts it in the appropriate structure.
+      std::string edge_marker = marker_attribute();
+      mesh->boundary_markers_conversion.insert_marker(mesh->boundary_markers_conversion.min_marker_unused, edge_marker);
+      int marker = mesh->boundary_markers_conversion.get_internal_marker(edge_marker).marker;
+
+      en->marker = marker;
+
+      // This is extremely important, as in DG, it is assumed that negative boundary markers are reserved
+      // for the inner edges.
+      if(marker > 0)
+      {
+        mesh->nodes[v1].bnd = 1;
+        mesh->nodes[v2].bnd = 1;
+        en->bnd = 1;
+      }
+
+      if(domain)
+      {
+        if(boundary_marker_indices.find(edge_marker) == boundary_marker_indices.end())
+        {
+          boundary_marker_indices.insert(std::pair<std::string, int>(edge_marker, boundary_markers.size()));
+          boundary_markers.push_back(edge_marker);
+        }
+        edges.push_back(v1);
+        edges.push_back(v2);
+        edges.push_back(boundary_marker_indices.find(edge_marker)->second);
+        edges.push_back(int_attribute("i"));
+      }
+      edges_read++;
+    }
+
+    void MeshReaderH2DXML::StreamingHandler::add_curve(Mesh* mesh, const Curve& curve, int p1, int p2, bool skip_missing)
+    {
+      Node* en = mesh->peek_edge_node(p1, p2);
+      if(en == NULL)
+      {
+        if(skip_missing)
+          return;
+        throw Hermes::Exceptions::MeshLoadFailureException("Curve #%d: edge %d-%d does not exist.", curves_read, p1, p2);
+      }
+
+      Nurbs* nurbs = new Nurbs;
+      nurbs->arc = curve.arc;
+      if(curve.arc)
+      {
+        // degree of an arc == 2, there are three control points and 6 knots: {0, 0, 0, 1, 1, 1}
+        nurbs->degree = 2;
+        nurbs->np = 3;
+        nurbs->nk = 6;
+        nurbs->kv = new double[nurbs->nk];
+        for (int i = 0; i < 3; i++)
+          nurbs->kv[i] = 0.0;
+        for (int i = 3; i < nurbs->nk; i++)
+          nurbs->kv[i] = 1.0;
+
+        // edge endpoints control points.
+        nurbs->pt = new double3[3];
+        nurbs->pt[0][0] = mesh->nodes[p1].x;
+        nurbs->pt[0][1] = mesh->nodes[p1].y;
+        nurbs->pt[0][2] = 1.0;
+        nurbs->pt[2][0] = mesh->nodes[p2].x;
+        nurbs->pt[2][1] = mesh->nodes[p2].y;
+        nurbs->pt[2][2] = 1.0;
+
+        // generate one inner control point
+        nurbs->angle = curve.angle;
+        double a = (180.0 - nurbs->angle) / 180.0 * M_PI;
+        double x = 1.0 / std::tan(a * 0.5);
+        nurbs->pt[1][0] = 0.5*((nurbs->pt[2][0] + nurbs->pt[0][0]) + (nurbs->pt[2][1] - nurbs->pt[0][1]) * x);
+        nurbs->pt[1][1] = 0.5*((nurbs->pt[2][1] + nurbs->pt[0][1]) - (nurbs->pt[2][0] - nurbs->pt[0][0]) * x);
+        nurbs->pt[1][2] = Hermes::cos((M_PI - a) * 0.5);
+      }
+      else
+      {
+        nurbs->degree = curve.degree;
+        int inner = curve.inner_points.size() / 3;
+        nurbs->np = inner + 2;
+
+        // knot vector is completed by 0.0 on the left and by 1.0 on the right
+        int inner_knots = curve.knots.size();
+        nurbs->nk = nurbs->degree + nurbs->np + 1;
+        int outer = nurbs->nk - inner_knots;
+        if((outer & 1) == 1)
+        {
+          delete nurbs;
+          throw Hermes::Exceptions::MeshLoadFailureException("Curve #%d: incorrect number of knot points.", curves_read);
+        }
+
+        // edge endpoints are also control points, with weight 1.0
+        nurbs->pt = new double3[nurbs->np];
+        nurbs->pt[0][0] = mesh->nodes[p1].x;
+        nurbs->pt[0][1] = mesh->nodes[p1].y;
+        nurbs->pt[0][2] = 1.0;
+        nurbs->pt[inner + 1][0] = mesh->nodes[p2].x;
+        nurbs->pt[inner + 1][1] = mesh->nodes[p2].y;
+        nurbs->pt[inner + 1][2] = 1.0;
+        for (int i = 0; i < inner; i++)
+          for (int j = 0; j < 3; j++)
+            nurbs->pt[i + 1][j] = curve.inner_points[3 * i + j];
+
+        nurbs->kv = new double[nurbs->nk];
+        for (int i = 0; i < outer/2; i++)
+          nurbs->kv[i] = 0.0;
+        for (int i = outer/2; i < inner_knots + outer/2; i++)
+          nurbs->kv[i] = curve.knots[i - (outer/2)];
+        for (int i = outer/2 + inner_knots; i < nurbs->nk; i++)
+          nurbs->kv[i] = 1.0;
+      }
+      nurbs->ref = 0;
+
+      // assign the curve to the elements sharing the edge node
+      for (unsigned int node_i = 0; node_i < 2; node_i++)
+      {
+        Element* e = en->elem[node_i];
+        if(e == NULL) continue;
+
+        if(e->cm == NULL)
+        {
+          e->cm = new CurvMap;
+          memset(e->cm, 0, sizeof(CurvMap));
+          e->cm->toplevel = 1;
+          e->cm->order = 4;
+        }
+
+        int idx = -1;
+        for (unsigned j = 0; j < e->get_nvert(); j++)
+          if(e->en[j] == en) { idx = j; break; }
+        assert(idx >= 0);
+
+        if(e->vn[idx]->id == p1)
+        {
+          e->cm->nurbs[idx] = nurbs;
+          nurbs->ref++;
+        }
+        else
+        {
+          Nurbs* nurbs_rev = mesh->reverse_nurbs(nurbs);
+          e->cm->nurbs[idx] = nurbs_rev;
+          nurbs_rev->ref++;
+        }
+      }
+      if(!nurbs->ref) delete nurbs;
+    }
+
+    void MeshReaderH2DXML::StreamingHandler::finish_base_mesh()
+    {
+      if(base_mesh_finished)
+        return;
+
+      // update refmap coeffs of curvilinear elements
+      mesh->precalculate_refmap_coeffs();
+
+      base_mesh_finished = true;
+    }
+
+    void MeshReaderH2DXML::StreamingHandler::refine(Mesh* mesh, int element_id, int refinement_type)
+    {
+      if(refinement_type == -1)
+        mesh->unrefine_element_id(element_id);
+      else if(refinement_type == -2)
+        mesh->reorder_hilbert(NULL, element_id);
+      else
+        mesh->refine_element_id(element_id, refinement_type);
+    }
+
+    void MeshReaderH2DXML::StreamingHandler::create_subdomains(Hermes::vector<Mesh *> meshes)
+    {
+      if(subdomains.size() != meshes.size())
+        throw Hermes::Exceptions::MeshLoadFailureException("Number of subdomains( = %u) does not equal the number of provided meshes in the vector( = %u).", subdomains.size(), meshes.size());
+
+      int vertex_count = mesh->ntopvert;
+      int element_count = elements.size() / 5;
+      int edge_count = edges.size() / 4;
+
+      // Position of the edge with the index 'i' from the file.
+      std::map<int, int> edge_positions;
+      for (int edge_i = 0; edge_i < edge_count; edge_i++)
+        edge_positions.insert(std::pair<int, int>(edges[4 * edge_i + 3], edge_i));
+
+      int num_threads = Hermes2DApi.get_integral_param_value(numThreads);
+      Hermes::Exceptions::Exception* caught_exception = NULL;
+
+      // The meshes of the subdomains are created in parallel, the stored domain is only read.
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+      for (int subdomains_i = 0; subdomains_i < (int)subdomains.size(); subdomains_i++)
+      {
+        if(caught_exception != NULL)
+          continue;
+
+        try
+        {
+          Mesh* submesh = meshes[subdomains_i];
+          Subdomain& subdomain = subdomains[subdomains_i];
+
+          for (unsigned int marker_i = 0; marker_i < element_markers.size(); marker_i++)
+            submesh->element_markers_conversion.insert_marker(submesh->element_markers_conversion.min_marker_unused, element_markers[marker_i]);
+          for (unsigned int marker_i = 0; marker_i < boundary_markers.size(); marker_i++)
+            submesh->boundary_markers_conversion.insert_marker(submesh->boundary_markers_conversion.min_marker_unused, boundary_markers[marker_i]);
+
+          // copy the whole mesh if the subdomain is the whole mesh.
+          if(subdomain.elements.empty() || (int)subdomain.elements.size() == element_count)
+          {
+            submesh->copy(mesh);
+            for (unsigned int i = 0; i < subdomain.refinements.size(); i++)
+              refine(submesh, subdomain.refinements[i].first, subdomain.refinements[i].second);
+          }
+          else
+          {
+            bool all_vertices = subdomain.vertices.empty() || (int)subdomain.vertices.size() == vertex_count;
+            int vertex_number_count = all_vertices ? vertex_count : subdomain.vertices.size();
+
+            // Initialize mesh.
+            int size = HashTable::H2D_DEFAULT_HASH_SIZE;
+            while (size < 8 * vertex_number_count)
+              size *= 2;
+            submesh->init(size);
+
+            // Create top-level vertex nodes, mapping position-in-the-whole-domain -> position-in-this-subdomain.
+            std::vector<int> subdomain_vertices(vertex_count, -1);
+            for (int vertex_numbers_i = 0; vertex_numbers_i < vertex_number_count; vertex_numbers_i++)
+            {
+              int vertex_number;
+              if(all_vertices)
+                vertex_number = vertex_numbers_i < (int)vertex_is.size() ? vertex_is[vertex_numbers_i] : -1;
+              else
+                vertex_number = subdomain.vertices[vertex_numbers_i];
+              if(vertex_number < 0 || vertex_number >= vertex_count)
+                throw Exceptions::MeshLoadFailureException("Wrong vertex number:%i in subdomain %u.", vertex_number, subdomains_i);
+
+              subdomain_vertices[vertex_number] = vertex_numbers_i;
+              Node* node = submesh->nodes.add();
+              assert(node->id == vertex_numbers_i);
+              node->ref = TOP_LEVEL_REF;
+              node->type = HERMES_TYPE_VERTEX;
+              node->bnd = 0;
+              node->p1 = node->p2 = -1;
+              node->next_hash = NULL;
+              node->x = vertex_coordinates[2 * vertex_number];
+              node->y = vertex_coordinates[2 * vertex_number + 1];
+            }
+            submesh->ntopvert = vertex_number_count;
+
+            // Elements keep their positions in the whole domain as ids.
+            submesh->nbase = element_count;
+            submesh->nactive = submesh->ninitial = subdomain.elements.size();
+
+            std::vector<bool> elements_existing(element_count, false);
+            for (unsigned int element_number_i = 0; element_number_i < subdomain.elements.size(); element_number_i++)
+            {
+              int elementI = subdomain.elements[element_number_i];
+              if(elementI < 0 || elementI >= (int)element_is.size() || element_is[elementI] == -1)
+                throw Exceptions::MeshLoadFailureException("Wrong element number:%i in subdomain %u.", elementI, subdomains_i);
+              elements_existing[element_is[elementI]] = true;
+            }
+
+            std::vector<int> internal_markers(element_markers.size());
+            for (unsigned int marker_i = 0; marker_i < element_markers.size(); marker_i++)
+              internal_markers[marker_i] = submesh->element_markers_conversion.get_internal_marker(element_markers[marker_i]).marker;
+
+            for (int element_i = 0; element_i < element_count; element_i++)
+            {
+              if(!elements_existing[element_i])
+              {
+                submesh->elements.skip_slot();
+                continue;
+              }
+
+              const int* element = &elements[5 * element_i];
+              Node* v[4] = { NULL, NULL, NULL, NULL };
+              for (int i = 0; i < 4 && element[i] != -1; i++)
+              {
+                if(subdomain_vertices[element[i]] == -1)
+                  throw Exceptions::MeshLoadFailureException("Element number %i in subdomain %u uses a vertex not in the subdomain.", element_i, subdomains_i);
+                v[i] = &submesh->nodes[subdomain_vertices[element[i]]];
+              }
+
+              if(element[3] != -1)
+                submesh->create_quad(internal_markers[element[4]], v[0], v[1], v[2], v[3], NULL, element_i);
+              else
+                submesh->create_triangle(internal_markers[element[4]], v[0], v[1], v[2], NULL, element_i);
+            }
+
+            // Boundary Edge numbers //
+            bool all_boundary_edges = subdomain.boundary_edges.empty();
+            int boundary_edge_number_count = all_boundary_edges ? edge_count : subdomain.boundary_edges.size();
+            for (int boundary_edge_number_i = 0; boundary_edge_number_i < boundary_edge_number_count; boundary_edge_number_i++)
+            {
+              int edge_i = boundary_edge_number_i;
+              if(!all_boundary_edges)
+              {
+                std::map<int, int>::iterator position = edge_positions.find(subdomain.boundary_edges[boundary_edge_number_i]);
+                if(position == edge_positions.end())
+                  throw Exceptions::MeshLoadFailureException("Wrong boundary-edge number:%i in subdomain %u.", subdomain.boundary_edges[boundary_edge_number_i], subdomains_i);
+                edge_i = position->second;
+              }
+
+              int p1 = subdomain_vertices[edges[4 * edge_i]];
+              int p2 = subdomain_vertices[edges[4 * edge_i + 1]];
+              Node* en = (p1 == -1 || p2 == -1) ? NULL : submesh->peek_edge_node(p1, p2);
+              if(en == NULL)
+              {
+                // Without a list, the edges outside of the subdomain are skipped.
+                if(all_boundary_edges)
+                  continue;
+                throw Hermes::Exceptions::MeshLoadFailureException("Boundary data error (edge %i does not exist).", boundary_edge_number_i);
+              }
+
+              en->marker = submesh->boundary_markers_conversion.get_internal_marker(boundary_markers[edges[4 * edge_i + 2]]).marker;
+
+              submesh->nodes[p1].bnd = 1;
+              submesh->nodes[p2].bnd = 1;
+              en->bnd = 1;
+            }
+
+            // Inner Edge numbers //
+            for (unsigned int inner_edge_number_i = 0; inner_edge_number_i < subdomain.inner_edges.size(); inner_edge_number_i++)
+            {
+              std::map<int, int>::iterator position = edge_positions.find(subdomain.inner_edges[inner_edge_number_i]);
+              if(position == edge_positions.end())
+                throw Exceptions::MeshLoadFailureException("Wrong inner-edge number:%i in subdomain %u.", subdomain.inner_edges[inner_edge_number_i], subdomains_i);
+              int edge_i = position->second;
+
+              int p1 = subdomain_vertices[edges[4 * edge_i]];
+              int p2 = subdomain_vertices[edges[4 * edge_i + 1]];
+              Node* en = (p1 == -1 || p2 == -1) ? NULL : submesh->peek_edge_node(p1, p2);
+              if(en == NULL)
+                throw Hermes::Exceptions::MeshLoadFailureException("Inner data error (edge %i does not exist).", inner_edge_number_i);
+
+              en->marker = submesh->boundary_markers_conversion.get_internal_marker(boundary_markers[edges[4 * edge_i + 2]]).marker;
+              en->bnd = 0;
+            }
+
+            // Curves //
+            for (unsigned int curves_i = 0; curves_i < curves.size(); curves_i++)
+            {
+              int p1 = subdomain_vertices[curves[curves_i].v1];
+              int p2 = subdomain_vertices[curves[curves_i].v2];
+              if(p1 != -1 && p2 != -1)
+                add_curve(submesh, curves[curves_i], p1, p2, true);
+            }
+
+            // update refmap coeffs of curvilinear elements
+            submesh->precalculate_refmap_coeffs();
+
+            // refinements.
+            for (unsigned int i = 0; i < subdomain.refinements.size(); i++)
+              refine(submesh, subdomain.refinements[i].first, subdomain.refinements[i].second);
+          }
+          submesh->initial_single_check();
+        }
+        catch(Hermes::Exceptions::Exception& e)
+        {
+#pragma omp critical (caught_exception)
+          if(caught_exception == NULL)
+            caught_exception = e.clone();
+        }
+        catch(std::exception& e)
+        {
+#pragma omp critical (caught_exception)
+          if(caught_exception == NULL)
+            caught_exception = new Hermes::Exceptions::Exception(e.what());
+        }
+      }
+
+      if(caught_exception != NULL)
+      {
+        std::string message(caught_exception->what());
+        delete caught_exception;
+        throw Hermes::Exceptions::MeshLoadFailureException("%s", message.c_str());
+      }
+
+      // The sequence numbers follow the order of the subdomains.
+      for (unsigned int subdomains_i = 0; subdomains_i < subdomains.size(); subdomains_i++)
+        meshes[subdomains_i]->seq = next_mesh_seq();
+    }
   }
 }
@@ -16,17 +16,17 @@
 #include "global.h"
 #include "mesh.h"
 #include "refmap.h"
+#include "cache_statistics.h"
 
 namespace Hermes
 {
   namespace Hermes2D
   {
-    RefMap::RefMap() : ref_map_shapeset(H1ShapesetJacobi()), ref_map_pss(PrecalcShapeset(&ref_map_shapeset))
+    RefMap::RefMap() : Mixins::MemoryAccounted(Mixins::H2D_MEMORY_REFMAP), ref_map_shapeset(H1ShapesetJacobi()), ref_map_pss(PrecalcShapeset(&ref_map_shapeset))
     {
       quad_2d = NULL;
       num_tables = 0;
       cur_node = NULL;
-      overflow = NULL;
       set_quad_2d(&g_quad_2d_std); // default quadrature
     }
 
@@ -77,6 +77,7 @@ namespace Hermes
     {
       if(cur_node == NULL)
         throw Hermes::Exceptions::Exception("Cur_node == NULL in RefMap - inner algorithms failed");
+      CacheStatistics::lookup(H2D_CACHE_REFMAP, cur_node->inv_ref_map[order] != NULL);
       if(cur_node->inv_ref_map[order] == NULL)
         calc_inv_ref_map(order);
       return cur_node->jacobian[order];
@@ -89,6 +90,7 @@ namespace Hermes
     {
       if(cur_node == NULL)
         throw Hermes::Exceptions::Exception("Cur_node == NULL in RefMap - inner algorithms failed");
+      CacheStatistics::lookup(H2D_CACHE_REFMAP, cur_node->inv_ref_map[order] != NULL);
       if(cur_node->inv_ref_map[order] == NULL)
         calc_inv_ref_map(order);
       return cur_node->inv_ref_map[order];
@@ -99,6 +101,7 @@ namespace Hermes
     {
       if(cur_node == NULL)
         throw Hermes::Exceptions::Exception("Cur_node == NULL in RefMap - inner algorithms failed");
+      CacheStatistics::lookup(H2D_CACHE_REFMAP, cur_node->second_ref_map[order] != NULL);
       if(cur_node->second_ref_map[order] == NULL) calc_second_ref_map(order);
       return cur_node->second_ref_map[order];
     }
@@ -110,6 +113,7 @@ namespace Hermes
     {
       if(cur_node == NULL)
         throw Hermes::Exceptions::Exception("Cur_node == NULL in RefMap - inner algorithms failed");
+      CacheStatistics::lookup(H2D_CACHE_REFMAP, cur_node->phys_x[order] != NULL);
       if(cur_node->phys_x[order] == NULL) calc_phys_x(order);
       return cur_node->phys_x[order];
     }
@@ -121,6 +125,7 @@ namespace Hermes
     {
       if(cur_node == NULL)
         throw Hermes::Exceptions::Exception("Cur_node == NULL in RefMap - inner algorithms failed");
+      CacheStatistics::lookup(H2D_CACHE_REFMAP, cur_node->phys_y[order] != NULL);
       if(cur_node->phys_y[order] == NULL) calc_phys_y(order);
       return cur_node->phys_y[order];
     }
@@ -256,6 +261,7 @@ namespace Hermes
       double trj = get_transform_jacobian();
       double2x2* irm = cur_node->inv_ref_map[order] = new double2x2[np];
       double* jac = cur_node->jacobian[order] = new double[np];
+      insert_table(np * (sizeof(double2x2) + sizeof(double)));
       for (i = 0; i < np; i++)
       {
         jac[i] = (m[i][0][0] * m[i][1][1] - m[i][0][1] * m[i][1][0]);
@@ -311,6 +317,7 @@ namespace Hermes
       }
 
       double3x2* mm = cur_node->second_ref_map[order] = new double3x2[np];
+      insert_table(np * sizeof(double3x2));
       double2x2* m = get_inv_ref_map(order);
       for (j = 0; j < np; j++)
       {
@@ -365,11 +372,38 @@ namespace Hermes
       const_jacobian *= get_transform_jacobian();
     }
 
+    void RefMap::calc_const_phys_coords(int order, double* x, double* y)
+    {
+      int np = quad_2d->get_num_points(order, element->get_mode());
+      double3* pt = quad_2d->get_points(order, element->get_mode());
+
+      // The affine map is v0 + m (xi + 1) / 2, with xi transformed by the sub-element matrix.
+      int k = element->is_triangle() ? 2 : 3;
+      double m[2][2] = { { 0.5 * (element->vn[1]->x - element->vn[0]->x), 0.5 * (element->vn[k]->x - element->vn[0]->x) },
+      { 0.5 * (element->vn[1]->y - element->vn[0]->y), 0.5 * (element->vn[k]->y - element->vn[0]->y) } };
+      double a[2][2] = { { m[0][0] * ctm->m[0], m[0][1] * ctm->m[1] }, { m[1][0] * ctm->m[0], m[1][1] * ctm->m[1] } };
+      double b[2] = { element->vn[0]->x + m[0][0] * (ctm->t[0] + 1.0) + m[0][1] * (ctm->t[1] + 1.0),
+        element->vn[0]->y + m[1][0] * (ctm->t[0] + 1.0) + m[1][1] * (ctm->t[1] + 1.0) };
+
+      if(x != NULL)
+        for (int i = 0; i < np; i++)
+          x[i] = b[0] + a[0][0] * pt[i][0] + a[0][1] * pt[i][1];
+      if(y != NULL)
+        for (int i = 0; i < np; i++)
+          y[i] = b[1] + a[1][0] * pt[i][0] + a[1][1] * pt[i][1];
+    }
+
     void RefMap::calc_phys_x(int order)
     {
       // transform all x coordinates of the integration points
       int i, j, np = quad_2d->get_num_points(order, element->get_mode());
       double* x = cur_node->phys_x[order] = new double[np];
+      insert_table(np * sizeof(double));
+      if(is_const)
+      {
+        calc_const_phys_coords(order, x, NULL);
+        return;
+      }
       memset(x, 0, np * sizeof(double));
       ref_map_pss.force_transform(sub_idx, ctm);
       for (i = 0; i < nc; i++)
@@ -387,6 +421,12 @@ namespace Hermes
       // transform all y coordinates of the integration points
       int i, j, np = quad_2d->get_num_points(order, element->get_mode());
       double* y = cur_node->phys_y[order] = new double[np];
+      insert_table(np * sizeof(double));
+      if(is_const)
+      {
+        calc_const_phys_coords(order, NULL, y);
+        return;
+      }
       memset(y, 0, np * sizeof(double));
       ref_map_pss.force_transform(sub_idx, ctm);
       for (i = 0; i < nc; i++)
@@ -784,132 +824,20 @@ namespace Hermes
 
     Element* RefMap::element_on_physical_coordinates(const Mesh* mesh, double x, double y, double* x_reference, double* y_reference)
     {
-      // go through all elements
-      double xi1, xi2;
-      Element *e;
-      // vector for curved elements that do not have the point in them when considering straight edges.
-      Hermes::vector<Element*> improbable_curved_elements;
-      for_all_active_elements(e, mesh)
+      // only the elements whose boxes contain the point
+      const ElementGrid* grid = mesh->get_element_grid();
+      int count;
+      Element** candidates = grid->get_candidates(x, y, count);
+      for(int i = 0; i < count; i++)
       {
-        bool is_triangle = e->is_triangle();
-        bool is_curved = e->is_curved();
-
-        // For curved elements.
-        bool is_near_straightened_element = false;
-
-        // edge vectors.
-        double2 vector[4];
-        vector[0][0] = e->vn[1]->x - e->vn[0]->x;
-        vector[0][1] = e->vn[1]->y - e->vn[0]->y;
-        vector[1][0] = e->vn[2]->x - e->vn[1]->x;
-        vector[1][1] = e->vn[2]->y - e->vn[1]->y;
-        if(is_triangle)
-        {
-          vector[2][0] = e->vn[0]->x - e->vn[2]->x;
-          vector[2][1] = e->vn[0]->y - e->vn[2]->y;
-        }
-        else
-        {
-          vector[2][0] = e->vn[3]->x - e->vn[2]->x;
-          vector[2][1] = e->vn[3]->y - e->vn[2]->y;
-          vector[3][0] = e->vn[0]->x - e->vn[3]->x;
-          vector[3][1] = e->vn[0]->y - e->vn[3]->y;
-        }
- 
-        // calculate cross products
-        // -> if all cross products of edge vectors (vector[*]) x vector (thePoint - aVertex) are positive (negative),
-        // the point is inside of the element.
-        double cross_product_0 = (x - e->vn[0]->x) * vector[0][1] - (y - e->vn[0]->y) * vector[0][0];
-        double cross_product_1 = (x - e->vn[1]->x) * vector[1][1] - (y - e->vn[1]->y) * vector[1][0];
-        double cross_product_2 = (x - e->vn[2]->x) * vector[2][1] - (y - e->vn[2]->y) * vector[2][0];
-        if(is_triangle)
-        {
-          if ((cross_product_0 * cross_product_1 >= 0) && (cross_product_0 * cross_product_2 >= 0) && (cross_product_1 * cross_product_2 >= 0))
-          {
-            if(!is_curved)
-            {
-              untransform(e, x, y, xi1, xi2);
-              if(x_reference != NULL)
-                (*x_reference) = xi1;
-              if(y_reference != NULL)
-                (*y_reference) = xi2;
-              return e;
-            }
-            else
-              is_near_straightened_element = true;
-          }
-          if(is_curved && !is_near_straightened_element)
-          {
-            double gravity_center_x = (e->vn[0]->x + e->vn[1]->x + e->vn[2]->x) / 3.;
-            double gravity_center_y = (e->vn[0]->y + e->vn[1]->y + e->vn[2]->y) / 3.;
-            double distance_x = std::abs(x - gravity_center_x);
-            double distance_y = std::abs(y - gravity_center_y);
-            if(distance_x < std::abs(e->vn[0]->x - gravity_center_x) && distance_x < std::abs(e->vn[1]->x - gravity_center_x) && distance_x < std::abs(e->vn[2]->x - gravity_center_x) &&
-              distance_y < std::abs(e->vn[0]->y - gravity_center_y) && distance_y < std::abs(e->vn[1]->y - gravity_center_y) && distance_y < std::abs(e->vn[2]->y - gravity_center_y))
-                is_near_straightened_element = true;
-          }
-        }
-        else
-        {
-          double cross_product_3 = (x - e->vn[3]->x) * vector[3][1] - (y - e->vn[3]->y) * vector[3][0];
-          if ((cross_product_0 * cross_product_1 >= 0) && (cross_product_0 * cross_product_2 >= 0) && 
-              (cross_product_1 * cross_product_2 >= 0) && (cross_product_1 * cross_product_3 >= 0) &&
-              (cross_product_2 * cross_product_3 >= 0) && (cross_product_0 * cross_product_3 >= 0))
-          {
-            if(!is_curved)
-            {
-              untransform(e, x, y, xi1, xi2);
-              if(x_reference != NULL)
-                (*x_reference) = xi1;
-              if(y_reference != NULL)
-                (*y_reference) = xi2;
-              return e;
-            }
-            else
-              is_near_straightened_element = true;
-          }
-          if(is_curved && !is_near_straightened_element)
-          {
-            double gravity_center_x = (e->vn[0]->x + e->vn[1]->x + e->vn[2]->x + e->vn[3]->x) / 4.;
-            double gravity_center_y = (e->vn[0]->y + e->vn[1]->y + e->vn[2]->y + e->vn[3]->y) / 4.;
-            double distance_x = std::abs(x - gravity_center_x);
-            double distance_y = std::abs(y - gravity_center_y);
-            if(distance_x <= std::abs(e->vn[0]->x - gravity_center_x) && distance_x <= std::abs(e->vn[1]->x - gravity_center_x) && distance_x <= std::abs(e->vn[2]->x - gravity_center_x) && distance_x <= std::abs(e->vn[3]->x - gravity_center_x) &&
-              distance_y <= std::abs(e->vn[0]->y - gravity_center_y) && distance_y <= std::abs(e->vn[1]->y - gravity_center_y) && distance_y <= std::abs(e->vn[2]->y - gravity_center_y) && distance_y <= std::abs(e->vn[3]->y - gravity_center_y))
-                is_near_straightened_element = true;
-          }
-        }
-
-        if(is_curved)
-        {
-          if(is_near_straightened_element)
-          {
-            untransform(e, x, y, xi1, xi2);
-            if(is_in_ref_domain(e, xi1, xi2))
-            {
-              if(x_reference != NULL)
-                (*x_reference) = xi1;
-              if(y_reference != NULL)
-                (*y_reference) = xi2;
-              return e;
-            }
-          }
-          else
-            improbable_curved_elements.push_back(e);
-        }
-      }
-
-      // loop through the improbable curved elements.
-      for(int i = 0; i < improbable_curved_elements.size(); i++)
-      {
-        untransform(improbable_curved_elements[i], x, y, xi1, xi2);
-        if(is_in_ref_domain(improbable_curved_elements[i], xi1, xi2))
+        double xi1, xi2;
+        if(is_element_on_physical_coordinates(candidates[i], x, y, &xi1, &xi2))
         {
           if(x_reference != NULL)
             (*x_reference) = xi1;
           if(y_reference != NULL)
             (*y_reference) = xi2;
-          return improbable_curved_elements[i];
+          return candidates[i];
         }
       }
 
@@ -924,6 +852,14 @@ namespace Hermes
       memset(pp->phys_x, 0, num_tables * sizeof(double*));
       memset(pp->phys_y, 0, num_tables * sizeof(double*));
       memset(pp->tan, 0, sizeof(pp->tan));
+      pp->bytes = sizeof(Node);
+      CacheStatistics::insert(H2D_CACHE_REFMAP, sizeof(Node));
+    }
+
+    void RefMap::insert_table(long long bytes)
+    {
+      cur_node->bytes += bytes;
+      CacheStatistics::insert(H2D_CACHE_REFMAP, bytes);
     }
 
     void RefMap::free_node(Node* node)
@@ -945,9 +881,16 @@ namespace Hermes
         if(node->tan[i] != NULL)
           delete [] node->tan[i];
 
+      CacheStatistics::add_bytes(H2D_CACHE_REFMAP, -node->bytes);
       delete node;
     }
 
+    void RefMap::reset()
+    {
+      free();
+      this->element = NULL;
+    }
+
     void RefMap::free()
     {
       std::map<uint64_t, Node*>::iterator it;
@@ -955,19 +898,19 @@ namespace Hermes
       for (it = nodes.begin(); it != nodes.end(); ++it)
         free_node(it->second);
       nodes.clear();
-      if(overflow != NULL)
-      {
-        free_node(overflow); delete overflow; overflow = NULL;
-      }
     }
 
-    RefMap::Node* RefMap::handle_overflow()
+    std::size_t RefMap::get_memory_usage() const
+    {
+      std::size_t size = 0;
+      for (std::map<uint64_t, Node*>::const_iterator it = nodes.begin(); it != nodes.end(); ++it)
+        size += it->second->bytes;
+      return size;
+    }
+
+    std::size_t RefMap::get_total_memory_usage() const
     {
-      if(overflow != NULL)
-        free_node(overflow);
-      overflow = new Node;
-      init_node(overflow);
-      return overflow;
+      return this->get_memory_usage();
     }
   }
 }
@@ -17,15 +17,23 @@
 #include "mesh.h"
 #include "transformable.h"
 #include "traverse.h"
+#include <algorithm>
 namespace Hermes
 {
   namespace Hermes2D
   {
     static const Rect H2D_UNITY = { 0, 0, ONE, ONE };
-    Traverse::Traverse(bool master) : master(master)
+    Traverse::Traverse(bool master) : element_markers(NULL), master(master)
     {
     }
 
+    bool Traverse::is_traversed(int i, Element* base_element) const
+    {
+      if(this->element_markers == NULL || (*this->element_markers)[i].empty())
+        return true;
+      return std::binary_search((*this->element_markers)[i].begin(), (*this->element_markers)[i].end(), base_element->marker);
+    }
+
     static int get_split_and_sons(Element* e, Rect* cr, Rect* er, int4& sons)
     {
       uint64_t hmid = (er->l + er->r) >> 1;
@@ -161,7 +169,7 @@ namespace Hermes
 
     void Traverse::State::push_transform(int son, int i, bool is_triangle)
     {
-      this->sub_idx[i] = (sub_idx[i] << 3) + son + 1;
+      this->sub_idx[i] = Transformable::get_son_idx(sub_idx[i], son);
 
       if(is_triangle)
       {
@@ -517,6 +525,7 @@ namespace Hermes
 
     Traverse::State* Traverse::get_next_state(int* top_by_ref, int* id_by_ref)
     {
+      Hermes::ProfilerRegion profiler_region("Traverse::get_next_state");
       // Serial / parallel code.
       int* top_f = (top_by_ref == NULL) ? &this->top : top_by_ref;
       int* id_f = (id_by_ref == NULL) ? &this->id : id_by_ref;
@@ -554,7 +563,7 @@ namespace Hermes
             {
               // Retrieve the Element with this id on the i-th mesh.
               s->e[i] = meshes[i]->get_element(*id_f);
-              if(!s->e[i]->used)
+              if(!s->e[i]->used || !this->is_traversed(i, s->e[i]))
               {
                 s->e[i] = NULL;
                 continue;
@@ -784,6 +793,223 @@ namespace Hermes
       }
     }
 
+    Traverse::State** Traverse::get_states(Hermes::vector<const Mesh*> meshes, int& states_count, const Hermes::vector<std::vector<int> >* element_markers)
+    {
+      if(!this->master)
+        throw Hermes::Exceptions::Exception("Traverse::get_states() has to be called on a master Traverse.");
+
+      int states_size = 1024;
+      State** states = (State**)malloc(states_size * sizeof(State*));
+      states_count = 0;
+
+      if(element_markers != NULL && element_markers->size() != meshes.size())
+        throw Hermes::Exceptions::LengthException(3, element_markers->size(), meshes.size());
+
+      if(is_single_mesh(meshes))
+      {
+        free(states);
+        this->element_markers = element_markers;
+        states = this->get_states_single_mesh(meshes, states_count);
+        this->element_markers = NULL;
+        return states;
+      }
+
+      this->begin(meshes.size(), &meshes.front());
+      this->element_markers = element_markers;
+
+      State* current_state;
+      while((current_state = this->get_next_state()) != NULL)
+      {
+        if(states_count == states_size)
+        {
+          states_size *= 2;
+          states = (State**)realloc(states, states_size * sizeof(State*));
+        }
+        states[states_count] = new State;
+        *(states[states_count]) = current_state;
+        states_count++;
+      }
+
+      this->finish();
+      this->element_markers = NULL;
+
+      return states;
+    }
+
+    bool Traverse::is_single_mesh(Hermes::vector<const Mesh*>& meshes)
+    {
+      for(unsigned int i = 1; i < meshes.size(); i++)
+      {
+        if(meshes[i] == meshes[0])
+          continue;
+        // A copy (Mesh::copy() keeps the seq), the refinements are verified, as the seq is not changed by all of them.
+        if(meshes[i]->get_seq() != meshes[0]->get_seq() || meshes[i]->get_max_element_id() != meshes[0]->get_max_element_id()
+          || meshes[i]->get_num_base_elements() != meshes[0]->get_num_base_elements())
+          return false;
+        for(int id = 0; id < meshes[0]->get_max_element_id(); id++)
+        {
+          Element* e_0 = meshes[0]->get_element_fast(id);
+          Element* e_i = meshes[i]->get_element_fast(id);
+          if(e_0->used != e_i->used || (e_0->used && e_0->active != e_i->active))
+            return false;
+        }
+      }
+      return true;
+    }
+
+    Traverse::State** Traverse::get_states_single_mesh(Hermes::vector<const Mesh*>& meshes, int& states_count)
+    {
+      this->num = meshes.size();
+      int states_size = std::max(1, meshes[0]->get_num_active_elements());
+      State** states = (State**)malloc(states_size * sizeof(State*));
+      states_count = 0;
+
+      std::vector<Element*> to_visit;
+      for(int id = 0; id < meshes[0]->get_num_base_elements(); id++)
+      {
+        Element* base_element = meshes[0]->get_element_fast(id);
+        if(!base_element->used)
+          continue;
+
+        // The meshes traversed on this base element (element_markers).
+        bool any_traversed = false;
+        std::vector<bool> traversed(num);
+        for(int i = 0; i < num; i++)
+        {
+          traversed[i] = this->is_traversed(i, meshes[i]->get_element_fast(id));
+          any_traversed = any_traversed || traversed[i];
+        }
+        if(!any_traversed)
+          continue;
+
+        // Depth first, the sons in their order.
+        to_visit.push_back(base_element);
+        while(!to_visit.empty())
+        {
+          Element* e = to_visit.back();
+          to_visit.pop_back();
+          if(!e->active)
+          {
+            for(int son = H2D_MAX_ELEMENT_SONS - 1; son >= 0; son--)
+              if(e->sons[son] != NULL)
+                to_visit.push_back(e->sons[son]);
+            continue;
+          }
+
+          if(states_count == states_size)
+          {
+            states_size *= 2;
+            states = (State**)realloc(states, states_size * sizeof(State*));
+          }
+          State* s = new State;
+          s->num = num;
+          s->e = new Element*[num];
+          s->sub_idx = new uint64_t[num];
+          memset(s->sub_idx, 0, num * sizeof(uint64_t));
+          s->visited = true;
+          for(int i = 0; i < num; i++)
+          {
+            if(!traversed[i])
+              s->e[i] = NULL;
+            else
+            {
+              s->e[i] = (meshes[i] == meshes[0]) ? e : meshes[i]->get_element_fast(e->id);
+              s->rep = s->e[i];
+            }
+          }
+          // The whole element, set_boundary_info() with the unit rectangle.
+          int nvert = e->get_nvert();
+          s->isBnd = false;
+          for(int j = 0; j < nvert; j++)
+          {
+            s->bnd[j] = s->rep->en[j]->bnd;
+            s->isBnd = s->isBnd || s->bnd[j] || s->rep->vn[j]->bnd;
+          }
+          states[states_count++] = s;
+        }
+      }
+
+      return states;
+    }
+
+    void Traverse::free_states(State** states, int states_count)
+    {
+      for(int i = 0; i < states_count; i++)
+        delete states[i];
+      free(states);
+    }
+
+    TraversePlan::TraversePlan() : states(NULL), num_states(0), num_traversals(0), num_replays(0)
+    {
+    }
+
+    TraversePlan::~TraversePlan()
+    {
+      this->clear();
+    }
+
+    void TraversePlan::clear()
+    {
+      if(this->states != NULL)
+        Traverse::free_states(this->states, this->num_states);
+      this->states = NULL;
+      this->num_states = 0;
+      this->meshes.clear();
+      this->seqs.clear();
+      this->first_elements.clear();
+      this->element_markers.clear();
+    }
+
+    bool TraversePlan::is_valid_for(Hermes::vector<const Mesh*>& meshes, const Hermes::vector<std::vector<int> >* element_markers) const
+    {
+      if(this->states == NULL || meshes.size() != this->meshes.size())
+        return false;
+      if(element_markers == NULL ? !this->element_markers.empty() : *element_markers != this->element_markers)
+        return false;
+      for(unsigned int i = 0; i < meshes.size(); i++)
+        if(meshes[i] != this->meshes[i] || meshes[i]->get_seq() != this->seqs[i] || meshes[i]->get_element_fast(0) != this->first_elements[i])
+          return false;
+      return true;
+    }
+
+    Traverse::State** TraversePlan::get_states(Hermes::vector<const Mesh*> meshes, int& states_count, const Hermes::vector<std::vector<int> >* element_markers)
+    {
+      if(this->is_valid_for(meshes, element_markers))
+      {
+        this->num_replays++;
+        states_count = this->num_states;
+        return this->states;
+      }
+
+      this->clear();
+
+      Traverse trav_master(true);
+      this->states = trav_master.get_states(meshes, this->num_states, element_markers);
+      this->num_traversals++;
+      if(element_markers != NULL)
+        this->element_markers = *element_markers;
+
+      for(unsigned int i = 0; i < meshes.size(); i++)
+      {
+        this->meshes.push_back(meshes[i]);
+        this->seqs.push_back(meshes[i]->get_seq());
+        this->first_elements.push_back(meshes[i]->get_element_fast(0));
+      }
+
+      states_count = this->num_states;
+      return this->states;
+    }
+
+    void Traverse::set_state_to_fns(State* state, Transformable** fn)
+    {
+      for(int i = 0; i < state->num; i++)
+        if(state->e[i] != NULL)
+        {
+          fn[i]->set_active_element(state->e[i]);
+          fn[i]->set_transform(state->sub_idx[i]);
+        }
+    }
+
     void Traverse::begin(int n, const Mesh** meshes, Transformable** fn)
     {
       //if(stack != NULL) finish();
@@ -906,7 +1132,7 @@ namespace Hermes
         else if(cr->l >= hmid) { son = 7; r.l = hmid; }
         else assert(0);
 
-        idx = (idx << 3) + son + 1;
+        idx = Transformable::get_son_idx(idx, son);
       }
       return idx;
     }
@@ -962,7 +1188,7 @@ namespace Hermes
               if(e[i]->active)
               {
                 e_new[i] = e[i];
-                idx_new[i] = (idx[i] << 3) + son + 1;
+                idx_new[i] = Transformable::get_son_idx(idx[i], son);
               } else
                 e_new[i] = e[i]->sons[son];
             }
@@ -990,7 +1216,7 @@ namespace Hermes
                 if(e[i]->active)
                 {
                   e_new[i] = e[i];
-                  idx_new[i] = (idx[i] << 3) + son + 1;
+                  idx_new[i] = Transformable::get_son_idx(idx[i], son);
                 } else
                 {
                   e_new[i] = e[i]->sons[sons[i][son] & 3];
@@ -1018,7 +1244,7 @@ namespace Hermes
                 if(e[i]->active)
                 {
                   e_new[i] = e[i];
-                  idx_new[i] = (idx[i] << 3) + son + 1;
+                  idx_new[i] = Transformable::get_son_idx(idx[i], son);
                 } else
                 {
                   e_new[i] = e[i]->sons[sons[i][j] & 3];
@@ -1090,5 +1316,123 @@ namespace Hermes
 
       return unidata;
     }
+
+    /// Cached union mesh (see Traverse::get_union_mesh()).
+    class UnionMeshCacheRecord
+    {
+    public:
+      Hermes::vector<const Mesh*> meshes;
+      Hermes::vector<unsigned> seqs;
+      Hermes::vector<Element*> first_elements;
+      Mesh* unimesh;
+      UniData** unidata;
+      /// Number of the current users.
+      int users;
+      /// Time of the last use, for the eviction of the unused records.
+      unsigned long last_used;
+    };
+
+    /// Number of the cached union meshes that are not in use and are kept for a future use.
+    static const unsigned int H2D_UNION_MESH_CACHE_SIZE = 8;
+
+    static Hermes::vector<UnionMeshCacheRecord*> union_mesh_cache;
+    static unsigned long union_mesh_cache_time = 0;
+
+    static void delete_union_mesh_cache_record(UnionMeshCacheRecord* record)
+    {
+      for(unsigned int i = 0; i < record->meshes.size(); i++)
+        ::free(record->unidata[i]);
+      delete [] record->unidata;
+      delete record->unimesh;
+      delete record;
+    }
+
+    /// Deletes the least recently used records that are not in use, so that at most max_unused of these remain.
+    static void trim_union_mesh_cache(unsigned int max_unused)
+    {
+      while(true)
+      {
+        unsigned int unused = 0;
+        int oldest = -1;
+        for(unsigned int i = 0; i < union_mesh_cache.size(); i++)
+          if(union_mesh_cache[i]->users == 0)
+          {
+            unused++;
+            if(oldest == -1 || union_mesh_cache[i]->last_used < union_mesh_cache[oldest]->last_used)
+              oldest = i;
+          }
+        if(unused <= max_unused)
+          return;
+        delete_union_mesh_cache_record(union_mesh_cache[oldest]);
+        union_mesh_cache.erase(union_mesh_cache.begin() + oldest);
+      }
+    }
+
+    Mesh* Traverse::get_union_mesh(int n, const Mesh** meshes, UniData**& unidata)
+    {
+      Mesh* unimesh = NULL;
+#pragma omp critical (union_mesh_cache)
+      {
+        for(unsigned int i = 0; i < union_mesh_cache.size() && unimesh == NULL; i++)
+        {
+          UnionMeshCacheRecord* record = union_mesh_cache[i];
+          if(record->meshes.size() != n)
+            continue;
+          bool fits = true;
+          for(int j = 0; j < n && fits; j++)
+            fits = (record->meshes[j] == meshes[j] && record->seqs[j] == meshes[j]->get_seq() && record->first_elements[j] == meshes[j]->get_element_fast(0));
+          if(fits)
+          {
+            record->users++;
+            record->last_used = union_mesh_cache_time++;
+            unimesh = record->unimesh;
+            unidata = record->unidata;
+          }
+        }
+
+        if(unimesh == NULL)
+        {
+          UnionMeshCacheRecord* record = new UnionMeshCacheRecord;
+          Traverse trav;
+          trav.begin(n, meshes);
+          record->unimesh = new Mesh;
+          record->unidata = trav.construct_union_mesh(record->unimesh);
+          trav.finish();
+          for(int j = 0; j < n; j++)
+          {
+            record->meshes.push_back(meshes[j]);
+            record->seqs.push_back(meshes[j]->get_seq());
+            record->first_elements.push_back(meshes[j]->get_element_fast(0));
+          }
+          record->users = 1;
+          record->last_used = union_mesh_cache_time++;
+          union_mesh_cache.push_back(record);
+
+          unimesh = record->unimesh;
+          unidata = record->unidata;
+        }
+      }
+      return unimesh;
+    }
+
+    void Traverse::release_union_mesh(Mesh* unimesh)
+    {
+#pragma omp critical (union_mesh_cache)
+      {
+        for(unsigned int i = 0; i < union_mesh_cache.size(); i++)
+          if(union_mesh_cache[i]->unimesh == unimesh)
+          {
+            union_mesh_cache[i]->users--;
+            break;
+          }
+        trim_union_mesh_cache(H2D_UNION_MESH_CACHE_SIZE);
+      }
+    }
+
+    void Traverse::clear_union_mesh_cache()
+    {
+#pragma omp critical (union_mesh_cache)
+      trim_union_mesh_cache(0);
+    }
   }
-}
\ No newline at end of file
+}
@@ -13,6 +13,14 @@
 // You should have received a copy of the GNU General Public License
 // along with Hermes; if not, see <http://www.gnu.prg/licenses/>.
 #include "mixins2d.h"
+#include "api2d.h"
+#include <set>
+#include <sstream>
+#ifdef WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
 
 namespace Hermes
 {
@@ -45,6 +53,142 @@ namespace Hermes
         this->validate = to_set;
       }
 
+      /// The living instances of the kind, guarded by the critical section memory_accounted.
+      /// Never deleted, there are static instances (destroyed in an unspecified order).
+      static std::set<const MemoryAccounted*>& memory_accounted_instances(MemoryUsageKind kind)
+      {
+        static std::set<const MemoryAccounted*>* instances = new std::set<const MemoryAccounted*>[H2D_NUM_MEMORY_USAGE_KINDS];
+        return instances[kind];
+      }
+
+      MemoryAccounted::MemoryAccounted(MemoryUsageKind kind) : memory_usage_kind(kind)
+      {
+#pragma omp critical (memory_accounted)
+        memory_accounted_instances(kind).insert(this);
+      }
+
+      MemoryAccounted::MemoryAccounted(const MemoryAccounted& other) : memory_usage_kind(other.memory_usage_kind)
+      {
+#pragma omp critical (memory_accounted)
+        memory_accounted_instances(memory_usage_kind).insert(this);
+      }
+
+      MemoryAccounted& MemoryAccounted::operator=(const MemoryAccounted& other)
+      {
+        return *this;
+      }
+
+      MemoryAccounted::~MemoryAccounted()
+      {
+#pragma omp critical (memory_accounted)
+        memory_accounted_instances(memory_usage_kind).erase(this);
+      }
+
+      std::size_t MemoryAccounted::get_global_memory_usage(MemoryUsageKind kind)
+      {
+        std::size_t size = 0;
+#pragma omp critical (memory_accounted)
+        for(std::set<const MemoryAccounted*>::const_iterator it = memory_accounted_instances(kind).begin(); it != memory_accounted_instances(kind).end(); it++)
+          size += (*it)->get_total_memory_usage();
+        return size;
+      }
+
+      unsigned int MemoryAccounted::get_global_instance_count(MemoryUsageKind kind)
+      {
+        unsigned int count;
+#pragma omp critical (memory_accounted)
+        count = memory_accounted_instances(kind).size();
+        return count;
+      }
+
+      const char* MemoryAccounted::get_kind_name(MemoryUsageKind kind)
+      {
+        switch(kind)
+        {
+        case H2D_MEMORY_MESH:
+          return "Mesh";
+        case H2D_MEMORY_SPACE:
+          return "Space";
+        case H2D_MEMORY_SOLUTION:
+          return "Solution";
+        case H2D_MEMORY_PRECALC_SHAPESET:
+          return "PrecalcShapeset";
+        case H2D_MEMORY_REFMAP:
+          return "RefMap";
+        case H2D_MEMORY_DISCRETE_PROBLEM:
+          return "DiscreteProblem";
+        default:
+          return "";
+        }
+      }
+
+      void MemoryAccounted::report_global_memory_usage(std::ostream& out)
+      {
+        char line[256];
+        sprintf(line, "%-20s %10s %16s", "Object", "Instances", "Bytes");
+        out << line << std::endl;
+        std::size_t total = 0;
+        for(int kind = 0; kind < H2D_NUM_MEMORY_USAGE_KINDS; kind++)
+        {
+          std::size_t size = get_global_memory_usage((MemoryUsageKind)kind);
+          total += size;
+          sprintf(line, "%-20s %10u %16lu", get_kind_name((MemoryUsageKind)kind), get_global_instance_count((MemoryUsageKind)kind), (unsigned long)size);
+          out << line << std::endl;
+        }
+        sprintf(line, "%-20s %10s %16lu", "Total", "", (unsigned long)total);
+        out << line << std::endl;
+      }
+
+      Parallel::Parallel() : num_threads(0)
+      {
+      }
+
+      void Parallel::set_num_threads(int num_threads)
+      {
+        if(num_threads < 0)
+          throw Hermes::Exceptions::ValueException("num_threads", num_threads, 0);
+        this->num_threads = num_threads;
+      }
+
+      int Parallel::get_num_threads() const
+      {
+        if(this->num_threads > 0)
+          return this->num_threads;
+        return Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+      }
+
+      void Parallel::set_thread_affinity(const std::vector<int>& cores)
+      {
+        for(unsigned int i = 0; i < cores.size(); i++)
+          if(cores[i] < 0)
+            throw Hermes::Exceptions::ValueException("cores", cores[i], 0);
+        this->affinity_cores = cores;
+      }
+
+      const std::vector<int>& Parallel::get_thread_affinity() const
+      {
+        return this->affinity_cores;
+      }
+
+      void Parallel::apply_thread_affinity() const
+      {
+        if(this->affinity_cores.empty())
+          return;
+        int core = this->affinity_cores[omp_get_thread_num() % this->affinity_cores.size()];
+#ifdef WIN32
+        if(core < (int)(8 * sizeof(DWORD_PTR)))
+          SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core);
+#elif defined(__linux__)
+        if(core < CPU_SETSIZE)
+        {
+          cpu_set_t cpu_set;
+          CPU_ZERO(&cpu_set);
+          CPU_SET(core, &cpu_set);
+          pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set);
+        }
+#endif
+      }
+
       template<typename Scalar>
       MatrixRhsOutput<Scalar>::MatrixRhsOutput() : output_matrixOn(false), output_matrixIterations(-1), matrixFilename("Matrix_"),
         matrixVarname("A"), matrixFormat(Hermes::Algebra::DF_MATLAB_SPARSE), matrix_number_format("%lf"), output_rhsOn(false), output_rhsIterations(-1),
@@ -112,6 +256,49 @@ namespace Hermes
         this->rhs_number_format = number_format;
       }
 
+      /// Size of the stdio buffer of the matrix and rhs dumps.
+      static const int MATRIX_RHS_OUTPUT_BUFFER_SIZE = 1 << 20;
+
+      /// Opens the output file of the dump, the binary format in the binary mode, with a large buffer (the formatted dumps
+      /// write each entry by one fprintf()), the buffer is deleted by the caller after fclose().
+      static FILE* open_matrix_rhs_output_file(std::string filename, int iteration, EMatrixDumpFormat format, char*& buffer)
+      {
+        std::stringstream name;
+        name << filename << iteration;
+        if(format == Hermes::Algebra::DF_MATLAB_SPARSE)
+          name << ".m";
+        FILE* file = fopen(name.str().c_str(), format == Hermes::Algebra::DF_HERMES_BIN ? "wb" : "w");
+        if(file == NULL)
+          throw Hermes::Exceptions::Exception("Could not open %s for writing.", name.str().c_str());
+        buffer = new char[MATRIX_RHS_OUTPUT_BUFFER_SIZE];
+        setvbuf(file, buffer, _IOFBF, MATRIX_RHS_OUTPUT_BUFFER_SIZE);
+        return file;
+      }
+
+      template<typename Scalar>
+      void MatrixRhsOutput<Scalar>::process_matrix_output(SparseMatrix<Scalar>* matrix, int iteration)
+      {
+        if(!this->output_matrixOn || (this->output_matrixIterations != -1 && this->output_matrixIterations < iteration))
+          return;
+        char* buffer;
+        FILE* matrix_file = open_matrix_rhs_output_file(this->matrixFilename, iteration, this->matrixFormat, buffer);
+        matrix->dump(matrix_file, this->matrixVarname.c_str(), this->matrixFormat, this->matrix_number_format);
+        fclose(matrix_file);
+        delete [] buffer;
+      }
+
+      template<typename Scalar>
+      void MatrixRhsOutput<Scalar>::process_vector_output(Vector<Scalar>* rhs, int iteration)
+      {
+        if(!this->output_rhsOn || (this->output_rhsIterations != -1 && this->output_rhsIterations < iteration))
+          return;
+        char* buffer;
+        FILE* rhs_file = open_matrix_rhs_output_file(this->RhsFilename, iteration, this->RhsFormat, buffer);
+        rhs->dump(rhs_file, this->RhsVarname.c_str(), this->RhsFormat, this->rhs_number_format);
+        fclose(rhs_file);
+        delete [] buffer;
+      }
+
       template HERMES_API class SettableSpaces<double>;
       template HERMES_API class SettableSpaces<std::complex<double> >;
       template HERMES_API class MatrixRhsOutput<double>;
@@ -160,6 +160,13 @@ namespace Hermes
       //std::cout << std::endl << "central element: " << central_el->id << std::endl;
       if(central_el->en[active_edge]->bnd == 0)
       {
+        NeighborTableEntry entry;
+        if(mesh->get_neighbor_table_entry(central_el->id, active_edge, entry))
+        {
+          load_neighbor_table_entry(entry);
+          return;
+        }
+
         neighb_el = central_el->get_neighbor(active_edge);
 
         // First case : The neighboring element is of the same size as the central one.
@@ -233,12 +240,80 @@ namespace Hermes
             //debug_log("number of neighbors on the way down: %d ", n_neighbors);
           }
         }
+
+        if(mesh->is_neighbor_table_enabled())
+          store_neighbor_table_entry();
       }
       else
         if(!ignore_errors)
           throw Hermes::Exceptions::Exception("The given edge isn't inner");
     }
 
+    template<typename Scalar>
+    void NeighborSearch<Scalar>::load_neighbor_table_entry(const NeighborTableEntry& entry)
+    {
+      neighborhood_type = (NeighborhoodType)entry.neighborhood_type;
+      n_neighbors = entry.local_edges.size();
+      for(unsigned int i = 0; i < n_neighbors; i++)
+      {
+        neighbors.push_back(mesh->get_element_fast(entry.element_ids[i + 1]));
+
+        NeighborEdgeInfo local_edge_info;
+        local_edge_info.local_num_of_edge = entry.local_edges[i];
+        local_edge_info.orientation = entry.orientations[i];
+        neighbor_edges.push_back(local_edge_info);
+
+        if(!entry.central_transformations[i].empty())
+        {
+          if(!central_transformations.present(i))
+            central_transformations.add(new Transformations, i);
+          Transformations* tr = central_transformations.get(i);
+          tr->num_levels = entry.central_transformations[i].size();
+          for(unsigned int j = 0; j < tr->num_levels; j++)
+            tr->transf[j] = entry.central_transformations[i][j];
+        }
+        if(!entry.neighbor_transformations[i].empty())
+        {
+          if(!neighbor_transformations.present(i))
+            neighbor_transformations.add(new Transformations, i);
+          Transformations* tr = neighbor_transformations.get(i);
+          tr->num_levels = entry.neighbor_transformations[i].size();
+          for(unsigned int j = 0; j < tr->num_levels; j++)
+            tr->transf[j] = entry.neighbor_transformations[i][j];
+        }
+      }
+
+      // As left by the search.
+      if(n_neighbors > 0)
+      {
+        neighb_el = neighbors[n_neighbors - 1];
+        neighbor_edge.local_num_of_edge = neighbor_edges[n_neighbors - 1].local_num_of_edge;
+      }
+    }
+
+    template<typename Scalar>
+    void NeighborSearch<Scalar>::store_neighbor_table_entry() const
+    {
+      NeighborTableEntry entry;
+      entry.neighborhood_type = neighborhood_type;
+      entry.element_ids.push_back(central_el->id);
+      entry.element_stamps.push_back(mesh->get_element_stamp(central_el->id));
+      entry.central_transformations.resize(n_neighbors);
+      entry.neighbor_transformations.resize(n_neighbors);
+      for(unsigned int i = 0; i < n_neighbors; i++)
+      {
+        entry.element_ids.push_back(neighbors[i]->id);
+        entry.element_stamps.push_back(mesh->get_element_stamp(neighbors[i]->id));
+        entry.local_edges.push_back(neighbor_edges[i].local_num_of_edge);
+        entry.orientations.push_back(neighbor_edges[i].orientation);
+        if(central_transformations.present(i))
+          entry.central_transformations[i].assign(central_transformations.get(i)->transf, central_transformations.get(i)->transf + central_transformations.get(i)->num_levels);
+        if(neighbor_transformations.present(i))
+          entry.neighbor_transformations[i].assign(neighbor_transformations.get(i)->transf, neighbor_transformations.get(i)->transf + neighbor_transformations.get(i)->num_levels);
+      }
+      mesh->set_neighbor_table_entry(central_el->id, active_edge, entry);
+    }
+
     template<typename Scalar>
     bool NeighborSearch<Scalar>::set_active_edge_multimesh(const int& edge)
     {
@@ -277,8 +352,8 @@ namespace Hermes
       Hermes::vector<unsigned int> transformations_backwards;
       while (sub_idx > 0)
       {
-        transformations_backwards.push_back((sub_idx - 1) & 7);
-        sub_idx = (sub_idx - 1) >> 3;
+        transformations_backwards.push_back(Transformable::get_last_son(sub_idx));
+        sub_idx = Transformable::get_parent_idx(sub_idx);
       }
       Hermes::vector<unsigned int> transformations;
       for(unsigned int i = 0; i < transformations_backwards.size(); i++)
@@ -831,6 +906,12 @@ namespace Hermes
       return new_supp_shapes;
     }
 
+    template<typename Scalar>
+    typename NeighborSearch<Scalar>::ExtendedShapeset* NeighborSearch<Scalar>::create_extended_asmlist(const Space<Scalar>*space, AsmList<Scalar>* al, const AsmList<Scalar>* neighbor_al)
+    {
+      return new ExtendedShapeset(al, neighbor_al);
+    }
+
     template<typename Scalar>
     typename NeighborSearch<Scalar>::ExtendedShapeset* NeighborSearch<Scalar>::create_extended_asmlist_multicomponent(const Space<Scalar> *space, AsmList<Scalar>* al)
     {
@@ -968,6 +1049,14 @@ namespace Hermes
       combine_assembly_lists();
     }
 
+    template<typename Scalar>
+    NeighborSearch<Scalar>::ExtendedShapeset::ExtendedShapeset(AsmList<Scalar>* central_al, const AsmList<Scalar>* neighbor_al) :
+    central_al(central_al)
+    {
+      this->neighbor_al = new AsmList<Scalar>(*neighbor_al);
+      combine_assembly_lists();
+    }
+
     template<typename Scalar>
     void NeighborSearch<Scalar>::ExtendedShapeset::combine_assembly_lists()
     {
@@ -76,6 +76,25 @@ namespace Hermes
       this->initial_auto_damping_ratio = 1.0;
       this->sufficient_improvement_factor = 0.95;
       this->necessary_successful_steps_to_increase = 1;
+      this->jacobian_reuse = false;
+      this->max_jacobian_reuse_contraction_rate = 0.5;
+      this->jacobian_factorized = false;
+      this->num_saved_factorizations = 0;
+      this->inexact_newton = false;
+      this->forcing_term_choice = 2;
+      this->max_forcing_term = 0.9;
+      this->max_jacobian_lag = 0;
+      this->jacobian_stagnation_ratio = 0.9;
+      this->lagged_iterations = 0;
+      this->broyden_updates = false;
+      this->pipelined_analysis = false;
+      this->broyden_residual = NULL;
+      this->broyden_step = NULL;
+      this->broyden_vec = NULL;
+      this->broyden_ndof = 0;
+      this->precond_order_reduction = 0;
+      this->precond_dp = NULL;
+      this->precond_matrix = NULL;
     }
 
     template<typename Scalar>
@@ -88,6 +107,121 @@ namespace Hermes
     void NewtonSolver<Scalar>::set_weak_formulation(const WeakForm<Scalar>* wf)
     {
       (static_cast<DiscreteProblem<Scalar>*>(this->dp))->set_weak_formulation(wf);
+      if(this->precond_dp != NULL)
+        this->precond_dp->set_weak_formulation(wf);
+      this->jacobian_factorized = false;
+    }
+
+    template<typename Scalar>
+    void NewtonSolver<Scalar>::set_jacobian_reuse(bool onOff, double max_contraction_rate)
+    {
+      if(max_contraction_rate <= 0.0 || max_contraction_rate > 1.0)
+        throw Exceptions::ValueException("max_contraction_rate", max_contraction_rate, 0.0, 1.0);
+      this->jacobian_reuse = onOff;
+      this->max_jacobian_reuse_contraction_rate = max_contraction_rate;
+      this->jacobian_factorized = false;
+    }
+
+    template<typename Scalar>
+    void NewtonSolver<Scalar>::set_pipelined_analysis(bool onOff)
+    {
+      this->pipelined_analysis = onOff;
+    }
+
+    template<typename Scalar>
+    unsigned int NewtonSolver<Scalar>::get_num_saved_factorizations() const
+    {
+      return this->num_saved_factorizations;
+    }
+
+    template<typename Scalar>
+    void NewtonSolver<Scalar>::set_jacobian_lagging(unsigned int max_lag, double stagnation_ratio)
+    {
+      if(stagnation_ratio <= 0.0 || stagnation_ratio > 1.0)
+        throw Exceptions::ValueException("stagnation_ratio", stagnation_ratio, 0.0, 1.0);
+      this->max_jacobian_lag = max_lag;
+      this->jacobian_stagnation_ratio = stagnation_ratio;
+      this->lagged_iterations = 0;
+      this->jacobian_factorized = false;
+    }
+
+    template<typename Scalar>
+    void NewtonSolver<Scalar>::set_broyden_updates(bool onOff)
+    {
+      this->broyden_updates = onOff;
+    }
+
+    template<typename Scalar>
+    void NewtonSolver<Scalar>::apply_broyden_updates(Scalar* vec, int ndof)
+    {
+      for (unsigned int update_i = 0; update_i < this->broyden_steps.size(); update_i++)
+      {
+        Scalar product = 0.0;
+        for (int i = 0; i < ndof; i++)
+          product += this->broyden_steps[update_i][i] * vec[i];
+        for (int i = 0; i < ndof; i++)
+          vec[i] += product * this->broyden_directions[update_i][i];
+      }
+    }
+
+    template<typename Scalar>
+    void NewtonSolver<Scalar>::add_broyden_update(Scalar* y, int ndof)
+    {
+      // B_k^{-1} y.
+      residual->zero();
+      residual->add_vector(y);
+      if(!linear_solver->solve())
+        throw Exceptions::LinearMatrixSolverException();
+      Scalar* direction = new Scalar[ndof];
+      memcpy(direction, linear_solver->get_sln_vector(), ndof * sizeof(Scalar));
+      this->apply_broyden_updates(direction, ndof);
+
+      Scalar denominator = 0.0;
+      for (int i = 0; i < ndof; i++)
+        denominator += this->broyden_step[i] * direction[i];
+      double step_norm = 0.0;
+      for (int i = 0; i < ndof; i++)
+        step_norm += std::pow(std::abs(this->broyden_step[i]), 2.0);
+
+      // The update is skipped if it would be (nearly) singular.
+      if(std::abs(denominator) <= 1e-12 * step_norm)
+      {
+        delete [] direction;
+        return;
+      }
+
+      Scalar* step = new Scalar[ndof];
+      memcpy(step, this->broyden_step, ndof * sizeof(Scalar));
+      for (int i = 0; i < ndof; i++)
+        direction[i] = (step[i] - direction[i]) / denominator;
+      this->broyden_steps.push_back(step);
+      this->broyden_directions.push_back(direction);
+    }
+
+    template<typename Scalar>
+    void NewtonSolver<Scalar>::free_broyden_updates()
+    {
+      for (unsigned int update_i = 0; update_i < this->broyden_steps.size(); update_i++)
+      {
+        delete [] this->broyden_steps[update_i];
+        delete [] this->broyden_directions[update_i];
+      }
+      this->broyden_steps.clear();
+      this->broyden_directions.clear();
+    }
+
+    template<typename Scalar>
+    void NewtonSolver<Scalar>::set_inexact_newton(bool onOff, int choice, double max_forcing_term)
+    {
+      if(choice != 1 && choice != 2)
+        throw Exceptions::ValueException("choice", choice, 1, 2);
+      if(max_forcing_term <= 0.0 || max_forcing_term >= 1.0)
+        throw Exceptions::ValueException("max_forcing_term", max_forcing_term, 0.0, 1.0);
+      if(onOff && dynamic_cast<Hermes::Solvers::IterSolver<Scalar>*>(linear_solver) == NULL)
+        this->warn("The linear solver is not iterative, the inexact Newton's method has no effect.");
+      this->inexact_newton = onOff;
+      this->forcing_term_choice = choice;
+      this->max_forcing_term = max_forcing_term;
     }
 
     template<typename Scalar>
@@ -141,18 +275,24 @@ namespace Hermes
     void NewtonSolver<Scalar>::set_spaces(Hermes::vector<const Space<Scalar>*> spaces)
     {
       static_cast<DiscreteProblem<Scalar>*>(this->dp)->set_spaces(spaces);
+      if(this->precond_dp != NULL)
+        this->precond_dp->set_spaces(spaces);
       if(kept_jacobian != NULL)
         delete kept_jacobian;
       kept_jacobian = NULL;
+      this->jacobian_factorized = false;
     }
 
     template<typename Scalar>
     void NewtonSolver<Scalar>::set_space(const Space<Scalar>* space)
     {
       static_cast<DiscreteProblem<Scalar>*>(this->dp)->set_space(space);
+      if(this->precond_dp != NULL)
+        this->precond_dp->set_space(space);
       if(kept_jacobian != NULL)
         delete kept_jacobian;
       kept_jacobian = NULL;
+      this->jacobian_factorized = false;
     }
     
     template<typename Scalar>
@@ -178,6 +318,18 @@ namespace Hermes
       delete jacobian;
       delete residual;
       delete linear_solver;
+      if(this->precond_dp != NULL)
+      {
+        delete this->precond_dp;
+        delete this->precond_matrix;
+      }
+      this->free_broyden_updates();
+      if(this->broyden_residual != NULL)
+      {
+        delete [] this->broyden_residual;
+        delete [] this->broyden_step;
+        delete [] this->broyden_vec;
+      }
       if(own_dp)
         delete this->dp;
       else
@@ -260,6 +412,7 @@ namespace Hermes
     template<typename Scalar>
     void NewtonSolver<Scalar>::solve(Scalar* coeff_vec)
     {
+      Hermes::ProfilerRegion profiler_region("NewtonSolver::solve");
       this->check();
 
       this->tick();
@@ -292,27 +445,58 @@ namespace Hermes
       double last_residual_norm;
       int it = 1;
       int successfulSteps = 0;
+      unsigned int saved_factorizations = 0;
+
+      // The inexact Newton's method: the forcing term, the l2-norms of the last residual and of the last linear model
+      // ||F_{k-1} + J_{k-1} s_{k-1}||, and the vectors for the latter.
+      Hermes::Solvers::IterSolver<Scalar>* linear_iter_solver = dynamic_cast<Hermes::Solvers::IterSolver<Scalar>*>(linear_solver);
+      Hermes::Solvers::IterSolver<Scalar>* iter_solver = this->inexact_newton ? linear_iter_solver : NULL;
+      double forcing_term = this->max_forcing_term;
+      double last_l2_residual_norm = 0.0;
+      double linear_model_norm = 0.0;
+      Scalar* linear_model_rhs = NULL;
+      Scalar* linear_model_product = NULL;
+      if(iter_solver != NULL && this->forcing_term_choice == 1)
+      {
+        linear_model_rhs = new Scalar[ndof];
+        linear_model_product = new Scalar[ndof];
+      }
+
+      // Broyden's updates (only of the lagged jacobian), the updates from the previous calls are not used.
+      bool broyden = this->broyden_updates && this->max_jacobian_lag > 0;
+      bool broyden_step_valid = false;
+      this->free_broyden_updates();
+      if(broyden && this->broyden_ndof != ndof)
+      {
+        if(this->broyden_residual != NULL)
+        {
+          delete [] this->broyden_residual;
+          delete [] this->broyden_step;
+          delete [] this->broyden_vec;
+        }
+        this->broyden_residual = new Scalar[ndof];
+        this->broyden_step = new Scalar[ndof];
+        this->broyden_vec = new Scalar[ndof];
+        this->broyden_ndof = ndof;
+      }
 
       this->on_initialization();
 
+      // Per-iteration records, timed by iteration_timer.
+      this->clear_iteration_records();
+      Hermes::Mixins::TimeMeasurable iteration_timer;
+
       while (true)
       {
         this->on_step_begin();
+        this->add_iteration_record(it);
+        iteration_timer.tick(Hermes::Mixins::TimeMeasurable::HERMES_SKIP);
 
         // Assemble just the residual vector.
-        this->dp->assemble(coeff_vec, residual);
-        if(this->output_rhsOn && (this->output_rhsIterations == -1 || this->output_rhsIterations >= it))
-        {
-          char* fileName = new char[this->RhsFilename.length() + 5];
-          if(this->RhsFormat == Hermes::Algebra::DF_MATLAB_SPARSE)
-            sprintf(fileName, "%s%i.m", this->RhsFilename.c_str(), it);
-          else
-            sprintf(fileName, "%s%i", this->RhsFilename.c_str(), it);
-          FILE* rhs_file = fopen(fileName, "w+");
-          residual->dump(rhs_file, this->RhsVarname.c_str(), this->RhsFormat, this->rhs_number_format);
-          fclose(rhs_file);
-          delete [] fileName;
-        }
+        static_cast<DiscreteProblem<Scalar>*>(this->dp)->assemble_residual(coeff_vec, residual);
+        iteration_timer.tick();
+        this->last_iteration_record().assembly_time = iteration_timer.last();
+        this->process_vector_output(residual, it);
         
         Element* e;
         for(unsigned int i = 0; i < static_cast<DiscreteProblem<Scalar>*>(this->dp)->get_spaces().size(); i++)
@@ -334,7 +518,11 @@ namespace Hermes
           Solution<Scalar>::vector_to_solutions(residual, static_cast<DiscreteProblem<Scalar>*>(this->dp)->get_spaces(), solutions, dir_lift_false);
 
           // Calculate the norm.
+          if(it > 1)
+            last_residual_norm = residual_norm;
           residual_norm = Global<Scalar>::calc_norms(solutions);
+          if(it == 1)
+            last_residual_norm = residual_norm;
 
           // Clean up.
           for (unsigned int i = 0; i < static_cast<DiscreteProblem<Scalar>*>(this->dp)->get_spaces().size(); i++)
@@ -381,6 +569,8 @@ namespace Hermes
                 }
 
                 delete [] coeff_vec_back;
+                delete [] linear_model_rhs;
+                delete [] linear_model_product;
 
                 throw Exceptions::Exception("Newton NOT converged because of damping coefficient could not be decreased anymore to possibly handle non-converging process.");
               }
@@ -393,6 +583,9 @@ namespace Hermes
           }
         }
 
+        this->last_iteration_record().residual_norm = residual_norm;
+        this->last_iteration_record().damping_coefficient = this->currentDampingCofficient;
+
         // If maximum allowed residual norm is exceeded, fail.
         if(residual_norm > max_allowed_residual_norm)
         {
@@ -407,6 +600,8 @@ namespace Hermes
           }
 
           delete [] coeff_vec_back;
+          delete [] linear_model_rhs;
+          delete [] linear_model_product;
           
           throw Exceptions::ValueException("residual norm", residual_norm, max_allowed_residual_norm);
         }
@@ -427,53 +622,161 @@ namespace Hermes
           }
 
           delete [] coeff_vec_back;
+          delete [] linear_model_rhs;
+          delete [] linear_model_product;
 
           this->on_finish();
 
           this->tick();
+          if(this->jacobian_reuse || this->max_jacobian_lag > 0)
+            this->info("\tNewton: jacobian reused in %d iterations, %d factorizations saved in total.", saved_factorizations, this->num_saved_factorizations);
           this->info("\tNewton: solution duration: %f s.\n", this->last());
 
           return;
         }
 
-        // Assemble just the jacobian.
-        this->dp->assemble(coeff_vec, jacobian);
-        if(this->output_matrixOn && (this->output_matrixIterations == -1 || this->output_matrixIterations >= it))
+        // A rejected step is retried along the same direction with the decreased damping coefficient,
+        // only the residual (of the next iteration) is needed for that, not the jacobian and the linear system.
+        bool step_rejected = !(residual_norm < last_residual_norm * this->sufficient_improvement_factor || this->manual_damping || it == 1);
+        if(step_rejected)
         {
-          char* fileName = new char[this->matrixFilename.length() + 5];
-          if(this->matrixFormat == Hermes::Algebra::DF_MATLAB_SPARSE)
-            sprintf(fileName, "%s%i.m", this->matrixFilename.c_str(), it);
-          else
-            sprintf(fileName, "%s%i", this->matrixFilename.c_str(), it);
-          FILE* matrix_file = fopen(fileName, "w+");
+          this->on_step_end();
 
-          jacobian->dump(matrix_file, this->matrixVarname.c_str(), this->matrixFormat, this->matrix_number_format);
-          fclose(matrix_file);
-          delete [] fileName;
+          for (int i = 0; i < ndof; i++)
+            coeff_vec[i] = coeff_vec_back[i] + currentDampingCofficient * (coeff_vec[i] - coeff_vec_back[i]);
+          broyden_step_valid = false;
         }
+        else
+        {
+          // The forcing term of the inexact Newton's method, S. C. Eisenstat, H. F. Walker:
+          // Choosing the forcing terms in an inexact Newton method, SIAM J. Sci. Comput. 17 (1996).
+          if(iter_solver != NULL)
+          {
+            double l2_residual_norm = residual_as_function ? Global<Scalar>::get_l2_norm(residual) : residual_norm;
+            if(it > 1 && last_l2_residual_norm > 0.0)
+            {
+              double safeguard;
+              if(this->forcing_term_choice == 1)
+              {
+                safeguard = std::pow(forcing_term, (1.0 + std::sqrt(5.0)) / 2.0);
+                forcing_term = std::abs(l2_residual_norm - linear_model_norm) / last_l2_residual_norm;
+              }
+              else
+              {
+                safeguard = 0.9 * forcing_term * forcing_term;
+                forcing_term = 0.9 * std::pow(l2_residual_norm / last_l2_residual_norm, 2.0);
+              }
+              if(safeguard > 0.1)
+                forcing_term = std::max(forcing_term, safeguard);
+              // Do not oversolve the last iterations.
+              forcing_term = std::min(this->max_forcing_term, std::max(forcing_term, 0.5 * newton_tol / residual_norm));
+            }
+            last_l2_residual_norm = l2_residual_norm;
+            iter_solver->set_tolerance(forcing_term);
+            this->info("\tNewton: linear solver tolerance (forcing term): %g.", forcing_term);
+          }
 
-        this->on_step_end();
+          // The jacobian (and its factorization) from the previous iteration is reused if the residual norm contracted enough,
+          // the lagged one until it is max_jacobian_lag iterations old or the iterations stagnate.
+          bool reuse_jacobian = false;
+          if(this->jacobian_factorized && (int)jacobian->get_size() == ndof)
+          {
+            if(this->jacobian_reuse)
+              reuse_jacobian = (it == 1) || (residual_norm < this->max_jacobian_reuse_contraction_rate * last_residual_norm);
+            if(this->max_jacobian_lag > 0 && this->lagged_iterations < this->max_jacobian_lag)
+              reuse_jacobian = reuse_jacobian || (it == 1) || (residual_norm <= this->jacobian_stagnation_ratio * last_residual_norm);
+          }
 
-        // Multiply the residual vector with -1 since the matrix
-        // equation reads J(Y^n) \deltaY^{n + 1} = -F(Y^n).
-        residual->change_sign();
+          if(reuse_jacobian)
+          {
+            linear_solver->set_factorization_scheme(HERMES_REUSE_FACTORIZATION_COMPLETELY);
+            saved_factorizations++;
+            this->num_saved_factorizations++;
+            this->lagged_iterations++;
+          }
+          else
+          {
+            // Assemble just the jacobian.
+            iteration_timer.tick(Hermes::Mixins::TimeMeasurable::HERMES_SKIP);
+            static_cast<DiscreteProblem<Scalar>*>(this->dp)->set_structure_analysis(this->pipelined_analysis ? linear_solver : NULL);
+            this->dp->assemble(coeff_vec, jacobian);
+            static_cast<DiscreteProblem<Scalar>*>(this->dp)->set_structure_analysis(NULL);
+            this->assemble_precond_matrix(coeff_vec);
+            iteration_timer.tick();
+            this->last_iteration_record().assembly_time += iteration_timer.last();
+            this->process_matrix_output(jacobian, it);
+
+            if(this->jacobian_reuse || this->max_jacobian_lag > 0)
+            {
+              linear_solver->set_factorization_scheme(HERMES_FACTORIZE_FROM_SCRATCH);
+              this->jacobian_factorized = true;
+            }
+            this->lagged_iterations = 0;
+            this->free_broyden_updates();
+          }
 
-        // Solve the linear system.
-        if(!linear_solver->solve())
-          throw Exceptions::LinearMatrixSolverException();
+          // The Broyden's update by the last step and the difference of the residuals F_k - F_{k-1}.
+          if(broyden)
+          {
+            residual->extract(this->broyden_vec);
+            if(reuse_jacobian && broyden_step_valid)
+            {
+              for (int i = 0; i < ndof; i++)
+                this->broyden_residual[i] = this->broyden_vec[i] - this->broyden_residual[i];
+              this->add_broyden_update(this->broyden_residual, ndof);
+              residual->zero();
+              residual->add_vector(this->broyden_vec);
+            }
+            memcpy(this->broyden_residual, this->broyden_vec, ndof * sizeof(Scalar));
+          }
 
-        // Add \deltaY^{n + 1} to Y^n.
-        // The good case.
-        if(residual_norm < last_residual_norm * this->sufficient_improvement_factor || this->manual_damping || it == 1)
-        {
+          this->on_step_end();
+
+          // Multiply the residual vector with -1 since the matrix
+          // equation reads J(Y^n) \deltaY^{n + 1} = -F(Y^n).
+          residual->change_sign();
+
+          // Solve the linear system.
+          iteration_timer.tick(Hermes::Mixins::TimeMeasurable::HERMES_SKIP);
+          if(!linear_solver->solve())
+            throw Exceptions::LinearMatrixSolverException();
+          iteration_timer.tick();
+          this->last_iteration_record().solve_time = iteration_timer.last();
+          this->last_iteration_record().factorization_reused = reuse_jacobian;
+          if(linear_iter_solver != NULL)
+            this->last_iteration_record().linear_iterations = linear_iter_solver->get_num_iters();
+
+          // The norm of the linear model F + J s (the residual holds -F) for the next forcing term.
+          if(linear_model_rhs != NULL)
+          {
+            residual->extract(linear_model_rhs);
+            jacobian->multiply_with_vector(linear_solver->get_sln_vector(), linear_model_product);
+            linear_model_norm = 0.0;
+            for (int i = 0; i < ndof; i++)
+              linear_model_norm += std::pow(std::abs(linear_model_product[i] - linear_model_rhs[i]), 2.0);
+            linear_model_norm = std::sqrt(linear_model_norm);
+          }
+
+          // The quasi-Newton's step with the Broyden's updates.
+          Scalar* step = linear_solver->get_sln_vector();
+          if(broyden)
+          {
+            memcpy(this->broyden_vec, step, ndof * sizeof(Scalar));
+            this->apply_broyden_updates(this->broyden_vec, ndof);
+            step = this->broyden_vec;
+          }
+
+          // Add \deltaY^{n + 1} to Y^n.
           memcpy(coeff_vec_back, coeff_vec, sizeof(Scalar)*ndof);
           for (int i = 0; i < ndof; i++)
-            coeff_vec[i] += currentDampingCofficient * linear_solver->get_sln_vector()[i];
-        }
-        else
-        {
-          for (int i = 0; i < ndof; i++)
-            coeff_vec[i] = coeff_vec_back[i] + currentDampingCofficient * (coeff_vec[i] - coeff_vec_back[i]);
+            coeff_vec[i] += currentDampingCofficient * step[i];
+
+          if(broyden)
+          {
+            for (int i = 0; i < ndof; i++)
+              this->broyden_step[i] = currentDampingCofficient * step[i];
+            broyden_step_valid = true;
+          }
         }
 
         // Increase the number of iterations and test if we are still under the limit.
@@ -491,9 +794,13 @@ namespace Hermes
           }
 
           delete [] coeff_vec_back;
+          delete [] linear_model_rhs;
+          delete [] linear_model_product;
           coeff_vec_back = NULL;
 
           this->tick();
+          if(this->jacobian_reuse || this->max_jacobian_lag > 0)
+            this->info("\tNewton: jacobian reused in %d iterations, %d factorizations saved in total.", saved_factorizations, this->num_saved_factorizations);
           this->info("\tNewton: solution duration: %f s.\n", this->last());
 
           this->on_finish();
@@ -552,23 +859,23 @@ namespace Hermes
 
       this->on_initialization();
 
+      // Per-iteration records, timed by iteration_timer.
+      this->clear_iteration_records();
+      Hermes::Mixins::TimeMeasurable iteration_timer;
+      // The factorization of the kept jacobian from the previous calls is reused.
+      bool kept_jacobian_factorized = kept_jacobian != NULL && (static_cast<DiscreteProblem<Scalar>*>(this->dp))->have_matrix;
+
       while (true)
       {
         this->on_step_begin();
+        this->add_iteration_record(it);
+        iteration_timer.tick(Hermes::Mixins::TimeMeasurable::HERMES_SKIP);
 
         // Assemble the residual vector.
-        this->dp->assemble(coeff_vec, residual);
-        if(this->output_rhsOn && (this->output_rhsIterations == -1 || this->output_rhsIterations >= it))
-        {
-          char* fileName = new char[this->RhsFilename.length() + 5];
-          if(this->RhsFormat == Hermes::Algebra::DF_MATLAB_SPARSE)
-            sprintf(fileName, "%s%i.m", this->RhsFilename.c_str(), it);
-          else
-            sprintf(fileName, "%s%i", this->RhsFilename.c_str(), it);
-          FILE* rhs_file = fopen(fileName, "w+");
-          residual->dump(rhs_file, this->RhsVarname.c_str(), this->RhsFormat, this->rhs_number_format);
-          fclose(rhs_file);
-        }
+        static_cast<DiscreteProblem<Scalar>*>(this->dp)->assemble_residual(coeff_vec, residual);
+        iteration_timer.tick();
+        this->last_iteration_record().assembly_time = iteration_timer.last();
+        this->process_vector_output(residual, it);
 
         Element* e;
         for(unsigned int i = 0; i < static_cast<DiscreteProblem<Scalar>*>(this->dp)->get_spaces().size(); i++)
@@ -649,6 +956,9 @@ namespace Hermes
           }
         }
 
+        this->last_iteration_record().residual_norm = residual_norm;
+        this->last_iteration_record().damping_coefficient = this->currentDampingCofficient;
+
         // If maximum allowed residual norm is exceeded, fail.
         if(residual_norm > max_allowed_residual_norm)
         {
@@ -708,49 +1018,54 @@ namespace Hermes
           delete linear_solver;
           // Create new matrix solver with correct matrix.
           linear_solver = create_linear_solver<Scalar>(kept_jacobian, residual);
+          this->jacobian_factorized = false;
 
+          iteration_timer.tick(Hermes::Mixins::TimeMeasurable::HERMES_SKIP);
+          static_cast<DiscreteProblem<Scalar>*>(this->dp)->set_structure_analysis(this->pipelined_analysis ? linear_solver : NULL);
           this->dp->assemble(coeff_vec, kept_jacobian);
+          static_cast<DiscreteProblem<Scalar>*>(this->dp)->set_structure_analysis(NULL);
+          this->assemble_precond_matrix(coeff_vec);
+          iteration_timer.tick();
+          this->last_iteration_record().assembly_time += iteration_timer.last();
+          kept_jacobian_factorized = false;
 
-          if(this->output_matrixOn && (this->output_matrixIterations == -1 || this->output_matrixIterations >= it))
-          {
-            char* fileName = new char[this->matrixFilename.length() + 5];
-            if(this->matrixFormat == Hermes::Algebra::DF_MATLAB_SPARSE)
-              sprintf(fileName, "%s%i.m", this->matrixFilename.c_str(), it);
-            else
-              sprintf(fileName, "%s%i", this->matrixFilename.c_str(), it);
-            FILE* matrix_file = fopen(fileName, "w+");
-
-            kept_jacobian->dump(matrix_file, this->matrixVarname.c_str(), this->matrixFormat, this->matrix_number_format);
-            fclose(matrix_file);
-          }
+          this->process_matrix_output(kept_jacobian, it);
 
           linear_solver->set_factorization_scheme(HERMES_REUSE_FACTORIZATION_COMPLETELY);
         }
 
         this->on_step_end();
 
-        // Multiply the residual vector with -1 since the matrix
-        // equation reads J(Y^n) \deltaY^{n + 1} = -F(Y^n).
-        residual->change_sign();
-
-        // Solve the linear system.
-        if(!linear_solver->solve()) 
-        {
-          throw Exceptions::LinearMatrixSolverException();
-        }
-
-         // Add \deltaY^{n + 1} to Y^n.
-        // The good case.
-        if(residual_norm < last_residual_norm * this->sufficient_improvement_factor || this->manual_damping || it == 1)
+        // A rejected step is retried along the same direction with the decreased damping coefficient (without the linear system).
+        if(!(residual_norm < last_residual_norm * this->sufficient_improvement_factor || this->manual_damping || it == 1))
         {
-          memcpy(coeff_vec_back, coeff_vec, sizeof(Scalar)*ndof);
           for (int i = 0; i < ndof; i++)
-            coeff_vec[i] += currentDampingCofficient * linear_solver->get_sln_vector()[i];
+            coeff_vec[i] = coeff_vec_back[i] + currentDampingCofficient * (coeff_vec[i] - coeff_vec_back[i]);
         }
         else
         {
+          // Multiply the residual vector with -1 since the matrix
+          // equation reads J(Y^n) \deltaY^{n + 1} = -F(Y^n).
+          residual->change_sign();
+
+          // Solve the linear system.
+          iteration_timer.tick(Hermes::Mixins::TimeMeasurable::HERMES_SKIP);
+          if(!linear_solver->solve()) 
+          {
+            throw Exceptions::LinearMatrixSolverException();
+          }
+          iteration_timer.tick();
+          this->last_iteration_record().solve_time = iteration_timer.last();
+          this->last_iteration_record().factorization_reused = kept_jacobian_factorized;
+          kept_jacobian_factorized = true;
+          Hermes::Solvers::IterSolver<Scalar>* linear_iter_solver = dynamic_cast<Hermes::Solvers::IterSolver<Scalar>*>(linear_solver);
+          if(linear_iter_solver != NULL)
+            this->last_iteration_record().linear_iterations = linear_iter_solver->get_num_iters();
+
+          // Add \deltaY^{n + 1} to Y^n.
+          memcpy(coeff_vec_back, coeff_vec, sizeof(Scalar)*ndof);
           for (int i = 0; i < ndof; i++)
-            coeff_vec[i] = coeff_vec_back[i] + currentDampingCofficient * (coeff_vec[i] - coeff_vec_back[i]);
+            coeff_vec[i] += currentDampingCofficient * linear_solver->get_sln_vector()[i];
         }
 
         // Increase the number of iterations and test if we are still under the limit.
@@ -782,6 +1097,14 @@ namespace Hermes
     void NewtonSolver<Scalar>::set_iterative_method(const char* iterative_method_name)
     {
       NonlinearSolver<Scalar>::set_iterative_method(iterative_method_name);
+      // Set iterative method in case of the built-in iterative solver.
+#ifdef WITH_UMFPACK
+      if(dynamic_cast<Hermes::Solvers::NativeIterSolver<Scalar>*>(linear_solver) != NULL)
+      {
+        dynamic_cast<Hermes::Solvers::NativeIterSolver<Scalar>*>(linear_solver)->set_solver(iterative_method_name);
+        return;
+      }
+#endif
       // Set iterative method in case of iterative solver AztecOO.
 #ifdef HAVE_AZTECOO
       dynamic_cast<Hermes::Solvers::AztecOOSolver<Scalar>*>(linear_solver)->set_solver(iterative_method_name);
@@ -794,6 +1117,14 @@ namespace Hermes
     void NewtonSolver<Scalar>::set_preconditioner(const char* preconditioner_name)
     {
       NonlinearSolver<Scalar>::set_preconditioner(preconditioner_name);
+      // Set preconditioner in case of the built-in iterative solver.
+#ifdef WITH_UMFPACK
+      if(dynamic_cast<Hermes::Solvers::NativeIterSolver<Scalar>*>(linear_solver) != NULL)
+      {
+        dynamic_cast<Hermes::Solvers::NativeIterSolver<Scalar>*>(linear_solver)->set_precond(preconditioner_name);
+        return;
+      }
+#endif
       // Set preconditioner in case of iterative solver AztecOO.
 #ifdef HAVE_AZTECOO
       dynamic_cast<Hermes::Solvers::AztecOOSolver<Scalar> *>(linear_solver)->set_precond(preconditioner_name);
@@ -802,6 +1133,46 @@ namespace Hermes
 #endif
     }
 
+    template<typename Scalar>
+    void NewtonSolver<Scalar>::set_precond_quadrature_order_reduction(int reduction)
+    {
+      if(reduction < 0)
+        throw Exceptions::ValueException("reduction", reduction, 0);
+      this->precond_order_reduction = reduction;
+      if(reduction == 0)
+      {
+        if(this->precond_dp != NULL)
+        {
+          linear_solver->set_precond_matrix(NULL);
+          delete this->precond_dp;
+          delete this->precond_matrix;
+          this->precond_dp = NULL;
+          this->precond_matrix = NULL;
+        }
+      }
+      else if(this->precond_dp != NULL)
+        this->precond_dp->set_quadrature_order_reduction(reduction);
+    }
+
+    template<typename Scalar>
+    void NewtonSolver<Scalar>::assemble_precond_matrix(Scalar* coeff_vec)
+    {
+      if(this->precond_order_reduction == 0)
+        return;
+
+      if(this->precond_dp == NULL)
+      {
+        DiscreteProblem<Scalar>* dp = static_cast<DiscreteProblem<Scalar>*>(this->dp);
+        this->precond_dp = new DiscreteProblem<Scalar>(dp->get_weak_formulation(), dp->get_spaces());
+        this->precond_dp->set_num_threads(dp->get_num_threads());
+        this->precond_dp->set_quadrature_order_reduction(this->precond_order_reduction);
+        this->precond_matrix = create_matrix<Scalar>();
+      }
+
+      this->precond_dp->assemble(coeff_vec, this->precond_matrix);
+      linear_solver->set_precond_matrix(this->precond_matrix);
+    }
+
     template class HERMES_API NewtonSolver<double>;
     template class HERMES_API NewtonSolver<std::complex<double> >;
   }
@@ -0,0 +1,449 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "p_multigrid_precond.h"
+#ifdef WITH_UMFPACK
+#include "api2d.h"
+#include <algorithm>
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// Below this number of the rows, the level operations run sequentially.
+    static const int PMG_PARALLEL_MIN_SIZE = 10000;
+
+    template<typename Scalar>
+    PMultigridPrecond<Scalar>::Level::Level() : order(0), size(0), Ap(NULL), Aj(NULL), Ax(NULL), fine_index(NULL), inv_diag(NULL), lambda_max(1.0),
+      b(NULL), x(NULL), r(NULL), d(NULL), t(NULL)
+    {
+    }
+
+    template<typename Scalar>
+    PMultigridPrecond<Scalar>::Level::~Level()
+    {
+      delete [] Ap;
+      delete [] Aj;
+      delete [] Ax;
+      delete [] fine_index;
+      delete [] inv_diag;
+      delete [] b;
+      delete [] x;
+      delete [] r;
+      delete [] d;
+      delete [] t;
+    }
+
+    template<typename Scalar>
+    PMultigridPrecond<Scalar>::PMultigridPrecond(Hermes::vector<const Space<Scalar>*> spaces) : Hermes::Preconditioners::CSCPrecond<Scalar>(),
+      spaces(spaces), dof_orders(NULL), coarse_solver_type(PMG_COARSE_UMFPACK), order_step(1), sweeps(3),
+      coarse_matrix(NULL), coarse_rhs(NULL), coarse_umfpack(NULL), coarse_factorization_needed(true), coarse_amg(NULL)
+    {
+    }
+
+    template<typename Scalar>
+    PMultigridPrecond<Scalar>::PMultigridPrecond(const Space<Scalar>* space) : Hermes::Preconditioners::CSCPrecond<Scalar>(),
+      dof_orders(NULL), coarse_solver_type(PMG_COARSE_UMFPACK), order_step(1), sweeps(3),
+      coarse_matrix(NULL), coarse_rhs(NULL), coarse_umfpack(NULL), coarse_factorization_needed(true), coarse_amg(NULL)
+    {
+      spaces.push_back(space);
+    }
+
+    template<typename Scalar>
+    PMultigridPrecond<Scalar>::~PMultigridPrecond()
+    {
+      destroy();
+      delete coarse_amg;
+    }
+
+    template<typename Scalar>
+    void PMultigridPrecond<Scalar>::destroy()
+    {
+      for (unsigned int i = 0; i < levels.size(); i++)
+        delete levels[i];
+      levels.clear();
+      if(dof_orders != NULL)
+      {
+        delete [] dof_orders;
+        dof_orders = NULL;
+      }
+      if(coarse_umfpack != NULL)
+      {
+        delete coarse_umfpack;
+        coarse_umfpack = NULL;
+      }
+      if(coarse_matrix != NULL)
+      {
+        delete coarse_matrix;
+        coarse_matrix = NULL;
+      }
+      if(coarse_rhs != NULL)
+      {
+        delete coarse_rhs;
+        coarse_rhs = NULL;
+      }
+    }
+
+    template<typename Scalar>
+    void PMultigridPrecond<Scalar>::set_coarse_solver(CoarseSolverType coarse_solver_type)
+    {
+      this->coarse_solver_type = coarse_solver_type;
+    }
+
+    template<typename Scalar>
+    void PMultigridPrecond<Scalar>::set_order_step(int order_step)
+    {
+      if(order_step < 1)
+        throw Exceptions::ValueException("order_step", order_step, 1);
+      this->order_step = order_step;
+    }
+
+    template<typename Scalar>
+    void PMultigridPrecond<Scalar>::set_smoother_sweeps(int sweeps)
+    {
+      if(sweeps < 1)
+        throw Exceptions::ValueException("sweeps", sweeps, 1);
+      this->sweeps = sweeps;
+    }
+
+    template<typename Scalar>
+    int PMultigridPrecond<Scalar>::get_num_levels() const
+    {
+      return levels.size();
+    }
+
+    template<typename Scalar>
+    void PMultigridPrecond<Scalar>::calculate_dof_orders(int ndof)
+    {
+      dof_orders = new int[ndof > 0 ? ndof : 1];
+      for (int i = 0; i < ndof; i++)
+        dof_orders[i] = -1;
+
+      // A DOF shared by several elements (or constrained at a hanging node) gets the lowest degree of its shape functions,
+      // i.e. vertex functions stay vertex functions.
+      AsmList<Scalar> al;
+      for (unsigned int space_i = 0; space_i < spaces.size(); space_i++)
+      {
+        Shapeset* shapeset = spaces[space_i]->get_shapeset();
+        Element* e;
+        for_all_active_elements(e, spaces[space_i]->get_mesh())
+        {
+          spaces[space_i]->get_element_assembly_list(e, &al);
+          int* al_dof = al.get_dof();
+          int* al_idx = al.get_idx();
+          for (unsigned int i = 0; i < al.get_cnt(); i++)
+          {
+            int dof = al_dof[i];
+            if(dof < 0 || dof >= ndof)
+              continue;
+            int order = shapeset->get_order(al_idx[i], e->get_mode());
+            order = std::max(H2D_GET_H_ORDER(order), H2D_GET_V_ORDER(order));
+            if(dof_orders[dof] == -1 || order < dof_orders[dof])
+              dof_orders[dof] = order;
+          }
+        }
+      }
+
+      for (int i = 0; i < ndof; i++)
+        if(dof_orders[i] < 1)
+          dof_orders[i] = 1;
+    }
+
+    template<typename Scalar>
+    typename PMultigridPrecond<Scalar>::Level* PMultigridPrecond<Scalar>::create_coarser_level(Level* finer, int order)
+    {
+      Level* level = new Level();
+      level->order = order;
+
+      // The DOFs of the degree <= order, numbered as in the finer level.
+      int* coarse_index = new int[finer->size > 0 ? finer->size : 1];
+      int* finer_dofs = new int[finer->size > 0 ? finer->size : 1];
+      if(finer->fine_index == NULL)
+        for (int i = 0; i < finer->size; i++)
+          finer_dofs[i] = i;
+      else
+      {
+        // The DOF numbers of the finer level, through the finer levels up to the finest one.
+        for (int i = 0; i < finer->size; i++)
+          finer_dofs[i] = finer->fine_index[i];
+        for (int level_i = levels.size() - 2; level_i >= 0 && levels[level_i]->fine_index != NULL; level_i--)
+          for (int i = 0; i < finer->size; i++)
+            finer_dofs[i] = levels[level_i]->fine_index[finer_dofs[i]];
+      }
+      for (int i = 0; i < finer->size; i++)
+        coarse_index[i] = (dof_orders[finer_dofs[i]] <= order) ? level->size++ : -1;
+      delete [] finer_dofs;
+
+      level->fine_index = new int[level->size > 0 ? level->size : 1];
+      for (int i = 0; i < finer->size; i++)
+        if(coarse_index[i] != -1)
+          level->fine_index[coarse_index[i]] = i;
+
+      // The submatrix, the columns stay sorted.
+      level->Ap = new int[level->size + 1];
+      level->Ap[0] = 0;
+      for (int i = 0; i < level->size; i++)
+      {
+        int fine_row = level->fine_index[i];
+        int count = 0;
+        for (int k = finer->Ap[fine_row]; k < finer->Ap[fine_row + 1]; k++)
+          if(coarse_index[finer->Aj[k]] != -1)
+            count++;
+        level->Ap[i + 1] = level->Ap[i] + count;
+      }
+      level->Aj = new int[level->Ap[level->size] > 0 ? level->Ap[level->size] : 1];
+      level->Ax = new Scalar[level->Ap[level->size] > 0 ? level->Ap[level->size] : 1];
+      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(level->size > PMG_PARALLEL_MIN_SIZE)
+      for (int i = 0; i < level->size; i++)
+      {
+        int fine_row = level->fine_index[i];
+        int position = level->Ap[i];
+        for (int k = finer->Ap[fine_row]; k < finer->Ap[fine_row + 1]; k++)
+          if(coarse_index[finer->Aj[k]] != -1)
+          {
+            level->Aj[position] = coarse_index[finer->Aj[k]];
+            level->Ax[position++] = finer->Ax[k];
+          }
+      }
+      delete [] coarse_index;
+      return level;
+    }
+
+    template<typename Scalar>
+    void PMultigridPrecond<Scalar>::setup_smoother(Level* level)
+    {
+      level->inv_diag = new Scalar[level->size > 0 ? level->size : 1];
+      double lambda_max = 0.0;
+      for (int i = 0; i < level->size; i++)
+      {
+        Scalar diagonal = 0.0;
+        double row_sum = 0.0;
+        for (int k = level->Ap[i]; k < level->Ap[i + 1]; k++)
+        {
+          if(level->Aj[k] == i)
+            diagonal = level->Ax[k];
+          row_sum += std::abs(level->Ax[k]);
+        }
+        if(diagonal == 0.0)
+          throw Hermes::Exceptions::Exception("PMultigridPrecond: zero diagonal entry in the row %d of the level p = %d.", i, level->order);
+        level->inv_diag[i] = 1.0 / diagonal;
+        lambda_max = std::max(lambda_max, row_sum / std::abs(diagonal));
+      }
+      level->lambda_max = lambda_max > 0.0 ? lambda_max : 1.0;
+    }
+
+    template<typename Scalar>
+    void PMultigridPrecond<Scalar>::smooth(Level* level)
+    {
+      // The Chebyshev iteration for D^{-1} A on [lambda_max / 30, lambda_max], as in AMGPrecond.
+      int n = level->size;
+      double upper = level->lambda_max;
+      double lower = upper / 30.0;
+      double center = (upper + lower) / 2.0;
+      double half_width = (upper - lower) / 2.0;
+      double sigma = center / half_width;
+      double rho = 1.0 / sigma;
+      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PMG_PARALLEL_MIN_SIZE)
+      for (int i = 0; i < n; i++)
+      {
+        Scalar value = level->b[i];
+        for (int k = level->Ap[i]; k < level->Ap[i + 1]; k++)
+          value -= level->Ax[k] * level->x[level->Aj[k]];
+        level->r[i] = value;
+        level->d[i] = level->inv_diag[i] * value / center;
+      }
+
+      for (int sweep = 0; sweep < sweeps; sweep++)
+      {
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PMG_PARALLEL_MIN_SIZE)
+        for (int i = 0; i < n; i++)
+          level->x[i] += level->d[i];
+        if(sweep == sweeps - 1)
+          break;
+
+        double rho_new = 1.0 / (2.0 * sigma - rho);
+        double d_factor = rho_new * rho;
+        double r_factor = 2.0 * rho_new / half_width;
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PMG_PARALLEL_MIN_SIZE)
+        for (int i = 0; i < n; i++)
+        {
+          Scalar value = 0.0;
+          for (int k = level->Ap[i]; k < level->Ap[i + 1]; k++)
+            value += level->Ax[k] * level->d[level->Aj[k]];
+          level->t[i] = value;
+        }
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PMG_PARALLEL_MIN_SIZE)
+        for (int i = 0; i < n; i++)
+        {
+          level->r[i] -= level->t[i];
+          level->d[i] = d_factor * level->d[i] + r_factor * level->inv_diag[i] * level->r[i];
+        }
+        rho = rho_new;
+      }
+    }
+
+    template<typename Scalar>
+    void PMultigridPrecond<Scalar>::setup_coarse_solver(Level* level)
+    {
+      // The column-wise copy of the coarse matrix.
+      int nnz = level->Ap[level->size];
+      int* Cp = new int[level->size + 1];
+      int* Ci = new int[nnz > 0 ? nnz : 1];
+      Scalar* Cx = new Scalar[nnz > 0 ? nnz : 1];
+      memset(Cp, 0, (level->size + 1) * sizeof(int));
+      for (int k = 0; k < nnz; k++)
+        Cp[level->Aj[k] + 1]++;
+      for (int i = 0; i < level->size; i++)
+        Cp[i + 1] += Cp[i];
+      int* position = new int[level->size > 0 ? level->size : 1];
+      memcpy(position, Cp, level->size * sizeof(int));
+      for (int i = 0; i < level->size; i++)
+        for (int k = level->Ap[i]; k < level->Ap[i + 1]; k++)
+        {
+          Ci[position[level->Aj[k]]] = i;
+          Cx[position[level->Aj[k]]++] = level->Ax[k];
+        }
+      delete [] position;
+
+      coarse_matrix = new UMFPackMatrix<Scalar>();
+      coarse_matrix->create(level->size, nnz, Cp, Ci, Cx);
+      delete [] Cp;
+      delete [] Ci;
+      delete [] Cx;
+
+      if(coarse_solver_type == PMG_COARSE_AMG)
+      {
+        if(coarse_amg == NULL)
+          coarse_amg = new Hermes::Preconditioners::AMGPrecond<Scalar>();
+        coarse_amg->create(coarse_matrix);
+        coarse_amg->compute();
+      }
+      else
+      {
+        coarse_rhs = new UMFPackVector<Scalar>(level->size);
+        coarse_umfpack = new Hermes::Solvers::UMFPackLinearMatrixSolver<Scalar>(coarse_matrix, coarse_rhs);
+        coarse_umfpack->set_verbose_output(false);
+        coarse_factorization_needed = true;
+      }
+    }
+
+    template<typename Scalar>
+    void PMultigridPrecond<Scalar>::solve_coarse(Level* level)
+    {
+      if(coarse_solver_type == PMG_COARSE_AMG)
+      {
+        coarse_amg->apply(level->b, level->x);
+        return;
+      }
+
+      // The factorization is done in the first coarse solve after compute() and reused in the following ones.
+      ((Hermes::Solvers::LinearMatrixSolver<Scalar>*)coarse_umfpack)->set_factorization_scheme(coarse_factorization_needed ? Hermes::Solvers::HERMES_FACTORIZE_FROM_SCRATCH : Hermes::Solvers::HERMES_REUSE_FACTORIZATION_COMPLETELY);
+      if(!coarse_umfpack->solve(1, level->b))
+        throw Hermes::Exceptions::Exception("PMultigridPrecond: the coarse solve failed.");
+      coarse_factorization_needed = false;
+      memcpy(level->x, coarse_umfpack->get_sln_vector(), level->size * sizeof(Scalar));
+    }
+
+    template<typename Scalar>
+    void PMultigridPrecond<Scalar>::compute()
+    {
+      if(this->mat == NULL)
+        throw Hermes::Exceptions::Exception("PMultigridPrecond::compute() called before create().");
+      destroy();
+
+      int ndof = this->mat->get_size();
+      if(ndof != Space<Scalar>::get_num_dofs(spaces))
+        throw Hermes::Exceptions::Exception("PMultigridPrecond: the matrix size %d does not match the number of DOFs of the spaces %d.", ndof, Space<Scalar>::get_num_dofs(spaces));
+      calculate_dof_orders(ndof);
+
+      Level* finest = new Level();
+      finest->size = ndof;
+      for (int i = 0; i < ndof; i++)
+        finest->order = std::max(finest->order, dof_orders[i]);
+      this->get_rows(finest->Ap, finest->Aj, finest->Ax);
+      levels.push_back(finest);
+
+      Level* level = finest;
+      while(level->order > 1)
+      {
+        level = create_coarser_level(level, std::max(1, level->order - order_step));
+        levels.push_back(level);
+      }
+
+      for (unsigned int i = 0; i < levels.size(); i++)
+      {
+        int alloc_size = levels[i]->size > 0 ? levels[i]->size : 1;
+        levels[i]->b = new Scalar[alloc_size];
+        levels[i]->x = new Scalar[alloc_size];
+        levels[i]->r = new Scalar[alloc_size];
+        levels[i]->d = new Scalar[alloc_size];
+        levels[i]->t = new Scalar[alloc_size];
+        if(i + 1 < levels.size())
+          setup_smoother(levels[i]);
+      }
+      setup_coarse_solver(levels.back());
+    }
+
+    template<typename Scalar>
+    void PMultigridPrecond<Scalar>::cycle(unsigned int level_i)
+    {
+      Level* level = levels[level_i];
+      if(level_i == levels.size() - 1)
+      {
+        solve_coarse(level);
+        return;
+      }
+
+      Level* coarse = levels[level_i + 1];
+      std::fill(level->x, level->x + level->size, Scalar(0));
+      smooth(level);
+
+      // The restriction, the residual b - A x at the DOFs of the coarse level.
+      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(coarse->size > PMG_PARALLEL_MIN_SIZE)
+      for (int i = 0; i < coarse->size; i++)
+      {
+        int fine_row = coarse->fine_index[i];
+        Scalar value = level->b[fine_row];
+        for (int k = level->Ap[fine_row]; k < level->Ap[fine_row + 1]; k++)
+          value -= level->Ax[k] * level->x[level->Aj[k]];
+        coarse->b[i] = value;
+      }
+
+      cycle(level_i + 1);
+
+      for (int i = 0; i < coarse->size; i++)
+        level->x[coarse->fine_index[i]] += coarse->x[i];
+      smooth(level);
+    }
+
+    template<typename Scalar>
+    void PMultigridPrecond<Scalar>::apply(Scalar* r, Scalar* z)
+    {
+      if(levels.empty())
+        throw Hermes::Exceptions::Exception("PMultigridPrecond::apply() called before compute().");
+      memcpy(levels[0]->b, r, levels[0]->size * sizeof(Scalar));
+      cycle(0);
+      memcpy(z, levels[0]->x, levels[0]->size * sizeof(Scalar));
+    }
+
+    template class HERMES_API PMultigridPrecond<double>;
+    template class HERMES_API PMultigridPrecond<std::complex<double> >;
+  }
+}
+#endif
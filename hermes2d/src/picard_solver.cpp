@@ -67,6 +67,17 @@ namespace Hermes
       anderson_beta = 1.0;
       anderson_is_on = false;
 
+      anderson_ndof = 0;
+      anderson_size = 0;
+      anderson_vectors = NULL;
+      anderson_num_vectors = 0;
+      anderson_Q = NULL;
+      anderson_R = NULL;
+      anderson_num_columns = 0;
+      anderson_work = NULL;
+      anderson_gamma = NULL;
+      anderson_coeffs = NULL;
+
       matrix = create_matrix<Scalar>();
       rhs = create_vector<Scalar>();
       linear_solver = create_linear_solver<Scalar>(matrix, rhs);
@@ -105,6 +116,7 @@ namespace Hermes
       delete matrix;
       delete rhs;
       delete linear_solver;
+      free_anderson();
       if(own_dp)
         delete this->dp;
       else
@@ -135,76 +147,259 @@ namespace Hermes
       this->verbose_output_linear_solver = to_set;
     }
 
+    // Vector kernels of the Anderson acceleration.
+    template<typename Scalar>
+    static Scalar anderson_dot(int n, const Scalar* x, const Scalar* y)
+    {
+      Scalar result = 0.0;
+      for (int i = 0; i < n; i++)
+        result += conj(x[i]) * y[i];
+      return result;
+    }
+
+    template<typename Scalar>
+    static void anderson_axpy(int n, Scalar alpha, Scalar* x, Scalar* y)
+    {
+#ifdef WITH_BLAS
+      Hermes::BLAS::blas_axpy(n, alpha, x, 1, y, 1);
+#else
+      for (int i = 0; i < n; i++)
+        y[i] += alpha * x[i];
+#endif
+    }
+
+    template<typename Scalar>
+    static void anderson_copy(int n, Scalar* x, Scalar* y)
+    {
+#ifdef WITH_BLAS
+      Hermes::BLAS::blas_copy(n, x, 1, y, 1);
+#else
+      memcpy(y, x, n * sizeof(Scalar));
+#endif
+    }
+
+    template<typename Scalar>
+    static void anderson_scal(int n, Scalar alpha, Scalar* x)
+    {
+#ifdef WITH_BLAS
+      Hermes::BLAS::blas_scal(n, alpha, x, 1);
+#else
+      for (int i = 0; i < n; i++)
+        x[i] *= alpha;
+#endif
+    }
+
     template<typename Scalar>
-    void PicardSolver<Scalar>::calculate_anderson_coeffs(Scalar** previous_vectors, Scalar* anderson_coeffs, int num_last_vectors_used, int ndof)
+    void PicardSolver<Scalar>::init_anderson(int ndof)
     {
       if(num_last_vectors_used <= 1) throw Hermes::Exceptions::Exception("Picard: Anderson acceleration makes sense only if at least two last iterations are used.");
 
-      // If num_last_vectors_used is 2, then there is only one residual, and thus only one alpha coeff which is 1.0.
-      if(num_last_vectors_used == 2)
+      if(anderson_ndof != ndof || anderson_size != num_last_vectors_used)
       {
-        anderson_coeffs[0] = 1.0;
+        free_anderson();
+
+        int m = num_last_vectors_used;
+        anderson_vectors = new Scalar*[m];
+        for (int i = 0; i < m; i++)
+          anderson_vectors[i] = new Scalar[ndof];
+        anderson_Q = new Scalar*[m - 2];
+        for (int i = 0; i < m - 2; i++)
+          anderson_Q[i] = new Scalar[ndof];
+        anderson_R = new_matrix<Scalar>(m - 2, m - 2);
+        anderson_work = new Scalar[ndof];
+        anderson_gamma = new Scalar[m - 2];
+        anderson_coeffs = new Scalar[m - 1];
+
+        anderson_ndof = ndof;
+        anderson_size = m;
+      }
+
+      anderson_num_vectors = 0;
+      anderson_num_columns = 0;
+    }
+
+    template<typename Scalar>
+    void PicardSolver<Scalar>::free_anderson()
+    {
+      if(anderson_vectors == NULL)
         return;
+
+      for (int i = 0; i < anderson_size; i++)
+        delete [] anderson_vectors[i];
+      delete [] anderson_vectors;
+      for (int i = 0; i < anderson_size - 2; i++)
+        delete [] anderson_Q[i];
+      delete [] anderson_Q;
+      delete [] anderson_R;
+      delete [] anderson_work;
+      delete [] anderson_gamma;
+      delete [] anderson_coeffs;
+
+      anderson_vectors = NULL;
+      anderson_Q = NULL;
+      anderson_R = NULL;
+      anderson_work = NULL;
+      anderson_gamma = NULL;
+      anderson_coeffs = NULL;
+      anderson_ndof = 0;
+      anderson_size = 0;
+      anderson_num_vectors = 0;
+      anderson_num_columns = 0;
+    }
+
+    template<typename Scalar>
+    bool PicardSolver<Scalar>::anderson_append_column(int ndof)
+    {
+      int k = anderson_num_columns;
+      double original_norm = sqrt(std::abs(anderson_dot(ndof, anderson_work, anderson_work)));
+
+      // Modified Gram-Schmidt against the current columns of Q.
+      for (int i = 0; i < k; i++)
+      {
+        anderson_R[i][k] = anderson_dot(ndof, anderson_Q[i], anderson_work);
+        anderson_axpy(ndof, -anderson_R[i][k], anderson_Q[i], anderson_work);
       }
 
-      // In the following, num_last_vectors_used is at least three.
-      // Thematrix problem will have dimension num_last_vectors_used - 2.
-      int n = num_last_vectors_used - 2;
+      double norm = sqrt(std::abs(anderson_dot(ndof, anderson_work, anderson_work)));
+      if(norm <= 1e-10 * original_norm)
+        return false;
 
-      // Allocate the matrix system for the Anderson coefficients.
-      double** mat = new_matrix<double>(n, n);
-      Scalar* rhs = new Scalar[n];
+      anderson_R[k][k] = norm;
+      anderson_copy(ndof, anderson_work, anderson_Q[k]);
+      anderson_scal(ndof, Scalar(1.0 / norm), anderson_Q[k]);
+      anderson_num_columns++;
+      return true;
+    }
 
-      // Set up the matrix and rhs vector.
-      for (int i = 0; i < n; i++)
+    template<typename Scalar>
+    void PicardSolver<Scalar>::anderson_delete_first_column(int ndof)
+    {
+      int k = anderson_num_columns;
+
+      // Shift the columns of R to the left, which leaves an upper Hessenberg matrix.
+      for (int i = 0; i < k; i++)
+        for (int j = 0; j < k - 1; j++)
+          anderson_R[i][j] = anderson_R[i][j + 1];
+
+      // Restore the triangular form by Givens rotations acting on the rows i, i + 1 of R,
+      // and apply their adjoints to the columns i, i + 1 of Q.
+      for (int i = 0; i < k - 1; i++)
       {
-        // Calculate i-th entry of the rhs vector.
-        rhs[i] = 0;
-        for (int k = 0; k < ndof; k++)
+        Scalar a = anderson_R[i][i];
+        Scalar b = anderson_R[i + 1][i];
+        double abs_a = std::abs(a);
+        double rho = sqrt(abs_a * abs_a + std::abs(b) * std::abs(b));
+        if(rho == 0.0)
+          continue;
+
+        double c;
+        Scalar s;
+        if(abs_a == 0.0)
+        {
+          c = 0.0;
+          s = 1.0;
+        }
+        else
         {
-          Scalar residual_n_k = previous_vectors[n + 1][k] - previous_vectors[n][k];
-          Scalar residual_i_k = previous_vectors[i + 1][k] - previous_vectors[i][k];
-          rhs[i] += residual_n_k * (residual_n_k - residual_i_k);
+          c = abs_a / rho;
+          s = (a / abs_a) * conj(b) / rho;
         }
-        for (int j = 0; j < n; j++)
+
+        for (int j = i; j < k - 1; j++)
         {
-          Scalar val = 0;
-          for (int k = 0; k < ndof; k++)
-          {
-            Scalar residual_n_k = previous_vectors[n + 1][k] - previous_vectors[n][k];
-            Scalar residual_i_k = previous_vectors[i + 1][k] - previous_vectors[i][k];
-            Scalar residual_j_k = previous_vectors[j + 1][k] - previous_vectors[j][k];
-            val += (residual_n_k - residual_i_k) * (residual_n_k - residual_j_k);
-          }
-
-          // FIXME: This is not a nice way to cast Scalar to double. Not mentioning
-          // that this will not work for Scalar = complex.
-          double* ptr = (double*)(&val);
-          mat[i][j] = *ptr;
+          Scalar r_i = anderson_R[i][j];
+          Scalar r_i_next = anderson_R[i + 1][j];
+          anderson_R[i][j] = c * r_i + s * r_i_next;
+          anderson_R[i + 1][j] = -conj(s) * r_i + c * r_i_next;
         }
+        anderson_R[i + 1][i] = 0.0;
+
+        Scalar* q_i = anderson_Q[i];
+        Scalar* q_i_next = anderson_Q[i + 1];
+        for (int l = 0; l < ndof; l++)
+        {
+          Scalar q = q_i[l];
+          q_i[l] = c * q + conj(s) * q_i_next[l];
+          q_i_next[l] = -s * q + c * q_i_next[l];
+        }
+      }
+
+      // The last column of Q now corresponds to the zero last row of R.
+      anderson_num_columns--;
+    }
+
+    template<typename Scalar>
+    void PicardSolver<Scalar>::anderson_step(int ndof)
+    {
+      int m = num_last_vectors_used;
+
+      // If the memory is full, forget the oldest vector, and with it the oldest residual difference.
+      if(anderson_num_vectors == m)
+      {
+        Scalar* oldest_vec = anderson_vectors[0];
+        for (int i = 0; i < m - 1; i++)
+          anderson_vectors[i] = anderson_vectors[i + 1];
+        anderson_vectors[m - 1] = oldest_vec;
+        anderson_num_vectors--;
+        if(anderson_num_columns > 0)
+          anderson_delete_first_column(ndof);
       }
 
-      // Solve the matrix system.
-      double d;
-      int* perm = new int[n];
-      ludcmp(mat, n, perm, &d);
-      lubksb<Scalar>(mat, n, perm, rhs);
+      // Save this->sln_vector[] as the newest one.
+      Scalar* newest_vec = anderson_vectors[anderson_num_vectors];
+      anderson_copy(ndof, this->sln_vector, newest_vec);
+      anderson_num_vectors++;
 
-      // Use the result to define the Anderson coefficients. Remember that
-      // n were computed and the last one is 1.0 minus the sum of the 'n' numbers.
-      Scalar sum = 0;
+      // The newest residual difference r_{k+1} - r_k = x_{k+2} - 2 x_{k+1} + x_k.
+      if(anderson_num_vectors >= 3)
+      {
+        anderson_copy(ndof, newest_vec, anderson_work);
+        anderson_axpy(ndof, Scalar(-2.0), anderson_vectors[anderson_num_vectors - 2], anderson_work);
+        anderson_axpy(ndof, Scalar(1.0), anderson_vectors[anderson_num_vectors - 3], anderson_work);
+        if(!anderson_append_column(ndof))
+        {
+          // The residual differences are (numerically) linearly dependent: start over from the newest vector.
+          anderson_vectors[anderson_num_vectors - 1] = anderson_vectors[0];
+          anderson_vectors[0] = newest_vec;
+          anderson_num_vectors = 1;
+          anderson_num_columns = 0;
+          this->info("\tPicard: Anderson acceleration restarted (linearly dependent residuals).");
+          return;
+        }
+      }
+
+      if(anderson_num_vectors < m)
+        return;
+
+      // Least-squares problem min || r_n - sum_k gamma_k (r_{k+1} - r_k) ||, n = m - 2,
+      // solved as R gamma = Q^H r_n.
+      int n = m - 2;
+      anderson_copy(ndof, anderson_vectors[n + 1], anderson_work);
+      anderson_axpy(ndof, Scalar(-1.0), anderson_vectors[n], anderson_work);
       for (int i = 0; i < n; i++)
+        anderson_gamma[i] = anderson_dot(ndof, anderson_Q[i], anderson_work);
+      for (int i = n - 1; i >= 0; i--)
       {
-        anderson_coeffs[i] = rhs[i];
-        sum += rhs[i];
+        for (int j = i + 1; j < n; j++)
+          anderson_gamma[i] -= anderson_R[i][j] * anderson_gamma[j];
+        anderson_gamma[i] /= anderson_R[i][i];
       }
-      anderson_coeffs[n] = 1.0 - sum;
 
-      // Clean up.
-      delete [] mat;
-      delete [] rhs;
+      // Anderson coefficients alpha_j, j = 0, ..., n, which minimize || sum_j alpha_j r_j || subject to sum_j alpha_j = 1.
+      for (int j = 0; j <= n; j++)
+        anderson_coeffs[j] = (j < n ? anderson_gamma[j] : Scalar(1.0)) - (j > 0 ? anderson_gamma[j - 1] : Scalar(0.0));
 
-      return;
+      // Calculate new vector sum_j alpha_j ((1 - beta) x_j + beta x_{j+1}) and store it in this->sln_vector[].
+      memset(this->sln_vector, 0, ndof * sizeof(Scalar));
+      for (int l = 0; l <= n + 1; l++)
+      {
+        Scalar coeff = 0.0;
+        if(l <= n)
+          coeff += (1.0 - anderson_beta) * anderson_coeffs[l];
+        if(l > 0)
+          coeff += anderson_beta * anderson_coeffs[l - 1];
+        anderson_axpy(ndof, coeff, anderson_vectors[l], this->sln_vector);
+      }
     }
 
     template<typename Scalar>
@@ -298,103 +493,54 @@ namespace Hermes
       for (int i = 0; i < ndof; i++)
         last_iter_vector[i] = this->sln_vector[i];
 
-      // If Anderson is used, allocate memory for vectors and coefficients.
-      Scalar** previous_vectors = NULL;      // To store num_last_vectors_used last coefficient vectors.
-      Scalar* anderson_coeffs = NULL;        // To store num_last_vectors_used - 1 Anderson coefficients.
+      // If Anderson is used, prepare the memory and save the initial coefficient vector in it.
       if (anderson_is_on)
       {
-        previous_vectors = new Scalar*[num_last_vectors_used];
-        for (int i = 0; i < num_last_vectors_used; i++) previous_vectors[i] = new Scalar[ndof];
-        anderson_coeffs = new Scalar[num_last_vectors_used-1];
+        init_anderson(ndof);
+        anderson_step(ndof);
       }
 
-      // If Anderson is used, save the initial coefficient vector in the memory.
-      if (anderson_is_on)
-        for (int i = 0; i < ndof; i++) previous_vectors[0][i] = this->sln_vector[i];
-
       int it = 1;
-      int vec_in_memory = 1;   // There is already one vector in the memory.
 
       this->on_initialization();
 
+      // Per-iteration records, timed by iteration_timer.
+      this->clear_iteration_records();
+      Hermes::Mixins::TimeMeasurable iteration_timer;
+      Hermes::Solvers::IterSolver<Scalar>* iter_solver = dynamic_cast<Hermes::Solvers::IterSolver<Scalar>*>(linear_solver);
+
       while (true)
       {
         this->on_step_begin();
+        this->add_iteration_record(it);
+        iteration_timer.tick(Hermes::Mixins::TimeMeasurable::HERMES_SKIP);
 
         (static_cast<DiscreteProblem<Scalar>*>(this->dp))->is_linear = false;
         this->dp->assemble(last_iter_vector, matrix, rhs);
-        if(this->output_matrixOn && (this->output_matrixIterations == -1 || this->output_matrixIterations >= it))
-        {
-          char* fileName = new char[this->matrixFilename.length() + 5];
-          if(this->matrixFormat == Hermes::Algebra::DF_MATLAB_SPARSE)
-            sprintf(fileName, "%s%i.m", this->matrixFilename.c_str(), it);
-          else
-            sprintf(fileName, "%s%i", this->matrixFilename.c_str(), it);
-          FILE* matrix_file = fopen(fileName, "w+");
-
-          matrix->dump(matrix_file, this->matrixVarname.c_str(), this->matrixFormat, this->matrix_number_format);
-          fclose(matrix_file);
-          delete [] fileName;
-        }
-        if(this->output_rhsOn && (this->output_rhsIterations == -1 || this->output_rhsIterations >= it))
-        {
-          char* fileName = new char[this->RhsFilename.length() + 5];
-          if(this->RhsFormat == Hermes::Algebra::DF_MATLAB_SPARSE)
-            sprintf(fileName, "%s%i.m", this->RhsFilename.c_str(), it);
-          else
-            sprintf(fileName, "%s%i", this->RhsFilename.c_str(), it);
-          FILE* rhs_file = fopen(fileName, "w+");
-          rhs->dump(rhs_file, this->RhsVarname.c_str(), this->RhsFormat, this->rhs_number_format);
-          fclose(rhs_file);
-          delete [] fileName;
-        }
+        iteration_timer.tick();
+        this->last_iteration_record().assembly_time = iteration_timer.last();
+        this->process_matrix_output(matrix, it);
+        this->process_vector_output(rhs, it);
 
         this->on_step_end();
 
         //rhs->change_sign();
 
         // Solve the linear system.
+        iteration_timer.tick(Hermes::Mixins::TimeMeasurable::HERMES_SKIP);
         if(!linear_solver->solve())
           throw Exceptions::LinearMatrixSolverException();
+        iteration_timer.tick();
+        this->last_iteration_record().solve_time = iteration_timer.last();
+        if(iter_solver != NULL)
+          this->last_iteration_record().linear_iterations = iter_solver->get_num_iters();
 
         memcpy(this->sln_vector, linear_solver->get_sln_vector(), sizeof(Scalar)*ndof);
 
-        // If Anderson is used, store the new vector in the memory.
+        // If Anderson is used, store the new vector in the memory and, if there is enough vectors
+        // in the memory, replace it by the accelerated one.
         if (anderson_is_on)
-        {
-          // If memory not full, just add the vector.
-          if (vec_in_memory < num_last_vectors_used)
-          {
-            for (int i = 0; i < ndof; i++) previous_vectors[vec_in_memory][i] = this->sln_vector[i];
-            vec_in_memory++;
-          }
-          else
-          {
-            // If memory full, shift all vectors back, forgetting the oldest one.
-            // Save this->sln_vector[] as the newest one.
-            Scalar* oldest_vec = previous_vectors[0];
-            for (int i = 0; i < num_last_vectors_used-1; i++) previous_vectors[i] = previous_vectors[i + 1];
-            previous_vectors[num_last_vectors_used-1] = oldest_vec;
-            for (int j = 0; j < ndof; j++) previous_vectors[num_last_vectors_used-1][j] = this->sln_vector[j];
-          }
-        }
-
-        // If there is enough vectors in the memory, calculate Anderson coeffs.
-        if (anderson_is_on && vec_in_memory >= num_last_vectors_used)
-        {
-          // Calculate Anderson coefficients.
-          calculate_anderson_coeffs(previous_vectors, anderson_coeffs, num_last_vectors_used, ndof);
-
-          // Calculate new vector and store it in this->sln_vector[].
-          for (int i = 0; i < ndof; i++)
-          {
-            this->sln_vector[i] = 0;
-            for (int j = 1; j < num_last_vectors_used; j++)
-            {
-              this->sln_vector[i] += anderson_coeffs[j-1] * previous_vectors[j][i] - (1.0 - anderson_beta) * anderson_coeffs[j-1] * (previous_vectors[j][i] - previous_vectors[j-1][i]);
-            }
-          }
-        }
+          anderson_step(ndof);
 
         // Calculate relative error between last_iter_vector[] and this->sln_vector[].
         // FIXME: this is wrong in the complex case (complex conjugation must be used).
@@ -410,6 +556,7 @@ namespace Hermes
         abs_error = sqrt(abs_error);
 
         double rel_error = abs_error / last_iter_vec_norm;
+        this->last_iteration_record().residual_norm = rel_error;
 
         // Output for the user.
         if(std::abs(last_iter_vec_norm) < 1e-12)
@@ -421,13 +568,6 @@ namespace Hermes
         if(rel_error < tol)
         {
           delete [] last_iter_vector;
-          // If Anderson acceleration was employed, release memory for the Anderson vectors and coeffs.
-          if (anderson_is_on)
-          {
-            for (int i = 0; i < num_last_vectors_used; i++) delete [] previous_vectors[i];
-            delete [] previous_vectors;
-            delete [] anderson_coeffs;
-          }
           
           static_cast<DiscreteProblem<Scalar>*>(this->dp)->have_matrix = false;
 
@@ -441,13 +581,6 @@ namespace Hermes
         if(it >= max_iter)
         {
           delete [] last_iter_vector;
-          // If Anderson acceleration was employed, release memory for the Anderson vectors and coeffs.
-          if (anderson_is_on)
-          {
-            for (int i = 0; i < num_last_vectors_used; i++) delete [] previous_vectors[i];
-            delete [] previous_vectors;
-            delete [] anderson_coeffs;
-          }
           static_cast<DiscreteProblem<Scalar>*>(this->dp)->have_matrix = false;
 
           this->tick();
@@ -0,0 +1,106 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "precalculated_tables.h"
+#include "matrix.h"
+#include "api2d.h"
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+using namespace Hermes::Algebra::DenseMatrixOperations;
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// Identifies the files, with the version of the format.
+    static const char precalculated_tables_magic[8] = { 'H', '2', 'D', 'P', 'T', 'A', 'B', '1' };
+
+    bool PrecalculatedTables::is_enabled()
+    {
+      return Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::precalculatedTablesCache) != 0;
+    }
+
+    std::string PrecalculatedTables::get_filename(const std::string& name, int order)
+    {
+      std::stringstream ss;
+      ss << Hermes2DApi.get_text_param_value(Hermes::Hermes2D::precalculatedFormsDirPath);
+      std::string dir = ss.str();
+      if(!dir.empty() && dir[dir.length() - 1] != '/' && dir[dir.length() - 1] != '\\')
+        ss << '/';
+      ss << "precalculated_" << name << "_" << order << ".dat";
+      return ss.str();
+    }
+
+    bool PrecalculatedTables::load(const std::string& name, int order, int n, double**& mat, double*& p)
+    {
+      if(n <= 0)
+        return false;
+      FILE* f = fopen(get_filename(name, order).c_str(), "rb");
+      if(f == NULL)
+        return false;
+
+      // The whole table is read at once, into the layout of new_matrix (the row pointers are set up by it).
+      char magic[8];
+      int header[2];
+      bool ok = fread(magic, sizeof(char), 8, f) == 8 && memcmp(magic, precalculated_tables_magic, 8) == 0
+        && fread(header, sizeof(int), 2, f) == 2 && header[0] == n && header[1] == (int)sizeof(double);
+
+      double** loaded_mat = NULL;
+      double* loaded_p = NULL;
+      if(ok)
+      {
+        loaded_mat = new_matrix<double>(n, n);
+        loaded_p = new double[n];
+        ok = fread(loaded_mat[0], sizeof(double), n * n, f) == (std::size_t)(n * n)
+          && fread(loaded_p, sizeof(double), n, f) == (std::size_t)n;
+      }
+      fclose(f);
+
+      if(!ok)
+      {
+        delete [] loaded_mat;
+        delete [] loaded_p;
+        return false;
+      }
+      mat = loaded_mat;
+      p = loaded_p;
+      return true;
+    }
+
+    bool PrecalculatedTables::save(const std::string& name, int order, int n, double** mat, const double* p)
+    {
+      if(n <= 0)
+        return false;
+      std::string filename = get_filename(name, order);
+      FILE* f = fopen(filename.c_str(), "wb");
+      if(f == NULL)
+        return false;
+
+      int header[2] = { n, (int)sizeof(double) };
+      bool ok = fwrite(precalculated_tables_magic, sizeof(char), 8, f) == 8 && fwrite(header, sizeof(int), 2, f) == 2;
+      for(int i = 0; ok && i < n; i++)
+        ok = fwrite(mat[i], sizeof(double), n, f) == (std::size_t)n;
+      if(ok)
+        ok = fwrite(p, sizeof(double), n, f) == (std::size_t)n;
+
+      ok = fclose(f) == 0 && ok;
+      if(!ok)
+        remove(filename.c_str());
+      return ok;
+    }
+  }
+}
@@ -16,6 +16,9 @@
 #include "projections/localprojection.h"
 #include "space.h"
 #include "discrete_problem.h"
+#include "quad_all.h"
+#include "limit_order.h"
+#include "api2d.h"
 
 namespace Hermes
 {
@@ -42,7 +45,7 @@ namespace Hermes
           case HERMES_HCURL_SPACE: proj_norm = HERMES_HCURL_NORM; break;
           case HERMES_HDIV_SPACE: proj_norm = HERMES_HDIV_NORM; break;
           case HERMES_L2_SPACE: proj_norm = HERMES_L2_NORM; break;
-          default: throw Hermes::Exceptions::Exception("Unknown space type in OGProjection<Scalar>::project_global().");
+          default: throw Hermes::Exceptions::Exception("Unknown space type in LocalProjection<Scalar>::project_local().");
         }
       }
 
@@ -52,44 +55,413 @@ namespace Hermes
       // Erase the target vector.
       memset(target_vec, 0, ndof*sizeof(Scalar));
 
-      // Dump into the first part of target_vec the values of active vertex dofs, then add values
-      // of active edge dofs, and finally also values of active bubble dofs.
-      // Start with active vertex dofs.
+      // Vertices first, they are point values.
+      if(space->get_type() == HERMES_H1_SPACE)
+        project_vertices(space, meshfn, target_vec);
+
+      // Edges next. An edge is projected from one of the elements it is a whole edge of. The functions of a constrained
+      // vertex are combinations of the functions of the constraining edge, which belongs to an element of a lower level,
+      // so the edges are processed level by level.
       Mesh* mesh = space->get_mesh();
       Element* e;
-      // Go through all active elements in mesh to collect active vertex DOF.
+      std::map<int, Hermes::vector<Element*> > edge_elements;
+      std::map<int, Hermes::vector<int> > edge_indices;
+      if(space->get_type() != HERMES_L2_SPACE)
+      {
+        std::vector<bool> edge_assigned(mesh->get_max_node_id() + 1, false);
+        for_all_active_elements(e, mesh)
+        {
+          for (unsigned int edge = 0; edge < e->get_nvert(); edge++)
+          {
+            Node* en = e->en[edge];
+            typename Space<Scalar>::NodeData* nd = space->ndata + en->id;
+            if(edge_assigned[en->id] || nd->n <= 0 || nd->dof < 0)
+              continue;
+            edge_assigned[en->id] = true;
+            int level = 0;
+            for(Element* parent = e->parent; parent != NULL; parent = parent->parent)
+              level++;
+            edge_elements[level].push_back(e);
+            edge_indices[level].push_back(edge);
+          }
+        }
+      }
+      for(typename std::map<int, Hermes::vector<Element*> >::iterator it = edge_elements.begin(); it != edge_elements.end(); ++it)
+        project_entities(space, meshfn, proj_norm, it->second, edge_indices[it->first], target_vec);
+
+      // Bubbles last, independent of each other.
+      Hermes::vector<Element*> bubble_elements;
+      Hermes::vector<int> bubble_indices;
       for_all_active_elements(e, mesh)
       {
-        int order = space->get_element_order(e->id);
-        if(order > 0)
+        if(space->edata[e->id].n > 0)
+        {
+          bubble_elements.push_back(e);
+          bubble_indices.push_back(-1);
+        }
+      }
+      project_entities(space, meshfn, proj_norm, bubble_elements, bubble_indices, target_vec);
+    }
+
+    template<typename Scalar>
+    void LocalProjection<Scalar>::project_vertices(const Space<Scalar>* space, MeshFunction<Scalar>* meshfn, Scalar* target_vec)
+    {
+      Mesh* mesh = space->get_mesh();
+      Element* e;
+
+      // Collect the unconstrained vertices with a DOF, each once.
+      std::vector<bool> vertex_assigned(mesh->get_max_node_id() + 1, false);
+      std::vector<double> x, y;
+      std::vector<int> dofs;
+      for_all_active_elements(e, mesh)
+      {
+        if(space->get_element_order(e->id) <= 0)
+          continue;
+        for (unsigned int j = 0; j < e->get_nvert(); j++)
+        {
+          Node* vn = e->vn[j];
+          typename Space<Scalar>::NodeData* nd = space->ndata + vn->id;
+          if(vertex_assigned[vn->id] || vn->is_constrained_vertex() || nd->dof < 0)
+            continue;
+          vertex_assigned[vn->id] = true;
+          x.push_back(vn->x);
+          y.push_back(vn->y);
+          dofs.push_back(nd->dof);
+        }
+      }
+      if(dofs.empty())
+        return;
+
+      // The vertex functions are the only ones not vanishing in the vertices.
+      int n = dofs.size();
+      Scalar* values = new Scalar[n];
+      meshfn->get_pt_values(&x[0], &y[0], n, values, NULL, NULL);
+      for (int i = 0; i < n; i++)
+        target_vec[dofs[i] - space->first_dof] = values[i];
+      delete [] values;
+    }
+
+    template<typename Scalar>
+    void LocalProjection<Scalar>::project_entities(const Space<Scalar>* space, MeshFunction<Scalar>* meshfn, ProjNormType proj_norm,
+      const Hermes::vector<Element*>& elements, const Hermes::vector<int>& edges, Scalar* target_vec)
+    {
+      int num_entities = elements.size();
+      if(num_entities == 0)
+        return;
+
+      // Each thread evaluates its own copy of the source function, the first one the original.
+      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+      if(num_threads_used > num_entities)
+        num_threads_used = num_entities;
+      MeshFunction<Scalar>** thread_meshfns = new MeshFunction<Scalar>*[num_threads_used];
+      int num_clones = 0;
+      try
+      {
+        for (int thread_i = 0; thread_i < num_threads_used; thread_i++, num_clones++)
+          thread_meshfns[thread_i] = (thread_i == 0) ? meshfn : meshfn->clone();
+      }
+      catch(Hermes::Exceptions::Exception&)
+      {
+        num_threads_used = num_clones;
+      }
+
+      PrecalcShapeset master_pss(space->get_shapeset());
+      Hermes::Exceptions::Exception* caughtException = NULL;
+
+      int entity_i;
+#pragma omp parallel private(entity_i) num_threads(num_threads_used)
+      {
+        MeshFunction<Scalar>* current_meshfn = thread_meshfns[omp_get_thread_num()];
+        RefMap refmap;
+        refmap.set_quad_2d(&g_quad_2d_std);
+        PrecalcShapeset pss(&master_pss);
+        AsmList<Scalar> al;
+
+#pragma omp for schedule(dynamic, 16)
+        for(entity_i = 0; entity_i < num_entities; entity_i++)
+        {
+          if(caughtException != NULL)
+            continue;
+
+          try
+          {
+            project_entity(space, current_meshfn, proj_norm, elements[entity_i], edges[entity_i], &refmap, &pss, &al, target_vec);
+          }
+          catch(Hermes::Exceptions::Exception& e)
+          {
+#pragma omp critical (caughtException)
+            if(caughtException == NULL)
+              caughtException = e.clone();
+          }
+          catch(std::exception& e)
+          {
+#pragma omp critical (caughtException)
+            if(caughtException == NULL)
+              caughtException = new Hermes::Exceptions::Exception(e.what());
+          }
+        }
+      }
+
+      for (int thread_i = 1; thread_i < num_threads_used; thread_i++)
+        delete thread_meshfns[thread_i];
+      delete [] thread_meshfns;
+
+      if(caughtException != NULL)
+      {
+        Hermes::Exceptions::Exception exception(*caughtException);
+        delete caughtException;
+        throw exception;
+      }
+    }
+
+    template<typename Scalar>
+    void LocalProjection<Scalar>::project_entity(const Space<Scalar>* space, MeshFunction<Scalar>* meshfn, ProjNormType proj_norm,
+      Element* e, int edge, RefMap* refmap, PrecalcShapeset* pss, AsmList<Scalar>* al, Scalar* target_vec)
+    {
+      // The DOFs of the edge node or of the element interior.
+      int first, count;
+      if(edge >= 0)
+      {
+        typename Space<Scalar>::NodeData* nd = space->ndata + e->en[edge]->id;
+        first = nd->dof;
+        count = nd->n;
+      }
+      else
+      {
+        first = space->edata[e->id].bdof;
+        count = space->edata[e->id].n;
+      }
+      if(first < 0 || count <= 0)
+        return;
+
+      // Split the assembly list into the unknown functions and the already projected ones. On an edge, only
+      // the vertex functions (possibly constrained) do not vanish, the other edges and the bubbles are left out.
+      space->get_element_assembly_list(e, al);
+      int* al_idx = al->get_idx();
+      int* al_dof = al->get_dof();
+      Scalar* al_coef = al->get_coef();
+      SpaceType space_type = space->get_type();
+      Shapeset* shapeset = space->get_shapeset();
+      ElementMode2D mode = e->get_mode();
+      std::vector<int> unknowns, knowns;
+      for (unsigned int k = 0; k < al->get_cnt(); k++)
+      {
+        int offset = al_dof[k] - first;
+        if(al_dof[k] >= 0 && offset >= 0 && offset % space->stride == 0 && offset / space->stride < count)
+          unknowns.push_back(k);
+        else if(edge < 0)
+          knowns.push_back(k);
+        else if(space_type == HERMES_H1_SPACE)
         {
           for (unsigned int j = 0; j < e->get_nvert(); j++)
+            if(al_idx[k] == shapeset->get_vertex_index(j, mode))
+              knowns.push_back(k);
+        }
+      }
+      int n = unknowns.size();
+      if(n == 0)
+        return;
+
+      // Quadrature for the element order, with a reserve for the higher order of the source.
+      refmap->set_active_element(e);
+      pss->set_active_element(e);
+      Quad2D* quad = &g_quad_2d_std;
+      int element_order = space->get_element_order(e->id);
+      int order = refmap->get_inv_ref_order() + 2 * std::max(H2D_GET_H_ORDER(element_order), H2D_GET_V_ORDER(element_order)) + 2;
+      limit_order_nowarn(order, mode);
+
+      Geom<double>* geometry;
+      double* jwt;
+      int np;
+      if(edge >= 0)
+      {
+        order = quad->get_edge_points(edge, order, mode);
+        double3* pt = quad->get_points(order, mode);
+        np = quad->get_num_points(order, mode);
+        double3* tan;
+        geometry = init_geom_surf(refmap, edge, e->en[edge]->marker, order, tan);
+        jwt = new double[np];
+        for (int i = 0; i < np; i++)
+          jwt[i] = pt[i][2] * tan[i][2];
+      }
+      else
+      {
+        double3* pt = quad->get_points(order, mode);
+        np = quad->get_num_points(order, mode);
+        geometry = init_geom_vol(refmap, order);
+        double* jac = NULL;
+        if(!refmap->is_jacobian_const())
+          jac = refmap->get_jacobian(order);
+        jwt = new double[np];
+        for (int i = 0; i < np; i++)
+          jwt[i] = pt[i][2] * (refmap->is_jacobian_const() ? refmap->get_const_jacobian() : jac[i]);
+      }
+
+      // The source function in the points.
+      bool vector_valued = (space_type == HERMES_HCURL_SPACE || space_type == HERMES_HDIV_SPACE);
+      int num_features = get_num_features(space_type, proj_norm, edge >= 0);
+      Scalar* source = new Scalar[6 * np];
+      memset(source, 0, 6 * np * sizeof(Scalar));
+      meshfn->get_pt_values(geometry->x, geometry->y, np, source, source + np, source + 2 * np, 0);
+      if(vector_valued)
+      {
+        meshfn->get_pt_values(geometry->x, geometry->y, np, source + 3 * np, source + 4 * np, source + 5 * np, 1);
+        // curl = dx(v1) - dy(v0), div = dx(v0) + dy(v1), stored in place of dx(v0).
+        for (int i = 0; i < np; i++)
+          source[np + i] = (space_type == HERMES_HCURL_SPACE) ? source[4 * np + i] - source[2 * np + i] : source[np + i] + source[5 * np + i];
+      }
+      Scalar* residual = new Scalar[np * num_features];
+      if(vector_valued)
+        get_features<Scalar>(space_type, proj_norm, edge >= 0, geometry, np, source, source + 3 * np, source + np, NULL, residual);
+      else
+        get_features<Scalar>(space_type, proj_norm, edge >= 0, geometry, np, source, NULL, source + np, source + 2 * np, residual);
+
+      // Subtract the already projected functions.
+      double* features = new double[np * num_features];
+      for (unsigned int i = 0; i < knowns.size(); i++)
+      {
+        int k = knowns[i];
+        Scalar coef = al_coef[k] * (al_dof[k] >= 0 ? target_vec[al_dof[k] - space->first_dof] : (Scalar)1.0);
+        if(coef == (Scalar)0.0)
+          continue;
+        pss->set_active_shape(al_idx[k]);
+        Func<double>* fn = init_fn(pss, refmap, order);
+        if(vector_valued)
+          get_features<double>(space_type, proj_norm, edge >= 0, geometry, np, fn->val0, fn->val1, space_type == HERMES_HCURL_SPACE ? fn->curl : fn->div, NULL, features);
+        else
+          get_features<double>(space_type, proj_norm, edge >= 0, geometry, np, fn->val, NULL, fn->dx, fn->dy, features);
+        for (int j = 0; j < np * num_features; j++)
+          residual[j] -= coef * features[j];
+        fn->free_fn();
+        delete fn;
+      }
+
+      // The local system.
+      double** unknown_features = new_matrix<double>(n, np * num_features);
+      for (int a = 0; a < n; a++)
+      {
+        pss->set_active_shape(al_idx[unknowns[a]]);
+        Func<double>* fn = init_fn(pss, refmap, order);
+        if(vector_valued)
+          get_features<double>(space_type, proj_norm, edge >= 0, geometry, np, fn->val0, fn->val1, space_type == HERMES_HCURL_SPACE ? fn->curl : fn->div, NULL, unknown_features[a]);
+        else
+          get_features<double>(space_type, proj_norm, edge >= 0, geometry, np, fn->val, NULL, fn->dx, fn->dy, unknown_features[a]);
+        fn->free_fn();
+        delete fn;
+      }
+
+      double** matrix = new_matrix<double>(n, n);
+      double* diag = new double[n];
+      Scalar* rhs = new Scalar[n];
+      for (int a = 0; a < n; a++)
+      {
+        rhs[a] = 0.0;
+        for (int i = 0; i < np; i++)
+          for (int f = 0; f < num_features; f++)
+            rhs[a] += jwt[i] * unknown_features[a][i * num_features + f] * residual[i * num_features + f];
+        for (int b = 0; b <= a; b++)
+        {
+          double sum = 0.0;
+          for (int i = 0; i < np; i++)
+            for (int f = 0; f < num_features; f++)
+              sum += jwt[i] * unknown_features[a][i * num_features + f] * unknown_features[b][i * num_features + f];
+          matrix[a][b] = matrix[b][a] = sum;
+        }
+      }
+      choldc(matrix, n, diag);
+      cholsl<Scalar>(matrix, n, diag, rhs, rhs);
+
+      for (int a = 0; a < n; a++)
+        target_vec[al_dof[unknowns[a]] - space->first_dof] = rhs[a] / al_coef[unknowns[a]];
+
+      delete [] rhs;
+      delete [] diag;
+      delete [] matrix;
+      delete [] unknown_features;
+      delete [] features;
+      delete [] residual;
+      delete [] source;
+      delete [] jwt;
+      geometry->free();
+      delete geometry;
+    }
+
+    template<typename Scalar>
+    int LocalProjection<Scalar>::get_num_features(SpaceType space_type, ProjNormType proj_norm, bool edge)
+    {
+      switch (space_type)
+      {
+      case HERMES_H1_SPACE:
+      case HERMES_L2_SPACE:
+        if(edge)
+          return (proj_norm == HERMES_H1_NORM) ? 2 : 1;
+        return (proj_norm == HERMES_H1_NORM) ? 3 : ((proj_norm == HERMES_H1_SEMINORM) ? 2 : 1);
+      case HERMES_HCURL_SPACE:
+      case HERMES_HDIV_SPACE:
+        if(edge)
+          return 1;
+        return (proj_norm == HERMES_HCURL_NORM || proj_norm == HERMES_HDIV_NORM) ? 3 : 2;
+      default:
+        throw Hermes::Exceptions::Exception("Unknown space type in LocalProjection<Scalar>::get_num_features().");
+        return 0;
+      }
+    }
+
+    template<typename Scalar>
+    template<typename T>
+    void LocalProjection<Scalar>::get_features(SpaceType space_type, ProjNormType proj_norm, bool edge, Geom<double>* geometry, int np,
+      T* v0, T* v1, T* d0, T* d1, T* features)
+    {
+      int num_features = get_num_features(space_type, proj_norm, edge);
+      for (int i = 0; i < np; i++)
+      {
+        T* f = features + i * num_features;
+        if(space_type == HERMES_H1_SPACE || space_type == HERMES_L2_SPACE)
+        {
+          if(edge)
           {
-            // FIXME - the same vertex is visited several times since it
-            // belongs to multiple elements!
-            Node* vn = e->vn[j];
-            double x = e->vn[j]->x;
-            double y = e->vn[j]->y;
-            //this->info("Probing vertex %g %g\n", x, y);
-            typename Space<Scalar>::NodeData* nd = space->ndata + vn->id;
-            if(!vn->is_constrained_vertex() && nd->dof >= 0)
+            // The trace and (for H1 norms) its tangential derivative, the seminorm keeps the derivative only.
+            T dt = d0[i] * geometry->tx[i] + d1[i] * geometry->ty[i];
+            if(proj_norm == HERMES_H1_NORM)
             {
-              int dof_num = nd->dof;
-              // FIXME: If this is a Solution, the it would be MUCH faster to just
-              // retrieve the value from the coefficient vector stored in the Solution.
-
-              // FIXME: Retrieving the value through get_pt_value() is slow and this
-              // should be only done if we are dealing with MeshFunction (not a Solution).
-              Scalar val = meshfn->get_pt_value(x, y)->val[0];
-              //printf("Found active vertex %g %g, val = %g, dof_num = %d\n", x, y, std::abs(val), dof_num);
-              target_vec[dof_num] = val;
+              f[0] = v0[i];
+              f[1] = dt;
             }
+            else
+              f[0] = (proj_norm == HERMES_H1_SEMINORM) ? dt : v0[i];
+          }
+          else if(proj_norm == HERMES_H1_NORM)
+          {
+            f[0] = v0[i];
+            f[1] = d0[i];
+            f[2] = d1[i];
+          }
+          else if(proj_norm == HERMES_H1_SEMINORM)
+          {
+            f[0] = d0[i];
+            f[1] = d1[i];
+          }
+          else
+            f[0] = v0[i];
+        }
+        else
+        {
+          if(edge)
+          {
+            // The tangential (Hcurl) or normal (Hdiv) component.
+            if(space_type == HERMES_HCURL_SPACE)
+              f[0] = v0[i] * geometry->tx[i] + v1[i] * geometry->ty[i];
+            else
+              f[0] = v0[i] * geometry->nx[i] + v1[i] * geometry->ny[i];
+          }
+          else
+          {
+            f[0] = v0[i];
+            f[1] = v1[i];
+            if(num_features == 3)
+              f[2] = d0[i];
           }
         }
-
-        // TODO: Calculate coefficients of edge functions and copy into target_vec_space[i] as well
-
-        // TODO: Calculate coefficients of bubble functions and copy into target_vec_space[i] as well.
       }
     }
 
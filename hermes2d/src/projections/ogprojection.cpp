@@ -50,6 +50,126 @@ namespace Hermes
           target_vec[i] = linear_solver.get_sln_vector()[i];
     }
 
+    template<typename Scalar>
+    Hermes::vector<typename OGProjection<Scalar>::CachedProjection*> OGProjection<Scalar>::cache;
+
+    template<typename Scalar>
+    typename OGProjection<Scalar>::CachedProjection* OGProjection<Scalar>::get_cached_projection(const Space<Scalar>* space, ProjNormType norm)
+    {
+      for(unsigned int i = 0; i < cache.size(); i++)
+      {
+        CachedProjection* cached = cache[i];
+        if(cached->space != space || cached->norm != norm)
+          continue;
+
+        cache.erase(cache.begin() + i);
+        if(cached->space_seq == space->get_seq() && cached->first_dof == space->first_dof
+          && cached->ndof == space->get_num_dofs() && cached->bc_values_seq == space->bc_values_seq)
+        {
+          cache.push_back(cached);
+          return cached;
+        }
+
+        // The space changed since.
+        free_cached_projection(cached);
+        break;
+      }
+
+      if(cache.size() >= H2D_OGPROJECTION_CACHE_SIZE)
+      {
+        free_cached_projection(cache.front());
+        cache.erase(cache.begin());
+      }
+
+      CachedProjection* cached = new CachedProjection;
+      cached->space = space;
+      cached->space_seq = space->get_seq();
+      cached->first_dof = space->first_dof;
+      cached->ndof = space->get_num_dofs();
+      cached->bc_values_seq = space->bc_values_seq;
+      cached->norm = norm;
+      cached->matrix = create_matrix<Scalar>();
+      cached->lift = create_vector<Scalar>();
+      cached->rhs = create_vector<Scalar>();
+      cached->matrix_solver = create_linear_solver<Scalar>(cached->matrix, cached->rhs);
+      cached->matrix_solver->set_verbose_output(this->get_verbose_output());
+      cached->factorized = false;
+
+      // Without the vector form the right hand side only receives the Dirichlet lift.
+      WeakForm<Scalar> matrix_wf(1);
+      matrix_wf.warned_nonOverride = true;
+      matrix_wf.add_matrix_form(new ProjectionMatrixFormVol(0, 0, norm));
+
+      try
+      {
+        DiscreteProblemLinear<Scalar> dp(&matrix_wf, space);
+        dp.set_do_not_use_cache();
+        dp.assemble(cached->matrix, cached->lift);
+      }
+      catch(...)
+      {
+        free_cached_projection(cached);
+        throw;
+      }
+
+      cache.push_back(cached);
+      return cached;
+    }
+
+    template<typename Scalar>
+    void OGProjection<Scalar>::project_cached(const Space<Scalar>* space, MeshFunction<Scalar>* source_meshfn, Scalar* target_vec, ProjNormType norm)
+    {
+      // Sanity check.
+      if(space == NULL)
+        throw Hermes::Exceptions::Exception("this->space == NULL in project_cached().");
+
+      CachedProjection* cached = get_cached_projection(space, norm);
+
+      // Only the residual is assembled, into the right hand side of the solver.
+      WeakForm<Scalar> rhs_wf(1);
+      rhs_wf.warned_nonOverride = true;
+      rhs_wf.set_ext(source_meshfn);
+      rhs_wf.add_vector_form(new ProjectionVectorFormVol(0, norm));
+
+      DiscreteProblemLinear<Scalar> dp(&rhs_wf, space);
+      dp.set_do_not_use_cache();
+      dp.assemble((SparseMatrix<Scalar>*)NULL, cached->rhs);
+      cached->rhs->add_vector(cached->lift);
+
+      // The first solve factorizes the matrix, the following ones only back-substitute.
+      if(cached->factorized)
+        cached->matrix_solver->set_factorization_scheme(HERMES_REUSE_FACTORIZATION_COMPLETELY);
+      if(!cached->matrix_solver->solve())
+      {
+        // Let the next projection start over.
+        cache.pop_back();
+        free_cached_projection(cached);
+        throw Exceptions::LinearMatrixSolverException();
+      }
+      cached->factorized = true;
+
+      for (int i = 0; i < cached->ndof; i++)
+        target_vec[i] = cached->matrix_solver->get_sln_vector()[i];
+    }
+
+    template<typename Scalar>
+    void OGProjection<Scalar>::free_cached_projection(CachedProjection* cached)
+    {
+      delete cached->matrix_solver;
+      delete cached->matrix;
+      delete cached->lift;
+      delete cached->rhs;
+      delete cached;
+    }
+
+    template<typename Scalar>
+    void OGProjection<Scalar>::free_cache()
+    {
+      for(unsigned int i = 0; i < cache.size(); i++)
+        free_cached_projection(cache[i]);
+      cache.clear();
+    }
+
     template<typename Scalar>
     void OGProjection<Scalar>::project_global(const Space<Scalar>* space,
         MatrixFormVol<Scalar>* custom_projection_jacobian,
@@ -155,20 +275,8 @@ namespace Hermes
       }
       else norm = proj_norm;
 
-      // Define temporary projection weak form.
-      WeakForm<Scalar>* proj_wf = new WeakForm<Scalar>(1);
-      proj_wf->warned_nonOverride = true;
-      proj_wf->set_ext(source_meshfn);
-      // Add Jacobian.
-      proj_wf->add_matrix_form(new ProjectionMatrixFormVol(0, 0, norm));
-      // Add Residual.
-      proj_wf->add_vector_form(new ProjectionVectorFormVol(0, norm));
-
-      // Call main function.
-      project_internal(space, proj_wf, target_vec);
-
-      // Clean up.
-      delete proj_wf;
+      // The matrix depends on the space and the norm only.
+      project_cached(space, source_meshfn, target_vec, norm);
     }
 
     template<typename Scalar>
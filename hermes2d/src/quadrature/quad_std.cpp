@@ -15,6 +15,7 @@
 
 #include "global.h"
 #include "quad_all.h"
+#include <fstream>
 
 namespace Hermes
 {
@@ -2479,6 +2480,124 @@ namespace Hermes
 
     static int quad_pt_ref = 0;
 
+    /// The built-in triangle rules, kept while loaded rules replace them.
+    static double3* builtin_tables_2d_tri[g_max_tri + 1];
+    static int builtin_np_2d_tri[g_max_tri + 1];
+    static bool triangle_rules_loaded = false;
+
+    /// The integral of x^a y^b over the reference triangle (-1,-1), (1,-1), (-1,1), through the integrals
+    /// of the monomials over the unit triangle (i! j! / (i + j + 2)!).
+    /// \param[out] magnitude The sum of the absolute values of the terms (the scale of the rounding errors).
+    static double reference_triangle_monomial_integral(int a, int b, double& magnitude)
+    {
+      double result = 0.0;
+      magnitude = 0.0;
+      double binom_a = 1.0;
+      for (int i = 0; i <= a; i++)
+      {
+        double binom_b = 1.0;
+        for (int j = 0; j <= b; j++)
+        {
+          // i! j! / (i + j + 2)!
+          double unit_integral = 1.0;
+          for (int k = 1; k <= j; k++)
+            unit_integral *= k / (double)(i + k);
+          unit_integral /= (i + j + 1) * (double)(i + j + 2);
+          double term = 4.0 * binom_a * std::pow(2.0, i) * binom_b * std::pow(2.0, j) * unit_integral;
+          if((a - i + b - j) % 2)
+            term = -term;
+          result += term;
+          magnitude += std::abs(term);
+          binom_b = binom_b * (b - j) / (j + 1);
+        }
+        binom_a = binom_a * (a - i) / (i + 1);
+      }
+      return result;
+    }
+
+    void Quad2DStd::load_triangle_rules(const char* filename, int min_order)
+    {
+      std::ifstream in(filename);
+      if(!in.is_open())
+        throw Hermes::Exceptions::Exception("Could not open the triangle quadrature rules file %s.", filename);
+
+      if(!triangle_rules_loaded)
+      {
+        for (int order = 0; order <= g_max_tri; order++)
+        {
+          builtin_tables_2d_tri[order] = std_tables_2d_tri[order];
+          builtin_np_2d_tri[order] = std_np_2d_tri[order];
+        }
+      }
+
+      int order, num_points;
+      while(in >> order >> num_points)
+      {
+        if(order < 0 || order > g_max_tri || num_points <= 0)
+          throw Hermes::Exceptions::Exception("Wrong rule (order %i, %i points) in the triangle quadrature rules file %s.", order, num_points, filename);
+
+        double3* rule = new double3[num_points];
+        for (int i = 0; i < num_points; i++)
+          if(!(in >> rule[i][0] >> rule[i][1] >> rule[i][2]))
+          {
+            delete [] rule;
+            throw Hermes::Exceptions::Exception("Incomplete rule of order %i in the triangle quadrature rules file %s.", order, filename);
+          }
+        if(order < min_order)
+        {
+          delete [] rule;
+          continue;
+        }
+
+        for (int i = 0; i < num_points; i++)
+          if(rule[i][0] < -1.0 - 1e-12 || rule[i][1] < -1.0 - 1e-12 || rule[i][0] + rule[i][1] > 1e-12)
+          {
+            delete [] rule;
+            throw Hermes::Exceptions::Exception("The rule of order %i in the triangle quadrature rules file %s has points outside of the triangle.", order, filename);
+          }
+
+        for (int a = 0; a <= order; a++)
+          for (int b = 0; a + b <= order; b++)
+          {
+            double magnitude;
+            double exact = reference_triangle_monomial_integral(a, b, magnitude);
+            double sum = 0.0;
+            for (int i = 0; i < num_points; i++)
+              sum += rule[i][2] * std::pow(rule[i][0], a) * std::pow(rule[i][1], b);
+            if(std::abs(sum - exact) > 1e-10 * std::max(magnitude, 1.0))
+            {
+              delete [] rule;
+              throw Hermes::Exceptions::Exception("The rule of order %i in the triangle quadrature rules file %s does not integrate x^%i y^%i exactly.", order, filename, a, b);
+            }
+          }
+
+        if(std_tables_2d_tri[order] != builtin_tables_2d_tri[order])
+          delete [] std_tables_2d_tri[order];
+        std_tables_2d_tri[order] = rule;
+        std_np_2d_tri[order] = num_points;
+        triangle_rules_loaded = true;
+
+        // The built-in rule of the highest order has points outside.
+        if(order == g_max_tri)
+          safe_max_order[0] = g_max_tri;
+      }
+    }
+
+    void Quad2DStd::reset_triangle_rules()
+    {
+      if(!triangle_rules_loaded)
+        return;
+      for (int order = 0; order <= g_max_tri; order++)
+      {
+        if(std_tables_2d_tri[order] != builtin_tables_2d_tri[order])
+          delete [] std_tables_2d_tri[order];
+        std_tables_2d_tri[order] = builtin_tables_2d_tri[order];
+        std_np_2d_tri[order] = builtin_np_2d_tri[order];
+      }
+      triangle_rules_loaded = false;
+      safe_max_order[0] = g_max_tri - 1;
+    }
+
     Quad2DStd::Quad2DStd()
     {
       ref_vert[0][0][0] = -1.0;
@@ -2538,6 +2657,7 @@ namespace Hermes
       int i;
       if(!--quad_pt_ref)
       {
+        reset_triangle_rules();
         for (i = 0; i <= 3 * max_order[0] + 2; i++)
           delete [] std_tables_2d_tri[max_order[0] + 1 + i];
 
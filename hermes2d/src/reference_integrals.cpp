@@ -0,0 +1,230 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "reference_integrals.h"
+#include "quadrature/limit_order.h"
+#include "quadrature/quad_all.h"
+#include "api2d.h"
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    /// Identifies the files, with the version of the format.
+    static const char reference_integrals_magic[8] = { 'H', '2', 'D', 'R', 'I', 'N', 'T', '1' };
+
+    ReferenceIntegrals::ReferenceIntegrals(Shapeset* shapeset_i, Shapeset* shapeset_j, ElementMode2D mode, int order_i, int order_j)
+      : id_i(shapeset_i->get_id()), id_j(shapeset_j->get_id()), mode(mode), order_i(order_i), order_j(order_j), loaded(false)
+    {
+      get_indices(shapeset_i, mode, order_i, this->indices_i);
+      get_indices(shapeset_j, mode, order_j, this->indices_j);
+
+      std::string filename = get_filename(id_i, id_j, mode, order_i, order_j);
+      this->loaded = this->load(filename);
+      if(!this->loaded)
+      {
+        this->calculate(shapeset_i, shapeset_j);
+        if(!this->save(filename))
+          this->warn("The reference integrals could not be written to %s.", filename.c_str());
+      }
+
+      this->positions_i.assign(shapeset_i->get_max_index(mode) + 1, -1);
+      for (unsigned int i = 0; i < this->indices_i.size(); i++)
+        this->positions_i[this->indices_i[i]] = i;
+      this->positions_j.assign(shapeset_j->get_max_index(mode) + 1, -1);
+      for (unsigned int j = 0; j < this->indices_j.size(); j++)
+        this->positions_j[this->indices_j[j]] = j;
+    }
+
+    int ReferenceIntegrals::get_position_i(int index) const
+    {
+      if(index < 0 || index >= (int)this->positions_i.size())
+        return -1;
+      return this->positions_i[index];
+    }
+
+    int ReferenceIntegrals::get_position_j(int index) const
+    {
+      if(index < 0 || index >= (int)this->positions_j.size())
+        return -1;
+      return this->positions_j[index];
+    }
+
+    int ReferenceIntegrals::get_num_i() const
+    {
+      return this->indices_i.size();
+    }
+
+    int ReferenceIntegrals::get_num_j() const
+    {
+      return this->indices_j.size();
+    }
+
+    const double* ReferenceIntegrals::get_table(ReferenceIntegral integral) const
+    {
+      return &this->tables[integral * this->indices_i.size() * this->indices_j.size()];
+    }
+
+    std::size_t ReferenceIntegrals::get_memory_size() const
+    {
+      return (indices_i.capacity() + indices_j.capacity() + positions_i.capacity() + positions_j.capacity()) * sizeof(int)
+        + tables.capacity() * sizeof(double);
+    }
+
+    bool ReferenceIntegrals::is_loaded() const
+    {
+      return this->loaded;
+    }
+
+    std::string ReferenceIntegrals::get_filename(int id_i, int id_j, ElementMode2D mode, int order_i, int order_j)
+    {
+      std::stringstream ss;
+      ss << Hermes2DApi.get_text_param_value(Hermes::Hermes2D::precalculatedFormsDirPath);
+      std::string dir = ss.str();
+      if(!dir.empty() && dir[dir.length() - 1] != '/' && dir[dir.length() - 1] != '\\')
+        ss << '/';
+      ss << "reference_integrals_" << id_i << "_" << id_j << "_" << (mode == HERMES_MODE_TRIANGLE ? "tri" : "quad")
+        << "_" << order_i << "_" << order_j << ".dat";
+      return ss.str();
+    }
+
+    void ReferenceIntegrals::get_indices(Shapeset* shapeset, ElementMode2D mode, int order, std::vector<int>& indices)
+    {
+      indices.clear();
+      int max_index = shapeset->get_max_index(mode);
+      for (int index = 0; index <= max_index; index++)
+      {
+        int index_order = shapeset->get_order(index, mode);
+        if(std::max(H2D_GET_H_ORDER(index_order), H2D_GET_V_ORDER(index_order)) <= order)
+          indices.push_back(index);
+      }
+    }
+
+    void ReferenceIntegrals::calculate(Shapeset* shapeset_i, Shapeset* shapeset_j)
+    {
+      // The products are polynomials of the order order_i + order_j, integrated exactly.
+      int order = this->order_i + this->order_j;
+      limit_order_nowarn(order, this->mode);
+      int np = g_quad_2d_std.get_num_points(order, this->mode);
+      double3* pt = g_quad_2d_std.get_points(order, this->mode);
+
+      int n_i = this->indices_i.size(), n_j = this->indices_j.size();
+
+      // Values, x- and y-derivatives at the points, the test functions first.
+      std::vector<double> values(3 * np * (n_i + n_j));
+      for (int k = 0; k < n_i + n_j; k++)
+      {
+        Shapeset* shapeset = k < n_i ? shapeset_i : shapeset_j;
+        int index = k < n_i ? this->indices_i[k] : this->indices_j[k - n_i];
+        double* val = &values[3 * np * k];
+        for (int q = 0; q < np; q++)
+        {
+          val[q] = shapeset->get_fn_value(index, pt[q][0], pt[q][1], 0, this->mode);
+          val[np + q] = shapeset->get_dx_value(index, pt[q][0], pt[q][1], 0, this->mode);
+          val[2 * np + q] = shapeset->get_dy_value(index, pt[q][0], pt[q][1], 0, this->mode);
+        }
+      }
+
+      int size = n_i * n_j;
+      this->tables.assign(H2D_RI_NUM * size, 0.0);
+      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+#pragma omp parallel for num_threads(num_threads_used)
+      for (int i = 0; i < n_i; i++)
+      {
+        const double* v = &values[3 * np * i];
+        const double* v_x = v + np;
+        const double* v_y = v_x + np;
+        for (int j = 0; j < n_j; j++)
+        {
+          const double* u = &values[3 * np * (n_i + j)];
+          const double* u_x = u + np;
+          const double* u_y = u_x + np;
+          double sums[H2D_RI_NUM] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+          for (int q = 0; q < np; q++)
+          {
+            sums[H2D_RI_MASS] += pt[q][2] * u[q] * v[q];
+            sums[H2D_RI_DX_DX] += pt[q][2] * u_x[q] * v_x[q];
+            sums[H2D_RI_DY_DY] += pt[q][2] * u_y[q] * v_y[q];
+            sums[H2D_RI_DX_DY] += pt[q][2] * (u_x[q] * v_y[q] + u_y[q] * v_x[q]);
+            sums[H2D_RI_DX_V] += pt[q][2] * u_x[q] * v[q];
+            sums[H2D_RI_DY_V] += pt[q][2] * u_y[q] * v[q];
+          }
+          for (int integral = 0; integral < H2D_RI_NUM; integral++)
+            this->tables[integral * size + i * n_j + j] = sums[integral];
+        }
+      }
+    }
+
+    bool ReferenceIntegrals::load(const std::string& filename)
+    {
+      FILE* f = fopen(filename.c_str(), "rb");
+      if(f == NULL)
+        return false;
+
+      // The header has to describe exactly the tables asked for, otherwise they are calculated again.
+      char magic[8];
+      int header[7];
+      bool ok = fread(magic, sizeof(char), 8, f) == 8 && memcmp(magic, reference_integrals_magic, 8) == 0
+        && fread(header, sizeof(int), 7, f) == 7
+        && header[0] == this->id_i && header[1] == this->id_j && header[2] == this->mode
+        && header[3] == this->order_i && header[4] == this->order_j
+        && header[5] == (int)this->indices_i.size() && header[6] == (int)this->indices_j.size();
+
+      if(ok)
+      {
+        std::vector<int> indices(this->indices_i.size() + this->indices_j.size());
+        ok = indices.empty() || fread(&indices[0], sizeof(int), indices.size(), f) == indices.size();
+        for (unsigned int k = 0; ok && k < indices.size(); k++)
+          ok = indices[k] == (k < this->indices_i.size() ? this->indices_i[k] : this->indices_j[k - this->indices_i.size()]);
+      }
+
+      if(ok)
+      {
+        this->tables.resize(H2D_RI_NUM * this->indices_i.size() * this->indices_j.size());
+        ok = this->tables.empty() || fread(&this->tables[0], sizeof(double), this->tables.size(), f) == this->tables.size();
+      }
+
+      fclose(f);
+      if(!ok)
+        this->tables.clear();
+      return ok;
+    }
+
+    bool ReferenceIntegrals::save(const std::string& filename) const
+    {
+      FILE* f = fopen(filename.c_str(), "wb");
+      if(f == NULL)
+        return false;
+
+      int header[7] = { this->id_i, this->id_j, this->mode, this->order_i, this->order_j, (int)this->indices_i.size(), (int)this->indices_j.size() };
+      bool ok = fwrite(reference_integrals_magic, sizeof(char), 8, f) == 8 && fwrite(header, sizeof(int), 7, f) == 7;
+      if(ok && !this->indices_i.empty())
+        ok = fwrite(&this->indices_i[0], sizeof(int), this->indices_i.size(), f) == this->indices_i.size();
+      if(ok && !this->indices_j.empty())
+        ok = fwrite(&this->indices_j[0], sizeof(int), this->indices_j.size(), f) == this->indices_j.size();
+      if(ok && !this->tables.empty())
+        ok = fwrite(&this->tables[0], sizeof(double), this->tables.size(), f) == this->tables.size();
+
+      ok = fclose(f) == 0 && ok;
+      // A partially written file would only be calculated again, but it is better not to leave it there.
+      if(!ok)
+        remove(filename.c_str());
+      return ok;
+    }
+  }
+}
@@ -36,6 +36,7 @@ namespace Hermes
       {
         L2ProjBasedSelector<Scalar>* newSelector = new L2ProjBasedSelector(this->cand_list, this->conv_exp, this->max_order, (L2Shapeset*)this->shapeset);
         newSelector->set_error_weights(this->error_weight_h, this->error_weight_p, this->error_weight_aniso);
+        newSelector->copy_options(this);
         newSelector->isAClone = true;
         return newSelector;
       }
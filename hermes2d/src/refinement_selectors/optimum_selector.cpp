@@ -71,6 +71,8 @@ namespace Hermes
       Selector<Scalar>(max_order),
         opt_symmetric_mesh(true),
         opt_apply_exp_dof(false),
+        opt_prune_candidates(false),
+        pruning_tolerance(H2DRS_DEFAULT_PRUNING_TOLERANCE),
         cand_list(cand_list),
         conv_exp(conv_exp),
         shapeset(shapeset)
@@ -606,6 +608,76 @@ namespace Hermes
         evaluate_cands_score(e);
       }
 
+      template<typename Scalar>
+      void OptimumSelector<Scalar>::evaluate_candidates_pruned(Element* e, int quad_order, Solution<Scalar>* rsln, double* avg_error, double* dev_error)
+      {
+        //DOFs do not depend on errors, order candidates (except the original one) by them
+        evaluate_cands_dof(e, rsln);
+        if(candidates.size() > 2)
+          std::stable_sort(candidates.begin() + 1, candidates.end(), CompareCandDofs(quad_order));
+
+        //evaluate prefixes of the ordered list, doubling the prefix until no other candidate can improve the score
+        Hermes::vector<Cand> all_candidates = candidates;
+        const int num_cands = (int)all_candidates.size();
+        int num_evaluated = std::max(2, num_cands / 4);
+        while(true)
+        {
+          num_evaluated = std::min(num_evaluated, num_cands);
+          candidates.assign(all_candidates.begin(), all_candidates.begin() + num_evaluated);
+          evaluate_cands_error(e, rsln, avg_error, dev_error);
+          evaluate_cands_score(e);
+
+          if(num_evaluated == num_cands)
+            break;
+
+          //the best score so far and the smallest error so far
+          const Cand& unrefined = candidates[0];
+          double best_score = 0.0, min_error = unrefined.error;
+          for(int i = 1; i < num_evaluated; i++)
+          {
+            best_score = std::max(best_score, candidates[i].score);
+            min_error = std::min(min_error, candidates[i].error);
+          }
+
+          //the best score a candidate with at least the DOFs of the next candidate could get
+          int next_dofs = all_candidates[num_evaluated].dofs;
+          if(next_dofs > unrefined.dofs && min_error > 0.0 && unrefined.error > 0.0)
+          {
+            double delta_dof_exp = std::pow(next_dofs - unrefined.dofs, conv_exp);
+            if(opt_apply_exp_dof)
+              delta_dof_exp = std::pow(next_dofs, conv_exp) - std::pow(unrefined.dofs, conv_exp);
+            double max_score = (log10(unrefined.error) - log10(pruning_tolerance * min_error)) / delta_dof_exp;
+            if(best_score > 0.0 && max_score <= best_score)
+              break;
+          }
+
+          num_evaluated *= 2;
+        }
+      }
+
+      template<typename Scalar>
+      OptimumSelector<Scalar>::CompareCandDofs::CompareCandDofs(int quad_order) : order_h(H2D_GET_H_ORDER(quad_order)), order_v(H2D_GET_V_ORDER(quad_order))
+      {
+      }
+
+      template<typename Scalar>
+      int OptimumSelector<Scalar>::CompareCandDofs::distance(const Cand& cand) const
+      {
+        int dist = 0;
+        const int num_elems = cand.get_num_elems();
+        for(int i = 0; i < num_elems; i++)
+          dist += std::abs(H2D_GET_H_ORDER(cand.p[i]) - order_h) + std::abs(H2D_GET_V_ORDER(cand.p[i]) - order_v);
+        return dist;
+      }
+
+      template<typename Scalar>
+      bool OptimumSelector<Scalar>::CompareCandDofs::operator()(const Cand& a, const Cand& b) const
+      {
+        if(a.dofs != b.dofs)
+          return a.dofs < b.dofs;
+        return distance(a) < distance(b);
+      }
+
       template<typename Scalar>
       void OptimumSelector<Scalar>::evaluate_cands_score(Element* e)
       {
@@ -704,7 +776,10 @@ namespace Hermes
         if(candidates.size() > 1) { //there are candidates to choose from
           // evaluate candidates (sum partial projection errors, calculate dofs)
           double avg_error, dev_error;
-          evaluate_candidates(element, rsln, &avg_error, &dev_error);
+          if(opt_prune_candidates)
+            evaluate_candidates_pruned(element, quad_order, rsln, &avg_error, &dev_error);
+          else
+            evaluate_candidates(element, rsln, &avg_error, &dev_error);
 
           //select candidate
           select_best_candidate(element, avg_error, dev_error, &inx_cand, &inx_h_cand);
@@ -798,6 +873,24 @@ namespace Hermes
         }
       }
 
+      template<typename Scalar>
+      void OptimumSelector<Scalar>::set_candidate_pruning(bool enable, double tolerance)
+      {
+        if(tolerance <= 0.0 || tolerance > 1.0)
+          throw Exceptions::ValueException("tolerance", tolerance, 0.0, 1.0);
+        opt_prune_candidates = enable;
+        pruning_tolerance = tolerance;
+      }
+
+      template<typename Scalar>
+      void OptimumSelector<Scalar>::copy_options(const OptimumSelector<Scalar>* source)
+      {
+        opt_symmetric_mesh = source->opt_symmetric_mesh;
+        opt_apply_exp_dof = source->opt_apply_exp_dof;
+        opt_prune_candidates = source->opt_prune_candidates;
+        pruning_tolerance = source->pruning_tolerance;
+      }
+
       template<typename Scalar>
       OptimumSelector<Scalar>::Range::Range() : empty_range(true) {}
 
@@ -21,7 +21,9 @@ namespace Hermes
         warn_uniform_orders(false),
         error_weight_h(H2DRS_DEFAULT_ERR_WEIGHT_H),
         error_weight_p(H2DRS_DEFAULT_ERR_WEIGHT_P),
-        error_weight_aniso(H2DRS_DEFAULT_ERR_WEIGHT_ANISO)
+        error_weight_aniso(H2DRS_DEFAULT_ERR_WEIGHT_ANISO),
+        ref_samples(NULL),
+        ref_sample_offsets(NULL)
       {
         cached_shape_vals_valid = new bool[2];
         cached_shape_ortho_vals = new TrfShape[2];
@@ -34,7 +36,10 @@ namespace Hermes
         for(int m = 0; m < H2D_NUM_MODES; m++)
           for(int i = 0; i < H2DRS_MAX_ORDER + 2; i++)
             for(int k = 0; k < H2DRS_MAX_ORDER + 2; k++)
+            {
               proj_matrix_cache[m][i][k] = NULL;
+              proj_matrix_diag_cache[m][i][k] = NULL;
+            }
 
         //allocate caches
         int max_inx = this->max_shape_inx[0];
@@ -55,17 +60,171 @@ namespace Hermes
             {
               if(proj_matrix_cache[m][i][k] != NULL)
                 delete [] proj_matrix_cache[m][i][k];
+              if(proj_matrix_diag_cache[m][i][k] != NULL)
+                delete [] proj_matrix_diag_cache[m][i][k];
             }
         }
 
         if(!this->isAClone)
         {
+          free_ref_solution_samples();
           delete [] cached_shape_vals_valid;
           delete [] cached_shape_ortho_vals;
           delete [] cached_shape_vals;
         }
       }
 
+      template<typename Scalar>
+      void ProjBasedSelector<Scalar>::precalculate_shape_values()
+      {
+        Quad2D* quad = &g_quad_2d_std;
+        for(int m = 0; m < H2D_NUM_MODES; m++)
+        {
+          if(cached_shape_vals_valid[m])
+            continue;
+
+          ElementMode2D mode = (ElementMode2D)m;
+          double3* gip_points = quad->get_points(H2DRS_INTR_GIP_ORDER, mode);
+          int num_gip_points = quad->get_num_points(H2DRS_INTR_GIP_ORDER, mode);
+
+          Trf* trfs = (mode == HERMES_MODE_TRIANGLE) ? tri_trf : quad_trf;
+          int num_noni_trfs = (mode == HERMES_MODE_TRIANGLE) ? H2D_TRF_TRI_NUM : H2D_TRF_QUAD_NUM;
+
+          precalc_ortho_shapes(gip_points, num_gip_points, trfs, num_noni_trfs, this->shape_indices[mode], this->max_shape_inx[mode], cached_shape_ortho_vals[mode], mode);
+          precalc_shapes(gip_points, num_gip_points, trfs, num_noni_trfs, this->shape_indices[mode], this->max_shape_inx[mode], cached_shape_vals[mode], mode);
+          cached_shape_vals_valid[mode] = true;
+        }
+      }
+
+      template<typename Scalar>
+      void ProjBasedSelector<Scalar>::init_ref_solution_samples(const Hermes::vector<Element*>& elements)
+      {
+        free_ref_solution_samples();
+
+        const int num_expansions = get_num_ref_expansions();
+        if(num_expansions == 0)
+          return;
+        if(num_expansions > H2DRS_MAX_REF_EXPANSIONS)
+          throw Exceptions::ValueException("number of function expansions", num_expansions, H2DRS_MAX_REF_EXPANSIONS);
+
+        ref_sample_offsets = new std::map<int, size_t>;
+        size_t size = 0;
+        for(unsigned int i = 0; i < elements.size(); i++)
+        {
+          if(ref_sample_offsets->find(elements[i]->id) != ref_sample_offsets->end())
+            continue;
+          (*ref_sample_offsets)[elements[i]->id] = size;
+          size += H2D_MAX_ELEMENT_SONS * num_expansions * g_quad_2d_std.get_num_points(H2DRS_INTR_GIP_ORDER, elements[i]->get_mode());
+        }
+        ref_samples = new Scalar[size];
+      }
+
+      template<typename Scalar>
+      void ProjBasedSelector<Scalar>::share_ref_solution_samples(ProjBasedSelector<Scalar>* source)
+      {
+        if(!this->isAClone)
+          throw Exceptions::Exception("Only a clone of a selector can share samples of a reference solution.");
+        ref_samples = source->ref_samples;
+        ref_sample_offsets = source->ref_sample_offsets;
+      }
+
+      template<typename Scalar>
+      void ProjBasedSelector<Scalar>::store_ref_solution_samples(Element* e, Solution<Scalar>* rsln)
+      {
+        if(ref_samples == NULL)
+          return;
+        std::map<int, size_t>::const_iterator offset = ref_sample_offsets->find(e->id);
+        if(offset == ref_sample_offsets->end())
+          throw Exceptions::Exception("Element #%d was not passed to init_ref_solution_samples().", e->id);
+
+        Scalar** rval[H2D_MAX_ELEMENT_SONS];
+        precalc_ref_solution_sons(e, rsln, rval);
+
+        const int num_expansions = get_num_ref_expansions();
+        const int num_gip_points = g_quad_2d_std.get_num_points(H2DRS_INTR_GIP_ORDER, e->get_mode());
+        Scalar* samples = ref_samples + offset->second;
+        for(int son = 0; son < H2D_MAX_ELEMENT_SONS; son++)
+          for(int k = 0; k < num_expansions; k++, samples += num_gip_points)
+            memcpy(samples, rval[son][k], num_gip_points * sizeof(Scalar));
+      }
+
+      template<typename Scalar>
+      void ProjBasedSelector<Scalar>::free_ref_solution_samples()
+      {
+        if(!this->isAClone)
+        {
+          delete [] ref_samples;
+          delete ref_sample_offsets;
+        }
+        ref_samples = NULL;
+        ref_sample_offsets = NULL;
+      }
+
+      template<typename Scalar>
+      bool ProjBasedSelector<Scalar>::get_ref_solution_samples(Element* e, Scalar** rval[H2D_MAX_ELEMENT_SONS])
+      {
+        if(ref_samples == NULL)
+          return false;
+        std::map<int, size_t>::const_iterator offset = ref_sample_offsets->find(e->id);
+        if(offset == ref_sample_offsets->end())
+          return false;
+
+        const int num_expansions = get_num_ref_expansions();
+        const int num_gip_points = g_quad_2d_std.get_num_points(H2DRS_INTR_GIP_ORDER, e->get_mode());
+        Scalar* samples = ref_samples + offset->second;
+        for(int son = 0; son < H2D_MAX_ELEMENT_SONS; son++)
+        {
+          for(int k = 0; k < num_expansions; k++, samples += num_gip_points)
+            ref_sample_rvals[son][k] = samples;
+          rval[son] = ref_sample_rvals[son];
+        }
+        return true;
+      }
+
+      template<typename Scalar>
+      void ProjBasedSelector<Scalar>::precalc_ref_solution_sons(Element* e, Solution<Scalar>* rsln, Scalar** rval[H2D_MAX_ELEMENT_SONS])
+      {
+        rsln->set_quad_2d(&g_quad_2d_std);
+
+        // everything is done on the reference domain
+        rsln->enable_transform(false);
+
+        Element* base_element = rsln->get_mesh()->get_element(e->id);
+        if(base_element->active)
+        {
+          this->info("Have you calculated element errors twice with solutions_for_adaptivity == true?");
+        };
+
+        // value on base element.
+        if(base_element->active)
+        {
+          for (int son = 0; son < H2D_MAX_ELEMENT_SONS; son++)
+          {
+            //set element
+            rsln->set_active_element(base_element);
+            rsln->set_quad_order(H2DRS_INTR_GIP_ORDER);
+            rsln->push_transform(son);
+
+            //obtain precalculated values
+            rval[son] = precalc_ref_solution(son, rsln, e, H2DRS_INTR_GIP_ORDER);
+          }
+        }
+        else
+        {
+          for (int son = 0; son < H2D_MAX_ELEMENT_SONS; son++)
+          {
+            //set element
+            Element* e = base_element->sons[son];
+            assert(e != NULL);
+            rsln->set_active_element(e);
+            rsln->set_quad_order(H2DRS_INTR_GIP_ORDER);
+
+            //obtain precalculated values
+            rval[son] = precalc_ref_solution(son, rsln, e, H2DRS_INTR_GIP_ORDER);
+          }
+        }
+      }
+
       template<typename Scalar>
       void ProjBasedSelector<Scalar>::set_error_weights(double weight_h, double weight_p, double weight_aniso)
       {
@@ -236,77 +395,24 @@ namespace Hermes
 
         // select quadrature, obtain integration points and weights
         Quad2D* quad = &g_quad_2d_std;
-        rsln->set_quad_2d(quad);
         double3* gip_points = quad->get_points(H2DRS_INTR_GIP_ORDER, mode);
         int num_gip_points = quad->get_num_points(H2DRS_INTR_GIP_ORDER, mode);
 
-        // everything is done on the reference domain
-        rsln->enable_transform(false);
-
-        // obtain reference solution values on all four refined sons
+        // obtain reference solution values on all four refined sons, sampled in advance if available
         Scalar** rval[H2D_MAX_ELEMENT_SONS];
         Element* base_element = rsln->get_mesh()->get_element(e->id);
-        if(base_element->active)
-        {
-          this->info("Have you calculated element errors twice with solutions_for_adaptivity == true?");
-        };
-
-        // value on base element.
-        if(base_element->active)
-        {
-          for (int son = 0; son < H2D_MAX_ELEMENT_SONS; son++)
-          {
-            //set element
-            rsln->set_active_element(base_element);
-            rsln->set_quad_order(H2DRS_INTR_GIP_ORDER);
-            rsln->push_transform(son);
-
-            //obtain precalculated values
-            rval[son] = precalc_ref_solution(son, rsln, e, H2DRS_INTR_GIP_ORDER);
-          }
-        }
-        else
-        {
-          for (int son = 0; son < H2D_MAX_ELEMENT_SONS; son++)
-          {
-            //set element
-            Element* e = base_element->sons[son];
-            assert(e != NULL);
-            rsln->set_active_element(e);
-            rsln->set_quad_order(H2DRS_INTR_GIP_ORDER);
-
-            //obtain precalculated values
-            rval[son] = precalc_ref_solution(son, rsln, e, H2DRS_INTR_GIP_ORDER);
-          }
-        }
+        if(!get_ref_solution_samples(e, rval))
+          precalc_ref_solution_sons(e, rsln, rval);
 
         //retrieve transformations
-        Trf* trfs = NULL;
-        int num_noni_trfs = 0;
-        if(mode == HERMES_MODE_TRIANGLE)
-        {
-          trfs = tri_trf;
-          num_noni_trfs = H2D_TRF_TRI_NUM;
-        }
-        else
-        {
-          trfs = quad_trf;
-          num_noni_trfs = H2D_TRF_QUAD_NUM;
-        }
+        Trf* trfs = (mode == HERMES_MODE_TRIANGLE) ? tri_trf : quad_trf;
 
         // precalculate values of shape functions
         TrfShape empty_shape_vals;
 
+        // Adapt::adapt() evaluates the values before going parallel, this only serves serial use of the selector.
         if(!cached_shape_vals_valid[mode])
-        {
-#pragma omp critical (cached_shape_vals_valid)
-          if(!cached_shape_vals_valid[mode])
-          {
-            precalc_ortho_shapes(gip_points, num_gip_points, trfs, num_noni_trfs, this->shape_indices[mode], this->max_shape_inx[mode], cached_shape_ortho_vals[mode], mode);
-            precalc_shapes(gip_points, num_gip_points, trfs, num_noni_trfs, this->shape_indices[mode], this->max_shape_inx[mode], cached_shape_vals[mode], mode);
-            cached_shape_vals_valid[mode] = true;
-          }
-        }
+          precalculate_shape_values();
 
         //issue a warning if ortho values are defined and the selected cand_list might benefit from that but it cannot because elements do not have uniform orders
         if(!warn_uniform_orders && mode == HERMES_MODE_QUAD && !cached_shape_ortho_vals[mode][H2D_TRF_IDENTITY].empty())
@@ -437,10 +543,8 @@ namespace Hermes
         int max_num_shapes = this->next_order_shape[mode][this->current_max_order];
         Scalar* right_side = new Scalar[max_num_shapes];
         int* shape_inxs = new int[max_num_shapes];
-        int* indx = new int[max_num_shapes]; //solver data
-        double* d = new double[max_num_shapes]; //solver data
-        double** proj_matrix = new_matrix<double>(max_num_shapes, max_num_shapes);
         ProjMatrixCache& proj_matrices = proj_matrix_cache[mode];
+        ProjMatrixDiagCache& proj_matrix_diags = proj_matrix_diag_cache[mode];
         Hermes::vector<typename OptimumSelector<Scalar>::ShapeInx>& full_shape_indices = this->shape_indices[mode];
 
         //check whether ortho-svals are available
@@ -489,12 +593,14 @@ namespace Hermes
           Hermes::vector< ValueCacheItem<Scalar> >& rhs_cache = use_ortho ? ortho_rhs_cache : nonortho_rhs_cache;
           Hermes::vector<TrfShapeExp>** sub_svals = use_ortho ? sub_ortho_svals : sub_nonortho_svals;
 
-          //calculate projection matrix iff no ortho is used
-          if(!use_ortho)
+          //calculate and factor projection matrix iff no ortho is used, the factors are reused by all following elements
+          if(!use_ortho && proj_matrices[order_h][order_v] == NULL)
           {
-            if(proj_matrices[order_h][order_v] == NULL)
-              proj_matrices[order_h][order_v] = build_projection_matrix(gip_points, num_gip_points, shape_inxs, num_shapes, mode);
-            copy_matrix(proj_matrix, proj_matrices[order_h][order_v], num_shapes, num_shapes); //copy projection matrix because original matrix will be modified
+            double** proj_matrix = build_projection_matrix(gip_points, num_gip_points, shape_inxs, num_shapes, mode);
+            double* proj_matrix_diag = new double[num_shapes];
+            choldc(proj_matrix, num_shapes, proj_matrix_diag);
+            proj_matrices[order_h][order_v] = proj_matrix;
+            proj_matrix_diags[order_h][order_v] = proj_matrix_diag;
           }
 
           //build right side (fill cache values that are missing)
@@ -528,10 +634,7 @@ namespace Hermes
 
           //solve iff no ortho is used
           if(!use_ortho)
-          {
-            ludcmp(proj_matrix, num_shapes, indx, d);
-            lubksb<Scalar>(proj_matrix, num_shapes, indx, right_side);
-          }
+            cholsl<Scalar>(proj_matrices[order_h][order_v], num_shapes, proj_matrix_diags[order_h][order_v], right_side, right_side);
 
           //calculate error
           double error_squared = 0;
@@ -548,11 +651,8 @@ namespace Hermes
         }
         while (order_perm.next());
 
-        delete [] proj_matrix;
         delete [] right_side;
         delete [] shape_inxs;
-        delete [] indx;
-        delete [] d;
       }
 
       template class HERMES_API ProjBasedSelector<double>;
@@ -0,0 +1,190 @@
+#include <limits>
+#include "global.h"
+#include "matrix.h"
+#include "solution.h"
+#include "quad_all.h"
+#include "element_to_refine.h"
+#include "smoothness_selector.h"
+
+using namespace Hermes::Algebra::DenseMatrixOperations;
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    namespace RefinementSelectors
+    {
+      template<typename Scalar>
+      SmoothnessSelector<Scalar>::SmoothnessSelector(int max_order, double decay_threshold)
+        : Selector<Scalar>(max_order), decay_threshold(decay_threshold)
+      {
+        if(decay_threshold <= 0.0)
+          throw Hermes::Exceptions::ValueException("decay threshold", decay_threshold, 0.0);
+      }
+
+      template<typename Scalar>
+      Selector<Scalar>* SmoothnessSelector<Scalar>::clone()
+      {
+        return new SmoothnessSelector(this->max_order, this->decay_threshold);
+      }
+
+      template<typename Scalar>
+      double SmoothnessSelector<Scalar>::get_decay_rate(Element* element, int quad_order, Solution<Scalar>* sln)
+      {
+        ElementMode2D mode = element->get_mode();
+        int order_h = H2D_GET_H_ORDER(quad_order), order_v = H2D_GET_V_ORDER(quad_order);
+        if(element->is_triangle())
+          order_v = order_h;
+        int order = std::max(order_h, order_v);
+        if(order < 2)
+          return std::numeric_limits<double>::infinity();
+
+        // All the shape functions of the element, the edge functions of the order of the edge direction.
+        Hermes::vector<int> indices;
+        for (int i = 0; i < element->get_nvert(); i++)
+          indices.push_back(shapeset.get_vertex_index(i, mode));
+        for (int i = 0; i < element->get_nvert(); i++)
+        {
+          int edge_order = (element->is_quad() && i % 2 == 1) ? order_v : order_h;
+          for (int o = 2; o <= edge_order; o++)
+            indices.push_back(shapeset.get_edge_index(i, 0, o, mode));
+        }
+        int bubble_order = element->is_triangle() ? order_h : quad_order;
+        int num_bubbles = shapeset.get_num_bubbles(bubble_order, mode);
+        int* bubble_indices = shapeset.get_bubble_indices(bubble_order, mode);
+        for (int i = 0; i < num_bubbles; i++)
+          indices.push_back(bubble_indices[i]);
+        int num_shapes = indices.size();
+
+        // The solution values and the shape function values on the reference element.
+        int quad_ord = std::min(2 * order, g_quad_2d_std.get_safe_max_order(mode));
+        double3* pt = g_quad_2d_std.get_points(quad_ord, mode);
+        int np = g_quad_2d_std.get_num_points(quad_ord, mode);
+        sln->set_quad_2d(&g_quad_2d_std);
+        sln->set_active_element(element);
+        sln->set_quad_order(quad_ord, H2D_FN_VAL);
+        Scalar* values = sln->get_fn_values();
+
+        double** shape_values = new_matrix<double>(num_shapes, np);
+        for (int i = 0; i < num_shapes; i++)
+          for (int j = 0; j < np; j++)
+            shape_values[i][j] = shapeset.get_value(H2D_FEI_VALUE, indices[i], pt[j][0], pt[j][1], 0, mode);
+
+        // The local L2 projection, the expansion of the solution.
+        double** mass = new_matrix<double>(num_shapes, num_shapes);
+        double* mass_diag = new double[num_shapes];
+        double* chol_diag = new double[num_shapes];
+        Scalar* coeffs = new Scalar[num_shapes];
+        for (int i = 0; i < num_shapes; i++)
+        {
+          for (int k = 0; k <= i; k++)
+          {
+            double value = 0.0;
+            for (int j = 0; j < np; j++)
+              value += pt[j][2] * shape_values[i][j] * shape_values[k][j];
+            mass[i][k] = mass[k][i] = value;
+          }
+          mass_diag[i] = mass[i][i];
+          Scalar value = 0.0;
+          for (int j = 0; j < np; j++)
+            value += pt[j][2] * values[j] * shape_values[i][j];
+          coeffs[i] = value;
+        }
+        choldc(mass, num_shapes, chol_diag);
+        cholsl<Scalar>(mass, num_shapes, chol_diag, coeffs, coeffs);
+
+        // The norms of the parts of the degrees 1, ..., order.
+        double* degree_norms = new double[order + 1];
+        memset(degree_norms, 0, (order + 1) * sizeof(double));
+        for (int i = 0; i < num_shapes; i++)
+        {
+          int shape_order = shapeset.get_order(indices[i], mode);
+          int degree = element->is_triangle() ? shape_order : std::max(H2D_GET_H_ORDER(shape_order), H2D_GET_V_ORDER(shape_order));
+          degree_norms[degree] += std::norm(coeffs[i]) * mass_diag[i];
+        }
+
+        // The least squares fit of log a_k = log C - sigma k, the vanishing parts limited relative to the largest one.
+        double max_norm = 0.0;
+        for (int k = 1; k <= order; k++)
+        {
+          degree_norms[k] = sqrt(degree_norms[k]);
+          max_norm = std::max(max_norm, degree_norms[k]);
+        }
+        double decay_rate = std::numeric_limits<double>::infinity();
+        if(max_norm > 0.0)
+        {
+          double sum_k = 0.0, sum_kk = 0.0, sum_log = 0.0, sum_k_log = 0.0;
+          for (int k = 1; k <= order; k++)
+          {
+            double log_a = log(std::max(degree_norms[k], 1e-12 * max_norm));
+            sum_k += k;
+            sum_kk += k * k;
+            sum_log += log_a;
+            sum_k_log += k * log_a;
+          }
+          decay_rate = -(order * sum_k_log - sum_k * sum_log) / (order * sum_kk - sum_k * sum_k);
+        }
+
+        delete [] shape_values;
+        delete [] mass;
+        delete [] mass_diag;
+        delete [] chol_diag;
+        delete [] coeffs;
+        delete [] degree_norms;
+
+        return decay_rate;
+      }
+
+      template<typename Scalar>
+      bool SmoothnessSelector<Scalar>::select_refinement(Element* element, int quad_order, Solution<Scalar>* rsln, ElementToRefine& refinement)
+      {
+        if(rsln == NULL)
+          throw Exceptions::NullException(2);
+
+        int max_allowed_order = this->max_order;
+        if(this->max_order == H2DRS_DEFAULT_ORDER)
+          max_allowed_order = H2DRS_MAX_ORDER;
+
+        int order_h = H2D_GET_H_ORDER(quad_order), order_v = H2D_GET_V_ORDER(quad_order);
+        int new_order_h = std::min(max_allowed_order, order_h + 1);
+        int new_order_v = std::min(max_allowed_order, order_v + 1);
+        bool can_increase = new_order_h > order_h || (element->is_quad() && new_order_v > order_v);
+
+        if(can_increase && get_decay_rate(element, quad_order, rsln) > decay_threshold)
+        {
+          refinement.split = H2D_REFINEMENT_P;
+          if(element->is_triangle())
+            refinement.p[0] = refinement.q[0] = new_order_h;
+          else
+            refinement.p[0] = refinement.q[0] = H2D_MAKE_QUAD_ORDER(new_order_h, new_order_v);
+        }
+        else
+        {
+          refinement.split = H2D_REFINEMENT_H;
+          refinement.p[0] = refinement.p[1] = refinement.p[2] = refinement.p[3] = quad_order;
+          refinement.q[0] = refinement.q[1] = refinement.q[2] = refinement.q[3] = quad_order;
+        }
+        return true;
+      }
+
+      template<typename Scalar>
+      void SmoothnessSelector<Scalar>::generate_shared_mesh_orders(const Element* element, const int orig_quad_order, const int refinement, int tgt_quad_orders[H2D_MAX_ELEMENT_SONS], const int* suggested_quad_orders)
+      {
+        int num_sons = (refinement == H2D_REFINEMENT_P) ? 1 : H2D_MAX_ELEMENT_SONS;
+        if(suggested_quad_orders != NULL)
+          for(int i = 0; i < num_sons; i++)
+            tgt_quad_orders[i] = suggested_quad_orders[i];
+        else
+          for(int i = 0; i < num_sons; i++)
+            tgt_quad_orders[i] = orig_quad_order;
+#ifdef _DEBUG
+        for(int i = num_sons; i < H2D_MAX_ELEMENT_SONS; i++)
+          tgt_quad_orders[i] = 0;
+#endif
+      }
+
+      template class HERMES_API SmoothnessSelector<double>;
+      template class HERMES_API SmoothnessSelector<std::complex<double> >;
+    }
+  }
+}
@@ -18,15 +18,167 @@
 #include "projections/ogprojection.h"
 #include "projections/localprojection.h"
 #include "weakform_library/weakforms_hcurl.h"
+#include <limits>
 namespace Hermes
 {
   namespace Hermes2D
   {
+    /// The mass matrix is real also for complex problems.
+    template<typename Scalar>
+    void RungeKutta<Scalar>::assemble_mass_matrix()
+    {
+      bool spaces_changed = (this->mass_matrix_seqs.size() != spaces.size());
+      for (unsigned int space_i = 0; !spaces_changed && space_i < spaces.size(); space_i++)
+        if(this->mass_matrix_seqs[space_i] != spaces[space_i]->get_seq())
+          spaces_changed = true;
+      if(!spaces_changed)
+        return;
+
+      stage_dp_left->assemble(matrix_left, NULL);
+
+      this->mass_matrix_seqs.clear();
+      for (unsigned int space_i = 0; space_i < spaces.size(); space_i++)
+        this->mass_matrix_seqs.push_back(spaces[space_i]->get_seq());
+    }
+
+    template<typename Scalar>
+    double RungeKutta<Scalar>::embedded_error_norm()
+    {
+      int ndof = Space<Scalar>::get_num_dofs(spaces);
+
+      // sln_coeff_vec holds Y_{n+1}, Y_n = Y_{n+1} - h \sum_j b_j K_j.
+      double error_sum = 0.0, sln_new_sum = 0.0, sln_prev_sum = 0.0;
+      for (int i = 0; i < ndof; i++)
+      {
+        Scalar error = 0.0, increment = 0.0;
+        for (unsigned int j = 0; j < num_stages; j++)
+        {
+          error += (bt->get_B(j) - bt->get_B2(j)) * K_vector[j * ndof + i];
+          increment += bt->get_B(j) * K_vector[j * ndof + i];
+        }
+        error_sum += std::pow(std::abs(this->time_step * error), 2.0);
+        sln_new_sum += std::pow(std::abs(this->sln_coeff_vec[i]), 2.0);
+        sln_prev_sum += std::pow(std::abs(this->sln_coeff_vec[i] - this->time_step * increment), 2.0);
+      }
+
+      double error_rms = std::sqrt(error_sum / ndof);
+      double scale = this->adaptive_abs_tol + this->adaptive_rel_tol * std::sqrt(std::max(sln_new_sum, sln_prev_sum) / ndof);
+      if(scale == 0.0)
+        return error_rms == 0.0 ? 0.0 : std::numeric_limits<double>::max();
+      return error_rms / scale;
+    }
+
+    template<typename Scalar>
+    double RungeKutta<Scalar>::rk_time_step_adaptive(Hermes::vector<Solution<Scalar>*> slns_time_prev, Hermes::vector<Solution<Scalar>*> slns_time_new)
+    {
+      if(!bt->is_embedded())
+        throw Hermes::Exceptions::Exception("rk_time_step_adaptive(): R-K method must be embedded for the adaptive time stepping.");
+      if(this->adaptive_rel_tol == 0.0 && this->adaptive_abs_tol == 0.0)
+        throw Hermes::Exceptions::Exception("rk_time_step_adaptive(): the tolerances have to be set by set_adaptive_time_stepping().");
+
+      if(this->max_time_step > 0.0 && this->time_step > this->max_time_step)
+        this->time_step = this->max_time_step;
+
+      bool rejected = false;
+      while (true)
+      {
+        double time_step = this->time_step;
+
+        // A failure of the Newton's method rejects the step as well.
+        bool newton_failed = false;
+        try
+        {
+          this->rk_time_step_newton(slns_time_prev, slns_time_new);
+        }
+        catch(Exceptions::ValueException&)
+        {
+          newton_failed = true;
+        }
+
+        double error = newton_failed ? 0.0 : this->embedded_error_norm();
+        if(!newton_failed && error <= 1.0)
+        {
+          // The PID controller, without the terms for which there are no previous errors.
+          error = std::max(error, 1e-10);
+          double last_error = this->last_step_error > 0.0 ? this->last_step_error : error;
+          double second_last_error = this->second_last_step_error > 0.0 ? this->second_last_step_error : last_error;
+          double factor = this->controller_safety * std::pow(error, -this->controller_k_integral)
+            * std::pow(last_error / error, this->controller_k_proportional)
+            * std::pow(last_error * last_error / (error * second_last_error), this->controller_k_derivative);
+          factor = std::min(this->controller_max_factor, std::max(this->controller_min_factor, factor));
+          // No increase right after a rejection.
+          if(rejected)
+            factor = std::min(factor, 1.0);
+          // Keep the time step (and the stage matrix) rather than increase it just slightly.
+          if(factor >= 1.0 && factor < this->time_step_keep_ratio)
+            factor = 1.0;
+
+          this->second_last_step_error = this->last_step_error;
+          this->last_step_error = error;
+
+          double next_time_step = time_step * factor;
+          if(this->max_time_step > 0.0)
+            next_time_step = std::min(next_time_step, this->max_time_step);
+          next_time_step = std::max(next_time_step, this->min_time_step);
+
+          this->info("\tRunge-Kutta: time step %g accepted (relative error %g), next time step: %g.", time_step, error, next_time_step);
+          this->time += time_step;
+          this->time_step = next_time_step;
+          return time_step;
+        }
+
+        // Repeat the step with a smaller time step, from the stage vectors of this one,
+        // or from zero if the Newton's method failed.
+        double factor = newton_failed ? 0.5 : this->controller_safety * std::pow(error, -(this->controller_k_integral + this->controller_k_proportional));
+        factor = std::min(1.0, std::max(this->controller_min_factor, factor));
+        if(time_step * factor < this->min_time_step)
+          throw Hermes::Exceptions::Exception("Runge-Kutta: the time step %g would be below the minimum time step %g.", time_step * factor, this->min_time_step);
+        if(newton_failed)
+        {
+          Hermes::Algebra::first_touch_zero(K_vector, num_stages * Space<Scalar>::get_num_dofs(spaces) * sizeof(Scalar));
+          this->warn("\tRunge-Kutta: time step %g rejected (Newton's method failed), repeated with %g.", time_step, time_step * factor);
+        }
+        else
+          this->warn("\tRunge-Kutta: time step %g rejected (relative error %g), repeated with %g.", time_step, error, time_step * factor);
+        this->time_step = time_step * factor;
+        rejected = true;
+      }
+    }
+
+    template<typename Scalar>
+    double RungeKutta<Scalar>::rk_time_step_adaptive(Solution<Scalar>* sln_time_prev, Solution<Scalar>* sln_time_new)
+    {
+      Hermes::vector<Solution<Scalar>*> slns_time_prev = Hermes::vector<Solution<Scalar>*>();
+      slns_time_prev.push_back(sln_time_prev);
+      Hermes::vector<Solution<Scalar>*> slns_time_new = Hermes::vector<Solution<Scalar>*>();
+      slns_time_new.push_back(sln_time_new);
+      return rk_time_step_adaptive(slns_time_prev, slns_time_new);
+    }
+
+    static double mass_matrix_entry(double value)
+    {
+      return value;
+    }
+
+    static double mass_matrix_entry(std::complex<double> value)
+    {
+      return value.real();
+    }
+
     template<typename Scalar>
     RungeKutta<Scalar>::RungeKutta(const WeakForm<Scalar>* wf, Hermes::vector<const Space<Scalar> *> spaces, ButcherTable* bt)
       : wf(wf), bt(bt), num_stages(bt->get_size()), stage_wf_right(bt->get_size() * spaces.size()),
       stage_wf_left(spaces.size()), start_from_zero_K_vector(false), block_diagonal_jacobian(false), residual_as_vector(true), iteration(0),
-      freeze_jacobian(false), newton_tol(1e-6), newton_max_iter(20), newton_damping_coeff(1.0), newton_max_allowed_residual_norm(1e10)
+      freeze_jacobian(false), newton_tol(1e-6), newton_max_iter(20), newton_damping_coeff(1.0), newton_max_allowed_residual_norm(1e10),
+      jacobian_reuse(false), max_jacobian_reuse_contraction_rate(0.5), jacobian_factorized(false), num_saved_factorizations(0),
+      decoupled_stages(false), schur_Q(NULL), schur_R(NULL), stage_jacobian(NULL),
+      time_independent_jacobian(false), time_independent_jacobian_linear(false), stationary_jacobian(NULL), stationary_jacobian_time(0.0),
+      stage_matrix_structure_valid(false), stage_matrix_time_step(-1.0), lumped_mass(false), explicit_wf(NULL), explicit_dp(NULL),
+      explicit_rhs(NULL), mass_solver(NULL), lumped_mass_inverse(NULL), l2_mass_inverse(NULL),
+      adaptive_rel_tol(0.0), adaptive_abs_tol(0.0), min_time_step(0.0), max_time_step(0.0), controller_k_integral(0.15),
+      controller_k_proportional(0.2), controller_k_derivative(0.0), controller_safety(0.9), controller_min_factor(0.2),
+      controller_max_factor(5.0), time_step_keep_ratio(1.0), last_step_error(0.0), second_last_step_error(0.0),
+      workspace_ndof(0), K_vector(NULL), u_ext_vec(NULL), vector_left(NULL), sln_coeff_vec(NULL), decoupled_increment(NULL)
     {
       for(unsigned int i = 0; i < spaces.size(); i++)
       {
@@ -47,15 +199,7 @@ namespace Hermes
       // Create matrix solver.
       solver = create_linear_solver(matrix_right, vector_right);
 
-      // Vector K_vector of length num_stages * ndof. will represent
-      // the 'K_i' vectors in the usual R-K notation.
-      K_vector = new Scalar[num_stages * Space<Scalar>::get_num_dofs(this->spaces)];
-
-      // Vector u_ext_vec will represent h \sum_{j = 1}^s a_{ij} K_i.
-      u_ext_vec = new Scalar[num_stages * Space<Scalar>::get_num_dofs(this->spaces)];
-
-      // Vector for the left part of the residual.
-      vector_left = new Scalar[num_stages*  Space<Scalar>::get_num_dofs(this->spaces)];
+      this->ensure_workspace(Space<Scalar>::get_num_dofs(this->spaces));
 
       this->stage_dp_left = NULL;
       this->stage_dp_right = NULL;
@@ -65,7 +209,16 @@ namespace Hermes
     RungeKutta<Scalar>::RungeKutta(const WeakForm<Scalar>* wf, const Space<Scalar>* space, ButcherTable* bt)
       : wf(wf), bt(bt), num_stages(bt->get_size()), stage_wf_right(bt->get_size() * 1),
       stage_wf_left(1), start_from_zero_K_vector(false), block_diagonal_jacobian(false), residual_as_vector(true), iteration(0),
-      freeze_jacobian(false), newton_tol(1e-6), newton_max_iter(20), newton_damping_coeff(1.0), newton_max_allowed_residual_norm(1e10)
+      freeze_jacobian(false), newton_tol(1e-6), newton_max_iter(20), newton_damping_coeff(1.0), newton_max_allowed_residual_norm(1e10),
+      jacobian_reuse(false), max_jacobian_reuse_contraction_rate(0.5), jacobian_factorized(false), num_saved_factorizations(0),
+      decoupled_stages(false), schur_Q(NULL), schur_R(NULL), stage_jacobian(NULL),
+      time_independent_jacobian(false), time_independent_jacobian_linear(false), stationary_jacobian(NULL), stationary_jacobian_time(0.0),
+      stage_matrix_structure_valid(false), stage_matrix_time_step(-1.0), lumped_mass(false), explicit_wf(NULL), explicit_dp(NULL),
+      explicit_rhs(NULL), mass_solver(NULL), lumped_mass_inverse(NULL), l2_mass_inverse(NULL),
+      adaptive_rel_tol(0.0), adaptive_abs_tol(0.0), min_time_step(0.0), max_time_step(0.0), controller_k_integral(0.15),
+      controller_k_proportional(0.2), controller_k_derivative(0.0), controller_safety(0.9), controller_min_factor(0.2),
+      controller_max_factor(5.0), time_step_keep_ratio(1.0), last_step_error(0.0), second_last_step_error(0.0),
+      workspace_ndof(0), K_vector(NULL), u_ext_vec(NULL), vector_left(NULL), sln_coeff_vec(NULL), decoupled_increment(NULL)
     {
       this->spaces.push_back(space);
       this->spaces_seqs.push_back(space->get_seq());
@@ -81,15 +234,7 @@ namespace Hermes
       // Create matrix solver.
       solver = create_linear_solver(matrix_right, vector_right);
 
-      // Vector K_vector of length num_stages * ndof. will represent
-      // the 'K_i' vectors in the usual R-K notation.
-      K_vector = new Scalar[num_stages * Space<Scalar>::get_num_dofs(spaces)];
-
-      // Vector u_ext_vec will represent h \sum_{j = 1}^s a_{ij} K_i.
-      u_ext_vec = new Scalar[num_stages * Space<Scalar>::get_num_dofs(spaces)];
-
-      // Vector for the left part of the residual.
-      vector_left = new Scalar[num_stages*  Space<Scalar>::get_num_dofs(spaces)];
+      this->ensure_workspace(Space<Scalar>::get_num_dofs(this->spaces));
 
       this->stage_dp_left = NULL;
       this->stage_dp_right = NULL;
@@ -115,15 +260,18 @@ namespace Hermes
 
       if(delete_K_vector)
       {
-        delete [] K_vector;
-        K_vector = new Scalar[num_stages * Space<Scalar>::get_num_dofs(this->spaces)];
+        this->jacobian_factorized = false;
+        this->stage_matrix_structure_valid = false;
+        this->stage_matrix_time_step = -1.0;
+        if(this->stationary_jacobian != NULL)
+        {
+          delete this->stationary_jacobian;
+          this->stationary_jacobian = NULL;
+        }
+        this->ensure_workspace(Space<Scalar>::get_num_dofs(this->spaces));
         this->info("\tRunge-Kutta: K vectors are being set to zero, as the spaces changed during computation.");
-        memset(K_vector, 0, num_stages * Space<Scalar>::get_num_dofs(this->spaces) * sizeof(Scalar));
+        Hermes::Algebra::first_touch_zero(K_vector, num_stages * Space<Scalar>::get_num_dofs(this->spaces) * sizeof(Scalar));
       }
-      delete [] u_ext_vec;
-      u_ext_vec = new Scalar[num_stages * Space<Scalar>::get_num_dofs(this->spaces)];
-      delete [] vector_left;
-      vector_left = new Scalar[num_stages*  Space<Scalar>::get_num_dofs(this->spaces)];
 
       if(this->stage_dp_left != NULL)
         static_cast<DiscreteProblem<Scalar>*>(this->stage_dp_left)->set_spaces(this->spaces);
@@ -145,15 +293,18 @@ namespace Hermes
 
       if(delete_K_vector)
       {
-        delete [] K_vector;
-        K_vector = new Scalar[num_stages * Space<Scalar>::get_num_dofs(this->spaces)];
+        this->jacobian_factorized = false;
+        this->stage_matrix_structure_valid = false;
+        this->stage_matrix_time_step = -1.0;
+        if(this->stationary_jacobian != NULL)
+        {
+          delete this->stationary_jacobian;
+          this->stationary_jacobian = NULL;
+        }
+        this->ensure_workspace(Space<Scalar>::get_num_dofs(this->spaces));
         this->info("\tRunge-Kutta: K vector is being set to zero, as the spaces changed during computation.");
-        memset(K_vector, 0, num_stages * Space<Scalar>::get_num_dofs(this->spaces) * sizeof(Scalar));
+        Hermes::Algebra::first_touch_zero(K_vector, num_stages * Space<Scalar>::get_num_dofs(this->spaces) * sizeof(Scalar));
       }
-      delete [] u_ext_vec;
-      u_ext_vec = new Scalar[num_stages * Space<Scalar>::get_num_dofs(this->spaces)];
-      delete [] vector_left;
-      vector_left = new Scalar[num_stages*  Space<Scalar>::get_num_dofs(this->spaces)];
 
       if(this->stage_dp_left != NULL)
         static_cast<DiscreteProblem<Scalar>*>(this->stage_dp_left)->set_space(space);
@@ -190,16 +341,9 @@ namespace Hermes
       // are added to matrix_right and vector_right, respectively.
       this->stage_dp_left = new DiscreteProblem<Scalar>(&stage_wf_left, spaces);
       
-      // All Spaces of the problem.
-      Hermes::vector<const Space<Scalar>*> stage_spaces_vector;
-
       // Create spaces for stage solutions K_i. This is necessary
       // to define a num_stages x num_stages block weak formulation.
-      for (unsigned int i = 0; i < num_stages; i++)
-        for(unsigned int space_i = 0; space_i < spaces.size(); space_i++)
-          stage_spaces_vector.push_back(spaces[space_i]);
-
-      this->stage_dp_right = new DiscreteProblem<Scalar>(&stage_wf_right, stage_spaces_vector);
+      this->update_stage_spaces();
 
       stage_dp_right->set_RK(spaces.size());
 
@@ -210,6 +354,76 @@ namespace Hermes
             residuals_vector.push_back(new Solution<Scalar>(spaces[sln_i]->get_mesh()));
     }
 
+    template<typename Scalar>
+    void RungeKutta<Scalar>::ensure_workspace(unsigned int ndof)
+    {
+      if(ndof <= this->workspace_ndof)
+        return;
+
+      // The contents are not kept, K_vector is zeroed by the callers whenever the spaces change.
+      delete [] K_vector;
+      delete [] u_ext_vec;
+      delete [] vector_left;
+      delete [] sln_coeff_vec;
+      delete [] decoupled_increment;
+
+      // Vector K_vector of length num_stages * ndof. will represent
+      // the 'K_i' vectors in the usual R-K notation.
+      K_vector = new Scalar[num_stages * ndof];
+
+      // Vector u_ext_vec will represent h \sum_{j = 1}^s a_{ij} K_i.
+      u_ext_vec = new Scalar[num_stages * ndof];
+
+      // Vector for the left part of the residual.
+      vector_left = new Scalar[num_stages * ndof];
+
+      sln_coeff_vec = new Scalar[ndof];
+      decoupled_increment = new Scalar[num_stages * ndof];
+
+      this->workspace_ndof = ndof;
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::update_stage_spaces()
+    {
+      bool spaces_changed = (this->stage_spaces.size() != num_stages * spaces.size());
+      for(unsigned int space_i = 0; !spaces_changed && space_i < spaces.size(); space_i++)
+        if(this->stage_spaces_seqs[space_i] != spaces[space_i]->get_seq())
+          spaces_changed = true;
+
+      if(!spaces_changed)
+      {
+        // Only the values of the essential boundary conditions (at the current time) may differ.
+        for(unsigned int i = 0; i < this->stage_spaces.size(); i++)
+          this->stage_spaces[i]->update_essential_bc_values();
+        return;
+      }
+
+      Hermes::vector<Space<Scalar>*> old_stage_spaces = this->stage_spaces;
+      this->stage_spaces.clear();
+      this->stage_spaces_seqs.clear();
+
+      Hermes::vector<const Space<Scalar>*> stage_spaces_vector;
+      for (unsigned int i = 0; i < num_stages; i++)
+        for(unsigned int space_i = 0; space_i < spaces.size(); space_i++)
+        {
+          typename Space<Scalar>::ReferenceSpaceCreator ref_space_creator(spaces[space_i], spaces[space_i]->get_mesh(), 0);
+          this->stage_spaces.push_back(ref_space_creator.create_ref_space());
+          stage_spaces_vector.push_back(this->stage_spaces.back());
+        }
+      for(unsigned int space_i = 0; space_i < spaces.size(); space_i++)
+        this->stage_spaces_seqs.push_back(spaces[space_i]->get_seq());
+
+      if(this->stage_dp_right == NULL)
+        this->stage_dp_right = new DiscreteProblem<Scalar>(&stage_wf_right, stage_spaces_vector);
+      else
+        this->stage_dp_right->set_spaces(stage_spaces_vector);
+
+      // The discrete problem does not reference the previous copies any more.
+      for(unsigned int i = 0; i < old_stage_spaces.size(); i++)
+        delete old_stage_spaces[i];
+    }
+
     template<typename Scalar>
     void RungeKutta<Scalar>::set_start_from_zero_K_vector()
     {
@@ -233,6 +447,93 @@ namespace Hermes
     {
       this->freeze_jacobian = true;
     }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::set_jacobian_reuse(bool onOff, double max_contraction_rate)
+    {
+      if(max_contraction_rate <= 0.0 || max_contraction_rate > 1.0)
+        throw Exceptions::ValueException("max_contraction_rate", max_contraction_rate, 0.0, 1.0);
+      this->jacobian_reuse = onOff;
+      this->max_jacobian_reuse_contraction_rate = max_contraction_rate;
+      this->jacobian_factorized = false;
+    }
+
+    template<typename Scalar>
+    unsigned int RungeKutta<Scalar>::get_num_saved_factorizations() const
+    {
+      return this->num_saved_factorizations;
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::set_decoupled_stages(bool onOff)
+    {
+      this->decoupled_stages = onOff;
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::set_time_independent_jacobian(bool onOff, bool linear)
+    {
+      this->time_independent_jacobian = onOff;
+      this->time_independent_jacobian_linear = linear;
+      this->stage_matrix_time_step = -1.0;
+      if(this->stationary_jacobian != NULL)
+      {
+        delete this->stationary_jacobian;
+        this->stationary_jacobian = NULL;
+      }
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::set_lumped_mass(bool onOff)
+    {
+      this->lumped_mass = onOff;
+      this->explicit_mass_seqs.clear();
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::set_adaptive_time_stepping(double rel_tol, double abs_tol)
+    {
+      if(rel_tol < 0.0 || abs_tol < 0.0 || (rel_tol == 0.0 && abs_tol == 0.0))
+        throw Exceptions::Exception("Runge-Kutta: the tolerances of the adaptive time stepping must be nonnegative, and not both zero.");
+      this->adaptive_rel_tol = rel_tol;
+      this->adaptive_abs_tol = abs_tol;
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::set_time_step_bounds(double min_time_step, double max_time_step)
+    {
+      if(max_time_step > 0.0 && max_time_step < min_time_step)
+        throw Exceptions::ValueException("max_time_step", max_time_step, min_time_step);
+      this->min_time_step = min_time_step;
+      this->max_time_step = max_time_step;
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::set_time_step_controller(double k_integral, double k_proportional, double k_derivative,
+      double safety, double min_factor, double max_factor)
+    {
+      if(safety <= 0.0 || safety > 1.0)
+        throw Exceptions::ValueException("safety", safety, 0.0, 1.0);
+      if(min_factor <= 0.0 || min_factor > 1.0)
+        throw Exceptions::ValueException("min_factor", min_factor, 0.0, 1.0);
+      if(max_factor < 1.0)
+        throw Exceptions::ValueException("max_factor", max_factor, 1.0);
+      this->controller_k_integral = k_integral;
+      this->controller_k_proportional = k_proportional;
+      this->controller_k_derivative = k_derivative;
+      this->controller_safety = safety;
+      this->controller_min_factor = min_factor;
+      this->controller_max_factor = max_factor;
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::set_max_time_step_ratio_without_rebuild(double ratio)
+    {
+      if(ratio < 1.0)
+        throw Exceptions::ValueException("ratio", ratio, 1.0);
+      this->time_step_keep_ratio = ratio;
+    }
+
     template<typename Scalar>
     void RungeKutta<Scalar>::set_newton_tol(double newton_tol)
     {
@@ -261,6 +562,28 @@ namespace Hermes
         delete stage_dp_left;
       if(stage_dp_right != NULL)
         delete stage_dp_right;
+      for(unsigned int i = 0; i < stage_spaces.size(); i++)
+        delete stage_spaces[i];
+      for(unsigned int i = 0; i < residuals_vector.size(); i++)
+        delete residuals_vector[i];
+      this->free_decoupled_stage_matrices();
+      this->free_explicit_mass();
+      if(explicit_dp != NULL)
+      {
+        delete explicit_dp;
+        delete explicit_wf;
+      }
+      if(mass_solver != NULL)
+        delete mass_solver;
+      if(explicit_rhs != NULL)
+        delete explicit_rhs;
+      if(stationary_jacobian != NULL)
+        delete stationary_jacobian;
+      if(schur_Q != NULL)
+      {
+        delete [] schur_Q;
+        delete [] schur_R;
+      }
       delete solver;
       delete matrix_right;
       delete matrix_left;
@@ -268,6 +591,8 @@ namespace Hermes
       delete [] K_vector;
       delete [] u_ext_vec;
       delete [] vector_left;
+      delete [] sln_coeff_vec;
+      delete [] decoupled_increment;
     }
 
     template<typename Scalar>
@@ -322,41 +647,50 @@ namespace Hermes
 
       info("\tRunge-Kutta: time step, time: %f, time step: %f", this->time, this->time_step);
 
+      this->clear_iteration_records();
+
       // Set the correct time to the essential boundary conditions.
       for (unsigned int stage_i = 0; stage_i < num_stages; stage_i++)
         Space<Scalar>::update_essential_bc_values(spaces_mutable, this->time + bt->get_C(stage_i)*this->time_step);
 
-      // All Spaces of the problem.
-      Hermes::vector<const Space<Scalar>*> stage_spaces_vector;
-
-      // Create spaces for stage solutions K_i. This is necessary
-      // to define a num_stages x num_stages block weak formulation.
-      for (unsigned int i = 0; i < num_stages; i++)
-        for(unsigned int space_i = 0; space_i < spaces.size(); space_i++)
-        {
-          typename Space<Scalar>::ReferenceSpaceCreator ref_space_creator(spaces[space_i], spaces[space_i]->get_mesh(), 0);
-          stage_spaces_vector.push_back(ref_space_creator.create_ref_space());
-        }
+      // The stages of explicit methods do not need the Newton's method.
+      if(bt->is_explicit())
+      {
+        this->rk_explicit_stages(slns_time_prev, slns_time_new);
+        this->finish_time_step(slns_time_prev, slns_time_new, error_fns);
+        return;
+      }
 
-      this->stage_dp_right->set_spaces(stage_spaces_vector);
+      // Spaces for stage solutions K_i, recreated only when the spaces changed.
+      this->update_stage_spaces();
 
       // Zero utility vectors.
       if(start_from_zero_K_vector || !iteration)
-        memset(K_vector, 0, num_stages * ndof * sizeof(Scalar));
-      memset(u_ext_vec, 0, num_stages * ndof * sizeof(Scalar));
-      memset(vector_left, 0, num_stages * ndof * sizeof(Scalar));
+        Hermes::Algebra::first_touch_zero(K_vector, num_stages * ndof * sizeof(Scalar));
+      Hermes::Algebra::first_touch_zero(u_ext_vec, num_stages * ndof * sizeof(Scalar));
+      Hermes::Algebra::first_touch_zero(vector_left, num_stages * ndof * sizeof(Scalar));
 
       // Assemble the block-diagonal mass matrix M of size ndof times ndof.
       // The corresponding part of the global residual vector is obtained
       // just by multiplication with the stage vector K.
-      // FIXME: This should not be repeated if spaces have not changed.
-      stage_dp_left->assemble(matrix_left, NULL);
+      this->assemble_mass_matrix();
+
+      // The decoupled stage matrices are kept for all the Newton's iterations of the time step.
+      if(this->decoupled_stages)
+        this->assemble_decoupled_stage_matrices(slns_time_prev);
 
       // The Newton's loop.
-      double residual_norm;
+      double residual_norm = 0.0;
+      double last_residual_norm = 0.0;
       int it = 1;
+      unsigned int saved_factorizations = 0;
+      Hermes::Solvers::IterSolver<Scalar>* iter_solver = dynamic_cast<Hermes::Solvers::IterSolver<Scalar>*>(solver);
+      Hermes::Mixins::TimeMeasurable iteration_timer;
       while (true)
       {
+        this->add_iteration_record(it).damping_coefficient = newton_damping_coeff;
+        iteration_timer.tick(Hermes::Mixins::TimeMeasurable::HERMES_SKIP);
+
         // Prepare vector h\sum_{j = 1}^s a_{ij} K_j.
         prepare_u_ext_vec();
 
@@ -379,23 +713,16 @@ namespace Hermes
 
         // Finalizing the residual vector.
         vector_right->add_vector(vector_left);
+        iteration_timer.tick();
+        this->last_iteration_record().assembly_time = iteration_timer.last();
 
         // Multiply the residual vector with -1 since the matrix
         // equation reads J(Y^n) \deltaY^{n + 1} = -F(Y^n).
         vector_right->change_sign();
-        if(this->output_rhsOn && (this->output_rhsIterations == -1 || this->output_rhsIterations >= it))
-        {
-          char* fileName = new char[this->RhsFilename.length() + 5];
-          if(this->RhsFormat == Hermes::Algebra::DF_MATLAB_SPARSE)
-            sprintf(fileName, "%s%i.m", this->RhsFilename.c_str(), it);
-          else
-            sprintf(fileName, "%s%i", this->RhsFilename.c_str(), it);
-          FILE* rhs_file = fopen(fileName, "w+");
-          vector_right->dump(rhs_file, this->RhsVarname.c_str(), this->RhsFormat, this->rhs_number_format);
-          fclose(rhs_file);
-        }
+        this->process_vector_output(vector_right, it);
 
         // Measure the residual norm.
+        last_residual_norm = residual_norm;
         if(residual_as_vector)
           // Calculate the l2-norm of residual vector.
           residual_norm = Global<Scalar>::get_l2_norm(vector_right);
@@ -410,6 +737,8 @@ namespace Hermes
           residual_norm = Global<Scalar>::calc_norms(residuals_vector);
         }
 
+        this->last_iteration_record().residual_norm = residual_norm;
+
         // Info for the user.
         if(it == 1)
           this->info("\tRunge-Kutta: Newton initial residual norm: %g", residual_norm);
@@ -427,39 +756,83 @@ namespace Hermes
         if((residual_norm < newton_tol || it > newton_max_iter) && it > 1)
           break;
 
+        if(this->decoupled_stages)
+        {
+          iteration_timer.tick(Hermes::Mixins::TimeMeasurable::HERMES_SKIP);
+          this->solve_decoupled_stages(this->decoupled_increment);
+          iteration_timer.tick();
+          this->last_iteration_record().solve_time = iteration_timer.last();
+          for (unsigned int i = 0; i < num_stages*ndof; i++)
+            K_vector[i] += newton_damping_coeff * this->decoupled_increment[i];
+          it++;
+          continue;
+        }
+
         bool rhs_only = (freeze_jacobian && it > 1);
+
+        // The Jacobian (and its factorization) from the previous iteration is reused if the residual norm contracted enough.
+        bool reuse_jacobian = false;
+        if(!rhs_only && this->jacobian_reuse && this->jacobian_factorized && matrix_right->get_size() == num_stages * ndof)
+          reuse_jacobian = rhs_only = (it == 1) || (residual_norm < this->max_jacobian_reuse_contraction_rate * last_residual_norm);
+
+        // The stage matrix by scaling only changes with the time step and with the stationary Jacobian.
+        if(!rhs_only && this->can_scale_stationary_jacobian() && this->stage_matrix_time_step == this->time_step
+          && (this->time_independent_jacobian_linear || (this->stationary_jacobian != NULL && this->stationary_jacobian_time == this->time)))
+          rhs_only = true;
+
         if(!rhs_only)
         {
-          // Assemble the block Jacobian matrix of the stationary residual F
-          // Diagonal blocks are created even if empty, so that matrix_left
-          // can be added later.
-          stage_dp_right->assemble(u_ext_vec, matrix_right, NULL, force_diagonal_blocks);
+          iteration_timer.tick(Hermes::Mixins::TimeMeasurable::HERMES_SKIP);
+          if(this->can_scale_stationary_jacobian())
+          {
+            this->scale_stationary_jacobian(slns_time_prev);
+            this->stage_matrix_time_step = this->time_step;
+          }
+          else
+          {
+            // Assemble the block Jacobian matrix of the stationary residual F
+            // Diagonal blocks are created even if empty, so that matrix_left
+            // can be added later.
+            stage_dp_right->assemble(u_ext_vec, matrix_right, NULL, force_diagonal_blocks);
+            this->stage_matrix_structure_valid = true;
+            // Of a linear problem, this is the same matrix as the one by scaling.
+            this->stage_matrix_time_step = this->time_independent_jacobian_linear ? this->time_step : -1.0;
+          }
 
           // Adding the block mass matrix M to matrix_right. This completes the
           // resulting tensor Jacobian.
           matrix_right->add_sparse_to_diagonal_blocks(num_stages, matrix_left);
 
-          if(this->output_matrixOn && (this->output_matrixIterations == -1 || this->output_matrixIterations >= it))
-          {
-            char* fileName = new char[this->matrixFilename.length() + 5];
-            if(this->matrixFormat == Hermes::Algebra::DF_MATLAB_SPARSE)
-              sprintf(fileName, "%s%i.m", this->matrixFilename.c_str(), it);
-            else
-              sprintf(fileName, "%s%i", this->matrixFilename.c_str(), it);
-            FILE* matrix_file = fopen(fileName, "w+");
-
-            matrix_right->dump(matrix_file, this->matrixVarname.c_str(), this->matrixFormat, this->matrix_number_format);
-            fclose(matrix_file);
-          }
+          this->process_matrix_output(matrix_right, it);
 
           matrix_right->finish();
+          iteration_timer.tick();
+          this->last_iteration_record().assembly_time += iteration_timer.last();
+
+          if(this->jacobian_reuse || this->time_independent_jacobian)
+            solver->set_factorization_scheme(HERMES_FACTORIZE_FROM_SCRATCH);
+          if(this->jacobian_reuse)
+            this->jacobian_factorized = true;
         }
         else
+        {
           solver->set_factorization_scheme(HERMES_REUSE_FACTORIZATION_COMPLETELY);
+          if(reuse_jacobian)
+          {
+            saved_factorizations++;
+            this->num_saved_factorizations++;
+          }
+        }
 
         // Solve the linear system.
+        iteration_timer.tick(Hermes::Mixins::TimeMeasurable::HERMES_SKIP);
         if(!solver->solve())
           throw Exceptions::LinearMatrixSolverException();
+        iteration_timer.tick();
+        this->last_iteration_record().solve_time = iteration_timer.last();
+        this->last_iteration_record().factorization_reused = rhs_only;
+        if(iter_solver != NULL)
+          this->last_iteration_record().linear_iterations = iter_solver->get_num_iters();
 
         // Add \deltaK^{n + 1} to K^n.
         for (unsigned int i = 0; i < num_stages*ndof; i++)
@@ -469,6 +842,9 @@ namespace Hermes
         it++;
       }
 
+      if(this->jacobian_reuse)
+        this->info("\tRunge-Kutta: Jacobian reused in %d iterations, %d factorizations saved in total.", saved_factorizations, this->num_saved_factorizations);
+
       // If max number of iterations was exceeded, fail.
       if(it >= newton_max_iter)
       {
@@ -477,23 +853,22 @@ namespace Hermes
         throw Exceptions::ValueException("Newton iterations", it, newton_max_iter);
       }
 
+      this->finish_time_step(slns_time_prev, slns_time_new, error_fns);
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::finish_time_step(Hermes::vector<Solution<Scalar>*> slns_time_prev,
+                                          Hermes::vector<Solution<Scalar>*> slns_time_new,
+                                          Hermes::vector<Solution<Scalar>*> error_fns)
+    {
+      int ndof = Space<Scalar>::get_num_dofs(spaces);
+
       // Project previous time level solution on the stage space,
       // to be able to add them together. The result of the projection
       // will be stored in the vector coeff_vec.
       // FIXME - this projection is not needed when the
       //         spaces are the same (if spatial adaptivity is not used).
-      Scalar* coeff_vec = new Scalar[ndof];
-      if(do_global_projections)
-      {
-        OGProjection<Scalar> ogProjection;
-        ogProjection.project_global(spaces, slns_time_prev, coeff_vec);
-      }
-      else
-      {
-        LocalProjection<Scalar> ogProjection;
-        ogProjection.project_local(spaces, slns_time_prev, coeff_vec);
-      }
-
+      Scalar* coeff_vec = this->sln_coeff_vec;
       if(do_global_projections)
       {
         OGProjection<Scalar> ogProjection;
@@ -526,18 +901,6 @@ namespace Hermes
         Solution<Scalar>::vector_to_solutions_common_dir_lift(coeff_vec, spaces, error_fns);
       }
 
-      // Delete stage spaces.
-      for (unsigned int i = 0; i < num_stages * spaces.size(); i++)
-          delete stage_spaces_vector[i];
-
-      // Delete all residuals.
-      if(!residual_as_vector)
-        for (unsigned int i = 0; i < num_stages; i++)
-          delete residuals_vector[i];
-
-      // Clean up.
-      delete [] coeff_vec;
-
       iteration++;
       this->tick();
       this->info("\tRunge-Kutta: time step duration: %f s.\n", this->last());
@@ -721,8 +1084,11 @@ namespace Hermes
       Hermes::vector<VectorFormVol<Scalar> *> vfvol = stage_wf_right.vfvol;
       Hermes::vector<VectorFormSurf<Scalar> *> vfsurf = stage_wf_right.vfsurf;
 
+      // The previous time level solutions are the (only) external functions of the stage weak formulation,
+      // they are replaced in place so that ext does not grow with the number of time steps.
+      stage_wf_right.ext.resize(slns_time_prev.size());
       for(unsigned int slns_time_prev_i = 0; slns_time_prev_i < slns_time_prev.size(); slns_time_prev_i++)
-          stage_wf_right.ext.push_back(slns_time_prev[slns_time_prev_i]);
+        stage_wf_right.ext[slns_time_prev_i] = slns_time_prev[slns_time_prev_i];
 
       // Duplicate matrix volume forms, scale them according
       // to the Butcher's table, enhance them with additional
@@ -765,6 +1131,490 @@ namespace Hermes
       }
     }
 
+    template<typename Scalar>
+    void RungeKutta<Scalar>::init_schur_form()
+    {
+      schur_R = new_matrix<double>(num_stages, num_stages);
+      schur_Q = new_matrix<double>(num_stages, num_stages);
+      for (unsigned int i = 0; i < num_stages; i++)
+        for (unsigned int j = 0; j < num_stages; j++)
+          schur_R[i][j] = bt->get_A(i, j);
+      Hermes::Algebra::DenseMatrixOperations::real_schur(schur_R, num_stages, schur_Q);
+
+      // The diagonal blocks, the equal ones share the matrix.
+      schur_block_starts.clear();
+      schur_block_owners.clear();
+      for (unsigned int stage_i = 0; stage_i < num_stages; )
+      {
+        unsigned int block_size = (stage_i + 1 < num_stages && schur_R[stage_i + 1][stage_i] != 0.0) ? 2 : 1;
+        unsigned int owner = schur_block_starts.size();
+        for (unsigned int block_i = 0; block_i < schur_block_starts.size(); block_i++)
+        {
+          unsigned int start = schur_block_starts[block_i];
+          if(schur_block_owners[block_i] != block_i || (block_i + 1 < schur_block_starts.size() ? schur_block_starts[block_i + 1] : stage_i) - start != block_size)
+            continue;
+          bool equal = true;
+          for (unsigned int i = 0; i < block_size; i++)
+            for (unsigned int j = 0; j < block_size; j++)
+              if(std::abs(schur_R[start + i][start + j] - schur_R[stage_i + i][stage_i + j]) > 1e-12)
+                equal = false;
+          if(equal)
+          {
+            owner = block_i;
+            break;
+          }
+        }
+        schur_block_starts.push_back(stage_i);
+        schur_block_owners.push_back(owner);
+        stage_i += block_size;
+      }
+      schur_block_starts.push_back(num_stages);
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::assemble_stage_block(double** block_table, unsigned int block_size, SparseMatrix<Scalar>* matrix,
+      Hermes::vector<Solution<Scalar>*> slns_time_prev, SparsityPattern* pattern)
+    {
+      unsigned int neq = spaces.size();
+      WeakForm<Scalar> block_wf(block_size * neq);
+      block_wf.set_verbose_output(this->get_verbose_output());
+      if(this->wf->global_integration_order_set)
+        block_wf.set_global_integration_order(this->wf->global_integration_order);
+
+      // The same blocks as in create_stage_wf(), with the Jacobian evaluated at the previous time level.
+      for (unsigned int i = 0; i < block_size; i++)
+      {
+        for (unsigned int j = 0; j < block_size; j++)
+        {
+          if(block_table[i][j] == 0.0)
+            continue;
+
+          for (unsigned int m = 0; m < wf->mfvol.size(); m++)
+          {
+            MatrixFormVol<Scalar>* mfv_ij = wf->mfvol[m]->clone();
+            mfv_ij->i = mfv_ij->i + i * neq;
+            mfv_ij->j = mfv_ij->j + j * neq;
+            mfv_ij->u_ext_offset = i * neq;
+            mfv_ij->scaling_factor = block_table[i][j];
+            mfv_ij->set_current_stage_time(this->time);
+            block_wf.add_matrix_form(mfv_ij);
+          }
+
+          for (unsigned int m = 0; m < wf->mfsurf.size(); m++)
+          {
+            MatrixFormSurf<Scalar>* mfs_ij = wf->mfsurf[m]->clone();
+            mfs_ij->i = mfs_ij->i + i * neq;
+            mfs_ij->j = mfs_ij->j + j * neq;
+            mfs_ij->u_ext_offset = i * neq;
+            mfs_ij->scaling_factor = block_table[i][j];
+            mfs_ij->set_current_stage_time(this->time);
+            block_wf.add_matrix_form_surf(mfs_ij);
+          }
+        }
+      }
+
+      for(unsigned int slns_time_prev_i = 0; slns_time_prev_i < slns_time_prev.size(); slns_time_prev_i++)
+        block_wf.ext.push_back(slns_time_prev[slns_time_prev_i]);
+
+      Hermes::vector<const Space<Scalar>*> block_spaces;
+      for (unsigned int i = 0; i < block_size; i++)
+        for(unsigned int space_i = 0; space_i < neq; space_i++)
+          block_spaces.push_back(spaces[space_i]);
+
+      DiscreteProblem<Scalar> block_dp(&block_wf, block_spaces);
+      block_dp.set_RK(neq);
+      block_dp.set_sparsity_pattern(pattern);
+
+      // Zero stage increments, i.e. the previous time level solutions.
+      int block_ndof = block_size * Space<Scalar>::get_num_dofs(spaces);
+      Scalar* zero_vec = new Scalar[block_ndof];
+      memset(zero_vec, 0, block_ndof * sizeof(Scalar));
+      block_dp.assemble(zero_vec, matrix, NULL, true);
+      delete [] zero_vec;
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::assemble_decoupled_stage_matrices(Hermes::vector<Solution<Scalar>*> slns_time_prev)
+    {
+      if(schur_R == NULL)
+        this->init_schur_form();
+      this->free_decoupled_stage_matrices();
+
+      unsigned int num_blocks = schur_block_owners.size();
+      double** block_table = new_matrix<double>(2, 2);
+
+      // The matrices of the single stages (and the Jacobian) share one pattern, the one of the Jacobian
+      // with all its blocks, i.e. of a block assembled with a nonzero multiplier.
+      SparsityPattern* pattern = NULL;
+
+      // The blocks are coupled by the Jacobian through the entries of schur_R above the diagonal blocks.
+      bool coupled = false;
+      for (unsigned int block_i = 0; block_i < num_blocks; block_i++)
+        for (unsigned int i = schur_block_starts[block_i]; i < schur_block_starts[block_i + 1]; i++)
+          for (unsigned int j = schur_block_starts[block_i + 1]; j < num_stages; j++)
+            if(schur_R[i][j] != 0.0)
+              coupled = true;
+      if(coupled)
+      {
+        block_table[0][0] = 1.0;
+        stage_jacobian = create_matrix<Scalar>();
+        this->assemble_stage_block(block_table, 1, stage_jacobian, slns_time_prev);
+        stage_jacobian->finish();
+        pattern = stage_jacobian->get_sparsity_pattern();
+      }
+
+      for (unsigned int block_i = 0; block_i < num_blocks; block_i++)
+      {
+        SparseMatrix<Scalar>* matrix = NULL;
+        Vector<Scalar>* rhs = NULL;
+        LinearMatrixSolver<Scalar>* block_solver = NULL;
+        if(schur_block_owners[block_i] == block_i)
+        {
+          // I x M - h R_ii x J.
+          unsigned int start = schur_block_starts[block_i];
+          unsigned int block_size = schur_block_starts[block_i + 1] - start;
+          for (unsigned int i = 0; i < block_size; i++)
+            for (unsigned int j = 0; j < block_size; j++)
+              block_table[i][j] = -this->time_step * schur_R[start + i][start + j];
+
+          matrix = create_matrix<Scalar>();
+          rhs = create_vector<Scalar>();
+          if(block_size == 1)
+          {
+            this->assemble_stage_block(block_table, 1, matrix, slns_time_prev, pattern);
+            if(pattern == NULL && block_table[0][0] != 0.0)
+              pattern = matrix->get_sparsity_pattern();
+          }
+          else
+            this->assemble_stage_block(block_table, block_size, matrix, slns_time_prev);
+          matrix->add_sparse_to_diagonal_blocks(block_size, matrix_left);
+          matrix->finish();
+          block_solver = create_linear_solver(matrix, rhs);
+        }
+        schur_block_matrices.push_back(matrix);
+        schur_block_rhs.push_back(rhs);
+        schur_block_solvers.push_back(block_solver);
+        schur_block_factorized.push_back(false);
+      }
+
+      delete [] block_table;
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::solve_decoupled_stages(Scalar* increment)
+    {
+      unsigned int ndof = Space<Scalar>::get_num_dofs(spaces);
+      unsigned int num_blocks = schur_block_owners.size();
+
+      Scalar* residual = new Scalar[num_stages * ndof];
+      vector_right->extract(residual);
+
+      // Transformed residual Q^T r and the transformed increment w.
+      Scalar* transformed = new Scalar[num_stages * ndof];
+      memset(transformed, 0, num_stages * ndof * sizeof(Scalar));
+      for (unsigned int i = 0; i < num_stages; i++)
+        for (unsigned int k = 0; k < num_stages; k++)
+          if(schur_Q[k][i] != 0.0)
+            for (unsigned int idx = 0; idx < ndof; idx++)
+              transformed[i * ndof + idx] += schur_Q[k][i] * residual[k * ndof + idx];
+
+      // J w of the stages solved already.
+      Scalar* jacobian_times_w = (stage_jacobian != NULL) ? new Scalar[num_stages * ndof] : NULL;
+      Scalar* w = residual;
+
+      // The block back substitution: (I x M - h R_ii x J) w_i = (Q^T r)_i + h sum_{j > i} R_ij J w_j.
+      for (int block_i = num_blocks - 1; block_i >= 0; block_i--)
+      {
+        unsigned int start = schur_block_starts[block_i];
+        unsigned int end = schur_block_starts[block_i + 1];
+        unsigned int owner = schur_block_owners[block_i];
+
+        for (unsigned int i = start; i < end; i++)
+          for (unsigned int j = end; j < num_stages; j++)
+            if(schur_R[i][j] != 0.0)
+              for (unsigned int idx = 0; idx < ndof; idx++)
+                transformed[i * ndof + idx] += this->time_step * schur_R[i][j] * jacobian_times_w[j * ndof + idx];
+
+        schur_block_rhs[owner]->alloc((end - start) * ndof);
+        schur_block_rhs[owner]->add_vector(transformed + start * ndof);
+
+        // The factorization is reused by all the Newton's iterations and by all the equal blocks.
+        schur_block_solvers[owner]->set_factorization_scheme(schur_block_factorized[owner] ? HERMES_REUSE_FACTORIZATION_COMPLETELY : HERMES_FACTORIZE_FROM_SCRATCH);
+        if(!schur_block_solvers[owner]->solve())
+        {
+          delete [] residual;
+          delete [] transformed;
+          if(jacobian_times_w != NULL)
+            delete [] jacobian_times_w;
+          throw Exceptions::LinearMatrixSolverException();
+        }
+        schur_block_factorized[owner] = true;
+
+        memcpy(w + start * ndof, schur_block_solvers[owner]->get_sln_vector(), (end - start) * ndof * sizeof(Scalar));
+        if(jacobian_times_w != NULL && start > 0)
+          for (unsigned int i = start; i < end; i++)
+            stage_jacobian->multiply_with_vector(w + i * ndof, jacobian_times_w + i * ndof);
+      }
+
+      // The increment Q w.
+      memset(increment, 0, num_stages * ndof * sizeof(Scalar));
+      for (unsigned int k = 0; k < num_stages; k++)
+        for (unsigned int i = 0; i < num_stages; i++)
+          if(schur_Q[k][i] != 0.0)
+            for (unsigned int idx = 0; idx < ndof; idx++)
+              increment[k * ndof + idx] += schur_Q[k][i] * w[i * ndof + idx];
+
+      delete [] residual;
+      delete [] transformed;
+      if(jacobian_times_w != NULL)
+        delete [] jacobian_times_w;
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::free_decoupled_stage_matrices()
+    {
+      for (unsigned int block_i = 0; block_i < schur_block_solvers.size(); block_i++)
+      {
+        if(schur_block_solvers[block_i] != NULL)
+          delete schur_block_solvers[block_i];
+        if(schur_block_matrices[block_i] != NULL)
+          delete schur_block_matrices[block_i];
+        if(schur_block_rhs[block_i] != NULL)
+          delete schur_block_rhs[block_i];
+      }
+      schur_block_solvers.clear();
+      schur_block_matrices.clear();
+      schur_block_rhs.clear();
+      schur_block_factorized.clear();
+
+      if(stage_jacobian != NULL)
+      {
+        delete stage_jacobian;
+        stage_jacobian = NULL;
+      }
+    }
+
+    template<typename Scalar>
+    bool RungeKutta<Scalar>::can_scale_stationary_jacobian()
+    {
+      return this->time_independent_jacobian && this->stage_matrix_structure_valid && matrix_right->supports_sparse_to_blocks()
+        && matrix_right->get_size() == num_stages * Space<Scalar>::get_num_dofs(spaces);
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::scale_stationary_jacobian(Hermes::vector<Solution<Scalar>*> slns_time_prev)
+    {
+      // Once per time step, or only once for linear problems.
+      if(stationary_jacobian == NULL || (!time_independent_jacobian_linear && stationary_jacobian_time != this->time))
+      {
+        if(stationary_jacobian == NULL)
+          stationary_jacobian = create_matrix<Scalar>();
+        double** block_table = new_matrix<double>(1, 1);
+        block_table[0][0] = 1.0;
+        this->assemble_stage_block(block_table, 1, stationary_jacobian, slns_time_prev);
+        stationary_jacobian->finish();
+        delete [] block_table;
+        stationary_jacobian_time = this->time;
+      }
+
+      // The blocks -h a_ij J, as in update_stage_wf().
+      Scalar** coefficients = new_matrix<Scalar>(num_stages, num_stages);
+      for (unsigned int i = 0; i < num_stages; i++)
+        for (unsigned int j = 0; j < num_stages; j++)
+          coefficients[i][j] = (block_diagonal_jacobian && i != j) ? 0.0 : -this->time_step * bt->get_A(i, j);
+
+      matrix_right->zero();
+      matrix_right->add_sparse_to_blocks(num_stages, stationary_jacobian, coefficients);
+      delete [] coefficients;
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::rk_explicit_stages(Hermes::vector<Solution<Scalar>*> slns_time_prev, Hermes::vector<Solution<Scalar>*> slns_time_new)
+    {
+      unsigned int neq = spaces.size();
+      int ndof = Space<Scalar>::get_num_dofs(spaces);
+
+      // The weak formulation of one stage residual F(t, Y), the stage is set by the stage time and the coefficient vector.
+      if(this->explicit_dp == NULL)
+      {
+        this->explicit_wf = new WeakForm<Scalar>(neq);
+        this->explicit_wf->set_verbose_output(false);
+        if(this->wf->global_integration_order_set)
+          this->explicit_wf->set_global_integration_order(this->wf->global_integration_order);
+        for (unsigned int m = 0; m < wf->vfvol.size(); m++)
+        {
+          VectorFormVol<Scalar>* vfv = wf->vfvol[m]->clone();
+          vfv->scaling_factor = 1.0;
+          vfv->u_ext_offset = 0;
+          this->explicit_wf->add_vector_form(vfv);
+        }
+        for (unsigned int m = 0; m < wf->vfsurf.size(); m++)
+        {
+          VectorFormSurf<Scalar>* vfs = wf->vfsurf[m]->clone();
+          vfs->scaling_factor = 1.0;
+          vfs->u_ext_offset = 0;
+          this->explicit_wf->add_vector_form_surf(vfs);
+        }
+        this->explicit_dp = new DiscreteProblem<Scalar>(this->explicit_wf, spaces);
+        this->explicit_dp->set_RK(neq);
+        this->explicit_rhs = create_vector<Scalar>();
+      }
+
+      // The mass matrix and the stage discrete problem only change with the spaces.
+      bool spaces_changed = (this->explicit_mass_seqs.size() != neq);
+      for (unsigned int space_i = 0; !spaces_changed && space_i < neq; space_i++)
+        if(this->explicit_mass_seqs[space_i] != spaces[space_i]->get_seq())
+          spaces_changed = true;
+      if(spaces_changed)
+      {
+        this->explicit_dp->set_spaces(spaces);
+        this->init_explicit_mass();
+      }
+
+      // The previous time level solutions, to which the stage increments are added.
+      this->explicit_wf->ext.resize(slns_time_prev.size());
+      for(unsigned int slns_time_prev_i = 0; slns_time_prev_i < slns_time_prev.size(); slns_time_prev_i++)
+        this->explicit_wf->ext[slns_time_prev_i] = slns_time_prev[slns_time_prev_i];
+
+      Hermes::Mixins::TimeMeasurable stage_timer;
+      for (unsigned int stage_i = 0; stage_i < num_stages; stage_i++)
+      {
+        // One record per stage, there is no residual.
+        this->add_iteration_record(stage_i + 1).factorization_reused = (stage_i > 0 || !spaces_changed);
+
+        // h \sum_{j < i} a_{ij} K_j, i.e. only the stages already computed.
+        Scalar* stage_increment = u_ext_vec + stage_i * ndof;
+        for (int idx = 0; idx < ndof; idx++)
+        {
+          Scalar increment = 0;
+          for (unsigned int stage_j = 0; stage_j < stage_i; stage_j++)
+            increment += bt->get_A(stage_i, stage_j) * K_vector[stage_j * ndof + idx];
+          stage_increment[idx] = this->time_step * increment;
+        }
+
+        // Reinitialize filters.
+        if(this->filters_to_reinit.size() > 0)
+        {
+          Solution<Scalar>::vector_to_solutions(stage_increment, spaces, slns_time_new);
+
+          for(unsigned int filters_i = 0; filters_i < this->filters_to_reinit.size(); filters_i++)
+            filters_to_reinit.at(filters_i)->reinit();
+        }
+
+        double stage_time = this->time + bt->get_C(stage_i) * this->time_step;
+        for (unsigned int m = 0; m < this->explicit_wf->vfvol.size(); m++)
+          this->explicit_wf->vfvol[m]->set_current_stage_time(stage_time);
+        for (unsigned int m = 0; m < this->explicit_wf->vfsurf.size(); m++)
+          this->explicit_wf->vfsurf[m]->set_current_stage_time(stage_time);
+
+        // M K_i = F(t_n + c_i h, Y_n + h \sum_{j < i} a_{ij} K_j).
+        stage_timer.tick(Hermes::Mixins::TimeMeasurable::HERMES_SKIP);
+        this->explicit_dp->assemble(stage_increment, NULL, this->explicit_rhs);
+        stage_timer.tick();
+        this->last_iteration_record().assembly_time = stage_timer.last();
+        this->solve_explicit_stage(K_vector + stage_i * ndof);
+        stage_timer.tick();
+        this->last_iteration_record().solve_time = stage_timer.last();
+      }
+
+      this->info("\tRunge-Kutta: %d explicit stages computed.", num_stages);
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::init_explicit_mass()
+    {
+      this->free_explicit_mass();
+
+      int ndof = Space<Scalar>::get_num_dofs(spaces);
+
+      bool all_l2 = true;
+      for(unsigned int space_i = 0; space_i < spaces.size(); space_i++)
+        if(spaces[space_i]->get_type() != HERMES_L2_SPACE)
+          all_l2 = false;
+
+      if(all_l2 && !this->lumped_mass)
+      {
+        // The basis functions of L2 spaces do not overlap the elements, M is block diagonal by the elements
+        // and its blocks are integrated and inverted directly.
+        this->l2_mass_inverse = new L2MassInverse<Scalar>(spaces);
+        this->l2_mass_inverse->compute();
+      }
+      else
+      {
+        // The mass matrix M of size ndof times ndof.
+        this->assemble_mass_matrix();
+        matrix_left->finish();
+
+        if(this->lumped_mass)
+        {
+          // The row sums of M.
+          Scalar* ones = new Scalar[ndof];
+          for (int i = 0; i < ndof; i++)
+            ones[i] = 1.0;
+          this->lumped_mass_inverse = new Scalar[ndof];
+          matrix_left->multiply_with_vector(ones, this->lumped_mass_inverse);
+          delete [] ones;
+          for (int i = 0; i < ndof; i++)
+          {
+            if(this->lumped_mass_inverse[i] == 0.0)
+              throw Exceptions::Exception("Runge-Kutta: zero row sum of the mass matrix, the lumped mass matrix can not be used.");
+            this->lumped_mass_inverse[i] = 1.0 / this->lumped_mass_inverse[i];
+          }
+        }
+        else
+        {
+          // M is factorized by the first solve and the factorization is kept until the spaces change.
+          if(this->mass_solver == NULL)
+            this->mass_solver = create_linear_solver(matrix_left, this->explicit_rhs);
+          this->mass_solver->set_factorization_scheme(HERMES_FACTORIZE_FROM_SCRATCH);
+        }
+      }
+
+      for(unsigned int space_i = 0; space_i < spaces.size(); space_i++)
+        this->explicit_mass_seqs.push_back(spaces[space_i]->get_seq());
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::solve_explicit_stage(Scalar* k)
+    {
+      int ndof = Space<Scalar>::get_num_dofs(spaces);
+
+      if(this->lumped_mass_inverse != NULL)
+      {
+        this->explicit_rhs->extract(k);
+        for (int i = 0; i < ndof; i++)
+          k[i] *= this->lumped_mass_inverse[i];
+      }
+      else if(this->l2_mass_inverse != NULL)
+      {
+        this->explicit_rhs->extract(k);
+        this->l2_mass_inverse->apply(k, k);
+      }
+      else
+      {
+        if(!this->mass_solver->solve())
+          throw Exceptions::LinearMatrixSolverException();
+        memcpy(k, this->mass_solver->get_sln_vector(), ndof * sizeof(Scalar));
+        this->mass_solver->set_factorization_scheme(HERMES_REUSE_FACTORIZATION_COMPLETELY);
+      }
+    }
+
+    template<typename Scalar>
+    void RungeKutta<Scalar>::free_explicit_mass()
+    {
+      if(this->lumped_mass_inverse != NULL)
+      {
+        delete [] this->lumped_mass_inverse;
+        this->lumped_mass_inverse = NULL;
+      }
+      if(this->l2_mass_inverse != NULL)
+      {
+        delete this->l2_mass_inverse;
+        this->l2_mass_inverse = NULL;
+      }
+      this->explicit_mass_seqs.clear();
+    }
+
     template<typename Scalar>
     void RungeKutta<Scalar>::prepare_u_ext_vec()
     {
@@ -17,11 +17,12 @@
 #include "quad_all.h"
 #include "precalc.h"
 #include "mesh.h"
+#include "cache_statistics.h"
 namespace Hermes
 {
   namespace Hermes2D
   {
-    PrecalcShapeset::PrecalcShapeset(Shapeset* shapeset) : Function<double>()
+    PrecalcShapeset::PrecalcShapeset(Shapeset* shapeset) : Function<double>(), Mixins::MemoryAccounted(Mixins::H2D_MEMORY_PRECALC_SHAPESET)
     {
       if(shapeset == NULL)
         throw Exceptions::NullException(0);
@@ -30,10 +31,11 @@ namespace Hermes
       num_components = shapeset->get_num_components();
       assert(num_components == 1 || num_components == 2);
       update_max_index();
+      reference_table = get_reference_table(shapeset);
       set_quad_2d(&g_quad_2d_std);
     }
 
-    PrecalcShapeset::PrecalcShapeset(PrecalcShapeset* pss) : Function<double>()
+    PrecalcShapeset::PrecalcShapeset(PrecalcShapeset* pss) : Function<double>(), Mixins::MemoryAccounted(Mixins::H2D_MEMORY_PRECALC_SHAPESET)
     {
       while (pss->is_slave())
         pss = pss->master_pss;
@@ -41,35 +43,165 @@ namespace Hermes
       shapeset = pss->shapeset;
       num_components = pss->num_components;
       update_max_index();
+      reference_table = pss->reference_table;
       set_quad_2d(&g_quad_2d_std);
     }
 
-    void PrecalcShapeset::update_max_index()
+    // Zero-initialized before any dynamic initialization, so that static instances may be constructed first.
+    PrecalcShapeset::ReferenceTables PrecalcShapeset::reference_tables;
+
+    PrecalcShapeset::ReferenceTables::~ReferenceTables()
     {
-      max_index[0] = shapeset->get_max_index(HERMES_MODE_TRIANGLE);
-      max_index[1] = shapeset->get_max_index(HERMES_MODE_QUAD);
+      for(int i = 0; i < H2D_NUM_SHAPESET_IDS; i++)
+        delete tables[i];
     }
 
-    void PrecalcShapeset::set_quad_2d(Quad2D* quad_2d)
+    PrecalcShapeset::ReferenceTable::ReferenceTable(int max_index_tri, int max_index_quad)
     {
-      Function<double>::set_quad_2d(quad_2d);
+      num_indices[HERMES_MODE_TRIANGLE] = max_index_tri + 1;
+      num_indices[HERMES_MODE_QUAD] = max_index_quad + 1;
+      size = 0;
+      for(int mode = 0; mode < H2D_NUM_MODES; mode++)
+      {
+        num_orders[mode] = g_quad_2d_std.get_num_tables((ElementMode2D)mode);
+        offset[mode] = size;
+        size += num_indices[mode] * num_orders[mode] * 2;
+      }
+      nodes = new Node*[size];
+      memset(nodes, 0, size * sizeof(Node*));
+
+      sub_rows = new SubRow[H2D_NUM_SUB_ROWS];
+      memset(sub_rows, 0, H2D_NUM_SUB_ROWS * sizeof(SubRow));
+      num_sub_rows = 0;
     }
 
-    void PrecalcShapeset::handle_overflow_idx()
+    PrecalcShapeset::ReferenceTable::~ReferenceTable()
     {
-      if(overflow_nodes != NULL)
+      for(int i = 0; i < size; i++)
+        if(nodes[i] != NULL)
+        {
+          CacheStatistics::add_bytes(H2D_CACHE_PRECALC, -nodes[i]->size);
+          ::free(nodes[i]);
+        }
+      delete [] nodes;
+
+      for(int i = 0; i < H2D_NUM_SUB_ROWS; i++)
+        if(sub_rows[i].key != 0)
+        {
+          int row_size = num_orders[sub_rows[i].key & 1] * 2;
+          for(int j = 0; j < row_size; j++)
+            if(sub_rows[i].nodes[j] != NULL)
+            {
+              CacheStatistics::add_bytes(H2D_CACHE_PRECALC, -sub_rows[i].nodes[j]->size);
+              ::free(sub_rows[i].nodes[j]);
+            }
+          delete [] sub_rows[i].nodes;
+        }
+      delete [] sub_rows;
+    }
+
+    Function<double>::Node** PrecalcShapeset::ReferenceTable::get_entry(ElementMode2D mode, int index, uint64_t sub_idx, unsigned int order, int level)
+    {
+      if(index < 0 || index >= num_indices[mode] || order >= (unsigned int) num_orders[mode])
+        return NULL;
+
+      if(sub_idx == 0)
+        return nodes + offset[mode] + (index * num_orders[mode] + order) * 2 + level;
+
+      // sub_idx <= H2D_MAX_IDX (use_reference_table()) has at most 45 bits, leaving 18 bits for the index.
+      if(index >= (1 << 18))
+        return NULL;
+      Node** row = get_sub_row((sub_idx << 19) | ((uint64_t) index << 1) | mode, num_orders[mode] * 2);
+      if(row == NULL)
+        return NULL;
+      return row + order * 2 + level;
+    }
+
+    Function<double>::Node** PrecalcShapeset::ReferenceTable::get_sub_row(uint64_t key, int row_size)
+    {
+      unsigned int hash = (unsigned int) ((key * 0x9E3779B97F4A7C15ULL) >> 50);
+
+      // Lock-free lookup, rows are never removed.
+      for(int probe = 0; probe < H2D_NUM_SUB_ROWS; probe++)
       {
-        for(unsigned int i = 0; i < overflow_nodes->get_size(); i++)
-          if(overflow_nodes->present(i))
-            ::free(overflow_nodes->get(i));
-        delete overflow_nodes;
+        SubRow* sub_row = sub_rows + ((hash + probe) & (H2D_NUM_SUB_ROWS - 1));
+        uint64_t row_key = sub_row->key;
+        if(row_key == key)
+        {
+#pragma omp flush
+          return sub_row->nodes;
+        }
+        if(row_key == 0)
+          break;
       }
-      nodes = new LightArray<Node *>;
-      overflow_nodes = nodes;
+
+      Node** row = NULL;
+#pragma omp critical (precalc_reference_table)
+      {
+        for(int probe = 0; probe < H2D_NUM_SUB_ROWS; probe++)
+        {
+          SubRow* sub_row = sub_rows + ((hash + probe) & (H2D_NUM_SUB_ROWS - 1));
+          if(sub_row->key == key)
+          {
+            row = sub_row->nodes;
+            break;
+          }
+          if(sub_row->key == 0)
+          {
+            // Keep the probe sequences short, the caller falls back to its own tables.
+            if(num_sub_rows < H2D_NUM_SUB_ROWS / 4 * 3)
+            {
+              row = new Node*[row_size];
+              memset(row, 0, row_size * sizeof(Node*));
+              sub_row->nodes = row;
+#pragma omp flush
+              sub_row->key = key;
+              num_sub_rows++;
+            }
+            break;
+          }
+        }
+      }
+      return row;
+    }
+
+    PrecalcShapeset::ReferenceTable* PrecalcShapeset::get_reference_table(Shapeset* shapeset)
+    {
+      int id = shapeset->get_id();
+      if(id < 0 || id >= H2D_NUM_SHAPESET_IDS)
+        return NULL;
+
+      ReferenceTable* table;
+#pragma omp critical (precalc_reference_table)
+      {
+        if(reference_tables.tables[id] == NULL)
+          reference_tables.tables[id] = new ReferenceTable(shapeset->get_max_index(HERMES_MODE_TRIANGLE), shapeset->get_max_index(HERMES_MODE_QUAD));
+        table = reference_tables.tables[id];
+      }
+      return table;
+    }
+
+    bool PrecalcShapeset::use_reference_table() const
+    {
+      return reference_table != NULL && sub_idx <= H2D_MAX_IDX && index >= 0 && quads[cur_quad] == &g_quad_2d_std;
+    }
+
+    void PrecalcShapeset::update_max_index()
+    {
+      max_index[0] = shapeset->get_max_index(HERMES_MODE_TRIANGLE);
+      max_index[1] = shapeset->get_max_index(HERMES_MODE_QUAD);
+    }
+
+    void PrecalcShapeset::set_quad_2d(Quad2D* quad_2d)
+    {
+      Function<double>::set_quad_2d(quad_2d);
     }
 
     void PrecalcShapeset::set_active_shape(int index)
     {
+      this->index = index;
+      order = std::max(H2D_GET_H_ORDER(shapeset->get_order(index, element->get_mode())), H2D_GET_V_ORDER(shapeset->get_order(index, element->get_mode())));
+
       // Key creation.
       unsigned key = cur_quad | (element->get_mode() << 3) | ((unsigned) (max_index[element->get_mode()] - index) << 4);
 
@@ -86,11 +218,102 @@ namespace Hermes
         sub_tables = master_pss->tables.get(key);
       }
 
-      // Update the Node table.
-      update_nodes_ptr();
+      // Update the Node table, postponed to set_quad_order() if the shared cache can be used.
+      if(use_reference_table())
+        nodes = NULL;
+      else
+        update_nodes_ptr();
+    }
 
-      this->index = index;
-      order = std::max(H2D_GET_H_ORDER(shapeset->get_order(index, element->get_mode())), H2D_GET_V_ORDER(shapeset->get_order(index, element->get_mode())));
+    void PrecalcShapeset::set_quad_order(unsigned int order, int mask)
+    {
+      if(use_reference_table())
+      {
+        int level = (mask & ~H2D_FN_DEFAULT) ? 1 : 0;
+        Node** entry = reference_table->get_entry(element->get_mode(), index, sub_idx, order, level);
+        if(entry != NULL)
+        {
+          Node* node = *entry;
+          CacheStatistics::lookup(H2D_CACHE_PRECALC, node != NULL);
+          if(node == NULL)
+          {
+#pragma omp critical (precalc_reference_node)
+            {
+              if(*entry == NULL)
+              {
+                node = precalculate_reference(order, level);
+                CacheStatistics::insert(H2D_CACHE_PRECALC, node->size);
+#pragma omp flush
+                *entry = node;
+              }
+              node = *entry;
+            }
+          }
+          else
+          {
+#pragma omp flush
+          }
+          cur_node = node;
+          return;
+        }
+      }
+
+      if(nodes == NULL)
+        update_nodes_ptr();
+      if(CacheStatistics::is_enabled())
+        CacheStatistics::lookup(H2D_CACHE_PRECALC, nodes->present(order) && (nodes->get(order)->mask & mask) == mask);
+      Function<double>::set_quad_order(order, mask);
+    }
+
+    Function<double>::Node* PrecalcShapeset::precalculate_reference(int order, int level)
+    {
+      ElementMode2D mode = this->element->get_mode();
+      int np = g_quad_2d_std.get_num_points(order, mode);
+      double3* pt = g_quad_2d_std.get_points(order, mode);
+
+      double* x = new double[2 * np];
+      double* y = x + np;
+      for (int i = 0; i < np; i++)
+      {
+        x[i] = ctm->m[0] * pt[i][0] + ctm->t[0];
+        y[i] = ctm->m[1] * pt[i][1] + ctm->t[1];
+      }
+
+      Node* node = new_node(level ? H2D_FN_ALL : H2D_FN_DEFAULT, np);
+      for (int j = 0; j < num_components; j++)
+        for (int k = 0; k < (level ? 6 : 3); k++)
+          calculate_values(&g_quad_2d_std, order, k, j, x, y, node->values[j][k]);
+
+      delete [] x;
+      return node;
+    }
+
+    void PrecalcShapeset::calculate_values(Quad2D* quad, int order, int k, int component, const double* x, const double* y, double* result)
+    {
+      ElementMode2D mode = element->get_mode();
+      int np = quad->get_num_points(order, mode);
+
+      // Volume rules of quads in g_quad_2d_std are tensor products with the x coordinate
+      // of the point a * n + b being the a-th and the y coordinate the b-th 1D point.
+      if(mode == HERMES_MODE_QUAD && quad == &g_quad_2d_std && order <= quad->get_max_order(mode) && shapeset->is_tensor_product(mode))
+      {
+        int n = (int) (sqrt((double) np) + 0.5);
+        if(n * n == np)
+        {
+          double* x1 = new double[2 * n];
+          double* y1 = x1 + n;
+          for (int a = 0; a < n; a++)
+          {
+            x1[a] = x[a * n];
+            y1[a] = y[a];
+          }
+          shapeset->get_values_tensor(k, index, n, x1, n, y1, component, mode, result);
+          delete [] x1;
+          return;
+        }
+      }
+
+      shapeset->get_values(k, index, np, x, y, component, mode, result);
     }
 
     void PrecalcShapeset::set_active_element(Element* e)
@@ -111,6 +334,14 @@ namespace Hermes
       int newmask = mask | oldmask;
       Node* node = new_node(newmask, np);
 
+      double* x = new double[2 * np];
+      double* y = x + np;
+      for (i = 0; i < np; i++)
+      {
+        x[i] = ctm->m[0] * pt[i][0] + ctm->t[0];
+        y[i] = ctm->m[1] * pt[i][1] + ctm->t[1];
+      }
+
       // precalculate all required tables
       for (j = 0; j < num_components; j++)
       {
@@ -121,18 +352,19 @@ namespace Hermes
             if(oldmask & idx2mask[k][j])
               memcpy(node->values[j][k], cur_node->values[j][k], np * sizeof(double));
             else
-              for (i = 0; i < np; i++)
-                node->values[j][k][i] = shapeset->get_value(k, index, ctm->m[0] * pt[i][0] + ctm->t[0],
-                ctm->m[1] * pt[i][1] + ctm->t[1], j, element->get_mode());
+              calculate_values(quad, order, k, j, x, y, node->values[j][k]);
           }
         }
       }
+      delete [] x;
       if(nodes->present(order))
       {
         assert(nodes->get(order) == cur_node);
+        CacheStatistics::add_bytes(H2D_CACHE_PRECALC, -nodes->get(order)->size);
         ::free(nodes->get(order));
       }
       nodes->add(node, order);
+      CacheStatistics::insert(H2D_CACHE_PRECALC, node->size);
       cur_node = node;
     }
 
@@ -147,19 +379,34 @@ namespace Hermes
           {
             for(unsigned int k = 0; k < it->second->get_size(); k++)
               if(it->second->present(k))
+              {
+                CacheStatistics::add_bytes(H2D_CACHE_PRECALC, -it->second->get(k)->size);
                 ::free(it->second->get(k));
+              }
             delete it->second;
           }
           delete tables.get(i);
         }
+    }
 
-        if(overflow_nodes != NULL)
-        {
-          for(unsigned int i = 0; i < overflow_nodes->get_size(); i++)
-            if(overflow_nodes->present(i))
-              ::free(overflow_nodes->get(i));
-          delete overflow_nodes;
-        }
+    std::size_t PrecalcShapeset::get_memory_usage() const
+    {
+      if(master_pss != NULL)
+        return 0;
+
+      std::size_t size = 0;
+      for(unsigned int i = 0; i < tables.get_size(); i++)
+        if(tables.present(i))
+          for(std::map<uint64_t, LightArray<Node*>*>::const_iterator it = tables.get(i)->begin(); it != tables.get(i)->end(); it++)
+            for(unsigned int k = 0; k < it->second->get_size(); k++)
+              if(it->second->present(k))
+                size += it->second->get(k)->size;
+      return size;
+    }
+
+    std::size_t PrecalcShapeset::get_total_memory_usage() const
+    {
+      return this->get_memory_usage();
     }
 
     extern PrecalcShapeset ref_map_pss;
@@ -173,14 +420,24 @@ namespace Hermes
     {
       Transformable::push_transform(son);
       if(sub_tables != NULL)
-        update_nodes_ptr();
+      {
+        if(use_reference_table())
+          nodes = NULL;
+        else
+          update_nodes_ptr();
+      }
     }
 
     void PrecalcShapeset::pop_transform()
     {
       Transformable::pop_transform();
       if(sub_tables != NULL)
-        update_nodes_ptr();
+      {
+        if(use_reference_table())
+          nodes = NULL;
+        else
+          update_nodes_ptr();
+      }
     }
 
     int PrecalcShapeset::get_active_shape() const
@@ -250,6 +250,239 @@ namespace Hermes
         return get_constrained_value(n, index, x, y, component, mode);
     }
 
+    /// Degree in each variable of the monomials x^a y^b used by Shapeset::get_values().
+    /// One more than H2D_BATCH_MAX_ORDER, H(curl) functions of order p may be of degree p + 1.
+    static const int H2D_BATCH_DEGREE = H2D_BATCH_MAX_ORDER + 1;
+    static const int H2D_BATCH_NUM_MONOMIALS = (H2D_BATCH_DEGREE + 1) * (H2D_BATCH_DEGREE + 1);
+
+    /// Coefficients of the low-order shape functions of one shapeset type,
+    /// by (mode, component, expansion, index). Slots are filled once and never change.
+    struct ShapesetCoefficients
+    {
+      ShapesetCoefficients(int max_index_tri, int max_index_quad)
+      {
+        num_indices[HERMES_MODE_TRIANGLE] = max_index_tri + 1;
+        num_indices[HERMES_MODE_QUAD] = max_index_quad + 1;
+        offset[HERMES_MODE_TRIANGLE] = 0;
+        offset[HERMES_MODE_QUAD] = num_indices[HERMES_MODE_TRIANGLE] * H2D_MAX_SOLUTION_COMPONENTS * 6;
+        size = offset[HERMES_MODE_QUAD] + num_indices[HERMES_MODE_QUAD] * H2D_MAX_SOLUTION_COMPONENTS * 6;
+        coefs = new double*[size];
+        memset(coefs, 0, size * sizeof(double*));
+      }
+
+      ~ShapesetCoefficients()
+      {
+        for(int i = 0; i < size; i++)
+          if(coefs[i] != NULL && coefs[i] != &not_polynomial)
+            delete [] coefs[i];
+        delete [] coefs;
+      }
+
+      double** get_slot(int n, int index, int component, ElementMode2D mode)
+      {
+        return coefs + offset[mode] + (index * H2D_MAX_SOLUTION_COMPONENTS + component) * 6 + n;
+      }
+
+      double** coefs;
+      int size;
+      int offset[H2D_NUM_MODES];
+      int num_indices[H2D_NUM_MODES];
+
+      /// Marks a slot of a function which is not a polynomial in the monomials.
+      static double not_polynomial;
+    };
+
+    double ShapesetCoefficients::not_polynomial = 0.0;
+
+    /// Coefficient tables by Shapeset::get_id(), freed at exit.
+    /// Zero-initialized before any dynamic initialization.
+    static struct ShapesetCoefficientTables
+    {
+      ~ShapesetCoefficientTables()
+      {
+        for(int i = 0; i < H2D_NUM_SHAPESET_IDS; i++)
+          delete tables[i];
+        if(lu != NULL)
+        {
+          delete [] lu;
+          delete [] perm;
+        }
+      }
+
+      ShapesetCoefficients* tables[H2D_NUM_SHAPESET_IDS];
+
+      /// LU decomposition of the Vandermonde matrix of the monomials at the fitting points.
+      double** lu;
+      int* perm;
+    } coefficient_tables;
+
+    /// Fitting points, a tensor grid of Chebyshev nodes of [-1, 1].
+    static double batch_fit_point(int i)
+    {
+      return cos((2 * i + 1) * M_PI / (2 * (H2D_BATCH_DEGREE + 1)));
+    }
+
+    static double batch_eval(const double* c, double x, double y)
+    {
+      double value = 0.0;
+      for (int a = H2D_BATCH_DEGREE; a >= 0; a--)
+      {
+        const double* ca = c + a * (H2D_BATCH_DEGREE + 1);
+        double sum = ca[H2D_BATCH_DEGREE];
+        for (int b = H2D_BATCH_DEGREE - 1; b >= 0; b--)
+          sum = sum * y + ca[b];
+        value = value * x + sum;
+      }
+      return value;
+    }
+
+    const double* Shapeset::get_coefficients(int n, int index, int component, ElementMode2D mode)
+    {
+      if(index < 0 || shape_table[n][mode] == NULL)
+        return NULL;
+      int id = get_id();
+      if(id < 0 || id >= H2D_NUM_SHAPESET_IDS)
+        return NULL;
+      int order = get_order(index, mode);
+      if(std::max(H2D_GET_H_ORDER(order), H2D_GET_V_ORDER(order)) > H2D_BATCH_MAX_ORDER)
+        return NULL;
+
+      ShapesetCoefficients* table = coefficient_tables.tables[id];
+      double* coefs = NULL;
+      if(table != NULL && index < table->num_indices[mode])
+      {
+        coefs = *table->get_slot(n, index, component, mode);
+#pragma omp flush
+      }
+
+      if(coefs == NULL)
+      {
+#pragma omp critical (shapeset_coefficients)
+        {
+          if(coefficient_tables.lu == NULL)
+          {
+            double** lu = new_matrix<double>(H2D_BATCH_NUM_MONOMIALS, H2D_BATCH_NUM_MONOMIALS);
+            for (int i = 0; i < H2D_BATCH_NUM_MONOMIALS; i++)
+            {
+              double x = batch_fit_point(i / (H2D_BATCH_DEGREE + 1)), y = batch_fit_point(i % (H2D_BATCH_DEGREE + 1));
+              for (int a = 0; a <= H2D_BATCH_DEGREE; a++)
+                for (int b = 0; b <= H2D_BATCH_DEGREE; b++)
+                  lu[i][a * (H2D_BATCH_DEGREE + 1) + b] = pow(x, a) * pow(y, b);
+            }
+            double d;
+            coefficient_tables.perm = new int[H2D_BATCH_NUM_MONOMIALS];
+            ludcmp(lu, H2D_BATCH_NUM_MONOMIALS, coefficient_tables.perm, &d);
+            coefficient_tables.lu = lu;
+          }
+          if(coefficient_tables.tables[id] == NULL)
+            coefficient_tables.tables[id] = new ShapesetCoefficients(get_max_index(HERMES_MODE_TRIANGLE), get_max_index(HERMES_MODE_QUAD));
+          table = coefficient_tables.tables[id];
+
+          if(index >= table->num_indices[mode])
+            coefs = &ShapesetCoefficients::not_polynomial;
+          else if((coefs = *table->get_slot(n, index, component, mode)) == NULL)
+          {
+            shape_fn_t fn = shape_table[n][mode][component][index];
+            double* c = new double[H2D_BATCH_NUM_MONOMIALS];
+            for (int i = 0; i < H2D_BATCH_NUM_MONOMIALS; i++)
+              c[i] = fn(batch_fit_point(i / (H2D_BATCH_DEGREE + 1)), batch_fit_point(i % (H2D_BATCH_DEGREE + 1)));
+            double scale = 1.0;
+            for (int i = 0; i < H2D_BATCH_NUM_MONOMIALS; i++)
+              scale = std::max(scale, fabs(c[i]));
+            lubksb(coefficient_tables.lu, H2D_BATCH_NUM_MONOMIALS, coefficient_tables.perm, c);
+
+            // Check the fit inside the reference triangle, which is a part of the reference quad.
+            static const double check_pts[5][2] = { {-0.7, -0.6}, {0.3, -0.8}, {-0.2, 0.1}, {-0.9, 0.75}, {0.55, -0.95} };
+            bool is_polynomial = true;
+            for (int i = 0; i < 5 && is_polynomial; i++)
+              if(!(fabs(batch_eval(c, check_pts[i][0], check_pts[i][1]) - fn(check_pts[i][0], check_pts[i][1])) <= 1e-10 * scale))
+                is_polynomial = false;
+
+            if(is_polynomial)
+              coefs = c;
+            else
+            {
+              delete [] c;
+              coefs = &ShapesetCoefficients::not_polynomial;
+            }
+#pragma omp flush
+            *table->get_slot(n, index, component, mode) = coefs;
+          }
+        }
+      }
+
+      return coefs == &ShapesetCoefficients::not_polynomial ? NULL : coefs;
+    }
+
+    void Shapeset::get_values(int n, int index, int np, const double* x, const double* y, int component, ElementMode2D mode, double* result)
+    {
+      const double* c = get_coefficients(n, index, component, mode);
+      if(c == NULL)
+      {
+        for (int i = 0; i < np; i++)
+          result[i] = get_value(n, index, x[i], y[i], component, mode);
+        return;
+      }
+
+      for (int i = 0; i < np; i++)
+        result[i] = batch_eval(c, x[i], y[i]);
+    }
+
+    bool Shapeset::is_tensor_product(ElementMode2D mode) const
+    {
+      return false;
+    }
+
+    void Shapeset::get_values_tensor(int n, int index, int nx, const double* x, int ny, const double* y, int component, ElementMode2D mode, double* result)
+    {
+      if(index < 0 || shape_table[n][mode] == NULL)
+      {
+        for (int a = 0; a < nx; a++)
+          for (int b = 0; b < ny; b++)
+            result[a * ny + b] = get_value(n, index, x[a], y[b], component, mode);
+        return;
+      }
+      shape_fn_t fn = shape_table[n][mode][component][index];
+
+      // f(x, y) = g(x) h(y): find a line y = y[b0] on which f is not close to zero, then
+      // f(x[a], y[b]) = f(x[a], y[b0]) * f(x[a0], y[b]) / f(x[a0], y[b0]).
+      double* line_x = new double[nx + ny];
+      double* line_y = line_x + nx;
+      int a0 = -1;
+      for (int b0 = 0; b0 < ny && a0 < 0; b0++)
+      {
+        double max = 1e-8;
+        for (int a = 0; a < nx; a++)
+        {
+          line_x[a] = fn(x[a], y[b0]);
+          if(fabs(line_x[a]) > max)
+          {
+            max = fabs(line_x[a]);
+            a0 = a;
+          }
+        }
+      }
+
+      // Values too small for a safe division, f is evaluated point by point.
+      if(a0 < 0)
+      {
+        for (int a = 0; a < nx; a++)
+          for (int b = 0; b < ny; b++)
+            result[a * ny + b] = fn(x[a], y[b]);
+      }
+      else
+      {
+        double pivot = line_x[a0];
+        for (int b = 0; b < ny; b++)
+          line_y[b] = fn(x[a0], y[b]) / pivot;
+        for (int a = 0; a < nx; a++)
+          for (int b = 0; b < ny; b++)
+            result[a * ny + b] = line_x[a] * line_y[b];
+      }
+
+      delete [] line_x;
+    }
+
     double Shapeset::get_fn_value (int index, double x, double y, int component, ElementMode2D mode)  { return get_value(0, index, x, y, component, mode); }
     double Shapeset::get_dx_value (int index, double x, double y, int component, ElementMode2D mode)  { return get_value(1, index, x, y, component, mode); }
     double Shapeset::get_dy_value (int index, double x, double y, int component, ElementMode2D mode)  { return get_value(2, index, x, y, component, mode); }
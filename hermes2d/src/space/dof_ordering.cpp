@@ -0,0 +1,181 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "dof_ordering.h"
+#include <algorithm>
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    DofOrdering::Graph::Graph(int num_vertices, const int* adjacency_start, const int* adjacency)
+      : num_vertices(num_vertices), adjacency_start(adjacency_start), adjacency(adjacency), next_label(1), visit_stamp(0)
+    {
+      labels = new int[std::max(num_vertices, 1)];
+      visited = new int[std::max(num_vertices, 1)];
+      for (int i = 0; i < num_vertices; i++)
+      {
+        labels[i] = 0;
+        visited[i] = 0;
+      }
+    }
+
+    DofOrdering::Graph::~Graph()
+    {
+      delete [] labels;
+      delete [] visited;
+    }
+
+    bool DofOrdering::Graph::DegreeLess::operator()(int a, int b) const
+    {
+      int degree_a = graph->get_degree(a);
+      int degree_b = graph->get_degree(b);
+      return degree_a < degree_b || (degree_a == degree_b && a < b);
+    }
+
+    int DofOrdering::Graph::get_level_structure(int root, int label, std::vector<int>& vertices, std::vector<int>& level_start, bool sort_by_degree)
+    {
+      vertices.clear();
+      level_start.clear();
+      visit_stamp++;
+
+      vertices.push_back(root);
+      visited[root] = visit_stamp;
+      int begin = 0;
+      while (begin < (int)vertices.size())
+      {
+        level_start.push_back(begin);
+        int end = vertices.size();
+        for (int i = begin; i < end; i++)
+        {
+          int v = vertices[i];
+          int first_new = vertices.size();
+          for (int j = adjacency_start[v]; j < adjacency_start[v + 1]; j++)
+          {
+            int w = adjacency[j];
+            if(labels[w] == label && visited[w] != visit_stamp)
+            {
+              visited[w] = visit_stamp;
+              vertices.push_back(w);
+            }
+          }
+          if(sort_by_degree)
+            std::sort(vertices.begin() + first_new, vertices.end(), DegreeLess(this));
+        }
+        begin = end;
+      }
+      level_start.push_back(vertices.size());
+
+      return level_start.size() - 1;
+    }
+
+    int DofOrdering::Graph::get_pseudo_peripheral_vertex(int start, int label)
+    {
+      std::vector<int> vertices, level_start;
+      int root = start;
+      int num_levels = get_level_structure(root, label, vertices, level_start, false);
+      while (true)
+      {
+        // The vertex of the minimum degree in the last level.
+        int candidate = vertices[level_start[num_levels - 1]];
+        for (int i = level_start[num_levels - 1] + 1; i < level_start[num_levels]; i++)
+          if(get_degree(vertices[i]) < get_degree(candidate))
+            candidate = vertices[i];
+
+        int candidate_num_levels = get_level_structure(candidate, label, vertices, level_start, false);
+        if(candidate_num_levels <= num_levels)
+          return root;
+        root = candidate;
+        num_levels = candidate_num_levels;
+      }
+    }
+
+    void DofOrdering::Graph::append_reverse_cuthill_mckee(int root, int label, std::vector<int>& order)
+    {
+      std::vector<int> vertices, level_start;
+      get_level_structure(root, label, vertices, level_start, true);
+      for (int i = vertices.size() - 1; i >= 0; i--)
+      {
+        order.push_back(vertices[i]);
+        labels[vertices[i]] = -1;
+      }
+    }
+
+    void DofOrdering::Graph::dissect(int label, const std::vector<int>& vertices, std::vector<int>& order)
+    {
+      std::vector<int> component, level_start;
+      for (unsigned int i = 0; i < vertices.size(); i++)
+      {
+        // Each connected component separately, the vertices of the processed ones are relabeled.
+        if(labels[vertices[i]] != label)
+          continue;
+        int root = get_pseudo_peripheral_vertex(vertices[i], label);
+        int num_levels = get_level_structure(root, label, component, level_start, false);
+
+        if((int)component.size() <= H2D_DISSECTION_LEAF_SIZE || num_levels < 3)
+        {
+          append_reverse_cuthill_mckee(root, label, order);
+          continue;
+        }
+
+        // There are only edges between the subsequent levels, the middle one separates the lower and the upper ones.
+        int middle = num_levels / 2;
+        std::vector<int> lower(component.begin(), component.begin() + level_start[middle]);
+        std::vector<int> separator(component.begin() + level_start[middle], component.begin() + level_start[middle + 1]);
+        std::vector<int> upper(component.begin() + level_start[middle + 1], component.end());
+
+        int lower_label = next_label++;
+        int upper_label = next_label++;
+        for (unsigned int j = 0; j < lower.size(); j++)
+          labels[lower[j]] = lower_label;
+        for (unsigned int j = 0; j < upper.size(); j++)
+          labels[upper[j]] = upper_label;
+        for (unsigned int j = 0; j < separator.size(); j++)
+          labels[separator[j]] = -1;
+
+        dissect(lower_label, lower, order);
+        dissect(upper_label, upper, order);
+        order.insert(order.end(), separator.begin(), separator.end());
+      }
+    }
+
+    void DofOrdering::reverse_cuthill_mckee(int num_vertices, const int* adjacency_start, const int* adjacency, int* order)
+    {
+      Graph graph(num_vertices, adjacency_start, adjacency);
+      std::vector<int> result;
+      result.reserve(num_vertices);
+      for (int v = 0; v < num_vertices; v++)
+        if(graph.labels[v] == 0)
+          graph.append_reverse_cuthill_mckee(graph.get_pseudo_peripheral_vertex(v, 0), 0, result);
+
+      for (int i = 0; i < num_vertices; i++)
+        order[i] = result[i];
+    }
+
+    void DofOrdering::nested_dissection(int num_vertices, const int* adjacency_start, const int* adjacency, int* order)
+    {
+      Graph graph(num_vertices, adjacency_start, adjacency);
+      std::vector<int> vertices(num_vertices);
+      for (int v = 0; v < num_vertices; v++)
+        vertices[v] = v;
+      std::vector<int> result;
+      result.reserve(num_vertices);
+      graph.dissect(0, vertices, result);
+
+      for (int i = 0; i < num_vertices; i++)
+        order[i] = result[i];
+    }
+  }
+}
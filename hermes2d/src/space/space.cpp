@@ -23,7 +23,17 @@
 #include "space_hdiv.h"
 #include "space_h2d_xml.h"
 #include "api2d.h"
+#include "precalculated_tables.h"
 #include <iostream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <set>
+
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
 
 namespace Hermes
 {
@@ -43,10 +53,23 @@ namespace Hermes
 			this->mesh_seq = -1;
 			this->seq = g_space_seq;
 			this->was_assigned = -1;
+			this->bc_values_seq = 0;
 			this->ndof = 0;
       this->proj_mat = NULL;
       this->chol_p = NULL;
+      this->proj_mat_size = 0;
       this->vertex_functions_count = this->edge_functions_count = this->bubble_functions_count = 0;
+      this->element_colors = NULL;
+      this->element_colors_count = 0;
+      this->element_colors_seq = -1;
+      this->dof_ordering = HERMES_DOF_ORDERING_NATURAL;
+      this->interleaved_dofs = false;
+      this->dof_tracking = false;
+      this->previous_first_dof = this->previous_size = 0;
+      this->previous_stride = 1;
+      this->al_cache_start = NULL;
+      this->al_cache_size = 0;
+      this->edge_bc_points_mesh_seq = -1;
 
 			if(essential_bcs != NULL)
 				for(Hermes::vector<EssentialBoundaryCondition<double>*>::const_iterator it = essential_bcs->begin(); it != essential_bcs->end(); it++)
@@ -71,10 +94,23 @@ namespace Hermes
 			this->mesh_seq = -1;
 			this->seq = g_space_seq;
 			this->was_assigned = -1;
+			this->bc_values_seq = 0;
 			this->ndof = 0;
       this->proj_mat = NULL;
       this->chol_p = NULL;
+      this->proj_mat_size = 0;
       this->vertex_functions_count = this->edge_functions_count = this->bubble_functions_count = 0;
+      this->element_colors = NULL;
+      this->element_colors_count = 0;
+      this->element_colors_seq = -1;
+      this->dof_ordering = HERMES_DOF_ORDERING_NATURAL;
+      this->interleaved_dofs = false;
+      this->dof_tracking = false;
+      this->previous_first_dof = this->previous_size = 0;
+      this->previous_stride = 1;
+      this->al_cache_start = NULL;
+      this->al_cache_size = 0;
+      this->edge_bc_points_mesh_seq = -1;
 
 			if(essential_bcs != NULL)
 				for(Hermes::vector<EssentialBoundaryCondition<std::complex<double> >*>::const_iterator it = essential_bcs->begin(); it != essential_bcs->end(); it++)
@@ -91,6 +127,7 @@ namespace Hermes
 		void Space<double>::free()
 		{
 			free_bc_data();
+			free_assembly_list_cache();
 			if(nsize) { ::free(ndata); nsize = 0; ndata = NULL; }
 			if(esize) { ::free(edata); edata = 0; edata = NULL; }
 			this->seq = -1;
@@ -100,38 +137,43 @@ namespace Hermes
 		void Space<std::complex<double> >::free()
 		{
 			free_bc_data();
+			free_assembly_list_cache();
 			if(nsize) { ::free(ndata); nsize = 0; ndata = NULL; }
 			if(esize) { ::free(edata); edata = 0; edata = NULL; }
 			this->seq = -1;
 		}
 
     template<>
-    Space<double>::Space() : shapeset(NULL), essential_bcs(NULL), mesh(NULL)
+    Space<double>::Space() : Mixins::MemoryAccounted(Mixins::H2D_MEMORY_SPACE), shapeset(NULL), essential_bcs(NULL), mesh(NULL)
     {
       this->init();
     }
 
     template<>
-    Space<std::complex<double> >::Space() : shapeset(NULL), essential_bcs(NULL), mesh(NULL)
+    Space<std::complex<double> >::Space() : Mixins::MemoryAccounted(Mixins::H2D_MEMORY_SPACE), shapeset(NULL), essential_bcs(NULL), mesh(NULL)
     {
       this->init();
     }
 
      template<>
     Space<double>::Space(const Mesh* mesh, Shapeset* shapeset, EssentialBCs<double>* essential_bcs)
-      : shapeset(shapeset), essential_bcs(essential_bcs), mesh(mesh)
+      : Mixins::MemoryAccounted(Mixins::H2D_MEMORY_SPACE), shapeset(shapeset), essential_bcs(essential_bcs), mesh(mesh)
     {
       if(mesh == NULL)
         throw Hermes::Exceptions::NullException(0);
+#pragma omp atomic
+      mesh->space_count++;
       this->init();
     }
 
     template<>
     Space<std::complex<double> >::Space(const Mesh* mesh, Shapeset* shapeset, EssentialBCs<std::complex<double> >* essential_bcs)
-      : shapeset(shapeset), essential_bcs(essential_bcs), mesh(mesh)
+      : Mixins::MemoryAccounted(Mixins::H2D_MEMORY_SPACE), shapeset(shapeset), essential_bcs(essential_bcs), mesh(mesh)
     {
       if(mesh == NULL)
         throw Hermes::Exceptions::NullException(0);
+#pragma omp atomic
+      mesh->space_count++;
       this->init();
     }
     
@@ -166,24 +208,30 @@ namespace Hermes
     Space<double>::~Space()
     {
       free();
+      free_edge_bc_points();
+      this->release_mesh();
 
       if(this->proj_mat != NULL)
         delete [] this->proj_mat;
       if(this->chol_p != NULL)
         delete [] this->chol_p;
-
+      if(this->element_colors != NULL)
+        delete [] this->element_colors;
     }
 
     template<>
     Space<std::complex<double> >::~Space()
     {
       free();
+      free_edge_bc_points();
+      this->release_mesh();
 
       if(this->proj_mat != NULL)
         delete [] this->proj_mat;
       if(this->chol_p != NULL)
         delete [] this->chol_p;
-
+      if(this->element_colors != NULL)
+        delete [] this->element_colors;
     }
 
 		template<typename Scalar>
@@ -242,9 +290,13 @@ namespace Hermes
 
       this->essential_bcs = space->essential_bcs;
       this->shapeset = space->shapeset->clone();
+      this->dof_ordering = space->dof_ordering;
 
       new_mesh->copy(space->get_mesh());
+      this->release_mesh();
       this->mesh = new_mesh;
+#pragma omp atomic
+      new_mesh->space_count++;
 
       this->resize_tables();
 
@@ -387,6 +439,94 @@ namespace Hermes
       return ndof;
     }
 
+    template<typename Scalar>
+    int Space<Scalar>::assign_dofs_interleaved(Hermes::vector<Space<Scalar>*> spaces, DofInterleavingType interleaving)
+    {
+      int n = spaces.size();
+      if(n == 0)
+        return 0;
+
+      const Mesh* mesh = spaces[0]->get_mesh();
+      for (int i = 1; i < n; i++)
+        if(spaces[i]->get_mesh() != mesh)
+          throw Hermes::Exceptions::Exception("All spaces have to be defined on the same mesh in Space::assign_dofs_interleaved().");
+
+      // Each space first numbered on its own, from zero.
+      for (int i = 0; i < n; i++)
+      {
+        if(!spaces[i]->number_dofs(0, 1))
+          throw Hermes::Exceptions::Exception("The space %d is not ready to be assigned in Space::assign_dofs_interleaved().", i);
+        spaces[i]->ndof = spaces[i]->next_dof;
+      }
+
+      // The blocks of the spaces renumbered in the order of their first appearance in the active elements.
+      int max_node_id = mesh->get_max_node_id();
+      bool* renumbered = new bool[n * std::max(max_node_id, 1)];
+      memset(renumbered, 0, n * std::max(max_node_id, 1) * sizeof(bool));
+
+      int dof = 0;
+      Element* e;
+      for_all_active_elements(e, mesh)
+      {
+        if(interleaving == HERMES_DOF_INTERLEAVING_ELEMENTS)
+        {
+          for (int s = 0; s < n; s++)
+          {
+            for (unsigned int i = 0; i < e->get_nvert(); i++)
+              spaces[s]->interleave_node_dofs(e->vn[i], renumbered + s * max_node_id, dof);
+            for (unsigned int i = 0; i < e->get_nvert(); i++)
+              spaces[s]->interleave_node_dofs(e->en[i], renumbered + s * max_node_id, dof);
+          }
+        }
+        else
+        {
+          for (unsigned int i = 0; i < e->get_nvert(); i++)
+            for (int s = 0; s < n; s++)
+              spaces[s]->interleave_node_dofs(e->vn[i], renumbered + s * max_node_id, dof);
+          for (unsigned int i = 0; i < e->get_nvert(); i++)
+            for (int s = 0; s < n; s++)
+              spaces[s]->interleave_node_dofs(e->en[i], renumbered + s * max_node_id, dof);
+        }
+
+        for (int s = 0; s < n; s++)
+        {
+          ElementData* ed = spaces[s]->edata + e->id;
+          if(ed->bdof >= 0 && ed->n > 0)
+          {
+            ed->bdof = dof;
+            dof += ed->n;
+          }
+        }
+      }
+      delete [] renumbered;
+
+      for (int i = 0; i < n; i++)
+      {
+        spaces[i]->next_dof = dof;
+        spaces[i]->interleaved_dofs = true;
+        spaces[i]->finish_dofs_assignment();
+      }
+
+      return dof;
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::interleave_node_dofs(Node* node, bool* renumbered, int& dof)
+    {
+      NodeData* nd = ndata + node->id;
+      if(nd->dof < 0 || nd->n <= 0 || renumbered[node->id])
+        return;
+      renumbered[node->id] = true;
+      nd->dof = dof;
+      dof += nd->n;
+    }
+
+    template<typename Scalar>
+    bool Space<Scalar>::has_interleaved_dofs() const
+    {
+      return this->interleaved_dofs;
+    }
+
     template<typename Scalar>
     int Space<Scalar>::get_element_order(int id) const
     {
@@ -742,6 +882,7 @@ namespace Hermes
     template<typename Scalar>
     void Space<Scalar>::ReferenceSpaceCreator::finish_construction(Space<Scalar>* ref_space)
     {
+      ref_space->dof_ordering = this->coarse_space->dof_ordering;
       ref_space->seq = g_space_seq++;
 
       Element *e;
@@ -760,6 +901,89 @@ namespace Hermes
       }
     }
 
+    template<typename Scalar>
+    Space<Scalar>::IncrementalReferenceSpaceCreator::IncrementalReferenceSpaceCreator(const Space<Scalar>* coarse_space, int refinement, unsigned int order_increase) :
+      coarse_space(coarse_space), refinement(refinement), order_increase(order_increase), ref_mesh(NULL), ref_space(NULL), coarse_mesh_seq(0), reused(false)
+    {
+    }
+
+    template<typename Scalar>
+    Space<Scalar>::IncrementalReferenceSpaceCreator::~IncrementalReferenceSpaceCreator()
+    {
+      delete ref_space;
+      delete ref_mesh;
+    }
+
+    template<typename Scalar>
+    int Space<Scalar>::IncrementalReferenceSpaceCreator::get_ref_order(Element* e) const
+    {
+      int current_order = coarse_space->get_element_order(e->id);
+      if(current_order < 0)
+        throw Hermes::Exceptions::Exception("Source space has an uninitialized order (element id = %d)", e->id);
+
+      // The same as ReferenceSpaceCreator::handle_orders(), the limits are guarded by update_orders_recurrent().
+      if(e->is_triangle())
+        return current_order + this->order_increase;
+      else
+        return H2D_MAKE_QUAD_ORDER(H2D_GET_H_ORDER(current_order) + this->order_increase, H2D_GET_V_ORDER(current_order) + this->order_increase);
+    }
+
+    template<typename Scalar>
+    Space<Scalar>* Space<Scalar>::IncrementalReferenceSpaceCreator::update_ref_space(bool assign_dofs)
+    {
+      Mesh* coarse_mesh = coarse_space->get_mesh();
+      Element* e;
+
+      this->reused = (ref_space != NULL && coarse_mesh->get_seq() == coarse_mesh_seq);
+      if(this->reused)
+      {
+        // Only the orders changed, update them on the changed coarse elements.
+        bool changed = false;
+        for_all_active_elements(e, coarse_mesh)
+        {
+          int order = coarse_space->get_element_order(e->id);
+          if(coarse_space->edata[e->id].changed_in_last_adaptation || order != coarse_orders[e->id])
+          {
+            ref_space->update_orders_recurrent(ref_mesh->get_element(e->id), get_ref_order(e));
+            coarse_orders[e->id] = order;
+            changed = true;
+          }
+        }
+
+        if(changed)
+        {
+          ref_space->seq = g_space_seq++;
+          if(assign_dofs)
+            ref_space->assign_dofs();
+        }
+        return ref_space;
+      }
+
+      // The coarse mesh changed, start over.
+      delete ref_space;
+      ref_space = NULL;
+      delete ref_mesh;
+      ref_mesh = NULL;
+
+      Mesh::ReferenceMeshCreator ref_mesh_creator(coarse_mesh, refinement);
+      ref_mesh = ref_mesh_creator.create_ref_mesh();
+      ReferenceSpaceCreator ref_space_creator(coarse_space, ref_mesh, order_increase);
+      ref_space = ref_space_creator.create_ref_space(assign_dofs);
+
+      coarse_mesh_seq = coarse_mesh->get_seq();
+      coarse_orders.assign(coarse_mesh->get_max_element_id(), -1);
+      for_all_active_elements(e, coarse_mesh)
+        coarse_orders[e->id] = coarse_space->get_element_order(e->id);
+
+      return ref_space;
+    }
+
+    template<typename Scalar>
+    bool Space<Scalar>::IncrementalReferenceSpaceCreator::was_reused() const
+    {
+      return this->reused;
+    }
+
     template<typename Scalar>
     void Space<Scalar>::update_orders_recurrent(Element* e, int order)
     {
@@ -825,11 +1049,24 @@ namespace Hermes
       if(this->mesh == mesh) 
         return;
       free();
+      this->release_mesh();
       this->mesh = mesh;
+#pragma omp atomic
+      mesh->space_count++;
       this->mesh_seq = mesh->get_seq();
       seq = g_space_seq++;
     }
 
+    template<typename Scalar>
+    void Space<Scalar>::release_mesh()
+    {
+      if(this->mesh == NULL)
+        return;
+#pragma omp atomic
+      this->mesh->space_count--;
+      this->mesh = NULL;
+    }
+
     template<typename Scalar>
     void Space<Scalar>::set_mesh_seq(int seq)
     {
@@ -871,8 +1108,38 @@ namespace Hermes
       delete [] orders;
     }
 
+    template<typename Scalar>
+    void Space<Scalar>::reorder_element_data(const int* new_element_ids)
+    {
+      this->resize_tables();
+      int max_element_id = this->mesh->get_max_element_id();
+      ElementData* copies = new ElementData[max_element_id];
+      memcpy(copies, edata, sizeof(ElementData) * max_element_id);
+      for (int i = 0; i < max_element_id; i++)
+        edata[new_element_ids[i]] = copies[i];
+      delete [] copies;
+      seq = g_space_seq++;
+    }
+
     template<typename Scalar>
     int Space<Scalar>::assign_dofs(int first_dof, int stride)
+    {
+      if(!this->number_dofs(first_dof, stride))
+        return false;
+      if(this->dof_ordering != HERMES_DOF_ORDERING_NATURAL)
+        reorder_dofs();
+      else if(this->dof_tracking && this->previous_size > 0)
+        renumber_dofs_stably();
+
+      this->interleaved_dofs = false;
+      this->ndof = (next_dof - first_dof) / stride;
+      this->finish_dofs_assignment();
+
+      return this->ndof;
+    }
+
+    template<typename Scalar>
+    bool Space<Scalar>::number_dofs(int first_dof, int stride)
     {
       if(ndata == NULL || edata == NULL || !nsize || !esize)
         return false;
@@ -920,6 +1187,17 @@ namespace Hermes
       assign_edge_dofs();
       assign_bubble_dofs();
 
+      return true;
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::finish_dofs_assignment()
+    {
+      // Before the constraints reuse the node data of the constrained nodes.
+      if(this->dof_tracking)
+        update_dof_tracking();
+
+      free_assembly_list_cache();
       free_bc_data();
       update_essential_bc_values();
       update_constraints();
@@ -927,10 +1205,290 @@ namespace Hermes
 
       mesh_seq = mesh->get_seq();
       was_assigned = this->seq;
-      this->ndof = (next_dof - first_dof) / stride;
+    }
 
-      return this->ndof;
-      check();
+    template<typename Scalar>
+    void Space<Scalar>::set_dof_tracking(bool enabled)
+    {
+      this->dof_tracking = enabled;
+      if(!enabled)
+      {
+        this->previous_node_blocks.clear();
+        this->previous_element_blocks.clear();
+        this->dof_mapping.clear();
+        this->previous_size = 0;
+      }
+    }
+
+    template<typename Scalar>
+    const int* Space<Scalar>::get_dof_mapping() const
+    {
+      return this->dof_mapping.empty() ? NULL : &this->dof_mapping[0];
+    }
+
+    template<typename Scalar>
+    int Space<Scalar>::get_dof_mapping_size() const
+    {
+      return this->dof_mapping.size();
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::transfer_coeff_vector(const Scalar* previous_coeff_vec, Scalar* coeff_vec) const
+    {
+      int size = (next_dof - first_dof) / stride;
+      for (int i = 0; i < size; i++)
+        coeff_vec[i] = 0.0;
+      for (unsigned int i = 0; i < this->dof_mapping.size(); i++)
+        if(this->dof_mapping[i] >= 0)
+          coeff_vec[(this->dof_mapping[i] - first_dof) / stride] = previous_coeff_vec[i];
+    }
+
+    template<typename Scalar>
+    const typename Space<Scalar>::DofBlockRecord* Space<Scalar>::get_previous_block(Node* node) const
+    {
+      if(node->id >= (int)this->previous_node_blocks.size())
+        return NULL;
+      const DofBlockRecord* record = &this->previous_node_blocks[node->id];
+      if(record->dof < 0 || record->key[0] != (int)node->type || record->key[1] != node->p1 || record->key[2] != node->p2)
+        return NULL;
+      if(node->type == 0 && (record->x != node->x || record->y != node->y))
+        return NULL;
+      return record;
+    }
+
+    template<typename Scalar>
+    const typename Space<Scalar>::DofBlockRecord* Space<Scalar>::get_previous_block(Element* e) const
+    {
+      if(e->id >= (int)this->previous_element_blocks.size())
+        return NULL;
+      const DofBlockRecord* record = &this->previous_element_blocks[e->id];
+      if(record->dof < 0 || record->n != edata[e->id].n || record->key[3] != edata[e->id].order)
+        return NULL;
+      for (unsigned int i = 0; i < 3; i++)
+        if(record->key[i] != e->vn[i]->id)
+          return NULL;
+      return record;
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::add_stable_block(const DofBlockRecord* record, int* dof, int n, int& anchor, std::vector<std::pair<std::pair<int, int>, int> >& keys,
+      std::vector<int*>& block_dofs, std::vector<int>& block_lengths)
+    {
+      if(record != NULL)
+        anchor = record->dof;
+      keys.push_back(std::make_pair(std::make_pair(anchor, record == NULL ? 1 : 0), (int)block_dofs.size()));
+      block_dofs.push_back(dof);
+      block_lengths.push_back(n);
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::renumber_dofs_stably()
+    {
+      // The blocks in the order of the natural numbering, the unchanged ones sorted by their previous
+      // DOFs, each changed one directly after the unchanged block preceding it.
+      std::vector<std::pair<std::pair<int, int>, int> > keys;
+      std::vector<int*> block_dofs;
+      std::vector<int> block_lengths;
+      int anchor = -1;
+      Element* e;
+      for (int k = 0; k < 2; k++)
+        for_all_active_elements(e, mesh)
+          for (unsigned int i = 0; i < e->get_nvert(); i++)
+          {
+            Node* node = (k == 0) ? e->vn[i] : e->en[i];
+            NodeData* nd = ndata + node->id;
+            if(nd->dof < 0 || nd->n <= 0)
+              continue;
+            add_stable_block(get_previous_block(node), &nd->dof, nd->n, anchor, keys, block_dofs, block_lengths);
+            // Marks the node as processed, the DOF is set below.
+            nd->dof = H2D_UNASSIGNED_DOF - 1;
+          }
+      for_all_active_elements(e, mesh)
+        if(edata[e->id].bdof >= 0 && edata[e->id].n > 0)
+          add_stable_block(get_previous_block(e), &edata[e->id].bdof, edata[e->id].n, anchor, keys, block_dofs, block_lengths);
+
+      std::sort(keys.begin(), keys.end());
+      int dof = first_dof;
+      for (unsigned int i = 0; i < keys.size(); i++)
+      {
+        *block_dofs[keys[i].second] = dof;
+        dof += block_lengths[keys[i].second] * stride;
+      }
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::update_dof_tracking()
+    {
+      // The previous DOFs of the unchanged nodes and elements, the hierarchic edge functions of the
+      // orders present in both numberings.
+      this->dof_mapping.assign(this->previous_size, -1);
+      Element* e;
+      if(this->previous_size > 0)
+        for_all_active_elements(e, mesh)
+        {
+          for (unsigned int i = 0; i < 2 * e->get_nvert(); i++)
+          {
+            Node* node = (i < e->get_nvert()) ? e->vn[i] : e->en[i - e->get_nvert()];
+            NodeData* nd = ndata + node->id;
+            if(nd->dof < 0 || nd->n <= 0)
+              continue;
+            const DofBlockRecord* record = get_previous_block(node);
+            if(record != NULL)
+              for (int j = 0; j < std::min(nd->n, record->n); j++)
+                this->dof_mapping[(record->dof - previous_first_dof) / previous_stride + j] = nd->dof + j * stride;
+          }
+          const DofBlockRecord* record = (edata[e->id].bdof >= 0) ? get_previous_block(e) : NULL;
+          if(record != NULL)
+            for (int j = 0; j < record->n; j++)
+              this->dof_mapping[(record->dof - previous_first_dof) / previous_stride + j] = edata[e->id].bdof + j * stride;
+        }
+
+      DofBlockRecord unused;
+      unused.dof = -1;
+      this->previous_node_blocks.assign(mesh->get_max_node_id(), unused);
+      this->previous_element_blocks.assign(mesh->get_max_element_id(), unused);
+      for_all_active_elements(e, mesh)
+      {
+        for (unsigned int i = 0; i < 2 * e->get_nvert(); i++)
+        {
+          Node* node = (i < e->get_nvert()) ? e->vn[i] : e->en[i - e->get_nvert()];
+          NodeData* nd = ndata + node->id;
+          if(nd->dof < 0 || nd->n <= 0)
+            continue;
+          DofBlockRecord* record = &this->previous_node_blocks[node->id];
+          record->dof = nd->dof;
+          record->n = nd->n;
+          record->key[0] = node->type;
+          record->key[1] = node->p1;
+          record->key[2] = node->p2;
+          record->x = (node->type == 0) ? node->x : 0.0;
+          record->y = (node->type == 0) ? node->y : 0.0;
+        }
+        ElementData* ed = edata + e->id;
+        if(ed->bdof >= 0 && ed->n > 0)
+        {
+          DofBlockRecord* record = &this->previous_element_blocks[e->id];
+          record->dof = ed->bdof;
+          record->n = ed->n;
+          for (unsigned int i = 0; i < 3; i++)
+            record->key[i] = e->vn[i]->id;
+          record->key[3] = ed->order;
+        }
+      }
+      this->previous_first_dof = first_dof;
+      this->previous_stride = stride;
+      this->previous_size = (next_dof - first_dof) / stride;
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::set_dof_ordering(DofOrderingType dof_ordering)
+    {
+      this->dof_ordering = dof_ordering;
+      seq = g_space_seq++;
+    }
+
+    template<typename Scalar>
+    DofOrderingType Space<Scalar>::get_dof_ordering() const
+    {
+      return this->dof_ordering;
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::reorder_dofs()
+    {
+      // The blocks of consecutive DOFs: those of the nodes and of the element interiors, in the order of
+      // their first appearance in the active elements, which is the element block ordering.
+      int max_node_id = mesh->get_max_node_id();
+      int* node_blocks = new int[std::max(max_node_id, 1)];
+      for (int i = 0; i < max_node_id; i++)
+        node_blocks[i] = -1;
+      std::vector<int> block_lengths;
+      std::vector<int*> block_dofs;
+      std::vector<int> element_block_start(1, 0);
+      std::vector<int> element_blocks;
+
+      Element* e;
+      for_all_active_elements(e, mesh)
+      {
+        for (int k = 0; k < 2; k++)
+          for (unsigned int i = 0; i < e->get_nvert(); i++)
+          {
+            Node* node = (k == 0) ? e->vn[i] : e->en[i];
+            NodeData* nd = ndata + node->id;
+            if(nd->dof < 0 || nd->n <= 0)
+              continue;
+            if(node_blocks[node->id] < 0)
+            {
+              node_blocks[node->id] = block_lengths.size();
+              block_lengths.push_back(nd->n);
+              block_dofs.push_back(&nd->dof);
+            }
+            element_blocks.push_back(node_blocks[node->id]);
+          }
+        ElementData* ed = edata + e->id;
+        if(ed->bdof >= 0 && ed->n > 0)
+        {
+          element_blocks.push_back(block_lengths.size());
+          block_lengths.push_back(ed->n);
+          block_dofs.push_back(&ed->bdof);
+        }
+        element_block_start.push_back(element_blocks.size());
+      }
+      delete [] node_blocks;
+
+      int num_blocks = block_lengths.size();
+      int num_elements = element_block_start.size() - 1;
+      int* order = new int[std::max(num_blocks, 1)];
+      if(this->dof_ordering == HERMES_DOF_ORDERING_ELEMENT_BLOCKS)
+        for (int i = 0; i < num_blocks; i++)
+          order[i] = i;
+      else
+      {
+        // The elements of each block.
+        std::vector<int> block_element_start(num_blocks + 1, 0);
+        for (unsigned int i = 0; i < element_blocks.size(); i++)
+          block_element_start[element_blocks[i] + 1]++;
+        for (int i = 0; i < num_blocks; i++)
+          block_element_start[i + 1] += block_element_start[i];
+        std::vector<int> block_elements(element_blocks.size());
+        std::vector<int> position(block_element_start.begin(), block_element_start.end() - 1);
+        for (int i = 0; i < num_elements; i++)
+          for (int j = element_block_start[i]; j < element_block_start[i + 1]; j++)
+            block_elements[position[element_blocks[j]]++] = i;
+
+        // The graph of the blocks, those sharing an element are neighbors.
+        std::vector<int> adjacency_start(1, 0);
+        std::vector<int> adjacency;
+        std::vector<int> marks(num_blocks, -1);
+        for (int b = 0; b < num_blocks; b++)
+        {
+          marks[b] = b;
+          for (int i = block_element_start[b]; i < block_element_start[b + 1]; i++)
+          {
+            int element = block_elements[i];
+            for (int j = element_block_start[element]; j < element_block_start[element + 1]; j++)
+              if(marks[element_blocks[j]] != b)
+              {
+                marks[element_blocks[j]] = b;
+                adjacency.push_back(element_blocks[j]);
+              }
+          }
+          adjacency_start.push_back(adjacency.size());
+        }
+
+        if(this->dof_ordering == HERMES_DOF_ORDERING_RCM)
+          DofOrdering::reverse_cuthill_mckee(num_blocks, &adjacency_start[0], adjacency.empty() ? NULL : &adjacency[0], order);
+        else
+          DofOrdering::nested_dissection(num_blocks, &adjacency_start[0], adjacency.empty() ? NULL : &adjacency[0], order);
+      }
+
+      int dof = first_dof;
+      for (int i = 0; i < num_blocks; i++)
+      {
+        *block_dofs[order[i]] = dof;
+        dof += block_lengths[order[i]] * stride;
+      }
+      delete [] order;
     }
 
     template<typename Scalar>
@@ -951,6 +1509,10 @@ namespace Hermes
       Element* e;
       for_all_active_elements(e, mesh)
       {
+        // No bubble functions until assigned.
+        edata[e->id].bdof = H2D_UNASSIGNED_DOF;
+        edata[e->id].n = 0;
+
         for (unsigned int i = 0; i < e->get_nvert(); i++)
         {
           if(e->en[i]->bnd)
@@ -994,6 +1556,31 @@ namespace Hermes
         throw Hermes::Exceptions::Exception("The space in get_element_assembly_list() is out of date. You need to update it with assign_dofs()"
         " any time the mesh changes.");
 
+      if(this->al_cache_start == NULL)
+        build_assembly_list_cache();
+
+      if(e->id >= this->al_cache_size || this->al_cache_start[e->id] == this->al_cache_start[e->id + 1])
+        calculate_element_assembly_list(e, al);
+      else
+      {
+        // A copy of the cached list.
+        int start = this->al_cache_start[e->id];
+        al->cnt = this->al_cache_start[e->id + 1] - start;
+        while(al->cap < al->cnt)
+          al->enlarge();
+        memcpy(al->idx, this->al_cache_idx + start, al->cnt * sizeof(int));
+        memcpy(al->dof, this->al_cache_dof + start, al->cnt * sizeof(int));
+        memcpy(al->coef, this->al_cache_coef + start, al->cnt * sizeof(Scalar));
+      }
+
+      for(unsigned int i = 0; i < al->cnt; i++)
+        if(al->dof[i] >= 0)
+          al->dof[i] += first_dof;
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::calculate_element_assembly_list(Element* e, AsmList<Scalar>* al) const
+    {
       // add vertex, edge and bubble functions to the assembly list
       al->cnt = 0;
       for (unsigned int i = 0; i < e->get_nvert(); i++)
@@ -1001,9 +1588,162 @@ namespace Hermes
       for (unsigned int i = 0; i < e->get_nvert(); i++)
         get_boundary_assembly_list_internal(e, i, al);
       get_bubble_assembly_list(e, al);
-      for(unsigned int i = 0; i < al->cnt; i++)
-        if(al->dof[i] >= 0)
-          al->dof[i] += first_dof;
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::build_assembly_list_cache() const
+    {
+#pragma omp critical (space_assembly_list_cache)
+      if(this->al_cache_start == NULL)
+      {
+        int size = this->mesh->get_max_element_id();
+        int* start = new int[size + 1];
+        memset(start, 0, (size + 1) * sizeof(int));
+
+        // The counts first, then the lists themselves.
+        AsmList<Scalar> al;
+        Element* e;
+        for_all_active_elements(e, this->mesh)
+        {
+          calculate_element_assembly_list(e, &al);
+          start[e->id + 1] = al.cnt;
+        }
+        for (int i = 0; i < size; i++)
+          start[i + 1] += start[i];
+
+        this->al_cache_idx = new int[std::max(start[size], 1)];
+        this->al_cache_dof = new int[std::max(start[size], 1)];
+        this->al_cache_coef = new Scalar[std::max(start[size], 1)];
+        for_all_active_elements(e, this->mesh)
+        {
+          calculate_element_assembly_list(e, &al);
+          memcpy(this->al_cache_idx + start[e->id], al.idx, al.cnt * sizeof(int));
+          memcpy(this->al_cache_dof + start[e->id], al.dof, al.cnt * sizeof(int));
+          memcpy(this->al_cache_coef + start[e->id], al.coef, al.cnt * sizeof(Scalar));
+        }
+
+        this->al_cache_size = size;
+#pragma omp flush
+        this->al_cache_start = start;
+      }
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::free_assembly_list_cache()
+    {
+      if(this->al_cache_start != NULL)
+      {
+        delete [] this->al_cache_start;
+        delete [] this->al_cache_idx;
+        delete [] this->al_cache_dof;
+        delete [] this->al_cache_coef;
+        this->al_cache_start = NULL;
+      }
+    }
+
+    std::size_t SpaceMemoryUsage::get_total() const
+    {
+      return node_data + element_data + projection + assembly_lists + auxiliary;
+    }
+
+    template<typename Scalar>
+    SpaceMemoryUsage Space<Scalar>::get_memory_usage() const
+    {
+      SpaceMemoryUsage usage;
+      usage.node_data = this->ndata_allocated * sizeof(NodeData);
+      // The boundary projections are not sized, only the pointers are counted.
+      usage.node_data += this->bc_data.capacity() * sizeof(void*);
+      usage.element_data = this->esize * sizeof(ElementData);
+
+      usage.projection = 0;
+      if(this->proj_mat != NULL)
+        usage.projection += this->proj_mat_size * (sizeof(double*) + this->proj_mat_size * sizeof(double));
+      if(this->chol_p != NULL)
+        usage.projection += this->proj_mat_size * sizeof(double);
+      usage.projection += this->edge_bc_points.size() * (sizeof(EdgeBCPoint*) + sizeof(SurfPos)) + this->edge_bcs.capacity() * sizeof(EdgeBC);
+      for (unsigned int i = 0; i < this->edge_bc_points.size(); i++)
+        if(this->edge_bc_points[i] != NULL)
+          usage.projection += get_edge_bc_points_count() * sizeof(EdgeBCPoint);
+
+      usage.assembly_lists = 0;
+      if(this->al_cache_start != NULL)
+        usage.assembly_lists = (this->al_cache_size + 1) * sizeof(int) + this->al_cache_start[this->al_cache_size] * (2 * sizeof(int) + sizeof(Scalar));
+
+      usage.auxiliary = (this->previous_node_blocks.capacity() + this->previous_element_blocks.capacity()) * sizeof(DofBlockRecord)
+        + this->dof_mapping.capacity() * sizeof(int);
+      if(this->element_colors != NULL && this->mesh != NULL)
+        usage.auxiliary += this->mesh->get_max_element_id() * sizeof(int);
+
+      return usage;
+    }
+
+    template<typename Scalar>
+    std::size_t Space<Scalar>::get_total_memory_usage() const
+    {
+      return this->get_memory_usage().get_total();
+    }
+
+    template<typename Scalar>
+    const int* Space<Scalar>::get_element_coloring(int& num_colors) const
+    {
+      if(this->element_colors != NULL && this->element_colors_seq == this->seq)
+      {
+        num_colors = this->element_colors_count;
+        return this->element_colors;
+      }
+
+      if(this->element_colors != NULL)
+        delete [] this->element_colors;
+
+      int max_element_id = this->mesh->get_max_element_id();
+      this->element_colors = new int[max_element_id];
+      for(int i = 0; i < max_element_id; i++)
+        this->element_colors[i] = -1;
+
+      // DOFs of every active element, and the elements every DOF belongs to.
+      std::vector<std::vector<int> > element_dofs(max_element_id);
+      std::vector<std::vector<int> > dof_elements(this->get_max_dof() + 1);
+      AsmList<Scalar> al;
+      Element* e;
+      for_all_active_elements(e, this->mesh)
+      {
+        this->get_element_assembly_list(e, &al);
+        for(unsigned int i = 0; i < al.cnt; i++)
+          if(al.dof[i] >= 0)
+          {
+            element_dofs[e->id].push_back(al.dof[i]);
+            dof_elements[al.dof[i]].push_back(e->id);
+          }
+      }
+
+      // Greedy coloring, the lowest color not used by any already colored element sharing a DOF.
+      // color_taken_by[color] == e->id marks the color as not usable for the element e.
+      std::vector<int> color_taken_by;
+      this->element_colors_count = 0;
+      for_all_active_elements(e, this->mesh)
+      {
+        for(unsigned int i = 0; i < element_dofs[e->id].size(); i++)
+        {
+          std::vector<int>& elements = dof_elements[element_dofs[e->id][i]];
+          for(unsigned int j = 0; j < elements.size(); j++)
+            if(this->element_colors[elements[j]] >= 0)
+              color_taken_by[this->element_colors[elements[j]]] = e->id;
+        }
+
+        int color = 0;
+        while(color < this->element_colors_count && color_taken_by[color] == e->id)
+          color++;
+        if(color == this->element_colors_count)
+        {
+          this->element_colors_count++;
+          color_taken_by.push_back(-1);
+        }
+        this->element_colors[e->id] = color;
+      }
+
+      this->element_colors_seq = this->seq;
+      num_colors = this->element_colors_count;
+      return this->element_colors;
     }
 
     template<typename Scalar>
@@ -1042,6 +1782,15 @@ namespace Hermes
     void Space<Scalar>::precalculate_projection_matrix(int nv, double**& mat, double*& p)
     {
       int n = shapeset->get_max_order() + 1 - nv;
+      this->proj_mat_size = n;
+
+      // The matrix depends only on the shapeset (and the vertex functions left out), the name of the table says which.
+      bool cached = PrecalculatedTables::is_enabled();
+      std::stringstream name;
+      name << "space_edge_" << shapeset->get_id() << "_" << nv;
+      if(cached && PrecalculatedTables::load(name.str(), shapeset->get_max_order(), n, mat, p))
+        return;
+
       mat = new_matrix<double>(n, n);
       int component = (get_type() == HERMES_HDIV_SPACE) ? 1 : 0;
 
@@ -1066,10 +1815,13 @@ namespace Hermes
 
       p = new double[n];
       choldc(mat, n, p);
+
+      if(cached)
+        PrecalculatedTables::save(name.str(), shapeset->get_max_order(), n, mat, p);
     }
 
     template<typename Scalar>
-    void Space<Scalar>::update_edge_bc(Element* e, SurfPos* surf_pos)
+    void Space<Scalar>::collect_edge_bc(Element* e, SurfPos* surf_pos)
     {
       if(e->active)
       {
@@ -1083,14 +1835,9 @@ namespace Hermes
             EssentialBoundaryCondition<Scalar> *bc = this->essential_bcs->get_boundary_condition(this->mesh->boundary_markers_conversion.get_user_marker(en->marker).marker);
             if(bc != NULL)
             {
-              int order = get_edge_order_internal(en);
               surf_pos->marker = en->marker;
-              nd->edge_bc_proj = get_bc_projection(surf_pos, order, bc);
-              bc_data.push_back(nd->edge_bc_proj);
-
-              int i = surf_pos->surf_num, j = e->next_vert(i);
-              ndata[e->vn[i]->id].vertex_bc_coef = nd->edge_bc_proj + 0;
-              ndata[e->vn[j]->id].vertex_bc_coef = nd->edge_bc_proj + 1;
+              EdgeBC edge_bc = { e, *surf_pos, bc, get_edge_order_internal(en) };
+              edge_bcs.push_back(edge_bc);
             }
           }
       }
@@ -1101,18 +1848,70 @@ namespace Hermes
         {
           double mid = (surf_pos->lo + surf_pos->hi) * 0.5, tmp = surf_pos->hi;
           surf_pos->hi = mid;
-          update_edge_bc(e->sons[son1], surf_pos);
+          collect_edge_bc(e->sons[son1], surf_pos);
           surf_pos->lo = mid; surf_pos->hi = tmp;
-          update_edge_bc(e->sons[son2], surf_pos);
+          collect_edge_bc(e->sons[son2], surf_pos);
         }
         else
-          update_edge_bc(e->sons[son1], surf_pos);
+          collect_edge_bc(e->sons[son1], surf_pos);
+      }
+    }
+
+    template<typename Scalar>
+    int Space<Scalar>::get_edge_bc_points_count()
+    {
+      Quad1DStd quad1d;
+      return quad1d.get_num_points(quad1d.get_max_order()) + 2;
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::calc_edge_bc_points(SurfPos* surf_pos, EdgeBCPoint* points)
+    {
+      Quad1DStd quad1d;
+      int mo = quad1d.get_max_order();
+      double2* pt = quad1d.get_points(mo);
+      Nurbs* nurbs = surf_pos->base->is_curved() ? surf_pos->base->cm->nurbs[surf_pos->surf_num] : NULL;
+
+      for (int j = 0; j < quad1d.get_num_points(mo) + 2; j++)
+      {
+        double t;
+        if(j < 2)
+          t = (j == 0) ? surf_pos->lo : surf_pos->hi;
+        else
+        {
+          double u = (pt[j - 2][0] + 1) * 0.5;
+          t = surf_pos->lo * (1.0 - u) + surf_pos->hi * u;
+        }
+        EdgeBCPoint& point = points[j];
+        CurvMap::nurbs_edge(surf_pos->base, nurbs, surf_pos->surf_num, 2.0 * t - 1.0, point.x, point.y, point.n_x, point.n_y, point.t_x, point.t_y);
       }
     }
 
+    template<typename Scalar>
+    Scalar* Space<Scalar>::get_bc_projection(SurfPos* surf_pos, int order, EssentialBoundaryCondition<Scalar> *bc, const EdgeBCPoint* points)
+    {
+      return get_bc_projection(surf_pos, order, bc);
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::free_edge_bc_points()
+    {
+      for (unsigned int i = 0; i < edge_bc_points.size(); i++)
+        delete [] edge_bc_points[i];
+      edge_bc_points.clear();
+      edge_bc_points_positions.clear();
+      edge_bc_points_mesh_seq = -1;
+    }
+
     template<typename Scalar>
     void Space<Scalar>::update_essential_bc_values()
     {
+      // The cached assembly lists contain the values.
+      free_assembly_list_cache();
+      this->bc_values_seq++;
+
+      // The edges first (serially, they are found by the recursion over the refinement trees).
+      edge_bcs.clear();
       Element* e;
       for_all_base_elements(e, mesh)
       {
@@ -1122,10 +1921,90 @@ namespace Hermes
           if(e->vn[i]->bnd && e->vn[j]->bnd)
           {
             SurfPos surf_pos = {0, i, e, e->vn[i]->id, e->vn[j]->id, 0.0, 0.0, 1.0};
-            update_edge_bc(e, &surf_pos);
+            collect_edge_bc(e, &surf_pos);
+          }
+        }
+      }
+      int num_edges = edge_bcs.size();
+      if(num_edges == 0)
+        return;
+
+      // The geometry of the edges is kept until the mesh changes, only the values of the conditions are evaluated again.
+      if(edge_bc_points_mesh_seq != (int)this->mesh->get_seq())
+      {
+        free_edge_bc_points();
+        edge_bc_points_mesh_seq = this->mesh->get_seq();
+      }
+      if((int)edge_bc_points.size() < num_edges)
+      {
+        SurfPos empty_position = {0, -1, NULL, -1, -1, 0.0, 0.0, 0.0};
+        edge_bc_points.resize(num_edges, NULL);
+        edge_bc_points_positions.resize(num_edges, empty_position);
+      }
+      int points_count = get_edge_bc_points_count();
+
+      Scalar** projections = new Scalar*[num_edges];
+      Hermes::Exceptions::Exception* caughtException = NULL;
+      int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+
+      // Each edge writes only its own projection and geometry.
+#pragma omp parallel for schedule(dynamic, 16) num_threads(num_threads_used)
+      for (int i = 0; i < num_edges; i++)
+      {
+        EdgeBC& edge_bc = edge_bcs[i];
+        projections[i] = NULL;
+        try
+        {
+          const EdgeBCPoint* points = NULL;
+          if(edge_bc.bc->get_value_type() == EssentialBoundaryCondition<Scalar>::BC_FUNCTION)
+          {
+            SurfPos& position = edge_bc_points_positions[i];
+            if(edge_bc_points[i] == NULL || position.base != edge_bc.surf_pos.base || position.surf_num != edge_bc.surf_pos.surf_num
+              || position.lo != edge_bc.surf_pos.lo || position.hi != edge_bc.surf_pos.hi)
+            {
+              if(edge_bc_points[i] == NULL)
+                edge_bc_points[i] = new EdgeBCPoint[points_count];
+              calc_edge_bc_points(&edge_bc.surf_pos, edge_bc_points[i]);
+              position = edge_bc.surf_pos;
+            }
+            points = edge_bc_points[i];
           }
+          projections[i] = get_bc_projection(&edge_bc.surf_pos, edge_bc.order, edge_bc.bc, points);
+        }
+        catch(Hermes::Exceptions::Exception& exception)
+        {
+#pragma omp critical (space_bc_projection_exception)
+          if(caughtException == NULL)
+            caughtException = exception.clone();
+        }
+        catch(std::exception& exception)
+        {
+#pragma omp critical (space_bc_projection_exception)
+          if(caughtException == NULL)
+            caughtException = new Hermes::Exceptions::Exception(exception.what());
         }
       }
+
+      for (int i = 0; i < num_edges; i++)
+      {
+        if(projections[i] == NULL)
+          continue;
+        EdgeBC& edge_bc = edge_bcs[i];
+        ndata[edge_bc.e->en[edge_bc.surf_pos.surf_num]->id].edge_bc_proj = projections[i];
+        bc_data.push_back(projections[i]);
+
+        int vi = edge_bc.surf_pos.surf_num, vj = edge_bc.e->next_vert(vi);
+        ndata[edge_bc.e->vn[vi]->id].vertex_bc_coef = projections[i] + 0;
+        ndata[edge_bc.e->vn[vj]->id].vertex_bc_coef = projections[i] + 1;
+      }
+      delete [] projections;
+
+      if(caughtException != NULL)
+      {
+        Hermes::Exceptions::Exception exception(*caughtException);
+        delete caughtException;
+        throw exception;
+      }
     }
 
     template<typename Scalar>
@@ -1140,9 +2019,38 @@ namespace Hermes
     bool Space<Scalar>::save(const char *filename) const
     {
       this->check();
+      ElementDataSnapshot element_data;
+      this->get_element_data_snapshot(element_data);
+      return save(filename, this->get_type(), element_data);
+    }
+
+    template<typename Scalar>
+    bool Space<Scalar>::save_bin(const char *filename, bool compress) const
+    {
+      this->check();
+      ElementDataSnapshot element_data;
+      this->get_element_data_snapshot(element_data);
+      return save_bin(filename, this->get_type(), element_data, compress);
+    }
+
+    template<typename Scalar>
+    void Space<Scalar>::get_element_data_snapshot(ElementDataSnapshot& element_data) const
+    {
+      element_data.clear();
+      element_data.reserve(this->get_mesh()->get_max_element_id());
+
+      // Utility pointer.
+      Element *e;
+      for_all_elements(e, this->get_mesh())
+        element_data.push_back(std::pair<int, ElementData>(e->id, this->edata[e->id]));
+    }
+
+    template<typename Scalar>
+    bool Space<Scalar>::save(const char *filename, SpaceType type, const ElementDataSnapshot& element_data)
+    {
       XMLSpace::space xmlspace;
 
-      switch(this->get_type())
+      switch(type)
       {
         case HERMES_H1_SPACE:
             xmlspace.spaceType().set("h1");
@@ -1160,10 +2068,8 @@ namespace Hermes
             return false;
       }
 
-      // Utility pointer.
-      Element *e;
-      for_all_elements(e, this->get_mesh())
-        xmlspace.element_data().push_back(XMLSpace::space::element_data_type(e->id, this->edata[e->id].order, this->edata[e->id].bdof, this->edata[e->id].n, this->edata[e->id].changed_in_last_adaptation));
+      for(unsigned int i = 0; i < element_data.size(); i++)
+        xmlspace.element_data().push_back(XMLSpace::space::element_data_type(element_data[i].first, element_data[i].second.order, element_data[i].second.bdof, element_data[i].second.n, element_data[i].second.changed_in_last_adaptation));
 
       std::string space_schema_location(Hermes2DApi.get_text_param_value(xmlSchemasDirPath));
       space_schema_location.append("/space_h2d_xml.xsd");
@@ -1182,142 +2088,380 @@ namespace Hermes
       return true;
     }
 
-    template<typename Scalar>
-    Space<Scalar>* Space<Scalar>::load(const char *filename, Mesh* mesh, bool validate, EssentialBCs<Scalar>* essential_bcs, Shapeset* shapeset)
+    static const char H2D_SPACE_DELTA_MAGIC[8] = { 'H', '2', 'D', 'S', 'P', 'C', 'D', 'L' };
+    static const int H2D_SPACE_DELTA_BYTE_ORDER = 0x01020304;
+    static const int H2D_SPACE_DELTA_VERSION = 1;
+
+    static size_t space_delta_aligned_size(size_t bytes)
     {
-      try
-      {
-				Space<Scalar>* space;
+      return (bytes + 7) & ~(size_t)7;
+    }
 
-        ::xml_schema::flags parsing_flags = 0;
+    static void space_delta_write_block(std::ofstream& out, const void* data, size_t bytes)
+    {
+      static const char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+      if(bytes > 0)
+        out.write((const char*)data, bytes);
+      out.write(padding, space_delta_aligned_size(bytes) - bytes);
+    }
 
-        if(!validate)
-          parsing_flags = xml_schema::flags::dont_validate;
+    static const char H2D_SPACE_BINARY_MAGIC[8] = { 'H', '2', 'D', 'S', 'P', 'C', 'B', 'I' };
+    static const int H2D_SPACE_BINARY_VERSION = 1;
 
-        std::auto_ptr<XMLSpace::space> parsed_xml_space (XMLSpace::space_(filename, parsing_flags));
+    template<typename Scalar>
+    bool Space<Scalar>::save_bin(const char *filename, SpaceType type, const ElementDataSnapshot& element_data, bool compress)
+    {
+      // The arrays one after another, each of them compresses well on its own (ids ascending, orders repeating).
+      int count = element_data.size();
+      std::vector<int> block(5 * (size_t)count);
+      for(int i = 0; i < count; i++)
+      {
+        block[i] = element_data[i].first;
+        block[count + i] = element_data[i].second.order;
+        block[2 * count + i] = element_data[i].second.bdof;
+        block[3 * count + i] = element_data[i].second.n;
+        block[4 * count + i] = element_data[i].second.changed_in_last_adaptation ? 1 : 0;
+      }
+      size_t bytes = block.size() * sizeof(int);
+
+      BinaryHeader header;
+      memset(&header, 0, sizeof(BinaryHeader));
+      memcpy(header.magic, H2D_SPACE_BINARY_MAGIC, sizeof(H2D_SPACE_BINARY_MAGIC));
+      header.byte_order = H2D_SPACE_DELTA_BYTE_ORDER;
+      header.version = H2D_SPACE_BINARY_VERSION;
+      header.space_type = type;
+      header.count = count;
+      header.block_size = bytes;
+
+      const char* data = bytes > 0 ? (const char*)&block[0] : NULL;
+      std::vector<char> compressed;
+#ifdef WITH_ZSTD
+      if(compress && bytes > 0)
+      {
+        compressed.resize(ZSTD_compressBound(bytes));
+        size_t stored = ZSTD_compress(&compressed[0], compressed.size(), data, bytes, 3);
+        if(ZSTD_isError(stored))
+          return false;
+        header.compression = 1;
+        header.block_size = stored;
+        data = &compressed[0];
+      }
+#endif
 
-				if(!strcmp(parsed_xml_space->spaceType().get().c_str(),"h1"))
-				{
-					space = new H1Space<Scalar>();
-					space->mesh = mesh;
+      std::ofstream out(filename, std::ios::out | std::ios::binary);
+      if(!out.is_open())
+        return false;
+      space_delta_write_block(out, &header, sizeof(BinaryHeader));
+      space_delta_write_block(out, data, (size_t)header.block_size);
+      out.close();
 
-					if(shapeset == NULL)
-					{
-						space->shapeset = new H1Shapeset;
-						space->own_shapeset = true;
-					}
-					else
-					{
-						if(shapeset->get_space_type() != HERMES_H1_SPACE)
-							throw Hermes::Exceptions::SpaceLoadFailureException("Wrong shapeset / Wrong spaceType in the Solution XML file %s in Space::load.", filename);
-						else
-							space->shapeset = shapeset;
-					}
+      return !out.fail();
+    }
 
-					space->precalculate_projection_matrix(2, space->proj_mat, space->chol_p);
-				}
-				else if (!strcmp(parsed_xml_space->spaceType().get().c_str(),"hcurl"))
-				{
-					space = new HcurlSpace<Scalar>();
-					space->mesh = mesh;
+    template<typename Scalar>
+    bool Space<Scalar>::save_delta(const char *filename, SpaceType type, const ElementDataSnapshot& element_data, const char* parent_filename, const ElementDataSnapshot& parent_element_data)
+    {
+      // Parent data indexed by element id.
+      int max_id = 0;
+      for(unsigned int i = 0; i < parent_element_data.size(); i++)
+        max_id = std::max(max_id, parent_element_data[i].first + 1);
+      for(unsigned int i = 0; i < element_data.size(); i++)
+        max_id = std::max(max_id, element_data[i].first + 1);
+      std::vector<int> parent_index(max_id, -1);
+      for(unsigned int i = 0; i < parent_element_data.size(); i++)
+        parent_index[parent_element_data[i].first] = i;
+
+      std::vector<int> changed;
+      std::vector<bool> present(max_id, false);
+      for(unsigned int i = 0; i < element_data.size(); i++)
+      {
+        int id = element_data[i].first;
+        const ElementData& data = element_data[i].second;
+        present[id] = true;
+        if(parent_index[id] >= 0)
+        {
+          const ElementData& parent_data = parent_element_data[parent_index[id]].second;
+          if(data.order == parent_data.order && data.bdof == parent_data.bdof && data.n == parent_data.n && data.changed_in_last_adaptation == parent_data.changed_in_last_adaptation)
+            continue;
+        }
+        changed.push_back(id);
+        changed.push_back(data.order);
+        changed.push_back(data.bdof);
+        changed.push_back(data.n);
+        changed.push_back(data.changed_in_last_adaptation ? 1 : 0);
+      }
 
-					if(shapeset == NULL)
-					{
-						space->shapeset = new HcurlShapeset;
-						space->own_shapeset = true;
-					}
-				else
-					{
-						if(shapeset->get_num_components() < 2)
-							throw Hermes::Exceptions::Exception("HcurlSpace requires a vector shapeset in Space::load.");
-						if(shapeset->get_space_type() != HERMES_HCURL_SPACE)
-							throw Hermes::Exceptions::SpaceLoadFailureException("Wrong shapeset / Wrong spaceType in the Solution XML file %s in Space::load.", filename);
-						else
-							space->shapeset = shapeset;
-					}
+      std::vector<int> removed;
+      for(unsigned int i = 0; i < parent_element_data.size(); i++)
+        if(!present[parent_element_data[i].first])
+          removed.push_back(parent_element_data[i].first);
+
+      DeltaHeader header;
+      memset(&header, 0, sizeof(DeltaHeader));
+      memcpy(header.magic, H2D_SPACE_DELTA_MAGIC, sizeof(H2D_SPACE_DELTA_MAGIC));
+      header.byte_order = H2D_SPACE_DELTA_BYTE_ORDER;
+      header.version = H2D_SPACE_DELTA_VERSION;
+      header.space_type = type;
+      header.parent_name_length = strlen(parent_filename);
+      header.changed_count = changed.size() / 5;
+      header.removed_count = removed.size();
+
+      std::ofstream out(filename, std::ios::out | std::ios::binary);
+      if(!out.is_open())
+        return false;
+      space_delta_write_block(out, &header, sizeof(DeltaHeader));
+      space_delta_write_block(out, parent_filename, header.parent_name_length);
+      space_delta_write_block(out, changed.empty() ? NULL : &changed[0], changed.size() * sizeof(int));
+      space_delta_write_block(out, removed.empty() ? NULL : &removed[0], removed.size() * sizeof(int));
+      out.close();
 
-					space->precalculate_projection_matrix(0, space->proj_mat, space->chol_p);
-				}
-				else if(!!strcmp(parsed_xml_space->spaceType().get().c_str(),"hdiv"))
-				{
-					space = new HdivSpace<Scalar>();
-					space->mesh = mesh;
+      return !out.fail();
+    }
 
-					if(shapeset == NULL)
-					{
-						space->shapeset = new HdivShapeset;
-						space->own_shapeset = true;
-					}
-					else
-					{
-						if(shapeset->get_num_components() < 2)
-							throw Hermes::Exceptions::Exception("HdivSpace requires a vector shapeset in Space::load.");
-						if(shapeset->get_space_type() != HERMES_HDIV_SPACE)
-							throw Hermes::Exceptions::SpaceLoadFailureException("Wrong shapeset / Wrong spaceType in the Solution XML file %s in Space::load.", filename);
-						else
-							space->shapeset = shapeset;
-					}
+    template<typename Scalar>
+    void Space<Scalar>::load_element_data(const char *filename, bool validate, SpaceType& type, ElementDataSnapshot& element_data)
+    {
+      std::ifstream in(filename, std::ios::in | std::ios::binary);
+      if(!in.is_open())
+        throw Hermes::Exceptions::SpaceLoadFailureException("Could not open the space file %s.", filename);
+      char magic[8];
+      in.read(magic, sizeof(magic));
+
+      if(in.good() && memcmp(magic, H2D_SPACE_DELTA_MAGIC, sizeof(H2D_SPACE_DELTA_MAGIC)) == 0)
+      {
+        DeltaHeader header;
+        in.seekg(0, std::ios::beg);
+        in.read((char*)&header, sizeof(DeltaHeader));
+        if(header.byte_order != H2D_SPACE_DELTA_BYTE_ORDER)
+          throw Hermes::Exceptions::SpaceLoadFailureException("The space delta file %s was written on a platform with a different byte order.", filename);
+        if(header.version != H2D_SPACE_DELTA_VERSION)
+          throw Hermes::Exceptions::SpaceLoadFailureException("Unsupported space delta file version %i (expected %i).", header.version, H2D_SPACE_DELTA_VERSION);
+        if(header.parent_name_length <= 0 || header.changed_count < 0 || header.removed_count < 0)
+          throw Hermes::Exceptions::SpaceLoadFailureException("Corrupt space delta file %s.", filename);
+
+        std::vector<char> parent_filename(space_delta_aligned_size(header.parent_name_length));
+        std::vector<int> changed(space_delta_aligned_size(5 * (size_t)header.changed_count * sizeof(int)) / sizeof(int));
+        std::vector<int> removed(space_delta_aligned_size((size_t)header.removed_count * sizeof(int)) / sizeof(int));
+        in.seekg(space_delta_aligned_size(sizeof(DeltaHeader)), std::ios::beg);
+        in.read(&parent_filename[0], parent_filename.size());
+        if(!changed.empty())
+          in.read((char*)&changed[0], changed.size() * sizeof(int));
+        if(!removed.empty())
+          in.read((char*)&removed[0], removed.size() * sizeof(int));
+        if(in.fail())
+          throw Hermes::Exceptions::SpaceLoadFailureException("The space delta file %s is truncated.", filename);
+        in.close();
+
+        // The chain of parents first.
+        load_element_data(std::string(&parent_filename[0], header.parent_name_length).c_str(), validate, type, element_data);
+        if(type != header.space_type)
+          throw Hermes::Exceptions::SpaceLoadFailureException("Space types not compliant in the space delta file %s.", filename);
+
+        std::map<int, unsigned int> index;
+        for(unsigned int i = 0; i < element_data.size(); i++)
+          index[element_data[i].first] = i;
+
+        for(int i = 0; i < header.changed_count; i++)
+        {
+          ElementData data;
+          data.order = changed[5 * i + 1];
+          data.bdof = changed[5 * i + 2];
+          data.n = changed[5 * i + 3];
+          data.changed_in_last_adaptation = changed[5 * i + 4] != 0;
+          std::map<int, unsigned int>::iterator it = index.find(changed[5 * i]);
+          if(it == index.end())
+          {
+            index[changed[5 * i]] = element_data.size();
+            element_data.push_back(std::pair<int, ElementData>(changed[5 * i], data));
+          }
+          else
+            element_data[it->second].second = data;
+        }
 
-					space->precalculate_projection_matrix(0, space->proj_mat, space->chol_p);
-				}
-				else if(strcmp(parsed_xml_space->spaceType().get().c_str(),"l2"))
-				{
-					space = new L2Space<Scalar>();
-					space->mesh = mesh;
+        if(header.removed_count > 0)
+        {
+          std::set<int> removed_ids(removed.begin(), removed.begin() + header.removed_count);
+          ElementDataSnapshot kept;
+          kept.reserve(element_data.size());
+          for(unsigned int i = 0; i < element_data.size(); i++)
+            if(removed_ids.find(element_data[i].first) == removed_ids.end())
+              kept.push_back(element_data[i]);
+          element_data = kept;
+        }
+        return;
+      }
 
-					if(shapeset == NULL)
-					{
-						space->shapeset = new L2Shapeset;
-						space->own_shapeset = true;
-					}
-					{
-						if(shapeset->get_space_type() != HERMES_L2_SPACE)
-							throw Hermes::Exceptions::SpaceLoadFailureException("Wrong shapeset / Wrong spaceType in the Solution XML file %s in Space::load.", filename);
-						else
-							space->shapeset = shapeset;
-					}
+      if(in.good() && memcmp(magic, H2D_SPACE_BINARY_MAGIC, sizeof(H2D_SPACE_BINARY_MAGIC)) == 0)
+      {
+        BinaryHeader header;
+        in.seekg(0, std::ios::beg);
+        in.read((char*)&header, sizeof(BinaryHeader));
+        if(header.byte_order != H2D_SPACE_DELTA_BYTE_ORDER)
+          throw Hermes::Exceptions::SpaceLoadFailureException("The binary space file %s was written on a platform with a different byte order.", filename);
+        if(header.version != H2D_SPACE_BINARY_VERSION)
+          throw Hermes::Exceptions::SpaceLoadFailureException("Unsupported binary space file version %i (expected %i).", header.version, H2D_SPACE_BINARY_VERSION);
+        size_t bytes = 5 * (size_t)header.count * sizeof(int);
+        if(header.count < 0 || (header.compression == 0 && header.block_size != bytes))
+          throw Hermes::Exceptions::SpaceLoadFailureException("Corrupt binary space file %s.", filename);
+
+        std::vector<char> stored((size_t)header.block_size);
+        in.seekg(space_delta_aligned_size(sizeof(BinaryHeader)), std::ios::beg);
+        if(!stored.empty())
+          in.read(&stored[0], stored.size());
+        if(in.fail())
+          throw Hermes::Exceptions::SpaceLoadFailureException("The binary space file %s is truncated.", filename);
+        in.close();
+
+        std::vector<int> block(5 * (size_t)header.count);
+        if(header.compression != 0)
+        {
+#ifdef WITH_ZSTD
+          size_t result = ZSTD_decompress(block.empty() ? NULL : &block[0], bytes, stored.empty() ? NULL : &stored[0], stored.size());
+          if(ZSTD_isError(result) || result != bytes)
+            throw Hermes::Exceptions::SpaceLoadFailureException("Decompression of the binary space file %s failed.", filename);
+#else
+          throw Hermes::Exceptions::SpaceLoadFailureException("The binary space file %s is compressed, Hermes has to be built with WITH_ZSTD to read it.", filename);
+#endif
+        }
+        else if(bytes > 0)
+          memcpy(&block[0], &stored[0], bytes);
+
+        type = (SpaceType)header.space_type;
+        int count = header.count;
+        element_data.clear();
+        element_data.reserve(count);
+        for(int i = 0; i < count; i++)
+        {
+          ElementData data;
+          data.order = block[count + i];
+          data.bdof = block[2 * count + i];
+          data.n = block[3 * count + i];
+          data.changed_in_last_adaptation = block[4 * count + i] != 0;
+          element_data.push_back(std::pair<int, ElementData>(block[i], data));
+        }
+        return;
+      }
+      in.close();
 
-					static_cast<L2Space<Scalar>*>(space)->ldata = NULL;
-					static_cast<L2Space<Scalar>*>(space)->lsize = 0;
-				}
-				else
-				{
-					throw Exceptions::SpaceLoadFailureException("Wrong spaceType in the Solution XML file %s in Space::load.", filename);
-					return NULL;
-				}
+      try
+      {
+        ::xml_schema::flags parsing_flags = 0;
 
-				space->essential_bcs = essential_bcs;
-				space->mesh_seq = space->mesh->get_seq();
+        if(!validate)
+          parsing_flags = xml_schema::flags::dont_validate;
 
-				// L2 space does not have any (strong) essential BCs.
-				if(essential_bcs != NULL && parsed_xml_space->spaceType().get().c_str() != "l2")
-					for(typename Hermes::vector<EssentialBoundaryCondition<Scalar>*>::const_iterator it = essential_bcs->begin(); it != essential_bcs->end(); it++)
-						for(unsigned int i = 0; i < (*it)->markers.size(); i++)
-							if(space->get_mesh()->boundary_markers_conversion.conversion_table_inverse.find((*it)->markers.at(i)) == space->get_mesh()->boundary_markers_conversion.conversion_table_inverse.end())
-								throw Hermes::Exceptions::Exception("A boundary condition defined on a non-existent marker.");
+        std::auto_ptr<XMLSpace::space> parsed_xml_space (XMLSpace::space_(filename, parsing_flags));
 
-				space->resize_tables();
+        if(!strcmp(parsed_xml_space->spaceType().get().c_str(),"h1"))
+          type = HERMES_H1_SPACE;
+        else if(!strcmp(parsed_xml_space->spaceType().get().c_str(),"hcurl"))
+          type = HERMES_HCURL_SPACE;
+        else if(!strcmp(parsed_xml_space->spaceType().get().c_str(),"hdiv"))
+          type = HERMES_HDIV_SPACE;
+        else if(!strcmp(parsed_xml_space->spaceType().get().c_str(),"l2"))
+          type = HERMES_L2_SPACE;
+        else
+          throw Exceptions::SpaceLoadFailureException("Wrong spaceType in the Solution XML file %s in Space::load.", filename);
 
         // Element data //
         unsigned int elem_data_count = parsed_xml_space->element_data().size();
+        element_data.clear();
+        element_data.reserve(elem_data_count);
         for (unsigned int elem_data_i = 0; elem_data_i < elem_data_count; elem_data_i++)
         {
-          space->edata[parsed_xml_space->element_data().at(elem_data_i).e_id()].order = parsed_xml_space->element_data().at(elem_data_i).ord();
-          space->edata[parsed_xml_space->element_data().at(elem_data_i).e_id()].bdof = parsed_xml_space->element_data().at(elem_data_i).bd();
-          space->edata[parsed_xml_space->element_data().at(elem_data_i).e_id()].n = parsed_xml_space->element_data().at(elem_data_i).n();
-          space->edata[parsed_xml_space->element_data().at(elem_data_i).e_id()].changed_in_last_adaptation = parsed_xml_space->element_data().at(elem_data_i).chgd();
+          ElementData data;
+          data.order = parsed_xml_space->element_data().at(elem_data_i).ord();
+          data.bdof = parsed_xml_space->element_data().at(elem_data_i).bd();
+          data.n = parsed_xml_space->element_data().at(elem_data_i).n();
+          data.changed_in_last_adaptation = parsed_xml_space->element_data().at(elem_data_i).chgd();
+          element_data.push_back(std::pair<int, ElementData>(parsed_xml_space->element_data().at(elem_data_i).e_id(), data));
         }
+      }
+      catch (const xml_schema::exception& e)
+      {
+        throw Hermes::Exceptions::SpaceLoadFailureException(e.what());
+      }
+    }
 
-        space->seq = g_space_seq++;
+    template<typename Scalar>
+    Space<Scalar>* Space<Scalar>::load(const char *filename, Mesh* mesh, bool validate, EssentialBCs<Scalar>* essential_bcs, Shapeset* shapeset)
+    {
+      SpaceType type;
+      ElementDataSnapshot element_data;
+      load_element_data(filename, validate, type, element_data);
+      return load(type, element_data, mesh, essential_bcs, shapeset);
+    }
+
+    template<typename Scalar>
+    Space<Scalar>* Space<Scalar>::load(SpaceType type, const ElementDataSnapshot& element_data, Mesh* mesh, EssentialBCs<Scalar>* essential_bcs, Shapeset* shapeset)
+    {
+      Space<Scalar>* space;
 
-        space->assign_dofs();
+      if(shapeset != NULL && shapeset->get_space_type() != type)
+        throw Hermes::Exceptions::SpaceLoadFailureException("Wrong shapeset / Wrong spaceType in Space::load.");
 
-        return space;
+      switch(type)
+      {
+      case HERMES_H1_SPACE:
+        space = new H1Space<Scalar>();
+        space->shapeset = (shapeset == NULL) ? new H1Shapeset : shapeset;
+        break;
+      case HERMES_HCURL_SPACE:
+        if(shapeset != NULL && shapeset->get_num_components() < 2)
+          throw Hermes::Exceptions::Exception("HcurlSpace requires a vector shapeset in Space::load.");
+        space = new HcurlSpace<Scalar>();
+        space->shapeset = (shapeset == NULL) ? new HcurlShapeset : shapeset;
+        break;
+      case HERMES_HDIV_SPACE:
+        if(shapeset != NULL && shapeset->get_num_components() < 2)
+          throw Hermes::Exceptions::Exception("HdivSpace requires a vector shapeset in Space::load.");
+        space = new HdivSpace<Scalar>();
+        space->shapeset = (shapeset == NULL) ? new HdivShapeset : shapeset;
+        break;
+      case HERMES_L2_SPACE:
+        space = new L2Space<Scalar>();
+        space->shapeset = (shapeset == NULL) ? new L2Shapeset : shapeset;
+        static_cast<L2Space<Scalar>*>(space)->ldata = NULL;
+        static_cast<L2Space<Scalar>*>(space)->lsize = 0;
+        break;
+      default:
+        throw Exceptions::SpaceLoadFailureException("Wrong spaceType in Space::load.");
       }
-      catch (const xml_schema::exception& e)
+      space->own_shapeset = (shapeset == NULL);
+      space->mesh = mesh;
+#pragma omp atomic
+      mesh->space_count++;
+
+      if(type == HERMES_H1_SPACE)
+        space->precalculate_projection_matrix(2, space->proj_mat, space->chol_p);
+      else if(type != HERMES_L2_SPACE)
+        space->precalculate_projection_matrix(0, space->proj_mat, space->chol_p);
+
+      space->essential_bcs = essential_bcs;
+      space->mesh_seq = space->mesh->get_seq();
+
+      // L2 space does not have any (strong) essential BCs.
+      if(essential_bcs != NULL && type != HERMES_L2_SPACE)
+        for(typename Hermes::vector<EssentialBoundaryCondition<Scalar>*>::const_iterator it = essential_bcs->begin(); it != essential_bcs->end(); it++)
+          for(unsigned int i = 0; i < (*it)->markers.size(); i++)
+            if(space->get_mesh()->boundary_markers_conversion.conversion_table_inverse.find((*it)->markers.at(i)) == space->get_mesh()->boundary_markers_conversion.conversion_table_inverse.end())
+              throw Hermes::Exceptions::Exception("A boundary condition defined on a non-existent marker.");
+
+      space->resize_tables();
+
+      // Element data //
+      for (unsigned int elem_data_i = 0; elem_data_i < element_data.size(); elem_data_i++)
       {
-        throw Hermes::Exceptions::SpaceLoadFailureException(e.what());
+        if(element_data[elem_data_i].first < 0 || element_data[elem_data_i].first >= space->esize)
+          throw Hermes::Exceptions::SpaceLoadFailureException("Element #%i of the space file does not exist in the mesh.", element_data[elem_data_i].first);
+        space->edata[element_data[elem_data_i].first] = element_data[elem_data_i].second;
       }
+
+      space->seq = g_space_seq++;
+
+      space->assign_dofs();
+
+      return space;
     }
 
     template class HERMES_API Space<double>;
@@ -14,12 +14,13 @@
 // along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "space_h1.h"
+#include <algorithm>
 namespace Hermes
 {
   namespace Hermes2D
   {
     template<typename Scalar>
-    H1Space<Scalar>::H1Space() : Space<Scalar>()
+    H1Space<Scalar>::H1Space() : Space<Scalar>(), constraint_mesh_seq(-1), constraint_space_seq(-1), constraint_shapeset(NULL)
     {
     }
 
@@ -46,14 +47,14 @@ namespace Hermes
 
     template<typename Scalar>
     H1Space<Scalar>::H1Space(const Mesh* mesh, EssentialBCs<Scalar>* essential_bcs, int p_init, Shapeset* shapeset)
-      : Space<Scalar>(mesh, shapeset, essential_bcs)
+      : Space<Scalar>(mesh, shapeset, essential_bcs), constraint_mesh_seq(-1), constraint_space_seq(-1), constraint_shapeset(NULL)
     {
       init(shapeset, p_init);
     }
 
     template<typename Scalar>
     H1Space<Scalar>::H1Space(const Mesh* mesh, int p_init, Shapeset* shapeset)
-      : Space<Scalar>(mesh, shapeset, NULL)
+      : Space<Scalar>(mesh, shapeset, NULL), constraint_mesh_seq(-1), constraint_space_seq(-1), constraint_shapeset(NULL)
     {
       init(shapeset, p_init);
     }
@@ -69,6 +70,7 @@ namespace Hermes
     void H1Space<Scalar>::copy(const Space<Scalar>* space, Mesh* new_mesh)
     {
       Space<Scalar>::copy(space, new_mesh);
+      this->constraint_mesh_seq = -1;
 
       this->precalculate_projection_matrix(2, this->proj_mat, this->chol_p);
 
@@ -266,28 +268,31 @@ namespace Hermes
 
     template<typename Scalar>
     Scalar* H1Space<Scalar>::get_bc_projection(SurfPos* surf_pos, int order, EssentialBoundaryCondition<Scalar> *bc)
+    {
+      if(bc->get_value_type() != EssentialBoundaryCondition<Scalar>::BC_FUNCTION)
+        return get_bc_projection(surf_pos, order, bc, NULL);
+
+      typename Space<Scalar>::EdgeBCPoint* points = new typename Space<Scalar>::EdgeBCPoint[this->get_edge_bc_points_count()];
+      this->calc_edge_bc_points(surf_pos, points);
+      Scalar* proj = get_bc_projection(surf_pos, order, bc, points);
+      delete [] points;
+      return proj;
+    }
+
+    template<typename Scalar>
+    Scalar* H1Space<Scalar>::get_bc_projection(SurfPos* surf_pos, int order, EssentialBoundaryCondition<Scalar> *bc, const typename Space<Scalar>::EdgeBCPoint* points)
     {
       assert(order >= 1);
       Scalar* proj = new Scalar[order + 1];
+      bool constant = (bc->get_value_type() == EssentialBoundaryCondition<Scalar>::BC_CONST);
 
-      if(bc->get_value_type() == EssentialBoundaryCondition<Scalar>::BC_CONST)
-      {
+      if(constant)
         proj[0] = proj[1] = bc->value_const;
-      } // If the BC is not constant.
-      else if(bc->get_value_type() == EssentialBoundaryCondition<Scalar>::BC_FUNCTION)
+      else
       {
-        surf_pos->t = surf_pos->lo;
-        // Find out the (x, y) coordinates for the first endpoint.
-        double x, y, n_x, n_y, t_x, t_y;
-        Nurbs* nurbs = surf_pos->base->is_curved() ? surf_pos->base->cm->nurbs[surf_pos->surf_num] : NULL;
-        CurvMap::nurbs_edge(surf_pos->base, nurbs, surf_pos->surf_num, 2.0*surf_pos->t - 1.0, x, y, n_x, n_y, t_x, t_y);
-        // Calculate.
-        proj[0] = bc->value(x, y, n_x, n_y, t_x, t_y);
-        surf_pos->t = surf_pos->hi;
-        // Find out the (x, y) coordinates for the second endpoint.
-        CurvMap::nurbs_edge(surf_pos->base, nurbs, surf_pos->surf_num, 2.0*surf_pos->t - 1.0, x, y, n_x, n_y, t_x, t_y);
-        // Calculate.
-        proj[1] = bc->value(x, y, n_x, n_y, t_x, t_y);
+        // The endpoints.
+        proj[0] = bc->value(points[0].x, points[0].y, points[0].n_x, points[0].n_y, points[0].t_x, points[0].t_y);
+        proj[1] = bc->value(points[1].x, points[1].y, points[1].n_x, points[1].n_y, points[1].t_x, points[1].t_y);
       }
 
       if(order-- > 1)
@@ -296,34 +301,33 @@ namespace Hermes
         Scalar* rhs = proj + 2;
         int mo = quad1d.get_max_order();
         double2* pt = quad1d.get_points(mo);
+        int np = quad1d.get_num_points(mo);
+
+        // The weighted difference of the boundary values and their linear part at the integration points,
+        // evaluated once for all the edge functions.
+        Scalar* diff = new Scalar[np];
+        for (int j = 0; j < np; j++)
+        {
+          double t = (pt[j][0] + 1) * 0.5, s = 1.0 - t;
+          Scalar l = proj[0] * s + proj[1] * t;
+          if(constant)
+            diff[j] = pt[j][1] * (bc->value_const - l);
+          else
+          {
+            const typename Space<Scalar>::EdgeBCPoint& point = points[j + 2];
+            diff[j] = pt[j][1] * (bc->value(point.x, point.y, point.n_x, point.n_y, point.t_x, point.t_y) - l);
+          }
+        }
 
-        // get boundary values at integration points, construct rhs
+        // construct rhs
         for (int i = 0; i < order; i++)
         {
           rhs[i] = 0.0;
           int ii = this->shapeset->get_edge_index(0, 0, i + 2, surf_pos->base->get_mode());
-          for (int j = 0; j < quad1d.get_num_points(mo); j++)
-          {
-            double t = (pt[j][0] + 1) * 0.5, s = 1.0 - t;
-            Scalar l = proj[0] * s + proj[1] * t;
-            surf_pos->t = surf_pos->lo * s + surf_pos->hi * t;
-
-            if(bc->get_value_type() == EssentialBoundaryCondition<Scalar>::BC_CONST)
-              rhs[i] += pt[j][1] * this->shapeset->get_fn_value(ii, pt[j][0], -1.0, 0, surf_pos->base->get_mode())
-              * (bc->value_const - l);
-            // If the BC is not constant.
-            else if(bc->get_value_type() == EssentialBoundaryCondition<Scalar>::BC_FUNCTION)
-            {
-              // Find out the (x, y) coordinate.
-              double x, y, n_x, n_y, t_x, t_y;
-              Nurbs* nurbs = surf_pos->base->is_curved() ? surf_pos->base->cm->nurbs[surf_pos->surf_num] : NULL;
-              CurvMap::nurbs_edge(surf_pos->base, nurbs, surf_pos->surf_num, 2.0*surf_pos->t - 1.0, x, y, n_x, n_y, t_x, t_y);
-              // Calculate.
-              rhs[i] += pt[j][1] * this->shapeset->get_fn_value(ii, pt[j][0], -1.0, 0, surf_pos->base->get_mode())
-                * (bc->value(x, y, n_x, n_y, t_x, t_y) - l);
-            }
-          }
+          for (int j = 0; j < np; j++)
+            rhs[i] += this->shapeset->get_fn_value(ii, pt[j][0], -1.0, 0, surf_pos->base->get_mode()) * diff[j];
         }
+        delete [] diff;
 
         // solve the system using a precalculated Cholesky decomposed projection matrix
         cholsl(this->proj_mat, order, this->chol_p, rhs, rhs);
@@ -332,91 +336,75 @@ namespace Hermes
       return proj;
     }
 
-    template<typename Scalar>
-    inline void H1Space<Scalar>::output_component(typename Space<Scalar>::BaseComponent*& current, typename Space<Scalar>::BaseComponent*& last, typename Space<Scalar>::BaseComponent* min,
-      Node*& edge, typename Space<Scalar>::BaseComponent*& edge_dofs)
+    /// Orders the baselist components by the DOFs.
+    template<typename Component>
+    static bool base_component_less(const Component& a, const Component& b)
     {
-      // if the dof is already in the list, just add half of the other coef
-      if(last != NULL && last->dof == min->dof)
-      {
-        last->coef += min->coef * 0.5;
-        return;
-      }
-
-      // leave space for edge node dofs if they belong in front of the current minimum dof
-      if(edge != NULL && this->ndata[edge->id].dof <= min->dof)
-      {
-        edge_dofs = current;
-
-        // (reserve space only if the edge dofs are not in the list yet)
-        if(this->ndata[edge->id].dof != min->dof)
-        {
-          current += this->ndata[edge->id].n;
-        }
-        edge = NULL;
-      }
+      return a.dof < b.dof;
+    }
 
-      // output new dof
-      current->dof = min->dof;
-      current->coef = min->coef * 0.5;
-      last = current++;
+    /// Orders the constraint components by the nodes and the functions.
+    template<typename Component>
+    static bool constraint_component_less(const Component& a, const Component& b)
+    {
+      return a.node < b.node || (a.node == b.node && a.k < b.k);
     }
 
     template<typename Scalar>
-    typename Space<Scalar>::BaseComponent* H1Space<Scalar>::merge_baselists(typename Space<Scalar>::BaseComponent* l1, int n1, typename Space<Scalar>::BaseComponent* l2, int n2,
-      Node* edge, typename Space<Scalar>::BaseComponent*& edge_dofs, int& ncomponents)
+    void H1Space<Scalar>::add_vertex_constraint(Node* mid_vn, Node* vn0, Node* vn1, Node* en, double mid, int ori, ElementMode2D mode)
     {
-      // estimate the upper bound of the result size
-      int max_result = n1 + n2;
-      if(edge != NULL) max_result += this->ndata[edge->id].n;
-
-      typename Space<Scalar>::BaseComponent* result = (typename Space<Scalar>::BaseComponent*) malloc(max_result * sizeof(typename Space<Scalar>::BaseComponent));
-      typename Space<Scalar>::BaseComponent* current = result;
-      typename Space<Scalar>::BaseComponent* last = NULL;
-
-      // main loop - always output the component with smaller dof so that we get a sorted array
-      int i1 = 0, i2 = 0;
-      while (i1 < n1 && i2 < n2)
+      // Halves of the constraints of the endpoints (an unconstrained endpoint is its own constraint),
+      // except the functions of the constraining edge, exact at the midpoint.
+      std::vector<ConstraintComponent> merged;
+      Node* vn[2] = { vn0, vn1 };
+      for (int k = 0; k < 2; k++)
       {
-        if(l1[i1].dof < l2[i2].dof)
-          output_component(current, last, l1 + i1++, edge, edge_dofs);
+        if(vn[k]->is_constrained_vertex() && vn[k]->id < (int)this->constraint_start.size() && this->constraint_start[vn[k]->id] >= 0)
+        {
+          for (int i = 0; i < this->constraint_count[vn[k]->id]; i++)
+          {
+            ConstraintComponent component = this->constraint_components[this->constraint_start[vn[k]->id] + i];
+            if(component.node == en->id && component.k >= 0)
+              continue;
+            component.coef *= 0.5;
+            merged.push_back(component);
+          }
+        }
         else
-          output_component(current, last, l2 + i2++, edge, edge_dofs);
+        {
+          ConstraintComponent component = { vn[k]->id, -1, 0.5 };
+          merged.push_back(component);
+        }
       }
 
-      // finish the longer baselist
-      while (i1 < n1) output_component(current, last, l1 + i1++, edge, edge_dofs);
-      while (i2 < n2) output_component(current, last, l2 + i2++, edge, edge_dofs);
-
-      // don't forget to reserve space for edge dofs if we haven't done that already
-      if(edge != NULL)
+      std::sort(merged.begin(), merged.end(), constraint_component_less<ConstraintComponent>);
+      int start = this->constraint_components.size();
+      for (unsigned int i = 0; i < merged.size(); i++)
       {
-        edge_dofs = current;
-        current += this->ndata[edge->id].n;
+        if(this->constraint_components.size() > (unsigned int)start && !constraint_component_less(this->constraint_components.back(), merged[i]))
+          this->constraint_components.back().coef += merged[i].coef;
+        else
+          this->constraint_components.push_back(merged[i]);
       }
 
-      // if we produced less components than we expected, reallocate the resulting array
-      // ...this should be OK as we are always shrinking the array so no copying should occur
-      ncomponents = current - result;
-      if(ncomponents < max_result)
+      // The edge functions at the midpoint.
+      for (int k = 0; k < this->ndata[en->id].n; k++)
       {
-        typename Space<Scalar>::BaseComponent* reallocated_result = (typename Space<Scalar>::BaseComponent*) realloc(result, ncomponents * sizeof(typename Space<Scalar>::BaseComponent));
-        if(edge_dofs != NULL)
-        {
-          edge_dofs = reallocated_result + (edge_dofs - result);
-        }
-        return reallocated_result;
+        ConstraintComponent component = { en->id, k, this->shapeset->get_fn_value(this->shapeset->get_edge_index(0, ori, k + 2, mode), mid, -1.0, 0, mode) };
+        this->constraint_components.push_back(component);
       }
-      else
-        return result;
+
+      if(this->constraint_start[mid_vn->id] < 0)
+        this->constrained_vertices.push_back(mid_vn->id);
+      this->constraint_start[mid_vn->id] = start;
+      this->constraint_count[mid_vn->id] = this->constraint_components.size() - start;
     }
 
     template<typename Scalar>
     void H1Space<Scalar>::update_constrained_nodes(Element* e, EdgeInfo* ei0, EdgeInfo* ei1, EdgeInfo* ei2, EdgeInfo* ei3)
     {
-      int j, k;
+      int j;
       EdgeInfo* ei[4] = { ei0, ei1, ei2, ei3 };
-      typename Space<Scalar>::NodeData* nd;
 
       if(this->get_element_order(e->id) == 0) return;
 
@@ -427,10 +415,9 @@ namespace Hermes
         {
           if(ei[i] != NULL)
           {
-            nd = &this->ndata[e->en[i]->id];
-            nd->base = ei[i]->node;
-            nd->part = ei[i]->part;
-            if(ei[i]->ori) nd->part ^=  ~0;
+            ConstrainedEdge constrained_edge = { e->en[i]->id, ei[i]->node, ei[i]->part };
+            if(ei[i]->ori) constrained_edge.part ^=  ~0;
+            this->constrained_edges.push_back(constrained_edge);
           }
         }
       }
@@ -470,45 +457,7 @@ namespace Hermes
           Node* mid_vn = this->get_mid_edge_vertex_node(e, i, j);
           if(mid_vn == NULL) continue;
 
-          Node* vn[2] = { e->vn[i], e->vn[j] }; // endpoint vertex nodes
-          Node* en = ei[i]->node; // constraining edge node
-          typename Space<Scalar>::BaseComponent *bl[2], dummy_bl[2]; // base lists of v[0] and v[1]
-          int nc[2] = { 0, 0 }; // number of components of bl[0] and bl[1]
-
-          // get baselists of vn[0] and vn[1] - pretend we have them even if they are unconstrained
-          for (k = 0; k < 2; k++)
-          {
-            nd = &this->ndata[vn[k]->id];
-            if(vn[k]->is_constrained_vertex())
-            {
-              bl[k] = nd->baselist;
-              nc[k] = nd->ncomponents;
-            }
-            else // make up an artificial baselist
-            {
-              dummy_bl[k].dof = nd->dof;
-              dummy_bl[k].coef = (nd->dof >= 0) ? 1.0 : *nd->vertex_bc_coef;
-              bl[k] = &dummy_bl[k];
-              nc[k] = 1;
-            }
-          }
-
-          // merge the baselists
-          typename Space<Scalar>::BaseComponent* edge_dofs;
-          nd = &this->ndata[mid_vn->id];
-          nd->baselist = merge_baselists(bl[0], nc[0], bl[1], nc[1], en, edge_dofs, nd->ncomponents);
-          this->bc_data.push_back(nd->baselist);
-
-          // set edge node coeffs to function values of the edge functions
-          double mid = (ei[i]->lo + ei[i]->hi) * 0.5;
-          nd = &this->ndata[en->id];
-          for (k = 0; k < nd->n; k++, edge_dofs++)
-          {
-            edge_dofs->dof = nd->dof + k*this->stride;
-            edge_dofs->coef = this->shapeset->get_fn_value(this->shapeset->get_edge_index(0, ei[i]->ori, k + 2, e->get_mode()), mid, -1.0, 0, e->get_mode());
-          }
-
-          //dump_baselist(ndata[mid_vn->id]);
+          add_vertex_constraint(mid_vn, e->vn[i], e->vn[j], ei[i]->node, (ei[i]->lo + ei[i]->hi) * 0.5, ei[i]->ori, e->get_mode());
         }
 
         // create edge infos for half-edges
@@ -566,9 +515,78 @@ namespace Hermes
     template<typename Scalar>
     void H1Space<Scalar>::update_constraints()
     {
-      Element* e;
-      for_all_base_elements(e, this->mesh)
-        update_constrained_nodes(e, NULL, NULL, NULL, NULL);
+      // The constraints depend on the mesh, the orders (the element orders, the numbers of the edge functions) and the shapeset only,
+      // the recursion is only done when one of them changed.
+      if(this->constraint_mesh_seq != (int)this->mesh->get_seq() || this->constraint_space_seq != this->seq || this->constraint_shapeset != this->shapeset)
+      {
+        this->constraint_components.clear();
+        this->constrained_vertices.clear();
+        this->constrained_edges.clear();
+        this->constraint_start.assign(this->mesh->get_max_node_id(), -1);
+        this->constraint_count.assign(this->mesh->get_max_node_id(), 0);
+
+        Element* e;
+        for_all_base_elements(e, this->mesh)
+          update_constrained_nodes(e, NULL, NULL, NULL, NULL);
+
+        this->constraint_mesh_seq = this->mesh->get_seq();
+        this->constraint_space_seq = this->seq;
+        this->constraint_shapeset = this->shapeset;
+      }
+
+      for (unsigned int i = 0; i < this->constrained_edges.size(); i++)
+      {
+        typename Space<Scalar>::NodeData* nd = &this->ndata[this->constrained_edges[i].node];
+        nd->base = this->constrained_edges[i].base;
+        nd->part = this->constrained_edges[i].part;
+      }
+
+      // The baselists, sorted by the DOFs, the Dirichlet components in one.
+      this->constraint_baselists.clear();
+      this->constraint_baselists.reserve(this->constraint_components.size());
+      std::vector<int> baselist_starts(this->constrained_vertices.size() + 1);
+      for (unsigned int i = 0; i < this->constrained_vertices.size(); i++)
+      {
+        int id = this->constrained_vertices[i];
+        baselist_starts[i] = this->constraint_baselists.size();
+        for (int j = 0; j < this->constraint_count[id]; j++)
+        {
+          const ConstraintComponent& component = this->constraint_components[this->constraint_start[id] + j];
+          typename Space<Scalar>::NodeData* component_nd = &this->ndata[component.node];
+          typename Space<Scalar>::BaseComponent base_component;
+          if(component.k >= 0)
+          {
+            base_component.dof = component_nd->dof + component.k * this->stride;
+            base_component.coef = component.coef;
+          }
+          else
+          {
+            base_component.dof = component_nd->dof;
+            base_component.coef = (component_nd->dof >= 0) ? component.coef : component.coef * *component_nd->vertex_bc_coef;
+          }
+          this->constraint_baselists.push_back(base_component);
+        }
+
+        typename std::vector<typename Space<Scalar>::BaseComponent>::iterator first = this->constraint_baselists.begin() + baselist_starts[i];
+        std::sort(first, this->constraint_baselists.end(), base_component_less<typename Space<Scalar>::BaseComponent>);
+        typename std::vector<typename Space<Scalar>::BaseComponent>::iterator last = first;
+        for (typename std::vector<typename Space<Scalar>::BaseComponent>::iterator it = first + 1; it < this->constraint_baselists.end(); ++it)
+        {
+          if(it->dof == last->dof)
+            last->coef += it->coef;
+          else
+            *(++last) = *it;
+        }
+        this->constraint_baselists.erase(last + 1, this->constraint_baselists.end());
+      }
+      baselist_starts[this->constrained_vertices.size()] = this->constraint_baselists.size();
+
+      for (unsigned int i = 0; i < this->constrained_vertices.size(); i++)
+      {
+        typename Space<Scalar>::NodeData* nd = &this->ndata[this->constrained_vertices[i]];
+        nd->baselist = this->constraint_baselists.empty() ? NULL : &this->constraint_baselists[0] + baselist_starts[i];
+        nd->ncomponents = baselist_starts[i + 1] - baselist_starts[i];
+      }
     }
 
     template<typename Scalar>
@@ -180,6 +180,19 @@ namespace Hermes
 
     template<typename Scalar>
     Scalar* HcurlSpace<Scalar>::get_bc_projection(SurfPos* surf_pos, int order, EssentialBoundaryCondition<Scalar> *bc)
+    {
+      if(bc->get_value_type() != EssentialBoundaryCondition<Scalar>::BC_FUNCTION)
+        return get_bc_projection(surf_pos, order, bc, NULL);
+
+      typename Space<Scalar>::EdgeBCPoint* points = new typename Space<Scalar>::EdgeBCPoint[this->get_edge_bc_points_count()];
+      this->calc_edge_bc_points(surf_pos, points);
+      Scalar* proj = get_bc_projection(surf_pos, order, bc, points);
+      delete [] points;
+      return proj;
+    }
+
+    template<typename Scalar>
+    Scalar* HcurlSpace<Scalar>::get_bc_projection(SurfPos* surf_pos, int order, EssentialBoundaryCondition<Scalar> *bc, const typename Space<Scalar>::EdgeBCPoint* points)
     {
       assert(order >= 0);
       Scalar* proj = new Scalar[order + 1];
@@ -188,40 +201,35 @@ namespace Hermes
       Scalar* rhs = proj;
       int mo = quad1d.get_max_order();
       double2* pt = quad1d.get_points(mo);
+      int np = quad1d.get_num_points(mo);
 
       Node* vn1 = this->mesh->get_node(surf_pos->v1);
       Node* vn2 = this->mesh->get_node(surf_pos->v2);
       double el = sqrt(sqr(vn1->x - vn2->x) + sqr(vn1->y - vn2->y));
       el *= 0.5 * (surf_pos->hi - surf_pos->lo);
 
-      // get boundary values at integration points, construct rhs
+      // The weighted boundary values at the integration points, evaluated once for all the edge functions.
+      Scalar* values = new Scalar[np];
+      for (int j = 0; j < np; j++)
+      {
+        if(bc->get_value_type() == EssentialBoundaryCondition<Scalar>::BC_CONST)
+          values[j] = pt[j][1] * bc->value_const * el;
+        else
+        {
+          const typename Space<Scalar>::EdgeBCPoint& point = points[j + 2];
+          values[j] = pt[j][1] * bc->value(point.x, point.y, point.n_x, point.n_y, point.t_x, point.t_y) * el;
+        }
+      }
+
+      // construct rhs
       for (int i = 0; i <= order; i++)
       {
         rhs[i] = 0.0;
         int ii = this->shapeset->get_edge_index(0, 0, i, surf_pos->base->get_mode());
-        for (int j = 0; j < quad1d.get_num_points(mo); j++)
-        {
-          double t = (pt[j][0] + 1) * 0.5, s = 1.0 - t;
-          surf_pos->t = surf_pos->lo * s + surf_pos->hi * t;
-
-          if(bc->get_value_type() == EssentialBoundaryCondition<Scalar>::BC_CONST)
-          {
-            rhs[i] += pt[j][1] * this->shapeset->get_fn_value(ii, pt[j][0], -1.0, 0, surf_pos->base->get_mode())
-              * bc->value_const * el;
-          }
-          // If the BC is not constant.
-          else if(bc->get_value_type() == EssentialBoundaryCondition<Scalar>::BC_FUNCTION)
-          {
-            // Find out the (x, y) coordinate.
-            double x, y, n_x, n_y, t_x, t_y;
-            Nurbs* nurbs = surf_pos->base->is_curved() ? surf_pos->base->cm->nurbs[surf_pos->surf_num] : NULL;
-            CurvMap::nurbs_edge(surf_pos->base, nurbs, surf_pos->surf_num, 2.0*surf_pos->t - 1.0, x, y, n_x, n_y, t_x, t_y);
-            // Calculate.
-            rhs[i] += pt[j][1] * this->shapeset->get_fn_value(ii, pt[j][0], -1.0, 0, surf_pos->base->get_mode())
-              * bc->value(x, y, n_x, n_y, t_x, t_y) * el;
-          }
-        }
+        for (int j = 0; j < np; j++)
+          rhs[i] += this->shapeset->get_fn_value(ii, pt[j][0], -1.0, 0, surf_pos->base->get_mode()) * values[j];
       }
+      delete [] values;
 
       // solve the system using a precalculated Cholesky decomposed projection matrix
       cholsl(this->proj_mat, order + 1, this->chol_p, rhs, rhs);
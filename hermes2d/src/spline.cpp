@@ -26,12 +26,12 @@ namespace Hermes
       bool extrapolate_der_left, bool extrapolate_der_right) : Hermes::Hermes1DFunction<double>(), points(points), values(values),
       bc_left(bc_left), bc_right(bc_right), first_der_left(first_der_left),
       first_der_right(first_der_right), extrapolate_der_left(extrapolate_der_left),
-      extrapolate_der_right(extrapolate_der_right)
+      extrapolate_der_right(extrapolate_der_right), bucket_inv_width(0.0)
     {
       this->is_const = false;
     }
 
-    CubicSpline::CubicSpline(double const_value) : Hermes::Hermes1DFunction<double>(const_value)
+    CubicSpline::CubicSpline(double const_value) : Hermes::Hermes1DFunction<double>(const_value), bucket_inv_width(0.0)
     {
     }
 
@@ -134,6 +134,62 @@ namespace Hermes
         + 3 * this->coeffs[m].d * x2;
     }
 
+    void CubicSpline::value_batch(int n, const double* x, double* out) const
+    {
+      if(this->is_const)
+      {
+        for(int i = 0; i < n; i++)
+          out[i] = const_value;
+        return;
+      }
+
+      for(int i = 0; i < n; i++)
+      {
+        int m;
+        if(this->find_interval(x[i], m))
+          out[i] = get_value_from_interval(x[i], m);
+        else
+          out[i] = this->value(x[i]);
+      }
+    }
+
+    void CubicSpline::derivative_batch(int n, const double* x, double* out) const
+    {
+      if(this->is_const)
+      {
+        for(int i = 0; i < n; i++)
+          out[i] = 0.0;
+        return;
+      }
+
+      for(int i = 0; i < n; i++)
+      {
+        int m;
+        if(this->find_interval(x[i], m))
+          out[i] = get_derivative_from_interval(x[i], m);
+        else
+          out[i] = this->derivative(x[i]);
+      }
+    }
+
+    void CubicSpline::init_buckets()
+    {
+      bucket_intervals.clear();
+      int nelem = points.size() - 1;
+      int num_buckets = 2 * nelem;
+      bucket_inv_width = num_buckets / (points[nelem] - points[0]);
+
+      // The same interval as the bisection gives: the last one with points[m] < x (the first one for x == points[0]).
+      int m = 0;
+      for (int b = 0; b < num_buckets; b++)
+      {
+        double x = points[0] + b / bucket_inv_width;
+        while(m + 1 < nelem && points[m + 1] < x)
+          m++;
+        bucket_intervals.push_back(m);
+      }
+    }
+
     bool CubicSpline::find_interval(double x_in, int &m) const
     {
       int i_left = 0;
@@ -144,6 +200,20 @@ namespace Hermes
       if(x_in < points[i_left]) return false;
       if(x_in > points[i_right]) return false;
 
+      if(!bucket_intervals.empty())
+      {
+        int b = (int)((x_in - points[0]) * bucket_inv_width);
+        if(b >= (int)bucket_intervals.size())
+          b = bucket_intervals.size() - 1;
+        m = bucket_intervals[b];
+        // The rounding of the bucket index may put the point to the previous bucket.
+        while(m > 0 && points[m] >= x_in)
+          m--;
+        while(m + 1 < i_right && points[m + 1] < x_in)
+          m++;
+        return true;
+      }
+
       while (i_left + 1 < i_right)
       {
         int i_mid = (i_left + i_right) / 2;
@@ -387,6 +457,8 @@ namespace Hermes
       value_right = values[values.size() - 1];
       derivative_right = get_derivative_from_interval(point_right, points.size() - 2);
 
+      init_buckets();
+
       // Free the matrix and rhs vector.
       delete [] matrix;
       delete [] rhs;
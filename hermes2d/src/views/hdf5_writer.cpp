@@ -0,0 +1,360 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "hdf5_writer.h"
+#ifdef WITH_HDF5
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    namespace Views
+    {
+      /// The maximum number of the values in one chunk of /mesh_<m>/values (a chunk is a part of one row).
+      static const hsize_t HDF5_VALUES_CHUNK_SIZE = 1 << 20;
+      /// The number of the times in one chunk of /mesh_<m>/times.
+      static const hsize_t HDF5_TIMES_CHUNK_SIZE = 256;
+
+      /// Writes a whole two-dimensional dataset of the group.
+      static bool hdf5_write_dataset(hid_t group, const char* name, hid_t file_type, hid_t mem_type, hsize_t rows, hsize_t columns, const void* data)
+      {
+        hsize_t dims[2] = { rows, columns };
+        hid_t space = H5Screate_simple(2, dims, NULL);
+        hid_t dataset = H5Dcreate2(group, name, file_type, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        bool ok = dataset >= 0 && H5Dwrite(dataset, mem_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, data) >= 0;
+        if(dataset >= 0)
+          H5Dclose(dataset);
+        H5Sclose(space);
+        return ok;
+      }
+
+      /// Creates an empty dataset of rows of the length row_length (rank 2), or of single values (rank 1),
+      /// extendible in the number of rows.
+      static hid_t hdf5_create_extendible(hid_t group, const char* name, int rank, hsize_t row_length, hsize_t chunk_length, int compression_level)
+      {
+        hsize_t dims[2] = { 0, row_length };
+        hsize_t max_dims[2] = { H5S_UNLIMITED, row_length };
+        hsize_t chunk[2] = { rank == 1 ? chunk_length : 1, chunk_length };
+        hid_t space = H5Screate_simple(rank, dims, max_dims);
+        hid_t properties = H5Pcreate(H5P_DATASET_CREATE);
+        H5Pset_chunk(properties, rank, chunk);
+        if(compression_level > 0)
+          H5Pset_deflate(properties, compression_level);
+        hid_t dataset = H5Dcreate2(group, name, H5T_IEEE_F64LE, space, H5P_DEFAULT, properties, H5P_DEFAULT);
+        H5Pclose(properties);
+        H5Sclose(space);
+        return dataset;
+      }
+
+      /// Appends the row (of the length row_length for rank 2, one value for rank 1) of doubles as the row row.
+      static bool hdf5_append_row(hid_t dataset, int rank, hsize_t row, hsize_t row_length, const double* data)
+      {
+        hsize_t dims[2] = { row + 1, row_length };
+        if(H5Dset_extent(dataset, dims) < 0)
+          return false;
+        hsize_t start[2] = { row, 0 };
+        hsize_t count[2] = { 1, row_length };
+        hid_t file_space = H5Dget_space(dataset);
+        H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+        hid_t mem_space = H5Screate_simple(rank, count, NULL);
+        bool ok = H5Dwrite(dataset, H5T_NATIVE_DOUBLE, mem_space, file_space, H5P_DEFAULT, data) >= 0;
+        H5Sclose(mem_space);
+        H5Sclose(file_space);
+        return ok;
+      }
+
+      HDF5TimeSeriesWriter::HDF5TimeSeriesWriter(const char* filename, const char* quantity_name, int compression_level) :
+        filename(filename), quantity_name(quantity_name), compression_level(compression_level), values_dataset(-1), times_dataset(-1),
+        async(false), max_in_flight(4), thread_running(false), thread_exit(false)
+      {
+        if(compression_level < 0 || compression_level > 9)
+          throw Exceptions::ValueException("compression_level", compression_level, 0, 9);
+        this->file = H5Fcreate(filename, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        if(this->file < 0)
+          throw Hermes::Exceptions::Exception("Could not create the HDF5 file %s.", filename);
+        pthread_mutex_init(&this->mutex, NULL);
+        pthread_cond_init(&this->cond, NULL);
+      }
+
+      HDF5TimeSeriesWriter::~HDF5TimeSeriesWriter()
+      {
+        if(this->thread_running)
+        {
+          // The thread writes all the remaining steps before exiting.
+          pthread_mutex_lock(&this->mutex);
+          this->thread_exit = true;
+          pthread_cond_broadcast(&this->cond);
+          pthread_mutex_unlock(&this->mutex);
+          pthread_join(this->thread, NULL);
+        }
+        if(this->values_dataset >= 0)
+        {
+          H5Dclose(this->values_dataset);
+          H5Dclose(this->times_dataset);
+        }
+        if(!this->steps.empty())
+          this->write_xdmf();
+        H5Fclose(this->file);
+        pthread_mutex_destroy(&this->mutex);
+        pthread_cond_destroy(&this->cond);
+      }
+
+      void HDF5TimeSeriesWriter::set_async(bool enabled, int max_in_flight)
+      {
+        if(max_in_flight < 1)
+          throw Exceptions::ValueException("max_in_flight", max_in_flight, 1);
+        std::string failure;
+        if(!enabled)
+          failure = this->wait_for_steps();
+
+        pthread_mutex_lock(&this->mutex);
+        this->async = enabled;
+        this->max_in_flight = max_in_flight;
+        pthread_mutex_unlock(&this->mutex);
+
+        if(!failure.empty())
+          throw Hermes::Exceptions::Exception("%s", failure.c_str());
+      }
+
+      void HDF5TimeSeriesWriter::add_step(Linearizer* lin, double time)
+      {
+        StepJob* job = new StepJob;
+        job->time = time;
+
+        lin->lock_data();
+        int num_vertices = lin->get_num_vertices();
+        int num_triangles = lin->get_num_triangles();
+        double3* vertices = lin->get_vertices();
+        int3* triangles = lin->get_triangles();
+        if(num_vertices == 0 || num_triangles == 0)
+        {
+          lin->unlock_data();
+          delete job;
+          throw Hermes::Exceptions::Exception("HDF5TimeSeriesWriter::add_step(): the linearization is empty.");
+        }
+        job->values.resize(num_vertices);
+        std::vector<double> points(2 * num_vertices);
+        for(int i = 0; i < num_vertices; i++)
+        {
+          points[2 * i] = vertices[i][0];
+          points[2 * i + 1] = vertices[i][1];
+          job->values[i] = vertices[i][2];
+        }
+        bool same_mesh = points.size() == this->last_points.size() && 3 * num_triangles == (int)this->last_triangles.size()
+          && memcmp(&points[0], &this->last_points[0], points.size() * sizeof(double)) == 0
+          && memcmp(triangles, &this->last_triangles[0], this->last_triangles.size() * sizeof(int)) == 0;
+        if(!same_mesh)
+        {
+          this->last_points.swap(points);
+          this->last_triangles.assign(&triangles[0][0], &triangles[0][0] + 3 * num_triangles);
+          job->points = this->last_points;
+          job->triangles = this->last_triangles;
+          MeshRecord record = { num_vertices, num_triangles, 0 };
+          this->meshes.push_back(record);
+        }
+        lin->unlock_data();
+
+        job->mesh_index = this->meshes.size() - 1;
+        job->step_index = this->meshes.back().num_steps++;
+        this->steps.push_back(std::pair<int, double>(job->mesh_index, time));
+
+        if(!this->async)
+        {
+          try
+          {
+            this->write(job);
+          }
+          catch(...)
+          {
+            delete job;
+            throw;
+          }
+          delete job;
+          return;
+        }
+
+        if(!this->thread_running)
+        {
+          this->thread_exit = false;
+          if(pthread_create(&this->thread, NULL, writer_thread_func, this) != 0)
+          {
+            delete job;
+            throw Hermes::Exceptions::Exception("Could not start the HDF5 writing thread.");
+          }
+          this->thread_running = true;
+        }
+
+        pthread_mutex_lock(&this->mutex);
+        while((int)this->queue.size() >= this->max_in_flight)
+          pthread_cond_wait(&this->cond, &this->mutex);
+        this->queue.push(job);
+        pthread_cond_broadcast(&this->cond);
+        std::string failure = this->failure;
+        this->failure.clear();
+        pthread_mutex_unlock(&this->mutex);
+
+        if(!failure.empty())
+          throw Hermes::Exceptions::Exception("%s", failure.c_str());
+      }
+
+      void HDF5TimeSeriesWriter::flush()
+      {
+        std::string failure = this->wait_for_steps();
+        H5Fflush(this->file, H5F_SCOPE_GLOBAL);
+        this->write_xdmf();
+        if(!failure.empty())
+          throw Hermes::Exceptions::Exception("%s", failure.c_str());
+      }
+
+      std::string HDF5TimeSeriesWriter::wait_for_steps()
+      {
+        pthread_mutex_lock(&this->mutex);
+        while(!this->queue.empty())
+          pthread_cond_wait(&this->cond, &this->mutex);
+        std::string failure = this->failure;
+        this->failure.clear();
+        pthread_mutex_unlock(&this->mutex);
+        return failure;
+      }
+
+      void HDF5TimeSeriesWriter::write(StepJob* job)
+      {
+        if(!job->points.empty())
+          this->write_mesh(job);
+
+        int num_vertices = this->meshes[job->mesh_index].num_vertices;
+        if(!hdf5_append_row(this->values_dataset, 2, job->step_index, num_vertices, &job->values[0])
+          || !hdf5_append_row(this->times_dataset, 1, job->step_index, 1, &job->time))
+          throw Hermes::Exceptions::Exception("Writing of the step %d of the mesh %d to %s failed.", job->step_index, job->mesh_index, this->filename.c_str());
+      }
+
+      void HDF5TimeSeriesWriter::write_mesh(StepJob* job)
+      {
+        if(this->values_dataset >= 0)
+        {
+          H5Dclose(this->values_dataset);
+          H5Dclose(this->times_dataset);
+          this->values_dataset = this->times_dataset = -1;
+        }
+
+        std::stringstream name;
+        name << "/mesh_" << job->mesh_index;
+        hid_t group = H5Gcreate2(this->file, name.str().c_str(), H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        if(group < 0)
+          throw Hermes::Exceptions::Exception("Could not create the group %s in %s.", name.str().c_str(), this->filename.c_str());
+
+        hsize_t num_vertices = job->points.size() / 2;
+        bool ok = hdf5_write_dataset(group, "points", H5T_IEEE_F64LE, H5T_NATIVE_DOUBLE, num_vertices, 2, &job->points[0])
+          && hdf5_write_dataset(group, "triangles", H5T_STD_I32LE, H5T_NATIVE_INT, job->triangles.size() / 3, 3, &job->triangles[0]);
+        if(ok)
+        {
+          this->values_dataset = hdf5_create_extendible(group, "values", 2, num_vertices, std::min(num_vertices, HDF5_VALUES_CHUNK_SIZE), this->compression_level);
+          this->times_dataset = hdf5_create_extendible(group, "times", 1, 1, HDF5_TIMES_CHUNK_SIZE, 0);
+          ok = this->values_dataset >= 0 && this->times_dataset >= 0;
+        }
+        H5Gclose(group);
+        if(!ok)
+          throw Hermes::Exceptions::Exception("Writing of the mesh %d to %s failed.", job->mesh_index, this->filename.c_str());
+      }
+
+      void HDF5TimeSeriesWriter::write_xdmf() const
+      {
+        // The descriptor lies next to the data file and refers to it by its name only.
+        std::string base_name = this->filename;
+        size_t slash = base_name.find_last_of("/\\");
+        if(slash != std::string::npos)
+          base_name = base_name.substr(slash + 1);
+        std::string xdmf_name = this->filename;
+        size_t dot = xdmf_name.find_last_of('.');
+        if(dot != std::string::npos && (slash == std::string::npos || dot > slash))
+          xdmf_name = xdmf_name.substr(0, dot);
+        xdmf_name.append(".xmf");
+
+        FILE* f = fopen(xdmf_name.c_str(), "w");
+        if(f == NULL)
+        {
+          this->warn("Could not open %s for writing.", xdmf_name.c_str());
+          return;
+        }
+        fprintf(f, "<?xml version=\"1.0\" ?>\n<!DOCTYPE Xdmf SYSTEM \"Xdmf.dtd\" []>\n<Xdmf Version=\"2.0\">\n  <Domain>\n");
+        fprintf(f, "    <Grid Name=\"TimeSeries\" GridType=\"Collection\" CollectionType=\"Temporal\">\n");
+        std::vector<int> step_indices(this->meshes.size(), 0);
+        for(unsigned int i = 0; i < this->steps.size(); i++)
+        {
+          int m = this->steps[i].first;
+          const MeshRecord& mesh = this->meshes[m];
+          fprintf(f, "      <Grid Name=\"step_%u\" GridType=\"Uniform\">\n", i);
+          fprintf(f, "        <Time Value=\"%.17g\"/>\n", this->steps[i].second);
+          fprintf(f, "        <Topology TopologyType=\"Triangle\" NumberOfElements=\"%d\">\n", mesh.num_triangles);
+          fprintf(f, "          <DataItem Dimensions=\"%d 3\" NumberType=\"Int\" Precision=\"4\" Format=\"HDF\">%s:/mesh_%d/triangles</DataItem>\n",
+            mesh.num_triangles, base_name.c_str(), m);
+          fprintf(f, "        </Topology>\n        <Geometry GeometryType=\"XY\">\n");
+          fprintf(f, "          <DataItem Dimensions=\"%d 2\" NumberType=\"Float\" Precision=\"8\" Format=\"HDF\">%s:/mesh_%d/points</DataItem>\n",
+            mesh.num_vertices, base_name.c_str(), m);
+          fprintf(f, "        </Geometry>\n        <Attribute Name=\"%s\" AttributeType=\"Scalar\" Center=\"Node\">\n", this->quantity_name.c_str());
+          fprintf(f, "          <DataItem ItemType=\"HyperSlab\" Dimensions=\"1 %d\" Type=\"HyperSlab\">\n", mesh.num_vertices);
+          fprintf(f, "            <DataItem Dimensions=\"3 2\" Format=\"XML\">%d 0 1 1 1 %d</DataItem>\n", step_indices[m]++, mesh.num_vertices);
+          fprintf(f, "            <DataItem Dimensions=\"%d %d\" NumberType=\"Float\" Precision=\"8\" Format=\"HDF\">%s:/mesh_%d/values</DataItem>\n",
+            mesh.num_steps, mesh.num_vertices, base_name.c_str(), m);
+          fprintf(f, "          </DataItem>\n        </Attribute>\n      </Grid>\n");
+        }
+        fprintf(f, "    </Grid>\n  </Domain>\n</Xdmf>\n");
+        fclose(f);
+      }
+
+      void* HDF5TimeSeriesWriter::writer_thread_func(void* data)
+      {
+        HDF5TimeSeriesWriter* writer = (HDF5TimeSeriesWriter*)data;
+
+        pthread_mutex_lock(&writer->mutex);
+        while(true)
+        {
+          while(writer->queue.empty() && !writer->thread_exit)
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+          if(writer->queue.empty())
+            break;
+
+          // The step stays in the queue while it is written, so that it counts as in flight.
+          StepJob* job = writer->queue.front();
+          pthread_mutex_unlock(&writer->mutex);
+
+          std::string failure;
+          try
+          {
+            writer->write(job);
+          }
+          catch(std::exception& e)
+          {
+            failure = e.what();
+          }
+          delete job;
+
+          pthread_mutex_lock(&writer->mutex);
+          writer->queue.pop();
+          if(!failure.empty() && writer->failure.empty())
+            writer->failure = failure;
+          pthread_cond_broadcast(&writer->cond);
+        }
+        pthread_mutex_unlock(&writer->mutex);
+
+        return NULL;
+      }
+    }
+  }
+}
+#endif
@@ -111,11 +111,22 @@ namespace Hermes
         ydisp = NULL;
         user_ydisp = false;
         tris_contours = NULL;
+        replaying = false;
+        topology_reuse = false;
+        lod_level = -1;
+        record_item = -1;
+        record_eps = record_dmult = record_curvature_epsilon = 0.0;
+        record_xdisp = record_ydisp = NULL;
       }
 
       void Linearizer::process_triangle(MeshFunction<double>** fns, int iv0, int iv1, int iv2, int level,
         double* val, double* phx, double* phy, int* idx, bool curved)
       {
+        // The vertices and the maximum of the calling thread, verts is read only before get_vertex() which may move it.
+        // When replaying, the vertices are not read at all, their values are being updated by the other threads.
+        ThreadBuffer* buffer = this->get_thread_buffer();
+        double3* verts = (double3*) buffer->verts;
+        double& max = buffer->max;
         double midval[3][3];
 
         if(level < LIN_MAX_LEVEL)
@@ -130,7 +141,6 @@ namespace Hermes
               for (i = 0; i < lin_np_tri[1]; i++)
               {
                 double v = val[i];
-#pragma omp critical(max)
                 if(finite(v) && fabs(v) > max)
                   max = fabs(v);
               }
@@ -166,7 +176,7 @@ namespace Hermes
           }
 
           // obtain linearized values and coordinates at the midpoints
-          for (i = 0; i < 3; i++)
+          for (i = 0; i < 3 && !this->replaying; i++)
           {
             midval[i][0] = (verts[iv0][i] + verts[iv1][i])*0.5;
             midval[i][1] = (verts[iv1][i] + verts[iv2][i])*0.5;
@@ -175,7 +185,9 @@ namespace Hermes
 
           // determine whether or not to split the element
           bool split;
-          if(eps >= 1.0)
+          if(this->replaying)
+            split = (this->record_cursors[omp_get_thread_num()].record->splits[this->record_cursors[omp_get_thread_num()].split_i++] != 0);
+          else if(eps >= 1.0)
           {
             // if eps > 1, the user wants a fixed number of refinements (no adaptivity)
             split = ((level + 5) < eps);
@@ -215,10 +227,15 @@ namespace Hermes
                 fabs(val[4] - 0.5*(midval[2][2] + midval[2][0]))) > max*3*eps;
             }
           }
+          if(!this->replaying)
+            this->record_cursors[omp_get_thread_num()].record->splits.push_back(split ? 1 : 0);
 
           // split the triangle if the error is too large, otherwise produce a linear triangle
           if(split)
           {
+            if(level == this->lod_level && !this->replaying)
+              buffer->add_lod_triangle(iv0, iv1, iv2);
+
             if(curved)
               for (i = 0; i < 3; i++)
               {
@@ -255,7 +272,12 @@ namespace Hermes
         }
 
         // no splitting: output a linear triangle
-        add_triangle(iv0, iv1, iv2, fns[0]->get_active_element()->marker);
+        if(!this->replaying)
+        {
+          buffer->add_triangle(iv0, iv1, iv2, fns[0]->get_active_element()->marker);
+          if(level <= this->lod_level)
+            buffer->add_lod_triangle(iv0, iv1, iv2);
+        }
       }
 
       void Linearizer::set_curvature_epsilon(double curvature_epsilon)
@@ -307,13 +329,22 @@ namespace Hermes
       void Linearizer::process_quad(MeshFunction<double>** fns, int iv0, int iv1, int iv2, int iv3, int level,
         double* val, double* phx, double* phy, int* idx, bool curved)
       {
+        // The vertices and the maximum of the calling thread, verts is read only before get_vertex() which may move it.
+        // When replaying, the vertices are not read at all, their values are being updated by the other threads.
+        ThreadBuffer* buffer = this->get_thread_buffer();
+        double3* verts = (double3*) buffer->verts;
+        double& max = buffer->max;
         double midval[3][5];
 
         // try not to split through the vertex with the largest value
-        int a = (verts[iv0][2] > verts[iv1][2]) ? iv0 : iv1;
-        int b = (verts[iv2][2] > verts[iv3][2]) ? iv2 : iv3;
-        a = (verts[a][2] > verts[b][2]) ? a : b;
-        int flip = (a == iv1 || a == iv3) ? 1 : 0;
+        int flip = 0;
+        if(!this->replaying)
+        {
+          int a = (verts[iv0][2] > verts[iv1][2]) ? iv0 : iv1;
+          int b = (verts[iv2][2] > verts[iv3][2]) ? iv2 : iv3;
+          a = (verts[a][2] > verts[b][2]) ? a : b;
+          flip = (a == iv1 || a == iv3) ? 1 : 0;
+        }
 
         if(level < LIN_MAX_LEVEL)
         {
@@ -328,9 +359,7 @@ namespace Hermes
               {
                 double v = val[i];
                 if(finite(v) && fabs(v) > max)
-#pragma omp critical(max)
-                  if(finite(v) && fabs(v) > max)
-                    max = fabs(v);
+                  max = fabs(v);
               }
 
               // This is just to make some sense.
@@ -367,7 +396,7 @@ namespace Hermes
           }
 
           // obtain linearized values and coordinates at the midpoints
-          for (i = 0; i < 3; i++)
+          for (i = 0; i < 3 && !this->replaying; i++)
           {
             midval[i][0] = (verts[iv0][i] + verts[iv1][i]) * 0.5;
             midval[i][1] = (verts[iv1][i] + verts[iv2][i]) * 0.5;
@@ -377,11 +406,14 @@ namespace Hermes
           };
 
           // the value of the middle point is not the average of the four vertex values, since quad == 2 triangles
-          midval[2][4] = flip ? (verts[iv0][2] + verts[iv2][2]) * 0.5 : (verts[iv1][2] + verts[iv3][2]) * 0.5;
+          if(!this->replaying)
+            midval[2][4] = flip ? (verts[iv0][2] + verts[iv2][2]) * 0.5 : (verts[iv1][2] + verts[iv3][2]) * 0.5;
 
           // determine whether or not to split the element
           int split;
-          if(eps >= 1.0)
+          if(this->replaying)
+            split = this->record_cursors[omp_get_thread_num()].record->splits[this->record_cursors[omp_get_thread_num()].split_i++];
+          else if(eps >= 1.0)
           {
             // if eps > 1, the user wants a fixed number of refinements (no adaptivity)
             split = (level < eps) ? 3 : 0;
@@ -431,10 +463,18 @@ namespace Hermes
                 fabs(val[9]  - 0.5*(midval[2][3] + midval[2][0]))) > max*4*eps) ? 3 : 0;
             }
           }
+          if(!this->replaying)
+            this->record_cursors[omp_get_thread_num()].record->splits.push_back((char)split);
 
           // split the quad if the error is too large, otherwise produce two linear triangles
           if(split)
           {
+            if(level == this->lod_level && !this->replaying)
+            {
+              buffer->add_lod_triangle(iv3, iv0, iv1);
+              buffer->add_lod_triangle(iv1, iv2, iv3);
+            }
+
             if(curved)
               for (i = 0; i < 5; i++)
               {
@@ -498,15 +538,27 @@ namespace Hermes
         }
 
         // output two linear triangles,
+        if(this->replaying)
+          return;
         if(!flip)
         {
-          add_triangle(iv3, iv0, iv1, fns[0]->get_active_element()->marker);
-          add_triangle(iv1, iv2, iv3, fns[0]->get_active_element()->marker);
+          buffer->add_triangle(iv3, iv0, iv1, fns[0]->get_active_element()->marker);
+          buffer->add_triangle(iv1, iv2, iv3, fns[0]->get_active_element()->marker);
+          if(level <= this->lod_level)
+          {
+            buffer->add_lod_triangle(iv3, iv0, iv1);
+            buffer->add_lod_triangle(iv1, iv2, iv3);
+          }
         }
         else
         {
-          add_triangle(iv0, iv1, iv2, fns[0]->get_active_element()->marker);
-          add_triangle(iv2, iv3, iv0, fns[0]->get_active_element()->marker);
+          buffer->add_triangle(iv0, iv1, iv2, fns[0]->get_active_element()->marker);
+          buffer->add_triangle(iv2, iv3, iv0, fns[0]->get_active_element()->marker);
+          if(level <= this->lod_level)
+          {
+            buffer->add_lod_triangle(iv0, iv1, iv2);
+            buffer->add_lod_triangle(iv2, iv3, iv0);
+          }
         }
       }
 
@@ -519,8 +571,42 @@ namespace Hermes
         this->dmult = dmult;
       }
 
+      void Linearizer::set_topology_reuse(bool reuse)
+      {
+        this->topology_reuse = reuse;
+      }
+
+      void Linearizer::set_lod_level(int level)
+      {
+        // the recorded topology does not contain the level of detail.
+        if(level != this->lod_level)
+          this->state_records.clear();
+        this->lod_level = level;
+      }
+
+      void Linearizer::get_element_orders(MeshFunction<double>* sln, std::vector<int>& orders) const
+      {
+        orders.clear();
+        Solution<double>* solution = dynamic_cast<Solution<double>*>(sln);
+        if(solution == NULL || solution->get_type() != HERMES_SLN)
+          return;
+        Element* e;
+        for_all_active_elements(e, sln->get_mesh())
+          orders.push_back(solution->get_elem_order(e->id));
+      }
+
       void Linearizer::process_solution(MeshFunction<double>* sln, int item_, double eps)
       {
+        std::vector<int> orders;
+        this->get_element_orders(sln, orders);
+
+        // the same topology as the last time, only the values are updated.
+        if(this->topology_reuse && !this->empty && item_ == this->record_item && eps == this->record_eps
+          && this->xdisp == this->record_xdisp && this->ydisp == this->record_ydisp && this->dmult == this->record_dmult
+          && this->curvature_epsilon == this->record_curvature_epsilon && orders == this->record_orders
+          && this->update_values(sln))
+          return;
+
         // Important, sets the current caughtException to NULL.
         this->caughtException = NULL;
 
@@ -531,6 +617,8 @@ namespace Hermes
         this->item = item_;
         this->eps = eps;
         //   get the component and desired value from item.
+        component = 0;
+        value_type = 0;
         if(item >= 0x40)
         {
           component = 1;
@@ -549,22 +637,129 @@ namespace Hermes
         this->vertex_size = std::max(100 * sln->get_mesh()->get_num_elements(), std::max(this->vertex_size, 50000));
         this->triangle_size = std::max(150 * sln->get_mesh()->get_num_elements(), std::max(this->triangle_size, 75000));
         this->edges_size = std::max(100 * sln->get_mesh()->get_num_elements(), std::max(this->edges_size, 50000));
-        //    counts.
-        this->vertex_count = 0;
-        this->triangle_count = 0;
-        this->edges_count = 0;
-        //    reuse or allocate vertex, triangle and edge arrays.
-        this->verts = (double3*) realloc(this->verts, sizeof(double3) * this->vertex_size);
-        this->tris = (int3*) realloc(this->tris, sizeof(int3) * this->triangle_size);
-        this->tri_markers = (int*) realloc(this->tri_markers, sizeof(int) * this->triangle_size);
-        this->edges = (int2*) realloc(this->edges, sizeof(int2) * this->edges_size);
-        this->edge_markers = (int*) realloc(this->edge_markers, sizeof(int) * this->edges_size);
-        this->info = (int4*) malloc(sizeof(int4) * this->vertex_size);
+        //    the vertices, triangles and edges are produced into per-thread buffers and merged afterwards.
+        int num_threads_used = this->get_num_threads();
+        this->init_thread_buffers(num_threads_used, 3, this->vertex_size, this->triangle_size, this->edges_size);
         this->empty = false;
-        //    initialize the hash table
-        this->hash_table = (int*) malloc(sizeof(int) * this->vertex_size);
-        memset(this->hash_table, 0xff, sizeof(int) * this->vertex_size);
 
+        this->linearize(sln, false);
+
+        if(this->caughtException != NULL)
+        {
+          this->state_records.clear();
+          this->free_thread_buffers();
+          this->unlock_data();
+          throw *(this->caughtException);
+        }
+
+        // merge the thread buffers, vertices with different values stay separate (discontinuities).
+        this->reduce_thread_max();
+        ::free(this->verts);
+        std::vector<std::vector<int> > vertex_maps;
+        this->verts = (double3*) this->merge_thread_buffers(3, true, &vertex_maps);
+        this->free_thread_buffers();
+
+        // the recorded vertices are renumbered to the merged ones, each is updated by the first state using it.
+        std::vector<bool> vertex_used(this->vertex_count, false);
+        for (unsigned int state_i = 0; state_i < this->state_records.size(); state_i++)
+        {
+          StateRecord& record = this->state_records[state_i];
+          for (unsigned int i = 0; i < record.vertices.size(); i++)
+          {
+            int vertex = vertex_maps[record.thread][record.vertices[i]];
+            record.vertices[i] = vertex_used[vertex] ? -1 - vertex : vertex;
+            vertex_used[vertex] = true;
+          }
+        }
+
+        // for contours, without regularization.
+        this->tris_contours = (int3*) realloc(this->tris_contours, sizeof(int3) * this->triangle_count);
+        memcpy(this->tris_contours, this->tris, this->triangle_count * sizeof(int3));
+        triangle_contours_count = this->triangle_count;
+
+        // regularize the linear mesh
+        for (int i = 0; i < this->triangle_count; i++)
+        {
+          int iv0 = tris[i][0], iv1 = tris[i][1], iv2 = tris[i][2];
+
+          int mid0 = peek_vertex(iv0, iv1);
+          int mid1 = peek_vertex(iv1, iv2);
+          int mid2 = peek_vertex(iv2, iv0);
+          if(mid0 >= 0 || mid1 >= 0 || mid2 >= 0)
+          {
+            this->del_slot = i;
+            regularize_triangle(iv0, iv1, iv2, mid0, mid1, mid2, tri_markers[i]);
+          }
+        }
+
+        find_min_max();
+
+        this->record_item = item_;
+        this->record_eps = eps;
+        this->record_xdisp = this->xdisp;
+        this->record_ydisp = this->ydisp;
+        this->record_dmult = this->dmult;
+        this->record_curvature_epsilon = this->curvature_epsilon;
+        this->record_orders.swap(orders);
+
+        this->unlock_data();
+
+        if(!user_xdisp)
+          delete xdisp;
+        if(!user_ydisp)
+          delete ydisp;
+
+        // clean up
+        ::free(hash_table);
+        ::free(info);
+      }
+
+      bool Linearizer::update_values(MeshFunction<double>* sln)
+      {
+        if(this->empty || this->state_records.empty())
+          return false;
+
+        // the records are valid only for the same, unchanged meshes.
+        Hermes::vector<const Mesh*> meshes = this->get_meshes(sln);
+        if(meshes.size() != this->record_meshes.size())
+          return false;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+          if(meshes[i] != this->record_meshes[i] || meshes[i]->get_seq() != this->record_mesh_seqs[i])
+            return false;
+
+        this->caughtException = NULL;
+        lock_data();
+        this->tick();
+
+        // the buffers only hold the maxima of the threads, no vertices are created.
+        this->init_thread_buffers(this->get_num_threads(), 3, 0, 0, 0);
+        this->linearize(sln, true);
+        this->free_thread_buffers();
+
+        if(this->caughtException != NULL)
+        {
+          this->unlock_data();
+          throw *(this->caughtException);
+        }
+
+        find_min_max();
+        this->unlock_data();
+        return true;
+      }
+
+      Hermes::vector<const Mesh*> Linearizer::get_meshes(MeshFunction<double>* sln) const
+      {
+        Hermes::vector<const Mesh*> meshes;
+        meshes.push_back(sln->get_mesh());
+        if(xdisp != NULL)
+          meshes.push_back(xdisp->get_mesh());
+        if(ydisp != NULL)
+          meshes.push_back(ydisp->get_mesh());
+        return meshes;
+      }
+
+      void Linearizer::linearize(MeshFunction<double>* sln, bool replay)
+      {
         // select the linearization quadratures
         Quad2D *old_quad, *old_quad_x = NULL, *old_quad_y = NULL;
         old_quad = sln->get_quad_2d();
@@ -575,16 +770,11 @@ namespace Hermes
 
         // obtain the solution in vertices, estimate the maximum solution value
         // meshes.
-        Hermes::vector<const Mesh*> meshes;
-        meshes.push_back(sln->get_mesh());
-        if(xdisp != NULL)
-          meshes.push_back(xdisp->get_mesh());
-        if(ydisp != NULL)
-          meshes.push_back(ydisp->get_mesh());
+        Hermes::vector<const Mesh*> meshes = this->get_meshes(sln);
 
         // Parallelization
-        MeshFunction<double>*** fns = new MeshFunction<double>**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+        MeshFunction<double>*** fns = new MeshFunction<double>**[this->get_num_threads()];
+        for(unsigned int i = 0; i < this->get_num_threads(); i++)
         {
           fns[i] = new MeshFunction<double>*[3];
           fns[i][0] = sln->clone();
@@ -602,8 +792,8 @@ namespace Hermes
           }
         }
 
-        Transformable*** trfs = new Transformable**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+        Transformable*** trfs = new Transformable**[this->get_num_threads()];
+        for(unsigned int i = 0; i < this->get_num_threads(); i++)
         {
           trfs[i] = new Transformable*[3];
           trfs[i][0] = fns[i][0];
@@ -613,79 +803,76 @@ namespace Hermes
             trfs[i][xdisp == NULL ? 1 : 2] = fns[i][xdisp == NULL ? 1 : 2];
         }
 
-        Traverse trav_masterMax(true);
-        unsigned int num_states = trav_masterMax.get_num_states(meshes);
+        // The states are precalculated once and used for both the passes below.
+        int num_states;
+        Traverse::State** states = this->traverse_plan.get_states(meshes, num_states);
 
-        trav_masterMax.begin(meshes.size(), &(meshes.front()));
-
-        Traverse* trav = new Traverse[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+        // The refinement is recorded for update_values().
+        if(!replay)
         {
-          trav[i].begin(meshes.size(), &(meshes.front()), trfs[i]);
-          trav[i].stack = trav_masterMax.stack;
+          this->state_records.clear();
+          this->state_records.resize(num_states);
+          this->record_meshes = meshes;
+          this->record_mesh_seqs.clear();
+          for (unsigned int i = 0; i < meshes.size(); i++)
+            this->record_mesh_seqs.push_back(meshes[i]->get_seq());
         }
+        else if(num_states != (int)this->state_records.size())
+          this->caughtException = new Hermes::Exceptions::Exception("The traversal does not match the recorded one in Linearizer::update_values.");
+        this->record_cursors.resize(this->get_num_threads());
+        this->replaying = replay;
 
         int state_i;
 
 #define CHUNKSIZE 1
-        int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
-#pragma omp parallel shared(trav_masterMax) private(state_i) num_threads(num_threads_used)
+        int num_threads_used = this->get_num_threads();
+        if(!replay)
         {
-#pragma omp for schedule(static, CHUNKSIZE)
-          for(state_i = 0; state_i < num_states; state_i++)
+#pragma omp parallel shared(states) private(state_i) num_threads(num_threads_used)
           {
-            try
+            this->apply_thread_affinity();
+#pragma omp for schedule(dynamic, CHUNKSIZE)
+            for(state_i = 0; state_i < num_states; state_i++)
             {
-              Traverse::State current_state;
-#pragma omp critical(get_next_state)
-              current_state = trav[omp_get_thread_num()].get_next_state(&trav_masterMax.top, &trav_masterMax.id);
+              try
+              {
+                Traverse::State* current_state = states[state_i];
+                Traverse::set_state_to_fns(current_state, trfs[omp_get_thread_num()]);
 
-              fns[omp_get_thread_num()][0]->set_quad_order(0, this->item);
-              double* val = fns[omp_get_thread_num()][0]->get_values(component, value_type);
+                fns[omp_get_thread_num()][0]->set_quad_order(0, this->item);
+                double* val = fns[omp_get_thread_num()][0]->get_values(component, value_type);
 
-              for (unsigned int i = 0; i < current_state.e[0]->get_nvert(); i++)
+                ThreadBuffer* buffer = this->get_thread_buffer();
+                for (unsigned int i = 0; i < current_state->e[0]->get_nvert(); i++)
+                {
+                  double f = val[i];
+                  if(this->auto_max && finite(f) && fabs(f) > buffer->max)
+                    buffer->max = fabs(f);
+                }
+              }
+              catch(Hermes::Exceptions::Exception& e)
               {
-                double f = val[i];
-#pragma omp critical (max)
-                if(this->auto_max && finite(f) && fabs(f) > this->max)
-                  this->max = fabs(f);
+                if(this->caughtException == NULL)
+                  this->caughtException = e.clone();
+              }
+              catch(std::exception& e)
+              {
+                if(this->caughtException == NULL)
+                  this->caughtException = new Hermes::Exceptions::Exception(e.what());
               }
-            }
-            catch(Hermes::Exceptions::Exception& e)
-            {
-              if(this->caughtException == NULL)
-                this->caughtException = e.clone();
-            }
-            catch(std::exception& e)
-            {
-              if(this->caughtException == NULL)
-                this->caughtException = new Hermes::Exceptions::Exception(e.what());
             }
           }
         }
 
-        trav_masterMax.finish();
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
-          trav[i].finish();
-        delete [] trav;
-
-        Traverse trav_master(true);
-        num_states = trav_master.get_num_states(meshes);
-
-        trav_master.begin(meshes.size(), &(meshes.front()));
-
-        trav = new Traverse[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
+        // All the threads start the refinement from the maximum of the first pass.
+        this->reduce_thread_max();
+        for(int i = 0; i < num_threads_used; i++)
+          this->thread_buffers[i]->max = this->max;
 
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+#pragma omp parallel shared(states) private(state_i) num_threads(num_threads_used)
         {
-          trav[i].begin(meshes.size(), &(meshes.front()), trfs[i]);
-          trav[i].stack = trav_master.stack;
-        }
-
-#pragma omp parallel shared(trav_master) private(state_i) num_threads(num_threads_used)
-        {
-#pragma omp for schedule(static, CHUNKSIZE)
+          this->apply_thread_affinity();
+#pragma omp for schedule(dynamic, CHUNKSIZE)
           for(state_i = 0; state_i < num_states; state_i++)
           {
             if(this->caughtException != NULL)
@@ -693,18 +880,19 @@ namespace Hermes
 
             try
             {
-              Traverse::State current_state;
+              Traverse::State* current_state = states[state_i];
+              Traverse::set_state_to_fns(current_state, trfs[omp_get_thread_num()]);
 
-#pragma omp critical (get_next_state)
-              current_state = trav[omp_get_thread_num()].get_next_state(&trav_master.top, &trav_master.id);
+              RecordCursor& cursor = this->record_cursors[omp_get_thread_num()];
+              cursor.record = &this->state_records[state_i];
+              cursor.split_i = cursor.vertex_i = 0;
+              if(!replay)
+                cursor.record->thread = omp_get_thread_num();
 
               fns[omp_get_thread_num()][0]->set_quad_order(0, this->item);
               double* val = fns[omp_get_thread_num()][0]->get_values(component, value_type);
               if(val == NULL)
-              {
-                delete [] trav;
                 throw Hermes::Exceptions::Exception("Item not defined in the solution in Linearizer::process_solution.");
-              }
 
               if(xdisp != NULL)
                 fns[omp_get_thread_num()][1]->set_quad_order(0, H2D_FN_VAL);
@@ -719,7 +907,7 @@ namespace Hermes
                 dy = fns[omp_get_thread_num()][xdisp == NULL ? 1 : 2]->get_fn_values();
 
               int iv[H2D_MAX_NUMBER_VERTICES];
-              for (unsigned int i = 0; i < current_state.e[0]->get_nvert(); i++)
+              for (unsigned int i = 0; i < current_state->e[0]->get_nvert(); i++)
               {
                 double f = val[i];
                 double x_disp = fns[omp_get_thread_num()][0]->get_refmap()->get_phys_x(0)[i];
@@ -736,13 +924,15 @@ namespace Hermes
               }
 
               // recur to sub-elements
-              if(current_state.e[0]->is_triangle())
-                process_triangle(fns[omp_get_thread_num()], iv[0], iv[1], iv[2], 0, NULL, NULL, NULL, NULL, current_state.e[0]->is_curved());
+              if(current_state->e[0]->is_triangle())
+                process_triangle(fns[omp_get_thread_num()], iv[0], iv[1], iv[2], 0, NULL, NULL, NULL, NULL, current_state->e[0]->is_curved());
               else
-                process_quad(fns[omp_get_thread_num()], iv[0], iv[1], iv[2], iv[3], 0, NULL, NULL, NULL, NULL, current_state.e[0]->is_curved());
+                process_quad(fns[omp_get_thread_num()], iv[0], iv[1], iv[2], iv[3], 0, NULL, NULL, NULL, NULL, current_state->e[0]->is_curved());
 
-              for (unsigned int i = 0; i < current_state.e[0]->get_nvert(); i++)
-                process_edge(iv[i], iv[current_state.e[0]->next_vert(i)], current_state.e[0]->en[i]->marker);
+              // the edges are split at the mid-edge vertices of both the neighbors after the merge.
+              if(!replay)
+                for (unsigned int i = 0; i < current_state->e[0]->get_nvert(); i++)
+                  this->get_thread_buffer()->add_edge(iv[i], iv[current_state->e[0]->next_vert(i)], current_state->e[0]->en[i]->marker);
             }
             catch(Hermes::Exceptions::Exception& e)
             {
@@ -756,11 +946,10 @@ namespace Hermes
             }
           }
         }
+        this->replaying = false;
 
-        trav_master.finish();
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+        for(unsigned int i = 0; i < this->get_num_threads(); i++)
         {
-          trav[i].finish();
           for(unsigned int j = 0; j < (1 + (xdisp != NULL? 1 : 0) + (ydisp != NULL ? 1 : 0)); j++)
             delete fns[i][j];
           delete [] fns[i];
@@ -768,54 +957,13 @@ namespace Hermes
         }
         delete [] fns;
         delete [] trfs;
-        delete [] trav;
-
-        // for contours, without regularization.
-        this->tris_contours = (int3*) realloc(this->tris_contours, sizeof(int3) * this->triangle_count);
-        memcpy(this->tris_contours, this->tris, this->triangle_count * sizeof(int3));
-        triangle_contours_count = this->triangle_count;
-
-        if(this->caughtException != NULL)
-        {
-          this->unlock_data();
-          ::free(hash_table);
-          ::free(info);
-          throw *(this->caughtException);
-        }
-
-        // regularize the linear mesh
-        for (int i = 0; i < this->triangle_count; i++)
-        {
-          int iv0 = tris[i][0], iv1 = tris[i][1], iv2 = tris[i][2];
-
-          int mid0 = peek_vertex(iv0, iv1);
-          int mid1 = peek_vertex(iv1, iv2);
-          int mid2 = peek_vertex(iv2, iv0);
-          if(mid0 >= 0 || mid1 >= 0 || mid2 >= 0)
-          {
-            this->del_slot = i;
-            regularize_triangle(iv0, iv1, iv2, mid0, mid1, mid2, tri_markers[i]);
-          }
-        }
-
-        find_min_max();
-
-        this->unlock_data();
 
         // select old quadratrues
         sln->set_quad_2d(old_quad);
-        if(user_xdisp)
+        if(xdisp != NULL)
           xdisp->set_quad_2d(old_quad_x);
-        else
-          delete xdisp;
-        if(user_ydisp)
+        if(ydisp != NULL)
           ydisp->set_quad_2d(old_quad_y);
-        else
-          delete ydisp;
-
-        // clean up
-        ::free(hash_table);
-        ::free(info);
       }
 
       void Linearizer::find_min_max()
@@ -832,67 +980,55 @@ namespace Hermes
 
       int Linearizer::get_vertex(int p1, int p2, double x, double y, double value)
       {
-        // search for an existing vertex
+        RecordCursor& cursor = this->record_cursors[omp_get_thread_num()];
+        if(this->replaying)
+        {
+          int recorded = cursor.record->vertices[cursor.vertex_i++];
+          if(recorded < 0)
+            return -1 - recorded;
+          this->verts[recorded][2] = value;
+          return recorded;
+        }
+
+        ThreadBuffer* buffer = this->get_thread_buffer();
+        double3* verts = (double3*) buffer->verts;
+
+        // search for an existing vertex of this thread
         if(p1 > p2) std::swap(p1, p2);
-        int index = this->hash(p1, p2);
-        int i = 0;
-        if(index < this->vertex_count)
+        int index = buffer->hash(p1, p2);
+        int i = buffer->hash_table[index];
+        while (i >= 0)
         {
-          i = this->hash_table[index];
-          while (i >= 0 && i < this->vertex_count)
+          if(
+            buffer->info[i][0] == p1 && buffer->info[i][1] == p2 &&
+            (value == verts[i][2] || fabs(value - verts[i][2]) < buffer->max*1e-8) &&
+            (fabs(x - verts[i][0]) < 1e-8) &&
+            (fabs(y - verts[i][1]) < 1e-8)
+            )
           {
-            if(
-              this->info[i][0] == p1 && this->info[i][1] == p2 &&
-              (value == verts[i][2] || fabs(value - verts[i][2]) < this->max*1e-8) &&
-              (fabs(x - verts[i][0]) < 1e-8) &&
-              (fabs(y - verts[i][1]) < 1e-8)
-              )
-              return i;
-            // note that we won't return a vertex with a different value than the required one;
-            // this takes care for discontinuities in the solution, where more vertices
-            // with different values will be created
-            i = info[i][2];
+            cursor.record->vertices.push_back(i);
+            return i;
           }
+          // note that we won't return a vertex with a different value than the required one;
+          // this takes care for discontinuities in the solution, where more vertices
+          // with different values will be created
+          i = buffer->info[i][2];
         }
 
         // if not found, create a new one
-#pragma omp critical(realloc_vertices)
-        try
-        {
-          i = add_vertex();
-        }
-        catch(std::exception& e)
-        {
-          if(this->caughtException == NULL)
-            this->caughtException = new Hermes::Exceptions::Exception(e.what());
-        }
-        if(this->caughtException != NULL)
-        {
-          return -1;
-        }
+        i = buffer->add_vertex();
+        verts = (double3*) buffer->verts;
         verts[i][0] = x;
         verts[i][1] = y;
         verts[i][2] = value;
-        this->info[i][0] = p1;
-        this->info[i][1] = p2;
-        this->info[i][2] = hash_table[index];
-        this->hash_table[index] = i;
+        buffer->info[i][0] = p1;
+        buffer->info[i][1] = p2;
+        buffer->info[i][2] = buffer->hash_table[index];
+        buffer->hash_table[index] = i;
+        cursor.record->vertices.push_back(i);
         return i;
       }
 
-      int Linearizer::add_vertex()
-      {
-        if(this->vertex_count >= this->vertex_size)
-        {
-          this->vertex_size *= 2;
-          verts = (double3*) realloc(verts, sizeof(double3) * vertex_size);
-          this->info = (int4*) realloc(info, sizeof(int4) * vertex_size);
-          this->hash_table = (int*) realloc(hash_table, sizeof(int) * vertex_size);
-          memset(this->hash_table + this->vertex_size / 2, 0xff, sizeof(int) * this->vertex_size / 2);
-        }
-        return this->vertex_count++;
-      }
-
       void Linearizer::free()
       {
         if(verts != NULL)
@@ -915,56 +1051,26 @@ namespace Hermes
       }
 
       void Linearizer::save_solution_vtk(MeshFunction<double>* sln, const char* filename, const char *quantity_name,
-        bool mode_3D, int item, double eps)
+        bool mode_3D, int item, double eps, VTKFormat format, int num_parts)
       {
         process_solution(sln, item, eps);
 
-        FILE* f = fopen(filename, "wb");
-        if(f == NULL) throw Hermes::Exceptions::Exception("Could not open %s for writing.", filename);
         lock_data();
-
-        // Output header for vertices.
-        fprintf(f, "# vtk DataFile Version 2.0\n");
-        fprintf(f, "\n");
-        fprintf(f, "ASCII\n\n");
-        fprintf(f, "DATASET UNSTRUCTURED_GRID\n");
-
-        // Output vertices.
-        fprintf(f, "POINTS %d %s\n", this->vertex_count, "float");
-        for (int i = 0; i < this->vertex_count; i++)
-        {
-          if(mode_3D == true) fprintf(f, "%g %g %g\n", this->verts[i][0], this->verts[i][1], this->verts[i][2]);
-          else fprintf(f, "%g %g %g\n", this->verts[i][0], this->verts[i][1], 0.0);
-        }
-
-        // Output elements.
-        fprintf(f, "\n");
-        fprintf(f, "CELLS %d %d\n", this->triangle_count, 4 * this->triangle_count);
-        for (int i = 0; i < this->triangle_count; i++)
-        {
-          fprintf(f, "3 %d %d %d\n", this->tris[i][0], this->tris[i][1], this->tris[i][2]);
-        }
-
-        // Output cell types.
-        fprintf(f, "\n");
-        fprintf(f, "CELL_TYPES %d\n", this->triangle_count);
-        for (int i = 0; i < this->triangle_count; i++)
+        try
         {
-          fprintf(f, "5\n");    // The "5" means triangle in VTK.
+          VTKWriter writer(this->vertex_count, &this->verts[0][0], 3, mode_3D, this->triangle_count, &this->tris[0][0], 3);
+          writer.add_point_data(quantity_name, &this->verts[0][2], 3);
+          if(num_parts > 1)
+            writer.save_parallel(filename, num_parts, format);
+          else
+            writer.save(filename, format);
         }
-
-        // This outputs double solution values.
-        fprintf(f, "\n");
-        fprintf(f, "POINT_DATA %d\n", this->vertex_count);
-        fprintf(f, "SCALARS %s %s %d\n", quantity_name, "float", 1);
-        fprintf(f, "LOOKUP_TABLE %s\n", "default");
-        for (int i = 0; i < this->vertex_count; i++)
+        catch(Hermes::Exceptions::Exception&)
         {
-          fprintf(f, "%g\n", this->verts[i][2]);
+          unlock_data();
+          throw;
         }
-
         unlock_data();
-        fclose(f);
       }
 
       void Linearizer::calc_vertices_aabb(double* min_x, double* max_x, double* min_y, double* max_y) const
@@ -39,6 +39,8 @@ namespace Hermes
       {
 				tris = NULL;
         tri_markers = NULL;
+        lod_tris = NULL;
+        lod_triangle_count = 0;
 				edges = NULL;
         edge_markers = NULL;
         hash_table = NULL;
@@ -68,6 +70,12 @@ namespace Hermes
 					::free(tri_markers);
 					tri_markers = NULL;
         }
+        if(lod_tris != NULL)
+        {
+          ::free(lod_tris);
+          lod_tris = NULL;
+          lod_triangle_count = 0;
+        }
         if(edges != NULL)
         {
           ::free(edges);
@@ -80,7 +88,9 @@ namespace Hermes
 
       LinearizerBase::~LinearizerBase()
       {
-        
+        this->free_thread_buffers();
+        ::free(lod_tris);
+
         pthread_mutex_destroy(&data_mutex);
       }
 
@@ -171,17 +181,14 @@ namespace Hermes
 
       void LinearizerBase::add_edge(int iv1, int iv2, int marker)
       {
-#pragma omp critical(realloc_edges)
+        if(edges_count >= edges_size)
         {
-          if(edges_count >= edges_size)
-          {
-						edges = (int2*) realloc(edges, sizeof(int2) * (edges_size * 1.5));
-            edge_markers = (int*) realloc(edge_markers, sizeof(int) * (edges_size = edges_size * 1.5));
-          }
-          edges[edges_count][0] = iv1;
-          edges[edges_count][1] = iv2;
-          edge_markers[edges_count++] = marker;
+          edges = (int2*) realloc(edges, sizeof(int2) * (edges_size * 1.5));
+          edge_markers = (int*) realloc(edge_markers, sizeof(int) * (edges_size = edges_size * 1.5));
         }
+        edges[edges_count][0] = iv1;
+        edges[edges_count][1] = iv2;
+        edge_markers[edges_count++] = marker;
       }
 
       int LinearizerBase::peek_vertex(int p1, int p2)
@@ -201,26 +208,23 @@ namespace Hermes
       void LinearizerBase::add_triangle(int iv0, int iv1, int iv2, int marker)
       {
         int index;
-#pragma omp critical(realloc_triangles)
+        if(this->del_slot >= 0) // reuse a slot after a deleted triangle
         {
-          if(this->del_slot >= 0) // reuse a slot after a deleted triangle
-          {
-            index = this->del_slot;
-            del_slot = -1;
-          }
+          index = this->del_slot;
+          del_slot = -1;
+        }
+        {
+          if(triangle_count >= triangle_size)
           {
-            if(triangle_count >= triangle_size)
-						{
-							tris = (int3*) realloc(tris, sizeof(int3) * (triangle_size * 2));
-              tri_markers = (int*) realloc(tri_markers, sizeof(int) * (triangle_size = triangle_size * 2));
-						}
-            index = triangle_count++;
-
-            tris[index][0] = iv0;
-            tris[index][1] = iv1;
-            tris[index][2] = iv2;
-						tri_markers[index] = marker;
+            tris = (int3*) realloc(tris, sizeof(int3) * (triangle_size * 2));
+            tri_markers = (int*) realloc(tri_markers, sizeof(int) * (triangle_size = triangle_size * 2));
           }
+          index = triangle_count++;
+
+          tris[index][0] = iv0;
+          tris[index][1] = iv1;
+          tris[index][2] = iv2;
+          tri_markers[index] = marker;
         }
       }
 
@@ -229,6 +233,254 @@ namespace Hermes
         return (984120265*p1 + 125965121*p2) & (vertex_size - 1);
       }
 
+      LinearizerBase::ThreadBuffer::ThreadBuffer(int vertex_dim, int vertex_size, int triangle_size, int edges_size) :
+        vertex_dim(vertex_dim), vertex_count(0), vertex_size(std::max(vertex_size, 16)), triangle_count(0), triangle_size(std::max(triangle_size, 16)),
+        lod_triangle_count(0), lod_triangle_size(16),
+        edges_count(0), edges_size(std::max(edges_size, 16)), max(0.0)
+      {
+        this->verts = (double*) malloc(sizeof(double) * this->vertex_dim * this->vertex_size);
+        this->info = (int4*) malloc(sizeof(int4) * this->vertex_size);
+        this->hash_size = 1;
+        while(this->hash_size < this->vertex_size)
+          this->hash_size *= 2;
+        this->hash_table = (int*) malloc(sizeof(int) * this->hash_size);
+        memset(this->hash_table, 0xff, sizeof(int) * this->hash_size);
+        this->tris = (int3*) malloc(sizeof(int3) * this->triangle_size);
+        this->tri_markers = (int*) malloc(sizeof(int) * this->triangle_size);
+        this->lod_tris = (int3*) malloc(sizeof(int3) * this->lod_triangle_size);
+        this->edges = (int3*) malloc(sizeof(int3) * this->edges_size);
+      }
+
+      LinearizerBase::ThreadBuffer::~ThreadBuffer()
+      {
+        ::free(this->verts);
+        ::free(this->info);
+        ::free(this->hash_table);
+        ::free(this->tris);
+        ::free(this->tri_markers);
+        ::free(this->lod_tris);
+        ::free(this->edges);
+      }
+
+      int LinearizerBase::ThreadBuffer::add_vertex()
+      {
+        if(this->vertex_count >= this->vertex_size)
+        {
+          this->vertex_size *= 2;
+          this->verts = (double*) realloc(this->verts, sizeof(double) * this->vertex_dim * this->vertex_size);
+          this->info = (int4*) realloc(this->info, sizeof(int4) * this->vertex_size);
+        }
+        return this->vertex_count++;
+      }
+
+      void LinearizerBase::ThreadBuffer::add_triangle(int iv0, int iv1, int iv2, int marker)
+      {
+        if(this->triangle_count >= this->triangle_size)
+        {
+          this->triangle_size *= 2;
+          this->tris = (int3*) realloc(this->tris, sizeof(int3) * this->triangle_size);
+          this->tri_markers = (int*) realloc(this->tri_markers, sizeof(int) * this->triangle_size);
+        }
+        this->tris[this->triangle_count][0] = iv0;
+        this->tris[this->triangle_count][1] = iv1;
+        this->tris[this->triangle_count][2] = iv2;
+        this->tri_markers[this->triangle_count++] = marker;
+      }
+
+      void LinearizerBase::ThreadBuffer::add_lod_triangle(int iv0, int iv1, int iv2)
+      {
+        if(this->lod_triangle_count >= this->lod_triangle_size)
+        {
+          this->lod_triangle_size *= 2;
+          this->lod_tris = (int3*) realloc(this->lod_tris, sizeof(int3) * this->lod_triangle_size);
+        }
+        this->lod_tris[this->lod_triangle_count][0] = iv0;
+        this->lod_tris[this->lod_triangle_count][1] = iv1;
+        this->lod_tris[this->lod_triangle_count++][2] = iv2;
+      }
+
+      void LinearizerBase::ThreadBuffer::add_edge(int iv1, int iv2, int marker)
+      {
+        if(this->edges_count >= this->edges_size)
+        {
+          this->edges_size *= 2;
+          this->edges = (int3*) realloc(this->edges, sizeof(int3) * this->edges_size);
+        }
+        this->edges[this->edges_count][0] = iv1;
+        this->edges[this->edges_count][1] = iv2;
+        this->edges[this->edges_count++][2] = marker;
+      }
+
+      int LinearizerBase::ThreadBuffer::hash(int p1, int p2) const
+      {
+        return (984120265*p1 + 125965121*p2) & (this->hash_size - 1);
+      }
+
+      void LinearizerBase::init_thread_buffers(int num_threads, int vertex_dim, int vertex_size, int triangle_size, int edges_size)
+      {
+        this->free_thread_buffers();
+        for(int i = 0; i < num_threads; i++)
+          this->thread_buffers.push_back(new ThreadBuffer(vertex_dim, vertex_size / num_threads, triangle_size / num_threads, edges_size / num_threads));
+      }
+
+      void LinearizerBase::free_thread_buffers()
+      {
+        for(unsigned int i = 0; i < this->thread_buffers.size(); i++)
+          delete this->thread_buffers[i];
+        this->thread_buffers.clear();
+      }
+
+      LinearizerBase::ThreadBuffer* LinearizerBase::get_thread_buffer() const
+      {
+        return this->thread_buffers[omp_get_thread_num()];
+      }
+
+      void LinearizerBase::reduce_thread_max()
+      {
+        if(!this->auto_max)
+          return;
+        for(unsigned int i = 0; i < this->thread_buffers.size(); i++)
+          if(this->thread_buffers[i]->max > this->max)
+            this->max = this->thread_buffers[i]->max;
+      }
+
+      double* LinearizerBase::merge_thread_buffers(int vertex_dim, bool match_values, std::vector<std::vector<int> >* vertex_maps_out)
+      {
+        int num_buffers = this->thread_buffers.size();
+        int total_vertices = 0, total_triangles = 0, total_lod_triangles = 0, total_edges = 0;
+        for(int buffer_i = 0; buffer_i < num_buffers; buffer_i++)
+        {
+          total_vertices += this->thread_buffers[buffer_i]->vertex_count;
+          total_triangles += this->thread_buffers[buffer_i]->triangle_count;
+          total_lod_triangles += this->thread_buffers[buffer_i]->lod_triangle_count;
+          total_edges += this->thread_buffers[buffer_i]->edges_count;
+        }
+
+        // Vertices, the size is a power of two for hash().
+        this->vertex_size = 16;
+        while(this->vertex_size < total_vertices)
+          this->vertex_size *= 2;
+        double* verts = (double*) malloc(sizeof(double) * vertex_dim * this->vertex_size);
+        this->info = (int4*) malloc(sizeof(int4) * this->vertex_size);
+        this->hash_table = (int*) malloc(sizeof(int) * this->vertex_size);
+        memset(this->hash_table, 0xff, sizeof(int) * this->vertex_size);
+        this->vertex_count = 0;
+
+        // The vertices of a buffer are added in the order of their creation, so the parents are already mapped.
+        int** vertex_maps = new int*[num_buffers];
+        for(int buffer_i = 0; buffer_i < num_buffers; buffer_i++)
+        {
+          ThreadBuffer* buffer = this->thread_buffers[buffer_i];
+          vertex_maps[buffer_i] = new int[buffer->vertex_count > 0 ? buffer->vertex_count : 1];
+          for(int i = 0; i < buffer->vertex_count; i++)
+          {
+            int p1 = buffer->info[i][0], p2 = buffer->info[i][1];
+            if(p1 >= 0)
+              p1 = vertex_maps[buffer_i][p1];
+            if(p2 >= 0)
+              p2 = vertex_maps[buffer_i][p2];
+            if(p1 > p2)
+              std::swap(p1, p2);
+            double* vertex = buffer->verts + i * vertex_dim;
+
+            int index = this->hash(p1, p2);
+            int j = this->hash_table[index];
+            while(j >= 0)
+            {
+              if(this->info[j][0] == p1 && this->info[j][1] == p2)
+              {
+                if(!match_values)
+                  break;
+                double* other = verts + j * vertex_dim;
+                bool same = (fabs(vertex[0] - other[0]) < 1e-8) && (fabs(vertex[1] - other[1]) < 1e-8);
+                for(int k = 2; k < vertex_dim && same; k++)
+                  same = (vertex[k] == other[k] || fabs(vertex[k] - other[k]) < this->max*1e-8);
+                if(same)
+                  break;
+              }
+              j = this->info[j][2];
+            }
+
+            if(j < 0)
+            {
+              j = this->vertex_count++;
+              memcpy(verts + j * vertex_dim, vertex, sizeof(double) * vertex_dim);
+              this->info[j][0] = p1;
+              this->info[j][1] = p2;
+              this->info[j][2] = this->hash_table[index];
+              this->hash_table[index] = j;
+            }
+            vertex_maps[buffer_i][i] = j;
+          }
+        }
+
+        // Triangles, each buffer is copied to its offset.
+        this->triangle_size = std::max(2 * total_triangles, 16);
+        this->tris = (int3*) realloc(this->tris, sizeof(int3) * this->triangle_size);
+        this->tri_markers = (int*) realloc(this->tri_markers, sizeof(int) * this->triangle_size);
+        this->lod_tris = (int3*) realloc(this->lod_tris, sizeof(int3) * std::max(total_lod_triangles, 1));
+        int* triangle_offsets = new int[num_buffers + 1];
+        int* lod_triangle_offsets = new int[num_buffers + 1];
+        triangle_offsets[0] = lod_triangle_offsets[0] = 0;
+        for(int buffer_i = 0; buffer_i < num_buffers; buffer_i++)
+        {
+          triangle_offsets[buffer_i + 1] = triangle_offsets[buffer_i] + this->thread_buffers[buffer_i]->triangle_count;
+          lod_triangle_offsets[buffer_i + 1] = lod_triangle_offsets[buffer_i] + this->thread_buffers[buffer_i]->lod_triangle_count;
+        }
+
+        int buffer_i;
+#pragma omp parallel for private(buffer_i) num_threads(num_buffers)
+        for(buffer_i = 0; buffer_i < num_buffers; buffer_i++)
+        {
+          ThreadBuffer* buffer = this->thread_buffers[buffer_i];
+          int* vertex_map = vertex_maps[buffer_i];
+          for(int i = 0; i < buffer->triangle_count; i++)
+          {
+            int index = triangle_offsets[buffer_i] + i;
+            this->tris[index][0] = vertex_map[buffer->tris[i][0]];
+            this->tris[index][1] = vertex_map[buffer->tris[i][1]];
+            this->tris[index][2] = vertex_map[buffer->tris[i][2]];
+            this->tri_markers[index] = buffer->tri_markers[i];
+          }
+          for(int i = 0; i < buffer->lod_triangle_count; i++)
+          {
+            int index = lod_triangle_offsets[buffer_i] + i;
+            this->lod_tris[index][0] = vertex_map[buffer->lod_tris[i][0]];
+            this->lod_tris[index][1] = vertex_map[buffer->lod_tris[i][1]];
+            this->lod_tris[index][2] = vertex_map[buffer->lod_tris[i][2]];
+          }
+        }
+        this->triangle_count = total_triangles;
+        this->lod_triangle_count = total_lod_triangles;
+        delete [] triangle_offsets;
+        delete [] lod_triangle_offsets;
+
+        // Edges, split at the mid-edge vertices of all the elements.
+        this->edges_size = std::max(2 * total_edges, 16);
+        this->edges = (int2*) realloc(this->edges, sizeof(int2) * this->edges_size);
+        this->edge_markers = (int*) realloc(this->edge_markers, sizeof(int) * this->edges_size);
+        this->edges_count = 0;
+        for(int buffer_i = 0; buffer_i < num_buffers; buffer_i++)
+        {
+          ThreadBuffer* buffer = this->thread_buffers[buffer_i];
+          for(int i = 0; i < buffer->edges_count; i++)
+            this->process_edge(vertex_maps[buffer_i][buffer->edges[i][0]], vertex_maps[buffer_i][buffer->edges[i][1]], buffer->edges[i][2]);
+        }
+
+        if(vertex_maps_out != NULL)
+        {
+          vertex_maps_out->resize(num_buffers);
+          for(int buffer_i = 0; buffer_i < num_buffers; buffer_i++)
+            (*vertex_maps_out)[buffer_i].assign(vertex_maps[buffer_i], vertex_maps[buffer_i] + this->thread_buffers[buffer_i]->vertex_count);
+        }
+
+        for(int buffer_i = 0; buffer_i < num_buffers; buffer_i++)
+          delete [] vertex_maps[buffer_i];
+        delete [] vertex_maps;
+
+        return verts;
+      }
+
       void LinearizerBase::set_max_absolute_value(double max_abs)
       {
         if(max_abs < 0.0)
@@ -279,6 +531,14 @@ namespace Hermes
       {
         return this->triangle_count;
       }
+      int3* LinearizerBase::get_lod_triangles()
+      {
+        return this->lod_tris;
+      }
+      int LinearizerBase::get_num_lod_triangles()
+      {
+        return this->lod_triangle_count;
+      }
       int2* LinearizerBase::get_edges()
       {
         return this->edges;
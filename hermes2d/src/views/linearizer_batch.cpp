@@ -0,0 +1,139 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "linearizer_batch.h"
+#include "api2d.h"
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    namespace Views
+    {
+      LinearizerBatch::LinearizerBatch(const char* quantity_name, VTKFormat format, int item, double eps, bool mode_3D) :
+        quantity_name(quantity_name), format(format), item(item), eps(eps), mode_3D(mode_3D), num_linearizations(0)
+      {
+      }
+
+      void LinearizerBatch::add(MeshFunction<double>* sln, const char* filename)
+      {
+        if(sln == NULL)
+          throw Exceptions::NullException(1);
+        Job job;
+        job.sln = sln;
+        job.filename = filename;
+        this->jobs.push_back(job);
+      }
+
+      int LinearizerBatch::get_num_jobs() const
+      {
+        return this->jobs.size();
+      }
+
+      int LinearizerBatch::get_num_linearizations() const
+      {
+        return this->num_linearizations;
+      }
+
+      void LinearizerBatch::run()
+      {
+        this->num_linearizations = 0;
+
+        // Groups of the jobs on the same mesh, in the order of adding.
+        std::vector<std::vector<int> > groups;
+        std::map<std::pair<const Mesh*, unsigned>, int> group_of_mesh;
+        for (unsigned int job_i = 0; job_i < this->jobs.size(); job_i++)
+        {
+          const Mesh* mesh = this->jobs[job_i].sln->get_mesh();
+          std::pair<const Mesh*, unsigned> key(mesh, mesh->get_seq());
+          std::map<std::pair<const Mesh*, unsigned>, int>::iterator it = group_of_mesh.find(key);
+          if(it == group_of_mesh.end())
+          {
+            it = group_of_mesh.insert(std::pair<std::pair<const Mesh*, unsigned>, int>(key, groups.size())).first;
+            groups.push_back(std::vector<int>());
+          }
+          groups[it->second].push_back(job_i);
+        }
+
+        // With a single group, the threads are left to the Linearizer.
+        int num_groups = groups.size();
+        Hermes::Exceptions::Exception* caughtException = NULL;
+        int group_i;
+#pragma omp parallel for private(group_i) schedule(dynamic, 1) if(num_groups > 1) num_threads(Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads))
+        for (group_i = 0; group_i < num_groups; group_i++)
+        {
+          try
+          {
+            this->run_group(groups[group_i]);
+          }
+          catch(Hermes::Exceptions::Exception& e)
+          {
+#pragma omp critical(batch_exception)
+            if(caughtException == NULL)
+              caughtException = e.clone();
+          }
+          catch(std::exception& e)
+          {
+#pragma omp critical(batch_exception)
+            if(caughtException == NULL)
+              caughtException = new Hermes::Exceptions::Exception(e.what());
+          }
+        }
+
+        this->jobs.clear();
+        if(caughtException != NULL)
+        {
+          Hermes::Exceptions::Exception e(*caughtException);
+          delete caughtException;
+          throw e;
+        }
+      }
+
+      void LinearizerBatch::run_group(const std::vector<int>& group)
+      {
+        Linearizer linearizer;
+        bool linearized = false;
+        for (unsigned int i = 0; i < group.size(); i++)
+        {
+          Job& job = this->jobs[group[i]];
+
+          // The mesh can still change in between (adaptivity of the functions is not forbidden).
+          if(!linearized || !linearizer.update_values(job.sln))
+          {
+            linearizer.process_solution(job.sln, this->item, this->eps);
+            linearized = true;
+#pragma omp atomic
+            this->num_linearizations++;
+          }
+
+          linearizer.lock_data();
+          try
+          {
+            VTKWriter writer(linearizer.get_num_vertices(), &linearizer.get_vertices()[0][0], 3, this->mode_3D,
+              linearizer.get_num_triangles(), &linearizer.get_triangles()[0][0], 3);
+            writer.add_point_data(this->quantity_name.c_str(), &linearizer.get_vertices()[0][2], 3);
+            writer.save(job.filename.c_str(), this->format);
+          }
+          catch(Hermes::Exceptions::Exception&)
+          {
+            linearizer.unlock_data();
+            throw;
+          }
+          linearizer.unlock_data();
+        }
+      }
+    }
+  }
+}
@@ -208,31 +208,28 @@ namespace Hermes
       void Orderizer::add_triangle(int iv0, int iv1, int iv2, int order, int marker)
       {
         int index;
-#pragma omp critical(realloc_triangles)
+        if(this->del_slot >= 0) // reuse a slot after a deleted triangle
         {
-          if(this->del_slot >= 0) // reuse a slot after a deleted triangle
+          index = this->del_slot;
+          del_slot = -1;
+        }
+        {
+          if(triangle_count >= triangle_size)
           {
-            index = this->del_slot;
-            del_slot = -1;
+            tri_markers = (int*) realloc(tri_markers, sizeof(int) * (triangle_size * 2));
+            tris = (int3*) realloc(tris, sizeof(int3) * (triangle_size * 2));
+            tris_orders = (int*) realloc(tris_orders, sizeof(int) * (triangle_size = triangle_size * 2));
           }
-          {
-            if(triangle_count >= triangle_size)
-            {
-							tri_markers = (int*) realloc(tri_markers, sizeof(int) * (triangle_size * 2));
-              tris = (int3*) realloc(tris, sizeof(int3) * (triangle_size * 2));
-              tris_orders = (int*) realloc(tris_orders, sizeof(int) * (triangle_size = triangle_size * 2));
-            }
-            index = triangle_count++;
+          index = triangle_count++;
 
-            tris[index][0] = iv0;
-            tris[index][1] = iv1;
-            tris[index][2] = iv2;
-						tris_orders[index] = order;
-            tri_markers[index] = marker;
-          }
+          tris[index][0] = iv0;
+          tris[index][1] = iv1;
+          tris[index][2] = iv2;
+          tris_orders[index] = order;
+          tri_markers[index] = marker;
         }
       }
-      
+
       void Orderizer::free()
       {
         if(verts != NULL)
@@ -270,131 +267,55 @@ namespace Hermes
       }
 
       template<typename Scalar>
-      void Orderizer::save_orders_vtk(const Space<Scalar>* space, const char* file_name)
+      void Orderizer::save_orders_vtk(const Space<Scalar>* space, const char* file_name, VTKFormat format, int num_parts)
       {
         process_space(space);
 
-        FILE* f = fopen(file_name, "wb");
-        if(f == NULL) throw Hermes::Exceptions::Exception("Could not open %s for writing.", file_name);
         lock_data();
-
-        // Output header for vertices.
-        fprintf(f, "# vtk DataFile Version 2.0\n");
-        fprintf(f, "\n");
-        fprintf(f, "ASCII\n\n");
-        fprintf(f, "DATASET UNSTRUCTURED_GRID\n");
-
-        // Output vertices.
-        fprintf(f, "POINTS %d %s\n", this->vertex_count, "float");
-        for (int i = 0; i < this->vertex_count; i++)
+        try
         {
-          fprintf(f, "%g %g %g\n", this->verts[i][0], this->verts[i][1], 0.0);
+          VTKWriter writer(this->vertex_count, &this->verts[0][0], 3, false, this->triangle_count, &this->tris[0][0], 3);
+          writer.add_cell_data("Mesh", this->tris_orders);
+          if(num_parts > 1)
+            writer.save_parallel(file_name, num_parts, format);
+          else
+            writer.save(file_name, format);
         }
-
-        // Output elements.
-        fprintf(f, "\n");
-        fprintf(f, "CELLS %d %d\n", this->triangle_count, 4 * this->triangle_count);
-        for (int i = 0; i < this->triangle_count; i++)
-        {
-          fprintf(f, "3 %d %d %d\n", this->tris[i][0], this->tris[i][1], this->tris[i][2]);
-        }
-
-        // Output cell types.
-        fprintf(f, "\n");
-        fprintf(f, "CELL_TYPES %d\n", this->triangle_count);
-        for (int i = 0; i < this->triangle_count; i++)
+        catch(Hermes::Exceptions::Exception&)
         {
-          fprintf(f, "5\n");    // The "5" means triangle in VTK.
+          unlock_data();
+          throw;
         }
-
-        // This outputs double solution values. Look into Hermes2D/src/output/vtk.cpp
-        // for how it is done for vectors.
-        fprintf(f, "\n");
-        fprintf(f, "CELL_DATA %d\n", this->triangle_count);
-        fprintf(f, "SCALARS %s %s %d\n", "Mesh", "float", 1);
-        fprintf(f, "LOOKUP_TABLE %s\n", "default");
-        for (int i = 0; i < this->triangle_count; i++)
-        {
-          fprintf(f, "%i\n", this->tris_orders[i]);
-        }
-
         unlock_data();
-        fclose(f);
       }
 
       template<typename Scalar>
-      void Orderizer::save_mesh_vtk(const Space<Scalar>* space, const char* file_name)
+      void Orderizer::save_mesh_vtk(const Space<Scalar>* space, const char* file_name, VTKFormat format, int num_parts)
       {
         process_space(space);
 
-        FILE* f = fopen(file_name, "wb");
-        if(f == NULL) throw Hermes::Exceptions::Exception("Could not open %s for writing.", file_name);
         lock_data();
-
-        // Output header for vertices.
-        fprintf(f, "# vtk DataFile Version 2.0\n");
-        fprintf(f, "\n");
-        fprintf(f, "ASCII\n\n");
-        fprintf(f, "DATASET UNSTRUCTURED_GRID\n");
-
-        // Output vertices.
-        fprintf(f, "POINTS %d %s\n", this->vertex_count, "float");
-        for (int i = 0; i < this->vertex_count; i++)
-          fprintf(f, "%g %g %g\n", this->verts[i][0], this->verts[i][1], 0.0);
-
-        // Output elements.
-        fprintf(f, "\n");
-        fprintf(f, "CELLS %d %d\n", this->edges_count, + 3 * this->edges_count);
-        for (int i = 0; i < this->edges_count; i++)
-          fprintf(f, "2 %d %d\n", this->edges[i][0], this->edges[i][1]);
-
-        // Output cell types.
-        fprintf(f, "\n");
-        fprintf(f, "CELL_TYPES %d\n", this->edges_count);
-
-        for (int i = 0; i < this->edges_count; i++)
-          fprintf(f, "3\n");    // The "5" means triangle in VTK.
-
-        // This outputs double solution values. Look into Hermes2D/src/output/vtk.cpp
-        // for how it is done for vectors.
-        fprintf(f, "\n");
-        fprintf(f, "CELL_DATA %d\n", this->edges_count);
-        fprintf(f, "SCALARS %s %s %d\n", "Mesh", "float", 1);
-        fprintf(f, "LOOKUP_TABLE %s\n", "default");
-        for (int i = 0; i < this->edges_count; i++)
-          fprintf(f, "0 \n");
+        try
+        {
+          VTKWriter writer(this->vertex_count, &this->verts[0][0], 3, false, this->edges_count, &this->edges[0][0], 2);
+          writer.add_cell_data("Mesh", NULL);
+          if(num_parts > 1)
+            writer.save_parallel(file_name, num_parts, format);
+          else
+            writer.save(file_name, format);
+        }
+        catch(Hermes::Exceptions::Exception&)
+        {
+          unlock_data();
+          throw;
+        }
         unlock_data();
-        fclose(f);
-      }
-
-      int Orderizer::get_labels(int*& lvert, char**& ltext, double2*& lbox) const
-      {
-        lvert = this->lvert;
-        ltext = this->ltext;
-        lbox = this->lbox;
-        return label_count;
-      }
-
-      void Orderizer::calc_vertices_aabb(double* min_x, double* max_x, double* min_y, double* max_y) const
-      {
-        if(verts == NULL)
-          throw Exceptions::Exception("Cannot calculate AABB from NULL vertices");
-        calc_aabb(&verts[0][0], &verts[0][1], sizeof(double3), vertex_count, min_x, max_x, min_y, max_y);
-      }
-
-      double3* Orderizer::get_vertices()
-      {
-        return this->verts;
-      }
-      int Orderizer::get_num_vertices()
-      {
-        return this->vertex_count;
       }
 
-      template HERMES_API void Orderizer::save_orders_vtk<double>(const Space<double>* space, const char* file_name);
-      template HERMES_API void Orderizer::save_orders_vtk<std::complex<double> >(const Space<std::complex<double> >* space, const char* file_name);
-      template HERMES_API void Orderizer::save_mesh_vtk<double>(const Space<double>* space, const char* file_name);
-      template HERMES_API void Orderizer::save_mesh_vtk<std::complex<double> >(const Space<std::complex<double> >* space, const char* file_name);
+      template HERMES_API void Orderizer::save_orders_vtk<double>(const Space<double>* space, const char* file_name, VTKFormat format, int num_parts);
+      template HERMES_API void Orderizer::save_orders_vtk<std::complex<double> >(const Space<std::complex<double> >* space, const char* file_name, VTKFormat format, int num_parts);
+      template HERMES_API void Orderizer::save_mesh_vtk<double>(const Space<double>* space, const char* file_name, VTKFormat format, int num_parts);
+      template HERMES_API void Orderizer::save_mesh_vtk<std::complex<double> >(const Space<std::complex<double> >* space, const char* file_name, VTKFormat format, int num_parts);
       template HERMES_API void Orderizer::process_space<double>(const Space<double>* space);
       template HERMES_API void Orderizer::process_space<std::complex<double> >(const Space<std::complex<double> >* space);
     }
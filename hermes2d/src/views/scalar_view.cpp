@@ -43,6 +43,7 @@ namespace Hermes
       void ScalarView::init()
       {
         lin = new Linearizer;
+        lin->set_lod_level(H2DV_LOD_LEVEL);
         pmode = mode3d = false;
         normals = NULL;
         panning = false;
@@ -58,10 +59,18 @@ namespace Hermes
 
         show_values = true;
         lin_updated = false;
-        gl_coord_buffer = 0; gl_index_buffer = 0; gl_edge_inx_buffer = 0;
+        gl_coord_buffer = 0; gl_coord_buffer_3d = 0; gl_index_buffer = 0; gl_lod_index_buffer = 0; gl_edge_inx_buffer = 0;
+        max_gl_verts = max_gl_verts_3d = max_gl_tris = max_gl_lod_tris = 0;
+        gl_tri_cnt = gl_lod_tri_cnt = gl_edge_cnt = gl_boundary_edge_cnt = 0;
 
         do_zoom_to_fit = true;
         is_constant = false;
+
+        asynchronous = false;
+        async_pending = NULL;
+        async_busy = async_stop = async_thread_running = false;
+        pthread_mutex_init(&async_mutex, NULL);
+        pthread_cond_init(&async_cond, NULL);
       }
 
 #ifndef _MSC_VER
@@ -114,6 +123,9 @@ namespace Hermes
 
       ScalarView::~ScalarView()
       {
+        stop_async_worker();
+        pthread_mutex_destroy(&async_mutex);
+        pthread_cond_destroy(&async_cond);
         delete [] normals;
         vertex_nodes.clear();
         delete lin;
@@ -142,18 +154,147 @@ namespace Hermes
           glDeleteBuffersARB(1, &gl_coord_buffer);
           gl_coord_buffer = 0;
         }
+        if(gl_coord_buffer_3d != 0)
+        {
+          glDeleteBuffersARB(1, &gl_coord_buffer_3d);
+          gl_coord_buffer_3d = 0;
+        }
         if(gl_index_buffer != 0)
         {
           glDeleteBuffersARB(1, &gl_index_buffer);
           gl_index_buffer = 0;
         }
+        if(gl_lod_index_buffer != 0)
+        {
+          glDeleteBuffersARB(1, &gl_lod_index_buffer);
+          gl_lod_index_buffer = 0;
+        }
+        if(gl_edge_inx_buffer != 0)
+        {
+          glDeleteBuffersARB(1, &gl_edge_inx_buffer);
+          gl_edge_inx_buffer = 0;
+        }
 
         //call of parent implementation
         View::on_close();
       }
 
+      void ScalarView::set_asynchronous(bool asynchronous)
+      {
+        if(!asynchronous)
+          stop_async_worker();
+        this->asynchronous = asynchronous;
+      }
+
+      void ScalarView::delete_async_job(AsyncJob* job)
+      {
+        delete job->sln;
+        delete job->mesh;
+        delete job;
+      }
+
+      void* ScalarView::async_worker(void* view_ptr)
+      {
+        ScalarView* view = (ScalarView*) view_ptr;
+        pthread_mutex_lock(&view->async_mutex);
+        while(true)
+        {
+          while(view->async_pending == NULL && !view->async_stop)
+            pthread_cond_wait(&view->async_cond, &view->async_mutex);
+          if(view->async_stop)
+            break;
+
+          AsyncJob* job = view->async_pending;
+          view->async_pending = NULL;
+          view->async_busy = true;
+          pthread_mutex_unlock(&view->async_mutex);
+
+          try
+          {
+            view->process_and_draw(job->sln, job->eps, job->item, NULL, NULL, 1.0);
+          }
+          catch(std::exception& e)
+          {
+            view->warn("Asynchronous update of ScalarView failed: %s", e.what());
+          }
+          delete_async_job(job);
+
+          pthread_mutex_lock(&view->async_mutex);
+          view->async_busy = false;
+          pthread_cond_broadcast(&view->async_cond);
+        }
+        pthread_mutex_unlock(&view->async_mutex);
+        return NULL;
+      }
+
+      void ScalarView::stop_async_worker()
+      {
+        pthread_mutex_lock(&async_mutex);
+        bool running = async_thread_running;
+        async_stop = true;
+        pthread_cond_broadcast(&async_cond);
+        pthread_mutex_unlock(&async_mutex);
+
+        if(running)
+          pthread_join(async_thread, NULL);
+
+        pthread_mutex_lock(&async_mutex);
+        if(async_pending != NULL)
+          delete_async_job(async_pending);
+        async_pending = NULL;
+        async_thread_running = async_stop = false;
+        pthread_mutex_unlock(&async_mutex);
+      }
+
+      void ScalarView::wait_for_asynchronous_updates()
+      {
+        pthread_mutex_lock(&async_mutex);
+        while(async_thread_running && (async_pending != NULL || async_busy))
+          pthread_cond_wait(&async_cond, &async_mutex);
+        pthread_mutex_unlock(&async_mutex);
+      }
+
       void ScalarView::show(MeshFunction<double>* sln, double eps, int item,
         MeshFunction<double>* xdisp, MeshFunction<double>* ydisp, double dmult)
+      {
+        Solution<double>* solution = dynamic_cast<Solution<double>*>(sln);
+        if(!asynchronous || solution == NULL || solution->get_type() != HERMES_SLN || xdisp != NULL || ydisp != NULL)
+        {
+          process_and_draw(sln, eps, item, xdisp, ydisp, dmult);
+          return;
+        }
+
+        // the snapshot, cheap compared to the linearization
+        AsyncJob* job = new AsyncJob;
+        job->mesh = new Mesh;
+        job->mesh->copy(sln->get_mesh());
+        job->sln = new Solution<double>;
+        job->sln->copy(solution, job->mesh);
+        job->eps = eps;
+        job->item = item;
+
+        pthread_mutex_lock(&async_mutex);
+        // the previous snapshot not drawn yet is dropped
+        if(async_pending != NULL)
+          delete_async_job(async_pending);
+        async_pending = job;
+        if(!async_thread_running)
+        {
+          if(pthread_create(&async_thread, NULL, async_worker, this) != 0)
+          {
+            async_pending = NULL;
+            pthread_mutex_unlock(&async_mutex);
+            delete_async_job(job);
+            throw Hermes::Exceptions::Exception("Failed to create the worker thread of ScalarView.");
+          }
+          async_thread_running = true;
+        }
+        pthread_cond_broadcast(&async_cond);
+        pthread_mutex_unlock(&async_mutex);
+      }
+
+      void ScalarView::process_and_draw(MeshFunction<double>* sln, double eps, int item,
+        MeshFunction<double>* xdisp, MeshFunction<double>* ydisp, double dmult)
       {
         // For preservation of the sln's active element. Will be set back after the visualization.
         Element* active_element = sln->get_active_element();
@@ -470,33 +611,36 @@ namespace Hermes
         element_infos.reserve(mesh->get_num_active_elements());
 
         //build element info
-        Element *element = NULL;
-        for_all_active_elements(element, mesh)
+        const MeshSnapshot* snapshot = mesh->get_snapshot();
+        for(int i = 0; i < snapshot->get_num_elements(); i++)
         {
+          const int* vertices = snapshot->get_vertices(i);
+          int nvert = snapshot->get_nvert(i);
           double sum_x = 0.0, sum_y = 0.0;
           double max_x, max_y, min_x, min_y;
-          max_x = min_x = element->vn[0]->x;
-          max_y = min_y = element->vn[0]->y;
-          for(unsigned int i = 0; i < element->get_nvert(); i++)
+          max_x = min_x = snapshot->get_x(vertices[0]);
+          max_y = min_y = snapshot->get_y(vertices[0]);
+          for(int j = 0; j < nvert; j++)
           {
-            sum_x += element->vn[i]->x;
-            sum_y += element->vn[i]->y;
-
-            if(element->vn[i]->x > max_x)
-              max_x = element->vn[i]->x;
-            if(element->vn[i]->x < min_x)
-              min_x = element->vn[i]->x;
-            if(element->vn[i]->y > max_y)
-              max_y = element->vn[i]->y;
-            if(element->vn[i]->y < min_y)
-              min_y = element->vn[i]->y;
+            double x = snapshot->get_x(vertices[j]), y = snapshot->get_y(vertices[j]);
+            sum_x += x;
+            sum_y += y;
+
+            if(x > max_x)
+              max_x = x;
+            if(x < min_x)
+              min_x = x;
+            if(y > max_y)
+              max_y = y;
+            if(y < min_y)
+              min_y = y;
           }
-          element_infos.push_back(ElementInfo(element->id,
-            (float)(sum_x / element->get_nvert()), (float)(sum_y / element->get_nvert()),
+          element_infos.push_back(ElementInfo(snapshot->get_element_id(i),
+            (float)(sum_x / nvert), (float)(sum_y / nvert),
             (float)(max_x - min_x), (float)(max_y - min_y)));
         }
       }
-        
+
       Linearizer* ScalarView::get_linearizer()
       {
         return this->lin;
@@ -656,6 +800,48 @@ namespace Hermes
         }
       }
 
+      void ScalarView::fill_gl_triangles(unsigned int& gl_buffer, int& max_gl_cnt, int& gl_cnt, const int3* tris, int tri_cnt, const double3* verts)
+      {
+        //reallocate indices
+        if(gl_buffer == 0 || tri_cnt > max_gl_cnt)
+        {
+          if(gl_buffer == 0)
+            glGenBuffersARB(1, &gl_buffer);
+          glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, gl_buffer);
+          glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, sizeof(GLint) * std::max(tri_cnt, 1) * 3, NULL, GL_STATIC_DRAW_ARB);
+          GLenum err = glGetError();
+          if(err != GL_NO_ERROR)
+            throw std::runtime_error("unable to allocate vertex buffer: " + err);
+          max_gl_cnt = tri_cnt;
+        }
+        else
+        {
+          glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, gl_buffer);
+        }
+
+        //fill indices
+        GLuint* gl_triangle = (GLuint*)glMapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+        if(gl_triangle == NULL)
+          throw std::runtime_error("unable to map index buffer: " + glGetError());
+        gl_cnt = 0;
+        for(int i = 0; i < tri_cnt; i++)
+        {
+          const int3& triangle = tris[i];
+          const double3& vert_a = verts[triangle[0]];
+          const double3& vert_b = verts[triangle[1]];
+          const double3& vert_c = verts[triangle[2]];
+          if(finite(vert_a[2]) && finite(vert_b[2]) && finite(vert_c[2]))
+          {
+            gl_triangle[0] = (GLint)triangle[0];
+            gl_triangle[1] = (GLint)triangle[1];
+            gl_triangle[2] = (GLint)triangle[2];
+            gl_cnt++;
+            gl_triangle += 3; //three indices per triangle
+          }
+        }
+        glUnmapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB);
+      }
+
       void ScalarView::prepare_gl_geometry()
       {
         if(lin_updated)
@@ -674,44 +860,9 @@ namespace Hermes
             if(!GLEW_ARB_vertex_buffer_object)
               throw std::runtime_error("ARB_vertex_buffer_object not supported");
 
-            //reallocate indices
-            if(gl_index_buffer == 0 || tri_cnt > max_gl_tris)
-            {
-              if(gl_index_buffer == 0)
-                glGenBuffersARB(1, &gl_index_buffer);
-              glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, gl_index_buffer);
-              glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, sizeof(GLint) * tri_cnt * 3, NULL, GL_DYNAMIC_DRAW_ARB);
-              GLenum err = glGetError();
-              if(err != GL_NO_ERROR)
-                throw std::runtime_error("unable to allocate vertex buffer: " + err);
-              max_gl_tris = tri_cnt;
-            }
-            else
-            {
-              glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, gl_index_buffer);
-            }
-
-            //fill indices
-            GLuint* gl_triangle = (GLuint*)glMapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, GL_WRITE_ONLY_ARB);
-            if(gl_triangle == NULL)
-              throw std::runtime_error("unable to map index buffer: " + glGetError());
-            gl_tri_cnt = 0;
-            for(int i = 0; i < tri_cnt; i++)
-            {
-              const int3& triangle = tris[i];
-              const double3& vert_a = verts[triangle[0]];
-              const double3& vert_b = verts[triangle[1]];
-              const double3& vert_c = verts[triangle[2]];
-              if(finite(vert_a[2]) && finite(vert_b[2]) && finite(vert_c[2]))
-              {
-                gl_triangle[0] = (GLint)triangle[0];
-                gl_triangle[1] = (GLint)triangle[1];
-                gl_triangle[2] = (GLint)triangle[2];
-                gl_tri_cnt++;
-                gl_triangle += 3; //three indices per triangle
-              }
-            }
-            glUnmapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB);
+            //triangles and the level of detail
+            fill_gl_triangles(gl_index_buffer, max_gl_tris, gl_tri_cnt, tris, tri_cnt, verts);
+            fill_gl_triangles(gl_lod_index_buffer, max_gl_lod_tris, gl_lod_tri_cnt, lin->get_lod_triangles(), lin->get_num_lod_triangles(), verts);
 
             //reallocate vertices
             if(gl_coord_buffer == 0 || vert_cnt > max_gl_verts)
@@ -719,7 +870,7 @@ namespace Hermes
               if(gl_coord_buffer == 0)
                 glGenBuffersARB(1, &gl_coord_buffer);
               glBindBufferARB(GL_ARRAY_BUFFER_ARB, gl_coord_buffer);
-              glBufferDataARB(GL_ARRAY_BUFFER_ARB, sizeof(GLVertex2) * vert_cnt, NULL, GL_DYNAMIC_DRAW_ARB);
+              glBufferDataARB(GL_ARRAY_BUFFER_ARB, sizeof(GLVertex2) * vert_cnt, NULL, GL_STATIC_DRAW_ARB);
               GLenum err = glGetError();
               if(err != GL_NO_ERROR)
                 throw std::runtime_error("unable to allocate coord buffer: " + err);
@@ -738,29 +889,96 @@ namespace Hermes
               gl_verts[i] = GLVertex2((float)verts[i][0], (float)verts[i][1], (float)((verts[i][2] - range_min) * value_irange));
             glUnmapBufferARB(GL_ARRAY_BUFFER_ARB);
 
-            //allocate edge indices
-            if(gl_edge_inx_buffer == 0)
+            //vertices of the 3D mode, the transformation and the colors are left to the matrices
+            if(normals != NULL)
+            {
+              if(gl_coord_buffer_3d == 0 || vert_cnt > max_gl_verts_3d)
+              {
+                if(gl_coord_buffer_3d == 0)
+                  glGenBuffersARB(1, &gl_coord_buffer_3d);
+                glBindBufferARB(GL_ARRAY_BUFFER_ARB, gl_coord_buffer_3d);
+                glBufferDataARB(GL_ARRAY_BUFFER_ARB, sizeof(GLVertex3) * vert_cnt, NULL, GL_STATIC_DRAW_ARB);
+                GLenum err = glGetError();
+                if(err != GL_NO_ERROR)
+                  throw std::runtime_error("unable to allocate 3D coord buffer: " + err);
+                max_gl_verts_3d = vert_cnt;
+              }
+              else
+              {
+                glBindBufferARB(GL_ARRAY_BUFFER_ARB, gl_coord_buffer_3d);
+              }
+
+              GLVertex3* gl_verts_3d = (GLVertex3*)glMapBufferARB(GL_ARRAY_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+              if(gl_verts_3d == NULL)
+                throw std::runtime_error("unable to map 3D coord buffer: " + glGetError());
+              for(int i = 0; i < vert_cnt; i++)
+                gl_verts_3d[i] = GLVertex3((float)verts[i][0], (float)verts[i][1], (float)verts[i][2],
+                (float)normals[i][0], (float)normals[i][1], (float)normals[i][2]);
+              glUnmapBufferARB(GL_ARRAY_BUFFER_ARB);
+            }
+
+            //edge indices, the boundary ones first
+            int edge_cnt = lin->get_num_edges();
+            int2* edges = lin->get_edges();
+            int* edge_markers = lin->get_edge_markers();
+            if(gl_edge_inx_buffer == 0 || edge_cnt > gl_edge_cnt)
             {
-              glGenBuffersARB(1, &gl_edge_inx_buffer);
-              glBindBufferARB(GL_ARRAY_BUFFER_ARB, gl_edge_inx_buffer);
-              glBufferDataARB(GL_ARRAY_BUFFER_ARB, sizeof(GLuint) * H2DV_GL_MAX_EDGE_BUFFER * 2, NULL, GL_DYNAMIC_DRAW_ARB);
+              if(gl_edge_inx_buffer == 0)
+                glGenBuffersARB(1, &gl_edge_inx_buffer);
+              glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, gl_edge_inx_buffer);
+              glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, sizeof(GLuint) * std::max(edge_cnt, 1) * 2, NULL, GL_STATIC_DRAW_ARB);
               GLenum err = glGetError();
               if(err != GL_NO_ERROR) { //if it fails, no problem
                 glDeleteBuffersARB(1, &gl_edge_inx_buffer);
                 gl_edge_inx_buffer = 0;
               }
             }
+            else
+            {
+              glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, gl_edge_inx_buffer);
+            }
+            if(gl_edge_inx_buffer != 0)
+            {
+              GLuint* gl_inx_buffer = (GLuint*)glMapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+              if(gl_inx_buffer == NULL)
+                throw std::runtime_error("unable to map edge buffer: " + glGetError());
+              gl_boundary_edge_cnt = 0;
+              for (int i = 0; i < edge_cnt; i++)
+                if(edge_markers[i] != 0)
+                {
+                  gl_inx_buffer[2 * gl_boundary_edge_cnt] = (GLuint)edges[i][0];
+                  gl_inx_buffer[2 * gl_boundary_edge_cnt + 1] = (GLuint)edges[i][1];
+                  gl_boundary_edge_cnt++;
+                }
+              gl_edge_cnt = gl_boundary_edge_cnt;
+              for (int i = 0; i < edge_cnt; i++)
+                if(edge_markers[i] == 0)
+                {
+                  gl_inx_buffer[2 * gl_edge_cnt] = (GLuint)edges[i][0];
+                  gl_inx_buffer[2 * gl_edge_cnt + 1] = (GLuint)edges[i][1];
+                  gl_edge_cnt++;
+                }
+              glUnmapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB);
+            }
+            glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
             glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
           }
           catch(std::exception &e)
           { //out-of-memory or any other failure
             if(gl_coord_buffer) { glDeleteBuffersARB(1, &gl_coord_buffer); gl_coord_buffer = 0; }
+            if(gl_coord_buffer_3d) { glDeleteBuffersARB(1, &gl_coord_buffer_3d); gl_coord_buffer_3d = 0; }
             if(gl_index_buffer) { glDeleteBuffersARB(1, &gl_index_buffer); gl_index_buffer = 0; }
+            if(gl_lod_index_buffer) { glDeleteBuffersARB(1, &gl_lod_index_buffer); gl_lod_index_buffer = 0; }
             if(gl_edge_inx_buffer) { glDeleteBuffersARB(1, &gl_edge_inx_buffer); gl_edge_inx_buffer = 0; }
           }
         }
       }
 
+      bool ScalarView::use_lod() const
+      {
+        return (dragging || scaling || panning) && gl_lod_index_buffer != 0 && gl_lod_tri_cnt > 0 && gl_tri_cnt > H2DV_LOD_MIN_TRIANGLES;
+      }
+
       void ScalarView::draw_values_2d()
       {
         //set texture for coloring
@@ -805,7 +1023,9 @@ namespace Hermes
           glEnd();
         }
         else { //render using vertex buffer object
-          if(gl_tri_cnt > 0)
+          bool lod = use_lod();
+          int cnt = lod ? gl_lod_tri_cnt : gl_tri_cnt;
+          if(cnt > 0)
           {
             //bind vertices
             glBindBufferARB(GL_ARRAY_BUFFER_ARB, gl_coord_buffer);
@@ -815,14 +1035,16 @@ namespace Hermes
             glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 
             //bind indices
-            glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, gl_index_buffer);
+            glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, lod ? gl_lod_index_buffer : gl_index_buffer);
 
             //render
-            glDrawElements(GL_TRIANGLES, 3*gl_tri_cnt, GL_UNSIGNED_INT, GL_BUFFER_OFFSET(0));
+            glDrawElements(GL_TRIANGLES, 3*cnt, GL_UNSIGNED_INT, GL_BUFFER_OFFSET(0));
 
             //GL cleanup
             glDisableClientState(GL_VERTEX_ARRAY);
             glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+            glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+            glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
           }
         }
 
@@ -835,64 +1057,137 @@ namespace Hermes
       void ScalarView::draw_edges_2d()
       {
         glColor3fv(edges_color);
-        bool displayed = false;
-        if(gl_edge_inx_buffer != 0) {//VBO
-          //prepage GL
-          glEnableClientState(GL_VERTEX_ARRAY);
+        if(gl_edge_inx_buffer != 0 && gl_coord_buffer != 0) {//VBO
+          int cnt = show_edges ? gl_edge_cnt : gl_boundary_edge_cnt;
+          if(cnt > 0)
+          {
+            //bind vertices and buffers
+            glEnableClientState(GL_VERTEX_ARRAY);
+            glBindBufferARB(GL_ARRAY_BUFFER_ARB, gl_coord_buffer);
+            glVertexPointer(2, GL_FLOAT, sizeof(GLVertex2), GL_BUFFER_OFFSET(0));
+            glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, gl_edge_inx_buffer);
 
-          //map edge buffer
-          glBindBufferARB(GL_ARRAY_BUFFER_ARB, gl_edge_inx_buffer);
-          GLuint *gl_inx_buffer = (GLuint*)glMapBufferARB(GL_ARRAY_BUFFER_ARB, GL_WRITE_ONLY);
-          GLenum err = glGetError();
-          if(err == GL_NO_ERROR) {//render edges
-            unsigned int buffer_inx = 0;
-						int2* edges = lin->get_edges();
-            int* edge_markers = lin->get_edge_markers();
-            int edge_cnt = lin->get_num_edges();
-            for (int i = 0; i < edge_cnt; i++) //TODO: we could draw only left-right, top-bottom ones
-            {
-							const int2 &edge = edges[i];
-              const int &edge_marker = edge_markers[i];
-              if(show_edges || edge_marker != 0) { //select internal edges to draw
-                gl_inx_buffer[buffer_inx] = (GLuint)edge[0];
-                gl_inx_buffer[buffer_inx + 1] = (GLuint)edge[1];
-                buffer_inx += 2;
-              }
+            //render
+            glDrawElements(GL_LINES, 2*cnt, GL_UNSIGNED_INT, GL_BUFFER_OFFSET(0));
 
-              //render buffer if it is full or if this is the last edge processed
-              if(buffer_inx == (2*H2DV_GL_MAX_EDGE_BUFFER) || (buffer_inx > 0 && i == (edge_cnt-1)))
-              {
-                glUnmapBufferARB(GL_ARRAY_BUFFER_ARB);
+            //GL cleanup
+            glDisableClientState(GL_VERTEX_ARRAY);
+            glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+            glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+          }
+        }
+        else { //safe fallback, VBO not suppored
+          glBegin(GL_LINES);
+          draw_edges(&draw_gl_edge, NULL, !show_edges);
+          glEnd();
+        }
+      }
 
-                //bind vertices and buffers
-                glBindBufferARB(GL_ARRAY_BUFFER_ARB, gl_coord_buffer);
-                glVertexPointer(2, GL_FLOAT, sizeof(GLVertex2), GL_BUFFER_OFFSET(0));
-                glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, gl_edge_inx_buffer);
+      void ScalarView::draw_values_3d()
+      {
+        int3* tris = lin->get_triangles();
+        double3* vert = lin->get_vertices();
+        int2* edges = lin->get_edges();
+        int i, j;
 
-                //render
-                glDrawElements(GL_LINES, buffer_inx, GL_UNSIGNED_INT, GL_BUFFER_OFFSET(0));
+        // Draw the surface.
+        glEnable(GL_LIGHTING);
+        glEnable(GL_TEXTURE_1D);
+        glBindTexture(GL_TEXTURE_1D, gl_pallete_tex_id);
+        glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+        glEnable(GL_NORMALIZE);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(1.0, 1.0);
+        bool vbo = (gl_coord_buffer_3d != 0 && gl_index_buffer != 0);
+        if(vbo)
+        {
+          // (x, y, value) -> ((x - xctr) * xzscale, (value - yctr) * yscale, -(y - zctr) * xzscale), the normals are
+          // transformed by the inverse transpose, as the ones drawn below.
+          glMatrixMode(GL_MODELVIEW);
+          glPushMatrix();
+          double model_matrix[16] = { xzscale, 0.0, 0.0, 0.0,  0.0, 0.0, -xzscale, 0.0,  0.0, yscale, 0.0, 0.0,
+            -xctr * xzscale, -yctr * yscale, zctr * xzscale, 1.0 };
+          glMultMatrixd(model_matrix);
 
-                //map edge buffer
-                glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
-                glBindBufferARB(GL_ARRAY_BUFFER_ARB, gl_edge_inx_buffer);
-                gl_inx_buffer = (GLuint*)glMapBufferARB(GL_ARRAY_BUFFER_ARB, GL_WRITE_ONLY);
-                buffer_inx = 0;
-              }
+          // texture coordinate (value - range_min) * value_irange * tex_scale + tex_shift
+          glMatrixMode(GL_TEXTURE);
+          glLoadIdentity();
+          glTranslated(tex_shift, 0.0, 0.0);
+          glScaled(tex_scale * value_irange, 0.0, 0.0);
+          glTranslated(-range_min, 0.0, 0.0);
+
+          bool lod = use_lod();
+          int cnt = lod ? gl_lod_tri_cnt : gl_tri_cnt;
+          glBindBufferARB(GL_ARRAY_BUFFER_ARB, gl_coord_buffer_3d);
+          glVertexPointer(3, GL_FLOAT, sizeof(GLVertex3), GL_BUFFER_OFFSET(0));
+          glTexCoordPointer(1, GL_FLOAT, sizeof(GLVertex3), GL_BUFFER_OFFSET(GLVertex3::H2D_OFFSETOF_VALUE));
+          glNormalPointer(GL_FLOAT, sizeof(GLVertex3), GL_BUFFER_OFFSET(GLVertex3::H2D_OFFSETOF_NORMAL));
+          glEnableClientState(GL_VERTEX_ARRAY);
+          glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+          glEnableClientState(GL_NORMAL_ARRAY);
+          glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, lod ? gl_lod_index_buffer : gl_index_buffer);
+          if(cnt > 0)
+            glDrawElements(GL_TRIANGLES, 3*cnt, GL_UNSIGNED_INT, GL_BUFFER_OFFSET(0));
+          glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+          glDisableClientState(GL_NORMAL_ARRAY);
+
+          glMatrixMode(GL_TEXTURE);
+          glLoadIdentity();
+          glMatrixMode(GL_MODELVIEW);
+        }
+        else
+        {
+          glBegin(GL_TRIANGLES);
+          double normal_xzscale = 1.0 / xzscale, normal_yscale = 1.0 / yscale;
+          for (i = 0; i < lin->get_num_triangles(); i++)
+          {
+            for (j = 0; j < 3; j++)
+            {
+              glNormal3d(normals[tris[i][j]][0] * normal_xzscale, normals[tris[i][j]][2] * normal_yscale, -normals[tris[i][j]][1] * normal_xzscale);
+              glTexCoord2d((vert[tris[i][j]][2] - range_min) * value_irange * tex_scale + tex_shift, 0.0);
+              glVertex3d((vert[tris[i][j]][0] - xctr) * xzscale,
+                (vert[tris[i][j]][2] - yctr) * yscale,
+                -(vert[tris[i][j]][1] - zctr) * xzscale);
             }
-            glUnmapBufferARB(GL_ARRAY_BUFFER_ARB);
-
-            //GL cleanup
-            glDisableClientState(GL_VERTEX_ARRAY);
+          }
+          glEnd();
+        }
+        glDisable(GL_POLYGON_OFFSET_FILL);
 
-            displayed = true;
+        // Draw edges.
+        glDisable(GL_LIGHTING);
+        glDisable(GL_TEXTURE_1D);
+        if(show_edges)
+        {
+          glColor3fv(edges_color);
+          if(vbo && gl_edge_inx_buffer != 0)
+          {
+            glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, gl_edge_inx_buffer);
+            if(gl_edge_cnt > 0)
+              glDrawElements(GL_LINES, 2*gl_edge_cnt, GL_UNSIGNED_INT, GL_BUFFER_OFFSET(0));
+          }
+          else
+          {
+            glBegin(GL_LINES);
+            for (i = 0; i < lin->get_num_edges(); i++)
+            {
+              glVertex3d((vert[edges[i][0]][0] - xctr) * xzscale,
+                (vert[edges[i][0]][2] - yctr) * yscale,
+                -(vert[edges[i][0]][1] - zctr) * xzscale);
+              glVertex3d((vert[edges[i][1]][0] - xctr) * xzscale,
+                (vert[edges[i][1]][2] - yctr) * yscale,
+                -(vert[edges[i][1]][1] - zctr) * xzscale);
+            }
+            glEnd();
           }
         }
 
-        //safe fallback
-        if(!displayed) { //VBO not suppored
-          glBegin(GL_LINES);
-          draw_edges(&draw_gl_edge, NULL, !show_edges);
-          glEnd();
+        if(vbo)
+        {
+          glDisableClientState(GL_VERTEX_ARRAY);
+          glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+          glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+          glPopMatrix();
         }
       }
 
@@ -994,7 +1289,7 @@ namespace Hermes
 
       void ScalarView::on_display()
       {
-        int i, j;
+        int i;
 
         // lock and get data
         lin->lock_data();
@@ -1087,48 +1382,8 @@ namespace Hermes
           glRotated(xrot, 1, 0, 0);
           glRotated(yrot, 0, 1, 0);
 
-          // Draw the surface.
-          glEnable(GL_LIGHTING);
-          glEnable(GL_TEXTURE_1D);
-          glBindTexture(GL_TEXTURE_1D, gl_pallete_tex_id);
-          glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-          glEnable(GL_NORMALIZE);
-          glEnable(GL_POLYGON_OFFSET_FILL);
-          glPolygonOffset(1.0, 1.0);
-          glBegin(GL_TRIANGLES);
-          double normal_xzscale = 1.0 / xzscale, normal_yscale = 1.0 / yscale;
-          for (i = 0; i < lin->get_num_triangles(); i++)
-          {
-            for (j = 0; j < 3; j++)
-            {
-              glNormal3d(normals[tris[i][j]][0] * normal_xzscale, normals[tris[i][j]][2] * normal_yscale, -normals[tris[i][j]][1] * normal_xzscale);
-              glTexCoord2d((vert[tris[i][j]][2] - range_min) * value_irange * tex_scale + tex_shift, 0.0);
-              glVertex3d((vert[tris[i][j]][0] - xctr) * xzscale,
-                (vert[tris[i][j]][2] - yctr) * yscale,
-                -(vert[tris[i][j]][1] - zctr) * xzscale);
-            }
-          }
-          glEnd();
-          glDisable(GL_POLYGON_OFFSET_FILL);
-
-          // Draw edges.
-          glDisable(GL_LIGHTING);
-          glDisable(GL_TEXTURE_1D);
-          if(show_edges)
-          {
-            glColor3fv(edges_color);
-            glBegin(GL_LINES);
-            for (i = 0; i < lin->get_num_edges(); i++)
-            {
-              glVertex3d((vert[edges[i][0]][0] - xctr) * xzscale,
-                (vert[edges[i][0]][2] - yctr) * yscale,
-                -(vert[edges[i][0]][1] - zctr) * xzscale);
-              glVertex3d((vert[edges[i][1]][0] - xctr) * xzscale,
-                (vert[edges[i][1]][2] - yctr) * yscale,
-                -(vert[edges[i][1]][1] - zctr) * xzscale);
-            }
-            glEnd();
-          }
+          // Draw the surface and the edges.
+          draw_values_3d();
 
           // Draw the whole bounding box or only the boundary edges.
           if(show_aabb)
@@ -1196,6 +1451,9 @@ namespace Hermes
 
         for (int i = 0; i < num_verts; i++)
           normalize(normals[i][0], normals[i][1], normals[i][2]);
+
+        // the vertex buffer of the 3D mode contains the normals.
+        lin_updated = true;
       }
 
       void ScalarView::update_layout()
@@ -1541,6 +1799,20 @@ namespace Hermes
       void ScalarView::on_middle_mouse_up(int x, int y)
       {
           panning = false;
+          refresh();
+      }
+
+      void ScalarView::on_left_mouse_up(int x, int y)
+      {
+        View::on_left_mouse_up(x, y);
+        // all the triangles instead of the level of detail
+        refresh();
+      }
+
+      void ScalarView::on_right_mouse_up(int x, int y)
+      {
+        View::on_right_mouse_up(x, y);
+        refresh();
       }
 
 
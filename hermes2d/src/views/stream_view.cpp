@@ -17,6 +17,7 @@
 #include <GL/freeglut.h>
 #include "global.h"
 #include "stream_view.h"
+#include "api2d.h"
 
 namespace Hermes
 {
@@ -34,7 +35,8 @@ namespace Hermes
         root_y_min = 1e100;
         root_x_max = -1e100;
         root_y_max = -1e100;
-        root = NULL;
+        streamlines = NULL;
+        streamlength = NULL;
       }
 
       StreamView::StreamView(char* title, WinGeom* wg)
@@ -47,7 +49,8 @@ namespace Hermes
         root_y_min = 1e100;
         root_x_max = -1e100;
         root_y_max = -1e100;
-        root = NULL;
+        streamlines = NULL;
+        streamlength = NULL;
       }
 
       void StreamView::show(MeshFunction<double>* xsln, MeshFunction<double>* ysln, int marker, double step, double eps)
@@ -59,13 +62,10 @@ namespace Hermes
         show(xsln, ysln, marker, step, eps, H2D_FN_VAL_0, H2D_FN_VAL_0);
       }
 
-      bool StreamView::is_in_triangle(int idx, double x, double y, double3& bar)
+      bool StreamView::is_in_triangle(const BVHTriangle& tri, double x, double y, double3& bar)
       {
-        double4* vert = vec->get_vertices();
-        int3* xtris = vec->get_triangles();
-        int3& tri = xtris[idx];
-        double x1 = vert[tri[0]][0], x2 = vert[tri[1]][0], x3 = vert[tri[2]][0];
-        double y1 = vert[tri[0]][1], y2 = vert[tri[1]][1], y3 = vert[tri[2]][1];
+        double x1 = tri.x1, x2 = tri.x2, x3 = tri.x3;
+        double y1 = tri.y1, y2 = tri.y2, y3 = tri.y3;
         double jac = ((x1 - x3)*(y2 - y3) - (x2 - x3)*(y1 - y3));
         double eps = jac * 1e-8;
         double a = ((y2 - y3) * (x - x3) - (x2 - x3) * (y - y3));
@@ -78,111 +78,155 @@ namespace Hermes
           return false;
       }
 
-      void StreamView::add_element_to_tree(Node* father, int e_idx, double x_min, double x_max, double y_min, double y_max)
+      /// Orders the triangles by their centroids along one axis.
+      struct CentroidLess
       {
-        double4* vert = vec->get_vertices();
-        int3* xtris = vec->get_triangles();
-        if(father->leaf == true)
+        CentroidLess(const double* centroids, int axis) : centroids(centroids), axis(axis) {};
+        bool operator()(int a, int b) const { return centroids[2 * a + axis] < centroids[2 * b + axis]; }
+        const double* centroids;
+        int axis;
+      };
+
+      static const int H2DV_BVH_LEAF_SIZE = 8;
+
+      int StreamView::build_tree_node(std::vector<int>& indices, int first, int count, const double* boxes, const double* centroids)
+      {
+        int node_i = bvh_nodes.size();
+        bvh_nodes.push_back(BVHNode());
+
+        BVHNode node;
+        node.x_min = node.y_min = 1e100;
+        node.x_max = node.y_max = -1e100;
+        double c_x_min = 1e100, c_x_max = -1e100, c_y_min = 1e100, c_y_max = -1e100;
+        for (int i = first; i < first + count; i++)
         {
-          father->elements[father->num_elem++] = e_idx;
-          if(father->num_elem >= 100) // too many elements
-          {
-            father->leaf = false;
-            for (int k = 0; k < 2; k++)
-            {
-              father->sons[k] = new Node;
-              father->sons[k]->level = father->level + 1;
-              father->sons[k]->leaf = true;
-              father->sons[k]->num_elem = 0;
-            }
-            for (int i = 0; i < father->num_elem; i++)
-              add_element_to_tree(father, father->elements[i], x_min, x_max, y_min, y_max);
-          }
+          const double* box = boxes + 4 * indices[i];
+          node.x_min = std::min(node.x_min, box[0]); node.x_max = std::max(node.x_max, box[1]);
+          node.y_min = std::min(node.y_min, box[2]); node.y_max = std::max(node.y_max, box[3]);
+          const double* centroid = centroids + 2 * indices[i];
+          c_x_min = std::min(c_x_min, centroid[0]); c_x_max = std::max(c_x_max, centroid[0]);
+          c_y_min = std::min(c_y_min, centroid[1]); c_y_max = std::max(c_y_max, centroid[1]);
+        }
+
+        if(count <= H2DV_BVH_LEAF_SIZE)
+        {
+          node.first = first;
+          node.count = count;
+          node.second = -1;
         }
         else
         {
-          double x_mid = (x_min + x_max)/2;
-          double y_mid = (y_min + y_max)/2;
-          int3& tri = xtris[e_idx];
-          if(father->level % 2) // level = 1, 3, 5, ...
-          {
-            if(vert[tri[0]][1] <= y_mid || vert[tri[1]][1] <= y_mid || vert[tri[2]][1] <= y_mid)
-              add_element_to_tree(father->sons[0], e_idx, x_min, x_max, y_min, y_mid);
-            if(vert[tri[0]][1] >= y_mid || vert[tri[1]][1] >= y_mid || vert[tri[2]][1] >= y_mid)
-              add_element_to_tree(father->sons[1], e_idx, x_min, x_max, y_mid, y_max);
-          }
-          else // level 0, 2, 4, ...
-          {
-            if(vert[tri[0]][0] <= x_mid || vert[tri[1]][0] <= x_mid || vert[tri[2]][0] <= x_mid)
-              add_element_to_tree(father->sons[0], e_idx, x_min, x_mid, y_min, y_max);
-            if(vert[tri[0]][0] >= x_mid || vert[tri[1]][0] >= x_mid || vert[tri[2]][0] >= x_mid)
-              add_element_to_tree(father->sons[1], e_idx, x_mid, x_max, y_min, y_max);
-          }
+          // median split along the longer extent of the centroids
+          int axis = (c_x_max - c_x_min >= c_y_max - c_y_min) ? 0 : 1;
+          int mid = first + count / 2;
+          std::nth_element(indices.begin() + first, indices.begin() + mid, indices.begin() + first + count, CentroidLess(centroids, axis));
+          node.first = first;
+          node.count = 0;
+          build_tree_node(indices, first, mid - first, boxes, centroids);
+          node.second = build_tree_node(indices, mid, first + count - mid, boxes, centroids);
         }
+        bvh_nodes[node_i] = node;
+        return node_i;
       }
 
       void StreamView::build_tree()
       {
-        root->leaf = true;
-        root->level = 0;
-        root->num_elem = 0;
-        for (int i = 0; i < vec->get_num_triangles(); i++)
+        double4* vert = vec->get_vertices();
+        int3* xtris = vec->get_triangles();
+        int num_triangles = vec->get_num_triangles();
+
+        // the bounding boxes, slightly enlarged for the tolerance of is_in_triangle(), and the centroids
+        double* boxes = new double[4 * std::max(num_triangles, 1)];
+        double* centroids = new double[2 * std::max(num_triangles, 1)];
+        std::vector<int> indices(num_triangles);
+        for (int i = 0; i < num_triangles; i++)
+        {
+          int3& tri = xtris[i];
+          double x_min = std::min(vert[tri[0]][0], std::min(vert[tri[1]][0], vert[tri[2]][0]));
+          double x_max = std::max(vert[tri[0]][0], std::max(vert[tri[1]][0], vert[tri[2]][0]));
+          double y_min = std::min(vert[tri[0]][1], std::min(vert[tri[1]][1], vert[tri[2]][1]));
+          double y_max = std::max(vert[tri[0]][1], std::max(vert[tri[1]][1], vert[tri[2]][1]));
+          double tolerance = 1e-8 * std::max(x_max - x_min, y_max - y_min);
+          boxes[4 * i] = x_min - tolerance; boxes[4 * i + 1] = x_max + tolerance;
+          boxes[4 * i + 2] = y_min - tolerance; boxes[4 * i + 3] = y_max + tolerance;
+          centroids[2 * i] = (vert[tri[0]][0] + vert[tri[1]][0] + vert[tri[2]][0]) / 3.0;
+          centroids[2 * i + 1] = (vert[tri[0]][1] + vert[tri[1]][1] + vert[tri[2]][1]) / 3.0;
+          indices[i] = i;
+        }
+
+        bvh_nodes.clear();
+        bvh_nodes.reserve(2 * (num_triangles / H2DV_BVH_LEAF_SIZE + 1));
+        if(num_triangles > 0)
+          build_tree_node(indices, 0, num_triangles, boxes, centroids);
+
+        // the triangles in the order of the leaves
+        bvh_triangles.resize(num_triangles);
+        for (int i = 0; i < num_triangles; i++)
         {
-          add_element_to_tree(root, i, root_x_min, root_x_max, root_y_min, root_y_max);
+          int3& tri = xtris[indices[i]];
+          BVHTriangle& bvh_triangle = bvh_triangles[i];
+          bvh_triangle.x1 = vert[tri[0]][0]; bvh_triangle.y1 = vert[tri[0]][1];
+          bvh_triangle.x2 = vert[tri[1]][0]; bvh_triangle.y2 = vert[tri[1]][1];
+          bvh_triangle.x3 = vert[tri[2]][0]; bvh_triangle.y3 = vert[tri[2]][1];
+          bvh_triangle.index = indices[i];
         }
+
+        delete [] boxes;
+        delete [] centroids;
       }
 
-      int StreamView::find_triangle_in_tree(double x, double y, Node* father, double x_min, double x_max, double y_min, double y_max, double3& bar)
+      int StreamView::find_triangle(double x, double y, double3& bar) const
       {
-        if(father->leaf == true)
+        if(bvh_nodes.empty())
+          return -1;
+
+        // the depth of the median split tree is logarithmic
+        int stack[64];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0)
         {
-          double4* vert = vec->get_vertices();
-          int3* xtris = vec->get_triangles();
-          for (int idx = 0; idx < father->num_elem; idx++)
+          int node_i = stack[--stack_size];
+          const BVHNode& node = bvh_nodes[node_i];
+          if(x < node.x_min || x > node.x_max || y < node.y_min || y > node.y_max)
+            continue;
+          if(node.count > 0)
           {
-            int i = father->elements[idx];
-            if(is_in_triangle(i, x, y, bar)) return i;
+            for (int i = node.first; i < node.first + node.count; i++)
+              if(is_in_triangle(bvh_triangles[i], x, y, bar))
+                return bvh_triangles[i].index;
+          }
+          else
+          {
+            stack[stack_size++] = node.second;
+            stack[stack_size++] = node_i + 1;
           }
-          return -1;
-        }
-        else
-        {
-          double x_mid = (x_max + x_min)/2;
-          double y_mid = (y_max + y_min)/2;
-          if(father->level % 2) // level = 1, 3, 5, ...
-            if(y <= y_mid)
-              return find_triangle_in_tree(x, y, father->sons[0], x_min, x_max, y_min, y_mid, bar);
-            else
-              return find_triangle_in_tree(x, y, father->sons[1], x_min, x_max, y_mid, y_max, bar);
-          else // level 0, 2, 4, ...
-            if(x <= x_mid)
-              return find_triangle_in_tree(x, y, father->sons[0], x_min, x_mid, y_min, y_max, bar);
-            else
-              return find_triangle_in_tree(x, y, father->sons[1], x_mid, x_max, y_min, y_max, bar);
         }
+        return -1;
       }
 
-      bool StreamView::get_solution_values(double x, double y, double& xval, double& yval)
+      bool StreamView::get_solution_values(double x, double y, double& xval, double& yval) const
       {
         double4* vert = vec->get_vertices();
         int3* xtris = vec->get_triangles();
         double3 bar;
         int e_idx;
-        if((e_idx = find_triangle_in_tree(x, y, root, root_x_min, root_x_max, root_y_min, root_y_max, bar)) == -1) return false;
+        if((e_idx = find_triangle(x, y, bar)) == -1) return false;
         int3& tri = xtris[e_idx];
         xval = bar[0] * vert[tri[0]][2] + bar[1] * vert[tri[1]][2] + bar[2] * vert[tri[2]][2];
         yval = bar[0] * vert[tri[0]][3] + bar[1] * vert[tri[1]][3] + bar[2] * vert[tri[2]][3];
         return true;
       }
 
-      void StreamView::delete_tree(Node* father)
+      void StreamView::free_streamlines()
       {
-        if(father->leaf == false)
-        {
-          delete_tree(father->sons[0]);
-          delete_tree(father->sons[1]);
-        }
-        delete [] father;
+        for (int i = 0; i < num_stream; i++)
+          delete [] streamlines[i];
+        ::free(streamlines);
+        ::free(streamlength);
+        streamlines = NULL;
+        streamlength = NULL;
+        num_stream = 0;
       }
 
       int StreamView::create_streamline(double x_start, double y_start, int idx)
@@ -358,6 +402,14 @@ namespace Hermes
             double remaining_len = len; double init_x = ax; double init_y = ay;
             while (tmp_step < remaining_len)
             {
+              if(k >= buffer_length)
+              {
+                double2* larger = new double2[2 * buffer_length];
+                memcpy(larger, initial_points, buffer_length * sizeof(double2));
+                delete [] initial_points;
+                initial_points = larger;
+                buffer_length *= 2;
+              }
               initial_points[k][0] = init_x + tmp_step * ((bx - ax) / len);
               initial_points[k][1] = init_y + tmp_step * ((by - ay) / len);
               remaining_len = remaining_len - tmp_step;
@@ -390,7 +442,10 @@ namespace Hermes
         vec->calc_vertices_aabb(&vertices_min_x, &vertices_max_x, &vertices_min_y, &vertices_max_y);
 
         // create streamlines
+        free_streamlines();
         double4* vert = vec->get_vertices();
+        root_x_min = root_y_min = 1e100;
+        root_x_max = root_y_max = -1e100;
         for (int i = 0; i < vec->get_num_vertices(); i++)
         {
           if(vert[i][0] < root_x_min) root_x_min = vert[i][0];
@@ -405,15 +460,18 @@ namespace Hermes
         max_mag = vec->get_max_value();
 
         this->tick();
-        root = new Node;
         build_tree();
 
         double2* initial_points;
         find_initial_points(marker, step, initial_points);
 
-        streamlines = (double2**) malloc(sizeof(double2*) * (num_stream));
-        streamlength = (int*) malloc(sizeof(int) * (num_stream));
-        for (int i = 0; i < num_stream; i++)
+        // the streamlines are independent, the BVH and the vectorizer data are only read.
+        streamlines = (double2**) malloc(sizeof(double2*) * std::max(num_stream, 1));
+        streamlength = (int*) malloc(sizeof(int) * std::max(num_stream, 1));
+        int i;
+        int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
+#pragma omp parallel for schedule(dynamic, 1) private(i) num_threads(num_threads_used)
+        for (i = 0; i < num_stream; i++)
           streamlength[i] =  create_streamline(initial_points[i][0], initial_points[i][1], i);
 
         delete [] initial_points;
@@ -429,7 +487,7 @@ namespace Hermes
 
       void StreamView::add_streamline(double x, double y)
       {
-        if(root == NULL)
+        if(bvh_nodes.empty())
           throw Hermes::Exceptions::Exception("Function add_streamline must be called after StreamView::show().");
         this->tick();
         streamlines = (double2**) realloc(streamlines, sizeof(double2*) * (num_stream + 1));
@@ -607,11 +665,7 @@ namespace Hermes
 
       StreamView::~StreamView()
       {
-        delete_tree(root);
-        for (int i = 0; i < num_stream; i++)
-          delete [] streamlines[i];
-        delete [] streamlines;
-        delete [] streamlength;
+        free_streamlines();
         delete vec;
       }
     }
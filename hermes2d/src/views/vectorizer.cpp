@@ -43,47 +43,30 @@ namespace Hermes
 
       int Vectorizer::get_vertex(int p1, int p2, double x, double y, double xvalue, double yvalue)
       {
-        // search for an existing vertex
+        ThreadBuffer* buffer = this->get_thread_buffer();
+
+        // search for an existing vertex of this thread
         if(p1 > p2) std::swap(p1, p2);
-        int index = this->hash(p1, p2);
-        int i = 0;
-        if(index < this->vertex_count)
+        int index = buffer->hash(p1, p2);
+        int i = buffer->hash_table[index];
+        while (i >= 0)
         {
-          i = this->hash_table[index];
-          while (i >= 0 && i < this->vertex_count)
-          {
-            if(this->info[i][0] == p1 && this->info[i][1] == p2)
-              return i;
-            // note that we won't return a vertex with a different value than the required one;
-            // this takes care for discontinuities in the solution, where more vertices
-            // with different values will be created
-            i = info[i][2];
-          }
+          if(buffer->info[i][0] == p1 && buffer->info[i][1] == p2)
+            return i;
+          i = buffer->info[i][2];
         }
 
         // if not found, create a new one
-#pragma omp critical(realloc_vertices)
-        try
-        {
-          i = add_vertex();
-        }
-        catch(std::exception& e)
-        {
-          if(this->caughtException == NULL)
-            this->caughtException = new Hermes::Exceptions::Exception(e.what());
-        }
-        if(this->caughtException != NULL)
-        {
-          return -1;
-        }
+        i = buffer->add_vertex();
+        double4* verts = (double4*) buffer->verts;
         verts[i][0] = x;
         verts[i][1] = y;
         verts[i][2] = xvalue;
         verts[i][3] = yvalue;
-        this->info[i][0] = p1;
-        this->info[i][1] = p2;
-        this->info[i][2] = this->hash_table[index];
-        this->hash_table[index] = i;
+        buffer->info[i][0] = p1;
+        buffer->info[i][1] = p2;
+        buffer->info[i][2] = buffer->hash_table[index];
+        buffer->hash_table[index] = i;
         return i;
       }
 
@@ -138,6 +121,10 @@ namespace Hermes
       void Vectorizer::process_triangle(MeshFunction<double>** fns, int iv0, int iv1, int iv2, int level,
         double* xval, double* yval, double* phx, double* phy, int* idx, bool curved)
       {
+        // The vertices and the maximum of the calling thread, verts is read only before get_vertex() which may move it.
+        ThreadBuffer* buffer = this->get_thread_buffer();
+        double4* verts = (double4*) buffer->verts;
+        double& max = buffer->max;
         double midval[4][3];
 
         if(level < LIN_MAX_LEVEL)
@@ -153,7 +140,6 @@ namespace Hermes
             for (i = 0; i < lin_np_tri[1]; i++)
             {
               double m = (sqrt(sqr(xval[i]) + sqr(yval[i])));
-#pragma omp critical(max)
               if(finite(m) && fabs(m) > max)
                 max = fabs(m);
             }
@@ -272,12 +258,16 @@ namespace Hermes
         }
 
         // no splitting: output a linear triangle
-        add_triangle(iv0, iv1, iv2, fns[0]->get_active_element()->marker);
+        buffer->add_triangle(iv0, iv1, iv2, fns[0]->get_active_element()->marker);
       }
 
       void Vectorizer::process_quad(MeshFunction<double>** fns, int iv0, int iv1, int iv2, int iv3, int level,
         double* xval, double* yval, double* phx, double* phy, int* idx, bool curved)
       {
+        // The vertices and the maximum of the calling thread, verts is read only before get_vertex() which may move it.
+        ThreadBuffer* buffer = this->get_thread_buffer();
+        double4* verts = (double4*) buffer->verts;
+        double& max = buffer->max;
         double midval[4][5];
 
         // try not to split through the vertex with the largest value
@@ -300,9 +290,7 @@ namespace Hermes
             {
               double m = sqrt(sqr(xval[i]) + sqr(yval[i]));
               if(finite(m) && fabs(m) > max)
-#pragma omp critical(max)
-                if(finite(m) && fabs(m) > max)
-                  max = fabs(m);
+                max = fabs(m);
             }
 
             // This is just to make some sense.
@@ -435,13 +423,13 @@ namespace Hermes
         // output two linear triangles,
         if(!flip)
         {
-          add_triangle(iv3, iv0, iv1, fns[0]->get_active_element()->marker);
-          add_triangle(iv1, iv2, iv3, fns[0]->get_active_element()->marker);
+          buffer->add_triangle(iv3, iv0, iv1, fns[0]->get_active_element()->marker);
+          buffer->add_triangle(iv1, iv2, iv3, fns[0]->get_active_element()->marker);
         }
         else
         {
-          add_triangle(iv0, iv1, iv2, fns[0]->get_active_element()->marker);
-          add_triangle(iv2, iv3, iv0, fns[0]->get_active_element()->marker);
+          buffer->add_triangle(iv0, iv1, iv2, fns[0]->get_active_element()->marker);
+          buffer->add_triangle(iv2, iv3, iv0, fns[0]->get_active_element()->marker);
         }
       }
 
@@ -509,24 +497,13 @@ namespace Hermes
         this->edges_size = std::max(100 * nn, std::max(this->edges_size, 50000));
         //dashes_size = edges_size;
 
-        vertex_count = 0;
-        triangle_count = 0;
-        edges_count = 0;
         dashes_count = 0;
-
-        // reuse or allocate vertex, triangle and edge arrays
-        this->verts = (double4*) realloc(this->verts, sizeof(double4) * vertex_size);
-        this->tris = (int3*) realloc(this->tris, sizeof(int3) * this->triangle_size);
-        this->tri_markers = (int*) realloc(this->tri_markers, sizeof(int) * this->triangle_size);
-        this->edges = (int2*) realloc(this->edges, sizeof(int2) * this->edges_size);
-        this->edge_markers = (int*) realloc(this->edge_markers, sizeof(int) * this->edges_size);
         this->dashes = (int2*) realloc(this->dashes, sizeof(int2) * dashes_size);
-        info = (int4*) malloc(sizeof(int4) * vertex_size);
-        this->empty = false;
 
-        // initialize the hash table
-        hash_table = (int*) malloc(sizeof(int) * vertex_size);
-        memset(hash_table, 0xff, sizeof(int) * vertex_size);
+        // the vertices, triangles and edges are produced into per-thread buffers and merged afterwards
+        int num_threads_used = this->get_num_threads();
+        this->init_thread_buffers(num_threads_used, 4, this->vertex_size, this->triangle_size, this->edges_size);
+        this->empty = false;
 
         // select the linearization quadrature
         Quad2D *old_quad_x, *old_quad_y;
@@ -547,8 +524,8 @@ namespace Hermes
           meshes.push_back(ydisp->get_mesh());
 
         // Parallelization
-        MeshFunction<double>*** fns = new MeshFunction<double>**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+        MeshFunction<double>*** fns = new MeshFunction<double>**[this->get_num_threads()];
+        for(unsigned int i = 0; i < this->get_num_threads(); i++)
         {
           fns[i] = new MeshFunction<double>*[4];
           fns[i][0] = xsln->clone();
@@ -569,8 +546,8 @@ namespace Hermes
           }
         }
 
-        Transformable*** trfs = new Transformable**[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+        Transformable*** trfs = new Transformable**[this->get_num_threads()];
+        for(unsigned int i = 0; i < this->get_num_threads(); i++)
         {
           trfs[i] = new Transformable*[4];
           trfs[i][0] = fns[i][0];
@@ -606,46 +583,36 @@ namespace Hermes
         xitem = xitem_orig;
         yitem = yitem_orig;
 
-        Traverse trav_masterMax(true);
-        unsigned int num_states = trav_masterMax.get_num_states(meshes);
-
-        trav_masterMax.begin(meshes.size(), &(meshes.front()));
-
-        Traverse* trav = new Traverse[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
-        {
-          trav[i].begin(meshes.size(), &(meshes.front()), trfs[i]);
-          trav[i].stack = trav_masterMax.stack;
-        }
+        // The states are precalculated once and used for both the passes below.
+        int num_states;
+        Traverse::State** states = this->traverse_plan.get_states(meshes, num_states);
 
         int state_i;
 
 #define CHUNKSIZE 1
-        int num_threads_used = Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads);
-#pragma omp parallel shared(trav_masterMax) private(state_i) num_threads(num_threads_used)
+#pragma omp parallel shared(states) private(state_i) num_threads(num_threads_used)
         {
-#pragma omp for schedule(static, CHUNKSIZE)
+          this->apply_thread_affinity();
+#pragma omp for schedule(dynamic, CHUNKSIZE)
           for(state_i = 0; state_i < num_states; state_i++)
           {
             try
             {
-              Traverse::State current_state;
-#pragma omp critical(get_next_state)
-              current_state = trav[omp_get_thread_num()].get_next_state(&trav_masterMax.top, &trav_masterMax.id);
+              Traverse::State* current_state = states[state_i];
+              Traverse::set_state_to_fns(current_state, trfs[omp_get_thread_num()]);
 
               fns[omp_get_thread_num()][0]->set_quad_order(0, xitem);
               fns[omp_get_thread_num()][1]->set_quad_order(0, yitem);
               double* xval = fns[omp_get_thread_num()][0]->get_values(component_x, value_type_x);
               double* yval = fns[omp_get_thread_num()][1]->get_values(component_y, value_type_y);
 
-              for (unsigned int i = 0; i < current_state.e[0]->get_nvert(); i++)
+              ThreadBuffer* buffer = this->get_thread_buffer();
+              for (unsigned int i = 0; i < current_state->e[0]->get_nvert(); i++)
               {
                 double fx = xval[i];
                 double fy = yval[i];
-#pragma omp critical(max)
-                if(fabs(sqrt(fx*fx + fy*fy)) > max)
-                  max = fabs(sqrt(fx*fx + fy*fy));
+                if(fabs(sqrt(fx*fx + fy*fy)) > buffer->max)
+                  buffer->max = fabs(sqrt(fx*fx + fy*fy));
               }
             }
             catch(Hermes::Exceptions::Exception& e)
@@ -661,27 +628,15 @@ namespace Hermes
           }
         }
 
-        trav_masterMax.finish();
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
-          trav[i].finish();
-        delete [] trav;
+        // all the threads start the refinement from the maximum of the first pass
+        this->reduce_thread_max();
+        for(int i = 0; i < num_threads_used; i++)
+          this->thread_buffers[i]->max = this->max;
 
-        Traverse trav_master(true);
-        num_states = trav_master.get_num_states(meshes);
-
-        trav_master.begin(meshes.size(), &(meshes.front()));
-
-        trav = new Traverse[Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads)];
-
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
-        {
-          trav[i].begin(meshes.size(), &(meshes.front()), trfs[i]);
-          trav[i].stack = trav_master.stack;
-        }
-
-#pragma omp parallel shared(trav_master) private(state_i) num_threads(num_threads_used)
+#pragma omp parallel shared(states) private(state_i) num_threads(num_threads_used)
         {
-#pragma omp for schedule(static, CHUNKSIZE)
+          this->apply_thread_affinity();
+#pragma omp for schedule(dynamic, CHUNKSIZE)
           for(state_i = 0; state_i < num_states; state_i++)
           {
             if(this->caughtException != NULL)
@@ -689,20 +644,15 @@ namespace Hermes
 
             try
             {
-              Traverse::State current_state;
-
-#pragma omp critical (get_next_state)
-              current_state = trav[omp_get_thread_num()].get_next_state(&trav_master.top, &trav_master.id);
+              Traverse::State* current_state = states[state_i];
+              Traverse::set_state_to_fns(current_state, trfs[omp_get_thread_num()]);
 
               fns[omp_get_thread_num()][0]->set_quad_order(0, xitem);
               fns[omp_get_thread_num()][1]->set_quad_order(0, yitem);
               double* xval = fns[omp_get_thread_num()][0]->get_values(component_x, value_type_x);
               double* yval = fns[omp_get_thread_num()][1]->get_values(component_y, value_type_y);
               if(xval == NULL || yval == NULL)
-              {
-                delete [] trav;
                 throw Hermes::Exceptions::Exception("Item not defined in the solution in Linearizer::process_solution.");
-              }
 
               if(xdisp != NULL)
                 fns[omp_get_thread_num()][2]->set_quad_order(0, H2D_FN_VAL);
@@ -717,7 +667,7 @@ namespace Hermes
                 dy = fns[omp_get_thread_num()][xdisp == NULL ? 2 : 3]->get_fn_values();
 
               int iv[H2D_MAX_NUMBER_VERTICES];
-              for (unsigned int i = 0; i < current_state.e[0]->get_nvert(); i++)
+              for (unsigned int i = 0; i < current_state->e[0]->get_nvert(); i++)
               {
                 double fx = xval[i];
                 double fy = yval[i];
@@ -736,13 +686,14 @@ namespace Hermes
               }
 
               // recur to sub-elements
-              if(current_state.e[0]->is_triangle())
-                process_triangle(fns[omp_get_thread_num()], iv[0], iv[1], iv[2], 0, NULL, NULL, NULL, NULL, NULL, current_state.e[0]->is_curved());
+              if(current_state->e[0]->is_triangle())
+                process_triangle(fns[omp_get_thread_num()], iv[0], iv[1], iv[2], 0, NULL, NULL, NULL, NULL, NULL, current_state->e[0]->is_curved());
               else
-                process_quad(fns[omp_get_thread_num()], iv[0], iv[1], iv[2], iv[3], 0, NULL, NULL, NULL, NULL, NULL, current_state.e[0]->is_curved());
+                process_quad(fns[omp_get_thread_num()], iv[0], iv[1], iv[2], iv[3], 0, NULL, NULL, NULL, NULL, NULL, current_state->e[0]->is_curved());
 
-              for (unsigned int i = 0; i < current_state.e[0]->get_nvert(); i++)
-                process_edge(iv[i], iv[current_state.e[0]->next_vert(i)], current_state.e[0]->en[i]->marker);
+              // the edges are split at the mid-edge vertices of both the neighbors after the merge
+              for (unsigned int i = 0; i < current_state->e[0]->get_nvert(); i++)
+                this->get_thread_buffer()->add_edge(iv[i], iv[current_state->e[0]->next_vert(i)], current_state->e[0]->en[i]->marker);
             }
             catch(Hermes::Exceptions::Exception& e)
             {
@@ -757,10 +708,8 @@ namespace Hermes
           }
         }
 
-        trav_master.finish();
-        for(unsigned int i = 0; i < Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads); i++)
+        for(unsigned int i = 0; i < this->get_num_threads(); i++)
         {
-          trav[i].finish();
           for(unsigned int j = 0; j < (2 + (xdisp != NULL? 1 : 0) + (ydisp != NULL ? 1 : 0)); j++)
             delete fns[i][j];
           delete [] fns[i];
@@ -768,7 +717,19 @@ namespace Hermes
         }
         delete [] fns;
         delete [] trfs;
-        delete [] trav;
+
+        if(this->caughtException != NULL)
+        {
+          this->free_thread_buffers();
+          this->unlock_data();
+          throw *(this->caughtException);
+        }
+
+        // merge the thread buffers, the vertices are identified by their parents only
+        this->reduce_thread_max();
+        ::free(this->verts);
+        this->verts = (double4*) this->merge_thread_buffers(4, false);
+        this->free_thread_buffers();
 
         // regularize the linear mesh
         for (int i = 0; i < this->triangle_count; i++)
@@ -850,19 +811,6 @@ namespace Hermes
         return this->vertex_count;
       }
 
-      int Vectorizer::add_vertex()
-      {
-        if(this->vertex_count >= this->vertex_size)
-        {
-          this->vertex_size *= 2;
-          verts = (double4*) realloc(verts, sizeof(double4) * vertex_size);
-          this->info = (int4*) realloc(info, sizeof(int4) * vertex_size);
-          this->hash_table = (int*) realloc(hash_table, sizeof(int) * vertex_size);
-          memset(this->hash_table + this->vertex_size / 2, 0xff, sizeof(int) * this->vertex_size / 2);
-        }
-        return this->vertex_count++;
-      }
-
       void Vectorizer::add_dash(int iv1, int iv2)
       {
         if(this->dashes_count >= this->dashes_size)
@@ -0,0 +1,452 @@
+// This file is part of Hermes2D.
+//
+// Hermes2D is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "vtk_writer.h"
+#include "api2d.h"
+
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
+namespace Hermes
+{
+  namespace Hermes2D
+  {
+    namespace Views
+    {
+      /// Size of the blocks the arrays are compressed in, the blocks are compressed in parallel.
+      static const size_t VTK_COMPRESSION_BLOCK_SIZE = 1 << 20;
+
+      static bool host_is_little_endian()
+      {
+        const unsigned short one = 1;
+        return *((const unsigned char*)&one) == 1;
+      }
+
+      /// Writes count items of item_size bytes in the big-endian byte order of the legacy binary format.
+      static void write_big_endian(FILE* f, const void* data, size_t item_size, size_t count)
+      {
+        if(count == 0)
+          return;
+        if(!host_is_little_endian())
+        {
+          fwrite(data, item_size, count, f);
+          return;
+        }
+        std::vector<char> swapped(item_size * count);
+        const char* bytes = (const char*)data;
+        for(size_t i = 0; i < count; i++)
+          for(size_t j = 0; j < item_size; j++)
+            swapped[i * item_size + j] = bytes[i * item_size + item_size - 1 - j];
+        fwrite(&swapped[0], item_size, count, f);
+      }
+
+      VTKWriter::VTKWriter(int num_points, const double* points, int point_stride, bool use_z, int num_cells, const int* cells, int cell_size) :
+        num_points(num_points), points(points), point_stride(point_stride), use_z(use_z), num_cells(num_cells), cells(cells), cell_size(cell_size)
+      {
+        if(cell_size != 2 && cell_size != 3)
+          throw Exceptions::ValueException("cell_size", cell_size, 2, 3);
+      }
+
+      void VTKWriter::add_point_data(const char* name, const double* values, int stride)
+      {
+        DataArray array;
+        array.name = name;
+        array.values = values;
+        array.stride = stride;
+        array.int_values = NULL;
+        this->point_data.push_back(array);
+      }
+
+      void VTKWriter::add_cell_data(const char* name, const int* values)
+      {
+        DataArray array;
+        array.name = name;
+        array.values = NULL;
+        array.stride = 1;
+        array.int_values = values;
+        this->cell_data.push_back(array);
+      }
+
+      unsigned char VTKWriter::get_cell_type() const
+      {
+        // VTK_LINE and VTK_TRIANGLE.
+        return this->cell_size == 2 ? 3 : 5;
+      }
+
+      void VTKWriter::save(const char* filename, VTKFormat format)
+      {
+        if(format == HERMES_VTK_ASCII || format == HERMES_VTK_BINARY)
+        {
+          this->save_legacy(filename, format == HERMES_VTK_BINARY);
+          return;
+        }
+
+        bool compress = (format == HERMES_VTU_COMPRESSED);
+#ifndef WITH_ZLIB
+        if(compress)
+        {
+          this->warn("VTKWriter::save(): Hermes was built without WITH_ZLIB, the file will not be compressed.");
+          compress = false;
+        }
+#endif
+        Piece piece;
+        this->build_piece(0, this->num_cells, piece);
+        this->save_vtu(filename, piece, compress);
+      }
+
+      void VTKWriter::save_parallel(const char* filename, int num_parts, VTKFormat format)
+      {
+        if(format != HERMES_VTU_RAW && format != HERMES_VTU_COMPRESSED)
+          throw Exceptions::Exception("VTKWriter::save_parallel(): the parallel output requires one of the VTU formats.");
+        if(num_parts < 1)
+          throw Exceptions::ValueException("num_parts", num_parts, 1);
+
+        bool compress = (format == HERMES_VTU_COMPRESSED);
+#ifndef WITH_ZLIB
+        if(compress)
+        {
+          this->warn("VTKWriter::save_parallel(): Hermes was built without WITH_ZLIB, the files will not be compressed.");
+          compress = false;
+        }
+#endif
+
+        // The pieces are named after the .pvtu file without its extension.
+        std::string base(filename);
+        std::string::size_type dot = base.find_last_of('.');
+        std::string::size_type slash = base.find_last_of("/\\");
+        if(dot != std::string::npos && (slash == std::string::npos || dot > slash))
+          base = base.substr(0, dot);
+        std::string base_name = (slash == std::string::npos) ? base : base.substr(slash + 1);
+
+        std::vector<std::string> piece_names(num_parts);
+        for(int part_i = 0; part_i < num_parts; part_i++)
+        {
+          char suffix[32];
+          sprintf(suffix, "_%d.vtu", part_i);
+          piece_names[part_i] = base_name + suffix;
+        }
+
+        Hermes::Exceptions::Exception* caughtException = NULL;
+        int part_i;
+#pragma omp parallel for private(part_i) schedule(dynamic, 1) num_threads(Hermes2DApi.get_integral_param_value(Hermes::Hermes2D::numThreads))
+        for(part_i = 0; part_i < num_parts; part_i++)
+        {
+          try
+          {
+            Piece piece;
+            this->build_piece((int)((long long)this->num_cells * part_i / num_parts), (int)((long long)this->num_cells * (part_i + 1) / num_parts), piece);
+            char suffix[32];
+            sprintf(suffix, "_%d.vtu", part_i);
+            this->save_vtu((base + suffix).c_str(), piece, compress);
+          }
+          catch(Hermes::Exceptions::Exception& e)
+          {
+#pragma omp critical(vtk_exception)
+            if(caughtException == NULL)
+              caughtException = e.clone();
+          }
+        }
+        if(caughtException != NULL)
+        {
+          Hermes::Exceptions::Exception e(*caughtException);
+          delete caughtException;
+          throw e;
+        }
+
+        FILE* f = fopen(filename, "wb");
+        if(f == NULL)
+          throw Hermes::Exceptions::Exception("Could not open %s for writing.", filename);
+        fprintf(f, "<?xml version=\"1.0\"?>\n");
+        fprintf(f, "<VTKFile type=\"PUnstructuredGrid\" version=\"0.1\" byte_order=\"%s\" header_type=\"UInt64\"%s>\n",
+          host_is_little_endian() ? "LittleEndian" : "BigEndian", compress ? " compressor=\"vtkZLibDataCompressor\"" : "");
+        fprintf(f, "  <PUnstructuredGrid GhostLevel=\"0\">\n");
+        if(!this->point_data.empty())
+        {
+          fprintf(f, "    <PPointData Scalars=\"%s\">\n", this->point_data[0].name.c_str());
+          for(unsigned int i = 0; i < this->point_data.size(); i++)
+            fprintf(f, "      <PDataArray type=\"Float32\" Name=\"%s\"/>\n", this->point_data[i].name.c_str());
+          fprintf(f, "    </PPointData>\n");
+        }
+        if(!this->cell_data.empty())
+        {
+          fprintf(f, "    <PCellData Scalars=\"%s\">\n", this->cell_data[0].name.c_str());
+          for(unsigned int i = 0; i < this->cell_data.size(); i++)
+            fprintf(f, "      <PDataArray type=\"Float32\" Name=\"%s\"/>\n", this->cell_data[i].name.c_str());
+          fprintf(f, "    </PCellData>\n");
+        }
+        fprintf(f, "    <PPoints>\n      <PDataArray type=\"Float32\" NumberOfComponents=\"3\"/>\n    </PPoints>\n");
+        for(int i = 0; i < num_parts; i++)
+          fprintf(f, "    <Piece Source=\"%s\"/>\n", piece_names[i].c_str());
+        fprintf(f, "  </PUnstructuredGrid>\n</VTKFile>\n");
+        fclose(f);
+      }
+
+      void VTKWriter::build_piece(int first_cell, int last_cell, Piece& piece) const
+      {
+        // The points used by the cells of the piece, in the order of their first use.
+        std::vector<int> point_map(this->num_points, -1);
+        std::vector<int> piece_points;
+        piece.connectivity.reserve((last_cell - first_cell) * this->cell_size);
+        for(int cell_i = first_cell; cell_i < last_cell; cell_i++)
+          for(int k = 0; k < this->cell_size; k++)
+          {
+            int point = this->cells[cell_i * this->cell_size + k];
+            if(point_map[point] < 0)
+            {
+              point_map[point] = piece_points.size();
+              piece_points.push_back(point);
+            }
+            piece.connectivity.push_back(point_map[point]);
+          }
+
+        int num_piece_points = piece_points.size();
+        piece.points.resize(3 * num_piece_points);
+        for(int i = 0; i < num_piece_points; i++)
+        {
+          const double* point = this->points + piece_points[i] * this->point_stride;
+          piece.points[3 * i] = (float)point[0];
+          piece.points[3 * i + 1] = (float)point[1];
+          piece.points[3 * i + 2] = this->use_z ? (float)point[2] : 0.0f;
+        }
+
+        piece.offsets.resize(last_cell - first_cell);
+        for(int i = 0; i < last_cell - first_cell; i++)
+          piece.offsets[i] = (i + 1) * this->cell_size;
+        piece.types.assign(last_cell - first_cell, this->get_cell_type());
+
+        piece.point_data.resize(this->point_data.size());
+        for(unsigned int array_i = 0; array_i < this->point_data.size(); array_i++)
+        {
+          piece.point_data[array_i].resize(num_piece_points);
+          for(int i = 0; i < num_piece_points; i++)
+            piece.point_data[array_i][i] = (float)this->point_data[array_i].values[piece_points[i] * this->point_data[array_i].stride];
+        }
+
+        piece.cell_data.resize(this->cell_data.size());
+        for(unsigned int array_i = 0; array_i < this->cell_data.size(); array_i++)
+        {
+          piece.cell_data[array_i].resize(last_cell - first_cell);
+          for(int i = 0; i < last_cell - first_cell; i++)
+            piece.cell_data[array_i][i] = this->cell_data[array_i].int_values == NULL ? 0.0f : (float)this->cell_data[array_i].int_values[first_cell + i];
+        }
+      }
+
+      void VTKWriter::encode_array(const void* data, size_t bytes, bool compress, std::vector<char>& out)
+      {
+        size_t start = out.size();
+#ifdef WITH_ZLIB
+        if(compress)
+        {
+          // Header: number of blocks, block size, size of the last block and the compressed sizes of the blocks.
+          size_t num_blocks = (bytes + VTK_COMPRESSION_BLOCK_SIZE - 1) / VTK_COMPRESSION_BLOCK_SIZE;
+          std::vector<uint64_t> header(3 + num_blocks);
+          header[0] = num_blocks;
+          header[1] = VTK_COMPRESSION_BLOCK_SIZE;
+          header[2] = (num_blocks == 0) ? 0 : bytes - (num_blocks - 1) * VTK_COMPRESSION_BLOCK_SIZE;
+
+          std::vector<std::vector<char> > blocks(num_blocks);
+          int block_i;
+#pragma omp parallel for private(block_i) schedule(dynamic, 1)
+          for(block_i = 0; block_i < (int)num_blocks; block_i++)
+          {
+            size_t block_bytes = (block_i == (int)num_blocks - 1) ? header[2] : VTK_COMPRESSION_BLOCK_SIZE;
+            uLongf compressed_bytes = compressBound(block_bytes);
+            blocks[block_i].resize(compressed_bytes);
+            compress2((Bytef*)&blocks[block_i][0], &compressed_bytes, (const Bytef*)data + block_i * VTK_COMPRESSION_BLOCK_SIZE, block_bytes, Z_DEFAULT_COMPRESSION);
+            blocks[block_i].resize(compressed_bytes);
+          }
+
+          for(size_t i = 0; i < num_blocks; i++)
+            header[3 + i] = blocks[i].size();
+          out.resize(start + header.size() * sizeof(uint64_t));
+          memcpy(&out[start], &header[0], header.size() * sizeof(uint64_t));
+          for(size_t i = 0; i < num_blocks; i++)
+            out.insert(out.end(), blocks[i].begin(), blocks[i].end());
+          return;
+        }
+#endif
+        uint64_t header = bytes;
+        out.resize(start + sizeof(uint64_t) + bytes);
+        memcpy(&out[start], &header, sizeof(uint64_t));
+        if(bytes > 0)
+          memcpy(&out[start + sizeof(uint64_t)], data, bytes);
+      }
+
+      void VTKWriter::save_vtu(const char* filename, const Piece& piece, bool compress) const
+      {
+        int num_piece_points = piece.points.size() / 3;
+        int num_piece_cells = piece.types.size();
+
+        // The appended data, the offsets in the XML are relative to its start.
+        std::vector<char> appended;
+        std::vector<size_t> point_data_offsets, cell_data_offsets;
+        for(unsigned int i = 0; i < piece.point_data.size(); i++)
+        {
+          point_data_offsets.push_back(appended.size());
+          encode_array(piece.point_data[i].empty() ? NULL : &piece.point_data[i][0], piece.point_data[i].size() * sizeof(float), compress, appended);
+        }
+        for(unsigned int i = 0; i < piece.cell_data.size(); i++)
+        {
+          cell_data_offsets.push_back(appended.size());
+          encode_array(piece.cell_data[i].empty() ? NULL : &piece.cell_data[i][0], piece.cell_data[i].size() * sizeof(float), compress, appended);
+        }
+        size_t points_offset = appended.size();
+        encode_array(piece.points.empty() ? NULL : &piece.points[0], piece.points.size() * sizeof(float), compress, appended);
+        size_t connectivity_offset = appended.size();
+        encode_array(piece.connectivity.empty() ? NULL : &piece.connectivity[0], piece.connectivity.size() * sizeof(int), compress, appended);
+        size_t offsets_offset = appended.size();
+        encode_array(piece.offsets.empty() ? NULL : &piece.offsets[0], piece.offsets.size() * sizeof(int), compress, appended);
+        size_t types_offset = appended.size();
+        encode_array(piece.types.empty() ? NULL : &piece.types[0], piece.types.size(), compress, appended);
+
+        FILE* f = fopen(filename, "wb");
+        if(f == NULL)
+          throw Hermes::Exceptions::Exception("Could not open %s for writing.", filename);
+
+        fprintf(f, "<?xml version=\"1.0\"?>\n");
+        fprintf(f, "<VTKFile type=\"UnstructuredGrid\" version=\"0.1\" byte_order=\"%s\" header_type=\"UInt64\"%s>\n",
+          host_is_little_endian() ? "LittleEndian" : "BigEndian", compress ? " compressor=\"vtkZLibDataCompressor\"" : "");
+        fprintf(f, "  <UnstructuredGrid>\n");
+        fprintf(f, "    <Piece NumberOfPoints=\"%d\" NumberOfCells=\"%d\">\n", num_piece_points, num_piece_cells);
+        if(!this->point_data.empty())
+        {
+          fprintf(f, "      <PointData Scalars=\"%s\">\n", this->point_data[0].name.c_str());
+          for(unsigned int i = 0; i < this->point_data.size(); i++)
+            fprintf(f, "        <DataArray type=\"Float32\" Name=\"%s\" format=\"appended\" offset=\"%lu\"/>\n", this->point_data[i].name.c_str(), (unsigned long)point_data_offsets[i]);
+          fprintf(f, "      </PointData>\n");
+        }
+        if(!this->cell_data.empty())
+        {
+          fprintf(f, "      <CellData Scalars=\"%s\">\n", this->cell_data[0].name.c_str());
+          for(unsigned int i = 0; i < this->cell_data.size(); i++)
+            fprintf(f, "        <DataArray type=\"Float32\" Name=\"%s\" format=\"appended\" offset=\"%lu\"/>\n", this->cell_data[i].name.c_str(), (unsigned long)cell_data_offsets[i]);
+          fprintf(f, "      </CellData>\n");
+        }
+        fprintf(f, "      <Points>\n");
+        fprintf(f, "        <DataArray type=\"Float32\" NumberOfComponents=\"3\" format=\"appended\" offset=\"%lu\"/>\n", (unsigned long)points_offset);
+        fprintf(f, "      </Points>\n");
+        fprintf(f, "      <Cells>\n");
+        fprintf(f, "        <DataArray type=\"Int32\" Name=\"connectivity\" format=\"appended\" offset=\"%lu\"/>\n", (unsigned long)connectivity_offset);
+        fprintf(f, "        <DataArray type=\"Int32\" Name=\"offsets\" format=\"appended\" offset=\"%lu\"/>\n", (unsigned long)offsets_offset);
+        fprintf(f, "        <DataArray type=\"UInt8\" Name=\"types\" format=\"appended\" offset=\"%lu\"/>\n", (unsigned long)types_offset);
+        fprintf(f, "      </Cells>\n");
+        fprintf(f, "    </Piece>\n");
+        fprintf(f, "  </UnstructuredGrid>\n");
+        fprintf(f, "  <AppendedData encoding=\"raw\">\n_");
+        if(!appended.empty())
+          fwrite(&appended[0], 1, appended.size(), f);
+        fprintf(f, "\n  </AppendedData>\n</VTKFile>\n");
+        fclose(f);
+      }
+
+      void VTKWriter::save_legacy(const char* filename, bool binary) const
+      {
+        FILE* f = fopen(filename, "wb");
+        if(f == NULL)
+          throw Hermes::Exceptions::Exception("Could not open %s for writing.", filename);
+
+        // Output header for vertices.
+        fprintf(f, "# vtk DataFile Version 2.0\n");
+        fprintf(f, "\n");
+        fprintf(f, binary ? "BINARY\n\n" : "ASCII\n\n");
+        fprintf(f, "DATASET UNSTRUCTURED_GRID\n");
+
+        // Output vertices.
+        fprintf(f, "POINTS %d %s\n", this->num_points, "float");
+        if(binary)
+        {
+          std::vector<float> coords(3 * this->num_points);
+          for (int i = 0; i < this->num_points; i++)
+          {
+            coords[3 * i] = (float)this->points[i * this->point_stride];
+            coords[3 * i + 1] = (float)this->points[i * this->point_stride + 1];
+            coords[3 * i + 2] = this->use_z ? (float)this->points[i * this->point_stride + 2] : 0.0f;
+          }
+          write_big_endian(f, coords.empty() ? NULL : &coords[0], sizeof(float), coords.size());
+        }
+        else
+          for (int i = 0; i < this->num_points; i++)
+            fprintf(f, "%g %g %g\n", this->points[i * this->point_stride], this->points[i * this->point_stride + 1], this->use_z ? this->points[i * this->point_stride + 2] : 0.0);
+
+        // Output elements.
+        fprintf(f, "\n");
+        fprintf(f, "CELLS %d %d\n", this->num_cells, (this->cell_size + 1) * this->num_cells);
+        if(binary)
+        {
+          std::vector<int> cell_list((this->cell_size + 1) * this->num_cells);
+          for (int i = 0; i < this->num_cells; i++)
+          {
+            cell_list[i * (this->cell_size + 1)] = this->cell_size;
+            for(int k = 0; k < this->cell_size; k++)
+              cell_list[i * (this->cell_size + 1) + 1 + k] = this->cells[i * this->cell_size + k];
+          }
+          write_big_endian(f, cell_list.empty() ? NULL : &cell_list[0], sizeof(int), cell_list.size());
+        }
+        else
+          for (int i = 0; i < this->num_cells; i++)
+          {
+            fprintf(f, "%d", this->cell_size);
+            for(int k = 0; k < this->cell_size; k++)
+              fprintf(f, " %d", this->cells[i * this->cell_size + k]);
+            fprintf(f, "\n");
+          }
+
+        // Output cell types.
+        fprintf(f, "\n");
+        fprintf(f, "CELL_TYPES %d\n", this->num_cells);
+        if(binary)
+        {
+          std::vector<int> types(this->num_cells, this->get_cell_type());
+          write_big_endian(f, types.empty() ? NULL : &types[0], sizeof(int), types.size());
+        }
+        else
+          for (int i = 0; i < this->num_cells; i++)
+            fprintf(f, "%d\n", this->get_cell_type());
+
+        // Output the data.
+        for(int data_i = 0; data_i < 2; data_i++)
+        {
+          const std::vector<DataArray>& arrays = (data_i == 0) ? this->point_data : this->cell_data;
+          int count = (data_i == 0) ? this->num_points : this->num_cells;
+          if(arrays.empty())
+            continue;
+          fprintf(f, "\n");
+          fprintf(f, "%s %d\n", data_i == 0 ? "POINT_DATA" : "CELL_DATA", count);
+          for(unsigned int array_i = 0; array_i < arrays.size(); array_i++)
+          {
+            const DataArray& array = arrays[array_i];
+            fprintf(f, "SCALARS %s %s %d\n", array.name.c_str(), "float", 1);
+            fprintf(f, "LOOKUP_TABLE %s\n", "default");
+            std::vector<double> values(count);
+            for (int i = 0; i < count; i++)
+              values[i] = (array.values != NULL) ? array.values[i * array.stride] : (array.int_values != NULL ? array.int_values[i] : 0.0);
+            if(binary)
+            {
+              std::vector<float> float_values(values.begin(), values.end());
+              write_big_endian(f, float_values.empty() ? NULL : &float_values[0], sizeof(float), float_values.size());
+              fprintf(f, "\n");
+            }
+            else
+              for (int i = 0; i < count; i++)
+                fprintf(f, "%g\n", values[i]);
+          }
+        }
+
+        fclose(f);
+      }
+    }
+  }
+}
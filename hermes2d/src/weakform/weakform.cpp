@@ -18,6 +18,9 @@
 #include "weakform.h"
 #include "matrix.h"
 #include "forms.h"
+#include <map>
+#include <set>
+#include <algorithm>
 #include "shapeset_l2_all.h"
 #include "shapeset_hc_all.h"
 #include "shapeset_hd_all.h"
@@ -43,11 +46,15 @@ namespace Hermes
     template<typename Scalar>
     void WeakForm<Scalar>::free_ext()
     {
+      // The forms may share the functions (cloneMembers()).
+      std::set<MeshFunction<Scalar>*> deleted;
       for(unsigned int i = 0; i < this->ext.size(); i++)
-        delete this->ext[i];
+        if(deleted.insert(this->ext[i]).second)
+          delete this->ext[i];
       for(unsigned int i = 0; i < this->forms.size(); i++)
         for(unsigned int j = 0; j < get_forms()[i]->ext.size(); j++)
-          delete get_forms()[i]->ext[j];
+          if(deleted.insert(get_forms()[i]->ext[j]).second)
+            delete get_forms()[i]->ext[j];
     }
 
     template<typename Scalar>
@@ -101,6 +108,20 @@ namespace Hermes
       this->forms.clear();
       this->ext.clear();
 
+      // Each distinct function is cloned once, the forms sharing a function share its clone,
+      // so that DiscreteProblem evaluates it once per element for all of them.
+      std::map<MeshFunction<Scalar>*, MeshFunction<Scalar>*> ext_clones;
+      for(unsigned int i = 0; i < otherWf->ext.size(); i++)
+      {
+        if(ext_clones.find(otherWf->ext[i]) == ext_clones.end())
+        {
+          ext_clones[otherWf->ext[i]] = otherWf->ext[i]->clone();
+          if(dynamic_cast<Solution<Scalar>*>(otherWf->ext[i]) != NULL)
+            dynamic_cast<Solution<Scalar>*>(ext_clones[otherWf->ext[i]])->set_type(dynamic_cast<Solution<Scalar>*>(otherWf->ext[i])->get_type());
+        }
+        this->ext.push_back(ext_clones[otherWf->ext[i]]);
+      }
+
       for(unsigned int i = 0; i < otherWf->forms.size(); i++)
       {
         if(dynamic_cast<MatrixFormVol<Scalar>*>(otherWf->forms[i]) != NULL)
@@ -119,9 +140,21 @@ namespace Hermes
 
         Hermes::vector<MeshFunction<Scalar>*> newExt;
         for(unsigned int ext_i = 0; ext_i < otherWf->forms[i]->ext.size(); ext_i++)
-          newExt.push_back(otherWf->forms[i]->ext[ext_i]->clone());
+        {
+          MeshFunction<Scalar>* form_ext = otherWf->forms[i]->ext[ext_i];
+          if(form_ext == NULL)
+          {
+            newExt.push_back(NULL);
+            continue;
+          }
+          if(ext_clones.find(form_ext) == ext_clones.end())
+            ext_clones[form_ext] = form_ext->clone();
+          newExt.push_back(ext_clones[form_ext]);
+        }
         this->forms.back()->set_ext(newExt);
         this->forms.back()->wf = this;
+        this->forms.back()->affine_term = otherWf->forms[i]->affine_term;
+        this->forms.back()->position = i;
 
         if(dynamic_cast<MatrixFormVol<Scalar>*>(otherWf->forms[i]) != NULL)
           this->mfvol.push_back(dynamic_cast<MatrixFormVol<Scalar>*>(this->forms.back()));
@@ -137,14 +170,6 @@ namespace Hermes
         if(dynamic_cast<VectorFormDG<Scalar>*>(otherWf->forms[i]) != NULL)
           this->vfDG.push_back(dynamic_cast<VectorFormDG<Scalar>*>(this->forms.back()));
       }
-      for(unsigned int i = 0; i < otherWf->ext.size(); i++)
-      {
-        this->ext.push_back(otherWf->ext[i]->clone());
-        if(dynamic_cast<Solution<Scalar>*>(otherWf->ext[i]) != NULL)
-        {
-          dynamic_cast<Solution<Scalar>*>(this->ext.back())->set_type(dynamic_cast<Solution<Scalar>*>(otherWf->ext[i])->get_type());
-        }
-      }
     }
 
     template<typename Scalar>
@@ -179,7 +204,9 @@ namespace Hermes
     }
 
     template<typename Scalar>
-    Form<Scalar>::Form() : scaling_factor(1.0), u_ext_offset(0), wf(NULL)
+    Form<Scalar>::Form() : scaling_factor(1.0), u_ext_offset(0), wf(NULL),
+      u_demand(H2D_DEMAND_DEFAULT), v_demand(H2D_DEMAND_DEFAULT), u_ext_demand(H2D_DEMAND_DEFAULT), ext_demand(H2D_DEMAND_DEFAULT),
+      affine_term(H2D_AFFINE_CONSTANT_TERM), position(-1)
     {
       areas.push_back(HERMES_ANY);
       stage_time = 0.0;
@@ -226,6 +253,29 @@ namespace Hermes
       this->scaling_factor = scalingFactor;
     }
 
+    template<typename Scalar>
+    void Form<Scalar>::set_demand(unsigned int u_demand, unsigned int v_demand, unsigned int u_ext_demand, unsigned int ext_demand)
+    {
+      this->u_demand = u_demand;
+      this->v_demand = v_demand;
+      this->u_ext_demand = u_ext_demand;
+      this->ext_demand = ext_demand;
+    }
+
+    template<typename Scalar>
+    void Form<Scalar>::set_affine_term(int q)
+    {
+      if(q < H2D_AFFINE_CONSTANT_TERM)
+        throw Exceptions::ValueException("q", q, H2D_AFFINE_CONSTANT_TERM);
+      this->affine_term = q;
+    }
+
+    template<typename Scalar>
+    int Form<Scalar>::get_affine_term() const
+    {
+      return this->affine_term;
+    }
+
     template<typename Scalar>
     void Form<Scalar>::set_uExtOffset(int u_ext_offset)
     {
@@ -278,6 +328,13 @@ namespace Hermes
       return Hermes::Ord();
     }
 
+    template<typename Scalar>
+    bool MatrixForm<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+      Geom<double> *e, Func<Scalar> **ext, Scalar **result) const
+    {
+      return false;
+    }
+
     template<typename Scalar>
     MatrixFormVol<Scalar>::MatrixFormVol(unsigned int i, unsigned int j) :
     MatrixForm<Scalar>(i, j)
@@ -308,6 +365,12 @@ namespace Hermes
       return NULL;
     }
 
+    template<typename Scalar>
+    bool MatrixFormVol<Scalar>::get_constant_coefficients(Scalar& mass, Scalar& diffusion, Scalar& convection_x, Scalar& convection_y) const
+    {
+      return false;
+    }
+
     template<typename Scalar>
     MatrixFormSurf<Scalar>::MatrixFormSurf(unsigned int i, unsigned int j) :
     MatrixForm<Scalar>(i, j)
@@ -399,6 +462,13 @@ namespace Hermes
       return Hermes::Ord();
     }
 
+    template<typename Scalar>
+    bool VectorForm<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+      Geom<double> *e, Func<Scalar> **ext, Scalar *result) const
+    {
+      return false;
+    }
+
     template<typename Scalar>
     VectorFormVol<Scalar>* VectorFormVol<Scalar>::clone() const
     {
@@ -475,6 +545,7 @@ namespace Hermes
 
       form->set_weakform(this);
       mfvol.push_back(form);
+      form->position = forms.size();
       forms.push_back(form);
     }
 
@@ -486,6 +557,7 @@ namespace Hermes
 
       form->set_weakform(this);
       mfsurf.push_back(form);
+      form->position = forms.size();
       forms.push_back(form);
     }
 
@@ -497,6 +569,7 @@ namespace Hermes
 
       form->set_weakform(this);
       mfDG.push_back(form);
+      form->position = forms.size();
       forms.push_back(form);
     }
 
@@ -507,6 +580,7 @@ namespace Hermes
         throw Hermes::Exceptions::Exception("Invalid equation number.");
       form->set_weakform(this);
       vfvol.push_back(form);
+      form->position = forms.size();
       forms.push_back(form);
     }
 
@@ -518,6 +592,7 @@ namespace Hermes
 
       form->set_weakform(this);
       vfsurf.push_back(form);
+      form->position = forms.size();
       forms.push_back(form);
     }
 
@@ -529,9 +604,19 @@ namespace Hermes
 
       form->set_weakform(this);
       vfDG.push_back(form);
+      form->position = forms.size();
       forms.push_back(form);
     }
 
+    template<typename Scalar>
+    int WeakForm<Scalar>::get_num_affine_terms() const
+    {
+      int num_terms = 0;
+      for(unsigned int i = 0; i < this->forms.size(); i++)
+        num_terms = std::max(num_terms, this->forms[i]->affine_term + 1);
+      return num_terms;
+    }
+
     template<typename Scalar>
     Hermes::vector<Form<Scalar> *> WeakForm<Scalar>::get_forms() const
     {
@@ -21,6 +21,59 @@ namespace Hermes
   {
     namespace WeakFormsElasticity
     {
+      /// result[i][j] = sum_k wt[k] (c_xx du_j/dx dv_i/dx + c_yx du_j/dy dv_i/dx + c_xy du_j/dx dv_i/dy + c_yy du_j/dy dv_i/dy).
+      /// The weighted combinations of the derivatives of each test function are formed once, for the same functions
+      /// with a symmetric tensor (the diagonal blocks) only the upper triangle is computed.
+      template<typename Scalar>
+      static void elasticity_block(int n, double *wt, Func<double> **u, int u_count, Func<double> **v, int v_count,
+        double c_xx, double c_yx, double c_xy, double c_yy, Scalar **result)
+      {
+        bool symmetric = (u == v) && (u_count == v_count) && (c_yx == c_xy);
+        double* weighted_x = new double[2 * n];
+        double* weighted_y = weighted_x + n;
+        for (int i = 0; i < v_count; i++)
+        {
+          for (int k = 0; k < n; k++)
+          {
+            weighted_x[k] = wt[k] * (c_xx * v[i]->dx[k] + c_xy * v[i]->dy[k]);
+            weighted_y[k] = wt[k] * (c_yx * v[i]->dx[k] + c_yy * v[i]->dy[k]);
+          }
+          for (int j = symmetric ? i : 0; j < u_count; j++)
+          {
+            double sum = 0.0;
+            for (int k = 0; k < n; k++)
+              sum += weighted_x[k] * u[j]->dx[k] + weighted_y[k] * u[j]->dy[k];
+            result[i][j] = sum;
+            if(symmetric)
+              result[j][i] = sum;
+          }
+        }
+        delete [] weighted_x;
+      }
+
+      /// result[i] = sum_k wt[k] (c_xx du/dx dv_i/dx + c_yx du/dy dv_i/dx + c_xy du/dx dv_i/dy + c_yy du/dy dv_i/dy)
+      /// with the weights of the derivatives of the test functions formed once.
+      template<typename Scalar>
+      static void elasticity_residual_block(int n, double *wt, Func<Scalar> *u, Func<double> **v, int v_count,
+        double c_xx, double c_yx, double c_xy, double c_yy, Scalar *result)
+      {
+        Scalar* weighted_x = new Scalar[2 * n];
+        Scalar* weighted_y = weighted_x + n;
+        for (int k = 0; k < n; k++)
+        {
+          weighted_x[k] = wt[k] * (c_xx * u->dx[k] + c_yx * u->dy[k]);
+          weighted_y[k] = wt[k] * (c_xy * u->dx[k] + c_yy * u->dy[k]);
+        }
+        for (int i = 0; i < v_count; i++)
+        {
+          Scalar sum = 0.0;
+          for (int k = 0; k < n; k++)
+            sum += weighted_x[k] * v[i]->dx[k] + weighted_y[k] * v[i]->dy[k];
+          result[i] = sum;
+        }
+        delete [] weighted_x;
+      }
+
       template<typename Scalar>
       DefaultJacobianElasticity_0_0<Scalar>::DefaultJacobianElasticity_0_0
         (unsigned int i, unsigned int j, double lambda, double mu)
@@ -54,6 +107,14 @@ namespace Hermes
           mu * int_dudy_dvdy<Ord, Ord>(n, wt, u, v);
       }
 
+      template<typename Scalar>
+      bool DefaultJacobianElasticity_0_0<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar **result) const
+      {
+        elasticity_block(n, wt, u, u_count, v, v_count, lambda + 2*mu, 0.0, 0.0, mu, result);
+        return true;
+      }
+
       template<typename Scalar>
       MatrixFormVol<Scalar>* DefaultJacobianElasticity_0_0<Scalar>::clone() const
       {
@@ -93,6 +154,14 @@ namespace Hermes
           mu * int_dudx_dvdy<Ord, Ord>(n, wt, u, v);
       }
 
+      template<typename Scalar>
+      bool DefaultJacobianElasticity_0_1<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar **result) const
+      {
+        elasticity_block(n, wt, u, u_count, v, v_count, 0.0, lambda, mu, 0.0, result);
+        return true;
+      }
+
       template<typename Scalar>
       MatrixFormVol<Scalar>* DefaultJacobianElasticity_0_1<Scalar>::clone() const
       {
@@ -130,6 +199,14 @@ namespace Hermes
           mu * int_dudy_dvdy<Ord, Ord>(n, wt, u_ext[0], v);
       }
 
+      template<typename Scalar>
+      bool DefaultResidualElasticity_0_0<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar *result) const
+      {
+        elasticity_residual_block(n, wt, u_ext[0], v, v_count, 2*mu + lambda, 0.0, 0.0, mu, result);
+        return true;
+      }
+
       template<typename Scalar>
       VectorFormVol<Scalar>* DefaultResidualElasticity_0_0<Scalar>::clone() const
       {
@@ -167,6 +244,14 @@ namespace Hermes
           mu * int_dudx_dvdy<Ord, Ord>(n, wt, u_ext[1], v);
       }
 
+      template<typename Scalar>
+      bool DefaultResidualElasticity_0_1<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar *result) const
+      {
+        elasticity_residual_block(n, wt, u_ext[1], v, v_count, 0.0, lambda, mu, 0.0, result);
+        return true;
+      }
+
       template<typename Scalar>
       VectorFormVol<Scalar>* DefaultResidualElasticity_0_1<Scalar>::clone() const
       {
@@ -204,6 +289,14 @@ namespace Hermes
           lambda * int_dudx_dvdy<Ord, Ord>(n, wt, u_ext[0], v);
       }
 
+      template<typename Scalar>
+      bool DefaultResidualElasticity_1_0<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar *result) const
+      {
+        elasticity_residual_block(n, wt, u_ext[0], v, v_count, 0.0, mu, lambda, 0.0, result);
+        return true;
+      }
+
       template<typename Scalar>
       VectorFormVol<Scalar>* DefaultResidualElasticity_1_0<Scalar>::clone() const
       {
@@ -241,6 +334,14 @@ namespace Hermes
           mu * int_dudx_dvdx<Ord, Ord>(n, wt, u_ext[1], v);
       }
 
+      template<typename Scalar>
+      bool DefaultResidualElasticity_1_1<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar *result) const
+      {
+        elasticity_residual_block(n, wt, u_ext[1], v, v_count, mu, 0.0, 0.0, 2*mu + lambda, result);
+        return true;
+      }
+
       template<typename Scalar>
       VectorFormVol<Scalar>* DefaultResidualElasticity_1_1<Scalar>::clone() const
       {
@@ -252,6 +353,7 @@ namespace Hermes
         (unsigned int i, unsigned int j, double lambda, double mu)
         : MatrixFormVol<Scalar>(i, j), lambda(lambda), mu(mu)
       {
+        this->setSymFlag(HERMES_SYM);
       }
 
       template<typename Scalar>
@@ -259,6 +361,7 @@ namespace Hermes
         (unsigned int i, unsigned int j, std::string area, double lambda, double mu)
         : MatrixFormVol<Scalar>(i, j), lambda(lambda), mu(mu)
       {
+        this->setSymFlag(HERMES_SYM);
         this->set_area(area);
       }
 
@@ -278,6 +381,14 @@ namespace Hermes
           (lambda + 2*mu) * int_dudy_dvdy<Ord, Ord>(n, wt, u, v);
       }
 
+      template<typename Scalar>
+      bool DefaultJacobianElasticity_1_1<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar **result) const
+      {
+        elasticity_block(n, wt, u, u_count, v, v_count, mu, 0.0, 0.0, lambda + 2*mu, result);
+        return true;
+      }
+
       template<typename Scalar>
       MatrixFormVol<Scalar>* DefaultJacobianElasticity_1_1<Scalar>::clone() const
       {
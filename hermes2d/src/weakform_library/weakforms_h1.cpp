@@ -21,6 +21,83 @@ namespace Hermes
   {
     namespace WeakFormsH1
     {
+      /// The number of the test / basis functions up to which the tables of the block kernels are on the stack.
+      static const int H2D_BLOCK_STACK_FUNCTIONS = 128;
+
+      /// Scratch array of the block kernels (value_block()), on the stack if it has at most stack_size items,
+      /// allocated otherwise (e.g. for the triangle rules loaded from a file, which may have more points).
+      template<typename T, int stack_size>
+      class ScratchArray
+      {
+      public:
+        ScratchArray(int size) : data(size <= stack_size ? stack : new T[size]) {}
+        ~ScratchArray() { if(data != stack) delete [] data; }
+        operator T*() { return data; }
+      private:
+        T stack[stack_size];
+        T* data;
+      };
+
+      /// Multiplies the quadrature weights by the geometric factor of the axisymmetric formulations.
+      static void geometry_weights(int n, double *wt, Geom<double> *e, GeomType gt, double* result)
+      {
+        if(gt == HERMES_PLANAR)
+          for (int i = 0; i < n; i++)
+            result[i] = wt[i];
+        else if(gt == HERMES_AXISYM_X)
+          for (int i = 0; i < n; i++)
+            result[i] = wt[i] * e->y[i];
+        else
+          for (int i = 0; i < n; i++)
+            result[i] = wt[i] * e->x[i];
+      }
+
+      /// Adds (test_values) * diag(weights) * (basis_values)^T to result.
+      /// Each row of the test / basis tables holds the values of one function in the quadrature points,
+      /// the weighted test row is formed once and then used in unit-stride dot products that the compiler vectorizes.
+      template<typename Scalar>
+      static void add_weighted_block(int n, Scalar* weights, double** test_values, int test_count, double** basis_values, int basis_count,
+        Scalar** result, Scalar* weighted_test)
+      {
+        for (int i = 0; i < test_count; i++)
+        {
+          double* test_value = test_values[i];
+          for (int k = 0; k < n; k++)
+            weighted_test[k] = weights[k] * test_value[k];
+
+          Scalar* result_row = result[i];
+          for (int j = 0; j < basis_count; j++)
+          {
+            double* basis_value = basis_values[j];
+            Scalar sum = 0;
+            for (int k = 0; k < n; k++)
+              sum += weighted_test[k] * basis_value[k];
+            result_row[j] += sum;
+          }
+        }
+      }
+
+      /// Sets result[i] to the weighted sum of the values of the i-th test function in the quadrature points.
+      template<typename Scalar>
+      static void weighted_sums(int n, Scalar* weights, double** test_values, int test_count, Scalar* result)
+      {
+        for (int i = 0; i < test_count; i++)
+        {
+          double* test_value = test_values[i];
+          Scalar sum = 0;
+          for (int k = 0; k < n; k++)
+            sum += weights[k] * test_value[k];
+          result[i] = sum;
+        }
+      }
+
+      template<typename Scalar>
+      static void zero_block(Scalar** result, int test_count, int basis_count)
+      {
+        for (int i = 0; i < test_count; i++)
+          for (int j = 0; j < basis_count; j++)
+            result[i][j] = 0;
+      }
       template<>
       DefaultMatrixFormVol<double>::DefaultMatrixFormVol
         (int i, int j, std::string area, Hermes2DFunction<double>* coeff, SymFlag sym, GeomType gt)
@@ -131,12 +208,51 @@ namespace Hermes
         return result;
       }
 
+      template<typename Scalar>
+      bool DefaultMatrixFormVol<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar **result) const
+      {
+        ScratchArray<double, H2D_MAX_INTEGRATION_POINTS_COUNT> geom_wt_buffer(n);
+        double* geom_wt = geom_wt_buffer;
+        geometry_weights(n, wt, e, gt, geom_wt);
+        ScratchArray<Scalar, 2 * H2D_MAX_INTEGRATION_POINTS_COUNT> weights_buffer(2 * n);
+        Scalar* weights = weights_buffer;
+        coeff->value_batch(n, e->x, e->y, weights);
+        for (int i = 0; i < n; i++)
+          weights[i] *= geom_wt[i];
+
+        ScratchArray<double*, H2D_BLOCK_STACK_FUNCTIONS> test_values_buffer(v_count);
+        double** test_values = test_values_buffer;
+        for (int i = 0; i < v_count; i++)
+          test_values[i] = v[i]->val;
+        ScratchArray<double*, H2D_BLOCK_STACK_FUNCTIONS> basis_values_buffer(u_count);
+        double** basis_values = basis_values_buffer;
+        for (int j = 0; j < u_count; j++)
+          basis_values[j] = u[j]->val;
+
+        zero_block(result, v_count, u_count);
+        add_weighted_block(n, weights, test_values, v_count, basis_values, u_count, result, weights + n);
+
+        return true;
+      }
+
       template<typename Scalar>
       MatrixFormVol<Scalar>* DefaultMatrixFormVol<Scalar>::clone() const
       {
         return new DefaultMatrixFormVol<Scalar>(*this);
       }
 
+      template<typename Scalar>
+      bool DefaultMatrixFormVol<Scalar>::get_constant_coefficients(Scalar& mass, Scalar& diffusion, Scalar& convection_x, Scalar& convection_y) const
+      {
+        if(gt != HERMES_PLANAR || !coeff->is_constant())
+          return false;
+        mass = coeff->value(0.0, 0.0);
+        diffusion = 0.0;
+        convection_x = convection_y = 0.0;
+        return true;
+      }
+
       template<typename Scalar>
       DefaultJacobianDiffusion<Scalar>::DefaultJacobianDiffusion(int i, int j, std::string area,
         Hermes1DFunction<Scalar>* coeff,
@@ -239,12 +355,82 @@ namespace Hermes
         return result;
       }
 
+      template<typename Scalar>
+      bool DefaultJacobianDiffusion<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar **result) const
+      {
+        ScratchArray<double, H2D_MAX_INTEGRATION_POINTS_COUNT> geom_wt_buffer(n);
+        double* geom_wt = geom_wt_buffer;
+        geometry_weights(n, wt, e, gt, geom_wt);
+
+        // weights: coeff(u_ext), weights_dx / weights_dy: coeff'(u_ext) * grad u_ext, last block: scratch row.
+        // The coefficient is evaluated at all the points at once (value_batch()), weights_dx serves as the buffer of the derivatives.
+        ScratchArray<Scalar, 4 * H2D_MAX_INTEGRATION_POINTS_COUNT> weights_buffer(4 * n);
+        Scalar* weights = weights_buffer;
+        Scalar* weights_dx = weights + n;
+        Scalar* weights_dy = weights + 2 * n;
+        bool constant_coeff = coeff->is_constant();
+        coeff->value_batch(n, u_ext[idx_j]->val, weights);
+        if(!constant_coeff)
+          coeff->derivative_batch(n, u_ext[idx_j]->val, weights_dx);
+        for (int i = 0; i < n; i++)
+        {
+          weights[i] *= geom_wt[i];
+          if(!constant_coeff)
+          {
+            Scalar derivative = geom_wt[i] * weights_dx[i];
+            weights_dx[i] = derivative * u_ext[idx_j]->dx[i];
+            weights_dy[i] = derivative * u_ext[idx_j]->dy[i];
+          }
+        }
+
+        ScratchArray<double*, H2D_BLOCK_STACK_FUNCTIONS> test_values_buffer(v_count);
+        double** test_values = test_values_buffer;
+        ScratchArray<double*, H2D_BLOCK_STACK_FUNCTIONS> basis_values_buffer(u_count);
+        double** basis_values = basis_values_buffer;
+
+        zero_block(result, v_count, u_count);
+
+        for (int i = 0; i < v_count; i++)
+          test_values[i] = v[i]->dx;
+        for (int j = 0; j < u_count; j++)
+          basis_values[j] = u[j]->dx;
+        add_weighted_block(n, weights, test_values, v_count, basis_values, u_count, result, weights + 3 * n);
+        if(!constant_coeff)
+        {
+          for (int j = 0; j < u_count; j++)
+            basis_values[j] = u[j]->val;
+          add_weighted_block(n, weights_dx, test_values, v_count, basis_values, u_count, result, weights + 3 * n);
+        }
+
+        for (int i = 0; i < v_count; i++)
+          test_values[i] = v[i]->dy;
+        if(!constant_coeff)
+          add_weighted_block(n, weights_dy, test_values, v_count, basis_values, u_count, result, weights + 3 * n);
+        for (int j = 0; j < u_count; j++)
+          basis_values[j] = u[j]->dy;
+        add_weighted_block(n, weights, test_values, v_count, basis_values, u_count, result, weights + 3 * n);
+
+        return true;
+      }
+
       template<typename Scalar>
       MatrixFormVol<Scalar>* DefaultJacobianDiffusion<Scalar>::clone() const
       {
         return new DefaultJacobianDiffusion<Scalar>(*this);
       }
 
+      template<typename Scalar>
+      bool DefaultJacobianDiffusion<Scalar>::get_constant_coefficients(Scalar& mass, Scalar& diffusion, Scalar& convection_x, Scalar& convection_y) const
+      {
+        if(gt != HERMES_PLANAR || !coeff->is_constant())
+          return false;
+        mass = 0.0;
+        diffusion = coeff->value(0.0);
+        convection_x = convection_y = 0.0;
+        return true;
+      }
+
       template<typename Scalar>
       DefaultMatrixFormDiffusion<Scalar>::DefaultMatrixFormDiffusion(int i, int j, std::string area,
         Hermes1DFunction<Scalar>* coeff,
@@ -328,12 +514,58 @@ namespace Hermes
         return result;
       }
 
+      template<typename Scalar>
+      bool DefaultMatrixFormDiffusion<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar **result) const
+      {
+        ScratchArray<double, H2D_MAX_INTEGRATION_POINTS_COUNT> geom_wt_buffer(n);
+        double* geom_wt = geom_wt_buffer;
+        geometry_weights(n, wt, e, gt, geom_wt);
+        ScratchArray<Scalar, 2 * H2D_MAX_INTEGRATION_POINTS_COUNT> weights_buffer(2 * n);
+        Scalar* weights = weights_buffer;
+        for (int i = 0; i < n; i++)
+          weights[i] = geom_wt[i];
+
+        ScratchArray<double*, H2D_BLOCK_STACK_FUNCTIONS> test_values_buffer(v_count);
+        double** test_values = test_values_buffer;
+        ScratchArray<double*, H2D_BLOCK_STACK_FUNCTIONS> basis_values_buffer(u_count);
+        double** basis_values = basis_values_buffer;
+
+        zero_block(result, v_count, u_count);
+
+        for (int i = 0; i < v_count; i++)
+          test_values[i] = v[i]->dx;
+        for (int j = 0; j < u_count; j++)
+          basis_values[j] = u[j]->dx;
+        add_weighted_block(n, weights, test_values, v_count, basis_values, u_count, result, weights + n);
+
+        for (int i = 0; i < v_count; i++)
+          test_values[i] = v[i]->dy;
+        for (int j = 0; j < u_count; j++)
+          basis_values[j] = u[j]->dy;
+        add_weighted_block(n, weights, test_values, v_count, basis_values, u_count, result, weights + n);
+
+        return true;
+      }
+
       template<typename Scalar>
       MatrixFormVol<Scalar>* DefaultMatrixFormDiffusion<Scalar>::clone() const
       {
         return new DefaultMatrixFormDiffusion<Scalar>(*this);
       }
 
+      template<typename Scalar>
+      bool DefaultMatrixFormDiffusion<Scalar>::get_constant_coefficients(Scalar& mass, Scalar& diffusion, Scalar& convection_x, Scalar& convection_y) const
+      {
+        // The coefficient is not used by value().
+        if(gt != HERMES_PLANAR)
+          return false;
+        mass = 0.0;
+        diffusion = 1.0;
+        convection_x = convection_y = 0.0;
+        return true;
+      }
+
       template<typename Scalar>
       DefaultJacobianAdvection<Scalar>::DefaultJacobianAdvection(int i, int j, std::string area,
         Hermes1DFunction<Scalar>* coeff1,
@@ -411,6 +643,19 @@ namespace Hermes
         return new DefaultJacobianAdvection<Scalar>(*this);
       }
 
+      template<typename Scalar>
+      bool DefaultJacobianAdvection<Scalar>::get_constant_coefficients(Scalar& mass, Scalar& diffusion, Scalar& convection_x, Scalar& convection_y) const
+      {
+        // With constant coefficients, the derivative terms vanish.
+        if(gt != HERMES_PLANAR || !coeff1->is_constant() || !coeff2->is_constant())
+          return false;
+        mass = 0.0;
+        diffusion = 0.0;
+        convection_x = coeff1->value(0.0);
+        convection_y = coeff2->value(0.0);
+        return true;
+      }
+
       template<typename Scalar>
       DefaultVectorFormVol<Scalar>::DefaultVectorFormVol(int i, std::string area,
         Hermes2DFunction<Scalar>* coeff,
@@ -493,6 +738,28 @@ namespace Hermes
         return result;
       }
 
+      template<typename Scalar>
+      bool DefaultVectorFormVol<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar *result) const
+      {
+        ScratchArray<double, H2D_MAX_INTEGRATION_POINTS_COUNT> geom_wt_buffer(n);
+        double* geom_wt = geom_wt_buffer;
+        geometry_weights(n, wt, e, gt, geom_wt);
+        ScratchArray<Scalar, H2D_MAX_INTEGRATION_POINTS_COUNT> weights_buffer(n);
+        Scalar* weights = weights_buffer;
+        coeff->value_batch(n, e->x, e->y, weights);
+        for (int i = 0; i < n; i++)
+          weights[i] *= geom_wt[i];
+
+        ScratchArray<double*, H2D_BLOCK_STACK_FUNCTIONS> test_values_buffer(v_count);
+        double** test_values = test_values_buffer;
+        for (int i = 0; i < v_count; i++)
+          test_values[i] = v[i]->val;
+        weighted_sums(n, weights, test_values, v_count, result);
+
+        return true;
+      }
+
       template<typename Scalar>
       VectorFormVol<Scalar>* DefaultVectorFormVol<Scalar>::clone() const
       {
@@ -534,6 +801,10 @@ namespace Hermes
       Scalar DefaultResidualVol<Scalar>::value(int n, double *wt, Func<Scalar> *u_ext[], Func<double> *v,
         Geom<double> *e, Func<Scalar> **ext) const
       {
+        // Constant coefficient, on the split storage for complex problems.
+        if(gt == HERMES_PLANAR && coeff->is_constant())
+          return coeff->value(0.0, 0.0) * int_fn_products(n, wt, u_ext[idx_i], u_ext[idx_i]->val, v->val);
+
         Scalar result = 0;
         if(gt == HERMES_PLANAR) {
           for (int i = 0; i < n; i++) {
@@ -620,6 +891,10 @@ namespace Hermes
       Scalar DefaultResidualDiffusion<Scalar>::value(int n, double *wt, Func<Scalar> *u_ext[], Func<double> *v,
         Geom<double> *e, Func<Scalar> **ext) const
       {
+        // Constant coefficient, on the split storage for complex problems.
+        if(gt == HERMES_PLANAR && coeff->is_constant())
+          return coeff->value(u_ext[idx_i]->val[0]) * int_fn_products(n, wt, u_ext[idx_i], u_ext[idx_i]->dx, v->dx, u_ext[idx_i]->dy, v->dy);
+
         Scalar result = 0;
         if(gt == HERMES_PLANAR) {
           for (int i = 0; i < n; i++) {
@@ -659,6 +934,41 @@ namespace Hermes
         return result;
       }
 
+      template<typename Scalar>
+      bool DefaultResidualDiffusion<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+        Geom<double> *e, Func<Scalar> **ext, Scalar *result) const
+      {
+        ScratchArray<double, H2D_MAX_INTEGRATION_POINTS_COUNT> geom_wt_buffer(n);
+        double* geom_wt = geom_wt_buffer;
+        geometry_weights(n, wt, e, gt, geom_wt);
+
+        // weights_dx / weights_dy: coeff(u_ext) * grad u_ext, last block: partial sums.
+        ScratchArray<Scalar, 2 * H2D_MAX_INTEGRATION_POINTS_COUNT + H2D_BLOCK_STACK_FUNCTIONS> weights_dx_buffer(n + n + v_count);
+        Scalar* weights_dx = weights_dx_buffer;
+        Scalar* weights_dy = weights_dx + n;
+        Scalar* partial = weights_dx + 2 * n;
+        coeff->value_batch(n, u_ext[idx_i]->val, weights_dy);
+        for (int i = 0; i < n; i++)
+        {
+          Scalar value = geom_wt[i] * weights_dy[i];
+          weights_dx[i] = value * u_ext[idx_i]->dx[i];
+          weights_dy[i] = value * u_ext[idx_i]->dy[i];
+        }
+
+        ScratchArray<double*, H2D_BLOCK_STACK_FUNCTIONS> test_values_buffer(v_count);
+        double** test_values = test_values_buffer;
+        for (int i = 0; i < v_count; i++)
+          test_values[i] = v[i]->dx;
+        weighted_sums(n, weights_dx, test_values, v_count, result);
+        for (int i = 0; i < v_count; i++)
+          test_values[i] = v[i]->dy;
+        weighted_sums(n, weights_dy, test_values, v_count, partial);
+        for (int i = 0; i < v_count; i++)
+          result[i] += partial[i];
+
+        return true;
+      }
+
       template<typename Scalar>
       VectorFormVol<Scalar>* DefaultResidualDiffusion<Scalar>::clone() const
       {
@@ -1015,6 +1325,10 @@ namespace Hermes
       Scalar DefaultResidualSurf<Scalar>::value(int n, double *wt, Func<Scalar> *u_ext[], Func<double> *v,
         Geom<double> *e, Func<Scalar> **ext) const
       {
+        // Constant coefficient, on the split storage for complex problems.
+        if(gt == HERMES_PLANAR && coeff->is_constant())
+          return coeff->value(0.0, 0.0) * int_fn_products(n, wt, u_ext[idx_i], u_ext[idx_i]->val, v->val);
+
         Scalar result = 0;
         if(gt == HERMES_PLANAR) {
           for (int i = 0; i < n; i++) {
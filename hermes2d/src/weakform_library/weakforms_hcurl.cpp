@@ -267,6 +267,10 @@ namespace Hermes
       Scalar DefaultResidualVol<Scalar>::value(int n, double *wt, Func<Scalar> *u_ext[], Func<double> *v,
         Geom<double> *e, Func<Scalar> **ext) const
       {
+        // Constant coefficient, on the split storage for complex problems.
+        if(gt == HERMES_PLANAR && function_coeff->is_constant())
+          return const_coeff * function_coeff->value(0.0, 0.0) * int_fn_products(n, wt, u_ext[idx_i], u_ext[idx_i]->val0, v->val0, u_ext[idx_i]->val1, v->val1);
+
         Scalar result = 0;
         if(gt == HERMES_PLANAR)
         {
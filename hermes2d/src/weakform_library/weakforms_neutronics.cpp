@@ -755,6 +755,197 @@ namespace Hermes
                   return matprop.get_src(mat)[g] * int_x_v<Real>(n, wt, v, e);
               }
             }
+
+            MultigroupMaterialData::MultigroupMaterialData(const MaterialPropertyMaps& matprop, Mesh *mesh) : G(matprop.get_G()), num_markers(0)
+            {
+              const MaterialPropertyMap1& D_map = matprop.get_D();
+              for(MaterialPropertyMap1::const_iterator it = D_map.begin(); it != D_map.end(); ++it)
+                if(mesh->get_element_markers_conversion().get_internal_marker(it->first).valid)
+                  num_markers = std::max(num_markers, mesh->get_element_markers_conversion().get_internal_marker(it->first).marker + 1);
+
+              defined.assign(num_markers, false);
+              D.assign(num_markers * G, 0.0);
+              src.assign(num_markers * G, 0.0);
+              reaction.assign(num_markers * G * G, 0.0);
+
+              const bool2& Ss_nnz = matprop.get_scattering_multigroup_structure();
+              const bool1& chi_nnz = matprop.get_fission_multigroup_structure();
+              for(MaterialPropertyMap1::const_iterator it = D_map.begin(); it != D_map.end(); ++it)
+              {
+                if(!mesh->get_element_markers_conversion().get_internal_marker(it->first).valid)
+                  continue;
+                int marker = mesh->get_element_markers_conversion().get_internal_marker(it->first).marker;
+                const std::string& mat = it->first;
+                defined[marker] = true;
+
+                const rank1& D_mat = matprop.get_D(mat);
+                const rank1& Sigma_r_mat = matprop.get_Sigma_r(mat);
+                const rank2& Sigma_s_mat = matprop.get_Sigma_s(mat);
+                const rank1& src_mat = matprop.get_src(mat);
+                const rank1& nu_mat = matprop.get_nu(mat);
+                const rank1& Sigma_f_mat = matprop.get_Sigma_f(mat);
+                const rank1& chi_mat = matprop.get_chi(mat);
+
+                for (unsigned int gto = 0; gto < G; gto++)
+                {
+                  D[marker * G + gto] = D_mat[gto];
+                  src[marker * G + gto] = src_mat[gto];
+                  double* reaction_row = &reaction[(marker * G + gto) * G];
+                  reaction_row[gto] = Sigma_r_mat[gto];
+                  for (unsigned int gfrom = 0; gfrom < G; gfrom++)
+                  {
+                    if(Ss_nnz[gto][gfrom])
+                      reaction_row[gfrom] -= Sigma_s_mat[gto][gfrom];
+                    if(chi_nnz[gto])
+                      reaction_row[gfrom] -= chi_mat[gto] * nu_mat[gfrom] * Sigma_f_mat[gfrom];
+                  }
+                }
+              }
+            }
+
+            bool MultigroupMaterialData::is_block_nonzero(unsigned int gto, unsigned int gfrom) const
+            {
+              for (int marker = 0; marker < num_markers; marker++)
+                if(defined[marker] && (get_reaction(marker, gto, gfrom) != 0.0 || (gto == gfrom && get_D(marker, gto) != 0.0)))
+                  return true;
+              return false;
+            }
+
+            /// The quadrature weight of the point times the geometric factor of the axisymmetric formulations.
+            static inline double multigroup_geometry_weight(double *wt, Geom<double> *e, GeomType geom_type, int i)
+            {
+              if(geom_type == HERMES_AXISYM_X)
+                return wt[i] * e->y[i];
+              else if(geom_type == HERMES_AXISYM_Y)
+                return wt[i] * e->x[i];
+              return wt[i];
+            }
+
+            template<typename Scalar>
+            Scalar MultigroupDiffusion::Jacobian<Scalar>::value(int n, double *wt, Func<Scalar> *u_ext[], Func<double> *u,
+              Func<double> *v, Geom<double> *e, Func<Scalar> **ext) const
+            {
+              if(!data->has_marker(e->elem_marker))
+                throw Hermes::Exceptions::Exception(E_INVALID_MARKER);
+              double D_g = (gto == gfrom) ? data->get_D(e->elem_marker, gto) : 0.0;
+              double reaction = data->get_reaction(e->elem_marker, gto, gfrom);
+
+              Scalar result = Scalar(0);
+              for (int i = 0; i < n; i++)
+                result += multigroup_geometry_weight(wt, e, geom_type, i) * (D_g * (u->dx[i] * v->dx[i] + u->dy[i] * v->dy[i]) + reaction * u->val[i] * v->val[i]);
+              return result;
+            }
+
+            template<typename Scalar>
+            Hermes::Ord MultigroupDiffusion::Jacobian<Scalar>::ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *u,
+              Func<Hermes::Ord> *v, Geom<Hermes::Ord> *e, Func<Hermes::Ord> **ext) const
+            {
+              Hermes::Ord result = u->dx[0] * v->dx[0] + u->dy[0] * v->dy[0] + u->val[0] * v->val[0];
+              if(geom_type != HERMES_PLANAR)
+                result = result * e->x[0];
+              return result;
+            }
+
+            template<typename Scalar>
+            bool MultigroupDiffusion::Jacobian<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **u, int u_count, Func<double> **v, int v_count,
+              Geom<double> *e, Func<Scalar> **ext, Scalar **result) const
+            {
+              if(!data->has_marker(e->elem_marker))
+                throw Hermes::Exceptions::Exception(E_INVALID_MARKER);
+              double D_g = (gto == gfrom) ? data->get_D(e->elem_marker, gto) : 0.0;
+              double reaction = data->get_reaction(e->elem_marker, gto, gfrom);
+
+              // The weighted test function values and derivatives are formed once per test function.
+              double* weighted = new double[3 * n];
+              for (int i = 0; i < v_count; i++)
+              {
+                for (int k = 0; k < n; k++)
+                {
+                  double w = multigroup_geometry_weight(wt, e, geom_type, k);
+                  weighted[k] = w * reaction * v[i]->val[k];
+                  weighted[n + k] = w * D_g * v[i]->dx[k];
+                  weighted[2 * n + k] = w * D_g * v[i]->dy[k];
+                }
+                for (int j = 0; j < u_count; j++)
+                {
+                  double sum = 0.0;
+                  if(D_g != 0.0)
+                    for (int k = 0; k < n; k++)
+                      sum += weighted[k] * u[j]->val[k] + weighted[n + k] * u[j]->dx[k] + weighted[2 * n + k] * u[j]->dy[k];
+                  else
+                    for (int k = 0; k < n; k++)
+                      sum += weighted[k] * u[j]->val[k];
+                  result[i][j] = sum;
+                }
+              }
+              delete [] weighted;
+              return true;
+            }
+
+            template<typename Scalar>
+            void MultigroupDiffusion::Residual<Scalar>::weights(int n, double *wt, Func<Scalar> *u_ext[], Geom<double> *e, Scalar* wt_v, Scalar* wt_dx, Scalar* wt_dy) const
+            {
+              if(!data->has_marker(e->elem_marker))
+                throw Hermes::Exceptions::Exception(E_INVALID_MARKER);
+              int marker = e->elem_marker;
+              unsigned int G = data->get_G();
+              double D_g = data->get_D(marker, g);
+              double src_g = data->get_src(marker, g);
+
+              for (int i = 0; i < n; i++)
+              {
+                double w = multigroup_geometry_weight(wt, e, geom_type, i);
+                Scalar reaction_sum = Scalar(-src_g);
+                for (unsigned int gfrom = 0; gfrom < G; gfrom++)
+                  reaction_sum += data->get_reaction(marker, g, gfrom) * u_ext[gfrom]->val[i];
+                wt_v[i] = w * reaction_sum;
+                wt_dx[i] = w * D_g * u_ext[g]->dx[i];
+                wt_dy[i] = w * D_g * u_ext[g]->dy[i];
+              }
+            }
+
+            template<typename Scalar>
+            Scalar MultigroupDiffusion::Residual<Scalar>::value(int n, double *wt, Func<Scalar> *u_ext[], Func<double> *v,
+              Geom<double> *e, Func<Scalar> **ext) const
+            {
+              Scalar* wt_v = new Scalar[3 * n];
+              weights(n, wt, u_ext, e, wt_v, wt_v + n, wt_v + 2 * n);
+              Scalar result = Scalar(0);
+              for (int i = 0; i < n; i++)
+                result += wt_v[i] * v->val[i] + wt_v[n + i] * v->dx[i] + wt_v[2 * n + i] * v->dy[i];
+              delete [] wt_v;
+              return result;
+            }
+
+            template<typename Scalar>
+            Hermes::Ord MultigroupDiffusion::Residual<Scalar>::ord(int n, double *wt, Func<Hermes::Ord> *u_ext[], Func<Hermes::Ord> *v,
+              Geom<Hermes::Ord> *e, Func<Ord> **ext) const
+            {
+              Hermes::Ord result = u_ext[g]->dx[0] * v->dx[0] + u_ext[g]->dy[0] * v->dy[0];
+              for (unsigned int gfrom = 0; gfrom < data->get_G(); gfrom++)
+                result += u_ext[gfrom]->val[0] * v->val[0];
+              if(geom_type != HERMES_PLANAR)
+                result = result * e->x[0];
+              return result;
+            }
+
+            template<typename Scalar>
+            bool MultigroupDiffusion::Residual<Scalar>::value_block(int n, double *wt, Func<Scalar> *u_ext[], Func<double> **v, int v_count,
+              Geom<double> *e, Func<Scalar> **ext, Scalar *result) const
+            {
+              // The weights of all the groups and of the source are formed once for all the test functions.
+              Scalar* wt_v = new Scalar[3 * n];
+              weights(n, wt, u_ext, e, wt_v, wt_v + n, wt_v + 2 * n);
+              for (int j = 0; j < v_count; j++)
+              {
+                Scalar sum = Scalar(0);
+                for (int i = 0; i < n; i++)
+                  sum += wt_v[i] * v[j]->val[i] + wt_v[n + i] * v[j]->dx[i] + wt_v[2 * n + i] * v[j]->dy[i];
+                result[j] = sum;
+              }
+              delete [] wt_v;
+              return true;
+            }
           }
         }
 
@@ -878,6 +1069,26 @@ namespace Hermes
               }
             }
 
+            template<typename Scalar>
+            FusedWeakFormFixedSource<Scalar>::FusedWeakFormFixedSource(const MaterialPropertyMaps& matprop, Mesh *mesh,
+              GeomType geom_type) : WeakForm<Scalar>(matprop.get_G())
+            {
+              this->data = new MultigroupMaterialData(matprop, mesh);
+              for (unsigned int gto = 0; gto < matprop.get_G(); gto++)
+              {
+                for (unsigned int gfrom = 0; gfrom < matprop.get_G(); gfrom++)
+                  if(this->data->is_block_nonzero(gto, gfrom))
+                    this->add_matrix_form(new MultigroupDiffusion::Jacobian<Scalar>(gto, gfrom, this->data, geom_type));
+                this->add_vector_form(new MultigroupDiffusion::Residual<Scalar>(gto, this->data, geom_type));
+              }
+            }
+
+            template<typename Scalar>
+            FusedWeakFormFixedSource<Scalar>::~FusedWeakFormFixedSource()
+            {
+              delete this->data;
+            }
+
             template<typename Scalar>
             void DefaultWeakFormSourceIteration<Scalar>::update_keff(double new_keff)
             {
@@ -903,6 +1114,212 @@ namespace Hermes
                 result[i] += nu[j] * Sigma_f[j] * values.at(j)[i];
             }
           }
+
+          PowerIteration::PowerIteration(const MaterialProperties::Diffusion::MaterialPropertyMaps& matprop, Hermes::vector<const Space<double>*> spaces, GeomType geom_type)
+            : matprop(matprop), spaces(spaces), geom_type(geom_type), keff_shift(0.0), tol(1e-8), max_iterations(1000),
+            ndof(0), iteration_matrix(NULL), fission_matrix(NULL), rhs(NULL), solver(NULL), factorized(false),
+            sln_vector(NULL), keff(0.0), num_iterations(0)
+          {
+            if(spaces.size() != matprop.get_G())
+              throw Hermes::Exceptions::Exception(MaterialProperties::Messages::E_INVALID_SIZE);
+          }
+
+          PowerIteration::~PowerIteration()
+          {
+            delete solver;
+            delete iteration_matrix;
+            delete fission_matrix;
+            delete rhs;
+            delete [] sln_vector;
+          }
+
+          void PowerIteration::set_wielandt_shift(double keff_shift)
+          {
+            if(keff_shift < 0.0)
+              throw Hermes::Exceptions::ValueException("keff_shift", keff_shift, 0.0);
+            this->keff_shift = keff_shift;
+            delete solver;
+            solver = NULL;
+            delete iteration_matrix;
+            iteration_matrix = NULL;
+          }
+
+          void PowerIteration::set_tolerance(double tol)
+          {
+            this->tol = tol;
+          }
+
+          void PowerIteration::set_max_iterations(int max_iterations)
+          {
+            this->max_iterations = max_iterations;
+          }
+
+          double* PowerIteration::get_sln_vector() const
+          {
+            return sln_vector;
+          }
+
+          double PowerIteration::get_keff() const
+          {
+            return keff;
+          }
+
+          int PowerIteration::get_num_iterations() const
+          {
+            return num_iterations;
+          }
+
+          void PowerIteration::init_operators()
+          {
+            using namespace ElementaryForms::Diffusion;
+
+            Mesh* mesh = spaces[0]->get_mesh();
+            unsigned int G = matprop.get_G();
+            const bool2& Ss_nnz = matprop.get_scattering_multigroup_structure();
+            const bool1& chi_nnz = matprop.get_fission_multigroup_structure();
+
+            // FissionYield::Jacobian is -F.
+            if(fission_matrix == NULL)
+            {
+              WeakForm<double> wf_fission(G);
+              for (unsigned int gto = 0; gto < G; gto++)
+                for (unsigned int gfrom = 0; gfrom < G; gfrom++)
+                  if(chi_nnz[gto])
+                  {
+                    FissionYield::Jacobian<double>* form = new FissionYield::Jacobian<double>(gto, gfrom, matprop, mesh, geom_type);
+                    form->setScalingFactor(-1.0);
+                    wf_fission.add_matrix_form(form);
+                  }
+              fission_matrix = create_matrix<double>();
+              DiscreteProblem<double> dp_fission(&wf_fission, spaces);
+              dp_fission.assemble(fission_matrix);
+              wf_fission.delete_all();
+            }
+
+            if(iteration_matrix == NULL)
+            {
+              WeakForm<double> wf_iteration(G);
+              for (unsigned int gto = 0; gto < G; gto++)
+              {
+                wf_iteration.add_matrix_form(new DiffusionReaction::Jacobian<double>(gto, matprop, mesh, geom_type));
+                for (unsigned int gfrom = 0; gfrom < G; gfrom++)
+                {
+                  if(Ss_nnz[gto][gfrom])
+                    wf_iteration.add_matrix_form(new Scattering::Jacobian<double>(gto, gfrom, matprop, mesh, geom_type));
+                  if(chi_nnz[gto] && keff_shift != 0.0)
+                  {
+                    FissionYield::Jacobian<double>* form = new FissionYield::Jacobian<double>(gto, gfrom, matprop, mesh, geom_type);
+                    form->setScalingFactor(1.0 / keff_shift);
+                    wf_iteration.add_matrix_form(form);
+                  }
+                }
+              }
+              iteration_matrix = create_matrix<double>();
+              DiscreteProblem<double> dp_iteration(&wf_iteration, spaces);
+              dp_iteration.assemble(iteration_matrix);
+              wf_iteration.delete_all();
+
+              if(rhs == NULL)
+                rhs = create_vector<double>();
+              rhs->alloc(ndof);
+              solver = create_linear_solver<double>(iteration_matrix, rhs);
+              factorized = false;
+            }
+          }
+
+          double PowerIteration::fission_production(double* phi, double* fission)
+          {
+            fission_matrix->multiply_with_vector(phi, fission);
+            double production = 0.0;
+            for (int i = 0; i < ndof; i++)
+              production += fission[i];
+            return production;
+          }
+
+          double PowerIteration::solve(double initial_keff_guess, double* coeff_vec)
+          {
+            if(initial_keff_guess <= 0.0)
+              throw Hermes::Exceptions::ValueException("initial_keff_guess", initial_keff_guess, 0.0);
+
+            int new_ndof = Space<double>::get_num_dofs(spaces);
+            if(new_ndof != ndof)
+            {
+              // The spaces changed, all the operators are assembled again.
+              set_wielandt_shift(keff_shift);
+              delete fission_matrix;
+              fission_matrix = NULL;
+              ndof = new_ndof;
+            }
+            init_operators();
+
+            delete [] sln_vector;
+            sln_vector = new double[ndof];
+            double* fission = new double[ndof];
+            double* fission_new = new double[ndof];
+            double* b = new double[ndof];
+            if(coeff_vec == NULL)
+              for (int i = 0; i < ndof; i++)
+                sln_vector[i] = 1.0;
+            else
+              memcpy(sln_vector, coeff_vec, ndof * sizeof(double));
+
+            double production = fission_production(sln_vector, fission);
+            if(production == 0.0)
+              throw Hermes::Exceptions::Exception("PowerIteration: the initial flux produces no fission source.");
+
+            double inv_shift = (keff_shift == 0.0) ? 0.0 : 1.0 / keff_shift;
+            keff = initial_keff_guess;
+            num_iterations = 0;
+            bool converged = false;
+            while(!converged && num_iterations < max_iterations)
+            {
+              double factor = (1.0 / keff - inv_shift) / production;
+              for (int i = 0; i < ndof; i++)
+                b[i] = factor * fission[i];
+              rhs->zero();
+              rhs->add_vector(b);
+              if(!solver->solve())
+                throw Hermes::Exceptions::LinearMatrixSolverException("PowerIteration: the iteration matrix could not be solved with.");
+              if(!factorized)
+              {
+                solver->set_factorization_scheme(HERMES_REUSE_FACTORIZATION_COMPLETELY);
+                factorized = true;
+              }
+              memcpy(sln_vector, solver->get_sln_vector(), ndof * sizeof(double));
+              num_iterations++;
+
+              // The right hand side had the unit production, its ratio to the new one is the update of 1 / keff - 1 / keff_s.
+              double production_new = fission_production(sln_vector, fission_new);
+              if(production_new == 0.0)
+                throw Hermes::Exceptions::Exception("PowerIteration: the flux produces no fission source.");
+              double keff_new = 1.0 / (inv_shift + (1.0 / keff - inv_shift) / production_new);
+
+              double source_change = 0.0, source_max = 0.0;
+              for (int i = 0; i < ndof; i++)
+              {
+                source_change = std::max(source_change, std::abs(fission_new[i] / production_new - fission[i] / production));
+                source_max = std::max(source_max, std::abs(fission_new[i] / production_new));
+              }
+              converged = std::abs(keff_new - keff) <= tol * keff_new && source_change <= tol * source_max;
+
+              // The flux is normalized to the unit production.
+              for (int i = 0; i < ndof; i++)
+              {
+                sln_vector[i] /= production_new;
+                fission[i] = fission_new[i] / production_new;
+              }
+              production = 1.0;
+              keff = keff_new;
+            }
+
+            if(!converged)
+              this->warn("PowerIteration: keff = %g not converged in %d iterations.", keff, num_iterations);
+
+            delete [] fission;
+            delete [] fission_new;
+            delete [] b;
+            return keff;
+          }
         }
       }
       namespace Monoenergetic
@@ -931,6 +1348,11 @@ namespace Hermes
             template class HERMES_API VacuumBoundaryCondition::Residual<double>;
             template class HERMES_API VacuumBoundaryCondition::Residual<std::complex<double> >;
 
+            template class HERMES_API MultigroupDiffusion::Jacobian<double>;
+            template class HERMES_API MultigroupDiffusion::Jacobian<std::complex<double> >;
+            template class HERMES_API MultigroupDiffusion::Residual<double>;
+            template class HERMES_API MultigroupDiffusion::Residual<std::complex<double> >;
+
             template double VacuumBoundaryCondition::Jacobian<double>::matrix_form<double, double>(int n, double *wt, Func<double> *u_ext[], Func<double> *u,
               Func<double> *v, Geom<double> *e, Func<double> **ext) const;
 
@@ -972,6 +1394,9 @@ namespace Hermes
 
             template class HERMES_API DefaultWeakFormSourceIteration<double>;
             template class HERMES_API DefaultWeakFormSourceIteration<std::complex<double> >;
+
+            template class HERMES_API FusedWeakFormFixedSource<double>;
+            template class HERMES_API FusedWeakFormFixedSource<std::complex<double> >;
           }
         }
       }
@@ -1,16 +1,16 @@
 #include "definitions.h"
 
-WeakFormEigenLeft::WeakFormEigenLeft() : WeakForm(1) 
+WeakFormEigenLeft::WeakFormEigenLeft() : WeakForm<double>(1) 
 {
-  add_matrix_form(new WeakFormsH1::DefaultJacobianDiffusion<double>(0, 0));
+  add_matrix_form(new DefaultJacobianDiffusion<double>(0, 0, HERMES_ANY, HERMES_ONE, HERMES_SYM));
   add_matrix_form(new MatrixFormPotential(0, 0));
 }
 
 template<typename Real, typename Scalar>
 Scalar WeakFormEigenLeft::MatrixFormPotential::matrix_form(int n, double *wt, Func<Scalar> *u_ext[], Func<Real> *u, 
-                                                           Func<Real> *v, Geom<Real> *e, ExtData<Scalar> *ext) const 
+                                                           Func<Real> *v, Geom<Real> *e, Func<Scalar> **ext) const 
 {
-  Scalar result = 0;
+  Scalar result = Scalar(0);
   for (int i = 0; i < n; i++) 
   {
     Real x = e->x[i];
@@ -21,20 +21,23 @@ Scalar WeakFormEigenLeft::MatrixFormPotential::matrix_form(int n, double *wt, Fu
 }
 
 double WeakFormEigenLeft::MatrixFormPotential::value(int n, double *wt, Func<double> *u_ext[], Func<double> *u, 
-                                                     Func<double> *v, Geom<double> *e, ExtData<double> *ext) const 
+                                                     Func<double> *v, Geom<double> *e, Func<double> **ext) const 
 {
   return matrix_form<double, double>(n, wt, u_ext, u, v, e, ext);
 }
 
 Ord WeakFormEigenLeft::MatrixFormPotential::ord(int n, double *wt, Func<Ord> *u_ext[], Func<Ord> *u, 
-                                                Func<Ord> *v, Geom<Ord> *e, ExtData<Ord> *ext) const 
+                                                Func<Ord> *v, Geom<Ord> *e, Func<Ord> **ext) const 
 {
   return matrix_form<Ord, Ord>(n, wt, u_ext, u, v, e, ext);
 }
 
-
-WeakFormEigenRight::WeakFormEigenRight() : WeakForm(1) 
+MatrixFormVol<double>* WeakFormEigenLeft::MatrixFormPotential::clone() const
 {
-  add_matrix_form(new WeakFormsH1::DefaultMatrixFormVol<double>(0, 0));
+  return new MatrixFormPotential(*this);
 }
 
+WeakFormEigenRight::WeakFormEigenRight() : WeakForm<double>(1) 
+{
+  add_matrix_form(new DefaultMatrixFormVol<double>(0, 0, HERMES_ANY, HERMES_ONE, HERMES_SYM));
+}
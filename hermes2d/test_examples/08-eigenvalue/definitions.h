@@ -1,5 +1,10 @@
 #include "hermes2d.h"
 
+using namespace Hermes;
+using namespace Hermes::Hermes2D;
+using namespace Hermes::Hermes2D::WeakFormsH1;
+using namespace Hermes::Hermes2D::Views;
+
 /* Weak forms */
 
 class WeakFormEigenLeft : public WeakForm<double>
@@ -15,13 +20,15 @@ private:
 
     template<typename Real, typename Scalar>
     Scalar matrix_form(int n, double *wt, Func<Scalar> *u_ext[], Func<Real> *u, 
-                       Func<Real> *v, Geom<Real> *e, ExtData<Scalar> *ext) const;
+                       Func<Real> *v, Geom<Real> *e, Func<Scalar> **ext) const;
 
     virtual double value(int n, double *wt, Func<double> *u_ext[], Func<double> *u, 
-                         Func<double> *v, Geom<double> *e, ExtData<double> *ext) const;
+                         Func<double> *v, Geom<double> *e, Func<double> **ext) const;
 
     virtual Ord ord(int n, double *wt, Func<Ord> *u_ext[], Func<Ord> *u, 
-                    Func<Ord> *v, Geom<Ord> *e, ExtData<Ord> *ext) const;
+                    Func<Ord> *v, Geom<Ord> *e, Func<Ord> **ext) const;
+
+    virtual MatrixFormVol<double>* clone() const;
   };
 };
 
@@ -30,4 +37,3 @@ class WeakFormEigenRight : public WeakForm<double>
 public:
   WeakFormEigenRight();
 };
-
@@ -0,0 +1,86 @@
+#include "definitions.h"
+
+static bool compare_elements(Mesh* mesh, Mesh* loaded_mesh, Element* e, Element* loaded_e, bool all_elements)
+{
+  if(loaded_e->used != e->used || loaded_e->active != e->active || loaded_e->get_nvert() != e->get_nvert())
+  {
+    printf("Element %d differs in its state.\n", e->id);
+    return false;
+  }
+  if(!e->used)
+    return true;
+
+  std::string marker = mesh->get_element_markers_conversion().get_user_marker(e->marker).marker;
+  std::string loaded_marker = loaded_mesh->get_element_markers_conversion().get_user_marker(loaded_e->marker).marker;
+  if(loaded_marker != marker)
+  {
+    printf("Element %d has the marker %s instead of %s.\n", e->id, loaded_marker.c_str(), marker.c_str());
+    return false;
+  }
+
+  for (int i = 0; i < e->get_nvert(); i++)
+  {
+    if(fabs(loaded_e->vn[i]->x - e->vn[i]->x) > 1e-14 || fabs(loaded_e->vn[i]->y - e->vn[i]->y) > 1e-14)
+    {
+      printf("Vertex %d of the element %d differs.\n", i, e->id);
+      return false;
+    }
+    if(e->active && loaded_e->en[i]->bnd != e->en[i]->bnd)
+    {
+      printf("Edge %d of the element %d differs.\n", i, e->id);
+      return false;
+    }
+    if(e->active && e->en[i]->bnd)
+    {
+      marker = mesh->get_boundary_markers_conversion().get_user_marker(e->en[i]->marker).marker;
+      loaded_marker = loaded_mesh->get_boundary_markers_conversion().get_user_marker(loaded_e->en[i]->marker).marker;
+      if(loaded_marker != marker)
+      {
+        printf("Edge %d of the element %d has the marker %s instead of %s.\n", i, e->id, loaded_marker.c_str(), marker.c_str());
+        return false;
+      }
+    }
+  }
+
+  if(all_elements)
+  {
+    if((e->parent == NULL) != (loaded_e->parent == NULL) || (e->parent != NULL && loaded_e->parent->id != e->parent->id))
+    {
+      printf("Element %d has a different parent.\n", e->id);
+      return false;
+    }
+    if(!e->active)
+      for (int i = 0; i < H2D_MAX_ELEMENT_SONS; i++)
+        if((e->sons[i] == NULL) != (loaded_e->sons[i] == NULL) || (e->sons[i] != NULL && loaded_e->sons[i]->id != e->sons[i]->id))
+        {
+          printf("Son %d of the element %d differs.\n", i, e->id);
+          return false;
+        }
+  }
+
+  return true;
+}
+
+bool compare_meshes(Mesh* mesh, Mesh* loaded_mesh, bool all_elements)
+{
+  if(loaded_mesh->get_num_active_elements() != mesh->get_num_active_elements()
+    || loaded_mesh->get_num_base_elements() != mesh->get_num_base_elements()
+    || loaded_mesh->get_max_element_id() != mesh->get_max_element_id())
+  {
+    printf("The loaded mesh has %d active elements (%d base, max. id %d) instead of %d (%d base, max. id %d).\n",
+      loaded_mesh->get_num_active_elements(), loaded_mesh->get_num_base_elements(), loaded_mesh->get_max_element_id(),
+      mesh->get_num_active_elements(), mesh->get_num_base_elements(), mesh->get_max_element_id());
+    return false;
+  }
+
+  for (int id = 0; id < mesh->get_max_element_id(); id++)
+  {
+    Element* e = mesh->get_element(id);
+    if(!all_elements && !(e->used && e->active))
+      continue;
+    if(!compare_elements(mesh, loaded_mesh, e, loaded_mesh->get_element(id), all_elements))
+      return false;
+  }
+
+  return true;
+}
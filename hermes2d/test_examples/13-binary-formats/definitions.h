@@ -0,0 +1,9 @@
+#include "hermes2d.h"
+
+using namespace Hermes;
+using namespace Hermes::Hermes2D;
+
+/// Checks that the two meshes have the same elements (with the same ids), markers and vertex coordinates.
+/// If all_elements is false, only the active elements are compared, otherwise also the inactive ones,
+/// including their parents and sons. Prints the first difference found.
+bool compare_meshes(Mesh* mesh, Mesh* loaded_mesh, bool all_elements);
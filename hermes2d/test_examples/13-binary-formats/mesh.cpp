@@ -0,0 +1,42 @@
+#define HERMES_REPORT_ALL
+#include "definitions.h"
+
+// This test saves a refined mesh in the binary format (MeshReaderH2DBinary::save()), loads it back
+// and checks that the loaded mesh has the same active elements, with the same ids, markers and vertices.
+// The binary file stores the base mesh and the refinement history, which is replayed on loading.
+
+int main(int argc, char* argv[])
+{
+  // Load the mesh.
+  Mesh mesh;
+  MeshReaderH2D mloader;
+  mloader.load("domain.mesh", &mesh);
+
+  // Refine the mesh uniformly, anisotropically and towards the boundary, so that the history
+  // contains all kinds of refinements.
+  mesh.refine_all_elements();
+  for (int id = 0, count = 0; id < mesh.get_max_element_id() && count < 3; id++)
+  {
+    Element* e = mesh.get_element(id);
+    if(e->used && e->active)
+      mesh.refine_element_id(id, ++count % 3);
+  }
+  mesh.refine_towards_boundary("Dirichlet", 2);
+
+  // Save and load the mesh.
+  MeshReaderH2DBinary bin_loader;
+  bin_loader.save("domain.h2db", &mesh);
+  Mesh loaded_mesh;
+  bin_loader.load("domain.h2db", &loaded_mesh);
+
+  if(compare_meshes(&mesh, &loaded_mesh, false))
+  {
+    printf("Success!\n");
+    return 0;
+  }
+  else
+  {
+    printf("Failure!\n");
+    return -1;
+  }
+}
@@ -0,0 +1,52 @@
+#define HERMES_REPORT_ALL
+#include "definitions.h"
+
+// This test saves a refined mesh with its complete element tree (MeshReaderH2DBinary::save_tree()),
+// loads it back and checks that all the elements, active or not, have the same ids, parents, sons,
+// markers and vertices. Then it saves the loaded mesh by save(), which needs the refinement history
+// stored in the tree file, and checks the active elements of the mesh loaded from that file.
+
+int main(int argc, char* argv[])
+{
+  // Load the mesh.
+  Mesh mesh;
+  MeshReaderH2D mloader;
+  mloader.load("domain.mesh", &mesh);
+
+  // Perform an initial refinement and further refinements.
+  mesh.refine_all_elements(0, true);
+  for (int id = 0, count = 0; id < mesh.get_max_element_id() && count < 3; id++)
+  {
+    Element* e = mesh.get_element(id);
+    if(e->used && e->active)
+      mesh.refine_element_id(id, ++count % 3);
+  }
+  mesh.refine_towards_boundary("Dirichlet", 2);
+
+  // Save and load the element tree.
+  MeshReaderH2DBinary bin_loader;
+  bin_loader.save_tree("domain-tree.h2db", &mesh);
+  Mesh loaded_mesh;
+  bin_loader.load("domain-tree.h2db", &loaded_mesh);
+  bool success = compare_meshes(&mesh, &loaded_mesh, true);
+
+  // Save the loaded mesh in the plain binary format and load it again.
+  if(success)
+  {
+    bin_loader.save("domain-tree-resaved.h2db", &loaded_mesh);
+    Mesh resaved_mesh;
+    bin_loader.load("domain-tree-resaved.h2db", &resaved_mesh);
+    success = compare_meshes(&mesh, &resaved_mesh, false);
+  }
+
+  if(success)
+  {
+    printf("Success!\n");
+    return 0;
+  }
+  else
+  {
+    printf("Failure!\n");
+    return -1;
+  }
+}
@@ -0,0 +1,117 @@
+#define HERMES_REPORT_ALL
+#include "definitions.h"
+
+// This test saves real and complex solutions in the binary format (Solution::save_bin()), uncompressed
+// and compressed (the latter is stored uncompressed if Hermes was built without WITH_ZSTD), loads them
+// back (Solution::load_bin()) and compares the values and derivatives of the solutions on a grid of points.
+
+// Number of initial uniform mesh refinements.
+const int INIT_REF_NUM = 2;
+// Highest polynomial degree of the elements, the elements get degrees from 1 up to it.
+const int P_MAX = 4;
+// Number of the points in the x and y directions.
+const int NX = 20, NY = 15;
+// Relative tolerance of the comparison.
+const double TOLERANCE = 1e-12;
+
+template<typename Scalar>
+Scalar coefficient(int i);
+
+template<>
+double coefficient<double>(int i)
+{
+  return std::sin(i + 1.0);
+}
+
+template<>
+std::complex<double> coefficient<std::complex<double> >(int i)
+{
+  return std::complex<double>(std::sin(i + 1.0), std::cos(3.0 * i));
+}
+
+template<typename Scalar>
+bool compare_values(const Scalar* values, const Scalar* loaded_values, int n, const char* what)
+{
+  for (int i = 0; i < n; i++)
+    if(std::abs(loaded_values[i] - values[i]) > TOLERANCE * (1.0 + std::abs(values[i])))
+    {
+      printf("The %s at the point %d differs.\n", what, i);
+      return false;
+    }
+  return true;
+}
+
+template<typename Scalar>
+bool test_solution(Mesh* mesh, const char* filename, bool compress)
+{
+  // Create a space with varying element orders and a solution with arbitrary coefficients.
+  H1Space<Scalar> space(mesh, 1);
+  Element* e;
+  for_all_active_elements(e, mesh)
+    space.set_element_order(e->id, 1 + e->id % P_MAX);
+  space.assign_dofs();
+
+  int ndof = space.get_num_dofs();
+  Scalar* coeffs = new Scalar[ndof];
+  for (int i = 0; i < ndof; i++)
+    coeffs[i] = coefficient<Scalar>(i);
+  Solution<Scalar> sln;
+  Solution<Scalar>::vector_to_solution(coeffs, &space, &sln);
+  delete [] coeffs;
+
+  // Save and load the solution.
+  sln.save_bin(filename, compress);
+  Solution<Scalar> loaded_sln;
+  loaded_sln.load_bin(filename, &space);
+
+  // Evaluate both solutions in the interior of the domain of domain.mesh, (0, 0.004) x (0, 0.003).
+  const int n = NX * NY;
+  double x[n], y[n];
+  for (int i = 0; i < NX; i++)
+    for (int j = 0; j < NY; j++)
+    {
+      x[i * NY + j] = 0.004 * (i + 0.5) / NX;
+      y[i * NY + j] = 0.003 * (j + 0.5) / NY;
+    }
+
+  Scalar val[n], dx[n], dy[n], loaded_val[n], loaded_dx[n], loaded_dy[n];
+  int found = sln.get_pt_values(x, y, n, val, dx, dy);
+  int loaded_found = loaded_sln.get_pt_values(x, y, n, loaded_val, loaded_dx, loaded_dy);
+  if(found != n || loaded_found != n)
+  {
+    printf("Only %d and %d of the %d points were found.\n", found, loaded_found, n);
+    return false;
+  }
+
+  return compare_values(val, loaded_val, n, "value")
+    && compare_values(dx, loaded_dx, n, "x-derivative")
+    && compare_values(dy, loaded_dy, n, "y-derivative");
+}
+
+int main(int argc, char* argv[])
+{
+  // Load the mesh.
+  Mesh mesh;
+  MeshReaderH2D mloader;
+  mloader.load("domain.mesh", &mesh);
+
+  // Perform initial mesh refinements.
+  for (int i = 0; i < INIT_REF_NUM; i++)
+    mesh.refine_all_elements();
+
+  bool success = test_solution<double>(&mesh, "solution-real.h2ds", false)
+    && test_solution<double>(&mesh, "solution-real-compressed.h2ds", true)
+    && test_solution<std::complex<double> >(&mesh, "solution-complex.h2ds", false)
+    && test_solution<std::complex<double> >(&mesh, "solution-complex-compressed.h2ds", true);
+
+  if(success)
+  {
+    printf("Success!\n");
+    return 0;
+  }
+  else
+  {
+    printf("Failure!\n");
+    return -1;
+  }
+}
@@ -0,0 +1,94 @@
+#define HERMES_REPORT_ALL
+#include "definitions.h"
+
+// This test saves a space with varying (also anisotropic) element orders in the binary format
+// (Space::save_bin()), uncompressed and compressed (the latter is stored uncompressed if Hermes
+// was built without WITH_ZSTD), loads it back (Space::load()) and checks the number of DOFs,
+// the element orders and the assembly lists of all the active elements.
+
+// Number of initial uniform mesh refinements.
+const int INIT_REF_NUM = 2;
+// Highest polynomial degree of the elements, the elements get degrees from 1 up to it.
+const int P_MAX = 4;
+// Tolerance of the comparison of the assembly list coefficients.
+const double TOLERANCE = 1e-12;
+
+bool compare_spaces(Space<double>* space, Space<double>* loaded_space)
+{
+  if(loaded_space->get_type() != space->get_type() || loaded_space->get_num_dofs() != space->get_num_dofs())
+  {
+    printf("The loaded space has %d DOFs instead of %d.\n", loaded_space->get_num_dofs(), space->get_num_dofs());
+    return false;
+  }
+
+  AsmList<double> al, loaded_al;
+  Element* e;
+  for_all_active_elements(e, space->get_mesh())
+  {
+    if(loaded_space->get_element_order(e->id) != space->get_element_order(e->id))
+    {
+      printf("Element %d has the order %d instead of %d.\n", e->id, loaded_space->get_element_order(e->id), space->get_element_order(e->id));
+      return false;
+    }
+
+    space->get_element_assembly_list(e, &al);
+    loaded_space->get_element_assembly_list(e, &loaded_al);
+    if(loaded_al.get_cnt() != al.get_cnt())
+    {
+      printf("Element %d has %d basis functions instead of %d.\n", e->id, loaded_al.get_cnt(), al.get_cnt());
+      return false;
+    }
+    for (unsigned int i = 0; i < al.get_cnt(); i++)
+      if(loaded_al.get_dof()[i] != al.get_dof()[i] || fabs(loaded_al.get_coef()[i] - al.get_coef()[i]) > TOLERANCE)
+      {
+        printf("Basis function %d of the element %d differs.\n", i, e->id);
+        return false;
+      }
+  }
+
+  return true;
+}
+
+bool test_space(Space<double>* space, EssentialBCs<double>* bcs, const char* filename, bool compress)
+{
+  space->save_bin(filename, compress);
+  Space<double>* loaded_space = Space<double>::load(filename, space->get_mesh(), false, bcs);
+  bool success = compare_spaces(space, loaded_space);
+  delete loaded_space;
+  return success;
+}
+
+int main(int argc, char* argv[])
+{
+  // Load the mesh.
+  Mesh mesh;
+  MeshReaderH2D mloader;
+  mloader.load("domain.mesh", &mesh);
+
+  // Perform initial mesh refinements.
+  for (int i = 0; i < INIT_REF_NUM; i++)
+    mesh.refine_all_elements();
+
+  // Initialize the boundary conditions and the space with varying element orders.
+  DefaultEssentialBCConst<double> bc_essential("Dirichlet", 1.0);
+  EssentialBCs<double> bcs(&bc_essential);
+  H1Space<double> space(&mesh, &bcs, 1);
+  Element* e;
+  for_all_active_elements(e, &mesh)
+    space.set_element_order(e->id, H2D_MAKE_QUAD_ORDER(1 + e->id % P_MAX, 1 + (e->id / P_MAX) % P_MAX));
+  space.assign_dofs();
+
+  bool success = test_space(&space, &bcs, "space.h2dsp", false)
+    && test_space(&space, &bcs, "space-compressed.h2dsp", true);
+
+  if(success)
+  {
+    printf("Success!\n");
+    return 0;
+  }
+  else
+  {
+    printf("Failure!\n");
+    return -1;
+  }
+}
@@ -11,10 +11,13 @@
 
 #cmakedefine WITH_UMFPACK
 #cmakedefine WITH_MUMPS
+#cmakedefine HAVE_MUMPS_SINGLE
 #cmakedefine WITH_SUPERLU
 #cmakedefine WITH_PETSC
 #cmakedefine WITH_HDF5
 #cmakedefine WITH_EXODUSII
+#cmakedefine WITH_ZSTD
+#cmakedefine WITH_ZLIB
 #cmakedefine WITH_MPI
 
 // stacktrace
@@ -32,6 +35,9 @@
 #cmakedefine HAVE_NOX
 #cmakedefine HAVE_KOMPLEX
 
+// logging
+#cmakedefine HERMES_STRIP_HOT_INFO
+
 // no logo
 #cmakedefine HERMES_NO_LOGO
 
@@ -31,7 +31,19 @@ namespace Hermes
   enum HermesCommonApiParam
   {
     exceptionsPrintCallstack,
-    matrixSolverType
+    matrixSolverType,
+    /// Number of threads of the matrix and vector operations (products with vectors, sums), NUM_THREADS by default.
+    numThreadsAlgebra,
+    /// The hierarchical profiler (Hermes::Profiler) records the times of the regions, 0 (off) by default.
+    profiling,
+    /// The messages of Mixins::Loggable are written by a background thread (Hermes::BufferedLogger), 0 (off) by default.
+    bufferedLogging,
+    /// The large arrays of the matrices and vectors are zeroed (first touched) in parallel (Hermes::Algebra::first_touch_zero()),
+    /// 1 (on) by default.
+    parallelFirstTouch,
+    /// The number of the systems of one sparsity pattern each solver solves with SOLVER_AUTO before the fastest is selected,
+    /// 2 by default.
+    autotuningTrials
   };
 
   /// API Class containing settings for the whole HermesCommon.
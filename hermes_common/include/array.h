@@ -19,6 +19,8 @@
 #define __HERMES_COMMON_ARRAY_H
 
 #include <vector>
+#include <algorithm>
+#include <functional>
 #include <limits.h>
 
 #ifndef INVALID_IDX
@@ -40,6 +42,9 @@ namespace Hermes
     class Array
     {
     protected:
+      static bool page_less(const std::pair<TYPE*, TYPE*>& a, const std::pair<TYPE*, TYPE*>& b) { return std::less<TYPE*>()(a.first, b.first); }
+      static bool item_before_page(TYPE* item, const std::pair<TYPE*, TYPE*>& page) { return std::less<TYPE*>()(item, page.first); }
+
       Hermes::vector<TYPE*> pages; ///< \todo standard array for maximum access speed
       Hermes::vector<int> unused;
       int  size, nitems;
@@ -80,6 +85,29 @@ namespace Hermes
         }
       }
 
+      /// The pairs (page of the original, page of this copy) of the array copied by copy(), sorted by the original pages,
+      /// for translate().
+      void get_page_map(const Array& original, std::vector<std::pair<TYPE*, TYPE*> >& page_map) const
+      {
+        page_map.resize(pages.size());
+        for (unsigned i = 0; i < pages.size(); i++)
+          page_map[i] = std::make_pair(original.pages[i], pages[i]);
+        std::sort(page_map.begin(), page_map.end(), page_less);
+      }
+
+      /// The item of the copy with the same id as the item of the original (NULL for NULL), by the page map
+      /// of get_page_map() only, the item of the original is not read. The pointers between the items of a copy
+      /// are patched this way without the random accesses to the original.
+      static TYPE* translate(const std::vector<std::pair<TYPE*, TYPE*> >& page_map, TYPE* item)
+      {
+        if (item == NULL)
+          return NULL;
+        // The last original page starting at or before the item.
+        typename std::vector<std::pair<TYPE*, TYPE*> >::const_iterator it = std::upper_bound(page_map.begin(), page_map.end(), item, item_before_page);
+        --it;
+        return it->second + (item - it->first);
+      }
+
       /// Removes all elements from the array.
       void free()
       {
@@ -99,6 +127,22 @@ namespace Hermes
         this->append_only = append_only;
       }
 
+      /// Allocates the pages for (at least) the given number of items in advance,
+      /// appending items up to that number then does not touch the page table,
+      /// which allows reading the existing items while others are added (under a lock).
+      void reserve(int n)
+      {
+        while ((int)pages.size() << HERMES_PAGE_BITS < n)
+          pages.push_back(new TYPE[HERMES_PAGE_SIZE]);
+      }
+
+      /// Sorts the ids of the unused items, so that the order of their reuse does not depend
+      /// on the order of removals.
+      void sort_unused()
+      {
+        std::sort(unused.begin(), unused.end(), std::greater<int>());
+      }
+
       /// Wrapper function for Hermes::vector::add() for compatibility purposes.
       int add(TYPE item)
       {
@@ -116,7 +160,7 @@ namespace Hermes
         TYPE* item;
         if (unused.empty() || append_only)
         {
-          if (!(size & HERMES_PAGE_MASK))
+          if (!(size & HERMES_PAGE_MASK) && (size >> HERMES_PAGE_BITS) >= (int)pages.size())
           {
             TYPE* new_page = new TYPE[HERMES_PAGE_SIZE];
             pages.push_back(new_page);
@@ -274,6 +318,12 @@ namespace Hermes
       int get_size() const { return size; }
       int get_num_items() const { return nitems; }
 
+      /// Memory allocated by the array (all pages, including the unused items), in bytes.
+      std::size_t get_memory_size() const
+      {
+        return pages.size() * HERMES_PAGE_SIZE * sizeof(TYPE) + pages.capacity() * sizeof(TYPE*) + unused.capacity() * sizeof(int);
+      }
+
       TYPE& get(int id) const { return pages[id >> HERMES_PAGE_BITS][id & HERMES_PAGE_MASK]; }
       TYPE& operator[] (int id) const { return get(id); }
 
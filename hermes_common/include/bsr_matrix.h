@@ -0,0 +1,95 @@
+// This file is part of HermesCommon
+//
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Email: hpfem-group@unr.edu, home page: http://hpfem.org/.
+//
+// Hermes2D is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation; either version 2 of the License,
+// or (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/*! \file bsr_matrix.h
+\brief Block sparse row matrix.
+*/
+#ifndef __HERMES_COMMON_BSR_MATRIX_H
+#define __HERMES_COMMON_BSR_MATRIX_H
+
+#include "matrix.h"
+
+namespace Hermes
+{
+  namespace Algebra
+  {
+    /// \brief Sparse matrix made of dense blocks of block_size x block_size entries (BSR format).
+    /// \details The block (I, J) holds the entries of the rows I * block_size, ..., (I + 1) * block_size - 1
+    /// and the columns J * block_size, ..., (J + 1) * block_size - 1, it is stored whenever any of its entries
+    /// is in the structure. The blocks are stored by the block rows, each block row-wise. Suitable for
+    /// systems of block_size equations with the DOFs numbered by Space::assign_dofs_interleaved(), where the
+    /// unknowns of one node form one block: the indices are then stored once per block and the products
+    /// with vectors work on whole blocks of a fixed size, which the compiler unrolls and vectorizes.
+    /// Available for block_size 2, 3 and 4. The last block row and column are padded if the size of the matrix
+    /// is not a multiple of block_size.
+    template<typename Scalar, int block_size>
+    class HERMES_API BSRMatrix : public SparseMatrix<Scalar>
+    {
+    public:
+      BSRMatrix();
+      /// \brief Constructor with specific size.
+      /// @param[in] size size of matrix (number of rows and columns)
+      BSRMatrix(unsigned int size);
+      virtual ~BSRMatrix();
+
+      virtual void alloc();
+      virtual void free();
+      virtual Scalar get(unsigned int m, unsigned int n);
+      virtual void zero();
+      virtual void add(unsigned int m, unsigned int n, Scalar v);
+      virtual void add(unsigned int m, unsigned int n, Scalar **mat, int *rows, int *cols);
+      /// Adds the dense block by whole blocks of the matrix: the blocks covering the dense block in one block row
+      /// are looked up once and then follow one after another.
+      virtual void add_dense_block(unsigned int row, unsigned int col, unsigned int m, unsigned int n, Scalar** mat, unsigned int mat_col = 0);
+      virtual void add_to_diagonal(Scalar v);
+      virtual bool dump(FILE *file, const char *var_name, EMatrixDumpFormat fmt = DF_MATLAB_SPARSE, char* number_format = "%lf");
+      virtual unsigned int get_matrix_size() const;
+      /// The number of the stored entries, including the zeros of the stored blocks.
+      virtual unsigned int get_nnz() const;
+      virtual double get_fill_in() const;
+
+      /// Applies the matrix to vector_in and saves result to vector_out.
+      virtual void multiply_with_vector(Scalar* vector_in, Scalar* vector_out);
+      /// Multiplies matrix with a Scalar.
+      virtual void multiply_with_Scalar(Scalar value);
+      /// Duplicates a matrix (including allocation).
+      virtual BSRMatrix* duplicate();
+
+      /// Number of the block rows (and columns).
+      unsigned int get_num_block_rows() const { return this->num_block_rows; }
+      /// Number of the stored blocks.
+      unsigned int get_num_blocks() const { return this->num_blocks; }
+
+    protected:
+      /// Index of the block (I, J) in Bx, -1 if it is not stored.
+      int find_block(unsigned int block_row, unsigned int block_col) const;
+
+      /// The number of the block rows, the size divided by block_size and rounded up.
+      unsigned int num_block_rows;
+      /// Number of the stored blocks ( =  Bp[num_block_rows]).
+      unsigned int num_blocks;
+      /// Index to Bj, where each block row starts.
+      int *Bp;
+      /// Sorted block column indices of the blocks of each block row.
+      int *Bj;
+      /// Block entries, block_size * block_size per block.
+      Scalar *Bx;
+    };
+  }
+}
+#endif
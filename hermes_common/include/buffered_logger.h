@@ -0,0 +1,58 @@
+// This file is part of HermesCommon
+//
+// Hermes2D is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation; either version 2 of the License,
+// or (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/*! \file buffered_logger.h
+\brief Buffered backend of Mixins::Loggable for multithreaded runs.
+*/
+#ifndef __HERMES_COMMON_BUFFERED_LOGGER_H
+#define __HERMES_COMMON_BUFFERED_LOGGER_H
+
+#include "compat.h"
+
+namespace Hermes
+{
+  /// Maximum number of the threads that have their own ring buffer, the messages of the others are written directly.
+  #define HERMES_LOGGER_MAX_THREADS 256
+  /// Number of the messages one ring buffer holds.
+  #define HERMES_LOGGER_RING_SIZE 64
+
+  /// \brief Buffered backend of Mixins::Loggable.
+  /// \details When enabled (HermesCommonApi.set_integral_param_value(Hermes::bufferedLogging, 1)), the messages are not
+  /// written by the logging thread under the logger mutex, but stored into the ring buffer of the thread (one producer,
+  /// one consumer, no locking) and written to the console and to the log file by a single background thread, which
+  /// keeps the log files open. The messages are written in the order they were logged in.
+  /// A thread whose ring is full waits for the flusher, so that no message is lost.
+  /// Disabling the backend (or the end of the program) writes the remaining messages and closes the files.
+  class HERMES_API BufferedLogger
+  {
+  public:
+    static inline bool is_enabled() { return enabled; }
+
+    /// Called by Api::set_integral_param_value() for Hermes::bufferedLogging, starts / stops the flusher thread.
+    static void set_enabled(bool to_set);
+
+    /// Stores a message into the ring buffer of the calling thread.
+    /// \return False if the message could not be buffered (the backend is off, too many threads), the caller writes it then.
+    /// \param[in] log_file, src_function, src_file Have to be static strings (they are not copied), log_file may be NULL.
+    static bool push(char code, const char* text, const char* log_file, const char* src_function, const char* src_file, int src_line);
+
+    /// Waits until all the messages logged so far are written.
+    static void flush();
+
+  private:
+    static bool enabled;
+  };
+}
+#endif
@@ -60,6 +60,11 @@
 #else
   inline int omp_get_num_threads( ) { return 1; }
   inline int omp_get_thread_num( ) { return 0; }
+  typedef int omp_lock_t;
+  inline void omp_init_lock(omp_lock_t*) { }
+  inline void omp_destroy_lock(omp_lock_t*) { }
+  inline void omp_set_lock(omp_lock_t*) { }
+  inline void omp_unset_lock(omp_lock_t*) { }
 #endif
 
 typedef int int2[2];
@@ -30,17 +30,23 @@
 #include "solvers/petsc_solver.h"
 #include "solvers/umfpack_solver.h"
 #include "solvers/superlu_solver.h"
+#include "solvers/native_iter_solver.h"
+#include "solvers/precond_amg.h"
 #include "solvers/precond.h"
 #include "solvers/precond_ifpack.h"
 #include "solvers/precond_ml.h"
 #include "solvers/eigensolver.h"
+#include "solvers/auto_solver.h"
 #include "hermes_function.h"
 #include "compat.h"
 #include "callstack.h"
 #include "vector.h"
+#include "bsr_matrix.h"
 #include "tables.h"
 #include "array.h"
 #include "qsort.h"
 #include "ord.h"
 #include "mixins.h"
-#include "api.h"
\ No newline at end of file
+#include "api.h"
+#include "profiler.h"
+#include "buffered_logger.h"
\ No newline at end of file
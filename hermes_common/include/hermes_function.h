@@ -60,6 +60,14 @@ namespace Hermes
     /// One-dimensional function derivative integration order.
     virtual Hermes::Ord derivative(Hermes::Ord x) const;
 
+    /// Values at n points at once, out[i] = value(x[i]).
+    /// Called by the weak forms once per element with the values at all the quadrature points,
+    /// descendants with an expensive lookup per point (CubicSpline) override it.
+    virtual void value_batch(int n, const Scalar* x, Scalar* out) const;
+
+    /// Derivatives at n points at once, out[i] = derivative(x[i]).
+    virtual void derivative_batch(int n, const Scalar* x, Scalar* out) const;
+
     /// The function is constant.
     /// Returns the value of is_const.
     bool is_constant() const;
@@ -105,6 +113,10 @@ namespace Hermes
     virtual Hermes::Ord derivative_x(Hermes::Ord x, Hermes::Ord y) const;
     virtual Hermes::Ord derivative_y(Hermes::Ord x, Hermes::Ord y) const;
 
+    /// Values at n points (x[i], y[i]) at once, out[i] = value(x[i], y[i]), see Hermes1DFunction::value_batch().
+    /// A constant function only fills out.
+    virtual void value_batch(int n, const double* x, const double* y, Scalar* out) const;
+
     /// The function is constant.
     /// Returns the value of is_const.
     bool is_constant() const;
@@ -36,12 +36,26 @@ namespace Hermes
     SOLVER_MUMPS,
     SOLVER_SUPERLU,
     SOLVER_AMESOS,
-    SOLVER_AZTECOO
+    SOLVER_AZTECOO,
+    /// Built-in iterative solvers over the CSC matrix (Hermes::Solvers::NativeIterSolver).
+    SOLVER_NATIVE_ITERATIVE,
+    /// The fastest of the available solvers, selected by timing them (Hermes::Solvers::AutoLinearMatrixSolver), over the CSC matrix.
+    SOLVER_AUTO
   };
 
   /// \brief Namespace containing classes for vector / matrix operations.
   namespace Algebra
   {
+    /// \brief Zeroes size bytes of the array in parallel, the i-th thread of numThreadsAlgebra the i-th of equal parts, the same
+    /// distribution as of the static schedule of the parallel kernels of the matrices and the vectors (the products, the sums).
+    /// \details On a NUMA machine, a page of a new array is placed on the node of the thread touching it first, so the kernels
+    /// then access the memory of their own node. Small arrays, and all of them with HermesCommonApi parallelFirstTouch 0,
+    /// are zeroed by the calling thread.
+    HERMES_API void first_touch_zero(void* array, std::size_t size);
+
+    /// Copies size bytes in the same way as first_touch_zero() zeroes them.
+    HERMES_API void first_touch_copy(void* dest, const void* src, std::size_t size);
+
     /// Contains operation on dense matrices.
     namespace DenseMatrixOperations
     {
@@ -230,6 +244,12 @@ namespace Hermes
       /// elements which are returned in p[n].
       HERMES_API void choldc(double **a, int n, double p[]);
 
+      /// Computes the real Schur decomposition A = Q*T*Q^T of a general matrix a[n][n] by the reduction
+      /// to the Hessenberg form and the Francis double shift QR steps. On output, a is replaced by T,
+      /// which is upper triangular up to 2x2 diagonal blocks, each with a pair of complex conjugate
+      /// eigenvalues, and the orthogonal q[n][n] holds Q. Meant for small matrices (e.g. Butcher's tables).
+      HERMES_API void real_schur(double **a, int n, double **q);
+
       /// Solves the set of n linear equations A*x = b, where a is a positive-definite symmetric matrix.
       /// a[n][n] and p[n] are input as the output of the routine choldc. Only the lower
       /// subdiagonal portion of a is accessed. b[n] is input as the right-hand side vector. The
@@ -271,7 +291,8 @@ namespace Hermes
       /// next lines contains row column and value
       DF_PLAIN_ASCII,
       /// \brief Hermes binary format
-      ///
+      /// the arrays of the matrix / vector written as they are in the memory (one fwrite each), read back by load()
+      /// (the files are not portable between the platforms of a different endianness / sizeof(int))
       DF_HERMES_BIN,
       DF_MATRIX_MARKET ///< Matrix Market which can be read by pysparse library
     };
@@ -334,6 +355,13 @@ namespace Hermes
       /// @return true on succes
       virtual bool dump(FILE *file, const char *var_name, EMatrixDumpFormat fmt = DF_MATLAB_SPARSE, char* number_format = "%lf") = 0;
 
+      /// Reads the matrix written by dump() (the structure and the values), the current one is replaced.
+      /// The file has to be opened in the binary mode ("rb").
+      /// @param[in] file file handle
+      /// @param[in] fmt input file format
+      /// @return true on succes, false if the format is not supported by the matrix
+      virtual bool load(FILE *file, EMatrixDumpFormat fmt = DF_HERMES_BIN) { return false; }
+
       /// Get size of matrix
       /// @return size of matrix
       virtual unsigned int get_matrix_size() const = 0;
@@ -343,6 +371,41 @@ namespace Hermes
       unsigned int size;  ///< matrix size
     };
 
+    /// \brief The (CSC) nonzero pattern of a sparse matrix, shared by several matrices of the same structure.
+    /// The pattern is immutable and reference counted: the matrices allocated by SparseMatrix::alloc_with_pattern()
+    /// hold a reference, the last release() deletes it. A matrix that supports it (CSCMatrix) stores only its values
+    /// then, and the sums of such matrices (A + alpha M) just add the arrays of the values.
+    class HERMES_API SparsityPattern
+    {
+    public:
+      /// Takes the arrays over (deleted by delete []), the reference count is 1 (the caller's reference).
+      /// @param[in] size number of columns
+      /// @param[in] col_start index to rows, where each column starts (size is size + 1)
+      /// @param[in] rows sorted row indices of the nonzero entries of each column, without duplicities
+      /// @param[in] symmetric only the upper triangle of a symmetric matrix (SparseMatrix::set_symmetric_storage())
+      SparsityPattern(unsigned int size, int* col_start, int* rows, bool symmetric = false);
+
+      /// Adds a reference.
+      void add_reference();
+      /// Releases a reference, the last one deletes the pattern.
+      void release();
+
+      unsigned int get_size() const { return this->size; }
+      unsigned int get_nnz() const { return this->col_start[this->size]; }
+      const int* get_col_start() const { return this->col_start; }
+      const int* get_rows() const { return this->rows; }
+      bool is_symmetric() const { return this->symmetric; }
+
+    private:
+      ~SparsityPattern();
+
+      unsigned int size;
+      int* col_start;
+      int* rows;
+      bool symmetric;
+      int num_references;
+    };
+
     /// \brief General (abstract) sparse matrix representation in Hermes.
     template<typename Scalar>
     class HERMES_API SparseMatrix : public Matrix<Scalar> {
@@ -364,11 +427,57 @@ namespace Hermes
       /// @param[in] col  - column index
       virtual void pre_add_ij(unsigned int row, unsigned int col);
 
+      /// Allocates the matrix of a known structure, in place of prealloc(), pre_add_ij() and alloc().
+      ///
+      /// @param[in] n - number of unknowns
+      /// @param[in] col_start - index to rows, where each column starts (size is n + 1)
+      /// @param[in] rows - sorted row indices of the nonzero entries of each column, without duplicities
+      virtual void alloc_with_structure(unsigned int n, const int* col_start, const int* rows);
+
+      /// Allocates the matrix of the structure of the pattern, like alloc_with_structure(). Matrices that can do
+      /// it (CSCMatrix) share the pattern instead of copying it. The symmetric storage has to match the pattern.
+      virtual void alloc_with_pattern(SparsityPattern* pattern);
+
+      /// The shared pattern of the matrix (allocated by alloc_with_pattern()), NULL if there is none.
+      virtual SparsityPattern* get_sparsity_pattern() const { return NULL; }
+
       /// Finish manipulation with matrix (called before solving)
       virtual void finish() { }
 
+      /// Stores only the upper triangle (row <= column) of the matrix, which has to be symmetric. The entries
+      /// added below the diagonal are ignored, get() returns them from the upper triangle. Has to be set before
+      /// the structure of the matrix is created, only matrices with supports_symmetric_storage() can do that.
+      void set_symmetric_storage(bool symmetric);
+      bool is_symmetric_storage() const { return this->symmetric_storage; }
+      virtual bool supports_symmetric_storage() const { return false; }
+
       virtual unsigned int get_size() { return this->size; }
 
+      /// Direct access to the stored values, for repeated additions to the same entries without searching the structure:
+      /// get_position() gives the position of the entry (m, n), -1 if the entry is ignored (below the diagonal of the
+      /// symmetric storage), add_to_position() then adds to it. Valid until the structure of the matrix changes.
+      virtual bool supports_positions() const { return false; }
+      virtual int get_position(unsigned int m, unsigned int n)
+      {
+        throw Hermes::Exceptions::Exception("get_position() undefined.");
+        return -1;
+      }
+      virtual void add_to_position(int position, Scalar v)
+      {
+        throw Hermes::Exceptions::Exception("add_to_position() undefined.");
+      }
+
+      /// Adds the dense m x n block to the rows row, ..., row + m - 1 and the columns col, ..., col + n - 1,
+      /// e.g. the local matrix of an element of a discontinuous (L2) space, whose DOFs are contiguous.
+      /// The entry (i, j) of the block is mat[i][mat_col + j]. Matrices of a sorted compressed structure
+      /// override it to search the structure once per column of the block instead of once per entry.
+      virtual void add_dense_block(unsigned int row, unsigned int col, unsigned int m, unsigned int n, Scalar** mat, unsigned int mat_col = 0)
+      {
+        for (unsigned int i = 0; i < m; i++)
+          for (unsigned int j = 0; j < n; j++)
+            this->add(row + i, col + j, mat[i][mat_col + j]);
+      }
+
       /// Add matrix
       /// @param mat matrix to add
       virtual void add_sparse_matrix(SparseMatrix* mat)
@@ -376,6 +485,13 @@ namespace Hermes
         throw Hermes::Exceptions::Exception("add_sparse_matrix() undefined.");
       };
 
+      /// Add matrix multiplied by alpha, in O(nnz) for the matrices of the same (shared) pattern.
+      /// Matrices must be the same type of solver, the target has to contain the structure of mat.
+      virtual void add_scaled_sparse_matrix(Scalar alpha, SparseMatrix<Scalar>* mat)
+      {
+        throw Hermes::Exceptions::Exception("add_scaled_sparse_matrix() undefined.");
+      };
+
       /// Add matrix to diagonal
       /// Matrices must be the same type of solver
       /// @param[in] num_stages matrix is added to num_stages positions. num_stages * size(added matrix) = size(target matrix)
@@ -385,6 +501,17 @@ namespace Hermes
         throw Hermes::Exceptions::Exception("add_sparse_to_diagonal_blocks() undefined.");
       };
 
+      /// Add matrix multiplied by coefficients[i][j] to the block (i, j), for all the nonzero coefficients.
+      /// The target has to contain the structure of mat in these blocks, the matrices must be the same type of solver.
+      /// @param[in] num_stages number of blocks in a row. num_stages * size(added matrix) = size(target matrix)
+      /// @param[in] mat added matrix
+      /// @param[in] coefficients num_stages times num_stages multipliers of the blocks
+      virtual void add_sparse_to_blocks(int num_stages, SparseMatrix<Scalar>* mat, Scalar** coefficients)
+      {
+        throw Hermes::Exceptions::Exception("add_sparse_to_blocks() undefined.");
+      };
+      virtual bool supports_sparse_to_blocks() const { return false; }
+
       /// Return the number of entries in a specified row
       ///
       /// @param[in] row - index of the row
@@ -475,6 +602,9 @@ namespace Hermes
 
       /// mem stat
       int mem_size;
+
+      /// See set_symmetric_storage().
+      bool symmetric_storage;
     };
 
     /// \brief General (abstract) vector representation in Hermes.
@@ -543,6 +673,13 @@ namespace Hermes
       virtual bool dump(FILE *file, const char *var_name,
         EMatrixDumpFormat fmt = DF_MATLAB_SPARSE, char* number_format = "%lf") = 0;
 
+      /// Reads the vector written by dump(), the vector is reallocated to the size stored in the file.
+      /// The file has to be opened in the binary mode ("rb").
+      /// @param[in] file file handle
+      /// @param[in] fmt input file format
+      /// @return true on succes, false if the format is not supported by the vector
+      virtual bool load(FILE *file, EMatrixDumpFormat fmt = DF_HERMES_BIN) { return false; }
+
     protected:
       /// size of vector
       unsigned int size;
@@ -41,6 +41,15 @@ namespace Hermes
   /// could use - logging, time measurement, ...
   namespace Mixins
   {
+    /// Info from hot loops (over elements, integration points, ...) of a Loggable, removed at compile time
+    /// (including the evaluation of the arguments) if Hermes is built with HERMES_STRIP_HOT_INFO.
+    /// Usage: HERMES_HOT_INFO("Element %i assembled.", e->id);
+#ifdef HERMES_STRIP_HOT_INFO
+  #define HERMES_HOT_INFO(...) ((void)0)
+#else
+  #define HERMES_HOT_INFO(...) this->info(__VA_ARGS__)
+#endif
+
     /// \brief Class the output of which is loggable, i.e. that uses functionality of info(), warn()
     /// Contains the class Static with the following usage:
     /// Anywhere in your program you can write Hermes::Mixins::Loggable::Static::info("whatever you want to output").
@@ -246,6 +255,60 @@ namespace Hermes
       virtual void on_step_end();
       virtual void on_finish();
     };
+
+    /// \brief Class that records the course of the iterations of a solver.
+    /// After a solve, get_iteration_records() returns one record per iteration (the records of the previous solve are discarded).
+    /// For RungeKutta, these are the Newton's iterations of the last time step, or its stages for an explicit method.
+    /// The records can be also written to a CSV or JSON file by export_iteration_records().
+    class HERMES_API IterationRecordable
+    {
+    public:
+      /// One iteration.
+      struct HERMES_API IterationRecord
+      {
+        IterationRecord(int iteration = 0);
+        /// Number of the iteration.
+        int iteration;
+        /// Convergence measure of the iteration: the residual norm at its beginning, the relative change of the solution for the Picard's method,
+        /// 0.0 where there is no residual (explicit Runge-Kutta stages).
+        double residual_norm;
+        /// Damping coefficient of the step (1.0 for no damping).
+        double damping_coefficient;
+        /// Time (in seconds) spent in the assembling of the residual and the matrix.
+        double assembly_time;
+        /// Time (in seconds) spent in the linear solver.
+        double solve_time;
+        /// The factorization of the previous iteration was reused.
+        bool factorization_reused;
+        /// Number of iterations of the linear solver, -1 for a direct solver or no solve.
+        int linear_iterations;
+      };
+
+      /// Format of export_iteration_records().
+      enum IterationRecordsFormat
+      {
+        IterationRecordsCSV,
+        IterationRecordsJSON
+      };
+
+      IterationRecordable();
+
+      /// Returns the records of the last solve.
+      const std::vector<IterationRecord>& get_iteration_records() const;
+
+      /// Writes the records of the last solve to the file filename.
+      void export_iteration_records(const char* filename, IterationRecordsFormat format = IterationRecordsCSV) const;
+
+    protected:
+      /// Discards all records.
+      void clear_iteration_records();
+      /// Appends a new record and returns it.
+      IterationRecord& add_iteration_record(int iteration);
+      /// Returns the last record (add_iteration_record() must have been called before).
+      IterationRecord& last_iteration_record();
+
+      std::vector<IterationRecord> iteration_records;
+    };
   }
 }
 #endif
@@ -0,0 +1,91 @@
+// This file is part of HermesCommon
+//
+// Hermes2D is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation; either version 2 of the License,
+// or (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/*! \file profiler.h
+\brief Hierarchical profiler of the phases of the computation.
+*/
+#ifndef __HERMES_COMMON_PROFILER_H
+#define __HERMES_COMMON_PROFILER_H
+
+#include "compat.h"
+#include <iostream>
+
+namespace Hermes
+{
+  /// Maximum number of the threads the profiler keeps the times of, the regions of the others are ignored.
+  #define HERMES_PROFILER_MAX_THREADS 256
+
+  /// \brief Hierarchical, thread-aware profiler.
+  /// \details The regions (see ProfilerRegion) entered by one thread form a tree, the region entered inside another one
+  /// is its child. Every thread (also of the OpenMP teams running concurrently) accumulates the times and the numbers of calls
+  /// of its own tree, without any locking, using its own Mixins::TimeMeasurable clock. The report merges the trees of the threads:
+  /// a region entered by a thread outside of all its other regions (typically in a parallel loop) is placed under the first
+  /// region of the same name of the first profiled thread, if there is one.
+  /// The profiler is switched on and off by the parameter Hermes::profiling of HermesCommonApi
+  /// (HermesCommonApi.set_integral_param_value(Hermes::profiling, 1)), a disabled ProfilerRegion costs one test.
+  /// reset() and report() must not be called while other threads are in a region.
+  class HERMES_API Profiler
+  {
+  public:
+    static inline bool is_enabled() { return enabled; }
+
+    /// Called by Api::set_integral_param_value() for Hermes::profiling.
+    static void set_enabled(bool to_set);
+
+    /// Enters a region of the calling thread, the name has to be a string literal (it is not copied).
+    static void enter(const char* name);
+
+    /// Leaves the last entered region of the calling thread.
+    static void leave();
+
+    /// Zeroes all the times and the numbers of calls.
+    static void reset();
+
+    /// Writes the tree of the regions with the time summed over the threads, the maximum time of one thread,
+    /// the share of the parent region, the number of calls and the number of threads.
+    static void report(std::ostream& out = std::cout);
+
+  private:
+    static bool enabled;
+  };
+
+  /// \brief Scoped region of Profiler, entered by the constructor and left by the destructor (if the profiler is enabled).
+  /// Typical usage:
+  /// void DiscreteProblem<Scalar>::assemble(...)
+  /// {
+  ///   Hermes::ProfilerRegion profiler_region("DiscreteProblem::assemble");
+  ///   ...
+  /// }
+  class HERMES_API ProfilerRegion
+  {
+  public:
+    inline ProfilerRegion(const char* name) : active(Profiler::is_enabled())
+    {
+      if(active)
+        Profiler::enter(name);
+    }
+
+    inline ~ProfilerRegion()
+    {
+      if(active)
+        Profiler::leave();
+    }
+
+  private:
+    /// The region was entered, it has to be left even if the profiler was switched off meanwhile.
+    bool active;
+  };
+}
+#endif
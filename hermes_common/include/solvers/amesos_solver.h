@@ -51,6 +51,8 @@ namespace Hermes
 
       virtual ~AmesosSolver();
       virtual bool solve();
+      /// The right hand sides are given to Amesos as one Epetra_MultiVector.
+      virtual bool solve(int num_rhs, Scalar* rhs_block);
       virtual int get_matrix_size();
     protected:
       static Amesos factory;
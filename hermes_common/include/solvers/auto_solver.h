@@ -0,0 +1,137 @@
+// This file is part of HermesCommon
+//
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Email: hpfem-group@unr.edu, home page: http://hpfem.org/.
+//
+// Hermes2D is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation; either version 2 of the License,
+// or (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/*! \file auto_solver.h
+\brief Linear solver selecting the fastest of the available backends by timing them (SOLVER_AUTO).
+*/
+#ifndef __HERMES_COMMON_AUTO_SOLVER_H_
+#define __HERMES_COMMON_AUTO_SOLVER_H_
+#include "config.h"
+#ifdef WITH_UMFPACK
+#include "linear_matrix_solver.h"
+#include "umfpack_solver.h"
+#include "precond.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Hermes
+{
+  namespace Solvers
+  {
+    /// \brief Autotuning linear solver, created by create_linear_solver() for the matrixSolverType SOLVER_AUTO.
+    /// \details The matrix is assembled in the CSC format (UMFPackMatrix). The first systems of each sparsity pattern are solved
+    /// in turns by the candidates, each of them autotuningTrials times (HermesCommonApi): UMFPACK, MUMPS, SuperLU,
+    /// AztecOO with ML and the built-in CG with AMG and GMRES with ILU(0), those of them that are available.
+    /// A candidate is timed including the copy of the system into its format, it is dropped if it fails or if
+    /// the relative residual of its solution is above 1e-6 (the system is then solved by the next one).
+    /// The fastest candidate then solves all the following systems of the pattern.
+    /// The choices are shared by all instances (keyed by the hash of the pattern), save_choices() and load_choices()
+    /// keep them for the later runs, e.g.:
+    /// HermesCommonApi.set_integral_param_value(Hermes::matrixSolverType, SOLVER_AUTO);
+    /// AutoLinearMatrixSolver<double>::load_choices("solvers.txt");
+    /// ... solve ...
+    /// AutoLinearMatrixSolver<double>::save_choices("solvers.txt");
+    ///
+    /// @ingroup solvers
+    template <typename Scalar>
+    class HERMES_API AutoLinearMatrixSolver : public LinearMatrixSolver<Scalar>
+    {
+    public:
+      AutoLinearMatrixSolver(CSCMatrix<Scalar> *m, Vector<Scalar> *rhs);
+      virtual ~AutoLinearMatrixSolver();
+
+      virtual bool solve();
+      virtual int get_matrix_size();
+
+      /// Passed to the candidate solving the system, a candidate solving a different system than the last time
+      /// refactorizes (keeping its symbolic analysis for the same pattern) instead of HERMES_REUSE_FACTORIZATION_COMPLETELY.
+      virtual void set_factorization_scheme(FactorizationScheme reuse_scheme);
+
+      /// The name of the candidate that solved the last system, NULL before the first solve().
+      const char* get_last_solver_name() const;
+
+      /// The names of the candidates available in this build.
+      static const std::vector<std::string>& get_candidate_names();
+
+      /// Writes the selected candidates (one line per pattern: the hash of the pattern, the name of the candidate).
+      /// @return false if the file could not be written.
+      static bool save_choices(const char* filename);
+
+      /// Reads the file written by save_choices(), the patterns in it are not tuned again.
+      /// The candidates not available in this build are ignored.
+      /// @return false if the file could not be read.
+      static bool load_choices(const char* filename);
+
+      /// Forgets all the timings and the choices.
+      static void reset_choices();
+
+    protected:
+      /// The timings of one pattern.
+      struct Tuning
+      {
+        /// The selected candidate, -1 while tuning.
+        int selected;
+        std::vector<double> times;
+        std::vector<int> trials;
+        std::vector<bool> failed;
+      };
+
+      /// The data of one candidate in this instance, created with its first use.
+      struct Candidate
+      {
+        /// Copies of the matrix and the right hand side in the format of the candidate, NULL if the system is used in place.
+        SparseMatrix<Scalar>* matrix;
+        Vector<Scalar>* rhs;
+        LinearMatrixSolver<Scalar>* solver;
+        Precond<Scalar>* precond;
+      };
+
+      /// The candidate to solve the next system of the pattern, -1 if all of them failed.
+      /// @param[out] tuning The candidate is being tuned (not selected yet).
+      static int next_candidate(unsigned long long hash, bool& tuning);
+
+      /// Records the result of a solve, selects the fastest candidate once all of them are tuned.
+      /// @return true if the candidate has just been selected.
+      static bool record(unsigned long long hash, int candidate, bool success, double time);
+
+      /// Creates the solver (and the copies of the system) of the candidate.
+      void create_candidate(int candidate);
+      void free_candidates();
+
+      /// Solves the system with the candidate, b is the extracted right hand side.
+      bool solve_with(int candidate, Scalar* b);
+
+      /// The relative residual of the solution x of the system.
+      double relative_residual(Scalar* b, Scalar* x);
+
+      CSCMatrix<Scalar> *m;
+      Vector<Scalar> *rhs;
+
+      std::vector<Candidate> candidates;
+      /// The pattern the copies of the candidates were created for.
+      unsigned long long structure_hash;
+      unsigned int reuse_scheme;
+      int last_candidate;
+
+      static std::map<unsigned long long, Tuning> tunings;
+    };
+  }
+}
+#endif
+#endif
@@ -58,6 +58,13 @@ namespace Hermes
       virtual ~AztecOOSolver();
       virtual bool solve();
       virtual int get_matrix_size();
+
+      /// The reuse of the preconditioner set by set_precond(Precond<Scalar>*) in the following solve():
+      /// HERMES_REUSE_FACTORIZATION_COMPLETELY keeps it as it is, the other schemes keep its symbolic setup and only
+      /// recompute it (Precond::recompute(), e.g. the ILU factors on the kept graph, the ML levels on the kept aggregation)
+      /// if the pattern of the matrix did not change, and build it from scratch otherwise.
+      /// Default: HERMES_FACTORIZE_FROM_SCRATCH, i.e. the numerical recomputation for an unchanged pattern.
+      virtual void set_factorization_scheme(FactorizationScheme reuse_scheme);
     protected:
       virtual int get_num_iters();
       virtual double get_residual();
@@ -72,13 +79,22 @@ namespace Hermes
       /// Parameter setting function
       void set_param(int param, double value);
 
+      /// Creates and computes pc for the matrix pm, or recomputes it (see set_factorization_scheme()).
+      void setup_precond(EpetraMatrix<Scalar>* pm);
+
       AztecOO aztec;    ///< Instance of the Aztec solver.
       EpetraMatrix<Scalar> *m;
       EpetraVector<Scalar> *rhs;
 
       Precond<Scalar> *pc;
 
+      unsigned int precond_reuse_scheme;
+      /// The matrix pc was computed for (NULL if it was not) and the hash of its pattern.
+      Epetra_CrsMatrix *precond_epetra_mat;
+      unsigned long long precond_structure_hash;
+
       template<typename T> friend LinearMatrixSolver<T>* create_linear_solver(Matrix<T>* matrix, Vector<T>* rhs);
+      template<typename T> friend class AutoLinearMatrixSolver;
     };
   }
 }
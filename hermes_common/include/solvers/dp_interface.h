@@ -59,6 +59,11 @@ namespace Hermes
       virtual void assemble(Scalar* coeff_vec, Vector<Scalar>* rhs = NULL,
         bool force_diagonal_blocks = false, Table* block_weights = NULL) = 0;
 
+      /// Jacobian-vector product without the matrix: result = J(coeff_vec) direction, the matrix forms
+      /// are applied to the direction as they are assembled (analytic, not by finite differences).
+      /// @return false if the problem does not provide the product (the default).
+      virtual bool assemble_jacobian_vector_product(Scalar* coeff_vec, Scalar* direction, Scalar* result) { return false; }
+
     protected:
       /// Preassembling.
       /// Precalculate matrix sparse structure.
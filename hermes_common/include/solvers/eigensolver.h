@@ -17,76 +17,100 @@
 // along with Hermes2D; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 /*! \file eigensolver.h
-    \brief class for solving Eigenproblems. Currently using Python.
+    \brief Built-in solver of symmetric (generalized) eigenproblems.
 */
 #ifndef __HERMES_EIGENSOLVER_H
 #define __HERMES_EIGENSOLVER_H
 
-#include "config.h"
-#ifdef WITH_PYTHON
-
 #include "matrix.h"
-
-#include "python_API/python_api.h"
-
-// RCP
-#ifndef WITH_TRILINOS
-#include "Teuchos_RCP.hpp"
-#else
-#include "Teuchos_RCP.hpp"
-#endif
+#include "linear_matrix_solver.h"
 
 namespace Hermes
 {
-
-using Teuchos::RCP;
-using Teuchos::Ptr;
-using Teuchos::rcp;
-using Teuchos::null;
-
-
-template <typename Scalar>
-class HERMES_API EigenSolver
-{
-public:
-    EigenSolver(const RCP<Algebra::Matrix<Scalar> > &A, const RCP<Algebra::Matrix<Scalar> > &B);
-
-
-    // Solves for 'n_eigs' eigenvectors, around the 'target_value'. Use
-    // 'get_eigenvalue' and 'get_eigenvector' to retrieve the
-    // eigenvalues/eigenvectors:
-    void solve(int n_eigs = 4, double target_value = -1, double tol = 1e-6,
-            int max_iter = 150);
-
-    // Returns the number of calculated eigenvalues
-    int get_n_eigs()
+  namespace Solvers
+  {
+    using namespace Hermes::Algebra;
+
+    /// \brief Solver of the eigenproblem A x = lambda B x, A symmetric, B symmetric positive definite (or the identity).
+    /// \details Shift-and-invert Krylov-Schur method (thick restarted Lanczos): the eigenvalues closest to the target value
+    /// are the dominant ones of (A - target B)^{-1} B, which is self-adjoint in the B inner product.
+    /// The shifted matrix is factorized once (by the solver create_linear_solver() returns for it), each Krylov step is then
+    /// one solve with the factors and one product with B. The basis is B-orthogonalized (twice) in full, so that the method
+    /// does not lose the orthogonality, and on each restart the Ritz vectors of the n_eigs + (subspace size - n_eigs) / 2
+    /// eigenvalues closest to the target are kept.
+    /// The matrices have to come from create_matrix() (the shifted matrix is A->duplicate() + (-target) B) and the sparsity
+    /// pattern of A has to contain the one of B (true for the matrices assembled on the same space).
+    /// Typical usage:
+    /// EigenSolver<double> es(matrix_A, matrix_B);
+    /// es.solve(6, 2.0, 1e-8);
+    /// for(int i = 0; i < es.get_n_eigs(); i++) { es.get_eigenvalue(i); es.get_eigenvector(i, &vec, &n); }
+    ///
+    /// @ingroup solvers
+    template <typename Scalar>
+    class HERMES_API EigenSolver : public Hermes::Mixins::Loggable
     {
-        return this->n_eigs;
-    }
-    // Returns the i-th eigenvalue
-    double get_eigenvalue(int i);
-    // Returns the i-th eigenvector. A pointer will be returned into an
-    // internal array, as well as the size of the vector. You don't own the
-    // memory and it will be deallocated once the EigenSolver() class is
-    // deleted. You need to make a copy of it if you want to store it
-    // permanently.
-    void get_eigenvector(int i, double **vec, int *n);
-
-    void print_eigenvalues()
-    {
-        printf("Eigenvalues:\n");
-        for (int i = 0; i < this->get_n_eigs(); i++)
-            printf("%3d: %f\n", i, this->get_eigenvalue(i));
-    }
-
-private:
-    RCP<Algebra::Matrix<Scalar> > A, B;
-    int n_eigs;
-    Python p;
-};
-
+    public:
+      /// \param[in] B NULL for the standard eigenproblem A x = lambda x.
+      /// The matrices are not owned (nor changed) by the solver.
+      EigenSolver(SparseMatrix<Scalar>* A, SparseMatrix<Scalar>* B = NULL);
+      virtual ~EigenSolver();
+
+      /// Solves for 'n_eigs' eigenvectors, with the eigenvalues closest to the 'target_value'. Use
+      /// 'get_eigenvalue' and 'get_eigenvector' to retrieve the eigenvalues/eigenvectors, the closest first.
+      /// The target value must not be an eigenvalue (the shifted matrix would be singular).
+      /// \param[in] tol Relative tolerance of the residual of the eigenpairs.
+      /// \param[in] max_iter Maximum number of restarts, if exceeded, the converged eigenpairs are kept and a warning is issued.
+      void solve(int n_eigs = 4, double target_value = 0.0, double tol = 1e-6, int max_iter = 150);
+
+      /// Sets the dimension of the Krylov subspace, has to be greater than n_eigs.
+      /// Default: 0 meaning max(2 * n_eigs + 1, 20) (at most the size of the matrix).
+      void set_subspace_size(int subspace_size);
+
+      /// Returns the number of calculated eigenvalues.
+      int get_n_eigs() const;
+
+      /// Returns the i-th eigenvalue.
+      double get_eigenvalue(int i) const;
+
+      /// Returns the i-th eigenvector (B-normalized). A pointer will be returned into an
+      /// internal array, as well as the size of the vector. You don't own the
+      /// memory and it will be deallocated once the EigenSolver() class is
+      /// deleted. You need to make a copy of it if you want to store it
+      /// permanently.
+      void get_eigenvector(int i, double **vec, int *n) const;
+
+      /// The number of restarts and of the solves with the factorized shifted matrix of the last solve().
+      int get_num_restarts() const;
+      int get_num_solves() const;
+
+      void print_eigenvalues() const;
+
+    private:
+      /// out = B in.
+      void apply_B(Scalar* in, Scalar* out);
+
+      /// B-orthogonalizes w (Bw = B w on output) against the first k basis vectors, the coefficients are added to h.
+      /// Returns the B-norm of the result.
+      double orthogonalize(Scalar* w, Scalar* Bw, int k, Scalar* h);
+
+      void free_eigenpairs();
+
+      SparseMatrix<Scalar>* A;
+      SparseMatrix<Scalar>* B;
+      unsigned int size;
+      int subspace_size;
+
+      int n_eigs;
+      double* eigenvalues;
+      double** eigenvectors;
+
+      int num_restarts;
+      int num_solves;
+
+      /// Krylov basis (subspace_size + 1 vectors) and B times the basis vectors.
+      Scalar** V;
+      Scalar** BV;
+    };
+  }
 }
-
-#endif
-
 #endif
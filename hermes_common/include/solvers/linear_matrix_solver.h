@@ -49,9 +49,10 @@ namespace Hermes
     ///
     /// <b>Enabled solvers:</b>
     ///&nbsp;-\c SuperLU - performs reordering, scaling and factorization separately. When the
-    ///&nbsp;              multithreaded version is used, scaling is performed during the factorization
-    ///&nbsp;              phase (if neccessary) and thus \c HERMES_REUSE_MATRIX_REORDERING_AND_SCALING
-    ///&nbsp;              and \c HERMES_REUSE_MATRIX_REORDERING have the same effect.
+    ///&nbsp;              multithreaded version (SuperLU_MT, numThreadsAlgebra threads) is used, scaling
+    ///&nbsp;              is performed during the factorization phase (if neccessary), so
+    ///&nbsp;              \c HERMES_REUSE_MATRIX_REORDERING_AND_SCALING reuses the column permutation,
+    ///&nbsp;              the elimination tree and the row permutation, but not the scaling.
     ///&nbsp;-\c UMFPack - like the MT version of SuperLU, performs scaling and factorization in one step.
     ///&nbsp;              \c HERMES_REUSE_MATRIX_REORDERING_AND_SCALING has thus the same effect as
     ///&nbsp;              \c HERMES_REUSE_MATRIX_REORDERING (saves the preceding symbolic analysis step).
@@ -100,6 +101,12 @@ namespace Hermes
       /// @return true on succes
       virtual bool solve() = 0;
 
+      /// Solves the system with num_rhs right hand sides, the matrix is factorized only once.
+      /// The right hand sides are stored one after another in rhs_block (num_rhs * get_matrix_size() values),
+      /// the solutions are then stored the same way in the solution vector (get_sln_vector()).
+      /// @return true on succes
+      virtual bool solve(int num_rhs, Scalar* rhs_block);
+
       /// Get solution vector.
       /// @return solution vector ( #sln )
       Scalar *get_sln_vector();
@@ -119,6 +126,19 @@ namespace Hermes
       /// Set factorization scheme to default.
       virtual void set_factorization_scheme();
 
+      /// Sets the matrix the preconditioner is built from instead of the system matrix, typically a cheaper
+      /// approximation of it (the same problem assembled with lower integration orders, see
+      /// NewtonSolver::set_precond_quadrature_order_reduction()). It has to have the size of the system matrix
+      /// and to live until the solve(), NULL builds the preconditioner from the system matrix again.
+      /// Supported by the iterative solvers and by PETSc, the others throw.
+      virtual void set_precond_matrix(Matrix<Scalar>* precond_matrix);
+
+      /// Symbolic analysis of the pattern of the matrix alone, which has to be final (allocated), its values may be
+      /// being assembled meanwhile (by other threads, see DiscreteProblem::set_structure_analysis()).
+      /// The next factorization keeps the analysis if the pattern does not change.
+      /// @return false if the solver has no such analysis (the default), or if it failed.
+      virtual bool analyze_structure() { return false; }
+
     protected:
       /// Solution vector.
       Scalar *sln;
@@ -134,12 +154,48 @@ namespace Hermes
     {
     public:
       DirectSolver(unsigned int factorization_scheme = HERMES_FACTORIZE_FROM_SCRATCH)
-        : LinearMatrixSolver<Scalar>(), factorization_scheme(factorization_scheme) {};
+        : LinearMatrixSolver<Scalar>(), mixed_precision(false), max_refinement_steps(10), refinement_tolerance(1e-12),
+        num_refinement_steps(0), factorization_scheme(factorization_scheme), structure_hash(0) {};
+
+      /// Cheap hash of a sparsity pattern in the compressed column format.
+      static unsigned long long get_structure_hash(unsigned int size, unsigned int nnz, const int* Ap, const int* Ai);
+
+      /// Mixed precision: the matrix is factorized in single precision and the solution is improved by the iterative
+      /// refinement, the residual being calculated in double precision by SparseMatrix::multiply_with_vector(),
+      /// until its norm is below tolerance times the norm of the right hand side, or after max_steps corrections.
+      /// Available with SuperLU (sequential) and MUMPS (if smumps_seq / cmumps_seq were found, otherwise MumpsSolver warns
+      /// and stays in double precision), UMFPACK has no single precision factorization and ignores it.
+      virtual void set_mixed_precision(bool to_set = true, int max_steps = 10, double tolerance = 1e-12);
+
+      /// The number of the corrections of the last solve() in the mixed precision (the largest over the right hand sides).
+      int get_num_refinement_steps() const;
 
     protected:
       virtual void set_factorization_scheme(FactorizationScheme reuse_scheme);
 
+      /// Iterative refinement of the solution x of A x = b, the corrections are solved by solve_low_precision().
+      /// @param[in] x On input the solution by the low precision factorization.
+      /// @return true if the tolerance was reached.
+      bool refine(SparseMatrix<Scalar>* A, Scalar* b, Scalar* x);
+
+      /// Solves the system by the single precision factorization.
+      virtual bool solve_low_precision(Scalar* b, Scalar* x);
+
+      bool mixed_precision;
+      int max_refinement_steps;
+      double refinement_tolerance;
+      int num_refinement_steps;
+
+      /// Compares the pattern of the matrix to be factorized with the one of the last symbolic analysis.
+      /// The analysis (if have_analysis) is kept for a matrix with the same pattern even if it is factorized
+      /// from scratch (typically a matrix recreated in the next time step), and it is redone for a changed pattern.
+      /// @return The factorization scheme to use instead of eff_fact_scheme.
+      int check_structure(int eff_fact_scheme, bool have_analysis, unsigned int size, unsigned int nnz, const int* Ap, const int* Ai);
+
       unsigned int factorization_scheme;
+
+      /// Hash of the pattern of the last symbolic analysis.
+      unsigned long long structure_hash;
     };
 
     /// \brief  Abstract class for defining interface for iterative solvers.
@@ -148,7 +204,7 @@ namespace Hermes
     class IterSolver : public LinearMatrixSolver<Scalar>
     {
     public:
-      IterSolver() : LinearMatrixSolver<Scalar>(), max_iters(10000), tolerance(1e-8), precond_yes(false) {};
+      IterSolver() : LinearMatrixSolver<Scalar>(), max_iters(10000), tolerance(1e-8), precond_yes(false), precond_matrix(NULL) {};
 
       virtual int get_num_iters() = 0;
       virtual double get_residual() = 0;
@@ -165,10 +221,14 @@ namespace Hermes
 
       virtual void set_precond(Precond<Scalar> *pc) = 0;
 
+      virtual void set_precond_matrix(Matrix<Scalar>* precond_matrix);
+
     protected:
       int max_iters;          ///< Maximum number of iterations.
       double tolerance;       ///< Convergence tolerance.
       bool precond_yes;
+      /// The matrix the preconditioner is built from, NULL for the system matrix.
+      Matrix<Scalar>* precond_matrix;
     };
 
     /// \brief Function returning a solver according to the users's choice.
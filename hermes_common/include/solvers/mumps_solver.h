@@ -31,6 +31,10 @@ extern "C"
 #include <mumps_c_types.h>
 #include <dmumps_c.h>
 #include <zmumps_c.h>
+#ifdef HAVE_MUMPS_SINGLE
+#include <smumps_c.h>
+#include <cmumps_c.h>
+#endif
 }
 
 #ifdef WITH_MPI
@@ -59,6 +63,11 @@ namespace Hermes
       typedef ZMUMPS_STRUC_C mumps_struct;
     /** Type for storing scalar number in Mumps complex structures */
       typedef ZMUMPS_COMPLEX mumps_Scalar;
+#ifdef HAVE_MUMPS_SINGLE
+    /// The single precision counterparts (mixed precision).
+      typedef CMUMPS_STRUC_C mumps_single_struct;
+      typedef CMUMPS_COMPLEX mumps_single_Scalar;
+#endif
     };
 
     /** Type for storing number in Mumps real structures */
@@ -69,6 +78,11 @@ namespace Hermes
       typedef DMUMPS_STRUC_C mumps_struct;
     /** Type for storing scalar number in Mumps real structures */
       typedef double mumps_Scalar;
+#ifdef HAVE_MUMPS_SINGLE
+    /// The single precision counterparts (mixed precision).
+      typedef SMUMPS_STRUC_C mumps_single_struct;
+      typedef float mumps_single_Scalar;
+#endif
     };
 
     /** \brief Matrix used with MUMPS solver */
@@ -104,6 +118,9 @@ namespace Hermes
       /// @param[in] mat added matrix
       virtual void add_as_block(unsigned int i, unsigned int j, MumpsMatrix* mat);
 
+      /// MUMPS factorizes the symmetric matrices given by one triangle.
+      virtual bool supports_symmetric_storage() const { return true; }
+
       /// Applies the matrix to vector_in and saves result to vector_out.
       void multiply_with_vector(Scalar* vector_in, Scalar* vector_out);
       /// Multiplies matrix with a Scalar.
@@ -114,13 +131,13 @@ namespace Hermes
       MumpsMatrix* duplicate();
 
     protected:
-      /// MUMPS specific data structures for storing the system matrix (CSC format).
+      /// MUMPS specific data structures for storing the system matrix (CSC format, which is also the coordinate
+      /// format MUMPS is given: the row indices of the CSC structure are stored once, from 1, as MUMPS wants them).
       unsigned int nnz;          ///< Number of non-zero elements.
-      int *irn;         ///< Row indices.
-      int *jcn;         ///< Column indices.
+      int *irn;         ///< Row indices (from 1) of values in Ax.
+      int *jcn;         ///< Column indices (from 1) of values in Ax.
       typename mumps_type<Scalar>::mumps_Scalar *Ax; ///< Matrix entries (column-wise).
-      int *Ai;          ///< Row indices of values in Ax.
-      unsigned int *Ap;          ///< Index to Ax/Ai, where each column starts.
+      unsigned int *Ap;          ///< Index to Ax/irn, where each column starts.
 
       friend class Solvers::MumpsSolver<Scalar>;
       template<typename T> friend SparseMatrix<T>*  create_matrix();
@@ -171,7 +188,36 @@ namespace Hermes
       virtual ~MumpsSolver();
 
       virtual bool solve();
+      /// All right hand sides are given to MUMPS at once (NRHS).
+      virtual bool solve(int num_rhs, Scalar* rhs_block);
       virtual int get_matrix_size();
+      /// The analysis (JOB = 1) without the values (no maximum transversal, ICNTL(6) = 0), not with the distributed input.
+      virtual bool analyze_structure();
+
+#ifdef WITH_MPI
+      /// Distributed input (ICNTL(18) = 3): every process of MPI_COMM_WORLD gives the entries it assembled
+      /// (e.g. by DiscreteProblem::set_partition()), MUMPS sums them, the right hand sides of the processes
+      /// are summed as well. The solution is returned in all the processes.
+      /// All the processes have to call solve().
+      void set_distributed(bool to_set = true);
+#endif
+
+      /// Out-of-core factorization (ICNTL(22) = 1): the factors are written to files in the directory tmp_dir
+      /// (OOC_TMPDIR, the MUMPS default - the environment variable MUMPS_OOC_TMPDIR or /tmp - if empty),
+      /// for the problems whose factors do not fit in the memory.
+      /// Takes effect in the next factorization from scratch.
+      void set_out_of_core(bool to_set = true, std::string tmp_dir = "");
+
+      /// Block low-rank compression of the factors (ICNTL(35) = 2, MUMPS 5.1 and newer), with the dropping
+      /// threshold tolerance (CNTL(7)), which makes the factorization approximate, 0.0 means the full accuracy.
+      /// Takes effect in the next factorization from scratch.
+      void set_low_rank_compression(bool to_set = true, double tolerance = 0.0);
+
+#ifndef HAVE_MUMPS_SINGLE
+      /// Hermes was built without the single precision MUMPS (smumps_seq / cmumps_seq), the mixed precision
+      /// is not available, this warns and keeps solving in double precision.
+      virtual void set_mixed_precision(bool to_set = true, int max_steps = 10, double tolerance = 1e-12);
+#endif
 
       /// Matrix to solve.
       MumpsMatrix<Scalar> *m;
@@ -181,6 +227,9 @@ namespace Hermes
       /// \todo document
       bool setup_factorization();
 
+      /// Gives the matrix to MUMPS (centralized or distributed, see set_distributed()).
+      void specify_matrix();
+
       /// MUMPS specific structure with solver parameters.
       typename mumps_type<Scalar>::mumps_struct param;
 
@@ -193,8 +242,40 @@ namespace Hermes
       bool reinit();
       /// True if solver is inited.
       bool inited;
+
+      /// See set_distributed().
+      bool distributed;
+
+      /// See set_out_of_core().
+      bool out_of_core;
+      std::string ooc_tmpdir;
+      /// See set_low_rank_compression().
+      bool low_rank_compression;
+      double low_rank_tolerance;
+
+#ifdef HAVE_MUMPS_SINGLE
+      /// Mixed precision (DirectSolver::set_mixed_precision()): the single precision instance
+      /// of MUMPS (smumps / cmumps) and the single precision copy of the matrix values.
+      typename mumps_type<Scalar>::mumps_single_struct param_single;
+      typename mumps_type<Scalar>::mumps_single_Scalar* single_Ax;
+      bool single_inited;
+
+      /// (Re)initialize the single precision instance.
+      bool reinit_single();
+      /// Factorizes in single precision (according to the factorization scheme), the solutions are refined.
+      bool solve_mixed_precision(int num_rhs, Scalar* rhs_block);
+      virtual bool solve_low_precision(Scalar* b, Scalar* x);
+#endif
     private:
+      /// Sets the controls of an initialized instance (the printing, the input and the options of set_out_of_core(),
+      /// set_low_rank_compression(), the threads of the multithreaded BLAS / MUMPS 5.1 and newer).
+      template<typename MumpsStruct> void set_controls(MumpsStruct& mumps_param);
+      /// Terminates the instances (double and single precision) after a change of the options.
+      void end_instances();
       void mumps_c(typename mumps_type<Scalar>::mumps_struct * param);  //wrapper around dmums_c or zmumps_c
+#ifdef HAVE_MUMPS_SINGLE
+      void mumps_single_c(typename mumps_type<Scalar>::mumps_single_struct * param);  //wrapper around smumps_c or cmumps_c
+#endif
     };
   }
 }
@@ -0,0 +1,181 @@
+// This file is part of HermesCommon
+//
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Email: hpfem-group@unr.edu, home page: http://hpfem.org/.
+//
+// Hermes2D is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation; either version 2 of the License,
+// or (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/*! \file native_iter_solver.h
+\brief Built-in iterative solvers (CG, GMRES, BiCGStab) and preconditioners over CSCMatrix.
+*/
+#ifndef __HERMES_COMMON_NATIVE_ITER_SOLVER_H_
+#define __HERMES_COMMON_NATIVE_ITER_SOLVER_H_
+#include "config.h"
+#ifdef WITH_UMFPACK
+#include "linear_matrix_solver.h"
+#include "umfpack_solver.h"
+#include "precond.h"
+
+namespace Hermes
+{
+  namespace Preconditioners
+  {
+    /// \brief Preconditioner of the built-in iterative solvers (NativeIterSolver).
+    /// create() takes a CSCMatrix, compute() builds the preconditioner from its current values.
+    ///
+    /// @ingroup preconds
+    template <typename Scalar>
+    class HERMES_API CSCPrecond : public Precond<Scalar>
+    {
+    public:
+      CSCPrecond();
+      virtual ~CSCPrecond();
+
+      virtual void create(Matrix<Scalar> *mat);
+
+      /// Applies the preconditioner, z = M^{-1} r.
+      virtual void apply(Scalar* r, Scalar* z) = 0;
+
+#ifdef HAVE_EPETRA
+      /// The built-in preconditioners are not Epetra operators.
+      virtual Epetra_Operator *get_obj() { return this; }
+      virtual const Epetra_Comm &Comm() const;
+      virtual const Epetra_Map &OperatorDomainMap() const;
+      virtual const Epetra_Map &OperatorRangeMap() const;
+#endif
+
+    protected:
+      /// The row-wise (CSR) copy of the matrix with the sorted columns, the symmetric storage expanded to the full pattern.
+      /// The arrays are allocated here and owned by the caller.
+      void get_rows(int*& Rp, int*& Rj, Scalar*& Rx) const;
+
+      CSCMatrix<Scalar>* mat;
+    };
+
+    /// \brief Jacobi (diagonal) preconditioner.
+    ///
+    /// @ingroup preconds
+    template <typename Scalar>
+    class HERMES_API JacobiPrecond : public CSCPrecond<Scalar>
+    {
+    public:
+      JacobiPrecond();
+      virtual ~JacobiPrecond();
+
+      virtual void destroy();
+      virtual void compute();
+      virtual void apply(Scalar* r, Scalar* z);
+
+    protected:
+      /// Inverse of the diagonal.
+      Scalar* inv_diag;
+    };
+
+    /// \brief Incomplete LU factorization with no fill-in, ILU(0).
+    /// The factors are stored row-wise (L with the unit diagonal and U in one array), with the sparsity pattern of the matrix.
+    /// A matrix in the symmetric storage is expanded to the full pattern.
+    ///
+    /// @ingroup preconds
+    template <typename Scalar>
+    class HERMES_API ILU0Precond : public CSCPrecond<Scalar>
+    {
+    public:
+      ILU0Precond();
+      virtual ~ILU0Precond();
+
+      virtual void destroy();
+      virtual void compute();
+      /// The forward and backward substitution (sequential).
+      virtual void apply(Scalar* r, Scalar* z);
+
+    protected:
+      int size;
+      /// Index to Lj/LUx, where each row starts.
+      int* Lp;
+      /// Sorted column indices of each row.
+      int* Lj;
+      /// Entries of L (left of the diagonal) and U.
+      Scalar* LUx;
+      /// Position of the diagonal entry of each row.
+      int* diag;
+    };
+  }
+
+  namespace Solvers
+  {
+    /// \brief Built-in iterative solver (CG, restarted GMRES, BiCGStab) over CSCMatrix.
+    /// Available without Trilinos and PETSc: the products with the matrix, the dot products and the vector updates are OpenMP-parallel
+    /// (Hermes::numThreadsAlgebra threads). Converges when the residual norm drops below tolerance * (norm of the right hand side).
+    /// Preconditioned from the right (GMRES, BiCGStab), or split (CG), see set_precond().
+    ///
+    /// @ingroup solvers
+    template <typename Scalar>
+    class HERMES_API NativeIterSolver : public IterSolver<Scalar>
+    {
+    public:
+      NativeIterSolver(CSCMatrix<Scalar> *m, Vector<Scalar> *rhs);
+      virtual ~NativeIterSolver();
+
+      virtual bool solve();
+      virtual int get_matrix_size();
+      virtual int get_num_iters();
+      virtual double get_residual();
+
+      /// Set the type of the solver.
+      /// @param[in] solver - name of the solver [ cg | gmres | bicgstab ], default gmres.
+      void set_solver(const char *solver);
+
+      /// Set the number of GMRES iterations between the restarts.
+      /// Default: 30
+      void set_gmres_restart(int restart);
+
+      /// Set a built-in preconditioner.
+      /// @param[in] name - name of the preconditioner [ none | jacobi | ilu0 | amg ] (amg: AMGPrecond with the default settings)
+      virtual void set_precond(const char *name);
+
+      /// Set a preconditioner, which has to be a CSCPrecond (not owned by the solver).
+      virtual void set_precond(Precond<Scalar> *pc);
+
+    protected:
+      enum Method
+      {
+        METHOD_CG,
+        METHOD_GMRES,
+        METHOD_BICGSTAB
+      };
+
+      bool solve_cg(Scalar* b, Scalar* x);
+      bool solve_gmres(Scalar* b, Scalar* x);
+      bool solve_bicgstab(Scalar* b, Scalar* x);
+
+      /// z = M^{-1} r (or a copy without a preconditioner).
+      void apply_precond(Scalar* r, Scalar* z);
+
+      CSCMatrix<Scalar> *m;
+      Vector<Scalar> *rhs;
+
+      Method method;
+      int gmres_restart;
+
+      CSCPrecond<Scalar> *pc;
+      /// The preconditioner was created by set_precond(const char*).
+      bool own_pc;
+
+      int num_iters;
+      double residual;
+    };
+  }
+}
+#endif
+#endif
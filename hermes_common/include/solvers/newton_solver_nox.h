@@ -40,6 +40,39 @@ namespace Hermes
 {
   namespace Solvers
   {
+    /// \brief The Jacobian of a DiscreteProblemInterface as an Epetra_Operator, which is never assembled.
+    /// Apply() calls DiscreteProblemInterface::assemble_jacobian_vector_product() at the point set by set_coeff_vector()
+    /// (NOX does that through DiscreteProblemNOX::computeJacobian()), i.e. the analytic directional derivative,
+    /// unlike the finite differences of NOX::Epetra::MatrixFree.
+    template <typename Scalar>
+    class HERMES_API JacobianOperatorNOX : public Epetra_Operator
+    {
+    public:
+      JacobianOperatorNOX(DiscreteProblemInterface<Scalar>* problem, const Epetra_Map& map);
+      virtual ~JacobianOperatorNOX();
+
+      /// The point the Jacobian is evaluated at (copied).
+      void set_coeff_vector(const Epetra_Vector& x);
+
+      virtual int Apply(const Epetra_MultiVector& X, Epetra_MultiVector& Y) const;
+
+      /// Neither the transpose nor the inverse is available.
+      virtual int SetUseTranspose(bool UseTranspose) { return -1; }
+      virtual int ApplyInverse(const Epetra_MultiVector& X, Epetra_MultiVector& Y) const { return -1; }
+      virtual double NormInf() const { return 0.0; }
+      virtual const char* Label() const { return "Hermes Jacobian-vector product"; }
+      virtual bool UseTranspose() const { return false; }
+      virtual bool HasNormInf() const { return false; }
+      virtual const Epetra_Comm& Comm() const { return map.Comm(); }
+      virtual const Epetra_Map& OperatorDomainMap() const { return map; }
+      virtual const Epetra_Map& OperatorRangeMap() const { return map; }
+
+    private:
+      DiscreteProblemInterface<Scalar>* dp;
+      Epetra_Map map;
+      Scalar* coeff_vec;
+    };
+
     /// \brief discrete problem used in NOX solver
     /// Implents interfaces needed by NOX Epetra
     template <typename Scalar>
@@ -62,7 +95,7 @@ namespace Hermes
       /// \brief Compute and return F.
       virtual bool computeF(const Epetra_Vector &x, Epetra_Vector &f, FillType flag = Residual);
 
-      /// \brief Compute an explicit Jacobian.
+      /// \brief Compute an explicit Jacobian, or only set the point of the JacobianOperatorNOX.
       virtual bool computeJacobian(const Epetra_Vector &x, Epetra_Operator &op);
 
       /// \brief Computes a user supplied preconditioner based on input vector x.
@@ -70,9 +103,14 @@ namespace Hermes
       virtual bool computePreconditioner(const Epetra_Vector &x, Epetra_Operator &m,
         Teuchos::ParameterList *precParams = 0);
 
+      /// \brief The problem the preconditioner matrix is assembled from, the same problem by default.
+      /// It has to have the same DOFs, but it may use simplified forms or lower integration orders.
+      void set_precond_problem(DiscreteProblemInterface<Scalar>* problem);
+
     private:
       DiscreteProblemInterface<Scalar> * dp;
-      /// \brief Jacobian (optional).
+      DiscreteProblemInterface<Scalar> * precond_dp;
+      /// \brief Jacobian (optional), also the matrix of the preconditioner.
       EpetraMatrix<Scalar> jacobian;
       /// \brief Preconditioner (optional).
       Teuchos::RCP<Precond<Scalar> > precond;
@@ -177,6 +215,14 @@ namespace Hermes
       /// \param[in] max_age If the "Preconditioner Reuse Policy" is set to "Reuse",
       /// this integer tells the linear system how many times to reuse the preconditioner before rebuilding it. (default 999)
       void set_precond_max_age(int max_age);
+      /// Jacobian-free Newton-Krylov with the analytic Jacobian-vector products (JacobianOperatorNOX), the Jacobian
+      /// is not assembled, only the preconditioner matrix is (if a preconditioner is set).
+      /// The problem has to provide DiscreteProblemInterface::assemble_jacobian_vector_product().
+      /// Default: false (the Jacobian is assembled, or approximated by finite differences for the matrix-free weak forms).
+      void set_jacobian_free(bool to_set);
+      /// The preconditioner matrix is assembled from this problem, see DiscreteProblemNOX::set_precond_problem().
+      void set_precond_problem(DiscreteProblemInterface<Scalar>* problem);
+
       /// Set user defined preconditioner
       /// \param[in] pc preconditioner
       virtual void set_precond(Precond<Scalar> &pc);
@@ -189,6 +235,7 @@ namespace Hermes
       virtual void set_precond(const char *pc);
 
     protected:
+      bool jacobian_free;
       int num_iters;
       double residual;
       int num_lin_iters;
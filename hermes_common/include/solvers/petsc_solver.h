@@ -93,11 +93,19 @@ namespace Hermes
       /// @param[in] ax values
       ///  @todo same input parameters acts differen as in superlu
       void create(unsigned int size, unsigned int nnz, int* ap, int* ai, Scalar* ax);
+      /// The same as create(), but the arrays are not copied, PETSc works on them in place and the matrix deletes them
+      /// (by delete []) when freed. For a real Scalar the values are converted to PetscScalar (the only copy).
+      /// The arrays of an assembled CSCMatrix (CSCMatrix::release()) give the transposed matrix this way.
+      void adopt(unsigned int size, unsigned int nnz, int* ap, int* ai, Scalar* ax);
       // Duplicates a matrix (including allocation).
       PetscMatrix* duplicate();
     protected:
       /// Petsc matrix data structure.
       Mat matrix;
+      /// The arrays of the matrix made by create() / adopt(), PETSc does not copy them.
+      int* Ap;
+      int* Ai;
+      PetscScalar* Ax;
       /// Number of nonzero values.
       unsigned int nnz;
       /// Is matrix inited (allocated)?
@@ -154,10 +162,15 @@ namespace Hermes
       virtual bool solve();
       virtual int get_matrix_size();
 
+      /// The preconditioner of the KSP (set by the PETSc options) is built from precond_matrix, which has to be a PetscMatrix.
+      virtual void set_precond_matrix(Matrix<Scalar>* precond_matrix);
+
       /// Matrix to solve.
       PetscMatrix<Scalar> *m;
       /// Right hand side vector.
       PetscVector<Scalar> *rhs;
+      /// The matrix the preconditioner is built from, NULL for m.
+      PetscMatrix<Scalar> *precond_m;
     };
   }
 }
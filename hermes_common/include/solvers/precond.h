@@ -48,10 +48,16 @@ namespace Hermes
 #endif
     {
     public:
+      virtual ~Precond() {}
+
       virtual void create(Matrix<Scalar> *mat) = 0;
       virtual void destroy() = 0;
       virtual void compute() = 0;
 
+      /// Computes the preconditioner again after a change of the values (not of the pattern) of the matrix passed
+      /// to create(), keeping its symbolic setup (the graph, the aggregation, ...). By default the whole compute().
+      virtual void recompute() { this->compute(); }
+
 #ifdef HAVE_EPETRA
       virtual Epetra_Operator *get_obj() = 0;
 
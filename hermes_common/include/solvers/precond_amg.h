@@ -0,0 +1,153 @@
+// This file is part of HermesCommon
+//
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Email: hpfem-group@unr.edu, home page: http://hpfem.org/.
+//
+// Hermes2D is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation; either version 2 of the License,
+// or (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/*! \file precond_amg.h
+\brief Built-in smoothed aggregation algebraic multigrid preconditioner.
+*/
+#ifndef __HERMES_COMMON_PRECOND_AMG_H_
+#define __HERMES_COMMON_PRECOND_AMG_H_
+#include "config.h"
+#ifdef WITH_UMFPACK
+#include "native_iter_solver.h"
+
+namespace Hermes
+{
+  namespace Preconditioners
+  {
+    /// \brief Smoothed aggregation algebraic multigrid, one V-cycle per application.
+    /// \details The aggregates are built from the strong connections (|a_ij| >= theta * sqrt(|a_ii a_jj|)), independently
+    /// in one block of the rows per thread. The tentative prolongation (the constant per aggregate) is smoothed by
+    /// one damped Jacobi step and the coarse matrices are the Galerkin products P^T A P. The levels are smoothed
+    /// by the Chebyshev polynomial or the damped Jacobi method, both scaled by the diagonal, the coarsest one is solved
+    /// by the dense LU factorization.
+    /// When compute() is called for a matrix with the same pattern as before (e.g. in the next Newton iteration),
+    /// the aggregates and the prolongations are kept and only the coarse matrices and the smoothers are recomputed,
+    /// see set_reuse_hierarchy().
+    ///
+    /// @ingroup preconds
+    template <typename Scalar>
+    class HERMES_API AMGPrecond : public CSCPrecond<Scalar>
+    {
+    public:
+      AMGPrecond();
+      virtual ~AMGPrecond();
+
+      virtual void destroy();
+      virtual void compute();
+      virtual void apply(Scalar* r, Scalar* z);
+
+      /// Maximum number of the levels.
+      /// Default: 10
+      void set_max_levels(int max_levels);
+
+      /// The coarsening stops at this size.
+      /// Default: 300
+      void set_coarse_size(int coarse_size);
+
+      /// Threshold of the strong connections.
+      /// Default: 0.08
+      void set_strength_threshold(double theta);
+
+      /// Set the smoother.
+      /// \param[in] name [ chebyshev | jacobi ], default chebyshev.
+      /// \param[in] sweeps The degree of the Chebyshev polynomial / the number of the Jacobi sweeps, default 2.
+      void set_smoother(const char* name, int sweeps = 2);
+
+      /// Keep the hierarchy for the matrices of the same pattern (only the values are recomputed).
+      /// Default: true
+      void set_reuse_hierarchy(bool reuse);
+
+      /// Number of the levels of the current hierarchy.
+      int get_num_levels() const;
+
+    protected:
+      /// Row-wise (CSR) sparse matrix of a level.
+      struct LevelMatrix
+      {
+        LevelMatrix();
+        void free();
+        int rows, cols;
+        int* p;
+        int* j;
+        Scalar* x;
+      };
+
+      struct Level
+      {
+        Level();
+        ~Level();
+        /// Allocates the vectors of the cycle.
+        void alloc(int size);
+        /// The matrix, the prolongation from the next level, the restriction P^T and the product A P.
+        LevelMatrix A, P, R, AP;
+        /// Inverse of the diagonal of A.
+        Scalar* inv_diag;
+        /// Estimate of the largest eigenvalue of D^{-1} A.
+        double lambda_max;
+        /// Right hand side, solution and the work vectors of the cycle.
+        Scalar *b, *x, *r, *d, *t;
+      };
+
+      /// Row-parallel product C = A B, the pattern (sorted in each row).
+      static void multiply_structure(const LevelMatrix& A, const LevelMatrix& B, LevelMatrix& C);
+      /// Row-parallel product C = A B, the values on the pattern from multiply_structure().
+      static void multiply_values(const LevelMatrix& A, const LevelMatrix& B, LevelMatrix& C);
+      /// T = A^T.
+      static void transpose(const LevelMatrix& A, LevelMatrix& T);
+      /// y = A x.
+      static void multiply_with_vector(const LevelMatrix& A, const Scalar* x, Scalar* y);
+      /// r = b - A x.
+      static void calculate_residual(const LevelMatrix& A, const Scalar* b, const Scalar* x, Scalar* r);
+
+      /// The hierarchy, without the values.
+      void build_hierarchy();
+      /// The values of the coarse matrices, the smoothers and the coarsest factorization.
+      void compute_values();
+
+      void setup_smoother(Level* level);
+      void smooth(Level* level, Scalar* b, Scalar* x);
+      void cycle(unsigned int level_i);
+
+      /// The aggregate of every row of A.
+      /// @return The number of the aggregates.
+      int aggregate(LevelMatrix& A, int* aggregates);
+
+      void factorize_coarsest();
+      void solve_coarsest(Scalar* b, Scalar* x);
+
+      Hermes::vector<Level*> levels;
+
+      int max_levels;
+      int coarse_size;
+      double theta;
+      bool chebyshev;
+      int sweeps;
+      bool reuse_hierarchy;
+
+      /// The pattern of the finest matrix of the hierarchy.
+      unsigned long long structure_hash;
+      bool structure_symmetric;
+
+      /// Dense LU factorization of the coarsest matrix (row-wise), with the row pivots.
+      Scalar* coarse_lu;
+      int* coarse_pivots;
+    };
+  }
+}
+#endif
+#endif
@@ -63,6 +63,8 @@ namespace Hermes
 
       virtual void create(Matrix<Scalar> *mat);
       virtual void destroy() { }
+      /// The numerical phase only (Ifpack_Preconditioner::Compute()), the symbolic one (Initialize()) is done by create(),
+      /// so compute() alone serves as recompute().
       virtual void compute();
 
       // Epetra_Operator interface
@@ -59,6 +59,8 @@ namespace Hermes
       virtual void destroy();
       /// Compute the preconditioner.
       virtual void compute();
+      /// Recompute the hierarchy operators and the smoothers on the kept aggregation and prolongators.
+      virtual void recompute();
 
       void print_unused();
 
@@ -28,28 +28,24 @@ typedef int int_t;
 #include "linear_matrix_solver.h"
 #include "matrix.h"
 
+#ifdef SLU_MT
+#include <slu_mt_util.h>
+#else
 #include <supermatrix.h>
 #include <slu_util.h>
+#endif
 namespace Hermes
 {
   namespace Solvers
   {
     template <typename Scalar> class SuperLUSolver;
 #ifdef SLU_MT
-    template <typename Scalar>
-    class SuperLu
-    {
-    public:
-      void gsequ (SuperMatrix *A, double *r, double *c, double *rowcnd, double *colcnd, double *amax, int *info);
-      void laqgs (SuperMatrix *A, float *r, float *c, float rowcnd, float colcnd, float amax, char *equed);
-      int gstrf (superlu_options_t *options, int m, int n, double anorm, LUstruct_t *LUstruct, gridinfo_t *grid, SuperLUStat_t *stat, int *info);
-      float pivotGrowth (int ncols, SuperMatrix *A, int *perm_c, SuperMatrix *L, SuperMatrix *U);
-      float langs (char *norm, SuperMatrix *A);
-      void  gscon (char *norm, SuperMatrix *L, SuperMatrix *U, float anorm, float *rcond, SuperLUStat_t *stat, int *info);
-      void  gstrs (trans_t trans, SuperMatrix *L, SuperMatrix *U, int *perm_c, int *perm_r, SuperMatrix *B, SuperLUStat_t *stat, int *info);
-      double lamch_ (char *cmach);
-      int querySpace (SuperMatrix *, SuperMatrix *, slu_memusage_t *);
-    }
+    typedef superlumt_options_t       slu_options_t;
+    typedef Gstat_t                   slu_stat_t;
+    typedef superlu_memusage_t        slu_memusage_t;
+#define SLU_DESTROY_L             Destroy_SuperNode_SCP
+#define SLU_DESTROY_U             Destroy_CompCol_NCP
+#define SLU_PRINT_STAT(stat_ptr)  PrintStat(stat_ptr)
 #else //SLU_MT
 
     typedef superlu_options_t         slu_options_t;
@@ -63,6 +59,7 @@ namespace Hermes
 #define SLU_DESTROY_U             Destroy_CompCol_Matrix
 #define SLU_INIT_STAT(stat_ptr)   StatInit(stat_ptr)
 #define SLU_PRINT_STAT(stat_ptr)  StatPrint(stat_ptr)
+#endif //SLU_MT
 
 #define SLU_DTYPE                 SLU_D
 
@@ -78,6 +75,8 @@ namespace Hermes
     {
     /** Type for storing scalar number in SuperLU real structures */
       typedef double Scalar;
+    /** Type for storing scalar number in SuperLU single precision real structures */
+      typedef float SingleScalar;
     };
 
     /** Type for storing number in SuperLU complex structures */
@@ -86,8 +85,9 @@ namespace Hermes
     {
     /** Type for storing scalar number in SuperLU complex structures */
       typedef struct { double r, i; } Scalar;
+    /** Type for storing scalar number in SuperLU single precision complex structures */
+      typedef struct { float r, i; } SingleScalar;
     };
-#endif //SLU_MT
   }
 }
 
@@ -201,6 +201,8 @@ namespace Hermes
       virtual ~SuperLUSolver();
 
       virtual bool solve();
+      /// The right hand sides are given to the SuperLU driver as one dense matrix.
+      virtual bool solve(int num_rhs, Scalar* rhs_block);
       virtual int get_matrix_size();
 
     protected:
@@ -237,21 +239,60 @@ namespace Hermes
       int *etree;                   ///< Elimination tree of Pc'*A'*A*Pc.
       slu_options_t options;        ///< Structure holding the input options for the solver.
 
-      private:
 #ifndef SLU_MT
+      /// Mixed precision (DirectSolver::set_mixed_precision()): the single precision copy of the matrix,
+      /// its factors and the data of the factorization by sgssvx (cgssvx).
+      bool single_inited;
+      SuperMatrix A_single, L_single, U_single;
+      typename SuperLuType<Scalar>::SingleScalar *local_Ax_single;
+      float *R_single, *C_single;
+      int *perm_r_single, *perm_c_single, *etree_single;
+      char equed_single[1];
+      slu_options_t options_single;
+
+      /// Factorizes in single precision (according to the factorization scheme), the solutions are refined.
+      bool solve_mixed_precision(int num_rhs, Scalar* rhs_block);
+      virtual bool solve_low_precision(Scalar* b, Scalar* x);
+      void free_single();
+#endif
+
+      private:
       void create_csc_matrix (SuperMatrix *A, int m, int n, int nnz, typename SuperLuType<Scalar>::Scalar *nzval, int *rowind, int *colptr,
         Stype_t stype, Dtype_t dtype, Mtype_t mtype);
+      void create_dense_matrix (SuperMatrix *X, int m, int n, typename SuperLuType<Scalar>::Scalar *x, int ldx, Stype_t stype, Dtype_t dtype, Mtype_t mtype);
+#ifndef SLU_MT
       void  solver_driver (superlu_options_t *options, SuperMatrix *A, int *perm_c, int *perm_r, int *etree, char *equed, double *R,
         double *C, SuperMatrix *L, SuperMatrix *U, void *work, int lwork, SuperMatrix *B, SuperMatrix *X, double *recip_pivot_growth,
         double *rcond, double *ferr, double *berr, slu_memusage_t *mem_usage, SuperLUStat_t *stat, int *info);
-      void create_dense_matrix (SuperMatrix *X, int m, int n, typename SuperLuType<Scalar>::Scalar *x, int ldx, Stype_t stype, Dtype_t dtype, Mtype_t mtype);
+      /// The single precision versions (sgssvx, cgssvx).
+      void create_single_csc_matrix (SuperMatrix *A, int m, int n, int nnz, typename SuperLuType<Scalar>::SingleScalar *nzval, int *rowind, int *colptr);
+      void create_single_dense_matrix (SuperMatrix *X, int m, int n, typename SuperLuType<Scalar>::SingleScalar *x, int ldx);
+      void single_solver_driver (superlu_options_t *options, SuperMatrix *A, int *perm_c, int *perm_r, int *etree, char *equed, float *R,
+        float *C, SuperMatrix *L, SuperMatrix *U, SuperMatrix *B, SuperMatrix *X, slu_memusage_t *mem_usage, SuperLUStat_t *stat, int *info);
+#else
+      /// The driver of SuperLU_MT, a modification of p*gssvx keeping the structures for the factorization reuse (see superlu_solver.cpp).
+      void slu_mt_solver_driver(slu_options_t *options, SuperMatrix *A, int *perm_c, int *perm_r, SuperMatrix *AC, equed_t *equed,
+        double *R, double *C, SuperMatrix *L, SuperMatrix *U, SuperMatrix *B, SuperMatrix *X, double *recip_pivot_growth, double *rcond,
+        double *ferr, double *berr, slu_stat_t *stat, slu_memusage_t *memusage, int *info);
+      /// The steps of the driver, SuperLU_MT d* / z* routines (superlu_solver_real.cpp, superlu_solver_cplx.cpp).
+      void gsequ (SuperMatrix *A, double *r, double *c, double *rowcnd, double *colcnd, double *amax, int *info);
+      void laqgs (SuperMatrix *A, double *r, double *c, double rowcnd, double colcnd, double amax, equed_t *equed);
+      void gstrf (slu_options_t *options, SuperMatrix *AC, int *perm_r, SuperMatrix *L, SuperMatrix *U, slu_stat_t *stat, int *info);
+      double pivot_growth (int ncols, SuperMatrix *A, int *perm_c, SuperMatrix *L, SuperMatrix *U);
+      double langs (char *norm, SuperMatrix *A);
+      void gscon (char *norm, SuperMatrix *L, SuperMatrix *U, double anorm, double *rcond, int *info);
+      void gstrs (trans_t trans, SuperMatrix *L, SuperMatrix *U, int *perm_r, int *perm_c, SuperMatrix *B, slu_stat_t *stat, int *info);
+      void gsrfs (trans_t trans, SuperMatrix *A, SuperMatrix *L, SuperMatrix *U, int *perm_r, int *perm_c, equed_t equed, double *R, double *C,
+        SuperMatrix *B, SuperMatrix *X, double *ferr, double *berr, slu_stat_t *stat, int *info);
+      void query_space (int nprocs, SuperMatrix *L, SuperMatrix *U, int panel_size, slu_memusage_t *memusage);
 #endif  //SLU_MT
 
 #ifndef SLU_MT
       char equed[1];              ///< Form of equilibration that was done on A.
 #else
       equed_t equed;              ///< Form of equilibration that was done on A.
-      SuperMatrix AC;             ///< Matrix A permuted by perm_c.
+      SuperMatrix AC;             ///< Matrix A permuted by perm_c (kept with the elimination tree in options for the reuse).
+      bool has_AC;
 #endif //SLU_MT
       template<typename T> friend LinearMatrixSolver<T>* create_linear_solver(Matrix<T>* matrix, Vector<T>* rhs);
     };
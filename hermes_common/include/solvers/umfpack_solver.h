@@ -54,6 +54,18 @@ namespace Hermes
       /// @param[in] ax values
       void create(unsigned int size, unsigned int nnz, int* ap, int* ai, Scalar* ax);
 
+      /// The same as create(), but the arrays are not copied, the matrix takes them over (and deletes them by delete []).
+      /// Arrays built elsewhere (another library, a file reader, release() of another matrix) are used in place this way.
+      void adopt(unsigned int size, unsigned int nnz, int* ap, int* ai, Scalar* ax);
+
+      /// Hands the three arrays over to the caller (who deletes them by delete [] then) and leaves the matrix empty.
+      /// The counterpart of adopt(), e.g. PetscMatrix::adopt() uses the arrays of an assembled matrix in place
+      /// (as the CSR arrays of the transposed matrix).
+      /// @param[out] ap index to ai/ax, where each column starts (size is matrix size + 1)
+      /// @param[out] ai row indices
+      /// @param[out] ax values
+      void release(int*& ap, int*& ai, Scalar*& ax);
+
       /// \brief Default constructor.
       CSCMatrix();
       /// \brief Constructor with specific size
@@ -62,11 +74,24 @@ namespace Hermes
       CSCMatrix(unsigned int size);
       virtual ~CSCMatrix();
       virtual void alloc();
+      virtual void alloc_with_structure(unsigned int n, const int* col_start, const int* rows);
+      /// Shares the arrays Ap, Ai of the pattern, only Ax is allocated.
+      virtual void alloc_with_pattern(SparsityPattern* pattern);
+      virtual SparsityPattern* get_sparsity_pattern() const { return this->pattern; }
+      virtual bool supports_symmetric_storage() const { return true; }
       virtual void free();
+      /// Adds a CSCMatrix (of the same structure, or a part of it).
+      virtual void add_sparse_matrix(SparseMatrix<Scalar>* mat);
+      /// Adds alpha times a CSCMatrix (of the same structure, or a part of it).
+      virtual void add_scaled_sparse_matrix(Scalar alpha, SparseMatrix<Scalar>* mat);
       virtual Scalar get(unsigned int m, unsigned int n);
       virtual void zero();
       virtual void add(unsigned int m, unsigned int n, Scalar v);
       virtual void add_to_diagonal(Scalar v);
+      virtual bool supports_positions() const { return true; }
+      virtual int get_position(unsigned int m, unsigned int n);
+      virtual void add_to_position(int position, Scalar v);
+      virtual void add_dense_block(unsigned int row, unsigned int col, unsigned int m, unsigned int n, Scalar** mat, unsigned int mat_col = 0);
       /// Add matrix.
       /// @param[in] mat matrix to be added
       virtual void add_matrix(CSCMatrix<Scalar>* mat);
@@ -75,6 +100,8 @@ namespace Hermes
       /// @param[in] mat added matrix
       virtual void add_to_diagonal_blocks(int num_stages, CSCMatrix<Scalar>* mat);
       virtual void add_sparse_to_diagonal_blocks(int num_stages, SparseMatrix<Scalar>* mat);
+      virtual void add_sparse_to_blocks(int num_stages, SparseMatrix<Scalar>* mat, Scalar** coefficients);
+      virtual bool supports_sparse_to_blocks() const { return true; }
       /// Add matrix to specific position.
       /// @param[in] i row in target matrix coresponding with top row of added matrix
       /// @param[in] j column in target matrix coresponding with lef column of added matrix
@@ -82,11 +109,14 @@ namespace Hermes
       virtual void add_as_block(unsigned int i, unsigned int j, CSCMatrix<Scalar>* mat);
       virtual void add(unsigned int m, unsigned int n, Scalar **mat, int *rows, int *cols);
       virtual bool dump(FILE *file, const char *var_name, EMatrixDumpFormat fmt = DF_MATLAB_SPARSE, char* number_format = "%lf");
+      /// Reads DF_HERMES_BIN (also the symmetric storage flag), the arrays are read directly into the new matrix arrays.
+      virtual bool load(FILE *file, EMatrixDumpFormat fmt = DF_HERMES_BIN);
       virtual unsigned int get_matrix_size() const;
       virtual unsigned int get_nnz() const;
       virtual double get_fill_in() const;
 
       // Applies the matrix to vector_in and saves result to vector_out.
+      // Parallel over the rows, see build_row_index().
       void multiply_with_vector(Scalar* vector_in, Scalar* vector_out);
       // Multiplies matrix with a Scalar.
       void multiply_with_Scalar(Scalar value);
@@ -113,6 +143,27 @@ namespace Hermes
       int *Ap;
       /// Number of non-zero entries ( =  Ap[size]).
       unsigned int nnz;
+      /// The shared pattern Ap, Ai point to (see alloc_with_pattern()), NULL if the matrix owns them.
+      SparsityPattern* pattern;
+      /// Releases the shared pattern, Ap and Ai are NULL then.
+      void release_pattern();
+      /// The same Ap, Ai (the same arrays, e.g. a shared pattern, or equal ones).
+      bool has_structure_of(CSCMatrix<Scalar>* mat) const;
+
+      /// The DF_HERMES_BIN dump, the same for the real and the complex matrices.
+      void dump_hermes_bin(FILE *file);
+
+      /// The row-wise (CSR) index of the entries, built on the first product with a vector after the structure
+      /// changes: the entries of the row i are Ax[Rk[Rp[i]]], ..., Ax[Rk[Rp[i + 1] - 1]] in the columns Rj[...].
+      /// Then every thread computes its own range of the rows of the product, without any synchronization.
+      void build_row_index();
+      void free_row_index();
+      /// Index to Rj/Rk, where each row starts.
+      int *Rp;
+      /// Column indices of the entries of the rows.
+      int *Rj;
+      /// Positions of the entries of the rows in Ax.
+      int *Rk;
       template <typename T> friend class Hermes::Solvers::UMFPackLinearMatrixSolver;
       template <typename T> friend class Hermes::Solvers::UMFPackIterator;
       template<typename T> friend SparseMatrix<T>*  create_matrix();
@@ -122,6 +173,10 @@ namespace Hermes
     template <typename Scalar>
     class HERMES_API UMFPackMatrix : public CSCMatrix<Scalar>
     {
+    public:
+      /// UMFPACK factorizes the full matrix.
+      virtual bool supports_symmetric_storage() const { return false; }
+    protected:
       template <typename T> friend class Hermes::Solvers::UMFPackLinearMatrixSolver;
       template <typename T> friend class Hermes::Solvers::UMFPackIterator;
       template<typename T> friend SparseMatrix<T>*  create_matrix();
@@ -149,6 +204,8 @@ namespace Hermes
       virtual void add_vector(Vector<Scalar>* vec);
       virtual void add_vector(Scalar* vec);
       virtual bool dump(FILE *file, const char *var_name, EMatrixDumpFormat fmt = DF_MATLAB_SPARSE, char* number_format = "%lf");
+      /// Reads DF_HERMES_BIN.
+      virtual bool load(FILE *file, EMatrixDumpFormat fmt = DF_HERMES_BIN);
 
       /// @return pointer to array with vector data
       /// \sa #v
@@ -177,7 +234,11 @@ namespace Hermes
       UMFPackLinearMatrixSolver(UMFPackMatrix<Scalar> *m, UMFPackVector<Scalar> *rhs);
       virtual ~UMFPackLinearMatrixSolver();
       virtual bool solve();
+      /// UMFPACK solves the right hand sides one by one (in parallel) with the same numeric factorization.
+      virtual bool solve(int num_rhs, Scalar* rhs_block);
       virtual int get_matrix_size();
+      /// umfpack_*_symbolic() without the values.
+      virtual bool analyze_structure();
 
       /// Matrix to solve.
       UMFPackMatrix<Scalar> *m;
@@ -23,6 +23,8 @@
 #include "common.h"
 #include "exceptions.h"
 #include "matrix.h"
+#include "profiler.h"
+#include "buffered_logger.h"
 
 namespace Hermes
 {
@@ -42,6 +44,11 @@ namespace Hermes
 
     this->parameters.insert(std::pair<HermesCommonApiParam, Parameter*> (Hermes::exceptionsPrintCallstack,new Parameter(0)));
     this->parameters.insert(std::pair<HermesCommonApiParam, Parameter*> (Hermes::matrixSolverType,new Parameter(SOLVER_UMFPACK)));
+    this->parameters.insert(std::pair<HermesCommonApiParam, Parameter*> (Hermes::numThreadsAlgebra,new Parameter(NUM_THREADS)));
+    this->parameters.insert(std::pair<HermesCommonApiParam, Parameter*> (Hermes::profiling,new Parameter(0)));
+    this->parameters.insert(std::pair<HermesCommonApiParam, Parameter*> (Hermes::bufferedLogging,new Parameter(0)));
+    this->parameters.insert(std::pair<HermesCommonApiParam, Parameter*> (Hermes::parallelFirstTouch,new Parameter(1)));
+    this->parameters.insert(std::pair<HermesCommonApiParam, Parameter*> (Hermes::autotuningTrials,new Parameter(2)));
   }
 
   Api::~Api()
@@ -65,6 +72,11 @@ namespace Hermes
       throw Hermes::Exceptions::Exception("Wrong Hermes::Api parameter name:%i", param);
     this->parameters.find(param)->second->user_set = true;
     this->parameters.find(param)->second->user_val = value;
+    // Read in every profiled region, so kept where it is cheap to test.
+    if(param == Hermes::profiling)
+      Profiler::set_enabled(value != 0);
+    if(param == Hermes::bufferedLogging)
+      BufferedLogger::set_enabled(value != 0);
   }
 
   Hermes::Api HermesCommonApi;
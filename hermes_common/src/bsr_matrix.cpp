@@ -0,0 +1,345 @@
+// This file is part of HermesCommon
+//
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Email: hpfem-group@unr.edu, home page: http://hpfem.org/.
+//
+// Hermes2D is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation; either version 2 of the License,
+// or (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/*! \file bsr_matrix.cpp
+\brief Block sparse row matrix.
+*/
+#include "bsr_matrix.h"
+#include <algorithm>
+
+namespace Hermes
+{
+  namespace Algebra
+  {
+    static inline void add_shared(double& target, double v)
+    {
+#pragma omp atomic
+      target += v;
+    }
+
+    static inline void add_shared(std::complex<double>& target, std::complex<double> v)
+    {
+#pragma omp critical (BSRMatrix_add)
+      target += v;
+    }
+
+    template<typename Scalar, int block_size>
+    BSRMatrix<Scalar, block_size>::BSRMatrix() : num_block_rows(0), num_blocks(0), Bp(NULL), Bj(NULL), Bx(NULL)
+    {
+      this->size = 0;
+    }
+
+    template<typename Scalar, int block_size>
+    BSRMatrix<Scalar, block_size>::BSRMatrix(unsigned int size) : num_block_rows(0), num_blocks(0), Bp(NULL), Bj(NULL), Bx(NULL)
+    {
+      this->size = size;
+    }
+
+    template<typename Scalar, int block_size>
+    BSRMatrix<Scalar, block_size>::~BSRMatrix()
+    {
+      free();
+    }
+
+    template<typename Scalar, int block_size>
+    void BSRMatrix<Scalar, block_size>::alloc()
+    {
+      assert(this->pages != NULL);
+
+      // The scalar structure (column-wise) first.
+      int* col_start = new int[this->size + 1];
+      int* rows = new int[std::max(this->get_num_indices(), 1)];
+      int pos = 0;
+      for (unsigned int col = 0; col < this->size; col++)
+      {
+        col_start[col] = pos;
+        pos += this->sort_and_store_indices(this->pages[col], rows + pos, rows + pos);
+      }
+      col_start[this->size] = pos;
+      delete [] this->pages;
+      this->pages = NULL;
+
+      // The blocks of every block row, counted and then filled. The block columns are visited in the increasing order,
+      // last_block_col[I] is the last one seen in the block row I.
+      this->num_block_rows = (this->size + block_size - 1) / block_size;
+      Bp = new int[this->num_block_rows + 1];
+      memset(Bp, 0, (this->num_block_rows + 1) * sizeof(int));
+      int* last_block_col = new int[std::max(this->num_block_rows, 1u)];
+      for (int pass = 0; pass < 2; pass++)
+      {
+        for (unsigned int i = 0; i < this->num_block_rows; i++)
+          last_block_col[i] = -1;
+        int* position = (pass == 1) ? new int[std::max(this->num_block_rows, 1u)] : NULL;
+        if(pass == 1)
+          memcpy(position, Bp, this->num_block_rows * sizeof(int));
+
+        for (unsigned int col = 0; col < this->size; col++)
+        {
+          int block_col = col / block_size;
+          for (int i = col_start[col]; i < col_start[col + 1]; i++)
+          {
+            int block_row = rows[i] / block_size;
+            if(last_block_col[block_row] != block_col)
+            {
+              last_block_col[block_row] = block_col;
+              if(pass == 0)
+                Bp[block_row + 1]++;
+              else
+                Bj[position[block_row]++] = block_col;
+            }
+          }
+        }
+
+        if(pass == 0)
+        {
+          for (unsigned int i = 0; i < this->num_block_rows; i++)
+            Bp[i + 1] += Bp[i];
+          this->num_blocks = Bp[this->num_block_rows];
+          Bj = new int[std::max(this->num_blocks, 1u)];
+        }
+        else
+          delete [] position;
+      }
+      delete [] last_block_col;
+      delete [] col_start;
+      delete [] rows;
+
+      Bx = new Scalar[std::max(this->num_blocks, 1u) * block_size * block_size];
+      Hermes::Algebra::first_touch_zero(Bx, sizeof(Scalar) * this->num_blocks * block_size * block_size);
+    }
+
+    template<typename Scalar, int block_size>
+    void BSRMatrix<Scalar, block_size>::free()
+    {
+      this->num_blocks = 0;
+      if(Bp != NULL)
+      {
+        delete [] Bp;
+        Bp = NULL;
+      }
+      if(Bj != NULL)
+      {
+        delete [] Bj;
+        Bj = NULL;
+      }
+      if(Bx != NULL)
+      {
+        delete [] Bx;
+        Bx = NULL;
+      }
+    }
+
+    template<typename Scalar, int block_size>
+    int BSRMatrix<Scalar, block_size>::find_block(unsigned int block_row, unsigned int block_col) const
+    {
+      const int* begin = Bj + Bp[block_row];
+      const int* end = Bj + Bp[block_row + 1];
+      const int* found = std::lower_bound(begin, end, (int)block_col);
+      if(found == end || *found != (int)block_col)
+        return -1;
+      return found - Bj;
+    }
+
+    template<typename Scalar, int block_size>
+    Scalar BSRMatrix<Scalar, block_size>::get(unsigned int m, unsigned int n)
+    {
+      int block = find_block(m / block_size, n / block_size);
+      if(block < 0)
+        return 0.0;
+      return Bx[block * block_size * block_size + (m % block_size) * block_size + n % block_size];
+    }
+
+    template<typename Scalar, int block_size>
+    void BSRMatrix<Scalar, block_size>::zero()
+    {
+      Hermes::Algebra::first_touch_zero(Bx, sizeof(Scalar) * this->num_blocks * block_size * block_size);
+    }
+
+    template<typename Scalar, int block_size>
+    void BSRMatrix<Scalar, block_size>::add(unsigned int m, unsigned int n, Scalar v)
+    {
+      if(v != 0.0)   // ignore zero values.
+      {
+        int block = find_block(m / block_size, n / block_size);
+        // Make sure we are adding to an existing block.
+        if(block < 0)
+          throw Hermes::Exceptions::Exception("Sparse matrix entry not found: [%i, %i]", m, n);
+        add_shared(Bx[block * block_size * block_size + (m % block_size) * block_size + n % block_size], v);
+      }
+    }
+
+    template<typename Scalar, int block_size>
+    void BSRMatrix<Scalar, block_size>::add(unsigned int m, unsigned int n, Scalar **mat, int *rows, int *cols)
+    {
+      for (unsigned int i = 0; i < m; i++)       // rows
+        for (unsigned int j = 0; j < n; j++)     // cols
+          if(rows[i] >= 0 && cols[j] >= 0) // not Dir. dofs.
+            add(rows[i], cols[j], mat[i][j]);
+    }
+
+    template<typename Scalar, int block_size>
+    void BSRMatrix<Scalar, block_size>::add_dense_block(unsigned int row, unsigned int col, unsigned int m, unsigned int n, Scalar** mat, unsigned int mat_col)
+    {
+      if(m == 0 || n == 0)
+        return;
+
+      unsigned int first_block_col = col / block_size, last_block_col = (col + n - 1) / block_size;
+      for (unsigned int block_row = row / block_size; block_row <= (row + m - 1) / block_size; block_row++)
+      {
+        // The rows of the dense block within this block row.
+        unsigned int row_begin = std::max(row, block_row * block_size), row_end = std::min(row + m, (block_row + 1) * block_size);
+
+        // The block columns are sorted, so the blocks covering the contiguous columns are stored one after another.
+        int k = find_block(block_row, first_block_col);
+        if(k < 0)
+          throw Hermes::Exceptions::Exception("Sparse matrix block not found: [%i, %i]", block_row, first_block_col);
+        for (unsigned int block_col = first_block_col; block_col <= last_block_col; block_col++, k++)
+        {
+          if(k >= Bp[block_row + 1] || Bj[k] != (int)block_col)
+            throw Hermes::Exceptions::Exception("Sparse matrix block not found: [%i, %i]", block_row, block_col);
+
+          unsigned int col_begin = std::max(col, block_col * block_size), col_end = std::min(col + n, (block_col + 1) * block_size);
+          Scalar* block = Bx + k * block_size * block_size;
+          for (unsigned int i = row_begin; i < row_end; i++)
+            for (unsigned int j = col_begin; j < col_end; j++)
+            {
+              Scalar v = mat[i - row][mat_col + j - col];
+              if(v != 0.0)
+                add_shared(block[(i % block_size) * block_size + j % block_size], v);
+            }
+        }
+      }
+    }
+
+    template<typename Scalar, int block_size>
+    void BSRMatrix<Scalar, block_size>::add_to_diagonal(Scalar v)
+    {
+      for (unsigned int i = 0; i < this->size; i++)
+        add(i, i, v);
+    }
+
+    template<typename Scalar, int block_size>
+    void BSRMatrix<Scalar, block_size>::multiply_with_vector(Scalar* vector_in, Scalar* vector_out)
+    {
+      for (unsigned int block_row = 0; block_row < this->num_block_rows; block_row++)
+      {
+        Scalar result[block_size];
+        for (int r = 0; r < block_size; r++)
+          result[r] = 0.0;
+
+        for (int k = Bp[block_row]; k < Bp[block_row + 1]; k++)
+        {
+          const Scalar* block = Bx + k * block_size * block_size;
+          unsigned int col = Bj[k] * block_size;
+          // The fixed size loops over a whole block, only the padded last block column needs the checks.
+          if(col + block_size <= this->size)
+          {
+            for (int r = 0; r < block_size; r++)
+              for (int s = 0; s < block_size; s++)
+                result[r] += block[r * block_size + s] * vector_in[col + s];
+          }
+          else
+          {
+            for (int r = 0; r < block_size; r++)
+              for (int s = 0; col + s < this->size; s++)
+                result[r] += block[r * block_size + s] * vector_in[col + s];
+          }
+        }
+
+        for (int r = 0; r < block_size && block_row * block_size + r < this->size; r++)
+          vector_out[block_row * block_size + r] = result[r];
+      }
+    }
+
+    template<typename Scalar, int block_size>
+    void BSRMatrix<Scalar, block_size>::multiply_with_Scalar(Scalar value)
+    {
+      for (unsigned int i = 0; i < this->num_blocks * block_size * block_size; i++)
+        Bx[i] *= value;
+    }
+
+    template<typename Scalar, int block_size>
+    BSRMatrix<Scalar, block_size>* BSRMatrix<Scalar, block_size>::duplicate()
+    {
+      BSRMatrix<Scalar, block_size>* new_matrix = new BSRMatrix<Scalar, block_size>(this->size);
+      new_matrix->num_block_rows = this->num_block_rows;
+      new_matrix->num_blocks = this->num_blocks;
+      new_matrix->Bp = new int[this->num_block_rows + 1];
+      memcpy(new_matrix->Bp, Bp, sizeof(int) * (this->num_block_rows + 1));
+      new_matrix->Bj = new int[std::max(this->num_blocks, 1u)];
+      memcpy(new_matrix->Bj, Bj, sizeof(int) * this->num_blocks);
+      new_matrix->Bx = new Scalar[std::max(this->num_blocks, 1u) * block_size * block_size];
+      memcpy(new_matrix->Bx, Bx, sizeof(Scalar) * this->num_blocks * block_size * block_size);
+      return new_matrix;
+    }
+
+    template<typename Scalar, int block_size>
+    bool BSRMatrix<Scalar, block_size>::dump(FILE *file, const char *var_name, EMatrixDumpFormat fmt, char* number_format)
+    {
+      switch (fmt)
+      {
+      case DF_MATLAB_SPARSE:
+        fprintf(file, "%% Size: %dx%d\n%% Nonzeros: %d\ntemp = zeros(%d, 3);\ntemp =[\n",
+          this->size, this->size, this->get_nnz(), this->get_nnz());
+        for (unsigned int block_row = 0; block_row < this->num_block_rows; block_row++)
+          for (int k = Bp[block_row]; k < Bp[block_row + 1]; k++)
+            for (int r = 0; r < block_size; r++)
+              for (int s = 0; s < block_size; s++)
+              {
+                unsigned int row = block_row * block_size + r, col = Bj[k] * block_size + s;
+                if(row < this->size && col < this->size)
+                {
+                  fprintf(file, "%d %d ", row + 1, col + 1);
+                  Hermes::Helpers::fprint_num(file, Bx[k * block_size * block_size + r * block_size + s], number_format);
+                  fprintf(file, "\n");
+                }
+              }
+        fprintf(file, "];\n%s = spconvert(temp);\n", var_name);
+        return true;
+
+      default:
+        return false;
+      }
+    }
+
+    template<typename Scalar, int block_size>
+    unsigned int BSRMatrix<Scalar, block_size>::get_matrix_size() const
+    {
+      return this->size;
+    }
+
+    template<typename Scalar, int block_size>
+    unsigned int BSRMatrix<Scalar, block_size>::get_nnz() const
+    {
+      return this->num_blocks * block_size * block_size;
+    }
+
+    template<typename Scalar, int block_size>
+    double BSRMatrix<Scalar, block_size>::get_fill_in() const
+    {
+      return this->get_nnz() / (double) (this->size * this->size);
+    }
+
+    template class HERMES_API BSRMatrix<double, 2>;
+    template class HERMES_API BSRMatrix<double, 3>;
+    template class HERMES_API BSRMatrix<double, 4>;
+    template class HERMES_API BSRMatrix<std::complex<double>, 2>;
+    template class HERMES_API BSRMatrix<std::complex<double>, 3>;
+    template class HERMES_API BSRMatrix<std::complex<double>, 4>;
+  }
+}
@@ -0,0 +1,321 @@
+// This file is part of HermesCommon
+//
+// Hermes is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes; if not, see <http://www.gnu.prg/licenses/>.
+#include "buffered_logger.h"
+#include <vector>
+#include <string>
+#include <set>
+#include <map>
+#include "common.h"
+#ifndef WIN32
+#include <unistd.h>
+#include <sched.h>
+#endif
+
+namespace Hermes
+{
+  bool BufferedLogger::enabled = false;
+
+  /// One buffered message.
+  struct BufferedLogRecord
+  {
+    unsigned long sequence;
+    char code;
+    time_t time;
+    const char* log_file;
+    const char* src_function;
+    const char* src_file;
+    int src_line;
+    char text[BUF_SZ];
+  };
+
+  /// Ring buffer of one thread, written only by the thread, read only by the flusher.
+  struct BufferedLogRing
+  {
+    BufferedLogRecord records[HERMES_LOGGER_RING_SIZE];
+    /// Number of the records ever written (by the thread).
+    volatile unsigned long written;
+    /// Number of the records ever read (by the flusher).
+    volatile unsigned long read;
+  };
+
+  static BufferedLogRing* logger_rings[HERMES_LOGGER_MAX_THREADS];
+  static volatile int logger_num_rings = 0;
+  static pthread_mutex_t logger_rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+  static pthread_key_t logger_ring_key;
+  static pthread_once_t logger_ring_key_once = PTHREAD_ONCE_INIT;
+
+  static volatile unsigned long logger_sequence = 0;
+
+  static pthread_t logger_flusher;
+  static volatile bool logger_flusher_running = false;
+  static volatile bool logger_flusher_stop = false;
+
+  static inline void logger_memory_barrier()
+  {
+#ifdef _MSC_VER
+    MemoryBarrier();
+#else
+    __sync_synchronize();
+#endif
+  }
+
+  static inline unsigned long logger_next_sequence()
+  {
+#ifdef _MSC_VER
+    return (unsigned long)InterlockedIncrement((volatile LONG*)&logger_sequence);
+#else
+    return __sync_fetch_and_add(&logger_sequence, 1);
+#endif
+  }
+
+  static inline void logger_yield(bool sleep)
+  {
+#ifdef WIN32
+    Sleep(sleep ? 1 : 0);
+#else
+    if(sleep)
+      usleep(1000);
+    else
+      sched_yield();
+#endif
+  }
+
+  static void logger_create_ring_key()
+  {
+    pthread_key_create(&logger_ring_key, NULL);
+  }
+
+  /// The ring of the calling thread, created on the first use, NULL if there are too many threads.
+  static BufferedLogRing* get_logger_ring()
+  {
+    pthread_once(&logger_ring_key_once, logger_create_ring_key);
+    BufferedLogRing* ring = (BufferedLogRing*)pthread_getspecific(logger_ring_key);
+    if(ring != NULL)
+      return ring;
+
+    pthread_mutex_lock(&logger_rings_mutex);
+    if(logger_num_rings < HERMES_LOGGER_MAX_THREADS)
+    {
+      ring = new BufferedLogRing;
+      ring->written = ring->read = 0;
+      logger_rings[logger_num_rings] = ring;
+      logger_memory_barrier();
+      logger_num_rings++;
+    }
+    pthread_mutex_unlock(&logger_rings_mutex);
+
+    if(ring != NULL)
+      pthread_setspecific(logger_ring_key, ring);
+    return ring;
+  }
+
+  static bool logger_record_less(const BufferedLogRecord* a, const BufferedLogRecord* b)
+  {
+    return a->sequence < b->sequence;
+  }
+
+  /// Open log files of the flusher and the files it has already written to (the delimiter is written once).
+  static std::map<std::string, FILE*> logger_files;
+  static std::set<std::string> logger_files_written;
+
+  static FILE* get_logger_file(const char* log_file)
+  {
+    std::map<std::string, FILE*>::iterator it = logger_files.find(log_file);
+    if(it != logger_files.end())
+      return it->second;
+
+    FILE* file = fopen(log_file, "at");
+    if(file != NULL && logger_files_written.insert(log_file).second)
+    {
+      fprintf(file, "\n");
+      for(int i = 0; i < HERMES_LOG_FILE_DELIM_SIZE; i++)
+        fprintf(file, "-");
+      fprintf(file, "\n\n");
+    }
+    logger_files.insert(std::pair<std::string, FILE*>(log_file, file));
+    return file;
+  }
+
+  static void write_logger_record(const BufferedLogRecord& record)
+  {
+    // The same output as Mixins::Loggable::write_console().
+#ifdef WIN32
+    printf("%s\n", record.text);
+#else
+    if(record.code == HERMES_EC_WARNING)
+      printf("\033[33m%s\033[0m\n", record.text);
+    else if(record.code == HERMES_EC_INFO)
+      printf("\033[30m\033[1m%s\033[0m\n", record.text);
+    else
+      printf("%s\n", record.text);
+#endif
+
+    if(record.log_file == NULL)
+      return;
+    FILE* file = get_logger_file(record.log_file);
+    if(file == NULL)
+      return;
+
+    std::ostringstream location;
+    location << '(';
+    if(record.src_function != NULL)
+    {
+      location << record.src_function;
+      if(record.src_file != NULL)
+        location << '@';
+    }
+    if(record.src_file != NULL)
+      location << record.src_file << ':' << record.src_line;
+    location << ')';
+
+    char time_buf[BUF_SZ];
+    strftime(time_buf, BUF_SZ, "%y%m%d-%H:%M", gmtime(&record.time));
+    fprintf(file, "%s\t%s %s\n", time_buf, record.text, location.str().c_str());
+  }
+
+  /// Writes all the buffered records, in the order of their sequence numbers.
+  static void write_logger_rings()
+  {
+    int num_rings = logger_num_rings;
+    logger_memory_barrier();
+
+    std::vector<unsigned long> written(num_rings);
+    std::vector<const BufferedLogRecord*> batch;
+    for(int i = 0; i < num_rings; i++)
+    {
+      written[i] = logger_rings[i]->written;
+      logger_memory_barrier();
+      for(unsigned long k = logger_rings[i]->read; k < written[i]; k++)
+        batch.push_back(&logger_rings[i]->records[k % HERMES_LOGGER_RING_SIZE]);
+    }
+    if(batch.empty())
+      return;
+
+    std::sort(batch.begin(), batch.end(), logger_record_less);
+    for(unsigned int i = 0; i < batch.size(); i++)
+      write_logger_record(*batch[i]);
+
+    fflush(stdout);
+    for(std::map<std::string, FILE*>::iterator it = logger_files.begin(); it != logger_files.end(); it++)
+      if(it->second != NULL)
+        fflush(it->second);
+
+    logger_memory_barrier();
+    for(int i = 0; i < num_rings; i++)
+      logger_rings[i]->read = written[i];
+  }
+
+  static void* logger_flusher_main(void*)
+  {
+    while(true)
+    {
+      bool stop = logger_flusher_stop;
+      logger_memory_barrier();
+      write_logger_rings();
+      if(stop)
+        break;
+      logger_yield(true);
+    }
+
+    for(std::map<std::string, FILE*>::iterator it = logger_files.begin(); it != logger_files.end(); it++)
+      if(it->second != NULL)
+        fclose(it->second);
+    logger_files.clear();
+    return NULL;
+  }
+
+  /// Writes the remaining messages at the end of the program.
+  static class BufferedLoggerFinalizer
+  {
+  public:
+    ~BufferedLoggerFinalizer()
+    {
+      BufferedLogger::set_enabled(false);
+    }
+  } buffered_logger_finalizer;
+
+  void BufferedLogger::set_enabled(bool to_set)
+  {
+    if(to_set)
+    {
+      if(!logger_flusher_running)
+      {
+        logger_flusher_stop = false;
+        logger_memory_barrier();
+        if(pthread_create(&logger_flusher, NULL, logger_flusher_main, NULL) != 0)
+          return;
+        logger_flusher_running = true;
+      }
+      enabled = true;
+    }
+    else
+    {
+      enabled = false;
+      if(logger_flusher_running)
+      {
+        logger_flusher_stop = true;
+        logger_memory_barrier();
+        pthread_join(logger_flusher, NULL);
+        logger_flusher_running = false;
+      }
+    }
+  }
+
+  bool BufferedLogger::push(char code, const char* text, const char* log_file, const char* src_function, const char* src_file, int src_line)
+  {
+    BufferedLogRing* ring = get_logger_ring();
+    if(ring == NULL)
+      return false;
+
+    // Full ring, wait for the flusher.
+    while(ring->written - ring->read >= HERMES_LOGGER_RING_SIZE)
+    {
+      if(!logger_flusher_running)
+        return false;
+      logger_yield(false);
+      logger_memory_barrier();
+    }
+
+    BufferedLogRecord& record = ring->records[ring->written % HERMES_LOGGER_RING_SIZE];
+    record.code = code;
+    time(&record.time);
+    record.log_file = log_file;
+    record.src_function = src_function;
+    record.src_file = src_file;
+    record.src_line = src_line;
+    strncpy(record.text, text, BUF_SZ - 1);
+    record.text[BUF_SZ - 1] = '\0';
+    record.sequence = logger_next_sequence();
+
+    logger_memory_barrier();
+    ring->written = ring->written + 1;
+    return true;
+  }
+
+  void BufferedLogger::flush()
+  {
+    int num_rings = logger_num_rings;
+    logger_memory_barrier();
+    for(int i = 0; i < num_rings; i++)
+    {
+      unsigned long written = logger_rings[i]->written;
+      while(logger_flusher_running && logger_rings[i]->read < written)
+      {
+        logger_yield(false);
+        logger_memory_barrier();
+      }
+    }
+  }
+}
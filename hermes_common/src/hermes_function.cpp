@@ -118,6 +118,32 @@ namespace Hermes
     }
   };
 
+  template<typename Scalar>
+  void Hermes1DFunction<Scalar>::value_batch(int n, const Scalar* x, Scalar* out) const
+  {
+    if(this->is_const)
+    {
+      for(int i = 0; i < n; i++)
+        out[i] = this->const_value;
+    }
+    else
+      for(int i = 0; i < n; i++)
+        out[i] = this->value(x[i]);
+  }
+
+  template<typename Scalar>
+  void Hermes1DFunction<Scalar>::derivative_batch(int n, const Scalar* x, Scalar* out) const
+  {
+    if(this->is_const)
+    {
+      for(int i = 0; i < n; i++)
+        out[i] = Scalar(0);
+    }
+    else
+      for(int i = 0; i < n; i++)
+        out[i] = this->derivative(x[i]);
+  }
+
   template<typename Scalar>
   Hermes2DFunction<Scalar>::Hermes2DFunction()
   {
@@ -237,6 +263,19 @@ namespace Hermes
     }
   };
 
+  template<typename Scalar>
+  void Hermes2DFunction<Scalar>::value_batch(int n, const double* x, const double* y, Scalar* out) const
+  {
+    if(this->is_const)
+    {
+      for(int i = 0; i < n; i++)
+        out[i] = this->const_value;
+    }
+    else
+      for(int i = 0; i < n; i++)
+        out[i] = this->value(x[i], y[i]);
+  }
+
   template<typename Scalar>
   Hermes3DFunction<Scalar>::Hermes3DFunction()
   {
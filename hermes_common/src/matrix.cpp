@@ -31,9 +31,50 @@
 #include "solvers/mumps_solver.h"
 #include "solvers/newton_solver_nox.h"
 #include "solvers/aztecoo_solver.h"
+#include "solvers/native_iter_solver.h"
 #include "qsort.h"
 #include "api.h"
 
+/// Below this size (in bytes), the arrays are first touched by the calling thread.
+static const std::size_t FIRST_TOUCH_MIN_SIZE = 1 << 17;
+
+void Hermes::Algebra::first_touch_zero(void* array, std::size_t size)
+{
+  int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+  if(size < FIRST_TOUCH_MIN_SIZE || num_threads_used < 2 || !Hermes::HermesCommonApi.get_integral_param_value(Hermes::parallelFirstTouch))
+  {
+    memset(array, 0, size);
+    return;
+  }
+
+  char* bytes = (char*)array;
+#pragma omp parallel num_threads(num_threads_used)
+  {
+    std::size_t begin = size * omp_get_thread_num() / omp_get_num_threads();
+    std::size_t end = size * (omp_get_thread_num() + 1) / omp_get_num_threads();
+    memset(bytes + begin, 0, end - begin);
+  }
+}
+
+void Hermes::Algebra::first_touch_copy(void* dest, const void* src, std::size_t size)
+{
+  int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+  if(size < FIRST_TOUCH_MIN_SIZE || num_threads_used < 2 || !Hermes::HermesCommonApi.get_integral_param_value(Hermes::parallelFirstTouch))
+  {
+    memcpy(dest, src, size);
+    return;
+  }
+
+  char* dest_bytes = (char*)dest;
+  const char* src_bytes = (const char*)src;
+#pragma omp parallel num_threads(num_threads_used)
+  {
+    std::size_t begin = size * omp_get_thread_num() / omp_get_num_threads();
+    std::size_t end = size * (omp_get_thread_num() + 1) / omp_get_num_threads();
+    memcpy(dest_bytes + begin, src_bytes + begin, end - begin);
+  }
+}
+
 void Hermes::Algebra::DenseMatrixOperations::ludcmp(double **a, int n, int *indx, double *d)
 {
   int i, imax = 0, j, k;
@@ -117,6 +158,229 @@ void Hermes::Algebra::DenseMatrixOperations::choldc(double **a, int n, double p[
   }
 }
 
+/// Applies the Householder reflector I - 2 v v^T / (v^T v) of the length len from the left to the rows k, ..., k + len - 1
+/// (the columns first_col, ..., n - 1), from the right to the columns k, ..., k + len - 1 (the rows 0, ..., last_row) and to q.
+static void apply_householder_reflector(double **a, double **q, int n, int k, int len, const double* v, int first_col, int last_row)
+{
+  double vv = 0.0;
+  for (int i = 0; i < len; i++)
+    vv += v[i] * v[i];
+  if(vv == 0.0)
+    return;
+
+  for (int j = first_col; j < n; j++)
+  {
+    double s = 0.0;
+    for (int i = 0; i < len; i++)
+      s += v[i] * a[k + i][j];
+    s *= 2.0 / vv;
+    for (int i = 0; i < len; i++)
+      a[k + i][j] -= s * v[i];
+  }
+  for (int i = 0; i <= last_row; i++)
+  {
+    double s = 0.0;
+    for (int j = 0; j < len; j++)
+      s += a[i][k + j] * v[j];
+    s *= 2.0 / vv;
+    for (int j = 0; j < len; j++)
+      a[i][k + j] -= s * v[j];
+  }
+  for (int i = 0; i < n; i++)
+  {
+    double s = 0.0;
+    for (int j = 0; j < len; j++)
+      s += q[i][k + j] * v[j];
+    s *= 2.0 / vv;
+    for (int j = 0; j < len; j++)
+      q[i][k + j] -= s * v[j];
+  }
+}
+
+/// The Householder vector v of the reflector mapping x to a multiple of the first unit vector.
+static void householder_vector(const double* x, int len, double* v)
+{
+  double norm = 0.0;
+  for (int i = 0; i < len; i++)
+  {
+    norm += x[i] * x[i];
+    v[i] = x[i];
+  }
+  norm = sqrt(norm);
+  v[0] += (x[0] >= 0.0) ? norm : -norm;
+}
+
+/// Splits the converged 2x2 diagonal block at (p, p) by a rotation if its eigenvalues are real.
+static void split_real_schur_block(double **a, double **q, int n, int p)
+{
+  double half = 0.5 * (a[p][p] - a[p + 1][p + 1]);
+  double disc = half * half + a[p][p + 1] * a[p + 1][p];
+  // A pair of complex conjugate eigenvalues.
+  if(disc < 0.0)
+    return;
+
+  // The eigenvector (cs, sn) of the eigenvalue lambda becomes the first column of the rotation.
+  double lambda = a[p + 1][p + 1] + half + ((half >= 0.0) ? sqrt(disc) : -sqrt(disc));
+  double cs = a[p][p + 1], sn = lambda - a[p][p];
+  if(fabs(lambda - a[p + 1][p + 1]) + fabs(a[p + 1][p]) > fabs(cs) + fabs(sn))
+  {
+    cs = lambda - a[p + 1][p + 1];
+    sn = a[p + 1][p];
+  }
+  double norm = sqrt(cs * cs + sn * sn);
+  if(norm == 0.0)
+    return;
+  cs /= norm;
+  sn /= norm;
+
+  for (int j = p; j < n; j++)
+  {
+    double u = a[p][j], w = a[p + 1][j];
+    a[p][j] = cs * u + sn * w;
+    a[p + 1][j] = -sn * u + cs * w;
+  }
+  for (int i = 0; i <= p + 1; i++)
+  {
+    double u = a[i][p], w = a[i][p + 1];
+    a[i][p] = cs * u + sn * w;
+    a[i][p + 1] = -sn * u + cs * w;
+  }
+  for (int i = 0; i < n; i++)
+  {
+    double u = q[i][p], w = q[i][p + 1];
+    q[i][p] = cs * u + sn * w;
+    q[i][p + 1] = -sn * u + cs * w;
+  }
+  a[p + 1][p] = 0.0;
+}
+
+void Hermes::Algebra::DenseMatrixOperations::real_schur(double **a, int n, double **q)
+{
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      q[i][j] = (i == j) ? 1.0 : 0.0;
+
+  double* x = new double[n];
+  double* v = new double[n];
+
+  // Reduction to the upper Hessenberg form.
+  for (int k = 0; k < n - 2; k++)
+  {
+    int len = n - k - 1;
+    for (int i = 0; i < len; i++)
+      x[i] = a[k + 1 + i][k];
+    householder_vector(x, len, v);
+    apply_householder_reflector(a, q, n, k + 1, len, v, k, n - 1);
+    for (int i = k + 2; i < n; i++)
+      a[i][k] = 0.0;
+  }
+
+  double norm = 0.0;
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      norm += fabs(a[i][j]);
+
+  // The Francis double shift QR steps on the unreduced part a[l..m][l..m].
+  int m = n - 1, iterations = 0;
+  while(m > 0)
+  {
+    int l = m;
+    for (; l > 0; l--)
+    {
+      double s = fabs(a[l - 1][l - 1]) + fabs(a[l][l]);
+      if(s == 0.0)
+        s = norm;
+      if(fabs(a[l][l - 1]) <= 1e-15 * s)
+      {
+        a[l][l - 1] = 0.0;
+        break;
+      }
+    }
+
+    if(l == m)
+    {
+      m--;
+      iterations = 0;
+      continue;
+    }
+    if(l == m - 1)
+    {
+      split_real_schur_block(a, q, n, l);
+      m -= 2;
+      iterations = 0;
+      continue;
+    }
+
+    if(++iterations > 30 * n)
+    {
+      delete [] x;
+      delete [] v;
+      throw Exceptions::Exception("real_schur() did not converge.");
+    }
+
+    // The sum and the product of the shifts, an exceptional shift now and then.
+    double s, t;
+    if(iterations % 10 == 0)
+    {
+      double w = fabs(a[m][m - 1]) + fabs(a[m - 1][m - 2]);
+      s = 1.5 * w;
+      t = w * w;
+    }
+    else
+    {
+      s = a[m - 1][m - 1] + a[m][m];
+      t = a[m - 1][m - 1] * a[m][m] - a[m - 1][m] * a[m][m - 1];
+    }
+
+    x[0] = a[l][l] * a[l][l] + a[l][l + 1] * a[l + 1][l] - s * a[l][l] + t;
+    x[1] = a[l + 1][l] * (a[l][l] + a[l + 1][l + 1] - s);
+    x[2] = a[l + 1][l] * a[l + 2][l + 1];
+    for (int k = l; k < m - 1; k++)
+    {
+      householder_vector(x, 3, v);
+      apply_householder_reflector(a, q, n, k, 3, v, (k > l) ? k - 1 : l, std::min(k + 3, m));
+      if(k > l)
+        a[k + 1][k - 1] = a[k + 2][k - 1] = 0.0;
+      x[0] = a[k + 1][k];
+      x[1] = a[k + 2][k];
+      if(k < m - 2)
+        x[2] = a[k + 3][k];
+    }
+    householder_vector(x, 2, v);
+    apply_householder_reflector(a, q, n, m - 1, 2, v, m - 2, m);
+    a[m][m - 2] = 0.0;
+  }
+
+  delete [] x;
+  delete [] v;
+}
+
+Hermes::Algebra::SparsityPattern::SparsityPattern(unsigned int size, int* col_start, int* rows, bool symmetric)
+  : size(size), col_start(col_start), rows(rows), symmetric(symmetric), num_references(1)
+{
+}
+
+Hermes::Algebra::SparsityPattern::~SparsityPattern()
+{
+  delete [] col_start;
+  delete [] rows;
+}
+
+void Hermes::Algebra::SparsityPattern::add_reference()
+{
+#pragma omp critical (SparsityPattern_references)
+  this->num_references++;
+}
+
+void Hermes::Algebra::SparsityPattern::release()
+{
+  bool last;
+#pragma omp critical (SparsityPattern_references)
+  last = (--this->num_references == 0);
+  if(last)
+    delete this;
+}
+
 template<typename Scalar>
 Hermes::Algebra::SparseMatrix<Scalar>::SparseMatrix()
 {
@@ -125,6 +389,7 @@ Hermes::Algebra::SparseMatrix<Scalar>::SparseMatrix()
 
   row_storage = false;
   col_storage = false;
+  symmetric_storage = false;
 }
 
 template<typename Scalar>
@@ -135,6 +400,7 @@ Hermes::Algebra::SparseMatrix<Scalar>::SparseMatrix(unsigned int size)
 
   row_storage = false;
   col_storage = false;
+  symmetric_storage = false;
 }
 
 template<typename Scalar>
@@ -158,9 +424,19 @@ void Hermes::Algebra::SparseMatrix<Scalar>::prealloc(unsigned int n)
   memset(pages, 0, n * sizeof(Page *));
 }
 
+template<typename Scalar>
+void Hermes::Algebra::SparseMatrix<Scalar>::set_symmetric_storage(bool symmetric)
+{
+  if(symmetric && !this->supports_symmetric_storage())
+    throw Hermes::Exceptions::Exception("The matrix does not support the symmetric storage.");
+  this->symmetric_storage = symmetric;
+}
+
 template<typename Scalar>
 void Hermes::Algebra::SparseMatrix<Scalar>::pre_add_ij(unsigned int row, unsigned int col)
 {
+  if(this->symmetric_storage && row > col)
+    return;
   if(pages[col] == NULL || pages[col]->count >= PAGE_SIZE)
   {
     Page *new_page = new Page;
@@ -171,6 +447,33 @@ void Hermes::Algebra::SparseMatrix<Scalar>::pre_add_ij(unsigned int row, unsigne
   pages[col]->idx[pages[col]->count++] = row;
 }
 
+template<typename Scalar>
+void Hermes::Algebra::SparseMatrix<Scalar>::alloc_with_structure(unsigned int n, const int* col_start, const int* rows)
+{
+  this->prealloc(n);
+
+  // Whole pages at once, alloc() then finds the indices sorted already.
+  for (unsigned int col = 0; col < n; col++)
+    for (int i = col_start[col]; i < col_start[col + 1]; i += PAGE_SIZE)
+    {
+      Page *new_page = new Page;
+      new_page->count = (col_start[col + 1] - i < PAGE_SIZE) ? col_start[col + 1] - i : PAGE_SIZE;
+      memcpy(new_page->idx, rows + i, sizeof(int) * new_page->count);
+      new_page->next = pages[col];
+      pages[col] = new_page;
+    }
+
+  this->alloc();
+}
+
+template<typename Scalar>
+void Hermes::Algebra::SparseMatrix<Scalar>::alloc_with_pattern(SparsityPattern* pattern)
+{
+  if(pattern->is_symmetric() != this->symmetric_storage)
+    throw Hermes::Exceptions::Exception("The symmetric storage of the matrix does not match the sparsity pattern.");
+  this->alloc_with_structure(pattern->get_size(), pattern->get_col_start(), pattern->get_rows());
+}
+
 template<typename Scalar>
 int Hermes::Algebra::SparseMatrix<Scalar>::sort_and_store_indices(Page *page, int *buffer, int *max)
 {
@@ -260,6 +563,24 @@ SparseMatrix<Scalar>* Hermes::Algebra::create_matrix()
       return new SuperLUMatrix<Scalar>;
 #else
       throw Hermes::Exceptions::Exception("SuperLU was not installed.");
+#endif
+      break;
+    }
+  case Hermes::SOLVER_NATIVE_ITERATIVE:
+    {
+#ifdef WITH_UMFPACK
+      return new CSCMatrix<Scalar>;
+#else
+      throw Hermes::Exceptions::Exception("The built-in iterative solvers need the CSC matrix, which is available with UMFPACK.");
+#endif
+      break;
+    }
+  case Hermes::SOLVER_AUTO:
+    {
+#ifdef WITH_UMFPACK
+      return new UMFPackMatrix<Scalar>;
+#else
+      throw Hermes::Exceptions::Exception("The automatic selection of the solver needs the CSC matrix, which is available with UMFPACK.");
 #endif
       break;
     }
@@ -325,6 +646,24 @@ Vector<Scalar>* Hermes::Algebra::create_vector()
       return new SuperLUVector<Scalar>;
 #else
       throw Hermes::Exceptions::Exception("SuperLU was not installed.");
+#endif
+      break;
+    }
+  case Hermes::SOLVER_NATIVE_ITERATIVE:
+    {
+#ifdef WITH_UMFPACK
+      return new UMFPackVector<Scalar>;
+#else
+      throw Hermes::Exceptions::Exception("The built-in iterative solvers need the CSC matrix, which is available with UMFPACK.");
+#endif
+      break;
+    }
+  case Hermes::SOLVER_AUTO:
+    {
+#ifdef WITH_UMFPACK
+      return new UMFPackVector<Scalar>;
+#else
+      throw Hermes::Exceptions::Exception("The automatic selection of the solver needs the CSC matrix, which is available with UMFPACK.");
 #endif
       break;
     }
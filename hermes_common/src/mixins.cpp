@@ -16,6 +16,7 @@
 #include <map>
 #include <string>
 #include "common.h"
+#include "buffered_logger.h"
 
 namespace Hermes
 {
@@ -421,6 +422,18 @@ namespace Hermes
 
     void Loggable::hermes_log_message(const char code, const char* msg) const
     {
+      // Buffered backend, no locking and no file operations in the calling thread.
+      if(BufferedLogger::is_enabled())
+      {
+        const char* log_file = HERMES_LOG_FILE;
+        if(BufferedLogger::push(code, msg, log_file, __CURRENT_FUNCTION, __FILE__, __LINE__))
+        {
+          if(log_file != NULL && this->verbose_callback != NULL)
+            this->verbose_callback(msg);
+          return;
+        }
+      }
+
       logger_monitor.enter();
 
       //print the message
@@ -670,5 +683,64 @@ namespace Hermes
     {
 
     }
+  
+    IterationRecordable::IterationRecord::IterationRecord(int iteration) : iteration(iteration), residual_norm(0.0), damping_coefficient(1.0),
+      assembly_time(0.0), solve_time(0.0), factorization_reused(false), linear_iterations(-1)
+    {
+    }
+
+    IterationRecordable::IterationRecordable()
+    {
+    }
+
+    const std::vector<IterationRecordable::IterationRecord>& IterationRecordable::get_iteration_records() const
+    {
+      return this->iteration_records;
+    }
+
+    void IterationRecordable::clear_iteration_records()
+    {
+      this->iteration_records.clear();
+    }
+
+    IterationRecordable::IterationRecord& IterationRecordable::add_iteration_record(int iteration)
+    {
+      this->iteration_records.push_back(IterationRecord(iteration));
+      return this->iteration_records.back();
+    }
+
+    IterationRecordable::IterationRecord& IterationRecordable::last_iteration_record()
+    {
+      return this->iteration_records.back();
+    }
+
+    void IterationRecordable::export_iteration_records(const char* filename, IterationRecordsFormat format) const
+    {
+      FILE* file = fopen(filename, "w");
+      if(file == NULL)
+        throw Hermes::Exceptions::Exception("Could not open the file %s for writing the iteration records.", filename);
+
+      if(format == IterationRecordsCSV)
+        fprintf(file, "iteration,residual_norm,damping_coefficient,assembly_time,solve_time,factorization_reused,linear_iterations\n");
+      else
+        fprintf(file, "[\n");
+
+      for(unsigned int i = 0; i < this->iteration_records.size(); i++)
+      {
+        const IterationRecord& record = this->iteration_records[i];
+        if(format == IterationRecordsCSV)
+          fprintf(file, "%d,%.17g,%.17g,%.17g,%.17g,%d,%d\n", record.iteration, record.residual_norm, record.damping_coefficient,
+            record.assembly_time, record.solve_time, record.factorization_reused ? 1 : 0, record.linear_iterations);
+        else
+          fprintf(file, "  {\"iteration\": %d, \"residual_norm\": %.17g, \"damping_coefficient\": %.17g, \"assembly_time\": %.17g, \"solve_time\": %.17g, \"factorization_reused\": %s, \"linear_iterations\": %d}%s\n",
+            record.iteration, record.residual_norm, record.damping_coefficient, record.assembly_time, record.solve_time,
+            record.factorization_reused ? "true" : "false", record.linear_iterations, i + 1 < this->iteration_records.size() ? "," : "");
+      }
+
+      if(format == IterationRecordsJSON)
+        fprintf(file, "]\n");
+
+      fclose(file);
+    }
   }
 }
@@ -0,0 +1,233 @@
+// This file is part of HermesCommon
+//
+// Hermes is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// Hermes is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes; if not, see <http://www.gnu.prg/licenses/>.
+#include "profiler.h"
+#include <vector>
+#include <string>
+#include <cstdio>
+#include "common.h"
+#include "mixins.h"
+
+namespace Hermes
+{
+  bool Profiler::enabled = false;
+
+  /// One region in the tree of a thread.
+  struct ProfilerNode
+  {
+    const char* name;
+    int parent;
+    std::vector<int> children;
+    double time;
+    unsigned long calls;
+  };
+
+  /// The tree of the regions of one thread, node 0 is the root (no region).
+  struct ProfilerThreadData
+  {
+    ProfilerThreadData() : current(0)
+    {
+      ProfilerNode root;
+      root.name = "";
+      root.parent = -1;
+      root.time = 0.0;
+      root.calls = 0;
+      this->nodes.push_back(root);
+    }
+
+    std::vector<ProfilerNode> nodes;
+    int current;
+    /// The times (of the clock) the open regions were entered at.
+    std::vector<double> starts;
+    /// The time since the creation is clock.accumulated() after a tick.
+    Mixins::TimeMeasurable clock;
+  };
+
+  /// The slots are given to the threads in the order of their first region, only the thread itself writes its slot.
+  /// The threads are told apart by a thread-specific key, not by omp_get_thread_num(), which is the same
+  /// for the threads of the teams running concurrently (e.g. several problems solved in the threads of one process).
+  static ProfilerThreadData* profiler_threads[HERMES_PROFILER_MAX_THREADS];
+  static int profiler_num_threads = 0;
+  static pthread_mutex_t profiler_threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+  static pthread_key_t profiler_thread_key;
+  static pthread_once_t profiler_thread_key_once = PTHREAD_ONCE_INIT;
+
+  static void create_profiler_thread_key()
+  {
+    pthread_key_create(&profiler_thread_key, NULL);
+  }
+
+  static ProfilerThreadData* get_profiler_thread_data()
+  {
+    pthread_once(&profiler_thread_key_once, create_profiler_thread_key);
+    ProfilerThreadData* data = (ProfilerThreadData*)pthread_getspecific(profiler_thread_key);
+    if(data != NULL)
+      return data;
+
+    pthread_mutex_lock(&profiler_threads_mutex);
+    if(profiler_num_threads < HERMES_PROFILER_MAX_THREADS)
+    {
+      data = new ProfilerThreadData;
+      profiler_threads[profiler_num_threads++] = data;
+    }
+    pthread_mutex_unlock(&profiler_threads_mutex);
+
+    if(data != NULL)
+      pthread_setspecific(profiler_thread_key, data);
+    return data;
+  }
+
+  void Profiler::set_enabled(bool to_set)
+  {
+    enabled = to_set;
+  }
+
+  void Profiler::enter(const char* name)
+  {
+    ProfilerThreadData* data = get_profiler_thread_data();
+    if(data == NULL)
+      return;
+
+    int child = -1;
+    std::vector<int>& children = data->nodes[data->current].children;
+    for (unsigned int i = 0; i < children.size() && child < 0; i++)
+      if(data->nodes[children[i]].name == name || strcmp(data->nodes[children[i]].name, name) == 0)
+        child = children[i];
+    if(child < 0)
+    {
+      ProfilerNode node;
+      node.name = name;
+      node.parent = data->current;
+      node.time = 0.0;
+      node.calls = 0;
+      child = data->nodes.size();
+      data->nodes.push_back(node);
+      data->nodes[data->current].children.push_back(child);
+    }
+
+    data->current = child;
+    data->clock.tick();
+    data->starts.push_back(data->clock.accumulated());
+  }
+
+  void Profiler::leave()
+  {
+    ProfilerThreadData* data = get_profiler_thread_data();
+    if(data == NULL || data->starts.empty())
+      return;
+
+    data->clock.tick();
+    ProfilerNode& node = data->nodes[data->current];
+    node.time += data->clock.accumulated() - data->starts.back();
+    node.calls++;
+    data->starts.pop_back();
+    data->current = node.parent;
+  }
+
+  void Profiler::reset()
+  {
+    for (int thread_i = 0; thread_i < HERMES_PROFILER_MAX_THREADS; thread_i++)
+      if(profiler_threads[thread_i] != NULL)
+        for (unsigned int i = 0; i < profiler_threads[thread_i]->nodes.size(); i++)
+        {
+          profiler_threads[thread_i]->nodes[i].time = 0.0;
+          profiler_threads[thread_i]->nodes[i].calls = 0;
+        }
+  }
+
+  /// A region of the report, merged from the trees of the threads.
+  struct ProfilerReportNode
+  {
+    ProfilerReportNode(const std::string& name) : name(name), time(0.0), max_time(0.0), calls(0), threads(0) {}
+
+    std::string name;
+    double time;
+    double max_time;
+    unsigned long calls;
+    int threads;
+    std::vector<ProfilerReportNode> children;
+
+    ProfilerReportNode& get_child(const std::string& child_name)
+    {
+      for (unsigned int i = 0; i < this->children.size(); i++)
+        if(this->children[i].name == child_name)
+          return this->children[i];
+      this->children.push_back(ProfilerReportNode(child_name));
+      return this->children.back();
+    }
+
+    /// The first node of the name in the tree (breadth-first), NULL if there is none.
+    ProfilerReportNode* find(const std::string& node_name)
+    {
+      std::vector<ProfilerReportNode*> queue(1, this);
+      for (unsigned int i = 0; i < queue.size(); i++)
+      {
+        if(queue[i] != this && queue[i]->name == node_name)
+          return queue[i];
+        for (unsigned int j = 0; j < queue[i]->children.size(); j++)
+          queue.push_back(&queue[i]->children[j]);
+      }
+      return NULL;
+    }
+  };
+
+  static void merge_profiler_node(ProfilerReportNode& target, const ProfilerThreadData* data, int node_i)
+  {
+    const ProfilerNode& node = data->nodes[node_i];
+    target.time += node.time;
+    target.max_time = std::max(target.max_time, node.time);
+    target.calls += node.calls;
+    target.threads++;
+    for (unsigned int i = 0; i < node.children.size(); i++)
+      merge_profiler_node(target.get_child(data->nodes[node.children[i]].name), data, node.children[i]);
+  }
+
+  static void print_profiler_node(std::ostream& out, const ProfilerReportNode& node, double parent_time, int depth)
+  {
+    std::string label = std::string(2 * depth, ' ') + node.name;
+    char line[512];
+    sprintf(line, "%-60s %12.6f %12.6f %7.2f%% %10lu %7i", label.c_str(), node.time, node.max_time,
+      parent_time > 0.0 ? 100.0 * node.time / parent_time : 100.0, node.calls, node.threads);
+    out << line << std::endl;
+    for (unsigned int i = 0; i < node.children.size(); i++)
+      print_profiler_node(out, node.children[i], node.time, depth + 1);
+  }
+
+  void Profiler::report(std::ostream& out)
+  {
+    ProfilerReportNode root("");
+    for (int thread_i = 0; thread_i < HERMES_PROFILER_MAX_THREADS; thread_i++)
+    {
+      const ProfilerThreadData* data = profiler_threads[thread_i];
+      if(data == NULL)
+        continue;
+      const std::vector<int>& top = data->nodes[0].children;
+      for (unsigned int i = 0; i < top.size(); i++)
+      {
+        std::string name = data->nodes[top[i]].name;
+        ProfilerReportNode* target = (thread_i == 0) ? NULL : root.find(name);
+        merge_profiler_node(target == NULL ? root.get_child(name) : *target, data, top[i]);
+      }
+    }
+
+    char header[512];
+    sprintf(header, "%-60s %12s %12s %8s %10s %7s", "Region", "Total [s]", "Max [s]", "Parent", "Calls", "Threads");
+    out << header << std::endl;
+    double total = 0.0;
+    for (unsigned int i = 0; i < root.children.size(); i++)
+      total += root.children[i].time;
+    for (unsigned int i = 0; i < root.children.size(); i++)
+      print_profiler_node(out, root.children[i], total, 0);
+  }
+}
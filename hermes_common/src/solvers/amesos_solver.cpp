@@ -112,6 +112,52 @@ namespace Hermes
       return true;
     }
 
+    template<>
+    bool AmesosSolver<double>::solve(int num_rhs, double* rhs_block)
+    {
+      assert(m != NULL);
+
+      this->tick();
+
+      Epetra_MultiVector b(Copy, *m->std_map, rhs_block, m->size, num_rhs);
+      Epetra_MultiVector x(*m->std_map, num_rhs);
+      problem.SetOperator(m->mat);
+      problem.SetRHS(&b);
+      problem.SetLHS(&x);
+
+      if(!setup_factorization())
+      {
+        this->warn("AmesosSolver: LU factorization could not be completed");
+        return false;
+      }
+
+      int status = solver->Solve();
+      if(status != 0)
+      {
+        throw Hermes::Exceptions::Exception("AmesosSolver: Solution failed.");
+        return false;
+      }
+
+      this->tick();
+      this->time = this->accumulated();
+
+      delete [] this->sln;
+      this->sln = new double[m->size * num_rhs];
+      // copy the solutions into sln vector
+      for (int rhs_i = 0; rhs_i < num_rhs; rhs_i++)
+        for (unsigned int i = 0; i < m->size; i++)
+          this->sln[rhs_i * m->size + i] = x[rhs_i][i];
+
+      return true;
+    }
+
+    template<>
+    bool AmesosSolver<std::complex<double> >::solve(int num_rhs, std::complex<double>* rhs_block)
+    {
+      throw Hermes::Exceptions::Exception("AmesosSolver<Scalar>::solve() not yet implemented for complex problems");
+      return false;
+    }
+
     template<>
     bool AmesosSolver<std::complex<double> >::solve()
     {
@@ -0,0 +1,460 @@
+// This file is part of HermesCommon
+//
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Email: hpfem-group@unr.edu, home page: http://hpfem.org/.
+//
+// Hermes2D is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation; either version 2 of the License,
+// or (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/*! \file auto_solver.cpp
+\brief Linear solver selecting the fastest of the available backends by timing them (SOLVER_AUTO).
+*/
+#include "config.h"
+#ifdef WITH_UMFPACK
+#include "auto_solver.h"
+#include "native_iter_solver.h"
+#include "mumps_solver.h"
+#include "superlu_solver.h"
+#include "aztecoo_solver.h"
+#include "precond_ml.h"
+#include "profiler.h"
+#include "api.h"
+
+namespace Hermes
+{
+  namespace Solvers
+  {
+    /// The relative residual above which a solution of a candidate is not accepted while tuning.
+    static const double AUTO_SOLVER_MAX_RESIDUAL = 1e-6;
+
+    template<typename Scalar>
+    std::map<unsigned long long, typename AutoLinearMatrixSolver<Scalar>::Tuning> AutoLinearMatrixSolver<Scalar>::tunings;
+
+    static std::vector<std::string> make_auto_solver_candidate_names()
+    {
+      std::vector<std::string> names;
+      names.push_back("umfpack");
+#ifdef WITH_MUMPS
+      names.push_back("mumps");
+#endif
+#ifdef WITH_SUPERLU
+      names.push_back("superlu");
+#endif
+#if defined HAVE_AZTECOO && defined HAVE_EPETRA && defined HAVE_ML
+      names.push_back("aztecoo-ml");
+#endif
+      names.push_back("native-cg-amg");
+      names.push_back("native-gmres-ilu0");
+      return names;
+    }
+
+    template<typename Scalar>
+    AutoLinearMatrixSolver<Scalar>::AutoLinearMatrixSolver(CSCMatrix<Scalar> *m, Vector<Scalar> *rhs)
+      : LinearMatrixSolver<Scalar>(), m(m), rhs(rhs), structure_hash(0), reuse_scheme(HERMES_FACTORIZE_FROM_SCRATCH), last_candidate(-1)
+    {
+      Candidate empty = { NULL, NULL, NULL, NULL };
+      candidates.resize(get_candidate_names().size(), empty);
+    }
+
+    template<typename Scalar>
+    AutoLinearMatrixSolver<Scalar>::~AutoLinearMatrixSolver()
+    {
+      free_candidates();
+    }
+
+    template<typename Scalar>
+    const std::vector<std::string>& AutoLinearMatrixSolver<Scalar>::get_candidate_names()
+    {
+      static const std::vector<std::string> names = make_auto_solver_candidate_names();
+      return names;
+    }
+
+    template<typename Scalar>
+    int AutoLinearMatrixSolver<Scalar>::get_matrix_size()
+    {
+      return m->get_size();
+    }
+
+    template<typename Scalar>
+    void AutoLinearMatrixSolver<Scalar>::set_factorization_scheme(FactorizationScheme reuse_scheme)
+    {
+      this->reuse_scheme = reuse_scheme;
+    }
+
+    template<typename Scalar>
+    const char* AutoLinearMatrixSolver<Scalar>::get_last_solver_name() const
+    {
+      if(last_candidate < 0)
+        return NULL;
+      return get_candidate_names()[last_candidate].c_str();
+    }
+
+    template<typename Scalar>
+    void AutoLinearMatrixSolver<Scalar>::free_candidates()
+    {
+      for (unsigned int i = 0; i < candidates.size(); i++)
+      {
+        delete candidates[i].solver;
+        delete candidates[i].precond;
+        delete candidates[i].matrix;
+        delete candidates[i].rhs;
+        candidates[i].solver = NULL;
+        candidates[i].precond = NULL;
+        candidates[i].matrix = NULL;
+        candidates[i].rhs = NULL;
+      }
+    }
+
+    template<typename Scalar>
+    void AutoLinearMatrixSolver<Scalar>::create_candidate(int candidate)
+    {
+      const std::string& name = get_candidate_names()[candidate];
+      Candidate& c = candidates[candidate];
+
+      if(name == "umfpack")
+      {
+        // The system is used in place if it is of the UMFPACK types, a general CSCMatrix is copied.
+        UMFPackMatrix<Scalar>* matrix = dynamic_cast<UMFPackMatrix<Scalar>*>(m);
+        UMFPackVector<Scalar>* vector = dynamic_cast<UMFPackVector<Scalar>*>(rhs);
+        if(matrix == NULL || vector == NULL)
+        {
+          matrix = new UMFPackMatrix<Scalar>;
+          vector = new UMFPackVector<Scalar>;
+          c.matrix = matrix;
+          c.rhs = vector;
+        }
+        c.solver = new UMFPackLinearMatrixSolver<Scalar>(matrix, vector);
+      }
+#ifdef WITH_MUMPS
+      else if(name == "mumps")
+      {
+        MumpsMatrix<Scalar>* matrix = new MumpsMatrix<Scalar>;
+        MumpsVector<Scalar>* vector = new MumpsVector<Scalar>;
+        c.matrix = matrix;
+        c.rhs = vector;
+        c.solver = new MumpsSolver<Scalar>(matrix, vector);
+      }
+#endif
+#ifdef WITH_SUPERLU
+      else if(name == "superlu")
+      {
+        SuperLUMatrix<Scalar>* matrix = new SuperLUMatrix<Scalar>;
+        SuperLUVector<Scalar>* vector = new SuperLUVector<Scalar>;
+        c.matrix = matrix;
+        c.rhs = vector;
+        c.solver = new SuperLUSolver<Scalar>(matrix, vector);
+      }
+#endif
+#if defined HAVE_AZTECOO && defined HAVE_EPETRA && defined HAVE_ML
+      else if(name == "aztecoo-ml")
+      {
+        EpetraMatrix<Scalar>* matrix = new EpetraMatrix<Scalar>;
+        EpetraVector<Scalar>* vector = new EpetraVector<Scalar>;
+        c.matrix = matrix;
+        c.rhs = vector;
+        AztecOOSolver<Scalar>* solver = new AztecOOSolver<Scalar>(matrix, vector);
+        solver->set_solver("gmres");
+        c.precond = new Preconditioners::MlPrecond<Scalar>("sa");
+        solver->set_precond(c.precond);
+        c.solver = solver;
+      }
+#endif
+      else
+      {
+        NativeIterSolver<Scalar>* solver = new NativeIterSolver<Scalar>(m, rhs);
+        if(name == "native-cg-amg")
+        {
+          solver->set_solver("cg");
+          solver->set_precond("amg");
+        }
+        else
+        {
+          solver->set_solver("gmres");
+          solver->set_precond("ilu0");
+        }
+        c.solver = solver;
+      }
+
+      // The copy of the pattern.
+      if(c.matrix != NULL)
+      {
+        unsigned int n = m->get_size();
+        int* Ap = m->get_Ap();
+        int* Ai = m->get_Ai();
+        c.matrix->prealloc(n);
+        for (unsigned int col = 0; col < n; col++)
+          for (int k = Ap[col]; k < Ap[col + 1]; k++)
+            c.matrix->pre_add_ij(Ai[k], col);
+        c.matrix->alloc();
+        c.rhs->alloc(n);
+      }
+    }
+
+    template<typename Scalar>
+    bool AutoLinearMatrixSolver<Scalar>::solve_with(int candidate, Scalar* b)
+    {
+      Candidate& c = candidates[candidate];
+      if(c.solver == NULL)
+        create_candidate(candidate);
+
+      unsigned int n = m->get_size();
+      if(c.matrix != NULL)
+      {
+        int* Ap = m->get_Ap();
+        int* Ai = m->get_Ai();
+        Scalar* Ax = m->get_Ax();
+        c.matrix->zero();
+        for (unsigned int col = 0; col < n; col++)
+          for (int k = Ap[col]; k < Ap[col + 1]; k++)
+            c.matrix->add(Ai[k], col, Ax[k]);
+        c.matrix->finish();
+        c.rhs->zero();
+        c.rhs->add_vector(b);
+        c.rhs->finish();
+      }
+
+      // The factorization of a candidate that solved another system is not reused.
+      unsigned int scheme = this->reuse_scheme;
+      if(candidate != last_candidate && scheme == HERMES_REUSE_FACTORIZATION_COMPLETELY)
+        scheme = HERMES_FACTORIZE_FROM_SCRATCH;
+      c.solver->set_factorization_scheme((FactorizationScheme)scheme);
+
+      if(!c.solver->solve())
+        return false;
+
+      delete [] this->sln;
+      this->sln = new Scalar[n];
+      memcpy(this->sln, c.solver->get_sln_vector(), n * sizeof(Scalar));
+      return true;
+    }
+
+    template<typename Scalar>
+    double AutoLinearMatrixSolver<Scalar>::relative_residual(Scalar* b, Scalar* x)
+    {
+      int n = m->get_size();
+      Scalar* Ax = new Scalar[n];
+      m->multiply_with_vector(x, Ax);
+      double residual_norm = 0.0, rhs_norm = 0.0;
+      for (int i = 0; i < n; i++)
+      {
+        residual_norm += std::abs(b[i] - Ax[i]) * std::abs(b[i] - Ax[i]);
+        rhs_norm += std::abs(b[i]) * std::abs(b[i]);
+      }
+      delete [] Ax;
+      if(rhs_norm == 0.0)
+        return std::sqrt(residual_norm);
+      return std::sqrt(residual_norm / rhs_norm);
+    }
+
+    template<typename Scalar>
+    int AutoLinearMatrixSolver<Scalar>::next_candidate(unsigned long long hash, bool& tuning)
+    {
+      int num_trials = std::max(Hermes::HermesCommonApi.get_integral_param_value(Hermes::autotuningTrials), 1);
+      int candidate = -1;
+#pragma omp critical (AutoLinearMatrixSolver_tunings)
+      {
+        typename std::map<unsigned long long, Tuning>::iterator it = tunings.find(hash);
+        if(it == tunings.end())
+        {
+          Tuning tuning_new;
+          tuning_new.selected = -1;
+          tuning_new.times.resize(get_candidate_names().size(), 0.0);
+          tuning_new.trials.resize(get_candidate_names().size(), 0);
+          tuning_new.failed.resize(get_candidate_names().size(), false);
+          it = tunings.insert(std::pair<unsigned long long, Tuning>(hash, tuning_new)).first;
+        }
+        Tuning& t = it->second;
+
+        tuning = (t.selected < 0);
+        if(!tuning)
+          candidate = t.selected;
+        else
+        {
+          // The candidate with the fewest trials, i.e. the candidates in turns.
+          for (unsigned int i = 0; i < t.trials.size(); i++)
+            if(!t.failed[i] && t.trials[i] < num_trials && (candidate < 0 || t.trials[i] < t.trials[candidate]))
+              candidate = i;
+        }
+      }
+      return candidate;
+    }
+
+    template<typename Scalar>
+    bool AutoLinearMatrixSolver<Scalar>::record(unsigned long long hash, int candidate, bool success, double time)
+    {
+      int num_trials = std::max(Hermes::HermesCommonApi.get_integral_param_value(Hermes::autotuningTrials), 1);
+      bool selected_now = false;
+#pragma omp critical (AutoLinearMatrixSolver_tunings)
+      {
+        Tuning& t = tunings[hash];
+        if(!success)
+        {
+          t.failed[candidate] = true;
+          if(t.selected == candidate)
+            t.selected = -1;
+        }
+        else if(t.selected < 0)
+        {
+          t.times[candidate] += time;
+          t.trials[candidate]++;
+        }
+
+        // All the remaining candidates tuned, the fastest is selected.
+        if(t.selected < 0)
+        {
+          int fastest = -1;
+          bool tuned = true;
+          for (unsigned int i = 0; i < t.trials.size(); i++)
+          {
+            if(t.failed[i])
+              continue;
+            if(t.trials[i] < num_trials)
+              tuned = false;
+            else if(fastest < 0 || t.times[i] / t.trials[i] < t.times[fastest] / t.trials[fastest])
+              fastest = i;
+          }
+          if(tuned && fastest >= 0)
+          {
+            t.selected = fastest;
+            selected_now = (fastest == candidate);
+          }
+        }
+      }
+      return selected_now;
+    }
+
+    template<typename Scalar>
+    bool AutoLinearMatrixSolver<Scalar>::solve()
+    {
+      Hermes::ProfilerRegion profiler_region("AutoLinearMatrixSolver::solve");
+      assert(m != NULL);
+      assert(rhs != NULL);
+
+      this->tick();
+
+      int n = m->get_size();
+      unsigned long long hash = DirectSolver<Scalar>::get_structure_hash(n, m->get_nnz(), m->get_Ap(), m->get_Ai());
+      if(hash != this->structure_hash)
+      {
+        // The copies and the factorizations of the candidates are of another pattern.
+        free_candidates();
+        this->structure_hash = hash;
+        this->last_candidate = -1;
+      }
+
+      Scalar* b = new Scalar[n];
+      rhs->extract(b);
+
+      bool solved = false;
+      while(!solved)
+      {
+        bool tuning;
+        int candidate = next_candidate(hash, tuning);
+        if(candidate < 0)
+          break;
+        const char* name = get_candidate_names()[candidate].c_str();
+
+        Hermes::Mixins::TimeMeasurable timer;
+        bool success = false;
+        try
+        {
+          success = solve_with(candidate, b);
+          if(success && tuning)
+            success = relative_residual(b, this->sln) <= AUTO_SOLVER_MAX_RESIDUAL;
+        }
+        catch(std::exception& e)
+        {
+          this->warn("AutoLinearMatrixSolver: %s failed: %s", name, e.what());
+          success = false;
+        }
+        timer.tick();
+
+        if(!success)
+          this->warn("AutoLinearMatrixSolver: %s did not solve the system, it is not used for this pattern any more.", name);
+        if(record(hash, candidate, success, timer.last()))
+          this->info("AutoLinearMatrixSolver: %s selected for the systems of %d unknowns.", name, n);
+
+        if(success)
+        {
+          solved = true;
+          this->last_candidate = candidate;
+        }
+        else
+          this->last_candidate = -1;
+      }
+      delete [] b;
+
+      this->tick();
+      this->time = this->accumulated();
+
+      if(!solved)
+        throw Hermes::Exceptions::Exception("AutoLinearMatrixSolver: none of the solvers solved the system.");
+      return true;
+    }
+
+    template<typename Scalar>
+    bool AutoLinearMatrixSolver<Scalar>::save_choices(const char* filename)
+    {
+      FILE* file = fopen(filename, "w");
+      if(file == NULL)
+        return false;
+#pragma omp critical (AutoLinearMatrixSolver_tunings)
+      for (typename std::map<unsigned long long, Tuning>::const_iterator it = tunings.begin(); it != tunings.end(); it++)
+        if(it->second.selected >= 0)
+          fprintf(file, "%llx %s\n", it->first, get_candidate_names()[it->second.selected].c_str());
+      fclose(file);
+      return true;
+    }
+
+    template<typename Scalar>
+    bool AutoLinearMatrixSolver<Scalar>::load_choices(const char* filename)
+    {
+      FILE* file = fopen(filename, "r");
+      if(file == NULL)
+        return false;
+
+      const std::vector<std::string>& names = get_candidate_names();
+      unsigned long long hash;
+      char name[256];
+      while(fscanf(file, "%llx %255s", &hash, name) == 2)
+      {
+        for (unsigned int i = 0; i < names.size(); i++)
+        {
+          if(names[i] != name)
+            continue;
+          Tuning t;
+          t.selected = i;
+          t.times.resize(names.size(), 0.0);
+          t.trials.resize(names.size(), 0);
+          t.failed.resize(names.size(), false);
+#pragma omp critical (AutoLinearMatrixSolver_tunings)
+          tunings[hash] = t;
+          break;
+        }
+      }
+      fclose(file);
+      return true;
+    }
+
+    template<typename Scalar>
+    void AutoLinearMatrixSolver<Scalar>::reset_choices()
+    {
+#pragma omp critical (AutoLinearMatrixSolver_tunings)
+      tunings.clear();
+    }
+
+    template class HERMES_API AutoLinearMatrixSolver<double>;
+    template class HERMES_API AutoLinearMatrixSolver<std::complex<double> >;
+  }
+}
+#endif
@@ -34,6 +34,9 @@ namespace Hermes
       : IterSolver<Scalar>(), m(m), rhs(rhs)
     {
       pc = NULL;
+      precond_reuse_scheme = HERMES_FACTORIZE_FROM_SCRATCH;
+      precond_epetra_mat = NULL;
+      precond_structure_hash = 0;
     }
 
     template<typename Scalar>
@@ -80,6 +83,38 @@ namespace Hermes
     {
       this->precond_yes = true;
       this->pc = pc;
+      this->precond_epetra_mat = NULL;
+    }
+
+    template<typename Scalar>
+    void AztecOOSolver<Scalar>::set_factorization_scheme(FactorizationScheme reuse_scheme)
+    {
+      this->precond_reuse_scheme = reuse_scheme;
+    }
+
+    template<typename Scalar>
+    void AztecOOSolver<Scalar>::setup_precond(EpetraMatrix<Scalar>* pm)
+    {
+      bool same_matrix = (precond_epetra_mat != NULL && precond_epetra_mat == pm->mat);
+      if(same_matrix && precond_reuse_scheme == HERMES_REUSE_FACTORIZATION_COMPLETELY)
+        return;
+
+      // The pattern of the (storage optimized) matrix, without it the preconditioner is always built from scratch.
+      int* offsets;
+      int* indices;
+      double* values;
+      bool have_pattern = (pm->mat->ExtractCrsDataPointers(offsets, indices, values) == 0);
+      unsigned long long hash = have_pattern ? DirectSolver<Scalar>::get_structure_hash(pm->size, pm->mat->NumMyNonzeros(), offsets, indices) : 0;
+
+      if(same_matrix && have_pattern && hash == precond_structure_hash)
+        pc->recompute();
+      else
+      {
+        pc->create(pm);
+        pc->compute();
+      }
+      precond_epetra_mat = pm->mat;
+      precond_structure_hash = hash;
     }
 
     template<typename Scalar>
@@ -142,6 +177,8 @@ namespace Hermes
 
       if(pc != NULL)
       {
+        // A separate preconditioning matrix replaces the system matrix.
+        setup_precond(this->precond_matrix != NULL ? static_cast<EpetraMatrix<double>*>(this->precond_matrix) : m);
         Epetra_Operator *op = pc->get_obj();
         assert(op != NULL);    // can work only with Epetra_Operators
         aztec.SetPrecOperator(op);
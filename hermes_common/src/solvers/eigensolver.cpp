@@ -0,0 +1,451 @@
+// This file is part of HermesCommon
+//
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Email: hpfem-group@unr.edu, home page: http://hpfem.org/.
+//
+// Hermes2D is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation; either version 2 of the License,
+// or (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/*! \file eigensolver.cpp
+    \brief Built-in solver of symmetric (generalized) eigenproblems.
+*/
+#include "eigensolver.h"
+#include "api.h"
+#include <algorithm>
+
+namespace Hermes
+{
+  /// Below this size, the vector kernels run sequentially.
+  static const int PARALLEL_VECTOR_MIN_SIZE = 20000;
+
+  /// Maximum number of the Jacobi sweeps of the projected matrix.
+  static const int EIGENSOLVER_MAX_JACOBI_SWEEPS = 100;
+
+  static double eigensolver_dot(int n, double* a, double* b)
+  {
+    double result = 0.0;
+    int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) reduction(+:result) if(n > PARALLEL_VECTOR_MIN_SIZE)
+    for(int i = 0; i < n; i++)
+      result += a[i] * b[i];
+    return result;
+  }
+
+  /// Deterministic pseudo-random values in [-1, 1), so that the runs are reproducible.
+  static void eigensolver_random_vector(int n, double* v, unsigned int& seed)
+  {
+    for(int i = 0; i < n; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      v[i] = ((seed >> 16) & 0x7fff) / 16384.0 - 1.0;
+    }
+  }
+
+  /// Cyclic Jacobi method for the symmetric m x m matrix S (row-major, destroyed).
+  /// theta receives the eigenvalues, the column i of Y (row-major) the eigenvector of theta[i].
+  static void eigensolver_jacobi(int m, double* S, double* theta, double* Y)
+  {
+    for(int i = 0; i < m; i++)
+      for(int j = 0; j < m; j++)
+        Y[i * m + j] = (i == j) ? 1.0 : 0.0;
+
+    for(int sweep = 0; sweep < EIGENSOLVER_MAX_JACOBI_SWEEPS; sweep++)
+    {
+      double off = 0.0, norm = 0.0;
+      for(int p = 0; p < m; p++)
+        for(int q = 0; q < m; q++)
+        {
+          norm += S[p * m + q] * S[p * m + q];
+          if(p != q)
+            off += S[p * m + q] * S[p * m + q];
+        }
+      if(off <= 1e-30 * norm)
+        break;
+
+      for(int p = 0; p < m - 1; p++)
+        for(int q = p + 1; q < m; q++)
+        {
+          double apq = S[p * m + q];
+          if(apq == 0.0)
+            continue;
+          double tau = (S[q * m + q] - S[p * m + p]) / (2.0 * apq);
+          double t = (std::abs(tau) > 1e150) ? 0.5 / tau : ((tau >= 0.0) ? 1.0 : -1.0) / (std::abs(tau) + std::sqrt(1.0 + tau * tau));
+          double c = 1.0 / std::sqrt(1.0 + t * t);
+          double s = t * c;
+
+          for(int k = 0; k < m; k++)
+          {
+            double skp = S[k * m + p], skq = S[k * m + q];
+            S[k * m + p] = c * skp - s * skq;
+            S[k * m + q] = s * skp + c * skq;
+          }
+          for(int k = 0; k < m; k++)
+          {
+            double spk = S[p * m + k], sqk = S[q * m + k];
+            S[p * m + k] = c * spk - s * sqk;
+            S[q * m + k] = s * spk + c * sqk;
+          }
+          for(int k = 0; k < m; k++)
+          {
+            double ykp = Y[k * m + p], ykq = Y[k * m + q];
+            Y[k * m + p] = c * ykp - s * ykq;
+            Y[k * m + q] = s * ykp + c * ykq;
+          }
+        }
+    }
+
+    for(int i = 0; i < m; i++)
+      theta[i] = S[i * m + i];
+  }
+
+  /// Orders the Ritz values by their magnitude, the largest (the eigenvalues closest to the shift) first.
+  class EigensolverThetaGreater
+  {
+  public:
+    EigensolverThetaGreater(double* theta) : theta(theta) {}
+    bool operator()(int i, int j) const { return std::abs(theta[i]) > std::abs(theta[j]); }
+  private:
+    double* theta;
+  };
+
+  /// V[i] = sum_l V[l] Y(l, order[i]), i < count, done row by row in place (the rows are independent).
+  static void eigensolver_combine(int n, int m, double** V, double* Y, int* order, int count, double** target)
+  {
+    int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel num_threads(num_threads_used) if(n > PARALLEL_VECTOR_MIN_SIZE)
+    {
+      double* row = new double[count];
+#pragma omp for schedule(static)
+      for(int r = 0; r < n; r++)
+      {
+        for(int i = 0; i < count; i++)
+        {
+          double sum = 0.0;
+          for(int l = 0; l < m; l++)
+            sum += V[l][r] * Y[l * m + order[i]];
+          row[i] = sum;
+        }
+        for(int i = 0; i < count; i++)
+          target[i][r] = row[i];
+      }
+      delete [] row;
+    }
+  }
+
+  namespace Solvers
+  {
+    template<typename Scalar>
+    EigenSolver<Scalar>::EigenSolver(SparseMatrix<Scalar>* A, SparseMatrix<Scalar>* B) : A(A), B(B), subspace_size(0),
+      n_eigs(0), eigenvalues(NULL), eigenvectors(NULL), num_restarts(0), num_solves(0), V(NULL), BV(NULL)
+    {
+      if(A == NULL)
+        throw Exceptions::NullException(1);
+      this->size = A->get_size();
+      if(B != NULL && B->get_size() != this->size)
+        throw Exceptions::LengthException(2, B->get_size(), this->size);
+    }
+
+    template<typename Scalar>
+    EigenSolver<Scalar>::~EigenSolver()
+    {
+      free_eigenpairs();
+    }
+
+    template<typename Scalar>
+    void EigenSolver<Scalar>::free_eigenpairs()
+    {
+      if(eigenvectors != NULL)
+      {
+        for(int i = 0; i < n_eigs; i++)
+          delete [] eigenvectors[i];
+        delete [] eigenvectors;
+        eigenvectors = NULL;
+      }
+      delete [] eigenvalues;
+      eigenvalues = NULL;
+      n_eigs = 0;
+    }
+
+    template<typename Scalar>
+    void EigenSolver<Scalar>::set_subspace_size(int subspace_size)
+    {
+      if(subspace_size < 0)
+        throw Exceptions::ValueException("subspace_size", subspace_size, 0);
+      this->subspace_size = subspace_size;
+    }
+
+    template<typename Scalar>
+    void EigenSolver<Scalar>::apply_B(Scalar* in, Scalar* out)
+    {
+      if(B == NULL)
+        memcpy(out, in, this->size * sizeof(Scalar));
+      else
+        B->multiply_with_vector(in, out);
+    }
+
+    template<typename Scalar>
+    double EigenSolver<Scalar>::orthogonalize(Scalar* w, Scalar* Bw, int k, Scalar* h)
+    {
+      int n = this->size;
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+      Scalar* c = new Scalar[k];
+
+      // Classical Gram-Schmidt done twice, the coefficients of each pass are the B inner products (B V[i], w).
+      for(int pass = 0; pass < 2; pass++)
+      {
+        for(int i = 0; i < k; i++)
+        {
+          c[i] = eigensolver_dot(n, BV[i], w);
+          h[i] += c[i];
+        }
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PARALLEL_VECTOR_MIN_SIZE)
+        for(int r = 0; r < n; r++)
+        {
+          Scalar sum = 0.0;
+          for(int i = 0; i < k; i++)
+            sum += c[i] * V[i][r];
+          w[r] -= sum;
+        }
+      }
+      delete [] c;
+
+      apply_B(w, Bw);
+      double norm_sqr = eigensolver_dot(n, w, Bw);
+      return norm_sqr > 0.0 ? std::sqrt(norm_sqr) : 0.0;
+    }
+
+    template<typename Scalar>
+    void EigenSolver<Scalar>::solve(int n_eigs, double target_value, double tol, int max_iter)
+    {
+      int n = this->size;
+      if(n_eigs < 1 || n_eigs > n)
+        throw Exceptions::ValueException("n_eigs", n_eigs, 1, n);
+      if(tol <= 0.0)
+        throw Exceptions::ValueException("tol", tol, 0.0);
+
+      int m = (this->subspace_size > 0) ? this->subspace_size : std::max(2 * n_eigs + 1, 20);
+      if(m > n)
+        m = n;
+      if(m <= n_eigs && m < n)
+        throw Exceptions::ValueException("subspace_size", m, n_eigs + 1);
+
+      free_eigenpairs();
+      this->num_restarts = 0;
+      this->num_solves = 0;
+
+      // The shifted matrix A - target_value B and its solver, factorized by the first solve only.
+      SparseMatrix<Scalar>* shifted = A->duplicate();
+      if(shifted == NULL)
+        throw Exceptions::Exception("EigenSolver: the matrix does not support duplicate().");
+      if(target_value != 0.0)
+      {
+        if(B == NULL)
+          shifted->add_to_diagonal(-target_value);
+        else
+        {
+          SparseMatrix<Scalar>* shifted_B = B->duplicate();
+          if(shifted_B == NULL)
+            throw Exceptions::Exception("EigenSolver: the matrix does not support duplicate().");
+          shifted_B->multiply_with_Scalar(-target_value);
+          shifted->add_sparse_matrix(shifted_B);
+          delete shifted_B;
+        }
+      }
+      Vector<Scalar>* rhs = create_vector<Scalar>();
+      rhs->alloc(n);
+      LinearMatrixSolver<Scalar>* solver = create_linear_solver<Scalar>(shifted, rhs);
+
+      V = new Scalar*[m + 1];
+      BV = new Scalar*[m + 1];
+      for(int i = 0; i <= m; i++)
+      {
+        V[i] = new Scalar[n];
+        BV[i] = new Scalar[n];
+      }
+      // H(i, j) = H[i * m + j], (m + 1) x m, the projection of the operator onto the basis.
+      Scalar* H = new Scalar[(m + 1) * m];
+      memset(H, 0, (m + 1) * m * sizeof(Scalar));
+      Scalar* h = new Scalar[m];
+      double* S = new double[m * m];
+      double* theta = new double[m];
+      double* Y = new double[m * m];
+      int* order = new int[m];
+
+      unsigned int seed = 1;
+      eigensolver_random_vector(n, V[0], seed);
+      double beta = orthogonalize(V[0], BV[0], 0, h);
+      for(int r = 0; r < n; r++)
+      {
+        V[0][r] /= beta;
+        BV[0][r] /= beta;
+      }
+
+      int k = 0;
+      int n_converged = 0;
+      while(true)
+      {
+        // Extends the basis from k to m vectors.
+        for(int j = k; j < m; j++)
+        {
+          rhs->zero();
+          rhs->add_vector(BV[j]);
+          if(!solver->solve())
+            throw Exceptions::LinearMatrixSolverException("EigenSolver: the shifted matrix could not be solved with.");
+          if(this->num_solves++ == 0)
+            solver->set_factorization_scheme(HERMES_REUSE_FACTORIZATION_COMPLETELY);
+          memcpy(V[j + 1], solver->get_sln_vector(), n * sizeof(Scalar));
+
+          double norm_before = std::sqrt(eigensolver_dot(n, V[j + 1], V[j + 1]));
+          memset(h, 0, (j + 1) * sizeof(Scalar));
+          beta = orthogonalize(V[j + 1], BV[j + 1], j + 1, h);
+          for(int i = 0; i <= j; i++)
+            H[i * m + j] += h[i];
+
+          if(std::sqrt(eigensolver_dot(n, V[j + 1], V[j + 1])) <= 1e-12 * norm_before)
+          {
+            // Invariant subspace found, the basis continues with a new vector orthogonal to it.
+            H[(j + 1) * m + j] = 0.0;
+            if(j + 1 < m)
+            {
+              eigensolver_random_vector(n, V[j + 1], seed);
+              beta = orthogonalize(V[j + 1], BV[j + 1], j + 1, h);
+            }
+            else
+            {
+              memset(V[j + 1], 0, n * sizeof(Scalar));
+              memset(BV[j + 1], 0, n * sizeof(Scalar));
+              beta = 1.0;
+            }
+          }
+          else
+            H[(j + 1) * m + j] = beta;
+
+          for(int r = 0; r < n; r++)
+          {
+            V[j + 1][r] /= beta;
+            BV[j + 1][r] /= beta;
+          }
+        }
+
+        // Ritz pairs of the projected matrix, symmetric up to the rounding errors.
+        for(int i = 0; i < m; i++)
+          for(int j = 0; j < m; j++)
+            S[i * m + j] = 0.5 * (H[i * m + j] + H[j * m + i]);
+        eigensolver_jacobi(m, S, theta, Y);
+        for(int i = 0; i < m; i++)
+          order[i] = i;
+        std::sort(order, order + m, EigensolverThetaGreater(theta));
+
+        double beta_m = H[m * m + m - 1];
+        n_converged = 0;
+        while(n_converged < n_eigs && std::abs(beta_m * Y[(m - 1) * m + order[n_converged]]) <= tol * std::abs(theta[order[n_converged]]))
+          n_converged++;
+
+        if(n_converged == n_eigs || this->num_restarts >= max_iter)
+          break;
+
+        // Krylov-Schur restart: keeps the p leading Ritz vectors, the last basis vector continues the basis.
+        int p = std::min(n_eigs + (m - n_eigs) / 2, m - 1);
+        eigensolver_combine(n, m, V, Y, order, p, V);
+        eigensolver_combine(n, m, BV, Y, order, p, BV);
+        std::swap(V[p], V[m]);
+        std::swap(BV[p], BV[m]);
+
+        memset(H, 0, (m + 1) * m * sizeof(Scalar));
+        for(int i = 0; i < p; i++)
+        {
+          H[i * m + i] = theta[order[i]];
+          H[p * m + i] = beta_m * Y[(m - 1) * m + order[i]];
+        }
+        k = p;
+        this->num_restarts++;
+      }
+
+      this->warn_if(n_converged < n_eigs, "EigenSolver: only %i of %i eigenpairs converged in %i restarts.", n_converged, n_eigs, this->num_restarts);
+
+      this->n_eigs = n_converged;
+      this->eigenvalues = new double[n_converged];
+      this->eigenvectors = new double*[n_converged];
+      for(int i = 0; i < n_converged; i++)
+      {
+        this->eigenvalues[i] = target_value + 1.0 / theta[order[i]];
+        this->eigenvectors[i] = new double[n];
+      }
+      eigensolver_combine(n, m, V, Y, order, n_converged, this->eigenvectors);
+
+      delete [] order;
+      delete [] Y;
+      delete [] theta;
+      delete [] S;
+      delete [] h;
+      delete [] H;
+      for(int i = 0; i <= m; i++)
+      {
+        delete [] V[i];
+        delete [] BV[i];
+      }
+      delete [] V;
+      delete [] BV;
+      V = BV = NULL;
+
+      delete solver;
+      delete rhs;
+      delete shifted;
+    }
+
+    template<typename Scalar>
+    int EigenSolver<Scalar>::get_n_eigs() const
+    {
+      return this->n_eigs;
+    }
+
+    template<typename Scalar>
+    double EigenSolver<Scalar>::get_eigenvalue(int i) const
+    {
+      if(i < 0 || i >= this->n_eigs)
+        throw Exceptions::ValueException("i", i, 0, this->n_eigs - 1);
+      return this->eigenvalues[i];
+    }
+
+    template<typename Scalar>
+    void EigenSolver<Scalar>::get_eigenvector(int i, double **vec, int *n) const
+    {
+      if(i < 0 || i >= this->n_eigs)
+        throw Exceptions::ValueException("i", i, 0, this->n_eigs - 1);
+      *vec = this->eigenvectors[i];
+      *n = this->size;
+    }
+
+    template<typename Scalar>
+    int EigenSolver<Scalar>::get_num_restarts() const
+    {
+      return this->num_restarts;
+    }
+
+    template<typename Scalar>
+    int EigenSolver<Scalar>::get_num_solves() const
+    {
+      return this->num_solves;
+    }
+
+    template<typename Scalar>
+    void EigenSolver<Scalar>::print_eigenvalues() const
+    {
+      this->info("Eigenvalues:");
+      for (int i = 0; i < this->n_eigs; i++)
+        this->info("%3d: %f", i, this->eigenvalues[i]);
+    }
+
+    template class HERMES_API EigenSolver<double>;
+  }
+}
@@ -27,6 +27,8 @@
 #include "mumps_solver.h"
 #include "newton_solver_nox.h"
 #include "aztecoo_solver.h"
+#include "native_iter_solver.h"
+#include "auto_solver.h"
 #include "api.h"
 
 using namespace Hermes::Algebra;
@@ -49,6 +51,20 @@ namespace Hermes
         delete [] sln;
     }
 
+    template<typename Scalar>
+    bool LinearMatrixSolver<Scalar>::solve(int num_rhs, Scalar* rhs_block)
+    {
+      throw Hermes::Exceptions::Exception("Solving with multiple right hand sides is not supported by this solver.");
+      return false;
+    }
+
+    template<typename Scalar>
+    void LinearMatrixSolver<Scalar>::set_precond_matrix(Matrix<Scalar>* precond_matrix)
+    {
+      if(precond_matrix != NULL)
+        throw Hermes::Exceptions::Exception("A separate preconditioning matrix is not supported by this solver.");
+    }
+
     template<typename Scalar>
     Scalar *LinearMatrixSolver<Scalar>::get_sln_vector()
     {
@@ -136,6 +152,25 @@ namespace Hermes
           else return new SuperLUSolver<Scalar>(static_cast<SuperLUMatrix<Scalar>*>(matrix), static_cast<SuperLUVector<Scalar>*>(rhs_dummy));
 #else
           throw Hermes::Exceptions::Exception("SuperLU was not installed.");
+#endif
+          break;
+        }
+      case Hermes::SOLVER_NATIVE_ITERATIVE:
+        {
+#ifdef WITH_UMFPACK
+          return new NativeIterSolver<Scalar>(static_cast<CSCMatrix<Scalar>*>(matrix), rhs);
+#else
+          throw Hermes::Exceptions::Exception("The built-in iterative solvers need the CSC matrix, which is available with UMFPACK.");
+#endif
+          break;
+        }
+      case Hermes::SOLVER_AUTO:
+        {
+#ifdef WITH_UMFPACK
+          if(rhs != NULL) return new AutoLinearMatrixSolver<Scalar>(static_cast<CSCMatrix<Scalar>*>(matrix), rhs);
+          else return new AutoLinearMatrixSolver<Scalar>(static_cast<CSCMatrix<Scalar>*>(matrix), rhs_dummy);
+#else
+          throw Hermes::Exceptions::Exception("The automatic selection of the solver needs the CSC matrix, which is available with UMFPACK.");
 #endif
           break;
         }
@@ -151,6 +186,104 @@ namespace Hermes
       factorization_scheme = reuse_scheme;
     }
 
+    template<typename Scalar>
+    void DirectSolver<Scalar>::set_mixed_precision(bool to_set, int max_steps, double tolerance)
+    {
+      if(max_steps < 0)
+        throw Hermes::Exceptions::ValueException("max_steps", max_steps, 0);
+      if(tolerance < 0.)
+        throw Hermes::Exceptions::ValueException("tolerance", tolerance, 0.);
+      this->mixed_precision = to_set;
+      this->max_refinement_steps = max_steps;
+      this->refinement_tolerance = tolerance;
+    }
+
+    template<typename Scalar>
+    int DirectSolver<Scalar>::get_num_refinement_steps() const
+    {
+      return this->num_refinement_steps;
+    }
+
+    template<typename Scalar>
+    bool DirectSolver<Scalar>::solve_low_precision(Scalar* b, Scalar* x)
+    {
+      throw Hermes::Exceptions::Exception("This solver has no single precision factorization.");
+      return false;
+    }
+
+    template<typename Scalar>
+    bool DirectSolver<Scalar>::refine(SparseMatrix<Scalar>* A, Scalar* b, Scalar* x)
+    {
+      int n = A->get_size();
+      double b_norm = 0.;
+      for (int i = 0; i < n; i++)
+        b_norm += std::abs(b[i]) * std::abs(b[i]);
+      b_norm = std::sqrt(b_norm);
+
+      Scalar* r = new Scalar[n];
+      Scalar* d = new Scalar[n];
+      bool converged = false;
+      int steps = 0;
+      while(true)
+      {
+        // r = b - A x in double precision.
+        A->multiply_with_vector(x, r);
+        double r_norm = 0.;
+        for (int i = 0; i < n; i++)
+        {
+          r[i] = b[i] - r[i];
+          r_norm += std::abs(r[i]) * std::abs(r[i]);
+        }
+        if(std::sqrt(r_norm) <= this->refinement_tolerance * b_norm)
+        {
+          converged = true;
+          break;
+        }
+        if(steps == this->max_refinement_steps || !solve_low_precision(r, d))
+          break;
+        for (int i = 0; i < n; i++)
+          x[i] += d[i];
+        steps++;
+      }
+      this->num_refinement_steps = std::max(this->num_refinement_steps, steps);
+
+      delete [] r;
+      delete [] d;
+      return converged;
+    }
+
+    template<typename Scalar>
+    unsigned long long DirectSolver<Scalar>::get_structure_hash(unsigned int size, unsigned int nnz, const int* Ap, const int* Ai)
+    {
+      // FNV-1a over the size and the index arrays.
+      const unsigned long long prime = 1099511628211ULL;
+      unsigned long long hash = 14695981039346656037ULL;
+      hash = (hash ^ size) * prime;
+      hash = (hash ^ nnz) * prime;
+      for (unsigned int i = 0; i <= size; i++)
+        hash = (hash ^ (unsigned int)Ap[i]) * prime;
+      for (unsigned int i = 0; i < nnz; i++)
+        hash = (hash ^ (unsigned int)Ai[i]) * prime;
+      return hash;
+    }
+
+    template<typename Scalar>
+    int DirectSolver<Scalar>::check_structure(int eff_fact_scheme, bool have_analysis, unsigned int size, unsigned int nnz, const int* Ap, const int* Ai)
+    {
+      if(eff_fact_scheme == HERMES_REUSE_FACTORIZATION_COMPLETELY)
+        return eff_fact_scheme;
+
+      unsigned long long hash = get_structure_hash(size, nnz, Ap, Ai);
+      bool same_structure = have_analysis && hash == this->structure_hash;
+      this->structure_hash = hash;
+
+      if(!same_structure)
+        return HERMES_FACTORIZE_FROM_SCRATCH;
+      if(eff_fact_scheme == HERMES_FACTORIZE_FROM_SCRATCH)
+        return HERMES_REUSE_MATRIX_REORDERING;
+      return eff_fact_scheme;
+    }
+
     template<typename Scalar>
     void IterSolver<Scalar>::set_tolerance(double tol)
     {
@@ -163,6 +296,12 @@ namespace Hermes
       this->max_iters = iters;
     }
 
+    template<typename Scalar>
+    void IterSolver<Scalar>::set_precond_matrix(Matrix<Scalar>* precond_matrix)
+    {
+      this->precond_matrix = precond_matrix;
+    }
+
     template HERMES_API LinearMatrixSolver<double>*  create_linear_solver(Matrix<double>* matrix, Vector<double>* rhs);
 
     template HERMES_API LinearMatrixSolver<std::complex<double> >*  create_linear_solver(Matrix<std::complex<double> >* matrix, Vector<std::complex<double> >* rhs);
@@ -22,7 +22,9 @@
 #include "config.h"
 #ifdef WITH_MUMPS
 #include "mumps_solver.h"
+#include "profiler.h"
 #include "callstack.h"
+#include "api.h"
 
 namespace Hermes
 {
@@ -76,7 +78,6 @@ namespace Hermes
       jcn = NULL;
       Ax = NULL;
       Ap = NULL;
-      Ai = NULL;
     }
 
     template<typename Scalar>
@@ -90,17 +91,17 @@ namespace Hermes
     {
       assert(this->pages != NULL);
 
-      // initialize the arrays Ap and Ai
+      // initialize the arrays Ap and irn
       Ap = new unsigned int[this->size + 1];
       int aisize = this->get_num_indices();
-      Ai = new int[aisize];
+      irn = new int[aisize];
 
-      // sort the indices and remove duplicities, insert into Ai
+      // sort the indices and remove duplicities, insert into irn
       unsigned int i, pos = 0;
       for (i = 0; i < this->size; i++)
       {
         Ap[i] = pos;
-        pos += sort_and_store_indices(this->pages[i], Ai + pos, Ai + aisize);
+        pos += sort_and_store_indices(this->pages[i], irn + pos, irn + aisize);
       }
       Ap[i] = pos;
 
@@ -110,15 +111,16 @@ namespace Hermes
       nnz = Ap[this->size];
 
       Ax = new typename mumps_type<Scalar>::mumps_Scalar[nnz];
-      memset(Ax, 0, sizeof(Scalar) * nnz);
+      Hermes::Algebra::first_touch_zero(Ax, sizeof(Scalar) * nnz);
 
-      irn = new int[nnz];
+      // The coordinates of the entries are given by the structure, MUMPS is indexing from 1.
       jcn = new int[nnz];
-      for (unsigned int i = 0; i < nnz; i++)
-      {
-        irn[i] = 1;
-        jcn[i] = 1;
-      }
+      for (i = 0; i < this->size; i++)
+        for (unsigned int k = Ap[i]; k < Ap[i + 1]; k++)
+        {
+          irn[k]++;
+          jcn[k] = i + 1;
+        }
     }
 
     template<typename Scalar>
@@ -126,12 +128,34 @@ namespace Hermes
     {
       nnz = 0;
       delete [] Ap; Ap = NULL;
-      delete [] Ai; Ai = NULL;
       delete [] Ax; Ax = NULL;
       delete [] irn; irn = NULL;
       delete [] jcn; jcn = NULL;
     }
 
+#ifdef HAVE_MUMPS_SINGLE
+    inline double mumps_to_Scalar(float x)
+    {
+      return x;
+    }
+
+    inline std::complex<double> mumps_to_Scalar(CMUMPS_COMPLEX x)
+    {
+      return std::complex<double>(x.r, x.i);
+    }
+
+    inline void to_mumps_single(float& a, double b)
+    {
+      a = (float)b;
+    }
+
+    inline void to_mumps_single(CMUMPS_COMPLEX& a, std::complex<double> b)
+    {
+      a.r = (float)b.real();
+      a.i = (float)b.imag();
+    }
+#endif
+
     inline double mumps_to_Scalar(double x)
     {
       return x;
@@ -145,8 +169,11 @@ namespace Hermes
     template<typename Scalar>
     Scalar MumpsMatrix<Scalar>::get(unsigned int m, unsigned int n)
     {
+      if(this->symmetric_storage && m > n)
+        std::swap(m, n);
+
       // Find m-th row in the n-th column.
-      int mid = find_position(Ai + Ap[n], Ap[n + 1] - Ap[n], m);
+      int mid = find_position(irn + Ap[n], Ap[n + 1] - Ap[n], m + 1);
       // Return 0 if the entry has not been found.
       if(mid < 0) return 0.0;
       // Otherwise, add offset to the n-th column and return the value.
@@ -157,7 +184,7 @@ namespace Hermes
     template<typename Scalar>
     void MumpsMatrix<Scalar>::zero()
     {
-      memset(Ax, 0, sizeof(Scalar) * Ap[this->size]);
+      Hermes::Algebra::first_touch_zero(Ax, sizeof(Scalar) * Ap[this->size]);
     }
 
     inline ZMUMPS_COMPLEX& operator +=(ZMUMPS_COMPLEX &a, std::complex<double> b)
@@ -172,8 +199,11 @@ namespace Hermes
     {
       //          produced an error in neutronics-2-group-adapt (although tutorial-07
       //          ran well).
+      // The lower triangle of the symmetric storage is ignored.
+      if(this->symmetric_storage && m > n)
+        return;
       // Find m-th row in the n-th column.
-      int pos = find_position(Ai + Ap[n], Ap[n + 1] - Ap[n], m);
+      int pos = find_position(irn + Ap[n], Ap[n + 1] - Ap[n], m + 1);
       // Make sure we are adding to an existing non-zero entry.
       if(pos < 0)
         throw Hermes::Exceptions::Exception("Sparse matrix entry not found");
@@ -181,8 +211,6 @@ namespace Hermes
       pos += Ap[n];
 #pragma omp critical (MumpsMatrix_add)
       Ax[pos] += v;
-      irn[pos] = m + 1;  // MUMPS is indexing from 1
-      jcn[pos] = n + 1;
     }
 
     template<typename Scalar>
@@ -229,7 +257,7 @@ namespace Hermes
         for (unsigned int j = 0; j < this->size; j++)
           for (unsigned int i = Ap[j]; i < Ap[j + 1]; i++)
           {
-            fprintf(file, "%d %d ", Ai[i] + 1, j + 1);
+            fprintf(file, "%d %d ", irn[i], j + 1);
             Hermes::Helpers::fprint_num(file, mumps_to_Scalar(Ax[i]));
             fprintf(file, "\n");
           }
@@ -245,7 +273,11 @@ namespace Hermes
           this->hermes_fwrite(&this->size, sizeof(int), 1, file);
           this->hermes_fwrite(&nnz, sizeof(int), 1, file);
           this->hermes_fwrite(Ap, sizeof(int), this->size + 1, file);
+          int* Ai = new int[nnz];
+          for (unsigned int i = 0; i < nnz; i++)
+            Ai[i] = irn[i] - 1;
           this->hermes_fwrite(Ai, sizeof(int), nnz, file);
+          delete [] Ai;
           this->hermes_fwrite(Ax, sizeof(Scalar), nnz, file);
           return true;
         }
@@ -313,7 +345,7 @@ namespace Hermes
       {
         for (unsigned int n = mat->Ap[col];n<mat->Ap[col + 1];n++)
         {
-          idx = find_position(Ai + Ap[col + j], Ap[col + 1 + j] - Ap[col + j], mat->Ai[n] + i);
+          idx = find_position(irn + Ap[col + j], Ap[col + 1 + j] - Ap[col + j], mat->irn[n] + i);
           if(idx<0)
             throw Hermes::Exceptions::Exception("Sparse matrix entry not found");
           idx +=Ap[col + j];
@@ -334,7 +366,10 @@ namespace Hermes
       for (unsigned int i = 0;i<nnz;i++)
       {
         a = mumps_to_Scalar(Ax[i]);
-        vector_out[jcn[i]-1] +=vector_in[irn[i]-1]*a;
+        vector_out[irn[i]-1] +=vector_in[jcn[i]-1]*a;
+        // The lower triangle of the symmetric storage.
+        if(this->symmetric_storage && irn[i] != jcn[i])
+          vector_out[jcn[i]-1] +=vector_in[irn[i]-1]*a;
       }
     }
     // Multiplies matrix with a Scalar.
@@ -377,25 +412,25 @@ namespace Hermes
     template<typename Scalar>
     void MumpsMatrix<Scalar>::create(unsigned int size, unsigned int nnz, int* ap, int* ai, Scalar* ax)
     {
+      free();
       this->nnz = nnz;
       this->size = size;
       this->Ap = new unsigned int[this->size + 1]; assert(this->Ap != NULL);
-      this->Ai = new int[nnz];    assert(this->Ai != NULL);
       this->Ax = new typename mumps_type<Scalar>::mumps_Scalar[nnz]; assert(this->Ax != NULL);
       irn = new int[nnz];           assert(this->irn !=NULL);     // Row indices.
       jcn = new int[nnz];           assert(this->jcn !=NULL);     // Column indices.
 
+      // MUMPS is indexing from 1.
       for (unsigned int i = 0; i < this->size; i++)
       {
         this->Ap[i] = ap[i];
-        for (int j = ap[i];j<ap[i + 1];j++) jcn[j] = i;
+        for (int j = ap[i];j<ap[i + 1];j++) jcn[j] = i + 1;
       }
       this->Ap[this->size] = ap[this->size];
       for (unsigned int i = 0; i < nnz; i++)
       {
         mumps_assign_Scalar(this->Ax[i], ax[i]);
-        this->Ai[i] = ai[i];
-        irn[i] = ai[i];
+        irn[i] = ai[i] + 1;
       }
     }
     // Duplicates a matrix (including allocation).
@@ -403,17 +438,16 @@ namespace Hermes
     MumpsMatrix<Scalar>* MumpsMatrix<Scalar>::duplicate()
     {
       MumpsMatrix<Scalar> * nmat = new MumpsMatrix<Scalar>();
+      nmat->symmetric_storage = this->symmetric_storage;
 
       nmat->nnz = nnz;
       nmat->size = this->size;
       nmat->Ap = new unsigned int[this->size + 1]; assert(nmat->Ap != NULL);
-      nmat->Ai = new int[nnz];    assert(nmat->Ai != NULL);
       nmat->Ax = new typename mumps_type<Scalar>::mumps_Scalar[nnz]; assert(nmat->Ax != NULL);
       nmat->irn = new int[nnz];           assert(nmat->irn !=NULL);     // Row indices.
       nmat->jcn = new int[nnz];           assert(nmat->jcn !=NULL);     // Column indices.
       for (unsigned int i = 0;i<nnz;i++)
       {
-        nmat->Ai[i] = Ai[i];
         nmat->Ax[i] = Ax[i];
         nmat->irn[i] = irn[i];
         nmat->jcn[i] = jcn[i];
@@ -458,7 +492,7 @@ namespace Hermes
     template<typename Scalar>
     void MumpsVector<Scalar>::zero()
     {
-      memset(v, 0, this->size * sizeof(Scalar));
+      Hermes::Algebra::first_touch_zero(v, this->size * sizeof(Scalar));
     }
 
     template<typename Scalar>
@@ -564,6 +598,7 @@ namespace Hermes
   {
     /// Macros allowing to use indices according to the Fortran documentation to index C arrays.
 #define ICNTL(I)            icntl[(I)-1]
+#define CNTL(I)             cntl[(I)-1]
 #define MUMPS_INFO(param, I) (param).infog[(I)-1]
 #define INFOG(I)            infog[(I)-1]
 
@@ -572,7 +607,10 @@ namespace Hermes
 #define JOB_END                     -2
 #define JOB_ANALYZE_FACTORIZE_SOLVE  6
 #define JOB_FACTORIZE_SOLVE          5
+#define JOB_ANALYZE_FACTORIZE        4
+#define JOB_FACTORIZE                2
 #define JOB_SOLVE                    3
+#define JOB_ANALYZE                  1
 
     template<>
     void MumpsSolver<double>::mumps_c(mumps_type<double>::mumps_struct * param)
@@ -586,6 +624,20 @@ namespace Hermes
       zmumps_c(param);
     }
 
+#ifdef HAVE_MUMPS_SINGLE
+    template<>
+    void MumpsSolver<double>::mumps_single_c(mumps_type<double>::mumps_single_struct * param)
+    {
+      smumps_c(param);
+    }
+
+    template<>
+    void MumpsSolver<std::complex<double> >::mumps_single_c(mumps_type<std::complex<double> >::mumps_single_struct * param)
+    {
+      cmumps_c(param);
+    }
+#endif
+
     template<typename Scalar>
     bool MumpsSolver<Scalar>::check_status()
     {
@@ -599,6 +651,37 @@ namespace Hermes
       return false;
     }
 
+    template<typename Scalar>
+    template<typename MumpsStruct>
+    void MumpsSolver<Scalar>::set_controls(MumpsStruct& mumps_param)
+    {
+      // No printings.
+      mumps_param.ICNTL(1) = -1;
+      mumps_param.ICNTL(2) = -1;
+      mumps_param.ICNTL(3) = -1;
+      mumps_param.ICNTL(4) = 0;
+
+      mumps_param.ICNTL(20) = 0; // centralized dense RHS
+      mumps_param.ICNTL(21) = 0; // centralized dense solution
+      mumps_param.ICNTL(18) = distributed ? 3 : 0; // distributed / centralized assembled matrix
+
+      // The threads of MUMPS and of the multithreaded BLAS it calls (ignored by the MUMPS versions older than 5.1).
+      mumps_param.ICNTL(16) = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+
+      mumps_param.ICNTL(22) = out_of_core ? 1 : 0;
+      if(out_of_core && !ooc_tmpdir.empty())
+      {
+        strncpy(mumps_param.ooc_tmpdir, ooc_tmpdir.c_str(), sizeof(mumps_param.ooc_tmpdir) - 1);
+        mumps_param.ooc_tmpdir[sizeof(mumps_param.ooc_tmpdir) - 1] = '\0';
+      }
+
+      if(low_rank_compression)
+      {
+        mumps_param.ICNTL(35) = 2; // the factors compressed in the factorization and used so in the solution
+        mumps_param.CNTL(7) = low_rank_tolerance;
+      }
+    }
+
     template<typename Scalar>
     bool MumpsSolver<Scalar>::reinit()
     {
@@ -612,7 +695,7 @@ namespace Hermes
 
       param.job = JOB_INIT;
       param.par = 1; // host also performs calculations
-      param.sym = 0; // 0 = unsymmetric
+      param.sym = m->is_symmetric_storage() ? 2 : 0; // 0 = unsymmetric, 2 = general symmetric (upper triangle given)
       param.comm_fortran = USE_COMM_WORLD;
 
       mumps_c(&param);
@@ -620,21 +703,10 @@ namespace Hermes
 
       if(inited)
       {
-        // No printings.
-        param.ICNTL(1) = -1;
-        param.ICNTL(2) = -1;
-        param.ICNTL(3) = -1;
-        param.ICNTL(4) = 0;
-
-        param.ICNTL(20) = 0; // centralized dense RHS
-        param.ICNTL(21) = 0; // centralized dense solution
+        set_controls(param);
 
         // Specify the matrix.
-        param.n = m->size;
-        param.nz = m->nnz;
-        param.irn = m->irn;
-        param.jcn = m->jcn;
-        param.a = m->Ax;
+        specify_matrix();
       }
 
       return inited;
@@ -651,8 +723,84 @@ namespace Hermes
       param.rhs = NULL;
       param.INFOG(33) = -999; // see the case HERMES_REUSE_MATRIX_REORDERING_AND_SCALING
       // in setup_factorization()
+
+#ifdef HAVE_MUMPS_SINGLE
+      single_inited = false;
+      single_Ax = NULL;
+      param_single.rhs = NULL;
+#endif
+
+      distributed = false;
+      out_of_core = false;
+      low_rank_compression = false;
+      low_rank_tolerance = 0.0;
+    }
+
+    template<typename Scalar>
+    void MumpsSolver<Scalar>::set_out_of_core(bool to_set, std::string tmp_dir)
+    {
+      out_of_core = to_set;
+      ooc_tmpdir = tmp_dir;
+      end_instances();
+    }
+
+    template<typename Scalar>
+    void MumpsSolver<Scalar>::set_low_rank_compression(bool to_set, double tolerance)
+    {
+      if(tolerance < 0.0)
+        throw Hermes::Exceptions::ValueException("tolerance", tolerance, 0.0);
+      low_rank_compression = to_set;
+      low_rank_tolerance = tolerance;
+      end_instances();
+    }
+
+#ifndef HAVE_MUMPS_SINGLE
+    template<typename Scalar>
+    void MumpsSolver<Scalar>::set_mixed_precision(bool to_set, int max_steps, double tolerance)
+    {
+      if(to_set)
+        this->warn("MumpsSolver: Hermes was built without the single precision MUMPS, solving in double precision.");
+      DirectSolver<Scalar>::set_mixed_precision(false, max_steps, tolerance);
+    }
+#endif
+
+    template<typename Scalar>
+    void MumpsSolver<Scalar>::end_instances()
+    {
+      // The options are set at the initialization of an instance, the next solve() starts from scratch.
+      if(inited)
+      {
+        param.job = JOB_END;
+        mumps_c(&param);
+        inited = false;
+      }
+#ifdef HAVE_MUMPS_SINGLE
+      if(single_inited)
+      {
+        param_single.job = JOB_END;
+        mumps_single_c(&param_single);
+        single_inited = false;
+      }
+#endif
     }
 
+#ifdef WITH_MPI
+    template<typename Scalar>
+    void MumpsSolver<Scalar>::set_distributed(bool to_set)
+    {
+      if(to_set == distributed)
+        return;
+      distributed = to_set;
+      // A new instance with the other input format.
+      if(inited)
+      {
+        param.job = JOB_END;
+        mumps_c(&param);
+        inited = false;
+      }
+    }
+#endif
+
     template<typename Scalar>
     MumpsSolver<Scalar>::~MumpsSolver()
     {
@@ -664,6 +812,15 @@ namespace Hermes
       }
 
       if(param.rhs != NULL) delete [] param.rhs;
+
+#ifdef HAVE_MUMPS_SINGLE
+      if(single_inited)
+      {
+        param_single.job = JOB_END;
+        mumps_single_c(&param_single);
+      }
+      if(single_Ax != NULL) delete [] single_Ax;
+#endif
     }
 
     template<typename Scalar>
@@ -674,10 +831,27 @@ namespace Hermes
 
     template<typename Scalar>
     bool MumpsSolver<Scalar>::solve()
+    {
+      Hermes::ProfilerRegion profiler_region("MumpsSolver::solve");
+      assert(rhs != NULL);
+
+      return solve(1, rhs->v);
+    }
+
+    template<typename Scalar>
+    bool MumpsSolver<Scalar>::solve(int num_rhs, Scalar* rhs_block)
     {
       bool ret = false;
       assert(m != NULL);
-      assert(rhs != NULL);
+
+#ifdef HAVE_MUMPS_SINGLE
+      if(this->mixed_precision)
+      {
+        if(distributed)
+          throw Hermes::Exceptions::Exception("The mixed precision is not available with the distributed input.");
+        return solve_mixed_precision(num_rhs, rhs_block);
+      }
+#endif
 
       this->tick();
 
@@ -689,22 +863,37 @@ namespace Hermes
         throw Hermes::Exceptions::LinearMatrixSolverException("LU factorization could not be completed.");
       }
 
-      // Specify the right-hand side (will be replaced by the solution).
-      param.rhs = new typename mumps_type<Scalar>::mumps_Scalar[m->size];
-      memcpy(param.rhs, rhs->v, m->size * sizeof(Scalar));
+      // Specify the right-hand sides (will be replaced by the solutions), stored column by column.
+      param.rhs = new typename mumps_type<Scalar>::mumps_Scalar[m->size * num_rhs];
+#ifdef WITH_MPI
+      // The sum of the parts of the processes, on the host.
+      int num_doubles = m->size * num_rhs * (sizeof(Scalar) / sizeof(double));
+      if(distributed)
+        MPI_Reduce(rhs_block, param.rhs, num_doubles, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+      else
+#endif
+        memcpy(param.rhs, rhs_block, m->size * num_rhs * sizeof(Scalar));
+      param.nrhs = num_rhs;
+      param.lrhs = m->size;
 
       // Do the jobs specified in setup_factorization().
       mumps_c(&param);
 
       ret = check_status();
+#ifdef WITH_MPI
+      // The solution is on the host.
+      if(distributed && ret)
+        MPI_Bcast(param.rhs, num_doubles, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+#endif
 
       if(ret)
       {
         delete [] this->sln;
-        this->sln = new Scalar[m->size];
-        for (unsigned int i = 0; i < rhs->size; i++)
+        this->sln = new Scalar[m->size * num_rhs];
+        for (unsigned int i = 0; i < m->size * num_rhs; i++)
           this->sln[i] = mumps_to_Scalar(param.rhs[i]);
       }
+      param.nrhs = 1;
 
       this->tick();
       this->time = this->accumulated();
@@ -715,9 +904,152 @@ namespace Hermes
       return ret;
     }
 
+#ifdef HAVE_MUMPS_SINGLE
+    template<typename Scalar>
+    bool MumpsSolver<Scalar>::reinit_single()
+    {
+      if(single_inited)
+      {
+        param_single.job = JOB_END;
+        mumps_single_c(&param_single);
+      }
+
+      param_single.job = JOB_INIT;
+      param_single.par = 1;
+      param_single.sym = m->is_symmetric_storage() ? 2 : 0;
+      param_single.comm_fortran = USE_COMM_WORLD;
+
+      mumps_single_c(&param_single);
+      single_inited = (param_single.INFOG(1) == 0);
+
+      if(single_inited)
+      {
+        set_controls(param_single);
+
+        // Let MUMPS decide when and how to compute matrix reordering and scaling.
+        param_single.ICNTL(6) = 7;
+        param_single.ICNTL(8) = 77;
+      }
+      else
+        this->warn("Single precision MUMPS: INFOG(1) = %d", param_single.INFOG(1));
+
+      return single_inited;
+    }
+
+    template<typename Scalar>
+    bool MumpsSolver<Scalar>::solve_mixed_precision(int num_rhs, Scalar* rhs_block)
+    {
+      this->tick();
+      this->num_refinement_steps = 0;
+
+      int eff_fact_scheme = this->factorization_scheme;
+      if(!single_inited)
+        eff_fact_scheme = HERMES_FACTORIZE_FROM_SCRATCH;
+      bool have_analysis = single_inited && param_single.sym == (m->is_symmetric_storage() ? 2 : 0);
+      eff_fact_scheme = this->check_structure(eff_fact_scheme, have_analysis, m->size, m->nnz, (int*)m->Ap, m->irn);
+
+      if(eff_fact_scheme != HERMES_REUSE_FACTORIZATION_COMPLETELY)
+      {
+        if(eff_fact_scheme == HERMES_FACTORIZE_FROM_SCRATCH)
+        {
+          if(!reinit_single())
+            throw Hermes::Exceptions::LinearMatrixSolverException("Single precision MUMPS could not be initialized.");
+          param_single.job = JOB_ANALYZE_FACTORIZE;
+        }
+        else
+          // The analysis of the same pattern is kept.
+          param_single.job = JOB_FACTORIZE;
+
+        if(single_Ax != NULL) delete [] single_Ax;
+        single_Ax = new typename mumps_type<Scalar>::mumps_single_Scalar[m->nnz];
+        for (unsigned int i = 0; i < m->nnz; i++)
+          to_mumps_single(single_Ax[i], mumps_to_Scalar(m->Ax[i]));
+
+        param_single.n = m->size;
+        param_single.nz = m->nnz;
+        param_single.irn = m->irn;
+        param_single.jcn = m->jcn;
+        param_single.a = single_Ax;
+        mumps_single_c(&param_single);
+        if(param_single.INFOG(1) != 0)
+          throw Hermes::Exceptions::LinearMatrixSolverException("Single precision LU factorization could not be completed.");
+      }
+
+      delete [] this->sln;
+      this->sln = new Scalar[m->size * num_rhs];
+      bool converged = true;
+      for (int rhs_i = 0; rhs_i < num_rhs; rhs_i++)
+      {
+        Scalar* b = rhs_block + rhs_i * m->size;
+        Scalar* x = this->sln + rhs_i * m->size;
+        if(!solve_low_precision(b, x))
+          throw Hermes::Exceptions::LinearMatrixSolverException("Single precision MUMPS solve failed.");
+        if(!this->refine(m, b, x))
+          converged = false;
+      }
+      if(!converged)
+        this->warn("The iterative refinement did not reach the tolerance %g in %d steps.", this->refinement_tolerance, this->max_refinement_steps);
+
+      this->tick();
+      this->time = this->accumulated();
+
+      return true;
+    }
+
+    template<typename Scalar>
+    bool MumpsSolver<Scalar>::solve_low_precision(Scalar* b, Scalar* x)
+    {
+      param_single.rhs = new typename mumps_type<Scalar>::mumps_single_Scalar[m->size];
+      for (unsigned int i = 0; i < m->size; i++)
+        to_mumps_single(param_single.rhs[i], b[i]);
+      param_single.nrhs = 1;
+      param_single.lrhs = m->size;
+      param_single.job = JOB_SOLVE;
+
+      mumps_single_c(&param_single);
+
+      bool ret = (param_single.INFOG(1) == 0);
+      if(ret)
+        for (unsigned int i = 0; i < m->size; i++)
+          x[i] = mumps_to_Scalar(param_single.rhs[i]);
+
+      delete [] param_single.rhs;
+      param_single.rhs = NULL;
+      return ret;
+    }
+
+#endif
+
+    template<typename Scalar>
+    bool MumpsSolver<Scalar>::analyze_structure()
+    {
+      Hermes::ProfilerRegion profiler_region("MumpsSolver::analyze_structure");
+      // All the processes would have to analyze at once.
+      if(distributed)
+        return false;
+
+      unsigned long long hash = this->get_structure_hash(m->size, m->nnz, (int*)m->Ap, m->irn);
+      if(inited && param.sym == (m->is_symmetric_storage() ? 2 : 0) && hash == this->structure_hash)
+        return true;
+
+      if(!reinit())
+        return false;
+      // The values are not available yet, no maximum transversal, the scaling is left to the factorization.
+      param.ICNTL(6) = 0;
+      param.ICNTL(8) = 77;
+      param.job = JOB_ANALYZE;
+      mumps_c(&param);
+      if(!check_status())
+        return false;
+
+      this->structure_hash = hash;
+      return true;
+    }
+
     template<typename Scalar>
     bool MumpsSolver<Scalar>::setup_factorization()
     {
+      Hermes::ProfilerRegion profiler_region("MumpsSolver::setup_factorization");
       // When called for the first time, all three phases (analysis, factorization,
       // solution) must be performed.
       int eff_fact_scheme = this->factorization_scheme;
@@ -726,6 +1058,19 @@ namespace Hermes
           this->factorization_scheme == HERMES_REUSE_FACTORIZATION_COMPLETELY )
           eff_fact_scheme = HERMES_FACTORIZE_FROM_SCRATCH;
 
+      // Keep the analysis phase (JOB = 1) for an unchanged pattern.
+      bool have_analysis = inited && param.sym == (m->is_symmetric_storage() ? 2 : 0);
+      eff_fact_scheme = this->check_structure(eff_fact_scheme, have_analysis, m->size, m->nnz, (int*)m->Ap, m->irn);
+#ifdef WITH_MPI
+      // All the processes have to do the same jobs, the pattern of any part may have changed.
+      // The schemes are ordered from the one reusing nothing.
+      if(distributed)
+      {
+        int local_scheme = eff_fact_scheme;
+        MPI_Allreduce(&local_scheme, &eff_fact_scheme, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+      }
+#endif
+
       switch (eff_fact_scheme)
       {
       case HERMES_FACTORIZE_FROM_SCRATCH:
@@ -768,9 +1113,32 @@ namespace Hermes
         break;
       }
 
+      // The matrix may have been reallocated since the analysis.
+      specify_matrix();
+
       return true;
     }
 
+    template<typename Scalar>
+    void MumpsSolver<Scalar>::specify_matrix()
+    {
+      param.n = m->size;
+      if(distributed)
+      {
+        param.nz_loc = m->nnz;
+        param.irn_loc = m->irn;
+        param.jcn_loc = m->jcn;
+        param.a_loc = m->Ax;
+      }
+      else
+      {
+        param.nz = m->nnz;
+        param.irn = m->irn;
+        param.jcn = m->jcn;
+        param.a = m->Ax;
+      }
+    }
+
     template class HERMES_API MumpsSolver<double>;
     template class HERMES_API MumpsSolver<std::complex<double> >;
   }
@@ -0,0 +1,752 @@
+// This file is part of HermesCommon
+//
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Email: hpfem-group@unr.edu, home page: http://hpfem.org/.
+//
+// Hermes2D is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation; either version 2 of the License,
+// or (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/*! \file native_iter_solver.cpp
+\brief Built-in iterative solvers (CG, GMRES, BiCGStab) and preconditioners over CSCMatrix.
+*/
+#include "config.h"
+#ifdef WITH_UMFPACK
+#include "native_iter_solver.h"
+#include "profiler.h"
+#include "precond_amg.h"
+#include "api.h"
+
+namespace Hermes
+{
+  /// Below this size, the vector kernels run sequentially.
+  static const int PARALLEL_VECTOR_MIN_SIZE = 20000;
+
+  static inline double conjugate(double v)
+  {
+    return v;
+  }
+
+  static inline std::complex<double> conjugate(std::complex<double> v)
+  {
+    return std::conj(v);
+  }
+
+  /// (x, y) = sum conj(x_i) y_i.
+  static double dot(int n, const double* x, const double* y)
+  {
+    double result = 0.0;
+    int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) reduction(+:result) if(n > PARALLEL_VECTOR_MIN_SIZE)
+    for (int i = 0; i < n; i++)
+      result += x[i] * y[i];
+    return result;
+  }
+
+  static std::complex<double> dot(int n, const std::complex<double>* x, const std::complex<double>* y)
+  {
+    // OpenMP reduction works only for the built-in types.
+    double result_re = 0.0, result_im = 0.0;
+    int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) reduction(+:result_re, result_im) if(n > PARALLEL_VECTOR_MIN_SIZE)
+    for (int i = 0; i < n; i++)
+    {
+      std::complex<double> product = std::conj(x[i]) * y[i];
+      result_re += product.real();
+      result_im += product.imag();
+    }
+    return std::complex<double>(result_re, result_im);
+  }
+
+  template<typename Scalar>
+  static double norm(int n, const Scalar* x)
+  {
+    return sqrt(std::abs(dot(n, x, x)));
+  }
+
+  /// y = y + a * x.
+  template<typename Scalar>
+  static void axpy(int n, Scalar a, const Scalar* x, Scalar* y)
+  {
+    int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PARALLEL_VECTOR_MIN_SIZE)
+    for (int i = 0; i < n; i++)
+      y[i] += a * x[i];
+  }
+
+  /// y = x + b * y.
+  template<typename Scalar>
+  static void xpby(int n, const Scalar* x, Scalar b, Scalar* y)
+  {
+    int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PARALLEL_VECTOR_MIN_SIZE)
+    for (int i = 0; i < n; i++)
+      y[i] = x[i] + b * y[i];
+  }
+
+  /// r = b - A x.
+  template<typename Scalar>
+  static void calculate_residual(CSCMatrix<Scalar>* m, const Scalar* b, Scalar* x, Scalar* r)
+  {
+    int n = m->get_size();
+    m->multiply_with_vector(x, r);
+    int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PARALLEL_VECTOR_MIN_SIZE)
+    for (int i = 0; i < n; i++)
+      r[i] = b[i] - r[i];
+  }
+
+  namespace Preconditioners
+  {
+    template<typename Scalar>
+    CSCPrecond<Scalar>::CSCPrecond() : mat(NULL)
+    {
+    }
+
+    template<typename Scalar>
+    CSCPrecond<Scalar>::~CSCPrecond()
+    {
+    }
+
+    template<typename Scalar>
+    void CSCPrecond<Scalar>::create(Matrix<Scalar> *mat)
+    {
+      CSCMatrix<Scalar>* csc_mat = dynamic_cast<CSCMatrix<Scalar>*>(mat);
+      if(csc_mat == NULL)
+        throw Hermes::Exceptions::Exception("The built-in preconditioners need a CSCMatrix.");
+      this->mat = csc_mat;
+    }
+
+    template<typename Scalar>
+    void CSCPrecond<Scalar>::get_rows(int*& Rp, int*& Rj, Scalar*& Rx) const
+    {
+      int size = this->mat->get_size();
+      int* Ap = this->mat->get_Ap();
+      int* Ai = this->mat->get_Ai();
+      Scalar* Ax = this->mat->get_Ax();
+      bool symmetric = this->mat->is_symmetric_storage();
+
+      // Going through the columns in the increasing order keeps the columns of every row sorted, also with the mirrored
+      // entries of the symmetric storage (rows <= cols in every column): the row j gets its entries left of the diagonal
+      // from the column j, before the entries of the later columns.
+      Rp = new int[size + 1];
+      memset(Rp, 0, (size + 1) * sizeof(int));
+      for (int j = 0; j < size; j++)
+        for (int i = Ap[j]; i < Ap[j + 1]; i++)
+        {
+          Rp[Ai[i] + 1]++;
+          if(symmetric && Ai[i] != j)
+            Rp[j + 1]++;
+        }
+      for (int i = 0; i < size; i++)
+        Rp[i + 1] += Rp[i];
+
+      Rj = new int[Rp[size] > 0 ? Rp[size] : 1];
+      Rx = new Scalar[Rp[size] > 0 ? Rp[size] : 1];
+      int* position = new int[size > 0 ? size : 1];
+      memcpy(position, Rp, size * sizeof(int));
+      for (int j = 0; j < size; j++)
+        for (int i = Ap[j]; i < Ap[j + 1]; i++)
+        {
+          if(symmetric && Ai[i] != j)
+          {
+            Rj[position[j]] = Ai[i];
+            Rx[position[j]++] = Ax[i];
+          }
+          Rj[position[Ai[i]]] = j;
+          Rx[position[Ai[i]]++] = Ax[i];
+        }
+      delete [] position;
+    }
+
+#ifdef HAVE_EPETRA
+    template<typename Scalar>
+    const Epetra_Comm &CSCPrecond<Scalar>::Comm() const
+    {
+      throw Hermes::Exceptions::Exception("The built-in preconditioners are not Epetra operators.");
+    }
+
+    template<typename Scalar>
+    const Epetra_Map &CSCPrecond<Scalar>::OperatorDomainMap() const
+    {
+      throw Hermes::Exceptions::Exception("The built-in preconditioners are not Epetra operators.");
+    }
+
+    template<typename Scalar>
+    const Epetra_Map &CSCPrecond<Scalar>::OperatorRangeMap() const
+    {
+      throw Hermes::Exceptions::Exception("The built-in preconditioners are not Epetra operators.");
+    }
+#endif
+
+    template<typename Scalar>
+    JacobiPrecond<Scalar>::JacobiPrecond() : CSCPrecond<Scalar>(), inv_diag(NULL)
+    {
+    }
+
+    template<typename Scalar>
+    JacobiPrecond<Scalar>::~JacobiPrecond()
+    {
+      destroy();
+    }
+
+    template<typename Scalar>
+    void JacobiPrecond<Scalar>::destroy()
+    {
+      if(inv_diag != NULL)
+      {
+        delete [] inv_diag;
+        inv_diag = NULL;
+      }
+    }
+
+    template<typename Scalar>
+    void JacobiPrecond<Scalar>::compute()
+    {
+      if(this->mat == NULL)
+        throw Hermes::Exceptions::Exception("JacobiPrecond::compute() called before create().");
+      destroy();
+
+      int n = this->mat->get_size();
+      int* Ap = this->mat->get_Ap();
+      int* Ai = this->mat->get_Ai();
+      Scalar* Ax = this->mat->get_Ax();
+      inv_diag = new Scalar[n];
+      for (int j = 0; j < n; j++)
+      {
+        inv_diag[j] = 1.0;
+        for (int i = Ap[j]; i < Ap[j + 1]; i++)
+          if(Ai[i] == j)
+          {
+            if(Ax[i] != 0.0)
+              inv_diag[j] = 1.0 / Ax[i];
+            break;
+          }
+      }
+    }
+
+    template<typename Scalar>
+    void JacobiPrecond<Scalar>::apply(Scalar* r, Scalar* z)
+    {
+      int n = this->mat->get_size();
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PARALLEL_VECTOR_MIN_SIZE)
+      for (int i = 0; i < n; i++)
+        z[i] = inv_diag[i] * r[i];
+    }
+
+    template<typename Scalar>
+    ILU0Precond<Scalar>::ILU0Precond() : CSCPrecond<Scalar>(), size(0), Lp(NULL), Lj(NULL), LUx(NULL), diag(NULL)
+    {
+    }
+
+    template<typename Scalar>
+    ILU0Precond<Scalar>::~ILU0Precond()
+    {
+      destroy();
+    }
+
+    template<typename Scalar>
+    void ILU0Precond<Scalar>::destroy()
+    {
+      if(Lp != NULL)
+      {
+        delete [] Lp;
+        Lp = NULL;
+      }
+      if(Lj != NULL)
+      {
+        delete [] Lj;
+        Lj = NULL;
+      }
+      if(LUx != NULL)
+      {
+        delete [] LUx;
+        LUx = NULL;
+      }
+      if(diag != NULL)
+      {
+        delete [] diag;
+        diag = NULL;
+      }
+      size = 0;
+    }
+
+    template<typename Scalar>
+    void ILU0Precond<Scalar>::compute()
+    {
+      if(this->mat == NULL)
+        throw Hermes::Exceptions::Exception("ILU0Precond::compute() called before create().");
+      destroy();
+
+      size = this->mat->get_size();
+      // The row-wise copy of the matrix, factorized in place.
+      this->get_rows(Lp, Lj, LUx);
+
+      int* position = new int[size > 0 ? size : 1];
+      diag = new int[size];
+      for (int i = 0; i < size; i++)
+      {
+        diag[i] = -1;
+        for (int k = Lp[i]; k < Lp[i + 1]; k++)
+          if(Lj[k] == i)
+          {
+            diag[i] = k;
+            break;
+          }
+        if(diag[i] == -1)
+        {
+          delete [] position;
+          throw Hermes::Exceptions::Exception("ILU0Precond: the diagonal entry of the row %d is not in the matrix structure.", i);
+        }
+      }
+
+      // The IKJ variant restricted to the pattern, position[] maps the columns of the current row to their entries.
+      for (int j = 0; j < size; j++)
+        position[j] = -1;
+      for (int i = 0; i < size; i++)
+      {
+        for (int k = Lp[i]; k < Lp[i + 1]; k++)
+          position[Lj[k]] = k;
+
+        for (int k = Lp[i]; k < diag[i]; k++)
+        {
+          int row = Lj[k];
+          if(LUx[diag[row]] == 0.0)
+          {
+            delete [] position;
+            throw Hermes::Exceptions::Exception("ILU0Precond: zero pivot in the row %d.", row);
+          }
+          Scalar multiplier = LUx[k] / LUx[diag[row]];
+          LUx[k] = multiplier;
+          for (int l = diag[row] + 1; l < Lp[row + 1]; l++)
+            if(position[Lj[l]] != -1)
+              LUx[position[Lj[l]]] -= multiplier * LUx[l];
+        }
+
+        for (int k = Lp[i]; k < Lp[i + 1]; k++)
+          position[Lj[k]] = -1;
+      }
+      delete [] position;
+    }
+
+    template<typename Scalar>
+    void ILU0Precond<Scalar>::apply(Scalar* r, Scalar* z)
+    {
+      // L y = r, L with the unit diagonal.
+      for (int i = 0; i < size; i++)
+      {
+        Scalar value = r[i];
+        for (int k = Lp[i]; k < diag[i]; k++)
+          value -= LUx[k] * z[Lj[k]];
+        z[i] = value;
+      }
+      // U z = y.
+      for (int i = size - 1; i >= 0; i--)
+      {
+        Scalar value = z[i];
+        for (int k = diag[i] + 1; k < Lp[i + 1]; k++)
+          value -= LUx[k] * z[Lj[k]];
+        z[i] = value / LUx[diag[i]];
+      }
+    }
+
+    template class HERMES_API CSCPrecond<double>;
+    template class HERMES_API CSCPrecond<std::complex<double> >;
+    template class HERMES_API JacobiPrecond<double>;
+    template class HERMES_API JacobiPrecond<std::complex<double> >;
+    template class HERMES_API ILU0Precond<double>;
+    template class HERMES_API ILU0Precond<std::complex<double> >;
+  }
+
+  namespace Solvers
+  {
+    template<typename Scalar>
+    NativeIterSolver<Scalar>::NativeIterSolver(CSCMatrix<Scalar> *m, Vector<Scalar> *rhs)
+      : IterSolver<Scalar>(), m(m), rhs(rhs), method(METHOD_GMRES), gmres_restart(30), pc(NULL), own_pc(false), num_iters(0), residual(0.0)
+    {
+    }
+
+    template<typename Scalar>
+    NativeIterSolver<Scalar>::~NativeIterSolver()
+    {
+      if(own_pc)
+        delete pc;
+    }
+
+    template<typename Scalar>
+    int NativeIterSolver<Scalar>::get_matrix_size()
+    {
+      return m->get_size();
+    }
+
+    template<typename Scalar>
+    int NativeIterSolver<Scalar>::get_num_iters()
+    {
+      return num_iters;
+    }
+
+    template<typename Scalar>
+    double NativeIterSolver<Scalar>::get_residual()
+    {
+      return residual;
+    }
+
+    template<typename Scalar>
+    void NativeIterSolver<Scalar>::set_solver(const char *name)
+    {
+      if(strcasecmp(name, "cg") == 0)
+        method = METHOD_CG;
+      else if(strcasecmp(name, "gmres") == 0)
+        method = METHOD_GMRES;
+      else if(strcasecmp(name, "bicgstab") == 0)
+        method = METHOD_BICGSTAB;
+      else
+        throw Hermes::Exceptions::Exception("NativeIterSolver: unknown solver %s, available are cg, gmres, bicgstab.", name);
+    }
+
+    template<typename Scalar>
+    void NativeIterSolver<Scalar>::set_gmres_restart(int restart)
+    {
+      if(restart < 1)
+        throw Exceptions::ValueException("restart", restart, 1);
+      this->gmres_restart = restart;
+    }
+
+    template<typename Scalar>
+    void NativeIterSolver<Scalar>::set_precond(const char *name)
+    {
+      if(own_pc)
+        delete pc;
+      pc = NULL;
+      own_pc = false;
+      this->precond_yes = false;
+
+      if(strcasecmp(name, "none") == 0)
+        return;
+      if(strcasecmp(name, "jacobi") == 0)
+        pc = new Preconditioners::JacobiPrecond<Scalar>();
+      else if(strcasecmp(name, "ilu0") == 0)
+        pc = new Preconditioners::ILU0Precond<Scalar>();
+      else if(strcasecmp(name, "amg") == 0)
+        pc = new Preconditioners::AMGPrecond<Scalar>();
+      else
+        throw Hermes::Exceptions::Exception("NativeIterSolver: unknown preconditioner %s, available are none, jacobi, ilu0, amg.", name);
+      own_pc = true;
+      this->precond_yes = true;
+    }
+
+    template<typename Scalar>
+    void NativeIterSolver<Scalar>::set_precond(Precond<Scalar> *pc)
+    {
+      Preconditioners::CSCPrecond<Scalar>* csc_pc = dynamic_cast<Preconditioners::CSCPrecond<Scalar>*>(pc);
+      if(pc != NULL && csc_pc == NULL)
+        throw Hermes::Exceptions::Exception("NativeIterSolver needs a CSCPrecond preconditioner.");
+      if(own_pc)
+        delete this->pc;
+      this->pc = csc_pc;
+      own_pc = false;
+      this->precond_yes = (csc_pc != NULL);
+    }
+
+    template<typename Scalar>
+    void NativeIterSolver<Scalar>::apply_precond(Scalar* r, Scalar* z)
+    {
+      if(pc != NULL)
+        pc->apply(r, z);
+      else
+        memcpy(z, r, m->get_size() * sizeof(Scalar));
+    }
+
+    template<typename Scalar>
+    bool NativeIterSolver<Scalar>::solve()
+    {
+      Hermes::ProfilerRegion profiler_region("NativeIterSolver::solve");
+      assert(m != NULL);
+      assert(rhs != NULL);
+      assert(m->get_size() == rhs->length());
+
+      this->tick();
+
+      int n = m->get_size();
+      Scalar* b = new Scalar[n];
+      rhs->extract(b);
+
+      if(this->sln != NULL)
+        delete [] this->sln;
+      this->sln = new Scalar[n];
+      Hermes::Algebra::first_touch_zero(this->sln, n * sizeof(Scalar));
+
+      if(pc != NULL)
+      {
+        pc->create(this->precond_matrix != NULL ? this->precond_matrix : m);
+        pc->compute();
+      }
+
+      num_iters = 0;
+      residual = 0.0;
+      bool converged;
+      switch(method)
+      {
+      case METHOD_CG:
+        converged = solve_cg(b, this->sln);
+        break;
+      case METHOD_BICGSTAB:
+        converged = solve_bicgstab(b, this->sln);
+        break;
+      default:
+        converged = solve_gmres(b, this->sln);
+      }
+      delete [] b;
+
+      this->tick();
+      this->time = this->accumulated();
+
+      if(!converged)
+        this->warn("NativeIterSolver: not converged in %d iterations, relative residual %g.", num_iters, residual);
+      else
+        this->info("\tNativeIterSolver: converged in %d iterations, relative residual %g.", num_iters, residual);
+
+      return converged;
+    }
+
+    template<typename Scalar>
+    bool NativeIterSolver<Scalar>::solve_cg(Scalar* b, Scalar* x)
+    {
+      int n = m->get_size();
+      double b_norm = norm(n, b);
+      if(b_norm == 0.0)
+        return true;
+
+      Scalar* r = new Scalar[n];
+      Scalar* z = new Scalar[n];
+      Scalar* p = new Scalar[n];
+      Scalar* q = new Scalar[n];
+
+      calculate_residual(m, b, x, r);
+      apply_precond(r, z);
+      memcpy(p, z, n * sizeof(Scalar));
+      Scalar rz = dot(n, r, z);
+
+      bool converged = false;
+      residual = norm(n, r) / b_norm;
+      while(!(converged = (residual < this->tolerance)) && num_iters < this->max_iters)
+      {
+        m->multiply_with_vector(p, q);
+        Scalar alpha = rz / dot(n, p, q);
+        axpy(n, alpha, p, x);
+        axpy(n, -alpha, q, r);
+        num_iters++;
+        residual = norm(n, r) / b_norm;
+        if(residual < this->tolerance)
+          continue;
+
+        apply_precond(r, z);
+        Scalar rz_new = dot(n, r, z);
+        xpby(n, z, rz_new / rz, p);
+        rz = rz_new;
+      }
+
+      delete [] r;
+      delete [] z;
+      delete [] p;
+      delete [] q;
+      return converged;
+    }
+
+    template<typename Scalar>
+    bool NativeIterSolver<Scalar>::solve_bicgstab(Scalar* b, Scalar* x)
+    {
+      int n = m->get_size();
+      double b_norm = norm(n, b);
+      if(b_norm == 0.0)
+        return true;
+
+      Scalar* r = new Scalar[n];
+      Scalar* r_hat = new Scalar[n];
+      Scalar* p = new Scalar[n];
+      Scalar* p_hat = new Scalar[n];
+      Scalar* v = new Scalar[n];
+      Scalar* s_hat = new Scalar[n];
+      Scalar* t = new Scalar[n];
+
+      calculate_residual(m, b, x, r);
+      memcpy(r_hat, r, n * sizeof(Scalar));
+      Hermes::Algebra::first_touch_zero(p, n * sizeof(Scalar));
+      Hermes::Algebra::first_touch_zero(v, n * sizeof(Scalar));
+      Scalar rho = 1.0, alpha = 1.0, omega = 1.0;
+
+      bool converged = false;
+      residual = norm(n, r) / b_norm;
+      while(!(converged = (residual < this->tolerance)) && num_iters < this->max_iters)
+      {
+        Scalar rho_new = dot(n, r_hat, r);
+        if(rho_new == 0.0)
+          break;
+
+        // p = r + beta (p - omega v)
+        Scalar beta = (rho_new / rho) * (alpha / omega);
+        axpy(n, -omega, v, p);
+        xpby(n, r, beta, p);
+
+        apply_precond(p, p_hat);
+        m->multiply_with_vector(p_hat, v);
+        alpha = rho_new / dot(n, r_hat, v);
+
+        // s = r - alpha v, stored in r.
+        axpy(n, -alpha, v, r);
+        axpy(n, alpha, p_hat, x);
+        num_iters++;
+        residual = norm(n, r) / b_norm;
+        if(residual < this->tolerance)
+          continue;
+
+        apply_precond(r, s_hat);
+        m->multiply_with_vector(s_hat, t);
+        omega = dot(n, t, r) / dot(n, t, t);
+        axpy(n, omega, s_hat, x);
+        axpy(n, -omega, t, r);
+        residual = norm(n, r) / b_norm;
+        rho = rho_new;
+        if(omega == 0.0)
+          break;
+      }
+
+      delete [] r;
+      delete [] r_hat;
+      delete [] p;
+      delete [] p_hat;
+      delete [] v;
+      delete [] s_hat;
+      delete [] t;
+      return converged;
+    }
+
+    template<typename Scalar>
+    bool NativeIterSolver<Scalar>::solve_gmres(Scalar* b, Scalar* x)
+    {
+      int n = m->get_size();
+      double b_norm = norm(n, b);
+      if(b_norm == 0.0)
+        return true;
+
+      int restart = std::min(gmres_restart, n);
+      // The Krylov basis, the Hessenberg matrix (column-wise) and the Givens rotations.
+      Scalar** V = new Scalar*[restart + 1];
+      for (int i = 0; i <= restart; i++)
+        V[i] = new Scalar[n];
+      Scalar* H = new Scalar[(restart + 1) * restart];
+      double* cs = new double[restart];
+      Scalar* sn = new Scalar[restart];
+      Scalar* g = new Scalar[restart + 1];
+      Scalar* w = new Scalar[n];
+      Scalar* z = new Scalar[n];
+
+      calculate_residual(m, b, x, V[0]);
+      double beta = norm(n, V[0]);
+      residual = beta / b_norm;
+      bool converged = (residual < this->tolerance);
+
+      while(!converged && num_iters < this->max_iters)
+      {
+        for (int i = 0; i < n; i++)
+          V[0][i] /= beta;
+        g[0] = beta;
+
+        int j = 0;
+        while(j < restart && num_iters < this->max_iters)
+        {
+          Scalar* h = H + j * (restart + 1);
+
+          // w = A M^{-1} v_j, orthogonalized by the modified Gram-Schmidt.
+          apply_precond(V[j], z);
+          m->multiply_with_vector(z, w);
+          for (int i = 0; i <= j; i++)
+          {
+            h[i] = dot(n, V[i], w);
+            axpy(n, -h[i], V[i], w);
+          }
+          double h_next = norm(n, w);
+          if(h_next != 0.0)
+            for (int i = 0; i < n; i++)
+              V[j + 1][i] = w[i] / h_next;
+
+          // The previous rotations applied to the new column.
+          for (int i = 0; i < j; i++)
+          {
+            Scalar temp = cs[i] * h[i] + sn[i] * h[i + 1];
+            h[i + 1] = -conjugate(sn[i]) * h[i] + cs[i] * h[i + 1];
+            h[i] = temp;
+          }
+          // The new rotation eliminating h_next.
+          double h_abs = std::abs(h[j]);
+          double denominator = sqrt(h_abs * h_abs + h_next * h_next);
+          if(h_abs == 0.0)
+          {
+            cs[j] = 0.0;
+            sn[j] = 1.0;
+          }
+          else
+          {
+            cs[j] = h_abs / denominator;
+            sn[j] = (h[j] / h_abs) * h_next / denominator;
+          }
+          h[j] = cs[j] * h[j] + sn[j] * h_next;
+          g[j + 1] = -conjugate(sn[j]) * g[j];
+          g[j] = cs[j] * g[j];
+
+          j++;
+          num_iters++;
+          residual = std::abs(g[j]) / b_norm;
+          if(residual < this->tolerance || h_next == 0.0)
+            break;
+        }
+
+        // y = H^{-1} g (stored in g), x = x + M^{-1} V y.
+        for (int i = j - 1; i >= 0; i--)
+        {
+          for (int k = i + 1; k < j; k++)
+            g[i] -= H[k * (restart + 1) + i] * g[k];
+          g[i] /= H[i * (restart + 1) + i];
+        }
+        Hermes::Algebra::first_touch_zero(w, n * sizeof(Scalar));
+        for (int i = 0; i < j; i++)
+          axpy(n, g[i], V[i], w);
+        apply_precond(w, z);
+        axpy(n, (Scalar)1.0, z, x);
+
+        // The true residual for the restart.
+        calculate_residual(m, b, x, V[0]);
+        beta = norm(n, V[0]);
+        residual = beta / b_norm;
+        converged = (residual < this->tolerance);
+        if(beta == 0.0)
+          break;
+      }
+
+      for (int i = 0; i <= restart; i++)
+        delete [] V[i];
+      delete [] V;
+      delete [] H;
+      delete [] cs;
+      delete [] sn;
+      delete [] g;
+      delete [] w;
+      delete [] z;
+      return converged;
+    }
+
+    template class HERMES_API NativeIterSolver<double>;
+    template class HERMES_API NativeIterSolver<std::complex<double> >;
+  }
+}
+#endif
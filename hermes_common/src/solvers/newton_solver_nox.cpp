@@ -25,7 +25,35 @@ namespace Hermes
     static Epetra_SerialComm seq_comm;
 
     template<typename Scalar>
-    DiscreteProblemNOX<Scalar>::DiscreteProblemNOX(DiscreteProblemInterface<Scalar>* problem) : dp(problem)
+    JacobianOperatorNOX<Scalar>::JacobianOperatorNOX(DiscreteProblemInterface<Scalar>* problem, const Epetra_Map& map) : dp(problem), map(map)
+    {
+      this->coeff_vec = new Scalar[map.NumMyElements()];
+      memset(this->coeff_vec, 0, map.NumMyElements() * sizeof(Scalar));
+    }
+
+    template<typename Scalar>
+    JacobianOperatorNOX<Scalar>::~JacobianOperatorNOX()
+    {
+      delete [] this->coeff_vec;
+    }
+
+    template<typename Scalar>
+    void JacobianOperatorNOX<Scalar>::set_coeff_vector(const Epetra_Vector& x)
+    {
+      x.ExtractCopy(this->coeff_vec);
+    }
+
+    template<typename Scalar>
+    int JacobianOperatorNOX<Scalar>::Apply(const Epetra_MultiVector& X, Epetra_MultiVector& Y) const
+    {
+      for(int i = 0; i < X.NumVectors(); i++)
+        if(!this->dp->assemble_jacobian_vector_product(this->coeff_vec, X[i], Y[i]))
+          throw Exceptions::Exception("The problem does not provide the Jacobian-vector products.");
+      return 0;
+    }
+
+    template<typename Scalar>
+    DiscreteProblemNOX<Scalar>::DiscreteProblemNOX(DiscreteProblemInterface<Scalar>* problem) : dp(problem), precond_dp(problem)
     {
       this->precond = Teuchos::null;
       if(!this->dp->is_matrix_free())
@@ -51,6 +79,13 @@ namespace Hermes
     template<typename Scalar>
     bool DiscreteProblemNOX<Scalar>::computeJacobian(const Epetra_Vector &x, Epetra_Operator &op)
     {
+      JacobianOperatorNOX<Scalar>* jacobian_operator = dynamic_cast<JacobianOperatorNOX<Scalar>*>(&op);
+      if(jacobian_operator != NULL)
+      {
+        jacobian_operator->set_coeff_vector(x);
+        return true;
+      }
+
       Epetra_RowMatrix *jac = dynamic_cast<Epetra_RowMatrix *>(&op);
       assert(jac != NULL);
 
@@ -79,7 +114,7 @@ namespace Hermes
 
       Scalar* coeff_vec = new Scalar[xx.length()];
       xx.extract(coeff_vec);
-      this->dp->assemble(coeff_vec, &jacobian, NULL);  // NULL is for the right-hand side.
+      this->precond_dp->assemble(coeff_vec, &jacobian, NULL);  // NULL is for the right-hand side.
       delete [] coeff_vec;
       //jacobian.finish();
 
@@ -103,7 +138,7 @@ namespace Hermes
     }
 
     template<typename Scalar>
-    NewtonSolverNOX<Scalar>::NewtonSolverNOX(DiscreteProblemInterface<Scalar>* problem) : NonlinearSolver<Scalar>(problem), ndp(problem)
+    NewtonSolverNOX<Scalar>::NewtonSolverNOX(DiscreteProblemInterface<Scalar>* problem) : NonlinearSolver<Scalar>(problem), ndp(problem), jacobian_free(false)
     {
       // default values
       // convergence test
@@ -169,7 +204,29 @@ namespace Hermes
     void DiscreteProblemNOX<Scalar>::set_precond(Teuchos::RCP<Precond<Scalar> > &pc)
     {
       precond = pc;
-      this->dp->create_sparse_structure(&jacobian);
+      this->precond_dp->create_sparse_structure(&jacobian);
+    }
+
+    template<typename Scalar>
+    void DiscreteProblemNOX<Scalar>::set_precond_problem(DiscreteProblemInterface<Scalar>* problem)
+    {
+      if(problem->get_num_dofs() != this->dp->get_num_dofs())
+        throw Exceptions::LengthException(1, problem->get_num_dofs(), this->dp->get_num_dofs());
+      this->precond_dp = problem;
+      if(precond != Teuchos::null)
+        this->precond_dp->create_sparse_structure(&jacobian);
+    }
+
+    template<typename Scalar>
+    void NewtonSolverNOX<Scalar>::set_jacobian_free(bool to_set)
+    {
+      this->jacobian_free = to_set;
+    }
+
+    template<typename Scalar>
+    void NewtonSolverNOX<Scalar>::set_precond_problem(DiscreteProblemInterface<Scalar>* problem)
+    {
+      ndp.set_precond_problem(problem);
     }
 
     template<typename Scalar>
@@ -252,7 +309,22 @@ namespace Hermes
       Teuchos::RCP<Epetra_RowMatrix> jac_mat;
 
       // Create linear system
-      if(this->dp->is_matrix_free())
+      if(this->jacobian_free)
+      {
+        // Analytic Jacobian-vector products, the matrix (if any) is the preconditioner only.
+        Teuchos::RCP<NOX::Epetra::Interface::Jacobian> i_jac = Teuchos::rcpFromRef(ndp);
+        Teuchos::RCP<Epetra_Operator> jac_op = Teuchos::rcp(new JacobianOperatorNOX<Scalar>(this->dp, Epetra_Map(this->dp->get_num_dofs(), 0, seq_comm)));
+        if(precond == Teuchos::null)
+          lin_sys = Teuchos::rcp(new NOX::Epetra::LinearSystemAztecOO(print_pars, ls_pars, i_req,
+            i_jac, jac_op, init_sln));
+        else
+        {
+          Teuchos::RCP<NOX::Epetra::Interface::Preconditioner> i_prec = Teuchos::rcpFromRef(ndp);
+          lin_sys = Teuchos::rcp(new NOX::Epetra::LinearSystemAztecOO(print_pars, ls_pars,
+            i_jac, jac_op, i_prec, precond, init_sln));
+        }
+      }
+      else if(this->dp->is_matrix_free())
       {
         if(precond == Teuchos::null)
         { //Matrix free without preconditioner
@@ -340,7 +412,7 @@ namespace Hermes
       /// Solve.
       NOX::StatusTest::StatusType status = solver->solve();
 
-      if(!this->dp->is_matrix_free())
+      if(!this->jacobian_free && !this->dp->is_matrix_free())
         jac_mat.release();  // release the ownership (we take care of jac_mat by ourselves)
 
       if(status == NOX::StatusTest::Converged)
@@ -453,6 +525,7 @@ namespace Hermes
       conv.wrms_atol = atol;
     }
 
+    template class HERMES_API JacobianOperatorNOX<double>;
     template class HERMES_API DiscreteProblemNOX<double>;
     // template class HERMES_API DiscreteProblemNOX<std::complex<double> >; //complex version of nox solver is not implemented
     template class HERMES_API NewtonSolverNOX<double>;
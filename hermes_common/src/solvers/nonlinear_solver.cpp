@@ -56,9 +56,9 @@ namespace Hermes
     template<typename Scalar>
     void NonlinearSolver<Scalar>::set_iterative_method(const char* iterative_method_name)
     {
-      if(Hermes::HermesCommonApi.get_integral_param_value(Hermes::matrixSolverType) != SOLVER_AZTECOO)
+      if(Hermes::HermesCommonApi.get_integral_param_value(Hermes::matrixSolverType) != SOLVER_AZTECOO && Hermes::HermesCommonApi.get_integral_param_value(Hermes::matrixSolverType) != SOLVER_NATIVE_ITERATIVE)
       {
-        this->warn("Trying to set iterative method for a different solver than AztecOO.");
+        this->warn("Trying to set iterative method for a different solver than AztecOO or the built-in iterative solver.");
         return;
       }
       else
@@ -70,9 +70,9 @@ namespace Hermes
     template<typename Scalar>
     void NonlinearSolver<Scalar>::set_preconditioner(const char* preconditioner_name)
     {
-      if(Hermes::HermesCommonApi.get_integral_param_value(Hermes::matrixSolverType) != SOLVER_AZTECOO)
+      if(Hermes::HermesCommonApi.get_integral_param_value(Hermes::matrixSolverType) != SOLVER_AZTECOO && Hermes::HermesCommonApi.get_integral_param_value(Hermes::matrixSolverType) != SOLVER_NATIVE_ITERATIVE)
       {
-        this->warn("Trying to set iterative method for a different solver than AztecOO.");
+        this->warn("Trying to set iterative method for a different solver than AztecOO or the built-in iterative solver.");
         return;
       }
       else
@@ -86,6 +86,9 @@ namespace Hermes
     PetscMatrix<Scalar>::PetscMatrix()
     {
       inited = false;
+      Ap = NULL;
+      Ai = NULL;
+      Ax = NULL;
       add_petsc_object();
     }
 
@@ -135,6 +138,9 @@ namespace Hermes
     {
       if(inited) MatDestroy(matrix);
       inited = false;
+      delete [] Ap; Ap = NULL;
+      delete [] Ai; Ai = NULL;
+      delete [] Ax; Ax = NULL;
     }
 
     template<typename Scalar>
@@ -202,12 +208,43 @@ namespace Hermes
     template<typename Scalar>
     void PetscMatrix<Scalar>::add(unsigned int m, unsigned int n, Scalar **mat, int *rows, int *cols)
     {
-      /// \todo pass in just the block of the matrix without HERMES_DIRICHLET_DOFs (so that can use MatSetValues directly without checking
-      // row and cols for -1)
-      for (unsigned int i = 0; i < m; i++)        // rows
-        for (unsigned int j = 0; j < n; j++)      // cols
-          if(rows[i] >= 0 && cols[j] >= 0) // not Dir. dofs.
-            add(rows[i], cols[j], mat[i][j]);
+      // Leave out the Dirichlet (negative) DOFs once, and insert the rest of the block by one MatSetValues() call.
+      PetscInt* petsc_rows = new PetscInt[m];
+      PetscInt* petsc_cols = new PetscInt[n];
+      unsigned int* row_positions = new unsigned int[m];
+      unsigned int* col_positions = new unsigned int[n];
+      unsigned int num_rows = 0, num_cols = 0;
+      for (unsigned int i = 0; i < m; i++)
+        if(rows[i] >= 0)
+        {
+          petsc_rows[num_rows] = (PetscInt) rows[i];
+          row_positions[num_rows++] = i;
+        }
+      for (unsigned int j = 0; j < n; j++)
+        if(cols[j] >= 0)
+        {
+          petsc_cols[num_cols] = (PetscInt) cols[j];
+          col_positions[num_cols++] = j;
+        }
+
+      if(num_rows > 0 && num_cols > 0)
+      {
+        // Row-major, as MatSetValues() expects by default.
+        PetscScalar* values = new PetscScalar[num_rows * num_cols];
+        for (unsigned int i = 0; i < num_rows; i++)
+          for (unsigned int j = 0; j < num_cols; j++)
+            values[i * num_cols + j] = to_petsc(mat[row_positions[i]][col_positions[j]]);
+
+        #pragma omp critical (PetscMatrix_add)
+          MatSetValues(matrix, (PetscInt) num_rows, petsc_rows, (PetscInt) num_cols, petsc_cols, values, ADD_VALUES);
+
+        delete [] values;
+      }
+
+      delete [] petsc_rows;
+      delete [] petsc_cols;
+      delete [] row_positions;
+      delete [] col_positions;
     }
 
     template<typename Scalar>
@@ -307,13 +344,42 @@ namespace Hermes
     template<typename Scalar>
     void PetscMatrix<Scalar>::create(unsigned int size, unsigned int nnz, int* ap, int* ai, Scalar* ax)
     {
-      this->size = size;
-      this->nnz = nnz;
+      int* ap_copy = new int[size + 1];
+      memcpy(ap_copy, ap, (size + 1) * sizeof(int));
+      int* ai_copy = new int[nnz];
+      memcpy(ai_copy, ai, nnz * sizeof(int));
+      Scalar* ax_copy = new Scalar[nnz];
+      memcpy(ax_copy, ax, nnz * sizeof(Scalar));
+      adopt(size, nnz, ap_copy, ai_copy, ax_copy);
+    }
+
+    /// Takes over the values of the matrix, converts them if PetscScalar is not the Scalar.
+    static PetscScalar* adopt_petsc_values(double* ax, unsigned int nnz)
+    {
       PetscScalar* pax = new PetscScalar[nnz];
-      for (unsigned i = 0;i<nnz;i++)
+      for (unsigned int i = 0; i < nnz; i++)
         pax[i] = to_petsc(ax[i]);
-      MatCreateSeqAIJWithArrays(PETSC_COMM_SELF, size, size, ap, ai, pax, &matrix);
-      delete pax;
+      delete [] ax;
+      return pax;
+    }
+
+    static PetscScalar* adopt_petsc_values(std::complex<double>* ax, unsigned int nnz)
+    {
+      return ax;
+    }
+
+    template<typename Scalar>
+    void PetscMatrix<Scalar>::adopt(unsigned int size, unsigned int nnz, int* ap, int* ai, Scalar* ax)
+    {
+      free();
+      this->size = size;
+      this->nnz = nnz;
+      this->Ap = ap;
+      this->Ai = ai;
+      this->Ax = adopt_petsc_values(ax, nnz);
+      // PETSc uses the arrays as they are, they have to live as long as the matrix does.
+      MatCreateSeqAIJWithArrays(PETSC_COMM_SELF, size, size, this->Ap, this->Ai, this->Ax, &matrix);
+      inited = true;
     }
 
     template<typename Scalar>
@@ -425,11 +491,19 @@ namespace Hermes
     template<typename Scalar>
     void PetscVector<Scalar>::add(unsigned int n, unsigned int *idx, Scalar *y)
     {
-      PetscScalar py;
+      if(n == 0)
+        return;
+      PetscInt* petsc_idx = new PetscInt[n];
+      PetscScalar* py = new PetscScalar[n];
       for (unsigned int i = 0; i < n; i++)
       {
-        VecSetValue(vec, idx[i], to_petsc(y[i]), ADD_VALUES);
+        petsc_idx[i] = (PetscInt) idx[i];
+        py[i] = to_petsc(y[i]);
       }
+#pragma omp critical (PetscVector_add)
+      VecSetValues(vec, (PetscInt) n, petsc_idx, py, ADD_VALUES);
+      delete [] petsc_idx;
+      delete [] py;
     }
 
     template<typename Scalar>
@@ -468,11 +542,24 @@ namespace Hermes
   {
     template<typename Scalar>
     PetscLinearMatrixSolver<Scalar>::PetscLinearMatrixSolver(PetscMatrix<Scalar> *mat, PetscVector<Scalar> *rhs)
-      : DirectSolver<Scalar>(), m(mat), rhs(rhs)
+      : DirectSolver<Scalar>(), m(mat), rhs(rhs), precond_m(NULL)
     {
       add_petsc_object();
     }
 
+    template<typename Scalar>
+    void PetscLinearMatrixSolver<Scalar>::set_precond_matrix(Matrix<Scalar>* precond_matrix)
+    {
+      if(precond_matrix == NULL)
+      {
+        precond_m = NULL;
+        return;
+      }
+      precond_m = dynamic_cast<PetscMatrix<Scalar>*>(precond_matrix);
+      if(precond_m == NULL)
+        throw Hermes::Exceptions::Exception("PetscLinearMatrixSolver needs a PetscMatrix as the preconditioning matrix.");
+    }
+
     template<typename Scalar>
     PetscLinearMatrixSolver<Scalar>::~PetscLinearMatrixSolver()
     {
@@ -499,7 +586,7 @@ namespace Hermes
 
       KSPCreate(PETSC_COMM_WORLD, &ksp);
 
-      KSPSetOperators(ksp, m->matrix, m->matrix, DIFFERENT_NONZERO_PATTERN);
+      KSPSetOperators(ksp, m->matrix, precond_m != NULL ? precond_m->matrix : m->matrix, DIFFERENT_NONZERO_PATTERN);
       KSPSetFromOptions(ksp);
       VecDuplicate(rhs->vec, &x);
 
@@ -0,0 +1,753 @@
+// This file is part of HermesCommon
+//
+// Copyright (c) 2009 hp-FEM group at the University of Nevada, Reno (UNR).
+// Email: hpfem-group@unr.edu, home page: http://hpfem.org/.
+//
+// Hermes2D is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation; either version 2 of the License,
+// or (at your option) any later version.
+//
+// Hermes2D is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with Hermes2D; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+/*! \file precond_amg.cpp
+\brief Built-in smoothed aggregation algebraic multigrid preconditioner.
+*/
+#include "config.h"
+#ifdef WITH_UMFPACK
+#include "precond_amg.h"
+#include "api.h"
+#include <algorithm>
+
+namespace Hermes
+{
+  namespace Preconditioners
+  {
+    /// Below this number of the rows, the level operations run sequentially.
+    static const int AMG_PARALLEL_MIN_SIZE = 10000;
+
+    /// Largest coarsest level solved by the dense LU factorization, a larger one is only smoothed.
+    static const int AMG_MAX_DENSE_SIZE = 2000;
+
+    template<typename Scalar>
+    AMGPrecond<Scalar>::LevelMatrix::LevelMatrix() : rows(0), cols(0), p(NULL), j(NULL), x(NULL)
+    {
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::LevelMatrix::free()
+    {
+      if(p != NULL)
+      {
+        delete [] p;
+        p = NULL;
+      }
+      if(j != NULL)
+      {
+        delete [] j;
+        j = NULL;
+      }
+      if(x != NULL)
+      {
+        delete [] x;
+        x = NULL;
+      }
+      rows = cols = 0;
+    }
+
+    template<typename Scalar>
+    AMGPrecond<Scalar>::Level::Level() : inv_diag(NULL), lambda_max(1.0), b(NULL), x(NULL), r(NULL), d(NULL), t(NULL)
+    {
+    }
+
+    template<typename Scalar>
+    AMGPrecond<Scalar>::Level::~Level()
+    {
+      A.free();
+      P.free();
+      R.free();
+      AP.free();
+      delete [] inv_diag;
+      delete [] b;
+      delete [] x;
+      delete [] r;
+      delete [] d;
+      delete [] t;
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::Level::alloc(int size)
+    {
+      int alloc_size = size > 0 ? size : 1;
+      b = new Scalar[alloc_size];
+      x = new Scalar[alloc_size];
+      r = new Scalar[alloc_size];
+      d = new Scalar[alloc_size];
+      t = new Scalar[alloc_size];
+    }
+
+    template<typename Scalar>
+    AMGPrecond<Scalar>::AMGPrecond() : CSCPrecond<Scalar>(), max_levels(10), coarse_size(300), theta(0.08), chebyshev(true), sweeps(2),
+      reuse_hierarchy(true), structure_hash(0), structure_symmetric(false), coarse_lu(NULL), coarse_pivots(NULL)
+    {
+    }
+
+    template<typename Scalar>
+    AMGPrecond<Scalar>::~AMGPrecond()
+    {
+      destroy();
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::destroy()
+    {
+      for (unsigned int i = 0; i < levels.size(); i++)
+        delete levels[i];
+      levels.clear();
+      if(coarse_lu != NULL)
+      {
+        delete [] coarse_lu;
+        coarse_lu = NULL;
+      }
+      if(coarse_pivots != NULL)
+      {
+        delete [] coarse_pivots;
+        coarse_pivots = NULL;
+      }
+      structure_hash = 0;
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::set_max_levels(int max_levels)
+    {
+      if(max_levels < 1)
+        throw Exceptions::ValueException("max_levels", max_levels, 1);
+      this->max_levels = max_levels;
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::set_coarse_size(int coarse_size)
+    {
+      if(coarse_size < 1)
+        throw Exceptions::ValueException("coarse_size", coarse_size, 1);
+      this->coarse_size = coarse_size;
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::set_strength_threshold(double theta)
+    {
+      if(theta < 0.0)
+        throw Exceptions::ValueException("theta", theta, 0.0);
+      this->theta = theta;
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::set_smoother(const char* name, int sweeps)
+    {
+      if(sweeps < 1)
+        throw Exceptions::ValueException("sweeps", sweeps, 1);
+      if(strcasecmp(name, "chebyshev") == 0)
+        this->chebyshev = true;
+      else if(strcasecmp(name, "jacobi") == 0)
+        this->chebyshev = false;
+      else
+        throw Hermes::Exceptions::Exception("AMGPrecond: unknown smoother %s, available are chebyshev, jacobi.", name);
+      this->sweeps = sweeps;
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::set_reuse_hierarchy(bool reuse)
+    {
+      this->reuse_hierarchy = reuse;
+    }
+
+    template<typename Scalar>
+    int AMGPrecond<Scalar>::get_num_levels() const
+    {
+      return levels.size();
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::multiply_structure(const LevelMatrix& A, const LevelMatrix& B, LevelMatrix& C)
+    {
+      C.rows = A.rows;
+      C.cols = B.cols;
+      C.p = new int[C.rows + 1];
+      C.p[0] = 0;
+
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+      // The row sizes, marker[] holds the last row in which a column appeared.
+#pragma omp parallel num_threads(num_threads_used) if(A.rows > AMG_PARALLEL_MIN_SIZE)
+      {
+        int* marker = new int[B.cols > 0 ? B.cols : 1];
+        for (int k = 0; k < B.cols; k++)
+          marker[k] = -1;
+#pragma omp for schedule(static)
+        for (int i = 0; i < A.rows; i++)
+        {
+          int count = 0;
+          for (int a = A.p[i]; a < A.p[i + 1]; a++)
+            for (int b = B.p[A.j[a]]; b < B.p[A.j[a] + 1]; b++)
+              if(marker[B.j[b]] != i)
+              {
+                marker[B.j[b]] = i;
+                count++;
+              }
+          C.p[i + 1] = count;
+        }
+        delete [] marker;
+      }
+      for (int i = 0; i < C.rows; i++)
+        C.p[i + 1] += C.p[i];
+
+      C.j = new int[C.p[C.rows] > 0 ? C.p[C.rows] : 1];
+      C.x = new Scalar[C.p[C.rows] > 0 ? C.p[C.rows] : 1];
+#pragma omp parallel num_threads(num_threads_used) if(A.rows > AMG_PARALLEL_MIN_SIZE)
+      {
+        int* marker = new int[B.cols > 0 ? B.cols : 1];
+        for (int k = 0; k < B.cols; k++)
+          marker[k] = -1;
+#pragma omp for schedule(static)
+        for (int i = 0; i < A.rows; i++)
+        {
+          int position = C.p[i];
+          for (int a = A.p[i]; a < A.p[i + 1]; a++)
+            for (int b = B.p[A.j[a]]; b < B.p[A.j[a] + 1]; b++)
+              if(marker[B.j[b]] != i)
+              {
+                marker[B.j[b]] = i;
+                C.j[position++] = B.j[b];
+              }
+          std::sort(C.j + C.p[i], C.j + C.p[i + 1]);
+        }
+        delete [] marker;
+      }
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::multiply_values(const LevelMatrix& A, const LevelMatrix& B, LevelMatrix& C)
+    {
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel num_threads(num_threads_used) if(A.rows > AMG_PARALLEL_MIN_SIZE)
+      {
+        // Only the columns of the current row are looked up, the other entries of position[] are stale.
+        int* position = new int[B.cols > 0 ? B.cols : 1];
+#pragma omp for schedule(static)
+        for (int i = 0; i < A.rows; i++)
+        {
+          for (int c = C.p[i]; c < C.p[i + 1]; c++)
+          {
+            position[C.j[c]] = c;
+            C.x[c] = 0.0;
+          }
+          for (int a = A.p[i]; a < A.p[i + 1]; a++)
+            for (int b = B.p[A.j[a]]; b < B.p[A.j[a] + 1]; b++)
+              C.x[position[B.j[b]]] += A.x[a] * B.x[b];
+        }
+        delete [] position;
+      }
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::transpose(const LevelMatrix& A, LevelMatrix& T)
+    {
+      T.rows = A.cols;
+      T.cols = A.rows;
+      T.p = new int[T.rows + 1];
+      memset(T.p, 0, (T.rows + 1) * sizeof(int));
+      for (int k = 0; k < A.p[A.rows]; k++)
+        T.p[A.j[k] + 1]++;
+      for (int i = 0; i < T.rows; i++)
+        T.p[i + 1] += T.p[i];
+
+      T.j = new int[T.p[T.rows] > 0 ? T.p[T.rows] : 1];
+      T.x = new Scalar[T.p[T.rows] > 0 ? T.p[T.rows] : 1];
+      int* position = new int[T.rows > 0 ? T.rows : 1];
+      memcpy(position, T.p, T.rows * sizeof(int));
+      for (int i = 0; i < A.rows; i++)
+        for (int k = A.p[i]; k < A.p[i + 1]; k++)
+        {
+          T.j[position[A.j[k]]] = i;
+          T.x[position[A.j[k]]++] = A.x[k];
+        }
+      delete [] position;
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::multiply_with_vector(const LevelMatrix& A, const Scalar* x, Scalar* y)
+    {
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(A.rows > AMG_PARALLEL_MIN_SIZE)
+      for (int i = 0; i < A.rows; i++)
+      {
+        Scalar value = 0.0;
+        for (int k = A.p[i]; k < A.p[i + 1]; k++)
+          value += A.x[k] * x[A.j[k]];
+        y[i] = value;
+      }
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::calculate_residual(const LevelMatrix& A, const Scalar* b, const Scalar* x, Scalar* r)
+    {
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(A.rows > AMG_PARALLEL_MIN_SIZE)
+      for (int i = 0; i < A.rows; i++)
+      {
+        Scalar value = b[i];
+        for (int k = A.p[i]; k < A.p[i + 1]; k++)
+          value -= A.x[k] * x[A.j[k]];
+        r[i] = value;
+      }
+    }
+
+    template<typename Scalar>
+    int AMGPrecond<Scalar>::aggregate(LevelMatrix& A, int* aggregates)
+    {
+      int n = A.rows;
+      double* diag_abs = new double[n > 0 ? n : 1];
+      for (int i = 0; i < n; i++)
+      {
+        diag_abs[i] = 0.0;
+        for (int k = A.p[i]; k < A.p[i + 1]; k++)
+          if(A.j[k] == i)
+            diag_abs[i] = std::abs(A.x[k]);
+        aggregates[i] = -1;
+      }
+      double theta_squared = theta * theta;
+
+      // Every thread aggregates its own contiguous block of the rows, the connections to the other blocks are ignored.
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+      int num_blocks = (n > AMG_PARALLEL_MIN_SIZE) ? num_threads_used : 1;
+      int* block_aggregates = new int[num_blocks + 1];
+      block_aggregates[0] = 0;
+
+#pragma omp parallel for num_threads(num_threads_used) schedule(static, 1) if(num_blocks > 1)
+      for (int block = 0; block < num_blocks; block++)
+      {
+        int begin = (int)(((long long)n * block) / num_blocks);
+        int end = (int)(((long long)n * (block + 1)) / num_blocks);
+        int count = 0;
+
+        // 1. The rows with all their strong neighbours free become the roots of the new aggregates.
+        for (int i = begin; i < end; i++)
+        {
+          if(aggregates[i] != -1)
+            continue;
+          bool free_neighbourhood = true;
+          for (int k = A.p[i]; k < A.p[i + 1] && free_neighbourhood; k++)
+          {
+            int col = A.j[k];
+            if(col != i && col >= begin && col < end && std::abs(A.x[k]) * std::abs(A.x[k]) >= theta_squared * diag_abs[i] * diag_abs[col])
+              free_neighbourhood = (aggregates[col] == -1);
+          }
+          if(!free_neighbourhood)
+            continue;
+          aggregates[i] = begin + count;
+          for (int k = A.p[i]; k < A.p[i + 1]; k++)
+          {
+            int col = A.j[k];
+            if(col != i && col >= begin && col < end && std::abs(A.x[k]) * std::abs(A.x[k]) >= theta_squared * diag_abs[i] * diag_abs[col])
+              aggregates[col] = begin + count;
+          }
+          count++;
+        }
+
+        // 2. The remaining rows join an aggregate from the step 1 of a strong neighbour, marked as -(aggregate + 2) so that the aggregates do not grow in chains.
+        for (int i = begin; i < end; i++)
+        {
+          if(aggregates[i] != -1)
+            continue;
+          for (int k = A.p[i]; k < A.p[i + 1]; k++)
+          {
+            int col = A.j[k];
+            if(col != i && col >= begin && col < end && aggregates[col] >= 0 && std::abs(A.x[k]) * std::abs(A.x[k]) >= theta_squared * diag_abs[i] * diag_abs[col])
+            {
+              aggregates[i] = -(aggregates[col] + 2);
+              break;
+            }
+          }
+        }
+        for (int i = begin; i < end; i++)
+          if(aggregates[i] < -1)
+            aggregates[i] = -aggregates[i] - 2;
+
+        // 3. The rest forms the new aggregates with the free strong neighbours (an isolated row is an aggregate of its own).
+        for (int i = begin; i < end; i++)
+        {
+          if(aggregates[i] != -1)
+            continue;
+          aggregates[i] = begin + count;
+          for (int k = A.p[i]; k < A.p[i + 1]; k++)
+          {
+            int col = A.j[k];
+            if(col != i && col >= begin && col < end && aggregates[col] == -1 && std::abs(A.x[k]) * std::abs(A.x[k]) >= theta_squared * diag_abs[i] * diag_abs[col])
+              aggregates[col] = begin + count;
+          }
+          count++;
+        }
+
+        // The local numbers (offset by begin) are renumbered after all blocks are known.
+        block_aggregates[block + 1] = count;
+      }
+
+      for (int block = 0; block < num_blocks; block++)
+        block_aggregates[block + 1] += block_aggregates[block];
+      for (int block = 0; block < num_blocks; block++)
+      {
+        int begin = (int)(((long long)n * block) / num_blocks);
+        int end = (int)(((long long)n * (block + 1)) / num_blocks);
+        for (int i = begin; i < end; i++)
+          aggregates[i] = aggregates[i] - begin + block_aggregates[block];
+      }
+
+      int num_aggregates = block_aggregates[num_blocks];
+      delete [] block_aggregates;
+      delete [] diag_abs;
+      return num_aggregates;
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::setup_smoother(Level* level)
+    {
+      LevelMatrix& A = level->A;
+      if(level->inv_diag == NULL)
+        level->inv_diag = new Scalar[A.rows > 0 ? A.rows : 1];
+
+      // The Gershgorin bound of the spectrum of D^{-1} A.
+      double lambda_max = 0.0;
+      int zero_diagonal_row = -1;
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel num_threads(num_threads_used) if(A.rows > AMG_PARALLEL_MIN_SIZE)
+      {
+        double thread_lambda_max = 0.0;
+#pragma omp for schedule(static)
+        for (int i = 0; i < A.rows; i++)
+        {
+          Scalar diagonal = 0.0;
+          double row_sum = 0.0;
+          for (int k = A.p[i]; k < A.p[i + 1]; k++)
+          {
+            if(A.j[k] == i)
+              diagonal = A.x[k];
+            row_sum += std::abs(A.x[k]);
+          }
+          if(diagonal == 0.0)
+          {
+#pragma omp critical (AMGPrecond_zero_diagonal)
+            zero_diagonal_row = i;
+            level->inv_diag[i] = 1.0;
+            continue;
+          }
+          level->inv_diag[i] = 1.0 / diagonal;
+          thread_lambda_max = std::max(thread_lambda_max, row_sum / std::abs(diagonal));
+        }
+#pragma omp critical (AMGPrecond_lambda_max)
+        lambda_max = std::max(lambda_max, thread_lambda_max);
+      }
+
+      if(zero_diagonal_row != -1)
+        throw Hermes::Exceptions::Exception("AMGPrecond: zero diagonal entry in the row %d.", zero_diagonal_row);
+      level->lambda_max = lambda_max > 0.0 ? lambda_max : 1.0;
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::smooth(Level* level, Scalar* b, Scalar* x)
+    {
+      int n = level->A.rows;
+      Scalar* inv_diag = level->inv_diag;
+      Scalar* r = level->r;
+      Scalar* d = level->d;
+      Scalar* t = level->t;
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+
+      if(!chebyshev)
+      {
+        // Damped Jacobi.
+        double omega = 4.0 / (3.0 * level->lambda_max);
+        for (int sweep = 0; sweep < sweeps; sweep++)
+        {
+          calculate_residual(level->A, b, x, r);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > AMG_PARALLEL_MIN_SIZE)
+          for (int i = 0; i < n; i++)
+            x[i] += omega * inv_diag[i] * r[i];
+        }
+        return;
+      }
+
+      // The Chebyshev iteration for D^{-1} A on [lambda_max / 30, lambda_max], Y. Saad, Iterative methods for sparse linear systems, Algorithm 12.1.
+      double upper = level->lambda_max;
+      double lower = upper / 30.0;
+      double center = (upper + lower) / 2.0;
+      double half_width = (upper - lower) / 2.0;
+      double sigma = center / half_width;
+      double rho = 1.0 / sigma;
+
+      calculate_residual(level->A, b, x, r);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > AMG_PARALLEL_MIN_SIZE)
+      for (int i = 0; i < n; i++)
+        d[i] = inv_diag[i] * r[i] / center;
+
+      for (int sweep = 0; sweep < sweeps; sweep++)
+      {
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > AMG_PARALLEL_MIN_SIZE)
+        for (int i = 0; i < n; i++)
+          x[i] += d[i];
+        if(sweep == sweeps - 1)
+          break;
+
+        multiply_with_vector(level->A, d, t);
+        double rho_new = 1.0 / (2.0 * sigma - rho);
+        double d_factor = rho_new * rho;
+        double r_factor = 2.0 * rho_new / half_width;
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > AMG_PARALLEL_MIN_SIZE)
+        for (int i = 0; i < n; i++)
+        {
+          r[i] -= t[i];
+          d[i] = d_factor * d[i] + r_factor * inv_diag[i] * r[i];
+        }
+        rho = rho_new;
+      }
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::factorize_coarsest()
+    {
+      LevelMatrix& A = levels.back()->A;
+      int n = A.rows;
+      if(coarse_lu == NULL)
+      {
+        coarse_lu = new Scalar[n * n > 0 ? n * n : 1];
+        coarse_pivots = new int[n > 0 ? n : 1];
+      }
+      std::fill(coarse_lu, coarse_lu + n * n, Scalar(0));
+      for (int i = 0; i < n; i++)
+        for (int k = A.p[i]; k < A.p[i + 1]; k++)
+          coarse_lu[i * n + A.j[k]] = A.x[k];
+
+      // Partial pivoting by rows. A zero pivot (e.g. the constant of a pure Neumann problem) leaves its component of the solution zero.
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+      for (int k = 0; k < n; k++)
+      {
+        int pivot = k;
+        for (int i = k + 1; i < n; i++)
+          if(std::abs(coarse_lu[i * n + k]) > std::abs(coarse_lu[pivot * n + k]))
+            pivot = i;
+        coarse_pivots[k] = pivot;
+        if(pivot != k)
+          for (int j = 0; j < n; j++)
+            std::swap(coarse_lu[k * n + j], coarse_lu[pivot * n + j]);
+        if(coarse_lu[k * n + k] == 0.0)
+          continue;
+
+        Scalar* pivot_row = coarse_lu + k * n;
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n - k > 200)
+        for (int i = k + 1; i < n; i++)
+        {
+          Scalar* row = coarse_lu + i * n;
+          Scalar multiplier = row[k] / pivot_row[k];
+          row[k] = multiplier;
+          if(multiplier != 0.0)
+            for (int j = k + 1; j < n; j++)
+              row[j] -= multiplier * pivot_row[j];
+        }
+      }
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::solve_coarsest(Scalar* b, Scalar* x)
+    {
+      int n = levels.back()->A.rows;
+      memcpy(x, b, n * sizeof(Scalar));
+      for (int k = 0; k < n; k++)
+      {
+        if(coarse_pivots[k] != k)
+          std::swap(x[k], x[coarse_pivots[k]]);
+        for (int j = 0; j < k; j++)
+          x[k] -= coarse_lu[k * n + j] * x[j];
+      }
+      for (int k = n - 1; k >= 0; k--)
+      {
+        if(coarse_lu[k * n + k] == 0.0)
+        {
+          x[k] = 0.0;
+          continue;
+        }
+        for (int j = k + 1; j < n; j++)
+          x[k] -= coarse_lu[k * n + j] * x[j];
+        x[k] /= coarse_lu[k * n + k];
+      }
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::build_hierarchy()
+    {
+      Level* level = new Level();
+      level->A.rows = level->A.cols = this->mat->get_size();
+      this->get_rows(level->A.p, level->A.j, level->A.x);
+      level->alloc(level->A.rows);
+      levels.push_back(level);
+
+      while((int)levels.size() < max_levels && level->A.rows > coarse_size)
+      {
+        int n = level->A.rows;
+        setup_smoother(level);
+
+        int* aggregates = new int[n];
+        int num_aggregates = aggregate(level->A, aggregates);
+        if(num_aggregates == 0 || num_aggregates == n)
+        {
+          // The coarsening stalls.
+          delete [] aggregates;
+          break;
+        }
+
+        // The tentative prolongation, the normalized constant in each aggregate.
+        LevelMatrix tentative;
+        tentative.rows = n;
+        tentative.cols = num_aggregates;
+        tentative.p = new int[n + 1];
+        tentative.j = aggregates;
+        tentative.x = new Scalar[n];
+        int* aggregate_sizes = new int[num_aggregates];
+        memset(aggregate_sizes, 0, num_aggregates * sizeof(int));
+        for (int i = 0; i < n; i++)
+          aggregate_sizes[aggregates[i]]++;
+        for (int i = 0; i < n; i++)
+        {
+          tentative.p[i] = i;
+          tentative.x[i] = 1.0 / sqrt((double)aggregate_sizes[aggregates[i]]);
+        }
+        tentative.p[n] = n;
+        delete [] aggregate_sizes;
+
+        // P = (I - omega D^{-1} A) P_tentative, on the pattern of A P_tentative (which contains the one of P_tentative, as the diagonal of A is nonzero).
+        multiply_structure(level->A, tentative, level->P);
+        multiply_values(level->A, tentative, level->P);
+        double omega = 4.0 / (3.0 * level->lambda_max);
+        int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > AMG_PARALLEL_MIN_SIZE)
+        for (int i = 0; i < n; i++)
+          for (int k = level->P.p[i]; k < level->P.p[i + 1]; k++)
+          {
+            level->P.x[k] *= -omega * level->inv_diag[i];
+            if(level->P.j[k] == aggregates[i])
+              level->P.x[k] += tentative.x[i];
+          }
+        tentative.free();
+
+        // The restriction is the plain transpose (also in the complex case, keeping a complex symmetric matrix complex symmetric).
+        transpose(level->P, level->R);
+
+        Level* coarse = new Level();
+        multiply_structure(level->A, level->P, level->AP);
+        multiply_values(level->A, level->P, level->AP);
+        multiply_structure(level->R, level->AP, coarse->A);
+        multiply_values(level->R, level->AP, coarse->A);
+        coarse->alloc(coarse->A.rows);
+        levels.push_back(coarse);
+        level = coarse;
+      }
+
+      if(level->A.rows <= AMG_MAX_DENSE_SIZE)
+        factorize_coarsest();
+      else
+        setup_smoother(level);
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::compute_values()
+    {
+      // The aggregates and the prolongations are those of the matrix the hierarchy was built for.
+      Level* finest = levels[0];
+      finest->A.free();
+      finest->A.rows = finest->A.cols = this->mat->get_size();
+      this->get_rows(finest->A.p, finest->A.j, finest->A.x);
+
+      for (unsigned int i = 0; i + 1 < levels.size(); i++)
+      {
+        setup_smoother(levels[i]);
+        multiply_values(levels[i]->A, levels[i]->P, levels[i]->AP);
+        multiply_values(levels[i]->R, levels[i]->AP, levels[i + 1]->A);
+      }
+
+      if(coarse_lu != NULL)
+        factorize_coarsest();
+      else
+        setup_smoother(levels.back());
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::compute()
+    {
+      if(this->mat == NULL)
+        throw Hermes::Exceptions::Exception("AMGPrecond::compute() called before create().");
+
+      unsigned long long hash = Solvers::DirectSolver<Scalar>::get_structure_hash(this->mat->get_size(), this->mat->get_nnz(), this->mat->get_Ap(), this->mat->get_Ai());
+      bool symmetric = this->mat->is_symmetric_storage();
+      if(reuse_hierarchy && !levels.empty() && hash == structure_hash && symmetric == structure_symmetric)
+        compute_values();
+      else
+      {
+        destroy();
+        build_hierarchy();
+        structure_hash = hash;
+        structure_symmetric = symmetric;
+      }
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::cycle(unsigned int level_i)
+    {
+      Level* level = levels[level_i];
+      int n = level->A.rows;
+
+      if(level_i == levels.size() - 1)
+      {
+        if(coarse_lu != NULL)
+          solve_coarsest(level->b, level->x);
+        else
+        {
+          std::fill(level->x, level->x + n, Scalar(0));
+          smooth(level, level->b, level->x);
+          smooth(level, level->b, level->x);
+        }
+        return;
+      }
+
+      Level* coarse = levels[level_i + 1];
+      std::fill(level->x, level->x + n, Scalar(0));
+      smooth(level, level->b, level->x);
+      calculate_residual(level->A, level->b, level->x, level->r);
+      multiply_with_vector(level->R, level->r, coarse->b);
+      cycle(level_i + 1);
+      multiply_with_vector(level->P, coarse->x, level->t);
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > AMG_PARALLEL_MIN_SIZE)
+      for (int i = 0; i < n; i++)
+        level->x[i] += level->t[i];
+      smooth(level, level->b, level->x);
+    }
+
+    template<typename Scalar>
+    void AMGPrecond<Scalar>::apply(Scalar* r, Scalar* z)
+    {
+      if(levels.empty())
+        throw Hermes::Exceptions::Exception("AMGPrecond::apply() called before compute().");
+      int n = levels[0]->A.rows;
+      memcpy(levels[0]->b, r, n * sizeof(Scalar));
+      cycle(0);
+      memcpy(z, levels[0]->x, n * sizeof(Scalar));
+    }
+
+    template class HERMES_API AMGPrecond<double>;
+    template class HERMES_API AMGPrecond<std::complex<double> >;
+  }
+}
+#endif
@@ -93,6 +93,11 @@ namespace Hermes
       EpetraMatrix<Scalar> *mt = static_cast<EpetraMatrix<Scalar> *>(m);
       assert(mt != NULL);
       mat = mt;
+      if(owner)
+      {
+        delete prec;
+        prec = NULL;
+      }
       if(strcmp(cls, "point-relax") == 0)
       {
         create_point_relax(mat, type);
@@ -32,6 +32,8 @@ namespace Hermes
 
       if(strcmp(type, "sa") == 0) ML_Epetra::SetDefaults("SA", mlist);
       else if(strcmp(type, "dd") == 0) ML_Epetra::SetDefaults("DD", mlist);
+      // Keep the prolongators for recompute().
+      mlist.set("reuse: enable", true);
     }
 
     template<typename Scalar>
@@ -90,6 +92,16 @@ namespace Hermes
       prec->ComputePreconditioner();
     }
 
+    template<typename Scalar>
+    void MlPrecond<Scalar>::recompute()
+    {
+      assert(prec != NULL);
+      if(prec->IsPreconditionerComputed())
+        prec->ReComputePreconditioner();
+      else
+        prec->ComputePreconditioner();
+    }
+
     template<typename Scalar>
     void MlPrecond<Scalar>::print_unused()
     {
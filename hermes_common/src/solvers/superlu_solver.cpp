@@ -23,67 +23,12 @@
 #include "config.h"
 #ifdef WITH_SUPERLU
 #include "superlu_solver.h"
+#include "profiler.h"
 #include "callstack.h"
+#include "api.h"
 
 namespace Hermes
 {
-  namespace Solvers
-  {
-#ifdef SLU_MT
-    template <>
-    void SuperLu<double>::sequ(SuperMatrix *A, double *r, double *c, double *rowcnd, double *colcnd, double *amax, int *info)
-    {
-      dsequ (A, r, c, rowcnd, colcnd, amax, info);
-    }
-
-    template <>
-    void SuperLu<double>::laqgs (SuperMatrix *A, float *r, float *c, float rowcnd, float colcnd, float amax, char *equed)
-    {
-      dlaqgs (A, r, c, rowcnd, colcnd, amax, equed);
-    }
-
-    template <>
-    int SuperLu<double>::gstrf (superlu_options_t *options, int m, int n, double anorm, LUstruct_t *LUstruct, gridinfo_t *grid, SuperLUStat_t *stat, int *info)
-    {
-      return dgstrf (options, m, n, anorm, LUstruct, grid, stat, info);
-    }
-
-    template <>
-    float SuperLu<double>::pivotGrowth (int ncols, SuperMatrix *A, int *perm_c, SuperMatrix *L, SuperMatrix *U)
-    {
-      return dPivotGrowth (ncols, A, perm_c, L, U);
-    }
-
-    template <>
-    float SuperLu<double>::langs (char *norm, SuperMatrix *A)
-    {
-      return dlangs (norm, A);
-    }
-    template <>
-    void  SuperLu<double>::gscon (char *norm, SuperMatrix *L, SuperMatrix *U, float anorm, float *rcond, SuperLUStat_t *stat, int *info)
-    {
-      dgscon (norm, L, U, anorm, rcond, stat, info);
-    }
-
-    template <>
-    void  SuperLu<double>::gstrs (trans_t trans, SuperMatrix *L, SuperMatrix *U, int *perm_c, int *perm_r, SuperMatrix *B, SuperLUStat_t *stat, int *info)
-    {
-      dgstrs (trans, L, U, perm_c, perm_r, B, stat, info);
-    }
-
-    template <>
-    double SuperLu<double>::lamch_ (char *cmach)
-    {
-      return dlamch_ (cmach);
-    }
-
-    template <>
-    int SuperLu<double>::querySpace (SuperMatrix *a, SuperMatrix *b, mem_usage_t *mu)
-    {
-      return dquerySpace (a, b, mu);
-    }
-#endif
-  }
   namespace Algebra
   {
     /// Binary search for the location of a particular CSC/CSR matrix entry.
@@ -153,7 +98,7 @@ namespace Hermes
       nnz = Ap[this->size];
 
       Ax = new Scalar[nnz];
-      memset(Ax, 0, sizeof(Scalar) * nnz);
+      Hermes::Algebra::first_touch_zero(Ax, sizeof(Scalar) * nnz);
     }
 
     template<typename Scalar>
@@ -180,7 +125,7 @@ namespace Hermes
     template<typename Scalar>
     void SuperLUMatrix<Scalar>::zero()
     {
-      memset(Ax, 0, sizeof(Scalar) * nnz);
+      Hermes::Algebra::first_touch_zero(Ax, sizeof(Scalar) * nnz);
     }
 
     template<typename Scalar>
@@ -332,7 +277,7 @@ namespace Hermes
       {
         for (unsigned int i = Ap[c];i<Ap[c + 1];i++)
         {
-          vector_out[c] +=vector_in[Ai[i]]*Ax[i];
+          vector_out[Ai[i]] +=vector_in[c]*Ax[i];
         }
       }
     }
@@ -419,7 +364,7 @@ namespace Hermes
     template<typename Scalar>
     void SuperLUVector<Scalar>::zero()
     {
-      memset(v, 0, this->size * sizeof(Scalar));
+      Hermes::Algebra::first_touch_zero(v, this->size * sizeof(Scalar));
     }
 
     template<typename Scalar>
@@ -573,13 +518,8 @@ namespace Hermes
 
       // Set the default input options:
 #ifdef SLU_MT
-      // I am not sure if this will work well on Windows:
-      // http://stackoverflow.com/questions/631664/accessing-environment-variables-in-c
-      char *nt_var = getenv("OMP_NUM_THREADS");
-      if(nt_var)
-        options.nprocs          = std::max(1, atoi(nt_var));
-      else
-        options.nprocs          = 1;
+      // Set from numThreadsAlgebra in setup_factorization().
+      options.nprocs            = 1;
 
       options.fact              = EQUILIBRATE;  // Rescale the matrix if neccessary.
       options.trans             = NOTRANS;      // Not solving the transposed problem.
@@ -592,6 +532,12 @@ namespace Hermes
       // Default options related to the supernodal algorithm.
       options.panel_size        = sp_ienv(1);
       options.relax             = sp_ienv(2);
+
+      // The elimination tree, allocated by the driver.
+      options.etree             = NULL;
+      options.colcnt_h          = NULL;
+      options.part_super_h      = NULL;
+      has_AC = false;
 #else
       /*
       options.Fact = DOFACT;
@@ -611,6 +557,14 @@ namespace Hermes
       options.PrintStat = YES;   // Set to NO to suppress output.
 
       has_A = has_B = inited = false;
+
+#ifndef SLU_MT
+      single_inited = false;
+      local_Ax_single = NULL;
+      R_single = C_single = NULL;
+      perm_r_single = perm_c_single = etree_single = NULL;
+      *equed_single = '\0';
+#endif
     }
 
     inline SuperLuType<std::complex<double> >::Scalar to_superlu(SuperLuType<std::complex<double> >::Scalar &a, std::complex<double>b)
@@ -626,12 +580,38 @@ namespace Hermes
       return a;
     }
 
+#ifndef SLU_MT
+    inline void to_superlu_single(SuperLuType<std::complex<double> >::SingleScalar &a, std::complex<double> b)
+    {
+      a.r = (float)b.real();
+      a.i = (float)b.imag();
+    }
+
+    inline void to_superlu_single(SuperLuType<double>::SingleScalar &a, double b)
+    {
+      a = (float)b;
+    }
+
+    inline void from_superlu_single(std::complex<double> &a, SuperLuType<std::complex<double> >::SingleScalar b)
+    {
+      a = std::complex<double>(b.r, b.i);
+    }
+
+    inline void from_superlu_single(double &a, SuperLuType<double>::SingleScalar b)
+    {
+      a = b;
+    }
+#endif
+
     template<typename Scalar>
     SuperLUSolver<Scalar>::~SuperLUSolver()
     {
       free_factorization_data();
       free_matrix();
       free_rhs();
+#ifndef SLU_MT
+      free_single();
+#endif
 
       if(local_Ai)  delete [] local_Ai;
       if(local_Ap)  delete [] local_Ap;
@@ -648,14 +628,25 @@ namespace Hermes
     template<typename Scalar>
     bool SuperLUSolver<Scalar>::solve()
     {
-      assert(m != NULL);
+      Hermes::ProfilerRegion profiler_region("SuperLUSolver::solve");
       assert(rhs != NULL);
 
+      return solve(1, rhs->v);
+    }
+
+    template<typename Scalar>
+    bool SuperLUSolver<Scalar>::solve(int num_rhs, Scalar* rhs_block)
+    {
+      assert(m != NULL);
+
+#ifndef SLU_MT
+      if(this->mixed_precision)
+        return solve_mixed_precision(num_rhs, rhs_block);
+#endif
+
       this->tick();
 
-      // Initialize the statistics variable.
       slu_stat_t stat;
-      SLU_INIT_STAT(&stat);
 
       // Prepare data structures serving as input for the solver driver
       // (according to the chosen factorization reuse strategy).
@@ -663,9 +654,9 @@ namespace Hermes
       // (unused, see below).
       int lwork = 0;            // Space for the factorization will be allocated
       // internally by system malloc.
-      double ferr = 1.0;        // Estimated relative forward error
+      double* ferr = new double[num_rhs];  // Estimated relative forward errors
       // (unused unless iterative refinement is performed).
-      double berr = 1.0;        // Estimated relative backward error
+      double* berr = new double[num_rhs];  // Estimated relative backward errors
       // (unused unless iterative refinement is performed).
       slu_memusage_t memusage;  // Record the memory usage statistics.
       double rpivot_growth;     // The reciprocal pivot growth factor.
@@ -678,9 +669,19 @@ namespace Hermes
       if( !setup_factorization() )
       {
         this->warn("LU factorization could not be completed.");
+        delete [] ferr;
+        delete [] berr;
         return false;
       }
 
+      // Initialize the statistics variable (for the number of threads set by setup_factorization()).
+#ifdef SLU_MT
+      StatAlloc(m->size, options.nprocs, options.panel_size, options.relax, &stat);
+      StatInit(m->size, options.nprocs, &stat);
+#else
+      SLU_INIT_STAT(&stat);
+#endif
+
       // If the previous factorization of A is to be fully reused as an input for the solver driver,
       // keep the (possibly rescaled) matrix from the last factorization, otherwise recreate it
       // from the master SuperLUMatrix<Scalar> pointed to by this->m (this also applies to the case when
@@ -718,20 +719,20 @@ namespace Hermes
       free_rhs();
 
       if(local_rhs) delete [] local_rhs;
-      local_rhs = new typename SuperLuType<Scalar>::Scalar[rhs->size];
-      for (unsigned int i = 0;i<rhs->size;i++)
-        to_superlu(local_rhs[i], rhs->v[i]);
+      local_rhs = new typename SuperLuType<Scalar>::Scalar[m->size * num_rhs];
+      for (unsigned int i = 0;i<m->size * num_rhs;i++)
+        to_superlu(local_rhs[i], rhs_block[i]);
 
-      create_dense_matrix(&B, rhs->size, 1, local_rhs, rhs->size, SLU_DN, SLU_DTYPE, SLU_GE);
+      create_dense_matrix(&B, m->size, num_rhs, local_rhs, m->size, SLU_DN, SLU_DTYPE, SLU_GE);
 
       has_B = true;
 
       // Initialize the solution variable.
       SuperMatrix X;
       typename SuperLuType<Scalar>::Scalar *x;
-      if( !(x = new typename SuperLuType<Scalar>::Scalar[m->size]) )
+      if( !(x = new typename SuperLuType<Scalar>::Scalar[m->size * num_rhs]) )
         throw Hermes::Exceptions::Exception("Malloc fails for x[].");
-      create_dense_matrix(&X, m->size, 1, x, m->size, SLU_DN, SLU_DTYPE, SLU_GE);
+      create_dense_matrix(&X, m->size, num_rhs, x, m->size, SLU_DN, SLU_DTYPE, SLU_GE);
 
       // Solve the system.
       int info;
@@ -753,7 +754,7 @@ namespace Hermes
       // Memory usage will be acquired at the end. If A is singular, info will be set to A->ncol + 1.
       //
       slu_mt_solver_driver( &options, &A, perm_c, perm_r, &AC, &equed, R, C,
-      &L, &U, &B, &X, &rpivot_growth, &rcond, &ferr, &berr,
+      &L, &U, &B, &X, &rpivot_growth, &rcond, ferr, berr,
       &stat, &memusage, &info );
       */
 
@@ -777,7 +778,7 @@ namespace Hermes
       */
 #else
       solver_driver(&options, &A, perm_c, perm_r, etree, equed, R, C, &L, &U,
-        work, lwork, &B, &X, &rpivot_growth, &rcond, &ferr, &berr,
+        work, lwork, &B, &X, &rpivot_growth, &rcond, ferr, berr,
         &memusage, &stat, &info);
 #endif
 
@@ -796,11 +797,11 @@ namespace Hermes
       if(factorized)
       {
         delete [] this->sln;
-        this->sln = new Scalar[m->size];
+        this->sln = new Scalar[m->size * num_rhs];
 
         Scalar *sol = (Scalar*) ((DNformat*) X.Store)->nzval;
 
-        for (unsigned int i = 0; i < rhs->size; i++)
+        for (unsigned int i = 0; i < m->size * num_rhs; i++)
           this->sln[i] = sol[i];
       }
 
@@ -812,6 +813,8 @@ namespace Hermes
       //SUPERLU_FREE (x);
       delete x;
       Destroy_SuperMatrix_Store(&X);
+      delete [] ferr;
+      delete [] berr;
 
       this->tick();
       this->time = this->accumulated();
@@ -822,6 +825,10 @@ namespace Hermes
     template<typename Scalar>
     bool SuperLUSolver<Scalar>::setup_factorization()
     {
+      Hermes::ProfilerRegion profiler_region("SuperLUSolver::setup_factorization");
+#ifdef SLU_MT
+      options.nprocs = std::max(1, Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra));
+#endif
       unsigned int A_size = A.nrow < 0 ? 0 : A.nrow;
       if(has_A && this->factorization_scheme != HERMES_FACTORIZE_FROM_SCRATCH && A_size != m->size)
       {
@@ -836,6 +843,12 @@ namespace Hermes
       else
         eff_fact_scheme = this->factorization_scheme;
 
+      // Keep the column permutation (perm_c, etree) for an unchanged pattern, A is then recreated with the new values.
+      int requested_fact_scheme = eff_fact_scheme;
+      eff_fact_scheme = this->check_structure(eff_fact_scheme, inited && perm_c != NULL, m->size, m->nnz, (int*)m->Ap, m->Ai);
+      if(eff_fact_scheme != requested_fact_scheme)
+        A_changed = true;
+
       // Prepare factorization structures. In case of a particular reuse scheme, comments are given
       // to clarify which arguments will be reused and which will be reset by the dgssvx (zgssvx) routine.
       // It was determined empirically by running the dlinsolx2 example from SuperLU, setting options.Fact
@@ -869,6 +882,7 @@ namespace Hermes
 #ifdef SLU_MT
         options.fact = EQUILIBRATE;
         options.refact = NO;
+        options.usepr = NO;
         options.perm_c = perm_c;
         options.perm_r = perm_r;
 #else
@@ -885,8 +899,10 @@ namespace Hermes
         // needed from previous:      etree, perm_c
         // not needed from previous:  perm_r, R, C, L, U, equed
 #ifdef SLU_MT
+        // The column permutation and the elimination tree (options.etree, AC) are reused.
         options.fact = EQUILIBRATE;
         options.refact = YES;
+        options.usepr = NO;
 #else
         options.Fact = SamePattern;
 #endif
@@ -898,10 +914,11 @@ namespace Hermes
         // needed from previous:      etree, perm_c, perm_r, L, U
         // not needed from previous:  R, C, equed
 #ifdef SLU_MT
-        // MT version of SLU cannot reuse the equilibration factors (R, C), so
-        // this is the same as the previous case.
+        // MT version of SLU cannot reuse the equilibration factors (R, C), these are computed again,
+        // the row permutation from the previous factorization is used (usepr).
         options.fact = EQUILIBRATE;
         options.refact = YES;
+        options.usepr = YES;
 #else
         options.Fact = SamePattern_SameRowPerm;
 #endif
@@ -923,6 +940,140 @@ namespace Hermes
       return true;
     }
 
+#ifndef SLU_MT
+    template<typename Scalar>
+    bool SuperLUSolver<Scalar>::solve_mixed_precision(int num_rhs, Scalar* rhs_block)
+    {
+      this->tick();
+      this->num_refinement_steps = 0;
+
+      int eff_fact_scheme = single_inited ? this->factorization_scheme : HERMES_FACTORIZE_FROM_SCRATCH;
+      eff_fact_scheme = this->check_structure(eff_fact_scheme, single_inited, m->size, m->nnz, (int*)m->Ap, m->Ai);
+
+      if(eff_fact_scheme != HERMES_REUSE_FACTORIZATION_COMPLETELY)
+      {
+        // The column permutation and the elimination tree are kept for the same pattern.
+        bool same_pattern = single_inited && eff_fact_scheme != HERMES_FACTORIZE_FROM_SCRATCH;
+        if(same_pattern)
+          Destroy_SuperMatrix_Store(&A_single);
+        else
+        {
+          free_single();
+          if( !(perm_c_single = intMalloc(m->size)) || !(perm_r_single = intMalloc(m->size)) || !(etree_single = intMalloc(m->size)) )
+            throw Hermes::Exceptions::Exception("Malloc fails for the single precision permutations.");
+          if( !(R_single = (float *) SUPERLU_MALLOC(m->size * sizeof(float))) || !(C_single = (float *) SUPERLU_MALLOC(m->size * sizeof(float))) )
+            throw Hermes::Exceptions::Exception("SUPERLU_MALLOC fails for the single precision scaling factors.");
+        }
+
+        if(local_Ax_single) delete [] local_Ax_single;
+        local_Ax_single = new typename SuperLuType<Scalar>::SingleScalar[m->nnz];
+        for (unsigned int i = 0; i < m->nnz; i++)
+          to_superlu_single(local_Ax_single[i], m->Ax[i]);
+        // The driver only scales the values, the index arrays are not changed.
+        create_single_csc_matrix(&A_single, m->size, m->size, m->nnz, local_Ax_single, (int*)m->Ai, (int*)m->Ap);
+
+        set_default_options(&options_single);
+        options_single.PrintStat = NO;
+        options_single.Fact = same_pattern ? SamePattern : DOFACT;
+
+        // No right hand side: the factorization only.
+        SuperMatrix B, X;
+        create_single_dense_matrix(&B, m->size, 0, local_Ax_single, m->size);
+        create_single_dense_matrix(&X, m->size, 0, local_Ax_single, m->size);
+        slu_stat_t stat;
+        SLU_INIT_STAT(&stat);
+        slu_memusage_t memusage;
+        int info;
+        single_solver_driver(&options_single, &A_single, perm_c_single, perm_r_single, etree_single, equed_single, R_single, C_single,
+          &L_single, &U_single, &B, &X, &memusage, &stat, &info);
+        StatFree(&stat);
+        Destroy_SuperMatrix_Store(&B);
+        Destroy_SuperMatrix_Store(&X);
+        single_inited = true;
+
+        // info == size + 1 only reports that the matrix is ill conditioned in single precision, the refinement handles that.
+        if(info > 0 && info <= (int)m->size)
+          throw Hermes::Exceptions::LinearMatrixSolverException("The matrix is singular in single precision.");
+        else if(info > (int)m->size + 1)
+          throw Hermes::Exceptions::LinearMatrixSolverException("Memory allocation failed in the single precision factorization.");
+      }
+
+      delete [] this->sln;
+      this->sln = new Scalar[m->size * num_rhs];
+      bool converged = true;
+      for (int rhs_i = 0; rhs_i < num_rhs; rhs_i++)
+      {
+        Scalar* b = rhs_block + rhs_i * m->size;
+        Scalar* x = this->sln + rhs_i * m->size;
+        if(!solve_low_precision(b, x))
+          throw Hermes::Exceptions::LinearMatrixSolverException("The single precision solve failed.");
+        if(!this->refine(m, b, x))
+          converged = false;
+      }
+      if(!converged)
+        this->warn("The iterative refinement did not reach the tolerance %g in %d steps.", this->refinement_tolerance, this->max_refinement_steps);
+
+      this->tick();
+      this->time = this->accumulated();
+
+      return true;
+    }
+
+    template<typename Scalar>
+    bool SuperLUSolver<Scalar>::solve_low_precision(Scalar* b, Scalar* x)
+    {
+      typename SuperLuType<Scalar>::SingleScalar* b_single = new typename SuperLuType<Scalar>::SingleScalar[m->size];
+      typename SuperLuType<Scalar>::SingleScalar* x_single = new typename SuperLuType<Scalar>::SingleScalar[m->size];
+      for (unsigned int i = 0; i < m->size; i++)
+        to_superlu_single(b_single[i], b[i]);
+
+      SuperMatrix B, X;
+      create_single_dense_matrix(&B, m->size, 1, b_single, m->size);
+      create_single_dense_matrix(&X, m->size, 1, x_single, m->size);
+      options_single.Fact = FACTORED;
+      slu_stat_t stat;
+      SLU_INIT_STAT(&stat);
+      slu_memusage_t memusage;
+      int info;
+      single_solver_driver(&options_single, &A_single, perm_c_single, perm_r_single, etree_single, equed_single, R_single, C_single,
+        &L_single, &U_single, &B, &X, &memusage, &stat, &info);
+      StatFree(&stat);
+
+      bool ret = (info == 0 || info == (int)m->size + 1);
+      if(ret)
+        for (unsigned int i = 0; i < m->size; i++)
+          from_superlu_single(x[i], x_single[i]);
+
+      Destroy_SuperMatrix_Store(&B);
+      Destroy_SuperMatrix_Store(&X);
+      delete [] b_single;
+      delete [] x_single;
+      return ret;
+    }
+
+    template<typename Scalar>
+    void SuperLUSolver<Scalar>::free_single()
+    {
+      if(single_inited)
+      {
+        SUPERLU_FREE (etree_single);
+        SUPERLU_FREE (perm_c_single);
+        SUPERLU_FREE (perm_r_single);
+        SUPERLU_FREE (R_single);
+        SUPERLU_FREE (C_single);
+        SLU_DESTROY_L(&L_single);
+        SLU_DESTROY_U(&U_single);
+        Destroy_SuperMatrix_Store(&A_single);
+        single_inited = false;
+      }
+      if(local_Ax_single)
+      {
+        delete [] local_Ax_single;
+        local_Ax_single = NULL;
+      }
+    }
+#endif
+
     template<typename Scalar>
     void SuperLUSolver<Scalar>::free_matrix()
     {
@@ -952,7 +1103,10 @@ namespace Hermes
         SUPERLU_FREE(options.etree);
         SUPERLU_FREE(options.colcnt_h);
         SUPERLU_FREE(options.part_super_h);
-        Destroy_CompCol_Permuted(&AC);
+        options.etree = options.colcnt_h = options.part_super_h = NULL;
+        if(has_AC)
+          Destroy_CompCol_Permuted(&AC);
+        has_AC = false;
 #else
         SUPERLU_FREE (etree);
 #endif
@@ -967,16 +1121,29 @@ namespace Hermes
     }
 
 #ifdef SLU_MT
+    extern "C" double dlamch_(char *cmach);
+
+    inline void slu_scale(double &a, double r)
+    {
+      a *= r;
+    }
+
+    inline void slu_scale(SuperLuType<std::complex<double> >::Scalar &a, double r)
+    {
+      a.r *= r;
+      a.i *= r;
+    }
+
     // This is a modification of the original p*gssvx routines from the SuperLU_MT library.
     //
     // The original routines have been changed in view of our applications, i.e.
-    //  * only one right hand side is allowed,
     //  * some initial parameter checks have been omitted,
-    //  * macros allowing abstraction from the fundamental Scalar datatype have been used
+    //  * the Scalar dependent steps are the members gsequ(), gstrf(), ... specialized for real and complex numbers,
     //  * some phases of the calculation may be omitted for speed-up (less information about
     //    the matrix/solution can then be acquired, however),
     //  * deallocation at the end of the routine has been removed (this was neccessary to
-    //    enable factorization reuse).
+    //    enable factorization reuse): the elimination tree (options->etree, colcnt_h, part_super_h)
+    //    and the permuted matrix AC are kept for the refactorizations (options->refact == YES).
     //
     // See the correspondingly named attributes of SuperLUSolver class for brief description
     // of most parameters or the library source code for pdgssvx for more details. You may pass
@@ -992,7 +1159,8 @@ namespace Hermes
     //                          estimates of the computed solution;
     //  * memusage            - memory usage during the factorization/solution will not be queried.
     //
-    void slu_mt_solver_driver(slu_options_t *options, SuperMatrix *A,
+    template<typename Scalar>
+    void SuperLUSolver<Scalar>::slu_mt_solver_driver(slu_options_t *options, SuperMatrix *A,
       int *perm_c, int *perm_r, SuperMatrix *AC,
       equed_t *equed, double *R, double *C,
       SuperMatrix *L, SuperMatrix *U,
@@ -1012,11 +1180,12 @@ namespace Hermes
       int notran = (options->trans == NOTRANS);
       int colequ, rowequ;
 
-      /* Right hand side and solution vectors. */
+      /* Right hand sides and solutions, stored column by column. */
       DNformat *Bstore = (DNformat*) B->Store;
       DNformat *Xstore = (DNformat*) X->Store;
-      Scalar *Bmat = (Scalar*) Bstore->nzval;
-      Scalar *Xmat = (Scalar*) Xstore->nzval;
+      typename SuperLuType<Scalar>::Scalar *Bmat = (typename SuperLuType<Scalar>::Scalar*) Bstore->nzval;
+      typename SuperLuType<Scalar>::Scalar *Xmat = (typename SuperLuType<Scalar>::Scalar*) Xstore->nzval;
+      int num_entries = B->nrow * B->ncol;
 
       *info = 0;
 
@@ -1040,12 +1209,12 @@ namespace Hermes
         /* Compute row and column scalings to equilibrate the matrix A. */
         int info1;
         double rowcnd, colcnd, amax;
-        SLU_GSEQU(A, R, C, &rowcnd, &colcnd, &amax, &info1);
+        gsequ(A, R, C, &rowcnd, &colcnd, &amax, &info1);
 
         if( info1 == 0 )
         {
           /* Equilibrate matrix A. */
-          SLU_LAQGS(A, R, C, rowcnd, colcnd, amax, equed);
+          laqgs(A, R, C, rowcnd, colcnd, amax, equed);
           rowequ = (*equed == ROW) || (*equed == BOTH);
           colequ = (*equed == COL) || (*equed == BOTH);
         }
@@ -1053,18 +1222,18 @@ namespace Hermes
       }
 
       /* ------------------------------------------------------------
-      Scale the right hand side.
+      Scale the right hand sides.
       ------------------------------------------------------------*/
       if( notran )
       {
         if( rowequ )
-          for (int i = 0; i < A->nrow; ++i)
-            SLU_MULT(Bmat[i], R[i]);
+          for (int i = 0; i < num_entries; ++i)
+            slu_scale(Bmat[i], R[i % B->nrow]);
       }
       else if( colequ )
       {
-        for (int i = 0; i < A->nrow; ++i)
-          SLU_MULT(Bmat[i], C[i]);
+        for (int i = 0; i < num_entries; ++i)
+          slu_scale(Bmat[i], C[i % B->nrow]);
       }
 
       /* ------------------------------------------------------------
@@ -1077,13 +1246,23 @@ namespace Hermes
         if(options->refact == NO)
         {
           t0 = SuperLU_timer_();
-          SLU_SP_COLORDER(A, perm_c, options, AC);
+          sp_colorder(A, perm_c, options, AC);
+          has_AC = true;
           stat->utime[ETREE] = SuperLU_timer_() - t0;
         }
+        else
+        {
+          /* The same pattern, the permuted column pointers of AC are kept, the entries are those of the current A
+          (which may have been recreated since the last factorization). */
+          NCformat *Astore = (NCformat*) A->Store;
+          NCPformat *ACstore = (NCPformat*) AC->Store;
+          ACstore->nzval = Astore->nzval;
+          ACstore->rowind = Astore->rowind;
+        }
 
         /* Compute the LU factorization of A*Pc. */
         t0 = SuperLU_timer_();
-        SLU_GSTRF(options, AC, perm_r, L, U, stat, info);
+        gstrf(options, AC, perm_r, L, U, stat, info);
         stat->utime[FACT] = SuperLU_timer_() - t0;
 
         flopcnt = 0;
@@ -1105,7 +1284,7 @@ namespace Hermes
           /* Compute the reciprocal pivot growth factor of the leading
           rank-deficient *info columns of A. */
           if(recip_pivot_growth)
-            *recip_pivot_growth = SLU_PIVOT_GROWTH(*info, A, perm_c, L, U);
+            *recip_pivot_growth = pivot_growth(*info, A, perm_c, L, U);
         }
       }
       else
@@ -1114,7 +1293,7 @@ namespace Hermes
         Compute the reciprocal pivot growth factor *recip_pivot_growth.
         ------------------------------------------------------------*/
         if(recip_pivot_growth)
-          *recip_pivot_growth = SLU_PIVOT_GROWTH(A->ncol, A, perm_c, L, U);
+          *recip_pivot_growth = pivot_growth(A->ncol, A, perm_c, L, U);
 
         /* ------------------------------------------------------------
         Estimate the reciprocal of the condition number of A.
@@ -1128,8 +1307,8 @@ namespace Hermes
           char norm[1];
           *(unsigned char *)norm = (notran) ? '1' : 'I';
 
-          double anorm = SLU_LANGS(norm, A);
-          SLU_GSCON(norm, L, U, anorm, rcond, info);
+          double anorm = langs(norm, A);
+          gscon(norm, L, U, anorm, rcond, info);
           stat->utime[RCOND] = SuperLU_timer_() - t0;
         }
 
@@ -1137,10 +1316,10 @@ namespace Hermes
         Compute the solution matrix X.
         ------------------------------------------------------------*/
         // Save a copy of the right hand side.
-        memcpy(Xmat, Bmat, B->nrow * sizeof(Scalar));
+        memcpy(Xmat, Bmat, num_entries * sizeof(typename SuperLuType<Scalar>::Scalar));
 
         t0 = SuperLU_timer_();
-        SLU_GSTRS(options->trans, L, U, perm_r, perm_c, X, stat, info);
+        gstrs(options->trans, L, U, perm_r, perm_c, X, stat, info);
         stat->utime[SOLVE] = SuperLU_timer_() - t0;
         stat->ops[SOLVE] = stat->ops[TRISOLVE];
 
@@ -1151,7 +1330,7 @@ namespace Hermes
         if(ferr && berr)
         {
           t0 = SuperLU_timer_();
-          SLU_GSRFS(options->trans, A, L, U, perm_r, perm_c, *equed,
+          gsrfs(options->trans, A, L, U, perm_r, perm_c, *equed,
             R, C, B, X, ferr, berr, stat, info);
           stat->utime[REFINE] = SuperLU_timer_() - t0;
         }
@@ -1163,23 +1342,23 @@ namespace Hermes
         if( notran )
         {
           if( colequ )
-            for (int i = 0; i < A->nrow; ++i)
-              SLU_MULT(Xmat[i], C[i]);
+            for (int i = 0; i < num_entries; ++i)
+              slu_scale(Xmat[i], C[i % B->nrow]);
         }
         else if( rowequ )
         {
-          for (int i = 0; i < A->nrow; ++i)
-            SLU_MULT(Xmat[i], R[i]);
+          for (int i = 0; i < num_entries; ++i)
+            slu_scale(Xmat[i], R[i % B->nrow]);
         }
 
         /* Set INFO = A->ncol + 1 if the matrix is singular to
         working precision.*/
         char param[1]; param[0] = 'E';
-        if( rcond && *rcond < SLU_LAMCH_(param) ) *info = A->ncol + 1;
+        if( rcond && *rcond < dlamch_(param) ) *info = A->ncol + 1;
       }
 
       if(memusage)
-        SLU_QUERY_SPACE(options->nprocs, L, U, options->panel_size, memusage);
+        query_space(options->nprocs, L, U, options->panel_size, memusage);
     }
 #endif
 
@@ -23,7 +23,12 @@
 #ifdef WITH_SUPERLU
 #include "superlu_solver.h"
 #include "callstack.h"
+#ifdef SLU_MT
+#include <slu_mt_zdefs.h>
+#else
 #include <slu_zdefs.h>
+#include <slu_cdefs.h>
+#endif
 
 namespace Hermes
 {
@@ -44,6 +49,87 @@ namespace Hermes
       zCreate_Dense_Matrix (X, m, n, (doublecomplex *) x, ldx, stype, dtype, mtype);
     }
 
+#ifdef SLU_MT
+    template <>
+    void SuperLUSolver<std::complex<double> >::gsequ (SuperMatrix *A, double *r, double *c, double *rowcnd, double *colcnd, double *amax, int *info)
+    {
+      zgsequ (A, r, c, rowcnd, colcnd, amax, info);
+    }
+
+    template <>
+    void SuperLUSolver<std::complex<double> >::laqgs (SuperMatrix *A, double *r, double *c, double rowcnd, double colcnd, double amax, equed_t *equed)
+    {
+      zlaqgs (A, r, c, rowcnd, colcnd, amax, equed);
+    }
+
+    template <>
+    void SuperLUSolver<std::complex<double> >::gstrf (slu_options_t *options, SuperMatrix *AC, int *perm_r, SuperMatrix *L, SuperMatrix *U, slu_stat_t *stat, int *info)
+    {
+      pzgstrf (options, AC, perm_r, L, U, stat, info);
+    }
+
+    template <>
+    double SuperLUSolver<std::complex<double> >::pivot_growth (int ncols, SuperMatrix *A, int *perm_c, SuperMatrix *L, SuperMatrix *U)
+    {
+      return zPivotGrowth (ncols, A, perm_c, L, U);
+    }
+
+    template <>
+    double SuperLUSolver<std::complex<double> >::langs (char *norm, SuperMatrix *A)
+    {
+      return zlangs (norm, A);
+    }
+
+    template <>
+    void SuperLUSolver<std::complex<double> >::gscon (char *norm, SuperMatrix *L, SuperMatrix *U, double anorm, double *rcond, int *info)
+    {
+      zgscon (norm, L, U, anorm, rcond, info);
+    }
+
+    template <>
+    void SuperLUSolver<std::complex<double> >::gstrs (trans_t trans, SuperMatrix *L, SuperMatrix *U, int *perm_r, int *perm_c, SuperMatrix *B, slu_stat_t *stat, int *info)
+    {
+      zgstrs (trans, L, U, perm_r, perm_c, B, stat, info);
+    }
+
+    template <>
+    void SuperLUSolver<std::complex<double> >::gsrfs (trans_t trans, SuperMatrix *A, SuperMatrix *L, SuperMatrix *U, int *perm_r, int *perm_c, equed_t equed,
+      double *R, double *C, SuperMatrix *B, SuperMatrix *X, double *ferr, double *berr, slu_stat_t *stat, int *info)
+    {
+      zgsrfs (trans, A, L, U, perm_r, perm_c, equed, R, C, B, X, ferr, berr, stat, info);
+    }
+
+    template <>
+    void SuperLUSolver<std::complex<double> >::query_space (int nprocs, SuperMatrix *L, SuperMatrix *U, int panel_size, slu_memusage_t *memusage)
+    {
+      superlu_zQuerySpace (nprocs, L, U, panel_size, memusage);
+    }
+#else
+    template <>
+    void SuperLUSolver<std::complex<double> >::create_single_csc_matrix (SuperMatrix *A, int m, int n, int nnz,
+      SuperLuType<std::complex<double> >::SingleScalar *nzval, int *rowind, int *colptr)
+    {
+      cCreate_CompCol_Matrix (A, m, n, nnz, (complex*) nzval, rowind, colptr, SLU_NC, SLU_C, SLU_GE);
+    }
+
+    template<>
+    void SuperLUSolver<std::complex<double> >::create_single_dense_matrix (SuperMatrix *X, int m, int n, SuperLuType<std::complex<double> >::SingleScalar *x, int ldx)
+    {
+      cCreate_Dense_Matrix (X, m, n, (complex*) x, ldx, SLU_DN, SLU_C, SLU_GE);
+    }
+
+    template <>
+    void SuperLUSolver<std::complex<double> >::single_solver_driver (superlu_options_t *options, SuperMatrix *A, int *perm_c, int *perm_r, int *etree, char *equed, float *R,
+      float *C, SuperMatrix *L, SuperMatrix *U, SuperMatrix *B, SuperMatrix *X, slu_memusage_t *mem_usage, SuperLUStat_t *stat, int *info)
+    {
+      float rpivot_growth, rcond;
+      float* ferr = new float[std::max(B->ncol, 1)];
+      float* berr = new float[std::max(B->ncol, 1)];
+      cgssvx(options, A, perm_c, perm_r, etree, equed, R, C, L, U, NULL, 0, B, X, &rpivot_growth, &rcond, ferr, berr, (mem_usage_t*) mem_usage, stat, info);
+      delete [] ferr;
+      delete [] berr;
+    }
+
     template <>
     void  SuperLUSolver<std::complex<double> >::solver_driver (superlu_options_t *options, SuperMatrix *A, int *perm_c, int *perm_r, int *etree, char *equed, double *R,
       double *C, SuperMatrix *L, SuperMatrix *U, void *work, int lwork, SuperMatrix *B, SuperMatrix *X,
@@ -52,6 +138,7 @@ namespace Hermes
     {
       zgssvx(options, A, perm_c, perm_r, etree, equed, R, C, L, U, work, lwork, B, X, recip_pivot_growth, rcond, ferr, berr, (mem_usage_t*) mem_usage, stat, info);
     }
+#endif
   }
 }
 #endif
\ No newline at end of file
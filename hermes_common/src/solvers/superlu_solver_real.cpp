@@ -23,12 +23,87 @@
 #ifdef WITH_SUPERLU
 #include "superlu_solver.h"
 #include "callstack.h"
+#ifdef SLU_MT
+#include <slu_mt_ddefs.h>
+#else
 #include <slu_ddefs.h>
+#include <slu_sdefs.h>
+#endif
 
 namespace Hermes
 {
   namespace Solvers
   {
+    template <>
+    void SuperLUSolver<double>::create_csc_matrix (SuperMatrix *A, int m, int n, int nnz, SuperLuType<double>::Scalar *nzval,
+      int *rowind, int *colptr, Stype_t stype, Dtype_t dtype, Mtype_t mtype)
+    {
+      dCreate_CompCol_Matrix (A, m, n, nnz, nzval, rowind, colptr, stype, dtype, mtype);
+    }
+
+    template<>
+    void SuperLUSolver<double>::create_dense_matrix (SuperMatrix *X, int m, int n, SuperLuType<double>::Scalar *x,
+      int ldx, Stype_t stype, Dtype_t dtype, Mtype_t mtype)
+    {
+      dCreate_Dense_Matrix (X, m, n, (double*) x, ldx, stype, dtype, mtype);
+    }
+
+#ifdef SLU_MT
+    template <>
+    void SuperLUSolver<double>::gsequ (SuperMatrix *A, double *r, double *c, double *rowcnd, double *colcnd, double *amax, int *info)
+    {
+      dgsequ (A, r, c, rowcnd, colcnd, amax, info);
+    }
+
+    template <>
+    void SuperLUSolver<double>::laqgs (SuperMatrix *A, double *r, double *c, double rowcnd, double colcnd, double amax, equed_t *equed)
+    {
+      dlaqgs (A, r, c, rowcnd, colcnd, amax, equed);
+    }
+
+    template <>
+    void SuperLUSolver<double>::gstrf (slu_options_t *options, SuperMatrix *AC, int *perm_r, SuperMatrix *L, SuperMatrix *U, slu_stat_t *stat, int *info)
+    {
+      pdgstrf (options, AC, perm_r, L, U, stat, info);
+    }
+
+    template <>
+    double SuperLUSolver<double>::pivot_growth (int ncols, SuperMatrix *A, int *perm_c, SuperMatrix *L, SuperMatrix *U)
+    {
+      return dPivotGrowth (ncols, A, perm_c, L, U);
+    }
+
+    template <>
+    double SuperLUSolver<double>::langs (char *norm, SuperMatrix *A)
+    {
+      return dlangs (norm, A);
+    }
+
+    template <>
+    void SuperLUSolver<double>::gscon (char *norm, SuperMatrix *L, SuperMatrix *U, double anorm, double *rcond, int *info)
+    {
+      dgscon (norm, L, U, anorm, rcond, info);
+    }
+
+    template <>
+    void SuperLUSolver<double>::gstrs (trans_t trans, SuperMatrix *L, SuperMatrix *U, int *perm_r, int *perm_c, SuperMatrix *B, slu_stat_t *stat, int *info)
+    {
+      dgstrs (trans, L, U, perm_r, perm_c, B, stat, info);
+    }
+
+    template <>
+    void SuperLUSolver<double>::gsrfs (trans_t trans, SuperMatrix *A, SuperMatrix *L, SuperMatrix *U, int *perm_r, int *perm_c, equed_t equed,
+      double *R, double *C, SuperMatrix *B, SuperMatrix *X, double *ferr, double *berr, slu_stat_t *stat, int *info)
+    {
+      dgsrfs (trans, A, L, U, perm_r, perm_c, equed, R, C, B, X, ferr, berr, stat, info);
+    }
+
+    template <>
+    void SuperLUSolver<double>::query_space (int nprocs, SuperMatrix *L, SuperMatrix *U, int panel_size, slu_memusage_t *memusage)
+    {
+      superlu_dQuerySpace (nprocs, L, U, panel_size, memusage);
+    }
+#else
     template <>
     void  SuperLUSolver<double>::solver_driver (superlu_options_t *options, SuperMatrix *A, int *perm_c, int *perm_r, int *etree, char *equed, double *R,
       double *C, SuperMatrix *L, SuperMatrix *U, void *work, int lwork, SuperMatrix *B, SuperMatrix *X,
@@ -39,18 +114,30 @@ namespace Hermes
     }
 
     template <>
-    void SuperLUSolver<double>::create_csc_matrix (SuperMatrix *A, int m, int n, int nnz, SuperLuType<double>::Scalar *nzval,
-      int *rowind, int *colptr, Stype_t stype, Dtype_t dtype, Mtype_t mtype)
+    void SuperLUSolver<double>::create_single_csc_matrix (SuperMatrix *A, int m, int n, int nnz, SuperLuType<double>::SingleScalar *nzval,
+      int *rowind, int *colptr)
     {
-      dCreate_CompCol_Matrix (A, m, n, nnz, nzval, rowind, colptr, stype, dtype, mtype);
+      sCreate_CompCol_Matrix (A, m, n, nnz, nzval, rowind, colptr, SLU_NC, SLU_S, SLU_GE);
     }
 
     template<>
-    void SuperLUSolver<double>::create_dense_matrix (SuperMatrix *X, int m, int n, SuperLuType<double>::Scalar *x,
-      int ldx, Stype_t stype, Dtype_t dtype, Mtype_t mtype)
+    void SuperLUSolver<double>::create_single_dense_matrix (SuperMatrix *X, int m, int n, SuperLuType<double>::SingleScalar *x, int ldx)
     {
-      dCreate_Dense_Matrix (X, m, n, (double*) x, ldx, stype, dtype, mtype);
+      sCreate_Dense_Matrix (X, m, n, x, ldx, SLU_DN, SLU_S, SLU_GE);
+    }
+
+    template <>
+    void SuperLUSolver<double>::single_solver_driver (superlu_options_t *options, SuperMatrix *A, int *perm_c, int *perm_r, int *etree, char *equed, float *R,
+      float *C, SuperMatrix *L, SuperMatrix *U, SuperMatrix *B, SuperMatrix *X, slu_memusage_t *mem_usage, SuperLUStat_t *stat, int *info)
+    {
+      float rpivot_growth, rcond;
+      float* ferr = new float[std::max(B->ncol, 1)];
+      float* berr = new float[std::max(B->ncol, 1)];
+      sgssvx(options, A, perm_c, perm_r, etree, equed, R, C, L, U, NULL, 0, B, X, &rpivot_growth, &rcond, ferr, berr, (mem_usage_t*) mem_usage, stat, info);
+      delete [] ferr;
+      delete [] berr;
     }
+#endif
   }
 }
 #endif
\ No newline at end of file
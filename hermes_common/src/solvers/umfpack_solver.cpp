@@ -22,6 +22,8 @@
 #include "config.h"
 #ifdef WITH_UMFPACK
 #include "umfpack_solver.h"
+#include "profiler.h"
+#include "api.h"
 
 extern "C"
 {
@@ -32,6 +34,9 @@ namespace Hermes
 {
   namespace Algebra
   {
+    /// Vectors and matrices of fewer (nonzero) entries are not worth running the loops in parallel.
+    static const int PARALLEL_KERNEL_MIN_SIZE = 20000;
+
     static int find_position(int *Ai, int Alen, int idx)
     {
       assert(Ai != NULL);
@@ -66,11 +71,22 @@ namespace Hermes
       Ap = NULL;
       Ai = NULL;
       Ax = NULL;
+      pattern = NULL;
+      Rp = NULL;
+      Rj = NULL;
+      Rk = NULL;
     }
 
     template<typename Scalar>
     CSCMatrix<Scalar>::CSCMatrix(unsigned int size)
     {
+      Ap = NULL;
+      Ai = NULL;
+      Ax = NULL;
+      pattern = NULL;
+      Rp = NULL;
+      Rj = NULL;
+      Rk = NULL;
       this->size = size;
       this->alloc();
     }
@@ -82,29 +98,82 @@ namespace Hermes
     }
 
     template<typename Scalar>
-    void CSCMatrix<Scalar>::multiply_with_vector(Scalar* vector_in, Scalar* vector_out)
+    void CSCMatrix<Scalar>::build_row_index()
     {
       int n = this->size;
-      for (int j = 0; j<n; j++) vector_out[j] = 0;
-      for (int j = 0; j<n; j++)
-      {
+      Rp = new int[n + 1];
+      memset(Rp, 0, (n + 1) * sizeof(int));
+      for (unsigned int i = 0; i < nnz; i++)
+        Rp[Ai[i] + 1]++;
+      for (int i = 0; i < n; i++)
+        Rp[i + 1] += Rp[i];
+
+      Rj = new int[std::max((int)nnz, 1)];
+      Rk = new int[std::max((int)nnz, 1)];
+      int* position = new int[std::max(n, 1)];
+      memcpy(position, Rp, n * sizeof(int));
+      // The columns are visited in the increasing order, so are they stored in each row.
+      for (int j = 0; j < n; j++)
         for (int i = Ap[j]; i < Ap[j + 1]; i++)
         {
-          vector_out[Ai[i]] += vector_in[j]*Ax[i];
+          Rj[position[Ai[i]]] = j;
+          Rk[position[Ai[i]]++] = i;
         }
+      delete [] position;
+    }
+
+    template<typename Scalar>
+    void CSCMatrix<Scalar>::free_row_index()
+    {
+      if(Rp != NULL)
+      {
+        delete [] Rp;
+        delete [] Rj;
+        delete [] Rk;
+        Rp = NULL;
+        Rj = NULL;
+        Rk = NULL;
+      }
+    }
+
+    template<typename Scalar>
+    void CSCMatrix<Scalar>::multiply_with_vector(Scalar* vector_in, Scalar* vector_out)
+    {
+#pragma omp critical (CSCMatrix_row_index)
+      if(Rp == NULL)
+        build_row_index();
+
+      int n = this->size;
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if((int)nnz > PARALLEL_KERNEL_MIN_SIZE)
+      for (int j = 0; j < n; j++)
+      {
+        Scalar result = 0;
+        for (int i = Rp[j]; i < Rp[j + 1]; i++)
+          result += Ax[Rk[i]] * vector_in[Rj[i]];
+        // The lower triangle of the symmetric storage, i.e. the column j without the diagonal.
+        if(this->symmetric_storage)
+          for (int i = Ap[j]; i < Ap[j + 1]; i++)
+            if(Ai[i] != j)
+              result += Ax[i] * vector_in[Ai[i]];
+        vector_out[j] = result;
       }
     }
 
     template<typename Scalar>
     void CSCMatrix<Scalar>::multiply_with_Scalar(Scalar value)
     {
-      for (unsigned int i = 0; i < this->nnz; i++) Ax[i] *= value;
+      int n = this->nnz;
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PARALLEL_KERNEL_MIN_SIZE)
+      for (int i = 0; i < n; i++) Ax[i] *= value;
     }
 
     template<typename Scalar>
     void CSCMatrix<Scalar>::alloc()
     {
       assert(this->pages != NULL);
+      free_row_index();
 
       // initialize the arrays Ap and Ai
       Ap = new int[this->size + 1];
@@ -127,13 +196,62 @@ namespace Hermes
       nnz = Ap[this->size];
 
       Ax = new Scalar[nnz];
-      memset(Ax, 0, sizeof(Scalar) * nnz);
+      Hermes::Algebra::first_touch_zero(Ax, sizeof(Scalar) * nnz);
+    }
+
+    template<typename Scalar>
+    void CSCMatrix<Scalar>::alloc_with_structure(unsigned int n, const int* col_start, const int* rows)
+    {
+      free();
+      this->size = n;
+
+      // The structure is stored as it is, without the pages.
+      Ap = new int[this->size + 1];
+      memcpy(Ap, col_start, sizeof(int) * (this->size + 1));
+      nnz = Ap[this->size];
+      Ai = new int[nnz];
+      Hermes::Algebra::first_touch_copy(Ai, rows, sizeof(int) * nnz);
+
+      Ax = new Scalar[nnz];
+      Hermes::Algebra::first_touch_zero(Ax, sizeof(Scalar) * nnz);
+    }
+
+    template<typename Scalar>
+    void CSCMatrix<Scalar>::alloc_with_pattern(SparsityPattern* pattern)
+    {
+      if(pattern->is_symmetric() != this->symmetric_storage)
+        throw Hermes::Exceptions::Exception("The symmetric storage of the matrix does not match the sparsity pattern.");
+      free();
+      this->size = pattern->get_size();
+
+      pattern->add_reference();
+      this->pattern = pattern;
+      Ap = const_cast<int*>(pattern->get_col_start());
+      Ai = const_cast<int*>(pattern->get_rows());
+      nnz = pattern->get_nnz();
+
+      Ax = new Scalar[nnz];
+      Hermes::Algebra::first_touch_zero(Ax, sizeof(Scalar) * nnz);
+    }
+
+    template<typename Scalar>
+    void CSCMatrix<Scalar>::release_pattern()
+    {
+      if(pattern != NULL)
+      {
+        pattern->release();
+        pattern = NULL;
+        Ap = NULL;
+        Ai = NULL;
+      }
     }
 
     template<typename Scalar>
     void CSCMatrix<Scalar>::free()
     {
       nnz = 0;
+      free_row_index();
+      release_pattern();
       if(Ap != NULL)
       {
         delete [] Ap;
@@ -154,6 +272,9 @@ namespace Hermes
     template<typename Scalar>
     Scalar CSCMatrix<Scalar>::get(unsigned int m, unsigned int n)
     {
+      if(this->symmetric_storage && m > n)
+        std::swap(m, n);
+
       // Find m-th row in the n-th column.
       int mid = find_position(Ai + Ap[n], Ap[n + 1] - Ap[n], m);
 
@@ -166,13 +287,14 @@ namespace Hermes
     template<typename Scalar>
     void CSCMatrix<Scalar>::zero()
     {
-      memset(Ax, 0, sizeof(Scalar) * nnz);
+      Hermes::Algebra::first_touch_zero(Ax, sizeof(Scalar) * nnz);
     }
 
     template<>
     void CSCMatrix<double>::add(unsigned int m, unsigned int n, double v)
     {
-      if(v != 0.0)   // ignore zero values.
+      // The lower triangle of the symmetric storage is ignored.
+      if(v != 0.0 && (!this->symmetric_storage || m <= n))   // ignore zero values.
       {
         // Find m-th row in the n-th column.
         int pos = find_position(Ai + Ap[n], Ap[n + 1] - Ap[n], m);
@@ -191,7 +313,8 @@ namespace Hermes
     template<>
     void CSCMatrix<std::complex<double> >::add(unsigned int m, unsigned int n, std::complex<double> v)
     {
-      if(v != 0.0)   // ignore zero values.
+      // The lower triangle of the symmetric storage is ignored.
+      if(v != 0.0 && (!this->symmetric_storage || m <= n))   // ignore zero values.
       {
         // Find m-th row in the n-th column.
         int pos = find_position(Ai + Ap[n], Ap[n + 1] - Ap[n], m);
@@ -207,6 +330,62 @@ namespace Hermes
       }
     }
 
+    template<typename Scalar>
+    int CSCMatrix<Scalar>::get_position(unsigned int m, unsigned int n)
+    {
+      // The lower triangle of the symmetric storage is ignored.
+      if(this->symmetric_storage && m > n)
+        return -1;
+      int pos = find_position(Ai + Ap[n], Ap[n + 1] - Ap[n], m);
+      if(pos < 0)
+        throw Hermes::Exceptions::Exception("Sparse matrix entry not found: [%i, %i]", m, n);
+      return Ap[n] + pos;
+    }
+
+    template<>
+    void CSCMatrix<double>::add_to_position(int position, double v)
+    {
+      if(v != 0.0)
+      {
+#pragma omp atomic
+        Ax[position] += v;
+      }
+    }
+
+    template<>
+    void CSCMatrix<std::complex<double> >::add_to_position(int position, std::complex<double> v)
+    {
+      if(v != 0.0)
+      {
+#pragma omp critical
+        Ax[position] += v;
+      }
+    }
+
+    template<typename Scalar>
+    void CSCMatrix<Scalar>::add_dense_block(unsigned int row, unsigned int col, unsigned int m, unsigned int n, Scalar** mat, unsigned int mat_col)
+    {
+      // The lower triangle of the block would have to be filtered out entry by entry.
+      if(this->symmetric_storage)
+      {
+        SparseMatrix<Scalar>::add_dense_block(row, col, m, n, mat, mat_col);
+        return;
+      }
+
+      for (unsigned int j = 0; j < n; j++)
+      {
+        // The rows are sorted in the column, so the contiguous rows of the block are there one after another.
+        int* column = Ai + Ap[col + j];
+        int length = Ap[col + j + 1] - Ap[col + j];
+        int pos = find_position(column, length, row);
+        if(pos < 0 || pos + (int)m > length || column[pos + m - 1] != (int)(row + m - 1))
+          throw Hermes::Exceptions::Exception("Sparse matrix entries not found: rows %i - %i of the column %i", row, row + m - 1, col + j);
+        pos += Ap[col + j];
+        for (unsigned int i = 0; i < m; i++)
+          CSCMatrix<Scalar>::add_to_position(pos + i, mat[i][mat_col + j]);
+      }
+    }
+
     template<typename Scalar>
     void CSCMatrix<Scalar>::add_to_diagonal_blocks(int num_stages, CSCMatrix<Scalar>* mat_block)
     {
@@ -226,6 +405,49 @@ namespace Hermes
       add_to_diagonal_blocks(num_stages, static_cast<CSCMatrix<Scalar>*>(mat));
     }
 
+    template<typename Scalar>
+    void CSCMatrix<Scalar>::add_sparse_to_blocks(int num_stages, SparseMatrix<Scalar>* mat, Scalar** coefficients)
+    {
+      CSCMatrix<Scalar>* mat_block = static_cast<CSCMatrix<Scalar>*>(mat);
+      int ndof = mat_block->get_size();
+      if(this->get_size() != (unsigned int) num_stages * ndof)
+        throw Hermes::Exceptions::Exception("Incompatible matrix sizes in CSCMatrix<Scalar>::add_sparse_to_blocks()");
+      if(mat_block->is_symmetric_storage())
+        throw Hermes::Exceptions::Exception("The symmetric storage of the block is not supported in CSCMatrix<Scalar>::add_sparse_to_blocks()");
+
+      // Each column of this matrix is filled by one thread.
+      int size = this->size;
+      int num_missing = 0;
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) reduction(+:num_missing) if(this->nnz > PARALLEL_KERNEL_MIN_SIZE)
+      for (int col = 0; col < size; col++)
+      {
+        int stage_j = col / ndof;
+        int mat_col = col % ndof;
+        for (int stage_i = 0; stage_i < num_stages; stage_i++)
+        {
+          Scalar coefficient = coefficients[stage_i][stage_j];
+          if(coefficient == Scalar(0))
+            continue;
+          for (int n = mat_block->Ap[mat_col]; n < mat_block->Ap[mat_col + 1]; n++)
+          {
+            int row = mat_block->Ai[n] + stage_i * ndof;
+            // The lower triangle of the symmetric storage is ignored.
+            if(this->symmetric_storage && row > col)
+              continue;
+            int pos = find_position(Ai + Ap[col], Ap[col + 1] - Ap[col], row);
+            if(pos < 0)
+              num_missing++;
+            else
+              Ax[Ap[col] + pos] += coefficient * mat_block->Ax[n];
+          }
+        }
+      }
+
+      if(num_missing > 0)
+        throw Hermes::Exceptions::Exception("%d nonzero matrix entries not found in CSCMatrix<Scalar>::add_sparse_to_blocks().", num_missing);
+    }
+
     template<typename Scalar>
     unsigned int CSCMatrix<Scalar>::get_nnz() const
     {
@@ -261,10 +483,57 @@ namespace Hermes
       }
     }
 
+    template<typename Scalar>
+    void CSCMatrix<Scalar>::add_sparse_matrix(SparseMatrix<Scalar>* mat)
+    {
+      add_matrix(static_cast<CSCMatrix<Scalar>*>(mat));
+    }
+
+    template<typename Scalar>
+    bool CSCMatrix<Scalar>::has_structure_of(CSCMatrix<Scalar>* mat) const
+    {
+      if(mat->size != this->size || mat->nnz != this->nnz || mat->symmetric_storage != this->symmetric_storage)
+        return false;
+      return (mat->Ap == this->Ap || !memcmp(mat->Ap, this->Ap, (this->size + 1) * sizeof(int)))
+        && (mat->Ai == this->Ai || !memcmp(mat->Ai, this->Ai, this->nnz * sizeof(int)));
+    }
+
+    template<typename Scalar>
+    void CSCMatrix<Scalar>::add_scaled_sparse_matrix(Scalar alpha, SparseMatrix<Scalar>* mat)
+    {
+      CSCMatrix<Scalar>* mat_csc = static_cast<CSCMatrix<Scalar>*>(mat);
+      if(!has_structure_of(mat_csc))
+      {
+        // A part of the structure: the entries are searched for.
+        Scalar* coefficients = &alpha;
+        add_sparse_to_blocks(1, mat, &coefficients);
+        return;
+      }
+
+      int n = this->nnz;
+      Scalar* mat_Ax = mat_csc->Ax;
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PARALLEL_KERNEL_MIN_SIZE)
+      for (int i = 0; i < n; i++)
+        this->Ax[i] += alpha * mat_Ax[i];
+    }
+
     template<typename Scalar>
     void CSCMatrix<Scalar>::add_matrix(CSCMatrix<Scalar>* mat)
     {
       assert(this->get_size() == mat->get_size());
+
+      // The same structure (e.g. of a duplicate, or a shared pattern): just the arrays of values.
+      if(has_structure_of(mat))
+      {
+        int n = this->nnz;
+        int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PARALLEL_KERNEL_MIN_SIZE)
+        for (int i = 0; i < n; i++)
+          this->Ax[i] += mat->Ax[i];
+        return;
+      }
+
       // Create iterators for both matrices.
       UMFPackIterator<Scalar> mat_it(mat);
       UMFPackIterator<Scalar> this_it(this);
@@ -315,7 +584,8 @@ namespace Hermes
       for (unsigned int i = 0; i < m; i++)       // rows
         for (unsigned int j = 0; j < n; j++)     // cols
           if(rows[i] >= 0 && cols[j] >= 0) // not Dir. dofs.
-            add(rows[i], cols[j], mat[i][j]);
+            if(!this->symmetric_storage || rows[i] <= cols[j])
+              add(rows[i], cols[j], mat[i][j]);
     }
 
     double inline real(double x)
@@ -338,6 +608,78 @@ namespace Hermes
       return x.imag();;
     }
 
+    /// Version 2 of the binary matrix format stores also the symmetric storage flag, version 1 files are read as full matrices.
+    static const char* CSC_MATRIX_BIN_HEADER = "HERMESX\002";
+    static const char* CSC_MATRIX_BIN_HEADER_V1 = "HERMESX\001";
+    static const char* VECTOR_BIN_HEADER = "HERMESR\001";
+
+    template<typename Scalar>
+    void CSCMatrix<Scalar>::dump_hermes_bin(FILE *file)
+    {
+      this->hermes_fwrite(CSC_MATRIX_BIN_HEADER, 1, 8, file);
+      int ssize = sizeof(Scalar);
+      this->hermes_fwrite(&ssize, sizeof(int), 1, file);
+      this->hermes_fwrite(&this->size, sizeof(int), 1, file);
+      this->hermes_fwrite(&nnz, sizeof(int), 1, file);
+      int symmetric = this->symmetric_storage ? 1 : 0;
+      this->hermes_fwrite(&symmetric, sizeof(int), 1, file);
+      this->hermes_fwrite(Ap, sizeof(int), this->size + 1, file);
+      this->hermes_fwrite(Ai, sizeof(int), nnz, file);
+      this->hermes_fwrite(Ax, sizeof(Scalar), nnz, file);
+    }
+
+    template<typename Scalar>
+    bool CSCMatrix<Scalar>::load(FILE *file, EMatrixDumpFormat fmt)
+    {
+      if(fmt != DF_HERMES_BIN)
+        return false;
+
+      char header[8];
+      this->hermes_fread(header, 1, 8, file);
+      bool version_1 = (memcmp(header, CSC_MATRIX_BIN_HEADER_V1, 8) == 0);
+      if(!version_1 && memcmp(header, CSC_MATRIX_BIN_HEADER, 8) != 0)
+        throw Hermes::Exceptions::Exception("CSCMatrix::load(): not a Hermes binary matrix file.");
+
+      int ssize, new_size, new_nnz, symmetric = 0;
+      this->hermes_fread(&ssize, sizeof(int), 1, file);
+      if(ssize != sizeof(Scalar))
+        throw Hermes::Exceptions::Exception("CSCMatrix::load(): the file holds entries of size %i, the matrix entries are of size %i.", ssize, (int)sizeof(Scalar));
+      this->hermes_fread(&new_size, sizeof(int), 1, file);
+      this->hermes_fread(&new_nnz, sizeof(int), 1, file);
+      if(!version_1)
+        this->hermes_fread(&symmetric, sizeof(int), 1, file);
+      if(new_size < 0 || new_nnz < 0)
+        throw Hermes::Exceptions::Exception("CSCMatrix::load(): corrupted file.");
+
+      int* ap = new int[new_size + 1];
+      int* ai = new int[new_nnz];
+      Scalar* ax = new Scalar[new_nnz];
+      try
+      {
+        this->hermes_fread(ap, sizeof(int), new_size + 1, file);
+        this->hermes_fread(ai, sizeof(int), new_nnz, file);
+        this->hermes_fread(ax, sizeof(Scalar), new_nnz, file);
+      }
+      catch(Hermes::Exceptions::Exception&)
+      {
+        delete [] ap;
+        delete [] ai;
+        delete [] ax;
+        throw;
+      }
+      if(ap[new_size] != new_nnz)
+      {
+        delete [] ap;
+        delete [] ai;
+        delete [] ax;
+        throw Hermes::Exceptions::Exception("CSCMatrix::load(): corrupted file.");
+      }
+
+      adopt(new_size, new_nnz, ap, ai, ax);
+      this->symmetric_storage = (symmetric != 0);
+      return true;
+    }
+
     template<>
     bool CSCMatrix<double>::dump(FILE *file, const char *var_name, EMatrixDumpFormat fmt, char* number_format)
     {
@@ -381,17 +723,8 @@ namespace Hermes
         }
 
       case DF_HERMES_BIN:
-        {
-          hermes_fwrite("HERMESX\001", 1, 8, file);
-          int ssize = sizeof(double);
-          hermes_fwrite(&ssize, sizeof(int), 1, file);
-          hermes_fwrite(&this->size, sizeof(int), 1, file);
-          hermes_fwrite(&nnz, sizeof(int), 1, file);
-          hermes_fwrite(Ap, sizeof(int), this->size + 1, file);
-          hermes_fwrite(Ai, sizeof(int), nnz, file);
-          hermes_fwrite(Ax, sizeof(double), nnz, file);
-          return true;
-        }
+        dump_hermes_bin(file);
+        return true;
 
       case DF_PLAIN_ASCII:
         exit(1);
@@ -486,17 +819,8 @@ namespace Hermes
         }
 
       case DF_HERMES_BIN:
-        {
-          hermes_fwrite("HERMESX\001", 1, 8, file);
-          int ssize = sizeof(std::complex<double>);
-          hermes_fwrite(&ssize, sizeof(int), 1, file);
-          hermes_fwrite(&this->size, sizeof(int), 1, file);
-          hermes_fwrite(&nnz, sizeof(int), 1, file);
-          hermes_fwrite(Ap, sizeof(int), this->size + 1, file);
-          hermes_fwrite(Ai, sizeof(int), nnz, file);
-          hermes_fwrite(Ax, sizeof(std::complex<double>), nnz, file);
-          return true;
-        }
+        dump_hermes_bin(file);
+        return true;
 
       case DF_PLAIN_ASCII:
         exit(1);
@@ -563,6 +887,8 @@ namespace Hermes
     template<typename Scalar>
     void CSCMatrix<Scalar>::create(unsigned int size, unsigned int nnz, int* ap, int* ai, Scalar* ax)
     {
+      free_row_index();
+      release_pattern();
       this->nnz = nnz;
       this->size = size;
       this->Ap = new int[this->size + 1]; assert(this->Ap != NULL);
@@ -576,10 +902,45 @@ namespace Hermes
       }
     }
 
+    template<typename Scalar>
+    void CSCMatrix<Scalar>::adopt(unsigned int size, unsigned int nnz, int* ap, int* ai, Scalar* ax)
+    {
+      free();
+      this->nnz = nnz;
+      this->size = size;
+      this->Ap = ap;
+      this->Ai = ai;
+      this->Ax = ax;
+    }
+
+    template<typename Scalar>
+    void CSCMatrix<Scalar>::release(int*& ap, int*& ai, Scalar*& ax)
+    {
+      // The shared pattern stays with the other matrices, the caller gets a copy.
+      if(this->pattern != NULL)
+      {
+        int* own_ap = new int[this->size + 1];
+        memcpy(own_ap, this->Ap, (this->size + 1) * sizeof(int));
+        int* own_ai = new int[std::max((int)this->nnz, 1)];
+        memcpy(own_ai, this->Ai, this->nnz * sizeof(int));
+        release_pattern();
+        this->Ap = own_ap;
+        this->Ai = own_ai;
+      }
+      ap = this->Ap;
+      ai = this->Ai;
+      ax = this->Ax;
+      this->Ap = NULL;
+      this->Ai = NULL;
+      this->Ax = NULL;
+      free();
+    }
+
     template<typename Scalar>
     CSCMatrix<Scalar>* CSCMatrix<Scalar>::duplicate()
     {
       CSCMatrix<Scalar>* new_matrix = new CSCMatrix<Scalar>();
+      new_matrix->symmetric_storage = this->symmetric_storage;
       new_matrix->create(this->get_size(), this->get_nnz(), this->get_Ap(),  this->get_Ai(),  this->get_Ax());
       return new_matrix;
     }
@@ -635,13 +996,16 @@ namespace Hermes
     template<typename Scalar>
     void UMFPackVector<Scalar>::zero()
     {
-      memset(v, 0, this->size * sizeof(Scalar));
+      Hermes::Algebra::first_touch_zero(v, this->size * sizeof(Scalar));
     }
 
     template<typename Scalar>
     void UMFPackVector<Scalar>::change_sign()
     {
-      for (unsigned int i = 0; i < this->size; i++) v[i] *= -1.;
+      int n = this->size;
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PARALLEL_KERNEL_MIN_SIZE)
+      for (int i = 0; i < n; i++) v[i] *= -1.;
     }
 
     template<typename Scalar>
@@ -695,13 +1059,20 @@ namespace Hermes
     void UMFPackVector<Scalar>::add_vector(Vector<Scalar>* vec)
     {
       assert(this->length() == vec->length());
-      for (unsigned int i = 0; i < this->length(); i++) this->v[i] += vec->get(i);
+      UMFPackVector<Scalar>* umfpack_vec = dynamic_cast<UMFPackVector<Scalar>*>(vec);
+      if(umfpack_vec != NULL)
+        add_vector(umfpack_vec->v);
+      else
+        for (unsigned int i = 0; i < this->length(); i++) this->v[i] += vec->get(i);
     }
 
     template<typename Scalar>
     void UMFPackVector<Scalar>::add_vector(Scalar* vec)
     {
-      for (unsigned int i = 0; i < this->length(); i++) this->v[i] += vec[i];
+      int n = this->length();
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(static) if(n > PARALLEL_KERNEL_MIN_SIZE)
+      for (int i = 0; i < n; i++) this->v[i] += vec[i];
     }
 
     template<typename Scalar>
@@ -710,6 +1081,33 @@ namespace Hermes
       return this->v;
     }
 
+    template<typename Scalar>
+    bool UMFPackVector<Scalar>::load(FILE *file, EMatrixDumpFormat fmt)
+    {
+      if(fmt != DF_HERMES_BIN)
+        return false;
+
+      char header[8];
+      this->hermes_fread(header, 1, 8, file);
+      if(memcmp(header, VECTOR_BIN_HEADER, 8) != 0)
+        throw Hermes::Exceptions::Exception("UMFPackVector::load(): not a Hermes binary vector file.");
+
+      int ssize, new_size;
+      this->hermes_fread(&ssize, sizeof(int), 1, file);
+      if(ssize != sizeof(Scalar))
+        throw Hermes::Exceptions::Exception("UMFPackVector::load(): the file holds entries of size %i, the vector entries are of size %i.", ssize, (int)sizeof(Scalar));
+      this->hermes_fread(&new_size, sizeof(int), 1, file);
+      if(new_size < 0)
+        throw Hermes::Exceptions::Exception("UMFPackVector::load(): corrupted file.");
+
+      // Not alloc(), the values are not zeroed first.
+      free();
+      this->size = new_size;
+      v = new Scalar[new_size];
+      this->hermes_fread(v, sizeof(Scalar), new_size, file);
+      return true;
+    }
+
     template<>
     bool UMFPackVector<double>::dump(FILE *file, const char *var_name, EMatrixDumpFormat fmt, char* number_format)
     {
@@ -727,11 +1125,11 @@ namespace Hermes
 
       case DF_HERMES_BIN:
         {
-          hermes_fwrite("HERMESR\001", 1, 8, file);
+          this->hermes_fwrite(VECTOR_BIN_HEADER, 1, 8, file);
           int ssize = sizeof(double);
-          hermes_fwrite(&ssize, sizeof(int), 1, file);
-          hermes_fwrite(&this->size, sizeof(int), 1, file);
-          hermes_fwrite(v, sizeof(double), this->size, file);
+          this->hermes_fwrite(&ssize, sizeof(int), 1, file);
+          this->hermes_fwrite(&this->size, sizeof(int), 1, file);
+          this->hermes_fwrite(v, sizeof(double), this->size, file);
           return true;
         }
 
@@ -769,11 +1167,11 @@ namespace Hermes
 
       case DF_HERMES_BIN:
         {
-          hermes_fwrite("HERMESR\001", 1, 8, file);
+          this->hermes_fwrite(VECTOR_BIN_HEADER, 1, 8, file);
           int ssize = sizeof(std::complex<double>);
-          hermes_fwrite(&ssize, sizeof(int), 1, file);
-          hermes_fwrite(&this->size, sizeof(int), 1, file);
-          hermes_fwrite(v, sizeof(std::complex<double>), this->size, file);
+          this->hermes_fwrite(&ssize, sizeof(int), 1, file);
+          this->hermes_fwrite(&this->size, sizeof(int), 1, file);
+          this->hermes_fwrite(v, sizeof(std::complex<double>), this->size, file);
           return true;
         }
 
@@ -867,13 +1265,20 @@ namespace Hermes
     template<>
     bool UMFPackLinearMatrixSolver<double>::setup_factorization()
     {
+      Hermes::ProfilerRegion profiler_region("UMFPackLinearMatrixSolver::setup_factorization");
       // Perform both factorization phases for the first time.
       int eff_fact_scheme;
       if(factorization_scheme != HERMES_FACTORIZE_FROM_SCRATCH && symbolic == NULL && numeric == NULL)
         eff_fact_scheme = HERMES_FACTORIZE_FROM_SCRATCH;
+      // The numeric factorization was dropped by analyze_structure() for a new pattern.
+      else if(factorization_scheme == HERMES_REUSE_FACTORIZATION_COMPLETELY && numeric == NULL)
+        eff_fact_scheme = HERMES_REUSE_MATRIX_REORDERING;
       else
         eff_fact_scheme = factorization_scheme;
 
+      // Keep the symbolic analysis for an unchanged pattern.
+      eff_fact_scheme = this->check_structure(eff_fact_scheme, symbolic != NULL, m->get_size(), m->get_nnz(), m->get_Ap(), m->get_Ai());
+
       int status;
       switch(eff_fact_scheme)
       {
@@ -929,13 +1334,20 @@ namespace Hermes
     template<>
     bool UMFPackLinearMatrixSolver<std::complex<double> >::setup_factorization()
     {
+      Hermes::ProfilerRegion profiler_region("UMFPackLinearMatrixSolver::setup_factorization");
       // Perform both factorization phases for the first time.
       int eff_fact_scheme;
       if(factorization_scheme != HERMES_FACTORIZE_FROM_SCRATCH && symbolic == NULL && numeric == NULL)
         eff_fact_scheme = HERMES_FACTORIZE_FROM_SCRATCH;
+      // The numeric factorization was dropped by analyze_structure() for a new pattern.
+      else if(factorization_scheme == HERMES_REUSE_FACTORIZATION_COMPLETELY && numeric == NULL)
+        eff_fact_scheme = HERMES_REUSE_MATRIX_REORDERING;
       else
         eff_fact_scheme = factorization_scheme;
 
+      // Keep the symbolic analysis for an unchanged pattern.
+      eff_fact_scheme = this->check_structure(eff_fact_scheme, symbolic != NULL, m->get_size(), m->get_nnz(), m->get_Ap(), m->get_Ai());
+
       int status;
       switch(eff_fact_scheme)
       {
@@ -970,6 +1382,58 @@ namespace Hermes
       return true;
     }
 
+    template<>
+    bool UMFPackLinearMatrixSolver<double>::analyze_structure()
+    {
+      Hermes::ProfilerRegion profiler_region("UMFPackLinearMatrixSolver::analyze_structure");
+      unsigned long long hash = this->get_structure_hash(m->get_size(), m->get_nnz(), m->get_Ap(), m->get_Ai());
+      if(symbolic != NULL && hash == this->structure_hash)
+        return true;
+
+      if(numeric != NULL)
+        umfpack_di_free_numeric(&numeric);
+      numeric = NULL;
+      if(symbolic != NULL)
+        umfpack_di_free_symbolic(&symbolic);
+      symbolic = NULL;
+
+      int status = umfpack_di_symbolic(m->get_size(), m->get_size(), m->get_Ap(), m->get_Ai(), NULL, &symbolic, NULL, NULL);
+      if(status != UMFPACK_OK || symbolic == NULL)
+      {
+        check_status("umfpack_di_symbolic", status);
+        symbolic = NULL;
+        return false;
+      }
+      this->structure_hash = hash;
+      return true;
+    }
+
+    template<>
+    bool UMFPackLinearMatrixSolver<std::complex<double> >::analyze_structure()
+    {
+      Hermes::ProfilerRegion profiler_region("UMFPackLinearMatrixSolver::analyze_structure");
+      unsigned long long hash = this->get_structure_hash(m->get_size(), m->get_nnz(), m->get_Ap(), m->get_Ai());
+      if(symbolic != NULL && hash == this->structure_hash)
+        return true;
+
+      if(numeric != NULL)
+        umfpack_zi_free_numeric(&numeric);
+      numeric = NULL;
+      if(symbolic != NULL)
+        umfpack_zi_free_symbolic(&symbolic);
+      symbolic = NULL;
+
+      int status = umfpack_zi_symbolic(m->get_size(), m->get_size(), m->get_Ap(), m->get_Ai(), NULL, NULL, &symbolic, NULL, NULL);
+      if(status != UMFPACK_OK || symbolic == NULL)
+      {
+        check_status("umfpack_zi_symbolic", status);
+        symbolic = NULL;
+        return false;
+      }
+      this->structure_hash = hash;
+      return true;
+    }
+
     template<>
     void UMFPackLinearMatrixSolver<double>::free_factorization_data()
     {
@@ -988,23 +1452,45 @@ namespace Hermes
       numeric = NULL;
     }
 
-    template<>
-    bool UMFPackLinearMatrixSolver<double>::solve()
+    template<typename Scalar>
+    bool UMFPackLinearMatrixSolver<Scalar>::solve()
     {
-      assert(m != NULL);
+      Hermes::ProfilerRegion profiler_region("UMFPackLinearMatrixSolver::solve");
       assert(rhs != NULL);
       assert(m->get_size() == rhs->length());
 
+      return solve(1, rhs->get_c_array());
+    }
+
+    template<>
+    bool UMFPackLinearMatrixSolver<double>::solve(int num_rhs, double* rhs_block)
+    {
+      assert(m != NULL);
+
       this->tick();
 
       if( !setup_factorization() )
         throw Exceptions::LinearMatrixSolverException("LU factorization could not be completed.");
 
+      int size = m->get_size();
       if(sln != NULL)
         delete [] sln;
-      sln = new double[m->get_size()];
-      memset(sln, 0, m->get_size() * sizeof(double));
-      int status = umfpack_di_solve(UMFPACK_A, m->get_Ap(), m->get_Ai(), m->get_Ax(), sln, rhs->get_c_array(), numeric, NULL, NULL);
+      sln = new double[size * num_rhs];
+      memset(sln, 0, size * num_rhs * sizeof(double));
+
+      // The numeric factorization is only read by umfpack_di_solve(), the right hand sides can be solved in parallel.
+      int status = UMFPACK_OK;
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(dynamic, 1) if(num_rhs > 1)
+      for (int rhs_i = 0; rhs_i < num_rhs; rhs_i++)
+      {
+        int rhs_status = umfpack_di_solve(UMFPACK_A, m->get_Ap(), m->get_Ai(), m->get_Ax(), sln + rhs_i * size, rhs_block + rhs_i * size, numeric, NULL, NULL);
+        if(rhs_status != UMFPACK_OK)
+        {
+#pragma omp critical (UMFPackLinearMatrixSolver_status)
+          status = rhs_status;
+        }
+      }
       if(status != UMFPACK_OK)
       {
         check_status("umfpack_di_solve", status);
@@ -1018,11 +1504,9 @@ namespace Hermes
     }
 
     template<>
-    bool UMFPackLinearMatrixSolver<std::complex<double> >::solve()
+    bool UMFPackLinearMatrixSolver<std::complex<double> >::solve(int num_rhs, std::complex<double>* rhs_block)
     {
       assert(m != NULL);
-      assert(rhs != NULL);
-      assert(m->get_size() == rhs->length());
 
       this->tick();
       if( !setup_factorization() )
@@ -1031,14 +1515,28 @@ namespace Hermes
         return false;
       }
 
+      int size = m->get_size();
       if(sln)
         delete [] sln;
-      sln = new std::complex<double>[m->get_size()];
-      memset(sln, 0, m->get_size() * sizeof(std::complex<double>));
-      int status = umfpack_zi_solve(UMFPACK_A, m->get_Ap(), m->get_Ai(), (double *)m->get_Ax(), NULL, (double*) sln, NULL, (double *)rhs->get_c_array(), NULL, numeric, NULL, NULL);
+      sln = new std::complex<double>[size * num_rhs];
+      memset(sln, 0, size * num_rhs * sizeof(std::complex<double>));
+
+      // The numeric factorization is only read by umfpack_zi_solve(), the right hand sides can be solved in parallel.
+      int status = UMFPACK_OK;
+      int num_threads_used = Hermes::HermesCommonApi.get_integral_param_value(Hermes::numThreadsAlgebra);
+#pragma omp parallel for num_threads(num_threads_used) schedule(dynamic, 1) if(num_rhs > 1)
+      for (int rhs_i = 0; rhs_i < num_rhs; rhs_i++)
+      {
+        int rhs_status = umfpack_zi_solve(UMFPACK_A, m->get_Ap(), m->get_Ai(), (double *)m->get_Ax(), NULL, (double*) (sln + rhs_i * size), NULL, (double *) (rhs_block + rhs_i * size), NULL, numeric, NULL, NULL);
+        if(rhs_status != UMFPACK_OK)
+        {
+#pragma omp critical (UMFPackLinearMatrixSolver_status)
+          status = rhs_status;
+        }
+      }
       if(status != UMFPACK_OK)
       {
-        check_status("umfpack_di_solve", status);
+        check_status("umfpack_zi_solve", status);
         return false;
       }
 